@@ -14,11 +14,18 @@
 
 #include <sys/time.h>
 
+#include <algorithm>
+#include <chrono>  // NOLINT(build/c++11)
+#include <cmath>
 #include <cstdlib>
 #include <fstream>
+#include <map>
 #include <memory>
 #include <numeric>
+#include <sstream>
+#include <string>
 #include <thread>  // NOLINT(build/c++11)
+#include <vector>
 
 #include "gflags/gflags.h"
 #include "mace/public/mace.h"
@@ -90,6 +97,8 @@ DeviceType ParseDeviceType(const std::string &device_str) {
   }
 }
 
+DECLARE_string(trace_file);
+
 bool RunInference(MaceEngine *engine,
                   const std::map<std::string, mace::MaceTensor> &input_infos,
                   std::map<std::string, mace::MaceTensor> *output_infos,
@@ -114,6 +123,11 @@ bool RunInference(MaceEngine *engine,
 
   if (statistician != nullptr) {
     statistician->StatMetadata(run_metadata);
+    if (!FLAGS_trace_file.empty()) {
+      // the trace of the last run is kept
+      std::ofstream trace_file(FLAGS_trace_file);
+      trace_file << ChromeTrace(run_metadata);
+    }
   }
 
   return true;
@@ -160,6 +174,58 @@ bool Run(const std::string &title,
   return true;
 }
 
+// Run with statistics until the 95% confidence interval of the mean run
+// time is within target_ci of it. The runs during which the CPU is
+// throttled are not counted, the CPU is left to cool down instead.
+bool RunUntilConfident(MaceEngine *engine,
+                       const std::map<std::string, mace::MaceTensor> &inputs,
+                       std::map<std::string, mace::MaceTensor> *outputs,
+                       int min_runs,
+                       int max_runs,
+                       double max_time_sec,
+                       double target_ci,
+                       LatencySummary *run_summary,
+                       OpStat *statistician) {
+  CPUFreqMonitor freq_monitor;
+  TimeInfo<int64_t> time_info;
+  int64_t total_time_us = 0;
+  int throttled_runs = 0;
+  for (int i = 0; max_runs <= 0 || i < max_runs; ++i) {
+    if (freq_monitor.IsThrottled()) {
+      LOG(WARNING) << "CPU is throttled, freqs(MHz): "
+                   << freq_monitor.CurrentFreqs() << ", cool down";
+      ++throttled_runs;
+      std::this_thread::sleep_for(std::chrono::seconds(1));
+      total_time_us += 1000000;
+    } else {
+      int64_t inference_time_us = 0;
+      if (!RunInference(engine, inputs, outputs, &inference_time_us,
+                        statistician)) {
+        LOG(INFO) << "Failed on run " << i;
+        return false;
+      }
+      time_info.UpdateTime(inference_time_us);
+      total_time_us += inference_time_us;
+    }
+    *run_summary = {"run", time_info.round(), time_info.avg(),
+                    time_info.std_deviation()};
+    if (time_info.round() >= min_runs &&
+        ConfidenceInterval(*run_summary) <= target_ci * run_summary->mean) {
+      break;
+    }
+    if (max_time_sec > 0 && total_time_us / 1000000.0 > max_time_sec) {
+      LOG(WARNING) << "Confidence interval is not within " << target_ci
+                   << " of the mean in " << max_time_sec << " seconds";
+      break;
+    }
+  }
+  LOG(INFO) << "Confident runs: " << time_info.round() << ", throttled: "
+            << throttled_runs << ", mean(ms): "
+            << FloatToString(run_summary->mean / 1000, 3) << " +- "
+            << FloatToString(ConfidenceInterval(*run_summary) / 1000, 3);
+  return time_info.round() > 0;
+}
+
 DEFINE_string(model_name, "", "model name in yaml");
 DEFINE_string(device, "CPU", "Device [CPU|GPU|DSP]");
 DEFINE_string(input_node, "input_node0,input_node1",
@@ -184,9 +250,381 @@ DEFINE_string(model_file, "",
               "model file name, used when load mace model in pb");
 DEFINE_int32(gpu_perf_hint, 3, "0:DEFAULT/1:LOW/2:NORMAL/3:HIGH");
 DEFINE_int32(gpu_priority_hint, 3, "0:DEFAULT/1:LOW/2:NORMAL/3:HIGH");
+DEFINE_int32(dsp_perf_hint, 0,
+             "0:DEFAULT/1:BURST/2:SUSTAINED/3:POWER_SAVE");
 DEFINE_int32(omp_num_threads, -1, "num of openmp threads");
 DEFINE_int32(cpu_affinity_policy, 1,
              "0:AFFINITY_NONE/1:AFFINITY_BIG_ONLY/2:AFFINITY_LITTLE_ONLY");
+DEFINE_string(baseline_file, "",
+              "baseline json of a previous result_file to compare with, "
+              "the runs with statistics continue until target_ci is met");
+DEFINE_string(result_file, "", "write the latencies as a baseline json");
+DEFINE_double(target_ci, 0.01,
+              "relative half width of the 95% confidence interval of the "
+              "mean run time to stop at, with baseline_file or result_file");
+DEFINE_int32(min_runs, 10, "min number of runs to meet target_ci");
+DEFINE_double(regression_threshold, 0.05,
+              "min relative slowdown of a significant regression");
+DEFINE_bool(measure_init, false,
+            "measure the init of the engine instead of its runs");
+DEFINE_int32(init_runs, 10,
+             "number of inits to measure, the first one is cold");
+DEFINE_string(trace_file, "",
+              "write a chrome trace json of the last run with statistics, "
+              "with OpenCL kernels when MACE_OPENCL_PROFILING=1 and CPU "
+              "perf counters when MACE_CPU_PERF_COUNTERS=1");
+DEFINE_string(power_source, "",
+              "sample the power during the runs without statistics from "
+              "battery, a sysfs power supply dir or cmd:<command printing "
+              "watts>, empty to not sample");
+DEFINE_int32(power_interval_ms, 100, "interval of the power samples");
+DEFINE_double(power_idle_seconds, 3.0,
+              "seconds to sample the idle power before the runs, which is "
+              "subtracted from their power");
+DEFINE_bool(thread_sweep, false,
+            "run the model on CPU on 1 to omp_num_threads threads under each"
+            " cpu affinity policy and report the scaling of each op");
+DEFINE_double(sweep_tolerance, 0.05,
+              "the threads suggested for an op are the fewest within this"
+              " ratio of its best time");
+DEFINE_string(op_threads_file, "",
+              "the threads of the ops, an op name and its threads per line,"
+              " written by thread_sweep, used by the other runs");
+DEFINE_string(energy_file, "",
+              "append the energy of the runs as a csv line, to compare the "
+              "devices and policies of several invocations");
+
+MaceStatus CreateEngine(const MaceEngineConfig &config,
+                        const std::vector<unsigned char> &model_graph_data,
+                        const unsigned char *model_weights_data,
+                        size_t model_weights_data_size,
+                        const std::vector<std::string> &input_names,
+                        const std::vector<std::string> &output_names,
+                        std::shared_ptr<MaceEngine> *engine) {
+#ifdef MODEL_GRAPH_FORMAT_CODE
+  (void)(model_graph_data);
+  return CreateMaceEngineFromCode(FLAGS_model_name,
+                                  model_weights_data,
+                                  model_weights_data_size,
+                                  input_names,
+                                  output_names,
+                                  config,
+                                  engine);
+#else
+  return CreateMaceEngineFromProto(model_graph_data.data(),
+                                   model_graph_data.size(),
+                                   model_weights_data,
+                                   model_weights_data_size,
+                                   input_names,
+                                   output_names,
+                                   config,
+                                   engine);
+#endif
+}
+
+// Create the engine init_runs times and run it once. The first init is
+// cold: the runtime is loaded and the OpenCL programs are compiled unless
+// they are cached, the next ones are warm. The first run is reported, as
+// it builds the kernels and allocates the buffers the init left.
+bool MeasureInit(int init_runs,
+                 const MaceEngineConfig &config,
+                 const std::vector<unsigned char> &model_graph_data,
+                 const unsigned char *model_weights_data,
+                 size_t model_weights_data_size,
+                 const std::vector<std::string> &input_names,
+                 const std::vector<std::string> &output_names,
+                 const std::map<std::string, mace::MaceTensor> &inputs,
+                 std::map<std::string, mace::MaceTensor> *outputs) {
+  // the times of each metric, in order of the first init
+  std::vector<std::string> metric_names;
+  std::map<std::string, std::vector<double>> metrics;
+  auto add_metric = [&](const std::string &name, double value) {
+    if (metrics.count(name) == 0) {
+      metric_names.push_back(name);
+    }
+    metrics[name].push_back(value);
+  };
+  const bool rss_reset = ResetPeakRSS();
+  if (!rss_reset) {
+    LOG(WARNING) << "Peak RSS could not be reset, it is of the process";
+  }
+  for (int i = 0; i < init_runs; ++i) {
+    ResetPeakRSS();
+    std::shared_ptr<MaceEngine> engine;
+    const int64_t start_micros = NowMicros();
+    MaceStatus status = CreateEngine(config, model_graph_data,
+                                     model_weights_data,
+                                     model_weights_data_size, input_names,
+                                     output_names, &engine);
+    const int64_t create_micros = NowMicros() - start_micros;
+    if (status != MaceStatus::MACE_SUCCESS) {
+      LOG(ERROR) << "Create engine error: " << status.information();
+      return false;
+    }
+    const int64_t run_start_micros = NowMicros();
+    status = engine->Run(inputs, outputs);
+    const int64_t first_run_micros = NowMicros() - run_start_micros;
+    if (status != MaceStatus::MACE_SUCCESS) {
+      LOG(ERROR) << "First run error: " << status.information();
+      return false;
+    }
+    InitStats init_stats;
+    engine->GetInitStats(&init_stats);
+    add_metric("create engine(ms)", create_micros / 1000.0);
+    add_metric("  init(ms)", init_stats.total_micros / 1000.0);
+    for (auto &phase : init_stats.phases) {
+      add_metric("    " + phase.name + "(ms)", phase.micros / 1000.0);
+    }
+    add_metric("first run(ms)", first_run_micros / 1000.0);
+    add_metric("opencl build(ms)", init_stats.opencl_build_micros / 1000.0);
+    add_metric("peak RSS(MB)", PeakRSSKB() / 1024.0);
+  }
+
+  const std::vector<std::string> header = {
+      "metric", "cold", "warm p50", "warm p90", "warm max"};
+  std::vector<std::vector<std::string>> data;
+  for (auto &name : metric_names) {
+    std::vector<double> &values = metrics[name];
+    std::vector<std::string> row = {name, FloatToString(values[0], 3)};
+    std::vector<double> warm(values.begin() + 1, values.end());
+    std::sort(warm.begin(), warm.end());
+    for (double percentile : {0.5, 0.9, 1.0}) {
+      if (warm.empty()) {
+        row.push_back("-");
+      } else {
+        const size_t index = std::min(
+            warm.size() - 1,
+            static_cast<size_t>(std::ceil(percentile * warm.size())) - 1);
+        row.push_back(FloatToString(warm[index], 3));
+      }
+    }
+    data.push_back(row);
+  }
+  std::stringstream stream(mace::string_util::StringFormatter::Table(
+      "Init of " + std::to_string(init_runs) + " engines", header, data));
+  for (std::string line; std::getline(stream, line);) {
+    LOG(INFO) << line;
+  }
+  return true;
+}
+
+// Report the inferences per joule of the runs, from their mean power above
+// the idle one.
+void ReportEnergy(int64_t num_runs,
+                  int64_t wall_time_us,
+                  double run_watts,
+                  double idle_watts,
+                  int64_t num_samples) {
+  const double joules =
+      std::max(run_watts - idle_watts, 0.0) * wall_time_us * 1e-6;
+  const double inferences_per_joule = joules > 0 ? num_runs / joules : 0;
+  const double millijoules = num_runs > 0 ? joules * 1000 / num_runs : 0;
+  const std::vector<std::string> header = {
+      "device", "cpu affinity", "gpu perf hint", "threads", "runs",
+      "samples", "power(W)", "idle(W)", "mJ/inference", "inferences/J"};
+  const std::vector<std::string> row = {
+      FLAGS_device, IntToString(FLAGS_cpu_affinity_policy),
+      IntToString(FLAGS_gpu_perf_hint), IntToString(FLAGS_omp_num_threads),
+      IntToString(num_runs), IntToString(num_samples),
+      FloatToString(run_watts, 3), FloatToString(idle_watts, 3),
+      FloatToString(millijoules, 3), FloatToString(inferences_per_joule, 3)};
+  std::stringstream stream(mace::string_util::StringFormatter::Table(
+      "Energy", header, {row}));
+  for (std::string line; std::getline(stream, line);) {
+    LOG(INFO) << line;
+  }
+  if (FLAGS_energy_file.empty()) {
+    return;
+  }
+  const bool write_header = !std::ifstream(FLAGS_energy_file).good();
+  std::ofstream energy_file(FLAGS_energy_file, std::ios::app);
+  if (write_header) {
+    energy_file << "model,device,cpu_affinity_policy,gpu_perf_hint,"
+                   "omp_num_threads,runs,power_w,idle_w,mj_per_inference,"
+                   "inferences_per_j\n";
+  }
+  energy_file << FLAGS_model_name << "," << FLAGS_device << ","
+              << FLAGS_cpu_affinity_policy << "," << FLAGS_gpu_perf_hint
+              << "," << FLAGS_omp_num_threads << "," << num_runs << ","
+              << run_watts << "," << idle_watts << "," << millijoules << ","
+              << inferences_per_joule << "\n";
+}
+
+// The threads an op is run on, one "name threads" per line.
+bool ReadOpThreads(const std::string &path,
+                   std::map<std::string, int> *op_threads) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    return false;
+  }
+  for (std::string line; std::getline(file, line);) {
+    std::istringstream stream(line);
+    std::string name;
+    int threads = 0;
+    if (stream >> name >> threads && threads > 0) {
+      (*op_threads)[name] = threads;
+    }
+  }
+  return true;
+}
+
+// The mean time of each op, and of the whole run as "total", of an engine on
+// CPU with the threads and the policy, empty if it can not be run so. The
+// ops of op_names are forced onto the threads, not the ones they are
+// estimated to be worth; on 1 thread all of them run on it anyway.
+std::vector<LatencySummary> SweepRun(
+    int threads,
+    CPUAffinityPolicy policy,
+    const std::vector<std::string> &op_names,
+    const std::vector<unsigned char> &model_graph_data,
+    const unsigned char *model_weights_data,
+    size_t model_weights_data_size,
+    const std::vector<std::string> &input_names,
+    const std::vector<std::string> &output_names,
+    const std::map<std::string, mace::MaceTensor> &inputs,
+    std::map<std::string, mace::MaceTensor> *outputs) {
+  MaceEngineConfig config(DeviceType::CPU);
+  if (config.SetCPUThreadPolicy(threads, policy, true) !=
+      MaceStatus::MACE_SUCCESS) {
+    return {};
+  }
+  std::map<std::string, int> op_threads;
+  for (auto &name : op_names) {
+    op_threads[name] = threads;
+  }
+  config.SetCPUOpThreads(op_threads);
+  std::shared_ptr<MaceEngine> engine;
+  if (CreateEngine(config, model_graph_data, model_weights_data,
+                   model_weights_data_size, input_names, output_names,
+                   &engine) != MaceStatus::MACE_SUCCESS) {
+    LOG(ERROR) << "Create engine error of " << threads << " threads";
+    return {};
+  }
+  const std::string title = "Policy " + IntToString(policy) + ", " +
+      IntToString(threads) + " threads";
+  int64_t total_time_us = 0;
+  int64_t num_runs = 0;
+  if (FLAGS_warmup_runs > 0 &&
+      !Run(title + " warm up", engine.get(), inputs, outputs,
+           FLAGS_warmup_runs, -1.0, &total_time_us, &num_runs, nullptr)) {
+    return {};
+  }
+  OpStat statistician;
+  if (!Run(title, engine.get(), inputs, outputs, FLAGS_max_num_runs,
+           FLAGS_max_seconds, &total_time_us, &num_runs, &statistician)) {
+    return {};
+  }
+  return statistician.Summaries();
+}
+
+// Run the model on 1 to max_threads threads under each affinity policy and
+// report the speedup of each op over 1 thread, its parallel efficiency on
+// all the threads, and the ops which stop scaling before. The fewest threads
+// within sweep_tolerance of the best time of each op under the policy of
+// cpu_affinity_policy are written to op_threads_file, which the runs read
+// into MaceEngineConfig::SetCPUOpThreads.
+bool ThreadSweep(int max_threads,
+                 const std::vector<unsigned char> &model_graph_data,
+                 const unsigned char *model_weights_data,
+                 size_t model_weights_data_size,
+                 const std::vector<std::string> &input_names,
+                 const std::vector<std::string> &output_names,
+                 const std::map<std::string, mace::MaceTensor> &inputs,
+                 std::map<std::string, mace::MaceTensor> *outputs) {
+  std::map<std::string, int> suggested_threads;
+  bool swept = false;
+  for (int policy = AFFINITY_NONE; policy <= AFFINITY_POWER_SAVE; ++policy) {
+    // the mean micros of each op on 1 to max_threads threads, by run order
+    std::vector<std::string> names;
+    std::vector<std::string> op_names;
+    std::map<std::string, std::vector<double>> micros;
+    for (int threads = 1; threads <= max_threads; ++threads) {
+      const std::vector<LatencySummary> summaries = SweepRun(
+          threads, static_cast<CPUAffinityPolicy>(policy), op_names,
+          model_graph_data, model_weights_data, model_weights_data_size,
+          input_names, output_names, inputs, outputs);
+      if (summaries.empty()) {
+        break;
+      }
+      for (auto &summary : summaries) {
+        if (threads == 1) {
+          names.push_back(summary.name);
+          if (summary.name != "total") {
+            op_names.push_back(summary.name);
+          }
+        }
+        micros[summary.name].push_back(summary.mean);
+      }
+    }
+    if (names.empty()) {
+      LOG(WARNING) << "Policy " << policy << " is not swept, its cores can"
+                   << " not be detected";
+      continue;
+    }
+    swept = true;
+
+    std::vector<std::string> header = {"op", "1 thread(ms)"};
+    for (int threads = 2; threads <= max_threads; ++threads) {
+      header.push_back("x" + IntToString(threads));
+    }
+    header.insert(header.end(), {"efficiency", "best threads"});
+    std::vector<std::vector<std::string>> data;
+    std::vector<std::string> saturated;
+    for (auto &name : names) {
+      const std::vector<double> &times = micros[name];
+      if (times.size() != static_cast<size_t>(max_threads)) {
+        continue;
+      }
+      const double best_time = *std::min_element(times.begin(), times.end());
+      int best_threads = 1;
+      while (times[best_threads - 1] >
+             best_time * (1 + FLAGS_sweep_tolerance)) {
+        ++best_threads;
+      }
+      std::vector<std::string> row = {name, FloatToString(times[0] / 1000, 3)};
+      for (int threads = 2; threads <= max_threads; ++threads) {
+        row.push_back(FloatToString(
+            times[0] / std::max(times[threads - 1], 1e-3), 2));
+      }
+      row.push_back(FloatToString(
+          times[0] / std::max(times.back(), 1e-3) / max_threads, 2));
+      row.push_back(IntToString(best_threads));
+      data.push_back(row);
+      if (name == "total") {
+        continue;
+      }
+      if (best_threads < max_threads) {
+        saturated.push_back(name + "(" + IntToString(best_threads) + ")");
+      }
+      if (policy == FLAGS_cpu_affinity_policy) {
+        suggested_threads[name] = best_threads;
+      }
+    }
+    std::stringstream stream(mace::string_util::StringFormatter::Table(
+        "Thread scaling of policy " + IntToString(policy), header, data));
+    for (std::string line; std::getline(stream, line);) {
+      LOG(INFO) << line;
+    }
+    LOG(INFO) << saturated.size() << " ops stop scaling before "
+              << max_threads << " threads: "
+              << MakeString(saturated);
+  }
+
+  if (!FLAGS_op_threads_file.empty()) {
+    if (suggested_threads.empty()) {
+      LOG(WARNING) << "Policy " << FLAGS_cpu_affinity_policy
+                   << " is not swept, no op threads are written";
+    } else {
+      std::ofstream file(FLAGS_op_threads_file);
+      for (auto &op_thread : suggested_threads) {
+        file << op_thread.first << " " << op_thread.second << "\n";
+      }
+      LOG(INFO) << "Write the threads of " << suggested_threads.size()
+                << " ops to " << FLAGS_op_threads_file;
+    }
+  }
+  return swept;
+}
 
 int Main(int argc, char **argv) {
   MACE_CHECK(FLAGS_device != "HEXAGON",
@@ -201,6 +639,7 @@ int Main(int argc, char **argv) {
   LOG(INFO) << "Device: [" << FLAGS_device << "]";
   LOG(INFO) << "gpu_perf_hint: [" << FLAGS_gpu_perf_hint << "]";
   LOG(INFO) << "gpu_priority_hint: [" << FLAGS_gpu_priority_hint << "]";
+  LOG(INFO) << "dsp_perf_hint: [" << FLAGS_dsp_perf_hint << "]";
   LOG(INFO) << "omp_num_threads: [" << FLAGS_omp_num_threads << "]";
   LOG(INFO) << "cpu_affinity_policy: [" << FLAGS_cpu_affinity_policy << "]";
   LOG(INFO) << "Input node: [" << FLAGS_input_node<< "]";
@@ -268,11 +707,15 @@ int Main(int argc, char **argv) {
         static_cast<GPUPriorityHint>(FLAGS_gpu_priority_hint));
   }
 #endif  // MACE_ENABLE_OPENCL
+  config.SetDSPPerfHint(static_cast<DSPPerfHint>(FLAGS_dsp_perf_hint));
+  if (!FLAGS_op_threads_file.empty() && !FLAGS_thread_sweep) {
+    std::map<std::string, int> op_threads;
+    if (!ReadOpThreads(FLAGS_op_threads_file, &op_threads)) {
+      LOG(FATAL) << "Failed to read file: " << FLAGS_op_threads_file;
+    }
+    config.SetCPUOpThreads(op_threads);
+  }
 
-  // Create Engine
-  std::shared_ptr<mace::MaceEngine> engine;
-  MaceStatus create_engine_status;
-  // Create Engine
   std::vector<unsigned char> model_graph_data;
   if (FLAGS_model_file != "") {
     if (!mace::ReadBinaryFile(&model_graph_data, FLAGS_model_file)) {
@@ -289,30 +732,6 @@ int Main(int argc, char **argv) {
     MACE_CHECK(model_weights_data != nullptr && model_weights_data_size != 0);
   }
 
-#ifdef MODEL_GRAPH_FORMAT_CODE
-  create_engine_status =
-        CreateMaceEngineFromCode(FLAGS_model_name,
-                                 model_weights_data,
-                                 model_weights_data_size,
-                                 input_names,
-                                 output_names,
-                                 config,
-                                 &engine);
-#else
-  create_engine_status =
-      CreateMaceEngineFromProto(model_graph_data.data(),
-                                model_graph_data.size(),
-                                model_weights_data,
-                                model_weights_data_size,
-                                input_names,
-                                output_names,
-                                config,
-                                &engine);
-#endif
-  if (create_engine_status != MaceStatus::MACE_SUCCESS) {
-    LOG(FATAL) << "Create engine error, please check the arguments";
-  }
-
   std::map<std::string, mace::MaceTensor> inputs;
   std::map<std::string, mace::MaceTensor> outputs;
   for (size_t i = 0; i < input_count; ++i) {
@@ -347,6 +766,41 @@ int Main(int argc, char **argv) {
                                                 buffer_out);
   }
 
+  if (FLAGS_thread_sweep) {
+    MACE_CHECK(device_type == DeviceType::CPU,
+               "Thread sweep only supports CPU.");
+    const int max_threads = FLAGS_omp_num_threads > 0 ?
+        FLAGS_omp_num_threads :
+        std::max<int>(std::thread::hardware_concurrency(), 1);
+    bool swept = ThreadSweep(max_threads, model_graph_data,
+                             model_weights_data, model_weights_data_size,
+                             input_names, output_names, inputs, &outputs);
+    if (model_weights_data != nullptr) {
+      MemoryUnMap(model_weights_data, model_weights_data_size);
+    }
+    return swept ? 0 : -1;
+  }
+
+  if (FLAGS_measure_init) {
+    bool measured = MeasureInit(FLAGS_init_runs, config, model_graph_data,
+                                model_weights_data, model_weights_data_size,
+                                input_names, output_names, inputs, &outputs);
+    if (model_weights_data != nullptr) {
+      MemoryUnMap(model_weights_data, model_weights_data_size);
+    }
+    return measured ? 0 : -1;
+  }
+
+  // Create Engine
+  std::shared_ptr<mace::MaceEngine> engine;
+  MaceStatus create_engine_status =
+      CreateEngine(config, model_graph_data, model_weights_data,
+                   model_weights_data_size, input_names, output_names,
+                   &engine);
+  if (create_engine_status != MaceStatus::MACE_SUCCESS) {
+    LOG(FATAL) << "Create engine error, please check the arguments";
+  }
+
   int64_t warmup_time_us = 0;
   int64_t num_warmup_runs = 0;
   if (FLAGS_warmup_runs > 0) {
@@ -359,8 +813,29 @@ int Main(int argc, char **argv) {
     }
   }
 
+  std::unique_ptr<PowerMonitor> power_monitor;
+  double idle_watts = 0;
+  if (!FLAGS_power_source.empty()) {
+    power_monitor.reset(
+        new PowerMonitor(FLAGS_power_source, FLAGS_power_interval_ms));
+    std::string reason;
+    if (!power_monitor->Available(&reason)) {
+      LOG(ERROR) << "Power is not sampled: " << reason;
+      power_monitor.reset();
+    } else if (FLAGS_power_idle_seconds > 0) {
+      power_monitor->Start();
+      std::this_thread::sleep_for(std::chrono::milliseconds(
+          static_cast<int64_t>(FLAGS_power_idle_seconds * 1000)));
+      idle_watts = power_monitor->Stop(nullptr);
+    }
+  }
+
   int64_t no_stat_time_us = 0;
   int64_t no_stat_runs = 0;
+  const int64_t no_stat_start_us = NowMicros();
+  if (power_monitor != nullptr) {
+    power_monitor->Start();
+  }
   bool status =
       Run("Run without statistics", engine.get(), inputs, &outputs,
           FLAGS_max_num_runs, FLAGS_max_seconds,
@@ -368,6 +843,53 @@ int Main(int argc, char **argv) {
   if (!status) {
     LOG(ERROR) << "Failed at normal no-stat run";
   }
+  if (power_monitor != nullptr) {
+    int64_t num_samples = 0;
+    const double run_watts = power_monitor->Stop(&num_samples);
+    ReportEnergy(no_stat_runs, NowMicros() - no_stat_start_us, run_watts,
+                 idle_watts, num_samples);
+  }
+
+  if (!FLAGS_baseline_file.empty() || !FLAGS_result_file.empty()) {
+    // the op stats are kept apart from the run above
+    statistician.reset(new OpStat());
+    LatencySummary run_summary;
+    status = RunUntilConfident(engine.get(), inputs, &outputs,
+                               FLAGS_min_runs, FLAGS_max_num_runs,
+                               FLAGS_max_seconds, FLAGS_target_ci,
+                               &run_summary, statistician.get());
+    if (!status) {
+      LOG(ERROR) << "Failed at confident stat run";
+      return -1;
+    }
+    statistician->PrintStat();
+    std::vector<LatencySummary> summaries = statistician->Summaries();
+    summaries.insert(summaries.begin(), run_summary);
+    if (!FLAGS_result_file.empty()) {
+      std::ofstream result_file(FLAGS_result_file);
+      result_file << BaselineJson(summaries);
+    }
+    int exit_code = 0;
+    if (!FLAGS_baseline_file.empty()) {
+      std::ifstream baseline_file(FLAGS_baseline_file);
+      std::stringstream baseline_json;
+      baseline_json << baseline_file.rdbuf();
+      std::vector<LatencySummary> baseline;
+      MACE_CHECK(ParseBaselineJson(baseline_json.str(), &baseline),
+                 "Invalid baseline file: ", FLAGS_baseline_file);
+      const std::vector<std::string> regressions =
+          FindRegressions(baseline, summaries, FLAGS_regression_threshold);
+      LOG(INFO) << regressions.size() << " significant regressions";
+      for (auto &regression : regressions) {
+        LOG(ERROR) << "Regression of " << regression;
+      }
+      exit_code = regressions.empty() ? 0 : 1;
+    }
+    if (model_weights_data != nullptr) {
+      MemoryUnMap(model_weights_data, model_weights_data_size);
+    }
+    return exit_code;
+  }
 
   int64_t stat_time_us = 0;
   int64_t stat_runs = 0;
@@ -390,4 +912,4 @@ int Main(int argc, char **argv) {
 }  // namespace benchmark
 }  // namespace mace
 
-int main(int argc, char **argv) { mace::benchmark::Main(argc, argv); }
+int main(int argc, char **argv) { return mace::benchmark::Main(argc, argv); }
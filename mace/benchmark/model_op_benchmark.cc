@@ -0,0 +1,445 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmark the ops of a real model one by one, with their shapes, args and
+// weights, and every candidate kernel: the memory types on GPU and the
+// conv algorithms on CPU. The inputs which are not weights are filled with
+// a fixed seed, so runs are comparable.
+//
+// Usage:
+// model_op_benchmark --model_file=model.pb --model_data_file=model.data
+//     --device=CPU --filter=.*CONV2D.*
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "mace/benchmark/statistics.h"
+#include "mace/core/algorithm_cache.h"
+#include "mace/core/testing/test_benchmark.h"
+#include "mace/core/types.h"
+#include "mace/ops/ops_test_util.h"
+#include "mace/utils/utils.h"
+
+namespace mace {
+namespace benchmark {
+
+DEFINE_string(model_file, "", "model graph proto file");
+DEFINE_string(model_data_file, "", "model data file");
+DEFINE_string(device, "CPU", "device to run the ops on [CPU|GPU]");
+DEFINE_string(filter, "all", "op benchmark regex filter, eg:.*CONV2D.*");
+DEFINE_string(format, "text",
+              "text, or json/csv for the roofline records of the benchmarks");
+DEFINE_int32(omp_num_threads, -1, "num of openmp threads");
+DEFINE_int32(cpu_affinity_policy, 1,
+             "0:AFFINITY_NONE/1:AFFINITY_BIG_ONLY/2:AFFINITY_LITTLE_ONLY");
+DEFINE_double(gpu_peak_gflops, 0, "peak gflops of the GPU, 0 if unknown");
+DEFINE_double(gpu_peak_gbps, 0, "peak memory GB/s of the GPU, 0 if unknown");
+
+namespace {
+
+using ops::test::OpsTestNet;
+using ops::test::OpTestContext;
+
+// the Conv2dAlgorithm values of mace/ops/conv_2d.cc
+const char *kConv2dAlgorithms[] = {
+    "GEMM1X1", "IMPLICIT_GEMM", "WINOGRAD", "DIRECT", "SPARSE1X1"};
+
+struct TensorSpec {
+  std::vector<index_t> shape;
+  DataType dtype;
+  float scale;
+  int32_t zero_point;
+};
+
+// an op of the model run with one of its candidate kernels
+struct OpCase {
+  OperatorDef op_def;
+  DeviceType device;
+  MemoryType mem_type;
+  // forced conv algorithm, -1 for the default of the op
+  int algorithm;
+};
+
+std::string DataTypeName(DataType dtype) {
+  switch (dtype) {
+    case DT_HALF: return "half";
+    case DT_UINT8: return "uint8_t";
+    case DT_INT32: return "int32_t";
+    default: return "float";
+  }
+}
+
+std::string FormatName(const std::string &name) {
+  std::string res = name;
+  for (auto &c : res) {
+    c = std::isalnum(c) ? std::toupper(c) : '_';
+  }
+  return res;
+}
+
+// Float copy of a half or uint8 weight, as the engine expands them for the
+// float CPU ops.
+void ExpandWeight(const ConstTensor &tensor,
+                  const unsigned char *src,
+                  float *dst) {
+  const index_t size = tensor.data_size();
+  if (tensor.data_type() == DT_HALF) {
+    const half *half_data = reinterpret_cast<const half *>(src);
+    for (index_t i = 0; i < size; ++i) {
+      dst[i] = half_float::half_cast<float>(half_data[i]);
+    }
+    return;
+  }
+  index_t inner_size = 1;
+  for (int d = tensor.quantize_axis() + 1; d < tensor.dims_size(); ++d) {
+    inner_size *= tensor.dims(d);
+  }
+  for (index_t i = 0; i < size; ++i) {
+    const float scale = tensor.scales_size() == 0 ? tensor.scale() :
+        tensor.scales((i / inner_size) % tensor.scales_size());
+    dst[i] = scale * (static_cast<int>(src[i]) - tensor.zero_point());
+  }
+}
+
+class ModelOps {
+ public:
+  ModelOps(const NetDef *net_def, const unsigned char *model_data,
+           DeviceType device)
+      : model_data_(model_data), device_(device) {
+    for (auto &tensor : net_def->tensors()) {
+      weights_[tensor.name()] = &tensor;
+    }
+    for (auto &input_info : net_def->input_info()) {
+      TensorSpec spec = {std::vector<index_t>(input_info.dims().begin(),
+                                              input_info.dims().end()),
+                         input_info.data_type(), 0.f, 0};
+      // CPU engines transpose the float NHWC inputs to NCHW
+      if (device == CPU && spec.dtype == DT_FLOAT &&
+          input_info.data_format() == NHWC && spec.shape.size() == 4) {
+        spec.shape = TransposeShape<index_t, index_t>(spec.shape,
+                                                      {0, 3, 1, 2});
+      }
+      specs_[input_info.name()] = spec;
+    }
+    for (auto &op : net_def->op()) {
+      const DataType op_dtype = static_cast<DataType>(
+          ProtoArgHelper::GetOptionalArg<OperatorDef, int>(op, "T",
+                                                           DT_FLOAT));
+      for (int i = 0; i < op.output_size() && i < op.output_shape_size();
+           ++i) {
+        TensorSpec spec = {std::vector<index_t>(
+            op.output_shape(i).dims().begin(), op.output_shape(i).dims().end()),
+            DT_FLOAT, 0.f, 0};
+        if (op.output_type_size() == op.output_size()) {
+          spec.dtype = op.output_type(i);
+        } else if (op_dtype == DT_UINT8) {
+          spec.dtype = DT_UINT8;
+        }
+        if (i < op.quantize_info_size()) {
+          spec.scale = op.quantize_info(i).scale();
+          spec.zero_point = op.quantize_info(i).zero_point();
+        }
+        specs_[op.output(i)] = spec;
+      }
+    }
+  }
+
+  // the op with a shape for every input which is not a weight
+  bool Replayable(const OperatorDef &op_def) const {
+    if (op_def.output_shape_size() == 0) {
+      return false;
+    }
+    for (auto &input : op_def.input()) {
+      if (weights_.count(input) == 0 && specs_.count(input) == 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  std::vector<index_t> InputShape(const OperatorDef &op_def, int i) const {
+    const std::string &input = op_def.input(i);
+    auto weight = weights_.find(input);
+    if (weight != weights_.end()) {
+      return std::vector<index_t>(weight->second->dims().begin(),
+                                  weight->second->dims().end());
+    }
+    return specs_.at(input).shape;
+  }
+
+  // the multiply-adds and the bytes read and written by the op
+  void Stat(const OperatorDef &op_def, int64_t *macs, int64_t *bytes) const {
+    *bytes = 0;
+    for (int i = 0; i < op_def.input_size(); ++i) {
+      const std::vector<index_t> shape = InputShape(op_def, i);
+      *bytes += std::accumulate(shape.begin(), shape.end(), 1,
+                                std::multiplies<int64_t>()) * sizeof(float);
+    }
+    const std::vector<int64_t> output_shape(
+        op_def.output_shape(0).dims().begin(),
+        op_def.output_shape(0).dims().end());
+    *bytes += std::accumulate(output_shape.begin(), output_shape.end(), 1,
+                              std::multiplies<int64_t>()) * sizeof(float);
+    *macs = 0;
+    if (op_def.input_size() > 1) {
+      const std::vector<index_t> filter = InputShape(op_def, 1);
+      const std::string &type = op_def.type();
+      const bool conv = type == "Conv2D" || type == "Deconv2D" ||
+          type == "DepthwiseConv2d" || type == "DepthwiseDeconv2d";
+      if ((!conv || filter.size() == 4) && !filter.empty() &&
+          output_shape.size() >= (conv ? 4u : 1u)) {
+        *macs = StatMACs(type, std::vector<int64_t>(filter.begin(),
+                                                    filter.end()),
+                         output_shape);
+      }
+    }
+  }
+
+  void FillInputs(const OperatorDef &op_def, OpsTestNet *net) const {
+    Device *device = OpTestContext::Get()->GetDevice(device_);
+    const DataType op_dtype = static_cast<DataType>(
+        ProtoArgHelper::GetOptionalArg<OperatorDef, int>(op_def, "T",
+                                                         DT_FLOAT));
+    std::mt19937 rng(0);
+    for (auto &input : op_def.input()) {
+      if (net->ws()->HasTensor(input)) {
+        continue;
+      }
+      auto weight = weights_.find(input);
+      if (weight != weights_.end()) {
+        FillWeight(*weight->second, op_dtype, device, net);
+        continue;
+      }
+      const TensorSpec &spec = specs_.at(input);
+      // the GPU ops read float buffers which are transformed to their
+      // memory type, as in the op benchmarks
+      const DataType dtype = device_ == GPU ? DT_FLOAT : spec.dtype;
+      Tensor *tensor = net->ws()->CreateTensor(input, device->allocator(),
+                                               dtype);
+      tensor->Resize(spec.shape);
+      tensor->SetScale(spec.scale);
+      tensor->SetZeroPoint(spec.zero_point);
+      Tensor::MappingGuard guard(tensor);
+      const index_t size = tensor->size();
+      if (dtype == DT_FLOAT) {
+        std::uniform_real_distribution<float> dist(0.1f, 1.f);
+        float *data = tensor->mutable_data<float>();
+        for (index_t i = 0; i < size; ++i) {
+          data[i] = dist(rng);
+        }
+      } else if (dtype == DT_HALF) {
+        std::uniform_real_distribution<float> dist(0.1f, 1.f);
+        half *data = tensor->mutable_data<half>();
+        for (index_t i = 0; i < size; ++i) {
+          data[i] = half_float::half_cast<half>(dist(rng));
+        }
+      } else if (dtype == DT_UINT8) {
+        std::uniform_int_distribution<int> dist(0, 255);
+        uint8_t *data = tensor->mutable_data<uint8_t>();
+        for (index_t i = 0; i < size; ++i) {
+          data[i] = static_cast<uint8_t>(dist(rng));
+        }
+      } else {
+        // e.g. indices, zeros are valid for any table
+        memset(tensor->raw_mutable_data(), 0, tensor->raw_size());
+      }
+    }
+  }
+
+ private:
+  void FillWeight(const ConstTensor &const_tensor,
+                  DataType op_dtype,
+                  Device *device,
+                  OpsTestNet *net) const {
+    const unsigned char *src = model_data_ + const_tensor.offset();
+    const bool expand = device_ == CPU &&
+        (const_tensor.data_type() == DT_HALF ||
+         (const_tensor.quantized() && op_dtype != DT_UINT8));
+    Tensor *tensor = net->ws()->CreateTensor(
+        const_tensor.name(), device->allocator(),
+        expand ? DT_FLOAT : const_tensor.data_type(), true);
+    tensor->Resize(std::vector<index_t>(const_tensor.dims().begin(),
+                                        const_tensor.dims().end()));
+    tensor->SetScale(const_tensor.scale());
+    tensor->SetZeroPoint(const_tensor.zero_point());
+    if (const_tensor.scales_size() > 0) {
+      tensor->SetScales(std::vector<float>(const_tensor.scales().begin(),
+                                           const_tensor.scales().end()));
+    }
+    Tensor::MappingGuard guard(tensor);
+    if (expand) {
+      ExpandWeight(const_tensor, src, tensor->mutable_data<float>());
+    } else {
+      memcpy(tensor->raw_mutable_data(), src, tensor->raw_size());
+    }
+  }
+
+  const unsigned char *model_data_;
+  const DeviceType device_;
+  std::map<std::string, const ConstTensor *> weights_;
+  std::map<std::string, TensorSpec> specs_;
+};
+
+// Set up the op case and run it once, false if the forced algorithm does not
+// apply to the op.
+bool SetupCase(const ModelOps &model,
+               const OpCase &op_case,
+               const std::shared_ptr<AlgorithmCache> &cache,
+               OpsTestNet *net) {
+#ifdef MACE_ENABLE_OPENCL
+  if (op_case.device == GPU) {
+    OpTestContext::Get()->GetDevice(GPU)->gpu_runtime()->set_mem_type(
+        op_case.mem_type);
+  }
+#endif  // MACE_ENABLE_OPENCL
+  cache->Force(op_case.algorithm);
+  net->ws()->set_algorithm_cache(cache);
+  model.FillInputs(op_case.op_def, net);
+  *net->NewOperatorDef() = op_case.op_def;
+  MACE_CHECK(net->Setup(op_case.device), "Failed to set up ",
+             op_case.op_def.name());
+  MACE_CHECK(net->Run() == MaceStatus::MACE_SUCCESS, "Failed to run ",
+             op_case.op_def.name());
+  return op_case.algorithm < 0 ||
+      cache->last_selected() == op_case.algorithm;
+}
+
+void RunCase(const ModelOps &model, const OpCase &op_case, int iters) {
+  mace::testing::StopTiming();
+  OpsTestNet net;
+  auto cache = std::make_shared<AlgorithmCache>();
+  SetupCase(model, op_case, cache, &net);
+  int64_t macs = 0;
+  int64_t bytes = 0;
+  model.Stat(op_case.op_def, &macs, &bytes);
+  mace::testing::MacsProcessed(static_cast<int64_t>(iters) * macs);
+  mace::testing::BytesProcessed(static_cast<int64_t>(iters) * bytes);
+  // warm-up
+  net.Run();
+
+  mace::testing::StartTiming();
+  while (iters--) {
+    net.Run();
+  }
+}
+
+void RegisterCases(const NetDef &net_def,
+                   const ModelOps &model,
+                   DeviceType device) {
+  OpsTestNet registry_net;
+  std::vector<MemoryType> mem_types = {CPU_BUFFER};
+  if (device == GPU) {
+    mem_types = {GPU_IMAGE, GPU_BUFFER};
+  }
+  for (int i = 0; i < net_def.op_size(); ++i) {
+    OperatorDef op_def = net_def.op(i);
+    const DataType dtype = static_cast<DataType>(
+        ProtoArgHelper::GetOptionalArg<OperatorDef, int>(op_def, "T",
+                                                         DT_FLOAT));
+    if (!model.Replayable(op_def) ||
+        !registry_net.op_registry_->HasKernel(op_def.type(), device, dtype)) {
+      LOG(WARNING) << "Skip " << op_def.type() << " " << op_def.name();
+      continue;
+    }
+    op_def.set_device_type(device);
+    std::vector<OpCase> cases;
+    if (device == CPU && op_def.type() == "Conv2D" && dtype == DT_FLOAT) {
+      // the algorithms which apply, there are none without NEON
+      const int algorithm_count =
+          sizeof(kConv2dAlgorithms) / sizeof(kConv2dAlgorithms[0]);
+      for (int algorithm = 0; algorithm < algorithm_count; ++algorithm) {
+        OpCase op_case = {op_def, device, CPU_BUFFER, algorithm};
+        OpsTestNet net;
+        if (SetupCase(model, op_case, std::make_shared<AlgorithmCache>(),
+                      &net)) {
+          cases.push_back(op_case);
+        }
+      }
+    }
+    if (cases.empty()) {
+      for (auto mem_type : mem_types) {
+        cases.push_back({op_def, device, mem_type, -1});
+      }
+    }
+    char index[16];
+    snprintf(index, sizeof(index), "%03d", i);
+    for (auto &op_case : cases) {
+      std::string candidate;
+      if (op_case.algorithm >= 0) {
+        candidate = std::string("_") + kConv2dAlgorithms[op_case.algorithm];
+      } else if (device == GPU) {
+        candidate = op_case.mem_type == GPU_IMAGE ? "_IMAGE" : "_BUFFER";
+      }
+      const std::string name = "MACE_BM_" + FormatName(op_def.type()) + "_" +
+          index + "_" + FormatName(op_def.name()) + candidate + "_" +
+          DataTypeName(dtype) + "_" + (device == GPU ? "GPU" : "CPU");
+      new mace::testing::Benchmark(
+          name, [&model, op_case](int iters) {
+            RunCase(model, op_case, iters);
+          });
+    }
+  }
+}
+
+}  // namespace
+
+int Main(int argc, char **argv) {
+  std::string usage = "benchmark the ops of a model\nusage: " +
+      std::string(argv[0]) + " --model_file=model.pb [flags]";
+  gflags::SetUsageMessage(usage);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  OpTestContext::Get(
+      FLAGS_omp_num_threads,
+      static_cast<CPUAffinityPolicy>(FLAGS_cpu_affinity_policy),
+      true);
+  const DeviceType device = FLAGS_device == "GPU" ? GPU : CPU;
+
+  std::vector<unsigned char> model_pb;
+  MACE_CHECK(ReadBinaryFile(&model_pb, FLAGS_model_file),
+             "Failed to read model file: ", FLAGS_model_file);
+  NetDef net_def;
+  MACE_CHECK(net_def.ParseFromArray(model_pb.data(), model_pb.size()),
+             "Failed to parse model file: ", FLAGS_model_file);
+  const unsigned char *model_data = nullptr;
+  size_t model_data_size = 0;
+  if (!FLAGS_model_data_file.empty()) {
+    MemoryMap(FLAGS_model_data_file, &model_data, &model_data_size);
+  }
+
+  ModelOps model(&net_def, model_data, device);
+  RegisterCases(net_def, model, device);
+  mace::testing::Benchmark::SetDevicePeak("GPU", FLAGS_gpu_peak_gflops,
+                                          FLAGS_gpu_peak_gbps);
+  mace::testing::Benchmark::Run(FLAGS_filter.c_str(), FLAGS_format);
+
+  if (model_data != nullptr) {
+    MemoryUnMap(model_data, model_data_size);
+  }
+  return 0;
+}
+
+}  // namespace benchmark
+}  // namespace mace
+
+int main(int argc, char **argv) { return mace::benchmark::Main(argc, argv); }
@@ -13,135 +13,193 @@
 // limitations under the License.
 
 /**
+ * Run several models concurrently as described by a scenario file, and
+ * report their latencies, deadline misses and the device utilization.
+ *
  * Usage:
- * throughput_test \
- *          --input_shape=1,224,224,3   \
- *          --output_shape=1,224,224,2   \
- *          --input_file=input_data \
- *          --cpu_model_data_file=cpu_model_data.data \
- *          --gpu_model_data_file=gpu_model_data.data \
- *          --dsp_model_data_file=dsp_model_data.data \
- *          --run_seconds=10
+ * model_throughput_test --scenario_file=scenario.yml
+ *
+ * The scenario is a small subset of yaml, a map of scalars and a list of
+ * models which are maps of scalars:
+ *
+ * run_seconds: 10
+ * models:
+ *   - name: mobilenet_v1
+ *     model_file: mobilenet_v1.pb
+ *     model_data_file: mobilenet_v1.data
+ *     device: GPU                   # CPU, GPU or HEXAGON
+ *     input_node: input
+ *     input_shape: 1,224,224,3      # colon separated for several inputs
+ *     output_node: MobilenetV1/Predictions/Reshape_1
+ *     output_shape: 1,1001
+ *     input_file: mobilenet_v1_input   # optional, zeros without it
+ *     fps: 30                       # 0 to run back to back
+ *     deadline_ms: 33               # 1000 / fps by default
+ *     priority: -5                  # nice value of the model's thread
+ *     omp_num_threads: 2
+ *     cpu_affinity_policy: 1
+ *     gpu_priority_hint: 3
+ *     gpu_perf_hint: 3
+ *
+ * A frame of a model is released every 1 / fps. A model runs one frame at a
+ * time, the releases it could not start in time are dropped, except the
+ * latest one which starts at once as a camera would provide. Before the
+ * concurrent run, every model is run alone and the latencies measured are
+ * used to simulate the scenario with one non-preemptive priority queue per
+ * device, which estimates the misses the contention between the models of
+ * a device alone would cause.
  */
-#include <malloc.h>
-#include <stdint.h>
+#include <algorithm>
+#include <chrono>  // NOLINT(build/c++11)
+#include <cmath>
 #include <cstdlib>
 #include <fstream>
-#include <iostream>
+#include <functional>
+#include <map>
+#include <memory>
 #include <numeric>
+#include <string>
 #include <thread>  // NOLINT(build/c++11)
+#include <vector>
 
 #include "gflags/gflags.h"
 #include "mace/public/mace.h"
 #include "mace/utils/env_time.h"
 #include "mace/utils/logging.h"
-#include "mace/core/types.h"
+#include "mace/utils/string_util.h"
+#include "mace/utils/thread_pool.h"
+#include "mace/utils/utils.h"
 
 namespace mace {
-
-#ifdef MACE_CPU_MODEL_TAG
-namespace MACE_CPU_MODEL_TAG {
-
-extern const unsigned char *LoadModelData(const char *model_data_file);
-
-extern void UnloadModelData(const unsigned char *model_data);
-
-extern NetDef CreateNet(const unsigned char *model_data);
-
-extern const std::string ModelChecksum();
-
-}  // namespace MACE_CPU_MODEL_TAG
-#endif
-
-#ifdef MACE_GPU_MODEL_TAG
-namespace MACE_GPU_MODEL_TAG {
-
-extern const unsigned char *LoadModelData(const char *model_data_file);
-
-extern void UnloadModelData(const unsigned char *model_data);
-
-extern NetDef CreateNet(const unsigned char *model_data);
-
-extern const std::string ModelChecksum();
-
-}  // namespace MACE_GPU_MODEL_TAG
-#endif
-
-#ifdef MACE_DSP_MODEL_TAG
-namespace MACE_DSP_MODEL_TAG {
-
-extern const unsigned char *LoadModelData(const char *model_data_file);
-
-extern void UnloadModelData(const unsigned char *model_data);
-
-extern NetDef CreateNet(const unsigned char *model_data);
-
-extern const std::string ModelChecksum();
-
-}  // namespace MACE_DSP_MODEL_TAG
-#endif
-
 namespace benchmark {
 
-void Split(const std::string &str,
-           char delims,
-           std::vector<std::string> *result) {
-  MACE_CHECK_NOTNULL(result);
-  std::string tmp = str;
-  while (!tmp.empty()) {
-    size_t next_offset = tmp.find(delims);
-    result->push_back(tmp.substr(0, next_offset));
-    if (next_offset == std::string::npos) {
-      break;
-    } else {
-      tmp = tmp.substr(next_offset + 1);
-    }
+DEFINE_string(scenario_file, "", "scenario yaml of the models to run");
+DEFINE_int32(isolated_runs, 10,
+             "runs of each model alone to simulate the scenario with");
+
+namespace {
+
+struct ModelConfig {
+  std::string name;
+  std::string model_file;
+  std::string model_data_file;
+  std::string device = "CPU";
+  std::string input_node;
+  std::string input_shape;
+  std::string output_node;
+  std::string output_shape;
+  std::string input_file;
+  double fps = 0;
+  double deadline_ms = 0;
+  int priority = 0;
+  int omp_num_threads = -1;
+  int cpu_affinity_policy = 1;
+  int gpu_priority_hint = 3;
+  int gpu_perf_hint = 3;
+};
+
+struct Scenario {
+  double run_seconds = 10;
+  std::vector<ModelConfig> models;
+};
+
+std::string Trim(const std::string &str) {
+  const size_t begin = str.find_first_not_of(" \t\r");
+  if (begin == std::string::npos) {
+    return "";
   }
+  const size_t end = str.find_last_not_of(" \t\r");
+  return str.substr(begin, end - begin + 1);
 }
 
-void SplitAndParseToInts(const std::string &str,
-                         char delims,
-                         std::vector<int64_t> *result) {
-  MACE_CHECK_NOTNULL(result);
-  std::string tmp = str;
-  while (!tmp.empty()) {
-    index_t dim = atoi(tmp.data());
-    result->push_back(dim);
-    size_t next_offset = tmp.find(delims);
-    if (next_offset == std::string::npos) {
-      break;
-    } else {
-      tmp = tmp.substr(next_offset + 1);
-    }
+void SetModelValue(const std::string &key,
+                   const std::string &value,
+                   ModelConfig *model) {
+  std::map<std::string, std::string *> strings = {
+      {"name", &model->name},
+      {"model_file", &model->model_file},
+      {"model_data_file", &model->model_data_file},
+      {"device", &model->device},
+      {"input_node", &model->input_node},
+      {"input_shape", &model->input_shape},
+      {"output_node", &model->output_node},
+      {"output_shape", &model->output_shape},
+      {"input_file", &model->input_file},
+  };
+  std::map<std::string, int *> ints = {
+      {"priority", &model->priority},
+      {"omp_num_threads", &model->omp_num_threads},
+      {"cpu_affinity_policy", &model->cpu_affinity_policy},
+      {"gpu_priority_hint", &model->gpu_priority_hint},
+      {"gpu_perf_hint", &model->gpu_perf_hint},
+  };
+  if (strings.count(key) > 0) {
+    *strings[key] = value;
+  } else if (ints.count(key) > 0) {
+    *ints[key] = std::atoi(value.c_str());
+  } else if (key == "fps") {
+    model->fps = std::atof(value.c_str());
+  } else if (key == "deadline_ms") {
+    model->deadline_ms = std::atof(value.c_str());
+  } else {
+    LOG(FATAL) << "Unknown key of model " << model->name << ": " << key;
   }
 }
 
-void ParseShape(const std::string &str, std::vector<int64_t> *shape) {
-  std::string tmp = str;
-  while (!tmp.empty()) {
-    index_t dim = atoi(tmp.data());
-    shape->push_back(dim);
-    size_t next_offset = tmp.find(",");
-    if (next_offset == std::string::npos) {
-      break;
-    } else {
-      tmp = tmp.substr(next_offset + 1);
+Scenario ParseScenario(const std::string &file_path) {
+  std::ifstream file(file_path);
+  MACE_CHECK(file.is_open(), "Failed to open scenario: ", file_path);
+  Scenario scenario;
+  bool in_models = false;
+  for (std::string line; std::getline(file, line);) {
+    line = line.substr(0, line.find('#'));
+    std::string content = Trim(line);
+    if (content.empty()) {
+      continue;
     }
+    const bool top_level = line.find_first_not_of(" \t") == 0;
+    if (content[0] == '-') {
+      MACE_CHECK(in_models, "Only models could be a list: ", line);
+      scenario.models.emplace_back();
+      content = Trim(content.substr(1));
+      if (content.empty()) {
+        continue;
+      }
+    }
+    const size_t colon = content.find(':');
+    MACE_CHECK(colon != std::string::npos, "Invalid scenario line: ", line);
+    const std::string key = Trim(content.substr(0, colon));
+    std::string value = Trim(content.substr(colon + 1));
+    if (value.size() >= 2 && (value[0] == '"' || value[0] == '\'') &&
+        value.back() == value[0]) {
+      value = value.substr(1, value.size() - 2);
+    }
+    if (top_level) {
+      in_models = key == "models";
+      if (key == "run_seconds") {
+        scenario.run_seconds = std::atof(value.c_str());
+      } else if (!in_models) {
+        LOG(FATAL) << "Unknown key of scenario: " << key;
+      }
+      continue;
+    }
+    MACE_CHECK(in_models && !scenario.models.empty(),
+               "Invalid scenario line: ", line);
+    SetModelValue(key, value, &scenario.models.back());
   }
-}
-
-std::string FormatName(const std::string input) {
-  std::string res = input;
-  for (size_t i = 0; i < input.size(); ++i) {
-    if (!::isalnum(res[i])) res[i] = '_';
+  for (auto &model : scenario.models) {
+    if (model.name.empty()) {
+      model.name = model.model_file;
+    }
+    if (model.deadline_ms <= 0 && model.fps > 0) {
+      model.deadline_ms = 1000 / model.fps;
+    }
   }
-  return res;
+  return scenario;
 }
 
 DeviceType ParseDeviceType(const std::string &device_str) {
-  if (device_str.compare("CPU") == 0) {
-    return DeviceType::CPU;
-  } else if (device_str.compare("GPU") == 0) {
+  if (device_str.compare("GPU") == 0) {
     return DeviceType::GPU;
   } else if (device_str.compare("HEXAGON") == 0) {
     return DeviceType::HEXAGON;
@@ -150,234 +208,295 @@ DeviceType ParseDeviceType(const std::string &device_str) {
   }
 }
 
-DEFINE_string(input_node, "input_node0,input_node1",
-              "input nodes, separated by comma");
-DEFINE_string(output_node, "output_node0,output_node1",
-              "output nodes, separated by comma");
-DEFINE_string(input_shape, "1,224,224,3", "input shape, separated by comma");
-DEFINE_string(output_shape, "1,224,224,2", "output shape, separated by comma");
-DEFINE_string(input_file, "", "input file name");
-DEFINE_string(cpu_model_data_file, "", "cpu model data file name");
-DEFINE_string(gpu_model_data_file, "", "gpu model data file name");
-DEFINE_string(dsp_model_data_file, "", "dsp model data file name");
-DEFINE_int32(run_seconds, 10, "run seconds");
+std::vector<int64_t> ParseShape(const std::string &str) {
+  std::vector<int64_t> shape;
+  for (auto &dim : Split(str, ',')) {
+    shape.push_back(std::atoll(dim.c_str()));
+  }
+  return shape;
+}
 
-int Main(int argc, char **argv) {
-  std::string usage = "model throughput test\nusage: " + std::string(argv[0])
-      + " [flags]";
-  gflags::SetUsageMessage(usage);
-  gflags::ParseCommandLineFlags(&argc, &argv, true);
+std::string FormatName(const std::string input) {
+  std::string res = input;
+  for (size_t i = 0; i < input.size(); ++i) {
+    if (!::isalnum(res[i])) res[i] = '_';
+  }
+  return res;
+}
 
-  LOG(INFO) << "mace version: " << MaceVersion();
-#ifdef MACE_CPU_MODEL_TAG
-  LOG(INFO) << "cpu model checksum: "
-            << mace::MACE_CPU_MODEL_TAG::ModelChecksum();
-#endif
-#ifdef MACE_GPU_MODEL_TAG
-  LOG(INFO) << "gpu model checksum: "
-            << mace::MACE_GPU_MODEL_TAG::ModelChecksum();
-#endif
-#ifdef MACE_DSP_MODEL_TAG
-  LOG(INFO) << "dsp model checksum: "
-            << mace::MACE_DSP_MODEL_TAG::ModelChecksum();
-#endif
-  LOG(INFO) << "Input node: [" << FLAGS_input_node<< "]";
-  LOG(INFO) << "input_shape: " << FLAGS_input_shape;
-  LOG(INFO) << "Output node: [" << FLAGS_output_node<< "]";
-  LOG(INFO) << "output_shape: " << FLAGS_output_shape;
-  LOG(INFO) << "input_file: " << FLAGS_input_file;
-  LOG(INFO) << "cpu_model_data_file: " << FLAGS_cpu_model_data_file;
-  LOG(INFO) << "gpu_model_data_file: " << FLAGS_gpu_model_data_file;
-  LOG(INFO) << "dsp_model_data_file: " << FLAGS_dsp_model_data_file;
-  LOG(INFO) << "run_seconds: " << FLAGS_run_seconds;
+std::shared_ptr<float> NewBuffer(const std::vector<int64_t> &shape) {
+  const int64_t size = std::accumulate(shape.begin(), shape.end(), 1,
+                                       std::multiplies<int64_t>());
+  std::shared_ptr<float> buffer(new float[size](),
+                                std::default_delete<float[]>());
+  return buffer;
+}
 
-  std::vector<std::string> input_names;
-  std::vector<std::string> output_names;
-  std::vector<std::string> input_shapes;
-  std::vector<std::string> output_shapes;
-  Split(FLAGS_input_node, ',', &input_names);
-  Split(FLAGS_output_node, ',', &output_names);
-  Split(FLAGS_input_shape, ':', &input_shapes);
-  Split(FLAGS_output_shape, ':', &output_shapes);
+// A model of the scenario with the results of its runs.
+struct ModelRunner {
+  ModelConfig config;
+  std::shared_ptr<MaceEngine> engine;
+  std::map<std::string, MaceTensor> inputs;
+  std::map<std::string, MaceTensor> outputs;
+  // latency of the model run alone
+  double isolated_micros = 0;
+  std::vector<int64_t> latencies;
+  int64_t missed = 0;
+  int64_t dropped = 0;
+  int64_t busy_micros = 0;
+  int64_t simulated_missed = 0;
+  int64_t simulated_frames = 0;
+};
+
+void CreateModel(const ModelConfig &config, ModelRunner *runner) {
+  runner->config = config;
+  const DeviceType device_type = ParseDeviceType(config.device);
+  MaceEngineConfig engine_config(device_type);
+  engine_config.SetCPUThreadPolicy(
+      config.omp_num_threads,
+      static_cast<CPUAffinityPolicy>(config.cpu_affinity_policy));
+  if (device_type == DeviceType::GPU) {
+    engine_config.SetGPUHints(
+        static_cast<GPUPerfHint>(config.gpu_perf_hint),
+        static_cast<GPUPriorityHint>(config.gpu_priority_hint));
+  }
 
-  const size_t input_count = input_shapes.size();
-  const size_t output_count = output_shapes.size();
-  std::vector<std::vector<int64_t>> input_shape_vec(input_count);
-  std::vector<std::vector<int64_t>> output_shape_vec(output_count);
-  for (size_t i = 0; i < input_count; ++i) {
-    ParseShape(input_shapes[i], &input_shape_vec[i]);
+  std::vector<unsigned char> model_pb;
+  MACE_CHECK(ReadBinaryFile(&model_pb, config.model_file),
+             "Failed to read model file: ", config.model_file);
+  const unsigned char *model_data = nullptr;
+  size_t model_data_size = 0;
+  if (!config.model_data_file.empty()) {
+    MemoryMap(config.model_data_file, &model_data, &model_data_size);
   }
-  for (size_t i = 0; i < output_count; ++i) {
-    ParseShape(output_shapes[i], &output_shape_vec[i]);
+  const std::vector<std::string> input_names = Split(config.input_node, ',');
+  const std::vector<std::string> output_names =
+      Split(config.output_node, ',');
+  MaceStatus status = CreateMaceEngineFromProto(
+      model_pb.data(), model_pb.size(), model_data, model_data_size,
+      input_names, output_names, engine_config, &runner->engine);
+  if (model_data != nullptr) {
+    MemoryUnMap(model_data, model_data_size);
   }
-
-  std::map<std::string, mace::MaceTensor> inputs;
-  std::map<std::string, mace::MaceTensor> cpu_outputs;
-  std::map<std::string, mace::MaceTensor> gpu_outputs;
-  std::map<std::string, mace::MaceTensor> dsp_outputs;
-  for (size_t i = 0; i < input_count; ++i) {
-    // Allocate input and output
-    int64_t input_size =
-        std::accumulate(input_shape_vec[i].begin(), input_shape_vec[i].end(), 1,
-                        std::multiplies<int64_t>());
-    auto buffer_in = std::shared_ptr<float>(new float[input_size],
-                                            std::default_delete<float[]>());
-    // load input
-    std::ifstream in_file(FLAGS_input_file + "_" + FormatName(input_names[i]),
-                          std::ios::in | std::ios::binary);
-    if (in_file.is_open()) {
-      in_file.read(reinterpret_cast<char *>(buffer_in.get()),
-                   input_size * sizeof(float));
-      in_file.close();
-    } else {
-      LOG(FATAL) << "Open input file failed";
+  MACE_CHECK(status == MaceStatus::MACE_SUCCESS,
+             "Failed to create engine of ", config.name, ": ",
+             status.information());
+
+  const std::vector<std::string> input_shapes =
+      Split(config.input_shape, ':');
+  const std::vector<std::string> output_shapes =
+      Split(config.output_shape, ':');
+  MACE_CHECK(input_shapes.size() == input_names.size() &&
+             output_shapes.size() == output_names.size(),
+             "Shapes do not match nodes of ", config.name);
+  for (size_t i = 0; i < input_names.size(); ++i) {
+    const std::vector<int64_t> shape = ParseShape(input_shapes[i]);
+    auto buffer = NewBuffer(shape);
+    if (!config.input_file.empty()) {
+      std::ifstream in_file(
+          config.input_file + "_" + FormatName(input_names[i]),
+          std::ios::in | std::ios::binary);
+      MACE_CHECK(in_file.is_open(), "Open input file failed");
+      in_file.read(reinterpret_cast<char *>(buffer.get()),
+                   std::accumulate(shape.begin(), shape.end(), 1,
+                                   std::multiplies<int64_t>()) *
+                       sizeof(float));
     }
-    inputs[input_names[i]] = mace::MaceTensor(input_shape_vec[i], buffer_in);
+    runner->inputs[input_names[i]] = MaceTensor(shape, buffer);
   }
-
-  for (size_t i = 0; i < output_count; ++i) {
-    int64_t output_size =
-        std::accumulate(output_shape_vec[i].begin(),
-                        output_shape_vec[i].end(), 1,
-                        std::multiplies<int64_t>());
-    auto buffer_out = std::shared_ptr<float>(new float[output_size],
-                                             std::default_delete<float[]>());
-    cpu_outputs[output_names[i]] = mace::MaceTensor(output_shape_vec[i],
-                                                    buffer_out);
-    gpu_outputs[output_names[i]] = mace::MaceTensor(output_shape_vec[i],
-                                                    buffer_out);
-    dsp_outputs[output_names[i]] = mace::MaceTensor(output_shape_vec[i],
-                                                    buffer_out);
+  for (size_t i = 0; i < output_names.size(); ++i) {
+    const std::vector<int64_t> shape = ParseShape(output_shapes[i]);
+    runner->outputs[output_names[i]] = MaceTensor(shape, NewBuffer(shape));
   }
+}
 
-  int64_t t0, t1, init_micros;
-#ifdef MACE_CPU_MODEL_TAG
-  /* --------------------- CPU init ----------------------- */
-  LOG(INFO) << "Load & init cpu model and warm up";
-  const unsigned char *cpu_model_data =
-      mace::MACE_CPU_MODEL_TAG::LoadModelData(
-      FLAGS_cpu_model_data_file.c_str());
-  NetDef cpu_net_def = mace::MACE_CPU_MODEL_TAG::CreateNet(cpu_model_data);
-
-  mace::MaceEngine cpu_engine(&cpu_net_def, DeviceType::CPU, input_names,
-                              output_names);
-
-  LOG(INFO) << "CPU Warm up run";
-  t0 = NowMicros();
-  cpu_engine.Run(inputs, &cpu_outputs);
-  t1 = NowMicros();
-  LOG(INFO) << "CPU 1st warm up run latency: " << t1 - t0 << " us";
-#endif
-
-#ifdef MACE_GPU_MODEL_TAG
-  /* --------------------- GPU init ----------------------- */
-  LOG(INFO) << "Load & init gpu model and warm up";
-  const unsigned char *gpu_model_data =
-      mace::MACE_GPU_MODEL_TAG::LoadModelData(
-      FLAGS_gpu_model_data_file.c_str());
-  NetDef gpu_net_def = mace::MACE_GPU_MODEL_TAG::CreateNet(gpu_model_data);
-
-  mace::MaceEngine gpu_engine(&gpu_net_def, DeviceType::GPU, input_names,
-                              output_names);
-  mace::MACE_GPU_MODEL_TAG::UnloadModelData(gpu_model_data);
-
-  LOG(INFO) << "GPU Warm up run";
-  t0 = NowMicros();
-  gpu_engine.Run(inputs, &gpu_outputs);
-  t1 = NowMicros();
-  LOG(INFO) << "GPU 1st warm up run latency: " << t1 - t0 << " us";
-#endif
-
-#ifdef MACE_DSP_MODEL_TAG
-  /* --------------------- DSP init ----------------------- */
-  LOG(INFO) << "Load & init dsp model and warm up";
-  const unsigned char *dsp_model_data =
-      mace::MACE_DSP_MODEL_TAG::LoadModelData(
-      FLAGS_dsp_model_data_file.c_str());
-  NetDef dsp_net_def = mace::MACE_DSP_MODEL_TAG::CreateNet(dsp_model_data);
-
-  mace::MaceEngine dsp_engine(&dsp_net_def, DeviceType::HEXAGON, input_names,
-                              output_names);
-  mace::MACE_DSP_MODEL_TAG::UnloadModelData(dsp_model_data);
-
-  LOG(INFO) << "DSP Warm up run";
-  t0 = NowMicros();
-  dsp_engine.Run(inputs, &dsp_outputs);
-  t1 = NowMicros();
-  LOG(INFO) << "DSP 1st warm up run latency: " << t1 - t0 << " us";
-#endif
-
-  double cpu_throughput = 0;
-  double gpu_throughput = 0;
-  double dsp_throughput = 0;
-  int64_t run_micros = FLAGS_run_seconds * 1000000;
-
-#ifdef MACE_CPU_MODEL_TAG
-  std::thread cpu_thread([&]() {
-    int64_t frames = 0;
-    int64_t micros = 0;
-    int64_t start = NowMicros();
-    for (; micros < run_micros; ++frames) {
-      cpu_engine.Run(inputs, &cpu_outputs);
-      int64_t end = NowMicros();
-      micros = end - start;
+void RunModel(int64_t start_micros, int64_t end_micros, ModelRunner *runner) {
+  const ModelConfig &config = runner->config;
+  if (config.priority != 0) {
+    utils::SetThreadPriority(config.priority);
+  }
+  const int64_t period = config.fps > 0 ?
+      static_cast<int64_t>(1000000 / config.fps) : 0;
+  const int64_t deadline = static_cast<int64_t>(config.deadline_ms * 1000);
+  int64_t release = start_micros;
+  while (release < end_micros) {
+    const int64_t now = NowMicros();
+    if (now < release) {
+      std::this_thread::sleep_for(std::chrono::microseconds(release - now));
     }
-    cpu_throughput = frames * 1000000.0 / micros;
-  });
-#endif
-
-#ifdef MACE_GPU_MODEL_TAG
-  std::thread gpu_thread([&]() {
-    int64_t frames = 0;
-    int64_t micros = 0;
-    int64_t start = NowMicros();
-    for (; micros < run_micros; ++frames) {
-      gpu_engine.Run(inputs, &gpu_outputs);
-      int64_t end = NowMicros();
-      micros = end - start;
+    const int64_t run_start = std::max(release, NowMicros());
+    MaceStatus status = runner->engine->Run(runner->inputs,
+                                            &runner->outputs);
+    const int64_t run_end = NowMicros();
+    MACE_CHECK(status == MaceStatus::MACE_SUCCESS,
+               "Failed to run ", config.name, ": ", status.information());
+    runner->latencies.push_back(run_end - release);
+    runner->busy_micros += run_end - run_start;
+    if (deadline > 0 && run_end - release > deadline) {
+      ++runner->missed;
+    }
+    if (period == 0) {
+      release = run_end;
+      continue;
+    }
+    release += period;
+    if (release < run_end) {
+      // the latest release starts at once, the earlier ones are dropped
+      const int64_t late = (run_end - release) / period;
+      runner->dropped += late;
+      release += late * period;
     }
-    gpu_throughput = frames * 1000000.0 / micros;
-  });
-#endif
+  }
+}
 
-#ifdef MACE_DSP_MODEL_TAG
-  std::thread dsp_thread([&]() {
-    int64_t frames = 0;
-    int64_t micros = 0;
-    int64_t start = NowMicros();
-    for (; micros < run_micros; ++frames) {
-      dsp_engine.Run(inputs, &dsp_outputs);
-      int64_t end = NowMicros();
-      micros = end - start;
+// Replay the scenario with the isolated latencies of the models, one
+// non-preemptive queue per device picking the released frame of the
+// highest priority, i.e. the lowest nice value.
+void Simulate(double run_seconds, std::vector<ModelRunner> *runners) {
+  const int64_t end_micros = static_cast<int64_t>(run_seconds * 1e6);
+  std::map<std::string, std::vector<ModelRunner *>> devices;
+  for (auto &runner : *runners) {
+    devices[runner.config.device].push_back(&runner);
+  }
+  for (auto &device : devices) {
+    std::vector<ModelRunner *> &models = device.second;
+    std::vector<int64_t> releases(models.size(), 0);
+    int64_t now = 0;
+    while (true) {
+      int picked = -1;
+      int64_t earliest = end_micros;
+      for (size_t i = 0; i < models.size(); ++i) {
+        earliest = std::min(earliest, releases[i]);
+      }
+      if (earliest >= end_micros) {
+        break;
+      }
+      now = std::max(now, earliest);
+      for (size_t i = 0; i < models.size(); ++i) {
+        if (releases[i] <= now && releases[i] < end_micros &&
+            (picked < 0 ||
+             models[i]->config.priority < models[picked]->config.priority)) {
+          picked = static_cast<int>(i);
+        }
+      }
+      ModelRunner *model = models[picked];
+      const int64_t period = model->config.fps > 0 ?
+          static_cast<int64_t>(1000000 / model->config.fps) : 0;
+      const int64_t deadline =
+          static_cast<int64_t>(model->config.deadline_ms * 1000);
+      int64_t &release = releases[picked];
+      // releases passed while the device was busy, the latest one is run
+      if (period > 0 && now - release >= period) {
+        const int64_t late = (now - release) / period;
+        model->simulated_missed += late;
+        release += late * period;
+      }
+      now += std::max<int64_t>(1, static_cast<int64_t>(
+          model->isolated_micros));
+      ++model->simulated_frames;
+      if (deadline > 0 && now - release > deadline) {
+        ++model->simulated_missed;
+      }
+      release = period > 0 ? release + period : now;
     }
-    dsp_throughput = frames * 1000000.0 / micros;
-  });
-#endif
+  }
+}
 
-  double total_throughput = 0;
+int64_t Percentile(const std::vector<int64_t> &sorted, double percentile) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  const size_t index = static_cast<size_t>(std::ceil(
+      percentile * sorted.size())) - 1;
+  return sorted[std::min(index, sorted.size() - 1)];
+}
 
-#ifdef MACE_CPU_MODEL_TAG
-  cpu_thread.join();
-  LOG(INFO) << "CPU throughput: " << cpu_throughput << " f/s";
-  total_throughput += cpu_throughput;
-#endif
-#ifdef MACE_GPU_MODEL_TAG
-  gpu_thread.join();
-  LOG(INFO) << "GPU throughput: " << gpu_throughput << " f/s";
-  total_throughput += gpu_throughput;
-#endif
-#ifdef MACE_DSP_MODEL_TAG
-  dsp_thread.join();
-  LOG(INFO) << "DSP throughput: " << dsp_throughput << " f/s";
-  total_throughput += dsp_throughput;
-#endif
+}  // namespace
 
-  LOG(INFO) << "Total throughput: " << total_throughput << " f/s";
+int Main(int argc, char **argv) {
+  std::string usage = "model throughput test\nusage: " + std::string(argv[0])
+      + " --scenario_file=scenario.yml";
+  gflags::SetUsageMessage(usage);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
 
+  LOG(INFO) << "mace version: " << MaceVersion();
+  LOG(INFO) << "scenario_file: " << FLAGS_scenario_file;
+  const Scenario scenario = ParseScenario(FLAGS_scenario_file);
+  MACE_CHECK(!scenario.models.empty(), "No model in the scenario");
+
+  std::vector<ModelRunner> runners(scenario.models.size());
+  for (size_t i = 0; i < scenario.models.size(); ++i) {
+    LOG(INFO) << "Load & init " << scenario.models[i].name
+              << " on " << scenario.models[i].device;
+    CreateModel(scenario.models[i], &runners[i]);
+    ModelRunner &runner = runners[i];
+    const int64_t t0 = NowMicros();
+    runner.engine->Run(runner.inputs, &runner.outputs);
+    LOG(INFO) << runner.config.name << " 1st warm up run latency: "
+              << NowMicros() - t0 << " us";
+    std::vector<int64_t> latencies;
+    for (int r = 0; r < FLAGS_isolated_runs; ++r) {
+      const int64_t start = NowMicros();
+      runner.engine->Run(runner.inputs, &runner.outputs);
+      latencies.push_back(NowMicros() - start);
+    }
+    std::sort(latencies.begin(), latencies.end());
+    runner.isolated_micros = Percentile(latencies, 0.5);
+  }
+  Simulate(scenario.run_seconds, &runners);
+
+  const int64_t start_micros = NowMicros() + 10000;
+  const int64_t end_micros =
+      start_micros + static_cast<int64_t>(scenario.run_seconds * 1e6);
+  std::vector<std::thread> threads;
+  for (auto &runner : runners) {
+    threads.emplace_back(RunModel, start_micros, end_micros, &runner);
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  const double wall_micros = std::max<int64_t>(
+      NowMicros() - start_micros, 1);
+
+  std::vector<std::string> header = {
+      "model", "device", "fps", "p50(ms)", "p90(ms)", "p99(ms)", "max(ms)",
+      "alone(ms)", "missed", "dropped", "simulated missed"};
+  std::vector<std::vector<std::string>> data;
+  std::map<std::string, int64_t> device_busy;
+  for (auto &runner : runners) {
+    std::vector<int64_t> sorted = runner.latencies;
+    std::sort(sorted.begin(), sorted.end());
+    const int64_t releases = sorted.size() + runner.dropped;
+    device_busy[runner.config.device] += runner.busy_micros;
+    data.push_back({
+        runner.config.name, runner.config.device,
+        MakeString(sorted.size() * 1e6 / wall_micros),
+        MakeString(Percentile(sorted, 0.5) / 1000.0),
+        MakeString(Percentile(sorted, 0.9) / 1000.0),
+        MakeString(Percentile(sorted, 0.99) / 1000.0),
+        MakeString(sorted.empty() ? 0 : sorted.back() / 1000.0),
+        MakeString(runner.isolated_micros / 1000.0),
+        MakeString(runner.missed, "/", releases),
+        MakeString(runner.dropped),
+        MakeString(runner.simulated_missed, "/",
+                   runner.simulated_frames + runner.simulated_missed)});
+  }
+  LOG(INFO) << string_util::StringFormatter::Table(
+      "Models", header, data);
+
+  // the runs of models sharing a device overlap, e.g. the kernels of two
+  // GPU models, so it could exceed 100%
+  std::vector<std::vector<std::string>> utilization;
+  for (auto &device : device_busy) {
+    utilization.push_back({device.first,
+                           MakeString(device.second * 100 / wall_micros)});
+  }
+  LOG(INFO) << string_util::StringFormatter::Table(
+      "Device utilization", {"device", "busy(%)"}, utilization);
   return 0;
 }
 
 }  // namespace benchmark
 }  // namespace mace
 
-int main(int argc, char **argv) { mace::benchmark::Main(argc, argv); }
+int main(int argc, char **argv) { return mace::benchmark::Main(argc, argv); }
@@ -13,8 +13,13 @@
 // limitations under the License.
 
 #include <algorithm>
+#include <chrono>  // NOLINT(build/c++11)
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
 #include <numeric>
 #include <functional>
+#include <regex>  // NOLINT(build/c++11)
 #include <set>
 
 #include "mace/benchmark/statistics.h"
@@ -93,9 +98,96 @@ std::string VectorToString(const std::vector<T> &vec) {
   return stream.str();
 }
 
+std::string JsonString(const std::string &str) {
+  std::string result = "\"";
+  for (char c : str) {
+    if (c == '"' || c == '\\') {
+      result.push_back('\\');
+      result.push_back(c);
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      result.push_back(' ');
+    } else {
+      result.push_back(c);
+    }
+  }
+  result.push_back('"');
+  return result;
+}
+
+template <typename T>
+std::string JsonArray(const std::vector<T> &values) {
+  std::stringstream stream;
+  stream << "[";
+  for (size_t i = 0; i < values.size(); ++i) {
+    stream << (i == 0 ? "" : ",") << values[i];
+  }
+  stream << "]";
+  return stream.str();
+}
+
+void AppendTraceEvent(const std::string &name,
+                      const std::string &category,
+                      int tid,
+                      int64_t start_micros,
+                      int64_t end_micros,
+                      const std::string &args,
+                      bool *first,
+                      std::stringstream *stream) {
+  *stream << (*first ? "\n" : ",\n")
+          << "{\"name\":" << JsonString(name)
+          << ",\"cat\":" << JsonString(category)
+          << ",\"ph\":\"X\",\"pid\":0,\"tid\":" << tid
+          << ",\"ts\":" << start_micros
+          << ",\"dur\":" << end_micros - start_micros
+          << ",\"args\":{" << args << "}}";
+  *first = false;
+}
+
 }  // namespace
 
 
+std::string ChromeTrace(const RunMetadata &meta_data) {
+  std::stringstream stream;
+  stream << "{\"traceEvents\":[";
+  bool first = true;
+  for (auto &op_stat : meta_data.op_stats) {
+    std::vector<std::string> output_shapes;
+    for (auto &shape : op_stat.output_shape) {
+      output_shapes.push_back(JsonArray(shape));
+    }
+    std::string args = "\"output_shape\":" + JsonArray(output_shapes);
+    if (op_stat.dsp_cycles > 0) {
+      args += ",\"dsp_cycles\":" + std::to_string(op_stat.dsp_cycles);
+    }
+    const PerfCounterStats &counters = op_stat.perf_counters;
+    if (counters.cycles > 0) {
+      args += ",\"cycles\":" + std::to_string(counters.cycles) +
+          ",\"instructions\":" + std::to_string(counters.instructions) +
+          ",\"l1d_misses\":" + std::to_string(counters.l1d_misses) +
+          ",\"llc_misses\":" + std::to_string(counters.llc_misses) +
+          ",\"branch_misses\":" + std::to_string(counters.branch_misses) +
+          ",\"bus_accesses\":" + std::to_string(counters.bus_accesses);
+    }
+    AppendTraceEvent(op_stat.operator_name, op_stat.type, 0,
+                     op_stat.stats.start_micros, op_stat.stats.end_micros,
+                     args, &first, &stream);
+    for (auto &kernel : op_stat.kernel_stats) {
+      std::stringstream args;
+      args << "\"op\":" << JsonString(op_stat.operator_name)
+           << ",\"gws\":" << JsonArray(kernel.gws)
+           << ",\"lws\":" << JsonArray(kernel.lws)
+           << ",\"queued_to_submit_us\":"
+           << kernel.submit_micros - kernel.queued_micros
+           << ",\"submit_to_start_us\":"
+           << kernel.start_micros - kernel.submit_micros;
+      AppendTraceEvent(kernel.kernel_name, "kernel", 1, kernel.start_micros,
+                       kernel.end_micros, args.str(), &first, &stream);
+    }
+  }
+  stream << "\n]}\n";
+  return stream.str();
+}
+
 int64_t StatMACs(const std::string &op_type,
                  const std::vector<int64_t> &filter_shape,
                  const std::vector<int64_t> &output_shape) {
@@ -162,6 +254,9 @@ void OpStat::StatMetadata(const RunMetadata &meta_data) {
     int64_t run_time = op_stat.stats.end_micros - op_stat.stats.start_micros;
     record->rel_end.UpdateTime(run_time);
     record->called_times += 1;
+    if (op_stat.perf_counters.cycles > 0) {
+      record->perf_counts.push_back(op_stat.perf_counters);
+    }
     total_time += run_time;
   }
   total_time_.UpdateTime(total_time);
@@ -314,6 +409,60 @@ std::string OpStat::StatByMACs() const {
   return mace::string_util::StringFormatter::Table(title, header, data);
 }
 
+std::string OpStat::StatByPerfCounters() const {
+  // the averages of each op type over the runs, -1 for the counters the
+  // CPU does not provide
+  std::map<std::string, std::vector<double>> type_counts;
+  std::map<std::string, int64_t> type_runs;
+  for (auto &record : records_) {
+    const std::string &op_type = record.second.type;
+    for (const PerfCounterStats &counters : record.second.perf_counts) {
+      const int64_t values[] = {
+          counters.cycles, counters.instructions, counters.l1d_misses,
+          counters.llc_misses, counters.branch_misses, counters.bus_accesses
+      };
+      std::vector<double> &counts = type_counts[op_type];
+      counts.resize(6, 0);
+      for (size_t i = 0; i < counts.size(); ++i) {
+        counts[i] = values[i] < 0 || counts[i] < 0 ?
+            -1 : counts[i] + values[i];
+      }
+    }
+    type_runs[op_type] = std::max<int64_t>(type_runs[op_type],
+                                           record.second.perf_counts.size());
+  }
+  if (type_counts.empty()) {
+    return "";
+  }
+
+  std::string title = "Stat by CPU Perf Counters (per run)";
+  const std::vector<std::string> header = {
+      "Op Type", "MCycles", "IPC", "L1D MPKI", "LLC MPKI", "Branch MPKI",
+      "Bus accesses(K)"
+  };
+  auto per_kilo_instructions = [](double misses, double instructions) {
+    return misses < 0 || instructions <= 0 ? std::string("-") :
+        FloatToString(misses * 1000 / instructions, 3);
+  };
+  std::vector<std::vector<std::string>> data;
+  for (auto &type_count : type_counts) {
+    const std::vector<double> &counts = type_count.second;
+    const double runs = type_runs[type_count.first];
+    std::vector<std::string> tuple;
+    tuple.push_back(type_count.first);
+    tuple.push_back(FloatToString(counts[0] / runs * 1e-6, 3));
+    tuple.push_back(counts[1] < 0 ? std::string("-") :
+                    FloatToString(counts[1] / counts[0], 3));
+    tuple.push_back(per_kilo_instructions(counts[2], counts[1]));
+    tuple.push_back(per_kilo_instructions(counts[3], counts[1]));
+    tuple.push_back(per_kilo_instructions(counts[4], counts[1]));
+    tuple.push_back(counts[5] < 0 ? std::string("-") :
+                    FloatToString(counts[5] / runs * 1e-3, 3));
+    data.emplace_back(tuple);
+  }
+  return mace::string_util::StringFormatter::Table(title, header, data);
+}
+
 std::string OpStat::Summary() const {
   std::stringstream stream;
   if (!records_.empty()) {
@@ -325,6 +474,26 @@ std::string OpStat::Summary() const {
   return stream.str();
 }
 
+std::vector<LatencySummary> OpStat::Summaries() const {
+  std::vector<LatencySummary> summaries;
+  summaries.push_back({"total", total_time_.round(), total_time_.avg(),
+                       total_time_.std_deviation()});
+  std::vector<const Record *> records;
+  for (auto &record : records_) {
+    records.push_back(&record.second);
+  }
+  std::sort(records.begin(), records.end(),
+            [](const Record *lhs, const Record *rhs) {
+              return lhs->order < rhs->order;
+            });
+  for (const Record *record : records) {
+    summaries.push_back({record->name, record->rel_end.round(),
+                         record->rel_end.avg(),
+                         record->rel_end.std_deviation()});
+  }
+  return summaries;
+}
+
 void OpStat::PrintStat() const {
   std::stringstream stream;
   if (!records_.empty()) {
@@ -337,6 +506,8 @@ void OpStat::PrintStat() const {
   }
   // print MACs statistics
   stream << StatByMACs();
+  // print the CPU perf counters, if counted
+  stream << StatByPerfCounters();
   // Print summary
   stream << Summary();
 
@@ -345,5 +516,252 @@ void OpStat::PrintStat() const {
   }
 }
 
+double ConfidenceInterval(const LatencySummary &summary) {
+  if (summary.count <= 1) {
+    return std::numeric_limits<double>::infinity();
+  }
+  return 1.96 * summary.std_deviation / std::sqrt(summary.count);
+}
+
+std::string BaselineJson(const std::vector<LatencySummary> &summaries) {
+  std::stringstream stream;
+  stream << "[";
+  for (size_t i = 0; i < summaries.size(); ++i) {
+    const LatencySummary &summary = summaries[i];
+    stream << (i == 0 ? "\n" : ",\n")
+           << "{\"name\":" << JsonString(summary.name)
+           << ",\"count\":" << summary.count
+           << ",\"mean\":" << FloatToString(summary.mean, 3)
+           << ",\"std_deviation\":"
+           << FloatToString(summary.std_deviation, 3) << "}";
+  }
+  stream << "\n]\n";
+  return stream.str();
+}
+
+bool ParseBaselineJson(const std::string &json,
+                       std::vector<LatencySummary> *summaries) {
+  static const std::regex entry(
+      "\\{\"name\":\"((?:[^\"\\\\]|\\\\.)*)\",\"count\":(\\d+),"
+      "\"mean\":([-0-9.eE+]+),\"std_deviation\":([-0-9.eE+]+)\\}");
+  summaries->clear();
+  for (auto iter = std::sregex_iterator(json.begin(), json.end(), entry);
+       iter != std::sregex_iterator(); ++iter) {
+    std::string name;
+    const std::string escaped = (*iter)[1].str();
+    for (size_t i = 0; i < escaped.size(); ++i) {
+      if (escaped[i] == '\\' && i + 1 < escaped.size()) {
+        ++i;
+      }
+      name.push_back(escaped[i]);
+    }
+    summaries->push_back({name, std::stoll((*iter)[2].str()),
+                          std::stod((*iter)[3].str()),
+                          std::stod((*iter)[4].str())});
+  }
+  return !summaries->empty();
+}
+
+std::vector<std::string> FindRegressions(
+    const std::vector<LatencySummary> &baseline,
+    const std::vector<LatencySummary> &current,
+    double min_ratio) {
+  std::map<std::string, const LatencySummary *> baseline_map;
+  for (auto &summary : baseline) {
+    baseline_map[summary.name] = &summary;
+  }
+  std::vector<std::string> regressions;
+  for (auto &summary : current) {
+    auto iter = baseline_map.find(summary.name);
+    if (iter == baseline_map.end() || summary.count <= 1 ||
+        iter->second->count <= 1) {
+      continue;
+    }
+    const LatencySummary &base = *iter->second;
+    const double diff = summary.mean - base.mean;
+    if (diff <= min_ratio * base.mean) {
+      continue;
+    }
+    // Welch's t-test, with the normal quantile for the sample sizes of
+    // benchmarks
+    const double std_error = std::sqrt(
+        summary.std_deviation * summary.std_deviation / summary.count +
+        base.std_deviation * base.std_deviation / base.count);
+    if (std_error > 0 && diff / std_error < 1.96) {
+      continue;
+    }
+    std::stringstream stream;
+    stream << summary.name << ": " << FloatToString(base.mean, 3)
+           << "us -> " << FloatToString(summary.mean, 3) << "us (+"
+           << FloatToString(diff * 100 / base.mean, 1) << "%)";
+    regressions.push_back(stream.str());
+  }
+  return regressions;
+}
+
+namespace {
+int64_t ReadCPUFreq(int cpu, const std::string &name) {
+  std::ifstream file("/sys/devices/system/cpu/cpu" + std::to_string(cpu) +
+                     "/cpufreq/" + name);
+  int64_t freq = -1;
+  if (!(file >> freq)) {
+    return -1;
+  }
+  return freq;
+}
+}  // namespace
+
+CPUFreqMonitor::CPUFreqMonitor() {
+  for (int cpu = 0;; ++cpu) {
+    const int64_t max_freq = ReadCPUFreq(cpu, "cpuinfo_max_freq");
+    if (max_freq <= 0) {
+      break;
+    }
+    max_freqs_.push_back(max_freq);
+  }
+}
+
+bool CPUFreqMonitor::IsThrottled() const {
+  for (size_t cpu = 0; cpu < max_freqs_.size(); ++cpu) {
+    // the thermal driver caps the frequency governors could pick, offline
+    // cores have no cap to read
+    const int64_t scaling_max = ReadCPUFreq(cpu, "scaling_max_freq");
+    if (scaling_max > 0 && scaling_max < max_freqs_[cpu]) {
+      return true;
+    }
+  }
+  return false;
+}
+
+std::string CPUFreqMonitor::CurrentFreqs() const {
+  std::stringstream stream;
+  for (size_t cpu = 0; cpu < max_freqs_.size(); ++cpu) {
+    stream << (cpu == 0 ? "" : ",")
+           << std::max<int64_t>(ReadCPUFreq(cpu, "scaling_cur_freq"), 0) /
+               1000;
+  }
+  return stream.str();
+}
+
+PowerMonitor::PowerMonitor(const std::string &source, int interval_ms)
+    : interval_ms_(std::max(interval_ms, 1)),
+      running_(false),
+      watts_sum_(0),
+      num_samples_(0) {
+  const std::string cmd_prefix = "cmd:";
+  if (source.compare(0, cmd_prefix.size(), cmd_prefix) == 0) {
+    command_ = source.substr(cmd_prefix.size());
+  } else if (source == "battery") {
+    supply_dir_ = "/sys/class/power_supply/battery";
+  } else {
+    supply_dir_ = source;
+  }
+}
+
+PowerMonitor::~PowerMonitor() {
+  if (running_) {
+    Stop(nullptr);
+  }
+}
+
+bool PowerMonitor::Available(std::string *reason) const {
+  double watts = 0;
+  if (!Sample(&watts)) {
+    *reason = command_.empty() ?
+              "no current_now and voltage_now in " + supply_dir_ :
+              "no watts printed by " + command_;
+    return false;
+  }
+  if (!supply_dir_.empty()) {
+    std::ifstream status_file(supply_dir_ + "/status");
+    std::string status;
+    if (status_file >> status && status != "Discharging") {
+      // the current of a charging battery is of the charger as well
+      *reason = "power supply is " + status + ", unplug the charger";
+      return false;
+    }
+  }
+  return true;
+}
+
+bool PowerMonitor::Sample(double *watts) const {
+  if (!command_.empty()) {
+    FILE *pipe = popen(command_.c_str(), "r");
+    if (pipe == nullptr) {
+      return false;
+    }
+    const bool read = fscanf(pipe, "%lf", watts) == 1;
+    pclose(pipe);
+    return read;
+  }
+  std::ifstream current_file(supply_dir_ + "/current_now");
+  std::ifstream voltage_file(supply_dir_ + "/voltage_now");
+  int64_t current_ua = 0;
+  int64_t voltage_uv = 0;
+  if (!(current_file >> current_ua) || !(voltage_file >> voltage_uv)) {
+    return false;
+  }
+  // the sign of a discharging current differs between the drivers
+  *watts = std::abs(static_cast<double>(current_ua)) * voltage_uv * 1e-12;
+  return true;
+}
+
+void PowerMonitor::Loop() {
+  while (running_) {
+    double watts = 0;
+    if (Sample(&watts)) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      watts_sum_ += watts;
+      ++num_samples_;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(interval_ms_));
+  }
+}
+
+void PowerMonitor::Start() {
+  MACE_CHECK(!running_, "power monitor is already started");
+  watts_sum_ = 0;
+  num_samples_ = 0;
+  running_ = true;
+  thread_ = std::thread(&PowerMonitor::Loop, this);
+}
+
+double PowerMonitor::Stop(int64_t *num_samples) {
+  running_ = false;
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  if (num_samples_ == 0) {
+    // shorter than the interval
+    double watts = 0;
+    if (Sample(&watts)) {
+      watts_sum_ = watts;
+      num_samples_ = 1;
+    }
+  }
+  if (num_samples != nullptr) {
+    *num_samples = num_samples_;
+  }
+  return num_samples_ == 0 ? 0 : watts_sum_ / num_samples_;
+}
+
+int64_t PeakRSSKB() {
+  std::ifstream file("/proc/self/status");
+  for (std::string line; std::getline(file, line);) {
+    if (line.compare(0, 6, "VmHWM:") == 0) {
+      return std::atoll(line.c_str() + 6);
+    }
+  }
+  return -1;
+}
+
+bool ResetPeakRSS() {
+  // since Linux 4.0
+  std::ofstream file("/proc/self/clear_refs");
+  file << "5";
+  file.flush();
+  return file.good();
+}
+
 }  // namespace benchmark
 }  // namespace mace
@@ -16,13 +16,16 @@
 #define MACE_BENCHMARK_STATISTICS_H_
 
 #include <algorithm>
+#include <atomic>  // NOLINT(build/c++11)
 #include <cmath>
 #include <iomanip>
 #include <limits>
 #include <locale>
 #include <map>
+#include <mutex>  // NOLINT(build/c++11)
 #include <sstream>
 #include <string>
+#include <thread>  // NOLINT(build/c++11)
 #include <vector>
 
 #include "mace/public/mace.h"
@@ -144,6 +147,93 @@ class TimeInfo {
   double square_sum;
 };
 
+// Chrome trace (chrome://tracing) json of one run: the operators are on
+// thread 0 and their OpenCL kernels on thread 1. GPU times are of the device
+// clock, which could differ from the host clock of CPU operators.
+std::string ChromeTrace(const RunMetadata &meta_data);
+
+// Latencies of an operator or of the whole run, in microseconds.
+struct LatencySummary {
+  std::string name;
+  int64_t count;
+  double mean;
+  double std_deviation;
+};
+
+// Half width of the 95% confidence interval of the mean.
+double ConfidenceInterval(const LatencySummary &summary);
+
+// A baseline json of the summaries, one entry per line.
+std::string BaselineJson(const std::vector<LatencySummary> &summaries);
+
+// Parse a json written by BaselineJson.
+bool ParseBaselineJson(const std::string &json,
+                       std::vector<LatencySummary> *summaries);
+
+// The entries of current which are slower than in baseline by more than
+// min_ratio of the baseline mean, with 95% confidence by Welch's t-test,
+// as report lines.
+std::vector<std::string> FindRegressions(
+    const std::vector<LatencySummary> &baseline,
+    const std::vector<LatencySummary> &current,
+    double min_ratio);
+
+// Detect thermal throttling of the CPU cores, from the max frequencies of
+// cpufreq, as GetCPUMaxFreq of the CPU runtime reads them, and the current
+// and capped frequencies.
+class CPUFreqMonitor {
+ public:
+  CPUFreqMonitor();
+
+  // Whether the frequency of a core is capped below its max.
+  bool IsThrottled() const;
+
+  // the current frequencies in MHz, e.g. "2803,2803,1800"
+  std::string CurrentFreqs() const;
+
+ private:
+  std::vector<int64_t> max_freqs_;
+};
+
+// Sample the power drawn by the device on a background thread, from the
+// current_now and voltage_now of a power supply in sysfs, or from a command
+// printing the watts, e.g. the client of an external meter.
+class PowerMonitor {
+ public:
+  // source is "battery", a power supply dir such as
+  // /sys/class/power_supply/bms, or "cmd:<command>"
+  PowerMonitor(const std::string &source, int interval_ms);
+  ~PowerMonitor();
+
+  // Whether a sample could be read, with the reason if not.
+  bool Available(std::string *reason) const;
+
+  void Start();
+
+  // Stop sampling, the mean power in watts since Start.
+  double Stop(int64_t *num_samples);
+
+ private:
+  bool Sample(double *watts) const;
+  void Loop();
+
+  std::string supply_dir_;
+  std::string command_;
+  int interval_ms_;
+  std::thread thread_;
+  std::atomic<bool> running_;
+  std::mutex mutex_;
+  double watts_sum_;
+  int64_t num_samples_;
+};
+
+// Peak resident set size of the process in KB, -1 if unknown.
+int64_t PeakRSSKB();
+
+// Restart the peak resident set size from the current one, false if the
+// kernel does not support it.
+bool ResetPeakRSS();
+
 enum Metric {
   NAME,
   RUN_ORDER,
@@ -156,11 +246,15 @@ class OpStat {
 
   void PrintStat() const;
 
+  // the whole run named "total", then the ops in run order
+  std::vector<LatencySummary> Summaries() const;
+
  private:
   std::string StatByMetric(const Metric metric,
       const int top_limit) const;
   std::string StatByOpType() const;
   std::string StatByMACs() const;
+  std::string StatByPerfCounters() const;
   std::string Summary() const;
 
  private:
@@ -174,6 +268,8 @@ class OpStat {
     TimeInfo<int64_t> start;
     TimeInfo<int64_t> rel_end;
     int64_t called_times;
+    // the CPU perf counters of each counted run
+    std::vector<PerfCounterStats> perf_counts;
   };
 
   std::map<std::string, Record> records_;
@@ -0,0 +1,111 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "mace/core/algorithm_cache.h"
+
+#include <cstring>
+#include <map>
+#include <vector>
+
+#include "mace/utils/logging.h"
+
+namespace mace {
+
+AlgorithmCache::AlgorithmCache(const std::string &file_path)
+    : file_path_(file_path),
+      storage_(file_path),
+      forced_algorithm_(-1),
+      last_selected_(-1) {
+  if (!file_path_.empty() && storage_.Load() != 0) {
+    LOG(WARNING) << "Load algorithms from " << file_path_ << " failed";
+  }
+}
+
+std::shared_ptr<AlgorithmCache> AlgorithmCache::Shared(
+    const std::string &file_path) {
+  static std::mutex registry_mutex;
+  static std::map<std::string, std::weak_ptr<AlgorithmCache>> registry;
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  std::shared_ptr<AlgorithmCache> cache = registry[file_path].lock();
+  if (cache == nullptr) {
+    cache = std::make_shared<AlgorithmCache>(file_path);
+    registry[file_path] = cache;
+  }
+  return cache;
+}
+
+bool AlgorithmCache::Find(const std::string &key, int *algorithm) {
+  if (forced_algorithm_ >= 0) {
+    *algorithm = forced_algorithm_;
+    return true;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  const std::vector<unsigned char> *value = storage_.Find(key);
+  if (value == nullptr || value->size() != sizeof(int32_t)) {
+    return false;
+  }
+  int32_t data;
+  memcpy(&data, value->data(), sizeof(data));
+  *algorithm = data;
+  return true;
+}
+
+void AlgorithmCache::Insert(const std::string &key, int algorithm) {
+  const int32_t data = algorithm;
+  std::vector<unsigned char> value(sizeof(data));
+  memcpy(value.data(), &data, sizeof(data));
+  std::lock_guard<std::mutex> lock(mutex_);
+  storage_.Insert(key, value);
+}
+
+void AlgorithmCache::Force(int algorithm) {
+  forced_algorithm_ = algorithm;
+  last_selected_ = -1;
+}
+
+void AlgorithmCache::Selected(int algorithm) {
+  last_selected_ = algorithm;
+}
+
+int AlgorithmCache::last_selected() const {
+  return last_selected_;
+}
+
+void AlgorithmCache::Flush() {
+  if (file_path_.empty()) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (storage_.Flush() != 0) {
+    LOG(WARNING) << "Flush algorithms to " << file_path_ << " failed";
+  }
+}
+
+void AlgorithmCache::Export(const std::string &prefix, KVStorage *storage) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto &key : storage_.Keys()) {
+    storage->Insert(prefix + key, *storage_.Find(key));
+  }
+}
+
+void AlgorithmCache::Import(const std::string &prefix, KVStorage *storage) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto &key : storage->Keys()) {
+    if (key.compare(0, prefix.size(), prefix) == 0 &&
+        storage_.Find(key.substr(prefix.size())) == nullptr) {
+      storage_.Insert(key.substr(prefix.size()), *storage->Find(key));
+    }
+  }
+}
+
+}  // namespace mace
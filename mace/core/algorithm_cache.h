@@ -0,0 +1,78 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef MACE_CORE_ALGORITHM_CACHE_H_
+#define MACE_CORE_ALGORITHM_CACHE_H_
+
+#include <atomic>  // NOLINT(build/c++11)
+#include <memory>
+#include <mutex>  // NOLINT(build/c++11)
+#include <string>
+
+#include "mace/core/kv_storage.h"
+
+namespace mace {
+
+// The algorithms picked by benchmarking the CPU kernels of an op, keyed by
+// the op type and its shapes. Without a file path, nothing is benchmarked and
+// ops fall back to their heuristics. With a file path, ops benchmark the
+// candidates of a key once, at the first run of its shapes, and the winners
+// are loaded from and flushed to that file, so later engines of the device
+// skip the benchmark.
+class AlgorithmCache {
+ public:
+  explicit AlgorithmCache(const std::string &file_path = "");
+  AlgorithmCache(const AlgorithmCache &) = delete;
+  AlgorithmCache &operator=(const AlgorithmCache &) = delete;
+
+  // the process-wide cache backed by file_path
+  static std::shared_ptr<AlgorithmCache> Shared(const std::string &file_path);
+
+  // whether ops should benchmark the keys not found
+  bool tuning() const { return !file_path_.empty(); }
+
+  bool Find(const std::string &key, int *algorithm);
+
+  void Insert(const std::string &key, int algorithm);
+
+  // Make Find return the algorithm for every key, to benchmark the
+  // candidates of an op one by one, -1 to stop.
+  void Force(int algorithm);
+
+  // Ops report the algorithm they run, applicable forced ones included.
+  void Selected(int algorithm);
+
+  // the algorithm last reported, -1 if none
+  int last_selected() const;
+
+  // write the algorithms to the file, no-op without a file path
+  void Flush();
+
+  // copy the algorithms into storage, their keys prefixed, e.g. of a
+  // snapshot
+  void Export(const std::string &prefix, KVStorage *storage);
+
+  // add the algorithms of storage under prefix which the cache does not have
+  void Import(const std::string &prefix, KVStorage *storage);
+
+ private:
+  const std::string file_path_;
+  FileStorage storage_;
+  std::mutex mutex_;
+  std::atomic<int> forced_algorithm_;
+  std::atomic<int> last_selected_;
+};
+
+}  // namespace mace
+
+#endif  // MACE_CORE_ALGORITHM_CACHE_H_
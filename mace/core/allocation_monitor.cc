@@ -0,0 +1,54 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/core/allocation_monitor.h"
+
+#include "mace/utils/logging.h"
+
+namespace mace {
+
+namespace {
+thread_local AllocationMonitor *current_monitor = nullptr;
+thread_local const std::string *current_op_name = nullptr;
+}  // namespace
+
+AllocationMonitor::AllocationMonitor(bool fail_allocations)
+    : fail_allocations_(fail_allocations), allocation_count_(0) {}
+
+void AllocationMonitor::Watch(const std::string *op_name) {
+  current_monitor = this;
+  current_op_name = op_name;
+}
+
+void AllocationMonitor::Unwatch() {
+  current_monitor = nullptr;
+  current_op_name = nullptr;
+}
+
+bool AllocationMonitor::Allow(const std::string &op_name, size_t nbytes) {
+  ++allocation_count_;
+  LOG(WARNING) << "Operation " << op_name << " allocates " << nbytes
+               << " bytes while running"
+               << (fail_allocations_ ? ", fail the allocation" : "");
+  return !fail_allocations_;
+}
+
+bool AllowAllocation(size_t nbytes) {
+  if (current_monitor == nullptr) {
+    return true;
+  }
+  return current_monitor->Allow(*current_op_name, nbytes);
+}
+
+}  // namespace mace
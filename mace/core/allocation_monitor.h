@@ -0,0 +1,56 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_CORE_ALLOCATION_MONITOR_H_
+#define MACE_CORE_ALLOCATION_MONITOR_H_
+
+#include <atomic>  // NOLINT(build/c++11)
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace mace {
+
+// The allocations of the allocators made by the threads running the
+// operations of a net whose runs should not allocate, see
+// MaceEngineConfig::SetAllocationFreeRuns. They are logged with the
+// operation, and fail with fail_allocations.
+class AllocationMonitor {
+ public:
+  explicit AllocationMonitor(bool fail_allocations);
+
+  // The allocations of the calling thread are those of op_name, which must
+  // outlive the watch, until Unwatch.
+  void Watch(const std::string *op_name);
+  static void Unwatch();
+
+  // the allocations made while watched since the monitor was created
+  int64_t allocation_count() const { return allocation_count_; }
+
+ private:
+  friend bool AllowAllocation(size_t nbytes);
+
+  bool Allow(const std::string &op_name, size_t nbytes);
+
+  const bool fail_allocations_;
+  std::atomic<int64_t> allocation_count_;
+};
+
+// Called by the allocators before allocating nbytes, false if the
+// allocation must fail since the thread is watched.
+bool AllowAllocation(size_t nbytes);
+
+}  // namespace mace
+
+#endif  // MACE_CORE_ALLOCATION_MONITOR_H_
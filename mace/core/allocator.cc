@@ -14,17 +14,183 @@
 
 #include "mace/core/allocator.h"
 
+#include <dirent.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+#include <cstdio>
+#include <map>
 #include <memory>
+#include <set>
+#include <string>
 
 namespace mace {
 
+namespace {
+// from linux/mempolicy.h
+constexpr int kMpolBind = 2;
+constexpr int kMpolInterleave = 3;
+
+// the node<N> entries of a directory of sysfs
+std::set<int> ListNumaNodes(const std::string &dir) {
+  std::set<int> nodes;
+  DIR *d = opendir(dir.c_str());
+  if (d == nullptr) {
+    return nodes;
+  }
+  while (struct dirent *entry = readdir(d)) {
+    int node = 0;
+    char tail = 0;
+    if (sscanf(entry->d_name, "node%d%c", &node, &tail) == 1) {
+      nodes.insert(node);
+    }
+  }
+  closedir(d);
+  return nodes;
+}
+}  // namespace
+
+HugePageCPUAllocator::HugePageCPUAllocator(const std::vector<int> &numa_nodes)
+    : numa_nodes_(numa_nodes) {}
+
+MaceStatus HugePageCPUAllocator::New(size_t nbytes, void **result) const {
+#if defined(__linux__)
+  if (nbytes < kHugePageSize || ShouldMockRuntimeFailure()) {
+    return CPUAllocator::New(nbytes, result);
+  }
+  VLOG(3) << "Allocate CPU buffer with huge pages: " << nbytes;
+  if (!AllowAllocation(nbytes)) {
+    return MaceStatus::MACE_OUT_OF_RESOURCES;
+  }
+  const size_t size = (nbytes + kHugePageSize - 1) & ~(kHugePageSize - 1);
+  void *data = MAP_FAILED;
+#ifdef MAP_HUGETLB
+  data = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+              MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+  if (data == MAP_FAILED) {
+    // no huge page reserved, map a huge page aligned range for the
+    // transparent ones
+    void *mapped = mmap(nullptr, size + kHugePageSize,
+                        PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED) {
+      LOG(WARNING) << "Allocate CPU Buffer with " << nbytes
+                   << " bytes failed because of " << strerror(errno);
+      *result = nullptr;
+      return MaceStatus::MACE_OUT_OF_RESOURCES;
+    }
+    const uintptr_t begin = reinterpret_cast<uintptr_t>(mapped);
+    const uintptr_t aligned =
+        (begin + kHugePageSize - 1) & ~(kHugePageSize - 1);
+    if (aligned > begin) {
+      munmap(mapped, aligned - begin);
+    }
+    if (begin + kHugePageSize > aligned) {
+      munmap(reinterpret_cast<void *>(aligned + size),
+             begin + kHugePageSize - aligned);
+    }
+    data = reinterpret_cast<void *>(aligned);
+#ifdef MADV_HUGEPAGE
+    if (madvise(data, size, MADV_HUGEPAGE) != 0) {
+      VLOG(1) << "Advise huge pages failed: " << strerror(errno);
+    }
+#endif
+  }
+  // the pages are not touched yet, they are faulted on the bound nodes
+  BindNumaNodes(data, size);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    mapped_sizes_[data] = size;
+  }
+  // anonymous mappings are zero filled
+  *result = data;
+  return MaceStatus::MACE_SUCCESS;
+#else
+  return CPUAllocator::New(nbytes, result);
+#endif
+}
+
+void HugePageCPUAllocator::Delete(void *data) const {
+  MACE_CHECK_NOTNULL(data);
+  size_t size = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto iter = mapped_sizes_.find(data);
+    if (iter != mapped_sizes_.end()) {
+      size = iter->second;
+      mapped_sizes_.erase(iter);
+    }
+  }
+  if (size == 0) {
+    CPUAllocator::Delete(data);
+    return;
+  }
+  VLOG(3) << "Free CPU buffer with huge pages";
+  munmap(data, size);
+}
+
+void HugePageCPUAllocator::BindNumaNodes(void *data, size_t nbytes) const {
+#if defined(__linux__) && defined(__NR_mbind)
+  if (numa_nodes_.empty()) {
+    return;
+  }
+  const size_t bits = 8 * sizeof(unsigned long);  // NOLINT(runtime/int)
+  std::vector<unsigned long> mask;  // NOLINT(runtime/int)
+  for (int node : numa_nodes_) {
+    const size_t word = static_cast<size_t>(node) / bits;
+    if (word >= mask.size()) {
+      mask.resize(word + 1, 0);
+    }
+    mask[word] |= 1UL << (node % bits);
+  }
+  // the cores on several nodes share the bandwidth of all of them
+  const int mode = numa_nodes_.size() == 1 ? kMpolBind : kMpolInterleave;
+  if (syscall(__NR_mbind, data, nbytes, mode, mask.data(),
+              mask.size() * bits + 1, 0) != 0) {
+    VLOG(1) << "Bind NUMA nodes failed: " << strerror(errno);
+  }
+#else
+  MACE_UNUSED(data);
+  MACE_UNUSED(nbytes);
+#endif
+}
+
 Allocator *GetCPUAllocator() {
   static CPUAllocator allocator;
   return &allocator;
 }
 
+Allocator *GetHugePageCPUAllocator(bool bind_numa_nodes,
+                                   const std::vector<size_t> &cpu_ids) {
+  std::vector<int> nodes;
+  if (bind_numa_nodes && !cpu_ids.empty() &&
+      ListNumaNodes("/sys/devices/system/node").size() > 1) {
+    std::set<int> cpu_nodes;
+    for (size_t cpu_id : cpu_ids) {
+      const std::set<int> node = ListNumaNodes(
+          "/sys/devices/system/cpu/cpu" + std::to_string(cpu_id));
+      cpu_nodes.insert(node.begin(), node.end());
+    }
+    nodes.assign(cpu_nodes.begin(), cpu_nodes.end());
+  }
+  VLOG(1) << "Huge page CPU allocator on NUMA nodes: " << MakeString(nodes);
+  // the allocators live as long as the process, like the buffers of the
+  // weights shared between engines
+  static std::mutex mutex;
+  static auto *allocators =
+      new std::map<std::vector<int>, std::unique_ptr<Allocator>>;
+  std::lock_guard<std::mutex> lock(mutex);
+  auto &allocator = (*allocators)[nodes];
+  if (allocator == nullptr) {
+    allocator.reset(new HugePageCPUAllocator(nodes));
+  }
+  return allocator.get();
+}
+
 void AdviseFree(void *addr, size_t length) {
   int page_size = sysconf(_SC_PAGESIZE);
   void *addr_aligned =
@@ -19,9 +19,12 @@
 #include <string.h>
 #include <map>
 #include <limits>
+#include <mutex>  // NOLINT(build/c++11)
+#include <unordered_map>
 #include <vector>
 #include <cstring>
 
+#include "mace/core/allocation_monitor.h"
 #include "mace/core/macros.h"
 #include "mace/core/types.h"
 #include "mace/core/runtime_failure_mock.h"
@@ -58,6 +61,13 @@ class Allocator {
   virtual void *MapImage(void *buffer,
                          const std::vector<size_t> &image_shape,
                          std::vector<size_t> *mapped_image_pitch) const = 0;
+  // copy the tightly packed pixels of a whole 2d image from or to the host
+  virtual MaceStatus WriteImage(void *buffer,
+                                const std::vector<size_t> &image_shape,
+                                const void *data) const = 0;
+  virtual MaceStatus ReadImage(void *buffer,
+                               const std::vector<size_t> &image_shape,
+                               void *data) const = 0;
   virtual void Unmap(void *buffer, void *mapper_ptr) const = 0;
   virtual bool OnHost() const = 0;
 };
@@ -71,7 +81,7 @@ class CPUAllocator : public Allocator {
       return MaceStatus::MACE_SUCCESS;
     }
 
-    if (ShouldMockRuntimeFailure()) {
+    if (ShouldMockRuntimeFailure() || !AllowAllocation(nbytes)) {
       return MaceStatus::MACE_OUT_OF_RESOURCES;
     }
 
@@ -134,6 +144,24 @@ class CPUAllocator : public Allocator {
     MACE_UNUSED(mapped_image_pitch);
     return buffer;
   }
+  MaceStatus WriteImage(void *buffer,
+                        const std::vector<size_t> &image_shape,
+                        const void *data) const override {
+    MACE_UNUSED(buffer);
+    MACE_UNUSED(image_shape);
+    MACE_UNUSED(data);
+    LOG(FATAL) << "Write CPU image";
+    return MaceStatus::MACE_SUCCESS;
+  }
+  MaceStatus ReadImage(void *buffer,
+                       const std::vector<size_t> &image_shape,
+                       void *data) const override {
+    MACE_UNUSED(buffer);
+    MACE_UNUSED(image_shape);
+    MACE_UNUSED(data);
+    LOG(FATAL) << "Read CPU image";
+    return MaceStatus::MACE_SUCCESS;
+  }
   void Unmap(void *buffer, void *mapper_ptr) const override {
     MACE_UNUSED(buffer);
     MACE_UNUSED(mapper_ptr);
@@ -141,9 +169,38 @@ class CPUAllocator : public Allocator {
   bool OnHost() const override { return true; }
 };
 
+// The size of the huge pages of HugePageCPUAllocator.
+constexpr size_t kHugePageSize = 2 * 1024 * 1024;
+
+// A CPU allocator mapping the allocations of at least kHugePageSize with
+// huge pages, the explicit ones when the kernel has some reserved, or the
+// transparent ones otherwise, to take fewer TLB misses on large arenas and
+// weights. The mapped pages are bound to numa_nodes if it is not empty.
+// Smaller allocations are left to CPUAllocator.
+class HugePageCPUAllocator : public CPUAllocator {
+ public:
+  explicit HugePageCPUAllocator(const std::vector<int> &numa_nodes);
+  ~HugePageCPUAllocator() override {}
+  MaceStatus New(size_t nbytes, void **result) const override;
+  void Delete(void *data) const override;
+
+ private:
+  void BindNumaNodes(void *data, size_t nbytes) const;
+
+  std::vector<int> numa_nodes_;
+  mutable std::mutex mutex_;
+  mutable std::unordered_map<void *, size_t> mapped_sizes_;
+};
+
 // Global CPU allocator used for CPU/GPU/DSP
 Allocator *GetCPUAllocator();
 
+// Global huge page allocator bound to the NUMA nodes of cpu_ids. The pages
+// are not bound if bind_numa_nodes is false, cpu_ids is empty or the host
+// has a single node.
+Allocator *GetHugePageCPUAllocator(bool bind_numa_nodes,
+                                   const std::vector<size_t> &cpu_ids);
+
 void AdviseFree(void *addr, size_t length);
 
 }  // namespace mace
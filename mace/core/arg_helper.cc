@@ -12,6 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <set>
 #include <string>
 #include <vector>
 
@@ -20,24 +21,26 @@
 
 namespace mace {
 
-ProtoArgHelper::ProtoArgHelper(const OperatorDef &def) {
-  for (auto &arg : def.arg()) {
-    if (arg_map_.count(arg.name())) {
-      LOG(WARNING) << "Duplicated argument " << arg.name()
-                   << " found in operator " << def.name();
-    }
-    arg_map_[arg.name()] = arg;
-  }
-}
+ProtoArgHelper::ProtoArgHelper(const OperatorDef &def) : args_(&def.arg()) {}
 
-ProtoArgHelper::ProtoArgHelper(const NetDef &netdef) {
+ProtoArgHelper::ProtoArgHelper(const NetDef &netdef) : args_(&netdef.arg()) {
+  std::set<std::string> names;
   for (auto &arg : netdef.arg()) {
-    MACE_CHECK(arg_map_.count(arg.name()) == 0,
+    MACE_CHECK(names.insert(arg.name()).second,
                "Duplicated argument found in net def.");
-    arg_map_[arg.name()] = arg;
   }
 }
 
+const Argument *ProtoArgHelper::FindArg(const std::string &arg_name) const {
+  // ops have a few arguments, scanning them is cheaper than indexing
+  for (int i = args_->size() - 1; i >= 0; --i) {
+    if (args_->Get(i).name() == arg_name) {
+      return &args_->Get(i);
+    }
+  }
+  return nullptr;
+}
+
 namespace {
 template <typename InputType, typename TargetType>
 inline bool IsCastLossless(const InputType &value) {
@@ -49,14 +52,14 @@ inline bool IsCastLossless(const InputType &value) {
   template <>                                                                  \
   T ProtoArgHelper::GetOptionalArg<T>(const std::string &arg_name,             \
                                       const T &default_value) const {          \
-    if (arg_map_.count(arg_name) == 0) {                                       \
+    const Argument *arg = FindArg(arg_name);                                   \
+    if (arg == nullptr) {                                                      \
       VLOG(3) << "Using default parameter " << default_value << " for "        \
               << arg_name;                                                     \
       return default_value;                                                    \
     }                                                                          \
-    MACE_CHECK(arg_map_.at(arg_name).has_##fieldname(), "Argument ", arg_name, \
-               " not found!");                                                 \
-    auto value = arg_map_.at(arg_name).fieldname();                            \
+    MACE_CHECK(arg->has_##fieldname(), "Argument ", arg_name, " not found!");  \
+    auto value = arg->fieldname();                                             \
     if (lossless_conversion) {                                                 \
       const bool castLossless = IsCastLossless<decltype(value), T>(value);     \
       MACE_CHECK(castLossless, "Value", value, " of argument ", arg_name,      \
@@ -76,11 +79,12 @@ MACE_GET_OPTIONAL_ARGUMENT_FUNC(std::string, s, false)
   std::vector<T> ProtoArgHelper::GetRepeatedArgs<T>(                       \
       const std::string &arg_name, const std::vector<T> &default_value)    \
       const {                                                              \
-    if (arg_map_.count(arg_name) == 0) {                                   \
+    const Argument *arg = FindArg(arg_name);                               \
+    if (arg == nullptr) {                                                  \
       return default_value;                                                \
     }                                                                      \
     std::vector<T> values;                                                 \
-    for (const auto &v : arg_map_.at(arg_name).fieldname()) {              \
+    for (const auto &v : arg->fieldname()) {                               \
       if (lossless_conversion) {                                           \
         const bool castLossless = IsCastLossless<decltype(v), T>(v);       \
         MACE_CHECK(castLossless, "Value", v, " of argument ", arg_name,    \
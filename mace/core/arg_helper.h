@@ -15,7 +15,6 @@
 #ifndef MACE_CORE_ARG_HELPER_H_
 #define MACE_CORE_ARG_HELPER_H_
 
-#include <map>
 #include <string>
 #include <vector>
 
@@ -23,7 +22,8 @@
 
 namespace mace {
 
-// Refer to caffe2
+// Refer to caffe2. Looks the arguments up in the def without copying them,
+// the def must outlive the helper.
 class ProtoArgHelper {
  public:
   template <typename Def, typename T>
@@ -52,7 +52,11 @@ class ProtoArgHelper {
       const std::vector<T> &default_value = std::vector<T>()) const;
 
  private:
-  std::map<std::string, Argument> arg_map_;
+  // the last argument named arg_name, which wins over the former ones, or
+  // null if there is none
+  const Argument *FindArg(const std::string &arg_name) const;
+
+  const google::protobuf::RepeatedPtrField<Argument> *args_;
 };
 
 bool IsQuantizedModel(const NetDef &def);
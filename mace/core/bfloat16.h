@@ -0,0 +1,60 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_CORE_BFLOAT16_H_
+#define MACE_CORE_BFLOAT16_H_
+
+#include <cstdint>
+#include <cstring>
+
+namespace mace {
+
+// bfloat16, the upper half of a float: its sign, its 8 exponent bits and the
+// upper 7 bits of its mantissa. It has the range of a float with 3 decimal
+// digits, and is the input of the bfloat16 instructions of ARMv8.6 which
+// accumulate in float. Floats are rounded to the nearest even.
+class BFloat16 {
+ public:
+  BFloat16() : bits_(0) {}
+  explicit BFloat16(float value) : bits_(Round(value)) {}
+
+  operator float() const {
+    const uint32_t bits = static_cast<uint32_t>(bits_) << 16;
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+
+  uint16_t bits() const { return bits_; }
+
+ private:
+  static uint16_t Round(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    if ((bits & 0x7fffffffu) > 0x7f800000u) {
+      // a quiet NaN, which the rounding could turn into an infinity
+      return static_cast<uint16_t>((bits >> 16) | 0x40);
+    }
+    bits += 0x7fffu + ((bits >> 16) & 1);
+    return static_cast<uint16_t>(bits >> 16);
+  }
+
+  uint16_t bits_;
+};
+
+static_assert(sizeof(BFloat16) == 2, "BFloat16 is of 16 bits");
+
+}  // namespace mace
+
+#endif  // MACE_CORE_BFLOAT16_H_
@@ -17,11 +17,13 @@
 
 #include <vector>
 #include <algorithm>
+#include <mutex>  // NOLINT(build/c++11)
 #include <numeric>
 #include <functional>
 
 #include "mace/core/allocator.h"
 #include "mace/core/macros.h"
+#include "mace/core/tracer.h"
 #include "mace/core/types.h"
 
 namespace mace {
@@ -101,11 +103,16 @@ class Buffer : public BufferBase {
         is_data_owner_(true) {}
 
   Buffer(Allocator *allocator, void *data, index_t size)
+      : Buffer(allocator, data, size, false) {}
+
+  // is_data_owner - whether to free data with the allocator, e.g. a user's
+  // buffer imported by the allocator.
+  Buffer(Allocator *allocator, void *data, index_t size, bool is_data_owner)
       : BufferBase(size),
         allocator_(allocator),
         buf_(data),
         mapped_buf_(nullptr),
-        is_data_owner_(false) {}
+        is_data_owner_(is_data_owner) {}
 
   virtual ~Buffer() {
     if (mapped_buf_ != nullptr) {
@@ -158,6 +165,7 @@ class Buffer : public BufferBase {
       allocator_->Delete(buf_);
     }
     size_ = nbytes;
+    TraceAllocation("buffer", nbytes);
     return allocator_->New(nbytes, &buf_);
   }
 
@@ -196,11 +204,15 @@ class Buffer : public BufferBase {
     MACE_CHECK(is_data_owner_,
                "data is not owned by this buffer, cannot resize");
     if (nbytes != size_) {
+      // the data is kept if the allocation fails, e.g. in a run which must
+      // not allocate
+      void *buf = nullptr;
+      MACE_RETURN_IF_ERROR(allocator_->New(nbytes, &buf));
       if (buf_ != nullptr) {
         allocator_->Delete(buf_);
       }
+      buf_ = buf;
       size_ = nbytes;
-      return allocator_->New(nbytes, &buf_);
     }
     return MaceStatus::MACE_SUCCESS;
   }
@@ -211,6 +223,22 @@ class Buffer : public BufferBase {
     memcpy(mapped_buf_, reinterpret_cast<char*>(src) + offset, length);
   }
 
+  // Free the data, the next Allocate or Resize takes new data. The slices
+  // of the buffer read the new data.
+  void Release() {
+    if (!is_data_owner_) {
+      return;
+    }
+    if (mapped_buf_ != nullptr) {
+      UnMap();
+    }
+    if (buf_ != nullptr) {
+      allocator_->Delete(buf_);
+      buf_ = nullptr;
+    }
+    size_ = 0;
+  }
+
   bool OnHost() const { return allocator_->OnHost(); }
 
   void Clear() {
@@ -243,6 +271,20 @@ class Image : public BufferBase {
         buf_(nullptr),
         mapped_buf_(nullptr) {}
 
+  // Take an image created or imported by the allocator.
+  Image(Allocator *allocator,
+        void *data,
+        const std::vector<size_t> &shape,
+        DataType data_type)
+      : BufferBase(std::accumulate(shape.begin(), shape.end(), 1,
+                                   std::multiplies<index_t>()) *
+                       GetEnumTypeSize(data_type)),
+        allocator_(allocator),
+        shape_(shape),
+        data_type_(data_type),
+        buf_(data),
+        mapped_buf_(nullptr) {}
+
   virtual ~Image() {
     if (mapped_buf_ != nullptr) {
       UnMap();
@@ -296,6 +338,7 @@ class Image : public BufferBase {
     size_ = size;
     shape_ = shape;
     data_type_ = data_type;
+    TraceAllocation("image", size);
     return allocator_->NewImage(shape, data_type, &buf_);
   }
 
@@ -494,6 +537,56 @@ class BufferSlice : public BufferBase {
   index_t offset_;
 };
 
+// Host buffer whose data is only allocated and filled by the first access,
+// e.g. to expand compressed weights one op at a time on the first run.
+class LazyBuffer : public Buffer {
+ public:
+  typedef std::function<void(void *)> Filler;
+
+  LazyBuffer(Allocator *allocator, index_t size, Filler filler)
+      : Buffer(allocator), filler_(filler) {
+    size_ = size;
+  }
+
+  void *buffer() {
+    Materialize();
+    return Buffer::buffer();
+  }
+
+  const void *raw_data() const {
+    Materialize();
+    return Buffer::raw_data();
+  }
+
+  void *raw_mutable_data() {
+    Materialize();
+    return Buffer::raw_mutable_data();
+  }
+
+  using Buffer::Map;
+
+  void *Map(index_t offset, index_t length, std::vector<size_t> *pitch) const {
+    Materialize();
+    return Buffer::Map(offset, length, pitch);
+  }
+
+ private:
+  void Materialize() const {
+    // ops on concurrent branches may read the same weight
+    std::call_once(materialized_, [this] {
+      LazyBuffer *self = const_cast<LazyBuffer *>(this);
+      MACE_CHECK(self->Buffer::Allocate(size_) == MaceStatus::MACE_SUCCESS,
+                 "allocate lazy buffer of ", size_, " bytes failed");
+      filler_(self->Buffer::buffer());
+      self->filler_ = nullptr;
+    });
+  }
+
+ private:
+  Filler filler_;
+  mutable std::once_flag materialized_;
+};
+
 class ScratchBuffer: public Buffer {
  public:
   explicit ScratchBuffer(Allocator *allocator)
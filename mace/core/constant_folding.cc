@@ -0,0 +1,288 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/core/constant_folding.h"
+
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+#include "mace/core/arg_helper.h"
+#include "mace/core/op_context.h"
+#include "mace/utils/logging.h"
+#include "mace/utils/utils.h"
+
+namespace mace {
+
+namespace {
+
+typedef std::unordered_map<std::string, std::vector<index_t>> ShapeMap;
+
+// ops keeping a state between runs, their outputs change with it
+const std::unordered_set<std::string> kStatefulOps = {
+    "LSTMCell", "Splice", "TimeOffset"};
+
+// ops controlling the run of the net, kept even if their outputs are unread
+const std::unordered_set<std::string> kControlOps = {"EarlyExit"};
+
+// ops reading only the shapes of their inputs
+const std::unordered_set<std::string> kShapeOps = {
+    "InferConv2dShape", "PriorBox", "Shape"};
+
+DataType GetOpDataType(const OperatorDef &op) {
+  return static_cast<DataType>(
+      ProtoArgHelper::GetOptionalArg<OperatorDef, int>(
+          op, "T", static_cast<int>(DT_FLOAT)));
+}
+
+bool IsWeight(const Workspace *ws, const std::string &name) {
+  return ws->HasTensor(name) && ws->GetTensor(name)->is_weight();
+}
+
+// the shapes of the activations the CPU ops are run with, as SerialNet
+// transposes them
+ShapeMap RuntimeShapes(const NetDef &net_def) {
+  ShapeMap shapes;
+  DataFormat data_format_flag = NHWC;
+  for (auto &input_info : net_def.input_info()) {
+    std::vector<index_t> shape(input_info.dims().begin(),
+                               input_info.dims().end());
+    auto data_format = static_cast<DataFormat>(input_info.data_format());
+    if (data_format == NHWC && shape.size() == 4) {
+      shape = TransposeShape<index_t, index_t>(shape, {0, 3, 1, 2});
+    } else if (data_format == DataFormat::DF_NONE) {
+      data_format_flag = DataFormat::DF_NONE;
+    }
+    shapes[input_info.name()] = shape;
+  }
+  for (auto &op : net_def.op()) {
+    if (op.output_size() != op.output_shape_size()) {
+      continue;
+    }
+    for (int i = 0; i < op.output_size(); ++i) {
+      std::vector<index_t> shape(op.output_shape(i).dims().begin(),
+                                 op.output_shape(i).dims().end());
+      if (data_format_flag == NHWC && shape.size() == 4) {
+        shape = TransposeShape<index_t, index_t>(shape, {0, 3, 1, 2});
+      }
+      shapes[op.output(i)] = shape;
+    }
+  }
+  return shapes;
+}
+
+// the shapes of NHWC reshapes, only transposed to NCHW if they are weights
+std::unordered_set<std::string> ReshapeShapes(const NetDef &net_def) {
+  std::unordered_set<std::string> reshape_shapes;
+  for (auto &op : net_def.op()) {
+    if (op.type() == "Reshape" && op.input_size() > 1 &&
+        ProtoArgHelper::GetOptionalArg<OperatorDef, int>(
+            op, "data_format", DataFormat::DF_NONE) == DataFormat::NHWC) {
+      reshape_shapes.insert(op.input(1));
+    }
+  }
+  return reshape_shapes;
+}
+
+bool CanFold(const OpRegistryBase *op_registry,
+             const Workspace *ws,
+             const ShapeMap *shapes,
+             const std::unordered_set<std::string> &kept_outputs,
+             const OperatorDef &op) {
+  if (op.input_size() == 0 || kStatefulOps.count(op.type()) == 1 ||
+      kControlOps.count(op.type()) == 1 ||
+      !op_registry->HasKernel(op.type(), DeviceType::CPU,
+                              GetOpDataType(op))) {
+    return false;
+  }
+  for (auto &output : op.output()) {
+    if (kept_outputs.count(output) == 1 || ws->HasTensor(output)) {
+      return false;
+    }
+  }
+  const bool shape_only = shapes != nullptr && kShapeOps.count(op.type()) == 1;
+  for (auto &input : op.input()) {
+    if (!IsWeight(ws, input) &&
+        !(shape_only && shapes->count(input) == 1)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+MaceStatus RunOp(const OpRegistryBase *op_registry,
+                 Workspace *ws,
+                 Device *device,
+                 const OperatorDef &source) {
+  std::shared_ptr<OperatorDef> op_def(new OperatorDef(source));
+  op_def->set_device_type(DeviceType::CPU);
+  for (int i = 0; i < op_def->output_size(); ++i) {
+    const DataType dt = i < op_def->output_type_size() ?
+                        op_def->output_type(i) : GetOpDataType(*op_def);
+    ws->CreateTensor(op_def->output(i), GetCPUAllocator(), dt, true);
+  }
+  OpConstructContext construct_context(ws);
+  construct_context.set_device(device);
+  construct_context.set_operator_def(op_def);
+  construct_context.set_output_mem_type(MemoryType::CPU_BUFFER);
+  std::unique_ptr<Operation> op(
+      op_registry->CreateOperation(&construct_context, DeviceType::CPU));
+  OpInitContext init_context(ws, device);
+  MACE_RETURN_IF_ERROR(op->Init(&init_context));
+  OpContext context(ws, device);
+  return op->Run(&context);
+}
+
+// run a shape op over tensors of the shapes of the model, the activations
+// it reads are only shaped for the run
+MaceStatus RunShapeOp(const OpRegistryBase *op_registry,
+                      Workspace *ws,
+                      Device *device,
+                      const ShapeMap &shapes,
+                      const OperatorDef &op) {
+  std::vector<std::pair<Tensor *, std::vector<index_t>>> reshaped;
+  std::vector<std::string> placeholders;
+  for (auto &input : op.input()) {
+    if (IsWeight(ws, input)) {
+      continue;
+    }
+    Tensor *tensor = nullptr;
+    if (ws->HasTensor(input)) {
+      tensor = ws->GetTensor(input);
+      reshaped.emplace_back(tensor, tensor->shape());
+    } else {
+      tensor = ws->CreateTensor(input, GetCPUAllocator(), DT_FLOAT);
+      placeholders.push_back(input);
+    }
+    MACE_RETURN_IF_ERROR(tensor->Resize(shapes.at(input)));
+  }
+  MaceStatus status = RunOp(op_registry, ws, device, op);
+  for (auto &tensor : reshaped) {
+    MACE_RETURN_IF_ERROR(tensor.first->Resize(tensor.second));
+  }
+  for (auto &name : placeholders) {
+    ws->RemoveTensor(name);
+  }
+  return status;
+}
+
+}  // namespace
+
+MaceStatus FoldCPUConstantOps(
+    const OpRegistryBase *op_registry,
+    Workspace *ws,
+    Device *device,
+    bool fixed_input_shapes,
+    std::map<std::string, std::vector<index_t>> *input_shapes,
+    NetDef *net_def) {
+  ShapeMap shapes;
+  if (fixed_input_shapes) {
+    shapes = RuntimeShapes(*net_def);
+  }
+  std::unordered_set<std::string> net_outputs;
+  for (auto &output_info : net_def->output_info()) {
+    net_outputs.insert(output_info.name());
+  }
+  // the outputs read differently once they are weights are not folded
+  std::unordered_set<std::string> kept_outputs = ReshapeShapes(*net_def);
+  kept_outputs.insert(net_outputs.begin(), net_outputs.end());
+
+  std::vector<bool> kept(net_def->op_size(), true);
+  int folded_ops = 0;
+  // whether some shapes of activations are folded
+  bool shapes_folded = false;
+  for (int i = 0; i < net_def->op_size(); ++i) {
+    const OperatorDef &op = net_def->op(i);
+    if (!CanFold(op_registry, ws, fixed_input_shapes ? &shapes : nullptr,
+                 kept_outputs, op)) {
+      continue;
+    }
+    VLOG(2) << "Fold constant op " << op.name() << "(" << op.type() << ")";
+    if (kShapeOps.count(op.type()) == 1) {
+      for (auto &input : op.input()) {
+        shapes_folded = shapes_folded || !IsWeight(ws, input);
+      }
+      MACE_RETURN_IF_ERROR(RunShapeOp(op_registry, ws, device, shapes, op));
+    } else {
+      MACE_RETURN_IF_ERROR(RunOp(op_registry, ws, device, op));
+    }
+    kept[i] = false;
+    ++folded_ops;
+  }
+  // the shapes of the activations follow those of the inputs
+  if (shapes_folded) {
+    for (auto &input_info : net_def->input_info()) {
+      (*input_shapes)[input_info.name()] = shapes.at(input_info.name());
+    }
+  }
+
+  // the ops no kept op or output of the net reads, from the back
+  std::unordered_set<std::string> used(net_outputs);
+  int dead_ops = 0;
+  for (int i = net_def->op_size() - 1; i >= 0; --i) {
+    if (!kept[i]) {
+      continue;
+    }
+    const OperatorDef &op = net_def->op(i);
+    bool live = op.output_size() == 0 || kControlOps.count(op.type()) == 1;
+    for (auto &output : op.output()) {
+      live = live || used.count(output) == 1;
+    }
+    if (!live) {
+      VLOG(2) << "Remove dead op " << op.name() << "(" << op.type() << ")";
+      kept[i] = false;
+      ++dead_ops;
+      continue;
+    }
+    used.insert(op.input().begin(), op.input().end());
+  }
+  if (folded_ops == 0 && dead_ops == 0) {
+    return MaceStatus::MACE_SUCCESS;
+  }
+
+  NetDef kept_ops;
+  kept_ops.mutable_op()->Reserve(net_def->op_size() - folded_ops - dead_ops);
+  std::unordered_set<std::string> removable;
+  for (int i = 0; i < net_def->op_size(); ++i) {
+    const OperatorDef &op = net_def->op(i);
+    if (kept[i]) {
+      *kept_ops.add_op() = op;
+      continue;
+    }
+    removable.insert(op.input().begin(), op.input().end());
+    removable.insert(op.output().begin(), op.output().end());
+  }
+  // the buffers of the weights kept, folded outputs may reuse the buffers
+  // of their inputs, e.g. those of Reshape
+  std::unordered_set<const BufferBase *> kept_buffers;
+  for (auto &name : used) {
+    if (IsWeight(ws, name)) {
+      kept_buffers.insert(ws->GetTensor(name)->UnderlyingBuffer());
+    }
+  }
+  // the weights, loaded or folded, only the removed ops read
+  for (auto &name : removable) {
+    if (used.count(name) == 0 && IsWeight(ws, name) &&
+        kept_buffers.count(ws->GetTensor(name)->UnderlyingBuffer()) == 0) {
+      ws->RemoveTensor(name);
+    }
+  }
+  net_def->mutable_op()->Swap(kept_ops.mutable_op());
+  VLOG(1) << "Fold " << folded_ops << " constant ops and remove " << dead_ops
+          << " dead ops, " << net_def->op_size() << " ops left";
+  return MaceStatus::MACE_SUCCESS;
+}
+
+}  // namespace mace
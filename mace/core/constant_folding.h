@@ -0,0 +1,50 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_CORE_CONSTANT_FOLDING_H_
+#define MACE_CORE_CONSTANT_FOLDING_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "mace/core/device.h"
+#include "mace/core/operator.h"
+#include "mace/core/workspace.h"
+#include "mace/proto/mace.pb.h"
+#include "mace/public/mace.h"
+
+namespace mace {
+
+// Run the CPU ops whose inputs are all weights once, keep their outputs as
+// new weights of the workspace and remove them from the net, then remove
+// the ops whose outputs no op or output of the net reads, and the weights
+// only the removed ops read. With fixed_input_shapes, Shape,
+// InferConv2dShape and PriorBox, which only read the shapes of their
+// inputs, are folded over activations too, assuming the shapes of the model;
+// the input shapes are then returned in input_shapes, the runs must be fed
+// inputs of these shapes. Stateful ops and the ops of the
+// outputs of the net are kept. Call it after the weights are loaded and
+// before the net is created.
+MaceStatus FoldCPUConstantOps(
+    const OpRegistryBase *op_registry,
+    Workspace *ws,
+    Device *device,
+    bool fixed_input_shapes,
+    std::map<std::string, std::vector<index_t>> *input_shapes,
+    NetDef *net_def);
+
+}  // namespace mace
+
+#endif  // MACE_CORE_CONSTANT_FOLDING_H_
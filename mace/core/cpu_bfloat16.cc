@@ -0,0 +1,142 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/core/cpu_bfloat16.h"
+
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "mace/core/arg_helper.h"
+#include "mace/core/cpu_blocked_layout.h"
+#include "mace/core/cpu_nhwc_layout.h"
+#include "mace/utils/logging.h"
+
+namespace mace {
+
+namespace {
+
+int GetIntArg(const OperatorDef &op, const std::string &name, int value) {
+  return ProtoArgHelper::GetOptionalArg<OperatorDef, int>(op, name, value);
+}
+
+bool AllEqual(const std::vector<int> &values, int value) {
+  for (int v : values) {
+    if (v != value) {
+      return false;
+    }
+  }
+  return true;
+}
+
+const Tensor *GetFloatWeight(const Workspace *ws, const std::string &name) {
+  const Tensor *tensor = ws->GetTensor(name);
+  return tensor != nullptr && tensor->is_weight() &&
+      tensor->dtype() == DT_FLOAT ? tensor : nullptr;
+}
+
+// whether the weight, the second input, of a float op is multiplied in
+// bfloat16, by the ops of the shapes and the args the bfloat16 GEMM takes
+bool RunInBFloat16(const Workspace *ws, const OperatorDef &op) {
+  if (op.input_size() < 2 ||
+      GetIntArg(op, "T", static_cast<int>(DT_FLOAT)) != DT_FLOAT ||
+      GetIntArg(op, "weight_bits", 0) > 0 ||
+      GetIntArg(op, "sparse_weight", 0) == 1 ||
+      GetIntArg(op, kChannelBlockArg, 0) > 0 ||
+      GetIntArg(op, kNHWCArg, 0) == 1) {
+    return false;
+  }
+  const Tensor *weight = GetFloatWeight(ws, op.input(1));
+  if (weight == nullptr) {
+    return false;
+  }
+  if (op.type() == "FullyConnected") {
+    return weight->dim_size() == 4;
+  }
+  if (op.type() == "MatMul") {
+    return weight->dim_size() == 2 &&
+        GetIntArg(op, "transpose_a", 0) == 0 &&
+        GetIntArg(op, "transpose_b", 0) == 1 &&
+        ProtoArgHelper::GetRepeatedArgs<OperatorDef, int>(
+            op, "perm_a").empty() &&
+        ProtoArgHelper::GetRepeatedArgs<OperatorDef, int>(
+            op, "perm_b").empty();
+  }
+  if (op.type() == "Conv2D") {
+    const std::vector<int> strides =
+        ProtoArgHelper::GetRepeatedArgs<OperatorDef, int>(op, "strides");
+    return weight->dim_size() == 4 && weight->dim(2) == 1 &&
+        weight->dim(3) == 1 && !strides.empty() && AllEqual(strides, 1) &&
+        AllEqual(ProtoArgHelper::GetRepeatedArgs<OperatorDef, int>(
+            op, "dilations"), 1) &&
+        AllEqual(ProtoArgHelper::GetRepeatedArgs<OperatorDef, int>(
+            op, "padding_values"), 0) &&
+        GetIntArg(op, "depth_to_space", 1) == 1;
+  }
+  return false;
+}
+
+MaceStatus ConvertWeight(const std::string &name,
+                         const std::string &bf16_name,
+                         Workspace *ws) {
+  if (ws->HasTensor(bf16_name)) {
+    return MaceStatus::MACE_SUCCESS;
+  }
+  const Tensor *weight = ws->GetTensor(name);
+  Tensor *bf16_weight =
+      ws->CreateTensor(bf16_name, GetCPUAllocator(), DT_BFLOAT16, true);
+  MACE_RETURN_IF_ERROR(bf16_weight->Resize(weight->shape()));
+  bf16_weight->set_data_format(weight->data_format());
+  Tensor::MappingGuard weight_guard(weight);
+  const float *src = weight->data<float>();
+  BFloat16 *dst = bf16_weight->mutable_data<BFloat16>();
+  for (index_t i = 0; i < weight->size(); ++i) {
+    dst[i] = BFloat16(src[i]);
+  }
+  return MaceStatus::MACE_SUCCESS;
+}
+
+}  // namespace
+
+MaceStatus ConvertToCPUBFloat16(Workspace *ws, NetDef *net_def) {
+  int bf16_ops = 0;
+  for (OperatorDef &op : *net_def->mutable_op()) {
+    if (!RunInBFloat16(ws, op)) {
+      continue;
+    }
+    const std::string bf16_name = op.input(1) + "_bf16";
+    MACE_RETURN_IF_ERROR(ConvertWeight(op.input(1), bf16_name, ws));
+    op.set_input(1, bf16_name);
+    ++bf16_ops;
+  }
+
+  // float weights converted to bfloat16 and read by no float op
+  std::unordered_set<std::string> used;
+  for (auto &op : net_def->op()) {
+    for (auto &input : op.input()) {
+      used.insert(input);
+    }
+  }
+  for (auto &tensor : net_def->tensors()) {
+    if (used.count(tensor.name()) == 0 &&
+        used.count(tensor.name() + "_bf16") == 1) {
+      ws->RemoveTensor(tensor.name());
+    }
+  }
+  VLOG(1) << "Run " << bf16_ops << " of " << net_def->op_size()
+          << " CPU ops with bfloat16 weights";
+  return MaceStatus::MACE_SUCCESS;
+}
+
+}  // namespace mace
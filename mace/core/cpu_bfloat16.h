@@ -0,0 +1,35 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_CORE_CPU_BFLOAT16_H_
+#define MACE_CORE_CPU_BFLOAT16_H_
+
+#include "mace/core/workspace.h"
+#include "mace/proto/mace.pb.h"
+#include "mace/public/mace.h"
+
+namespace mace {
+
+// Rewrite a float CPU net to multiply the weights of its FullyConnected ops,
+// its MatMul ops by a transposed 2D weight and its 1x1 Conv2D ops of stride
+// 1 in bfloat16. Their float weights are converted once into new bfloat16
+// weights of the workspace, which the ops run by their bfloat16 GEMM with
+// float activations and float sums. The float weights no op reads any more
+// are removed. Call it after the weights are loaded and before the net is
+// created.
+MaceStatus ConvertToCPUBFloat16(Workspace *ws, NetDef *net_def);
+
+}  // namespace mace
+
+#endif  // MACE_CORE_CPU_BFLOAT16_H_
@@ -0,0 +1,284 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "mace/core/cpu_blocked_layout.h"
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "mace/core/arg_helper.h"
+#include "mace/utils/logging.h"
+
+namespace mace {
+
+namespace {
+
+DataType GetOpDataType(const OperatorDef &op) {
+  return static_cast<DataType>(
+      ProtoArgHelper::GetOptionalArg<OperatorDef, int>(
+          op, "T", static_cast<int>(DT_FLOAT)));
+}
+
+void SetIntArg(const std::string &name, int64_t value, OperatorDef *op) {
+  for (int i = 0; i < op->arg_size(); ++i) {
+    if (op->arg(i).name() == name) {
+      op->mutable_arg(i)->set_i(value);
+      return;
+    }
+  }
+  Argument *arg = op->add_arg();
+  arg->set_name(name);
+  arg->set_i(value);
+}
+
+// NHWC => [N, C / block, H, W, block]
+std::vector<int64_t> BlockedShape(const std::vector<int64_t> &shape,
+                                  const int channel_block) {
+  return {shape[0], shape[3] / channel_block, shape[1], shape[2],
+          channel_block};
+}
+
+// a transform to NCHWc of channel_block, or back to NCHW if it is 0
+OperatorDef CreateTransformOpDef(const std::string &input_name,
+                                 const std::string &output_name,
+                                 const int channel_block,
+                                 const std::vector<int64_t> &shape) {
+  OperatorDef op;
+  op.set_name("mace_node_" + output_name);
+  op.set_type("NCHWcTransform");
+  op.add_input(input_name);
+  op.add_output(output_name);
+  op.add_output_type(DT_FLOAT);
+  op.set_device_type(DeviceType::CPU);
+  SetIntArg("T", DT_FLOAT, &op);
+  SetIntArg(kChannelBlockArg, channel_block, &op);
+  OutputShape *output_shape = op.add_output_shape();
+  for (auto dim : shape) {
+    output_shape->add_dims(dim);
+  }
+  return op;
+}
+
+// a Conv2D adding its last input before the activation
+bool HasResidual(const OperatorDef &op) {
+  return op.type() == "Conv2D" &&
+      ProtoArgHelper::GetOptionalArg<OperatorDef, int>(op, "residual", 0) == 1;
+}
+
+// a Conv2D storing its output moved by a depth to space
+bool HasDepthToSpace(const OperatorDef &op) {
+  return op.type() == "Conv2D" &&
+      ProtoArgHelper::GetOptionalArg<OperatorDef, int>(
+          op, "depth_to_space", 1) > 1;
+}
+
+// a Conv2D of a filter marked by the converter for the block-sparse kernel
+bool IsSparse(const OperatorDef &op) {
+  return ProtoArgHelper::GetOptionalArg<OperatorDef, int>(
+      op, "sparse_weight", 0) == 1;
+}
+
+const Tensor *GetFloatWeight(const Workspace *ws, const std::string &name) {
+  const Tensor *tensor = ws->GetTensor(name);
+  return tensor != nullptr && tensor->is_weight() &&
+      tensor->dtype() == DT_FLOAT ? tensor : nullptr;
+}
+
+}  // namespace
+
+MaceStatus ConvertToCPUBlockedLayout(const Workspace *ws,
+                                     const int channel_block,
+                                     NetDef *net_def) {
+  MACE_CHECK(channel_block == 4 || channel_block == 8,
+             "channel block should be 4 or 8, not ", channel_block);
+  // NHWC shapes of the activations, as given by the net
+  std::unordered_map<std::string, std::vector<int64_t>> tensor_shapes;
+  // the names of the NCHW and the NCHWc tensors of the activations
+  std::unordered_map<std::string, std::string> nchw_names;
+  std::unordered_map<std::string, std::string> blocked_names;
+  for (auto &input_info : net_def->input_info()) {
+    if (static_cast<DataFormat>(input_info.data_format()) == DF_NONE) {
+      VLOG(1) << "Input " << input_info.name() << " has no data format,"
+              << " keep the net in NCHW";
+      return MaceStatus::MACE_SUCCESS;
+    }
+    tensor_shapes[input_info.name()] = std::vector<int64_t>(
+        input_info.dims().begin(), input_info.dims().end());
+    nchw_names[input_info.name()] = input_info.name();
+  }
+  std::unordered_set<std::string> net_outputs;
+  for (auto &output_info : net_def->output_info()) {
+    net_outputs.insert(output_info.name());
+  }
+
+  auto is_blocked = [&](const std::string &name) {
+    return blocked_names.count(name) == 1;
+  };
+  // blocked already or of a known shape of whole blocks
+  auto can_be_blocked = [&](const std::string &name) {
+    if (is_blocked(name)) {
+      return true;
+    }
+    auto shape = tensor_shapes.find(name);
+    return nchw_names.count(name) == 1 && shape != tensor_shapes.end() &&
+        shape->second.size() == 4 && shape->second[3] % channel_block == 0;
+  };
+  // Conv2D and DepthwiseConv2d are blocked wherever their weights allow,
+  // the elementwise ops and pooling only follow a blocked input
+  auto run_blocked = [&](const OperatorDef &op) {
+    if (GetOpDataType(op) != DT_FLOAT || op.input_size() == 0 ||
+        op.output_size() != 1 || op.output_shape_size() != 1 ||
+        op.output_shape(0).dims_size() != 4 ||
+        op.output_shape(0).dims(3) % channel_block != 0) {
+      return false;
+    }
+    const std::string &type = op.type();
+    if (type == "Conv2D" || type == "DepthwiseConv2d") {
+      // the residual of Conv2D, its last input, is blocked as the output
+      const int weight_size = op.input_size() - (HasResidual(op) ? 1 : 0);
+      // the pruned 1x1 convs run the block-sparse kernel in NCHW, and the
+      // depth to space is stored in NCHW
+      if (weight_size < 2 || weight_size > 3 ||
+          !can_be_blocked(op.input(0)) || IsSparse(op) ||
+          HasDepthToSpace(op)) {
+        return false;
+      }
+      if (HasResidual(op)) {
+        const std::string &residual = op.input(weight_size);
+        if (!can_be_blocked(residual) ||
+            tensor_shapes[residual] != std::vector<int64_t>(
+                op.output_shape(0).dims().begin(),
+                op.output_shape(0).dims().end())) {
+          return false;
+        }
+      }
+      const Tensor *bias =
+          weight_size == 3 ? GetFloatWeight(ws, op.input(2)) : nullptr;
+      if (weight_size == 3 && bias == nullptr) {
+        return false;
+      }
+      const Tensor *filter = GetFloatWeight(ws, op.input(1));
+      if (filter == nullptr || filter->dim_size() != 4) {
+        return false;
+      }
+      return type == "Conv2D" ? filter->dim(1) % channel_block == 0
+                              : filter->dim(0) == 1;
+    } else if (type == "Pooling") {
+      // the windows of count_include_pad are divided in NCHW only
+      return op.input_size() == 1 && is_blocked(op.input(0)) &&
+          ProtoArgHelper::GetOptionalArg<OperatorDef, int>(
+              op, "count_include_pad", 0) == 0;
+    } else if (type == "Activation") {
+      // PRELU reads the alpha of each channel
+      return op.input_size() == 1 && is_blocked(op.input(0)) &&
+          ProtoArgHelper::GetOptionalArg<OperatorDef, std::string>(
+              op, "activation", "NOOP") != "PRELU";
+    } else if (type == "Eltwise") {
+      // no broadcast, which would read the channels in NCHW
+      if (op.input_size() > 2) {
+        return false;
+      }
+      const std::vector<int64_t> output_shape(
+          op.output_shape(0).dims().begin(), op.output_shape(0).dims().end());
+      bool has_blocked_input = false;
+      for (auto &input : op.input()) {
+        if (!can_be_blocked(input) || tensor_shapes[input] != output_shape) {
+          return false;
+        }
+        has_blocked_input = has_blocked_input || is_blocked(input);
+      }
+      return has_blocked_input;
+    }
+    return false;
+  };
+
+  NetDef converted;
+  converted.mutable_op()->Reserve(net_def->op_size());
+  int blocked_ops = 0;
+  for (const OperatorDef &source : net_def->op()) {
+    OperatorDef op = source;
+    const bool to_blocked = run_blocked(op);
+    for (int i = 0; i < op.input_size(); ++i) {
+      const std::string input = op.input(i);
+      // the weights of Conv2D and DepthwiseConv2d are packed by the op
+      const bool blocked_input =
+          to_blocked && (i == 0 || op.type() == "Eltwise" ||
+                         (HasResidual(op) && i == op.input_size() - 1));
+      if (blocked_input) {
+        if (!is_blocked(input)) {
+          const std::string blocked_name = input + "_nchwc";
+          *converted.add_op() = CreateTransformOpDef(
+              nchw_names[input], blocked_name, channel_block,
+              BlockedShape(tensor_shapes[input], channel_block));
+          blocked_names[input] = blocked_name;
+        }
+        op.set_input(i, blocked_names[input]);
+      } else if (nchw_names.count(input) == 1) {
+        op.set_input(i, nchw_names[input]);
+      } else if (is_blocked(input)) {
+        const std::string nchw_name = input + "_nchw";
+        *converted.add_op() = CreateTransformOpDef(
+            blocked_names[input], nchw_name, 0, tensor_shapes[input]);
+        nchw_names[input] = nchw_name;
+        op.set_input(i, nchw_name);
+      }
+    }
+
+    // the outputs of the net are read as NCHW
+    std::vector<OperatorDef> output_transforms;
+    for (int i = 0; i < op.output_size(); ++i) {
+      const std::string output = op.output(i);
+      if (i < source.output_shape_size()) {
+        tensor_shapes[output] = std::vector<int64_t>(
+            source.output_shape(i).dims().begin(),
+            source.output_shape(i).dims().end());
+      }
+      if (!to_blocked) {
+        nchw_names[output] = output;
+        continue;
+      }
+      OutputShape *output_shape = op.mutable_output_shape(i);
+      output_shape->clear_dims();
+      for (auto dim : BlockedShape(tensor_shapes[output], channel_block)) {
+        output_shape->add_dims(dim);
+      }
+      if (net_outputs.count(output) == 1) {
+        op.set_output(i, output + "_nchwc");
+        output_transforms.push_back(CreateTransformOpDef(
+            output + "_nchwc", output, 0, tensor_shapes[output]));
+        nchw_names[output] = output;
+      }
+      blocked_names[output] = op.output(i);
+    }
+    if (to_blocked) {
+      SetIntArg(kChannelBlockArg, channel_block, &op);
+      if (op.type() == "Eltwise") {
+        SetIntArg("data_format", DF_NONE, &op);
+      }
+      ++blocked_ops;
+    }
+    *converted.add_op() = op;
+    for (auto &transform : output_transforms) {
+      *converted.add_op() = transform;
+    }
+  }
+
+  net_def->mutable_op()->Swap(converted.mutable_op());
+  VLOG(1) << "Run " << blocked_ops << " of " << net_def->op_size()
+          << " CPU ops in NCHW" << channel_block << "c";
+  return MaceStatus::MACE_SUCCESS;
+}
+
+}  // namespace mace
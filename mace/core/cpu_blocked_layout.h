@@ -0,0 +1,41 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef MACE_CORE_CPU_BLOCKED_LAYOUT_H_
+#define MACE_CORE_CPU_BLOCKED_LAYOUT_H_
+
+#include "mace/core/workspace.h"
+#include "mace/proto/mace.pb.h"
+#include "mace/public/mace.h"
+
+namespace mace {
+
+// Arg of the CPU ops converted to the NCHWc layout, the number of channels
+// of a block. Their activations are [N, C / block, H, W, block] instead of
+// NCHW.
+constexpr const char *kChannelBlockArg = "channel_block";
+
+// Rewrite a CPU net to run the float Conv2D and DepthwiseConv2d, and the
+// Pooling, Eltwise and Activation ops between them, in the NCHWc layout of
+// channel_block (4 or 8), which keeps the channels of a pixel in whole
+// vectors. Only tensors of channels a multiple of the block are blocked.
+// NCHWcTransform ops are inserted where a tensor goes between an NCHW op
+// and an NCHWc op, so the inputs and outputs of the net stay NCHW. Call it
+// after the weights are loaded and before the net is created.
+MaceStatus ConvertToCPUBlockedLayout(const Workspace *ws,
+                                     const int channel_block,
+                                     NetDef *net_def);
+
+}  // namespace mace
+
+#endif  // MACE_CORE_CPU_BLOCKED_LAYOUT_H_
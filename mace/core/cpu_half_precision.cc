@@ -0,0 +1,227 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/core/cpu_half_precision.h"
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "mace/utils/logging.h"
+
+namespace mace {
+
+namespace {
+
+DataType GetOpDataType(const OperatorDef &op) {
+  return static_cast<DataType>(
+      ProtoArgHelper::GetOptionalArg<OperatorDef, int>(
+          op, "T", static_cast<int>(DT_FLOAT)));
+}
+
+DataType GetOutputDataType(const OperatorDef &op, int idx) {
+  return idx < op.output_type_size() ? op.output_type(idx)
+                                     : GetOpDataType(op);
+}
+
+void SetIntArg(const std::string &name, int64_t value, OperatorDef *op) {
+  for (int i = 0; i < op->arg_size(); ++i) {
+    if (op->arg(i).name() == name) {
+      op->mutable_arg(i)->set_i(value);
+      return;
+    }
+  }
+  Argument *arg = op->add_arg();
+  arg->set_name(name);
+  arg->set_i(value);
+}
+
+void SetOutputType(DataType dt, OperatorDef *op) {
+  op->clear_output_type();
+  for (int i = 0; i < op->output_size(); ++i) {
+    op->add_output_type(dt);
+  }
+}
+
+OperatorDef CreateCastOpDef(const std::string &input_name,
+                            const std::string &output_name,
+                            const DataType src_dt,
+                            const DataType dst_dt,
+                            const OutputShape *shape) {
+  OperatorDef op;
+  op.set_name("mace_node_" + output_name);
+  op.set_type("Cast");
+  op.add_input(input_name);
+  op.add_output(output_name);
+  op.add_output_type(dst_dt);
+  op.set_device_type(DeviceType::CPU);
+  SetIntArg("T", src_dt, &op);
+  if (src_dt == DT_HALF) {
+    SetIntArg(kHalfPrecisionArg, 1, &op);
+  }
+  if (shape != nullptr) {
+    *op.add_output_shape() = *shape;
+  }
+  return op;
+}
+
+bool IsFloatWeight(const Workspace *ws, const std::string &name) {
+  const Tensor *tensor = ws->GetTensor(name);
+  return tensor != nullptr && tensor->is_weight() &&
+      tensor->dtype() == DT_FLOAT;
+}
+
+MaceStatus ConvertWeight(const std::string &name,
+                         const std::string &half_name,
+                         Workspace *ws) {
+  if (ws->HasTensor(half_name)) {
+    return MaceStatus::MACE_SUCCESS;
+  }
+  const Tensor *weight = ws->GetTensor(name);
+  Tensor *half_weight =
+      ws->CreateTensor(half_name, GetCPUAllocator(), DT_HALF, true);
+  MACE_RETURN_IF_ERROR(half_weight->Resize(weight->shape()));
+  half_weight->set_data_format(weight->data_format());
+  Tensor::MappingGuard weight_guard(weight);
+  const float *src = weight->data<float>();
+  half *dst = half_weight->mutable_data<half>();
+  for (index_t i = 0; i < weight->size(); ++i) {
+    dst[i] = half_float::half_cast<half>(src[i]);
+  }
+  return MaceStatus::MACE_SUCCESS;
+}
+
+}  // namespace
+
+MaceStatus ConvertToCPUHalfPrecision(const OpRegistryBase *op_registry,
+                                     Workspace *ws,
+                                     NetDef *net_def) {
+  // data type and shape of each activation after the conversion
+  std::unordered_map<std::string, DataType> tensor_types;
+  std::unordered_map<std::string, const OutputShape *> tensor_shapes;
+  std::vector<OutputShape> input_shapes(net_def->input_info_size());
+  for (int i = 0; i < net_def->input_info_size(); ++i) {
+    const InputInfo &input_info = net_def->input_info(i);
+    tensor_types[input_info.name()] = DT_FLOAT;
+    for (auto dim : input_info.dims()) {
+      input_shapes[i].add_dims(dim);
+    }
+    tensor_shapes[input_info.name()] = &input_shapes[i];
+  }
+  std::unordered_set<std::string> net_outputs;
+  for (auto &output_info : net_def->output_info()) {
+    net_outputs.insert(output_info.name());
+  }
+
+  NetDef converted;
+  converted.mutable_op()->Reserve(net_def->op_size());
+  // cast ops already inserted, by output name
+  std::unordered_set<std::string> casts;
+  int half_ops = 0;
+  for (const OperatorDef &source : net_def->op()) {
+    OperatorDef op = source;
+    bool to_half = GetOpDataType(op) != DT_UINT8 &&
+        op_registry->HasKernel(op.type(), DeviceType::CPU, DT_HALF);
+    for (int i = 0; i < op.output_size() && to_half; ++i) {
+      DataType dt = GetOutputDataType(op, i);
+      to_half = dt == DT_FLOAT || dt == DT_HALF;
+    }
+    for (int i = 0; i < op.input_size() && to_half; ++i) {
+      auto type = tensor_types.find(op.input(i));
+      to_half = type != tensor_types.end() ?
+                type->second == DT_FLOAT || type->second == DT_HALF :
+                IsFloatWeight(ws, op.input(i));
+    }
+    const DataType op_dt = to_half ? DT_HALF : DT_FLOAT;
+    if (to_half || GetOpDataType(op) == DT_HALF) {
+      SetIntArg("T", op_dt, &op);
+    }
+    for (int i = 0; i < op.output_type_size(); ++i) {
+      if (op.output_type(i) == DT_HALF) {
+        op.set_output_type(i, DT_FLOAT);
+      }
+    }
+
+    for (int i = 0; i < op.input_size(); ++i) {
+      const std::string &input = op.input(i);
+      auto type = tensor_types.find(input);
+      if (type == tensor_types.end()) {
+        if (to_half) {
+          const std::string half_name = input + "_half";
+          MACE_RETURN_IF_ERROR(ConvertWeight(input, half_name, ws));
+          op.set_input(i, half_name);
+        }
+        continue;
+      }
+      const DataType dt = type->second;
+      if ((dt != DT_FLOAT && dt != DT_HALF) || dt == op_dt) {
+        continue;
+      }
+      const std::string cast_name =
+          input + (op_dt == DT_HALF ? "_half" : "_float");
+      if (casts.count(cast_name) == 0) {
+        *converted.add_op() = CreateCastOpDef(
+            input, cast_name, dt, op_dt, tensor_shapes[input]);
+        casts.insert(cast_name);
+      }
+      op.set_input(i, cast_name);
+    }
+
+    if (to_half) {
+      SetIntArg(kHalfPrecisionArg, 1, &op);
+      SetOutputType(DT_HALF, &op);
+      ++half_ops;
+    }
+    // the outputs of the net are read as float
+    std::vector<OperatorDef> output_casts;
+    for (int i = 0; i < op.output_size(); ++i) {
+      const OutputShape *shape =
+          i < source.output_shape_size() ? &source.output_shape(i) : nullptr;
+      tensor_types[op.output(i)] = GetOutputDataType(op, i);
+      tensor_shapes[op.output(i)] = shape;
+      if (to_half && net_outputs.count(op.output(i)) == 1) {
+        const std::string output = op.output(i);
+        op.set_output(i, output + "_half");
+        output_casts.push_back(CreateCastOpDef(
+            output + "_half", output, DT_HALF, DT_FLOAT, shape));
+        tensor_types[output] = DT_FLOAT;
+      }
+    }
+    *converted.add_op() = op;
+    for (auto &cast : output_casts) {
+      *converted.add_op() = cast;
+    }
+  }
+
+  // float weights converted to half and read by no float op
+  std::unordered_set<std::string> used;
+  for (auto &op : converted.op()) {
+    for (auto &input : op.input()) {
+      used.insert(input);
+    }
+  }
+  for (auto &tensor : net_def->tensors()) {
+    if (used.count(tensor.name()) == 0 &&
+        used.count(tensor.name() + "_half") == 1) {
+      ws->RemoveTensor(tensor.name());
+    }
+  }
+  net_def->mutable_op()->Swap(converted.mutable_op());
+  VLOG(1) << "Run " << half_ops << " of " << net_def->op_size()
+          << " CPU ops in half precision";
+  return MaceStatus::MACE_SUCCESS;
+}
+
+}  // namespace mace
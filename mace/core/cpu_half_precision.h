@@ -0,0 +1,41 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_CORE_CPU_HALF_PRECISION_H_
+#define MACE_CORE_CPU_HALF_PRECISION_H_
+
+#include "mace/core/operator.h"
+#include "mace/core/workspace.h"
+#include "mace/proto/mace.pb.h"
+#include "mace/public/mace.h"
+
+namespace mace {
+
+// Arg marking the CPU ops converted to half, which keep their T = DT_HALF
+// instead of running in float.
+constexpr const char *kHalfPrecisionArg = "half_precision";
+
+// Rewrite a CPU net to run the ops with half kernels in half precision.
+// Their float weights are converted once into new half weights of the
+// workspace, float weights no op reads any more are removed. Cast ops are
+// inserted where a tensor goes between a float op and a half op, so the
+// inputs and outputs of the net stay float. Call it after the weights are
+// loaded and before the net is created.
+MaceStatus ConvertToCPUHalfPrecision(const OpRegistryBase *op_registry,
+                                     Workspace *ws,
+                                     NetDef *net_def);
+
+}  // namespace mace
+
+#endif  // MACE_CORE_CPU_HALF_PRECISION_H_
@@ -0,0 +1,307 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "mace/core/cpu_nhwc_layout.h"
+
+#include <unordered_map>
+#include <vector>
+
+#include "mace/core/arg_helper.h"
+#include "mace/utils/logging.h"
+
+namespace mace {
+
+namespace {
+
+DataType GetOpDataType(const OperatorDef &op) {
+  return static_cast<DataType>(
+      ProtoArgHelper::GetOptionalArg<OperatorDef, int>(
+          op, "T", static_cast<int>(DT_FLOAT)));
+}
+
+void SetIntArg(const std::string &name, int64_t value, OperatorDef *op) {
+  for (int i = 0; i < op->arg_size(); ++i) {
+    if (op->arg(i).name() == name) {
+      op->mutable_arg(i)->set_i(value);
+      return;
+    }
+  }
+  Argument *arg = op->add_arg();
+  arg->set_name(name);
+  arg->set_i(value);
+}
+
+// a transpose to NHWC, or back to NCHW if to_nhwc is false, of the NHWC
+// shape, which the net transposes for the NCHW output
+OperatorDef CreateTransposeOpDef(const std::string &input_name,
+                                 const std::string &output_name,
+                                 const bool to_nhwc,
+                                 const std::vector<int64_t> &shape) {
+  OperatorDef op;
+  op.set_name("mace_node_" + output_name);
+  op.set_type("Transpose");
+  op.add_input(input_name);
+  op.add_output(output_name);
+  op.add_output_type(DT_FLOAT);
+  op.set_device_type(DeviceType::CPU);
+  SetIntArg("T", DT_FLOAT, &op);
+  Argument *dims = op.add_arg();
+  dims->set_name("dims");
+  const std::vector<int> perm = to_nhwc ? std::vector<int>{0, 2, 3, 1}
+                                        : std::vector<int>{0, 3, 1, 2};
+  for (int dim : perm) {
+    dims->add_ints(dim);
+  }
+  if (to_nhwc) {
+    SetIntArg(kNHWCArg, 1, &op);
+  }
+  OutputShape *output_shape = op.add_output_shape();
+  for (auto dim : shape) {
+    output_shape->add_dims(dim);
+  }
+  return op;
+}
+
+// a Conv2D adding its last input before the activation
+bool HasResidual(const OperatorDef &op) {
+  return op.type() == "Conv2D" &&
+      ProtoArgHelper::GetOptionalArg<OperatorDef, int>(op, "residual", 0) == 1;
+}
+
+// a Conv2D of a filter marked by the converter for the block-sparse kernel,
+// or storing its output moved by a depth to space, both run in NCHW
+bool NeedsNCHW(const OperatorDef &op) {
+  return ProtoArgHelper::GetOptionalArg<OperatorDef, int>(
+             op, "sparse_weight", 0) == 1 ||
+      ProtoArgHelper::GetOptionalArg<OperatorDef, int>(
+          op, "depth_to_space", 1) > 1;
+}
+
+const Tensor *GetFloatWeight(const Workspace *ws, const std::string &name) {
+  const Tensor *tensor = ws->GetTensor(name);
+  return tensor != nullptr && tensor->is_weight() &&
+      tensor->dtype() == DT_FLOAT ? tensor : nullptr;
+}
+
+// Converts the ops of net_def, whose inputs in nhwc_inputs are fed NHWC,
+// into converted, and returns the number of the NHWC ops. read_inputs are
+// the inputs of nhwc_inputs read directly by an NHWC op.
+int ConvertOps(const Workspace *ws,
+               const NetDef &net_def,
+               const std::unordered_set<std::string> &nhwc_inputs,
+               NetDef *converted,
+               std::unordered_set<std::string> *read_inputs,
+               std::unordered_set<std::string> *nhwc_outputs) {
+  // NHWC shapes of the activations, as given by the net
+  std::unordered_map<std::string, std::vector<int64_t>> tensor_shapes;
+  // the names of the NCHW and the NHWC tensors of the activations
+  std::unordered_map<std::string, std::string> nchw_names;
+  std::unordered_map<std::string, std::string> nhwc_names;
+  for (auto &input_info : net_def.input_info()) {
+    tensor_shapes[input_info.name()] = std::vector<int64_t>(
+        input_info.dims().begin(), input_info.dims().end());
+    if (nhwc_inputs.count(input_info.name()) == 1) {
+      nhwc_names[input_info.name()] = input_info.name();
+    } else {
+      nchw_names[input_info.name()] = input_info.name();
+    }
+  }
+  std::unordered_set<std::string> net_outputs;
+  for (auto &output_info : net_def.output_info()) {
+    net_outputs.insert(output_info.name());
+  }
+
+  auto is_nhwc = [&](const std::string &name) {
+    return nhwc_names.count(name) == 1;
+  };
+  // an activation of a known 4D shape, in either layout
+  auto can_be_nhwc = [&](const std::string &name) {
+    if (is_nhwc(name)) {
+      return true;
+    }
+    auto shape = tensor_shapes.find(name);
+    return nchw_names.count(name) == 1 && shape != tensor_shapes.end() &&
+        shape->second.size() == 4;
+  };
+  // DepthwiseConv2d runs in NHWC wherever its weights allow, the 1x1 convs,
+  // the elementwise ops and pooling only follow an NHWC input, so no
+  // transposes are added around the 1x1 convs between NCHW convs
+  auto run_nhwc = [&](const OperatorDef &op) {
+    if (GetOpDataType(op) != DT_FLOAT || op.input_size() == 0 ||
+        op.output_size() != 1 || op.output_shape_size() != 1 ||
+        op.output_shape(0).dims_size() != 4) {
+      return false;
+    }
+    const std::string &type = op.type();
+    if (type == "Conv2D" || type == "DepthwiseConv2d") {
+      // the residual of Conv2D, its last input, is NHWC as the output
+      const int weight_size = op.input_size() - (HasResidual(op) ? 1 : 0);
+      if (weight_size < 2 || weight_size > 3 || !can_be_nhwc(op.input(0)) ||
+          (type == "Conv2D" && (!is_nhwc(op.input(0)) || NeedsNCHW(op)))) {
+        return false;
+      }
+      if (HasResidual(op)) {
+        const std::string &residual = op.input(weight_size);
+        if (!can_be_nhwc(residual) ||
+            tensor_shapes[residual] != std::vector<int64_t>(
+                op.output_shape(0).dims().begin(),
+                op.output_shape(0).dims().end())) {
+          return false;
+        }
+      }
+      if (weight_size == 3 && GetFloatWeight(ws, op.input(2)) == nullptr) {
+        return false;
+      }
+      const Tensor *filter = GetFloatWeight(ws, op.input(1));
+      if (filter == nullptr || filter->dim_size() != 4) {
+        return false;
+      }
+      return type == "Conv2D" ? filter->dim(2) == 1 && filter->dim(3) == 1
+                              : filter->dim(0) == 1;
+    } else if (type == "Pooling") {
+      // the windows of count_include_pad are divided in NCHW only
+      return op.input_size() == 1 && is_nhwc(op.input(0)) &&
+          ProtoArgHelper::GetOptionalArg<OperatorDef, int>(
+              op, "count_include_pad", 0) == 0;
+    } else if (type == "Activation") {
+      // PRELU reads the alpha of each channel
+      return op.input_size() == 1 && is_nhwc(op.input(0)) &&
+          ProtoArgHelper::GetOptionalArg<OperatorDef, std::string>(
+              op, "activation", "NOOP") != "PRELU";
+    } else if (type == "Eltwise") {
+      // no broadcast, which would read the channels in NCHW
+      if (op.input_size() > 2) {
+        return false;
+      }
+      const std::vector<int64_t> output_shape(
+          op.output_shape(0).dims().begin(), op.output_shape(0).dims().end());
+      bool has_nhwc_input = false;
+      for (auto &input : op.input()) {
+        if (!can_be_nhwc(input) || tensor_shapes[input] != output_shape) {
+          return false;
+        }
+        has_nhwc_input = has_nhwc_input || is_nhwc(input);
+      }
+      return has_nhwc_input;
+    }
+    return false;
+  };
+
+  converted->mutable_op()->Reserve(net_def.op_size());
+  int nhwc_ops = 0;
+  for (const OperatorDef &source : net_def.op()) {
+    OperatorDef op = source;
+    const bool to_nhwc = run_nhwc(op);
+    for (int i = 0; i < op.input_size(); ++i) {
+      const std::string input = op.input(i);
+      // the weights of Conv2D and DepthwiseConv2d are packed by the op
+      const bool nhwc_input =
+          to_nhwc && (i == 0 || op.type() == "Eltwise" ||
+                      (HasResidual(op) && i == op.input_size() - 1));
+      if (nhwc_input) {
+        if (!is_nhwc(input)) {
+          const std::string nhwc_name = input + "_nhwc";
+          *converted->add_op() = CreateTransposeOpDef(
+              nchw_names[input], nhwc_name, true, tensor_shapes[input]);
+          nhwc_names[input] = nhwc_name;
+        } else if (nhwc_inputs.count(input) == 1) {
+          read_inputs->insert(input);
+        }
+        op.set_input(i, nhwc_names[input]);
+      } else if (nchw_names.count(input) == 1) {
+        op.set_input(i, nchw_names[input]);
+      } else if (is_nhwc(input)) {
+        const std::string nchw_name = input + "_nchw";
+        *converted->add_op() = CreateTransposeOpDef(
+            nhwc_names[input], nchw_name, false, tensor_shapes[input]);
+        nchw_names[input] = nchw_name;
+        op.set_input(i, nchw_name);
+      }
+    }
+
+    for (int i = 0; i < op.output_size(); ++i) {
+      const std::string &output = op.output(i);
+      if (i < source.output_shape_size()) {
+        tensor_shapes[output] = std::vector<int64_t>(
+            source.output_shape(i).dims().begin(),
+            source.output_shape(i).dims().end());
+      }
+      if (to_nhwc) {
+        nhwc_names[output] = output;
+        // the outputs of the net are fetched as they are written
+        if (net_outputs.count(output) == 1) {
+          nhwc_outputs->insert(output);
+        }
+      } else {
+        nchw_names[output] = output;
+      }
+    }
+    if (to_nhwc) {
+      SetIntArg(kNHWCArg, 1, &op);
+      if (op.type() == "Eltwise") {
+        SetIntArg("data_format", DF_NONE, &op);
+      }
+      ++nhwc_ops;
+    }
+    *converted->add_op() = op;
+  }
+  return nhwc_ops;
+}
+
+}  // namespace
+
+MaceStatus ConvertToCPUNHWCLayout(
+    const Workspace *ws,
+    NetDef *net_def,
+    std::unordered_set<std::string> *nhwc_inputs,
+    std::unordered_set<std::string> *nhwc_outputs) {
+  nhwc_inputs->clear();
+  nhwc_outputs->clear();
+  std::unordered_set<std::string> candidates;
+  for (auto &input_info : net_def->input_info()) {
+    const DataFormat data_format =
+        static_cast<DataFormat>(input_info.data_format());
+    if (data_format == DF_NONE) {
+      VLOG(1) << "Input " << input_info.name() << " has no data format,"
+              << " keep the net in NCHW";
+      return MaceStatus::MACE_SUCCESS;
+    }
+    if (data_format == NHWC && input_info.dims_size() == 4) {
+      candidates.insert(input_info.name());
+    }
+  }
+
+  // The inputs no NHWC op reads directly are transposed to NCHW by the
+  // engine as before, rather than by a Transpose op in the net.
+  NetDef converted;
+  std::unordered_set<std::string> read_inputs;
+  int nhwc_ops = ConvertOps(ws, *net_def, candidates, &converted,
+                            &read_inputs, nhwc_outputs);
+  if (read_inputs != candidates) {
+    converted.clear_op();
+    nhwc_outputs->clear();
+    candidates.swap(read_inputs);
+    read_inputs.clear();
+    nhwc_ops = ConvertOps(ws, *net_def, candidates, &converted, &read_inputs,
+                          nhwc_outputs);
+  }
+  nhwc_inputs->swap(candidates);
+
+  net_def->mutable_op()->Swap(converted.mutable_op());
+  VLOG(1) << "Run " << nhwc_ops << " of " << net_def->op_size()
+          << " CPU ops in NHWC, keep " << nhwc_inputs->size()
+          << " inputs and " << nhwc_outputs->size() << " outputs in NHWC";
+  return MaceStatus::MACE_SUCCESS;
+}
+
+}  // namespace mace
@@ -0,0 +1,46 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef MACE_CORE_CPU_NHWC_LAYOUT_H_
+#define MACE_CORE_CPU_NHWC_LAYOUT_H_
+
+#include <string>
+#include <unordered_set>
+
+#include "mace/core/workspace.h"
+#include "mace/proto/mace.pb.h"
+#include "mace/public/mace.h"
+
+namespace mace {
+
+// Arg of the CPU ops whose 4D outputs are NHWC instead of NCHW, 1 if so.
+// Their output shapes in the net are not transposed to NCHW.
+constexpr const char *kNHWCArg = "cpu_nhwc";
+
+// Rewrite a CPU net to run the float DepthwiseConv2d of multiplier 1, and
+// the 1x1 Conv2D, Pooling, Eltwise and Activation ops after them, on NHWC
+// activations, which keep the channels of a pixel contiguous. Transpose ops
+// are inserted where a tensor goes between an NCHW op and an NHWC op. The
+// NHWC inputs of the net read directly by an NHWC op are kept NHWC, and so
+// are the outputs of the net written by one, so they are fed and fetched
+// without the transposes at the boundary; their names are returned. Call it
+// after the weights are loaded and before the net is created.
+MaceStatus ConvertToCPUNHWCLayout(
+    const Workspace *ws,
+    NetDef *net_def,
+    std::unordered_set<std::string> *nhwc_inputs,
+    std::unordered_set<std::string> *nhwc_outputs);
+
+}  // namespace mace
+
+#endif  // MACE_CORE_CPU_NHWC_LAYOUT_H_
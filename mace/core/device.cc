@@ -24,7 +24,8 @@ CPUDevice::CPUDevice(const int num_threads,
     : cpu_runtime_(new CPURuntime(num_threads,
                                   policy,
                                   use_gemmlowp)),
-      scratch_buffer_(new ScratchBuffer(GetCPUAllocator())) {}
+      allocator_(GetCPUAllocator()),
+      scratch_buffer_(new ScratchBuffer(allocator_)) {}
 
 CPUDevice::~CPUDevice() = default;
 
@@ -40,7 +41,7 @@ GPURuntime *CPUDevice::gpu_runtime() {
 #endif
 
 Allocator *CPUDevice::allocator() {
-  return GetCPUAllocator();
+  return allocator_;
 }
 
 DeviceType CPUDevice::device_type() const {
@@ -51,4 +52,37 @@ ScratchBuffer *CPUDevice::scratch_buffer() {
   return scratch_buffer_.get();
 }
 
+void CPUDevice::set_allocator(Allocator *allocator) {
+  allocator_ = allocator;
+  scratch_buffer_.reset(new ScratchBuffer(allocator_));
+}
+
+SharedDevice::SharedDevice(std::shared_ptr<Device> base)
+    : base_(base),
+      scratch_buffer_(new ScratchBuffer(base->allocator())) {}
+
+SharedDevice::~SharedDevice() = default;
+
+#ifdef MACE_ENABLE_OPENCL
+GPURuntime *SharedDevice::gpu_runtime() {
+  return base_->gpu_runtime();
+}
+#endif
+
+CPURuntime *SharedDevice::cpu_runtime() {
+  return base_->cpu_runtime();
+}
+
+Allocator *SharedDevice::allocator() {
+  return base_->allocator();
+}
+
+DeviceType SharedDevice::device_type() const {
+  return base_->device_type();
+}
+
+ScratchBuffer *SharedDevice::scratch_buffer() {
+  return scratch_buffer_.get();
+}
+
 }  // namespace mace
@@ -58,8 +58,35 @@ class CPUDevice : public Device {
   DeviceType device_type() const override;
   ScratchBuffer *scratch_buffer() override;
 
+  // Allocates the buffers with allocator instead of the global CPU
+  // allocator, before any allocation. The allocator outlives the device.
+  void set_allocator(Allocator *allocator);
+
  private:
   std::unique_ptr<CPURuntime> cpu_runtime_;
+  Allocator *allocator_;
+  std::unique_ptr<ScratchBuffer> scratch_buffer_;
+};
+
+// A device on the runtimes and the allocator of base, with a scratch buffer
+// of its own, so that a net could be initialized on it while another net
+// runs on base.
+class SharedDevice : public Device {
+ public:
+  explicit SharedDevice(std::shared_ptr<Device> base);
+  virtual ~SharedDevice();
+
+#ifdef MACE_ENABLE_OPENCL
+  GPURuntime *gpu_runtime() override;
+#endif
+  CPURuntime *cpu_runtime() override;
+
+  Allocator *allocator() override;
+  DeviceType device_type() const override;
+  ScratchBuffer *scratch_buffer() override;
+
+ private:
+  std::shared_ptr<Device> base_;
   std::unique_ptr<ScratchBuffer> scratch_buffer_;
 };
 
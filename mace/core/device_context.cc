@@ -16,11 +16,14 @@
 
 #include <sys/stat.h>
 
+#include "mace/utils/logging.h"
+
 namespace mace {
 
 namespace {
 
 const char *kPrecompiledProgramFileName = "mace_cl_compiled_program.bin";
+const char *kOnlineTunedParameterFileName = "mace_cl_tuned_parameter.bin";
 
 std::string FindFirstExistPath(const std::vector<std::string> &paths) {
   std::string result;
@@ -43,11 +46,21 @@ GPUContext::GPUContext(const std::string &storage_path,
                        const unsigned char *opencl_binary_ptr,
                        const size_t opencl_binary_size,
                        const unsigned char *opencl_parameter_ptr,
-                       const size_t opencl_parameter_size)
+                       const size_t opencl_parameter_size,
+                       const std::string &opencl_package_path,
+                       const unsigned char *opencl_package_ptr,
+                       const size_t opencl_package_size)
     : storage_factory_(new FileStorageFactory(storage_path)),
-      opencl_tuner_(new Tuner<uint32_t>(opencl_parameter_path,
-                                        opencl_parameter_ptr,
-                                        opencl_parameter_size)) {
+      has_opencl_parameter_(!opencl_parameter_path.empty() ||
+                            opencl_parameter_ptr != nullptr),
+      online_tuned_parameter_path_(
+          storage_path.empty()
+              ? "" : storage_path + "/" + kOnlineTunedParameterFileName) {
+  opencl_tuner_.reset(new Tuner<uint32_t>(
+      opencl_parameter_path,
+      opencl_parameter_ptr,
+      opencl_parameter_size,
+      online_tuned_parameter_path_));
   if (!storage_path.empty()) {
     opencl_cache_storage_ =
         storage_factory_->CreateStorage(kPrecompiledProgramFileName);
@@ -64,6 +77,41 @@ GPUContext::GPUContext(const std::string &storage_path,
           new FileStorage(precompiled_binary_path));
     }
   }
+
+  if (opencl_package_ptr != nullptr) {
+    opencl_package_.reset(
+        new OpenCLBinaryPackage(opencl_package_ptr, opencl_package_size));
+  } else if (!opencl_package_path.empty()) {
+    opencl_package_.reset(new OpenCLBinaryPackage(opencl_package_path));
+  }
+}
+
+void GPUContext::SelectOpenCLPackageEntry(const std::string &platform_info) {
+  std::call_once(opencl_package_selected_, [&]() {
+    if (opencl_package_ == nullptr) {
+      return;
+    }
+    const OpenCLBinaryPackage::Entry *entry =
+        opencl_package_->Find(platform_info);
+    if (entry == nullptr) {
+      VLOG(1) << "There is no entry of " << platform_info
+              << " in the OpenCL binary package, the programs are built"
+                 " from source";
+    } else {
+      VLOG(1) << "Using the OpenCL binary package entry of " << platform_info;
+      if (opencl_binary_storage_ == nullptr && entry->binary_size > 0) {
+        opencl_binary_storage_.reset(new ReadOnlyByteStreamStorage(
+            entry->binary, entry->binary_size));
+      }
+      if (!has_opencl_parameter_ && entry->parameter_size > 0) {
+        opencl_tuner_.reset(new Tuner<uint32_t>(
+            "", entry->parameter, entry->parameter_size,
+            online_tuned_parameter_path_));
+      }
+    }
+    // the entry is copied, the other platforms are not needed
+    opencl_package_.reset();
+  });
 }
 
 GPUContext::~GPUContext() = default;
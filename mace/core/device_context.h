@@ -17,10 +17,12 @@
 
 #include <cstdint>
 #include <memory>
+#include <mutex>  // NOLINT(build/c++11)
 #include <string>
 #include <vector>
 
 #include "mace/core/kv_storage.h"
+#include "mace/core/opencl_binary_package.h"
 #include "mace/utils/tuner.h"
 
 namespace mace {
@@ -33,9 +35,17 @@ class GPUContext {
              const unsigned char *opencl_binary_ptr = nullptr,
              const size_t opencl_binary_size = 0,
              const unsigned char *opencl_parameter_ptr = nullptr,
-             const size_t opencl_parameter_size = 0);
+             const size_t opencl_parameter_size = 0,
+             const std::string &opencl_package_path = "",
+             const unsigned char *opencl_package_ptr = nullptr,
+             const size_t opencl_package_size = 0);
   ~GPUContext();
 
+  // Takes the programs and the tuned parameters of the package entry of
+  // platform_info, unless they are set on their own; only the first call,
+  // which is made before any device uses the context, selects.
+  void SelectOpenCLPackageEntry(const std::string &platform_info);
+
   std::shared_ptr<KVStorage> opencl_binary_storage();
   std::shared_ptr<KVStorage> opencl_cache_storage();
   std::shared_ptr<Tuner<uint32_t>> opencl_tuner();
@@ -45,6 +55,10 @@ class GPUContext {
   std::shared_ptr<Tuner<uint32_t>> opencl_tuner_;
   std::shared_ptr<KVStorage> opencl_binary_storage_;
   std::shared_ptr<KVStorage> opencl_cache_storage_;
+  std::unique_ptr<OpenCLBinaryPackage> opencl_package_;
+  std::once_flag opencl_package_selected_;
+  bool has_opencl_parameter_;
+  std::string online_tuned_parameter_path_;
 };
 
 }  // namespace mace
@@ -0,0 +1,222 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/core/device_profile.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#ifdef MACE_ENABLE_OPENMP
+#include <omp.h>
+#endif
+
+#include "mace/core/kv_storage.h"
+#include "mace/core/macros.h"
+#include "mace/utils/env_time.h"
+#include "mace/utils/logging.h"
+
+namespace mace {
+
+namespace {
+
+constexpr int kMultiplyAddLanes = 32;
+constexpr int kRounds = 3;
+// the key of the profile in its file, of its layout
+const char *kProfileKey = "device_profile_v1";
+
+int MaxThreads() {
+#ifdef MACE_ENABLE_OPENMP
+  return omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
+// the size of the data or unified cache of cpu0 at the level, e.g. "512K"
+int64_t CacheBytes(int level) {
+  for (int index = 0; index < 8; ++index) {
+    const std::string dir =
+        "/sys/devices/system/cpu/cpu0/cache/index" + std::to_string(index);
+    std::ifstream level_file(dir + "/level");
+    int cache_level = 0;
+    if (!(level_file >> cache_level)) {
+      break;
+    }
+    std::ifstream type_file(dir + "/type");
+    std::string type;
+    type_file >> type;
+    if (cache_level != level || type == "Instruction") {
+      continue;
+    }
+    std::ifstream size_file(dir + "/size");
+    int64_t size = 0;
+    std::string unit;
+    if (!(size_file >> size)) {
+      return 0;
+    }
+    size_file >> unit;
+    if (unit == "K") {
+      size <<= 10;
+    } else if (unit == "M") {
+      size <<= 20;
+    }
+    return size;
+  }
+  return 0;
+}
+
+DeviceProfile Probe() {
+  const int64_t start_micros = NowMicros();
+  const int threads = MaxThreads();
+  DeviceProfile profile;
+  profile.l1_cache_bytes = CacheBytes(1);
+  profile.l2_cache_bytes = CacheBytes(2);
+  profile.l3_cache_bytes = CacheBytes(3);
+  profile.fma_gflops = ProbeMultiplyAddGflops(1, 1 << 15);
+  // three arrays in half of the L2 cache, 256KB if it is not reported
+  const int64_t l2_bytes =
+      profile.l2_cache_bytes > 0 ? profile.l2_cache_bytes : 256 << 10;
+  const int64_t cache_size =
+      std::max<int64_t>(l2_bytes / 2 / 3 / sizeof(float), 1024);
+  profile.cache_gbps = ProbeTriadGBps(1, cache_size, 16);
+  // three arrays of twice the last level cache, of 4MB to 8MB each
+  const int64_t last_bytes = std::max(profile.l3_cache_bytes, l2_bytes);
+  const int64_t memory_size = std::min<int64_t>(
+      std::max<int64_t>(last_bytes * 2 / sizeof(float), 1 << 20), 1 << 21);
+  profile.memory_gbps = ProbeTriadGBps(threads, memory_size, 1);
+  profile.fork_join_micros = ProbeForkJoinMicros(threads);
+  profile.num_cores =
+      std::max<int>(std::thread::hardware_concurrency(), 1);
+  VLOG(1) << "Probed the device in " << NowMicros() - start_micros
+          << "us: " << profile.fma_gflops << " GFLOPs and "
+          << profile.cache_gbps << " GB/s of cache per core, "
+          << profile.memory_gbps << " GB/s of memory, "
+          << profile.fork_join_micros << "us to fork and join " << threads
+          << " threads, caches " << profile.l1_cache_bytes << "/"
+          << profile.l2_cache_bytes << "/" << profile.l3_cache_bytes;
+  return profile;
+}
+
+DeviceProfile LoadOrProbe() {
+  const char *path = getenv("MACE_DEVICE_PROFILE_PATH");
+  if (path == nullptr || path[0] == '\0') {
+    return Probe();
+  }
+  FileStorage storage(path);
+  storage.Load();
+  DeviceProfile profile;
+  const std::vector<unsigned char> *value = storage.Find(kProfileKey);
+  if (value != nullptr && value->size() == sizeof(profile)) {
+    memcpy(&profile, value->data(), sizeof(profile));
+    return profile;
+  }
+  profile = Probe();
+  const unsigned char *bytes =
+      reinterpret_cast<const unsigned char *>(&profile);
+  storage.Insert(kProfileKey,
+                 std::vector<unsigned char>(bytes, bytes + sizeof(profile)));
+  if (storage.Flush() != 0) {
+    LOG(WARNING) << "Failed to write the device profile to " << path;
+  }
+  return profile;
+}
+
+}  // namespace
+
+const DeviceProfile &GetDeviceProfile() {
+  static const DeviceProfile profile = LoadOrProbe();
+  return profile;
+}
+
+double ProbeMultiplyAddGflops(int threads, int64_t iterations) {
+  threads = std::max(threads, 1);
+  std::vector<float> sums(threads, 0);
+  double best_seconds = 1e9;
+  for (int round = 0; round < kRounds; ++round) {
+    const int64_t start = NowMicros();
+#pragma omp parallel for num_threads(threads) schedule(static, 1)
+    for (int t = 0; t < threads; ++t) {
+      float acc[kMultiplyAddLanes];
+      for (int j = 0; j < kMultiplyAddLanes; ++j) {
+        acc[j] = t + j;
+      }
+      const float a = 0.999999f;
+      const float b = 1e-6f;
+      for (int64_t i = 0; i < iterations; ++i) {
+        for (int j = 0; j < kMultiplyAddLanes; ++j) {
+          acc[j] = acc[j] * a + b;
+        }
+      }
+      for (int j = 0; j < kMultiplyAddLanes; ++j) {
+        sums[t] += acc[j];
+      }
+    }
+    best_seconds = std::min(best_seconds,
+                            std::max<int64_t>(NowMicros() - start, 1) * 1e-6);
+  }
+  // keep the results alive
+  VLOG(3) << "Multiply-add checksum " << sums[0];
+  return 2.0 * kMultiplyAddLanes * iterations * threads / best_seconds * 1e-9;
+}
+
+double ProbeTriadGBps(int threads, int64_t size, int repeats) {
+  threads = std::max(threads, 1);
+  repeats = std::max(repeats, 1);
+  std::vector<float> a(size, 0), b(size, 1), c(size, 2);
+  double best_seconds = 1e9;
+  for (int round = 0; round < kRounds; ++round) {
+    const int64_t start = NowMicros();
+    for (int r = 0; r < repeats; ++r) {
+#pragma omp parallel for num_threads(threads) schedule(static)
+      for (int64_t i = 0; i < size; ++i) {
+        a[i] = b[i] + 3.0f * c[i];
+      }
+    }
+    best_seconds = std::min(best_seconds,
+                            std::max<int64_t>(NowMicros() - start, 1) * 1e-6);
+  }
+  VLOG(3) << "Triad checksum " << a[size - 1];
+  return 3.0 * sizeof(float) * size * repeats / best_seconds * 1e-9;
+}
+
+double ProbeForkJoinMicros(int threads) {
+#ifdef MACE_ENABLE_OPENMP
+  constexpr int kRegions = 64;
+  threads = std::max(threads, 1);
+  double best_micros = 1e9;
+  for (int round = 0; round < kRounds; ++round) {
+    const int64_t start = NowMicros();
+    for (int r = 0; r < kRegions; ++r) {
+#pragma omp parallel num_threads(threads)
+      {
+        // an empty region, only its fork and join
+      }
+    }
+    best_micros = std::min(
+        best_micros, static_cast<double>(NowMicros() - start) / kRegions);
+  }
+  return best_micros;
+#else
+  MACE_UNUSED(threads);
+  // of the thread pool, which wakes the workers up by futexes
+  return 5.0;
+#endif
+}
+
+}  // namespace mace
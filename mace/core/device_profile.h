@@ -0,0 +1,57 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_CORE_DEVICE_PROFILE_H_
+#define MACE_CORE_DEVICE_PROFILE_H_
+
+#include <cstdint>
+
+namespace mace {
+
+// The speeds of the CPU measured by short microbenchmarks, for the cost
+// models of the ops, see OpCostModel.
+struct DeviceProfile {
+  // float multiply-adds of a core, 2 flops each
+  double fma_gflops;
+  // a triad of a core on arrays which fit in its L2 cache
+  double cache_gbps;
+  // a triad of all the threads on arrays larger than the caches, which the
+  // cores share
+  double memory_gbps;
+  // the fork and join of a parallel region of all the threads
+  double fork_join_micros;
+  // the threads which run at once
+  int num_cores;
+  // the data caches of cpu0 in sysfs, 0 where they are not reported
+  int64_t l1_cache_bytes;
+  int64_t l2_cache_bytes;
+  int64_t l3_cache_bytes;
+};
+
+// The profile of the CPU, probed at the first call in some 20ms. If
+// MACE_DEVICE_PROFILE_PATH names a file, the profile is read from it, or
+// probed and written to it, so the later processes skip the probe.
+const DeviceProfile &GetDeviceProfile();
+
+// The microbenchmarks of the probe, also run by the benchmarks. Each is the
+// best of a few rounds, with OpenMP threads if it is enabled.
+// multiply-adds of independent accumulators the compiler could vectorize
+double ProbeMultiplyAddGflops(int threads, int64_t iterations);
+// a[i] = b[i] + 3 * c[i] over arrays of size floats, repeated
+double ProbeTriadGBps(int threads, int64_t size, int repeats);
+double ProbeForkJoinMicros(int threads);
+
+}  // namespace mace
+
+#endif  // MACE_CORE_DEVICE_PROFILE_H_
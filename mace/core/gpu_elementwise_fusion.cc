@@ -0,0 +1,236 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "mace/core/gpu_elementwise_fusion.h"
+
+#include <unordered_map>
+#include <vector>
+
+#include "mace/core/arg_helper.h"
+#include "mace/utils/logging.h"
+
+namespace mace {
+
+namespace {
+
+void SetIntArg(const std::string &name, int64_t value, OperatorDef *op) {
+  Argument *arg = op->add_arg();
+  arg->set_name(name);
+  arg->set_i(value);
+}
+
+std::vector<int64_t> OutputDims(const OperatorDef &op) {
+  return std::vector<int64_t>(op.output_shape(0).dims().begin(),
+                              op.output_shape(0).dims().end());
+}
+
+bool IsChannelWeight(const Workspace *ws,
+                     const std::string &name,
+                     const int64_t channels) {
+  const Tensor *tensor = ws->GetTensor(name);
+  return tensor != nullptr && tensor->is_weight() &&
+      tensor->dim_size() == 1 && tensor->dim(0) == channels;
+}
+
+bool HasArg(const OperatorDef &op, const std::string &name) {
+  for (auto &arg : op.arg()) {
+    if (arg.name() == name) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+std::string FusedStepArgName(int step, const std::string &name) {
+  return MakeString("fused", step, "_", name);
+}
+
+MaceStatus FuseGPUElementwiseOps(const Workspace *ws, NetDef *net_def) {
+  std::unordered_map<std::string, std::vector<int64_t>> tensor_shapes;
+  for (auto &input_info : net_def->input_info()) {
+    tensor_shapes[input_info.name()] = std::vector<int64_t>(
+        input_info.dims().begin(), input_info.dims().end());
+  }
+  // the outputs of the net count as a consumer, so they are not fused away
+  std::unordered_map<std::string, int> consumers;
+  for (auto &output_info : net_def->output_info()) {
+    ++consumers[output_info.name()];
+  }
+  for (auto &op : net_def->op()) {
+    for (auto &input : op.input()) {
+      ++consumers[input];
+    }
+    if (op.output_size() == op.output_shape_size()) {
+      for (int i = 0; i < op.output_size(); ++i) {
+        tensor_shapes[op.output(i)] = std::vector<int64_t>(
+            op.output_shape(i).dims().begin(),
+            op.output_shape(i).dims().end());
+      }
+    }
+  }
+
+  // an op the image kernel of the fused op runs on each pixel
+  auto is_elementwise = [&](const OperatorDef &op) {
+    const DataType dt = static_cast<DataType>(
+        ProtoArgHelper::GetOptionalArg<OperatorDef, int>(
+            op, "T", static_cast<int>(DT_FLOAT)));
+    if ((dt != DT_FLOAT && dt != DT_HALF) || op.input_size() == 0 ||
+        op.output_size() != 1 || op.output_shape_size() != 1 ||
+        op.output_shape(0).dims_size() != 4 ||
+        tensor_shapes[op.input(0)] != OutputDims(op)) {
+      return false;
+    }
+    const int64_t channels = op.output_shape(0).dims(3);
+    const std::string &type = op.type();
+    if (type == "BiasAdd") {
+      return op.input_size() == 2 &&
+          ProtoArgHelper::GetOptionalArg<OperatorDef, int>(
+              op, "data_format", NHWC) == NHWC &&
+          IsChannelWeight(ws, op.input(1), channels);
+    } else if (type == "Activation") {
+      const std::string activation =
+          ProtoArgHelper::GetOptionalArg<OperatorDef, std::string>(
+              op, "activation", "NOOP");
+      if (activation == "PRELU") {
+        return op.input_size() == 2 &&
+            IsChannelWeight(ws, op.input(1), channels);
+      }
+      return op.input_size() == 1 &&
+          (activation == "RELU" || activation == "RELUX" ||
+           activation == "TANH" || activation == "SIGMOID" ||
+           activation == "LEAKYRELU" || activation == "GELU");
+    } else if (type == "Eltwise") {
+      // SUM, SUB, PROD, DIV, MIN, MAX and SQR_DIFF, without broadcast
+      const int eltwise_type =
+          ProtoArgHelper::GetOptionalArg<OperatorDef, int>(op, "type", -1);
+      if (op.input_size() > 2 || HasArg(op, "coeff") ||
+          eltwise_type < 0 || eltwise_type > 8 ||
+          eltwise_type == 6 || eltwise_type == 7) {
+        return false;
+      }
+      for (auto &input : op.input()) {
+        const Tensor *tensor = ws->GetTensor(input);
+        if ((tensor != nullptr && tensor->is_weight()) ||
+            tensor_shapes[input] != OutputDims(op)) {
+          return false;
+        }
+      }
+      return true;
+    }
+    return false;
+  };
+
+  const int op_size = net_def->op_size();
+  // the chain of each op, -1 for the ops not fused, and its input the chain
+  // goes through
+  std::vector<int> chain_of_op(op_size, -1);
+  std::vector<int> chain_input(op_size, 0);
+  std::vector<std::vector<int>> chains;
+  // the chains by the output of their last op
+  std::unordered_map<std::string, int> chain_tails;
+  for (int i = 0; i < op_size; ++i) {
+    const OperatorDef &op = net_def->op(i);
+    if (!is_elementwise(op)) {
+      continue;
+    }
+    // only the tensor inputs of Eltwise may continue a chain
+    const int candidates = op.type() == "Eltwise" ? op.input_size() : 1;
+    int chain = -1;
+    for (int j = 0; j < candidates && chain == -1; ++j) {
+      auto tail = chain_tails.find(op.input(j));
+      if (tail != chain_tails.end() && consumers[op.input(j)] == 1) {
+        chain = tail->second;
+        chain_input[i] = j;
+        chain_tails.erase(tail);
+      }
+    }
+    if (chain == -1) {
+      chain = static_cast<int>(chains.size());
+      chains.emplace_back();
+    }
+    chains[chain].push_back(i);
+    chain_of_op[i] = chain;
+    chain_tails[op.output(0)] = chain;
+  }
+
+  NetDef fused_net;
+  fused_net.mutable_op()->Reserve(op_size);
+  int fused_ops = 0;
+  int fused_kernels = 0;
+  for (int i = 0; i < op_size; ++i) {
+    const OperatorDef &source = net_def->op(i);
+    const int chain = chain_of_op[i];
+    if (chain == -1 || chains[chain].size() < 2) {
+      *fused_net.add_op() = source;
+      continue;
+    }
+    // the fused op runs where the last op of the chain did
+    if (chains[chain].back() != i) {
+      continue;
+    }
+    const OperatorDef &head = net_def->op(chains[chain].front());
+    OperatorDef *op = fused_net.add_op();
+    op->set_name(source.name());
+    op->set_type(kFusedElementwiseOpType);
+    op->add_input(head.input(chain_input[chains[chain].front()]));
+    op->add_output(source.output(0));
+    *op->mutable_output_shape() = source.output_shape();
+    *op->mutable_output_type() = source.output_type();
+    *op->mutable_mem_id() = source.mem_id();
+    op->set_device_type(source.device_type());
+    for (auto &arg : source.arg()) {
+      if (arg.name() == "T" || arg.name() == "data_format") {
+        *op->add_arg() = arg;
+      }
+    }
+    SetIntArg(kFusedStepsArg, chains[chain].size(), op);
+    for (size_t step = 0; step < chains[chain].size(); ++step) {
+      const int op_idx = chains[chain][step];
+      const OperatorDef &step_op = net_def->op(op_idx);
+      Argument *type_arg = op->add_arg();
+      type_arg->set_name(FusedStepArgName(step, "op"));
+      type_arg->set_s(step_op.type());
+      int operand = -1;
+      bool swapped = false;
+      for (int j = 0; j < step_op.input_size(); ++j) {
+        if (j != chain_input[op_idx]) {
+          operand = op->input_size();
+          op->add_input(step_op.input(j));
+          swapped = j < chain_input[op_idx];
+        }
+      }
+      if (step_op.type() == "Eltwise" && step_op.input_size() == 1) {
+        swapped = ProtoArgHelper::GetOptionalArg<OperatorDef, int>(
+            step_op, "scalar_input_index", 1) == 0;
+      }
+      SetIntArg(FusedStepArgName(step, "operand"), operand, op);
+      SetIntArg(FusedStepArgName(step, "swapped"), swapped, op);
+      for (auto &arg : step_op.arg()) {
+        Argument *step_arg = op->add_arg();
+        *step_arg = arg;
+        step_arg->set_name(FusedStepArgName(step, arg.name()));
+      }
+    }
+    fused_ops += static_cast<int>(chains[chain].size());
+    ++fused_kernels;
+  }
+
+  VLOG(1) << "Fuse " << fused_ops << " of " << op_size
+          << " GPU elementwise ops into " << fused_kernels << " kernels";
+  net_def->mutable_op()->Swap(fused_net.mutable_op());
+  return MaceStatus::MACE_SUCCESS;
+}
+
+}  // namespace mace
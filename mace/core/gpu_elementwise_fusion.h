@@ -0,0 +1,47 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_CORE_GPU_ELEMENTWISE_FUSION_H_
+#define MACE_CORE_GPU_ELEMENTWISE_FUSION_H_
+
+#include <string>
+
+#include "mace/core/workspace.h"
+#include "mace/proto/mace.pb.h"
+#include "mace/public/mace.h"
+
+namespace mace {
+
+// Type of the op running a fused chain of elementwise ops.
+constexpr const char *kFusedElementwiseOpType = "FusedElementwise";
+// Arg of the fused op, the number of ops of the chain.
+constexpr const char *kFusedStepsArg = "fused_steps";
+
+// Prefix of the args of the i-th op of a chain in the fused op: its type,
+// the fused input it reads besides the chain, -1 for none, whether the
+// chain is its second operand, and its own args.
+std::string FusedStepArgName(int step, const std::string &name);
+
+// Rewrite a GPU net to run the chains of BiasAdd, Activation and Eltwise
+// ops, where each op only feeds the next one, as one FusedElementwise op,
+// which reads and writes each pixel once instead of once per op. Only the
+// elementwise forms are fused: the bias and the PRELU alpha are weights of
+// the channels, the other Eltwise operand is a scalar or a tensor of the
+// output shape. Call it after the weights are loaded and before the net is
+// created.
+MaceStatus FuseGPUElementwiseOps(const Workspace *ws, NetDef *net_def);
+
+}  // namespace mace
+
+#endif  // MACE_CORE_GPU_ELEMENTWISE_FUSION_H_
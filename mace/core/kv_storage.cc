@@ -19,9 +19,12 @@
 #include <unistd.h>
 
 #include <algorithm>
+#include <cstdio>
 #include <cstring>
 #include <memory>
+#include <string>
 #include <utility>
+#include <vector>
 
 #include "mace/core/kv_storage.h"
 #include "mace/core/macros.h"
@@ -30,38 +33,150 @@
 namespace mace {
 
 namespace {
+// "MACEKV1" heads the files written by FileStorage, files without it are of
+// the unversioned format of the precompiled OpenCL binaries.
+const uint64_t kFileStorageMagic = 0x0031564B4543414DULL;
+const uint32_t kFileStorageVersion = 1;
+const size_t kFileHeaderSize = 2 * sizeof(uint64_t) + 2 * sizeof(uint32_t);
+const size_t kEntryHeaderSize = 4 * sizeof(uint32_t);
+// The least recently used entries are dropped beyond this size.
+const size_t kMaxFileStorageSize = 32 << 20;
+
+// crc-32 of IEEE 802.3, the same as zlib.crc32(data, crc) of python
+uint32_t Crc32(const unsigned char *data, size_t size, uint32_t crc) {
+  struct Crc32Table {
+    Crc32Table() {
+      for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; ++k) {
+          c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        }
+        table[i] = c;
+      }
+    }
+    uint32_t table[256];
+  };
+  static const Crc32Table crc_table;
+  crc = ~crc;
+  for (size_t i = 0; i < size; ++i) {
+    crc = crc_table.table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+uint32_t EntryCrc32(const std::string &key,
+                    const std::vector<unsigned char> &value) {
+  return Crc32(value.data(), value.size(),
+               Crc32(reinterpret_cast<const unsigned char *>(key.data()),
+                     key.size(), 0));
+}
+
+bool IsVersionedKVData(const unsigned char *data, size_t data_size) {
+  uint64_t magic = 0;
+  if (data_size >= sizeof(magic)) {
+    memcpy(&magic, data, sizeof(magic));
+  }
+  return magic == kFileStorageMagic;
+}
+
+// Parse the versioned format: the header of magic, version, generation and
+// entry count, then for each entry the key size, value size, last used
+// generation and crc, followed by the key and the value. Corrupted entries
+// are skipped, as the storage is only a cache.
+void ParseVersionedKVData(
+    const unsigned char *data,
+    size_t data_size,
+    std::map<std::string, std::vector<unsigned char>> *kv_map,
+    std::map<std::string, uint32_t> *last_used,
+    uint32_t *generation) {
+  if (data_size < kFileHeaderSize) {
+    LOG(WARNING) << "Storage data is truncated";
+    return;
+  }
+  uint32_t version = 0;
+  uint64_t num_tuple = 0;
+  memcpy(&version, data + sizeof(uint64_t), sizeof(version));
+  memcpy(generation, data + sizeof(uint64_t) + sizeof(version),
+         sizeof(*generation));
+  memcpy(&num_tuple, data + sizeof(uint64_t) + 2 * sizeof(uint32_t),
+         sizeof(num_tuple));
+  if (version != kFileStorageVersion) {
+    LOG(WARNING) << "Unsupported storage version " << version;
+    return;
+  }
+  size_t offset = kFileHeaderSize;
+  for (uint64_t i = 0; i < num_tuple; ++i) {
+    uint32_t entry_header[4];
+    if (data_size - offset < kEntryHeaderSize) {
+      LOG(WARNING) << "Storage data is truncated";
+      return;
+    }
+    memcpy(entry_header, data + offset, kEntryHeaderSize);
+    offset += kEntryHeaderSize;
+    const size_t key_size = entry_header[0];
+    const size_t value_size = entry_header[1];
+    if (data_size - offset < key_size + value_size) {
+      LOG(WARNING) << "Storage data is truncated";
+      return;
+    }
+    std::string key(reinterpret_cast<const char *>(data + offset), key_size);
+    offset += key_size;
+    std::vector<unsigned char> value(data + offset,
+                                     data + offset + value_size);
+    offset += value_size;
+    if (EntryCrc32(key, value) != entry_header[3]) {
+      LOG(WARNING) << "Storage entry " << key << " is corrupted";
+      continue;
+    }
+    kv_map->emplace(key, std::move(value));
+    last_used->emplace(key, entry_header[2]);
+  }
+}
+
+// Parse the unversioned format: the entry count, then for each entry the key
+// size, the key, the value size and the value. Truncated data, e.g. of a file
+// which is not a storage, drops the entries from the first one cut.
 void ParseKVData(const unsigned char *data,
                  size_t data_size,
                  std::map<std::string, std::vector<unsigned char>> *kv_map) {
   const size_t int_size = sizeof(int32_t);
 
-  size_t parsed_offset = 0;
   int64_t num_tuple = 0;
+  if (data_size < sizeof(num_tuple)) {
+    LOG(WARNING) << "Storage data is truncated";
+    return;
+  }
   memcpy(&num_tuple, data, sizeof(num_tuple));
-  data += sizeof(num_tuple);
-  parsed_offset += sizeof(num_tuple);
+  size_t offset = sizeof(num_tuple);
   int32_t key_size = 0;
   int32_t value_size = 0;
-  for (int i = 0; i < num_tuple; ++i) {
-    memcpy(&key_size, data, int_size);
-    data += int_size;
-    std::unique_ptr<char[]> key(new char[key_size+1]);
-    memcpy(&key[0], data, key_size);
-    data += key_size;
-    key[key_size] = '\0';
-    parsed_offset += int_size + key_size;
-
-    memcpy(&value_size, data, int_size);
-    data += int_size;
-    std::vector<unsigned char> value(value_size);
-    memcpy(value.data(), data, value_size);
-    data += value_size;
-    parsed_offset += int_size + value_size;
-    MACE_CHECK(parsed_offset <= data_size,
-               "Paring storage data out of range: ",
-               parsed_offset, " > ", data_size);
-
-    kv_map->emplace(std::string(&key[0]), value);
+  for (int64_t i = 0; i < num_tuple; ++i) {
+    if (data_size - offset < int_size) {
+      LOG(WARNING) << "Storage data is truncated";
+      return;
+    }
+    memcpy(&key_size, data + offset, int_size);
+    offset += int_size;
+    if (key_size < 0 ||
+        data_size - offset < static_cast<size_t>(key_size) + int_size) {
+      LOG(WARNING) << "Storage data is truncated";
+      return;
+    }
+    std::string key(reinterpret_cast<const char *>(data + offset), key_size);
+    offset += key_size;
+
+    memcpy(&value_size, data + offset, int_size);
+    offset += int_size;
+    if (value_size < 0 ||
+        data_size - offset < static_cast<size_t>(value_size)) {
+      LOG(WARNING) << "Storage data is truncated";
+      return;
+    }
+    std::vector<unsigned char> value(data + offset,
+                                     data + offset + value_size);
+    offset += value_size;
+
+    kv_map->emplace(key.c_str(), std::move(value));
   }
 }
 
@@ -95,7 +210,8 @@ std::shared_ptr<KVStorage> FileStorageFactory::CreateStorage(
 }
 
 FileStorage::FileStorage(const std::string &file_path):
-    loaded_(false), data_changed_(false), file_path_(file_path) {}
+    loaded_(false), data_changed_(false), file_path_(file_path),
+    generation_(0) {}
 
 int FileStorage::Load() {
   struct stat st;
@@ -143,7 +259,14 @@ int FileStorage::Load() {
     return -1;
   }
 
-  ParseKVData(file_data, file_size, &data_);
+  if (IsVersionedKVData(file_data, file_size)) {
+    uint32_t generation = 0;
+    ParseVersionedKVData(file_data, file_size, &data_, &last_used_,
+                         &generation);
+    generation_ = generation + 1;
+  } else if (file_size > 0) {
+    ParseKVData(file_data, file_size, &data_);
+  }
   res = munmap(file_data, file_size);
   if (res != 0) {
     LOG(WARNING) << "munmap file " << file_path_
@@ -171,6 +294,8 @@ bool FileStorage::Clear() {
     data_.clear();
     data_changed_ = true;
   }
+  std::lock_guard<std::mutex> last_used_lock(last_used_mutex_);
+  last_used_.clear();
   return true;
 }
 
@@ -182,6 +307,8 @@ bool FileStorage::Insert(const std::string &key,
     data_[key] = value;
   }
   data_changed_ = true;
+  std::lock_guard<std::mutex> last_used_lock(last_used_mutex_);
+  last_used_[key] = generation_;
   return true;
 }
 
@@ -190,70 +317,128 @@ const std::vector<unsigned char> *FileStorage::Find(const std::string &key) {
   auto iter = data_.find(key);
   if (iter == data_.end()) return nullptr;
 
+  std::lock_guard<std::mutex> last_used_lock(last_used_mutex_);
+  last_used_[key] = generation_;
   return &(iter->second);
 }
 
+std::vector<std::string> FileStorage::Keys() {
+  utils::ReadLock lock(&data_mutex_);
+  std::vector<std::string> keys;
+  keys.reserve(data_.size());
+  for (auto &kv : data_) {
+    keys.push_back(kv.first);
+  }
+  return keys;
+}
+
+void FileStorage::Compact() {
+  size_t data_size = 0;
+  for (auto &kv : data_) {
+    data_size += kEntryHeaderSize + kv.first.size() + kv.second.size();
+  }
+  if (data_size <= kMaxFileStorageSize) return;
+
+  std::vector<std::pair<uint32_t, std::string>> entries;
+  for (auto &kv : data_) {
+    auto iter = last_used_.find(kv.first);
+    entries.emplace_back(iter == last_used_.end() ? 0 : iter->second,
+                         kv.first);
+  }
+  std::sort(entries.begin(), entries.end());
+  // the entries used by this process are kept whatever the size
+  for (auto &entry : entries) {
+    if (data_size <= kMaxFileStorageSize || entry.first == generation_) {
+      break;
+    }
+    auto iter = data_.find(entry.second);
+    data_size -= kEntryHeaderSize + iter->first.size() + iter->second.size();
+    VLOG(1) << "Drop storage entry " << entry.second
+            << " last used in generation " << entry.first;
+    data_.erase(iter);
+    last_used_.erase(entry.second);
+  }
+}
+
 int FileStorage::Flush() {
   utils::WriteLock lock(&data_mutex_);
   if (!data_changed_)  return 0;
-  int fd = open(file_path_.c_str(), O_WRONLY | O_CREAT, 0600);
-  if (fd < 0) {
-    LOG(WARNING) << "open file " << file_path_
-                 << " failed, error code: " << strerror(errno);
-    return -1;
-  }
+  std::lock_guard<std::mutex> last_used_lock(last_used_mutex_);
+  Compact();
 
-  const size_t int_size = sizeof(int32_t);
-
-  int64_t data_size = sizeof(int64_t);
+  int64_t data_size = kFileHeaderSize;
   for (auto &kv : data_) {
-    data_size += 2 * int_size + kv.first.size() + kv.second.size();
+    data_size += kEntryHeaderSize + kv.first.size() + kv.second.size();
   }
   std::unique_ptr<unsigned char[]> buffer(new unsigned char[data_size]);
   unsigned char *buffer_ptr = &buffer[0];
 
-  int64_t num_of_data = data_.size();
-  memcpy(buffer_ptr, &num_of_data, sizeof(int64_t));
-  buffer_ptr += sizeof(int64_t);
+  const uint64_t num_of_data = data_.size();
+  memcpy(buffer_ptr, &kFileStorageMagic, sizeof(kFileStorageMagic));
+  buffer_ptr += sizeof(kFileStorageMagic);
+  memcpy(buffer_ptr, &kFileStorageVersion, sizeof(kFileStorageVersion));
+  buffer_ptr += sizeof(kFileStorageVersion);
+  memcpy(buffer_ptr, &generation_, sizeof(generation_));
+  buffer_ptr += sizeof(generation_);
+  memcpy(buffer_ptr, &num_of_data, sizeof(num_of_data));
+  buffer_ptr += sizeof(num_of_data);
   for (auto &kv : data_) {
-    int32_t key_size = kv.first.size();
-    memcpy(buffer_ptr, &key_size, int_size);
-    buffer_ptr += int_size;
+    auto iter = last_used_.find(kv.first);
+    const uint32_t entry_header[4] = {
+        static_cast<uint32_t>(kv.first.size()),
+        static_cast<uint32_t>(kv.second.size()),
+        iter == last_used_.end() ? 0 : iter->second,
+        EntryCrc32(kv.first, kv.second)};
+    memcpy(buffer_ptr, entry_header, kEntryHeaderSize);
+    buffer_ptr += kEntryHeaderSize;
 
     memcpy(buffer_ptr, kv.first.c_str(), kv.first.size());
     buffer_ptr += kv.first.size();
 
-    int32_t value_size = kv.second.size();
-    memcpy(buffer_ptr, &value_size, int_size);
-    buffer_ptr += int_size;
-
     memcpy(buffer_ptr, kv.second.data(), kv.second.size());
     buffer_ptr += kv.second.size();
   }
+
+  // write a temporary file and rename it, readers see the old or new file
+  const std::string tmp_file_path = file_path_ + ".tmp";
+  int fd = open(tmp_file_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0) {
+    LOG(WARNING) << "open file " << tmp_file_path
+                 << " failed, error code: " << strerror(errno);
+    return -1;
+  }
   int res = 0;
   buffer_ptr = &buffer[0];
   int64_t remain_size = data_size;
   while (remain_size > 0) {
     size_t buffer_size = std::min<int64_t>(remain_size, SSIZE_MAX);
-    res = write(fd, buffer_ptr, buffer_size);
-    if (res == -1) {
-      LOG(WARNING) << "write file " << file_path_
+    ssize_t written = write(fd, buffer_ptr, buffer_size);
+    if (written == -1) {
+      LOG(WARNING) << "write file " << tmp_file_path
                    << " failed, error code: " << strerror(errno);
       res = close(fd);
       if (res != 0) {
-        LOG(WARNING) << "close file " << file_path_
+        LOG(WARNING) << "close file " << tmp_file_path
                      << " failed, error code: " << strerror(errno);
       }
+      unlink(tmp_file_path.c_str());
       return -1;
     }
-    remain_size -= buffer_size;
-    buffer_ptr += buffer_size;
+    remain_size -= written;
+    buffer_ptr += written;
   }
 
   res = close(fd);
   if (res != 0) {
-    LOG(WARNING) << "close file " << file_path_
+    LOG(WARNING) << "close file " << tmp_file_path
+                 << " failed, error code: " << strerror(errno);
+    unlink(tmp_file_path.c_str());
+    return -1;
+  }
+  if (rename(tmp_file_path.c_str(), file_path_.c_str()) != 0) {
+    LOG(WARNING) << "rename file " << tmp_file_path << " to " << file_path_
                  << " failed, error code: " << strerror(errno);
+    unlink(tmp_file_path.c_str());
     return -1;
   }
   data_changed_ = false;
@@ -263,7 +448,14 @@ int FileStorage::Flush() {
 
 ReadOnlyByteStreamStorage::ReadOnlyByteStreamStorage(
     const unsigned char *byte_stream, size_t byte_stream_size) {
-  ParseKVData(byte_stream, byte_stream_size, &data_);
+  if (IsVersionedKVData(byte_stream, byte_stream_size)) {
+    std::map<std::string, uint32_t> last_used;
+    uint32_t generation = 0;
+    ParseVersionedKVData(byte_stream, byte_stream_size, &data_, &last_used,
+                         &generation);
+  } else {
+    ParseKVData(byte_stream, byte_stream_size, &data_);
+  }
 }
 
 int ReadOnlyByteStreamStorage::Load() {
@@ -283,6 +475,15 @@ const std::vector<unsigned char>* ReadOnlyByteStreamStorage::Find(
   return &(iter->second);
 }
 
+std::vector<std::string> ReadOnlyByteStreamStorage::Keys() {
+  std::vector<std::string> keys;
+  keys.reserve(data_.size());
+  for (auto &kv : data_) {
+    keys.push_back(kv.first);
+  }
+  return keys;
+}
+
 bool ReadOnlyByteStreamStorage::Insert(
     const std::string &key,
     const std::vector<unsigned char> &value) {
@@ -17,6 +17,7 @@
 
 #include <map>
 #include <memory>
+#include <mutex>  // NOLINT(build/c++11)
 #include <string>
 #include <vector>
 
@@ -34,6 +35,7 @@ class KVStorage {
   virtual bool Insert(const std::string &key,
                       const std::vector<unsigned char> &value) = 0;
   virtual const std::vector<unsigned char> *Find(const std::string &key) = 0;
+  virtual std::vector<std::string> Keys() = 0;
   // return: 0 for success, -1 for error
   virtual int Flush() = 0;
   virtual ~KVStorage() {}
@@ -60,6 +62,10 @@ class FileStorageFactory : public KVStorageFactory {
   std::unique_ptr<Impl> impl_;
 };
 
+// Flush writes a versioned file with a crc of each entry to a temporary file
+// and renames it, so a crash never leaves a torn file. Each entry keeps the
+// generation, i.e. the Load count, it was last used in, and the least
+// recently used entries are dropped when the file grows too large.
 class FileStorage : public KVStorage {
  public:
   explicit FileStorage(const std::string &file_path);
@@ -70,14 +76,21 @@ class FileStorage : public KVStorage {
   bool Insert(const std::string &key,
               const std::vector<unsigned char> &value) override;
   const std::vector<unsigned char> *Find(const std::string &key) override;
+  std::vector<std::string> Keys() override;
   int Flush() override;
 
+ private:
+  void Compact();
+
  private:
   bool loaded_;
   bool data_changed_;
   std::string file_path_;
   std::map<std::string, std::vector<unsigned char>> data_;
   utils::RWMutex data_mutex_;
+  uint32_t generation_;
+  std::map<std::string, uint32_t> last_used_;
+  std::mutex last_used_mutex_;
 };
 
 
@@ -93,6 +106,7 @@ class ReadOnlyByteStreamStorage : public KVStorage {
   bool Insert(const std::string &key,
               const std::vector<unsigned char> &value) override;
   const std::vector<unsigned char> *Find(const std::string &key) override;
+  std::vector<std::string> Keys() override;
   int Flush() override;
 
  private:
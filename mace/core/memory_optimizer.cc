@@ -16,12 +16,15 @@
 
 #include <algorithm>
 #include <functional>
+#include <iomanip>
 #include <numeric>
 #include <sstream>
 #include <unordered_set>
 
 #include "mace/core/arg_helper.h"
+#include "mace/core/allocator.h"
 #include "mace/core/macros.h"
+#include "mace/core/tensor.h"
 #include "mace/utils/logging.h"
 
 #ifdef MACE_ENABLE_OPENCL
@@ -30,6 +33,134 @@
 
 namespace mace {
 
+namespace {
+
+DataType OutputDataType(const OperatorDef &op_def, int output_idx) {
+  if (output_idx < op_def.output_type_size()) {
+    return op_def.output_type(output_idx);
+  }
+  return static_cast<DataType>(ProtoArgHelper::GetOptionalArg(
+      op_def, "T", static_cast<int>(DT_FLOAT)));
+}
+
+// Whether the slices of a tensor along the "axis" of a CPU Concat or Split
+// are contiguous, i.e. the dims before the axis are all 1. The shapes are
+// those the CPU runs on, SerialNet transposes the 4D ones to NCHW, while the
+// axis of an NHWC op is still an NHWC one. The axis of a Stack or Unstack is
+// the stacked one, 0 by default, and never transposed.
+bool IsOuterAxis(const OperatorDef &op_def,
+                 const std::vector<int64_t> &shape) {
+  const int rank = static_cast<int>(shape.size());
+  const bool stacked =
+      op_def.type() == "Stack" || op_def.type() == "Unstack";
+  int axis = ProtoArgHelper::GetOptionalArg<OperatorDef, int>(
+      op_def, "axis", stacked ? 0 : 3);
+  axis = axis < 0 ? axis + rank : axis;
+  if (axis < 0 || axis >= rank) {
+    return false;
+  }
+  auto df = static_cast<DataFormat>(
+      ProtoArgHelper::GetOptionalArg<OperatorDef, int>(
+          op_def, "data_format", DataFormat::DF_NONE));
+  if (!stacked && df == DataFormat::NHWC && rank == 4) {
+    const int nchw_axis[] = {0, 2, 3, 1};
+    axis = nchw_axis[axis];
+  }
+  return std::accumulate(shape.begin(), shape.begin() + axis,
+                         static_cast<int64_t>(1),
+                         std::multiplies<int64_t>()) == 1;
+}
+
+// The offset in elements of the slice of a CPU Slice or Crop output into
+// its input, or -1 if the slice is not a contiguous range of the input: the
+// dims before the last cropped one must be 1 and those after it whole. Both
+// ops read their args in the layout the CPU runs on.
+int64_t SliceOffset(const OperatorDef &op_def,
+                    const std::vector<int64_t> &shape,
+                    const std::vector<int64_t> &slice_shape) {
+  const int rank = static_cast<int>(shape.size());
+  if (rank == 0 || static_cast<int>(slice_shape.size()) != rank) {
+    return -1;
+  }
+  std::vector<int64_t> begin(rank, 0);
+  if (op_def.type() == "Slice") {
+    const std::vector<int> starts =
+        ProtoArgHelper::GetRepeatedArgs<OperatorDef, int>(op_def, "starts");
+    if (starts.size() != 1) {
+      return -1;
+    }
+    // sliced along the last axis
+    begin[rank - 1] = starts[0];
+  } else if (op_def.type() == "Crop") {
+    const int axis =
+        ProtoArgHelper::GetOptionalArg<OperatorDef, int>(op_def, "axis", 2);
+    const std::vector<int> offsets =
+        ProtoArgHelper::GetRepeatedArgs<OperatorDef, int>(op_def, "offset");
+    if (rank != 4 || axis < 0 || axis >= rank) {
+      return -1;
+    }
+    for (int i = axis; i < rank; ++i) {
+      if (offsets.size() == 1) {
+        begin[i] = offsets[0];
+      } else if (offsets.size() > 1) {
+        begin[i] = offsets[i - axis];
+      }
+    }
+  } else {
+    return -1;
+  }
+  int last_sliced = -1;
+  for (int i = 0; i < rank; ++i) {
+    if (begin[i] < 0 || begin[i] + slice_shape[i] > shape[i]) {
+      return -1;
+    }
+    if (begin[i] != 0 || slice_shape[i] != shape[i]) {
+      last_sliced = i;
+    }
+  }
+  int64_t offset = 0;
+  int64_t stride = 1;
+  for (int i = rank - 1; i >= 0; --i) {
+    if (i < last_sliced && slice_shape[i] != 1) {
+      return -1;
+    }
+    offset += begin[i] * stride;
+    stride *= shape[i];
+  }
+  return offset;
+}
+
+int64_t TensorBytes(const std::vector<int64_t> &shape, DataType dt) {
+  return std::accumulate(shape.begin(), shape.end(),
+                         static_cast<int64_t>(GetEnumTypeSize(dt)),
+                         std::multiplies<int64_t>());
+}
+
+// FNV-1a, stable across builds and platforms
+class Fnv1aHash {
+ public:
+  Fnv1aHash() : hash_(0xCBF29CE484222325ULL) {}
+
+  void Add(const void *data, size_t size) {
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < size; ++i) {
+      hash_ = (hash_ ^ bytes[i]) * 0x100000001B3ULL;
+    }
+  }
+  void Add(int64_t value) { Add(&value, sizeof(value)); }
+  void Add(const std::string &str) {
+    Add(static_cast<int64_t>(str.size()));
+    Add(str.data(), str.size());
+  }
+
+  uint64_t hash() const { return hash_; }
+
+ private:
+  uint64_t hash_;
+};
+
+}  // namespace
+
 bool MemoryOptimizer::IsMemoryReuseOp(const std::string &op_type) {
   static const std::unordered_set<std::string> kReuseOp = {
       "Reshape", "Identity", "Squeeze", "ExpandDims"
@@ -37,6 +168,79 @@ bool MemoryOptimizer::IsMemoryReuseOp(const std::string &op_type) {
   return kReuseOp.count(op_type) == 1;
 }
 
+void MemoryOptimizer::PlanConcatViews(
+    const std::vector<const OperatorDef *> &op_defs) {
+  // a producer on another branch may run before the block is created
+  if (concurrent_branches_) {
+    return;
+  }
+  // a skipped producer keeps its output, which the Concat block would not
+  if (!incremental_inputs_.empty()) {
+    return;
+  }
+  std::unordered_map<std::string, std::pair<const OperatorDef *, int>>
+      producers;
+  for (const OperatorDef *op_def : op_defs) {
+    if (op_def->output_size() != op_def->output_shape_size()) {
+      continue;
+    }
+    for (int i = 0; i < op_def->output_size(); ++i) {
+      producers[op_def->output(i)] = std::make_pair(op_def, i);
+    }
+  }
+  for (const OperatorDef *op_def : op_defs) {
+    if ((op_def->type() != "Concat" && op_def->type() != "Stack") ||
+        static_cast<DeviceType>(op_def->device_type()) != DeviceType::CPU ||
+        op_def->output_shape_size() != 1 ||
+        OutputDataType(*op_def, 0) != DT_FLOAT) {
+      continue;
+    }
+    const std::vector<int64_t> output_shape(
+        op_def->output_shape(0).dims().begin(),
+        op_def->output_shape(0).dims().end());
+    if (!IsOuterAxis(*op_def, output_shape)) {
+      continue;
+    }
+    // inputs which can't be views are still copied by the Concat
+    std::vector<std::pair<std::string, int64_t>> views;
+    std::unordered_set<std::string> input_names;
+    int64_t offset = 0;
+    for (const std::string &input_name : op_def->input()) {
+      auto producer = producers.find(input_name);
+      if (producer == producers.end()) {
+        offset = -1;
+        break;
+      }
+      const OperatorDef *producer_def = producer->second.first;
+      const int output_idx = producer->second.second;
+      const std::vector<int64_t> shape(
+          producer_def->output_shape(output_idx).dims().begin(),
+          producer_def->output_shape(output_idx).dims().end());
+      const DataType dt = OutputDataType(*producer_def, output_idx);
+      if (static_cast<DeviceType>(producer_def->device_type()) ==
+          DeviceType::CPU && dt == DT_FLOAT &&
+          !IsMemoryReuseOp(producer_def->type()) &&
+          producer_def->type() != "Concat" &&
+          producer_def->type() != "Stack" &&
+          producer_def->type() != "Split" &&
+          producer_def->type() != "Unstack" &&
+          concat_views_.count(input_name) == 0 &&
+          input_names.insert(input_name).second) {
+        views.emplace_back(input_name, offset);
+      }
+      offset += TensorBytes(shape, dt);
+    }
+    if (views.empty() || offset != TensorBytes(output_shape, DT_FLOAT)) {
+      continue;
+    }
+    for (auto &view : views) {
+      concat_views_[view.first] = std::make_pair(op_def->output(0),
+                                                 view.second);
+    }
+    concat_blocks_[op_def->output(0)] = std::make_pair(-1, offset);
+  }
+}
+
 void MemoryOptimizer::UpdateTensorRef(const std::string &tensor_name) {
   if (tensor_ref_count_.count(tensor_name) == 0) {
     tensor_ref_count_.emplace(tensor_name, 1);
@@ -70,8 +274,10 @@ MemoryBlock MemoryOptimizer::CreateMemoryBlock(
     std::vector<size_t> image_shape;
     if (shape.size() == 2) {
       shape = {shape[0], 1, 1, shape[1]};
+    } else if (shape.size() == 3) {
+      shape = {shape[0] * shape[1], 1, 1, shape[2]};
     } else {
-      MACE_CHECK(shape.size() == 4) << "GPU only support 2D/4D input";
+      MACE_CHECK(shape.size() == 4) << "GPU only support 2D/3D/4D input";
     }
     OpenCLUtil::CalImage2DShape(shape,
                                 OpenCLBufferType::IN_OUT_CHANNEL,
@@ -91,10 +297,178 @@ MemoryBlock MemoryOptimizer::CreateMemoryBlock(
   return block;
 }
 
+void MemoryOptimizer::UpdateAncestors(const OperatorDef *op_def,
+                                      int op_idx) {
+  std::vector<bool> ancestors(op_idx, false);
+  int input_size = op_def->input_size();
+  for (int i = 0; i < input_size; ++i) {
+    auto producer = tensor_producer_.find(op_def->input(i));
+    if (producer == tensor_producer_.end()) {
+      continue;
+    }
+    int producer_idx = producer->second;
+    ancestors[producer_idx] = true;
+    for (int j = 0; j < producer_idx; ++j) {
+      if (op_ancestors_[producer_idx][j]) {
+        ancestors[j] = true;
+      }
+    }
+  }
+  op_ancestors_.push_back(std::move(ancestors));
+  int output_size = op_def->output_size();
+  for (int i = 0; i < output_size; ++i) {
+    tensor_producer_[op_def->output(i)] = op_idx;
+  }
+}
+
+bool MemoryOptimizer::IsBlockReusable(int mem_id, int op_idx) const {
+  if (!concurrent_branches_ || mem_users_.count(mem_id) == 0) {
+    return true;
+  }
+  for (int user : mem_users_.at(mem_id)) {
+    if (user == op_idx || !op_ancestors_[op_idx][user]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int MemoryOptimizer::InplaceMemId(const OperatorDef *op_def,
+                                  int inplace_input,
+                                  int op_idx,
+                                  const std::vector<int64_t> &shape,
+                                  DataType dt,
+                                  MemoryType mem_type) const {
+  if (inplace_input < 0 || inplace_input >= op_def->input_size()) {
+    return -1;
+  }
+  const std::string &input_name = op_def->input(inplace_input);
+  auto mem = tensor_mem_map_.find(input_name);
+  // a view shares its block with the other slices
+  if (mem == tensor_mem_map_.end() || tensor_views_.count(input_name) == 1 ||
+      mem->second.second != dt ||
+      tensor_shapes_.at(input_name) != shape) {
+    return -1;
+  }
+  // the input must die here and no other tensor may live in its block
+  const int mem_id = mem->second.first;
+  if (tensor_ref_count_.at(input_name) != 1 ||
+      mem_ref_count_.at(mem_id) != 1 ||
+      mem_blocks_[mem_id].mem_type() != mem_type) {
+    return -1;
+  }
+  if (concurrent_branches_) {
+    for (int user : mem_users_.at(mem_id)) {
+      if (user != op_idx && !op_ancestors_[op_idx][user]) {
+        return -1;
+      }
+    }
+  }
+  return mem_id;
+}
+
+int MemoryOptimizer::CreateArenaBlock(MemoryBlock block,
+                                      DataType dt,
+                                      int op_idx) {
+  // placed in the arena by PlanArena
+  const int mem_id = static_cast<int>(mem_blocks_.size());
+  block.set_mem_id(mem_id);
+  block.set_data_type(dt);
+  block.set_mem_type(MemoryType::CPU_BUFFER);
+  block.set_offset(0);
+  mem_blocks_.push_back(block);
+  arena_lifetimes_[mem_id] = std::make_pair(op_idx, kMaxOpIndex);
+  return mem_id;
+}
+
+int MemoryOptimizer::CreateImageBlock(MemoryBlock block,
+                                      DataType dt,
+                                      int op_idx) {
+  // packed with the other images by PlanImages
+  const int mem_id = static_cast<int>(mem_blocks_.size());
+  block.set_mem_id(mem_id);
+  block.set_data_type(dt);
+  block.set_mem_type(MemoryType::GPU_IMAGE);
+  block.set_offset(0);
+  mem_blocks_.push_back(block);
+  image_lifetimes_[mem_id] = std::make_pair(op_idx, kMaxOpIndex);
+  return mem_id;
+}
+
+int MemoryOptimizer::ViewMemId(const OperatorDef *op_def,
+                               int output_idx,
+                               int op_idx,
+                               const std::vector<int64_t> &shape,
+                               DataType dt,
+                               MemoryType mem_type,
+                               int64_t *offset) {
+  if (mem_type != MemoryType::CPU_BUFFER || dt != DT_FLOAT) {
+    return -1;
+  }
+  auto concat_view = concat_views_.find(op_def->output(output_idx));
+  if (concat_view != concat_views_.end()) {
+    auto &concat_block = concat_blocks_.at(concat_view->second.first);
+    if (concat_block.first == -1) {
+      MemoryBlock block;
+      block.set_x(concat_block.second);
+      block.set_y(1);
+      concat_block.first = CreateArenaBlock(block, dt, op_idx);
+    }
+    *offset = concat_view->second.second;
+    return concat_block.first;
+  }
+  const std::string &type = op_def->type();
+  if ((type != "Split" && type != "Unstack" && type != "Slice" &&
+       type != "Crop") ||
+      static_cast<DeviceType>(op_def->device_type()) != DeviceType::CPU) {
+    return -1;
+  }
+  const std::string &input_name = op_def->input(0);
+  auto mem = tensor_mem_map_.find(input_name);
+  if (mem == tensor_mem_map_.end() || mem->second.second != dt ||
+      mem_blocks_[mem->second.first].mem_type() != MemoryType::CPU_BUFFER) {
+    return -1;
+  }
+  const std::vector<int64_t> &input_shape = tensor_shapes_.at(input_name);
+  const int64_t input_bytes = TensorBytes(input_shape, dt);
+  const int64_t output_bytes = TensorBytes(shape, dt);
+  int64_t slice_offset = -1;
+  if (type == "Split" || type == "Unstack") {
+    // the outputs are the consecutive slices of the input
+    if (IsOuterAxis(*op_def, input_shape) &&
+        output_bytes * op_def->output_size() == input_bytes) {
+      slice_offset = output_idx * output_bytes;
+    }
+  } else {
+    // the output is a range of the input
+    const int64_t elements = SliceOffset(*op_def, input_shape, shape);
+    if (elements >= 0) {
+      slice_offset = elements * GetEnumTypeSize(dt);
+    }
+  }
+  if (slice_offset < 0) {
+    return -1;
+  }
+  auto input_view = tensor_views_.find(input_name);
+  *offset = (input_view == tensor_views_.end() ? 0 : input_view->second) +
+      slice_offset;
+  return mem->second.first;
+}
+
 void MemoryOptimizer::Optimize(
     const mace::OperatorDef *op_def,
-    const std::unordered_map<std::string, MemoryType> &mem_types) {
+    const std::unordered_map<std::string, MemoryType> &mem_types,
+    int inplace_input) {
   MACE_LATENCY_LOGGER(2, "Optimize memory");
+  const int op_idx = op_count_++;
+  if (concurrent_branches_) {
+    UpdateAncestors(op_def, op_idx);
+    for (auto &input_name : op_def->input()) {
+      if (tensor_mem_map_.count(input_name) == 1) {
+        mem_users_[tensor_mem_map_.at(input_name).first].push_back(op_idx);
+      }
+    }
+  }
   if (op_def->output_size() != op_def->output_shape_size()) {
     VLOG(1) << op_def->name()
             << ": the number of output shape "
@@ -132,15 +506,34 @@ void MemoryOptimizer::Optimize(
         op_def->output_shape(i).dims().end());
     MemoryBlock op_mem_block = CreateMemoryBlock(shape, dt, mem_type);
     MemoryBlock best_mem_block;
-    if (IsMemoryReuseOp(op_def->type())) {
-      if (tensor_mem_map_.count(op_def->input(0)) == 1) {
-        best_mem_id = tensor_mem_map_[op_def->input(0)].first;
+    int64_t view_offset = 0;
+    const int view_mem_id =
+        ViewMemId(op_def, i, op_idx, shape, dt, mem_type, &view_offset);
+    const int inplace_mem_id = i == 0 && view_mem_id == -1 ?
+        InplaceMemId(op_def, inplace_input, op_idx, shape, dt, mem_type) : -1;
+    auto concat_block = concat_blocks_.find(op_def->output(i));
+    if (view_mem_id != -1) {
+      best_mem_id = view_mem_id;
+      tensor_views_[op_def->output(i)] = view_offset;
+    } else if (concat_block != concat_blocks_.end() &&
+               concat_block->second.first != -1) {
+      // the producers of the inputs have written into the block
+      best_mem_id = concat_block->second.first;
+    } else if (inplace_mem_id != -1) {
+      best_mem_id = inplace_mem_id;
+    } else if (IsMemoryReuseOp(op_def->type())) {
+      const std::string &input_name = op_def->input(0);
+      if (tensor_mem_map_.count(input_name) == 1) {
+        best_mem_id = tensor_mem_map_[input_name].first;
+        if (tensor_views_.count(input_name) == 1) {
+          tensor_views_[op_def->output(i)] = tensor_views_.at(input_name);
+        }
       }
+    } else if (mem_type == MemoryType::CPU_BUFFER) {
+      best_mem_id = CreateArenaBlock(op_mem_block, dt, op_idx);
+    } else if (mem_type == MemoryType::GPU_IMAGE) {
+      best_mem_id = CreateImageBlock(op_mem_block, dt, op_idx);
     } else {
-      auto shape = std::vector<int64_t>(
-          op_def->output_shape(i).dims().begin(),
-          op_def->output_shape(i).dims().end());
-
       int64_t op_mem_size = op_mem_block.x() * op_mem_block.y();
       int64_t best_added_mem_size = LLONG_MAX;
       int64_t best_wasted_mem_size = LLONG_MAX;
@@ -148,24 +541,13 @@ void MemoryOptimizer::Optimize(
       int64_t old_mem_size = 0, new_mem_size = 0;
       MemoryBlock new_mem_block;
       for (auto idle_mem_id : idle_blocks_) {
+        if (!IsBlockReusable(idle_mem_id, op_idx)) {
+          continue;
+        }
         if (mem_blocks_[idle_mem_id].mem_type() == mem_type) {
-          if (mem_type == MemoryType::GPU_IMAGE) {
-            // GPU Image could reuse memory with same data type only
-            if (mem_blocks_[idle_mem_id].data_type() != dt) {
-              continue;
-            }
-            old_mem_size =
-                mem_blocks_[idle_mem_id].x() * mem_blocks_[idle_mem_id].y();
-            new_mem_block.set_x(std::max<int64_t>(mem_blocks_[idle_mem_id].x(),
-                                                  op_mem_block.x()));
-            new_mem_block.set_y(std::max<int64_t>(mem_blocks_[idle_mem_id].y(),
-                                                  op_mem_block.y()));
-            new_mem_size = new_mem_block.x() * new_mem_block.y();
-          } else {
-            old_mem_size = mem_blocks_[idle_mem_id].x();
-            new_mem_size = std::max(op_mem_size, old_mem_size);
-            new_mem_block.set_x(new_mem_size);
-          }
+          old_mem_size = mem_blocks_[idle_mem_id].x();
+          new_mem_size = std::max(op_mem_size, old_mem_size);
+          new_mem_block.set_x(new_mem_size);
           int64_t added_mem_size = new_mem_size - old_mem_size;
           int64_t wasted_mem_size = new_mem_size - op_mem_size;
           // minimize add_mem_size; if best_mem_add_size is 0,
@@ -181,6 +563,7 @@ void MemoryOptimizer::Optimize(
         }
       }
 
+      best_mem_block.set_offset(0);
       if (best_added_mem_size <= op_mem_size) {
         best_mem_block.set_mem_id(best_mem_id);
         best_mem_block.set_data_type(dt);
@@ -205,6 +588,14 @@ void MemoryOptimizer::Optimize(
         mem_ref_count_[best_mem_id] = 1;
       }
       tensor_mem_map_[op_def->output(i)] = std::make_pair(best_mem_id, dt);
+      tensor_shapes_[op_def->output(i)] = shape;
+      if (concurrent_branches_) {
+        if (inplace_mem_id == -1 && view_mem_id == -1 &&
+            !IsMemoryReuseOp(op_def->type())) {
+          mem_users_[best_mem_id].clear();
+        }
+        mem_users_[best_mem_id].push_back(op_idx);
+      }
     }
   }
 
@@ -219,7 +610,13 @@ void MemoryOptimizer::Optimize(
         int mem_id = tensor_mem_map_.at(input_name).first;
         mem_ref_count_[mem_id] -= 1;
         if (mem_ref_count_.at(mem_id) == 0) {
-          idle_blocks_.insert(mem_id);
+          if (arena_lifetimes_.count(mem_id) == 1) {
+            arena_lifetimes_[mem_id].second = op_idx;
+          } else if (image_lifetimes_.count(mem_id) == 1) {
+            image_lifetimes_[mem_id].second = op_idx;
+          } else {
+            idle_blocks_.insert(mem_id);
+          }
         }
       } else {
         MACE_CHECK(tensor_ref_count_.at(input_name) >= 0,
@@ -232,6 +629,425 @@ void MemoryOptimizer::Optimize(
   }
 }
 
+int64_t MemoryOptimizer::ArenaBlockSize(const MemoryBlock &block) {
+  return PadAlignSize(block.x() + MACE_EXTRA_BUFFER_PAD_SIZE);
+}
+
+const std::pair<int, int> &MemoryOptimizer::Lifetime(int mem_id) const {
+  auto lifetime = arena_lifetimes_.find(mem_id);
+  if (lifetime != arena_lifetimes_.end()) {
+    return lifetime->second;
+  }
+  return image_lifetimes_.at(mem_id);
+}
+
+bool MemoryOptimizer::IsArenaBlockBefore(int mem_id, int other_mem_id) const {
+  const auto &lifetime = Lifetime(mem_id);
+  const int other_first = Lifetime(other_mem_id).first;
+  if (lifetime.second >= other_first) {
+    return false;
+  }
+  if (concurrent_branches_ && mem_users_.count(mem_id) == 1) {
+    // the producer of the other block may run before the last reader
+    for (int user : mem_users_.at(mem_id)) {
+      if (!op_ancestors_[other_first][user]) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool MemoryOptimizer::IsArenaOverlapped(int mem_id, int other_mem_id) const {
+  return !IsArenaBlockBefore(mem_id, other_mem_id) &&
+      !IsArenaBlockBefore(other_mem_id, mem_id);
+}
+
+void MemoryOptimizer::PlanArena() {
+  MACE_LATENCY_LOGGER(2, "Plan memory arena");
+  std::vector<int> mem_ids;
+  for (auto &lifetime : arena_lifetimes_) {
+    mem_ids.push_back(lifetime.first);
+  }
+  std::stable_sort(mem_ids.begin(), mem_ids.end(),
+                   [this](int lhs, int rhs) {
+                     return ArenaBlockSize(mem_blocks_[lhs]) >
+                         ArenaBlockSize(mem_blocks_[rhs]);
+                   });
+
+  arena_size_ = PlaceArenaBlocks(mem_ids);
+
+  // no placement can go below the peak of the live blocks
+  arena_lower_bound_ = 0;
+  for (int op_idx = 0; op_idx < op_count_; ++op_idx) {
+    int64_t live_size = 0;
+    for (auto &lifetime : arena_lifetimes_) {
+      if (lifetime.second.first <= op_idx &&
+          op_idx <= lifetime.second.second) {
+        live_size += ArenaBlockSize(mem_blocks_[lifetime.first]);
+      }
+    }
+    arena_lower_bound_ = std::max(arena_lower_bound_, live_size);
+  }
+
+  if (!min_peak_ || arena_size_ <= arena_lower_bound_) {
+    return;
+  }
+  // the largest first leaves gaps the short lived blocks could have filled,
+  // try the longest lived first, the largest lifetime times size first and
+  // the earliest first too
+  auto lifetime_length = [this](int mem_id) -> int64_t {
+    const auto &lifetime = Lifetime(mem_id);
+    return std::min(lifetime.second, op_count_) - lifetime.first + 1;
+  };
+  const std::vector<std::function<bool(int, int)>> orders = {
+      [&lifetime_length](int lhs, int rhs) {
+        return lifetime_length(lhs) > lifetime_length(rhs);
+      },
+      [this, &lifetime_length](int lhs, int rhs) {
+        return lifetime_length(lhs) * ArenaBlockSize(mem_blocks_[lhs]) >
+            lifetime_length(rhs) * ArenaBlockSize(mem_blocks_[rhs]);
+      },
+      [this](int lhs, int rhs) {
+        return Lifetime(lhs).first < Lifetime(rhs).first;
+      },
+  };
+  std::vector<int64_t> best_offsets;
+  for (int mem_id : mem_ids) {
+    best_offsets.push_back(mem_blocks_[mem_id].offset());
+  }
+  for (auto &order : orders) {
+    // the blocks of the same key stay the largest first
+    std::vector<int> ordered_ids = mem_ids;
+    std::stable_sort(ordered_ids.begin(), ordered_ids.end(), order);
+    const int64_t size = PlaceArenaBlocks(ordered_ids);
+    if (size < arena_size_) {
+      VLOG(2) << "Arena of " << size << " bytes instead of " << arena_size_;
+      arena_size_ = size;
+      for (size_t i = 0; i < mem_ids.size(); ++i) {
+        best_offsets[i] = mem_blocks_[mem_ids[i]].offset();
+      }
+      if (arena_size_ <= arena_lower_bound_) {
+        break;
+      }
+    }
+  }
+  for (size_t i = 0; i < mem_ids.size(); ++i) {
+    mem_blocks_[mem_ids[i]].set_offset(best_offsets[i]);
+  }
+}
+
+int64_t MemoryOptimizer::PlaceArenaBlocks(const std::vector<int> &mem_ids) {
+  int64_t arena_size = 0;
+  std::vector<int> placed_ids;
+  for (int mem_id : mem_ids) {
+    const int64_t size = ArenaBlockSize(mem_blocks_[mem_id]);
+    // <offset, end> of the placed blocks living at the same time
+    std::vector<std::pair<int64_t, int64_t>> overlapped;
+    for (int placed_id : placed_ids) {
+      if (IsArenaOverlapped(mem_id, placed_id)) {
+        int64_t offset = mem_blocks_[placed_id].offset();
+        overlapped.emplace_back(
+            offset, offset + ArenaBlockSize(mem_blocks_[placed_id]));
+      }
+    }
+    std::sort(overlapped.begin(), overlapped.end());
+
+    // take the smallest gap which fits, or append after the last block
+    int64_t best_offset = -1;
+    int64_t best_gap = LLONG_MAX;
+    int64_t gap_start = 0;
+    for (auto &range : overlapped) {
+      int64_t gap = range.first - gap_start;
+      if (gap >= size && gap < best_gap) {
+        best_offset = gap_start;
+        best_gap = gap;
+      }
+      gap_start = std::max(gap_start, range.second);
+    }
+    if (best_offset == -1) {
+      best_offset = gap_start;
+    }
+    mem_blocks_[mem_id].set_offset(best_offset);
+    arena_size = std::max(arena_size, best_offset + size);
+    placed_ids.push_back(mem_id);
+  }
+  return arena_size;
+}
+
+void MemoryOptimizer::PlanImages() {
+  MACE_LATENCY_LOGGER(2, "Plan GPU images");
+  if (image_lifetimes_.empty()) {
+    return;
+  }
+  auto block_area = [](const MemoryBlock &block) -> int64_t {
+    return block.x() * block.y();
+  };
+  auto block_bytes = [&block_area](const MemoryBlock &block) -> int64_t {
+    // every pixel holds 4 channels
+    return block_area(block) * 4 * GetEnumTypeSize(block.data_type());
+  };
+
+  // no packing can go below the peak of the live image tensors
+  image_lower_bound_ = 0;
+  for (int op_idx = 0; op_idx < op_count_; ++op_idx) {
+    int64_t live_size = 0;
+    for (auto &lifetime : image_lifetimes_) {
+      if (lifetime.second.first <= op_idx &&
+          op_idx <= lifetime.second.second) {
+        live_size += block_bytes(mem_blocks_[lifetime.first]);
+      }
+    }
+    image_lower_bound_ = std::max(image_lower_bound_, live_size);
+  }
+
+  std::vector<int> mem_ids;
+  for (auto &lifetime : image_lifetimes_) {
+    mem_ids.push_back(lifetime.first);
+  }
+  std::stable_sort(mem_ids.begin(), mem_ids.end(),
+                   [this, &block_area](int lhs, int rhs) {
+                     return block_area(mem_blocks_[lhs]) >
+                         block_area(mem_blocks_[rhs]);
+                   });
+
+  // physical images and the tensor blocks they back, which never live at
+  // the same time
+  std::vector<MemoryBlock> images;
+  std::vector<std::vector<int>> image_users;
+  std::unordered_map<int, int> image_of_block;
+  for (int mem_id : mem_ids) {
+    const MemoryBlock &block = mem_blocks_[mem_id];
+    const int64_t area = block_area(block);
+    int best_image = -1;
+    int64_t best_added_area = LLONG_MAX;
+    int64_t best_wasted_area = LLONG_MAX;
+    for (size_t i = 0; i < images.size(); ++i) {
+      // GPU Image could reuse memory with same data type only
+      if (images[i].data_type() != block.data_type()) {
+        continue;
+      }
+      bool overlapped = false;
+      for (int user : image_users[i]) {
+        if (IsArenaOverlapped(mem_id, user)) {
+          overlapped = true;
+          break;
+        }
+      }
+      if (overlapped) {
+        continue;
+      }
+      const int64_t new_area = std::max(images[i].x(), block.x()) *
+          std::max(images[i].y(), block.y());
+      const int64_t added_area = new_area - block_area(images[i]);
+      const int64_t wasted_area = new_area - area;
+      if (added_area < best_added_area ||
+          (added_area == best_added_area &&
+              wasted_area < best_wasted_area)) {
+        best_image = static_cast<int>(i);
+        best_added_area = added_area;
+        best_wasted_area = wasted_area;
+      }
+    }
+    if (best_image != -1 && best_added_area <= area) {
+      MemoryBlock &image = images[best_image];
+      image.set_x(std::max(image.x(), block.x()));
+      image.set_y(std::max(image.y(), block.y()));
+    } else {
+      best_image = static_cast<int>(images.size());
+      images.push_back(block);
+      image_users.emplace_back();
+    }
+    image_users[best_image].push_back(mem_id);
+    image_of_block[mem_id] = best_image;
+  }
+
+  // renumber the blocks, an image takes the place of its first tensor block
+  std::vector<int> new_ids(mem_blocks_.size(), -1);
+  std::vector<int> image_ids(images.size(), -1);
+  std::vector<MemoryBlock> mem_blocks;
+  for (size_t mem_id = 0; mem_id < mem_blocks_.size(); ++mem_id) {
+    auto image = image_of_block.find(static_cast<int>(mem_id));
+    if (image == image_of_block.end()) {
+      new_ids[mem_id] = static_cast<int>(mem_blocks.size());
+      mem_blocks.push_back(mem_blocks_[mem_id]);
+      mem_blocks.back().set_mem_id(new_ids[mem_id]);
+    } else {
+      int &image_id = image_ids[image->second];
+      if (image_id == -1) {
+        image_id = static_cast<int>(mem_blocks.size());
+        mem_blocks.push_back(images[image->second]);
+        mem_blocks.back().set_mem_id(image_id);
+      }
+      new_ids[mem_id] = image_id;
+    }
+  }
+  mem_blocks_.swap(mem_blocks);
+
+  for (auto &tensor_mem : tensor_mem_map_) {
+    tensor_mem.second.first = new_ids[tensor_mem.second.first];
+  }
+  std::map<int, std::pair<int, int>> arena_lifetimes;
+  for (auto &lifetime : arena_lifetimes_) {
+    arena_lifetimes[new_ids[lifetime.first]] = lifetime.second;
+  }
+  arena_lifetimes_.swap(arena_lifetimes);
+  std::unordered_map<int, int> mem_ref_count;
+  for (auto &ref_count : mem_ref_count_) {
+    mem_ref_count[new_ids[ref_count.first]] += ref_count.second;
+  }
+  mem_ref_count_.swap(mem_ref_count);
+  std::set<int> idle_blocks;
+  for (int mem_id : idle_blocks_) {
+    idle_blocks.insert(new_ids[mem_id]);
+  }
+  idle_blocks_.swap(idle_blocks);
+  std::unordered_map<int, std::vector<int>> mem_users;
+  for (auto &users : mem_users_) {
+    auto &new_users = mem_users[new_ids[users.first]];
+    new_users.insert(new_users.end(), users.second.begin(),
+                     users.second.end());
+  }
+  mem_users_.swap(mem_users);
+  image_lifetimes_.clear();
+
+  image_size_ = 0;
+  for (auto &image : images) {
+    image_size_ += block_bytes(image);
+  }
+}
+
+void MemoryOptimizer::Sign(
+    const std::vector<const OperatorDef *> &op_defs,
+    const std::vector<int> &inplace_inputs,
+    const std::unordered_map<std::string, MemoryType> &mem_types,
+    const std::vector<std::string> &output_names) {
+  MACE_CHECK(op_defs.size() == inplace_inputs.size());
+  Fnv1aHash hash;
+  hash.Add(static_cast<int64_t>(kMaceAlignment));
+  hash.Add(static_cast<int64_t>(MACE_EXTRA_BUFFER_PAD_SIZE));
+  hash.Add(static_cast<int64_t>(concurrent_branches_));
+  hash.Add(static_cast<int64_t>(min_peak_));
+  for (size_t i = 0; i < op_defs.size(); ++i) {
+    const OperatorDef &op_def = *op_defs[i];
+    hash.Add(op_def.type());
+    hash.Add(static_cast<int64_t>(op_def.device_type()));
+    hash.Add(static_cast<int64_t>(inplace_inputs[i]));
+    for (auto &input : op_def.input()) {
+      hash.Add(input);
+    }
+    for (int j = 0; j < op_def.output_size(); ++j) {
+      hash.Add(op_def.output(j));
+      hash.Add(static_cast<int64_t>(OutputDataType(op_def, j)));
+      auto mem_type = mem_types.find(op_def.output(j));
+      hash.Add(static_cast<int64_t>(
+          mem_type == mem_types.end() ? -1 : mem_type->second));
+      if (j < op_def.output_shape_size()) {
+        for (int64_t dim : op_def.output_shape(j).dims()) {
+          hash.Add(dim);
+        }
+      }
+      hash.Add(static_cast<int64_t>(-1));
+    }
+    // the views depend on the axis and the data format, and the ranges of
+    // Slice and Crop
+    for (const char *name : {"axis", "data_format"}) {
+      hash.Add(static_cast<int64_t>(
+          ProtoArgHelper::GetOptionalArg<OperatorDef, int>(
+              op_def, name, INT_MIN)));
+    }
+    for (const char *name : {"starts", "offset"}) {
+      for (int value :
+          ProtoArgHelper::GetRepeatedArgs<OperatorDef, int>(op_def, name)) {
+        hash.Add(static_cast<int64_t>(value));
+      }
+      hash.Add(static_cast<int64_t>(-1));
+    }
+  }
+  // the outputs of the net are never released
+  for (auto &output_name : output_names) {
+    hash.Add(output_name);
+  }
+  signature_ = hash.hash();
+}
+
+bool MemoryOptimizer::LoadPlan(const MemoryPlan &plan) {
+  if (plan.signature() != signature_) {
+    VLOG(1) << "The memory plan was made for other operations";
+    return false;
+  }
+  std::vector<MemoryBlock> mem_blocks;
+  for (auto &block_plan : plan.blocks()) {
+    MemoryBlock block;
+    block.set_mem_id(block_plan.mem_id());
+    block.set_mem_type(block_plan.mem_type());
+    block.set_data_type(block_plan.data_type());
+    block.set_x(block_plan.x());
+    block.set_y(block_plan.y());
+    block.set_offset(block_plan.offset());
+    if (block.mem_id() != static_cast<int>(mem_blocks.size()) ||
+        block.x() < 0 || block.y() < 0 ||
+        (block.mem_type() == MemoryType::CPU_BUFFER &&
+            (block.offset() < 0 ||
+             block.offset() + ArenaBlockSize(block) > plan.arena_size()))) {
+      LOG(WARNING) << "Invalid block " << block.mem_id()
+                   << " of the memory plan";
+      return false;
+    }
+    mem_blocks.push_back(block);
+  }
+  std::unordered_map<std::string, std::pair<int, DataType>> tensor_mem_map;
+  std::unordered_map<std::string, int64_t> tensor_views;
+  for (auto &tensor_plan : plan.tensors()) {
+    const int mem_id = tensor_plan.mem_id();
+    if (mem_id < 0 || mem_id >= static_cast<int>(mem_blocks.size()) ||
+        tensor_plan.view_offset() < 0 ||
+        tensor_plan.view_offset() >= ArenaBlockSize(mem_blocks[mem_id])) {
+      LOG(WARNING) << "Invalid tensor " << tensor_plan.name()
+                   << " of the memory plan";
+      return false;
+    }
+    tensor_mem_map[tensor_plan.name()] =
+        std::make_pair(mem_id, tensor_plan.data_type());
+    if (tensor_plan.view_offset() > 0) {
+      tensor_views[tensor_plan.name()] = tensor_plan.view_offset();
+    }
+  }
+  mem_blocks_ = std::move(mem_blocks);
+  tensor_mem_map_ = std::move(tensor_mem_map);
+  tensor_views_ = std::move(tensor_views);
+  arena_size_ = plan.arena_size();
+  return true;
+}
+
+void MemoryOptimizer::ExportPlan(MemoryPlan *plan) const {
+  plan->Clear();
+  plan->set_signature(signature_);
+  plan->set_arena_size(arena_size_);
+  for (auto &block : mem_blocks_) {
+    MemoryBlockPlan *block_plan = plan->add_blocks();
+    block_plan->set_mem_id(block.mem_id());
+    block_plan->set_mem_type(block.mem_type());
+    block_plan->set_data_type(block.data_type());
+    block_plan->set_x(block.x());
+    block_plan->set_y(block.y());
+    block_plan->set_offset(block.offset());
+  }
+  // sorted, so that the same plan is serialized the same
+  std::map<std::string, std::pair<int, DataType>> tensor_mem_map(
+      tensor_mem_map_.begin(), tensor_mem_map_.end());
+  for (auto &tensor_mem : tensor_mem_map) {
+    TensorMemoryPlan *tensor_plan = plan->add_tensors();
+    tensor_plan->set_name(tensor_mem.first);
+    tensor_plan->set_mem_id(tensor_mem.second.first);
+    tensor_plan->set_data_type(tensor_mem.second.second);
+    auto view = tensor_views_.find(tensor_mem.first);
+    if (view != tensor_views_.end()) {
+      tensor_plan->set_view_offset(view->second);
+    }
+  }
+}
+
 const std::vector<MemoryBlock>& MemoryOptimizer::mem_blocks() const {
   return mem_blocks_;
 }
@@ -241,6 +1057,11 @@ const std::unordered_map<std::string, std::pair<int, DataType>>&
   return tensor_mem_map_;
 }
 
+const std::unordered_map<std::string, int64_t>&
+    MemoryOptimizer::tensor_views() const {
+  return tensor_views_;
+}
+
 std::string MemoryOptimizer::DebugInfo() const {
   auto memory_type_to_str = [](const MemoryType type) -> std::string {
     if (type == MemoryType::CPU_BUFFER) {
@@ -264,9 +1085,30 @@ std::string MemoryOptimizer::DebugInfo() const {
               "[" << mem_blocks_[i].x() << ", " << mem_blocks_[i].y() << "]";
     } else {
       sstream << "[" << mem_blocks_[i].x() << "]";
+      if (mem_blocks_[i].mem_type() == MemoryType::CPU_BUFFER) {
+        sstream << " offset " << mem_blocks_[i].offset();
+      }
+    }
+    sstream << "\n";
+  }
+  if (!tensor_views_.empty()) {
+    sstream << "Tensor views: " << tensor_views_.size() << "\n";
+  }
+  if (!arena_lifetimes_.empty()) {
+    sstream << "CPU arena: " << arena_size_ << " bytes, lower bound "
+            << arena_lower_bound_ << " bytes";
+    if (arena_lower_bound_ > 0) {
+      sstream << " (" << std::fixed << std::setprecision(2)
+              << (arena_size_ - arena_lower_bound_) * 100.0 /
+                  arena_lower_bound_
+              << "% above)";
     }
     sstream << "\n";
   }
+  if (image_size_ > 0) {
+    sstream << "GPU images: " << image_size_ << " bytes, lower bound "
+            << image_lower_bound_ << " bytes\n";
+  }
 
   return sstream.str();
 }
@@ -15,6 +15,8 @@
 #ifndef MACE_CORE_MEMORY_OPTIMIZER_H_
 #define MACE_CORE_MEMORY_OPTIMIZER_H_
 
+#include <climits>
+#include <map>
 #include <set>
 #include <string>
 #include <unordered_map>
@@ -68,33 +70,149 @@ class MemoryBlock {
     return y_;
   }
 
+  // Offset of a CPU block in the arena, in bytes.
+  inline void set_offset(int64_t offset) {
+    offset_ = offset;
+  }
+
+  inline int64_t offset() const {
+    return offset_;
+  }
+
  private:
   int mem_id_;
   DataType data_type_;
   MemoryType mem_type_;
   int64_t x_;
   int64_t y_;
+  int64_t offset_;
 };
 
 class MemoryOptimizer {
  public:
+  MemoryOptimizer() : concurrent_branches_(false), min_peak_(false),
+                      op_count_(0),
+                      arena_size_(0), arena_lower_bound_(0),
+                      image_size_(0), image_lower_bound_(0),
+                      signature_(0) {}
+
+  // Let operations on independent branches run at the same time: a block
+  // is only reused when all of its former users are ancestors of the new
+  // operation. Must be set before the first Optimize call.
+  void set_concurrent_branches(bool concurrent_branches) {
+    concurrent_branches_ = concurrent_branches;
+  }
+  bool concurrent_branches() const { return concurrent_branches_; }
+
+  // Spend more planning time on a smaller arena: PlanArena places the
+  // blocks in several orders and keeps the smallest placement. Must be set
+  // before PlanArena.
+  void set_min_peak(bool min_peak) {
+    min_peak_ = min_peak;
+  }
+  bool min_peak() const { return min_peak_; }
+
+  // Inputs of the net which often stay the same between runs: the
+  // operations depending only on unchanged ones are skipped, and the
+  // tensors they hand to the others are kept for the following runs instead
+  // of being reused, see SerialNet. Must be set before the net is created.
+  void set_incremental_inputs(const std::vector<std::string> &inputs) {
+    incremental_inputs_ = inputs;
+  }
+  const std::vector<std::string> &incremental_inputs() const {
+    return incremental_inputs_;
+  }
+
   static bool IsMemoryReuseOp(const std::string &op_type);
+  // The inputs of a CPU Concat or Stack along an axis with only unit dims
+  // before it are planned as views into its output, so their producers
+  // write the concatenated tensor in place. The outputs of Split, Unstack,
+  // Slice and Crop which are contiguous ranges of their input are planned
+  // as views into it by Optimize. Must be called before the first Optimize
+  // call with all the operations in execution order.
+  void PlanConcatViews(const std::vector<const OperatorDef *> &op_defs);
   void UpdateTensorRef(const std::string &tensor_name);
   void UpdateTensorRef(const OperatorDef *op_def);
+  // The first output shares the block of input inplace_input if that
+  // input dies here and has the same shape and data type.
   void Optimize(const OperatorDef *op_def,
-                const std::unordered_map<std::string, MemoryType> &mem_types);
+                const std::unordered_map<std::string, MemoryType> &mem_types,
+                int inplace_input = -1);
+
+  // Place every CPU block at an offset of one arena once all operations
+  // are optimized. Blocks whose lifetimes overlap never share bytes, the
+  // largest blocks are placed first into the best fitting gap, see
+  // set_min_peak for the other orders.
+  void PlanArena();
+
+  // Pack the GPU image tensors into as few images as their lifetimes allow
+  // once all operations are optimized, the largest first into the image
+  // its extents grow the least. Renumbers the memory blocks, so it must run
+  // after PlanArena and before the blocks and the tensor map are read.
+  void PlanImages();
+
+  // Sum up the operations Optimize would be called with, in execution
+  // order, and the outputs of the net, to tell whether a stored plan was
+  // made for them. Covers the options and the build settings the plan
+  // depends on.
+  void Sign(const std::vector<const OperatorDef *> &op_defs,
+            const std::vector<int> &inplace_inputs,
+            const std::unordered_map<std::string, MemoryType> &mem_types,
+            const std::vector<std::string> &output_names);
+  uint64_t signature() const { return signature_; }
+
+  // Take a stored plan instead of optimizing the operations, after Sign.
+  // Returns false if the plan was made for other operations or is invalid.
+  bool LoadPlan(const MemoryPlan &plan);
+
+  // The plan to store, once the operations are planned.
+  void ExportPlan(MemoryPlan *plan) const;
 
   const std::vector<MemoryBlock> &mem_blocks() const;
 
+  // Bytes of the CPU arena, including the padding of every block.
+  int64_t arena_size() const { return arena_size_; }
+
+  // Padded and aligned bytes a CPU block takes in the arena.
+  static int64_t ArenaBlockSize(const MemoryBlock &block);
+
   const std::unordered_map<std::string,
                            std::pair<int, DataType>> &tensor_mem_map() const;
 
+  // tensor name : offset in bytes into its CPU block, for the tensors which
+  // are views into the block of another, see PlanConcatViews
+  const std::unordered_map<std::string, int64_t> &tensor_views() const;
+
   std::string DebugInfo() const;
 
  private:
   MemoryBlock CreateMemoryBlock(std::vector<int64_t> shape,
                                 DataType dt,
                                 MemoryType mem_type);
+  void UpdateAncestors(const OperatorDef *op_def, int op_idx);
+  bool IsBlockReusable(int mem_id, int op_idx) const;
+  int InplaceMemId(const OperatorDef *op_def,
+                   int inplace_input,
+                   int op_idx,
+                   const std::vector<int64_t> &shape,
+                   DataType dt,
+                   MemoryType mem_type) const;
+  int CreateArenaBlock(MemoryBlock block, DataType dt, int op_idx);
+  // place the blocks in order into the best fitting gap, returns the size
+  // of the arena
+  int64_t PlaceArenaBlocks(const std::vector<int> &mem_ids);
+  int CreateImageBlock(MemoryBlock block, DataType dt, int op_idx);
+  int ViewMemId(const OperatorDef *op_def,
+                int output_idx,
+                int op_idx,
+                const std::vector<int64_t> &shape,
+                DataType dt,
+                MemoryType mem_type,
+                int64_t *offset);
+  static constexpr int kMaxOpIndex = INT_MAX;
+  const std::pair<int, int> &Lifetime(int mem_id) const;
+  bool IsArenaBlockBefore(int mem_id, int other_mem_id) const;
+  bool IsArenaOverlapped(int mem_id, int other_mem_id) const;
 
  private:
   std::unordered_map<std::string, int> tensor_ref_count_;
@@ -104,6 +222,38 @@ class MemoryOptimizer {
   std::unordered_map<std::string, std::pair<int, DataType>> tensor_mem_map_;
   std::unordered_map<int, int> mem_ref_count_;
   std::set<int> idle_blocks_;
+  bool concurrent_branches_;
+  bool min_peak_;
+  std::vector<std::string> incremental_inputs_;
+  int op_count_;
+  // tensor name : index of the operation producing it
+  std::unordered_map<std::string, int> tensor_producer_;
+  // op_ancestors_[i][j] is whether operation j must finish before i
+  std::vector<std::vector<bool>> op_ancestors_;
+  // mem id : operations which read or wrote the block since last reuse
+  std::unordered_map<int, std::vector<int>> mem_users_;
+  // tensor name : output shape of the tensors in memory blocks
+  std::unordered_map<std::string, std::vector<int64_t>> tensor_shapes_;
+  // CPU mem id : <first, last> operation using the block, last is
+  // kMaxOpIndex while the block is not released
+  std::map<int, std::pair<int, int>> arena_lifetimes_;
+  // GPU image mem id : <first, last> operation using the image, each image
+  // tensor gets its own block until PlanImages packs them
+  std::map<int, std::pair<int, int>> image_lifetimes_;
+  // planned Concat input : <Concat output, offset in bytes>
+  std::unordered_map<std::string,
+                     std::pair<std::string, int64_t>> concat_views_;
+  // planned Concat output : <mem id, size in bytes>, the block is created
+  // by the first producer of its inputs, mem id is -1 until then
+  std::unordered_map<std::string, std::pair<int, int64_t>> concat_blocks_;
+  std::unordered_map<std::string, int64_t> tensor_views_;
+  int64_t arena_size_;
+  // peak of the live CPU blocks over the execution order
+  int64_t arena_lower_bound_;
+  // bytes of the packed GPU images and the peak of the live image tensors
+  int64_t image_size_;
+  int64_t image_lower_bound_;
+  uint64_t signature_;
 };
 
 }  // namespace mace
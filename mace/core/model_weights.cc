@@ -0,0 +1,53 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/core/model_weights.h"
+
+#include <algorithm>
+
+namespace mace {
+
+ModelWeights::ModelWeights(const unsigned char *model_data,
+                           size_t model_data_size)
+    : model_data_(model_data), model_data_size_(model_data_size) {}
+
+MaceStatus ModelWeights::Load(const NetDef &net_def,
+                              Device *device,
+                              const Workspace **weights) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (workspace_ == nullptr) {
+    for (auto &const_tensor : net_def.tensors()) {
+      const size_t end = static_cast<size_t>(
+          const_tensor.offset() +
+              const_tensor.data_size() *
+                  GetEnumTypeSize(const_tensor.data_type()));
+      if (end > model_data_size_) {
+        return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                          MakeString("weight ", const_tensor.name(),
+                                     " ends at ", end, " past the ",
+                                     model_data_size_,
+                                     " bytes of the model data"));
+      }
+    }
+    // the CPU allocator is global, the weights outlive the device
+    std::unique_ptr<Workspace> workspace(new Workspace());
+    MACE_RETURN_IF_ERROR(workspace->LoadModelTensor(net_def, device,
+                                                    model_data_));
+    workspace_ = std::move(workspace);
+  }
+  *weights = workspace_.get();
+  return MaceStatus::MACE_SUCCESS;
+}
+
+}  // namespace mace
@@ -0,0 +1,57 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_CORE_MODEL_WEIGHTS_H_
+#define MACE_CORE_MODEL_WEIGHTS_H_
+
+#include <memory>
+#include <mutex>  // NOLINT(build/c++11)
+
+#include "mace/core/device.h"
+#include "mace/core/workspace.h"
+#include "mace/proto/mace.pb.h"
+#include "mace/public/mace.h"
+
+namespace mace {
+
+// The CPU weights of a model, loaded by the first engine of the model and
+// then shared by the next ones, which only own their activations and runtime
+// state. The weights are views of the model data, which must outlive them,
+// or float copies of its half and uint8 weights expanded once. Ops never
+// write their weights, so the engines can run at the same time.
+class ModelWeights {
+ public:
+  ModelWeights(const unsigned char *model_data, size_t model_data_size);
+  ModelWeights(const ModelWeights &) = delete;
+  ModelWeights &operator=(const ModelWeights &) = delete;
+
+  inline const unsigned char *model_data() const {
+    return model_data_;
+  }
+
+  // the workspace of the weights, loaded from net_def by the first caller
+  MaceStatus Load(const NetDef &net_def,
+                  Device *device,
+                  const Workspace **weights);
+
+ private:
+  const unsigned char *model_data_;
+  const size_t model_data_size_;
+  std::mutex mutex_;
+  std::unique_ptr<Workspace> workspace_;
+};
+
+}  // namespace mace
+
+#endif  // MACE_CORE_MODEL_WEIGHTS_H_
@@ -12,23 +12,35 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#ifdef MACE_ENABLE_OPENMP
+#include <omp.h>
+#endif
+
 #include <algorithm>
-#include <limits>
+#include <functional>
+#include <map>
 #include <set>
 #include <unordered_set>
 #include <utility>
 
+#include "mace/core/cpu_nhwc_layout.h"
+#include "mace/core/device_profile.h"
 #include "mace/core/future.h"
 #include "mace/core/macros.h"
 #include "mace/core/memory_optimizer.h"
 #include "mace/core/net.h"
 #include "mace/core/op_context.h"
+#include "mace/core/op_parallelism.h"
 #include "mace/public/mace.h"
 #include "mace/utils/memory_logging.h"
+#include "mace/utils/system_trace.h"
+#include "mace/utils/thread_pool.h"
 #include "mace/utils/timer.h"
 #include "mace/utils/utils.h"
 
 #ifdef MACE_ENABLE_OPENCL
+#include "mace/core/runtime/opencl/gpu_runtime.h"
+#include "mace/core/runtime/opencl/opencl_runtime.h"
 #include "mace/core/runtime/opencl/opencl_util.h"
 #endif  // MACE_ENABLE_OPENCL
 
@@ -48,6 +60,17 @@ struct InternalOutputInfo {
   int op_idx;  // operation which generate the tensor
 };
 
+// Ops computing host-side metadata from the shapes of their inputs only,
+// whose data they never read. They run on CPU whatever the target device,
+// so their small outputs stay in host memory, and their inputs are neither
+// transformed nor mapped, so the GPU queue is not drained for them.
+bool IsShapeOnlyOp(const std::string &op_type) {
+  static const std::unordered_set<std::string> kShapeOnlyOp = {
+      "Shape", "InferConv2dShape"
+  };
+  return kShapeOnlyOp.count(op_type) == 1;
+}
+
 #ifdef MACE_ENABLE_OPENCL
 std::string TransformedName(const std::string &input_name,
                             const mace::MemoryType mem_type) {
@@ -57,11 +80,253 @@ std::string TransformedName(const std::string &input_name,
 }
 
 bool TransformRequiredOp(const std::string &op_type) {
-  static const std::unordered_set<std::string> kNoTransformOp = {
-      "Shape", "InferConv2dShape"
+  return !IsShapeOnlyOp(op_type);
+}
+
+// GPU ops with both image and buffer kernels, the others run on images
+bool HasGPUBufferKernel(const OperatorDef &op) {
+  static const std::unordered_set<std::string> kBufferOp = {
+      "Conv2D", "DepthwiseConv2d", "Pooling", "Softmax"
   };
-  return kNoTransformOp.count(op_type) == 0;
+  // the buffer conv adds no residual and stores no depth to space
+  return kBufferOp.count(op.type()) == 1 &&
+      ProtoArgHelper::GetOptionalArg<OperatorDef, int>(op, "residual", 0) == 0
+      && ProtoArgHelper::GetOptionalArg<OperatorDef, int>(
+          op, "depth_to_space", 1) == 1;
 }
+
+// Whether the image of an activation of shape, NHWC, NC or TNC, exceeds
+// the max image size of the device, {height, width}.
+bool ExceedsMaxImageSize(const std::vector<index_t> &shape,
+                         const std::vector<uint64_t> &max_image_size) {
+  if (max_image_size.size() != 2 || shape.empty() || shape.size() > 4) {
+    return false;
+  }
+  std::vector<index_t> nhwc;
+  if (shape.size() == 4) {
+    nhwc = shape;
+  } else if (shape.size() == 3) {
+    nhwc = {shape[0] * shape[1], 1, 1, shape[2]};
+  } else if (shape.size() == 2) {
+    nhwc = {shape[0], 1, 1, shape[1]};
+  } else {
+    return false;
+  }
+  std::vector<size_t> image_shape;
+  OpenCLUtil::CalImage2DShape(nhwc, OpenCLBufferType::IN_OUT_CHANNEL,
+                              &image_shape);
+  return image_shape[0] > max_image_size[1] ||
+      image_shape[1] > max_image_size[0];
+}
+
+// Relative cost of transforming an element: a copy on the GPU between
+// image and buffer, a map and an NHWC <-> NCHW transpose to or from CPU.
+int64_t TransformCost(const MemoryType from, const MemoryType to) {
+  if (from == to) {
+    return 0;
+  } else if (from == MemoryType::CPU_BUFFER || to == MemoryType::CPU_BUFFER) {
+    return 4;
+  }
+  return 1;
+}
+
+// Plan the memory types of the ops of a GPU net. The CPU ops use CPU
+// buffers and the GPU ops with only image kernels use images, the GPU ops
+// with both kernels use the memory type which minimizes the elements
+// transformed between the ops, by flipping them, alone or with the ops of
+// both kernels next to them, while the cost goes down. The memory type of
+// the model is kept on ties, so a net of no mixed memory types is not
+// changed. The ops of both kernels reading or writing an activation too
+// large for an image run on buffers, which have no 2D size limit, so they
+// stay on the GPU.
+class MemoryTypePlanner {
+ public:
+  MemoryTypePlanner(
+      const NetDef *net_def,
+      const std::vector<bool> &on_gpu,
+      const std::unordered_map<std::string, MemoryType> &input_mem_types,
+      const MemoryType model_mem_type,
+      const std::vector<uint64_t> &max_image_size)
+      : net_def_(net_def),
+        input_mem_types_(input_mem_types) {
+    const int op_size = net_def->op_size();
+    mem_types_.resize(op_size, MemoryType::CPU_BUFFER);
+    std::unordered_map<std::string, std::vector<index_t>> shapes;
+    for (auto &input_info : net_def->input_info()) {
+      shapes[input_info.name()] = std::vector<index_t>(
+          input_info.dims().begin(), input_info.dims().end());
+    }
+    for (int i = 0; i < op_size; ++i) {
+      const OperatorDef &op = net_def->op(i);
+      bool exceeds_image = false;
+      for (auto &input : op.input()) {
+        auto shape = shapes.find(input);
+        exceeds_image |= shape != shapes.end() &&
+            ExceedsMaxImageSize(shape->second, max_image_size);
+      }
+      for (int j = 0; j < op.output_shape_size() && j < op.output_size();
+           ++j) {
+        shapes[op.output(j)] = std::vector<index_t>(
+            op.output_shape(j).dims().begin(),
+            op.output_shape(j).dims().end());
+        exceeds_image |=
+            ExceedsMaxImageSize(shapes[op.output(j)], max_image_size);
+      }
+      if (!on_gpu[i]) {
+        continue;
+      }
+      if (HasGPUBufferKernel(op) && exceeds_image) {
+        VLOG(1) << "Operator " << op.name()
+                << " exceeds the max image size, run on GPU buffers";
+        mem_types_[i] = MemoryType::GPU_BUFFER;
+      } else if (HasGPUBufferKernel(op)) {
+        mem_types_[i] = model_mem_type;
+        flexible_.push_back(i);
+      } else {
+        mem_types_[i] = MemoryType::GPU_IMAGE;
+      }
+    }
+  }
+
+  std::vector<MemoryType> Plan() {
+    constexpr int kMaxSweeps = 4;
+    // flip each op alone or with the group of the ops it is connected to
+    std::vector<std::vector<int>> moves;
+    for (auto &group : FlexibleGroups()) {
+      for (int op_idx : group) {
+        moves.push_back({op_idx});
+      }
+      if (group.size() > 1) {
+        moves.push_back(group);
+      }
+    }
+    int64_t cost = Cost();
+    bool changed = !moves.empty();
+    for (int sweep = 0; sweep < kMaxSweeps && changed; ++sweep) {
+      changed = false;
+      for (auto &move : moves) {
+        const std::vector<MemoryType> saved = mem_types_;
+        const MemoryType flipped =
+            mem_types_[move[0]] == MemoryType::GPU_IMAGE ?
+            MemoryType::GPU_BUFFER : MemoryType::GPU_IMAGE;
+        for (int op_idx : move) {
+          mem_types_[op_idx] = flipped;
+        }
+        const int64_t flipped_cost = Cost();
+        if (flipped_cost < cost) {
+          cost = flipped_cost;
+          changed = true;
+        } else {
+          mem_types_ = saved;
+        }
+      }
+    }
+    VLOG(1) << "Plan GPU memory types of transform cost " << cost;
+    return mem_types_;
+  }
+
+ private:
+  // the flexible ops, grouped by the flexible ops they read or write
+  std::vector<std::vector<int>> FlexibleGroups() const {
+    std::vector<int> parents(net_def_->op_size());
+    for (int i = 0; i < net_def_->op_size(); ++i) {
+      parents[i] = i;
+    }
+    std::function<int(int)> find = [&](int i) {
+      return parents[i] == i ? i : parents[i] = find(parents[i]);
+    };
+    const std::unordered_set<int> flexible(flexible_.begin(),
+                                           flexible_.end());
+    std::unordered_map<std::string, int> producers;
+    for (int i = 0; i < net_def_->op_size(); ++i) {
+      const OperatorDef &op = net_def_->op(i);
+      for (auto &input : op.input()) {
+        auto producer = producers.find(input);
+        if (producer != producers.end() && flexible.count(i) == 1 &&
+            flexible.count(producer->second) == 1) {
+          parents[find(i)] = find(producer->second);
+        }
+      }
+      for (auto &output : op.output()) {
+        producers[output] = i;
+      }
+    }
+    std::map<int, std::vector<int>> groups;
+    for (int op_idx : flexible_) {
+      groups[find(op_idx)].push_back(op_idx);
+    }
+    std::vector<std::vector<int>> result;
+    for (auto &group : groups) {
+      result.push_back(group.second);
+    }
+    return result;
+  }
+
+  // elements transformed, weighted by TransformCost, as the net would
+  // insert the transforms with the memory types of the plan
+  int64_t Cost() const {
+    std::unordered_map<std::string, std::pair<MemoryType, int64_t>> tensors;
+    for (auto &input : input_mem_types_) {
+      tensors[input.first] = std::make_pair(input.second, 1);
+    }
+    for (auto &input_info : net_def_->input_info()) {
+      int64_t size = 1;
+      for (auto dim : input_info.dims()) {
+        size *= dim;
+      }
+      tensors[input_info.name()].second = size;
+    }
+    std::set<std::pair<std::string, MemoryType>> transformed;
+    int64_t cost = 0;
+    for (int i = 0; i < net_def_->op_size(); ++i) {
+      const OperatorDef &op = net_def_->op(i);
+      MemoryType mem_type = mem_types_[i];
+      if (TransformRequiredOp(op.type())) {
+        for (auto &input : op.input()) {
+          auto tensor = tensors.find(input);
+          if (tensor == tensors.end()) {
+            continue;
+          }
+          if (MemoryOptimizer::IsMemoryReuseOp(op.type())) {
+            mem_type = tensor->second.first;
+            break;
+          }
+          if (tensor->second.first != mem_type &&
+              transformed.emplace(input, mem_type).second) {
+            cost += TransformCost(tensor->second.first, mem_type) *
+                tensor->second.second;
+          }
+        }
+      }
+      for (int j = 0; j < op.output_size(); ++j) {
+        int64_t size = 1;
+        if (j < op.output_shape_size()) {
+          for (auto dim : op.output_shape(j).dims()) {
+            size *= dim;
+          }
+        }
+        tensors[op.output(j)] = std::make_pair(mem_type, size);
+      }
+    }
+    // the outputs are read from GPU buffers
+    for (auto &output_info : net_def_->output_info()) {
+      auto tensor = tensors.find(output_info.name());
+      if (tensor != tensors.end() &&
+          tensor->second.first == MemoryType::GPU_IMAGE) {
+        cost += TransformCost(MemoryType::GPU_IMAGE, MemoryType::GPU_BUFFER) *
+            tensor->second.second;
+      }
+    }
+    return cost;
+  }
+
+ private:
+  const NetDef *net_def_;
+  const std::unordered_map<std::string, MemoryType> input_mem_types_;
+  std::vector<MemoryType> mem_types_;
+  // the ops with both image and buffer kernels
+  std::vector<int> flexible_;
+};
 #endif  // MACE_ENABLE_OPENCL
 
 }  // namespace
@@ -85,7 +350,7 @@ std::unique_ptr<Operation> SerialNet::CreateOperation(
   // If the target_device_type in available devices, use target_device_type,
   // otherwise, fallback to CPU device.
   for (auto device : available_devices) {
-    if (device == target_device_type) {
+    if (device == target_device_type && !IsShapeOnlyOp(op_def->type())) {
       device_type = target_device_type;
       construct_context->set_device(target_device_);
       if (target_device_->device_type() == DeviceType::GPU) {
@@ -96,9 +361,12 @@ std::unique_ptr<Operation> SerialNet::CreateOperation(
   }
   op_def->set_device_type(device_type);
 
-  // transpose output shape if run on CPU (default format is NHWC)
+  // transpose output shape if run on CPU (default format is NHWC), unless
+  // the op is converted to write NHWC
   if (!is_quantize_model && device_type == DeviceType::CPU &&
-      op_def->output_shape_size() == op_def->output_size()) {
+      op_def->output_shape_size() == op_def->output_size() &&
+      ProtoArgHelper::GetOptionalArg<OperatorDef, int>(
+          *op_def, kNHWCArg, 0) == 0) {
     for (int out_idx = 0; out_idx < op_def->output_size(); ++out_idx) {
       if (data_format_flag == NHWC &&
           op_def->output_shape(out_idx).dims_size() == 4) {
@@ -120,6 +388,25 @@ std::unique_ptr<Operation> SerialNet::CreateOperation(
   return std::move(op);
 }
 
+std::unordered_map<std::string, std::string> QuantizedOutputs(
+    const NetDef &net_def) {
+  std::unordered_set<std::string> output_names;
+  for (auto &output_info : net_def.output_info()) {
+    output_names.insert(output_info.name());
+  }
+  std::unordered_map<std::string, std::string> quantized_outputs;
+  for (auto &op : net_def.op()) {
+    if (op.type() == "Dequantize" && op.input_size() == 1 &&
+        op.output_size() == 1 && output_names.count(op.output(0)) == 1 &&
+        ProtoArgHelper::GetOptionalArg<OperatorDef, int>(
+            op, "T", static_cast<int>(DT_FLOAT)) ==
+            static_cast<int>(DT_UINT8)) {
+      quantized_outputs[op.output(0)] = op.input(0);
+    }
+  }
+  return quantized_outputs;
+}
+
 SerialNet::SerialNet(const OpRegistryBase *op_registry,
                      const NetDef *net_def,
                      Workspace *ws,
@@ -131,8 +418,19 @@ SerialNet::SerialNet(const OpRegistryBase *op_registry,
       cpu_device_(
           new CPUDevice(target_device->cpu_runtime()->num_threads(),
                         target_device->cpu_runtime()->policy(),
-                        target_device->cpu_runtime()->use_gemmlowp())) {
+                        target_device->cpu_runtime()->use_gemmlowp())),
+      changed_inputs_(~static_cast<uint64_t>(0)) {
   MACE_LATENCY_LOGGER(1, "Constructing SerialNet");
+  MACE_SYSTEM_TRACE("SerialNet::SerialNet");
+  CPURuntime *cpu_runtime = target_device->cpu_runtime();
+  if (cpu_runtime->sched_policy() != CPUSchedulingPolicy::CPU_SCHED_NORMAL) {
+    cpu_device_->cpu_runtime()->SetScheduling(cpu_runtime->sched_policy(),
+                                              cpu_runtime->sched_priority());
+  }
+  if (EnvEnabled("MACE_LOG_TENSOR_RANGE")) {
+    tensor_range_logger_.reset(new TensorRangeLogger);
+    AddObserver(tensor_range_logger_.get());
+  }
   // output tensor : related information
   std::unordered_map<std::string, InternalOutputInfo> output_map;
   // used for memory optimization
@@ -161,7 +459,9 @@ SerialNet::SerialNet(const OpRegistryBase *op_registry,
   }
 
   DataFormat data_format_flag = NHWC;
-  if (target_device_->device_type() == DeviceType::CPU) {
+  // the ops of a net partitioned between the DSP and CPU run on CPU
+  if (target_device_->device_type() == DeviceType::CPU ||
+      target_device_->device_type() == DeviceType::HEXAGON) {
     target_mem_type = MemoryType::CPU_BUFFER;
     for (auto &input_info : net_def->input_info()) {
       std::vector<index_t> input_shape =
@@ -191,7 +491,8 @@ SerialNet::SerialNet(const OpRegistryBase *op_registry,
     for (auto &input_info : net_def->input_info()) {
       auto input_data_format = static_cast<DataFormat>(
           input_info.data_format());
-      if (input_data_format == DataFormat::DF_NONE) {
+      // quantized tensors are NHWC on the CPU as well, none is transposed
+      if (input_data_format == DataFormat::DF_NONE || is_quantize_model) {
         data_format_flag = DataFormat::DF_NONE;
       }
       std::vector<index_t> input_shape =
@@ -199,15 +500,69 @@ SerialNet::SerialNet(const OpRegistryBase *op_registry,
                                input_info.dims().end());
       // update tensor shape map
       tensor_shape_map[input_info.name()] = input_shape;
-      output_map.emplace(input_info.name(), InternalOutputInfo(
-          target_mem_type, DataType::DT_FLOAT, input_shape, -1));
+      // inputs fed as images are read without the buffer transform
+      const Tensor *input_tensor = ws_->GetTensor(input_info.name());
+      if (input_tensor != nullptr && input_tensor->has_opencl_image()) {
+        output_map.emplace(input_info.name(), InternalOutputInfo(
+            MemoryType::GPU_IMAGE, input_tensor->dtype(), input_shape, -1));
+      } else {
+        output_map.emplace(input_info.name(), InternalOutputInfo(
+            target_mem_type, DataType::DT_FLOAT, input_shape, -1));
+      }
     }
   }
 #endif  // MACE_ENABLE_OPENCL
 
   OpConstructContext construct_context(ws_, &tensor_shape_map);
+#ifdef MACE_ENABLE_OPENCL
+  // the memory type each GPU op is constructed with
+  std::vector<MemoryType> op_mem_types;
+  MemoryType model_mem_type = MemoryType::GPU_IMAGE;
+  if (target_device_->device_type() == DeviceType::GPU) {
+    model_mem_type = target_device_->gpu_runtime()->UseImageMemory() ?
+                     MemoryType::GPU_IMAGE : MemoryType::GPU_BUFFER;
+    std::vector<bool> on_gpu(net_def->op_size(), false);
+    for (int idx = 0; idx < net_def->op_size(); ++idx) {
+      construct_context.set_device(target_device_);
+      construct_context.set_operator_def(
+          std::make_shared<OperatorDef>(net_def->op(idx)));
+      on_gpu[idx] = op_registry->AvailableDevices(
+          net_def->op(idx).type(), &construct_context).count(
+              DeviceType::GPU) == 1;
+    }
+    std::unordered_map<std::string, MemoryType> input_mem_types;
+    for (auto &input_info : net_def->input_info()) {
+      input_mem_types[input_info.name()] =
+          output_map.at(input_info.name()).mem_type;
+    }
+    op_mem_types = MemoryTypePlanner(
+        net_def, on_gpu, input_mem_types, model_mem_type,
+        target_device_->gpu_runtime()->opencl_runtime()->GetMaxImage2DSize())
+        .Plan();
+  }
+  // When the GPU shares the host memory, the CPU ops read the GPU buffers
+  // of their own layout and data type in place, mapped by RunOperation,
+  // instead of through a copy.
+  const bool host_unified_memory =
+      target_device_->device_type() == DeviceType::GPU &&
+      target_device_->gpu_runtime()->opencl_runtime()->IsHostUnifiedMemory();
+  auto read_in_place = [&](const InternalOutputInfo &info,
+                           const MemoryType wanted_mem_type,
+                           const DataType wanted_dt) {
+    return host_unified_memory && info.mem_type == MemoryType::GPU_BUFFER &&
+        wanted_mem_type == MemoryType::CPU_BUFFER && info.dtype == wanted_dt &&
+        !info.shape.empty() &&
+        (info.shape.size() != 4 || data_format_flag != DataFormat::NHWC);
+  };
+#endif  // MACE_ENABLE_OPENCL
   for (int idx = 0; idx < net_def->op_size(); ++idx) {
     std::shared_ptr<OperatorDef> op_def(new OperatorDef(net_def->op(idx)));
+#ifdef MACE_ENABLE_OPENCL
+    if (!op_mem_types.empty() &&
+        op_mem_types[idx] != MemoryType::CPU_BUFFER) {
+      target_device_->gpu_runtime()->set_mem_type(op_mem_types[idx]);
+    }
+#endif  // MACE_ENABLE_OPENCL
     // Create operation
     auto op = CreateOperation(op_registry,
                               &construct_context,
@@ -233,8 +588,13 @@ SerialNet::SerialNet(const OpRegistryBase *op_registry,
             MemoryType wanted_in_mem_type =
                 construct_context.GetInputMemType(i);
             DataType wanted_in_dt = construct_context.GetInputDataType(i);
-            if (output_map.at(op_def->input(i)).mem_type != wanted_in_mem_type
-                || output_map.at(op_def->input(i)).dtype != wanted_in_dt) {
+            if (read_in_place(output_map.at(op_def->input(i)),
+                              wanted_in_mem_type, wanted_in_dt)) {
+              VLOG(1) << "Operator " << op_def->name() << " reads GPU buffer "
+                      << op_def->input(i) << " in place";
+            } else if (output_map.at(op_def->input(i)).mem_type !=
+                wanted_in_mem_type ||
+                output_map.at(op_def->input(i)).dtype != wanted_in_dt) {
               auto t_input_name = TransformedName(op_def->input(i),
                                                   wanted_in_mem_type);
               auto &output_info = output_map.at(op_def->input(i));
@@ -251,7 +611,7 @@ SerialNet::SerialNet(const OpRegistryBase *op_registry,
                 op_def->set_input(i, t_input_name);
                 auto input_shape = output_info.shape;
                 if (output_info.mem_type == MemoryType::CPU_BUFFER &&
-                    input_shape.size() == 4) {
+                    input_shape.size() == 4 && !is_quantize_model) {
                   // NCHW -> NHWC
                   input_shape =
                       TransposeShape<index_t, index_t>(input_shape,
@@ -308,12 +668,18 @@ SerialNet::SerialNet(const OpRegistryBase *op_registry,
       }
     }
 #endif  // MACE_ENABLE_OPENCL
+    if (op->device_type() == DeviceType::CPU) {
+      op->set_num_threads(EstimateOpThreads(*op_def, tensor_shape_map));
+    }
     operators_.emplace_back(std::move(op));
     // where to do graph reference count.
     mem_optimizer->UpdateTensorRef(op_def.get());
   }
 
 #ifdef MACE_ENABLE_OPENCL
+  if (!op_mem_types.empty()) {
+    target_device_->gpu_runtime()->set_mem_type(model_mem_type);
+  }
   // Transform the output tensor if necessary
   if (target_device_->device_type() == DeviceType::GPU) {
     for (auto &output_info : net_def->output_info()) {
@@ -365,18 +731,151 @@ SerialNet::SerialNet(const OpRegistryBase *op_registry,
   for (auto &output_info : net_def->output_info()) {
     mem_optimizer->UpdateTensorRef(output_info.name());
   }
+  std::vector<std::string> kept_tensors;
+  PlanIncrementalRun(net_def, mem_optimizer, &kept_tensors);
+  for (auto &quantized_output : QuantizedOutputs(*net_def)) {
+    mem_optimizer->UpdateTensorRef(quantized_output.second);
+    kept_tensors.push_back(quantized_output.second);
+  }
+
+  std::vector<const OperatorDef *> op_defs;
+  std::vector<int> inplace_inputs;
+  for (auto &op : operators_) {
+    op_defs.push_back(op->operator_def().get());
+    inplace_inputs.push_back(op->InplaceInputIndex());
+  }
+  // Let the producers of a Concat write into its output, the CPU tensors
+  // of quantized models are NHWC so that only inner axes would be sliced
+  if (!is_quantize_model) {
+    mem_optimizer->PlanConcatViews(op_defs);
+  }
+
+  // Take the plan stored in the model (see MaceEngine::ExportMemoryPlan)
+  // if it was made for these operations
+  std::vector<std::string> output_names;
+  for (auto &output_info : net_def->output_info()) {
+    output_names.push_back(output_info.name());
+  }
+  // the kept tensors outlive the net like its outputs
+  output_names.insert(output_names.end(), kept_tensors.begin(),
+                      kept_tensors.end());
+  mem_optimizer->Sign(op_defs, inplace_inputs, output_mem_map, output_names);
+  if (net_def->has_memory_plan() &&
+      mem_optimizer->LoadPlan(net_def->memory_plan())) {
+    VLOG(1) << "Load the memory plan of the model";
+    return;
+  }
 
   // Do memory optimization
   for (auto &op : operators_) {
     VLOG(2) << "Operator " << op->debug_def().name() << "<" << op->device_type()
             << ", " << op->debug_def().type() << ">";
-    mem_optimizer->Optimize(op->operator_def().get(), output_mem_map);
+    mem_optimizer->Optimize(op->operator_def().get(), output_mem_map,
+                            op->InplaceInputIndex());
   }
+  mem_optimizer->PlanArena();
+  mem_optimizer->PlanImages();
   VLOG(1) << mem_optimizer->DebugInfo();
 }
 
+void SerialNet::PlanIncrementalRun(const NetDef *net_def,
+                                   MemoryOptimizer *mem_optimizer,
+                                   std::vector<std::string> *kept_tensors) {
+  const std::vector<std::string> &inputs =
+      mem_optimizer->incremental_inputs();
+  if (inputs.empty()) {
+    return;
+  }
+  // the last bit stands for the values changing at each run
+  const uint64_t kAlwaysChanged = static_cast<uint64_t>(1) << 63;
+  MACE_CHECK(inputs.size() < 64, "too many incremental inputs");
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    incremental_input_bits_[inputs[i]] = static_cast<uint64_t>(1) << i;
+  }
+  // the weights depend on no input
+  std::unordered_map<std::string, uint64_t> tensor_inputs;
+  for (auto &input_info : net_def->input_info()) {
+    auto bit = incremental_input_bits_.find(input_info.name());
+    tensor_inputs[input_info.name()] =
+        bit == incremental_input_bits_.end() ? kAlwaysChanged : bit->second;
+  }
+  std::set<std::string> kept;
+  for (auto &op : operators_) {
+    uint64_t op_inputs = op->AlwaysRuns() ? kAlwaysChanged : 0;
+    for (auto &input : op->debug_def().input()) {
+      auto iter = tensor_inputs.find(input);
+      if (iter != tensor_inputs.end()) {
+        op_inputs |= iter->second;
+      }
+    }
+    for (auto &output : op->debug_def().output()) {
+      tensor_inputs[output] = op_inputs;
+    }
+    if ((op_inputs & kAlwaysChanged) == 0) {
+      incremental_ops_[op.get()] = IncrementalOp{op_inputs, false};
+    }
+  }
+  // an op of the same inputs as the producer of a tensor is skipped along
+  // with it, the others could read the tensor later
+  for (auto &op : operators_) {
+    auto op_iter = incremental_ops_.find(op.get());
+    const uint64_t op_inputs = op_iter == incremental_ops_.end() ?
+                               kAlwaysChanged : op_iter->second.inputs;
+    for (auto &input : op->debug_def().input()) {
+      auto iter = tensor_inputs.find(input);
+      // the input tensors of the net are not reused
+      if (iter != tensor_inputs.end() && iter->second != op_inputs &&
+          (iter->second & kAlwaysChanged) == 0 &&
+          incremental_input_bits_.count(input) == 0 &&
+          kept.insert(input).second) {
+        mem_optimizer->UpdateTensorRef(input);
+      }
+    }
+  }
+  kept_tensors->assign(kept.begin(), kept.end());
+  VLOG(1) << incremental_ops_.size() << " of " << operators_.size()
+          << " operations depend only on the incremental inputs "
+          << MakeString(inputs) << ", keep " << kept.size() << " tensors";
+}
+
+MaceStatus SerialNet::RunDeferredInitTasks(
+    const std::vector<std::function<MaceStatus()>> &tasks) {
+  if (tasks.empty()) {
+    return MaceStatus::MACE_SUCCESS;
+  }
+  MACE_LATENCY_LOGGER(1, "Running ", tasks.size(), " deferred init tasks");
+  MACE_SYSTEM_TRACE("SerialNet::RunDeferredInitTasks");
+  std::vector<MaceStatus> status(tasks.size(), MaceStatus::MACE_SUCCESS);
+#ifdef MACE_ENABLE_OPENMP
+  const int omp_threads = omp_get_max_threads();
+#endif  // MACE_ENABLE_OPENMP
+  // a task on each thread, rather than the threads of each task
+  cpu_device_->cpu_runtime()->thread_pool()->Compute1D(
+      [&](int64_t start, int64_t end, int64_t step) {
+#ifdef MACE_ENABLE_OPENMP
+        omp_set_num_threads(1);
+#endif  // MACE_ENABLE_OPENMP
+        for (int64_t i = start; i < end; i += step) {
+          status[i] = tasks[i]();
+        }
+      }, 0, static_cast<int64_t>(tasks.size()), 1, 1);
+#ifdef MACE_ENABLE_OPENMP
+  omp_set_num_threads(omp_threads);
+#endif  // MACE_ENABLE_OPENMP
+  for (const MaceStatus &task_status : status) {
+    MACE_RETURN_IF_ERROR(task_status);
+  }
+  return MaceStatus::MACE_SUCCESS;
+}
+
 MaceStatus SerialNet::Init() {
   MACE_LATENCY_LOGGER(1, "Initializing SerialNet");
+  MACE_SYSTEM_TRACE("SerialNet::Init");
+  // the ops create their outputs in the workspace in order, then pack their
+  // weights concurrently; GPU ops are initialized in order, as the OpenCL
+  // runtime is not shared between threads
+  std::vector<std::function<MaceStatus()>> deferred_tasks;
+  cpu_device_->cpu_runtime()->BindOpenMPThreads();
   OpInitContext init_context(ws_);
   for (auto iter = operators_.begin(); iter != operators_.end(); ++iter) {
     auto &op = *iter;
@@ -386,134 +885,930 @@ MaceStatus SerialNet::Init() {
     } else {
       init_context.set_device(cpu_device_);
     }
+    init_context.set_deferred_tasks(
+        device_type == DeviceType::CPU ? &deferred_tasks : nullptr);
     // Initialize the operation
     MACE_RETURN_IF_ERROR(op->Init(&init_context));
   }
+  MACE_RETURN_IF_ERROR(RunDeferredInitTasks(deferred_tasks));
+  for (size_t i = 0; i < operators_.size(); ++i) {
+    for (auto &output : operators_[i]->debug_def().output()) {
+      tensor_producers_[output] = i;
+    }
+  }
   return MaceStatus::MACE_SUCCESS;
 }
 
+void SerialNet::ResetStates() {
+  for (auto &op : operators_) {
+    op->ResetState();
+  }
+}
+
+bool SerialNet::IsSkipped(const std::string &tensor_name) const {
+  if (skipped_ops_.empty()) {
+    return false;
+  }
+  auto iter = tensor_producers_.find(tensor_name);
+  return iter != tensor_producers_.end() && skipped_ops_[iter->second];
+}
+
+void SerialNet::SetChangedInputs(const std::set<std::string> &input_names) {
+  changed_inputs_ = static_cast<uint64_t>(0);
+  for (auto &name : input_names) {
+    auto bit = incremental_input_bits_.find(name);
+    if (bit != incremental_input_bits_.end()) {
+      changed_inputs_ |= bit->second;
+    }
+  }
+}
+
+void SerialNet::SetReplayKey(const std::string &key) {
+#ifdef MACE_ENABLE_OPENCL
+  replay_key_ = key;
+  if (key != recorded_key_) {
+    recorded_key_.clear();
+    kernel_recorder_.Clear();
+  }
+#else
+  MACE_UNUSED(key);
+#endif  // MACE_ENABLE_OPENCL
+}
+
+void SerialNet::InvalidateSkippedOps() {
+  if (incremental_ops_.empty()) {
+    return;
+  }
+  for (size_t i = 0; i < skipped_ops_.size(); ++i) {
+    auto iter = incremental_ops_.find(operators_[i].get());
+    if (skipped_ops_[i] && iter != incremental_ops_.end()) {
+      iter->second.valid = false;
+    }
+  }
+}
+
+void SerialNet::EnableLatencyMetrics() {
+  if (op_latency_ == nullptr) {
+    op_latency_.reset(new OpLatencyObserver(operators_.size()));
+    AddObserver(op_latency_.get());
+  }
+}
+
+namespace {
+
+// the L2 cache of the cores which do not report it
+constexpr int64_t kDefaultL2CacheBytes = 512 << 10;
+
+// the activations of a strip take half of the L2 cache of a core
+int64_t LineBufferBudgetBytes() {
+  const DeviceProfile &profile = GetDeviceProfile();
+  return (profile.l2_cache_bytes > 0 ?
+      profile.l2_cache_bytes : kDefaultL2CacheBytes) / 2;
+}
+
+// the bytes of the float output of an op, of its shape in the model
+int64_t OutputBytes(const OperatorDef &op_def) {
+  int64_t bytes = sizeof(float);
+  for (int64_t dim : op_def.output_shape(0).dims()) {
+    bytes *= std::max<int64_t>(dim, 0);
+  }
+  return bytes;
+}
+
+}  // namespace
+
+void SerialNet::EnableLineBufferedHead(
+    const std::set<std::string> &output_names) {
+  if (line_buffered_head_ != nullptr || operators_.empty() ||
+      target_device_->device_type() != DeviceType::CPU ||
+      !incremental_ops_.empty()) {
+    return;
+  }
+  const int64_t budget_bytes = LineBufferBudgetBytes();
+  std::unordered_map<const Tensor *, int> consumers;
+  for (auto &op : operators_) {
+    for (const Tensor *input : op->Inputs()) {
+      ++consumers[input];
+    }
+  }
+
+  // the longest chain of ops each reading the output of the previous one
+  // only, while it is too large for the cache, whose reach is known
+  NetDef head_def;
+  std::unique_ptr<LineBufferedHead> head(new LineBufferedHead);
+  head->num_ops = 0;
+  head->input = nullptr;
+  head->input_idx = -1;
+  head->halo = 0;
+  for (size_t i = 0; i < operators_.size(); ++i) {
+    Operation *op = operators_[i].get();
+    const OperatorDef &op_def = op->debug_def();
+    const Tensor *op_input = nullptr;
+    int op_input_idx = -1;
+    bool single_input = true;
+    for (int j = 0; j < op->InputSize(); ++j) {
+      if (op->Inputs()[j]->is_weight()) {
+        continue;
+      }
+      single_input = single_input && op_input == nullptr;
+      op_input = op->Inputs()[j];
+      op_input_idx = j;
+    }
+    if (op->device_type() != DeviceType::CPU || !single_input ||
+        op_input == nullptr || op->OutputSize() != 1 ||
+        op_def.output_shape_size() != 1 ||
+        op_def.output_shape(0).dims_size() != 4 ||
+        ProtoArgHelper::GetOptionalArg<OperatorDef, int>(
+            op_def, "T", static_cast<int>(DT_FLOAT)) != DT_FLOAT) {
+      break;
+    }
+    if (i == 0) {
+      head->input = op_input;
+      head->input_idx = op_input_idx;
+      head_def.add_input_info()->set_name(op_def.input(op_input_idx));
+    } else {
+      const OperatorDef &prev_def = operators_[i - 1]->debug_def();
+      if (op_input != operators_[i - 1]->Output(0) ||
+          consumers[op_input] != 1 ||
+          output_names.count(prev_def.output(0)) == 1 ||
+          OutputBytes(prev_def) <= budget_bytes) {
+        break;
+      }
+    }
+    for (int j = 0; j < op->InputSize(); ++j) {
+      if (op->Inputs()[j]->is_weight()) {
+        ConstTensor *weight = head_def.add_tensors();
+        weight->set_name(op_def.input(j));
+        for (index_t dim : op->Inputs()[j]->shape()) {
+          weight->add_dims(dim);
+        }
+      }
+    }
+    *head_def.add_op() = op_def;
+    std::map<std::string, SpatialReach> reaches;
+    if (ComputeSpatialReach(head_def, {op_def.output(0)}, &reaches) !=
+        MaceStatus::MACE_SUCCESS) {
+      break;
+    }
+    const SpatialReach &reach = reaches.at(op_def.output(0));
+    head->halo = reach.halo[0];
+    head->strides.push_back(reach.stride[0]);
+    head->chain_input_idx.push_back(op_input_idx);
+    head->outputs.push_back(op->Output(0));
+    head->num_ops = i + 1;
+  }
+  if (head->num_ops < 2) {
+    return;
+  }
+
+  // the strips, which the ops write instead of their planned outputs, as
+  // those may share memory with the input or the output of the chain
+  const std::string &input_name =
+      operators_[0]->debug_def().input(head->input_idx);
+  head->strip_input = ws_->CreateTensor(input_name + "_line_buffer",
+                                        cpu_device_->allocator(), DT_FLOAT);
+  for (size_t i = 0; i < head->num_ops; ++i) {
+    head->strip_outputs.push_back(ws_->CreateTensor(
+        operators_[i]->debug_def().output(0) + "_line_buffer",
+        cpu_device_->allocator(), DT_FLOAT));
+  }
+  head->tile_rows = 0;
+  VLOG(1) << "Run the first " << head->num_ops
+          << " ops on strips of rows, with halos of " << head->halo;
+  line_buffered_head_ = std::move(head);
+}
+
+void SerialNet::PlanLineBufferedHead() {
+  LineBufferedHead *head = line_buffered_head_.get();
+  head->input_shape = head->input->shape();
+  head->spans.clear();
+  if (head->input->dim_size() != 4 || head->input->dtype() != DT_FLOAT) {
+    return;
+  }
+  // the shapes of the outputs in the model, which must be those of the
+  // input, at the layout of the input at runtime
+  const DataFormat data_format = head->input->data_format();
+  const int h_axis = data_format == DataFormat::NCHW ? 2 : 1;
+  const index_t height = head->input_shape[h_axis];
+  int64_t row_bytes = head->input->raw_size() / height;
+  for (size_t i = 0; i < head->num_ops; ++i) {
+    const OperatorDef &op_def = operators_[i]->debug_def();
+    const auto &dims = op_def.output_shape(0).dims();
+    if (dims.Get(0) != head->input_shape[0] ||
+        dims.Get(h_axis) * head->strides[i] != height) {
+      VLOG(1) << "The input of " << MakeString(head->input_shape)
+              << " is not that of the model, the head is run whole";
+      return;
+    }
+    row_bytes += OutputBytes(op_def) / height;
+  }
+  // the rows of the strips which fit the budget, the halos they recompute
+  // at most as large as the rows they keep
+  const index_t align = head->strides.back();
+  const index_t halo = (head->halo + align - 1) / align * align;
+  index_t core_rows = LineBufferBudgetBytes() /
+      std::max<int64_t>(row_bytes, 1) - 2 * halo;
+  core_rows = std::max(core_rows / align * align,
+                       std::max((2 * halo + align - 1) / align * align,
+                                align));
+  const index_t tile_rows = core_rows + 2 * halo;
+  if (tile_rows >= height ||
+      PlanTileSpans(height, tile_rows, head->halo, align, &head->spans) !=
+          MaceStatus::MACE_SUCCESS) {
+    head->spans.clear();
+    return;
+  }
+
+  std::vector<index_t> strip_shape = head->input_shape;
+  strip_shape[h_axis] = tile_rows;
+  MaceStatus status = head->strip_input->Resize(strip_shape);
+  head->strip_input->set_data_format(data_format);
+  for (size_t i = 0; i < head->num_ops &&
+       status == MaceStatus::MACE_SUCCESS; ++i) {
+    const auto &dims = operators_[i]->debug_def().output_shape(0).dims();
+    strip_shape.assign(dims.begin(), dims.end());
+    strip_shape[h_axis] = tile_rows / head->strides[i];
+    status = head->strip_outputs[i]->Resize(strip_shape);
+    head->strip_outputs[i]->set_data_format(data_format);
+  }
+  if (status != MaceStatus::MACE_SUCCESS) {
+    LOG(WARNING) << "Failed to allocate the strips of the head of the net";
+    head->spans.clear();
+    return;
+  }
+  head->tile_rows = tile_rows;
+  VLOG(1) << "Run the first " << head->num_ops << " ops on "
+          << head->spans.size() << " strips of " << tile_rows << " of "
+          << height << " rows";
+}
+
+MaceStatus SerialNet::RunLineBufferedHead(
+    OpContext *context,
+    RunMetadata *run_metadata,
+    std::vector<std::pair<size_t, StatsFuture>> *deferred_stats) {
+  LineBufferedHead *head = line_buffered_head_.get();
+  const size_t last = head->num_ops - 1;
+  const std::vector<index_t> &input_shape = head->input_shape;
+  const auto &output_dims = operators_[last]->debug_def().output_shape(0);
+  const std::vector<index_t> output_shape(output_dims.dims().begin(),
+                                          output_dims.dims().end());
+  Tensor *output = head->outputs[last];
+  MACE_RETURN_IF_ERROR(output->Resize(output_shape));
+  const DataFormat data_format = head->input->data_format();
+  output->set_data_format(data_format);
+  const int h_axis = data_format == DataFormat::NCHW ? 2 : 1;
+  const int stride = head->strides[last];
+
+  operators_[0]->set_input(head->input_idx, head->strip_input);
+  for (size_t i = 0; i < head->num_ops; ++i) {
+    operators_[i]->set_output(0, head->strip_outputs[i]);
+    if (i > 0) {
+      operators_[i]->set_input(head->chain_input_idx[i],
+                               head->strip_outputs[i - 1]);
+    }
+  }
+  MaceStatus status = MaceStatus::MACE_SUCCESS;
+  for (const TileSpan &span : head->spans) {
+    CopySpatialWindow(head->input->data<float>(), input_shape, span.begin,
+                      0, head->strip_input->mutable_data<float>(),
+                      head->strip_input->shape(), 0, 0, head->tile_rows,
+                      input_shape[h_axis + 1], data_format);
+    for (size_t i = 0; i < head->num_ops &&
+         status == MaceStatus::MACE_SUCCESS; ++i) {
+      status = RunOperation(i, target_device_, cpu_device_, context,
+                            run_metadata, deferred_stats);
+    }
+    if (status != MaceStatus::MACE_SUCCESS) {
+      break;
+    }
+    CopySpatialWindow(head->strip_outputs[last]->data<float>(),
+                      head->strip_outputs[last]->shape(),
+                      (span.core_begin - span.begin) / stride, 0,
+                      output->mutable_data<float>(), output_shape,
+                      span.core_begin / stride, 0,
+                      (span.core_end - span.core_begin) / stride,
+                      output_shape[h_axis + 1], data_format);
+  }
+  operators_[0]->set_input(head->input_idx, head->input);
+  for (size_t i = 0; i < head->num_ops; ++i) {
+    operators_[i]->set_output(0, head->outputs[i]);
+    if (i > 0) {
+      operators_[i]->set_input(head->chain_input_idx[i],
+                               head->outputs[i - 1]);
+    }
+  }
+  return status;
+}
+
+void SerialNet::EnableWeightPrefetch() {
+  if (weight_prefetcher_ == nullptr) {
+    weight_prefetcher_.reset(new WeightPrefetcher(
+        operators_, WeightPrefetcher::DefaultBudgetBytes()));
+    if (weight_prefetcher_->empty()) {
+      weight_prefetcher_.reset();
+    } else {
+      AddObserver(weight_prefetcher_.get());
+    }
+  }
+}
+
+void SerialNet::GetLatencyMetrics(std::vector<OperatorLatencyStats> *stats,
+                                  bool reset) {
+  stats->clear();
+  if (op_latency_ == nullptr) {
+    return;
+  }
+  stats->resize(operators_.size());
+  for (size_t i = 0; i < operators_.size(); ++i) {
+    const Operation *op = operators_[i].get();
+    (*stats)[i].operator_name = op->debug_def().name();
+    (*stats)[i].type = op->debug_def().type();
+    op_latency_->histogram(i)->GetStats(&(*stats)[i].latency, reset);
+  }
+}
+
+void SerialNet::CreatePerfCounters() {
+  std::vector<int> thread_ids = {utils::CurrentThreadId()};
+#ifdef MACE_ENABLE_OPENMP
+  const int thread_count = cpu_device_->cpu_runtime()->thread_count();
+  std::mutex mutex;
+#pragma omp parallel num_threads(thread_count)
+  {
+    const int thread_id = utils::CurrentThreadId();
+    std::lock_guard<std::mutex> lock(mutex);
+    if (std::find(thread_ids.begin(), thread_ids.end(), thread_id) ==
+        thread_ids.end()) {
+      thread_ids.push_back(thread_id);
+    }
+  }
+#endif  // MACE_ENABLE_OPENMP
+  perf_counters_.reset(new utils::PerfCounters(thread_ids));
+  VLOG(1) << "Count the CPU ops on " << thread_ids.size() << " threads";
+}
+
 MaceStatus SerialNet::Run(RunMetadata *run_metadata) {
   MACE_MEMORY_LOGGING_GUARD();
   MACE_LATENCY_LOGGER(1, "Running net");
+  MACE_SYSTEM_TRACE("Net::Run");
+  cpu_device_->cpu_runtime()->BindOpenMPThreads();
   OpContext context(ws_, cpu_device_);
-  for (auto iter = operators_.begin(); iter != operators_.end(); ++iter) {
-    auto &op = *iter;
-    DeviceType device_type = op->device_type();
-    MACE_LATENCY_LOGGER(1, "Running operator ", op->debug_def().name(),
-                        "<", device_type, ", ", op->debug_def().type(),
-                        ", ",
-                        ProtoArgHelper::GetOptionalArg<OperatorDef, int>(
-                            op->debug_def(), "T", static_cast<int>(DT_FLOAT)),
-                        ">");
-    if (device_type == target_device_->device_type()) {
-      context.set_device(target_device_);
-    } else {
-      context.set_device(cpu_device_);
+  if (run_metadata != nullptr && perf_counters_ == nullptr &&
+      EnvEnabled("MACE_CPU_PERF_COUNTERS")) {
+    CreatePerfCounters();
+  }
+  // a batching queue is only synchronized once the whole net is enqueued
+  bool defer_stats = false;
+#ifdef MACE_ENABLE_OPENCL
+  defer_stats = run_metadata != nullptr &&
+      target_device_->device_type() == DeviceType::GPU &&
+      target_device_->gpu_runtime()->opencl_runtime()->IsQueueBatching();
+#endif  // MACE_ENABLE_OPENCL
+#ifdef MACE_ENABLE_OPENCL
+  // the host work of CPU ops, observers and stats is not replayed
+  const bool record = !replay_key_.empty() && run_metadata == nullptr &&
+      tracer_ == nullptr && observers_.empty() &&
+      incremental_ops_.empty() &&
+      target_device_->device_type() == DeviceType::GPU &&
+      std::all_of(operators_.begin(), operators_.end(),
+                  [](const std::unique_ptr<Operation> &op) {
+                    return op->device_type() == DeviceType::GPU;
+                  });
+  OpenCLRuntime *runtime = record ?
+      target_device_->gpu_runtime()->opencl_runtime() : nullptr;
+  if (record && recorded_key_ == replay_key_ &&
+      kernel_recorder_.replayable()) {
+    return kernel_recorder_.Replay(runtime);
+  }
+  if (record) {
+    recorded_key_.clear();
+    kernel_recorder_.Start(runtime->command_queue()());
+  }
+#endif  // MACE_ENABLE_OPENCL
+  std::vector<std::pair<size_t, StatsFuture>> deferred_stats;
+  skipped_ops_.clear();
+  size_t first_op = 0;
+  if (line_buffered_head_ != nullptr) {
+    if (line_buffered_head_->input->shape() !=
+        line_buffered_head_->input_shape) {
+      PlanLineBufferedHead();
+    }
+    if (!line_buffered_head_->spans.empty()) {
+      MACE_RETURN_IF_ERROR(RunLineBufferedHead(
+          &context, run_metadata,
+          defer_stats ? &deferred_stats : nullptr));
+      first_op = line_buffered_head_->num_ops;
+    }
+  }
+  for (size_t i = first_op; i < operators_.size(); ++i) {
+    MaceStatus status = RunOperation(i,
+                                     target_device_,
+                                     cpu_device_,
+                                     &context,
+                                     run_metadata,
+                                     defer_stats ? &deferred_stats
+                                                 : nullptr);
+    if (status != MaceStatus::MACE_SUCCESS) {
+#ifdef MACE_ENABLE_OPENCL
+      if (record) {
+        kernel_recorder_.Stop(false);
+      }
+#endif  // MACE_ENABLE_OPENCL
+      return status;
+    }
+    // the skipped ops write nothing, the blocks the memory optimizer
+    // planned for their tensors are left as they are
+    if (context.early_exit()) {
+      VLOG(2) << "Exit the net after " << operators_[i]->debug_def().name();
+      skipped_ops_.assign(operators_.size(), false);
+      std::fill(skipped_ops_.begin() + i + 1, skipped_ops_.end(), true);
+      InvalidateSkippedOps();
+      break;
+    }
+  }
+#ifdef MACE_ENABLE_OPENCL
+  if (record && kernel_recorder_.Stop(!context.early_exit())) {
+    recorded_key_ = replay_key_;
+  }
+#endif  // MACE_ENABLE_OPENCL
+  for (auto &stats : deferred_stats) {
+    stats.second.wait_fn(&run_metadata->op_stats[stats.first].stats);
+  }
+
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus SerialNet::RunOperation(
+    size_t op_idx,
+    Device *target_device,
+    Device *cpu_device,
+    OpContext *context,
+    RunMetadata *run_metadata,
+    std::vector<std::pair<size_t, StatsFuture>> *deferred_stats) {
+  Operation *op = operators_[op_idx].get();
+  if (!incremental_ops_.empty()) {
+    auto iter = incremental_ops_.find(op);
+    if (iter != incremental_ops_.end()) {
+      // the outputs of the previous run are still those of its inputs
+      if (iter->second.valid && (iter->second.inputs & changed_inputs_) == 0) {
+        return MaceStatus::MACE_SUCCESS;
+      }
+      iter->second.valid = true;
     }
+  }
+  DeviceType device_type = op->device_type();
+  MACE_LATENCY_LOGGER(1, "Running operator ", op->debug_def().name(),
+                      "<", device_type, ", ", op->debug_def().type(),
+                      ", ",
+                      ProtoArgHelper::GetOptionalArg<OperatorDef, int>(
+                          op->debug_def(), "T", static_cast<int>(DT_FLOAT)),
+                      ">");
+  MACE_SYSTEM_TRACE(op->debug_def().type(), " ", op->debug_def().name());
+  if (device_type == target_device->device_type()) {
+    context->set_device(target_device);
+  } else {
+    context->set_device(cpu_device);
+  }
+  // the GPU buffers a CPU op reads in place on host unified memory
+  std::vector<Tensor::MappingGuard> input_guards;
+  if (device_type == DeviceType::CPU &&
+      target_device->device_type() == DeviceType::GPU &&
+      !IsShapeOnlyOp(op->debug_def().type())) {
+    std::unordered_set<const Tensor *> mapped_inputs;
+    for (const Tensor *input : op->Inputs()) {
+      if (input != nullptr &&
+          input->memory_type() == MemoryType::GPU_BUFFER &&
+          mapped_inputs.insert(input).second) {
+        input_guards.emplace_back(input);
+      }
+    }
+  }
 
-    CallStats call_stats;
-    if (run_metadata == nullptr) {
-      MACE_RETURN_IF_ERROR(op->Run(&context));
+#ifdef MACE_ENABLE_OPENMP
+  if (device_type == DeviceType::CPU) {
+    // small ops run on fewer threads, down to the calling one
+    const int thread_count = context->device()->cpu_runtime()->thread_count();
+    omp_set_num_threads(op->num_threads() > 0 ?
+                        std::min(op->num_threads(), thread_count) :
+                        thread_count);
+  }
+#endif  // MACE_ENABLE_OPENMP
+
+  for (OpObserver *observer : observers_) {
+    observer->BeforeOp(op_idx, op, context);
+  }
+  // allocations of the op are traced within the scope
+  Tracer::Scope trace_scope(tracer_);
+  const int64_t start_micros = tracer_ != nullptr ? NowMicros() : 0;
+  CallStats call_stats;
+  std::vector<KernelStats> kernel_stats;
+  PerfCounterStats perf_stats = {0, 0, 0, 0, 0, 0};
+  if (run_metadata == nullptr) {
+#ifdef MACE_ENABLE_OPENCL
+    if (tracer_ != nullptr && device_type == DeviceType::GPU) {
+      OpenCLRuntime *runtime =
+          target_device->gpu_runtime()->opencl_runtime();
+      runtime->StartKernelRecording();
+      MaceStatus op_status = op->Run(context);
+      tracer_->AddKernels(op->debug_def().name(), start_micros,
+                          runtime->StopKernelRecording());
+      MACE_RETURN_IF_ERROR(op_status);
     } else {
-      if (device_type == DeviceType::CPU) {
-        call_stats.start_micros = NowMicros();
-        MACE_RETURN_IF_ERROR(op->Run(&context));
-        call_stats.end_micros = NowMicros();
-      } else if (device_type == DeviceType::GPU) {
-        StatsFuture future;
-        context.set_future(&future);
-        MACE_RETURN_IF_ERROR(op->Run(&context));
+      MACE_RETURN_IF_ERROR(op->Run(context));
+    }
+#else
+    MACE_RETURN_IF_ERROR(op->Run(context));
+#endif  // MACE_ENABLE_OPENCL
+  } else {
+    if (device_type == DeviceType::CPU) {
+      // the counters are opened by SerialNet::Run on the threads it runs
+      // ops on, not by the workers of DAGNet
+      utils::PerfCounters *perf_counters =
+          perf_counters_ != nullptr && perf_counters_->available() ?
+          perf_counters_.get() : nullptr;
+      if (perf_counters != nullptr) {
+        perf_counters->Start();
+      }
+      call_stats.start_micros = NowMicros();
+      MaceStatus op_status = op->Run(context);
+      call_stats.end_micros = NowMicros();
+      if (perf_counters != nullptr) {
+        perf_counters->Stop(&perf_stats);
+      }
+      MACE_RETURN_IF_ERROR(op_status);
+    } else if (device_type == DeviceType::GPU) {
+      StatsFuture future;
+      context->set_future(&future);
+#ifdef MACE_ENABLE_OPENCL
+      OpenCLRuntime *runtime =
+          target_device->gpu_runtime()->opencl_runtime();
+      runtime->StartKernelRecording();
+#endif  // MACE_ENABLE_OPENCL
+      MaceStatus op_status = op->Run(context);
+#ifdef MACE_ENABLE_OPENCL
+      std::vector<OpenCLKernelRecord> kernel_records =
+          runtime->StopKernelRecording();
+      if (tracer_ != nullptr) {
+        tracer_->AddKernels(op->debug_def().name(), start_micros,
+                            kernel_records);
+      }
+#endif  // MACE_ENABLE_OPENCL
+      MACE_RETURN_IF_ERROR(op_status);
+      context->set_future(nullptr);
+      if (deferred_stats != nullptr) {
+#ifdef MACE_ENABLE_OPENCL
+        if (!kernel_records.empty()) {
+          // the kernels are read once the op stats are waited for
+          const size_t op_idx = run_metadata->op_stats.size();
+          StatsFuture op_future = future;
+          future.wait_fn = [=](CallStats *stats) {
+            op_future.wait_fn(stats);
+            runtime->GetKernelStats(
+                kernel_records, &run_metadata->op_stats[op_idx].kernel_stats);
+          };
+        }
+#endif  // MACE_ENABLE_OPENCL
+        deferred_stats->emplace_back(run_metadata->op_stats.size(), future);
+      } else {
         future.wait_fn(&call_stats);
+#ifdef MACE_ENABLE_OPENCL
+        runtime->GetKernelStats(kernel_records, &kernel_stats);
+#endif  // MACE_ENABLE_OPENCL
       }
+    }
 
-      // Record run metadata
-      std::vector<int> strides;
-      int padding_type = -1;
-      std::vector<int> paddings;
-      std::vector<int> dilations;
-      std::vector<index_t> kernels;
-      std::string type = op->debug_def().type();
-
-      if (type.compare("Conv2D") == 0 ||
-          type.compare("Deconv2D") == 0 ||
-          type.compare("DepthwiseConv2d") == 0 ||
-          type.compare("DepthwiseDeconv2d") == 0 ||
-          type.compare("Pooling") == 0) {
-        strides = op->GetRepeatedArgs<int>("strides");
-        padding_type = op->GetOptionalArg<int>("padding", -1);
-        paddings = op->GetRepeatedArgs<int>("padding_values");
-        dilations = op->GetRepeatedArgs<int>("dilations");
-        if (type.compare("Pooling") == 0) {
-          kernels = op->GetRepeatedArgs<index_t>("kernels");
-        } else {
-          kernels = op->Input(1)->shape();
-        }
-      } else if (type.compare("MatMul") == 0) {
-        bool transpose_a = op->GetOptionalArg<bool>("transpose_a", false);
-        kernels = op->Input(0)->shape();
-        if (transpose_a) {
-          std::swap(kernels[kernels.size()-2], kernels[kernels.size()-1]);
-        }
-      } else if (type.compare("FullyConnected") == 0) {
+    // Record run metadata
+    std::vector<int> strides;
+    int padding_type = -1;
+    std::vector<int> paddings;
+    std::vector<int> dilations;
+    std::vector<index_t> kernels;
+    std::string type = op->debug_def().type();
+
+    if (type.compare("Conv2D") == 0 ||
+        type.compare("Deconv2D") == 0 ||
+        type.compare("DepthwiseConv2d") == 0 ||
+        type.compare("DepthwiseDeconv2d") == 0 ||
+        type.compare("Pooling") == 0) {
+      strides = op->GetRepeatedArgs<int>("strides");
+      padding_type = op->GetOptionalArg<int>("padding", -1);
+      paddings = op->GetRepeatedArgs<int>("padding_values");
+      dilations = op->GetRepeatedArgs<int>("dilations");
+      if (type.compare("Pooling") == 0) {
+        kernels = op->GetRepeatedArgs<index_t>("kernels");
+      } else {
         kernels = op->Input(1)->shape();
       }
+    } else if (type.compare("MatMul") == 0) {
+      bool transpose_a = op->GetOptionalArg<bool>("transpose_a", false);
+      kernels = op->Input(0)->shape();
+      if (transpose_a) {
+        std::swap(kernels[kernels.size()-2], kernels[kernels.size()-1]);
+      }
+    } else if (type.compare("FullyConnected") == 0) {
+      kernels = op->Input(1)->shape();
+    }
 
-      std::vector<std::vector<int64_t>> output_shapes;
-      for (auto output : op->Outputs()) {
-        output_shapes.push_back(output->shape());
-      }
-      OperatorStats op_stats = {op->debug_def().name(), op->debug_def().type(),
-                                output_shapes,
-                                {strides, padding_type, paddings, dilations,
-                                 kernels}, call_stats};
-      run_metadata->op_stats.emplace_back(op_stats);
-    }
-
-    VLOG(3) << "Operator " << op->debug_def().name()
-            << " has shape: " << MakeString(op->Output(0)->shape());
-
-    if (EnvEnabled("MACE_LOG_TENSOR_RANGE")) {
-      for (int i = 0; i < op->OutputSize(); ++i) {
-        if (op->debug_def().quantize_info_size() == 0) {
-          int data_type = op->GetOptionalArg("T", static_cast<int>(DT_FLOAT));
-          if (data_type == static_cast<int>(DT_FLOAT)) {
-            float max_v = std::numeric_limits<float>::lowest();
-            float min_v = std::numeric_limits<float>::max();
-            Tensor::MappingGuard guard(op->Output(i));
-            auto *output_data = op->Output(i)->data<float>();
-            for (index_t j = 0; j < op->Output(i)->size(); ++j) {
-              max_v = std::max(max_v, output_data[j]);
-              min_v = std::min(min_v, output_data[j]);
-            }
-            LOG(INFO) << "Tensor range @@" << op->debug_def().output(i)
-                      << "@@" << min_v << "," << max_v;
-          }
-        } else {
-          const int bin_size = 2048;
-          for (int ind = 0; ind < op->debug_def().quantize_info_size(); ++ind) {
-            float min_v = op->debug_def().quantize_info(ind).minval();
-            float max_v = op->debug_def().quantize_info(ind).maxval();
-            std::vector<int> bin_distribution(bin_size, 0);
-            float bin_v = (max_v - min_v) / bin_size;
-            Tensor::MappingGuard guard(op->Output(i));
-            auto *output_data = op->Output(i)->data<float>();
-            for (index_t j = 0; j < op->Output(i)->size(); ++j) {
-                int index = static_cast<int>((output_data[j] - min_v) / bin_v);
-                if (index < 0)
-                  index = 0;
-                else if (index > bin_size-1)
-                  index = bin_size-1;
-                bin_distribution[index]++;
-            }
-            LOG(INFO) << "Tensor range @@" << op->debug_def().output(i)
-                        << "@@" << min_v << "," << max_v<< "@@"
-                        << MakeString(bin_distribution);
-          }
+    std::vector<std::vector<int64_t>> output_shapes;
+    for (auto output : op->Outputs()) {
+      output_shapes.push_back(output->shape());
+    }
+    OperatorStats op_stats = {op->debug_def().name(), op->debug_def().type(),
+                              output_shapes,
+                              {strides, padding_type, paddings, dilations,
+                               kernels}, call_stats, kernel_stats};
+    op_stats.perf_counters = perf_stats;
+    run_metadata->op_stats.emplace_back(op_stats);
+  }
+  if (tracer_ != nullptr) {
+    // the enqueue span of GPU ops, their kernels are traced on the device
+    tracer_->AddSpan(
+        op->debug_def().name(), op->debug_def().type(), start_micros,
+        NowMicros(),
+        device_type == DeviceType::CPU ? "\"device\":\"CPU\""
+                                       : "\"device\":\"GPU\"");
+  }
+
+  VLOG(3) << "Operator " << op->debug_def().name()
+          << " has shape: " << MakeString(op->Output(0)->shape());
+
+  for (auto observer = observers_.rbegin(); observer != observers_.rend();
+       ++observer) {
+    (*observer)->AfterOp(op_idx, op, context);
+  }
+
+  return MaceStatus::MACE_SUCCESS;
+}
+
+DAGNet::DAGNet(const OpRegistryBase *op_registry,
+               const NetDef *net_def,
+               Workspace *ws,
+               Device *target_device,
+               MemoryOptimizer *mem_optimizer,
+               int num_workers)
+    : SerialNet(op_registry, net_def, ws, target_device, mem_optimizer),
+      run_metadata_(nullptr),
+      finished_count_(0),
+      running_count_(0),
+      exited_(false),
+      stop_(false) {
+  MACE_LATENCY_LOGGER(1, "Constructing DAGNet");
+  MACE_CHECK(target_device->device_type() == DeviceType::CPU,
+             "DAGNet only supports CPU");
+  MACE_CHECK(mem_optimizer->concurrent_branches(),
+             "DAGNet needs memory optimizer with concurrent branches");
+  // build dependencies from the producers of input tensors
+  const int op_size = static_cast<int>(operators_.size());
+  std::unordered_map<std::string, int> tensor_producer;
+  successors_.resize(op_size);
+  dependency_count_.resize(op_size, 0);
+  for (int i = 0; i < op_size; ++i) {
+    auto op_def = operators_[i]->operator_def();
+    std::set<int> producers;
+    for (auto &input : op_def->input()) {
+      auto producer = tensor_producer.find(input);
+      if (producer != tensor_producer.end()) {
+        producers.insert(producer->second);
+      }
+    }
+    for (int producer : producers) {
+      successors_[producer].push_back(i);
+    }
+    dependency_count_[i] = static_cast<int>(producers.size());
+    for (auto &output : op_def->output()) {
+      tensor_producer[output] = i;
+    }
+  }
+  num_workers = std::max(1, std::min(num_workers, op_size));
+  VLOG(1) << "Run DAGNet of " << op_size << " operations with "
+          << num_workers << " workers";
+  for (int i = 0; i < num_workers; ++i) {
+    workers_.emplace_back(&DAGNet::WorkerLoop, this);
+  }
+}
+
+DAGNet::~DAGNet() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  ready_cond_.notify_all();
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+}
+
+void DAGNet::WorkerLoop() {
+  // every worker has its own scratch buffer and OpenMP threads
+  CPURuntime *cpu_runtime = target_device_->cpu_runtime();
+  CPUDevice device(cpu_runtime->num_threads(),
+                   cpu_runtime->policy(),
+                   cpu_runtime->use_gemmlowp());
+  if (cpu_runtime->sched_policy() != CPUSchedulingPolicy::CPU_SCHED_NORMAL) {
+    utils::SetThreadScheduling(cpu_runtime->sched_policy(),
+                               cpu_runtime->sched_priority());
+    device.cpu_runtime()->SetScheduling(cpu_runtime->sched_policy(),
+                                        cpu_runtime->sched_priority());
+  }
+  OpContext context(ws_, &device);
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    ready_cond_.wait(lock, [this] { return stop_ || !ready_ops_.empty(); });
+    if (stop_) {
+      return;
+    }
+    if (status_ != MaceStatus::MACE_SUCCESS) {
+      ready_ops_.clear();
+      continue;
+    }
+    if (exited_) {
+      ready_ops_.clear();
+      continue;
+    }
+    const int op_idx = ready_ops_.front();
+    ready_ops_.pop_front();
+    ++running_count_;
+    lock.unlock();
+    context.set_early_exit(false);
+    MaceStatus status = RunOperation(
+        op_idx, &device, &device, &context,
+        run_metadata_ == nullptr ? nullptr : &op_metadata_[op_idx]);
+    lock.lock();
+    --running_count_;
+    ++finished_count_;
+    skipped_ops_[op_idx] = false;
+    if (status != MaceStatus::MACE_SUCCESS) {
+      status_ = status;
+    } else if (context.early_exit()) {
+      // the running ops finish, the others are not started
+      VLOG(2) << "Exit the net after "
+              << operators_[op_idx]->debug_def().name();
+      exited_ = true;
+      ready_ops_.clear();
+    } else {
+      for (int successor : successors_[op_idx]) {
+        if (--pending_count_[successor] == 0) {
+          ready_ops_.push_back(successor);
+          ready_cond_.notify_one();
         }
       }
     }
+    done_cond_.notify_all();
+  }
+}
+
+MaceStatus DAGNet::Run(RunMetadata *run_metadata) {
+  MACE_MEMORY_LOGGING_GUARD();
+  MACE_LATENCY_LOGGER(1, "Running net");
+  MACE_SYSTEM_TRACE("Net::Run");
+  std::unique_lock<std::mutex> lock(mutex_);
+  pending_count_ = dependency_count_;
+  for (size_t i = 0; i < pending_count_.size(); ++i) {
+    if (pending_count_[i] == 0) {
+      ready_ops_.push_back(static_cast<int>(i));
+    }
+  }
+  run_metadata_ = run_metadata;
+  if (run_metadata != nullptr) {
+    op_metadata_.assign(operators_.size(), RunMetadata());
+  }
+  finished_count_ = 0;
+  status_ = MaceStatus::MACE_SUCCESS;
+  exited_ = false;
+  skipped_ops_.assign(operators_.size(), true);
+  ready_cond_.notify_all();
+  done_cond_.wait(lock, [this] {
+    return finished_count_ == operators_.size() ||
+        ((status_ != MaceStatus::MACE_SUCCESS || exited_) &&
+         running_count_ == 0);
+  });
+  ready_ops_.clear();
+  if (exited_) {
+    InvalidateSkippedOps();
+  } else {
+    skipped_ops_.clear();
+  }
+  if (run_metadata != nullptr) {
+    for (auto &op_metadata : op_metadata_) {
+      run_metadata->op_stats.insert(run_metadata->op_stats.end(),
+                                    op_metadata.op_stats.begin(),
+                                    op_metadata.op_stats.end());
+    }
+  }
+  return status_;
+}
+
+#ifdef MACE_ENABLE_OPENCL
+MultiQueueNet::MultiQueueNet(const OpRegistryBase *op_registry,
+                             const NetDef *net_def,
+                             Workspace *ws,
+                             Device *target_device,
+                             MemoryOptimizer *mem_optimizer,
+                             int num_queues)
+    : SerialNet(op_registry, net_def, ws, target_device, mem_optimizer) {
+  MACE_LATENCY_LOGGER(1, "Constructing MultiQueueNet");
+  MACE_CHECK(target_device->device_type() == DeviceType::GPU,
+             "MultiQueueNet only supports GPU");
+  MACE_CHECK(mem_optimizer->concurrent_branches(),
+             "MultiQueueNet needs memory optimizer with concurrent branches");
+  const int op_size = static_cast<int>(operators_.size());
+  const size_t queue_count = static_cast<size_t>(
+      std::max(1, std::min(num_queues, op_size)));
+  MaceStatus status = target_device->gpu_runtime()->opencl_runtime()
+      ->SetCommandQueueCount(queue_count);
+  MACE_CHECK(status == MaceStatus::MACE_SUCCESS,
+             "Create OpenCL command queues failed");
+  // an operation follows its first producer whose queue is not taken by
+  // another successor yet, or starts a branch on the queue idle the longest
+  std::unordered_map<std::string, int> tensor_producer;
+  std::vector<bool> queue_taken(op_size, false);
+  std::vector<int> queue_last_op(queue_count, -1);
+  op_queues_.resize(op_size);
+  waited_ops_.resize(op_size);
+  signaled_ops_.resize(op_size, false);
+  op_events_.resize(op_size);
+  for (int i = 0; i < op_size; ++i) {
+    auto op_def = operators_[i]->operator_def();
+    std::set<int> producers;
+    for (auto &input : op_def->input()) {
+      auto producer = tensor_producer.find(input);
+      if (producer != tensor_producer.end()) {
+        producers.insert(producer->second);
+      }
+    }
+    int queue = -1;
+    for (int producer : producers) {
+      if (!queue_taken[producer]) {
+        queue_taken[producer] = true;
+        queue = static_cast<int>(op_queues_[producer]);
+        break;
+      }
+    }
+    if (queue < 0) {
+      queue = static_cast<int>(
+          std::min_element(queue_last_op.begin(), queue_last_op.end()) -
+          queue_last_op.begin());
+    }
+    op_queues_[i] = static_cast<size_t>(queue);
+    queue_last_op[queue] = i;
+    for (int producer : producers) {
+      if (op_queues_[producer] != op_queues_[i]) {
+        waited_ops_[i].push_back(producer);
+        signaled_ops_[producer] = true;
+      }
+    }
+    for (auto &output : op_def->output()) {
+      tensor_producer[output] = i;
+    }
   }
+  VLOG(1) << "Run MultiQueueNet of " << op_size << " operations on "
+          << queue_count << " command queues";
+}
 
+MaceStatus MultiQueueNet::Run(RunMetadata *run_metadata) {
+  MACE_MEMORY_LOGGING_GUARD();
+  MACE_LATENCY_LOGGER(1, "Running net");
+  MACE_SYSTEM_TRACE("Net::Run");
+  auto runtime = target_device_->gpu_runtime()->opencl_runtime();
+  MACE_RETURN_IF_ERROR(runtime->ForkCommandQueues());
+  MaceStatus run_status = RunOperations(run_metadata);
+  // the outputs are read from the first queue
+  MaceStatus join_status = runtime->JoinCommandQueues();
+  MACE_RETURN_IF_ERROR(run_status);
+  return join_status;
+}
+
+MaceStatus MultiQueueNet::RunOperations(RunMetadata *run_metadata) {
+  auto runtime = target_device_->gpu_runtime()->opencl_runtime();
+  cpu_device_->cpu_runtime()->BindOpenMPThreads();
+  OpContext context(ws_, cpu_device_);
+  std::vector<cl::Event> events;
+  skipped_ops_.clear();
+  for (size_t i = 0; i < operators_.size(); ++i) {
+    runtime->SetActiveCommandQueue(op_queues_[i]);
+    if (!waited_ops_[i].empty()) {
+      events.clear();
+      for (int producer : waited_ops_[i]) {
+        events.push_back(op_events_[producer]);
+      }
+      MACE_RETURN_IF_ERROR(runtime->EnqueueBarrier(events));
+    }
+    MACE_RETURN_IF_ERROR(RunOperation(i,
+                                      target_device_,
+                                      cpu_device_,
+                                      &context,
+                                      run_metadata));
+    if (signaled_ops_[i]) {
+      MACE_RETURN_IF_ERROR(runtime->EnqueueMarker(&op_events_[i]));
+    }
+    if (context.early_exit()) {
+      VLOG(2) << "Exit the net after " << operators_[i]->debug_def().name();
+      skipped_ops_.assign(operators_.size(), false);
+      std::fill(skipped_ops_.begin() + i + 1, skipped_ops_.end(), true);
+      InvalidateSkippedOps();
+      break;
+    }
+  }
   return MaceStatus::MACE_SUCCESS;
 }
+#endif  // MACE_ENABLE_OPENCL
 }  // namespace mace
@@ -15,13 +15,32 @@
 #ifndef MACE_CORE_NET_H_
 #define MACE_CORE_NET_H_
 
+#include <algorithm>
+#include <condition_variable>  // NOLINT(build/c++11)
+#include <deque>
+#include <functional>
 #include <memory>
+#include <mutex>  // NOLINT(build/c++11)
+#include <set>
 #include <string>
+#include <thread>  // NOLINT(build/c++11)
 #include <vector>
 #include <unordered_map>
+#include <utility>
 #include <sstream>
 
+#include "mace/core/future.h"
+#include "mace/core/op_observer.h"
 #include "mace/core/operator.h"
+#include "mace/core/tiled_execution.h"
+#include "mace/core/tracer.h"
+#include "mace/core/weight_prefetcher.h"
+#include "mace/utils/latency_histogram.h"
+#include "mace/utils/perf_counters.h"
+#ifdef MACE_ENABLE_OPENCL
+#include "mace/core/runtime/opencl/cl2_header.h"
+#include "mace/core/runtime/opencl/opencl_command_recorder.h"
+#endif  // MACE_ENABLE_OPENCL
 
 namespace mace {
 
@@ -29,6 +48,12 @@ class RunMetadata;
 class Workspace;
 class MemoryOptimizer;
 
+// The uint8 tensors the Dequantize ops of the outputs of a quantized net
+// read, by the names of the outputs. The nets keep them after the runs like
+// the outputs, to be handed out as the uint8 outputs of MaceEngine::Run.
+std::unordered_map<std::string, std::string> QuantizedOutputs(
+    const NetDef &net_def);
+
 class NetBase {
  public:
   NetBase() noexcept = default;
@@ -38,7 +63,76 @@ class NetBase {
 
   virtual MaceStatus Run(RunMetadata *run_metadata = nullptr) = 0;
 
+  // Reset the states all the stateful operations keep across runs.
+  virtual void ResetStates() {}
+
+  // Whether the last run exited early, see EarlyExit, before the operation
+  // producing the tensor, whose content is then stale.
+  virtual bool IsSkipped(const std::string &tensor_name) const {
+    MACE_UNUSED(tensor_name);
+    return false;
+  }
+
+  // Called before a run with the incremental inputs, see
+  // MemoryOptimizer::set_incremental_inputs, which changed since the
+  // previous one. All of them are taken as changed until it is called.
+  virtual void SetChangedInputs(const std::set<std::string> &input_names) {
+    MACE_UNUSED(input_names);
+  }
+
+  // Called before a run with a key of its shapes, e.g. of the input
+  // shapes, on GPU. The kernels of a run are recorded and the following
+  // runs of the same key replay them instead of running the operations,
+  // see MaceEngineConfig::SetGPUKernelReplay. An empty key runs the
+  // operations and drops the recorded kernels, e.g. once the memory they
+  // read is released.
+  virtual void SetReplayKey(const std::string &key) {
+    MACE_UNUSED(key);
+  }
+
+  // Trace the operations of the following runs, null to stop tracing.
+  void set_tracer(Tracer *tracer) { tracer_ = tracer; }
+
+  // Notify the observer around the operations of the following runs, it
+  // must outlive them or be removed. BeforeOp is called in the order the
+  // observers were added and AfterOp in the reverse order, so that the
+  // observers added last are the closest to the operations.
+  void AddObserver(OpObserver *observer) { observers_.push_back(observer); }
+
+  void RemoveObserver(OpObserver *observer) {
+    observers_.erase(std::remove(observers_.begin(), observers_.end(),
+                                 observer),
+                     observers_.end());
+  }
+
+  // Accumulate the latency of each operation across the following runs,
+  // called before the runs.
+  virtual void EnableLatencyMetrics() {}
+
+  virtual void GetLatencyMetrics(std::vector<OperatorLatencyStats> *stats,
+                                 bool reset) {
+    MACE_UNUSED(reset);
+    stats->clear();
+  }
+
+  // Prefetch the CPU weights of the next operation while one runs, called
+  // after Init.
+  virtual void EnableWeightPrefetch() {}
+
+  // Run the chain of CPU convolutions, poolings and ops of a single position
+  // at the head of the net on strips of rows, so that their activations
+  // stay in the cache, called after Init. The outputs of the net are not
+  // taken from the chain but its last op.
+  virtual void EnableLineBufferedHead(
+      const std::set<std::string> &output_names) {
+    MACE_UNUSED(output_names);
+  }
+
  protected:
+  Tracer *tracer_ = nullptr;
+  // read only while running, a single branch per operation when empty
+  std::vector<OpObserver *> observers_;
+
   MACE_DISABLE_COPY_AND_ASSIGN(NetBase);
 };
 
@@ -54,6 +148,24 @@ class SerialNet : public NetBase {
 
   MaceStatus Run(RunMetadata *run_metadata = nullptr) override;
 
+  void ResetStates() override;
+
+  bool IsSkipped(const std::string &tensor_name) const override;
+
+  void SetChangedInputs(const std::set<std::string> &input_names) override;
+
+  void SetReplayKey(const std::string &key) override;
+
+  void EnableLatencyMetrics() override;
+
+  void GetLatencyMetrics(std::vector<OperatorLatencyStats> *stats,
+                         bool reset) override;
+
+  void EnableWeightPrefetch() override;
+
+  void EnableLineBufferedHead(
+      const std::set<std::string> &output_names) override;
+
  private:
   std::unique_ptr<Operation> CreateOperation(
       const OpRegistryBase *op_registry,
@@ -62,16 +174,181 @@ class SerialNet : public NetBase {
       DataFormat input_format,
       bool is_quantize_model = false);
 
+  // Find the operations depending only on incremental inputs, and keep the
+  // tensors they hand to operations of other inputs out of memory reuse.
+  void PlanIncrementalRun(const NetDef *net_def,
+                          MemoryOptimizer *mem_optimizer,
+                          std::vector<std::string> *kept_tensors);
+
+  // Run the work the CPU ops deferred in Init, a task on each thread of the
+  // CPU runtime, and return the first error of the tasks.
+  MaceStatus RunDeferredInitTasks(
+      const std::vector<std::function<MaceStatus()>> &tasks);
+
+  // Open the perf counters of the calling thread and the OpenMP threads of
+  // the CPU runtime, which run the CPU ops.
+  void CreatePerfCounters();
+
+  // Plan the strips of the head for the shape of its input, no spans if
+  // they do not fit it.
+  void PlanLineBufferedHead();
+  // Run the head ops strip by strip, see EnableLineBufferedHead.
+  MaceStatus RunLineBufferedHead(
+      OpContext *context,
+      RunMetadata *run_metadata,
+      std::vector<std::pair<size_t, StatsFuture>> *deferred_stats);
+
+ protected:
+  // The ops after an early exit have no valid outputs to skip to.
+  void InvalidateSkippedOps();
+
+  // With `deferred_stats`, GPU ops are not waited for, their futures are
+  // queued with the index of their stats in `run_metadata` instead.
+  MaceStatus RunOperation(
+      size_t op_idx,
+      Device *target_device,
+      Device *cpu_device,
+      OpContext *context,
+      RunMetadata *run_metadata,
+      std::vector<std::pair<size_t, StatsFuture>> *deferred_stats = nullptr);
+
  protected:
   Workspace *ws_;
   Device *target_device_;
   // CPU is base device.
   Device *cpu_device_;
   std::vector<std::unique_ptr<Operation> > operators_;
+  // null if the latency metrics are disabled
+  std::unique_ptr<OpLatencyObserver> op_latency_;
+  // null unless the weights are prefetched
+  std::unique_ptr<WeightPrefetcher> weight_prefetcher_;
+  // The first num_ops ops, run on strips of tile_rows rows of their input
+  // which overlap by the halo of the output, each op writing the strip of
+  // its output into a strip tensor of its own, cut from the input and
+  // stitched into the output of the last op. The strips are planned for the
+  // shape of the input at its first run, and again when it changes, an
+  // input they do not fit runs the ops on the whole of it.
+  struct LineBufferedHead {
+    size_t num_ops;
+    const Tensor *input;
+    int input_idx;
+    int halo;
+    // the ratios of the rows of the input to those of the op outputs, and
+    // the index of the input of each op which reads the previous one
+    std::vector<int> strides;
+    std::vector<int> chain_input_idx;
+    std::vector<Tensor *> outputs;
+    Tensor *strip_input;
+    std::vector<Tensor *> strip_outputs;
+    std::vector<index_t> input_shape;
+    index_t tile_rows;
+    std::vector<TileSpan> spans;
+  };
+  // null unless the head runs on strips
+  std::unique_ptr<LineBufferedHead> line_buffered_head_;
+  // null unless MACE_LOG_TENSOR_RANGE is set
+  std::unique_ptr<TensorRangeLogger> tensor_range_logger_;
+  // opened by the first run with metadata if MACE_CPU_PERF_COUNTERS is set
+  std::unique_ptr<utils::PerfCounters> perf_counters_;
+  // the operation producing each tensor, and the operations the last run
+  // skipped after an early exit, empty if it ran them all
+  std::unordered_map<std::string, size_t> tensor_producers_;
+  std::vector<bool> skipped_ops_;
+  // for the incremental runs, the bit of each incremental input, and for
+  // each op depending only on them, the bits of the inputs it depends on
+  // and whether its outputs are those of these inputs, the op is skipped
+  // if none of them changed; the bits of the inputs changed for the run
+  struct IncrementalOp {
+    uint64_t inputs;
+    bool valid;
+  };
+  std::unordered_map<std::string, uint64_t> incremental_input_bits_;
+  std::unordered_map<const Operation *, IncrementalOp> incremental_ops_;
+  uint64_t changed_inputs_;
+#ifdef MACE_ENABLE_OPENCL
+  // the key of the next run and the one of the recorded kernels
+  std::string replay_key_;
+  std::string recorded_key_;
+  OpenCLCommandRecorder kernel_recorder_;
+#endif  // MACE_ENABLE_OPENCL
 
   MACE_DISABLE_COPY_AND_ASSIGN(SerialNet);
 };
 
+// Run independent operations of a CPU net concurrently, following the
+// producer/consumer relations of their tensors. The memory optimizer must
+// have concurrent branches enabled so that parallel branches never share
+// a memory block.
+class DAGNet : public SerialNet {
+ public:
+  DAGNet(const OpRegistryBase *op_registry,
+         const NetDef *net_def,
+         Workspace *ws,
+         Device *target_device,
+         MemoryOptimizer *mem_optimizer,
+         int num_workers);
+  ~DAGNet() override;
+
+  MaceStatus Run(RunMetadata *run_metadata = nullptr) override;
+
+ private:
+  void WorkerLoop();
+
+ private:
+  // successors_[i]: operations consuming the outputs of operation i
+  std::vector<std::vector<int>> successors_;
+  std::vector<int> dependency_count_;
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable ready_cond_;
+  std::condition_variable done_cond_;
+  // states of the running net
+  std::deque<int> ready_ops_;
+  std::vector<int> pending_count_;
+  std::vector<RunMetadata> op_metadata_;
+  RunMetadata *run_metadata_;
+  size_t finished_count_;
+  int running_count_;
+  MaceStatus status_;
+  // an operation exited the net early
+  bool exited_;
+  bool stop_;
+
+  MACE_DISABLE_COPY_AND_ASSIGN(DAGNet);
+};
+
+#ifdef MACE_ENABLE_OPENCL
+// Enqueue independent branches of a GPU net onto several OpenCL command
+// queues, so that their kernels can run at the same time. An operation
+// waits for the producers of its inputs on other queues through events.
+// The memory optimizer must have concurrent branches enabled so that
+// parallel branches never share a memory block.
+class MultiQueueNet : public SerialNet {
+ public:
+  MultiQueueNet(const OpRegistryBase *op_registry,
+                const NetDef *net_def,
+                Workspace *ws,
+                Device *target_device,
+                MemoryOptimizer *mem_optimizer,
+                int num_queues);
+
+  MaceStatus Run(RunMetadata *run_metadata = nullptr) override;
+
+ private:
+  MaceStatus RunOperations(RunMetadata *run_metadata);
+
+ private:
+  std::vector<size_t> op_queues_;
+  // waited_ops_[i]: producers of operation i's inputs on other queues
+  std::vector<std::vector<int>> waited_ops_;
+  // whether some operation on another queue waits for operation i
+  std::vector<bool> signaled_ops_;
+  std::vector<cl::Event> op_events_;
+
+  MACE_DISABLE_COPY_AND_ASSIGN(MultiQueueNet);
+};
+#endif  // MACE_ENABLE_OPENCL
+
 }  // namespace mace
 
 #endif  // MACE_CORE_NET_H_
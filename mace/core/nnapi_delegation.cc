@@ -0,0 +1,289 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "mace/core/nnapi_delegation.h"
+
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "mace/core/arg_helper.h"
+#include "mace/utils/logging.h"
+
+namespace mace {
+
+namespace {
+
+void SetIntArg(const std::string &name, int64_t value, OperatorDef *op) {
+  Argument *arg = op->add_arg();
+  arg->set_name(name);
+  arg->set_i(value);
+}
+
+std::vector<int64_t> OutputDims(const OperatorDef &op) {
+  return std::vector<int64_t>(op.output_shape(0).dims().begin(),
+                              op.output_shape(0).dims().end());
+}
+
+bool HasArg(const OperatorDef &op, const std::string &name) {
+  for (auto &arg : op.arg()) {
+    if (arg.name() == name) {
+      return true;
+    }
+  }
+  return false;
+}
+
+const Tensor *GetFloatWeight(const Workspace *ws, const std::string &name) {
+  const Tensor *tensor = ws->GetTensor(name);
+  return tensor != nullptr && tensor->is_weight() &&
+      tensor->dtype() == DT_FLOAT ? tensor : nullptr;
+}
+
+bool IsWeight(const Workspace *ws, const std::string &name) {
+  const Tensor *tensor = ws->GetTensor(name);
+  return tensor != nullptr && tensor->is_weight();
+}
+
+// RELU, RELU1 and RELU6 are the activations NNAPI fuses into its ops
+bool IsFusableActivation(const OperatorDef &op) {
+  const std::string activation =
+      ProtoArgHelper::GetOptionalArg<OperatorDef, std::string>(
+          op, "activation", "NOOP");
+  if (activation == "RELUX") {
+    const float max_limit =
+        ProtoArgHelper::GetOptionalArg<OperatorDef, float>(
+            op, "max_limit", 0.f);
+    return max_limit == 6.f || max_limit == 1.f;
+  }
+  return activation == "NOOP" || activation == "RELU";
+}
+
+// the ops which run the most arithmetic of a net, worth the hand-off
+bool IsConv(const OperatorDef &op) {
+  return op.type() == "Conv2D" || op.type() == "DepthwiseConv2d";
+}
+
+}  // namespace
+
+std::string NNAPIStepArgName(int step) {
+  return MakeString("nnapi_op", step);
+}
+
+MaceStatus DelegateToNNAPI(const Workspace *ws,
+                           const std::string &cache_dir,
+                           NetDef *net_def) {
+  // NHWC shapes of the activations, as given by the net
+  std::unordered_map<std::string, std::vector<int64_t>> tensor_shapes;
+  for (auto &input_info : net_def->input_info()) {
+    tensor_shapes[input_info.name()] = std::vector<int64_t>(
+        input_info.dims().begin(), input_info.dims().end());
+  }
+  std::unordered_set<std::string> net_outputs;
+  for (auto &output_info : net_def->output_info()) {
+    net_outputs.insert(output_info.name());
+  }
+  const int op_size = net_def->op_size();
+  // the last op reading each tensor
+  std::unordered_map<std::string, int> last_consumers;
+  for (int i = 0; i < op_size; ++i) {
+    const OperatorDef &op = net_def->op(i);
+    for (auto &input : op.input()) {
+      last_consumers[input] = i;
+    }
+    if (op.output_size() == op.output_shape_size()) {
+      for (int j = 0; j < op.output_size(); ++j) {
+        tensor_shapes[op.output(j)] = std::vector<int64_t>(
+            op.output_shape(j).dims().begin(),
+            op.output_shape(j).dims().end());
+      }
+    }
+  }
+
+  // an activation of a known 4D shape
+  auto is_4d_activation = [&](const std::string &name) {
+    auto shape = tensor_shapes.find(name);
+    return !IsWeight(ws, name) && shape != tensor_shapes.end() &&
+        shape->second.size() == 4;
+  };
+  // an op NNAPI has an operation for, as the NNAPI delegate op builds it
+  auto is_supported = [&](const OperatorDef &op) {
+    const DataType dt = static_cast<DataType>(
+        ProtoArgHelper::GetOptionalArg<OperatorDef, int>(
+            op, "T", static_cast<int>(DT_FLOAT)));
+    if (dt != DT_FLOAT || op.input_size() == 0 || op.output_size() != 1 ||
+        op.output_shape_size() != 1 ||
+        op.output_shape(0).dims_size() != 4 ||
+        ProtoArgHelper::GetOptionalArg<OperatorDef, int>(
+            op, "data_format", DF_NONE) != NHWC ||
+        !is_4d_activation(op.input(0))) {
+      return false;
+    }
+    const std::string &type = op.type();
+    if (type == "Conv2D" || type == "DepthwiseConv2d") {
+      const std::vector<int> dilations =
+          ProtoArgHelper::GetRepeatedArgs<OperatorDef, int>(
+              op, "dilations", {1, 1});
+      for (auto dilation : dilations) {
+        if (dilation != 1) {
+          return false;
+        }
+      }
+      if (op.input_size() < 2 || op.input_size() > 3 ||
+          !IsFusableActivation(op) ||
+          ProtoArgHelper::GetOptionalArg<OperatorDef, int>(
+              op, "depth_to_space", 1) > 1) {
+        return false;
+      }
+      const Tensor *filter = GetFloatWeight(ws, op.input(1));
+      if (filter == nullptr || filter->dim_size() != 4) {
+        return false;
+      }
+      if (op.input_size() == 3) {
+        const Tensor *bias = GetFloatWeight(ws, op.input(2));
+        return bias != nullptr && bias->dim_size() == 1;
+      }
+      return true;
+    } else if (type == "Pooling") {
+      const int pooling_type =
+          ProtoArgHelper::GetOptionalArg<OperatorDef, int>(
+              op, "pooling_type", 0);
+      // AVG and MAX
+      return op.input_size() == 1 &&
+          (pooling_type == 1 || pooling_type == 2);
+    } else if (type == "Activation") {
+      const std::string activation =
+          ProtoArgHelper::GetOptionalArg<OperatorDef, std::string>(
+              op, "activation", "NOOP");
+      return op.input_size() == 1 && activation != "NOOP" &&
+          (IsFusableActivation(op) || activation == "TANH" ||
+           activation == "SIGMOID");
+    } else if (type == "Eltwise") {
+      // SUM and PROD of two tensors of the output shape
+      const int eltwise_type =
+          ProtoArgHelper::GetOptionalArg<OperatorDef, int>(op, "type", -1);
+      return op.input_size() == 2 && !HasArg(op, "coeff") &&
+          (eltwise_type == 0 || eltwise_type == 2) &&
+          is_4d_activation(op.input(1)) &&
+          tensor_shapes[op.input(0)] == OutputDims(op) &&
+          tensor_shapes[op.input(1)] == OutputDims(op);
+    } else if (type == "Softmax") {
+      // over the channels
+      return op.input_size() == 1 &&
+          tensor_shapes[op.input(0)] == OutputDims(op);
+    } else if (type == "Concat") {
+      for (auto &input : op.input()) {
+        if (!is_4d_activation(input)) {
+          return false;
+        }
+      }
+      return true;
+    }
+    return false;
+  };
+
+  // the runs of consecutive supported ops with a conv, [begin, end)
+  std::vector<std::pair<int, int>> runs;
+  for (int i = 0; i < op_size;) {
+    if (!is_supported(net_def->op(i))) {
+      ++i;
+      continue;
+    }
+    int end = i;
+    bool has_conv = false;
+    while (end < op_size && is_supported(net_def->op(end))) {
+      has_conv = has_conv || IsConv(net_def->op(end));
+      ++end;
+    }
+    if (has_conv) {
+      runs.emplace_back(i, end);
+    }
+    i = end;
+  }
+
+  NetDef delegated_net;
+  int delegated_ops = 0;
+  int next_op = 0;
+  for (auto &run : runs) {
+    for (; next_op < run.first; ++next_op) {
+      *delegated_net.add_op() = net_def->op(next_op);
+    }
+    next_op = run.second;
+
+    const OperatorDef &last = net_def->op(run.second - 1);
+    OperatorDef *op = delegated_net.add_op();
+    op->set_name(last.name());
+    op->set_type(kNNAPIDelegateOpType);
+    op->set_device_type(last.device_type());
+    SetIntArg("T", DT_FLOAT, op);
+    SetIntArg("data_format", NHWC, op);
+    SetIntArg(kNNAPIStepsArg, run.second - run.first, op);
+    Argument *cache_arg = op->add_arg();
+    cache_arg->set_name(kNNAPICacheDirArg);
+    cache_arg->set_s(cache_dir);
+
+    // the activations, then the weights, read from outside the run
+    std::unordered_set<std::string> produced;
+    std::unordered_set<std::string> inputs;
+    std::vector<std::string> weights;
+    for (int i = run.first; i < run.second; ++i) {
+      const OperatorDef &step_op = net_def->op(i);
+      for (auto &input : step_op.input()) {
+        if (produced.count(input) == 1 || !inputs.insert(input).second) {
+          continue;
+        }
+        if (IsWeight(ws, input)) {
+          weights.push_back(input);
+        } else {
+          op->add_input(input);
+        }
+      }
+      for (auto &output : step_op.output()) {
+        produced.insert(output);
+      }
+      // read after the run or by the user
+      const std::string &output = step_op.output(0);
+      auto consumer = last_consumers.find(output);
+      if (net_outputs.count(output) == 1 ||
+          (consumer != last_consumers.end() &&
+           consumer->second >= run.second)) {
+        op->add_output(output);
+        *op->add_output_shape() = step_op.output_shape(0);
+        op->add_output_type(DT_FLOAT);
+      }
+
+      Argument *step_arg = op->add_arg();
+      step_arg->set_name(NNAPIStepArgName(i - run.first));
+      step_arg->set_s(step_op.SerializeAsString());
+    }
+    if (op->output_size() == 0) {
+      op->add_output(last.output(0));
+      *op->add_output_shape() = last.output_shape(0);
+      op->add_output_type(DT_FLOAT);
+    }
+    for (auto &weight : weights) {
+      op->add_input(weight);
+    }
+    delegated_ops += run.second - run.first;
+  }
+  for (; next_op < op_size; ++next_op) {
+    *delegated_net.add_op() = net_def->op(next_op);
+  }
+
+  VLOG(1) << "Delegate " << delegated_ops << " of " << op_size
+          << " CPU ops to NNAPI in " << runs.size() << " subgraphs";
+  net_def->mutable_op()->Swap(delegated_net.mutable_op());
+  return MaceStatus::MACE_SUCCESS;
+}
+
+}  // namespace mace
@@ -0,0 +1,51 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_CORE_NNAPI_DELEGATION_H_
+#define MACE_CORE_NNAPI_DELEGATION_H_
+
+#include <string>
+
+#include "mace/core/workspace.h"
+#include "mace/proto/mace.pb.h"
+#include "mace/public/mace.h"
+
+namespace mace {
+
+// Type of the op running a subgraph of the net with NNAPI.
+constexpr const char *kNNAPIDelegateOpType = "NNAPIDelegate";
+// Arg of the delegate op, the number of ops of the subgraph.
+constexpr const char *kNNAPIStepsArg = "nnapi_steps";
+// Arg of the delegate op, the directory NNAPI caches its compilation in,
+// empty for none.
+constexpr const char *kNNAPICacheDirArg = "nnapi_cache_dir";
+
+// Arg of the delegate op holding the serialized OperatorDef of the i-th op
+// of the subgraph.
+std::string NNAPIStepArgName(int step);
+
+// Rewrite a float CPU net to run each run of consecutive ops NNAPI has an
+// operation for, among them a Conv2D or a DepthwiseConv2d, as one
+// NNAPIDelegate op, so the vendor drivers may run it on their NPU, DSP or
+// GPU. A run of consecutive ops is a convex subgraph, so the ops around it
+// stay in order on the CPU. Only 4D NHWC ops of known output shapes are
+// delegated. Call it after the weights are loaded and before the net is
+// created.
+MaceStatus DelegateToNNAPI(const Workspace *ws,
+                           const std::string &cache_dir,
+                           NetDef *net_def);
+
+}  // namespace mace
+
+#endif  // MACE_CORE_NNAPI_DELEGATION_H_
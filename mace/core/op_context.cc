@@ -17,7 +17,7 @@
 namespace mace {
 
 OpContext::OpContext(Workspace *ws, Device *device)
-    : device_(device), ws_(ws), future_(nullptr) {}
+    : device_(device), ws_(ws), future_(nullptr), early_exit_(false) {}
 
 OpContext::~OpContext() = default;
 
@@ -41,4 +41,12 @@ StatsFuture *OpContext::future() const {
   return future_;
 }
 
+void OpContext::set_early_exit(bool early_exit) {
+  early_exit_ = early_exit;
+}
+
+bool OpContext::early_exit() const {
+  return early_exit_;
+}
+
 }  // namespace mace
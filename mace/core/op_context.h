@@ -31,10 +31,15 @@ class OpContext {
 
   void set_future(StatsFuture *future);
   StatsFuture *future() const;
+
+  // set by an op to skip the rest of the net, see EarlyExit
+  void set_early_exit(bool early_exit);
+  bool early_exit() const;
  private:
   Device *device_;
   Workspace *ws_;
   StatsFuture *future_;
+  bool early_exit_;
   // metadata
 };
 
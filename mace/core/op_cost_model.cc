@@ -0,0 +1,150 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/core/op_cost_model.h"
+
+#include <algorithm>
+
+#include "mace/core/arg_helper.h"
+
+namespace mace {
+
+namespace {
+
+// the L2 cache of the cores which do not report it
+constexpr int64_t kDefaultL2CacheBytes = 512 << 10;
+// waking up a worker is never free, even when the probe could not time it
+constexpr double kMinForkJoinMicros = 1.0;
+
+// -1 if some dimension is unknown
+int64_t Elements(const std::vector<index_t> &shape) {
+  int64_t elements = 1;
+  for (index_t dim : shape) {
+    if (dim < 0) {
+      return -1;
+    }
+    elements *= dim;
+  }
+  return elements;
+}
+
+// the multiply-adds of an output element
+int64_t ReductionSize(
+    const OperatorDef &op_def,
+    const std::unordered_map<std::string, std::vector<index_t>> &shapes) {
+  const std::string &type = op_def.type();
+  const int filter_idx = type == "MatMul" ? 0 : 1;
+  if (op_def.input_size() <= filter_idx) {
+    return 1;
+  }
+  auto iter = shapes.find(op_def.input(filter_idx));
+  if (iter == shapes.end() || iter->second.size() < 2 ||
+      Elements(iter->second) < 0) {
+    return 1;
+  }
+  const std::vector<index_t> &shape = iter->second;
+  if (type == "Conv2D" || type == "Deconv2D" || type == "FullyConnected") {
+    // OIHW filters
+    return Elements(shape) / std::max<index_t>(shape[0], 1);
+  } else if (type == "DepthwiseConv2d" || type == "DepthwiseDeconv2d") {
+    // MIHW filters
+    return Elements(shape) / std::max<index_t>(shape[0] * shape[1], 1);
+  } else if (type == "MatMul") {
+    const bool transpose_a = ProtoArgHelper::GetOptionalArg<OperatorDef, bool>(
+        op_def, "transpose_a", false);
+    return shape[shape.size() - (transpose_a ? 2 : 1)];
+  }
+  return 1;
+}
+
+}  // namespace
+
+OpCost EstimateOpCost(
+    const OperatorDef &op_def,
+    const std::unordered_map<std::string, std::vector<index_t>> &shapes) {
+  OpCost cost = {-1, 0, 0};
+  if (op_def.output_shape_size() == 0 ||
+      op_def.output_shape_size() != op_def.output_size()) {
+    return cost;
+  }
+  int64_t output_elements = 0;
+  for (auto &output_shape : op_def.output_shape()) {
+    const int64_t elements = Elements(std::vector<index_t>(
+        output_shape.dims().begin(), output_shape.dims().end()));
+    if (elements < 0) {
+      return cost;
+    }
+    output_elements += elements;
+  }
+  int64_t input_elements = 0;
+  // the shape ops only read the shapes of their inputs
+  const bool reads_inputs = op_def.type() != "Shape" &&
+                            op_def.type() != "InferConv2dShape";
+  for (auto &input : op_def.input()) {
+    if (!reads_inputs) {
+      break;
+    }
+    auto iter = shapes.find(input);
+    if (iter != shapes.end()) {
+      input_elements += std::max<int64_t>(Elements(iter->second), 0);
+    }
+  }
+  const int64_t reduction = ReductionSize(op_def, shapes);
+  cost.flops = static_cast<double>(output_elements) *
+      (reduction > 1 ? 2 * reduction : 1);
+  // the models run in float, the quantized ones read less, which only
+  // makes them look more memory bound than they are
+  cost.bytes =
+      static_cast<double>(input_elements + output_elements) * sizeof(float);
+  cost.working_set_bytes = cost.bytes;
+  return cost;
+}
+
+OpCostModel::OpCostModel(const DeviceProfile &profile) : profile_(profile) {}
+
+double OpCostModel::EstimateMicros(const OpCost &cost, int threads) const {
+  const bool forks = threads > 1;
+  // the threads beyond the cores take turns
+  threads = std::min(std::max(threads, 1), std::max(profile_.num_cores, 1));
+  const double compute_micros =
+      cost.flops / (std::max(profile_.fma_gflops, 1e-3) * 1e3 * threads);
+  const int64_t l2_cache_bytes = profile_.l2_cache_bytes > 0 ?
+      profile_.l2_cache_bytes : kDefaultL2CacheBytes;
+  // the cores read their own caches, and share the memory
+  double gbps = profile_.cache_gbps * threads;
+  if (cost.working_set_bytes > l2_cache_bytes) {
+    gbps = std::min(profile_.memory_gbps, gbps);
+  }
+  const double memory_micros = cost.bytes / (std::max(gbps, 1e-3) * 1e3);
+  return std::max(compute_micros, memory_micros) +
+      (forks ? std::max(profile_.fork_join_micros, kMinForkJoinMicros) : 0);
+}
+
+int OpCostModel::BestThreads(const OpCost &cost, int max_threads) const {
+  std::vector<double> micros(std::max(max_threads, 1));
+  double best_micros = EstimateMicros(cost, 1);
+  micros[0] = best_micros;
+  for (int threads = 2; threads <= max_threads; ++threads) {
+    micros[threads - 1] = EstimateMicros(cost, threads);
+    best_micros = std::min(best_micros, micros[threads - 1]);
+  }
+  for (int threads = 1; threads < max_threads; ++threads) {
+    if (micros[threads - 1] <= best_micros * 1.05) {
+      return threads;
+    }
+  }
+  return std::max(max_threads, 1);
+}
+
+}  // namespace mace
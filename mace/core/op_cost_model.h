@@ -0,0 +1,63 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_CORE_OP_COST_MODEL_H_
+#define MACE_CORE_OP_COST_MODEL_H_
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mace/core/device_profile.h"
+#include "mace/core/types.h"
+#include "mace/proto/mace.pb.h"
+
+namespace mace {
+
+// The work of a CPU op run once.
+struct OpCost {
+  // 2 for each multiply-add, 1 for each other element computed
+  double flops;
+  // the bytes of the inputs read and the outputs written
+  double bytes;
+  // the bytes the op touches, which decide the cache it runs from
+  double working_set_bytes;
+};
+
+// The cost of a CPU op from the shapes of the model, i.e. the multiply-adds
+// of the convolutions and the matrix products, the elements read and written
+// by the others. flops is negative if the shapes of its outputs are unknown.
+OpCost EstimateOpCost(
+    const OperatorDef &op_def,
+    const std::unordered_map<std::string, std::vector<index_t>> &shapes);
+
+// A roofline of the device: an op takes the longer of its compute and its
+// memory traffic, at the bandwidth of the cache its working set fits in,
+// plus the fork and join of its threads.
+class OpCostModel {
+ public:
+  explicit OpCostModel(const DeviceProfile &profile);
+
+  double EstimateMicros(const OpCost &cost, int threads) const;
+
+  // the threads of the least time, the fewest of those within 5% of it
+  int BestThreads(const OpCost &cost, int max_threads) const;
+
+ private:
+  DeviceProfile profile_;
+};
+
+}  // namespace mace
+
+#endif  // MACE_CORE_OP_COST_MODEL_H_
@@ -0,0 +1,113 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/core/op_observer.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "mace/utils/env_time.h"
+#include "mace/utils/logging.h"
+
+namespace mace {
+
+void TensorRangeLogger::AfterOp(size_t op_idx,
+                                Operation *op,
+                                const OpContext *context) {
+  MACE_UNUSED(op_idx);
+  MACE_UNUSED(context);
+  for (int i = 0; i < op->OutputSize(); ++i) {
+    if (op->debug_def().quantize_info_size() == 0) {
+      int data_type = op->GetOptionalArg("T", static_cast<int>(DT_FLOAT));
+      if (data_type == static_cast<int>(DT_FLOAT)) {
+        float max_v = std::numeric_limits<float>::lowest();
+        float min_v = std::numeric_limits<float>::max();
+        Tensor::MappingGuard guard(op->Output(i));
+        auto *output_data = op->Output(i)->data<float>();
+        for (index_t j = 0; j < op->Output(i)->size(); ++j) {
+          max_v = std::max(max_v, output_data[j]);
+          min_v = std::min(min_v, output_data[j]);
+        }
+        LOG(INFO) << "Tensor range @@" << op->debug_def().output(i)
+                  << "@@" << min_v << "," << max_v;
+      }
+    } else {
+      const int bin_size = 2048;
+      for (int ind = 0; ind < op->debug_def().quantize_info_size(); ++ind) {
+        float min_v = op->debug_def().quantize_info(ind).minval();
+        float max_v = op->debug_def().quantize_info(ind).maxval();
+        std::vector<int> bin_distribution(bin_size, 0);
+        float bin_v = (max_v - min_v) / bin_size;
+        Tensor::MappingGuard guard(op->Output(i));
+        auto *output_data = op->Output(i)->data<float>();
+        for (index_t j = 0; j < op->Output(i)->size(); ++j) {
+          int index = static_cast<int>((output_data[j] - min_v) / bin_v);
+          if (index < 0)
+            index = 0;
+          else if (index > bin_size-1)
+            index = bin_size-1;
+          bin_distribution[index]++;
+        }
+        LOG(INFO) << "Tensor range @@" << op->debug_def().output(i)
+                  << "@@" << min_v << "," << max_v << "@@"
+                  << MakeString(bin_distribution);
+      }
+    }
+  }
+}
+
+OpLatencyObserver::OpLatencyObserver(size_t op_count)
+    : start_micros_(op_count, 0) {
+  for (size_t i = 0; i < op_count; ++i) {
+    histograms_.emplace_back(new LatencyHistogram);
+  }
+}
+
+void OpLatencyObserver::BeforeOp(size_t op_idx,
+                                 Operation *op,
+                                 const OpContext *context) {
+  MACE_UNUSED(op);
+  MACE_UNUSED(context);
+  start_micros_[op_idx] = NowMicros();
+}
+
+void OpLatencyObserver::AfterOp(size_t op_idx,
+                                Operation *op,
+                                const OpContext *context) {
+  MACE_UNUSED(op);
+  MACE_UNUSED(context);
+  histograms_[op_idx]->Record(NowMicros() - start_micros_[op_idx]);
+}
+
+AllocationObserver::AllocationObserver(AllocationMonitor *monitor)
+    : monitor_(monitor) {}
+
+void AllocationObserver::BeforeOp(size_t op_idx,
+                                  Operation *op,
+                                  const OpContext *context) {
+  MACE_UNUSED(op_idx);
+  MACE_UNUSED(context);
+  monitor_->Watch(&op->debug_def().name());
+}
+
+void AllocationObserver::AfterOp(size_t op_idx,
+                                 Operation *op,
+                                 const OpContext *context) {
+  MACE_UNUSED(op_idx);
+  MACE_UNUSED(op);
+  MACE_UNUSED(context);
+  AllocationMonitor::Unwatch();
+}
+
+}  // namespace mace
@@ -0,0 +1,110 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_CORE_OP_OBSERVER_H_
+#define MACE_CORE_OP_OBSERVER_H_
+
+#include <memory>
+#include <vector>
+
+#include "mace/core/allocation_monitor.h"
+#include "mace/core/op_context.h"
+#include "mace/core/operator.h"
+#include "mace/utils/latency_histogram.h"
+
+namespace mace {
+
+// Notified around the run of each operation of a net, see
+// NetBase::AddObserver. op_idx is the index of the operation in the net,
+// whose tensors and device are those of op and context. The operations of
+// a DAGNet run concurrently, and so do the calls for them.
+class OpObserver {
+ public:
+  virtual ~OpObserver() = default;
+
+  virtual void BeforeOp(size_t op_idx,
+                        Operation *op,
+                        const OpContext *context) {
+    MACE_UNUSED(op_idx);
+    MACE_UNUSED(op);
+    MACE_UNUSED(context);
+  }
+
+  // the outputs of GPU ops are mapped to be read, which waits for them
+  virtual void AfterOp(size_t op_idx,
+                       Operation *op,
+                       const OpContext *context) {
+    MACE_UNUSED(op_idx);
+    MACE_UNUSED(op);
+    MACE_UNUSED(context);
+  }
+};
+
+// Log the range of the float outputs of each operation, and the histogram
+// over their quantization ranges for quantized operations, for the
+// quantization tools, see MACE_LOG_TENSOR_RANGE.
+class TensorRangeLogger : public OpObserver {
+ public:
+  void AfterOp(size_t op_idx,
+               Operation *op,
+               const OpContext *context) override;
+};
+
+// The latency of each operation of a net of op_count operations across the
+// runs, from the start of its run to its end, GPU ops excluding the
+// kernels still in flight.
+class OpLatencyObserver : public OpObserver {
+ public:
+  explicit OpLatencyObserver(size_t op_count);
+
+  void BeforeOp(size_t op_idx,
+                Operation *op,
+                const OpContext *context) override;
+
+  void AfterOp(size_t op_idx,
+               Operation *op,
+               const OpContext *context) override;
+
+  LatencyHistogram *histogram(size_t op_idx) {
+    return histograms_[op_idx].get();
+  }
+
+ private:
+  // each operation runs once per run, so its slot is only written by one
+  // thread at a time
+  std::vector<int64_t> start_micros_;
+  std::vector<std::unique_ptr<LatencyHistogram>> histograms_;
+};
+
+// Watch the allocations of the thread running each operation with the
+// monitor, which must outlive the runs.
+class AllocationObserver : public OpObserver {
+ public:
+  explicit AllocationObserver(AllocationMonitor *monitor);
+
+  void BeforeOp(size_t op_idx,
+                Operation *op,
+                const OpContext *context) override;
+
+  void AfterOp(size_t op_idx,
+               Operation *op,
+               const OpContext *context) override;
+
+ private:
+  AllocationMonitor *monitor_;
+};
+
+}  // namespace mace
+
+#endif  // MACE_CORE_OP_OBSERVER_H_
@@ -0,0 +1,44 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/core/op_parallelism.h"
+
+#include "mace/core/arg_helper.h"
+#include "mace/core/op_cost_model.h"
+
+namespace mace {
+
+namespace {
+
+constexpr int kMaxThreads = 1024;
+
+}  // namespace
+
+int EstimateOpThreads(
+    const OperatorDef &op_def,
+    const std::unordered_map<std::string, std::vector<index_t>> &shapes) {
+  const int num_threads = ProtoArgHelper::GetOptionalArg<OperatorDef, int>(
+      op_def, kOpThreadsArg, 0);
+  if (num_threads > 0) {
+    return num_threads;
+  }
+  const OpCost cost = EstimateOpCost(op_def, shapes);
+  if (cost.flops < 0) {
+    return 0;
+  }
+  static const OpCostModel model(GetDeviceProfile());
+  return model.BestThreads(cost, kMaxThreads);
+}
+
+}  // namespace mace
@@ -0,0 +1,40 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_CORE_OP_PARALLELISM_H_
+#define MACE_CORE_OP_PARALLELISM_H_
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mace/core/types.h"
+#include "mace/proto/mace.pb.h"
+
+namespace mace {
+
+// The arg of the threads of a CPU op which overrides the estimate, set by
+// MaceEngineConfig::SetCPUOpThreads.
+constexpr const char *kOpThreadsArg = "num_threads";
+
+// The threads worth their fork and join for a CPU op, by the OpCostModel of
+// the device profile on the cost its shapes in the model imply, unless its
+// kOpThreadsArg is set. 0 if the shapes of its outputs are unknown.
+int EstimateOpThreads(
+    const OperatorDef &op_def,
+    const std::unordered_map<std::string, std::vector<index_t>> &shapes);
+
+}  // namespace mace
+
+#endif  // MACE_CORE_OP_PARALLELISM_H_
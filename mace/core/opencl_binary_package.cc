@@ -0,0 +1,143 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/core/opencl_binary_package.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include "mace/utils/logging.h"
+
+namespace mace {
+
+namespace {
+const char kPackageMagic[] = "MACECLPK";
+const size_t kPackageMagicSize = 8;
+const uint32_t kPackageVersion = 1;
+}  // namespace
+
+OpenCLBinaryPackage::OpenCLBinaryPackage(const std::string &path)
+    : mapped_data_(nullptr), mapped_size_(0) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    LOG(WARNING) << "open OpenCL binary package " << path
+                 << " failed, error code: " << strerror(errno);
+    return;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      LOG(WARNING) << "mmap OpenCL binary package " << path
+                   << " failed, error code: " << strerror(errno);
+    } else {
+      mapped_data_ = static_cast<const unsigned char *>(data);
+      mapped_size_ = static_cast<size_t>(st.st_size);
+    }
+  }
+  if (close(fd) != 0) {
+    LOG(WARNING) << "close OpenCL binary package " << path
+                 << " failed, error code: " << strerror(errno);
+  }
+  if (mapped_data_ != nullptr) {
+    ParseIndex(mapped_data_, mapped_size_);
+    if (entries_.empty()) {
+      LOG(WARNING) << path << " is not a valid OpenCL binary package";
+    }
+  }
+}
+
+OpenCLBinaryPackage::OpenCLBinaryPackage(const unsigned char *data,
+                                         size_t size)
+    : mapped_data_(nullptr), mapped_size_(0) {
+  if (data != nullptr) {
+    ParseIndex(data, size);
+  }
+}
+
+OpenCLBinaryPackage::~OpenCLBinaryPackage() {
+  if (mapped_data_ != nullptr &&
+      munmap(const_cast<unsigned char *>(mapped_data_), mapped_size_) != 0) {
+    LOG(WARNING) << "munmap OpenCL binary package failed, error code: "
+                 << strerror(errno);
+  }
+}
+
+void OpenCLBinaryPackage::ParseIndex(const unsigned char *data,
+                                     size_t size) {
+  const size_t header_size = kPackageMagicSize + 2 * sizeof(uint32_t);
+  if (size < header_size ||
+      memcmp(data, kPackageMagic, kPackageMagicSize) != 0) {
+    return;
+  }
+  uint32_t version = 0;
+  uint32_t num_entries = 0;
+  memcpy(&version, data + kPackageMagicSize, sizeof(version));
+  memcpy(&num_entries, data + kPackageMagicSize + sizeof(version),
+         sizeof(num_entries));
+  if (version != kPackageVersion) {
+    LOG(WARNING) << "Unsupported OpenCL binary package version " << version;
+    return;
+  }
+  size_t offset = header_size;
+  std::vector<Entry> entries;
+  for (uint32_t i = 0; i < num_entries; ++i) {
+    uint32_t info_size = 0;
+    if (size - offset < sizeof(info_size)) {
+      return;
+    }
+    memcpy(&info_size, data + offset, sizeof(info_size));
+    offset += sizeof(info_size);
+    uint64_t ranges[4];
+    if (size - offset < info_size + sizeof(ranges)) {
+      return;
+    }
+    Entry entry;
+    entry.platform_info.assign(reinterpret_cast<const char *>(data + offset),
+                               info_size);
+    offset += info_size;
+    memcpy(ranges, data + offset, sizeof(ranges));
+    offset += sizeof(ranges);
+    // the programs then the parameters
+    for (int r = 0; r < 4; r += 2) {
+      if (ranges[r] > size || ranges[r + 1] > size - ranges[r]) {
+        LOG(WARNING) << "OpenCL binary package is truncated";
+        return;
+      }
+    }
+    entry.binary = data + ranges[0];
+    entry.binary_size = static_cast<size_t>(ranges[1]);
+    entry.parameter = data + ranges[2];
+    entry.parameter_size = static_cast<size_t>(ranges[3]);
+    entries.push_back(entry);
+  }
+  entries_.swap(entries);
+}
+
+const OpenCLBinaryPackage::Entry *OpenCLBinaryPackage::Find(
+    const std::string &platform_info) const {
+  for (const Entry &entry : entries_) {
+    if (entry.platform_info == platform_info) {
+      return &entry;
+    }
+  }
+  return nullptr;
+}
+
+}  // namespace mace
@@ -0,0 +1,69 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_CORE_OPENCL_BINARY_PACKAGE_H_
+#define MACE_CORE_OPENCL_BINARY_PACKAGE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mace/utils/utils.h"
+
+namespace mace {
+
+// The precompiled OpenCL programs and the tuned parameters of many
+// platforms, e.g. the SoCs an app is shipped to, in one file made by
+// tools/pack_opencl_binaries.py. The file starts with an index of the
+// platform info strings, the one matching the running platform selects its
+// entry, whose data are read in place from the mapped file:
+//
+//   "MACECLPK", uint32 version, uint32 entry count,
+//   for each entry: uint32 platform info size, the platform info,
+//                   uint64 offset and size of the programs,
+//                   uint64 offset and size of the tuned parameters,
+//   then the data of the entries.
+class OpenCLBinaryPackage {
+ public:
+  struct Entry {
+    std::string platform_info;
+    const unsigned char *binary;
+    size_t binary_size;
+    const unsigned char *parameter;
+    size_t parameter_size;
+  };
+
+  // maps the file, empty if it does not exist or is invalid
+  explicit OpenCLBinaryPackage(const std::string &path);
+  // the data must outlive the package
+  OpenCLBinaryPackage(const unsigned char *data, size_t size);
+  ~OpenCLBinaryPackage();
+
+  bool empty() const { return entries_.empty(); }
+  // the entry of platform_info, nullptr if none
+  const Entry *Find(const std::string &platform_info) const;
+
+ private:
+  void ParseIndex(const unsigned char *data, size_t size);
+
+  const unsigned char *mapped_data_;
+  size_t mapped_size_;
+  std::vector<Entry> entries_;
+
+  MACE_DISABLE_COPY_AND_ASSIGN(OpenCLBinaryPackage);
+};
+
+}  // namespace mace
+
+#endif  // MACE_CORE_OPENCL_BINARY_PACKAGE_H_
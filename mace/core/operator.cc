@@ -15,6 +15,7 @@
 #include <sstream>
 #include <map>
 #include <memory>
+#include <utility>
 #include <vector>
 
 #include "mace/core/operator.h"
@@ -87,7 +88,15 @@ DataType OpConstructContext::GetInputDataType(size_t idx) const {
 }
 
 OpInitContext::OpInitContext(Workspace *ws, Device *device)
-    : ws_(ws), device_(device) {}
+    : ws_(ws), device_(device), deferred_tasks_(nullptr) {}
+
+MaceStatus OpInitContext::RunOrDefer(std::function<MaceStatus()> task) {
+  if (deferred_tasks_ == nullptr) {
+    return task();
+  }
+  deferred_tasks_->push_back(std::move(task));
+  return MaceStatus::MACE_SUCCESS;
+}
 
 Operation::Operation(OpConstructContext *context)
     : operator_def_(context->operator_def())
@@ -189,6 +198,20 @@ OpRegistrationInfo::OpRegistrationInfo() {
         op->output_shape(0).dims_size() != 4) {
       return { DeviceType::CPU };
     }
+    // The GPU has kernels of a few data types, e.g. of few quantized ops
+    if (this->devices.count(DeviceType::GPU) == 1 &&
+        this->devices.count(DeviceType::CPU) == 1) {
+      DataType dtype = static_cast<DataType>(
+          ProtoArgHelper::GetOptionalArg<OperatorDef, int>(
+              *op, "T", static_cast<int>(DT_FLOAT)));
+      std::string key = OpKeyBuilder(op->type())
+          .Device(DeviceType::GPU)
+          .TypeConstraint("T", dtype)
+          .Build();
+      if (this->creators.count(key) == 0) {
+        return { DeviceType::CPU };
+      }
+    }
     return this->devices;
   };
 }
@@ -248,7 +271,11 @@ std::unique_ptr<Operation> OpRegistryBase::CreateOperation(
   DataType dtype = static_cast<DataType>(
       ProtoArgHelper::GetOptionalArg<OperatorDef, int>(
           *operator_def, "T", static_cast<int>(DT_FLOAT)));
-  if (device_type == DeviceType::CPU && dtype == DT_HALF) {
+  // CPU ops run half weights in float, unless the net was converted to the
+  // half kernels, see ConvertToCPUHalfPrecision
+  if (device_type == DeviceType::CPU && dtype == DT_HALF &&
+      !ProtoArgHelper::GetOptionalArg<OperatorDef, int>(
+          *operator_def, "half_precision", 0)) {
     int arg_size = operator_def->arg_size();
     for (int i = 0; i < arg_size; ++i) {
       if (operator_def->arg(i).name() == "T") {
@@ -274,6 +301,19 @@ std::unique_ptr<Operation> OpRegistryBase::CreateOperation(
   return registry_.at(op_type)->creators.at(key)(context);
 }
 
+bool OpRegistryBase::HasKernel(const std::string &op_type,
+                               const DeviceType device_type,
+                               const DataType dt) const {
+  if (registry_.count(op_type) == 0) {
+    return false;
+  }
+  std::string key = OpKeyBuilder(op_type)
+      .Device(device_type)
+      .TypeConstraint("T", dt)
+      .Build();
+  return registry_.at(op_type)->creators.count(key) != 0;
+}
+
 OpConditionBuilder::OpConditionBuilder(const std::string &type)
   : type_(type) {}
 
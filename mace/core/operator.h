@@ -15,6 +15,7 @@
 #ifndef MACE_CORE_OPERATOR_H_
 #define MACE_CORE_OPERATOR_H_
 
+#include <functional>
 #include <memory>
 #include <set>
 #include <string>
@@ -101,9 +102,20 @@ class OpInitContext {
     return device_;
   }
 
+  // Work of Init which reads only the constant weights, such as packing
+  // them, deferred to run concurrently with that of the other ops once the
+  // net has initialized them all; run at once if no tasks are collected.
+  MaceStatus RunOrDefer(std::function<MaceStatus()> task);
+
+  inline void set_deferred_tasks(
+      std::vector<std::function<MaceStatus()>> *deferred_tasks) {
+    deferred_tasks_ = deferred_tasks;
+  }
+
  private:
   Workspace *ws_;
   Device *device_;
+  std::vector<std::function<MaceStatus()>> *deferred_tasks_;
 };
 
 // Conventions
@@ -148,10 +160,34 @@ class Operation {
   inline const std::vector<const Tensor *> &Inputs() const { return inputs_; }
   inline const std::vector<Tensor *> &Outputs() { return outputs_; }
 
+  // bind an input or an output to another tensor, e.g. of a part of it
+  inline void set_input(unsigned int idx, const Tensor *tensor) {
+    MACE_CHECK(idx < inputs_.size());
+    inputs_[idx] = tensor;
+  }
+  inline void set_output(unsigned int idx, Tensor *tensor) {
+    MACE_CHECK(idx < outputs_.size());
+    outputs_[idx] = tensor;
+  }
+
   // Run Op asynchronously (depends on device), return a future if not nullptr.
   virtual MaceStatus Init(OpInitContext *);
   virtual MaceStatus Run(OpContext *) = 0;
 
+  // Index of the input whose memory the first output may take over when
+  // the input is not used afterwards, -1 if the op can't run in place.
+  // The op must support reading and writing the same memory then.
+  virtual int InplaceInputIndex() const { return -1; }
+
+  // Drop the states kept across runs, e.g. of a streaming LSTM, so that
+  // the next run starts from the initial states of the model.
+  virtual void ResetState() {}
+
+  // Whether the op runs even if its inputs are the same as in the previous
+  // run, e.g. it keeps a state or controls the net, see
+  // MemoryOptimizer::set_incremental_inputs.
+  virtual bool AlwaysRuns() const { return false; }
+
   inline const OperatorDef &debug_def() const {
     MACE_CHECK(has_debug_def(), "operator_def was null!");
     return *operator_def_;
@@ -168,10 +204,17 @@ class Operation {
     return operator_def_;
   }
 
+  // The threads the op is worth on CPU, at most those of the runtime,
+  // 0 for all of them.
+  inline int num_threads() const { return num_threads_; }
+
+  inline void set_num_threads(int num_threads) { num_threads_ = num_threads; }
+
  protected:
   std::shared_ptr<OperatorDef> operator_def_;
   std::vector<const Tensor *> inputs_;
   std::vector<Tensor *> outputs_;
+  int num_threads_ = 0;
 
   MACE_DISABLE_COPY_AND_ASSIGN(Operation);
 };
@@ -245,6 +288,11 @@ class OpRegistryBase {
       OpConstructContext *context,
       DeviceType device_type) const;
 
+  // whether a kernel of type dt is registered for op_type on device_type
+  bool HasKernel(const std::string &op_type,
+                 const DeviceType device_type,
+                 const DataType dt) const;
+
   template <class DerivedType>
   static std::unique_ptr<Operation> DefaultCreator(
       OpConstructContext *context) {
@@ -0,0 +1,157 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/core/packed_weights.h"
+
+#include <cstring>
+#include <map>
+#include <sstream>
+#include <vector>
+
+#include "mace/utils/logging.h"
+
+namespace mace {
+
+namespace {
+
+// FNV-1a of the size and all of the data, so that a pack loaded from a file
+// written by another process or model never stands for different weights of
+// the same name. The data is hashed by 8-byte words, which is fast enough to
+// run once per weight at init.
+std::string Fingerprint(const Tensor *weight) {
+  Tensor::MappingGuard guard(weight);
+  const unsigned char *data = weight->data<unsigned char>();
+  const index_t size = weight->raw_size();
+  uint64_t hash = 14695981039346656037ULL;
+  auto update = [&hash](uint64_t word) {
+    hash ^= word;
+    hash *= 1099511628211ULL;
+    hash ^= hash >> 32;
+  };
+  update(static_cast<uint64_t>(size));
+  const index_t words = size / static_cast<index_t>(sizeof(uint64_t));
+  for (index_t i = 0; i < words; ++i) {
+    uint64_t word;
+    memcpy(&word, data + i * sizeof(uint64_t), sizeof(word));
+    update(word);
+  }
+  for (index_t i = words * sizeof(uint64_t); i < size; ++i) {
+    update(data[i]);
+  }
+  std::stringstream ss;
+  ss << std::hex << hash;
+  return ss.str();
+}
+
+std::string Key(const std::string &layout, const Tensor *weight) {
+  return MakeString(layout, "/", weight->name(), "/", Fingerprint(weight));
+}
+
+}  // namespace
+
+PackedWeights::PackedWeights(const std::string &file_path)
+    : file_path_(file_path), storage_(file_path), imported_(false) {
+  if (!file_path_.empty() && storage_.Load() != 0) {
+    LOG(WARNING) << "Load packed weights from " << file_path_ << " failed";
+  }
+}
+
+std::shared_ptr<PackedWeights> PackedWeights::Shared(
+    const std::string &file_path) {
+  static std::mutex registry_mutex;
+  static std::map<std::string, std::weak_ptr<PackedWeights>> registry;
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  std::shared_ptr<PackedWeights> packed_weights = registry[file_path].lock();
+  if (packed_weights == nullptr) {
+    packed_weights = std::make_shared<PackedWeights>(file_path);
+    registry[file_path] = packed_weights;
+  }
+  return packed_weights;
+}
+
+const float *PackedWeights::GetOrPack(const std::string &layout,
+                                      const Tensor *weight,
+                                      index_t size,
+                                      const Packer &packer) {
+  const std::string key = Key(layout, weight);
+  const index_t bytes = size * static_cast<index_t>(sizeof(float));
+  const std::vector<unsigned char> *packed = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    packed = storage_.Find(key);
+  }
+  if (packed == nullptr) {
+    // packed out of the lock, so that the ops initialized concurrently pack
+    // their weights in parallel, the first of the same weight is kept
+    std::vector<unsigned char> value(bytes);
+    packer(reinterpret_cast<float *>(value.data()));
+    std::lock_guard<std::mutex> lock(mutex_);
+    packed = storage_.Find(key);
+    if (packed == nullptr) {
+      storage_.Insert(key, value);
+      packed = storage_.Find(key);
+    }
+  }
+  MACE_CHECK(static_cast<index_t>(packed->size()) == bytes,
+             "packed weight ", key, " has ", packed->size(),
+             " bytes, expect ", bytes);
+  return reinterpret_cast<const float *>(packed->data());
+}
+
+const std::vector<unsigned char> *PackedWeights::Find(
+    const std::string &layout, const Tensor *weight) {
+  const std::string key = Key(layout, weight);
+  std::lock_guard<std::mutex> lock(mutex_);
+  return storage_.Find(key);
+}
+
+void PackedWeights::Insert(const std::string &layout,
+                           const Tensor *weight,
+                           const std::vector<unsigned char> &packed) {
+  const std::string key = Key(layout, weight);
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (storage_.Find(key) == nullptr) {
+    storage_.Insert(key, packed);
+  }
+}
+
+void PackedWeights::Flush() {
+  if (file_path_.empty()) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (storage_.Flush() != 0) {
+    LOG(WARNING) << "Flush packed weights to " << file_path_ << " failed";
+  }
+}
+
+void PackedWeights::Export(const std::string &prefix, KVStorage *storage) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto &key : storage_.Keys()) {
+    storage->Insert(prefix + key, *storage_.Find(key));
+  }
+}
+
+void PackedWeights::Import(const std::string &prefix, KVStorage *storage) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto &key : storage->Keys()) {
+    if (key.compare(0, prefix.size(), prefix) == 0 &&
+        storage_.Find(key.substr(prefix.size())) == nullptr) {
+      storage_.Insert(key.substr(prefix.size()), *storage->Find(key));
+      imported_ = true;
+    }
+  }
+}
+
+}  // namespace mace
@@ -0,0 +1,87 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_CORE_PACKED_WEIGHTS_H_
+#define MACE_CORE_PACKED_WEIGHTS_H_
+
+#include <functional>
+#include <memory>
+#include <mutex>  // NOLINT(build/c++11)
+#include <string>
+#include <vector>
+
+#include "mace/core/kv_storage.h"
+#include "mace/core/tensor.h"
+#include "mace/public/mace.h"
+
+namespace mace {
+
+// Constant weights repacked into the layout of a CPU kernel, packed once and
+// then read by every run. An entry is keyed by the layout, the weight name and
+// a fingerprint of the weight data, so engines of different models can use
+// the same store. Entries are never replaced, the returned data stays valid
+// as long as the store is alive.
+//
+// With a file path, the packs are loaded from and flushed to that file, and
+// the engines of one process configured with the same file share one store.
+class PackedWeights {
+ public:
+  // fill the packed data, of the size passed to GetOrPack
+  typedef std::function<void(float *)> Packer;
+
+  explicit PackedWeights(const std::string &file_path = "");
+  PackedWeights(const PackedWeights &) = delete;
+  PackedWeights &operator=(const PackedWeights &) = delete;
+
+  // the process-wide store backed by file_path
+  static std::shared_ptr<PackedWeights> Shared(const std::string &file_path);
+
+  // size is the number of floats of the packed data
+  const float *GetOrPack(const std::string &layout,
+                         const Tensor *weight,
+                         index_t size,
+                         const Packer &packer);
+
+  // the packed bytes of a weight in the layout of a device, e.g. the pixels
+  // of a GPU image, nullptr if the store has none. They are only worth
+  // keeping with a file path, see persistent.
+  const std::vector<unsigned char> *Find(const std::string &layout,
+                                         const Tensor *weight);
+  void Insert(const std::string &layout,
+              const Tensor *weight,
+              const std::vector<unsigned char> &packed);
+
+  // whether the packs are loaded from and flushed to a file, or imported
+  // from an engine snapshot
+  bool persistent() const { return !file_path_.empty() || imported_; }
+
+  // write the packs to the file, no-op without a file path
+  void Flush();
+
+  // copy the packs into storage, their keys prefixed, e.g. of a snapshot
+  void Export(const std::string &prefix, KVStorage *storage);
+
+  // add the packs of storage under prefix which the store does not have
+  void Import(const std::string &prefix, KVStorage *storage);
+
+ private:
+  const std::string file_path_;
+  FileStorage storage_;
+  std::mutex mutex_;
+  bool imported_;
+};
+
+}  // namespace mace
+
+#endif  // MACE_CORE_PACKED_WEIGHTS_H_
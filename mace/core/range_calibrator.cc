@@ -0,0 +1,269 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/core/range_calibrator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "mace/utils/logging.h"
+
+namespace mace {
+
+namespace {
+
+// the values of a tile of the thread pool
+constexpr index_t kBlockSize = 16384;
+// the levels of the uint8 quantization the ranges are searched for
+constexpr int kQuantizedLevels = 256;
+// the step of the bins of the ranges searched by KL divergence
+constexpr int kSearchStride = RangeCalibrator::kHistogramBins / 32;
+
+int BinIndex(float value, float min_val, float bin_width) {
+  if (bin_width <= 0) {
+    return 0;
+  }
+  int index = static_cast<int>((value - min_val) / bin_width);
+  return std::max(0, std::min(RangeCalibrator::kHistogramBins - 1, index));
+}
+
+// the KL divergence between the histogram clipped to [start, end) and its
+// quantization into kQuantizedLevels levels
+double KLDivergence(const std::vector<int64_t> &histogram,
+                    int start,
+                    int end) {
+  const int bins = end - start;
+  std::vector<double> p(histogram.begin() + start, histogram.begin() + end);
+  for (int i = 0; i < start; ++i) {
+    p.front() += histogram[i];
+  }
+  for (int i = end; i < static_cast<int>(histogram.size()); ++i) {
+    p.back() += histogram[i];
+  }
+  std::vector<double> q(bins, 0);
+  for (int level = 0; level < kQuantizedLevels; ++level) {
+    const int level_start = level * bins / kQuantizedLevels;
+    const int level_end = (level + 1) * bins / kQuantizedLevels;
+    double sum = 0;
+    int non_zero = 0;
+    for (int i = level_start; i < level_end; ++i) {
+      sum += histogram[start + i];
+      non_zero += histogram[start + i] > 0;
+    }
+    for (int i = level_start; i < level_end; ++i) {
+      if (histogram[start + i] > 0) {
+        q[i] = sum / non_zero;
+      }
+    }
+  }
+  double p_sum = 0;
+  double q_sum = 0;
+  for (int i = 0; i < bins; ++i) {
+    p_sum += p[i];
+    q_sum += q[i];
+  }
+  if (p_sum == 0 || q_sum == 0) {
+    return std::numeric_limits<double>::max();
+  }
+  // the clipped values are not in q, they are smoothed
+  const double kEps = 1e-10;
+  double divergence = 0;
+  for (int i = 0; i < bins; ++i) {
+    if (p[i] > 0) {
+      const double p_i = p[i] / p_sum;
+      const double q_i = std::max(q[i] / q_sum, kEps);
+      divergence += p_i * std::log(p_i / q_i);
+    }
+  }
+  return divergence;
+}
+
+}  // namespace
+
+constexpr int RangeCalibrator::kHistogramBins;
+
+RangeCalibrator::RangeCalibrator(utils::ThreadPool *thread_pool)
+    : thread_pool_(thread_pool), histograms_(false) {}
+
+void RangeCalibrator::Record(const std::string &name, const Tensor *tensor) {
+  if (tensor->dtype() != DT_FLOAT || tensor->size() == 0) {
+    return;
+  }
+  TensorStats *stats = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto iter = stats_.find(name);
+    if (iter == stats_.end()) {
+      if (histograms_) {
+        return;
+      }
+      iter = stats_.emplace(name, TensorStats{
+          std::numeric_limits<float>::max(),
+          std::numeric_limits<float>::lowest(), {}}).first;
+    }
+    stats = &iter->second;
+  }
+  Tensor::MappingGuard guard(tensor);
+  const float *data = tensor->data<float>();
+  if (histograms_) {
+    RecordHistogram(data, tensor->size(), stats);
+  } else {
+    RecordMinMax(data, tensor->size(), stats);
+  }
+}
+
+void RangeCalibrator::RecordMinMax(const float *data,
+                                   index_t size,
+                                   TensorStats *stats) {
+  const index_t blocks = (size + kBlockSize - 1) / kBlockSize;
+  std::vector<float> block_min(blocks, std::numeric_limits<float>::max());
+  std::vector<float> block_max(blocks, std::numeric_limits<float>::lowest());
+  auto compute = [&](int64_t start, int64_t end, int64_t step) {
+    for (int64_t b = start; b < end; b += step) {
+      const index_t value_end = std::min(size, (b + 1) * kBlockSize);
+      for (index_t i = b * kBlockSize; i < value_end; ++i) {
+        block_min[b] = std::min(block_min[b], data[i]);
+        block_max[b] = std::max(block_max[b], data[i]);
+      }
+    }
+  };
+  if (thread_pool_ != nullptr && blocks > 1) {
+    thread_pool_->Compute1D(compute, 0, blocks, 1, 1);
+  } else {
+    compute(0, blocks, 1);
+  }
+  for (index_t b = 0; b < blocks; ++b) {
+    stats->min_val = std::min(stats->min_val, block_min[b]);
+    stats->max_val = std::max(stats->max_val, block_max[b]);
+  }
+}
+
+void RangeCalibrator::RecordHistogram(const float *data,
+                                      index_t size,
+                                      TensorStats *stats) {
+  const float min_val = stats->min_val;
+  const float bin_width = (stats->max_val - min_val) / kHistogramBins;
+  const index_t blocks = (size + kBlockSize - 1) / kBlockSize;
+  std::vector<std::vector<int64_t>> block_histograms(
+      blocks, std::vector<int64_t>(kHistogramBins, 0));
+  auto compute = [&](int64_t start, int64_t end, int64_t step) {
+    for (int64_t b = start; b < end; b += step) {
+      std::vector<int64_t> &histogram = block_histograms[b];
+      const index_t value_end = std::min(size, (b + 1) * kBlockSize);
+      for (index_t i = b * kBlockSize; i < value_end; ++i) {
+        ++histogram[BinIndex(data[i], min_val, bin_width)];
+      }
+    }
+  };
+  if (thread_pool_ != nullptr && blocks > 1) {
+    thread_pool_->Compute1D(compute, 0, blocks, 1, 1);
+  } else {
+    compute(0, blocks, 1);
+  }
+  for (index_t b = 0; b < blocks; ++b) {
+    for (int i = 0; i < kHistogramBins; ++i) {
+      stats->histogram[i] += block_histograms[b][i];
+    }
+  }
+}
+
+void RangeCalibrator::AfterOp(size_t op_idx,
+                              Operation *op,
+                              const OpContext *context) {
+  MACE_UNUSED(op_idx);
+  MACE_UNUSED(context);
+  if (op->device_type() != DeviceType::CPU) {
+    return;
+  }
+  for (int i = 0; i < op->OutputSize(); ++i) {
+    Record(op->debug_def().output(i), op->Output(i));
+  }
+}
+
+void RangeCalibrator::StartHistograms() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  histograms_ = true;
+  for (auto &stats : stats_) {
+    stats.second.histogram.assign(kHistogramBins, 0);
+  }
+}
+
+bool RangeCalibrator::GetRange(const std::string &name,
+                               CalibrationMethod method,
+                               float percentile,
+                               float *min_val,
+                               float *max_val) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto iter = stats_.find(name);
+  if (iter == stats_.end()) {
+    return false;
+  }
+  const TensorStats &stats = iter->second;
+  *min_val = stats.min_val;
+  *max_val = stats.max_val;
+  int64_t total = 0;
+  for (int64_t count : stats.histogram) {
+    total += count;
+  }
+  if (method == CALIBRATION_MIN_MAX || total == 0 ||
+      stats.max_val <= stats.min_val) {
+    return true;
+  }
+
+  const std::vector<int64_t> &histogram = stats.histogram;
+  const float bin_width = (stats.max_val - stats.min_val) / kHistogramBins;
+  int range_start = 0;
+  int range_end = kHistogramBins;
+  if (method == CALIBRATION_PERCENTILE) {
+    const double clipped = total * static_cast<double>(percentile) / 100;
+    int64_t count = 0;
+    while (range_start < kHistogramBins - 1 &&
+           count + histogram[range_start] <= clipped) {
+      count += histogram[range_start++];
+    }
+    count = 0;
+    while (range_end > range_start + 1 &&
+           count + histogram[range_end - 1] <= clipped) {
+      count += histogram[--range_end];
+    }
+  } else {
+    // the ranges keep the zero, which the quantization represents exactly
+    const int zero_bin = stats.min_val < 0 && stats.max_val > 0 ?
+                         BinIndex(0, stats.min_val, bin_width) : -1;
+    double min_divergence = std::numeric_limits<double>::max();
+    for (int bins = kQuantizedLevels; bins <= kHistogramBins;
+         bins += kSearchStride) {
+      for (int start = 0; start + bins <= kHistogramBins;
+           start += kSearchStride) {
+        if (zero_bin >= 0 && (zero_bin < start || zero_bin >= start + bins)) {
+          continue;
+        }
+        const double divergence = KLDivergence(histogram, start,
+                                               start + bins);
+        if (divergence < min_divergence) {
+          min_divergence = divergence;
+          range_start = start;
+          range_end = start + bins;
+        }
+      }
+    }
+  }
+  *min_val = stats.min_val + range_start * bin_width;
+  *max_val = range_end == kHistogramBins ?
+             stats.max_val : stats.min_val + range_end * bin_width;
+  return true;
+}
+
+}  // namespace mace
@@ -0,0 +1,77 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_CORE_RANGE_CALIBRATOR_H_
+#define MACE_CORE_RANGE_CALIBRATOR_H_
+
+#include <mutex>  // NOLINT(build/c++11)
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mace/core/op_observer.h"
+#include "mace/core/tensor.h"
+#include "mace/public/mace.h"
+#include "mace/utils/thread_pool.h"
+
+namespace mace {
+
+// Statistics of the float activations of the runs of a net, to calibrate
+// their quantization ranges. The first pass over the calibration data
+// finds the min and max of each tensor, the second, after
+// StartHistograms, accumulates their histograms over these ranges.
+// Record could be called from concurrent operations. As an observer of a
+// net, it records the outputs of its CPU operations.
+class RangeCalibrator : public OpObserver {
+ public:
+  static constexpr int kHistogramBins = 2048;
+
+  explicit RangeCalibrator(utils::ThreadPool *thread_pool);
+
+  void Record(const std::string &name, const Tensor *tensor);
+
+  void AfterOp(size_t op_idx,
+               Operation *op,
+               const OpContext *context) override;
+
+  void StartHistograms();
+
+  // the range of a recorded tensor, percentile is the percentage of the
+  // values clipped on each side for CALIBRATION_PERCENTILE
+  bool GetRange(const std::string &name,
+                CalibrationMethod method,
+                float percentile,
+                float *min_val,
+                float *max_val) const;
+
+ private:
+  struct TensorStats {
+    float min_val;
+    float max_val;
+    std::vector<int64_t> histogram;
+  };
+
+  void RecordMinMax(const float *data, index_t size, TensorStats *stats);
+
+  void RecordHistogram(const float *data, index_t size, TensorStats *stats);
+
+  utils::ThreadPool *thread_pool_;
+  bool histograms_;
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string, TensorStats> stats_;
+};
+
+}  // namespace mace
+
+#endif  // MACE_CORE_RANGE_CALIBRATOR_H_
@@ -0,0 +1,152 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/core/runtime/cpu/adaptive_cpu_scheduler.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "mace/utils/logging.h"
+
+namespace mace {
+
+namespace {
+
+// the runs whose latency is averaged
+constexpr int kWindowRuns = 8;
+// the windows a placement runs before the threads are moved again
+constexpr int kMinDwellWindows = 2;
+// the windows after which a measure is stale and the placement is
+// estimated again as if it was not measured
+constexpr int kMaxAgeWindows = 64;
+// how much lower the estimate of another placement must be
+constexpr double kHysteresis = 0.1;
+
+}  // namespace
+
+AdaptiveCPUScheduler::AdaptiveCPUScheduler(const std::vector<float> &max_freqs,
+                                           int max_threads)
+    : max_freqs_(max_freqs),
+      current_(0),
+      dwell_(0),
+      window_runs_(0),
+      window_micros_(0) {
+  MACE_CHECK(!max_freqs.empty(), "no cpu cores");
+  std::vector<size_t> cores(max_freqs.size());
+  for (size_t i = 0; i < cores.size(); ++i) {
+    cores[i] = i;
+  }
+  std::stable_sort(cores.begin(), cores.end(),
+                   [&max_freqs](size_t lhs, size_t rhs) {
+                     return max_freqs[lhs] > max_freqs[rhs];
+                   });
+  const size_t thread_limit =
+      max_threads > 0 ? std::min(cores.size(), static_cast<size_t>(max_threads))
+                      : cores.size();
+  // the clusters from the biggest, each placement adds one
+  for (size_t end = 1; end <= cores.size(); ++end) {
+    if (end < cores.size() &&
+        max_freqs[cores[end]] == max_freqs[cores[end - 1]]) {
+      continue;
+    }
+    const size_t count = std::min(end, thread_limit);
+    if (!placements_.empty() && placements_.back().cpu_ids.size() == count) {
+      break;
+    }
+    Placement placement;
+    placement.cpu_ids.assign(cores.begin(), cores.begin() + count);
+    placement.latency = 0;
+    placement.capacity = 0;
+    placement.measured = false;
+    placement.age = 0;
+    placements_.push_back(placement);
+  }
+  for (auto &placement : placements_) {
+    VLOG(2) << "Adaptive CPU placement: " << MakeString(placement.cpu_ids);
+  }
+}
+
+const std::vector<size_t> &AdaptiveCPUScheduler::cpu_ids() const {
+  return placements_[current_].cpu_ids;
+}
+
+bool AdaptiveCPUScheduler::RecordRun(int64_t latency_micros) {
+  window_micros_ += latency_micros;
+  return ++window_runs_ >= kWindowRuns;
+}
+
+double AdaptiveCPUScheduler::Capacity(const Placement &placement,
+                                      const std::vector<float> &freqs) const {
+  double capacity = 0;
+  for (size_t cpu_id : placement.cpu_ids) {
+    capacity += cpu_id < freqs.size() ? freqs[cpu_id] : max_freqs_[cpu_id];
+  }
+  return capacity;
+}
+
+bool AdaptiveCPUScheduler::Rebalance(const std::vector<float> &cur_freqs) {
+  const double latency =
+      static_cast<double>(window_micros_) / std::max(window_runs_, 1);
+  window_runs_ = 0;
+  window_micros_ = 0;
+  const std::vector<float> &freqs =
+      cur_freqs.size() == max_freqs_.size() ? cur_freqs : max_freqs_;
+
+  Placement &current = placements_[current_];
+  current.latency = latency;
+  current.capacity = Capacity(current, freqs);
+  current.measured = true;
+  current.age = 0;
+  ++dwell_;
+  if (placements_.size() == 1 || current.capacity <= 0) {
+    return false;
+  }
+
+  size_t best = current_;
+  double best_latency = latency;
+  for (size_t i = 0; i < placements_.size(); ++i) {
+    Placement &placement = placements_[i];
+    if (i == current_) {
+      continue;
+    }
+    if (placement.measured && ++placement.age > kMaxAgeWindows) {
+      placement.measured = false;
+    }
+    // offline cores have no frequency
+    const double capacity = Capacity(placement, freqs);
+    if (capacity <= 0) {
+      continue;
+    }
+    const double estimate = placement.measured ?
+        placement.latency * placement.capacity / capacity :
+        latency * current.capacity / capacity;
+    if (estimate < best_latency) {
+      best = i;
+      best_latency = estimate;
+    }
+  }
+  if (best == current_ || dwell_ < kMinDwellWindows ||
+      best_latency > latency * (1 - kHysteresis)) {
+    return false;
+  }
+  VLOG(1) << "Move the CPU threads from " << MakeString(current.cpu_ids)
+          << " (" << latency << " us) to "
+          << MakeString(placements_[best].cpu_ids) << " (" << best_latency
+          << " us estimated)";
+  current_ = best;
+  dwell_ = 0;
+  return true;
+}
+
+}  // namespace mace
@@ -0,0 +1,76 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_CORE_RUNTIME_CPU_ADAPTIVE_CPU_SCHEDULER_H_
+#define MACE_CORE_RUNTIME_CPU_ADAPTIVE_CPU_SCHEDULER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace mace {
+
+// The cores the threads of AFFINITY_ADAPTIVE run on. The placements tried
+// are the biggest cluster, then the two biggest and so on, one thread per
+// core. The latency of the runs is averaged over windows of runs; at the
+// end of a window, the latency each placement would have is estimated from
+// the one measured on it, scaled by the frequencies of its cores then and
+// now, so that the placement is moved off throttled cores. A placement not
+// measured yet is estimated from the current one, scaled by the
+// frequencies. The threads are moved only if the estimate is lower by a
+// margin and the current placement ran for a few windows.
+class AdaptiveCPUScheduler {
+ public:
+  // max_freqs: the max frequency of each core, max_threads: the threads
+  // to use at most, all the cores if it is not positive
+  AdaptiveCPUScheduler(const std::vector<float> &max_freqs, int max_threads);
+
+  size_t cpu_count() const { return max_freqs_.size(); }
+
+  // the cores of the current placement
+  const std::vector<size_t> &cpu_ids() const;
+
+  // record the latency of a run, true at the end of a window
+  bool RecordRun(int64_t latency_micros);
+
+  // called at the end of a window with the current frequencies of the
+  // cores, empty if they could not be read; true if the placement changed
+  bool Rebalance(const std::vector<float> &cur_freqs);
+
+ private:
+  struct Placement {
+    std::vector<size_t> cpu_ids;
+    // the mean latency and the sum of the frequencies of the cores when it
+    // was measured, the age of the measure in windows
+    double latency;
+    double capacity;
+    bool measured;
+    int age;
+  };
+
+  double Capacity(const Placement &placement,
+                  const std::vector<float> &freqs) const;
+
+  std::vector<float> max_freqs_;
+  std::vector<Placement> placements_;
+  size_t current_;
+  // windows the current placement has run
+  int dwell_;
+  int window_runs_;
+  int64_t window_micros_;
+};
+
+}  // namespace mace
+
+#endif  // MACE_CORE_RUNTIME_CPU_ADAPTIVE_CPU_SCHEDULER_H_
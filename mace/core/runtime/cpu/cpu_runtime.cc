@@ -18,24 +18,33 @@
 #include <omp.h>
 #endif
 
-#include <unistd.h>
-#include <sys/syscall.h>
-#include <sys/types.h>
+#if defined(__aarch64__) && defined(__linux__)
+#include <sched.h>
+#include <sys/auxv.h>
+#endif
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
 #include <algorithm>
-#include <cerrno>
+#include <atomic>
 #include <cstring>
 #include <fstream>
+#include <numeric>
 #include <string>
+#include <thread>  // NOLINT(build/c++11)
 #include <utility>
 #include <vector>
 
 #include "mace/core/macros.h"
 #include "mace/public/mace.h"
 #include "mace/utils/logging.h"
+#include "mace/utils/thread_pool.h"
 
 namespace mace {
 
-int MaceOpenMPThreadCount = 1;
+thread_local int MaceOpenMPThreadCount = 1;
 
 struct CPUFreq {
   size_t core_id;
@@ -44,6 +53,11 @@ struct CPUFreq {
 
 namespace {
 
+// the settings the OpenMP team of the calling thread is bound with, 0 if
+// it is not
+thread_local uint64_t bound_omp_config_id = 0;
+std::atomic<uint64_t> next_omp_config_id(1);
+
 int GetCPUCount() {
   int cpu_count = 0;
   std::string cpu_sys_conf = "/proc/cpuinfo";
@@ -101,42 +115,75 @@ int GetCPUMaxFreq(std::vector<float> *max_freqs) {
   return 0;
 }
 
-MaceStatus SetThreadAffinity(cpu_set_t mask) {
-#if defined(__ANDROID__)
-  pid_t pid = gettid();
-#else
-  pid_t pid = syscall(SYS_gettid);
-#endif
-  int err = sched_setaffinity(pid, sizeof(mask), &mask);
-  if (err) {
-    LOG(WARNING) << "set affinity error: " << strerror(errno);
-    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
-                      "set affinity error: " + std::string(strerror(errno)));
-  } else {
-    return MaceStatus::MACE_SUCCESS;
+// the current frequencies, 0 for the offline cores
+int GetCPUCurFreq(size_t cpu_count, std::vector<float> *cur_freqs) {
+  cur_freqs->assign(cpu_count, 0);
+  int online_count = 0;
+  for (size_t cpu_id = 0; cpu_id < cpu_count; ++cpu_id) {
+    std::ifstream f(MakeString("/sys/devices/system/cpu/cpu", cpu_id,
+                               "/cpufreq/scaling_cur_freq"));
+    std::string line;
+    if (f.is_open() && std::getline(f, line)) {
+      (*cur_freqs)[cpu_id] = strtof(line.c_str(), nullptr);
+      ++online_count;
+    }
+  }
+  if (online_count == 0) {
+    cur_freqs->clear();
+    return -1;
   }
+  return 0;
+}
+
+// The max frequency of each core of cpu_ids relative to the fastest one,
+// empty if they are all as fast or unknown.
+std::vector<float> RelativeCoreSpeeds(const std::vector<float> &cpu_max_freqs,
+                                      const std::vector<size_t> &cpu_ids) {
+  std::vector<float> speeds;
+  float max_freq = 0;
+  for (size_t cpu_id : cpu_ids) {
+    if (cpu_id >= cpu_max_freqs.size() || cpu_max_freqs[cpu_id] <= 0) {
+      return std::vector<float>();
+    }
+    speeds.push_back(cpu_max_freqs[cpu_id]);
+    max_freq = std::max(max_freq, cpu_max_freqs[cpu_id]);
+  }
+  if (std::all_of(speeds.begin(), speeds.end(),
+                  [max_freq](float freq) { return freq == max_freq; })) {
+    return std::vector<float>();
+  }
+  for (float &speed : speeds) {
+    speed /= max_freq;
+  }
+  return speeds;
+}
+
+#ifdef MACE_ENABLE_OPENMP
+// The guided schedule hands the first threads chunks of an even share of
+// the loop, the one going to a slower core holds up the others, so cores
+// of different speeds take small chunks as they go.
+void SetOpenMPSchedule(bool heterogeneous) {
+  omp_set_schedule(heterogeneous ? omp_sched_dynamic : omp_sched_guided, 1);
 }
+#endif  // MACE_ENABLE_OPENMP
 
 MaceStatus SetOpenMPThreadsAndAffinityCPUs(int omp_num_threads,
-                                           const std::vector<size_t> &cpu_ids) {
+                                           const std::vector<size_t> &cpu_ids,
+                                           bool heterogeneous) {
   MaceOpenMPThreadCount = omp_num_threads;
 
 #ifdef MACE_ENABLE_OPENMP
   VLOG(1) << "Set OpenMP threads number: " << omp_num_threads
-          << ", CPU core IDs: " << MakeString(cpu_ids);
-  omp_set_schedule(omp_sched_guided, 1);
+          << ", CPU core IDs: " << MakeString(cpu_ids)
+          << (heterogeneous ? ", of different speeds" : "");
+  SetOpenMPSchedule(heterogeneous);
   omp_set_num_threads(omp_num_threads);
 #else
   MACE_UNUSED(omp_num_threads);
+  MACE_UNUSED(heterogeneous);
   LOG(WARNING) << "Set OpenMP threads number failed: OpenMP not enabled.";
 #endif
 
-  // compute mask
-  cpu_set_t mask;
-  CPU_ZERO(&mask);
-  for (auto cpu_id : cpu_ids) {
-    CPU_SET(cpu_id, &mask);
-  }
 #ifdef MACE_ENABLE_OPENMP
   std::vector<MaceStatus> status(omp_num_threads,
                                  MaceStatus::MACE_INVALID_ARGS);
@@ -144,7 +191,7 @@ MaceStatus SetOpenMPThreadsAndAffinityCPUs(int omp_num_threads,
   for (int i = 0; i < omp_num_threads; ++i) {
     VLOG(1) << "Set affinity for OpenMP thread " << omp_get_thread_num()
             << "/" << omp_get_num_threads();
-    status[i] = SetThreadAffinity(mask);
+    status[i] = utils::SetThreadAffinity(cpu_ids);
   }
   for (int i = 0; i < omp_num_threads; ++i) {
     if (status[i] != MaceStatus::MACE_SUCCESS)
@@ -152,24 +199,225 @@ MaceStatus SetOpenMPThreadsAndAffinityCPUs(int omp_num_threads,
   }
   return MaceStatus::MACE_SUCCESS;
 #else
-  MaceStatus status = SetThreadAffinity(mask);
-  VLOG(1) << "Set affinity without OpenMP: " << mask.__bits[0];
+  MaceStatus status = utils::SetThreadAffinity(cpu_ids);
+  VLOG(1) << "Set affinity without OpenMP: " << MakeString(cpu_ids);
   return status;
 #endif
 }
 
+MaceStatus SetOpenMPThreadsScheduling(int omp_num_threads,
+                                      CPUSchedulingPolicy sched_policy,
+                                      int sched_priority) {
+#ifdef MACE_ENABLE_OPENMP
+  std::vector<MaceStatus> status(omp_num_threads,
+                                 MaceStatus::MACE_INVALID_ARGS);
+#pragma omp parallel for
+  for (int i = 0; i < omp_num_threads; ++i) {
+    status[i] = utils::SetThreadScheduling(sched_policy, sched_priority);
+  }
+  for (int i = 0; i < omp_num_threads; ++i) {
+    if (status[i] != MaceStatus::MACE_SUCCESS)
+      return status[i];
+  }
+  return MaceStatus::MACE_SUCCESS;
+#else
+  MACE_UNUSED(omp_num_threads);
+  MACE_UNUSED(sched_policy);
+  MACE_UNUSED(sched_priority);
+  return MaceStatus::MACE_SUCCESS;
+#endif
+}
+
+CPUFeatures DetectCPUFeatures() {
+  CPUFeatures features = {false, false, false, false, false, false, false};
+#if defined(__aarch64__) && defined(__linux__)
+  // bits of arch/arm64/include/uapi/asm/hwcap.h, which old headers lack
+  const uint64_t kHwcapAsimdhp = 1ULL << 10;
+  const uint64_t kHwcapAsimddp = 1ULL << 20;
+  const uint64_t kHwcapSve = 1ULL << 22;
+  const uint64_t kHwcap2I8mm = 1ULL << 13;
+  const uint64_t kHwcap2Bf16 = 1ULL << 14;
+  const uint64_t hwcap = getauxval(AT_HWCAP);
+  const uint64_t hwcap2 = getauxval(AT_HWCAP2);
+  features.asimdhp = (hwcap & kHwcapAsimdhp) != 0;
+  features.asimddp = (hwcap & kHwcapAsimddp) != 0;
+  features.sve = (hwcap & kHwcapSve) != 0;
+  features.i8mm = (hwcap2 & kHwcap2I8mm) != 0;
+  features.bf16 = (hwcap2 & kHwcap2Bf16) != 0;
+#elif defined(__x86_64__)
+  unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+  if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+    const bool fma = (ecx & bit_FMA) != 0;
+    const bool avx = (ecx & bit_AVX) != 0;
+    // the OS saves the ymm registers on context switches, see XCR0
+    bool ymm_saved = false;
+    if ((ecx & bit_OSXSAVE) != 0) {
+      unsigned int xcr0_low = 0, xcr0_high = 0;
+      __asm__ volatile("xgetbv" : "=a"(xcr0_low), "=d"(xcr0_high) : "c"(0));
+      ymm_saved = (xcr0_low & 0x6) == 0x6;
+    }
+    if (avx && ymm_saved &&
+        __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+      features.avx2 = (ebx & bit_AVX2) != 0;
+      features.fma = fma;
+    }
+  }
+#endif
+  VLOG(1) << "CPU features: asimdhp " << features.asimdhp
+          << ", asimddp " << features.asimddp
+          << ", i8mm " << features.i8mm
+          << ", bf16 " << features.bf16
+          << ", sve " << features.sve
+          << ", avx2 " << features.avx2
+          << ", fma " << features.fma;
+  return features;
+}
+
+// the bytes of a sysfs cache size, e.g. "32K", 0 if it can not be parsed
+size_t ParseCacheSize(const std::string &size) {
+  size_t pos = 0;
+  size_t bytes = 0;
+  while (pos < size.size() && size[pos] >= '0' && size[pos] <= '9') {
+    bytes = bytes * 10 + (size[pos] - '0');
+    ++pos;
+  }
+  if (pos < size.size() && (size[pos] == 'K' || size[pos] == 'k')) {
+    bytes *= 1024;
+  } else if (pos < size.size() && (size[pos] == 'M' || size[pos] == 'm')) {
+    bytes *= 1024 * 1024;
+  }
+  return bytes;
+}
+
+CPUCacheSizes DetectCPUCacheSizes() {
+  // those of the little cores of mobile SoCs, the smallest of the cores
+  CPUCacheSizes cache_sizes = {32 * 1024, 256 * 1024};
+  for (int index = 0; index < 8; ++index) {
+    const std::string dir =
+        MakeString("/sys/devices/system/cpu/cpu0/cache/index", index, "/");
+    std::ifstream level_file(dir + "level");
+    std::ifstream type_file(dir + "type");
+    std::ifstream size_file(dir + "size");
+    if (!level_file.is_open() || !type_file.is_open() ||
+        !size_file.is_open()) {
+      break;
+    }
+    int level = 0;
+    std::string type, size;
+    level_file >> level;
+    type_file >> type;
+    size_file >> size;
+    const size_t bytes = ParseCacheSize(size);
+    if (bytes == 0 || type == "Instruction") {
+      continue;
+    }
+    if (level == 1) {
+      cache_sizes.l1d = bytes;
+    } else if (level == 2) {
+      cache_sizes.l2 = bytes;
+    }
+  }
+  VLOG(1) << "CPU caches: L1d " << cache_sizes.l1d << ", L2 "
+          << cache_sizes.l2;
+  return cache_sizes;
+}
+
+#if defined(__aarch64__) && defined(__linux__)
+// whether each core is an in-order one of Arm, empty if none is reported
+std::vector<bool> DetectInOrderCPUs() {
+  std::vector<bool> in_order;
+  const int cpu_count = GetCPUCount();
+  for (int cpu_id = 0; cpu_id < cpu_count; ++cpu_id) {
+    std::ifstream f(MakeString("/sys/devices/system/cpu/cpu", cpu_id,
+                               "/regs/identification/midr_el1"));
+    std::string line;
+    if (!f.is_open() || !std::getline(f, line)) {
+      VLOG(2) << "The MIDR_EL1 of CPU " << cpu_id << " is not reported";
+      return std::vector<bool>();
+    }
+    const uint64_t midr = strtoull(line.c_str(), nullptr, 16);
+    const uint64_t implementer = (midr >> 24) & 0xff;
+    const uint64_t part = (midr >> 4) & 0xfff;
+    // Cortex-A53, A35, A55, A510 and A520
+    const bool is_in_order = implementer == 0x41 &&
+        (part == 0xd03 || part == 0xd04 || part == 0xd05 ||
+         part == 0xd46 || part == 0xd80);
+    VLOG(2) << "CPU " << cpu_id << " part " << std::hex << part << std::dec
+            << (is_in_order ? ", in order" : "");
+    in_order.push_back(is_in_order);
+  }
+  return in_order;
+}
+#endif
+
 }  // namespace
 
+bool CurrentCPUIsInOrder() {
+#if defined(__aarch64__) && defined(__linux__)
+  static const std::vector<bool> in_order = DetectInOrderCPUs();
+  if (in_order.empty()) {
+    return false;
+  }
+  // sched_getcpu is only worth a call on the SoCs of both kinds
+  static const bool all_same =
+      std::count(in_order.begin(), in_order.end(), in_order[0]) ==
+      static_cast<std::ptrdiff_t>(in_order.size());
+  if (all_same) {
+    return in_order[0];
+  }
+  const int cpu = sched_getcpu();
+  return cpu >= 0 && static_cast<size_t>(cpu) < in_order.size() &&
+      in_order[cpu];
+#else
+  return false;
+#endif
+}
+
+const CPUFeatures &GetCPUFeatures() {
+  static const CPUFeatures features = DetectCPUFeatures();
+  return features;
+}
+
+const CPUCacheSizes &GetCPUCacheSizes() {
+  static const CPUCacheSizes cache_sizes = DetectCPUCacheSizes();
+  return cache_sizes;
+}
+
 MaceStatus CPURuntime::SetOpenMPThreadsAndAffinityPolicy(
     int num_threads_hint,
     CPUAffinityPolicy policy,
-    void *gemm_context) {
+    void *gemm_context,
+    int *thread_count,
+    std::vector<size_t> *thread_cpu_ids) {
+  // used when the cores could not be detected
+  *thread_count = num_threads_hint > 0 ?
+      num_threads_hint :
+      static_cast<int>(std::thread::hardware_concurrency());
+  thread_cpu_ids->clear();
+  core_speeds_.clear();
   // get cpu frequency info
-  std::vector<float> cpu_max_freqs;
+  std::vector<float> &cpu_max_freqs = cpu_max_freqs_;
+  cpu_max_freqs.clear();
   if (GetCPUMaxFreq(&cpu_max_freqs) == -1 || cpu_max_freqs.size() == 0) {
     return MaceStatus::MACE_INVALID_ARGS;
   }
 
+  if (policy == CPUAffinityPolicy::AFFINITY_ADAPTIVE) {
+    scheduler_.reset(new AdaptiveCPUScheduler(cpu_max_freqs,
+                                              num_threads_hint));
+    *thread_cpu_ids = scheduler_->cpu_ids();
+    *thread_count = static_cast<int>(thread_cpu_ids->size());
+    core_speeds_ = RelativeCoreSpeeds(cpu_max_freqs, *thread_cpu_ids);
+#ifdef MACE_ENABLE_QUANTIZE
+    if (gemm_context) {
+      static_cast<gemmlowp::GemmContext*>(gemm_context)->set_max_num_threads(
+          *thread_count);
+    }
+#endif  // MACE_ENABLE_QUANTIZE
+    return SetOpenMPThreadsAndAffinityCPUs(*thread_count, *thread_cpu_ids,
+                                           !core_speeds_.empty());
+  }
+
   std::vector<CPUFreq> cpu_freq(cpu_max_freqs.size());
   for (size_t i = 0; i < cpu_max_freqs.size(); ++i) {
     cpu_freq[i].core_id = i;
@@ -197,6 +445,7 @@ MaceStatus CPURuntime::SetOpenMPThreadsAndAffinityPolicy(
   }
 
   if (policy == CPUAffinityPolicy::AFFINITY_NONE) {
+    *thread_count = num_threads_hint;
 #ifdef MACE_ENABLE_QUANTIZE
     if (gemm_context) {
       static_cast<gemmlowp::GemmContext*>(gemm_context)->set_max_num_threads(
@@ -206,6 +455,12 @@ MaceStatus CPURuntime::SetOpenMPThreadsAndAffinityPolicy(
     MACE_UNUSED(gemm_context);
 #endif  // MACE_ENABLE_QUANTIZE
 #ifdef MACE_ENABLE_OPENMP
+    // the threads are not bound, they only differ in speed on the cores of
+    // a big.LITTLE SoC
+    std::vector<size_t> all_cpu_ids(cpu_max_freqs.size());
+    std::iota(all_cpu_ids.begin(), all_cpu_ids.end(), 0);
+    SetOpenMPSchedule(
+        !RelativeCoreSpeeds(cpu_max_freqs, all_cpu_ids).empty());
     omp_set_num_threads(num_threads_hint);
 #else
     LOG(WARNING) << "Set OpenMP threads number failed: OpenMP not enabled.";
@@ -236,6 +491,9 @@ MaceStatus CPURuntime::SetOpenMPThreadsAndAffinityPolicy(
             << cpu_freq[i].freq;
     cpu_ids[i] = cpu_freq[i].core_id;
   }
+  *thread_count = num_threads_hint;
+  *thread_cpu_ids = cpu_ids;
+  core_speeds_ = RelativeCoreSpeeds(cpu_max_freqs, cpu_ids);
 
 #ifdef MACE_ENABLE_QUANTIZE
   if (gemm_context) {
@@ -244,7 +502,72 @@ MaceStatus CPURuntime::SetOpenMPThreadsAndAffinityPolicy(
   }
 #endif  // MACE_ENABLE_QUANTIZE
 
-  return SetOpenMPThreadsAndAffinityCPUs(num_threads_hint, cpu_ids);
+  return SetOpenMPThreadsAndAffinityCPUs(num_threads_hint, cpu_ids,
+                                         !core_speeds_.empty());
+}
+
+void CPURuntime::RecordRun(int64_t latency_micros) {
+  if (scheduler_ == nullptr || !scheduler_->RecordRun(latency_micros)) {
+    return;
+  }
+  std::vector<float> cur_freqs;
+  GetCPUCurFreq(scheduler_->cpu_count(), &cur_freqs);
+  if (!scheduler_->Rebalance(cur_freqs)) {
+    return;
+  }
+  cpu_ids_ = scheduler_->cpu_ids();
+  core_speeds_ = RelativeCoreSpeeds(cpu_max_freqs_, cpu_ids_);
+  const int thread_count = static_cast<int>(cpu_ids_.size());
+#ifdef MACE_ENABLE_QUANTIZE
+  if (gemm_context_) {
+    static_cast<gemmlowp::GemmContext*>(gemm_context_)->set_max_num_threads(
+        thread_count);
+  }
+#endif  // MACE_ENABLE_QUANTIZE
+  thread_pool_.reset(new utils::ThreadPool(thread_count, cpu_ids_,
+                                           sched_policy_, sched_priority_,
+                                           core_speeds_));
+  InvalidateOpenMPThreads();
+}
+
+MaceStatus CPURuntime::SetScheduling(CPUSchedulingPolicy sched_policy,
+                                     int sched_priority) {
+  sched_policy_ = sched_policy;
+  sched_priority_ = sched_priority;
+  // the new workers set their class when they start
+  const int thread_count = thread_pool_->thread_count();
+  thread_pool_.reset(new utils::ThreadPool(thread_count, cpu_ids_,
+                                           sched_policy_, sched_priority_,
+                                           core_speeds_));
+  InvalidateOpenMPThreads();
+  return SetOpenMPThreadsScheduling(thread_count, sched_policy_,
+                                    sched_priority_);
+}
+
+void CPURuntime::InvalidateOpenMPThreads() {
+  omp_config_id_ = next_omp_config_id.fetch_add(1);
+}
+
+void CPURuntime::BindOpenMPThreads() {
+  if (bound_omp_config_id == omp_config_id_) {
+    return;
+  }
+  bound_omp_config_id = omp_config_id_;
+  const int thread_count = thread_pool_->thread_count();
+  if (cpu_ids_.empty()) {
+    // free the threads from the cores another runtime bound them to
+    std::vector<size_t> all_cpu_ids(cpu_max_freqs_.size());
+    std::iota(all_cpu_ids.begin(), all_cpu_ids.end(), 0);
+    SetOpenMPThreadsAndAffinityCPUs(
+        thread_count, all_cpu_ids,
+        !RelativeCoreSpeeds(cpu_max_freqs_, all_cpu_ids).empty());
+  } else {
+    SetOpenMPThreadsAndAffinityCPUs(thread_count, cpu_ids_,
+                                    !core_speeds_.empty());
+  }
+  if (sched_policy_ != CPUSchedulingPolicy::CPU_SCHED_NORMAL) {
+    SetOpenMPThreadsScheduling(thread_count, sched_policy_, sched_priority_);
+  }
 }
 
 }  // namespace mace
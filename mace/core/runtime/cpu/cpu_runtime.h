@@ -23,12 +23,46 @@
 #endif  // MACE_ENABLE_QUANTIZE
 
 #include "mace/core/macros.h"
+#include "mace/core/runtime/cpu/adaptive_cpu_scheduler.h"
 #include "mace/public/mace.h"
 #include "mace/utils/logging.h"
+#include "mace/utils/thread_pool.h"
 
 namespace mace {
 
-extern int MaceOpenMPThreadCount;
+// the OpenMP threads of the calling thread, set by the runtime it last ran
+extern thread_local int MaceOpenMPThreadCount;
+
+// SIMD extensions of the cores, as reported by the kernel (HWCAP) on arm64
+// and by CPUID on x86-64. All false on other architectures.
+struct CPUFeatures {
+  bool asimdhp;  // half precision arithmetic (ARMv8.2)
+  bool asimddp;  // int8 dot product (ARMv8.2)
+  bool i8mm;     // int8 matrix multiply (ARMv8.6)
+  bool bf16;     // bfloat16 dot product and matrix multiply (ARMv8.6)
+  bool sve;      // scalable vector extension
+  bool avx2;     // 256-bit integer and float vectors, saved by the OS
+  bool fma;      // fused multiply-add of 256-bit float vectors
+};
+
+// detected once per process
+const CPUFeatures &GetCPUFeatures();
+
+// Bytes of the data caches of the first core as reported by sysfs, usually
+// a little core of a big.LITTLE SoC, whose caches are the smallest. Those of
+// common little cores where they are not reported.
+struct CPUCacheSizes {
+  size_t l1d;  // level 1 data cache
+  size_t l2;   // level 2 cache, possibly shared by a cluster
+};
+
+// detected once per process
+const CPUCacheSizes &GetCPUCacheSizes();
+
+// Whether the core the calling thread runs on issues in order, as the
+// Cortex-A53 and A55 little cores do, by the MIDR_EL1 of the cores in sysfs.
+// False off arm64 and where the cores are not reported.
+bool CurrentCPUIsInOrder();
 
 class CPURuntime {
  public:
@@ -37,7 +71,10 @@ class CPURuntime {
              bool use_gemmlowp)
       : num_threads_(num_threads),
         policy_(policy),
-        gemm_context_(nullptr) {
+        sched_policy_(CPUSchedulingPolicy::CPU_SCHED_NORMAL),
+        sched_priority_(0),
+        gemm_context_(nullptr),
+        omp_config_id_(0) {
 #ifdef MACE_ENABLE_QUANTIZE
     if (use_gemmlowp) {
       MACE_CHECK_NOTNULL(GetGemmlowpContext());
@@ -45,9 +82,16 @@ class CPURuntime {
 #else
     MACE_UNUSED(use_gemmlowp);
 #endif  // MACE_ENABLE_QUANTIZE
+    int thread_count = 1;
     SetOpenMPThreadsAndAffinityPolicy(num_threads_,
                                       policy_,
-                                      gemm_context_);
+                                      gemm_context_,
+                                      &thread_count,
+                                      &cpu_ids_);
+    thread_pool_.reset(new utils::ThreadPool(
+        thread_count, cpu_ids_, sched_policy_, sched_priority_,
+        core_speeds_));
+    InvalidateOpenMPThreads();
   }
 
 #ifdef MACE_ENABLE_QUANTIZE
@@ -79,15 +123,74 @@ class CPURuntime {
     return gemm_context_ != nullptr;
   }
 
+  CPUSchedulingPolicy sched_policy() const {
+    return sched_policy_;
+  }
+
+  int sched_priority() const {
+    return sched_priority_;
+  }
+
+  // Set the scheduling class of the OpenMP threads and of the thread pool,
+  // whose threads are replaced. Not thread-safe with the runs.
+  MaceStatus SetScheduling(CPUSchedulingPolicy sched_policy,
+                           int sched_priority);
+
+  const CPUFeatures &features() const {
+    return GetCPUFeatures();
+  }
+
+  // The cores the threads are bound to, empty if they are not bound.
+  const std::vector<size_t> &cpu_ids() const {
+    return cpu_ids_;
+  }
+
+  // Threads of this runtime only, bound like the OpenMP threads.
+  utils::ThreadPool *thread_pool() {
+    return thread_pool_.get();
+  }
+
+  // the threads the ops run on, those of the OpenMP team
+  int thread_count() const {
+    return thread_pool_->thread_count();
+  }
+
+  // Give the OpenMP team of the calling thread the thread count, the cores
+  // and the scheduling class of this runtime. Each thread starting OpenMP
+  // regions has a team of its own, so the engines run from different threads
+  // keep to their own cores. A no-op if the thread last ran this runtime.
+  void BindOpenMPThreads();
+
+  // Record the latency of a run of the engine, AFFINITY_ADAPTIVE moves the
+  // threads between the runs. Not thread-safe with the runs.
+  void RecordRun(int64_t latency_micros);
+
  private:
   MaceStatus SetOpenMPThreadsAndAffinityPolicy(
       int omp_num_threads_hint,
       CPUAffinityPolicy policy,
-      void *gemm_context);
+      void *gemm_context,
+      int *thread_count,
+      std::vector<size_t> *thread_cpu_ids);
+  // the OpenMP teams are bound again before the next runs
+  void InvalidateOpenMPThreads();
 
   int num_threads_;
   CPUAffinityPolicy policy_;
+  CPUSchedulingPolicy sched_policy_;
+  int sched_priority_;
   void *gemm_context_;
+  std::vector<size_t> cpu_ids_;
+  // the max frequencies of all the cores, and the relative speeds of those
+  // of cpu_ids_, empty if they are all as fast
+  std::vector<float> cpu_max_freqs_;
+  std::vector<float> core_speeds_;
+  std::unique_ptr<utils::ThreadPool> thread_pool_;
+  // unique in the process, changed with the settings of the threads, a team
+  // bound with another one is bound again
+  uint64_t omp_config_id_;
+  // null unless the policy is AFFINITY_ADAPTIVE
+  std::unique_ptr<AdaptiveCPUScheduler> scheduler_;
 };
 }  // namespace mace
 
@@ -0,0 +1,164 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/core/runtime/hexagon/hexagon_allocator.h"
+
+#include <dlfcn.h>
+
+#include <string>
+#include <vector>
+
+#include "mace/utils/logging.h"
+
+namespace mace {
+
+namespace {
+// from rpcmem.h of the Hexagon SDK
+constexpr int kRpcmemHeapIdSystem = 25;
+constexpr uint32_t kRpcmemDefaultFlags = 1;
+
+class RpcmemLibrary {
+ public:
+  using rpcmem_initFunc = void (*)();
+  using rpcmem_allocFunc = void *(*)(int, uint32_t, int);
+  using rpcmem_freeFunc = void (*)(void *);
+  using remote_register_bufFunc = void (*)(void *, int, int);
+
+  RpcmemLibrary() {
+    // cdsp first, the compute DSP nnlib runs on
+    const std::vector<std::string> paths = {
+        "libcdsprpc.so",
+        "libadsprpc.so",
+    };
+    for (auto &path : paths) {
+      void *handle = dlopen(path.c_str(), RTLD_LAZY | RTLD_LOCAL);
+      if (handle == nullptr) {
+        VLOG(2) << "Failed to load FastRPC library from path " << path;
+        continue;
+      }
+      rpcmem_alloc = reinterpret_cast<rpcmem_allocFunc>(
+          dlsym(handle, "rpcmem_alloc"));
+      rpcmem_free = reinterpret_cast<rpcmem_freeFunc>(
+          dlsym(handle, "rpcmem_free"));
+      remote_register_buf = reinterpret_cast<remote_register_bufFunc>(
+          dlsym(handle, "remote_register_buf"));
+      if (rpcmem_alloc != nullptr && rpcmem_free != nullptr) {
+        auto rpcmem_init = reinterpret_cast<rpcmem_initFunc>(
+            dlsym(handle, "rpcmem_init"));
+        if (rpcmem_init != nullptr) {
+          rpcmem_init();
+        }
+        VLOG(1) << "Loaded rpcmem from " << path;
+        return;
+      }
+      dlclose(handle);
+    }
+    LOG(WARNING) << "rpcmem is not available, "
+                 << "Hexagon inputs and outputs will be copied";
+    rpcmem_alloc = nullptr;
+    rpcmem_free = nullptr;
+    remote_register_buf = nullptr;
+  }
+
+  rpcmem_allocFunc rpcmem_alloc = nullptr;
+  rpcmem_freeFunc rpcmem_free = nullptr;
+  remote_register_bufFunc remote_register_buf = nullptr;
+};
+
+RpcmemLibrary *GetRpcmemLibrary() {
+  static RpcmemLibrary library;
+  return &library;
+}
+}  // namespace
+
+MaceStatus HexagonAllocator::New(size_t nbytes, void **result) const {
+  RpcmemLibrary *library = GetRpcmemLibrary();
+  if (library->rpcmem_alloc == nullptr || nbytes == 0) {
+    return CPUAllocator::New(nbytes, result);
+  }
+  VLOG(3) << "Allocate rpcmem buffer: " << nbytes;
+  void *data = library->rpcmem_alloc(kRpcmemHeapIdSystem,
+                                     kRpcmemDefaultFlags,
+                                     static_cast<int>(nbytes));
+  if (data == nullptr) {
+    LOG(WARNING) << "Allocate rpcmem buffer with " << nbytes
+                 << " bytes failed, fall back to a host buffer";
+    return CPUAllocator::New(nbytes, result);
+  }
+  memset(data, 0, nbytes);
+  AddSharedBuffer(data, nbytes);
+  *result = data;
+  return MaceStatus::MACE_SUCCESS;
+}
+
+void HexagonAllocator::Delete(void *data) const {
+  MACE_CHECK_NOTNULL(data);
+  if (RemoveSharedBuffer(data)) {
+    VLOG(3) << "Free rpcmem buffer";
+    GetRpcmemLibrary()->rpcmem_free(data);
+  } else {
+    CPUAllocator::Delete(data);
+  }
+}
+
+MaceStatus HexagonAllocator::Register(void *data, size_t nbytes, int fd) {
+  RpcmemLibrary *library = GetRpcmemLibrary();
+  if (library->remote_register_buf == nullptr) {
+    return MaceStatus(MaceStatus::MACE_OUT_OF_RESOURCES,
+                      "FastRPC could not register buffers");
+  }
+  library->remote_register_buf(data, static_cast<int>(nbytes), fd);
+  AddSharedBuffer(data, nbytes);
+  return MaceStatus::MACE_SUCCESS;
+}
+
+void HexagonAllocator::Unregister(void *data) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto iter = shared_buffers_.find(static_cast<const char *>(data));
+  if (iter == shared_buffers_.end()) {
+    return;
+  }
+  // fd -1 deregisters the buffer
+  GetRpcmemLibrary()->remote_register_buf(
+      data, static_cast<int>(iter->second), -1);
+  shared_buffers_.erase(iter);
+}
+
+bool HexagonAllocator::IsShared(const void *data, size_t nbytes) const {
+  const char *begin = static_cast<const char *>(data);
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto iter = shared_buffers_.upper_bound(begin);
+  if (iter == shared_buffers_.begin()) {
+    return false;
+  }
+  --iter;
+  return begin + nbytes <= iter->first + iter->second;
+}
+
+void HexagonAllocator::AddSharedBuffer(void *data, size_t nbytes) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  shared_buffers_[static_cast<const char *>(data)] = nbytes;
+}
+
+bool HexagonAllocator::RemoveSharedBuffer(void *data) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return shared_buffers_.erase(static_cast<const char *>(data)) > 0;
+}
+
+HexagonAllocator *GetHexagonAllocator() {
+  static HexagonAllocator allocator;
+  return &allocator;
+}
+
+}  // namespace mace
@@ -0,0 +1,57 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_CORE_RUNTIME_HEXAGON_HEXAGON_ALLOCATOR_H_
+#define MACE_CORE_RUNTIME_HEXAGON_HEXAGON_ALLOCATOR_H_
+
+#include <map>
+#include <mutex>  // NOLINT(build/c++11)
+
+#include "mace/core/allocator.h"
+
+namespace mace {
+
+// Allocator of rpcmem (ION) buffers, which FastRPC maps to the DSP instead
+// of copying them on every call. rpcmem is loaded from the FastRPC library,
+// without it the buffers are ordinary host ones.
+class HexagonAllocator : public CPUAllocator {
+ public:
+  HexagonAllocator() {}
+  ~HexagonAllocator() override {}
+  MaceStatus New(size_t nbytes, void **result) const override;
+  void Delete(void *data) const override;
+
+  // Share an ION or dma-buf buffer mapped at data with the DSP.
+  MaceStatus Register(void *data, size_t nbytes, int fd);
+  void Unregister(void *data);
+  // Whether FastRPC passes [data, data + nbytes) to the DSP without a copy.
+  bool IsShared(const void *data, size_t nbytes) const;
+
+ private:
+  void AddSharedBuffer(void *data, size_t nbytes) const;
+  // returns whether data was a shared buffer
+  bool RemoveSharedBuffer(void *data) const;
+
+  mutable std::mutex mutex_;
+  // the sizes of the shared buffers, by start address
+  mutable std::map<const char *, size_t> shared_buffers_;
+
+  MACE_DISABLE_COPY_AND_ASSIGN(HexagonAllocator);
+};
+
+HexagonAllocator *GetHexagonAllocator();
+
+}  // namespace mace
+
+#endif  // MACE_CORE_RUNTIME_HEXAGON_HEXAGON_ALLOCATOR_H_
@@ -14,17 +14,21 @@
 
 #include <sys/time.h>
 #include <algorithm>
+#include <cmath>
 #include <iomanip>
+#include <mutex>  // NOLINT(build/c++11)
 #include <thread>  // NOLINT(build/c++11)
 #include <vector>
 #include <unordered_map>
 #include <string>
 #include <utility>
 
+#include "mace/core/runtime/hexagon/hexagon_allocator.h"
 #include "mace/core/runtime/hexagon/hexagon_control_wrapper.h"
 #include "mace/core/runtime/hexagon/hexagon_nn_ops.h"
 #include "mace/core/types.h"
 #include "mace/utils/quantize.h"
+#include "mace/utils/system_trace.h"
 
 namespace {
 inline int64_t NowMicros() {
@@ -99,9 +103,73 @@ int HexagonControlWrapper::GetVersion() {
   return version;
 }
 
+namespace {
+// the DSP is configured for the first graph and released after the last
+// one, so that the graphs of several engines could run concurrently
+std::mutex dsp_mutex;
+int dsp_graph_count = 0;
+// the power save level voted for the DSP, -1 before any
+int dsp_powersave_level = -1;
+// the perf votes of the runs in progress
+int dsp_perf_vote_count = 0;
+}  // namespace
+
+DSPPerfVote::DSPPerfVote(DSPPerfHint perf_hint) : voted_(false) {
+  hexagon_nn_corner_type corner;
+  hexagon_nn_dcvs_type dcvs;
+  // the latency in microseconds the DSP could take to wake up
+  unsigned int latency;
+  switch (perf_hint) {
+    case DSPPerfHint::DSP_PERF_BURST:
+      corner = NN_CORNER_TURBO;
+      dcvs = NN_DCVS_DISABLE;
+      latency = 100;
+      break;
+    case DSPPerfHint::DSP_PERF_SUSTAINED:
+      corner = NN_CORNER_NOMINAL;
+      dcvs = NN_DCVS_ENABLE;
+      latency = 1000;
+      break;
+    case DSPPerfHint::DSP_PERF_POWER_SAVE:
+      corner = NN_CORNER_SVS;
+      dcvs = NN_DCVS_ENABLE;
+      latency = 5000;
+      break;
+    default:
+      return;
+  }
+  std::lock_guard<std::mutex> lock(dsp_mutex);
+  if (hexagon_nn_set_powersave_details(corner, dcvs, latency) != 0) {
+    LOG(WARNING) << "Failed to vote DSP perf hint " << perf_hint;
+    return;
+  }
+  ++dsp_perf_vote_count;
+  voted_ = true;
+}
+
+DSPPerfVote::~DSPPerfVote() {
+  if (!voted_) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(dsp_mutex);
+  if (--dsp_perf_vote_count > 0) {
+    return;
+  }
+  const unsigned int level =
+      static_cast<unsigned int>(std::max(dsp_powersave_level, 0));
+  if (hexagon_nn_set_powersave_level(level) != 0) {
+    LOG(WARNING) << "Failed to restore DSP power save level " << level;
+  }
+}
+
 bool HexagonControlWrapper::Config() {
+  std::lock_guard<std::mutex> lock(dsp_mutex);
+  if (dsp_graph_count++ > 0) {
+    return true;
+  }
   LOG(INFO) << "Hexagon config";
   MACE_CHECK(hexagon_nn_set_powersave_level(0) == 0, "hexagon power error");
+  dsp_powersave_level = 0;
   MACE_CHECK(hexagon_nn_config() == 0, "hexagon config error");
   return true;
 }
@@ -114,8 +182,16 @@ bool HexagonControlWrapper::Init() {
 }
 
 bool HexagonControlWrapper::Finalize() {
+  std::lock_guard<std::mutex> lock(dsp_mutex);
+  if (--dsp_graph_count > 0) {
+    return true;
+  }
   LOG(INFO) << "Hexagon finalize";
-  return hexagon_nn_set_powersave_level(1) == 0;
+  if (hexagon_nn_set_powersave_level(1) != 0) {
+    return false;
+  }
+  dsp_powersave_level = 1;
+  return true;
 }
 
 bool HexagonControlWrapper::SetupGraph(const NetDef &net_def,
@@ -124,6 +200,31 @@ bool HexagonControlWrapper::SetupGraph(const NetDef &net_def,
 
   int64_t t0 = NowMicros();
 
+  // FastRPC copies the const data of every append call unless it is in
+  // memory shared with the DSP, so the weights are moved there at once
+  size_t model_data_size = 0;
+  for (const ConstTensor &const_tensor : net_def.tensors()) {
+    model_data_size = std::max<size_t>(
+        model_data_size,
+        const_tensor.offset() +
+            const_tensor.data_size() *
+                GetEnumTypeSize(const_tensor.data_type()));
+  }
+  HexagonAllocator *allocator = GetHexagonAllocator();
+  void *shared_model_data = nullptr;
+  if (model_data_size > 0 &&
+      !allocator->IsShared(model_data, model_data_size) &&
+      allocator->New(model_data_size, &shared_model_data) ==
+          MaceStatus::MACE_SUCCESS) {
+    if (allocator->IsShared(shared_model_data, model_data_size)) {
+      memcpy(shared_model_data, model_data, model_data_size);
+      model_data = static_cast<const unsigned char *>(shared_model_data);
+    } else {
+      allocator->Delete(shared_model_data);
+      shared_model_data = nullptr;
+    }
+  }
+
   // const node
   std::vector<hexagon_nn_const_node> const_node_list;
   for (const ConstTensor &const_tensor : net_def.tensors()) {
@@ -168,6 +269,10 @@ bool HexagonControlWrapper::SetupGraph(const NetDef &net_def,
         "append const node error");
   }
   const_node_list.clear();
+  // the DSP keeps its own copy of the appended const data
+  if (shared_model_data != nullptr) {
+    allocator->Delete(shared_model_data);
+  }
 
   // op node
   OpMap op_map;
@@ -207,6 +312,14 @@ bool HexagonControlWrapper::SetupGraph(const NetDef &net_def,
     hexagon_nn_padding_type padding_type =
         static_cast<hexagon_nn_padding_type>(op.padding());
 
+    OperatorStats &node_stats = node_stats_[node_id(op.node_id())];
+    node_stats.operator_name = op.name();
+    node_stats.type = op.type();
+    for (auto &output_shape : op.output_shape()) {
+      node_stats.output_shape.emplace_back(output_shape.dims().begin(),
+                                           output_shape.dims().end());
+    }
+
     hexagon_nn_op_node op_node;
     op_node.node_id = node_id(op.node_id());
     op_node.operation = op_id;
@@ -392,11 +505,72 @@ void HexagonControlWrapper::ResetPerfInfo() {
   LOG(INFO) << "Reset perf info";
   MACE_CHECK(hexagon_nn_reset_perfinfo(nn_id_, NN_GRAPH_PERFEVENT_UTIME) == 0,
              "reset perf error");
+  node_counters_.clear();
+}
+
+void HexagonControlWrapper::GetRunMetadata(int64_t start_micros,
+                                           RunMetadata *run_metadata) {
+  std::vector<hexagon_nn_perfinfo> perf_info(MACE_MAX_NODE);
+  unsigned int n_items = 0;
+  if (hexagon_nn_get_perfinfo(nn_id_, perf_info.data(), MACE_MAX_NODE,
+                              &n_items) != 0) {
+    LOG(WARNING) << "Failed to get the perf info of the DSP";
+    return;
+  }
+  unsigned int cycles_lo = 0;
+  unsigned int cycles_hi = 0;
+  MACE_CHECK(hexagon_nn_last_execution_cycles(nn_id_, &cycles_lo,
+                                              &cycles_hi) == 0,
+             "get execution cycles error");
+  const int64_t cycles =
+      static_cast<int64_t>((static_cast<uint64_t>(cycles_hi) << 32) +
+                           cycles_lo);
+
+  // the counters accumulate the microseconds of the nodes over the runs,
+  // those of the last one are the increments since the last read
+  std::vector<std::pair<uint32_t, int64_t>> node_micros;
+  int64_t total_micros = 0;
+  for (unsigned int i = 0; i < n_items; ++i) {
+    auto node = node_stats_.find(perf_info[i].node_id);
+    if (node == node_stats_.end()) {
+      // the const nodes
+      continue;
+    }
+    const uint64_t counter =
+        (static_cast<uint64_t>(perf_info[i].counter_hi) << 32) +
+        perf_info[i].counter_lo;
+    uint64_t &last_counter = node_counters_[perf_info[i].node_id];
+    const int64_t micros = static_cast<int64_t>(counter - last_counter);
+    last_counter = counter;
+    node_micros.emplace_back(perf_info[i].node_id, micros);
+    total_micros += micros;
+  }
+
+  const int64_t clock_mhz = total_micros > 0 ? cycles / total_micros : 0;
+  // the nodes run one after another from the start of the execution
+  int64_t node_start_micros = start_micros;
+  for (auto &node : node_micros) {
+    OperatorStats op_stats = node_stats_[node.first];
+    op_stats.stats.start_micros = node_start_micros;
+    op_stats.stats.end_micros = node_start_micros + node.second;
+    op_stats.dsp_cycles = node.second * clock_mhz;
+    if (op_stats.output_shape.empty()) {
+      op_stats.output_shape.emplace_back();
+    }
+    node_start_micros = op_stats.stats.end_micros;
+    run_metadata->op_stats.emplace_back(op_stats);
+  }
+
+  run_metadata->dsp_stats.cycles = cycles;
+  run_metadata->dsp_stats.clock_mhz = clock_mhz;
+  std::lock_guard<std::mutex> lock(dsp_mutex);
+  run_metadata->dsp_stats.powersave_level = dsp_powersave_level;
 }
 
 bool HexagonControlWrapper::ExecuteGraph(const Tensor &input_tensor,
                                          Tensor *output_tensor) {
   VLOG(2) << "Execute graph: " << nn_id_;
+  MACE_SYSTEM_TRACE("Hexagon execute");
   // single input and single output
   MACE_ASSERT(num_inputs_ == 1, "Wrong inputs num");
   MACE_ASSERT(num_outputs_ == 1, "Wrong outputs num");
@@ -437,6 +611,7 @@ bool HexagonControlWrapper::ExecuteGraphNew(
     std::vector<Tensor *> *output_tensors,
     bool hexagon_quantize) {
   VLOG(2) << "Execute graph new: " << nn_id_;
+  MACE_SYSTEM_TRACE("Hexagon execute");
   uint32_t num_inputs = static_cast<uint32_t>(input_tensors.size());
   uint32_t num_outputs = static_cast<uint32_t>(output_tensors->size());
   MACE_ASSERT(num_inputs_ == num_inputs, "Wrong inputs num");
@@ -465,8 +640,9 @@ bool HexagonControlWrapper::ExecuteGraphNew(
       input_metadata[i].Init(.0f, .0f, 1);
     } else {
       if (input_tensors_u8_.size() < i + 1) {
-        input_tensors_u8_.emplace_back(new Tensor());
-        input_tensors_u8_[i]->SetDtype(DT_UINT8);
+        // shared with the DSP, so that FastRPC does not copy it
+        input_tensors_u8_.emplace_back(
+            new Tensor(GetHexagonAllocator(), DT_UINT8));
         input_tensors_u8_[i]->Resize(input_shape);
       }
 
@@ -504,8 +680,9 @@ bool HexagonControlWrapper::ExecuteGraphNew(
       output_metadata[i].Init(.0f, .0f, 1);
     } else {
       if (output_tensors_u8_.size() < i + 1) {
-        output_tensors_u8_.emplace_back(new Tensor());
-        output_tensors_u8_[i]->SetDtype(DT_UINT8);
+        // shared with the DSP, so that FastRPC does not copy it
+        output_tensors_u8_.emplace_back(
+            new Tensor(GetHexagonAllocator(), DT_UINT8));
         output_tensors_u8_[i]->Resize(output_shapes_[i]);
       }
 
@@ -562,4 +739,85 @@ bool HexagonControlWrapper::ExecuteGraphNew(
   return res == 0;
 }
 
+bool HexagonControlWrapper::ExecuteQuantizedGraph(
+    const std::vector<const Tensor *> &input_tensors,
+    const std::vector<Tensor *> &output_tensors) {
+  VLOG(2) << "Execute quantized graph: " << nn_id_;
+  uint32_t num_inputs = static_cast<uint32_t>(input_tensors.size());
+  uint32_t num_outputs = static_cast<uint32_t>(output_tensors.size());
+  MACE_ASSERT(num_inputs_ == num_inputs, "Wrong inputs num");
+  MACE_ASSERT(num_outputs_ == num_outputs, "Wrong outputs num");
+
+  std::vector<hexagon_nn_tensordef> inputs(num_inputs * NUM_METADATA);
+  std::vector<hexagon_nn_tensordef> outputs(num_outputs * NUM_METADATA);
+  std::vector<InputOutputMetadata> input_metadata(num_inputs);
+  std::vector<InputOutputMetadata> output_metadata(num_outputs);
+
+  // the tensors are in the arena shared with the DSP, passed in place
+  for (size_t i = 0; i < num_inputs; ++i) {
+    const Tensor *input = input_tensors[i];
+    MACE_CHECK(input->dtype() == DT_UINT8 && input->dim_size() == 4,
+               "the DSP reads 4D uint8 tensors");
+    size_t index = i * NUM_METADATA;
+    inputs[index].batches = static_cast<uint32_t>(input->dim(0));
+    inputs[index].height = static_cast<uint32_t>(input->dim(1));
+    inputs[index].width = static_cast<uint32_t>(input->dim(2));
+    inputs[index].depth = static_cast<uint32_t>(input->dim(3));
+    inputs[index].data = const_cast<unsigned char *>(
+        reinterpret_cast<const unsigned char *>(input->raw_data()));
+    inputs[index].dataLen = static_cast<int>(input->raw_size());
+    inputs[index].data_valid_len = static_cast<uint32_t>(input->raw_size());
+    inputs[index].unused = 0;
+    input_metadata[i].Init(-input->zero_point() * input->scale(),
+                           (255 - input->zero_point()) * input->scale(),
+                           0);
+    AddInputMetadata(input_metadata[i].min_val, &inputs[index + 1]);
+    AddInputMetadata(input_metadata[i].max_val, &inputs[index + 2]);
+    AddInputMetadata(input_metadata[i].needs_quantization, &inputs[index + 3]);
+  }
+
+  for (size_t i = 0; i < num_outputs; ++i) {
+    Tensor *output = output_tensors[i];
+    MACE_CHECK(output->dtype() == DT_UINT8, "the DSP writes uint8 tensors");
+    if (output->Resize(output_shapes_[i]) != MaceStatus::MACE_SUCCESS) {
+      return false;
+    }
+    size_t index = i * NUM_METADATA;
+    outputs[index].data =
+        reinterpret_cast<unsigned char *>(output->raw_mutable_data());
+    outputs[index].dataLen = static_cast<int>(output->raw_size());
+    output_metadata[i].Init(.0f, .0f, 0);
+    AddOutputMetadata(output_metadata[i].min_val, &outputs[index + 1]);
+    AddOutputMetadata(output_metadata[i].max_val, &outputs[index + 2]);
+    AddOutputMetadata(output_metadata[i].needs_quantization,
+                      &outputs[index + 3]);
+  }
+
+  int res = hexagon_nn_execute_new(nn_id_,
+                                   inputs.data(),
+                                   num_inputs * NUM_METADATA,
+                                   outputs.data(),
+                                   num_outputs * NUM_METADATA);
+  if (res != 0) {
+    return false;
+  }
+
+  for (size_t i = 0; i < num_outputs; ++i) {
+    size_t index = i * NUM_METADATA;
+    MACE_ASSERT(static_cast<index_t>(outputs[index].data_valid_len)
+                    == output_tensors[i]->raw_size(),
+                "wrong output bytes inferred.");
+    // the range the DSP quantized the output in, which includes zero
+    const float min_val = output_metadata[i].min_val;
+    const float max_val = output_metadata[i].max_val;
+    const float scale = std::max(max_val - min_val, 1e-6f) / 255.f;
+    output_tensors[i]->SetScale(scale);
+    output_tensors[i]->SetZeroPoint(std::min(255, std::max(0,
+        static_cast<int32_t>(std::round(-min_val / scale)))));
+    output_tensors[i]->SetMinVal(min_val);
+    output_tensors[i]->SetMaxVal(max_val);
+  }
+  return true;
+}
+
 }  // namespace mace
@@ -16,6 +16,7 @@
 #define MACE_CORE_RUNTIME_HEXAGON_HEXAGON_CONTROL_WRAPPER_H_
 
 #include <memory>
+#include <unordered_map>
 #include <vector>
 
 #include "mace/core/tensor.h"
@@ -24,6 +25,27 @@
 
 namespace mace {
 
+// Type of the CPU op running a partition of a net on the DSP, emitted by
+// the converter for the runs of ops the DSP supports when the others run on
+// CPU.
+constexpr const char *kHexagonGraphOpType = "HexagonGraph";
+// Arg of the op, the serialized NetDef of the partition, converted for the
+// DSP with its const tensors inline.
+constexpr const char *kHexagonGraphArg = "hexagon_graph";
+
+// Votes the clocks of a perf hint for the DSP while alive, and votes the
+// power save level back when the last of the overlapping votes ends.
+class DSPPerfVote {
+ public:
+  explicit DSPPerfVote(DSPPerfHint perf_hint);
+  ~DSPPerfVote();
+
+ private:
+  bool voted_;
+
+  MACE_DISABLE_COPY_AND_ASSIGN(DSPPerfVote);
+};
+
 class HexagonControlWrapper {
  public:
   HexagonControlWrapper() {}
@@ -36,12 +58,19 @@ class HexagonControlWrapper {
   bool ExecuteGraphNew(const std::vector<Tensor *> &input_tensors,
                        std::vector<Tensor *> *output_tensors,
                        bool hexagon_quantize);
+  // Execute a graph of uint8 inputs and outputs, whose ranges are taken
+  // from and given to the scales and zero points of the tensors.
+  bool ExecuteQuantizedGraph(const std::vector<const Tensor *> &input_tensors,
+                             const std::vector<Tensor *> &output_tensors);
 
   bool TeardownGraph();
   void PrintLog();
   void PrintGraph();
   void GetPerfInfo();
   void ResetPerfInfo();
+  // Fill the stats of the nodes in the last execution, which started at
+  // start_micros on the host, and the state of the DSP.
+  void GetRunMetadata(int64_t start_micros, RunMetadata *run_metadata);
   void SetDebugLevel(int level);
 
  private:
@@ -60,6 +89,10 @@ class HexagonControlWrapper {
   uint32_t num_outputs_;
   std::vector<std::unique_ptr<Tensor>> input_tensors_u8_;
   std::vector<std::unique_ptr<Tensor>> output_tensors_u8_;
+  // the ops of the nodes, and the perf counters of the nodes up to the
+  // last execution read, by node id
+  std::unordered_map<uint32_t, OperatorStats> node_stats_;
+  std::unordered_map<uint32_t, uint64_t> node_counters_;
 
   MACE_DISABLE_COPY_AND_ASSIGN(HexagonControlWrapper);
 };
@@ -16,6 +16,7 @@
 #define MACE_CORE_RUNTIME_HEXAGON_HEXAGON_DEVICE_H_
 
 #include "mace/core/device.h"
+#include "mace/core/runtime/hexagon/hexagon_allocator.h"
 
 namespace mace {
 
@@ -26,6 +27,11 @@ class HexagonDevice : public CPUDevice {
   DeviceType device_type() const override {
     return DeviceType::HEXAGON;
   };
+
+  // inputs and outputs are shared with the DSP
+  Allocator *allocator() override {
+    return GetHexagonAllocator();
+  }
 };
 
 }  // namespace mace
@@ -0,0 +1,99 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/core/runtime/nnapi/nnapi_wrapper.h"
+
+#include <dlfcn.h>
+
+#include "mace/utils/logging.h"
+
+namespace mace {
+namespace nnapi {
+
+NNAPILibrary *NNAPILibrary::Get() {
+  static NNAPILibrary library;
+  return &library;
+}
+
+NNAPILibrary::NNAPILibrary() {
+  Load();
+}
+
+bool NNAPILibrary::Load() {
+  if (handle_ != nullptr) {
+    return true;
+  }
+
+  void *handle = dlopen("libneuralnetworks.so", RTLD_LAZY | RTLD_LOCAL);
+  if (handle == nullptr) {
+    VLOG(2) << "Failed to load NNAPI library, error code: " << dlerror();
+    return false;
+  }
+
+#define MACE_NNAPI_ASSIGN_FROM_DLSYM(func, type)                \
+  do {                                                          \
+    void *ptr = dlsym(handle, #func);                           \
+    if (ptr == nullptr) {                                       \
+      LOG(WARNING) << "Failed to load " << #func << " of NNAPI"; \
+      dlclose(handle);                                          \
+      return false;                                             \
+    }                                                           \
+    func = reinterpret_cast<type>(ptr);                         \
+  } while (false)
+
+  MACE_NNAPI_ASSIGN_FROM_DLSYM(ANeuralNetworksModel_create, ModelCreateFunc);
+  MACE_NNAPI_ASSIGN_FROM_DLSYM(ANeuralNetworksModel_free, ModelFreeFunc);
+  MACE_NNAPI_ASSIGN_FROM_DLSYM(ANeuralNetworksModel_finish, ModelFinishFunc);
+  MACE_NNAPI_ASSIGN_FROM_DLSYM(ANeuralNetworksModel_addOperand,
+                               ModelAddOperandFunc);
+  MACE_NNAPI_ASSIGN_FROM_DLSYM(ANeuralNetworksModel_setOperandValue,
+                               ModelSetOperandValueFunc);
+  MACE_NNAPI_ASSIGN_FROM_DLSYM(ANeuralNetworksModel_addOperation,
+                               ModelAddOperationFunc);
+  MACE_NNAPI_ASSIGN_FROM_DLSYM(ANeuralNetworksModel_identifyInputsAndOutputs,
+                               ModelIdentifyInputsAndOutputsFunc);
+  MACE_NNAPI_ASSIGN_FROM_DLSYM(ANeuralNetworksCompilation_create,
+                               CompilationCreateFunc);
+  MACE_NNAPI_ASSIGN_FROM_DLSYM(ANeuralNetworksCompilation_free,
+                               CompilationFreeFunc);
+  MACE_NNAPI_ASSIGN_FROM_DLSYM(ANeuralNetworksCompilation_setPreference,
+                               CompilationSetPreferenceFunc);
+  MACE_NNAPI_ASSIGN_FROM_DLSYM(ANeuralNetworksCompilation_finish,
+                               CompilationFinishFunc);
+  MACE_NNAPI_ASSIGN_FROM_DLSYM(ANeuralNetworksExecution_create,
+                               ExecutionCreateFunc);
+  MACE_NNAPI_ASSIGN_FROM_DLSYM(ANeuralNetworksExecution_free,
+                               ExecutionFreeFunc);
+  MACE_NNAPI_ASSIGN_FROM_DLSYM(ANeuralNetworksExecution_setInput,
+                               ExecutionSetInputFunc);
+  MACE_NNAPI_ASSIGN_FROM_DLSYM(ANeuralNetworksExecution_setOutput,
+                               ExecutionSetOutputFunc);
+  MACE_NNAPI_ASSIGN_FROM_DLSYM(ANeuralNetworksExecution_startCompute,
+                               ExecutionStartComputeFunc);
+  MACE_NNAPI_ASSIGN_FROM_DLSYM(ANeuralNetworksEvent_wait, EventWaitFunc);
+  MACE_NNAPI_ASSIGN_FROM_DLSYM(ANeuralNetworksEvent_free, EventFreeFunc);
+
+#undef MACE_NNAPI_ASSIGN_FROM_DLSYM
+
+  // since Android 10, absent before
+  ANeuralNetworksCompilation_setCaching =
+      reinterpret_cast<CompilationSetCachingFunc>(
+          dlsym(handle, "ANeuralNetworksCompilation_setCaching"));
+
+  handle_ = handle;
+  return true;
+}
+
+}  // namespace nnapi
+}  // namespace mace
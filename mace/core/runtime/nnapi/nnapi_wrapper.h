@@ -0,0 +1,197 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_CORE_RUNTIME_NNAPI_NNAPI_WRAPPER_H_
+#define MACE_CORE_RUNTIME_NNAPI_NNAPI_WRAPPER_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "mace/utils/utils.h"
+
+// Wrapper of the Android Neural Networks API of android/NeuralNetworks.h,
+// loaded from libneuralnetworks.so at run time, so that the library builds
+// with any NDK and runs on devices without NNAPI. The values below are those
+// of the NDK header.
+
+struct ANeuralNetworksModel;
+struct ANeuralNetworksCompilation;
+struct ANeuralNetworksExecution;
+struct ANeuralNetworksEvent;
+
+namespace mace {
+namespace nnapi {
+
+struct OperandType {
+  int32_t type;
+  uint32_t dimension_count;
+  const uint32_t *dimensions;
+  float scale;
+  int32_t zero_point;
+};
+
+enum ResultCode {
+  NO_ERROR = 0,
+};
+
+enum OperandCode {
+  FLOAT32 = 0,
+  INT32 = 1,
+  TENSOR_FLOAT32 = 3,
+  TENSOR_INT32 = 4,
+};
+
+enum OperationCode {
+  ADD = 0,
+  AVERAGE_POOL_2D = 1,
+  CONCATENATION = 2,
+  CONV_2D = 3,
+  DEPTHWISE_CONV_2D = 4,
+  LOGISTIC = 14,
+  MAX_POOL_2D = 17,
+  MUL = 18,
+  RELU = 19,
+  RELU1 = 20,
+  RELU6 = 21,
+  SOFTMAX = 25,
+  TANH = 28,
+};
+
+enum FuseCode {
+  FUSED_NONE = 0,
+  FUSED_RELU = 1,
+  FUSED_RELU1 = 2,
+  FUSED_RELU6 = 3,
+};
+
+enum PreferenceCode {
+  PREFER_LOW_POWER = 0,
+  PREFER_FAST_SINGLE_ANSWER = 1,
+  PREFER_SUSTAINED_SPEED = 2,
+};
+
+// bytes of the token of a compilation cache
+constexpr size_t kCacheTokenSize = 32;
+
+class NNAPILibrary final {
+ private:
+  NNAPILibrary();
+  MACE_DISABLE_COPY_AND_ASSIGN(NNAPILibrary);
+
+  bool Load();
+
+ public:
+  static NNAPILibrary *Get();
+
+  // whether the device has NNAPI (Android 8.1)
+  bool available() const { return handle_ != nullptr; }
+  // whether the compilations can be cached (Android 10)
+  bool has_caching() const {
+    return ANeuralNetworksCompilation_setCaching != nullptr;
+  }
+
+  using ModelCreateFunc = int (*)(ANeuralNetworksModel **);
+  using ModelFreeFunc = void (*)(ANeuralNetworksModel *);
+  using ModelFinishFunc = int (*)(ANeuralNetworksModel *);
+  using ModelAddOperandFunc = int (*)(ANeuralNetworksModel *,
+                                      const OperandType *);
+  using ModelSetOperandValueFunc = int (*)(ANeuralNetworksModel *,
+                                           int32_t,
+                                           const void *,
+                                           size_t);
+  using ModelAddOperationFunc = int (*)(ANeuralNetworksModel *,
+                                        int32_t,
+                                        uint32_t,
+                                        const uint32_t *,
+                                        uint32_t,
+                                        const uint32_t *);
+  using ModelIdentifyInputsAndOutputsFunc = int (*)(ANeuralNetworksModel *,
+                                                    uint32_t,
+                                                    const uint32_t *,
+                                                    uint32_t,
+                                                    const uint32_t *);
+  using CompilationCreateFunc = int (*)(ANeuralNetworksModel *,
+                                        ANeuralNetworksCompilation **);
+  using CompilationFreeFunc = void (*)(ANeuralNetworksCompilation *);
+  using CompilationSetPreferenceFunc = int (*)(ANeuralNetworksCompilation *,
+                                               int32_t);
+  using CompilationSetCachingFunc = int (*)(ANeuralNetworksCompilation *,
+                                            const char *,
+                                            const uint8_t *);
+  using CompilationFinishFunc = int (*)(ANeuralNetworksCompilation *);
+  using ExecutionCreateFunc = int (*)(ANeuralNetworksCompilation *,
+                                      ANeuralNetworksExecution **);
+  using ExecutionFreeFunc = void (*)(ANeuralNetworksExecution *);
+  using ExecutionSetInputFunc = int (*)(ANeuralNetworksExecution *,
+                                        int32_t,
+                                        const OperandType *,
+                                        const void *,
+                                        size_t);
+  using ExecutionSetOutputFunc = int (*)(ANeuralNetworksExecution *,
+                                         int32_t,
+                                         const OperandType *,
+                                         void *,
+                                         size_t);
+  using ExecutionStartComputeFunc = int (*)(ANeuralNetworksExecution *,
+                                            ANeuralNetworksEvent **);
+  using EventWaitFunc = int (*)(ANeuralNetworksEvent *);
+  using EventFreeFunc = void (*)(ANeuralNetworksEvent *);
+
+#define MACE_NNAPI_DEFINE_FUNC_PTR(func, type) \
+  type func = nullptr
+
+  MACE_NNAPI_DEFINE_FUNC_PTR(ANeuralNetworksModel_create, ModelCreateFunc);
+  MACE_NNAPI_DEFINE_FUNC_PTR(ANeuralNetworksModel_free, ModelFreeFunc);
+  MACE_NNAPI_DEFINE_FUNC_PTR(ANeuralNetworksModel_finish, ModelFinishFunc);
+  MACE_NNAPI_DEFINE_FUNC_PTR(ANeuralNetworksModel_addOperand,
+                             ModelAddOperandFunc);
+  MACE_NNAPI_DEFINE_FUNC_PTR(ANeuralNetworksModel_setOperandValue,
+                             ModelSetOperandValueFunc);
+  MACE_NNAPI_DEFINE_FUNC_PTR(ANeuralNetworksModel_addOperation,
+                             ModelAddOperationFunc);
+  MACE_NNAPI_DEFINE_FUNC_PTR(ANeuralNetworksModel_identifyInputsAndOutputs,
+                             ModelIdentifyInputsAndOutputsFunc);
+  MACE_NNAPI_DEFINE_FUNC_PTR(ANeuralNetworksCompilation_create,
+                             CompilationCreateFunc);
+  MACE_NNAPI_DEFINE_FUNC_PTR(ANeuralNetworksCompilation_free,
+                             CompilationFreeFunc);
+  MACE_NNAPI_DEFINE_FUNC_PTR(ANeuralNetworksCompilation_setPreference,
+                             CompilationSetPreferenceFunc);
+  MACE_NNAPI_DEFINE_FUNC_PTR(ANeuralNetworksCompilation_setCaching,
+                             CompilationSetCachingFunc);
+  MACE_NNAPI_DEFINE_FUNC_PTR(ANeuralNetworksCompilation_finish,
+                             CompilationFinishFunc);
+  MACE_NNAPI_DEFINE_FUNC_PTR(ANeuralNetworksExecution_create,
+                             ExecutionCreateFunc);
+  MACE_NNAPI_DEFINE_FUNC_PTR(ANeuralNetworksExecution_free,
+                             ExecutionFreeFunc);
+  MACE_NNAPI_DEFINE_FUNC_PTR(ANeuralNetworksExecution_setInput,
+                             ExecutionSetInputFunc);
+  MACE_NNAPI_DEFINE_FUNC_PTR(ANeuralNetworksExecution_setOutput,
+                             ExecutionSetOutputFunc);
+  MACE_NNAPI_DEFINE_FUNC_PTR(ANeuralNetworksExecution_startCompute,
+                             ExecutionStartComputeFunc);
+  MACE_NNAPI_DEFINE_FUNC_PTR(ANeuralNetworksEvent_wait, EventWaitFunc);
+  MACE_NNAPI_DEFINE_FUNC_PTR(ANeuralNetworksEvent_free, EventFreeFunc);
+
+#undef MACE_NNAPI_DEFINE_FUNC_PTR
+
+ private:
+  void *handle_ = nullptr;
+};
+
+}  // namespace nnapi
+}  // namespace mace
+
+#endif  // MACE_CORE_RUNTIME_NNAPI_NNAPI_WRAPPER_H_
@@ -49,7 +49,7 @@ MaceStatus OpenCLAllocator::New(size_t nbytes, void **result) const {
   }
   VLOG(3) << "Allocate OpenCL buffer: " << nbytes;
 
-  if (ShouldMockRuntimeFailure()) {
+  if (ShouldMockRuntimeFailure() || !AllowAllocation(nbytes)) {
     return MaceStatus::MACE_OUT_OF_RESOURCES;
   }
 
@@ -77,7 +77,9 @@ MaceStatus OpenCLAllocator::NewImage(const std::vector<size_t> &image_shape,
   VLOG(3) << "Allocate OpenCL image: " << image_shape[0] << ", "
           << image_shape[1];
 
-  if (ShouldMockRuntimeFailure()) {
+  if (ShouldMockRuntimeFailure() ||
+      !AllowAllocation(image_shape[0] * image_shape[1] * 4 *
+                       GetEnumTypeSize(dt))) {
     return MaceStatus::MACE_OUT_OF_RESOURCES;
   }
 
@@ -102,6 +104,50 @@ MaceStatus OpenCLAllocator::NewImage(const std::vector<size_t> &image_shape,
   }
 }
 
+MaceStatus OpenCLAllocator::ImportBuffer(void *memory, void **result) const {
+  MACE_CHECK_NOTNULL(memory);
+  VLOG(3) << "Import OpenCL buffer";
+  *result = new cl::Buffer(static_cast<cl_mem>(memory), true);
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus OpenCLAllocator::ImportImage(void *memory,
+                                        std::vector<size_t> *image_shape,
+                                        void **result) const {
+  MACE_CHECK_NOTNULL(memory);
+  VLOG(3) << "Import OpenCL image";
+  std::unique_ptr<cl::Image2D> cl_image(
+      new cl::Image2D(static_cast<cl_mem>(memory), true));
+  cl::ImageFormat img_format;
+  size_t width = 0;
+  size_t height = 0;
+  cl_int error = cl_image->getImageInfo(CL_IMAGE_FORMAT, &img_format);
+  if (error == CL_SUCCESS) {
+    error = cl_image->getImageInfo(CL_IMAGE_WIDTH, &width);
+  }
+  if (error == CL_SUCCESS) {
+    error = cl_image->getImageInfo(CL_IMAGE_HEIGHT, &height);
+  }
+  if (error != CL_SUCCESS) {
+    LOG(WARNING) << "Query OpenCL image failed because of "
+                 << OpenCLErrorToString(error);
+    *result = nullptr;
+    return MaceStatus::MACE_INVALID_ARGS;
+  }
+  const cl_channel_type channel_type = img_format.image_channel_data_type;
+  if (img_format.image_channel_order != CL_RGBA ||
+      (channel_type != CL_FLOAT && channel_type != CL_HALF_FLOAT &&
+          channel_type != CL_UNORM_INT8)) {
+    LOG(WARNING) << "OpenCL image should be RGBA of float, half or "
+                    "normalized uint8";
+    *result = nullptr;
+    return MaceStatus::MACE_INVALID_ARGS;
+  }
+  *image_shape = {width, height};
+  *result = cl_image.release();
+  return MaceStatus::MACE_SUCCESS;
+}
+
 void OpenCLAllocator::Delete(void *buffer) const {
   VLOG(3) << "Free OpenCL buffer";
   if (buffer != nullptr) {
@@ -157,6 +203,40 @@ void *OpenCLAllocator::MapImage(void *buffer,
   return mapped_ptr;
 }
 
+MaceStatus OpenCLAllocator::WriteImage(void *buffer,
+                                       const std::vector<size_t> &image_shape,
+                                       const void *data) const {
+  MACE_CHECK(image_shape.size() == 2) << "Just support write 2d image";
+  auto cl_image = static_cast<cl::Image2D *>(buffer);
+  std::array<size_t, 3> origin = {0, 0, 0};
+  std::array<size_t, 3> region = {image_shape[0], image_shape[1], 1};
+  cl_int error = opencl_runtime_->command_queue().enqueueWriteImage(
+      *cl_image, CL_TRUE, origin, region, 0, 0, data);
+  if (error != CL_SUCCESS) {
+    LOG(WARNING) << "Write Image failed, error: "
+                 << OpenCLErrorToString(error);
+    return MaceStatus::MACE_OUT_OF_RESOURCES;
+  }
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus OpenCLAllocator::ReadImage(void *buffer,
+                                      const std::vector<size_t> &image_shape,
+                                      void *data) const {
+  MACE_CHECK(image_shape.size() == 2) << "Just support read 2d image";
+  auto cl_image = static_cast<cl::Image2D *>(buffer);
+  std::array<size_t, 3> origin = {0, 0, 0};
+  std::array<size_t, 3> region = {image_shape[0], image_shape[1], 1};
+  cl_int error = opencl_runtime_->command_queue().enqueueReadImage(
+      *cl_image, CL_TRUE, origin, region, 0, 0, data);
+  if (error != CL_SUCCESS) {
+    LOG(WARNING) << "Read Image failed, error: "
+                 << OpenCLErrorToString(error);
+    return MaceStatus::MACE_OUT_OF_RESOURCES;
+  }
+  return MaceStatus::MACE_SUCCESS;
+}
+
 void OpenCLAllocator::Unmap(void *buffer, void *mapped_ptr) const {
   VLOG(3) << "Unmap OpenCL buffer/Image";
   auto cl_buffer = static_cast<cl::Buffer *>(buffer);
@@ -40,6 +40,24 @@ class OpenCLAllocator : public Allocator {
                       const DataType dt,
                       void **result) const override;
 
+  /*
+   * Wrap a user-owned cl_mem buffer, which is created on the context of the
+   * runtime, like one returned by New. It is retained until Delete.
+   */
+  MaceStatus ImportBuffer(void *memory, void **result) const;
+
+  /*
+   * Wrap a user-owned cl_mem image2d like one returned by NewImage, whose
+   * format must be RGBA of float, half or normalized uint8, e.g. of a
+   * GL_RGBA8 texture, which the kernels read and write as floats in
+   * [0, 1]. It is retained until DeleteImage.
+   *
+   * @ image_shape : [width, height] of the image.
+   */
+  MaceStatus ImportImage(void *memory,
+                         std::vector<size_t> *image_shape,
+                         void **result) const;
+
   void Delete(void *buffer) const override;
 
   void DeleteImage(void *buffer) const override;
@@ -50,6 +68,14 @@ class OpenCLAllocator : public Allocator {
                  const std::vector<size_t> &image_shape,
                  std::vector<size_t> *mapped_image_pitch) const override;
 
+  MaceStatus WriteImage(void *buffer,
+                        const std::vector<size_t> &image_shape,
+                        const void *data) const override;
+
+  MaceStatus ReadImage(void *buffer,
+                       const std::vector<size_t> &image_shape,
+                       void *data) const override;
+
   void Unmap(void *buffer, void *mapped_ptr) const override;
 
   bool OnHost() const override;
@@ -0,0 +1,171 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/core/runtime/opencl/opencl_command_recorder.h"
+
+#include <algorithm>
+
+#include "mace/core/runtime/opencl/opencl_runtime.h"
+#include "mace/utils/logging.h"
+
+namespace mace {
+
+namespace {
+thread_local OpenCLCommandRecorder *current_recorder = nullptr;
+}  // namespace
+
+OpenCLCommandRecorder::~OpenCLCommandRecorder() {
+  if (recording_) {
+    Stop(false);
+  }
+  Clear();
+}
+
+void OpenCLCommandRecorder::Start(cl_command_queue queue) {
+  MACE_CHECK(current_recorder == nullptr,
+             "the thread already records OpenCL calls");
+  Clear();
+  queue_ = queue;
+  recording_ = true;
+  current_recorder = this;
+}
+
+bool OpenCLCommandRecorder::Stop(bool complete) {
+  MACE_CHECK(recording_ && current_recorder == this);
+  current_recorder = nullptr;
+  recording_ = false;
+  replayable_ = complete && !broken_ && !launched_.empty();
+  set_args_.clear();
+  launched_.clear();
+  if (!replayable_) {
+    Clear();
+  }
+  return replayable_;
+}
+
+void OpenCLCommandRecorder::Clear() {
+  for (cl_kernel kernel : kernels_) {
+    clReleaseKernel(kernel);
+  }
+  kernels_.clear();
+  commands_.clear();
+  set_args_.clear();
+  launched_.clear();
+  broken_ = false;
+  replayable_ = false;
+}
+
+MaceStatus OpenCLCommandRecorder::Replay(OpenCLRuntime *runtime) const {
+  MACE_CHECK(replayable_, "no replayable run is recorded");
+  for (const Command &command : commands_) {
+    cl_int error;
+    if (command.is_launch) {
+      error = clEnqueueNDRangeKernel(
+          queue_, command.kernel, command.work_dim,
+          command.has_offset ? command.offset.data() : nullptr,
+          command.gws.data(),
+          command.has_lws ? command.lws.data() : nullptr,
+          0, nullptr, nullptr);
+      MACE_CL_RET_STATUS(error);
+      runtime->KernelEnqueued();
+    } else {
+      error = clSetKernelArg(
+          command.kernel, command.arg_index, command.arg_size,
+          command.arg_value.empty() ? nullptr : command.arg_value.data());
+      MACE_CL_RET_STATUS(error);
+    }
+  }
+  return MaceStatus::MACE_SUCCESS;
+}
+
+void OpenCLCommandRecorder::Retain(cl_kernel kernel) {
+  if (kernels_.insert(kernel).second) {
+    clRetainKernel(kernel);
+  }
+}
+
+void OpenCLCommandRecorder::OnSetKernelArg(cl_kernel kernel,
+                                           cl_uint arg_index,
+                                           size_t arg_size,
+                                           const void *arg_value) {
+  OpenCLCommandRecorder *recorder = current_recorder;
+  if (recorder == nullptr || recorder->broken_) {
+    return;
+  }
+  // the launches before read the value of the previous run
+  bool newly_set = recorder->set_args_[kernel].insert(arg_index).second;
+  if (newly_set && recorder->launched_.count(kernel) > 0) {
+    recorder->broken_ = true;
+    return;
+  }
+  Command command;
+  command.kernel = kernel;
+  command.is_launch = false;
+  command.arg_index = arg_index;
+  command.arg_size = arg_size;
+  if (arg_value != nullptr) {
+    const unsigned char *bytes =
+        static_cast<const unsigned char *>(arg_value);
+    command.arg_value.assign(bytes, bytes + arg_size);
+  }
+  recorder->Retain(kernel);
+  recorder->commands_.push_back(std::move(command));
+}
+
+void OpenCLCommandRecorder::OnEnqueueNDRangeKernel(
+    cl_command_queue queue,
+    cl_kernel kernel,
+    cl_uint work_dim,
+    const size_t *global_work_offset,
+    const size_t *global_work_size,
+    const size_t *local_work_size) {
+  OpenCLCommandRecorder *recorder = current_recorder;
+  if (recorder == nullptr || recorder->broken_) {
+    return;
+  }
+  if (queue != recorder->queue_ || work_dim == 0 || work_dim > 3) {
+    recorder->broken_ = true;
+    return;
+  }
+  Command command;
+  command.kernel = kernel;
+  command.is_launch = true;
+  command.work_dim = work_dim;
+  command.has_offset = global_work_offset != nullptr;
+  command.has_lws = local_work_size != nullptr;
+  command.offset.fill(0);
+  command.gws.fill(1);
+  command.lws.fill(1);
+  if (command.has_offset) {
+    std::copy(global_work_offset, global_work_offset + work_dim,
+              command.offset.begin());
+  }
+  std::copy(global_work_size, global_work_size + work_dim,
+            command.gws.begin());
+  if (command.has_lws) {
+    std::copy(local_work_size, local_work_size + work_dim,
+              command.lws.begin());
+  }
+  recorder->Retain(kernel);
+  recorder->launched_.insert(kernel);
+  recorder->commands_.push_back(std::move(command));
+}
+
+void OpenCLCommandRecorder::OnUnreplayableCall() {
+  if (current_recorder != nullptr) {
+    current_recorder->broken_ = true;
+  }
+}
+
+}  // namespace mace
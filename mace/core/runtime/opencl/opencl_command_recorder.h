@@ -0,0 +1,106 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_CORE_RUNTIME_OPENCL_OPENCL_COMMAND_RECORDER_H_
+#define MACE_CORE_RUNTIME_OPENCL_OPENCL_COMMAND_RECORDER_H_
+
+#include <array>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "mace/core/runtime/opencl/cl2_header.h"
+#include "mace/public/mace.h"
+#include "mace/utils/utils.h"
+
+namespace mace {
+
+class OpenCLRuntime;
+
+// The kernel launches of a run, with the kernel args set in between, which
+// the next runs of the same shapes replay instead of running the operations,
+// saving their host side: shape inference, tuning lookups, arg setting.
+//
+// The OpenCL wrapper reports the calls of the recording thread. The run can
+// only be replayed if it enqueued its kernels on the recorded queue, made no
+// other command, e.g. a map or a copy whose host side work a replay would
+// skip, created no memory object or kernel, and set no arg of a kernel it
+// had already launched which it did not set before that launch.
+class OpenCLCommandRecorder {
+ public:
+  OpenCLCommandRecorder() = default;
+  ~OpenCLCommandRecorder();
+
+  // record the calls of this thread enqueuing on queue until Stop
+  void Start(cl_command_queue queue);
+  // complete: whether the run enqueued all of its kernels, e.g. it did not
+  // exit early or fail; returns whether the recorded calls can be replayed
+  bool Stop(bool complete);
+  bool replayable() const { return replayable_; }
+  void Clear();
+
+  // set the recorded args and enqueue the recorded launches
+  MaceStatus Replay(OpenCLRuntime *runtime) const;
+
+  // the hooks of the OpenCL wrapper, no-ops unless the calling thread
+  // records
+  static void OnSetKernelArg(cl_kernel kernel,
+                             cl_uint arg_index,
+                             size_t arg_size,
+                             const void *arg_value);
+  static void OnEnqueueNDRangeKernel(cl_command_queue queue,
+                                     cl_kernel kernel,
+                                     cl_uint work_dim,
+                                     const size_t *global_work_offset,
+                                     const size_t *global_work_size,
+                                     const size_t *local_work_size);
+  // a call which a replay can not reproduce
+  static void OnUnreplayableCall();
+
+ private:
+  struct Command {
+    cl_kernel kernel;
+    bool is_launch;
+    // of an arg set, the value is empty for local memory
+    cl_uint arg_index;
+    size_t arg_size;
+    std::vector<unsigned char> arg_value;
+    // of a launch
+    cl_uint work_dim;
+    bool has_offset;
+    bool has_lws;
+    std::array<size_t, 3> offset;
+    std::array<size_t, 3> gws;
+    std::array<size_t, 3> lws;
+  };
+
+  void Retain(cl_kernel kernel);
+
+  cl_command_queue queue_ = nullptr;
+  bool recording_ = false;
+  bool broken_ = false;
+  bool replayable_ = false;
+  std::vector<Command> commands_;
+  // the retained kernels, the args each one set while recording and the
+  // ones launched
+  std::unordered_set<cl_kernel> kernels_;
+  std::unordered_map<cl_kernel, std::unordered_set<cl_uint>> set_args_;
+  std::unordered_set<cl_kernel> launched_;
+
+  MACE_DISABLE_COPY_AND_ASSIGN(OpenCLCommandRecorder);
+};
+
+}  // namespace mace
+
+#endif  // MACE_CORE_RUNTIME_OPENCL_OPENCL_COMMAND_RECORDER_H_
@@ -35,6 +35,37 @@ typedef cl_uint cl_priority_hint;
 #define CL_PRIORITY_HINT_NORMAL_QCOM 0x40CB
 #define CL_PRIORITY_HINT_LOW_QCOM 0x40CC
 
+// cl_khr_priority_hints
+#ifndef CL_QUEUE_PRIORITY_KHR
+typedef cl_uint cl_queue_priority_khr;
+
+#define CL_QUEUE_PRIORITY_KHR 0x1096
+#define CL_QUEUE_PRIORITY_HIGH_KHR (1 << 0)
+#define CL_QUEUE_PRIORITY_MED_KHR (1 << 1)
+#define CL_QUEUE_PRIORITY_LOW_KHR (1 << 2)
+#endif
+
 /* Accepted by clGetKernelWorkGroupInfo */
 #define CL_KERNEL_WAVE_SIZE_QCOM 0xAA02
+
+// cl_khr_egl_image and cl_khr_egl_event, of CL/cl_egl.h which cl2.hpp does
+// not include, loaded by clGetExtensionFunctionAddressForPlatform
+#ifndef __OPENCL_CL_EGL_H
+typedef void *CLeglImageKHR;
+typedef void *CLeglDisplayKHR;
+typedef void *CLeglSyncKHR;
+typedef intptr_t cl_egl_image_properties_khr;
+
+#define CL_EGL_RESOURCE_NOT_ACQUIRED_KHR -1092
+#define CL_INVALID_EGL_OBJECT_KHR -1093
+#endif
+
+typedef cl_mem (*clCreateFromEGLImageKHRFunc)(
+    cl_context, CLeglDisplayKHR, CLeglImageKHR, cl_mem_flags,
+    const cl_egl_image_properties_khr *, cl_int *);
+typedef cl_int (*clEnqueueEGLObjectsKHRFunc)(
+    cl_command_queue, cl_uint, const cl_mem *, cl_uint, const cl_event *,
+    cl_event *);
+typedef cl_event (*clCreateEventFromEGLSyncKHRFunc)(
+    cl_context, CLeglSyncKHR, CLeglDisplayKHR, cl_int *);
 #endif  // MACE_CORE_RUNTIME_OPENCL_OPENCL_EXTENSION_H_
@@ -16,6 +16,7 @@
 
 #include <sys/stat.h>
 
+#include <algorithm>
 #include <cstdlib>
 #include <fstream>
 #include <memory>
@@ -27,6 +28,7 @@
 #include "mace/core/macros.h"
 #include "mace/core/kv_storage.h"
 #include "mace/core/runtime/opencl/opencl_extension.h"
+#include "mace/utils/system_trace.h"
 #include "mace/utils/tuner.h"
 
 namespace mace {
@@ -231,6 +233,23 @@ GPUType ParseGPUType(const std::string &device_name) {
 
 const char *kOpenCLPlatformInfoKey =
     "mace_opencl_precompiled_platform_info_key";
+
+std::string PlatformInfo(const cl::Platform &platform) {
+  std::stringstream ss;
+  ss << platform.getInfo<CL_PLATFORM_NAME>()
+     << ", " << platform.getInfo<CL_PLATFORM_PROFILE>() << ", "
+     << platform.getInfo<CL_PLATFORM_VERSION>() << ", "
+     << MaceVersion();
+  return ss.str();
+}
+
+// Max execution time of a kernel with MACE_LIMIT_OPENCL_KERNEL_TIME set,
+// to prevent the UI from being stuck.
+const uint32_t kDefaultMaxKernelMicros = 1000;
+
+// The driver compiles a program on the calling thread, a few programs are
+// compiled at once to cut the first run latency.
+const size_t kMaxPrebuildThreads = 4;
 }  // namespace
 
 void OpenCLProfilingTimer::StartTiming() {}
@@ -270,7 +289,21 @@ OpenCLRuntime::OpenCLRuntime(
     is_opencl_avaliable_(false),
     is_profiling_enabled_(false),
     opencl_version_(CL_VER_UNKNOWN),
-    gpu_type_(UNKNOWN) {
+    gpu_type_(UNKNOWN),
+    host_unified_memory_(false),
+    active_queue_(0),
+    queue_properties_(0),
+    queue_priority_hint_(GPUPriorityHint::PRIORITY_DEFAULT),
+    next_prebuild_program_(0),
+    flush_interval_(0),
+    max_kernel_micros_(0),
+    kernel_recording_(false),
+    unflushed_kernels_(0),
+    program_build_micros_(0),
+    create_from_egl_image_(nullptr),
+    acquire_egl_objects_(nullptr),
+    release_egl_objects_(nullptr),
+    create_event_from_egl_sync_(nullptr) {
   std::vector<cl::Platform> all_platforms;
   cl::Platform::get(&all_platforms);
   if (all_platforms.size() == 0) {
@@ -278,12 +311,7 @@ OpenCLRuntime::OpenCLRuntime(
     return;
   }
   cl::Platform default_platform = all_platforms[0];
-  std::stringstream ss;
-  ss << default_platform.getInfo<CL_PLATFORM_NAME>()
-     << ", " << default_platform.getInfo<CL_PLATFORM_PROFILE>() << ", "
-     << default_platform.getInfo<CL_PLATFORM_VERSION>() << ", "
-     << MaceVersion();
-  platform_info_ = ss.str();
+  platform_info_ = PlatformInfo(default_platform);
   VLOG(1) << "Using platform: " << platform_info_;
 
   // get default device (CPUs, GPUs) of the default platform
@@ -310,7 +338,15 @@ OpenCLRuntime::OpenCLRuntime(
         return;
       }
 
+      const std::string extensions = device.getInfo<CL_DEVICE_EXTENSIONS>();
+      for (auto &extension : Split(extensions, ' ')) {
+        if (!extension.empty()) {
+          device_extensions_.insert(extension);
+        }
+      }
+
       VLOG(1) << "Using device: " << device_name;
+      VLOG(2) << "Device extensions: " << extensions;
       break;
     }
   }
@@ -326,6 +362,9 @@ OpenCLRuntime::OpenCLRuntime(
       (profiling != nullptr && strlen(profiling) == 1 && profiling[0] == '1')) {
     properties |= CL_QUEUE_PROFILING_ENABLE;
     is_profiling_enabled_ = true;
+  } else if (IsOnlineTuning()) {
+    // only the kernels being tuned are timed
+    properties |= CL_QUEUE_PROFILING_ENABLE;
   }
 
   cl_int err;
@@ -359,15 +398,19 @@ OpenCLRuntime::OpenCLRuntime(
     return;
   }
 
-  command_queue_ = std::make_shared<cl::CommandQueue>(*context_,
-                                                      *device_,
-                                                      properties,
-                                                      &err);
-  if (err != CL_SUCCESS) {
-    LOG(ERROR) << "error: " << OpenCLErrorToString(err);
+  queue_properties_ = properties;
+  // the Adreno context above carries the priority already
+  if (gpu_type_ != GPUType::QUALCOMM_ADRENO ||
+      opencl_version_ != OpenCLVersion::CL_VER_2_0) {
+    queue_priority_hint_ = priority_hint;
+  }
+  if (!CreateCommandQueue()) {
     return;
   }
 
+  // The programs of a stale cache or the precompiled binary are those the
+  // models built before, they are rebuilt in the background
+  std::set<std::string> prebuild_program_keys;
   std::string cached_binary_platform_info;
   if (cache_storage_ != nullptr) {
     if (cache_storage_->Load() != 0) {
@@ -382,6 +425,9 @@ OpenCLRuntime::OpenCLRuntime(
           std::string(platform_info_array->begin(),
                       platform_info_array->end());
       if (cached_binary_platform_info != platform_info_) {
+        for (auto &key : cache_storage_->Keys()) {
+          prebuild_program_keys.insert(key);
+        }
         cache_storage_->Clear();
       }
     }
@@ -405,6 +451,9 @@ OpenCLRuntime::OpenCLRuntime(
             std::string(platform_info_array->begin(),
                         platform_info_array->end());
       }
+      for (auto &key : precompiled_binary_storage_->Keys()) {
+        prebuild_program_keys.insert(key);
+      }
     }
   }
 
@@ -413,6 +462,13 @@ OpenCLRuntime::OpenCLRuntime(
 
   device_->getInfo(CL_DEVICE_MAX_COMPUTE_UNITS,
                    &device_compute_units_);
+
+  cl_bool host_unified_memory = CL_FALSE;
+  if (device_->getInfo(CL_DEVICE_HOST_UNIFIED_MEMORY,
+                       &host_unified_memory) == CL_SUCCESS) {
+    host_unified_memory_ = host_unified_memory == CL_TRUE;
+  }
+  VLOG(1) << "Host unified memory: " << host_unified_memory_;
   const char *out_of_range_check = getenv("MACE_OUT_OF_RANGE_CHECK");
   if (out_of_range_check != nullptr && strlen(out_of_range_check) == 1
       && out_of_range_check[0] == '1') {
@@ -420,15 +476,42 @@ OpenCLRuntime::OpenCLRuntime(
   } else {
     this->out_of_range_check_ = false;
   }
+  const char *flush_interval = getenv("MACE_OPENCL_FLUSH_INTERVAL");
+  if (flush_interval != nullptr) {
+    flush_interval_ = static_cast<uint32_t>(
+        std::max(atoi(flush_interval), 0));
+    VLOG(1) << "Flush OpenCL queue every " << flush_interval_ << " kernels";
+  }
+
+  const char *limit_kernel_time = getenv("MACE_LIMIT_OPENCL_KERNEL_TIME");
+  if (limit_kernel_time != nullptr && strlen(limit_kernel_time) == 1 &&
+      limit_kernel_time[0] == '1') {
+    max_kernel_micros_ = kDefaultMaxKernelMicros;
+  }
 
   is_opencl_avaliable_ = true;
+
+  PrebuildPrograms(prebuild_program_keys);
 }
 
 OpenCLRuntime::~OpenCLRuntime() {
-  command_queue_->finish();
+  {
+    std::lock_guard<std::mutex> lock(program_build_mutex_);
+    next_prebuild_program_ = prebuild_program_keys_.size();
+  }
+  for (auto &worker : prebuild_workers_) {
+    worker.join();
+  }
+  for (auto &queue : command_queues_) {
+    queue->finish();
+  }
+  if (transfer_queue_ != nullptr) {
+    transfer_queue_->finish();
+  }
   built_program_map_.clear();
   // We need to control the destruction order, which has dependencies
-  command_queue_.reset();
+  command_queues_.clear();
+  transfer_queue_.reset();
   context_.reset();
   device_.reset();
 }
@@ -443,7 +526,127 @@ cl::Context &OpenCLRuntime::context() { return *context_; }
 
 cl::Device &OpenCLRuntime::device() { return *device_; }
 
-cl::CommandQueue &OpenCLRuntime::command_queue() { return *command_queue_; }
+cl::CommandQueue &OpenCLRuntime::command_queue() {
+  return *command_queues_[active_queue_];
+}
+
+bool OpenCLRuntime::CreateCommandQueue() {
+  cl_int err;
+  cl_queue_priority_khr priority = 0;
+  switch (queue_priority_hint_) {
+    case GPUPriorityHint::PRIORITY_LOW:
+      priority = CL_QUEUE_PRIORITY_LOW_KHR;
+      break;
+    case GPUPriorityHint::PRIORITY_NORMAL:
+      priority = CL_QUEUE_PRIORITY_MED_KHR;
+      break;
+    case GPUPriorityHint::PRIORITY_HIGH:
+      priority = CL_QUEUE_PRIORITY_HIGH_KHR;
+      break;
+    default:
+      break;
+  }
+  if (priority != 0 && opencl_version_ == OpenCLVersion::CL_VER_2_0 &&
+      IsExtensionSupported("cl_khr_priority_hints")) {
+    const cl_queue_properties queue_properties[] = {
+        CL_QUEUE_PROPERTIES, queue_properties_,
+        CL_QUEUE_PRIORITY_KHR, priority, 0};
+    cl_command_queue queue = clCreateCommandQueueWithProperties(
+        (*context_)(), (*device_)(), queue_properties, &err);
+    if (err == CL_SUCCESS) {
+      command_queues_.push_back(std::make_shared<cl::CommandQueue>(queue));
+      return true;
+    }
+    LOG(WARNING) << "Create command queue with priority failed: "
+                 << OpenCLErrorToString(err);
+  }
+  auto queue = std::make_shared<cl::CommandQueue>(*context_,
+                                                  *device_,
+                                                  queue_properties_,
+                                                  &err);
+  if (err != CL_SUCCESS) {
+    LOG(ERROR) << "error: " << OpenCLErrorToString(err);
+    return false;
+  }
+  command_queues_.push_back(queue);
+  return true;
+}
+
+MaceStatus OpenCLRuntime::SetCommandQueueCount(size_t count) {
+  MACE_CHECK(count > 0, "There must be a command queue");
+  while (command_queues_.size() < count) {
+    if (!CreateCommandQueue()) {
+      return MaceStatus::MACE_OUT_OF_RESOURCES;
+    }
+  }
+  command_queues_.resize(count);
+  active_queue_ = 0;
+  VLOG(1) << "Use " << count << " OpenCL command queues";
+  return MaceStatus::MACE_SUCCESS;
+}
+
+size_t OpenCLRuntime::command_queue_count() const {
+  return command_queues_.size();
+}
+
+void OpenCLRuntime::SetActiveCommandQueue(size_t index) {
+  MACE_CHECK(index < command_queues_.size(), "Invalid command queue ", index);
+  active_queue_ = index;
+}
+
+MaceStatus OpenCLRuntime::EnqueueMarker(cl::Event *event) {
+  cl_int error = command_queue().enqueueMarkerWithWaitList(nullptr, event);
+  MACE_CL_RET_STATUS(error);
+  error = command_queue().flush();
+  MACE_CL_RET_STATUS(error);
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus OpenCLRuntime::EnqueueBarrier(const std::vector<cl::Event> &events) {
+  cl_int error = command_queue().enqueueBarrierWithWaitList(&events);
+  MACE_CL_RET_STATUS(error);
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus OpenCLRuntime::ForkCommandQueues() {
+  if (command_queues_.size() < 2) {
+    return MaceStatus::MACE_SUCCESS;
+  }
+  std::vector<cl::Event> events(1);
+  active_queue_ = 0;
+  MACE_RETURN_IF_ERROR(EnqueueMarker(&events[0]));
+  for (active_queue_ = 1; active_queue_ < command_queues_.size();
+       ++active_queue_) {
+    MACE_RETURN_IF_ERROR(EnqueueBarrier(events));
+  }
+  active_queue_ = 0;
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus OpenCLRuntime::JoinCommandQueues() {
+  if (command_queues_.size() < 2) {
+    active_queue_ = 0;
+    return MaceStatus::MACE_SUCCESS;
+  }
+  std::vector<cl::Event> events(command_queues_.size() - 1);
+  for (active_queue_ = 1; active_queue_ < command_queues_.size();
+       ++active_queue_) {
+    MACE_RETURN_IF_ERROR(EnqueueMarker(&events[active_queue_ - 1]));
+  }
+  active_queue_ = 0;
+  return EnqueueBarrier(events);
+}
+
+cl::CommandQueue *OpenCLRuntime::transfer_command_queue() {
+  if (transfer_queue_ == nullptr) {
+    if (!CreateCommandQueue()) {
+      return nullptr;
+    }
+    transfer_queue_ = command_queues_.back();
+    command_queues_.pop_back();
+  }
+  return transfer_queue_.get();
+}
 
 Tuner<uint32_t> *OpenCLRuntime::tuner() { return tuner_.get(); }
 
@@ -525,11 +728,9 @@ bool OpenCLRuntime::BuildProgramFromSource(
     const std::string &build_options_str,
     cl::Program *program) {
   // Find from source
-  auto it_source = kEncryptedProgramMap.find(program_name);
-  if (it_source != kEncryptedProgramMap.end()) {
+  std::string kernel_source;
+  if (GetProgramSource(program_name, &kernel_source)) {
     cl::Program::Sources sources;
-    std::string source(it_source->second.begin(), it_source->second.end());
-    std::string kernel_source = ObfuscateString(source);
     sources.push_back(kernel_source);
     *program = cl::Program(context(), sources);
     cl_int ret = program->build({device()}, build_options_str.c_str());
@@ -590,11 +791,43 @@ bool OpenCLRuntime::BuildProgramFromSource(
   return true;
 }
 
+const std::string &OpenCLRuntime::DecryptedProgramSource(
+    const std::string &program_name) {
+  auto it_decrypted = decrypted_program_sources_.find(program_name);
+  if (it_decrypted == decrypted_program_sources_.end()) {
+    const std::vector<unsigned char> &encrypted =
+        kEncryptedProgramMap.at(program_name);
+    std::string source(encrypted.begin(), encrypted.end());
+    ObfuscateBytes(source.data(), source.size(), &source[0]);
+    it_decrypted = decrypted_program_sources_.emplace(
+        program_name, std::move(source)).first;
+  }
+  return it_decrypted->second;
+}
+
+bool OpenCLRuntime::GetProgramSource(const std::string &program_name,
+                                     std::string *source) {
+  std::lock_guard<std::mutex> lock(program_build_mutex_);
+  if (kEncryptedProgramMap.count(program_name) > 0) {
+    *source = DecryptedProgramSource(program_name);
+    return true;
+  }
+  auto it_generated = generated_program_sources_.find(program_name);
+  if (it_generated != generated_program_sources_.end()) {
+    *source = DecryptedProgramSource(it_generated->second.first) +
+        it_generated->second.second;
+    return true;
+  }
+  return false;
+}
+
 bool OpenCLRuntime::BuildProgram(const std::string &program_name,
                                  const std::string &built_program_key,
                                  const std::string &build_options,
                                  cl::Program *program) {
   MACE_CHECK_NOTNULL(program);
+  MACE_SYSTEM_TRACE("OpenCL build ", program_name);
+  const int64_t start_micros = NowMicros();
 
   std::string build_options_str =
       build_options + " -Werror -cl-mad-enable -cl-fast-relaxed-math";
@@ -609,6 +842,7 @@ bool OpenCLRuntime::BuildProgram(const std::string &program_name,
                                    build_options_str, program);
     }
   }
+  program_build_micros_ += NowMicros() - start_micros;
   return ret;
 }
 
@@ -623,14 +857,22 @@ MaceStatus OpenCLRuntime::BuildKernel(
   }
   std::string built_program_key = program_name + build_options_str;
 
-  std::lock_guard<std::mutex> lock(program_build_mutex_);
+  std::unique_lock<std::mutex> lock(program_build_mutex_);
+  program_built_cond_.wait(lock, [&] {
+    return building_programs_.count(built_program_key) == 0;
+  });
   auto built_program_it = built_program_map_.find(built_program_key);
   cl::Program program;
   if (built_program_it != built_program_map_.end()) {
     program = built_program_it->second;
   } else {
+    building_programs_.insert(built_program_key);
+    lock.unlock();
     bool ret = this->BuildProgram(program_name, built_program_key,
                                   build_options_str, &program);
+    lock.lock();
+    building_programs_.erase(built_program_key);
+    program_built_cond_.notify_all();
     if (!ret) {
       return MaceStatus::MACE_OUT_OF_RESOURCES;
     }
@@ -642,6 +884,74 @@ MaceStatus OpenCLRuntime::BuildKernel(
   return MaceStatus::MACE_SUCCESS;
 }
 
+MaceStatus OpenCLRuntime::BuildKernelFromSource(
+    const std::string &program_name,
+    const std::string &base_program,
+    const std::string &source,
+    const std::string &kernel_name,
+    const std::set<std::string> &build_options,
+    cl::Kernel *kernel) {
+  {
+    std::lock_guard<std::mutex> lock(program_build_mutex_);
+    if (generated_program_sources_.count(program_name) == 0) {
+      MACE_CHECK(kEncryptedProgramMap.count(base_program) > 0,
+                 "no OpenCL program ", base_program);
+      generated_program_sources_.emplace(
+          program_name, std::make_pair(base_program, source));
+    }
+  }
+  return BuildKernel(program_name, kernel_name, build_options, kernel);
+}
+
+void OpenCLRuntime::PrebuildPrograms(
+    const std::set<std::string> &built_program_keys) {
+  for (auto &key : built_program_keys) {
+    // the key is the program name followed by the build options
+    const std::string program_name = key.substr(0, key.find(' '));
+    if (kEncryptedProgramMap.count(program_name) > 0) {
+      prebuild_program_keys_.push_back(key);
+    }
+  }
+  const size_t thread_count =
+      std::min(kMaxPrebuildThreads, prebuild_program_keys_.size());
+  VLOG(1) << "Prebuild " << prebuild_program_keys_.size()
+          << " OpenCL programs with " << thread_count << " threads";
+  for (size_t i = 0; i < thread_count; ++i) {
+    prebuild_workers_.emplace_back(&OpenCLRuntime::PrebuildLoop, this);
+  }
+}
+
+void OpenCLRuntime::PrebuildLoop() {
+  std::unique_lock<std::mutex> lock(program_build_mutex_);
+  while (next_prebuild_program_ < prebuild_program_keys_.size()) {
+    const std::string key = prebuild_program_keys_[next_prebuild_program_++];
+    if (built_program_map_.count(key) > 0 ||
+        building_programs_.count(key) > 0) {
+      continue;
+    }
+    building_programs_.insert(key);
+    lock.unlock();
+    const size_t pos = key.find(' ');
+    const std::string build_options =
+        pos == std::string::npos ? "" : key.substr(pos);
+    cl::Program program;
+    bool ret = BuildProgram(key.substr(0, pos), key, build_options, &program);
+    lock.lock();
+    if (ret) {
+      built_program_map_.emplace(key, program);
+    }
+    building_programs_.erase(key);
+    program_built_cond_.notify_all();
+  }
+}
+
+void OpenCLRuntime::ReleasePrograms() {
+  std::lock_guard<std::mutex> lock(program_build_mutex_);
+  VLOG(1) << "Release " << built_program_map_.size() << " OpenCL programs";
+  built_program_map_.clear();
+  decrypted_program_sources_.clear();
+}
+
 void OpenCLRuntime::SaveBuiltCLProgram() {
   if (cache_storage_ != nullptr) {
     if (cache_storage_->Flush() != 0) {
@@ -661,6 +971,66 @@ void OpenCLRuntime::GetCallStats(const cl::Event &event, CallStats *stats) {
   }
 }
 
+void OpenCLRuntime::StartKernelRecording() {
+  kernel_recording_ = is_profiling_enabled_;
+  kernel_records_.clear();
+}
+
+std::vector<OpenCLKernelRecord> OpenCLRuntime::StopKernelRecording() {
+  kernel_recording_ = false;
+  std::vector<OpenCLKernelRecord> records;
+  records.swap(kernel_records_);
+  return records;
+}
+
+bool OpenCLRuntime::is_kernel_recording() const {
+  return kernel_recording_;
+}
+
+void OpenCLRuntime::RecordKernel(const cl::Kernel &kernel,
+                                 const uint32_t *gws,
+                                 const uint32_t *lws,
+                                 size_t dims,
+                                 const cl::Event &event) {
+  if (!kernel_recording_) {
+    return;
+  }
+  OpenCLKernelRecord record;
+  record.kernel_name = kernel.getInfo<CL_KERNEL_FUNCTION_NAME>();
+  // some drivers count the terminating null in the name
+  record.kernel_name.erase(
+      std::find(record.kernel_name.begin(), record.kernel_name.end(), '\0'),
+      record.kernel_name.end());
+  record.gws.assign(gws, gws + dims);
+  if (lws != nullptr) {
+    record.lws.assign(lws, lws + dims);
+  }
+  record.event = event;
+  kernel_records_.push_back(record);
+}
+
+void OpenCLRuntime::GetKernelStats(
+    const std::vector<OpenCLKernelRecord> &records,
+    std::vector<KernelStats> *stats) {
+  MACE_CHECK_NOTNULL(stats);
+  for (auto &record : records) {
+    record.event.wait();
+    KernelStats kernel_stats;
+    kernel_stats.kernel_name = record.kernel_name;
+    kernel_stats.gws = record.gws;
+    kernel_stats.lws = record.lws;
+    kernel_stats.queued_micros =
+        record.event.getProfilingInfo<CL_PROFILING_COMMAND_QUEUED>() / 1000;
+    kernel_stats.submit_micros =
+        record.event.getProfilingInfo<CL_PROFILING_COMMAND_SUBMIT>() / 1000;
+    kernel_stats.start_micros =
+        record.event.getProfilingInfo<CL_PROFILING_COMMAND_START>() / 1000;
+    kernel_stats.end_micros =
+        record.event.getProfilingInfo<CL_PROFILING_COMMAND_END>() / 1000;
+    stats->push_back(kernel_stats);
+  }
+}
+
 uint64_t OpenCLRuntime::GetDeviceMaxWorkGroupSize() {
   uint64_t size = 0;
   cl_int err = device_->getInfo(CL_DEVICE_MAX_WORK_GROUP_SIZE, &size);
@@ -732,6 +1102,103 @@ bool OpenCLRuntime::IsNonUniformWorkgroupsSupported() const {
       opencl_version_ == OpenCLVersion::CL_VER_2_0);
 }
 
+bool OpenCLRuntime::IsHostUnifiedMemory() const {
+  return host_unified_memory_;
+}
+
+bool OpenCLRuntime::IsExtensionSupported(const std::string &extension) const {
+  return device_extensions_.count(extension) > 0;
+}
+
+bool OpenCLRuntime::LoadEGLFunctions() {
+  std::call_once(egl_functions_once_, [this]() {
+    if (!IsExtensionSupported("cl_khr_egl_image")) {
+      return;
+    }
+    cl_platform_id platform = device_->getInfo<CL_DEVICE_PLATFORM>();
+    create_from_egl_image_ = reinterpret_cast<clCreateFromEGLImageKHRFunc>(
+        clGetExtensionFunctionAddressForPlatform(platform,
+                                                 "clCreateFromEGLImageKHR"));
+    acquire_egl_objects_ = reinterpret_cast<clEnqueueEGLObjectsKHRFunc>(
+        clGetExtensionFunctionAddressForPlatform(
+            platform, "clEnqueueAcquireEGLObjectsKHR"));
+    release_egl_objects_ = reinterpret_cast<clEnqueueEGLObjectsKHRFunc>(
+        clGetExtensionFunctionAddressForPlatform(
+            platform, "clEnqueueReleaseEGLObjectsKHR"));
+    if (IsExtensionSupported("cl_khr_egl_event")) {
+      create_event_from_egl_sync_ =
+          reinterpret_cast<clCreateEventFromEGLSyncKHRFunc>(
+              clGetExtensionFunctionAddressForPlatform(
+                  platform, "clCreateEventFromEGLSyncKHR"));
+    }
+  });
+  return create_from_egl_image_ != nullptr &&
+      acquire_egl_objects_ != nullptr && release_egl_objects_ != nullptr;
+}
+
+MaceStatus OpenCLRuntime::CreateImageFromEGLImage(void *egl_display,
+                                                  void *egl_image,
+                                                  cl_mem *image) {
+  MACE_CHECK_NOTNULL(image);
+  if (!LoadEGLFunctions()) {
+    LOG(WARNING) << "cl_khr_egl_image is not supported by the device";
+    return MaceStatus::MACE_INVALID_ARGS;
+  }
+  cl_int error = CL_SUCCESS;
+  *image = create_from_egl_image_(context()(), egl_display, egl_image,
+                                  CL_MEM_READ_WRITE, nullptr, &error);
+  if (error != CL_SUCCESS) {
+    LOG(WARNING) << "Create OpenCL image from EGL image failed because of "
+                 << OpenCLErrorToString(error);
+    *image = nullptr;
+    return MaceStatus::MACE_INVALID_ARGS;
+  }
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus OpenCLRuntime::AcquireEGLObjects(const std::vector<cl_mem> &images,
+                                            void *egl_display,
+                                            void *egl_sync) {
+  if (images.empty()) {
+    return MaceStatus::MACE_SUCCESS;
+  }
+  MACE_CHECK(LoadEGLFunctions(), "cl_khr_egl_image is not supported");
+  cl_event sync_event = nullptr;
+  if (egl_sync != nullptr) {
+    if (create_event_from_egl_sync_ == nullptr) {
+      LOG(WARNING) << "cl_khr_egl_event is not supported by the device, "
+                      "finish the GL commands before the run";
+      return MaceStatus::MACE_INVALID_ARGS;
+    }
+    cl_int error = CL_SUCCESS;
+    sync_event = create_event_from_egl_sync_(context()(), egl_sync,
+                                             egl_display, &error);
+    MACE_CL_RET_STATUS(error);
+  }
+  cl_int error = acquire_egl_objects_(
+      command_queue()(), static_cast<cl_uint>(images.size()), images.data(),
+      sync_event == nullptr ? 0 : 1,
+      sync_event == nullptr ? nullptr : &sync_event, nullptr);
+  if (sync_event != nullptr) {
+    clReleaseEvent(sync_event);
+  }
+  MACE_CL_RET_STATUS(error);
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus OpenCLRuntime::ReleaseEGLObjects(
+    const std::vector<cl_mem> &images) {
+  if (images.empty()) {
+    return MaceStatus::MACE_SUCCESS;
+  }
+  MACE_CHECK(LoadEGLFunctions(), "cl_khr_egl_image is not supported");
+  cl_int error = release_egl_objects_(
+      command_queue()(), static_cast<cl_uint>(images.size()), images.data(),
+      0, nullptr, nullptr);
+  MACE_CL_RET_STATUS(error);
+  return MaceStatus::MACE_SUCCESS;
+}
+
 GPUType OpenCLRuntime::gpu_type() const {
   return gpu_type_;
 }
@@ -740,6 +1207,15 @@ const std::string OpenCLRuntime::platform_info() const {
   return platform_info_;
 }
 
+std::string OpenCLRuntime::DefaultPlatformInfo() {
+  std::vector<cl::Platform> all_platforms;
+  cl::Platform::get(&all_platforms);
+  if (all_platforms.empty()) {
+    return "";
+  }
+  return PlatformInfo(all_platforms[0]);
+}
+
 OpenCLVersion OpenCLRuntime::ParseDeviceVersion(
     const std::string &device_version) {
   // OpenCL Device version string format:
@@ -768,4 +1244,30 @@ bool OpenCLRuntime::is_profiling_enabled() const {
   return is_profiling_enabled_;
 }
 
+bool OpenCLRuntime::IsQueueBatching() const {
+  return flush_interval_ > 0;
+}
+
+void OpenCLRuntime::SetMaxKernelMicros(uint32_t max_micros) {
+  max_kernel_micros_ = max_micros;
+}
+
+uint32_t OpenCLRuntime::max_kernel_micros() const {
+  return max_kernel_micros_;
+}
+
+int64_t OpenCLRuntime::program_build_micros() const {
+  return program_build_micros_;
+}
+
+void OpenCLRuntime::KernelEnqueued() {
+  if (flush_interval_ == 0) {
+    return;
+  }
+  if (++unflushed_kernels_ >= flush_interval_) {
+    unflushed_kernels_ = 0;
+    command_queue().flush();
+  }
+}
+
 }  // namespace mace
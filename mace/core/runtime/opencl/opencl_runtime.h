@@ -15,16 +15,21 @@
 #ifndef MACE_CORE_RUNTIME_OPENCL_OPENCL_RUNTIME_H_
 #define MACE_CORE_RUNTIME_OPENCL_OPENCL_RUNTIME_H_
 
+#include <atomic>  // NOLINT(build/c++11)
+#include <condition_variable>  // NOLINT(build/c++11)
 #include <map>
 #include <memory>
 #include <mutex>  // NOLINT(build/c++11)
 #include <set>
 #include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <utility>
 #include <vector>
 
 #include "mace/core/kv_storage.h"
 #include "mace/core/future.h"
 #include "mace/core/runtime/opencl/cl2_header.h"
+#include "mace/core/runtime/opencl/opencl_extension.h"
 #include "mace/core/runtime/opencl/scratch_image.h"
 #include "mace/proto/mace.pb.h"
 #include "mace/utils/string_util.h"
@@ -63,6 +68,14 @@ const std::string OpenCLErrorToString(cl_int error);
     return MaceStatus::MACE_OUT_OF_RESOURCES;               \
   }
 
+// A kernel enqueued while the runtime records kernels.
+struct OpenCLKernelRecord {
+  std::string kernel_name;
+  std::vector<uint32_t> gws;
+  std::vector<uint32_t> lws;
+  cl::Event event;
+};
+
 class OpenCLRuntime {
  public:
   OpenCLRuntime(
@@ -77,15 +90,54 @@ class OpenCLRuntime {
 
   cl::Context &context();
   cl::Device &device();
+  // The queue commands are enqueued to, see SetActiveCommandQueue.
   cl::CommandQueue &command_queue();
+  // Several in-order queues let independent branches of a net run at the
+  // same time: the first queue is created with the runtime, this adds the
+  // others with the same properties and priority.
+  MaceStatus SetCommandQueueCount(size_t count);
+  size_t command_queue_count() const;
+  // Enqueue the following commands to the queue of index, 0 by default.
+  void SetActiveCommandQueue(size_t index);
+  // Enqueue to the active queue a marker completed with the commands before
+  // it, and flush the queue so that the other queues can wait for it.
+  MaceStatus EnqueueMarker(cl::Event *event);
+  // Make the following commands of the active queue wait for the events.
+  MaceStatus EnqueueBarrier(const std::vector<cl::Event> &events);
+  // Make the other queues wait for the commands of the first one, e.g. the
+  // writes of the inputs.
+  MaceStatus ForkCommandQueues();
+  // Make the first queue wait for the commands of the others and activate
+  // it, so that the outputs are read after the whole net.
+  MaceStatus JoinCommandQueues();
+  // A queue of its own for the host transfers, so that the upload and the
+  // readback of the frames overlap the kernels; created on the first call,
+  // null if it could not be.
+  cl::CommandQueue *transfer_command_queue();
   GPUType gpu_type() const;
   const std::string platform_info() const;
+  // The platform info of the default platform, which the precompiled
+  // programs are built for, empty if there is no OpenCL platform.
+  static std::string DefaultPlatformInfo();
   uint64_t device_global_mem_cache_size() const;
   uint32_t device_compute_units() const;
   Tuner<uint32_t> *tuner();
   bool is_opencl_avaliable();
 
   void GetCallStats(const cl::Event &event, CallStats *stats);
+  // Record the kernels enqueued until StopKernelRecording, which returns
+  // them. Nothing is recorded without a profiling queue.
+  void StartKernelRecording();
+  std::vector<OpenCLKernelRecord> StopKernelRecording();
+  bool is_kernel_recording() const;
+  void RecordKernel(const cl::Kernel &kernel,
+                    const uint32_t *gws,
+                    const uint32_t *lws,
+                    size_t dims,
+                    const cl::Event &event);
+  // Wait for the recorded kernels and read their profiling info.
+  void GetKernelStats(const std::vector<OpenCLKernelRecord> &records,
+                      std::vector<KernelStats> *stats);
   uint64_t GetDeviceMaxWorkGroupSize();
   uint64_t GetDeviceMaxMemAllocSize();
   bool IsImageSupport();
@@ -93,16 +145,62 @@ class OpenCLRuntime {
   uint64_t GetKernelMaxWorkGroupSize(const cl::Kernel &kernel);
   uint64_t GetKernelWaveSize(const cl::Kernel &kernel);
   bool IsNonUniformWorkgroupsSupported() const;
+  // Whether the GPU shares the memory of the host, so that mapping a buffer
+  // allocated with CL_MEM_ALLOC_HOST_PTR copies nothing.
+  bool IsHostUnifiedMemory() const;
+  // Whether the device reports the extension, e.g. "cl_khr_subgroups".
+  bool IsExtensionSupported(const std::string &extension) const;
   bool IsOutOfRangeCheckEnabled() const;
   bool is_profiling_enabled() const;
+  // An OpenCL image sharing an EGLImage, e.g. of a GL texture, by
+  // cl_khr_egl_image. The commands using it are enqueued between
+  // AcquireEGLObjects and ReleaseEGLObjects.
+  MaceStatus CreateImageFromEGLImage(void *egl_display,
+                                     void *egl_image,
+                                     cl_mem *image);
+  // Acquire the images for the active queue after the GL commands before
+  // egl_sync, by cl_khr_egl_event; without egl_sync, the GL commands must
+  // have been finished.
+  MaceStatus AcquireEGLObjects(const std::vector<cl_mem> &images,
+                               void *egl_display,
+                               void *egl_sync);
+  MaceStatus ReleaseEGLObjects(const std::vector<cl_mem> &images);
+  // Whether kernels are batched: the queue is flushed every flush interval
+  // kernels and a run synchronizes once on its outputs instead of with a
+  // separate finish.
+  bool IsQueueBatching() const;
+  // Count an enqueued kernel and flush the queue once the interval is full.
+  void KernelEnqueued();
+  // Kernels are split into enqueues that each run at most about max_micros,
+  // as measured by tuning, with a flush in between so that the GPU can be
+  // preempted. 0 for no limit.
+  void SetMaxKernelMicros(uint32_t max_micros);
+  uint32_t max_kernel_micros() const;
+  // Time spent building programs, summed over the building threads.
+  int64_t program_build_micros() const;
 
   MaceStatus BuildKernel(const std::string &program_name,
                          const std::string &kernel_name,
                          const std::set<std::string> &build_options,
                          cl::Kernel *kernel);
+  // Build a kernel of a program generated at run time: its source follows
+  // the source of base_program, a program of the cl directory which brings
+  // the common header. The program is cached like the others by its name,
+  // which should identify the source.
+  MaceStatus BuildKernelFromSource(const std::string &program_name,
+                                   const std::string &base_program,
+                                   const std::string &source,
+                                   const std::string &kernel_name,
+                                   const std::set<std::string> &build_options,
+                                   cl::Kernel *kernel);
 
   void SaveBuiltCLProgram();
 
+  // Drop the built programs: those of the kernels still held are freed
+  // with their kernels, the next kernels build them again, from the
+  // compiled binaries when they are cached.
+  void ReleasePrograms();
+
  private:
   bool BuildProgram(const std::string &program_file_name,
                     const std::string &binary_file_name,
@@ -121,7 +219,21 @@ class OpenCLRuntime {
       const std::string &built_program_key,
       const std::string &build_options_str,
       cl::Program *program);
+  // The source of a program of the cl directory or generated at run time.
+  // Only the programs built from source are decrypted, once each.
+  bool GetProgramSource(const std::string &program_name,
+                        std::string *source);
+  // Needs program_build_mutex_ held.
+  const std::string &DecryptedProgramSource(const std::string &program_name);
   OpenCLVersion ParseDeviceVersion(const std::string &device_version);
+  // Create a queue of queue_properties_ and queue_priority_hint_.
+  bool CreateCommandQueue();
+  // Build the programs of built_program_keys on background threads, so that
+  // the first run does not compile them one by one.
+  void PrebuildPrograms(const std::set<std::string> &built_program_keys);
+  void PrebuildLoop();
+  // Load the functions of cl_khr_egl_image, false if it is not supported.
+  bool LoadEGLFunctions();
 
  private:
   std::shared_ptr<KVStorage> cache_storage_;
@@ -131,18 +243,47 @@ class OpenCLRuntime {
   bool is_profiling_enabled_;
   OpenCLVersion opencl_version_;
   GPUType gpu_type_;
+  bool host_unified_memory_;
+  std::set<std::string> device_extensions_;
   // All OpenCL object must be a pointer and manually deleted before unloading
   // OpenCL library.
   std::shared_ptr<cl::Context> context_;
   std::shared_ptr<cl::Device> device_;
-  std::shared_ptr<cl::CommandQueue> command_queue_;
+  std::vector<std::shared_ptr<cl::CommandQueue>> command_queues_;
+  size_t active_queue_;
+  std::shared_ptr<cl::CommandQueue> transfer_queue_;
+  cl_command_queue_properties queue_properties_;
+  GPUPriorityHint queue_priority_hint_;
   std::map<std::string, cl::Program> built_program_map_;
   std::mutex program_build_mutex_;
+  // Programs being built, BuildKernel waits for them on program_built_cond_
+  std::set<std::string> building_programs_;
+  std::condition_variable program_built_cond_;
+  // The base program and the appended source of the programs generated at
+  // run time, by program name
+  std::map<std::string, std::pair<std::string, std::string>>
+      generated_program_sources_;
+  // The embedded programs decrypted for a build from source, by name
+  std::map<std::string, std::string> decrypted_program_sources_;
+  std::vector<std::string> prebuild_program_keys_;
+  size_t next_prebuild_program_;
+  std::vector<std::thread> prebuild_workers_;
   std::string platform_info_;
   std::string precompiled_binary_platform_info_;
   bool out_of_range_check_;
+  uint32_t flush_interval_;
+  uint32_t max_kernel_micros_;
+  bool kernel_recording_;
+  std::vector<OpenCLKernelRecord> kernel_records_;
+  std::atomic<uint32_t> unflushed_kernels_;
+  std::atomic<int64_t> program_build_micros_;
   uint64_t device_global_mem_cache_size_;
   uint32_t device_compute_units_;
+  std::once_flag egl_functions_once_;
+  clCreateFromEGLImageKHRFunc create_from_egl_image_;
+  clEnqueueEGLObjectsKHRFunc acquire_egl_objects_;
+  clEnqueueEGLObjectsKHRFunc release_egl_objects_;
+  clCreateEventFromEGLSyncKHRFunc create_event_from_egl_sync_;
 };
 
 class OpenCLProfilingTimer : public Timer {
@@ -17,6 +17,7 @@
 #include <string>
 #include <vector>
 
+#include "mace/core/runtime/opencl/opencl_command_recorder.h"
 #include "mace/utils/logging.h"
 
 /**
@@ -39,6 +40,8 @@ class OpenCLLibrary final {
   using clGetPlatformIDsFunc = cl_int (*)(cl_uint, cl_platform_id *, cl_uint *);
   using clGetPlatformInfoFunc =
       cl_int (*)(cl_platform_id, cl_platform_info, size_t, void *, size_t *);
+  using clGetExtensionFunctionAddressForPlatformFunc =
+      void *(*)(cl_platform_id, const char *);
   using clBuildProgramFunc = cl_int (*)(cl_program,
                                         cl_uint,
                                         const cl_device_id *,
@@ -63,6 +66,10 @@ class OpenCLLibrary final {
   using clEnqueueUnmapMemObjectFunc = cl_int (*)(
       cl_command_queue, cl_mem, void *, cl_uint, const cl_event *, cl_event *);
   using clRetainCommandQueueFunc = cl_int (*)(cl_command_queue command_queue);
+  using clEnqueueMarkerWithWaitListFunc = cl_int (*)(
+      cl_command_queue, cl_uint, const cl_event *, cl_event *);
+  using clEnqueueBarrierWithWaitListFunc = cl_int (*)(
+      cl_command_queue, cl_uint, const cl_event *, cl_event *);
   using clCreateContextFunc =
       cl_context (*)(const cl_context_properties *,
                      cl_uint,
@@ -99,6 +106,37 @@ class OpenCLLibrary final {
                                              cl_uint,
                                              const cl_event *,
                                              cl_event *);
+  using clEnqueueCopyBufferFunc = cl_int (*)(cl_command_queue,
+                                             cl_mem,
+                                             cl_mem,
+                                             size_t,
+                                             size_t,
+                                             size_t,
+                                             cl_uint,
+                                             const cl_event *,
+                                             cl_event *);
+  using clEnqueueReadImageFunc = cl_int (*)(cl_command_queue,
+                                            cl_mem,
+                                            cl_bool,
+                                            const size_t *,
+                                            const size_t *,
+                                            size_t,
+                                            size_t,
+                                            void *,
+                                            cl_uint,
+                                            const cl_event *,
+                                            cl_event *);
+  using clEnqueueWriteImageFunc = cl_int (*)(cl_command_queue,
+                                             cl_mem,
+                                             cl_bool,
+                                             const size_t *,
+                                             const size_t *,
+                                             size_t,
+                                             size_t,
+                                             const void *,
+                                             cl_uint,
+                                             const cl_event *,
+                                             cl_event *);
   using clGetProgramBuildInfoFunc = cl_int (*)(cl_program,
                                                cl_device_id,
                                                cl_program_build_info,
@@ -199,6 +237,7 @@ class OpenCLLibrary final {
 
   MACE_CL_DEFINE_FUNC_PTR(clGetPlatformIDs);
   MACE_CL_DEFINE_FUNC_PTR(clGetPlatformInfo);
+  MACE_CL_DEFINE_FUNC_PTR(clGetExtensionFunctionAddressForPlatform);
   MACE_CL_DEFINE_FUNC_PTR(clBuildProgram);
   MACE_CL_DEFINE_FUNC_PTR(clEnqueueNDRangeKernel);
   MACE_CL_DEFINE_FUNC_PTR(clSetKernelArg);
@@ -225,6 +264,9 @@ class OpenCLLibrary final {
   MACE_CL_DEFINE_FUNC_PTR(clGetProgramBuildInfo);
   MACE_CL_DEFINE_FUNC_PTR(clEnqueueReadBuffer);
   MACE_CL_DEFINE_FUNC_PTR(clEnqueueWriteBuffer);
+  MACE_CL_DEFINE_FUNC_PTR(clEnqueueCopyBuffer);
+  MACE_CL_DEFINE_FUNC_PTR(clEnqueueReadImage);
+  MACE_CL_DEFINE_FUNC_PTR(clEnqueueWriteImage);
   MACE_CL_DEFINE_FUNC_PTR(clWaitForEvents);
   MACE_CL_DEFINE_FUNC_PTR(clReleaseEvent);
   MACE_CL_DEFINE_FUNC_PTR(clCreateContext);
@@ -232,6 +274,8 @@ class OpenCLLibrary final {
   MACE_CL_DEFINE_FUNC_PTR(clReleaseContext);
   MACE_CL_DEFINE_FUNC_PTR(clRetainCommandQueue);
   MACE_CL_DEFINE_FUNC_PTR(clEnqueueUnmapMemObject);
+  MACE_CL_DEFINE_FUNC_PTR(clEnqueueMarkerWithWaitList);
+  MACE_CL_DEFINE_FUNC_PTR(clEnqueueBarrierWithWaitList);
   MACE_CL_DEFINE_FUNC_PTR(clRetainMemObject);
   MACE_CL_DEFINE_FUNC_PTR(clReleaseMemObject);
   MACE_CL_DEFINE_FUNC_PTR(clGetDeviceInfo);
@@ -333,6 +377,7 @@ void *OpenCLLibrary::LoadFromPath(const std::string &path) {
 
   MACE_CL_ASSIGN_FROM_DLSYM(clGetPlatformIDs);
   MACE_CL_ASSIGN_FROM_DLSYM(clGetPlatformInfo);
+  MACE_CL_ASSIGN_FROM_DLSYM(clGetExtensionFunctionAddressForPlatform);
   MACE_CL_ASSIGN_FROM_DLSYM(clBuildProgram);
   MACE_CL_ASSIGN_FROM_DLSYM(clEnqueueNDRangeKernel);
   MACE_CL_ASSIGN_FROM_DLSYM(clSetKernelArg);
@@ -359,6 +404,9 @@ void *OpenCLLibrary::LoadFromPath(const std::string &path) {
   MACE_CL_ASSIGN_FROM_DLSYM(clGetProgramBuildInfo);
   MACE_CL_ASSIGN_FROM_DLSYM(clEnqueueReadBuffer);
   MACE_CL_ASSIGN_FROM_DLSYM(clEnqueueWriteBuffer);
+  MACE_CL_ASSIGN_FROM_DLSYM(clEnqueueCopyBuffer);
+  MACE_CL_ASSIGN_FROM_DLSYM(clEnqueueReadImage);
+  MACE_CL_ASSIGN_FROM_DLSYM(clEnqueueWriteImage);
   MACE_CL_ASSIGN_FROM_DLSYM(clWaitForEvents);
   MACE_CL_ASSIGN_FROM_DLSYM(clReleaseEvent);
   MACE_CL_ASSIGN_FROM_DLSYM(clCreateContext);
@@ -366,6 +414,8 @@ void *OpenCLLibrary::LoadFromPath(const std::string &path) {
   MACE_CL_ASSIGN_FROM_DLSYM(clReleaseContext);
   MACE_CL_ASSIGN_FROM_DLSYM(clRetainCommandQueue);
   MACE_CL_ASSIGN_FROM_DLSYM(clEnqueueUnmapMemObject);
+  MACE_CL_ASSIGN_FROM_DLSYM(clEnqueueMarkerWithWaitList);
+  MACE_CL_ASSIGN_FROM_DLSYM(clEnqueueBarrierWithWaitList);
   MACE_CL_ASSIGN_FROM_DLSYM(clRetainMemObject);
   MACE_CL_ASSIGN_FROM_DLSYM(clReleaseMemObject);
   MACE_CL_ASSIGN_FROM_DLSYM(clGetDeviceInfo);
@@ -416,6 +466,19 @@ CL_API_ENTRY cl_int clGetPlatformInfo(cl_platform_id platform,
   }
 }
 
+CL_API_ENTRY void *clGetExtensionFunctionAddressForPlatform(
+    cl_platform_id platform,
+    const char *func_name) CL_API_SUFFIX__VERSION_1_2 {
+  auto func = mace::runtime::OpenCLLibrary::Get()
+      ->clGetExtensionFunctionAddressForPlatform;
+  if (func != nullptr) {
+    MACE_LATENCY_LOGGER(3, "clGetExtensionFunctionAddressForPlatform");
+    return func(platform, func_name);
+  } else {
+    return nullptr;
+  }
+}
+
 // Device APIs
 CL_API_ENTRY cl_int clGetDeviceIDs(cl_platform_id platform,
                                    cl_device_type device_type,
@@ -656,6 +719,7 @@ CL_API_ENTRY cl_kernel clCreateKernel(cl_program program,
                                       const char *kernel_name,
                                       cl_int *errcode_ret)
     CL_API_SUFFIX__VERSION_1_0 {
+  mace::OpenCLCommandRecorder::OnUnreplayableCall();
   auto func = mace::runtime::OpenCLLibrary::Get()->clCreateKernel;
   if (func != nullptr) {
     MACE_LATENCY_LOGGER(3, "clCreateKernel");
@@ -696,7 +760,12 @@ CL_API_ENTRY cl_int clSetKernelArg(cl_kernel kernel,
   auto func = mace::runtime::OpenCLLibrary::Get()->clSetKernelArg;
   if (func != nullptr) {
     MACE_LATENCY_LOGGER(3, "clSetKernelArg");
-    return func(kernel, arg_index, arg_size, arg_value);
+    cl_int error = func(kernel, arg_index, arg_size, arg_value);
+    if (error == CL_SUCCESS) {
+      mace::OpenCLCommandRecorder::OnSetKernelArg(kernel, arg_index,
+                                                  arg_size, arg_value);
+    }
+    return error;
   } else {
     return CL_INVALID_PLATFORM;
   }
@@ -709,6 +778,7 @@ CL_API_ENTRY cl_mem clCreateBuffer(cl_context context,
                                    void *host_ptr,
                                    cl_int *errcode_ret)
     CL_API_SUFFIX__VERSION_1_0 {
+  mace::OpenCLCommandRecorder::OnUnreplayableCall();
   auto func = mace::runtime::OpenCLLibrary::Get()->clCreateBuffer;
   if (func != nullptr) {
     MACE_LATENCY_LOGGER(3, "clCreateBuffer");
@@ -726,6 +796,7 @@ CL_API_ENTRY cl_mem clCreateImage(cl_context context,
                                   void *host_ptr,
                                   cl_int *errcode_ret)
     CL_API_SUFFIX__VERSION_1_2 {
+  mace::OpenCLCommandRecorder::OnUnreplayableCall();
   auto func = mace::runtime::OpenCLLibrary::Get()->clCreateImage;
   if (func != nullptr) {
     MACE_LATENCY_LOGGER(3, "clCreateImage");
@@ -829,6 +900,7 @@ CL_API_ENTRY cl_int clEnqueueReadBuffer(cl_command_queue command_queue,
                                         const cl_event *event_wait_list,
                                         cl_event *event)
     CL_API_SUFFIX__VERSION_1_0 {
+  mace::OpenCLCommandRecorder::OnUnreplayableCall();
   auto func = mace::runtime::OpenCLLibrary::Get()->clEnqueueReadBuffer;
   if (func != nullptr) {
     MACE_LATENCY_LOGGER(3, "clEnqueueReadBuffer");
@@ -849,6 +921,7 @@ CL_API_ENTRY cl_int clEnqueueWriteBuffer(cl_command_queue command_queue,
                                          const cl_event *event_wait_list,
                                          cl_event *event)
     CL_API_SUFFIX__VERSION_1_0 {
+  mace::OpenCLCommandRecorder::OnUnreplayableCall();
   auto func = mace::runtime::OpenCLLibrary::Get()->clEnqueueWriteBuffer;
   if (func != nullptr) {
     MACE_LATENCY_LOGGER(3, "clEnqueueWriteBuffer");
@@ -859,6 +932,76 @@ CL_API_ENTRY cl_int clEnqueueWriteBuffer(cl_command_queue command_queue,
   }
 }
 
+CL_API_ENTRY cl_int clEnqueueCopyBuffer(cl_command_queue command_queue,
+                                        cl_mem src_buffer,
+                                        cl_mem dst_buffer,
+                                        size_t src_offset,
+                                        size_t dst_offset,
+                                        size_t size,
+                                        cl_uint num_events_in_wait_list,
+                                        const cl_event *event_wait_list,
+                                        cl_event *event)
+    CL_API_SUFFIX__VERSION_1_0 {
+  mace::OpenCLCommandRecorder::OnUnreplayableCall();
+  auto func = mace::runtime::OpenCLLibrary::Get()->clEnqueueCopyBuffer;
+  if (func != nullptr) {
+    MACE_LATENCY_LOGGER(3, "clEnqueueCopyBuffer");
+    return func(command_queue, src_buffer, dst_buffer, src_offset,
+                dst_offset, size, num_events_in_wait_list, event_wait_list,
+                event);
+  } else {
+    return CL_INVALID_PLATFORM;
+  }
+}
+
+CL_API_ENTRY cl_int clEnqueueReadImage(cl_command_queue command_queue,
+                                       cl_mem image,
+                                       cl_bool blocking_read,
+                                       const size_t *origin,
+                                       const size_t *region,
+                                       size_t row_pitch,
+                                       size_t slice_pitch,
+                                       void *ptr,
+                                       cl_uint num_events_in_wait_list,
+                                       const cl_event *event_wait_list,
+                                       cl_event *event)
+    CL_API_SUFFIX__VERSION_1_0 {
+  mace::OpenCLCommandRecorder::OnUnreplayableCall();
+  auto func = mace::runtime::OpenCLLibrary::Get()->clEnqueueReadImage;
+  if (func != nullptr) {
+    MACE_LATENCY_LOGGER(3, "clEnqueueReadImage");
+    return func(command_queue, image, blocking_read, origin, region,
+                row_pitch, slice_pitch, ptr, num_events_in_wait_list,
+                event_wait_list, event);
+  } else {
+    return CL_INVALID_PLATFORM;
+  }
+}
+
+CL_API_ENTRY cl_int clEnqueueWriteImage(cl_command_queue command_queue,
+                                        cl_mem image,
+                                        cl_bool blocking_write,
+                                        const size_t *origin,
+                                        const size_t *region,
+                                        size_t input_row_pitch,
+                                        size_t input_slice_pitch,
+                                        const void *ptr,
+                                        cl_uint num_events_in_wait_list,
+                                        const cl_event *event_wait_list,
+                                        cl_event *event)
+    CL_API_SUFFIX__VERSION_1_0 {
+  mace::OpenCLCommandRecorder::OnUnreplayableCall();
+  auto func = mace::runtime::OpenCLLibrary::Get()->clEnqueueWriteImage;
+  if (func != nullptr) {
+    MACE_LATENCY_LOGGER(3, "clEnqueueWriteImage");
+    return func(command_queue, image, blocking_write, origin, region,
+                input_row_pitch, input_slice_pitch, ptr,
+                num_events_in_wait_list, event_wait_list, event);
+  } else {
+    return CL_INVALID_PLATFORM;
+  }
+}
+
 CL_API_ENTRY void *clEnqueueMapBuffer(cl_command_queue command_queue,
                                       cl_mem buffer,
                                       cl_bool blocking_map,
@@ -870,6 +1013,7 @@ CL_API_ENTRY void *clEnqueueMapBuffer(cl_command_queue command_queue,
                                       cl_event *event,
                                       cl_int *errcode_ret)
     CL_API_SUFFIX__VERSION_1_0 {
+  mace::OpenCLCommandRecorder::OnUnreplayableCall();
   auto func = mace::runtime::OpenCLLibrary::Get()->clEnqueueMapBuffer;
   if (func != nullptr) {
     MACE_LATENCY_LOGGER(3, "clEnqueueMapBuffer");
@@ -894,6 +1038,7 @@ CL_API_ENTRY void *clEnqueueMapImage(cl_command_queue command_queue,
                                      cl_event *event,
                                      cl_int *errcode_ret)
     CL_API_SUFFIX__VERSION_1_0 {
+  mace::OpenCLCommandRecorder::OnUnreplayableCall();
   auto func = mace::runtime::OpenCLLibrary::Get()->clEnqueueMapImage;
   if (func != nullptr) {
     MACE_LATENCY_LOGGER(3, "clEnqueueMapImage");
@@ -913,6 +1058,7 @@ CL_API_ENTRY cl_int clEnqueueUnmapMemObject(cl_command_queue command_queue,
                                             const cl_event *event_wait_list,
                                             cl_event *event)
     CL_API_SUFFIX__VERSION_1_0 {
+  mace::OpenCLCommandRecorder::OnUnreplayableCall();
   auto func = mace::runtime::OpenCLLibrary::Get()->clEnqueueUnmapMemObject;
   if (func != nullptr) {
     MACE_LATENCY_LOGGER(3, "clEnqueueUnmapMemObject");
@@ -923,6 +1069,39 @@ CL_API_ENTRY cl_int clEnqueueUnmapMemObject(cl_command_queue command_queue,
   }
 }
 
+CL_API_ENTRY cl_int clEnqueueMarkerWithWaitList(
+    cl_command_queue command_queue,
+    cl_uint num_events_in_wait_list,
+    const cl_event *event_wait_list,
+    cl_event *event) CL_API_SUFFIX__VERSION_1_2 {
+  mace::OpenCLCommandRecorder::OnUnreplayableCall();
+  auto func = mace::runtime::OpenCLLibrary::Get()->clEnqueueMarkerWithWaitList;
+  if (func != nullptr) {
+    MACE_LATENCY_LOGGER(3, "clEnqueueMarkerWithWaitList");
+    return func(command_queue, num_events_in_wait_list, event_wait_list,
+                event);
+  } else {
+    return CL_INVALID_PLATFORM;
+  }
+}
+
+CL_API_ENTRY cl_int clEnqueueBarrierWithWaitList(
+    cl_command_queue command_queue,
+    cl_uint num_events_in_wait_list,
+    const cl_event *event_wait_list,
+    cl_event *event) CL_API_SUFFIX__VERSION_1_2 {
+  mace::OpenCLCommandRecorder::OnUnreplayableCall();
+  auto func =
+      mace::runtime::OpenCLLibrary::Get()->clEnqueueBarrierWithWaitList;
+  if (func != nullptr) {
+    MACE_LATENCY_LOGGER(3, "clEnqueueBarrierWithWaitList");
+    return func(command_queue, num_events_in_wait_list, event_wait_list,
+                event);
+  } else {
+    return CL_INVALID_PLATFORM;
+  }
+}
+
 CL_API_ENTRY cl_int clGetKernelWorkGroupInfo(
     cl_kernel kernel,
     cl_device_id device,
@@ -953,9 +1132,20 @@ CL_API_ENTRY cl_int clEnqueueNDRangeKernel(cl_command_queue command_queue,
   auto func = mace::runtime::OpenCLLibrary::Get()->clEnqueueNDRangeKernel;
   if (func != nullptr) {
     MACE_LATENCY_LOGGER(3, "clEnqueueNDRangeKernel");
-    return func(command_queue, kernel, work_dim, global_work_offset,
-                global_work_size, local_work_size, num_events_in_wait_list,
-                event_wait_list, event);
+    cl_int error = func(command_queue, kernel, work_dim, global_work_offset,
+                        global_work_size, local_work_size,
+                        num_events_in_wait_list, event_wait_list, event);
+    if (error == CL_SUCCESS) {
+      if (num_events_in_wait_list > 0) {
+        // the events of a replay are not those of the recorded run
+        mace::OpenCLCommandRecorder::OnUnreplayableCall();
+      } else {
+        mace::OpenCLCommandRecorder::OnEnqueueNDRangeKernel(
+            command_queue, kernel, work_dim, global_work_offset,
+            global_work_size, local_work_size);
+      }
+    }
+    return error;
   } else {
     return CL_INVALID_PLATFORM;
   }
@@ -964,6 +1154,7 @@ CL_API_ENTRY cl_int clEnqueueNDRangeKernel(cl_command_queue command_queue,
 // Event Object APIs
 CL_API_ENTRY cl_int clWaitForEvents(
     cl_uint num_events, const cl_event *event_list) CL_API_SUFFIX__VERSION_1_0 {
+  mace::OpenCLCommandRecorder::OnUnreplayableCall();
   auto func = mace::runtime::OpenCLLibrary::Get()->clWaitForEvents;
   if (func != nullptr) {
     MACE_LATENCY_LOGGER(3, "clWaitForEvents");
@@ -66,6 +66,25 @@ void ScratchImageManager::Deactive(int id) {
   reference_count_[id] -= 1;
 }
 
+index_t ScratchImageManager::bytes() const {
+  index_t bytes = 0;
+  for (auto &image : images_) {
+    // RGBA pixels
+    bytes += image.second->size() * 4;
+  }
+  return bytes;
+}
+
+void ScratchImageManager::Release() {
+  for (int count : reference_count_) {
+    if (count > 0) {
+      return;
+    }
+  }
+  images_.clear();
+  reference_count_.clear();
+}
+
 ScratchImage::ScratchImage(mace::ScratchImageManager *manager)
     : manager_(manager), id_(-1) {}
 
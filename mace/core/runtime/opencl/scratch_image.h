@@ -35,6 +35,12 @@ class ScratchImageManager {
 
   void Deactive(int id);
 
+  // the memory of the spawned images in bytes
+  index_t bytes() const;
+
+  // free the images unless some are in use, the next spawns create new ones
+  void Release();
+
  private:
   std::unordered_map<int, std::unique_ptr<Image>> images_;
   std::vector<int> reference_count_;
@@ -46,7 +46,7 @@ namespace mace {
     break;                            \
   }
 
-#ifdef MACE_ENABLE_OPENCL
+#if defined(MACE_ENABLE_OPENCL) || defined(MACE_ENABLE_FP16_NEON)
 #define MACE_TYPE_ENUM_SWITCH(                                     \
     TYPE_ENUM, STATEMENTS, INVALID_STATEMENTS, DEFAULT_STATEMENTS) \
   switch (TYPE_ENUM) {                                             \
@@ -54,6 +54,8 @@ namespace mace {
     MACE_CASE(float, MACE_SINGLE_ARG(STATEMENTS))                  \
     MACE_CASE(uint8_t, MACE_SINGLE_ARG(STATEMENTS))                \
     MACE_CASE(int32_t, MACE_SINGLE_ARG(STATEMENTS))                \
+    MACE_CASE(int16_t, MACE_SINGLE_ARG(STATEMENTS))                \
+    MACE_CASE(BFloat16, MACE_SINGLE_ARG(STATEMENTS))               \
     case DT_INVALID:                                               \
       INVALID_STATEMENTS;                                          \
       break;                                                       \
@@ -68,6 +70,8 @@ namespace mace {
     MACE_CASE(float, MACE_SINGLE_ARG(STATEMENTS))                  \
     MACE_CASE(uint8_t, MACE_SINGLE_ARG(STATEMENTS))                \
     MACE_CASE(int32_t, MACE_SINGLE_ARG(STATEMENTS))                \
+    MACE_CASE(int16_t, MACE_SINGLE_ARG(STATEMENTS))                \
+    MACE_CASE(BFloat16, MACE_SINGLE_ARG(STATEMENTS))               \
     case DT_INVALID:                                               \
       INVALID_STATEMENTS;                                          \
       break;                                                       \
@@ -108,6 +112,9 @@ class Tensor {
         dtype_(type),
         buffer_(nullptr),
         is_buffer_owner_(true),
+        saved_buffer_(nullptr),
+        saved_is_buffer_owner_(false),
+        is_buffer_bound_(false),
         unused_(false),
         name_(name),
         is_weight_(is_weight),
@@ -122,6 +129,9 @@ class Tensor {
     : dtype_(dtype),
       buffer_(buffer),
       is_buffer_owner_(false),
+      saved_buffer_(nullptr),
+      saved_is_buffer_owner_(false),
+      is_buffer_bound_(false),
       unused_(false),
       name_(name),
       is_weight_(is_weight),
@@ -137,6 +147,9 @@ class Tensor {
       : dtype_(dtype),
         buffer_slice_(buffer_slice),
         is_buffer_owner_(false),
+        saved_buffer_(nullptr),
+        saved_is_buffer_owner_(false),
+        is_buffer_bound_(false),
         unused_(false),
         name_(name),
         is_weight_(is_weight),
@@ -151,6 +164,9 @@ class Tensor {
       : Tensor(GetCPUAllocator(), DT_FLOAT, is_weight) {}
 
   ~Tensor() {
+    if (is_buffer_bound_) {
+      UnbindBuffer();
+    }
     if (is_buffer_owner_ && buffer_ != nullptr) {
       delete buffer_;
     }
@@ -304,7 +320,15 @@ class Tensor {
     if (buffer_ != nullptr) {
       MACE_CHECK(!has_opencl_image(),
                  name_, ": Cannot resize image, use ResizeImage.");
-      if (raw_size() + MACE_EXTRA_BUFFER_PAD_SIZE > buffer_->size()) {
+      // only host memory is read past the end, by NEON kernels
+      const index_t pad_size = is_buffer_bound_ && !buffer_->OnHost() ?
+                               0 : MACE_EXTRA_BUFFER_PAD_SIZE;
+      if (raw_size() + pad_size > buffer_->size()) {
+        if (is_buffer_bound_) {
+          // the borrowed buffer can't grow, fall back to our own one
+          UnbindBuffer();
+          return Resize(shape);
+        }
         LOG(WARNING) << name_ << ": Resize buffer from size " << buffer_->size()
                      << " to " << raw_size() + MACE_EXTRA_BUFFER_PAD_SIZE;
         return buffer_->Resize(raw_size() + MACE_EXTRA_BUFFER_PAD_SIZE);
@@ -333,6 +357,29 @@ class Tensor {
     image_shape_ = other.image_shape_;
   }
 
+  // Make this tensor borrow an external buffer, e.g. wrapping the memory of
+  // a user's input or output, until UnbindBuffer is called. Its own buffer
+  // is kept aside untouched.
+  inline void BindBuffer(BufferBase *buffer) {
+    MACE_CHECK(!is_buffer_bound_, name_, ": buffer is already bound");
+    MACE_CHECK_NOTNULL(buffer);
+    saved_buffer_ = buffer_;
+    saved_is_buffer_owner_ = is_buffer_owner_;
+    is_buffer_bound_ = true;
+    buffer_ = buffer;
+    is_buffer_owner_ = false;
+  }
+
+  inline void UnbindBuffer() {
+    MACE_CHECK(is_buffer_bound_, name_, ": buffer is not bound");
+    buffer_ = saved_buffer_;
+    is_buffer_owner_ = saved_is_buffer_owner_;
+    saved_buffer_ = nullptr;
+    is_buffer_bound_ = false;
+  }
+
+  inline bool is_buffer_bound() const { return is_buffer_bound_; }
+
   inline MaceStatus ResizeImage(const std::vector<index_t> &shape,
                                 const std::vector<size_t> &image_shape) {
     shape_ = shape;
@@ -402,6 +449,9 @@ class Tensor {
 
   inline BufferBase *UnderlyingBuffer() const { return buffer_; }
 
+  // whether the buffer is allocated for the tensor alone
+  inline bool is_buffer_owner() const { return is_buffer_owner_; }
+
   inline void DebugPrint() const {
     using namespace numerical_chars;  // NOLINT(build/namespaces)
     std::stringstream os;
@@ -425,7 +475,13 @@ class Tensor {
     explicit MappingGuard(const Tensor *tensor) : tensor_(tensor) {
       if (tensor_ != nullptr) {
         MACE_CHECK_NOTNULL(tensor_->buffer_);
-        tensor_->buffer_->Map(&mapped_image_pitch_);
+        if (tensor_->buffer_->OnHost()) {
+          // host memory is read directly, which also lets the input and
+          // output of an in-place op share one buffer
+          tensor_ = nullptr;
+        } else {
+          tensor_->buffer_->Map(&mapped_image_pitch_);
+        }
       }
     }
 
@@ -457,6 +513,17 @@ class Tensor {
     return scale_;
   }
 
+  // scale of a channel of a per-channel quantized weight
+  inline float scale(const index_t channel) const {
+    return scales_.empty() ? scale_ : scales_[channel];
+  }
+
+  // scales of the channels of a per-channel quantized weight, empty if the
+  // whole tensor is quantized with scale()
+  inline const std::vector<float> &scales() const {
+    return scales_;
+  }
+
   inline int32_t zero_point() const {
     return zero_point_;
   }
@@ -478,6 +545,10 @@ class Tensor {
     zero_point_ = zero_point;
   }
 
+  inline void SetScales(const std::vector<float> &scales) {
+    scales_ = scales;
+  }
+
   inline void SetIsWeight(bool is_weight) {
     is_weight_ = is_weight;
   }
@@ -502,10 +573,15 @@ class Tensor {
   BufferBase *buffer_;
   BufferSlice buffer_slice_;
   bool is_buffer_owner_;
+  // own buffer while an external one is bound
+  BufferBase *saved_buffer_;
+  bool saved_is_buffer_owner_;
+  bool is_buffer_bound_;
   bool unused_;
   std::string name_;
   bool is_weight_;
   float scale_;
+  std::vector<float> scales_;
   int32_t zero_point_;
   float minval_;
   float maxval_;
@@ -16,9 +16,17 @@
 #include <cstdlib>
 
 #include <algorithm>
+#include <map>
 #include <regex>  // NOLINT(build/c++11)
+#include <set>
+#include <string>
 #include <vector>
 
+#ifdef MACE_ENABLE_OPENMP
+#include <omp.h>
+#endif
+
+#include "mace/core/device_profile.h"
 #include "mace/core/testing/test_benchmark.h"
 #include "mace/utils/env_time.h"
 #include "mace/utils/logging.h"
@@ -32,13 +40,89 @@ static int64_t macs_processed = 0;
 static int64_t accum_time = 0;
 static int64_t start_time = 0;
 
+namespace {
+struct DevicePeak {
+  double gflops;
+  double gbps;
+};
+
+std::map<std::string, DevicePeak> *device_peaks = nullptr;
+
+// A benchmark named like MACE_BM_<OP>_<SHAPE>_<DTYPE>_<DEVICE>, e.g.
+// MACE_BM_CONV_2D_1_64_32_32_K3x3S1D1_SAME_128_float_GPU.
+struct BenchmarkRecord {
+  std::string name;
+  std::string op;
+  std::string dtype;
+  std::string device;
+  double ns_per_iter;
+  int iters;
+  double gflops;
+  double gbps;
+  double peak_gflops;
+  double peak_gbps;
+  // gflops bound by the peaks and the flops per byte of the benchmark
+  double roofline_gflops;
+};
+
+void ParseBenchmarkName(const std::string &name, BenchmarkRecord *record) {
+  static const std::set<std::string> devices = {"CPU", "GPU", "HEXAGON"};
+  static const std::set<std::string> dtypes = {
+      "float", "half", "uint8_t", "int32_t", "int8_t", "bfloat16"};
+  std::string rest = name;
+  const std::string prefix = "MACE_BM_";
+  if (rest.compare(0, prefix.size(), prefix) == 0) {
+    rest = rest.substr(prefix.size());
+  }
+  for (std::string *field : {&record->device, &record->dtype}) {
+    const size_t pos = rest.rfind('_');
+    if (pos == std::string::npos) {
+      break;
+    }
+    const std::string token = rest.substr(pos + 1);
+    const auto &known = field == &record->device ? devices : dtypes;
+    if (known.count(token) == 0) {
+      continue;
+    }
+    *field = token;
+    rest = rest.substr(0, pos);
+  }
+  record->op = rest;
+}
+
+const DevicePeak &GetDevicePeak(const std::string &device) {
+  if (device_peaks == nullptr) {
+    device_peaks = new std::map<std::string, DevicePeak>;
+  }
+  auto iter = device_peaks->find(device);
+  if (iter == device_peaks->end()) {
+    DevicePeak peak = {0, 0};
+    if (device == "CPU") {
+      MeasureCPUPeak(&peak.gflops, &peak.gbps);
+    }
+    iter = device_peaks->emplace(device, peak).first;
+  }
+  return iter->second;
+}
+
+std::string JsonString(const std::string &str) {
+  return "\"" + str + "\"";
+}
+}  // namespace
+
 Benchmark::Benchmark(const char *name, void (*benchmark_func)(int))
     : name_(name), benchmark_func_(benchmark_func) {
   Register();
 }
 
+Benchmark::Benchmark(const std::string &name,
+                     const std::function<void(int)> &benchmark_func)
+    : name_(name), benchmark_func_(benchmark_func) {
+  Register();
+}
+
 // Run all benchmarks that matches the pattern
-void Benchmark::Run(const char *pattern) {
+void Benchmark::Run(const char *pattern, const std::string &format) {
   if (!all_benchmarks) return;
 
   std::sort(all_benchmarks->begin(), all_benchmarks->end(),
@@ -50,6 +134,9 @@ void Benchmark::Run(const char *pattern) {
     pattern = ".*";
   }
   std::regex regex(pattern);
+  MACE_CHECK(format == "text" || format == "json" || format == "csv",
+             "unknown benchmark output format: ", format);
+  const bool text = format == "text";
 
   // Compute name width.
   int width = 10;
@@ -61,9 +148,12 @@ void Benchmark::Run(const char *pattern) {
 
   // Internal perf regression tools depends on the output formatting,
   // please keep in consistent when modifying
-  printf("%-*s %10s %10s %10s %10s\n", width, "Benchmark", "Time(ns)",
-         "Iterations", "Input(MB/s)", "GMACPS");
-  printf("%s\n", std::string(width + 45, '-').c_str());
+  if (text) {
+    printf("%-*s %10s %10s %10s %10s\n", width, "Benchmark", "Time(ns)",
+           "Iterations", "Input(MB/s)", "GMACPS");
+    printf("%s\n", std::string(width + 45, '-').c_str());
+  }
+  std::vector<BenchmarkRecord> records;
   for (auto b : *all_benchmarks) {
     if (!std::regex_match(b->name_, match, regex)) continue;
     int iters;
@@ -72,9 +162,76 @@ void Benchmark::Run(const char *pattern) {
     float mbps = (bytes_processed * 1e-6) / seconds;
     // MACCs or other computations
     float gmacs = (macs_processed * 1e-9) / seconds;
-    printf("%-*s %10.0f %10d %10.2f %10.2f\n", width, b->name_.c_str(),
-           seconds * 1e9 / iters, iters, mbps, gmacs);
+    if (text) {
+      printf("%-*s %10.0f %10d %10.2f %10.2f\n", width, b->name_.c_str(),
+             seconds * 1e9 / iters, iters, mbps, gmacs);
+      continue;
+    }
+    BenchmarkRecord record;
+    record.name = b->name_;
+    ParseBenchmarkName(b->name_, &record);
+    record.ns_per_iter = seconds * 1e9 / iters;
+    record.iters = iters;
+    // a multiply-add is two flops
+    record.gflops = 2 * gmacs;
+    record.gbps = std::max(mbps * 1e-3, 0.0);
+    const DevicePeak &peak = GetDevicePeak(record.device);
+    record.peak_gflops = peak.gflops;
+    record.peak_gbps = peak.gbps;
+    record.roofline_gflops = peak.gflops;
+    if (bytes_processed > 0 && peak.gbps > 0) {
+      const double flops_per_byte =
+          2.0 * macs_processed / bytes_processed;
+      record.roofline_gflops = peak.gflops > 0 ?
+          std::min(peak.gflops, flops_per_byte * peak.gbps) :
+          flops_per_byte * peak.gbps;
+    }
+    records.push_back(record);
+  }
+  if (text) {
+    return;
+  }
+
+  if (format == "csv") {
+    printf("name,op,dtype,device,ns_per_iter,iterations,gflops,gbps,"
+           "peak_gflops,peak_gbps,roofline_gflops,efficiency\n");
+  } else {
+    printf("[\n");
   }
+  for (size_t i = 0; i < records.size(); ++i) {
+    const BenchmarkRecord &r = records[i];
+    const double efficiency =
+        r.roofline_gflops > 0 ? r.gflops / r.roofline_gflops : 0;
+    if (format == "csv") {
+      printf("%s,%s,%s,%s,%.0f,%d,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n",
+             r.name.c_str(), r.op.c_str(), r.dtype.c_str(),
+             r.device.c_str(), r.ns_per_iter, r.iters, r.gflops, r.gbps,
+             r.peak_gflops, r.peak_gbps, r.roofline_gflops, efficiency);
+    } else {
+      printf("  {\"name\": %s, \"op\": %s, \"dtype\": %s, "
+             "\"device\": %s, \"ns_per_iter\": %.0f, "
+             "\"iterations\": %d, \"gflops\": %.3f, \"gbps\": %.3f, "
+             "\"peak_gflops\": %.3f, \"peak_gbps\": %.3f, "
+             "\"roofline_gflops\": %.3f, \"efficiency\": %.3f}%s\n",
+             JsonString(r.name).c_str(), JsonString(r.op).c_str(),
+             JsonString(r.dtype).c_str(), JsonString(r.device).c_str(),
+             r.ns_per_iter, r.iters, r.gflops, r.gbps, r.peak_gflops,
+             r.peak_gbps, r.roofline_gflops, efficiency,
+             i + 1 < records.size() ? "," : "");
+    }
+  }
+  if (format == "json") {
+    printf("]\n");
+  }
+}
+
+void Benchmark::SetDevicePeak(const std::string &device,
+                              double gflops,
+                              double gbps) {
+  if (device_peaks == nullptr) {
+    device_peaks = new std::map<std::string, DevicePeak>;
+  }
+  (*device_peaks)[device] = {gflops, gbps};
 }
 
 void Benchmark::Register() {
@@ -91,7 +248,7 @@ void Benchmark::Run(int *run_count, double *run_seconds) {
     bytes_processed = -1;
     macs_processed = 0;
     RestartTiming();
-    (*benchmark_func_)(iters);
+    benchmark_func_(iters);
     StopTiming();
     const double seconds = accum_time * 1e-6;
     if (seconds >= kMinTime || iters >= kMaxIters) {
@@ -107,6 +264,17 @@ void Benchmark::Run(int *run_count, double *run_seconds) {
   }
 }
 
+void MeasureCPUPeak(double *gflops, double *gbps) {
+  int threads = 1;
+#ifdef MACE_ENABLE_OPENMP
+  threads = omp_get_max_threads();
+#endif
+  *gflops = ProbeMultiplyAddGflops(threads, 1 << 22);
+  // STREAM triad on arrays much larger than the caches
+  *gbps = ProbeTriadGBps(threads, 1 << 23, 1);
+  VLOG(1) << "CPU peak probe with " << threads << " threads";
+}
+
 void BytesProcessed(int64_t n) { bytes_processed = n; }
 void MacsProcessed(int64_t n) { macs_processed = n; }
 void RestartTiming() {
@@ -16,6 +16,8 @@
 #ifndef MACE_CORE_TESTING_TEST_BENCHMARK_H_
 #define MACE_CORE_TESTING_TEST_BENCHMARK_H_
 
+#include <cstdint>
+#include <functional>
 #include <string>
 #include <utility>
 #include <vector>
@@ -30,17 +32,31 @@ namespace testing {
 class Benchmark {
  public:
   Benchmark(const char *name, void (*benchmark_func)(int));
+  // for the benchmarks registered at run time, e.g. from a model
+  Benchmark(const std::string &name,
+            const std::function<void(int)> &benchmark_func);
 
-  static void Run(const char *pattern);
+  // format: "text" for the table, "json" or "csv" for the roofline records
+  static void Run(const char *pattern, const std::string &format = "text");
+
+  // Peaks of a device for the roofline, 0 if unknown. The CPU ones are
+  // measured by MeasureCPUPeak if they are not set.
+  static void SetDevicePeak(const std::string &device,
+                            double gflops,
+                            double gbps);
 
  private:
   std::string name_;
-  void (*benchmark_func_)(int iters) = nullptr;
+  std::function<void(int iters)> benchmark_func_;
 
   void Register();
   void Run(int *run_count, double *run_seconds);
 };
 
+// Peak gflops of multiply-adds and GB/s of a STREAM triad on the CPU,
+// with all the OpenMP threads.
+void MeasureCPUPeak(double *gflops, double *gbps);
+
 void BytesProcessed(int64_t);
 void MacsProcessed(int64_t);
 void RestartTiming();
@@ -23,6 +23,10 @@ DEFINE_string(filter, "all", "op benchmark regex filter, eg:.*CONV.*");
 DEFINE_int32(omp_num_threads, -1, "num of openmp threads");
 DEFINE_int32(cpu_affinity_policy, 1,
              "0:AFFINITY_NONE/1:AFFINITY_BIG_ONLY/2:AFFINITY_LITTLE_ONLY");
+DEFINE_string(format, "text",
+              "text, or json/csv for the roofline records of the benchmarks");
+DEFINE_double(gpu_peak_gflops, 0, "peak gflops of the GPU, 0 if unknown");
+DEFINE_double(gpu_peak_gbps, 0, "peak memory GB/s of the GPU, 0 if unknown");
 
 int main(int argc, char **argv) {
   std::string usage = "run ops benchmark\nusage: " + std::string(argv[0])
@@ -36,6 +40,9 @@ int main(int argc, char **argv) {
       static_cast<mace::CPUAffinityPolicy>(FLAGS_cpu_affinity_policy),
       true);
 
-  mace::testing::Benchmark::Run(FLAGS_filter.c_str());
+  // the CPU peaks are measured on the first CPU benchmark
+  mace::testing::Benchmark::SetDevicePeak("GPU", FLAGS_gpu_peak_gflops,
+                                          FLAGS_gpu_peak_gbps);
+  mace::testing::Benchmark::Run(FLAGS_filter.c_str(), FLAGS_format);
   return 0;
 }
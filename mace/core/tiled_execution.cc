@@ -0,0 +1,218 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/core/tiled_execution.h"
+
+#include <algorithm>
+#include <cstring>
+#include <set>
+#include <unordered_map>
+
+#include "mace/core/arg_helper.h"
+#include "mace/utils/logging.h"
+
+namespace mace {
+
+namespace {
+
+// the ops whose output pixels only depend on the input pixels around them
+const std::set<std::string> kConvPoolOps = {
+    "Conv2D", "DepthwiseConv2d", "Pooling",
+};
+// the ops whose output pixels only depend on the input pixels at the same
+// position
+const std::set<std::string> kPositionwiseOps = {
+    "Activation", "BatchNorm", "BiasAdd", "ChannelShuffle", "Concat",
+    "Eltwise", "Identity", "Softmax", "Split",
+};
+
+MaceStatus Unsupported(const OperatorDef &op_def, const std::string &why) {
+  return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                    "can't tile the net at op " + op_def.name() + " (" +
+                    op_def.type() + "): " + why);
+}
+
+// the height and width of the kernel of a conv or pool op, 0 if unknown
+void KernelSize(
+    const OperatorDef &op_def,
+    const std::unordered_map<std::string, const ConstTensor *> &weights,
+    int *kernel) {
+  kernel[0] = kernel[1] = 0;
+  if (op_def.type() == "Pooling") {
+    std::vector<int> kernels = ProtoArgHelper::GetRepeatedArgs<OperatorDef,
+                                                               int>(
+        op_def, "kernels");
+    if (kernels.size() == 2) {
+      kernel[0] = kernels[0];
+      kernel[1] = kernels[1];
+    }
+    return;
+  }
+  if (op_def.input_size() < 2) {
+    return;
+  }
+  auto filter = weights.find(op_def.input(1));
+  // OIHW and MIHW filters
+  if (filter != weights.end() && filter->second->dims_size() == 4) {
+    kernel[0] = static_cast<int>(filter->second->dims(2));
+    kernel[1] = static_cast<int>(filter->second->dims(3));
+  }
+}
+
+}  // namespace
+
+MaceStatus ComputeSpatialReach(const NetDef &net_def,
+                               const std::vector<std::string> &outputs,
+                               std::map<std::string, SpatialReach> *reaches) {
+  std::unordered_map<std::string, const ConstTensor *> weights;
+  for (auto &const_tensor : net_def.tensors()) {
+    weights[const_tensor.name()] = &const_tensor;
+  }
+  std::unordered_map<std::string, SpatialReach> tensor_reaches;
+  for (auto &input_info : net_def.input_info()) {
+    tensor_reaches[input_info.name()] = SpatialReach{{0, 0}, {1, 1}};
+  }
+  for (auto &op_def : net_def.op()) {
+    const bool conv_pool = kConvPoolOps.count(op_def.type()) == 1;
+    if (!conv_pool && kPositionwiseOps.count(op_def.type()) == 0) {
+      return Unsupported(op_def, "it mixes the pixels of the image");
+    }
+    if (ProtoArgHelper::GetOptionalArg<OperatorDef, int>(
+            op_def, "depth_to_space", 1) > 1) {
+      return Unsupported(op_def, "it stores a depth to space");
+    }
+    bool has_input = false;
+    SpatialReach reach{{0, 0}, {1, 1}};
+    for (auto &input : op_def.input()) {
+      if (weights.count(input) == 1) {
+        continue;
+      }
+      auto iter = tensor_reaches.find(input);
+      if (iter == tensor_reaches.end()) {
+        return Unsupported(op_def, "unknown input " + input);
+      }
+      for (int axis = 0; axis < 2; ++axis) {
+        if (has_input && iter->second.stride[axis] != reach.stride[axis]) {
+          return Unsupported(op_def, "its inputs are of different scales");
+        }
+        reach.halo[axis] = std::max(reach.halo[axis], iter->second.halo[axis]);
+        reach.stride[axis] = iter->second.stride[axis];
+      }
+      has_input = true;
+    }
+    if (conv_pool) {
+      int kernel[2];
+      KernelSize(op_def, weights, kernel);
+      std::vector<int> strides = ProtoArgHelper::GetRepeatedArgs<OperatorDef,
+                                                                 int>(
+          op_def, "strides", {1, 1});
+      std::vector<int> dilations = ProtoArgHelper::GetRepeatedArgs<
+          OperatorDef, int>(op_def, "dilations", {1, 1});
+      if (kernel[0] <= 0 || kernel[1] <= 0 || strides.size() != 2 ||
+          dilations.size() != 2) {
+        return Unsupported(op_def, "unknown kernel");
+      }
+      for (int axis = 0; axis < 2; ++axis) {
+        // the larger side of the padding of an extent of the kernel
+        const int extent = dilations[axis] * (kernel[axis] - 1);
+        reach.halo[axis] += (extent + 1) / 2 * reach.stride[axis];
+        reach.stride[axis] *= strides[axis];
+      }
+    }
+    for (auto &output : op_def.output()) {
+      tensor_reaches[output] = reach;
+    }
+  }
+  for (auto &output : outputs) {
+    auto iter = tensor_reaches.find(output);
+    if (iter == tensor_reaches.end()) {
+      return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                        "can't tile the net: no op produces " + output);
+    }
+    (*reaches)[output] = iter->second;
+  }
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus PlanTileSpans(index_t size,
+                         index_t tile,
+                         index_t halo,
+                         index_t align,
+                         std::vector<TileSpan> *spans) {
+  halo = (halo + align - 1) / align * align;
+  const index_t core = tile - 2 * halo;
+  if (core <= 0 || tile % align != 0) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      MakeString("tiles of ", tile, " pixels aligned to ",
+                                 align, " can't hold halos of ", halo,
+                                 " pixels"));
+  }
+  if (size < tile || size % align != 0) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      MakeString("an image of ", size, " pixels can't be",
+                                 " cut into tiles of ", tile, " pixels",
+                                 " aligned to ", align));
+  }
+  spans->clear();
+  for (index_t core_begin = 0; core_begin < size; core_begin += core) {
+    TileSpan span;
+    span.begin = std::min(std::max<index_t>(core_begin - halo, 0),
+                          size - tile);
+    span.core_begin = core_begin;
+    span.core_end = std::min(core_begin + core, size);
+    spans->push_back(span);
+  }
+  return MaceStatus::MACE_SUCCESS;
+}
+
+void CopySpatialWindow(const float *src,
+                       const std::vector<int64_t> &src_shape,
+                       index_t src_h,
+                       index_t src_w,
+                       float *dst,
+                       const std::vector<int64_t> &dst_shape,
+                       index_t dst_h,
+                       index_t dst_w,
+                       index_t height,
+                       index_t width,
+                       DataFormat data_format) {
+  MACE_CHECK(src_shape.size() == 4 && dst_shape.size() == 4);
+  if (data_format == DataFormat::NCHW) {
+    // a row of a channel is contiguous
+    const index_t planes = src_shape[0] * src_shape[1];
+    for (index_t p = 0; p < planes; ++p) {
+      const float *src_plane = src + p * src_shape[2] * src_shape[3];
+      float *dst_plane = dst + p * dst_shape[2] * dst_shape[3];
+      for (index_t h = 0; h < height; ++h) {
+        memcpy(dst_plane + (dst_h + h) * dst_shape[3] + dst_w,
+               src_plane + (src_h + h) * src_shape[3] + src_w,
+               width * sizeof(float));
+      }
+    }
+  } else {
+    // the channels of a row are contiguous
+    const index_t channels = src_shape[3];
+    for (index_t b = 0; b < src_shape[0]; ++b) {
+      const float *src_image = src + b * src_shape[1] * src_shape[2] * channels;
+      float *dst_image = dst + b * dst_shape[1] * dst_shape[2] * channels;
+      for (index_t h = 0; h < height; ++h) {
+        memcpy(dst_image + ((dst_h + h) * dst_shape[2] + dst_w) * channels,
+               src_image + ((src_h + h) * src_shape[2] + src_w) * channels,
+               width * channels * sizeof(float));
+      }
+    }
+  }
+}
+
+}  // namespace mace
@@ -0,0 +1,78 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_CORE_TILED_EXECUTION_H_
+#define MACE_CORE_TILED_EXECUTION_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "mace/core/types.h"
+#include "mace/proto/mace.pb.h"
+#include "mace/public/mace.h"
+
+namespace mace {
+
+// How far an output of a fully convolutional net sees into its input,
+// along the height and the width: the input pixels around those of an
+// output pixel it depends on, and the input pixels per output pixel.
+struct SpatialReach {
+  int halo[2];
+  int stride[2];
+};
+
+// The reach of the outputs of a float net made of convolutions, poolings
+// and ops of a single position, from the kernels, strides and dilations of
+// their ConvPoolArgs. Other ops, e.g. resizes or fully connected ones, mix
+// all the positions and can't be tiled.
+MaceStatus ComputeSpatialReach(const NetDef &net_def,
+                               const std::vector<std::string> &outputs,
+                               std::map<std::string, SpatialReach> *reaches);
+
+// A tile along an axis: its first input pixel, and the input pixels
+// [core_begin, core_end) of the image whose outputs are taken from it.
+struct TileSpan {
+  index_t begin;
+  index_t core_begin;
+  index_t core_end;
+};
+
+// The tiles of `tile` pixels covering `size` pixels, each overlapping its
+// neighbours by `halo` pixels, which begin at multiples of `align` so that
+// their outputs fall on those of the image. Those at the borders are moved
+// inside the image, so that the ops pad them as they would pad the image.
+MaceStatus PlanTileSpans(index_t size,
+                         index_t tile,
+                         index_t halo,
+                         index_t align,
+                         std::vector<TileSpan> *spans);
+
+// Copy height rows of width pixels from (src_h, src_w) of a 4D NHWC or NCHW
+// tensor to (dst_h, dst_w) of another one of the same batch and channels.
+void CopySpatialWindow(const float *src,
+                       const std::vector<int64_t> &src_shape,
+                       index_t src_h,
+                       index_t src_w,
+                       float *dst,
+                       const std::vector<int64_t> &dst_shape,
+                       index_t dst_h,
+                       index_t dst_w,
+                       index_t height,
+                       index_t width,
+                       DataFormat data_format);
+
+}  // namespace mace
+
+#endif  // MACE_CORE_TILED_EXECUTION_H_
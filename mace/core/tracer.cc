@@ -0,0 +1,221 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/core/tracer.h"
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <sstream>
+#include <utility>
+
+#ifdef MACE_ENABLE_OPENCL
+#include "mace/core/runtime/opencl/opencl_runtime.h"
+#endif  // MACE_ENABLE_OPENCL
+#include "mace/utils/env_time.h"
+#include "mace/utils/logging.h"
+
+namespace mace {
+
+namespace {
+// the trace process of the host threads and the one of the GPU
+constexpr int kHostPid = 0;
+constexpr int kGPUPid = 1;
+#ifdef MACE_ENABLE_OPENCL
+// finished kernels whose times are not read yet hold their events
+constexpr size_t kMaxPendingKernels = 256;
+#endif  // MACE_ENABLE_OPENCL
+
+thread_local Tracer *current_tracer = nullptr;
+
+int64_t ThreadId() {
+#if defined(__ANDROID__)
+  return gettid();
+#else
+  return syscall(SYS_gettid);
+#endif
+}
+
+std::string JsonString(const std::string &str) {
+  std::string result = "\"";
+  for (char c : str) {
+    if (c == '"' || c == '\\') {
+      result.push_back('\\');
+      result.push_back(c);
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      result.push_back(' ');
+    } else {
+      result.push_back(c);
+    }
+  }
+  result.push_back('"');
+  return result;
+}
+}  // namespace
+
+#ifdef MACE_ENABLE_OPENCL
+struct Tracer::PendingKernels {
+  std::string op_name;
+  int64_t enqueue_micros;
+  std::vector<OpenCLKernelRecord> records;
+};
+#endif  // MACE_ENABLE_OPENCL
+
+Tracer::Tracer(const std::string &file_path)
+    : file_path_(file_path)
+#ifdef MACE_ENABLE_OPENCL
+    , has_device_offset_(false),
+    device_offset_micros_(0)
+#endif  // MACE_ENABLE_OPENCL
+{
+  AddEvent("process_name", "", "M", kHostPid, 0, 0, -1,
+           "\"name\":\"host\"");
+  AddEvent("process_name", "", "M", kGPUPid, 0, 0, -1,
+           "\"name\":\"GPU\"");
+}
+
+Tracer::~Tracer() {
+  std::lock_guard<std::mutex> lock(mutex_);
+#ifdef MACE_ENABLE_OPENCL
+  ResolveKernels(0);
+#endif  // MACE_ENABLE_OPENCL
+  std::ofstream file(file_path_);
+  if (!file.is_open()) {
+    LOG(WARNING) << "Failed to write trace file: " << file_path_;
+    return;
+  }
+  file << "{\"traceEvents\":[";
+  for (size_t i = 0; i < events_.size(); ++i) {
+    file << (i == 0 ? "\n" : ",\n") << events_[i];
+  }
+  file << "\n]}\n";
+  LOG(INFO) << "Write trace of " << events_.size() << " events to "
+            << file_path_;
+}
+
+void Tracer::AddSpan(const std::string &name,
+                     const std::string &category,
+                     int64_t start_micros,
+                     int64_t end_micros,
+                     const std::string &args) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  AddEvent(name, category, "X", kHostPid, ThreadId(), start_micros,
+           end_micros - start_micros, args);
+}
+
+void Tracer::AddInstant(const std::string &name,
+                        const std::string &category,
+                        const std::string &args) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  AddEvent(name, category, "i", kHostPid, ThreadId(), NowMicros(), -1,
+           args);
+}
+
+#ifdef MACE_ENABLE_OPENCL
+void Tracer::AddKernels(const std::string &op_name,
+                        int64_t enqueue_micros,
+                        const std::vector<OpenCLKernelRecord> &records) {
+  if (records.empty()) {
+    return;
+  }
+  std::unique_ptr<PendingKernels> pending(new PendingKernels);
+  pending->op_name = op_name;
+  pending->enqueue_micros = enqueue_micros;
+  pending->records = records;
+  std::lock_guard<std::mutex> lock(mutex_);
+  pending_kernels_.push_back(std::move(pending));
+  if (pending_kernels_.size() > kMaxPendingKernels) {
+    ResolveKernels(kMaxPendingKernels / 2);
+  }
+}
+
+void Tracer::ResolveKernels(size_t keep) {
+  while (pending_kernels_.size() > keep) {
+    PendingKernels *pending = pending_kernels_.front().get();
+    for (auto &record : pending->records) {
+      record.event.wait();
+      const int64_t queued_micros = static_cast<int64_t>(
+          record.event.getProfilingInfo<CL_PROFILING_COMMAND_QUEUED>() /
+          1000);
+      const int64_t start_micros = static_cast<int64_t>(
+          record.event.getProfilingInfo<CL_PROFILING_COMMAND_START>() /
+          1000);
+      const int64_t end_micros = static_cast<int64_t>(
+          record.event.getProfilingInfo<CL_PROFILING_COMMAND_END>() / 1000);
+      // the first kernel is taken as queued when its op started to enqueue
+      if (!has_device_offset_) {
+        device_offset_micros_ = pending->enqueue_micros - queued_micros;
+        has_device_offset_ = true;
+      }
+      std::stringstream args;
+      args << "\"op\":" << JsonString(pending->op_name)
+           << ",\"gws\":" << MakeString(record.gws)
+           << ",\"lws\":" << MakeString(record.lws)
+           << ",\"queued_us\":" << start_micros - queued_micros;
+      AddEvent(record.kernel_name, "kernel", "X", kGPUPid, 0,
+               start_micros + device_offset_micros_,
+               end_micros - start_micros, args.str());
+    }
+    pending_kernels_.pop_front();
+  }
+}
+#endif  // MACE_ENABLE_OPENCL
+
+Tracer *Tracer::Current() {
+  return current_tracer;
+}
+
+Tracer::Scope::Scope(Tracer *tracer) : previous_(current_tracer) {
+  current_tracer = tracer;
+}
+
+Tracer::Scope::~Scope() {
+  current_tracer = previous_;
+}
+
+void Tracer::AddEvent(const std::string &name,
+                      const std::string &category,
+                      const std::string &phase,
+                      int pid,
+                      int64_t tid,
+                      int64_t start_micros,
+                      int64_t duration_micros,
+                      const std::string &args) {
+  std::stringstream event;
+  event << "{\"name\":" << JsonString(name)
+        << ",\"cat\":" << JsonString(category)
+        << ",\"ph\":\"" << phase << "\",\"pid\":" << pid
+        << ",\"tid\":" << tid << ",\"ts\":" << start_micros;
+  if (duration_micros >= 0) {
+    event << ",\"dur\":" << duration_micros;
+  }
+  if (phase == "i") {
+    // an instant of the thread
+    event << ",\"s\":\"t\"";
+  }
+  event << ",\"args\":{" << args << "}}";
+  events_.push_back(event.str());
+}
+
+void TraceAllocation(const std::string &memory, int64_t nbytes) {
+  Tracer *tracer = Tracer::Current();
+  if (tracer != nullptr) {
+    tracer->AddInstant("allocate", "memory",
+                       "\"memory\":" + JsonString(memory) +
+                           ",\"bytes\":" + std::to_string(nbytes));
+  }
+}
+
+}  // namespace mace
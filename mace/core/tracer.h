@@ -0,0 +1,106 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_CORE_TRACER_H_
+#define MACE_CORE_TRACER_H_
+
+#include <deque>
+#include <memory>
+#include <mutex>  // NOLINT(build/c++11)
+#include <string>
+#include <vector>
+
+#include "mace/public/mace.h"
+#include "mace/utils/utils.h"
+
+namespace mace {
+
+struct OpenCLKernelRecord;
+
+// Chrome trace (chrome://tracing or the Perfetto UI) of net runs, written as
+// json when the tracer is destroyed. Host events are on the threads which
+// ran them, OpenCL kernels on a GPU process with their device times shifted
+// to the host clock.
+class Tracer {
+ public:
+  explicit Tracer(const std::string &file_path);
+  ~Tracer();
+
+  // A span of the calling thread, times of NowMicros. args are the members
+  // of a json object, e.g. "\"device\":\"GPU\"".
+  void AddSpan(const std::string &name,
+               const std::string &category,
+               int64_t start_micros,
+               int64_t end_micros,
+               const std::string &args = "");
+  // An event of the calling thread at the current time.
+  void AddInstant(const std::string &name,
+                  const std::string &category,
+                  const std::string &args = "");
+#ifdef MACE_ENABLE_OPENCL
+  // The kernels of an operation whose enqueue started at enqueue_micros,
+  // their times are read once they are finished.
+  void AddKernels(const std::string &op_name,
+                  int64_t enqueue_micros,
+                  const std::vector<OpenCLKernelRecord> &records);
+#endif  // MACE_ENABLE_OPENCL
+
+  // The tracer of the operation running on the calling thread, null if the
+  // operation is not traced.
+  static Tracer *Current();
+
+  // Make a tracer current on the calling thread within the scope.
+  class Scope {
+   public:
+    explicit Scope(Tracer *tracer);
+    ~Scope();
+
+   private:
+    Tracer *previous_;
+  };
+
+ private:
+  void AddEvent(const std::string &name,
+                const std::string &category,
+                const std::string &phase,
+                int pid,
+                int64_t tid,
+                int64_t start_micros,
+                int64_t duration_micros,
+                const std::string &args);
+#ifdef MACE_ENABLE_OPENCL
+  // read the times of the pending kernels but the last keep ones
+  void ResolveKernels(size_t keep);
+#endif  // MACE_ENABLE_OPENCL
+
+  std::string file_path_;
+  std::mutex mutex_;
+  std::vector<std::string> events_;
+#ifdef MACE_ENABLE_OPENCL
+  struct PendingKernels;
+  std::deque<std::unique_ptr<PendingKernels>> pending_kernels_;
+  bool has_device_offset_;
+  // host time minus device time
+  int64_t device_offset_micros_;
+#endif  // MACE_ENABLE_OPENCL
+
+  MACE_DISABLE_COPY_AND_ASSIGN(Tracer);
+};
+
+// Record an allocation of the traced operation on the calling thread.
+void TraceAllocation(const std::string &memory, int64_t nbytes);
+
+}  // namespace mace
+
+#endif  // MACE_CORE_TRACER_H_
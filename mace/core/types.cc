@@ -25,6 +25,8 @@ bool DataTypeCanUseMemcpy(DataType dt) {
     case DT_FLOAT:
     case DT_UINT8:
     case DT_INT32:
+    case DT_INT16:
+    case DT_BFLOAT16:
       return true;
     default:
       return false;
@@ -36,7 +38,9 @@ std::string DataTypeToString(const DataType dt) {
       {DT_FLOAT, "DT_FLOAT"},
       {DT_HALF, "DT_HALF"},
       {DT_UINT8, "DT_UINT8"},
-      {DT_INT32, "DT_INT32"}};
+      {DT_INT32, "DT_INT32"},
+      {DT_INT16, "DT_INT16"},
+      {DT_BFLOAT16, "DT_BFLOAT16"}};
   MACE_CHECK(dt != DT_INVALID, "Not support Invalid data type");
   return dtype_string_map[dt];
 }
@@ -51,6 +55,10 @@ size_t GetEnumTypeSize(const DataType dt) {
       return sizeof(uint8_t);
     case DT_INT32:
       return sizeof(int32_t);
+    case DT_INT16:
+      return sizeof(int16_t);
+    case DT_BFLOAT16:
+      return sizeof(BFloat16);
     default:
       LOG(FATAL) << "Unsupported data type: " << dt;
       return 0;
@@ -18,6 +18,7 @@
 #include <cstdint>
 #include <string>
 
+#include "mace/core/bfloat16.h"
 #include "mace/proto/mace.pb.h"
 #include "include/half.hpp"
 
@@ -54,6 +55,8 @@ MACE_MAPPING_DATA_TYPE_AND_ENUM(half, DT_HALF);
 MACE_MAPPING_DATA_TYPE_AND_ENUM(float, DT_FLOAT);
 MACE_MAPPING_DATA_TYPE_AND_ENUM(uint8_t, DT_UINT8);
 MACE_MAPPING_DATA_TYPE_AND_ENUM(int32_t, DT_INT32);
+MACE_MAPPING_DATA_TYPE_AND_ENUM(int16_t, DT_INT16);
+MACE_MAPPING_DATA_TYPE_AND_ENUM(BFloat16, DT_BFLOAT16);
 }  // namespace mace
 
 #endif  // MACE_CORE_TYPES_H_
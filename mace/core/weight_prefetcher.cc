@@ -0,0 +1,148 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/core/weight_prefetcher.h"
+
+#include <algorithm>
+
+#include "mace/core/device_profile.h"
+#include "mace/utils/logging.h"
+
+namespace mace {
+
+namespace {
+
+constexpr int64_t kCacheLineBytes = 64;
+// the weights an op reads from the L2 cache of its core, or from memory
+// faster than the helper thread could be woken up
+constexpr int64_t kMinPrefetchBytes = 64 << 10;
+// the reads between the checks for a newer request
+constexpr int64_t kCheckBytes = 16 << 10;
+
+}  // namespace
+
+WeightPrefetcher::WeightPrefetcher(
+    const std::vector<std::unique_ptr<Operation>> &operators,
+    int64_t budget_bytes)
+    : regions_(operators.size()),
+      prefetched_ops_(0),
+      next_op_(-1),
+      generation_(0),
+      stop_(false) {
+  for (size_t i = 0; i < operators.size(); ++i) {
+    const Operation *op = operators[i].get();
+    if (op->device_type() != DeviceType::CPU) {
+      continue;
+    }
+    std::vector<Region> regions;
+    int64_t weight_bytes = 0;
+    for (const Tensor *input : op->Inputs()) {
+      if (input == nullptr || !input->is_weight() ||
+          input->memory_type() != MemoryType::CPU_BUFFER) {
+        continue;
+      }
+      regions.push_back({static_cast<const unsigned char *>(
+          input->raw_data()), input->raw_size()});
+      weight_bytes += input->raw_size();
+    }
+    if (weight_bytes < kMinPrefetchBytes) {
+      continue;
+    }
+    // the head of each weight, in proportion to its size, which the kernels
+    // read first
+    if (weight_bytes > budget_bytes) {
+      for (Region &region : regions) {
+        region.bytes = region.bytes * budget_bytes / weight_bytes;
+      }
+    }
+    regions_[i] = regions;
+    ++prefetched_ops_;
+  }
+  VLOG(1) << "Prefetch the weights of " << prefetched_ops_ << " of "
+          << operators.size() << " ops, " << budget_bytes << " bytes at most";
+  if (prefetched_ops_ > 0) {
+    thread_ = std::thread(&WeightPrefetcher::Loop, this);
+  }
+}
+
+WeightPrefetcher::~WeightPrefetcher() {
+  if (thread_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+      ++generation_;
+    }
+    cond_.notify_one();
+    thread_.join();
+  }
+}
+
+int64_t WeightPrefetcher::DefaultBudgetBytes() {
+  const DeviceProfile &profile = GetDeviceProfile();
+  const int64_t shared_cache_bytes = profile.l3_cache_bytes > 0 ?
+      profile.l3_cache_bytes : profile.l2_cache_bytes;
+  return std::max<int64_t>(shared_cache_bytes / 2, kMinPrefetchBytes);
+}
+
+void WeightPrefetcher::BeforeOp(size_t op_idx,
+                                Operation *op,
+                                const OpContext *context) {
+  MACE_UNUSED(op);
+  MACE_UNUSED(context);
+  const size_t next = op_idx + 1;
+  if (next >= regions_.size() || regions_[next].empty()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    next_op_ = static_cast<int64_t>(next);
+    ++generation_;
+  }
+  cond_.notify_one();
+}
+
+void WeightPrefetcher::Loop() {
+  unsigned char sink = 0;
+  while (true) {
+    int64_t op_idx = -1;
+    uint64_t generation = 0;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cond_.wait(lock, [this] { return stop_ || next_op_ >= 0; });
+      if (stop_) {
+        break;
+      }
+      op_idx = next_op_;
+      next_op_ = -1;
+      generation = generation_;
+    }
+    for (const Region &region : regions_[op_idx]) {
+      for (int64_t offset = 0; offset < region.bytes;
+           offset += kCacheLineBytes) {
+        // loads rather than prefetch hints, which the cores may drop
+        sink ^= *static_cast<const volatile unsigned char *>(
+            region.data + offset);
+        if (offset % kCheckBytes == 0 && generation_ != generation) {
+          break;
+        }
+      }
+      if (generation_ != generation) {
+        break;
+      }
+    }
+  }
+  VLOG(3) << "Prefetch checksum " << static_cast<int>(sink);
+}
+
+}  // namespace mace
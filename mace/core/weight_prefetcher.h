@@ -0,0 +1,77 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_CORE_WEIGHT_PREFETCHER_H_
+#define MACE_CORE_WEIGHT_PREFETCHER_H_
+
+#include <atomic>
+#include <condition_variable>  // NOLINT(build/c++11)
+#include <memory>
+#include <mutex>  // NOLINT(build/c++11)
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "mace/core/op_observer.h"
+
+namespace mace {
+
+// Read the CPU weights of the next operation into the shared cache on a
+// helper thread while an operation runs, so that the large FullyConnected
+// and 1x1 Conv2D weights are not fetched from memory at the start of their
+// ops. An op gets at most budget_bytes of the heads of its weights, e.g.
+// half of the cache the cores share, the weights too small to stall on are
+// skipped. The weights the kernels repack are read from their packs, which
+// are not prefetched.
+class WeightPrefetcher : public OpObserver {
+ public:
+  WeightPrefetcher(const std::vector<std::unique_ptr<Operation>> &operators,
+                   int64_t budget_bytes);
+  ~WeightPrefetcher() override;
+
+  void BeforeOp(size_t op_idx,
+                Operation *op,
+                const OpContext *context) override;
+
+  // the budget of the shared cache of the device profile
+  static int64_t DefaultBudgetBytes();
+
+  // whether some op has weights to prefetch
+  bool empty() const { return prefetched_ops_ == 0; }
+
+ private:
+  struct Region {
+    const unsigned char *data;
+    int64_t bytes;
+  };
+
+  void Loop();
+
+  // the weights of each op to read
+  std::vector<std::vector<Region>> regions_;
+  int prefetched_ops_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  // the op to read the weights of, -1 if none; a later request abandons
+  // the reads of the earlier one
+  int64_t next_op_;
+  std::atomic<uint64_t> generation_;
+  bool stop_;
+  std::thread thread_;
+
+  MACE_DISABLE_COPY_AND_ASSIGN(WeightPrefetcher);
+};
+
+}  // namespace mace
+
+#endif  // MACE_CORE_WEIGHT_PREFETCHER_H_
@@ -14,41 +14,258 @@
 
 #include "mace/core/workspace.h"
 
+#include <unistd.h>
+
+#if defined(MACE_ENABLE_NEON)
+#include <arm_neon.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <unordered_map>
 #include <unordered_set>
 #include <utility>
+#include <vector>
 
 #include "mace/core/arg_helper.h"
 #include "mace/core/memory_optimizer.h"
+#include "mace/core/model_weights.h"
 #include "mace/utils/quantize.h"
+#include "mace/utils/system_trace.h"
 
 #ifdef MACE_ENABLE_OPENCL
 #include "mace/core/runtime/opencl/opencl_runtime.h"
+#include "mace/core/runtime/opencl/scratch_image.h"
 #endif
 
 namespace mace {
 
 namespace {
-bool HasQuantizedTensor(const NetDef &net_def) {
-  for (auto &tensor : net_def.tensors()) {
-    if (tensor.quantized()) {
-      return true;
+// the bytes of the memory of a buffer, an image holds RGBA pixels
+int64_t MemoryBytes(const BufferBase *buffer) {
+  return buffer->buffer_type() == core::BufferType::BT_IMAGE ?
+         buffer->size() * 4 : buffer->size();
+}
+
+std::string MemoryTypeName(const BufferBase *buffer) {
+  if (buffer->buffer_type() == core::BufferType::BT_IMAGE) {
+    return "GPU_IMAGE";
+  }
+  return buffer->OnHost() ? "CPU_BUFFER" : "GPU_BUFFER";
+}
+
+// add the buffer to the totals of its memory type and of the category
+void AddMemory(const BufferBase *buffer,
+               int64_t *category_bytes,
+               EngineMemoryStats *stats) {
+  const int64_t bytes = MemoryBytes(buffer);
+  if (buffer->buffer_type() == core::BufferType::BT_IMAGE) {
+    stats->gpu_image_bytes += bytes;
+  } else if (buffer->OnHost()) {
+    stats->cpu_buffer_bytes += bytes;
+  } else {
+    stats->gpu_buffer_bytes += bytes;
+  }
+  *category_bytes += bytes;
+}
+
+// the halves expanded to float per thread by blocks of this many
+const index_t kHalfBlockSize = 16384;
+
+// Expands the half weights to float, with the conversion of NEON on arm64.
+void HalfToFloat(const half *src, const index_t size, float *dst) {
+  const index_t block_count = RoundUpDiv(size, kHalfBlockSize);
+#pragma omp parallel for schedule(runtime)
+  for (index_t b = 0; b < block_count; ++b) {
+    const index_t end = std::min(size, (b + 1) * kHalfBlockSize);
+    index_t i = b * kHalfBlockSize;
+#if defined(MACE_ENABLE_NEON) && defined(__aarch64__)
+    for (; i + 8 <= end; i += 8) {
+      const uint16x8_t v =
+          vld1q_u16(reinterpret_cast<const uint16_t *>(src + i));
+      vst1q_f32(dst + i,
+                vcvt_f32_f16(vreinterpret_f16_u16(vget_low_u16(v))));
+      vst1q_f32(dst + i + 4,
+                vcvt_f32_f16(vreinterpret_f16_u16(vget_high_u16(v))));
+    }
+#endif
+    for (; i < end; ++i) {
+      dst[i] = half_float::half_cast<float>(src[i]);
     }
   }
-  return false;
 }
 
-bool HasHalfTensor(const NetDef &net_def) {
-  for (auto &tensor : net_def.tensors()) {
-    if (tensor.data_type() == DataType::DT_HALF) {
-      return true;
+// Float copy of a half, uint8 or palettized weight, filled when an op first
+// reads it.
+BufferBase *CreateExpandedWeight(const ConstTensor &const_tensor,
+                                 Allocator *allocator,
+                                 const unsigned char *model_data) {
+  index_t size = const_tensor.data_size();
+  const unsigned char *src = model_data + const_tensor.offset();
+  LazyBuffer::Filler filler;
+  if (const_tensor.palette_size() > 0) {
+    size = 1;
+    for (auto dim : const_tensor.dims()) {
+      size *= dim;
+    }
+    const int bits = const_tensor.palette_bits();
+    MACE_CHECK(bits >= 1 && bits <= 8 &&
+                   const_tensor.palette_size() <= (1 << bits),
+               const_tensor.name(), " has ", const_tensor.palette_size(),
+               " palette values for indices of ", bits, " bits");
+    MACE_CHECK(const_tensor.data_size() * 8 >= size * bits,
+               const_tensor.name(), " has ", const_tensor.data_size(),
+               " bytes for ", size, " indices of ", bits, " bits");
+    // the indices past the palette read 0
+    std::vector<float> palette(const_tensor.palette().begin(),
+                               const_tensor.palette().end());
+    palette.resize(1 << bits, 0.f);
+    filler = [src, size, bits, palette](void *dst) {
+      float *dst_data = static_cast<float *>(dst);
+      const uint32_t mask = (1u << bits) - 1;
+      for (index_t i = 0; i < size; ++i) {
+        const index_t bit = i * bits;
+        const unsigned char *byte = src + (bit >> 3);
+        const int shift = static_cast<int>(bit & 7);
+        uint32_t index = static_cast<uint32_t>(byte[0]) >> shift;
+        if (shift + bits > 8) {
+          index |= static_cast<uint32_t>(byte[1]) << (8 - shift);
+        }
+        dst_data[i] = palette[index & mask];
+      }
+    };
+  } else if (const_tensor.data_type() == DataType::DT_HALF) {
+    filler = [src, size](void *dst) {
+      HalfToFloat(reinterpret_cast<const half *>(src), size,
+                  static_cast<float *>(dst));
+    };
+  } else if (const_tensor.scales_size() > 0) {
+    // value i is of channel (i / inner_size) % channels of the quantize axis
+    const std::vector<float> scales(const_tensor.scales().begin(),
+                                    const_tensor.scales().end());
+    const int32_t zero_point = const_tensor.zero_point();
+    const index_t channels = const_tensor.dims(const_tensor.quantize_axis());
+    index_t inner_size = 1;
+    for (int i = const_tensor.quantize_axis() + 1;
+         i < const_tensor.dims_size(); ++i) {
+      inner_size *= const_tensor.dims(i);
+    }
+    MACE_CHECK(static_cast<index_t>(scales.size()) == channels,
+               const_tensor.name(), " has ", scales.size(), " scales for ",
+               channels, " channels");
+    filler = [src, size, scales, zero_point, channels, inner_size](
+        void *dst) {
+      auto org_data = reinterpret_cast<const uint8_t *>(src);
+      float *dst_data = static_cast<float *>(dst);
+      for (index_t i = 0; i < size; ++i) {
+        dst_data[i] = scales[(i / inner_size) % channels]
+            * (org_data[i] - zero_point);
+      }
+    };
+  } else {
+    const float scale = const_tensor.scale();
+    const int32_t zero_point = const_tensor.zero_point();
+    filler = [src, size, scale, zero_point](void *dst) {
+      Dequantize(reinterpret_cast<const uint8_t *>(src), size, scale,
+                 zero_point, static_cast<float *>(dst));
+    };
+  }
+  return new LazyBuffer(allocator,
+                        PadAlignSize(size * sizeof(float) +
+                                     MACE_EXTRA_BUFFER_PAD_SIZE),
+                        filler);
+}
+
+// The tables only read by Gather, which expands the gathered rows of fp16 and
+// uint8 tables itself, so the tables stay in the model data.
+std::unordered_set<std::string> GatheredTables(const NetDef &net_def) {
+  std::unordered_map<std::string, bool> gathered;
+  for (auto &op : net_def.op()) {
+    for (int i = 0; i < op.input_size(); ++i) {
+      const bool is_table = op.type() == "Gather" && i == 0;
+      auto iter = gathered.emplace(op.input(i), is_table).first;
+      iter->second = iter->second && is_table;
+    }
+  }
+  std::unordered_set<std::string> tables;
+  for (auto &table : gathered) {
+    if (table.second) {
+      tables.insert(table.first);
     }
   }
-  return false;
+  return tables;
+}
+
+// The attributes of a constant tensor but its name and data, which must
+// match for one tensor to take the place of another.
+std::string ConstTensorAttributes(const ConstTensor &const_tensor) {
+  ConstTensor attributes(const_tensor);
+  attributes.clear_name();
+  attributes.clear_offset();
+  attributes.clear_node_id();
+  attributes.clear_float_data();
+  attributes.clear_int32_data();
+  return attributes.SerializeAsString();
+}
+
+// Find the duplicates of the constant tensors, e.g. the tied weights of a
+// model or the equal biases of its layers. data_origin holds the first
+// tensor of the same bytes of each tensor and origin the first one of the
+// same bytes and attributes, which the tensor aliases. The converter stores
+// the duplicates once, sharing the offset, the bytes of older model data
+// are compared to those of the same size, which unlike a hash reads the
+// pages of the mapped data only until the first difference.
+void FindDuplicateConstTensors(const NetDef &net_def,
+                               const unsigned char *model_data,
+                               std::vector<int> *data_origin,
+                               std::vector<int> *origin) {
+  const int num_tensors = net_def.tensors_size();
+  data_origin->resize(num_tensors);
+  origin->resize(num_tensors);
+  std::unordered_map<index_t, std::vector<int>> tensors_of_bytes;
+  std::unordered_map<std::string, int> attribute_origins;
+  for (int i = 0; i < num_tensors; ++i) {
+    const ConstTensor &const_tensor = net_def.tensors(i);
+    const index_t bytes = const_tensor.data_size() *
+        GetEnumTypeSize(const_tensor.data_type());
+    (*data_origin)[i] = i;
+    (*origin)[i] = i;
+    if (bytes == 0) {
+      continue;
+    }
+    std::vector<int> &same_bytes = tensors_of_bytes[bytes];
+    for (int j : same_bytes) {
+      const ConstTensor &other = net_def.tensors(j);
+      if (other.offset() == const_tensor.offset() ||
+          memcmp(model_data + other.offset(),
+                 model_data + const_tensor.offset(), bytes) == 0) {
+        (*data_origin)[i] = j;
+        break;
+      }
+    }
+    if ((*data_origin)[i] == i) {
+      same_bytes.push_back(i);
+      continue;
+    }
+    // the attributes are only compared among the tensors of the same data
+    const int first = (*data_origin)[i];
+    attribute_origins.emplace(
+        MakeString(first, "/", ConstTensorAttributes(net_def.tensors(first))),
+        first);
+    (*origin)[i] = attribute_origins.emplace(
+        MakeString(first, "/", ConstTensorAttributes(const_tensor)),
+        i).first->second;
+  }
 }
 
 }  // namespace
 
-Workspace::Workspace() = default;
+Workspace::Workspace()
+    : released_arena_size_(0),
+      packed_weights_(new PackedWeights),
+      algorithm_cache_(new AlgorithmCache),
+      diffused_buffer_(false) {}
 
 Tensor *Workspace::CreateTensor(const std::string &name,
                                 Allocator *alloc,
@@ -90,8 +307,35 @@ MaceStatus Workspace::LoadModelTensor(const NetDef &net_def,
                                       Device *device,
                                       const unsigned char *model_data) {
   MACE_LATENCY_LOGGER(1, "Load model tensors");
+  MACE_SYSTEM_TRACE("Workspace::LoadModelTensor");
+  if (model_weights_ != nullptr && device->device_type() == DeviceType::CPU) {
+    return ShareModelTensor(net_def, device, model_data);
+  }
   index_t model_data_size = 0;
   for (auto &const_tensor : net_def.tensors()) {
+    if (const_tensor.palette_size() > 0 &&
+        device->device_type() != DeviceType::CPU) {
+      return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                        "palettized weights are only expanded on CPU: " +
+                            const_tensor.name());
+    }
+    // the weights of a bad model are an error rather than a crash, so
+    // that an engine loading it as its next model keeps the current one
+    if (const_tensor.palette_size() == 0) {
+      index_t size = 1;
+      for (auto dim : const_tensor.dims()) {
+        size *= dim;
+      }
+      if (size != const_tensor.data_size()) {
+        return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                          MakeString(const_tensor.name(), " has ",
+                                     const_tensor.data_size(),
+                                     " values for the shape ",
+                                     MakeString(std::vector<index_t>(
+                                         const_tensor.dims().begin(),
+                                         const_tensor.dims().end()))));
+      }
+    }
     model_data_size = std::max(
         model_data_size,
         static_cast<index_t>(const_tensor.offset() +
@@ -104,16 +348,26 @@ MaceStatus Workspace::LoadModelTensor(const NetDef &net_def,
 
   if (model_data_size > 0) {
     bool is_quantize_model = IsQuantizedModel(net_def);
-    diffused_buffer_ = (device_type == DeviceType::CPU &&
-        (HasHalfTensor(net_def) ||
-            (!is_quantize_model && HasQuantizedTensor(net_def))));
+    std::vector<int> data_origin;
+    std::vector<int> origin;
+    FindDuplicateConstTensors(net_def, model_data, &data_origin, &origin);
+    const_tensor_data_origins_ = data_origin;
+    const_tensor_origins_.clear();
+    for (int i = 0; i < net_def.tensors_size(); ++i) {
+      if (origin[i] != i) {
+        const_tensor_origins_[net_def.tensors(i).name()] =
+            net_def.tensors(origin[i]).name();
+      }
+    }
+    diffused_buffer_ = false;
 #ifdef MACE_ENABLE_OPENCL
-    diffused_buffer_ = diffused_buffer_ || (device_type == DeviceType::GPU &&
+    diffused_buffer_ = device_type == DeviceType::GPU &&
         device->gpu_runtime()->opencl_runtime()->GetDeviceMaxMemAllocSize() <=
-            static_cast<uint64_t>(model_data_size));
+            static_cast<uint64_t>(model_data_size);
 #endif
     if (diffused_buffer_) {
-      for (auto &const_tensor : net_def.tensors()) {
+      for (int i = 0; i < net_def.tensors_size(); ++i) {
+        const ConstTensor &const_tensor = net_def.tensors(i);
         MACE_LATENCY_LOGGER(2, "Load tensor ", const_tensor.name());
         VLOG(3) << "Tensor name: " << const_tensor.name()
                 << ", data type: " << const_tensor.data_type() << ", shape: "
@@ -124,14 +378,20 @@ MaceStatus Workspace::LoadModelTensor(const NetDef &net_def,
           dims.push_back(d);
         }
 
-        DataType dst_data_type = const_tensor.data_type();
-        if (device_type == DeviceType::CPU &&
-            const_tensor.data_type() == DataType::DT_HALF) {
-          dst_data_type = DataType::DT_FLOAT;
+        if (data_origin[i] != i) {
+          // a view of the buffer of the tensor of the same bytes
+          const Tensor *shared =
+              GetTensor(net_def.tensors(data_origin[i]).name());
+          std::unique_ptr<Tensor> tensor(
+              new Tensor(shared->UnderlyingBuffer(), const_tensor.data_type(),
+                         true, const_tensor.name()));
+          tensor->Reshape(dims);
+          tensor_map_[const_tensor.name()] = std::move(tensor);
+          continue;
         }
 
         std::unique_ptr<Tensor> tensor(
-            new Tensor(device->allocator(), dst_data_type, true,
+            new Tensor(device->allocator(), const_tensor.data_type(), true,
                        const_tensor.name()));
         tensor->Resize(dims);
 
@@ -147,46 +407,56 @@ MaceStatus Workspace::LoadModelTensor(const NetDef &net_def,
                    ") should <= ",
                    model_data_size);
 
-        if (device_type == DeviceType::CPU) {
-          if (const_tensor.data_type() == DataType::DT_HALF) {
-            // uncompress the weights of fp16
-            auto org_data = reinterpret_cast<const half *>(
-                model_data + const_tensor.offset());
-            float *dst_data = tensor->mutable_data<float>();
-            for (int i = 0; i < const_tensor.data_size(); ++i) {
-              dst_data[i] = half_float::half_cast<float>(org_data[i]);
-            }
-          } else if (!is_quantize_model && const_tensor.quantized()) {
-            // uncompress the weights of uint8
-            std::unique_ptr<Tensor> dequantized_tensor(new Tensor(true));
-            dequantized_tensor->Resize(dims);
-            auto quantized_data = reinterpret_cast<const uint8_t *>(
-                model_data + const_tensor.offset());
-            auto dequantized_data = tensor->mutable_data<float>();
-            Dequantize(quantized_data,
-                       tensor->size(),
-                       const_tensor.scale(),
-                       const_tensor.zero_point(),
-                       dequantized_data);
-          } else {
-            tensor->CopyBytes(model_data + const_tensor.offset(),
-                              const_tensor.data_size() *
-                                  GetEnumTypeSize(const_tensor.data_type()));
-          }
-        } else {
-          tensor->CopyBytes(model_data + const_tensor.offset(),
-                            const_tensor.data_size() *
-                                GetEnumTypeSize(const_tensor.data_type()));
-        }
+        tensor->CopyBytes(model_data + const_tensor.offset(),
+                          const_tensor.data_size() *
+                              GetEnumTypeSize(const_tensor.data_type()));
 
         tensor_map_[const_tensor.name()] = std::move(tensor);
       }
     } else {
+      // the offsets of the data of the tensors in tensor_buffer_, the same
+      // for the duplicates
+      std::vector<index_t> offsets(net_def.tensors_size());
+      bool has_copies = false;
+      for (int i = 0; i < net_def.tensors_size(); ++i) {
+        offsets[i] = net_def.tensors(data_origin[i]).offset();
+        has_copies = has_copies || offsets[i] != net_def.tensors(i).offset();
+      }
       if (device_type == DeviceType::CPU) {
+        // weights are views of the model data, which must outlive us
         tensor_buffer_ = std::unique_ptr<Buffer>(
             new Buffer(device->allocator(),
                        const_cast<unsigned char*>(model_data),
                        model_data_size));
+      } else if (has_copies) {
+        // copy the data of each tensor of distinct bytes once
+        index_t buffer_size = 0;
+        for (int i = 0; i < net_def.tensors_size(); ++i) {
+          if (data_origin[i] == i) {
+            offsets[i] = RoundUp<index_t>(buffer_size, 4);
+            buffer_size = offsets[i] + net_def.tensors(i).data_size() *
+                GetEnumTypeSize(net_def.tensors(i).data_type());
+          } else {
+            offsets[i] = offsets[data_origin[i]];
+          }
+        }
+        VLOG(1) << "Share the data of duplicate tensors, "
+                << model_data_size - buffer_size << " bytes saved";
+        tensor_buffer_ = std::unique_ptr<Buffer>(
+            new Buffer(device->allocator()));
+        MACE_RETURN_IF_ERROR(tensor_buffer_->Allocate(buffer_size));
+        tensor_buffer_->Map(nullptr);
+        for (int i = 0; i < net_def.tensors_size(); ++i) {
+          const ConstTensor &const_tensor = net_def.tensors(i);
+          if (data_origin[i] == i) {
+            tensor_buffer_->Copy(
+                const_cast<unsigned char*>(model_data) + const_tensor.offset(),
+                offsets[i],
+                const_tensor.data_size() *
+                    GetEnumTypeSize(const_tensor.data_type()));
+          }
+        }
+        tensor_buffer_->UnMap();
       } else {
         tensor_buffer_ = std::unique_ptr<Buffer>(
             new Buffer(device->allocator()));
@@ -196,7 +466,12 @@ MaceStatus Workspace::LoadModelTensor(const NetDef &net_def,
                              0, model_data_size);
         tensor_buffer_->UnMap();
       }
-      for (auto &const_tensor : net_def.tensors()) {
+      const std::unordered_set<std::string> gathered_tables =
+          GatheredTables(net_def);
+      // the expanded weight of each tensor, shared by its aliases
+      std::unordered_map<int, BufferBase *> expanded_weights;
+      for (int i = 0; i < net_def.tensors_size(); ++i) {
+        const ConstTensor &const_tensor = net_def.tensors(i);
         MACE_LATENCY_LOGGER(2, "Load tensor ", const_tensor.name());
         VLOG(3) << "Tensor name: " << const_tensor.name()
                 << ", data type: " << const_tensor.data_type() << ", shape: "
@@ -207,18 +482,53 @@ MaceStatus Workspace::LoadModelTensor(const NetDef &net_def,
           dims.push_back(d);
         }
 
-        std::unique_ptr<Tensor> tensor(
-            new Tensor(BufferSlice(
-                tensor_buffer_.get(), const_tensor.offset(),
-                const_tensor.data_size() *
-                    GetEnumTypeSize(const_tensor.data_type())),
-                       const_tensor.data_type(),
-                       true,
-                       const_tensor.name()));
+        // Gather reads the per-channel scales of the first dim only, and half
+        // tensors are only supported along with opencl or fp16 neon
+        bool gathered = gathered_tables.count(const_tensor.name()) > 0
+            && const_tensor.palette_size() == 0
+            && (const_tensor.scales_size() == 0
+                || const_tensor.quantize_axis() == 0);
+#if !defined(MACE_ENABLE_OPENCL) && !defined(MACE_ENABLE_FP16_NEON)
+        gathered = gathered && const_tensor.data_type() != DataType::DT_HALF;
+#endif
+        std::unique_ptr<Tensor> tensor;
+        if (device_type == DeviceType::CPU && !gathered &&
+            (const_tensor.data_type() == DataType::DT_HALF ||
+                const_tensor.palette_size() > 0 ||
+                (!is_quantize_model && const_tensor.quantized()))) {
+          // CPU ops need float weights, expand them on the first use
+          auto shared = expanded_weights.find(origin[i]);
+          if (shared != expanded_weights.end()) {
+            tensor.reset(new Tensor(shared->second, DataType::DT_FLOAT,
+                                    true, const_tensor.name()));
+          } else {
+            std::unique_ptr<BufferBase> weight_buf(
+                CreateExpandedWeight(const_tensor, device->allocator(),
+                                     model_data));
+            tensor.reset(new Tensor(weight_buf.get(), DataType::DT_FLOAT,
+                                    true, const_tensor.name()));
+            expanded_weights.emplace(origin[i], weight_buf.get());
+            expanded_weight_buffers_.push_back(std::move(weight_buf));
+          }
+        } else {
+          tensor.reset(new Tensor(BufferSlice(
+              tensor_buffer_.get(), offsets[i],
+              const_tensor.data_size() *
+                  GetEnumTypeSize(const_tensor.data_type())),
+                                  const_tensor.data_type(),
+                                  true,
+                                  const_tensor.name()));
+        }
 
         tensor->Reshape(dims);
-        tensor->SetScale(const_tensor.scale());
-        tensor->SetZeroPoint(const_tensor.zero_point());
+        if (tensor->dtype() == const_tensor.data_type()) {
+          tensor->SetScale(const_tensor.scale());
+          tensor->SetZeroPoint(const_tensor.zero_point());
+          if (const_tensor.scales_size() > 0) {
+            tensor->SetScales(std::vector<float>(
+                const_tensor.scales().begin(), const_tensor.scales().end()));
+          }
+        }
 
         tensor_map_[const_tensor.name()] = std::move(tensor);
       }
@@ -227,20 +537,65 @@ MaceStatus Workspace::LoadModelTensor(const NetDef &net_def,
   return MaceStatus::MACE_SUCCESS;
 }
 
+MaceStatus Workspace::ShareModelTensor(const NetDef &net_def,
+                                       Device *device,
+                                       const unsigned char *model_data) {
+  if (model_data != model_weights_->model_data()) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      "the engine must be created from the model data of"
+                      " its model weights");
+  }
+  const Workspace *weights = nullptr;
+  MACE_RETURN_IF_ERROR(model_weights_->Load(net_def, device, &weights));
+  for (auto &const_tensor : net_def.tensors()) {
+    const Tensor *weight = weights->GetTensor(const_tensor.name());
+    if (weight == nullptr) {
+      return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                        MakeString("model weights have no ",
+                                   const_tensor.name(),
+                                   ", they are of another model"));
+    }
+    std::unique_ptr<Tensor> tensor(new Tensor(weight->UnderlyingBuffer(),
+                                              weight->dtype(), true,
+                                              const_tensor.name()));
+    tensor->Reshape(weight->shape());
+    tensor->SetScale(weight->scale());
+    tensor->SetZeroPoint(weight->zero_point());
+    if (!weight->scales().empty()) {
+      tensor->SetScales(weight->scales());
+    }
+    tensor_map_[const_tensor.name()] = std::move(tensor);
+  }
+  return MaceStatus::MACE_SUCCESS;
+}
+
 MaceStatus Workspace::PreallocateOutputTensor(
     const mace::NetDef &net_def,
     const mace::MemoryOptimizer *mem_optimizer,
     Device *device) {
   auto &mem_blocks = mem_optimizer->mem_blocks();
+  std::unique_ptr<BufferBase> cpu_arena;
+  if (mem_optimizer->arena_size() > 0) {
+    VLOG(1) << "Preallocate CPU arena, size: "
+            << mem_optimizer->arena_size();
+    // the CPU ops of the other devices take the global CPU allocator, but
+    // those of a net partitioned between the DSP and CPU share the arena
+    // with the DSP
+    cpu_arena.reset(new Buffer(device->device_type() == DeviceType::CPU ||
+                               device->device_type() == DeviceType::HEXAGON ?
+                               device->allocator() : GetCPUAllocator()));
+    MACE_RETURN_IF_ERROR(cpu_arena->Allocate(mem_optimizer->arena_size()));
+  }
   for (auto &mem_block : mem_blocks) {
     VLOG(3) << "Preallocate memory block. id: " << mem_block.mem_id()
             << ", memory type: " << mem_block.mem_type()
             << ", size: " << mem_block.x() << "x" << mem_block.y();
     if (mem_block.mem_type() == MemoryType::CPU_BUFFER) {
+      MACE_CHECK_NOTNULL(cpu_arena);
       std::unique_ptr<BufferBase> tensor_buf(
-          new Buffer(GetCPUAllocator()));
-      MACE_RETURN_IF_ERROR(tensor_buf->Allocate(
-          mem_block.x() + MACE_EXTRA_BUFFER_PAD_SIZE));
+          new BufferSlice(cpu_arena.get(),
+                          mem_block.offset(),
+                          MemoryOptimizer::ArenaBlockSize(mem_block)));
       preallocated_allocator_.SetBuffer(mem_block.mem_id(),
                                         std::move(tensor_buf));
     } else if (mem_block.mem_type() == MemoryType::GPU_IMAGE) {
@@ -260,12 +615,26 @@ MaceStatus Workspace::PreallocateOutputTensor(
                                         std::move(tensor_buf));
     }
   }
+  if (cpu_arena != nullptr) {
+    cpu_arena_ = std::move(cpu_arena);
+  }
   VLOG(1) << "Preallocate buffer to tensors";
   bool is_quantize_model = IsQuantizedModel(net_def);
+  auto &tensor_views = mem_optimizer->tensor_views();
   for (auto &tensor_mem : mem_optimizer->tensor_mem_map()) {
+    BufferBase *buffer =
+        preallocated_allocator_.GetBuffer(tensor_mem.second.first);
+    auto view = tensor_views.find(tensor_mem.first);
+    if (view != tensor_views.end() && view->second > 0) {
+      // a slice of another tensor, see MemoryOptimizer::PlanConcatViews
+      const MemoryBlock &mem_block = mem_blocks[tensor_mem.second.first];
+      tensor_view_buffers_.emplace_back(new BufferSlice(
+          cpu_arena_.get(), mem_block.offset() + view->second,
+          MemoryOptimizer::ArenaBlockSize(mem_block) - view->second));
+      buffer = tensor_view_buffers_.back().get();
+    }
     std::unique_ptr<Tensor> tensor
-        (new Tensor(preallocated_allocator_.GetBuffer(tensor_mem.second.first),
-                    tensor_mem.second.second,
+        (new Tensor(buffer, tensor_mem.second.second,
                     false, tensor_mem.first));
     if (mem_blocks[tensor_mem.second.first].mem_type()
         == MemoryType::GPU_IMAGE) {
@@ -293,21 +662,22 @@ MaceStatus Workspace::PreallocateOutputTensor(
     tensor_map_[tensor_mem.first] = std::move(tensor);
   }
 
-  // add quantize info for output tensors.
-  if (device->device_type() == DeviceType::CPU) {
-    for (const auto &op : net_def.op()) {
-      VLOG(2) << "Add quantize info for op: " << op.name();
-      MACE_CHECK(op.quantize_info().empty()
-                     || op.quantize_info().size() == op.output().size(),
-                 "quantize info size must be equal to output size or empty");
-      for (int i = 0; i < op.quantize_info().size(); ++i) {
-        auto &quantize_info = op.quantize_info(i);
-        Tensor *tensor = GetTensor(op.output(i));
-        tensor->SetScale(quantize_info.scale());
-        tensor->SetZeroPoint(quantize_info.zero_point());
-        tensor->SetMinVal(quantize_info.minval());
-        tensor->SetMaxVal(quantize_info.maxval());
+  // add quantize info for output tensors, the quantized GPU ops use it too.
+  for (const auto &op : net_def.op()) {
+    VLOG(2) << "Add quantize info for op: " << op.name();
+    MACE_CHECK(op.quantize_info().empty()
+                   || op.quantize_info().size() == op.output().size(),
+               "quantize info size must be equal to output size or empty");
+    for (int i = 0; i < op.quantize_info().size(); ++i) {
+      auto &quantize_info = op.quantize_info(i);
+      Tensor *tensor = GetTensor(op.output(i));
+      if (tensor == nullptr) {
+        continue;
       }
+      tensor->SetScale(quantize_info.scale());
+      tensor->SetZeroPoint(quantize_info.zero_point());
+      tensor->SetMinVal(quantize_info.minval());
+      tensor->SetMaxVal(quantize_info.maxval());
     }
   }
 
@@ -337,49 +707,181 @@ void Workspace::RemoveAndReloadBuffer(const NetDef &net_def,
       }
     }
   }
-  for (auto &const_tensor : net_def.tensors()) {
+  // the tensor kept of the data of each tensor and its host expansion,
+  // shared by the tensors of the same bytes
+  std::map<std::pair<int, bool>, const Tensor *> kept_data;
+  std::vector<std::string> removed;
+  for (int i = 0; i < net_def.tensors_size(); ++i) {
+    const ConstTensor &const_tensor = net_def.tensors(i);
     auto iter = tensor_map_.find(const_tensor.name());
     if (iter->second->unused()) {
-      tensor_map_.erase(iter);
-    } else {
-      std::vector<index_t> dims;
-      for (const index_t d : const_tensor.dims()) {
-        dims.push_back(d);
+      // erased at last, a kept tensor of the same bytes may view it
+      removed.push_back(const_tensor.name());
+      continue;
+    }
+    std::vector<index_t> dims;
+    for (const index_t d : const_tensor.dims()) {
+      dims.push_back(d);
+    }
+    const bool to_host_half =
+        tensor_to_host.find(const_tensor.name()) != tensor_to_host.end()
+        && const_tensor.data_type() == DataType::DT_HALF;
+    const int data_origin = i < static_cast<int>(
+        const_tensor_data_origins_.size()) ?
+        const_tensor_data_origins_[i] : i;
+    auto kept = kept_data.find(std::make_pair(data_origin, to_host_half));
+    if (kept != kept_data.end()) {
+      std::unique_ptr<Tensor> tensor(
+          new Tensor(kept->second->UnderlyingBuffer(),
+                     to_host_half ? DataType::DT_FLOAT
+                                  : const_tensor.data_type(),
+                     true, const_tensor.name()));
+      tensor->Reshape(dims);
+      tensor->SetScale(iter->second->scale());
+      tensor->SetZeroPoint(iter->second->zero_point());
+      if (!iter->second->scales().empty()) {
+        tensor->SetScales(iter->second->scales());
       }
+      iter->second = std::move(tensor);
+      continue;
+    }
 
-      if (tensor_to_host.find(const_tensor.name()) != tensor_to_host.end()
-          && const_tensor.data_type() == DataType::DT_HALF) {
-        std::unique_ptr<Tensor> tensor(
-            new Tensor(alloc, DataType::DT_FLOAT,
-                       true, const_tensor.name()));
-        tensor->Resize(dims);
-        MACE_CHECK(tensor->size() == const_tensor.data_size(),
-                   "Tensor's data_size not equal with the shape");
-        Tensor::MappingGuard guard(tensor.get());
-        float *dst_data = tensor->mutable_data<float>();
-        const half *org_data = reinterpret_cast<const half *>(
-            model_data + const_tensor.offset());
-        for (index_t i = 0; i < const_tensor.data_size(); ++i) {
-          dst_data[i] = half_float::half_cast<float>(org_data[i]);
-        }
-        tensor_map_[const_tensor.name()] = std::move(tensor);
-      } else if (!diffused_buffer_) {
-        std::unique_ptr<Tensor> tensor(
-            new Tensor(alloc, const_tensor.data_type(),
-                       true, const_tensor.name()));
-        tensor->Resize(dims);
-        MACE_CHECK(tensor->size() == const_tensor.data_size(),
-                   "Tensor's data_size not equal with the shape");
-        tensor->CopyBytes(model_data + const_tensor.offset(),
-                          const_tensor.data_size() *
-                              GetEnumTypeSize(const_tensor.data_type()));
-        tensor_map_[const_tensor.name()] = std::move(tensor);
+    if (to_host_half) {
+      std::unique_ptr<Tensor> tensor(
+          new Tensor(alloc, DataType::DT_FLOAT,
+                     true, const_tensor.name()));
+      tensor->Resize(dims);
+      MACE_CHECK(tensor->size() == const_tensor.data_size(),
+                 "Tensor's data_size not equal with the shape");
+      Tensor::MappingGuard guard(tensor.get());
+      HalfToFloat(reinterpret_cast<const half *>(
+                      model_data + const_tensor.offset()),
+                  const_tensor.data_size(), tensor->mutable_data<float>());
+      iter->second = std::move(tensor);
+    } else if (!diffused_buffer_ || !iter->second->is_buffer_owner()) {
+      // a diffused view gets its own copy as the tensor it views may be
+      // erased
+      std::unique_ptr<Tensor> tensor(
+          new Tensor(alloc, const_tensor.data_type(),
+                     true, const_tensor.name()));
+      tensor->Resize(dims);
+      MACE_CHECK(tensor->size() == const_tensor.data_size(),
+                 "Tensor's data_size not equal with the shape");
+      tensor->CopyBytes(model_data + const_tensor.offset(),
+                        const_tensor.data_size() *
+                            GetEnumTypeSize(const_tensor.data_type()));
+      tensor->SetScale(iter->second->scale());
+      tensor->SetZeroPoint(iter->second->zero_point());
+      if (!iter->second->scales().empty()) {
+        tensor->SetScales(iter->second->scales());
       }
+      iter->second = std::move(tensor);
     }
+    kept_data.emplace(std::make_pair(data_origin, to_host_half),
+                      iter->second.get());
+  }
+  for (auto &name : removed) {
+    tensor_map_.erase(name);
   }
   tensor_buffer_.reset(nullptr);
 }
 
+void Workspace::GetMemoryStats(Device *device,
+                               EngineMemoryStats *stats) const {
+  *stats = EngineMemoryStats();
+  if (tensor_buffer_ != nullptr) {
+    AddMemory(tensor_buffer_.get(), &stats->weight_bytes, stats);
+  }
+  for (auto &buffer : expanded_weight_buffers_) {
+    AddMemory(buffer.get(), &stats->weight_bytes, stats);
+  }
+  if (cpu_arena_ != nullptr) {
+    AddMemory(cpu_arena_.get(), &stats->activation_bytes, stats);
+  }
+  for (auto &block : preallocated_allocator_.buffers()) {
+    // the host blocks are slices of the CPU arena
+    if (!block.second->OnHost()) {
+      AddMemory(block.second.get(), &stats->activation_bytes, stats);
+    }
+  }
+  for (auto &tensor : tensor_map_) {
+    const BufferBase *buffer = tensor.second->UnderlyingBuffer();
+    if (buffer == nullptr) {
+      continue;
+    }
+    if (tensor.second->is_buffer_owner()) {
+      AddMemory(buffer,
+                tensor.second->is_weight() ? &stats->weight_bytes
+                                           : &stats->other_tensor_bytes,
+                stats);
+    }
+    stats->tensors.push_back({tensor.first, MemoryTypeName(buffer),
+                              MemoryBytes(buffer), tensor.second->is_weight(),
+                              tensor.second->is_buffer_owner()});
+  }
+  if (device->scratch_buffer() != nullptr) {
+    AddMemory(device->scratch_buffer(), &stats->scratch_bytes, stats);
+  }
+#ifdef MACE_ENABLE_OPENCL
+  if (device->device_type() == DeviceType::GPU) {
+    const int64_t image_bytes =
+        device->gpu_runtime()->scratch_image_manager()->bytes();
+    stats->gpu_image_bytes += image_bytes;
+    stats->scratch_bytes += image_bytes;
+  }
+#endif  // MACE_ENABLE_OPENCL
+}
+
+void Workspace::ReleaseActivations() {
+  if (cpu_arena_ == nullptr || released_arena_size_ > 0) {
+    return;
+  }
+  VLOG(1) << "Release CPU arena, size: " << cpu_arena_->size();
+  released_arena_size_ = cpu_arena_->size();
+  // the blocks and the views are slices reading the data of the arena
+  static_cast<Buffer *>(cpu_arena_.get())->Release();
+}
+
+MaceStatus Workspace::ReacquireActivations() {
+  if (released_arena_size_ == 0) {
+    return MaceStatus::MACE_SUCCESS;
+  }
+  VLOG(1) << "Reacquire CPU arena, size: " << released_arena_size_;
+  MACE_RETURN_IF_ERROR(cpu_arena_->Allocate(released_arena_size_));
+  released_arena_size_ = 0;
+  return MaceStatus::MACE_SUCCESS;
+}
+
+index_t Workspace::PrefaultWeights() const {
+  const index_t page_size = sysconf(_SC_PAGESIZE);
+  index_t bytes = 0;
+  volatile uint8_t sink = 0;
+  // the aliases share the data of their origins
+  std::unordered_set<const void *> prefaulted;
+  for (auto &tensor : tensor_map_) {
+    const BufferBase *buffer = tensor.second->UnderlyingBuffer();
+    if (!tensor.second->is_weight() || buffer == nullptr ||
+        !buffer->OnHost() ||
+        !prefaulted.insert(tensor.second->raw_data()).second) {
+      continue;
+    }
+    const uint8_t *data =
+        reinterpret_cast<const uint8_t *>(tensor.second->raw_data());
+    const index_t size = tensor.second->raw_size();
+    for (index_t i = 0; i < size; i += page_size) {
+      sink = sink + data[i];
+    }
+    bytes += size;
+  }
+  return bytes;
+}
+
+const std::string &Workspace::ConstTensorOrigin(
+    const std::string &name) const {
+  auto iter = const_tensor_origins_.find(name);
+  return iter == const_tensor_origins_.end() ? name : iter->second;
+}
+
 void Workspace::RemoveTensor(const std::string &name) {
   auto iter = tensor_map_.find(name);
   if (iter != tensor_map_.end()) {
@@ -19,8 +19,11 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <utility>
 
+#include "mace/core/algorithm_cache.h"
 #include "mace/core/device.h"
+#include "mace/core/packed_weights.h"
 #include "mace/core/preallocated_pooled_allocator.h"
 #include "mace/core/tensor.h"
 #include "mace/public/mace.h"
@@ -28,6 +31,7 @@
 namespace mace {
 
 class MemoryOptimizer;
+class ModelWeights;
 
 class Workspace {
  public:
@@ -71,13 +75,101 @@ class Workspace {
 
   void RemoveTensor(const std::string &name);
 
+  // The first constant tensor of the same data and attributes as name, e.g.
+  // of the weights tied to it, which it aliases, or name itself.
+  const std::string &ConstTensorOrigin(const std::string &name) const;
+
+  // the tensor transformed of a weight by key, e.g. of its origin and the
+  // image type, shared by the ops transforming its aliases; empty if none
+  inline std::string TransformedWeight(const std::string &key) const {
+    auto iter = transformed_weights_.find(key);
+    return iter == transformed_weights_.end() ? "" : iter->second;
+  }
+
+  inline void AddTransformedWeight(const std::string &key,
+                                   const std::string &name) {
+    transformed_weights_[key] = name;
+  }
+
+  // Free the CPU arena of the activations, whose content is lost, until
+  // ReacquireActivations takes a new one before the next run. The GPU
+  // blocks are kept, the kernels bind their images once.
+  void ReleaseActivations();
+
+  MaceStatus ReacquireActivations();
+
+  // the memory held by the tensors and the scratch memory of the device
+  void GetMemoryStats(Device *device, EngineMemoryStats *stats) const;
+
+  // Read a byte of each page of the weights on the host, which faults in
+  // those mapped from the model data, and return their size in bytes.
+  index_t PrefaultWeights() const;
+
+  inline PackedWeights *packed_weights() const {
+    return packed_weights_.get();
+  }
+
+  // share the packs with other engines, call it before the ops are created
+  inline void set_packed_weights(
+      std::shared_ptr<PackedWeights> packed_weights) {
+    packed_weights_ = std::move(packed_weights);
+  }
+
+  // share the CPU weights of the model with its other engines, call it before
+  // LoadModelTensor
+  inline void set_model_weights(std::shared_ptr<ModelWeights> model_weights) {
+    model_weights_ = std::move(model_weights);
+  }
+
+  inline AlgorithmCache *algorithm_cache() const {
+    return algorithm_cache_.get();
+  }
+
+  // share the benchmarked algorithms with other engines, call it before the
+  // first run
+  inline void set_algorithm_cache(
+      std::shared_ptr<AlgorithmCache> algorithm_cache) {
+    algorithm_cache_ = std::move(algorithm_cache);
+  }
+
  private:
+  // the weights are views of the tensors of model_weights_
+  MaceStatus ShareModelTensor(const NetDef &net_def,
+                              Device *device,
+                              const unsigned char *model_data);
+
   TensorMap tensor_map_;
 
   std::unique_ptr<BufferBase> tensor_buffer_;
 
+  // float weights of CPU ops expanded from half or uint8 model data
+  std::vector<std::unique_ptr<BufferBase>> expanded_weight_buffers_;
+
+  // CPU memory blocks are slices of this buffer
+  std::unique_ptr<BufferBase> cpu_arena_;
+
+  // the size of the CPU arena while it is released, 0 while it is held
+  index_t released_arena_size_;
+
+  // slices of the CPU arena for the tensors which are views into a block
+  std::vector<std::unique_ptr<BufferBase>> tensor_view_buffers_;
+
   PreallocatedPooledAllocator preallocated_allocator_;
 
+  std::shared_ptr<PackedWeights> packed_weights_;
+
+  std::shared_ptr<AlgorithmCache> algorithm_cache_;
+
+  std::shared_ptr<ModelWeights> model_weights_;
+
+  // the origins of the constant tensors aliasing another
+  std::map<std::string, std::string> const_tensor_origins_;
+
+  // the first constant tensor of the same bytes of each one
+  std::vector<int> const_tensor_data_origins_;
+
+  std::map<std::string, std::string> transformed_weights_;
+
   bool diffused_buffer_;
 
   MACE_DISABLE_COPY_AND_ASSIGN(Workspace);
@@ -14,8 +14,11 @@
 
 #include "src/main/cpp/image_classify.h"
 
+#include <android/hardware_buffer.h>
 #include <android/log.h>
+#include <dlfcn.h>
 #include <jni.h>
+#include <pthread.h>
 
 #include <algorithm>
 #include <functional>
@@ -74,8 +77,144 @@ MaceContext& GetMaceContext() {
   return *mace_context;
 }
 
+const ModelInfo *GetModelInfo(const MaceContext &mace_context) {
+  auto model_info_iter =
+      mace_context.model_infos.find(mace_context.model_name);
+  if (model_info_iter == mace_context.model_infos.end()) {
+    __android_log_print(ANDROID_LOG_ERROR,
+                        "image_classify",
+                        "Invalid model name: %s",
+                        mace_context.model_name.c_str());
+    return nullptr;
+  }
+  return &model_info_iter->second;
+}
+
+int64_t ShapeSize(const std::vector<int64_t> &shape) {
+  return std::accumulate(shape.begin(), shape.end(), int64_t(1),
+                         std::multiplies<int64_t>());
+}
+
+// The JNI references cached by JNI_OnLoad.
+struct JniCache {
+  JavaVM *vm = nullptr;
+  jclass callback_class = nullptr;
+  jmethodID on_classified = nullptr;
+  // detaches the threads of the async callbacks when they exit
+  pthread_key_t detach_key;
+};
+
+JniCache &GetJniCache() {
+  static auto *jni_cache = new JniCache;
+  return *jni_cache;
+}
+
+void DetachThread(void *) {
+  GetJniCache().vm->DetachCurrentThread();
+}
+
+// the env of the calling thread, attached once until it exits
+JNIEnv *AttachedEnv() {
+  JniCache &jni_cache = GetJniCache();
+  JNIEnv *env = nullptr;
+  if (jni_cache.vm->GetEnv(reinterpret_cast<void **>(&env),
+                           JNI_VERSION_1_6) == JNI_OK) {
+    return env;
+  }
+  if (jni_cache.vm->AttachCurrentThread(&env, nullptr) != JNI_OK) {
+    return nullptr;
+  }
+  pthread_setspecific(jni_cache.detach_key, env);
+  return env;
+}
+
+// Wrap a direct java.nio.ByteBuffer of at least size floats, nullptr if it
+// is not direct or too small. The tensor reads and writes it in place, the
+// caller keeps it alive.
+std::shared_ptr<float> WrapDirectBuffer(JNIEnv *env, jobject buffer,
+                                        int64_t size) {
+  if (buffer == nullptr) return nullptr;
+  void *data = env->GetDirectBufferAddress(buffer);
+  jlong capacity = env->GetDirectBufferCapacity(buffer);
+  if (data == nullptr ||
+      capacity < size * static_cast<jlong>(sizeof(float))) {
+    __android_log_print(ANDROID_LOG_ERROR,
+                        "image_classify",
+                        "Expect a direct buffer of %lld floats",
+                        static_cast<long long>(size));  // NOLINT(runtime/int)
+    return nullptr;
+  }
+  return std::shared_ptr<float>(static_cast<float *>(data), [](float *) {});
+}
+
+// The AHardwareBuffer functions of API 26, looked up at runtime as the
+// library supports API 21.
+struct HardwareBufferApi {
+  AHardwareBuffer *(*from_hardware_buffer)(JNIEnv *, jobject) = nullptr;
+  void (*describe)(const AHardwareBuffer *, AHardwareBuffer_Desc *) = nullptr;
+  int (*lock)(AHardwareBuffer *, uint64_t, int32_t, const ARect *,
+              void **) = nullptr;
+  int (*unlock)(AHardwareBuffer *, int32_t *) = nullptr;
+};
+
+const HardwareBufferApi *GetHardwareBufferApi() {
+  static const HardwareBufferApi *api = []() -> const HardwareBufferApi * {
+    void *handle = dlopen("libandroid.so", RTLD_NOW | RTLD_LOCAL);
+    if (handle == nullptr) return nullptr;
+    auto *result = new HardwareBufferApi;
+    result->from_hardware_buffer =
+        reinterpret_cast<decltype(result->from_hardware_buffer)>(
+            dlsym(handle, "AHardwareBuffer_fromHardwareBuffer"));
+    result->describe = reinterpret_cast<decltype(result->describe)>(
+        dlsym(handle, "AHardwareBuffer_describe"));
+    result->lock = reinterpret_cast<decltype(result->lock)>(
+        dlsym(handle, "AHardwareBuffer_lock"));
+    result->unlock = reinterpret_cast<decltype(result->unlock)>(
+        dlsym(handle, "AHardwareBuffer_unlock"));
+    if (result->from_hardware_buffer == nullptr ||
+        result->describe == nullptr || result->lock == nullptr ||
+        result->unlock == nullptr) {
+      delete result;
+      return nullptr;
+    }
+    return result;
+  }();
+  return api;
+}
+
+// The buffers of an async run, alive until its callback.
+struct AsyncClassify {
+  jobject output_buffer;
+  jobject callback;
+  std::map<std::string, mace::MaceTensor> outputs;
+};
+
 }  // namespace
 
+JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM *vm, void *reserved) {
+  JNIEnv *env = nullptr;
+  if (vm->GetEnv(reinterpret_cast<void **>(&env), JNI_VERSION_1_6) !=
+      JNI_OK) {
+    return JNI_ERR;
+  }
+  JniCache &jni_cache = GetJniCache();
+  jni_cache.vm = vm;
+  // the class loader of the library finds the app classes only here
+  jclass callback_class =
+      env->FindClass("com/xiaomi/mace/JniMaceUtils$ClassifyCallback");
+  if (callback_class == nullptr) return JNI_ERR;
+  jni_cache.callback_class =
+      static_cast<jclass>(env->NewGlobalRef(callback_class));
+  env->DeleteLocalRef(callback_class);
+  jni_cache.on_classified = env->GetMethodID(jni_cache.callback_class,
+                                             "onClassified", "(I)V");
+  if (jni_cache.on_classified == nullptr) return JNI_ERR;
+  if (pthread_key_create(&jni_cache.detach_key, DetachThread) != 0) {
+    return JNI_ERR;
+  }
+  return JNI_VERSION_1_6;
+}
+
 JNIEXPORT jint JNICALL
 Java_com_xiaomi_mace_JniMaceUtils_maceMobilenetCreateGPUContext(
     JNIEnv *env, jclass thisObj, jstring storage_path) {
@@ -179,26 +318,14 @@ Java_com_xiaomi_mace_JniMaceUtils_maceMobilenetClassify(
     JNIEnv *env, jclass thisObj, jfloatArray input_data) {
   MaceContext &mace_context = GetMaceContext();
   //  prepare input and output
-  auto model_info_iter =
-      mace_context.model_infos.find(mace_context.model_name);
-  if (model_info_iter == mace_context.model_infos.end()) {
-    __android_log_print(ANDROID_LOG_ERROR,
-                        "image_classify",
-                        "Invalid model name: %s",
-                        mace_context.model_name.c_str());
-    return nullptr;
-  }
-  const ModelInfo &model_info = model_info_iter->second;
-  const std::string &input_name = model_info.input_name;
-  const std::string &output_name = model_info.output_name;
-  const std::vector<int64_t> &input_shape = model_info.input_shape;
-  const std::vector<int64_t> &output_shape = model_info.output_shape;
-  const int64_t input_size =
-      std::accumulate(input_shape.begin(), input_shape.end(), 1,
-                      std::multiplies<int64_t>());
-  const int64_t output_size =
-      std::accumulate(output_shape.begin(), output_shape.end(), 1,
-                      std::multiplies<int64_t>());
+  const ModelInfo *model_info = GetModelInfo(mace_context);
+  if (model_info == nullptr) return nullptr;
+  const std::string &input_name = model_info->input_name;
+  const std::string &output_name = model_info->output_name;
+  const std::vector<int64_t> &input_shape = model_info->input_shape;
+  const std::vector<int64_t> &output_shape = model_info->output_shape;
+  const int64_t input_size = ShapeSize(input_shape);
+  const int64_t output_size = ShapeSize(output_shape);
 
   //  load input
   jfloat *input_data_ptr = env->GetFloatArrayElements(input_data, nullptr);
@@ -231,3 +358,126 @@ Java_com_xiaomi_mace_JniMaceUtils_maceMobilenetClassify(
 
   return jOutputData;
 }
+
+JNIEXPORT jint JNICALL
+Java_com_xiaomi_mace_JniMaceUtils_maceMobilenetClassifyBuffer(
+    JNIEnv *env, jclass thisObj, jobject input_buffer, jobject output_buffer) {
+  MaceContext &mace_context = GetMaceContext();
+  const ModelInfo *model_info = GetModelInfo(mace_context);
+  if (model_info == nullptr || mace_context.engine == nullptr) return JNI_ERR;
+  std::shared_ptr<float> input_data = WrapDirectBuffer(
+      env, input_buffer, ShapeSize(model_info->input_shape));
+  std::shared_ptr<float> output_data = WrapDirectBuffer(
+      env, output_buffer, ShapeSize(model_info->output_shape));
+  if (input_data == nullptr || output_data == nullptr) return JNI_ERR;
+
+  std::map<std::string, mace::MaceTensor> inputs;
+  std::map<std::string, mace::MaceTensor> outputs;
+  inputs[model_info->input_name] =
+      mace::MaceTensor(model_info->input_shape, input_data);
+  outputs[model_info->output_name] =
+      mace::MaceTensor(model_info->output_shape, output_data);
+  return static_cast<jint>(mace_context.engine->Run(inputs, &outputs).code());
+}
+
+JNIEXPORT jint JNICALL
+Java_com_xiaomi_mace_JniMaceUtils_maceMobilenetClassifyHardwareBuffer(
+    JNIEnv *env, jclass thisObj, jobject input_hardware_buffer,
+    jobject output_buffer) {
+  MaceContext &mace_context = GetMaceContext();
+  const ModelInfo *model_info = GetModelInfo(mace_context);
+  const HardwareBufferApi *api = GetHardwareBufferApi();
+  if (model_info == nullptr || mace_context.engine == nullptr ||
+      api == nullptr || input_hardware_buffer == nullptr) {
+    return JNI_ERR;
+  }
+  const int64_t input_size = ShapeSize(model_info->input_shape);
+  std::shared_ptr<float> output_data = WrapDirectBuffer(
+      env, output_buffer, ShapeSize(model_info->output_shape));
+  if (output_data == nullptr) return JNI_ERR;
+
+  // a BLOB buffer of the floats, e.g. written by a camera or GPU producer
+  AHardwareBuffer *hardware_buffer =
+      api->from_hardware_buffer(env, input_hardware_buffer);
+  AHardwareBuffer_Desc desc;
+  api->describe(hardware_buffer, &desc);
+  if (desc.format != AHARDWAREBUFFER_FORMAT_BLOB ||
+      desc.width < input_size * sizeof(float)) {
+    __android_log_print(ANDROID_LOG_ERROR,
+                        "image_classify",
+                        "Expect a BLOB hardware buffer of %lld floats",
+                        static_cast<long long>(input_size));  // NOLINT
+    return JNI_ERR;
+  }
+  void *input_data = nullptr;
+  if (api->lock(hardware_buffer, AHARDWAREBUFFER_USAGE_CPU_READ_OFTEN, -1,
+                nullptr, &input_data) != 0) {
+    return JNI_ERR;
+  }
+
+  std::map<std::string, mace::MaceTensor> inputs;
+  std::map<std::string, mace::MaceTensor> outputs;
+  inputs[model_info->input_name] = mace::MaceTensor(
+      model_info->input_shape,
+      std::shared_ptr<float>(static_cast<float *>(input_data),
+                             [](float *) {}));
+  outputs[model_info->output_name] =
+      mace::MaceTensor(model_info->output_shape, output_data);
+  mace::MaceStatus status = mace_context.engine->Run(inputs, &outputs);
+  api->unlock(hardware_buffer, nullptr);
+  return static_cast<jint>(status.code());
+}
+
+JNIEXPORT jint JNICALL
+Java_com_xiaomi_mace_JniMaceUtils_maceMobilenetClassifyAsync(
+    JNIEnv *env, jclass thisObj, jobject input_buffer, jobject output_buffer,
+    jobject callback) {
+  MaceContext &mace_context = GetMaceContext();
+  const ModelInfo *model_info = GetModelInfo(mace_context);
+  if (model_info == nullptr || mace_context.engine == nullptr ||
+      callback == nullptr) {
+    return JNI_ERR;
+  }
+  std::shared_ptr<float> input_data = WrapDirectBuffer(
+      env, input_buffer, ShapeSize(model_info->input_shape));
+  std::shared_ptr<float> output_data = WrapDirectBuffer(
+      env, output_buffer, ShapeSize(model_info->output_shape));
+  if (input_data == nullptr || output_data == nullptr) return JNI_ERR;
+
+  // the input is consumed by RunAsync, the output is written until the
+  // callback
+  std::map<std::string, mace::MaceTensor> inputs;
+  inputs[model_info->input_name] =
+      mace::MaceTensor(model_info->input_shape, input_data);
+  auto *run = new AsyncClassify;
+  run->output_buffer = env->NewGlobalRef(output_buffer);
+  run->callback = env->NewGlobalRef(callback);
+  run->outputs[model_info->output_name] =
+      mace::MaceTensor(model_info->output_shape, output_data);
+
+  mace::MaceStatus status = mace_context.engine->RunAsync(
+      inputs, &run->outputs,
+      [run](const mace::MaceStatus &run_status) {
+        JNIEnv *callback_env = AttachedEnv();
+        if (callback_env != nullptr) {
+          callback_env->CallVoidMethod(run->callback,
+                                       GetJniCache().on_classified,
+                                       static_cast<jint>(run_status.code()));
+          if (callback_env->ExceptionCheck()) {
+            callback_env->ExceptionDescribe();
+            callback_env->ExceptionClear();
+          }
+          callback_env->DeleteGlobalRef(run->output_buffer);
+          callback_env->DeleteGlobalRef(run->callback);
+        }
+        delete run;
+      },
+      nullptr);
+  if (status != mace::MaceStatus::MACE_SUCCESS) {
+    // the callback is not called for a run not enqueued
+    env->DeleteGlobalRef(run->output_buffer);
+    env->DeleteGlobalRef(run->callback);
+    delete run;
+  }
+  return static_cast<jint>(status.code());
+}
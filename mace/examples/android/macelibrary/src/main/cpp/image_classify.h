@@ -50,6 +50,33 @@ JNIEXPORT jfloatArray JNICALL
 Java_com_xiaomi_mace_JniMaceUtils_maceMobilenetClassify
   (JNIEnv *, jclass, jfloatArray);
 
+/*
+ * Class:     com_xiaomi_mace_JniMaceUtils
+ * Method:    maceMobilenetClassifyBuffer
+ * Signature: (Ljava/nio/ByteBuffer;Ljava/nio/ByteBuffer;)I
+ */
+JNIEXPORT jint JNICALL
+Java_com_xiaomi_mace_JniMaceUtils_maceMobilenetClassifyBuffer
+  (JNIEnv *, jclass, jobject, jobject);
+
+/*
+ * Class:     com_xiaomi_mace_JniMaceUtils
+ * Method:    maceMobilenetClassifyHardwareBuffer
+ * Signature: (Landroid/hardware/HardwareBuffer;Ljava/nio/ByteBuffer;)I
+ */
+JNIEXPORT jint JNICALL
+Java_com_xiaomi_mace_JniMaceUtils_maceMobilenetClassifyHardwareBuffer
+  (JNIEnv *, jclass, jobject, jobject);
+
+/*
+ * Class:     com_xiaomi_mace_JniMaceUtils
+ * Method:    maceMobilenetClassifyAsync
+ * Signature: (Ljava/nio/ByteBuffer;Ljava/nio/ByteBuffer;Lcom/xiaomi/mace/JniMaceUtils$ClassifyCallback;)I
+ */
+JNIEXPORT jint JNICALL
+Java_com_xiaomi_mace_JniMaceUtils_maceMobilenetClassifyAsync
+  (JNIEnv *, jclass, jobject, jobject, jobject);
+
 #ifdef __cplusplus
 }
 #endif
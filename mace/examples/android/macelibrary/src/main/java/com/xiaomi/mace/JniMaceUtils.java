@@ -14,6 +14,10 @@
 
 package com.xiaomi.mace;
 
+import android.hardware.HardwareBuffer;
+
+import java.nio.ByteBuffer;
+
 public class JniMaceUtils {
 
     static {
@@ -26,4 +30,30 @@ public class JniMaceUtils {
 
     public static native float[] maceMobilenetClassify(float[] input);
 
+    /**
+     * Called from a native worker thread when an async classify finished.
+     */
+    public interface ClassifyCallback {
+        void onClassified(int status);
+    }
+
+    /**
+     * Classify without copies: the buffers must be direct, of native byte
+     * order, e.g. ByteBuffer.allocateDirect(n * 4).order(ByteOrder.nativeOrder()),
+     * the input of the input shape floats and the output of the output shape
+     * floats, which are written in place. Returns 0 for success.
+     */
+    public static native int maceMobilenetClassifyBuffer(ByteBuffer input, ByteBuffer output);
+
+    /**
+     * Classify a BLOB HardwareBuffer of the input floats in place, API 26+.
+     */
+    public static native int maceMobilenetClassifyHardwareBuffer(HardwareBuffer input, ByteBuffer output);
+
+    /**
+     * Classify without waiting, the input could be refilled once it returns,
+     * the output is written until the callback. Returns 0 if enqueued.
+     */
+    public static native int maceMobilenetClassifyAsync(ByteBuffer input, ByteBuffer output, ClassifyCallback callback);
+
 }
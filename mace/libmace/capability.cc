@@ -12,14 +12,24 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
 #include <map>
 #include <mutex>  // NOLINT(build/c++11)
+#include <sstream>
 #include <string>
 #include <vector>
 
+#include "mace/core/kv_storage.h"
 #include "mace/ops/common/conv_pool_2d_util.h"
+#include "mace/proto/mace.pb.h"
 #include "mace/public/mace.h"
 
+#ifdef MACE_ENABLE_OPENCL
+#include "mace/core/runtime/opencl/cl2_header.h"
+#endif  // MACE_ENABLE_OPENCL
+
 namespace mace {
 namespace capability {
 
@@ -398,6 +408,207 @@ MaceStatus BMNet::Run(DeviceType device,
 }
 }  // namespace capability
 
+namespace placement {
+
+const char *kPlacementFileName = "mace_device_placement.bin";
+// the runs measured on each device, after a warm-up one
+const int kMeasuredRuns = 5;
+
+// FNV-1a, enough to tell the models and the devices apart
+uint64_t Hash(const void *data, size_t size, uint64_t hash) {
+  const unsigned char *bytes = static_cast<const unsigned char *>(data);
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ bytes[i]) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+uint64_t Hash(const std::string &str, uint64_t hash) {
+  return Hash(str.data(), str.size(), hash);
+}
+
+// the SoC as the kernel reports it, e.g. the "Hardware" of arm cpuinfo
+std::string SocName() {
+  std::ifstream soc_id("/sys/devices/soc0/soc_id");
+  std::string name;
+  if (soc_id.is_open() && std::getline(soc_id, name) && !name.empty()) {
+    return name;
+  }
+  std::ifstream cpuinfo("/proc/cpuinfo");
+  std::string line;
+  while (std::getline(cpuinfo, line)) {
+    if (line.compare(0, 8, "Hardware") == 0 ||
+        line.compare(0, 10, "model name") == 0) {
+      return line;
+    }
+  }
+  return "";
+}
+
+// the OpenCL platform and the driver of its GPU, empty without OpenCL
+std::string GPUDriverInfo() {
+  std::stringstream ss;
+#ifdef MACE_ENABLE_OPENCL
+  std::vector<cl::Platform> platforms;
+  if (cl::Platform::get(&platforms) != CL_SUCCESS || platforms.empty()) {
+    return "";
+  }
+  ss << platforms[0].getInfo<CL_PLATFORM_NAME>() << ", "
+     << platforms[0].getInfo<CL_PLATFORM_VERSION>();
+  std::vector<cl::Device> devices;
+  platforms[0].getDevices(CL_DEVICE_TYPE_GPU, &devices);
+  for (auto &device : devices) {
+    ss << ", " << device.getInfo<CL_DEVICE_NAME>() << ", "
+       << device.getInfo<CL_DRIVER_VERSION>();
+  }
+#endif  // MACE_ENABLE_OPENCL
+  return ss.str();
+}
+
+std::string PlacementKey(const NetDef &net_def,
+                         const std::vector<std::string> &input_nodes,
+                         const std::vector<std::string> &output_nodes,
+                         const unsigned char *model_data,
+                         size_t model_data_size,
+                         const std::vector<DeviceType> &candidates) {
+  uint64_t model_hash = 14695981039346656037ULL;
+  model_hash = Hash(net_def.SerializeAsString(), model_hash);
+  model_hash = Hash(model_data, model_data_size, model_hash);
+  for (auto &node : input_nodes) {
+    model_hash = Hash(node + ";", model_hash);
+  }
+  for (auto &node : output_nodes) {
+    model_hash = Hash(node + ";", model_hash);
+  }
+  uint64_t device_hash = 14695981039346656037ULL;
+  device_hash = Hash(SocName(), device_hash);
+  device_hash = Hash(GPUDriverInfo(), device_hash);
+  device_hash = Hash(MaceVersion(), device_hash);
+  device_hash = Hash(candidates.data(),
+                     candidates.size() * sizeof(DeviceType), device_hash);
+  char key[64];
+  snprintf(key, sizeof(key), "placement_%016llx_%016llx",
+           static_cast<unsigned long long>(model_hash),  // NOLINT(runtime/int)
+           static_cast<unsigned long long>(device_hash));  // NOLINT
+  return key;
+}
+
+// the mean time of a run in milliseconds, negative if it failed
+float MeasureDevice(DeviceType device,
+                    const NetDef &net_def,
+                    const std::vector<std::string> &input_nodes,
+                    const std::vector<std::string> &output_nodes,
+                    const unsigned char *model_data) {
+  MaceEngineConfig config(device);
+  MaceEngine engine(config);
+  MaceStatus status = engine.Init(&net_def, input_nodes, output_nodes,
+                                  model_data);
+  if (status != MaceStatus::MACE_SUCCESS) {
+    LOG(INFO) << "The model could not be created on device " << device
+              << ": " << status.information();
+    return -1.f;
+  }
+  // the synthetic runs of the warm-up need no inputs or outputs, and wait
+  // for the GPU
+  WarmUpOptions options;
+  options.prefault_weights = false;
+  if (engine.WarmUp(options) != MaceStatus::MACE_SUCCESS) {
+    return -1.f;
+  }
+  const int64_t start_micros = NowMicros();
+  for (int i = 0; i < kMeasuredRuns; ++i) {
+    if (engine.WarmUp(options) != MaceStatus::MACE_SUCCESS) {
+      return -1.f;
+    }
+  }
+  return (NowMicros() - start_micros) / 1000.f / kMeasuredRuns;
+}
+
+std::vector<unsigned char> SerializeLatencies(
+    const std::vector<DeviceLatency> &latencies) {
+  std::stringstream ss;
+  for (auto &latency : latencies) {
+    ss << static_cast<int>(latency.device) << " " << latency.exec_time << " ";
+  }
+  const std::string str = ss.str();
+  return std::vector<unsigned char>(str.begin(), str.end());
+}
+
+std::vector<DeviceLatency> ParseLatencies(
+    const std::vector<unsigned char> &value) {
+  std::stringstream ss(std::string(value.begin(), value.end()));
+  std::vector<DeviceLatency> latencies;
+  int device;
+  float exec_time;
+  while (ss >> device >> exec_time) {
+    latencies.push_back({static_cast<DeviceType>(device), exec_time});
+  }
+  return latencies;
+}
+
+}  // namespace placement
+
+MaceStatus SelectDevice(const std::vector<DeviceType> &candidates,
+                        const NetDef *net_def,
+                        const std::vector<std::string> &input_nodes,
+                        const std::vector<std::string> &output_nodes,
+                        const unsigned char *model_data,
+                        size_t model_data_size,
+                        const std::string &storage_path,
+                        DevicePlacement *placement) {
+  MACE_CHECK_NOTNULL(net_def);
+  MACE_CHECK_NOTNULL(placement);
+  if (candidates.empty()) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      "no candidate device to place the model on");
+  }
+  std::shared_ptr<KVStorage> storage;
+  std::string key;
+  placement->latencies.clear();
+  placement->cached = false;
+  if (!storage_path.empty()) {
+    storage = FileStorageFactory(storage_path).CreateStorage(
+        placement::kPlacementFileName);
+    storage->Load();
+    key = placement::PlacementKey(*net_def, input_nodes, output_nodes,
+                                  model_data, model_data_size, candidates);
+    const std::vector<unsigned char> *value = storage->Find(key);
+    if (value != nullptr) {
+      placement->latencies = placement::ParseLatencies(*value);
+      placement->cached =
+          placement->latencies.size() == candidates.size();
+    }
+  }
+  if (!placement->cached) {
+    placement->latencies.clear();
+    for (auto device : candidates) {
+      const float exec_time = placement::MeasureDevice(
+          device, *net_def, input_nodes, output_nodes, model_data);
+      VLOG(1) << "The model runs in " << exec_time << " ms on device "
+              << device;
+      placement->latencies.push_back({device, exec_time});
+    }
+    if (storage != nullptr) {
+      storage->Insert(key,
+                      placement::SerializeLatencies(placement->latencies));
+      storage->Flush();
+    }
+  }
+  const DeviceLatency *fastest = nullptr;
+  for (auto &latency : placement->latencies) {
+    if (latency.exec_time >= 0 &&
+        (fastest == nullptr || latency.exec_time < fastest->exec_time)) {
+      fastest = &latency;
+    }
+  }
+  if (fastest == nullptr) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      "the model runs on none of the candidate devices");
+  }
+  placement->device = fastest->device;
+  return MaceStatus::MACE_SUCCESS;
+}
+
 Capability GetCapability(DeviceType device_type, float cpu_float32_exec_time) {
   Capability capability;
   if (device_type == DeviceType::HEXAGON) {
@@ -13,27 +13,69 @@
 // limitations under the License.
 
 #include <algorithm>
+#include <chrono>  // NOLINT(build/c++11)
+#include <condition_variable>  // NOLINT(build/c++11)
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <list>
 #include <numeric>
 #include <memory>
+#include <mutex>  // NOLINT(build/c++11)
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 
+#include "mace/core/algorithm_cache.h"
+#include "mace/core/constant_folding.h"
+#include "mace/core/cpu_blocked_layout.h"
+#include "mace/core/cpu_bfloat16.h"
+#include "mace/core/cpu_half_precision.h"
+#include "mace/core/cpu_nhwc_layout.h"
 #include "mace/core/device_context.h"
+#include "mace/core/gpu_elementwise_fusion.h"
 #include "mace/core/memory_optimizer.h"
+#include "mace/core/model_weights.h"
 #include "mace/core/net.h"
+#include "mace/core/nnapi_delegation.h"
+#include "mace/core/op_parallelism.h"
+#include "mace/core/packed_weights.h"
+#include "mace/core/range_calibrator.h"
+#include "mace/core/runtime/nnapi/nnapi_wrapper.h"
+#include "mace/core/tiled_execution.h"
+#include "mace/core/tracer.h"
 #include "mace/ops/ops_registry.h"
+#include "mace/ops/common/bfloat16_gemm.h"
+#include "mace/ops/common/preprocess.h"
+#include "mace/ops/common/quantize.h"
 #include "mace/ops/common/transpose.h"
 #include "mace/public/mace.h"
 
 #ifdef MACE_ENABLE_OPENCL
 #include "mace/core/runtime/opencl/gpu_device.h"
+#include "mace/core/runtime/opencl/opencl_allocator.h"
 #include "mace/core/runtime/opencl/opencl_runtime.h"
+#include "mace/core/runtime/opencl/opencl_util.h"
+#include "mace/ops/opencl/image/buffer_to_image.h"
 #endif  // MACE_ENABLE_OPENCL
 
 #ifdef MACE_ENABLE_HEXAGON
+#include "mace/core/runtime/hexagon/hexagon_allocator.h"
 #include "mace/core/runtime/hexagon/hexagon_control_wrapper.h"
 #include "mace/core/runtime/hexagon/hexagon_device.h"
 #endif  // MACE_ENABLE_HEXAGON
 
+#include "mace/utils/env_time.h"
+#include "mace/utils/latency_histogram.h"
 #include "mace/utils/memory.h"
+#include "mace/utils/quantize.h"
+#include "mace/utils/runtime_arbiter.h"
+#include "mace/utils/system_trace.h"
+#include "mace/utils/thread_pool.h"
 
 namespace mace {
 namespace {
@@ -64,6 +106,447 @@ MaceStatus CheckGPUAvalibility(const NetDef *net_def, Device *device) {
 }
 #endif
 
+#ifdef MACE_ENABLE_HEXAGON
+// whether the converter partitioned the net between the DSP and CPU, so that
+// it runs as a net of CPU ops and HexagonGraph ops instead of a DSP graph
+bool IsHexagonPartitioned(const NetDef &net_def) {
+  for (auto &op : net_def.op()) {
+    if (op.type() == kHexagonGraphOpType) {
+      return true;
+    }
+  }
+  return false;
+}
+#endif  // MACE_ENABLE_HEXAGON
+
+int64_t ShapeSizeFrom(const std::vector<int64_t> &shape, size_t begin) {
+  return std::accumulate(shape.begin() + std::min(begin, shape.size()),
+                         shape.end(), static_cast<int64_t>(1),
+                         std::multiplies<int64_t>());
+}
+
+int PixelChannels(const PixelFormat format) {
+  switch (format) {
+    case PIXEL_GRAY:
+      return 1;
+    case PIXEL_RGB:
+    case PIXEL_BGR:
+      return 3;
+    case PIXEL_RGBA:
+    case PIXEL_BGRA:
+      return 4;
+    default:
+      return 0;
+  }
+}
+
+// The pixel channel read by each channel of the model input.
+void PixelChannelMap(const InputPreprocess &preprocess, int *channel_map) {
+  const int channels = PixelChannels(preprocess.model_format);
+  const bool pixel_bgr = preprocess.pixel_format == PIXEL_BGR ||
+      preprocess.pixel_format == PIXEL_BGRA;
+  const bool model_bgr = preprocess.model_format == PIXEL_BGR;
+  for (int c = 0; c < channels; ++c) {
+    if (preprocess.pixel_format == PIXEL_GRAY) {
+      channel_map[c] = 0;
+    } else {
+      channel_map[c] = pixel_bgr == model_bgr ? c : channels - 1 - c;
+    }
+  }
+}
+
+size_t IDataTypeSize(const IDataType data_type) {
+  switch (data_type) {
+    case IDataType::IDT_UINT8:
+      return sizeof(uint8_t);
+    case IDataType::IDT_HALF:
+      return sizeof(half);
+    case IDataType::IDT_INT32:
+      return sizeof(int32_t);
+    default:
+      return sizeof(float);
+  }
+}
+
+// The inputs read by Quantize ops only, which could be fed quantized.
+std::set<std::string> QuantizedInputs(const NetDef &net_def) {
+  std::set<std::string> quantized_inputs;
+  for (auto &input_info : net_def.input_info()) {
+    bool quantized = false;
+    for (auto &op : net_def.op()) {
+      if (std::find(op.input().begin(), op.input().end(),
+                    input_info.name()) == op.input().end()) {
+        continue;
+      }
+      quantized = op.type() == "Quantize";
+      if (!quantized) {
+        break;
+      }
+    }
+    if (quantized) {
+      quantized_inputs.insert(input_info.name());
+    }
+  }
+  return quantized_inputs;
+}
+
+// Convert the elements of a MaceTensor to floats, uint8 ones dequantized
+// if it has a scale.
+void TypedToFloat(const MaceTensor &tensor, const int64_t size,
+                  float *output) {
+  const void *data = tensor.raw_data().get();
+  switch (tensor.data_type()) {
+    case IDataType::IDT_UINT8: {
+      const uint8_t *input = static_cast<const uint8_t *>(data);
+      if (tensor.scale() > 0.f) {
+        Dequantize(input, size, tensor.scale(), tensor.zero_point(), output);
+      } else {
+        std::copy(input, input + size, output);
+      }
+      break;
+    }
+    case IDataType::IDT_HALF: {
+      const half *input = static_cast<const half *>(data);
+      std::copy(input, input + size, output);
+      break;
+    }
+    case IDataType::IDT_INT32: {
+      const int32_t *input = static_cast<const int32_t *>(data);
+      std::copy(input, input + size, output);
+      break;
+    }
+    default:
+      std::memcpy(output, data, size * sizeof(float));
+  }
+}
+
+// Convert floats to the elements of a buffer of data_type, uint8 ones
+// quantized by scale and zero_point, or by their range if scale is 0, which
+// are then set.
+void FloatToTyped(const float *input, const int64_t size,
+                  const IDataType data_type, void *data, float *scale,
+                  int32_t *zero_point) {
+  switch (data_type) {
+    case IDataType::IDT_UINT8: {
+      uint8_t *output = static_cast<uint8_t *>(data);
+      if (*scale > 0.f) {
+        QuantizeWithScaleAndZeropoint(input, size, *scale, *zero_point,
+                                      output);
+      } else {
+        Quantize(input, size, false, output, scale, zero_point);
+      }
+      break;
+    }
+    case IDataType::IDT_HALF: {
+      half *output = static_cast<half *>(data);
+      for (int64_t i = 0; i < size; ++i) {
+        output[i] = half(input[i]);
+      }
+      break;
+    }
+    case IDataType::IDT_INT32: {
+      int32_t *output = static_cast<int32_t *>(data);
+      for (int64_t i = 0; i < size; ++i) {
+        output[i] = static_cast<int32_t>(std::lround(input[i]));
+      }
+      break;
+    }
+    default:
+      std::memcpy(data, input, size * sizeof(float));
+  }
+}
+
+// Batch size of one request, or -1 if its inputs disagree on it.
+int64_t RequestBatchSize(const std::map<std::string, MaceTensor> &inputs) {
+  int64_t batch = -1;
+  for (auto &input : inputs) {
+    // OpenCL memory and pixels are not stacked
+    if (input.second.shape().empty() || input.second.data() == nullptr) {
+      return -1;
+    }
+    if (batch == -1) {
+      batch = input.second.shape()[0];
+    } else if (batch != input.second.shape()[0]) {
+      return -1;
+    }
+  }
+  return batch;
+}
+
+// Whether two requests could be stacked along the batch dimension.
+bool CanStackRequests(const std::map<std::string, MaceTensor> &lhs_inputs,
+                      const std::map<std::string, MaceTensor> &lhs_outputs,
+                      const std::map<std::string, MaceTensor> &rhs_inputs,
+                      const std::map<std::string, MaceTensor> &rhs_outputs) {
+  if (lhs_inputs.size() != rhs_inputs.size() ||
+      lhs_outputs.size() != rhs_outputs.size()) {
+    return false;
+  }
+  for (auto &input : lhs_inputs) {
+    auto iter = rhs_inputs.find(input.first);
+    if (iter == rhs_inputs.end() ||
+        iter->second.data_format() != input.second.data_format()) {
+      return false;
+    }
+    auto &lhs_shape = input.second.shape();
+    auto &rhs_shape = iter->second.shape();
+    if (lhs_shape.size() != rhs_shape.size() ||
+        !std::equal(lhs_shape.begin() + 1, lhs_shape.end(),
+                    rhs_shape.begin() + 1)) {
+      return false;
+    }
+  }
+  for (auto &output : lhs_outputs) {
+    auto iter = rhs_outputs.find(output.first);
+    if (iter == rhs_outputs.end() ||
+        output.second.data() == nullptr || iter->second.data() == nullptr ||
+        iter->second.data_format() != output.second.data_format() ||
+        iter->second.shape().size() != output.second.shape().size()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Two nets cut from one model, the first one feeds the second one.
+struct NetPartition {
+  NetDef nets[2];
+  std::vector<std::string> inputs[2];
+  std::vector<std::string> outputs[2];
+  // tensors produced by the first net and consumed by the second one
+  std::map<std::string, std::vector<int64_t>> boundary;
+};
+
+std::unordered_map<std::string, int64_t> OpCosts(
+    const RunMetadata &run_metadata) {
+  std::unordered_map<std::string, int64_t> costs;
+  for (auto &op_stat : run_metadata.op_stats) {
+    costs[op_stat.operator_name] +=
+        op_stat.stats.end_micros - op_stat.stats.start_micros;
+  }
+  return costs;
+}
+
+// Cut points of the net, ordered by the latency of the slower stage.
+std::vector<int> BalancedCuts(const NetDef &net_def,
+                              const RunMetadata &first_costs,
+                              const RunMetadata &second_costs) {
+  auto first = OpCosts(first_costs);
+  auto second = OpCosts(second_costs);
+  const int op_size = net_def.op_size();
+  std::vector<int64_t> first_prefix(op_size + 1, 0);
+  std::vector<int64_t> second_suffix(op_size + 1, 0);
+  for (int i = 0; i < op_size; ++i) {
+    auto iter = first.find(net_def.op(i).name());
+    first_prefix[i + 1] =
+        first_prefix[i] + (iter == first.end() ? 0 : iter->second);
+  }
+  for (int i = op_size - 1; i >= 0; --i) {
+    auto iter = second.find(net_def.op(i).name());
+    second_suffix[i] =
+        second_suffix[i + 1] + (iter == second.end() ? 0 : iter->second);
+  }
+  std::vector<std::pair<int64_t, int>> cuts;
+  for (int cut = 1; cut < op_size; ++cut) {
+    cuts.emplace_back(std::max(first_prefix[cut], second_suffix[cut]), cut);
+  }
+  std::sort(cuts.begin(), cuts.end());
+  std::vector<int> result;
+  for (auto &cut : cuts) {
+    result.push_back(cut.second);
+  }
+  return result;
+}
+
+void AddUnique(const std::string &name, std::vector<std::string> *names) {
+  if (std::find(names->begin(), names->end(), name) == names->end()) {
+    names->push_back(name);
+  }
+}
+
+// Ops [0, cut) go to the first net and [cut, op_size) to the second one.
+MaceStatus PartitionNet(const NetDef &net_def,
+                        const std::vector<std::string> &input_nodes,
+                        const std::vector<std::string> &output_nodes,
+                        const int cut,
+                        NetPartition *partition) {
+  std::unordered_map<std::string, const ConstTensor *> weights;
+  for (auto &tensor : net_def.tensors()) {
+    weights[tensor.name()] = &tensor;
+  }
+  // tensor name : <stage, shape>
+  std::unordered_map<std::string,
+                     std::pair<int, std::vector<int64_t>>> producers;
+  std::set<std::string> used_weights[2];
+  for (int i = 0; i < net_def.op_size(); ++i) {
+    const OperatorDef &op = net_def.op(i);
+    const int stage = i < cut ? 0 : 1;
+    for (auto &input : op.input()) {
+      if (weights.count(input) == 1) {
+        used_weights[stage].insert(input);
+      } else if (std::find(input_nodes.begin(), input_nodes.end(), input) !=
+          input_nodes.end()) {
+        AddUnique(input, &partition->inputs[stage]);
+      } else if (producers.count(input) == 1 &&
+          producers[input].first != stage) {
+        if (producers[input].second.empty()) {
+          return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                            "no shape of boundary tensor " + input);
+        }
+        partition->boundary[input] = producers[input].second;
+        AddUnique(input, &partition->outputs[0]);
+        AddUnique(input, &partition->inputs[1]);
+      }
+    }
+    for (int j = 0; j < op.output_size(); ++j) {
+      std::vector<int64_t> shape;
+      if (j < op.output_shape_size()) {
+        shape.assign(op.output_shape(j).dims().begin(),
+                     op.output_shape(j).dims().end());
+      }
+      producers[op.output(j)] = std::make_pair(stage, shape);
+    }
+  }
+  for (auto &output : output_nodes) {
+    if (producers.count(output) == 0) {
+      return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                        "no operation produces output " + output);
+    }
+    AddUnique(output, &partition->outputs[producers[output].first]);
+  }
+  for (int stage = 0; stage < 2; ++stage) {
+    NetDef &net = partition->nets[stage];
+    net = net_def;
+    net.clear_op();
+    net.clear_tensors();
+    net.clear_input_info();
+    net.clear_output_info();
+    for (int i = stage == 0 ? 0 : cut;
+         i < (stage == 0 ? cut : net_def.op_size()); ++i) {
+      *net.add_op() = net_def.op(i);
+    }
+    for (auto &tensor : net_def.tensors()) {
+      if (used_weights[stage].count(tensor.name()) == 1) {
+        *net.add_tensors() = tensor;
+      }
+    }
+    for (auto &input : partition->inputs[stage]) {
+      InputInfo *input_info = net.add_input_info();
+      auto boundary = partition->boundary.find(input);
+      if (boundary == partition->boundary.end()) {
+        for (auto &model_input : net_def.input_info()) {
+          if (model_input.name() == input) {
+            *input_info = model_input;
+          }
+        }
+      } else {
+        input_info->set_name(input);
+        for (auto dim : boundary->second) {
+          input_info->add_dims(static_cast<int>(dim));
+        }
+      }
+    }
+    for (auto &output : partition->outputs[stage]) {
+      OutputInfo *output_info = net.add_output_info();
+      output_info->set_name(output);
+      for (auto &model_output : net_def.output_info()) {
+        if (model_output.name() == output) {
+          *output_info = model_output;
+        }
+      }
+      if (output_info->dims_size() == 0 &&
+          partition->boundary.count(output) == 1) {
+        for (auto dim : partition->boundary.at(output)) {
+          output_info->add_dims(static_cast<int>(dim));
+        }
+      }
+    }
+  }
+  return MaceStatus::MACE_SUCCESS;
+}
+
+// Workspace tensors borrowing the buffers of MaceTensors during a run, the
+// tensors get back their own buffers when it goes out of scope.
+class ZeroCopyBinding {
+ public:
+  ZeroCopyBinding() = default;
+
+  ~ZeroCopyBinding() {
+    for (auto &binding : bindings_) {
+      binding.first->UnbindBuffer();
+    }
+  }
+
+  void Bind(Tensor *tensor, float *data, int64_t buffer_size) {
+    Bind(tensor, std::unique_ptr<BufferBase>(
+        new Buffer(GetCPUAllocator(), data, buffer_size * sizeof(float))));
+  }
+
+  void Bind(Tensor *tensor, std::unique_ptr<BufferBase> buffer) {
+    tensor->BindBuffer(buffer.get());
+    bindings_.emplace_back(tensor, std::move(buffer));
+  }
+
+  // whether the tensor still works in the borrowed buffer, ops reusing
+  // other tensors' buffers or growing the tensor may have replaced it
+  bool IsBound(const Tensor *tensor) const {
+    for (auto &binding : bindings_) {
+      if (binding.first == tensor) {
+        return tensor->UnderlyingBuffer() == binding.second.get();
+      }
+    }
+    return false;
+  }
+
+  bool empty() const {
+    return bindings_.empty();
+  }
+
+ private:
+  std::vector<std::pair<Tensor *, std::unique_ptr<BufferBase>>> bindings_;
+
+  MACE_DISABLE_COPY_AND_ASSIGN(ZeroCopyBinding);
+};
+
+// the keys of an engine snapshot, and the prefixes of its packed weights
+// and algorithms
+const char *kSnapshotDeviceKey = "mace_snapshot_device";
+const char *kSnapshotMemoryPlanKey = "mace_snapshot_memory_plan";
+const char *kSnapshotInputShapesKey = "mace_snapshot_input_shapes";
+const char *kSnapshotPackedWeightsPrefix = "packed_weights/";
+const char *kSnapshotAlgorithmsPrefix = "algorithms/";
+
+// the device a snapshot is valid on: the build, the device type, the CPU
+// and, on GPU, the OpenCL platform
+std::string SnapshotDevice(Device *device) {
+  const CPUFeatures &features = GetCPUFeatures();
+  const CPUCacheSizes &cache_sizes = GetCPUCacheSizes();
+  std::stringstream ss;
+  ss << MaceVersion() << ";" << static_cast<int>(device->device_type())
+     << ";" << features.asimdhp << features.asimddp << features.i8mm
+     << features.sve << features.avx2 << features.fma << ";"
+     << cache_sizes.l1d << "," << cache_sizes.l2;
+#ifdef MACE_ENABLE_OPENCL
+  if (device->device_type() == DeviceType::GPU) {
+    ss << ";" << device->gpu_runtime()->opencl_runtime()->platform_info();
+  }
+#endif  // MACE_ENABLE_OPENCL
+  return ss.str();
+}
+
+// the model inputs and their shapes a snapshot is of
+std::string SnapshotInputShapes(
+    const std::map<std::string, InputInfo> &input_infos) {
+  std::stringstream ss;
+  for (auto &input_info : input_infos) {
+    ss << input_info.first << ":"
+       << MakeString(std::vector<int64_t>(input_info.second.dims().begin(),
+                                          input_info.second.dims().end()))
+       << ";";
+  }
+  return ss.str();
+}
+
 }  // namespace
 
 class GPUContextBuilder::Impl {
@@ -79,6 +562,10 @@ class GPUContextBuilder::Impl {
 
   void SetOpenCLParameter(const unsigned char *data, const size_t size);
 
+  void SetOpenCLBinaryPackagePath(const std::string &path);
+
+  void SetOpenCLBinaryPackage(const unsigned char *data, const size_t size);
+
   std::shared_ptr<GPUContext> Finalize();
 
  public:
@@ -89,12 +576,17 @@ class GPUContextBuilder::Impl {
   size_t opencl_binary_size_;
   const unsigned char *opencl_parameter_ptr_;
   size_t opencl_parameter_size_;
+  std::string opencl_package_path_;
+  const unsigned char *opencl_package_ptr_;
+  size_t opencl_package_size_;
 };
 
 GPUContextBuilder::Impl::Impl()
     : storage_path_(""), opencl_binary_paths_(0), opencl_parameter_path_(""),
       opencl_binary_ptr_(nullptr), opencl_binary_size_(0),
-      opencl_parameter_ptr_(nullptr), opencl_parameter_size_(0) {}
+      opencl_parameter_ptr_(nullptr), opencl_parameter_size_(0),
+      opencl_package_path_(""), opencl_package_ptr_(nullptr),
+      opencl_package_size_(0) {}
 
 void GPUContextBuilder::Impl::SetStoragePath(const std::string &path) {
   storage_path_ = path;
@@ -122,6 +614,17 @@ void GPUContextBuilder::Impl::SetOpenCLParameter(const unsigned char *data,
   opencl_parameter_size_ = size;
 }
 
+void GPUContextBuilder::Impl::SetOpenCLBinaryPackagePath(
+    const std::string &path) {
+  opencl_package_path_ = path;
+}
+
+void GPUContextBuilder::Impl::SetOpenCLBinaryPackage(
+    const unsigned char *data, const size_t size) {
+  opencl_package_ptr_ = data;
+  opencl_package_size_ = size;
+}
+
 std::shared_ptr<GPUContext> GPUContextBuilder::Impl::Finalize() {
   return std::shared_ptr<GPUContext>(new GPUContext(storage_path_,
                                                     opencl_binary_paths_,
@@ -129,7 +632,10 @@ std::shared_ptr<GPUContext> GPUContextBuilder::Impl::Finalize() {
                                                     opencl_binary_ptr_,
                                                     opencl_binary_size_,
                                                     opencl_parameter_ptr_,
-                                                    opencl_parameter_size_));
+                                                    opencl_parameter_size_,
+                                                    opencl_package_path_,
+                                                    opencl_package_ptr_,
+                                                    opencl_package_size_));
 }
 
 GPUContextBuilder::GPUContextBuilder() : impl_(new GPUContextBuilder::Impl) {}
@@ -165,6 +671,18 @@ GPUContextBuilder& GPUContextBuilder::SetOpenCLParameter(
   return *this;
 }
 
+GPUContextBuilder &GPUContextBuilder::SetOpenCLBinaryPackagePath(
+    const std::string &path) {
+  impl_->SetOpenCLBinaryPackagePath(path);
+  return *this;
+}
+
+GPUContextBuilder &GPUContextBuilder::SetOpenCLBinaryPackage(
+    const unsigned char *data, const size_t size) {
+  impl_->SetOpenCLBinaryPackage(data, size);
+  return *this;
+}
+
 std::shared_ptr<GPUContext> GPUContextBuilder::Finalize() {
   return impl_->Finalize();
 }
@@ -180,7 +698,76 @@ class MaceEngineConfig::Impl {
 
   MaceStatus SetCPUThreadPolicy(int num_threads_hint,
                                 CPUAffinityPolicy policy,
-                                bool use_gemmlowp);
+                                bool use_gemmlowp,
+                                CPUSchedulingPolicy sched_policy,
+                                int sched_priority);
+
+  MaceStatus SetCPUOpThreads(const std::map<std::string, int> &op_threads);
+
+  MaceStatus SetCPUWeightPrefetch(bool enable);
+
+  MaceStatus SetCPULineBufferedHead(bool enable);
+
+  MaceStatus SetInterOpParallelism(int num_workers);
+
+  MaceStatus SetZeroCopy(bool enable);
+
+  MaceStatus SetOpenCLImageInputs(const std::vector<std::string> &input_names);
+
+  MaceStatus SetPackedWeightsFile(const std::string &file_path);
+
+  MaceStatus SetAlgorithmCacheFile(const std::string &file_path);
+
+  MaceStatus SetModelWeights(std::shared_ptr<ModelWeights> model_weights);
+
+  MaceStatus SetCPUHalfPrecision(bool enable);
+
+  MaceStatus SetCPUBFloat16(bool enable);
+
+  MaceStatus SetCPUBlockedLayout(int channel_block);
+
+  MaceStatus SetCPUDataFormat(DataFormat data_format);
+
+  MaceStatus SetNNAPIDelegation(bool enable, const std::string &cache_dir);
+
+  MaceStatus SetDSPPerfHint(DSPPerfHint perf_hint);
+
+  MaceStatus SetGPUElementwiseFusion(bool enable);
+
+  MaceStatus SetGPUMaxKernelTime(int max_micros);
+
+  MaceStatus SetAsyncPriority(int nice);
+
+  MaceStatus SetMaxAsyncRuns(int max_runs);
+
+  MaceStatus SetTraceFile(const std::string &file_path);
+
+  MaceStatus SetLatencyMetrics(bool enable);
+
+  MaceStatus SetInputPreprocess(const std::string &input_name,
+                                const InputPreprocess &preprocess);
+
+  MaceStatus SetShapePlanCacheSize(int num_plans);
+
+  MaceStatus SetMaxConcurrentRuns(int max_runs);
+  MaceStatus SetIncrementalInputs(
+      const std::vector<std::string> &input_names);
+
+  MaceStatus SetTiledExecution(bool enable);
+
+  MaceStatus SetAllocationFreeRuns(bool enable, bool fail_allocations);
+
+  MaceStatus SetCPUMemoryPolicy(bool huge_pages, bool bind_numa_nodes);
+
+  MaceStatus SetCPUConstantFolding(bool enable, bool fixed_input_shapes);
+
+  MaceStatus SetLowMemoryMode(bool enable);
+
+  MaceStatus SetGPUKernelReplay(bool enable);
+
+  MaceStatus SetRuntimeArbiter(std::shared_ptr<RuntimeArbiter> arbiter,
+                               int priority,
+                               int64_t deadline_micros);
 
   inline DeviceType device_type() const {
     return device_type_;
@@ -198,6 +785,167 @@ class MaceEngineConfig::Impl {
     return use_gemmlowp_;
   }
 
+  inline CPUSchedulingPolicy cpu_sched_policy() const {
+    return cpu_sched_policy_;
+  }
+
+  inline int cpu_sched_priority() const {
+    return cpu_sched_priority_;
+  }
+
+  inline int inter_op_parallelism() const {
+    return inter_op_parallelism_;
+  }
+
+  inline bool zero_copy() const {
+    return zero_copy_;
+  }
+
+  inline const std::vector<std::string> &opencl_image_inputs() const {
+    return opencl_image_inputs_;
+  }
+
+  inline const std::string &packed_weights_file() const {
+    return packed_weights_file_;
+  }
+
+  inline const std::string &algorithm_cache_file() const {
+    return algorithm_cache_file_;
+  }
+
+  inline std::shared_ptr<ModelWeights> model_weights() const {
+    return model_weights_;
+  }
+
+  inline bool cpu_half_precision() const {
+    return cpu_half_precision_;
+  }
+
+  inline bool cpu_bfloat16() const {
+    return cpu_bfloat16_;
+  }
+
+  inline const std::map<std::string, int> &cpu_op_threads() const {
+    return cpu_op_threads_;
+  }
+
+  inline bool cpu_weight_prefetch() const {
+    return cpu_weight_prefetch_;
+  }
+
+  inline bool cpu_line_buffered_head() const {
+    return cpu_line_buffered_head_;
+  }
+
+  inline int cpu_channel_block() const {
+    return cpu_channel_block_;
+  }
+
+  inline DataFormat cpu_data_format() const {
+    return cpu_data_format_;
+  }
+
+  inline bool nnapi_delegation() const {
+    return nnapi_delegation_;
+  }
+
+  inline const std::string &nnapi_cache_dir() const {
+    return nnapi_cache_dir_;
+  }
+
+  inline DSPPerfHint dsp_perf_hint() const {
+    return dsp_perf_hint_;
+  }
+
+  inline bool cpu_constant_folding() const {
+    return cpu_constant_folding_;
+  }
+
+  inline bool cpu_fixed_input_shapes() const {
+    return cpu_fixed_input_shapes_;
+  }
+
+  inline bool gpu_elementwise_fusion() const {
+    return gpu_elementwise_fusion_;
+  }
+
+  inline int gpu_max_kernel_micros() const {
+    return gpu_max_kernel_micros_;
+  }
+
+  inline int async_priority() const {
+    return async_priority_;
+  }
+
+  inline int max_async_runs() const {
+    return max_async_runs_;
+  }
+
+  inline const std::string &trace_file() const {
+    return trace_file_;
+  }
+
+  inline bool latency_metrics() const {
+    return latency_metrics_;
+  }
+
+  inline const std::map<std::string, InputPreprocess> &input_preprocess()
+      const {
+    return input_preprocess_;
+  }
+
+  inline int shape_plan_cache_size() const {
+    return shape_plan_cache_size_;
+  }
+
+  inline int max_concurrent_runs() const {
+    return max_concurrent_runs_;
+  }
+
+  inline const std::vector<std::string> &incremental_inputs() const {
+    return incremental_inputs_;
+  }
+
+  inline bool tiled_execution() const {
+    return tiled_execution_;
+  }
+
+  inline bool allocation_free_runs() const {
+    return allocation_free_runs_;
+  }
+
+  inline bool fail_run_allocations() const {
+    return fail_run_allocations_;
+  }
+
+  inline bool cpu_huge_pages() const {
+    return cpu_huge_pages_;
+  }
+
+  inline bool cpu_bind_numa_nodes() const {
+    return cpu_bind_numa_nodes_;
+  }
+
+  inline bool low_memory() const {
+    return low_memory_;
+  }
+
+  inline bool gpu_kernel_replay() const {
+    return gpu_kernel_replay_;
+  }
+
+  inline std::shared_ptr<RuntimeArbiter> runtime_arbiter() const {
+    return runtime_arbiter_;
+  }
+
+  inline int run_priority() const {
+    return run_priority_;
+  }
+
+  inline int64_t run_deadline_micros() const {
+    return run_deadline_micros_;
+  }
+
   inline std::shared_ptr<GPUContext> gpu_context() const {
     return gpu_context_;
   }
@@ -215,6 +963,46 @@ class MaceEngineConfig::Impl {
   int num_threads_;
   CPUAffinityPolicy cpu_affinity_policy_;
   bool use_gemmlowp_;
+  CPUSchedulingPolicy cpu_sched_policy_;
+  int cpu_sched_priority_;
+  int inter_op_parallelism_;
+  bool zero_copy_;
+  std::vector<std::string> opencl_image_inputs_;
+  std::string packed_weights_file_;
+  std::string algorithm_cache_file_;
+  std::shared_ptr<ModelWeights> model_weights_;
+  bool cpu_half_precision_;
+  bool cpu_bfloat16_;
+  std::map<std::string, int> cpu_op_threads_;
+  bool cpu_weight_prefetch_;
+  bool cpu_line_buffered_head_;
+  int cpu_channel_block_;
+  DataFormat cpu_data_format_;
+  bool cpu_constant_folding_;
+  bool cpu_fixed_input_shapes_;
+  bool nnapi_delegation_;
+  std::string nnapi_cache_dir_;
+  DSPPerfHint dsp_perf_hint_;
+  bool gpu_elementwise_fusion_;
+  int gpu_max_kernel_micros_;
+  int async_priority_;
+  int max_async_runs_;
+  std::string trace_file_;
+  bool latency_metrics_;
+  std::map<std::string, InputPreprocess> input_preprocess_;
+  int shape_plan_cache_size_;
+  int max_concurrent_runs_;
+  std::vector<std::string> incremental_inputs_;
+  bool tiled_execution_;
+  bool allocation_free_runs_;
+  bool fail_run_allocations_;
+  bool cpu_huge_pages_;
+  bool cpu_bind_numa_nodes_;
+  bool low_memory_;
+  bool gpu_kernel_replay_;
+  std::shared_ptr<RuntimeArbiter> runtime_arbiter_;
+  int run_priority_;
+  int64_t run_deadline_micros_;
   std::shared_ptr<GPUContext> gpu_context_;
   GPUPriorityHint gpu_priority_hint_;
   GPUPerfHint gpu_perf_hint_;
@@ -225,6 +1013,36 @@ MaceEngineConfig::Impl::Impl(const DeviceType device_type)
       num_threads_(-1),
       cpu_affinity_policy_(CPUAffinityPolicy::AFFINITY_NONE),
       use_gemmlowp_(false),
+      cpu_sched_policy_(CPUSchedulingPolicy::CPU_SCHED_NORMAL),
+      cpu_sched_priority_(0),
+      inter_op_parallelism_(1),
+      zero_copy_(false),
+      cpu_half_precision_(false),
+      cpu_bfloat16_(false),
+      cpu_weight_prefetch_(false),
+      cpu_line_buffered_head_(false),
+      cpu_channel_block_(0),
+      cpu_data_format_(DataFormat::NCHW),
+      cpu_constant_folding_(false),
+      cpu_fixed_input_shapes_(false),
+      nnapi_delegation_(false),
+      dsp_perf_hint_(DSPPerfHint::DSP_PERF_DEFAULT),
+      gpu_elementwise_fusion_(false),
+      gpu_max_kernel_micros_(0),
+      async_priority_(0),
+      max_async_runs_(2),
+      latency_metrics_(false),
+      shape_plan_cache_size_(0),
+      max_concurrent_runs_(1),
+      tiled_execution_(false),
+      allocation_free_runs_(false),
+      fail_run_allocations_(false),
+      cpu_huge_pages_(false),
+      cpu_bind_numa_nodes_(false),
+      low_memory_(false),
+      gpu_kernel_replay_(false),
+      run_priority_(0),
+      run_deadline_micros_(0),
       gpu_context_(new GPUContext),
       gpu_priority_hint_(GPUPriorityHint::PRIORITY_LOW),
       gpu_perf_hint_(GPUPerfHint::PERF_NORMAL) {}
@@ -246,19 +1064,288 @@ MaceStatus MaceEngineConfig::Impl::SetGPUHints(
 MaceStatus MaceEngineConfig::Impl::SetCPUThreadPolicy(
     int num_threads,
     CPUAffinityPolicy policy,
-    bool use_gemmlowp) {
+    bool use_gemmlowp,
+    CPUSchedulingPolicy sched_policy,
+    int sched_priority) {
+  const bool real_time = sched_policy == CPUSchedulingPolicy::CPU_SCHED_FIFO ||
+      sched_policy == CPUSchedulingPolicy::CPU_SCHED_RR;
+  if (real_time ? sched_priority < 1 || sched_priority > 99
+                : sched_priority != 0) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      MakeString("invalid priority ", sched_priority,
+                                 " of scheduling class ",
+                                 static_cast<int>(sched_policy)));
+  }
   num_threads_ = num_threads;
   cpu_affinity_policy_ = policy;
   use_gemmlowp_ = use_gemmlowp;
+  cpu_sched_policy_ = sched_policy;
+  cpu_sched_priority_ = sched_priority;
   return MaceStatus::MACE_SUCCESS;
 }
 
+MaceStatus MaceEngineConfig::Impl::SetCPUOpThreads(
+    const std::map<std::string, int> &op_threads) {
+  for (auto &op_thread : op_threads) {
+    if (op_thread.second < 1) {
+      return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                        "threads of op " + op_thread.first +
+                        " should be positive");
+    }
+  }
+  cpu_op_threads_ = op_threads;
+  return MaceStatus::MACE_SUCCESS;
+}
 
-MaceEngineConfig::MaceEngineConfig(
-    const DeviceType device_type)
-    : impl_(new MaceEngineConfig::Impl(device_type)) {}
+MaceStatus MaceEngineConfig::Impl::SetCPUWeightPrefetch(bool enable) {
+  cpu_weight_prefetch_ = enable;
+  return MaceStatus::MACE_SUCCESS;
+}
 
-MaceEngineConfig::~MaceEngineConfig() = default;
+MaceStatus MaceEngineConfig::Impl::SetCPULineBufferedHead(bool enable) {
+  cpu_line_buffered_head_ = enable;
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngineConfig::Impl::SetInterOpParallelism(int num_workers) {
+  if (num_workers < 1) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      "inter op parallelism should be positive");
+  }
+  inter_op_parallelism_ = num_workers;
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngineConfig::Impl::SetZeroCopy(bool enable) {
+  zero_copy_ = enable;
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngineConfig::Impl::SetOpenCLImageInputs(
+    const std::vector<std::string> &input_names) {
+  opencl_image_inputs_ = input_names;
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngineConfig::Impl::SetPackedWeightsFile(
+    const std::string &file_path) {
+  packed_weights_file_ = file_path;
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngineConfig::Impl::SetAlgorithmCacheFile(
+    const std::string &file_path) {
+  algorithm_cache_file_ = file_path;
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngineConfig::Impl::SetModelWeights(
+    std::shared_ptr<ModelWeights> model_weights) {
+  model_weights_ = model_weights;
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngineConfig::Impl::SetCPUHalfPrecision(bool enable) {
+  cpu_half_precision_ = enable;
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngineConfig::Impl::SetCPUBFloat16(bool enable) {
+  cpu_bfloat16_ = enable;
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngineConfig::Impl::SetCPUBlockedLayout(int channel_block) {
+  if (channel_block != 0 && channel_block != 4 && channel_block != 8) {
+    LOG(ERROR) << "CPU channel block should be 0, 4 or 8, not "
+               << channel_block;
+    return MaceStatus::MACE_INVALID_ARGS;
+  }
+  cpu_channel_block_ = channel_block;
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngineConfig::Impl::SetCPUDataFormat(DataFormat data_format) {
+  if (data_format != DataFormat::NCHW && data_format != DataFormat::NHWC) {
+    LOG(ERROR) << "CPU data format should be NCHW or NHWC, not "
+               << data_format;
+    return MaceStatus::MACE_INVALID_ARGS;
+  }
+  cpu_data_format_ = data_format;
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngineConfig::Impl::SetNNAPIDelegation(
+    bool enable, const std::string &cache_dir) {
+  nnapi_delegation_ = enable;
+  nnapi_cache_dir_ = cache_dir;
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngineConfig::Impl::SetDSPPerfHint(DSPPerfHint perf_hint) {
+  dsp_perf_hint_ = perf_hint;
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngineConfig::Impl::SetGPUElementwiseFusion(bool enable) {
+  gpu_elementwise_fusion_ = enable;
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngineConfig::Impl::SetGPUMaxKernelTime(int max_micros) {
+  if (max_micros < 0) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      "max kernel time should not be negative");
+  }
+  gpu_max_kernel_micros_ = max_micros;
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngineConfig::Impl::SetAsyncPriority(int nice) {
+  if (nice < -20 || nice > 19) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      "nice value should be in [-20, 19]");
+  }
+  async_priority_ = nice;
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngineConfig::Impl::SetMaxAsyncRuns(int max_runs) {
+  if (max_runs < 1) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      "max async runs should be positive");
+  }
+  max_async_runs_ = max_runs;
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngineConfig::Impl::SetTraceFile(
+    const std::string &file_path) {
+  trace_file_ = file_path;
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngineConfig::Impl::SetLatencyMetrics(bool enable) {
+  latency_metrics_ = enable;
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngineConfig::Impl::SetInputPreprocess(
+    const std::string &input_name,
+    const InputPreprocess &preprocess) {
+  const int pixel_channels = PixelChannels(preprocess.pixel_format);
+  const int channels = PixelChannels(preprocess.model_format);
+  if (pixel_channels == 0 || channels == 0 || channels == 4 ||
+      (channels == 1 && pixel_channels != 1)) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      "unsupported pixel formats of input " + input_name);
+  }
+  const size_t mean_size = preprocess.mean.size();
+  const size_t scale_size = preprocess.scale.size();
+  if ((mean_size != 1 && mean_size != static_cast<size_t>(channels)) ||
+      (scale_size != 1 && scale_size != static_cast<size_t>(channels))) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      "mean and scale should have one value or one per "
+                      "channel: " + input_name);
+  }
+  input_preprocess_[input_name] = preprocess;
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngineConfig::Impl::SetShapePlanCacheSize(int num_plans) {
+  if (num_plans < 0) {
+    LOG(ERROR) << "Shape plan cache size should not be negative, not "
+               << num_plans;
+    return MaceStatus::MACE_INVALID_ARGS;
+  }
+  shape_plan_cache_size_ = num_plans;
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngineConfig::Impl::SetMaxConcurrentRuns(int max_runs) {
+  if (max_runs < 1) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      "max concurrent runs should be positive");
+  }
+  max_concurrent_runs_ = max_runs;
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngineConfig::Impl::SetIncrementalInputs(
+    const std::vector<std::string> &input_names) {
+  // the ops record the inputs they depend on in 63 bits, the last one is
+  // for the ops which always run
+  if (input_names.size() > 63) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      "at most 63 incremental inputs are supported");
+  }
+  incremental_inputs_ = input_names;
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngineConfig::Impl::SetTiledExecution(bool enable) {
+  tiled_execution_ = enable;
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngineConfig::Impl::SetAllocationFreeRuns(
+    bool enable, bool fail_allocations) {
+  if (fail_allocations && !enable) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      "failing the allocations needs allocation free runs");
+  }
+  allocation_free_runs_ = enable;
+  fail_run_allocations_ = fail_allocations;
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngineConfig::Impl::SetCPUMemoryPolicy(bool huge_pages,
+                                                      bool bind_numa_nodes) {
+  if (bind_numa_nodes && !huge_pages) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      "NUMA binding applies to the huge page allocations");
+  }
+  cpu_huge_pages_ = huge_pages;
+  cpu_bind_numa_nodes_ = bind_numa_nodes;
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngineConfig::Impl::SetCPUConstantFolding(
+    bool enable, bool fixed_input_shapes) {
+  if (fixed_input_shapes && !enable) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      "fixed input shapes only apply to constant folding");
+  }
+  cpu_constant_folding_ = enable;
+  cpu_fixed_input_shapes_ = fixed_input_shapes;
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngineConfig::Impl::SetLowMemoryMode(bool enable) {
+  low_memory_ = enable;
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngineConfig::Impl::SetGPUKernelReplay(bool enable) {
+  gpu_kernel_replay_ = enable;
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngineConfig::Impl::SetRuntimeArbiter(
+    std::shared_ptr<RuntimeArbiter> arbiter,
+    int priority,
+    int64_t deadline_micros) {
+  runtime_arbiter_ = arbiter;
+  run_priority_ = priority;
+  run_deadline_micros_ = std::max<int64_t>(deadline_micros, 0);
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceEngineConfig::MaceEngineConfig(
+    const DeviceType device_type)
+    : impl_(new MaceEngineConfig::Impl(device_type)) {}
+
+MaceEngineConfig::~MaceEngineConfig() = default;
 
 MaceStatus MaceEngineConfig::SetGPUContext(
     std::shared_ptr<GPUContext> context) {
@@ -274,8 +1361,187 @@ MaceStatus MaceEngineConfig::SetGPUHints(
 MaceStatus MaceEngineConfig::SetCPUThreadPolicy(
     int num_threads_hint,
     CPUAffinityPolicy policy,
-    bool use_gemmlowp) {
-  return impl_->SetCPUThreadPolicy(num_threads_hint, policy, use_gemmlowp);
+    bool use_gemmlowp,
+    CPUSchedulingPolicy sched_policy,
+    int sched_priority) {
+  return impl_->SetCPUThreadPolicy(num_threads_hint, policy, use_gemmlowp,
+                                   sched_policy, sched_priority);
+}
+
+MaceStatus MaceEngineConfig::SetCPUOpThreads(
+    const std::map<std::string, int> &op_threads) {
+  return impl_->SetCPUOpThreads(op_threads);
+}
+
+MaceStatus MaceEngineConfig::SetCPUWeightPrefetch(bool enable) {
+  return impl_->SetCPUWeightPrefetch(enable);
+}
+
+MaceStatus MaceEngineConfig::SetCPULineBufferedHead(bool enable) {
+  return impl_->SetCPULineBufferedHead(enable);
+}
+
+MaceStatus MaceEngineConfig::SetInterOpParallelism(int num_workers) {
+  return impl_->SetInterOpParallelism(num_workers);
+}
+
+MaceStatus MaceEngineConfig::SetZeroCopy(bool enable) {
+  return impl_->SetZeroCopy(enable);
+}
+
+MaceStatus MaceEngineConfig::SetOpenCLImageInputs(
+    const std::vector<std::string> &input_names) {
+  return impl_->SetOpenCLImageInputs(input_names);
+}
+
+MaceStatus MaceEngineConfig::SetPackedWeightsFile(
+    const std::string &file_path) {
+  return impl_->SetPackedWeightsFile(file_path);
+}
+
+MaceStatus MaceEngineConfig::SetAlgorithmCacheFile(
+    const std::string &file_path) {
+  return impl_->SetAlgorithmCacheFile(file_path);
+}
+
+MaceStatus MaceEngineConfig::SetModelWeights(
+    std::shared_ptr<ModelWeights> model_weights) {
+  return impl_->SetModelWeights(model_weights);
+}
+
+MaceStatus MaceEngineConfig::SetCPUHalfPrecision(bool enable) {
+  return impl_->SetCPUHalfPrecision(enable);
+}
+
+MaceStatus MaceEngineConfig::SetCPUBFloat16(bool enable) {
+  return impl_->SetCPUBFloat16(enable);
+}
+
+MaceStatus MaceEngineConfig::SetCPUBlockedLayout(int channel_block) {
+  return impl_->SetCPUBlockedLayout(channel_block);
+}
+
+MaceStatus MaceEngineConfig::SetCPUDataFormat(DataFormat data_format) {
+  return impl_->SetCPUDataFormat(data_format);
+}
+
+MaceStatus MaceEngineConfig::SetNNAPIDelegation(
+    bool enable, const std::string &cache_dir) {
+  return impl_->SetNNAPIDelegation(enable, cache_dir);
+}
+
+MaceStatus MaceEngineConfig::SetDSPPerfHint(DSPPerfHint perf_hint) {
+  return impl_->SetDSPPerfHint(perf_hint);
+}
+
+MaceStatus MaceEngineConfig::SetGPUElementwiseFusion(bool enable) {
+  return impl_->SetGPUElementwiseFusion(enable);
+}
+
+MaceStatus MaceEngineConfig::SetGPUMaxKernelTime(int max_micros) {
+  return impl_->SetGPUMaxKernelTime(max_micros);
+}
+
+MaceStatus MaceEngineConfig::SetAsyncPriority(int nice) {
+  return impl_->SetAsyncPriority(nice);
+}
+
+MaceStatus MaceEngineConfig::SetMaxAsyncRuns(int max_runs) {
+  return impl_->SetMaxAsyncRuns(max_runs);
+}
+
+MaceStatus MaceEngineConfig::SetTraceFile(const std::string &file_path) {
+  return impl_->SetTraceFile(file_path);
+}
+
+MaceStatus MaceEngineConfig::SetLatencyMetrics(bool enable) {
+  return impl_->SetLatencyMetrics(enable);
+}
+
+MaceStatus MaceEngineConfig::SetInputPreprocess(
+    const std::string &input_name,
+    const InputPreprocess &preprocess) {
+  return impl_->SetInputPreprocess(input_name, preprocess);
+}
+
+MaceStatus MaceEngineConfig::SetShapePlanCacheSize(int num_plans) {
+  return impl_->SetShapePlanCacheSize(num_plans);
+}
+
+MaceStatus MaceEngineConfig::SetMaxConcurrentRuns(int max_runs) {
+  return impl_->SetMaxConcurrentRuns(max_runs);
+}
+
+MaceStatus MaceEngineConfig::SetIncrementalInputs(
+    const std::vector<std::string> &input_names) {
+  return impl_->SetIncrementalInputs(input_names);
+}
+
+MaceStatus MaceEngineConfig::SetTiledExecution(bool enable) {
+  return impl_->SetTiledExecution(enable);
+}
+
+MaceStatus MaceEngineConfig::SetAllocationFreeRuns(bool enable,
+                                                   bool fail_allocations) {
+  return impl_->SetAllocationFreeRuns(enable, fail_allocations);
+}
+
+MaceStatus MaceEngineConfig::SetCPUMemoryPolicy(bool huge_pages,
+                                                bool bind_numa_nodes) {
+  return impl_->SetCPUMemoryPolicy(huge_pages, bind_numa_nodes);
+}
+
+MaceStatus MaceEngineConfig::SetCPUConstantFolding(bool enable,
+                                                   bool fixed_input_shapes) {
+  return impl_->SetCPUConstantFolding(enable, fixed_input_shapes);
+}
+
+MaceStatus MaceEngineConfig::SetLowMemoryMode(bool enable) {
+  return impl_->SetLowMemoryMode(enable);
+}
+
+MaceStatus MaceEngineConfig::SetGPUKernelReplay(bool enable) {
+  return impl_->SetGPUKernelReplay(enable);
+}
+
+// Mace Runtime Manager
+class MaceRuntimeManager::Impl : public RuntimeArbiter {};
+
+MaceRuntimeManager::MaceRuntimeManager()
+    : impl_(std::make_shared<MaceRuntimeManager::Impl>()) {}
+
+MaceRuntimeManager::~MaceRuntimeManager() = default;
+
+std::shared_ptr<MaceRuntimeManager> MaceRuntimeManager::Get() {
+  static std::shared_ptr<MaceRuntimeManager> manager(new MaceRuntimeManager);
+  return manager;
+}
+
+MaceStatus MaceRuntimeManager::SetCPUThreadBudget(int num_threads) {
+  impl_->SetCPUThreadBudget(num_threads);
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceRuntimeManager::SetMaxQueueLength(int max_queue_length) {
+  impl_->SetMaxQueueLength(max_queue_length);
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceRuntimeManager::GetStats(
+    std::vector<RuntimeDeviceStats> *stats, bool reset) {
+  impl_->GetStats(stats, reset);
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngineConfig::SetRuntimeManager(
+    std::shared_ptr<MaceRuntimeManager> manager,
+    int priority,
+    int64_t deadline_micros) {
+  std::shared_ptr<RuntimeArbiter> arbiter;
+  if (manager != nullptr) {
+    arbiter = manager->impl_;
+  }
+  return impl_->SetRuntimeArbiter(arbiter, priority, deadline_micros);
 }
 
 // Mace Tensor
@@ -285,6 +1551,14 @@ class MaceTensor::Impl {
   std::shared_ptr<float> data;
   DataFormat format;
   int64_t buffer_size;
+  void *opencl_memory;
+  OpenCLMemoryType opencl_memory_type;
+  std::shared_ptr<uint8_t> pixels;
+  std::shared_ptr<void> raw_data;
+  IDataType data_type = IDataType::IDT_FLOAT;
+  float scale = 0.f;
+  int32_t zero_point = 0;
+  bool valid = true;
 };
 
 MaceTensor::MaceTensor(const std::vector<int64_t> &shape,
@@ -294,13 +1568,78 @@ MaceTensor::MaceTensor(const std::vector<int64_t> &shape,
   impl_ = make_unique<MaceTensor::Impl>();
   impl_->shape = shape;
   impl_->data = data;
+  impl_->raw_data = data;
+  impl_->format = format;
+  impl_->buffer_size =
+      std::accumulate(shape.begin(), shape.end(), 1, std::multiplies<float>());
+  impl_->opencl_memory = nullptr;
+  impl_->opencl_memory_type = OpenCLMemoryType::OPENCL_BUFFER;
+}
+
+MaceTensor::MaceTensor(const std::vector<int64_t> &shape,
+                       std::shared_ptr<float> data,
+                       const DataFormat format,
+                       const int64_t buffer_size)
+    : MaceTensor(shape, data, format) {
+  MACE_CHECK(buffer_size >= impl_->buffer_size,
+             "buffer size ", buffer_size, " is less than the tensor size ",
+             impl_->buffer_size);
+  impl_->buffer_size = buffer_size;
+}
+
+MaceTensor::MaceTensor(const std::vector<int64_t> &shape,
+                       std::shared_ptr<uint8_t> pixels) {
+  MACE_CHECK_NOTNULL(pixels.get());
+  impl_ = make_unique<MaceTensor::Impl>();
+  impl_->shape = shape;
+  impl_->format = DataFormat::NHWC;
+  impl_->buffer_size = 0;
+  impl_->opencl_memory = nullptr;
+  impl_->opencl_memory_type = OpenCLMemoryType::OPENCL_BUFFER;
+  impl_->pixels = pixels;
+}
+
+MaceTensor::MaceTensor(const std::vector<int64_t> &shape,
+                       std::shared_ptr<void> data,
+                       const IDataType data_type,
+                       const DataFormat format,
+                       const float scale,
+                       const int32_t zero_point) {
+  MACE_CHECK_NOTNULL(data.get());
+  impl_ = make_unique<MaceTensor::Impl>();
+  impl_->shape = shape;
+  if (data_type == IDataType::IDT_FLOAT) {
+    impl_->data = std::static_pointer_cast<float>(data);
+  }
+  impl_->raw_data = data;
+  impl_->data_type = data_type;
+  impl_->format = format;
+  impl_->buffer_size =
+      std::accumulate(shape.begin(), shape.end(), 1, std::multiplies<float>());
+  impl_->opencl_memory = nullptr;
+  impl_->opencl_memory_type = OpenCLMemoryType::OPENCL_BUFFER;
+  impl_->scale = scale;
+  impl_->zero_point = zero_point;
+}
+
+MaceTensor::MaceTensor(const std::vector<int64_t> &shape,
+                       void *opencl_memory,
+                       const OpenCLMemoryType opencl_memory_type,
+                       const DataFormat format) {
+  MACE_CHECK_NOTNULL(opencl_memory);
+  impl_ = make_unique<MaceTensor::Impl>();
+  impl_->shape = shape;
   impl_->format = format;
   impl_->buffer_size =
       std::accumulate(shape.begin(), shape.end(), 1, std::multiplies<float>());
+  impl_->opencl_memory = opencl_memory;
+  impl_->opencl_memory_type = opencl_memory_type;
 }
 
 MaceTensor::MaceTensor() {
   impl_ = make_unique<MaceTensor::Impl>();
+  impl_->opencl_memory = nullptr;
+  impl_->opencl_memory_type = OpenCLMemoryType::OPENCL_BUFFER;
 }
 
 MaceTensor::MaceTensor(const MaceTensor &other) {
@@ -309,6 +1648,14 @@ MaceTensor::MaceTensor(const MaceTensor &other) {
   impl_->data = other.data();
   impl_->format = other.data_format();
   impl_->buffer_size = other.impl_->buffer_size;
+  impl_->opencl_memory = other.impl_->opencl_memory;
+  impl_->opencl_memory_type = other.impl_->opencl_memory_type;
+  impl_->pixels = other.impl_->pixels;
+  impl_->raw_data = other.impl_->raw_data;
+  impl_->data_type = other.impl_->data_type;
+  impl_->scale = other.impl_->scale;
+  impl_->zero_point = other.impl_->zero_point;
+  impl_->valid = other.impl_->valid;
 }
 
 MaceTensor::MaceTensor(const MaceTensor &&other) {
@@ -317,6 +1664,14 @@ MaceTensor::MaceTensor(const MaceTensor &&other) {
   impl_->data = other.data();
   impl_->format = other.data_format();
   impl_->buffer_size = other.impl_->buffer_size;
+  impl_->opencl_memory = other.impl_->opencl_memory;
+  impl_->opencl_memory_type = other.impl_->opencl_memory_type;
+  impl_->pixels = other.impl_->pixels;
+  impl_->raw_data = other.impl_->raw_data;
+  impl_->data_type = other.impl_->data_type;
+  impl_->scale = other.impl_->scale;
+  impl_->zero_point = other.impl_->zero_point;
+  impl_->valid = other.impl_->valid;
 }
 
 MaceTensor &MaceTensor::operator=(const MaceTensor &other) {
@@ -324,6 +1679,14 @@ MaceTensor &MaceTensor::operator=(const MaceTensor &other) {
   impl_->data = other.data();
   impl_->format = other.data_format();
   impl_->buffer_size = other.impl_->buffer_size;
+  impl_->opencl_memory = other.impl_->opencl_memory;
+  impl_->opencl_memory_type = other.impl_->opencl_memory_type;
+  impl_->pixels = other.impl_->pixels;
+  impl_->raw_data = other.impl_->raw_data;
+  impl_->data_type = other.impl_->data_type;
+  impl_->scale = other.impl_->scale;
+  impl_->zero_point = other.impl_->zero_point;
+  impl_->valid = other.impl_->valid;
   return *this;
 }
 
@@ -332,6 +1695,14 @@ MaceTensor &MaceTensor::operator=(const MaceTensor &&other) {
   impl_->data = other.data();
   impl_->format = other.data_format();
   impl_->buffer_size = other.impl_->buffer_size;
+  impl_->opencl_memory = other.impl_->opencl_memory;
+  impl_->opencl_memory_type = other.impl_->opencl_memory_type;
+  impl_->pixels = other.impl_->pixels;
+  impl_->raw_data = other.impl_->raw_data;
+  impl_->data_type = other.impl_->data_type;
+  impl_->scale = other.impl_->scale;
+  impl_->zero_point = other.impl_->zero_point;
+  impl_->valid = other.impl_->valid;
   return *this;
 }
 
@@ -347,10 +1718,81 @@ DataFormat MaceTensor::data_format() const {
   return impl_->format;
 }
 
+void *MaceTensor::opencl_memory() const {
+  return impl_->opencl_memory;
+}
+
+const std::shared_ptr<uint8_t> MaceTensor::pixels() const {
+  return impl_->pixels;
+}
+
+IDataType MaceTensor::data_type() const {
+  return impl_->data_type;
+}
+
+const std::shared_ptr<void> MaceTensor::raw_data() const {
+  return impl_->raw_data;
+}
+
+float MaceTensor::scale() const {
+  return impl_->scale;
+}
+
+int32_t MaceTensor::zero_point() const {
+  return impl_->zero_point;
+}
+
+bool MaceTensor::valid() const {
+  return impl_->valid;
+}
+
+// Run Future
+class RunFuture::Impl {
+ public:
+  Impl() : done_(false) {}
+
+  void Finish(const MaceStatus &status) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    status_ = status;
+    done_ = true;
+    cond_.notify_all();
+  }
+
+  MaceStatus Wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait(lock, [this] { return done_; });
+    return status_;
+  }
+
+  bool IsReady() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return done_;
+  }
+
+ private:
+  mutable std::mutex mutex_;
+  std::condition_variable cond_;
+  bool done_;
+  MaceStatus status_;
+};
+
+RunFuture::RunFuture() : impl_(make_unique<RunFuture::Impl>()) {}
+
+RunFuture::~RunFuture() = default;
+
+MaceStatus RunFuture::Wait() { return impl_->Wait(); }
+
+bool RunFuture::IsReady() const { return impl_->IsReady(); }
+
 // Mace Engine
 class MaceEngine::Impl {
  public:
-  explicit Impl(const MaceEngineConfig &config);
+  // a copy of the settings of the config, kept for the next versions of the
+  // model, which are created on the device of the first one, and for the
+  // execution contexts of primary, which share its weights and caches
+  Impl(std::shared_ptr<MaceEngineConfig::Impl> config,
+       std::shared_ptr<Device> base_device,
+       Impl *primary = nullptr);
 
   ~Impl();
 
@@ -368,70 +1810,598 @@ class MaceEngine::Impl {
                  std::map<std::string, MaceTensor> *outputs,
                  RunMetadata *run_metadata);
 
- private:
-  MaceStatus TransposeInput(
-      const std::pair<const std::string, MaceTensor> &input,
-      Tensor *input_tensor);
+  MaceStatus RunBatch(
+      const std::vector<std::map<std::string, MaceTensor>> &inputs,
+      std::vector<std::map<std::string, MaceTensor>> *outputs);
 
-  MaceStatus TransposeOutput(const Tensor *output_tensor,
-                             std::pair<const std::string, MaceTensor> *output);
+  MaceStatus RunAsync(const std::map<std::string, MaceTensor> &inputs,
+                      std::map<std::string, MaceTensor> *outputs,
+                      RunCallback callback,
+                      std::shared_ptr<RunFuture> *future);
 
- private:
-  const unsigned char *model_data_;
+  MaceStatus GetOpenCLContext(void **cl_context, void **cl_command_queue);
+
+  MaceStatus CreateOpenCLImageFromEGLImage(void *egl_display,
+                                           void *egl_image,
+                                           void **opencl_image);
+
+  MaceStatus ReleaseOpenCLImage(void *opencl_image);
+
+  MaceStatus SetEGLSync(void *egl_display, void *egl_sync);
+
+  MaceStatus ResetStates();
+
+  MaceStatus GetLatencyMetrics(LatencyMetrics *metrics, bool reset);
+
+  MaceStatus GetInitStats(InitStats *stats) const;
+
+  MaceStatus GetMemoryStats(EngineMemoryStats *stats) const;
+
+  MaceStatus Trim(TrimLevel level);
+
+  MaceStatus ExportMemoryPlan(
+      const unsigned char *model_graph_proto,
+      const size_t model_graph_proto_size,
+      std::vector<unsigned char> *planned_model_graph_proto) const;
+
+  MaceStatus SaveSnapshot(const std::string &file_path) const;
+
+  MaceStatus LoadSnapshot(const std::string &file_path, NetDef *net_def);
+
+  MaceStatus Calibrate(
+      const std::vector<std::map<std::string, MaceTensor>> &dataset,
+      const CalibrationMethod method,
+      const float percentile,
+      const unsigned char *model_graph_proto,
+      const size_t model_graph_proto_size,
+      std::vector<unsigned char> *calibrated_model_graph_proto);
+
+  MaceStatus LoadNextModel(const NetDef *net_def,
+                           const std::vector<std::string> &input_nodes,
+                           const std::vector<std::string> &output_nodes,
+                           const unsigned char *model_data,
+                           std::shared_ptr<RunFuture> *future);
+
+  // the next version of the model once it is loaded, null before or if its
+  // load failed
+  std::unique_ptr<Impl> TakeNextModel();
+
+  MaceStatus WarmUp(const WarmUpOptions &options,
+                    RunCallback callback,
+                    std::shared_ptr<RunFuture> *future);
+
+  // wait for the warm-up in the background, if any
+  void WaitWarmUp();
+
+ private:
+  struct AsyncRun {
+    std::map<std::string, MaceTensor> *outputs;
+    std::vector<Tensor *> input_tensors;
+    // the outputs the net exited early before, on GPU
+    std::set<std::string> skipped_outputs;
+    int slot;
+    int64_t call_micros;
+#ifdef MACE_ENABLE_OPENCL
+    std::vector<cl::Event> events;
+#endif
+    RunCallback callback;
+    std::shared_ptr<RunFuture> future;
+  };
+
+  // the workspace and the net planned for the input shapes of key
+  struct ShapePlan {
+    std::string key;
+    std::unique_ptr<Workspace> ws;
+    std::unique_ptr<NetBase> net;
+  };
+
+  // whether the last run exited early before producing the output
+  bool IsOutputSkipped(const std::string &output_name) const {
+    return net_ != nullptr && net_->IsSkipped(output_name);
+  }
+
+  // tell the net which incremental inputs differ from the ones of its
+  // last run
+  void UpdateChangedInputs(const std::map<std::string, MaceTensor> &inputs);
+
+  MaceStatus ExecuteNet(const std::vector<Tensor *> &input_tensors,
+                        std::vector<Tensor *> *output_tensors,
+                        RunMetadata *run_metadata);
+
+  // free the scratch memory of the ops, the next run allocates it again
+  void ReleaseScratch();
+
+  // the receptive field of the outputs and the tile of a fully
+  // convolutional net, see MaceEngineConfig::SetTiledExecution
+  MaceStatus InitTiles(const NetDef &net_def,
+                       const std::vector<std::string> &input_nodes,
+                       const std::vector<std::string> &output_nodes);
+
+  // whether the image fed is larger than a tile
+  bool NeedsTiles(const std::map<std::string, MaceTensor> &inputs) const;
+
+  // run the net on the tiles of the image and stitch their outputs
+  MaceStatus RunTiled(const std::map<std::string, MaceTensor> &inputs,
+                      std::map<std::string, MaceTensor> *outputs,
+                      RunMetadata *run_metadata);
+
+  // run the net once on zero inputs of the shapes of the model, doing the
+  // lazy work of the first run, then reset the states it left
+  MaceStatus RunOnZeros();
+
+  // run the net once on the input shapes of the model, so that the
+  // following runs of these shapes find their buffers allocated, and watch
+  // the allocations of their operations
+  MaceStatus PreallocateRuns();
+
+  // the warm-up of this context and of the others
+  MaceStatus WarmUpContexts(const WarmUpOptions &options);
+
+  // a run on the workspace of this context, called at call_micros
+  MaceStatus RunExclusive(const std::map<std::string, MaceTensor> &inputs,
+                          std::map<std::string, MaceTensor> *outputs,
+                          RunMetadata *run_metadata,
+                          int64_t call_micros);
+
+  // a free execution context, created if there are fewer than
+  // max_contexts_, wait for one otherwise
+  MaceStatus AcquireContext(Impl **context);
+
+  void ReleaseContext(Impl *context);
+
+  // share the weights among the workspaces of the model as views
+  void ShareModelWeights(const NetDef &net_def,
+                         const unsigned char *model_data);
+
+  MaceStatus EnqueueAsyncRun(const std::map<std::string, MaceTensor> &inputs,
+                             AsyncRun *run);
+
+  MaceStatus FinishAsyncRun(AsyncRun *run);
+
+  void AsyncLoop();
+
+  void WaitAsyncRuns();
+
+  MaceStatus RunStacked(
+      const std::vector<std::map<std::string, MaceTensor>> &inputs,
+      std::vector<std::map<std::string, MaceTensor>> *outputs,
+      const size_t begin,
+      const size_t end,
+      const int64_t batch);
+
+  MaceStatus TransposeInput(
+      const std::pair<const std::string, MaceTensor> &input,
+      Tensor *input_tensor);
+
+  MaceStatus CheckFoldedInputShape(const std::string &input_name,
+                                   const Tensor *input_tensor) const;
+
+  MaceStatus PreprocessInput(
+      const std::pair<const std::string, MaceTensor> &input,
+      Tensor *input_tensor);
+
+  MaceStatus TransposeOutput(const Tensor *output_tensor,
+                             std::pair<const std::string, MaceTensor> *output);
+
+  // the inputs and outputs of other data types than float, converted to
+  // float unless they are quantized ones of a quantized model
+  MaceStatus TransposeTypedInput(
+      const std::pair<const std::string, MaceTensor> &input,
+      Tensor *input_tensor);
+
+  MaceStatus TransposeTypedOutput(
+      const Tensor *output_tensor,
+      std::pair<const std::string, MaceTensor> *output);
+
+  // a span of the engine from start_micros to now, if it is traced
+  void TraceSpan(const std::string &name,
+                 const std::string &category,
+                 int64_t start_micros);
+
+  // a run called at call_micros and executed from start_micros to now
+  void RecordRunLatency(int64_t call_micros, int64_t start_micros);
+
+  // a phase of the init from the end of the previous one to now
+  void EndInitPhase(const std::string &name);
+
+  // whether the buffer of the tensor is shared with the Hexagon DSP
+  bool IsHexagonBuffer(const MaceTensor &tensor) const;
+
+  // whether the whole net runs as one DSP graph, not partitioned
+  bool RunsHexagonGraph() const;
+
+  bool CanBindInput(const std::string &name, const MaceTensor &input) const;
+
+  bool CanBindOutput(const MaceTensor &output,
+                     const Tensor *output_tensor) const;
+
+  MaceStatus CreateImageInput(const NetDef &net_def,
+                              const std::string &input_name,
+                              const std::vector<index_t> &shape);
+
+  MaceStatus BindOpenCLInput(
+      const std::pair<const std::string, MaceTensor> &input,
+      Tensor *input_tensor,
+      ZeroCopyBinding *zero_copy_binding);
+
+  MaceStatus BindOpenCLOutput(
+      const std::pair<const std::string, MaceTensor> &output,
+      Tensor *output_tensor,
+      ZeroCopyBinding *zero_copy_binding);
+
+  // write the NHWC output of the net into the OpenCL image of the output
+  MaceStatus WriteOpenCLImageOutput(
+      const std::pair<const std::string, MaceTensor> &output,
+      Tensor *output_tensor);
+
+  // acquire the EGL images among the OpenCL memory of a run for the queue,
+  // after the fence of SetEGLSync
+  MaceStatus AcquireEGLImages(const std::map<std::string, MaceTensor> &inputs,
+                              const std::map<std::string, MaceTensor> &outputs,
+                              std::vector<void *> *egl_images);
+
+  MaceStatus ReleaseEGLImages(const std::vector<void *> &egl_images);
+
+  // the shape of an input in the data format of the model, those not fed
+  // or fed as pixels are of the model
+  std::vector<int64_t> ShapePlanInputShape(
+      const std::string &input_name,
+      const std::map<std::string, MaceTensor> &inputs) const;
+
+  std::string ShapePlanKey(
+      const std::map<std::string, MaceTensor> &inputs) const;
+
+  MaceStatus InitShapePlans(const NetDef &net_def,
+                            const std::vector<std::string> &input_nodes,
+                            const std::vector<std::string> &output_nodes,
+                            const unsigned char *model_data);
+
+  // make the plan of the input shapes the one in ws_ and net_
+  MaceStatus SwitchShapePlan(const std::map<std::string, MaceTensor> &inputs);
+
+  MaceStatus BuildShapePlan(const std::map<std::string, MaceTensor> &inputs,
+                            ShapePlan *plan);
+
+  // a workspace of the views of the weights and of the io tensors
+  MaceStatus NewShapePlanWorkspace(const NetDef &net_def,
+                                   std::unique_ptr<Workspace> *ws);
+
+  // look the io tensors of ws_ up once instead of at each run
+  void ResolveIOTensors();
+
+ private:
+  std::shared_ptr<MaceEngineConfig::Impl> config_;
+  const unsigned char *model_data_;
   size_t model_data_size_;
   std::unique_ptr<OpRegistryBase> op_registry_;
   DeviceType device_type_;
-  std::unique_ptr<Device> device_;
+  // the device owning the runtimes, shared by the versions of the model
+  std::shared_ptr<Device> base_device_;
+  std::shared_ptr<Device> device_;
+  // the context whose weights and caches this one shares, null if it is the
+  // primary context
+  Impl *primary_;
   std::unique_ptr<Workspace> ws_;
+  // the memory plan of the net, loaded or made by Init
+  MemoryPlan memory_plan_;
   std::unique_ptr<NetBase> net_;
+  // destroyed before the net and the device, which its events refer to
+  std::shared_ptr<Tracer> tracer_;
+  bool latency_metrics_;
+  LatencyHistogram queued_latency_;
+  LatencyHistogram exec_latency_;
+  LatencyHistogram total_latency_;
+  int64_t init_start_micros_;
+  int64_t init_end_micros_;
+  int64_t init_phase_start_micros_;
+  std::vector<InitPhaseStats> init_phases_;
   bool is_quantized_model_;
+  int inter_op_parallelism_;
+  bool zero_copy_;
+  bool cpu_half_precision_;
+  bool cpu_bfloat16_;
+  std::map<std::string, int> cpu_op_threads_;
+  bool cpu_weight_prefetch_;
+  bool cpu_line_buffered_head_;
+  int cpu_channel_block_;
+  DataFormat cpu_data_format_;
+  // the inputs fed and the outputs fetched as NHWC by the CPU NHWC ops
+  std::unordered_set<std::string> nhwc_inputs_;
+  std::unordered_set<std::string> nhwc_outputs_;
+  bool cpu_constant_folding_;
+  bool cpu_fixed_input_shapes_;
+  // plan the smallest arena, run the ops one by one and release the
+  // scratch memory after the runs
+  bool low_memory_;
+  // replay the GPU kernels of the runs of the same input shapes
+  bool gpu_kernel_replay_;
+  // admits the runs onto the device among the engines of the process
+  std::shared_ptr<RuntimeArbiter> runtime_arbiter_;
+  int run_priority_;
+  int64_t run_deadline_micros_;
+  // the shapes of the inputs the folded shape ops read
+  std::map<std::string, std::vector<index_t>> folded_input_shapes_;
+  bool nnapi_delegation_;
+  std::string nnapi_cache_dir_;
+  DSPPerfHint dsp_perf_hint_;
+  bool gpu_elementwise_fusion_;
+  // the inputs which could be fed quantized, and the quantized tensors of
+  // the outputs, of a quantized model
+  std::set<std::string> quantized_inputs_;
+  std::unordered_map<std::string, std::string> quantized_outputs_;
+  std::set<std::string> opencl_image_inputs_;
+  // the OpenCL images sharing EGL images, kept by the primary context, and
+  // the fence the next run waits for before reading them
+  std::mutex egl_mutex_;
+  std::set<void *> egl_images_;
+  void *egl_display_;
+  void *egl_sync_;
+#ifdef MACE_ENABLE_OPENCL
+  // the transforms writing the outputs into their OpenCL images
+  std::map<std::string, std::unique_ptr<ops::OpenCLBufferTransformKernel>>
+      image_output_kernels_;
+#endif
+  std::map<std::string, InputPreprocess> input_preprocess_;
 #ifdef MACE_ENABLE_HEXAGON
   std::unique_ptr<HexagonControlWrapper> hexagon_controller_;
 #endif
   std::map<std::string, mace::InputInfo> input_info_map_;
   std::map<std::string, mace::OutputInfo> output_info_map_;
+  // the io tensors of ws_ by name
+  std::map<std::string, Tensor *> input_tensor_map_;
+  std::map<std::string, Tensor *> output_tensor_map_;
+  // the largest batch the preallocated input tensors could hold
+  int64_t max_batch_size_;
+  // host side staging tensors of in-flight GPU runs, and the input tensors
+  // shared with the DSP of in-flight HEXAGON runs, one set per slot
+  std::vector<std::map<std::string, std::unique_ptr<Tensor>>> async_inputs_;
+  std::vector<std::map<std::string, std::unique_ptr<Tensor>>> async_outputs_;
+  // the device buffers the staging tensors of in-flight GPU runs are
+  // transferred to and from
+  std::vector<std::map<std::string, std::unique_ptr<Tensor>>>
+      async_device_inputs_;
+  std::vector<std::map<std::string, std::unique_ptr<Tensor>>>
+      async_device_outputs_;
+  // nice value of the async worker
+  int async_priority_;
+  int async_slot_;
+  std::deque<std::unique_ptr<AsyncRun>> async_queue_;
+  size_t async_in_flight_;
+  bool async_stop_;
+  std::mutex async_mutex_;
+  std::condition_variable async_cond_;
+  std::thread async_worker_;
+  std::shared_ptr<PackedWeights> packed_weights_;
+  std::shared_ptr<AlgorithmCache> algorithm_cache_;
+  std::shared_ptr<ModelWeights> model_weights_;
+  size_t shape_plan_cache_size_;
+  // the model of which the shapes are derived for each plan
+  std::unique_ptr<NetDef> shape_plan_net_def_;
+  const unsigned char *shape_plan_model_data_;
+  std::vector<std::string> shape_plan_inputs_;
+  std::vector<std::string> shape_plan_outputs_;
+  // the plans of the last input shapes, the most recent first, whose
+  // workspace and net are in ws_ and net_
+  std::list<ShapePlan> shape_plans_;
+  // the next version of the model, loaded by next_loader_ while this one
+  // runs
+  std::thread next_loader_;
+  std::mutex next_mutex_;
+  bool next_loaded_;
+  std::unique_ptr<Impl> next_impl_;
+  // the warm-up in the background
+  std::thread warm_up_worker_;
+  // the execution contexts of the concurrent runs, this one and the ones
+  // created on demand, which share the model of this one
+  int max_concurrent_runs_;
+  size_t max_contexts_;
+  std::unique_ptr<NetDef> context_net_def_;
+  const unsigned char *context_model_data_;
+  std::vector<std::string> context_inputs_;
+  std::vector<std::string> context_outputs_;
+  std::vector<std::unique_ptr<Impl>> contexts_;
+  std::vector<Impl *> free_contexts_;
+  size_t num_contexts_;
+  // the inputs whose unchanged content lets the net skip ops, and their
+  // shapes and content in the last run of incremental_net_
+  struct IncrementalInput {
+    std::vector<int64_t> shape;
+    DataFormat format;
+    std::vector<char> data;
+  };
+  std::vector<std::string> incremental_inputs_;
+  std::map<std::string, IncrementalInput> last_inputs_;
+  const NetBase *incremental_net_;
+  // the input cut into tiles of its shape in the model, the halo of the
+  // tiles and the alignment of their origins along the height and the
+  // width, and the reach of each output, empty without tiled execution
+  bool tiled_execution_;
+  std::string tiled_input_;
+  index_t tile_size_[2];
+  index_t tile_halo_[2];
+  index_t tile_align_[2];
+  std::map<std::string, SpatialReach> tile_reaches_;
+  // the allocations of the operations of net_ after PreallocateRuns, null
+  // unless the runs should not allocate
+  std::unique_ptr<AllocationMonitor> allocation_monitor_;
+  std::unique_ptr<AllocationObserver> allocation_observer_;
+  std::mutex context_mutex_;
+  std::condition_variable context_cond_;
 
   MACE_DISABLE_COPY_AND_ASSIGN(Impl);
 };
 
-MaceEngine::Impl::Impl(const MaceEngineConfig &config)
-    : model_data_(nullptr),
+MaceEngine::Impl::Impl(std::shared_ptr<MaceEngineConfig::Impl> config,
+                       std::shared_ptr<Device> base_device,
+                       Impl *primary)
+    : config_(config),
+      model_data_(nullptr),
       model_data_size_(0),
       op_registry_(new OpRegistry),
-      device_type_(config.impl_->device_type()),
+      device_type_(config->device_type()),
+      base_device_(base_device),
       device_(nullptr),
+      primary_(primary),
       ws_(new Workspace()),
       net_(nullptr),
-      is_quantized_model_(false)
+      tracer_(nullptr),
+      latency_metrics_(config->latency_metrics()),
+      init_start_micros_(NowMicros()),
+      init_end_micros_(init_start_micros_),
+      init_phase_start_micros_(init_start_micros_),
+      is_quantized_model_(false),
+      inter_op_parallelism_(config->inter_op_parallelism()),
+      zero_copy_(config->zero_copy()),
+      cpu_half_precision_(config->cpu_half_precision()),
+      cpu_bfloat16_(config->cpu_bfloat16()),
+      cpu_op_threads_(config->cpu_op_threads()),
+      cpu_weight_prefetch_(config->cpu_weight_prefetch()),
+      cpu_line_buffered_head_(config->cpu_line_buffered_head()),
+      cpu_channel_block_(config->cpu_channel_block()),
+      cpu_data_format_(config->cpu_data_format()),
+      cpu_constant_folding_(config->cpu_constant_folding()),
+      cpu_fixed_input_shapes_(config->cpu_fixed_input_shapes()),
+      low_memory_(config->low_memory()),
+      gpu_kernel_replay_(config->gpu_kernel_replay() &&
+                         device_type_ == DeviceType::GPU),
+      runtime_arbiter_(config->runtime_arbiter()),
+      run_priority_(config->run_priority()),
+      run_deadline_micros_(config->run_deadline_micros()),
+      nnapi_delegation_(config->nnapi_delegation()),
+      nnapi_cache_dir_(config->nnapi_cache_dir()),
+      dsp_perf_hint_(config->dsp_perf_hint()),
+      gpu_elementwise_fusion_(config->gpu_elementwise_fusion()),
+      opencl_image_inputs_(config->opencl_image_inputs().begin(),
+                           config->opencl_image_inputs().end()),
+      egl_display_(nullptr),
+      egl_sync_(nullptr),
+      input_preprocess_(config->input_preprocess()),
 #ifdef MACE_ENABLE_HEXAGON
-      , hexagon_controller_(nullptr)
+      hexagon_controller_(nullptr),
 #endif
-{
+      max_batch_size_(1),
+      async_inputs_(config->max_async_runs()),
+      async_outputs_(config->max_async_runs()),
+      async_device_inputs_(config->max_async_runs()),
+      async_device_outputs_(config->max_async_runs()),
+      async_priority_(config->async_priority()),
+      async_slot_(0),
+      async_in_flight_(0),
+      async_stop_(false),
+      packed_weights_(new PackedWeights),
+      algorithm_cache_(new AlgorithmCache),
+      model_weights_(nullptr),
+      shape_plan_cache_size_(config->shape_plan_cache_size()),
+      shape_plan_model_data_(nullptr),
+      next_loaded_(false),
+      max_concurrent_runs_(primary == nullptr ?
+                           config->max_concurrent_runs() : 1),
+      max_contexts_(max_concurrent_runs_),
+      context_model_data_(nullptr),
+      num_contexts_(0),
+      incremental_inputs_(config->incremental_inputs()),
+      incremental_net_(nullptr),
+      tiled_execution_(config->tiled_execution()),
+      tile_size_{0, 0},
+      tile_halo_{0, 0},
+      tile_align_{1, 1} {
   LOG(INFO) << "Creating MaceEngine, MACE version: " << MaceVersion();
-  if (device_type_ == DeviceType::CPU) {
-    device_.reset(new CPUDevice(config.impl_->num_threads(),
-                                config.impl_->cpu_affinity_policy(),
-                                config.impl_->use_gemmlowp()));
+  if (primary_ != nullptr) {
+    tracer_ = primary_->tracer_;
+    packed_weights_ = primary_->packed_weights_;
+    algorithm_cache_ = primary_->algorithm_cache_;
+    model_weights_ = primary_->model_weights_;
+  } else {
+    if (!config->trace_file().empty()) {
+      tracer_.reset(new Tracer(config->trace_file()));
+    }
+    if (!config->packed_weights_file().empty()) {
+      packed_weights_ =
+          PackedWeights::Shared(config->packed_weights_file());
+    }
+    if (!config->algorithm_cache_file().empty()) {
+      algorithm_cache_ =
+          AlgorithmCache::Shared(config->algorithm_cache_file());
+    }
+    // the weights of the config are of the model, not of its next versions
+    if (config->model_weights() != nullptr && base_device_ == nullptr) {
+      if (device_type_ == DeviceType::CPU) {
+        model_weights_ = config->model_weights();
+      } else {
+        LOG(WARNING) << "Model weights are only shared on CPU, the engine"
+                     << " loads its own";
+      }
+    }
+  }
+  ws_->set_packed_weights(packed_weights_);
+  ws_->set_algorithm_cache(algorithm_cache_);
+  if (model_weights_ != nullptr) {
+    ws_->set_model_weights(model_weights_);
+  }
+  if (max_concurrent_runs_ > 1 && device_type_ != DeviceType::CPU) {
+    LOG(WARNING) << "Concurrent runs are only supported on CPU, the runs"
+                 << " are serialized";
+    max_contexts_ = 1;
   }
+  if (low_memory_) {
+    // the blocks of concurrent branches are not shared, and each cached
+    // shape plan holds its own arena
+    if (inter_op_parallelism_ > 1) {
+      LOG(INFO) << "Low memory mode runs the ops one by one";
+      inter_op_parallelism_ = 1;
+    }
+    shape_plan_cache_size_ = std::min<size_t>(shape_plan_cache_size_, 1);
+  }
+  if (base_device_ != nullptr) {
+    device_.reset(new SharedDevice(base_device_));
+  } else if (device_type_ == DeviceType::CPU) {
+    std::unique_ptr<CPUDevice> cpu_device(
+        new CPUDevice(config->num_threads(),
+                      config->cpu_affinity_policy(),
+                      config->use_gemmlowp()));
+    if (config->cpu_huge_pages()) {
+      cpu_device->set_allocator(GetHugePageCPUAllocator(
+          config->cpu_bind_numa_nodes(),
+          cpu_device->cpu_runtime()->cpu_ids()));
+    }
+    device_ = std::move(cpu_device);
 #ifdef MACE_ENABLE_OPENCL
-  if (device_type_ == DeviceType::GPU) {
+  } else if (device_type_ == DeviceType::GPU) {
+    config->gpu_context()->SelectOpenCLPackageEntry(
+        OpenCLRuntime::DefaultPlatformInfo());
     device_.reset(new GPUDevice(
-        config.impl_->gpu_context()->opencl_tuner(),
-        config.impl_->gpu_context()->opencl_cache_storage(),
-        config.impl_->gpu_priority_hint(),
-        config.impl_->gpu_perf_hint(),
-        config.impl_->gpu_context()->opencl_binary_storage(),
-        config.impl_->num_threads(),
-        config.impl_->cpu_affinity_policy(),
-        config.impl_->use_gemmlowp()));
-  }
+        config->gpu_context()->opencl_tuner(),
+        config->gpu_context()->opencl_cache_storage(),
+        config->gpu_priority_hint(),
+        config->gpu_perf_hint(),
+        config->gpu_context()->opencl_binary_storage(),
+        config->num_threads(),
+        config->cpu_affinity_policy(),
+        config->use_gemmlowp()));
+    if (config->gpu_max_kernel_micros() > 0) {
+      device_->gpu_runtime()->opencl_runtime()->SetMaxKernelMicros(
+          static_cast<uint32_t>(config->gpu_max_kernel_micros()));
+    }
 #endif
 #ifdef MACE_ENABLE_HEXAGON
-  if (device_type_ == DeviceType::HEXAGON) {
+  } else if (device_type_ == DeviceType::HEXAGON) {
     device_.reset(new HexagonDevice());
-  }
 #endif
+  }
   MACE_CHECK_NOTNULL(device_);
+  if (base_device_ == nullptr) {
+    // the threads of a shared device are those of its base
+    if (config->cpu_sched_policy() != CPUSchedulingPolicy::CPU_SCHED_NORMAL) {
+      MaceStatus status = device_->cpu_runtime()->SetScheduling(
+          config->cpu_sched_policy(), config->cpu_sched_priority());
+      if (status != MaceStatus::MACE_SUCCESS) {
+        LOG(WARNING) << "Failed to set the scheduling class of the CPU"
+                     << " threads: " << status.information();
+      }
+    }
+    base_device_ = device_;
+  }
+  EndInitPhase("create_device");
 }
 
 MaceStatus MaceEngine::Impl::Init(
@@ -440,14 +2410,24 @@ MaceStatus MaceEngine::Impl::Init(
     const std::vector<std::string> &output_nodes,
     const unsigned char *model_data) {
   LOG(INFO) << "Initializing MaceEngine";
+  MACE_SYSTEM_TRACE("MaceEngine::Init");
+  // the allocations of the workspace are traced
+  Tracer::Scope trace_scope(tracer_.get());
+  const int64_t trace_start_micros = NowMicros();
+  init_phase_start_micros_ = trace_start_micros;
   // Check avalibility
 #ifdef MACE_ENABLE_OPENCL
   if (device_type_ == DeviceType::GPU) {
     MACE_RETURN_IF_ERROR(CheckGPUAvalibility(net_def, device_.get()));
+    EndInitPhase("check_gpu");
   }
 #endif
   // mark quantized model flag
   is_quantized_model_ = IsQuantizedModel(*net_def);
+  if (is_quantized_model_) {
+    quantized_inputs_ = QuantizedInputs(*net_def);
+    quantized_outputs_ = QuantizedOutputs(*net_def);
+  }
   // Get input and output information.
   for (auto &input_info : net_def->input_info()) {
     input_info_map_[input_info.name()] = input_info;
@@ -455,21 +2435,54 @@ MaceStatus MaceEngine::Impl::Init(
   for (auto &output_info : net_def->output_info()) {
     output_info_map_[output_info.name()] = output_info;
   }
+  for (auto &input_name : incremental_inputs_) {
+    if (std::find(input_nodes.begin(), input_nodes.end(), input_name) ==
+        input_nodes.end()) {
+      return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                        "incremental input '" + input_name +
+                        "' is not an input of init");
+    }
+  }
+  if (tiled_execution_) {
+    MACE_RETURN_IF_ERROR(InitTiles(*net_def, input_nodes, output_nodes));
+  }
   // Set storage path for internal usage
+  max_batch_size_ = std::numeric_limits<int64_t>::max();
   for (auto input_name : input_nodes) {
     if (input_info_map_.find(input_name) == input_info_map_.end()) {
       LOG(FATAL) << "'" << input_name
                  << "' does not belong to model's inputs: "
                  << MakeString(MapKeys(input_info_map_));
     }
-    Tensor *input_tensor =
-        ws_->CreateTensor(input_name, device_->allocator(), DT_FLOAT);
     // Resize to possible largest shape to avoid resize during running.
     std::vector<index_t> shape(input_info_map_[input_name].dims_size());
     for (int i = 0; i < input_info_map_[input_name].dims_size(); ++i) {
       shape[i] = input_info_map_[input_name].dims(i);
     }
-    input_tensor->Resize(shape);
+    auto preprocess = input_preprocess_.find(input_name);
+    if (preprocess != input_preprocess_.end()) {
+      const auto &input_info = input_info_map_[input_name];
+      const int channel_dim = input_info.data_format() == NCHW ? 1 : 3;
+      if (shape.size() != 4 || input_info.data_format() == DF_NONE ||
+          shape[channel_dim] !=
+              PixelChannels(preprocess->second.model_format)) {
+        return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                          "input fed as pixels should be an image of the "
+                          "channels of its model format: " + input_name);
+      }
+    }
+    if (opencl_image_inputs_.count(input_name) == 1) {
+      MACE_RETURN_IF_ERROR(CreateImageInput(*net_def, input_name, shape));
+    } else {
+      Tensor *input_tensor =
+          ws_->CreateTensor(input_name, device_->allocator(), DT_FLOAT);
+      input_tensor->Resize(shape);
+    }
+    max_batch_size_ = std::min<int64_t>(max_batch_size_,
+                                        shape.empty() ? 1 : shape[0]);
+  }
+  if (input_nodes.empty()) {
+    max_batch_size_ = 1;
   }
   for (auto output_name : output_nodes) {
     if (output_info_map_.find(output_name) == output_info_map_.end()) {
@@ -479,8 +2492,24 @@ MaceStatus MaceEngine::Impl::Init(
     }
     ws_->CreateTensor(output_name, device_->allocator(), DT_FLOAT);
   }
+  EndInitPhase("create_io_tensors");
+  if (max_concurrent_runs_ > 1) {
+    if (max_contexts_ > 1) {
+      ShareModelWeights(*net_def, model_data);
+      context_net_def_.reset(new NetDef(*net_def));
+      context_model_data_ = model_data;
+      context_inputs_ = input_nodes;
+      context_outputs_ = output_nodes;
+    }
+    free_contexts_.push_back(this);
+    num_contexts_ = 1;
+  }
+  if (shape_plan_cache_size_ > 0) {
+    MACE_RETURN_IF_ERROR(InitShapePlans(*net_def, input_nodes, output_nodes,
+                                        model_data));
+  }
 #ifdef MACE_ENABLE_HEXAGON
-  if (device_type_ == HEXAGON) {
+  if (device_type_ == HEXAGON && !IsHexagonPartitioned(*net_def)) {
     hexagon_controller_.reset(new HexagonControlWrapper());
     MACE_CHECK(hexagon_controller_->Config(), "hexagon config error");
     MACE_CHECK(hexagon_controller_->Init(), "hexagon init error");
@@ -491,31 +2520,213 @@ MaceStatus MaceEngine::Impl::Init(
     if (VLOG_IS_ON(2)) {
       hexagon_controller_->PrintGraph();
     }
+    EndInitPhase("hexagon_setup_graph");
   } else {
 #endif
     MACE_RETURN_IF_ERROR(ws_->LoadModelTensor(*net_def,
                                               device_.get(),
                                               model_data));
+    EndInitPhase("load_model_tensors");
+
+    NetDef folded_net_def;
+    if (device_type_ == DeviceType::CPU && cpu_constant_folding_) {
+      if (!is_quantized_model_) {
+        folded_net_def = *net_def;
+        MACE_RETURN_IF_ERROR(FoldCPUConstantOps(
+            op_registry_.get(), ws_.get(), device_.get(),
+            cpu_fixed_input_shapes_, &folded_input_shapes_,
+            &folded_net_def));
+        net_def = &folded_net_def;
+      } else {
+        LOG(WARNING) << "CPU constant folding needs a float model, run all"
+                     << " the ops";
+      }
+    }
+
+    NetDef half_net_def;
+    if (device_type_ == DeviceType::CPU && cpu_half_precision_) {
+#ifdef MACE_ENABLE_FP16_NEON
+      if (device_->cpu_runtime()->features().asimdhp &&
+          !is_quantized_model_) {
+        half_net_def = *net_def;
+        MACE_RETURN_IF_ERROR(ConvertToCPUHalfPrecision(
+            op_registry_.get(), ws_.get(), &half_net_def));
+        net_def = &half_net_def;
+      } else {
+        LOG(WARNING) << "CPU half precision needs ARMv8.2 half arithmetic"
+                     << " and a float model, run in float";
+      }
+#else
+      LOG(WARNING) << "CPU half precision is not built, run in float";
+#endif  // MACE_ENABLE_FP16_NEON
+    }
+
+    NetDef blocked_net_def;
+    if (device_type_ == DeviceType::CPU && cpu_channel_block_ > 0) {
+      if (!is_quantized_model_) {
+        blocked_net_def = *net_def;
+        MACE_RETURN_IF_ERROR(ConvertToCPUBlockedLayout(
+            ws_.get(), cpu_channel_block_, &blocked_net_def));
+        net_def = &blocked_net_def;
+      } else {
+        LOG(WARNING) << "CPU blocked layout needs a float model, run in NCHW";
+      }
+    }
+
+    NetDef nhwc_net_def;
+    if (device_type_ == DeviceType::CPU &&
+        cpu_data_format_ == DataFormat::NHWC) {
+      if (is_quantized_model_ || net_def == &blocked_net_def) {
+        LOG(WARNING) << "CPU NHWC data format needs a float model without"
+                     << " the blocked layout, run in NCHW";
+      } else {
+        nhwc_net_def = *net_def;
+        MACE_RETURN_IF_ERROR(ConvertToCPUNHWCLayout(
+            ws_.get(), &nhwc_net_def, &nhwc_inputs_, &nhwc_outputs_));
+        net_def = &nhwc_net_def;
+      }
+    }
+
+    NetDef bf16_net_def;
+    if (device_type_ == DeviceType::CPU && cpu_bfloat16_) {
+      if (ops::HasBFloat16Kernel() && !is_quantized_model_) {
+        bf16_net_def = *net_def;
+        MACE_RETURN_IF_ERROR(ConvertToCPUBFloat16(ws_.get(), &bf16_net_def));
+        net_def = &bf16_net_def;
+      } else {
+        LOG(WARNING) << "CPU bfloat16 needs the ARMv8.6 bfloat16 extension"
+                     << " and a float model, run in float";
+      }
+    }
+
+    NetDef delegated_net_def;
+    if (device_type_ == DeviceType::CPU && nnapi_delegation_) {
+      if (!nnapi::NNAPILibrary::Get()->available()) {
+        LOG(WARNING) << "NNAPI is not available, run all the ops on CPU";
+      } else if (is_quantized_model_ || net_def == &half_net_def ||
+                 net_def == &blocked_net_def || net_def == &nhwc_net_def ||
+                 net_def == &bf16_net_def) {
+        LOG(WARNING) << "NNAPI delegation needs a float model in NCHW,"
+                     << " run all the ops on CPU";
+      } else {
+        delegated_net_def = *net_def;
+        MACE_RETURN_IF_ERROR(DelegateToNNAPI(ws_.get(), nnapi_cache_dir_,
+                                             &delegated_net_def));
+        net_def = &delegated_net_def;
+      }
+    }
+
+    NetDef fused_net_def;
+    if (device_type_ == DeviceType::GPU && gpu_elementwise_fusion_) {
+#ifdef MACE_ENABLE_OPENCL
+      if (!is_quantized_model_ && device_->gpu_runtime()->UseImageMemory()) {
+        fused_net_def = *net_def;
+        MACE_RETURN_IF_ERROR(FuseGPUElementwiseOps(ws_.get(),
+                                                   &fused_net_def));
+        net_def = &fused_net_def;
+      } else {
+        LOG(WARNING) << "GPU elementwise fusion needs a float model"
+                     << " on image memory, run the ops one by one";
+      }
+#endif  // MACE_ENABLE_OPENCL
+    }
+    NetDef threaded_net_def;
+    if (device_type_ == DeviceType::CPU && !cpu_op_threads_.empty()) {
+      threaded_net_def = *net_def;
+      for (OperatorDef &op : *threaded_net_def.mutable_op()) {
+        auto iter = cpu_op_threads_.find(op.name());
+        if (iter != cpu_op_threads_.end()) {
+          Argument *arg = op.add_arg();
+          arg->set_name(kOpThreadsArg);
+          arg->set_i(iter->second);
+        }
+      }
+      net_def = &threaded_net_def;
+    }
+    if (net_def == &folded_net_def || net_def == &half_net_def ||
+        net_def == &blocked_net_def || net_def == &nhwc_net_def ||
+        net_def == &bf16_net_def || net_def == &delegated_net_def ||
+        net_def == &fused_net_def || net_def == &threaded_net_def) {
+      EndInitPhase("convert_net_def");
+    }
 
     MemoryOptimizer mem_optimizer;
+    mem_optimizer.set_incremental_inputs(incremental_inputs_);
+    mem_optimizer.set_min_peak(low_memory_);
     // Init model
-    net_ = std::unique_ptr<NetBase>(new SerialNet(op_registry_.get(),
-                                                  net_def,
-                                                  ws_.get(),
-                                                  device_.get(),
-                                                  &mem_optimizer));
+    if (device_type_ == DeviceType::CPU && inter_op_parallelism_ > 1) {
+      mem_optimizer.set_concurrent_branches(true);
+      net_ = std::unique_ptr<NetBase>(new DAGNet(op_registry_.get(),
+                                                 net_def,
+                                                 ws_.get(),
+                                                 device_.get(),
+                                                 &mem_optimizer,
+                                                 inter_op_parallelism_));
+#ifdef MACE_ENABLE_OPENCL
+    } else if (device_type_ == DeviceType::GPU && inter_op_parallelism_ > 1) {
+      mem_optimizer.set_concurrent_branches(true);
+      net_ = std::unique_ptr<NetBase>(
+          new MultiQueueNet(op_registry_.get(), net_def, ws_.get(),
+                            device_.get(), &mem_optimizer,
+                            inter_op_parallelism_));
+#endif  // MACE_ENABLE_OPENCL
+    } else {
+      if (inter_op_parallelism_ > 1) {
+        LOG(WARNING) << "Inter op parallelism is only supported on CPU"
+                     << " and GPU";
+      }
+      net_ = std::unique_ptr<NetBase>(new SerialNet(op_registry_.get(),
+                                                    net_def,
+                                                    ws_.get(),
+                                                    device_.get(),
+                                                    &mem_optimizer));
+    }
+    // the ops, the transform ops of their inputs and the memory plan
+    EndInitPhase("create_net");
+    mem_optimizer.ExportPlan(&memory_plan_);
 
     // Preallocate all output tensors of ops
     MACE_RETURN_IF_ERROR(ws_->PreallocateOutputTensor(*net_def,
                                                       &mem_optimizer,
                                                       device_.get()));
+    // written by the NHWC ops, fetched without the transpose
+    for (auto &output_name : nhwc_outputs_) {
+      ws_->GetTensor(output_name)->set_data_format(DataFormat::NHWC);
+    }
     if (device_type_ == DeviceType::GPU) {
       ws_->RemoveAndReloadBuffer(*net_def, model_data, device_->allocator());
     }
+    EndInitPhase("preallocate_tensors");
     MACE_RETURN_IF_ERROR(net_->Init());
+    EndInitPhase("net_init");
+    ws_->packed_weights()->Flush();
+    EndInitPhase("flush_packed_weights");
+    if (config_->allocation_free_runs()) {
+      MACE_RETURN_IF_ERROR(PreallocateRuns());
+      EndInitPhase("preallocate_runs");
+    }
+    net_->set_tracer(tracer_.get());
+    if (latency_metrics_) {
+      net_->EnableLatencyMetrics();
+    }
+    if (device_type_ == DeviceType::CPU && cpu_weight_prefetch_ &&
+        inter_op_parallelism_ <= 1) {
+      net_->EnableWeightPrefetch();
+    }
+    if (device_type_ == DeviceType::CPU && cpu_line_buffered_head_ &&
+        inter_op_parallelism_ <= 1) {
+      std::set<std::string> output_names;
+      for (auto &output_info : net_def->output_info()) {
+        output_names.insert(output_info.name());
+      }
+      net_->EnableLineBufferedHead(output_names);
+    }
 #ifdef MACE_ENABLE_HEXAGON
   }
 #endif
+  ResolveIOTensors();
+  TraceSpan("Init", "engine", trace_start_micros);
+  init_end_micros_ = NowMicros();
 
   return MaceStatus::MACE_SUCCESS;
 }
@@ -527,25 +2738,47 @@ MaceStatus MaceEngine::Impl::Init(
     const std::string &model_data_file) {
   LOG(INFO) << "Loading Model Data";
 
+  const int64_t map_start_micros = NowMicros();
   MemoryMap(model_data_file, &model_data_, &model_data_size_);
+  init_phases_.push_back({"map_model_data", NowMicros() - map_start_micros});
 
   MACE_RETURN_IF_ERROR(Init(net_def, input_nodes, output_nodes, model_data_));
 
-  if (device_type_ == DeviceType::GPU || device_type_ == DeviceType::HEXAGON ||
-      (device_type_ == DeviceType::CPU && ws_->diffused_buffer())) {
+  // CPU weights are views of the mapped file, expanded ones are filled
+  // from it lazily
+  if (device_type_ == DeviceType::GPU || device_type_ == DeviceType::HEXAGON) {
     MemoryUnMap(model_data_, model_data_size_);
     model_data_ = nullptr;
+    EndInitPhase("unmap_model_data");
+    init_end_micros_ = NowMicros();
   }
   return MaceStatus::MACE_SUCCESS;
 }
 
 MaceEngine::Impl::~Impl() {
   LOG(INFO) << "Destroying MaceEngine";
+  if (next_loader_.joinable()) {
+    next_loader_.join();
+  }
+  WaitWarmUp();
+  // the contexts refer to the model data and the weights of this one
+  contexts_.clear();
+  if (async_worker_.joinable()) {
+    WaitAsyncRuns();
+    {
+      std::lock_guard<std::mutex> lock(async_mutex_);
+      async_stop_ = true;
+    }
+    async_cond_.notify_all();
+    async_worker_.join();
+  }
+  // the algorithms are benchmarked at the first runs of the shapes
+  ws_->algorithm_cache()->Flush();
   if (model_data_ != nullptr) {
     MemoryUnMap(model_data_, model_data_size_);
   }
 #ifdef MACE_ENABLE_HEXAGON
-  if (device_type_ == HEXAGON) {
+  if (hexagon_controller_ != nullptr) {
     if (VLOG_IS_ON(2)) {
       hexagon_controller_->GetPerfInfo();
       hexagon_controller_->PrintLog();
@@ -559,10 +2792,27 @@ MaceEngine::Impl::~Impl() {
 MaceStatus MaceEngine::Impl::TransposeInput(
     const std::pair<const std::string, MaceTensor> &input,
     Tensor *input_tensor) {
+  if (input.second.pixels() != nullptr && !input_tensor->has_opencl_image()) {
+    return PreprocessInput(input, input_tensor);
+  }
+  if (input.second.data_type() != IDataType::IDT_FLOAT) {
+    return TransposeTypedInput(input, input_tensor);
+  }
+  if (input_tensor->has_opencl_image() ||
+      input.second.data() == nullptr) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      "input should be a host buffer: " + input.first);
+  }
+  if (input_tensor->dtype() == DT_UINT8) {
+    // fed quantized by the last run
+    input_tensor->SetDtype(DT_FLOAT);
+  }
+  // the inputs the CPU NHWC ops read are kept NHWC
+  const bool nhwc_input = nhwc_inputs_.count(input.first) == 1;
   if (device_->device_type() == DeviceType::CPU &&
       input.second.shape().size() == 4 &&
       input.second.data_format() == NHWC &&
-      !is_quantized_model_) {
+      !is_quantized_model_ && !nhwc_input) {
     VLOG(1) << "Transform input " << input.first << " from NHWC to NCHW";
     input_tensor->set_data_format(DataFormat::NCHW);
     std::vector<int> dst_dims = {0, 3, 1, 2};
@@ -576,7 +2826,8 @@ MaceStatus MaceEngine::Impl::TransposeInput(
                           dst_dims,
                           input_data);
   } else if (
-      (is_quantized_model_ || device_->device_type() == DeviceType::GPU) &&
+      (is_quantized_model_ || device_->device_type() == DeviceType::GPU ||
+       nhwc_input) &&
       input.second.shape().size() == 4 &&
       input.second.data_format() == DataFormat::NCHW) {
     VLOG(1) << "Transform input " << input.first << " from NCHW to NHWC";
@@ -602,17 +2853,135 @@ MaceStatus MaceEngine::Impl::TransposeInput(
   }
 }
 
+MaceStatus MaceEngine::Impl::TransposeTypedInput(
+    const std::pair<const std::string, MaceTensor> &input,
+    Tensor *input_tensor) {
+  const MaceTensor &tensor = input.second;
+  if (input_tensor->has_opencl_image() || tensor.raw_data() == nullptr) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      "input should be a host buffer: " + input.first);
+  }
+  const std::vector<int64_t> &shape = tensor.shape();
+  const int64_t size = ShapeSizeFrom(shape, 0);
+  // the Quantize op passes it through, unless it has to be transposed
+  if (tensor.data_type() == IDataType::IDT_UINT8 &&
+      quantized_inputs_.count(input.first) == 1 &&
+      (shape.size() != 4 || tensor.data_format() != DataFormat::NCHW)) {
+    if (tensor.scale() <= 0.f) {
+      return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                        "quantized input should have a scale: " +
+                            input.first);
+    }
+    VLOG(1) << "Feed input " << input.first << " quantized";
+    input_tensor->SetDtype(DT_UINT8);
+    input_tensor->set_data_format(tensor.data_format());
+    MACE_RETURN_IF_ERROR(input_tensor->Resize(shape));
+    Tensor::MappingGuard input_guard(input_tensor);
+    std::memcpy(input_tensor->mutable_data<uint8_t>(),
+                tensor.raw_data().get(), size);
+    input_tensor->SetScale(tensor.scale());
+    input_tensor->SetZeroPoint(tensor.zero_point());
+    return MaceStatus::MACE_SUCCESS;
+  }
+  VLOG(1) << "Convert input " << input.first << " of type "
+          << tensor.data_type() << " to float";
+  std::vector<float> data(size);
+  TypedToFloat(tensor, size, data.data());
+  const std::pair<const std::string, MaceTensor> float_input(
+      input.first,
+      MaceTensor(shape, std::shared_ptr<float>(data.data(), [](float *) {}),
+                 tensor.data_format()));
+  return TransposeInput(float_input, input_tensor);
+}
+
+MaceStatus MaceEngine::Impl::CheckFoldedInputShape(
+    const std::string &input_name,
+    const Tensor *input_tensor) const {
+  auto shape = folded_input_shapes_.find(input_name);
+  if (shape == folded_input_shapes_.end() ||
+      input_tensor->shape() == shape->second) {
+    return MaceStatus::MACE_SUCCESS;
+  }
+  return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                    "the shape of " + input_name + " is fixed to " +
+                        MakeString(shape->second) + " by constant folding");
+}
+
+MaceStatus MaceEngine::Impl::PreprocessInput(
+    const std::pair<const std::string, MaceTensor> &input,
+    Tensor *input_tensor) {
+  auto iter = input_preprocess_.find(input.first);
+  if (iter == input_preprocess_.end()) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      "input fed as pixels has no preprocessing: " +
+                          input.first);
+  }
+  const InputPreprocess &preprocess = iter->second;
+  const std::vector<int64_t> &shape = input.second.shape();
+  const int pixel_channels = PixelChannels(preprocess.pixel_format);
+  if (shape.size() != 4 || shape[3] != pixel_channels) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      "pixels should be NHWC of " +
+                          MakeString(pixel_channels) + " channels: " +
+                          input.first);
+  }
+  // the height and width of the model input
+  const auto &input_info = input_info_map_[input.first];
+  const int height_dim = input_info.data_format() == NCHW ? 2 : 1;
+  const index_t height = input_info.dims(height_dim);
+  const index_t width = input_info.dims(height_dim + 1);
+  const int channels = PixelChannels(preprocess.model_format);
+  const DataFormat data_format =
+      device_->device_type() == DeviceType::CPU && !is_quantized_model_ ?
+      DataFormat::NCHW : DataFormat::NHWC;
+  VLOG(1) << "Preprocess pixels of input " << input.first << " "
+          << MakeString(shape) << " to " << data_format;
+  input_tensor->set_data_format(data_format);
+  if (data_format == DataFormat::NCHW) {
+    MACE_RETURN_IF_ERROR(
+        input_tensor->Resize({shape[0], channels, height, width}));
+  } else {
+    MACE_RETURN_IF_ERROR(
+        input_tensor->Resize({shape[0], height, width, channels}));
+  }
+  int channel_map[3];
+  PixelChannelMap(preprocess, channel_map);
+  std::vector<float> mean(channels, preprocess.mean[0]);
+  std::vector<float> scale(channels, preprocess.scale[0]);
+  if (preprocess.mean.size() > 1) {
+    mean = preprocess.mean;
+  }
+  if (preprocess.scale.size() > 1) {
+    scale = preprocess.scale;
+  }
+  Tensor::MappingGuard input_guard(input_tensor);
+  ops::PreprocessPixels(input.second.pixels().get(), shape[0], shape[1],
+                        shape[2], pixel_channels, channel_map, mean.data(),
+                        scale.data(), channels, height, width, data_format,
+                        input_tensor->mutable_data<float>());
+  return MaceStatus::MACE_SUCCESS;
+}
+
 MaceStatus MaceEngine::Impl::TransposeOutput(
     const mace::Tensor *output_tensor,
     std::pair<const std::string, mace::MaceTensor> *output) {
+  if (output_tensor != nullptr &&
+      output->second.data_type() != IDataType::IDT_FLOAT) {
+    return TransposeTypedOutput(output_tensor, output);
+  }
   // save output
   if (output_tensor != nullptr && output->second.data() != nullptr) {
     if (device_->device_type() == DeviceType::CPU &&
         output->second.shape().size() == 4 &&
         output->second.data_format() != output_tensor->data_format()) {
-      MACE_CHECK(output_tensor->data_format() == NCHW);
-      VLOG(1) << "Transform output " << output->first << " from NCHW to NHWC";
-      std::vector<int> dst_dims = {0, 2, 3, 1};
+      VLOG(1) << "Transform output " << output->first << " from "
+              << output_tensor->data_format() << " to "
+              << output->second.data_format();
+      // the outputs of quantized models are NHWC
+      std::vector<int> dst_dims = {0, 3, 1, 2};
+      if (output_tensor->data_format() == NCHW) {
+        dst_dims = {0, 2, 3, 1};
+      }
       std::vector<index_t> shape =
           TransposeShape<index_t, index_t>(output_tensor->shape(),
                                            dst_dims);
@@ -623,6 +2992,21 @@ MaceStatus MaceEngine::Impl::TransposeOutput(
         << MakeString<int64_t>(shape) << " vs buffer size "
         << output->second.impl_->buffer_size;
       output->second.impl_->shape = shape;
+      auto quantized = quantized_outputs_.find(output->first);
+      if (output_tensor->data_format() == NHWC &&
+          quantized != quantized_outputs_.end()) {
+        // dequantized into NCHW at once, instead of dequantized then
+        // transposed
+        const Tensor *quantized_tensor = ws_->GetTensor(quantized->second);
+        Tensor::MappingGuard quantized_guard(quantized_tensor);
+        const std::vector<index_t> &nhwc = quantized_tensor->shape();
+        ops::DequantizeUint8ToNCHW(quantized_tensor->data<uint8_t>(),
+                                   nhwc[0], nhwc[1], nhwc[2], nhwc[3],
+                                   quantized_tensor->scale(),
+                                   quantized_tensor->zero_point(),
+                                   output->second.data().get());
+        return MaceStatus::MACE_SUCCESS;
+      }
       Tensor::MappingGuard output_guard(output_tensor);
       const float *output_data = output_tensor->data<float>();
       return ops::Transpose(output_data,
@@ -674,87 +3058,2777 @@ MaceStatus MaceEngine::Impl::TransposeOutput(
   }
 }
 
-MaceStatus MaceEngine::Impl::Run(
-    const std::map<std::string, MaceTensor> &inputs,
-    std::map<std::string, MaceTensor> *outputs,
-    RunMetadata *run_metadata) {
-  MACE_CHECK_NOTNULL(outputs);
-  std::vector<Tensor *> input_tensors;
-  std::vector<Tensor *> output_tensors;
-  for (auto &input : inputs) {
-    if (input_info_map_.find(input.first) == input_info_map_.end()) {
-      LOG(FATAL) << "'" << input.first
-                 << "' does not belong to model's inputs: "
-                 << MakeString(MapKeys(input_info_map_));
-    }
-    Tensor *input_tensor = ws_->GetTensor(input.first);
-    MACE_RETURN_IF_ERROR(TransposeInput(input, input_tensor));
-    input_tensors.push_back(input_tensor);
-  }
-  for (auto &output : *outputs) {
-    if (output_info_map_.find(output.first) == output_info_map_.end()) {
-      LOG(FATAL) << "'" << output.first
-                 << "' does not belong to model's outputs: "
-                 << MakeString(MapKeys(output_info_map_));
-    }
-    Tensor *output_tensor = ws_->GetTensor(output.first);
-    output_tensors.push_back(output_tensor);
+MaceStatus MaceEngine::Impl::TransposeTypedOutput(
+    const Tensor *output_tensor,
+    std::pair<const std::string, MaceTensor> *output) {
+  MaceTensor &tensor = output->second;
+  if (tensor.raw_data() == nullptr) {
+    return MaceStatus::MACE_INVALID_ARGS;
   }
-#ifdef MACE_ENABLE_HEXAGON
-  if (device_type_ == HEXAGON) {
-    MACE_CHECK(input_tensors.size() == 1 && output_tensors.size() == 1,
-               "HEXAGON not support multiple inputs and outputs yet.");
-    hexagon_controller_->ExecuteGraphNew(input_tensors, &output_tensors, true);
-  } else {
-#endif
-    MACE_RETURN_IF_ERROR(net_->Run(run_metadata));
-#ifdef MACE_ENABLE_HEXAGON
+  // the uint8 tensor the Dequantize op of the output read
+  auto quantized = quantized_outputs_.find(output->first);
+  if (tensor.data_type() == IDataType::IDT_UINT8 &&
+      quantized != quantized_outputs_.end() &&
+      (tensor.shape().size() != 4 ||
+       tensor.data_format() == output_tensor->data_format())) {
+    const Tensor *quantized_tensor = ws_->GetTensor(quantized->second);
+    const index_t size = quantized_tensor->size();
+    MACE_CHECK(size <= tensor.impl_->buffer_size)
+      << "Output size exceeds buffer size: shape"
+      << MakeString(quantized_tensor->shape()) << " vs buffer size "
+      << tensor.impl_->buffer_size;
+    tensor.impl_->shape = quantized_tensor->shape();
+    Tensor::MappingGuard quantized_guard(quantized_tensor);
+    std::memcpy(tensor.raw_data().get(), quantized_tensor->data<uint8_t>(),
+                size);
+    tensor.impl_->scale = quantized_tensor->scale();
+    tensor.impl_->zero_point = quantized_tensor->zero_point();
+    return MaceStatus::MACE_SUCCESS;
   }
-#endif
-
-#ifdef MACE_ENABLE_OPENCL
-  if (device_type_ == GPU) {
-    device_->gpu_runtime()->opencl_runtime()->command_queue().finish();
-    device_->gpu_runtime()->opencl_runtime()->SaveBuiltCLProgram();
+  if (output_tensor->dtype() == DT_INT32 &&
+      tensor.data_type() != IDataType::IDT_INT32) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      "int32 output should be read as int32 or float: " +
+                          output->first);
   }
-#endif
-  for (auto &output : *outputs) {
-    Tensor *output_tensor = ws_->GetTensor(output.first);
-    // save output
-    MACE_RETURN_IF_ERROR(TransposeOutput(output_tensor, &output));
+  // the output as a float one, then converted
+  std::vector<float> data(tensor.impl_->buffer_size);
+  std::pair<const std::string, MaceTensor> float_output(
+      output->first,
+      MaceTensor(tensor.shape(),
+                 std::shared_ptr<float>(data.data(), [](float *) {}),
+                 tensor.data_format(), tensor.impl_->buffer_size));
+  MACE_RETURN_IF_ERROR(TransposeOutput(output_tensor, &float_output));
+  tensor.impl_->shape = float_output.second.shape();
+  const int64_t size = ShapeSizeFrom(tensor.shape(), 0);
+  if (output_tensor->dtype() == DT_INT32) {
+    // the int32 values were copied as they are
+    std::memcpy(tensor.raw_data().get(), data.data(),
+                size * sizeof(int32_t));
+  } else {
+    FloatToTyped(data.data(), size, tensor.data_type(),
+                 tensor.raw_data().get(), &tensor.impl_->scale,
+                 &tensor.impl_->zero_point);
   }
   return MaceStatus::MACE_SUCCESS;
 }
 
-MaceEngine::MaceEngine(const MaceEngineConfig &config):
-    impl_(make_unique<MaceEngine::Impl>(config)) {}
-
-MaceEngine::~MaceEngine() = default;
-
-MaceStatus MaceEngine::Init(const NetDef *net_def,
-                            const std::vector<std::string> &input_nodes,
-                            const std::vector<std::string> &output_nodes,
-                            const unsigned char *model_data) {
-  return impl_->Init(net_def, input_nodes, output_nodes, model_data);
+bool MaceEngine::Impl::IsHexagonBuffer(const MaceTensor &tensor) const {
+#ifdef MACE_ENABLE_HEXAGON
+  return device_type_ == HEXAGON && tensor.data() != nullptr &&
+      GetHexagonAllocator()->IsShared(
+          tensor.data().get(), tensor.impl_->buffer_size * sizeof(float));
+#else
+  MACE_UNUSED(tensor);
+  return false;
+#endif  // MACE_ENABLE_HEXAGON
 }
 
+bool MaceEngine::Impl::RunsHexagonGraph() const {
+#ifdef MACE_ENABLE_HEXAGON
+  return hexagon_controller_ != nullptr;
+#else
+  return false;
+#endif  // MACE_ENABLE_HEXAGON
+}
 
-MaceStatus MaceEngine::Init(const NetDef *net_def,
-                            const std::vector<std::string> &input_nodes,
-                            const std::vector<std::string> &output_nodes,
-                            const std::string &model_data_file) {
-  return impl_->Init(net_def, input_nodes, output_nodes, model_data_file);
+bool MaceEngine::Impl::CanBindInput(const std::string &name,
+                                    const MaceTensor &input) const {
+  // buffers shared with the DSP are worth binding without zero copy enabled
+  const bool hexagon_buffer = IsHexagonBuffer(input);
+  if (!((zero_copy_ && device_->device_type() == DeviceType::CPU) ||
+        hexagon_buffer) ||
+      input.data() == nullptr ||
+      reinterpret_cast<uintptr_t>(input.data().get()) % kMaceAlignment != 0) {
+    return false;
+  }
+  // inputs TransposeInput would transpose for the CPU kernels
+  const bool nhwc_kernels =
+      is_quantized_model_ || nhwc_inputs_.count(name) == 1;
+  if (input.shape().size() == 4 &&
+      ((!nhwc_kernels && input.data_format() == NHWC) ||
+       (nhwc_kernels && input.data_format() == NCHW))) {
+    return false;
+  }
+  int64_t input_size = std::accumulate(input.shape().begin(),
+                                       input.shape().end(), 1,
+                                       std::multiplies<int64_t>());
+  // only NEON kernels read past the end
+  const int64_t pad_size = hexagon_buffer ? 0 : MACE_EXTRA_BUFFER_PAD_SIZE;
+  return (input_size * static_cast<int64_t>(sizeof(float)) + pad_size) <=
+      input.impl_->buffer_size * static_cast<int64_t>(sizeof(float));
+}
+
+bool MaceEngine::Impl::CanBindOutput(const MaceTensor &output,
+                                     const Tensor *output_tensor) const {
+  if (!((zero_copy_ && device_->device_type() == DeviceType::CPU) ||
+        IsHexagonBuffer(output)) ||
+      // the skipped ops would not write to the buffer
+      !incremental_inputs_.empty() ||
+      output_tensor->dtype() != DT_FLOAT ||
+      reinterpret_cast<uintptr_t>(output.data().get()) % kMaceAlignment != 0) {
+    return false;
+  }
+  // outputs TransposeOutput would transpose
+  return output.shape().size() != 4 ||
+      output.data_format() == output_tensor->data_format();
+}
+
+MaceStatus MaceEngine::Impl::CreateImageInput(
+    const NetDef &net_def,
+    const std::string &input_name,
+    const std::vector<index_t> &shape) {
+#ifdef MACE_ENABLE_OPENCL
+  if (device_type_ == DeviceType::GPU && shape.size() == 4) {
+    // the image holds the data type the first consumer computes in
+    DataType dt = DT_FLOAT;
+    for (auto &op : net_def.op()) {
+      if (std::find(op.input().begin(), op.input().end(), input_name) !=
+          op.input().end()) {
+        dt = static_cast<DataType>(
+            ProtoArgHelper::GetOptionalArg<OperatorDef, int>(
+                op, "T", static_cast<int>(DT_FLOAT)));
+        break;
+      }
+    }
+    Tensor *input_tensor =
+        ws_->CreateTensor(input_name, device_->allocator(), dt);
+    input_tensor->set_data_format(DataFormat::NHWC);
+    std::vector<size_t> image_shape;
+    OpenCLUtil::CalImage2DShape(shape, OpenCLBufferType::IN_OUT_CHANNEL,
+                                &image_shape);
+    return input_tensor->ResizeImage(shape, image_shape);
+  }
+#else
+  MACE_UNUSED(net_def);
+  MACE_UNUSED(shape);
+#endif
+  return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                    "only 4D inputs on GPU could be fed as images: " +
+                        input_name);
+}
+
+MaceStatus MaceEngine::Impl::BindOpenCLInput(
+    const std::pair<const std::string, MaceTensor> &input,
+    Tensor *input_tensor,
+    ZeroCopyBinding *zero_copy_binding) {
+#ifdef MACE_ENABLE_OPENCL
+  if (device_type_ == DeviceType::GPU) {
+    auto allocator = static_cast<OpenCLAllocator *>(device_->allocator());
+    const MaceTensor &tensor = input.second;
+    if (input_tensor->has_opencl_image()) {
+      if (tensor.impl_->opencl_memory_type != OPENCL_IMAGE) {
+        return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                          "input should be an OpenCL image: " + input.first);
+      }
+      void *image = nullptr;
+      std::vector<size_t> image_shape;
+      MACE_RETURN_IF_ERROR(allocator->ImportImage(
+          tensor.opencl_memory(), &image_shape, &image));
+      zero_copy_binding->Bind(input_tensor, std::unique_ptr<BufferBase>(
+          new Image(allocator, image, image_shape, input_tensor->dtype())));
+      std::vector<size_t> wanted_image_shape;
+      OpenCLUtil::CalImage2DShape(tensor.shape(),
+                                  OpenCLBufferType::IN_OUT_CHANNEL,
+                                  &wanted_image_shape);
+      if (wanted_image_shape[0] > image_shape[0] ||
+          wanted_image_shape[1] > image_shape[1]) {
+        return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                          "OpenCL image is too small for input: " +
+                              input.first);
+      }
+      return input_tensor->ResizeImage(tensor.shape(), wanted_image_shape);
+    }
+    if (tensor.impl_->opencl_memory_type != OPENCL_BUFFER ||
+        (tensor.shape().size() == 4 && tensor.data_format() != NHWC)) {
+      return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                        "input should be an NHWC OpenCL buffer: " +
+                            input.first);
+    }
+    void *buffer = nullptr;
+    MACE_RETURN_IF_ERROR(
+        allocator->ImportBuffer(tensor.opencl_memory(), &buffer));
+    zero_copy_binding->Bind(input_tensor, std::unique_ptr<BufferBase>(
+        new Buffer(allocator, buffer,
+                   tensor.impl_->buffer_size * sizeof(float), true)));
+    input_tensor->set_data_format(tensor.data_format());
+    return input_tensor->Resize(tensor.shape());
+  }
+#else
+  MACE_UNUSED(input_tensor);
+  MACE_UNUSED(zero_copy_binding);
+#endif
+  return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                    "OpenCL memory is only supported on GPU: " + input.first);
+}
+
+MaceStatus MaceEngine::Impl::BindOpenCLOutput(
+    const std::pair<const std::string, MaceTensor> &output,
+    Tensor *output_tensor,
+    ZeroCopyBinding *zero_copy_binding) {
+#ifdef MACE_ENABLE_OPENCL
+  if (device_type_ == DeviceType::GPU) {
+    auto allocator = static_cast<OpenCLAllocator *>(device_->allocator());
+    const MaceTensor &tensor = output.second;
+    if (tensor.impl_->opencl_memory_type == OPENCL_IMAGE) {
+      // written by WriteOpenCLImageOutput after the net
+      if (output_tensor->dtype() != DT_FLOAT ||
+          output_tensor->has_opencl_image() ||
+          (output_tensor->dim_size() == 4 &&
+              output_tensor->data_format() != DataFormat::NHWC)) {
+        return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                          "output written into an OpenCL image should be an "
+                          "NHWC output of float: " + output.first);
+      }
+      return MaceStatus::MACE_SUCCESS;
+    }
+    if (tensor.impl_->opencl_memory_type != OPENCL_BUFFER ||
+        output_tensor->dtype() != DT_FLOAT ||
+        output_tensor->has_opencl_image() ||
+        (tensor.shape().size() == 4 &&
+            tensor.data_format() != output_tensor->data_format())) {
+      return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                        "output should be an OpenCL buffer of float in the "
+                        "data format of the net: " + output.first);
+    }
+    void *buffer = nullptr;
+    MACE_RETURN_IF_ERROR(
+        allocator->ImportBuffer(tensor.opencl_memory(), &buffer));
+    zero_copy_binding->Bind(output_tensor, std::unique_ptr<BufferBase>(
+        new Buffer(allocator, buffer,
+                   tensor.impl_->buffer_size * sizeof(float), true)));
+    return MaceStatus::MACE_SUCCESS;
+  }
+#else
+  MACE_UNUSED(output_tensor);
+  MACE_UNUSED(zero_copy_binding);
+#endif
+  return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                    "OpenCL memory is only supported on GPU: " +
+                        output.first);
+}
+
+MaceStatus MaceEngine::Impl::WriteOpenCLImageOutput(
+    const std::pair<const std::string, MaceTensor> &output,
+    Tensor *output_tensor) {
+#ifdef MACE_ENABLE_OPENCL
+  auto allocator = static_cast<OpenCLAllocator *>(device_->allocator());
+  void *image = nullptr;
+  std::vector<size_t> image_shape;
+  MACE_RETURN_IF_ERROR(allocator->ImportImage(
+      output.second.opencl_memory(), &image_shape, &image));
+  std::unique_ptr<BufferBase> image_buffer(
+      new Image(allocator, image, image_shape, DT_FLOAT));
+  std::vector<size_t> wanted_image_shape;
+  OpenCLUtil::CalImage2DShape(
+      ops::FormatBufferShape(output_tensor->shape(),
+                             OpenCLBufferType::IN_OUT_CHANNEL),
+      OpenCLBufferType::IN_OUT_CHANNEL, &wanted_image_shape);
+  if (wanted_image_shape[0] > image_shape[0] ||
+      wanted_image_shape[1] > image_shape[1]) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      "OpenCL image is too small for output: " +
+                          output.first);
+  }
+  Tensor image_tensor(image_buffer.get(), DT_FLOAT);
+  auto &kernel = image_output_kernels_[output.first];
+  if (kernel == nullptr) {
+    kernel = make_unique<ops::opencl::image::BufferToImage<float>>();
+  }
+  OpContext context(ws_.get(), device_.get());
+  return kernel->Compute(&context, output_tensor,
+                         OpenCLBufferType::IN_OUT_CHANNEL, 0, &image_tensor);
+#else
+  MACE_UNUSED(output_tensor);
+  return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                    "OpenCL memory is only supported on GPU: " +
+                        output.first);
+#endif
+}
+
+MaceStatus MaceEngine::Impl::AcquireEGLImages(
+    const std::map<std::string, MaceTensor> &inputs,
+    const std::map<std::string, MaceTensor> &outputs,
+    std::vector<void *> *egl_images) {
+  Impl *owner = primary_ != nullptr ? primary_ : this;
+  void *egl_display = nullptr;
+  void *egl_sync = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(owner->egl_mutex_);
+    if (owner->egl_images_.empty()) {
+      return MaceStatus::MACE_SUCCESS;
+    }
+    std::set<void *> used;
+    for (auto tensors : {&inputs, &outputs}) {
+      for (auto &tensor : *tensors) {
+        void *memory = tensor.second.opencl_memory();
+        if (owner->egl_images_.count(memory) == 1 &&
+            used.insert(memory).second) {
+          egl_images->push_back(memory);
+        }
+      }
+    }
+    if (egl_images->empty()) {
+      return MaceStatus::MACE_SUCCESS;
+    }
+    egl_display = owner->egl_display_;
+    egl_sync = owner->egl_sync_;
+    owner->egl_sync_ = nullptr;
+  }
+#ifdef MACE_ENABLE_OPENCL
+  std::vector<cl_mem> images;
+  for (void *image : *egl_images) {
+    images.push_back(static_cast<cl_mem>(image));
+  }
+  MaceStatus status = device_->gpu_runtime()->opencl_runtime()
+      ->AcquireEGLObjects(images, egl_display, egl_sync);
+  if (status != MaceStatus::MACE_SUCCESS) {
+    egl_images->clear();
+  }
+  return status;
+#else
+  MACE_UNUSED(egl_display);
+  MACE_UNUSED(egl_sync);
+  return MaceStatus::MACE_SUCCESS;
+#endif
+}
+
+MaceStatus MaceEngine::Impl::ReleaseEGLImages(
+    const std::vector<void *> &egl_images) {
+#ifdef MACE_ENABLE_OPENCL
+  std::vector<cl_mem> images;
+  for (void *image : egl_images) {
+    images.push_back(static_cast<cl_mem>(image));
+  }
+  return device_->gpu_runtime()->opencl_runtime()->ReleaseEGLObjects(images);
+#else
+  MACE_UNUSED(egl_images);
+  return MaceStatus::MACE_SUCCESS;
+#endif
+}
+
+MaceStatus MaceEngine::Impl::CreateOpenCLImageFromEGLImage(
+    void *egl_display,
+    void *egl_image,
+    void **opencl_image) {
+  MACE_CHECK_NOTNULL(opencl_image);
+#ifdef MACE_ENABLE_OPENCL
+  if (device_type_ == DeviceType::GPU) {
+    cl_mem image = nullptr;
+    MACE_RETURN_IF_ERROR(device_->gpu_runtime()->opencl_runtime()
+        ->CreateImageFromEGLImage(egl_display, egl_image, &image));
+    Impl *owner = primary_ != nullptr ? primary_ : this;
+    std::lock_guard<std::mutex> lock(owner->egl_mutex_);
+    owner->egl_images_.insert(image);
+    *opencl_image = image;
+    return MaceStatus::MACE_SUCCESS;
+  }
+#else
+  MACE_UNUSED(egl_display);
+  MACE_UNUSED(egl_image);
+#endif
+  return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                    "EGL images are only supported on GPU");
+}
+
+MaceStatus MaceEngine::Impl::ReleaseOpenCLImage(void *opencl_image) {
+  Impl *owner = primary_ != nullptr ? primary_ : this;
+  {
+    std::lock_guard<std::mutex> lock(owner->egl_mutex_);
+    if (owner->egl_images_.erase(opencl_image) == 0) {
+      return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                        "not an image of CreateOpenCLImageFromEGLImage");
+    }
+  }
+#ifdef MACE_ENABLE_OPENCL
+  clReleaseMemObject(static_cast<cl_mem>(opencl_image));
+#endif
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngine::Impl::SetEGLSync(void *egl_display, void *egl_sync) {
+  Impl *owner = primary_ != nullptr ? primary_ : this;
+  std::lock_guard<std::mutex> lock(owner->egl_mutex_);
+  owner->egl_display_ = egl_display;
+  owner->egl_sync_ = egl_sync;
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngine::Impl::GetOpenCLContext(void **cl_context,
+                                              void **cl_command_queue) {
+  MACE_CHECK_NOTNULL(cl_context);
+#ifdef MACE_ENABLE_OPENCL
+  if (device_type_ == DeviceType::GPU) {
+    auto runtime = device_->gpu_runtime()->opencl_runtime();
+    *cl_context = runtime->context()();
+    if (cl_command_queue != nullptr) {
+      *cl_command_queue = runtime->command_queue()();
+    }
+    return MaceStatus::MACE_SUCCESS;
+  }
+#else
+  MACE_UNUSED(cl_command_queue);
+#endif
+  return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                    "OpenCL context is only available on GPU");
+}
+
+MaceStatus MaceEngine::Impl::ResetStates() {
+  WaitAsyncRuns();
+  // hexagon nets keep no states
+  if (net_ != nullptr) {
+    net_->ResetStates();
+  }
+  for (auto &context : contexts_) {
+    MACE_RETURN_IF_ERROR(context->ResetStates());
+  }
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngine::Impl::GetLatencyMetrics(LatencyMetrics *metrics,
+                                               bool reset) {
+  MACE_CHECK_NOTNULL(metrics);
+  if (!latency_metrics_) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      "latency metrics are not enabled");
+  }
+  queued_latency_.GetStats(&metrics->queued, reset);
+  exec_latency_.GetStats(&metrics->exec, reset);
+  total_latency_.GetStats(&metrics->total, reset);
+  if (net_ != nullptr) {
+    net_->GetLatencyMetrics(&metrics->op_latency, reset);
+  } else {
+    metrics->op_latency.clear();
+  }
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngine::Impl::GetInitStats(InitStats *stats) const {
+  MACE_CHECK_NOTNULL(stats);
+  stats->total_micros = init_end_micros_ - init_start_micros_;
+  stats->phases = init_phases_;
+  stats->opencl_build_micros = 0;
+#ifdef MACE_ENABLE_OPENCL
+  if (device_type_ == DeviceType::GPU) {
+    stats->opencl_build_micros =
+        device_->gpu_runtime()->opencl_runtime()->program_build_micros();
+  }
+#endif  // MACE_ENABLE_OPENCL
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngine::Impl::GetMemoryStats(EngineMemoryStats *stats) const {
+  MACE_CHECK_NOTNULL(stats);
+  ws_->GetMemoryStats(device_.get(), stats);
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngine::Impl::Trim(TrimLevel level) {
+  if (device_type_ == DeviceType::HEXAGON) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      "the memory shared with the DSP is kept");
+  }
+  if (allocation_monitor_ != nullptr) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      "allocation free runs keep their memory");
+  }
+  WaitWarmUp();
+  WaitAsyncRuns();
+#ifdef MACE_ENABLE_OPENCL
+  if (device_type_ == DeviceType::GPU) {
+    device_->gpu_runtime()->opencl_runtime()->command_queue().finish();
+  }
+#endif  // MACE_ENABLE_OPENCL
+  ws_->ReleaseActivations();
+  for (auto &plan : shape_plans_) {
+    // the workspace of the plan in use is ws_
+    if (plan.ws != nullptr) {
+      plan.ws->ReleaseActivations();
+    }
+  }
+  ReleaseScratch();
+  // the ops skipped by the next run would hand over released activations
+  last_inputs_.clear();
+  for (auto &context : contexts_) {
+    MACE_RETURN_IF_ERROR(context->Trim(TRIM_ACTIVATIONS));
+  }
+#ifdef MACE_ENABLE_OPENCL
+  if (level == TRIM_PROGRAMS && device_type_ == DeviceType::GPU) {
+    device_->gpu_runtime()->opencl_runtime()->ReleasePrograms();
+  }
+#else
+  MACE_UNUSED(level);
+#endif  // MACE_ENABLE_OPENCL
+  return MaceStatus::MACE_SUCCESS;
+}
+
+void MaceEngine::Impl::ReleaseScratch() {
+  ScratchBuffer *scratch = device_->scratch_buffer();
+  if (scratch != nullptr) {
+    scratch->Rewind();
+    scratch->Release();
+  }
+#ifdef MACE_ENABLE_OPENCL
+  if (device_type_ == DeviceType::GPU) {
+    device_->gpu_runtime()->scratch_image_manager()->Release();
+  }
+#endif  // MACE_ENABLE_OPENCL
+  if (gpu_kernel_replay_) {
+    // the recorded kernels may read the released images
+    if (net_ != nullptr) {
+      net_->SetReplayKey("");
+    }
+    for (auto &plan : shape_plans_) {
+      if (plan.net != nullptr) {
+        plan.net->SetReplayKey("");
+      }
+    }
+  }
+}
+
+MaceStatus MaceEngine::Impl::ExportMemoryPlan(
+    const unsigned char *model_graph_proto,
+    const size_t model_graph_proto_size,
+    std::vector<unsigned char> *planned_model_graph_proto) const {
+  MACE_CHECK_NOTNULL(model_graph_proto);
+  MACE_CHECK_NOTNULL(planned_model_graph_proto);
+  if (!memory_plan_.has_signature()) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      "the engine has no memory plan, it is not initialized"
+                      " or runs on HEXAGON");
+  }
+  NetDef net_def;
+  if (!net_def.ParseFromArray(model_graph_proto,
+                              static_cast<int>(model_graph_proto_size))) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      "failed to parse the model graph");
+  }
+  *net_def.mutable_memory_plan() = memory_plan_;
+  planned_model_graph_proto->resize(net_def.ByteSizeLong());
+  if (!net_def.SerializeToArray(planned_model_graph_proto->data(),
+                                static_cast<int>(
+                                    planned_model_graph_proto->size()))) {
+    return MaceStatus(MaceStatus::MACE_OUT_OF_RESOURCES,
+                      "failed to serialize the model graph");
+  }
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngine::Impl::SaveSnapshot(
+    const std::string &file_path) const {
+  if (!memory_plan_.has_signature()) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      "the engine has no memory plan, it is not initialized"
+                      " or runs on HEXAGON");
+  }
+  const std::string device = SnapshotDevice(device_.get());
+  const std::string memory_plan = memory_plan_.SerializeAsString();
+  const std::string input_shapes = SnapshotInputShapes(input_info_map_);
+  FileStorage snapshot(file_path);
+  snapshot.Insert(kSnapshotDeviceKey,
+                  std::vector<unsigned char>(device.begin(), device.end()));
+  snapshot.Insert(kSnapshotInputShapesKey,
+                  std::vector<unsigned char>(input_shapes.begin(),
+                                             input_shapes.end()));
+  snapshot.Insert(kSnapshotMemoryPlanKey,
+                  std::vector<unsigned char>(memory_plan.begin(),
+                                             memory_plan.end()));
+  ws_->packed_weights()->Export(kSnapshotPackedWeightsPrefix, &snapshot);
+  ws_->algorithm_cache()->Export(kSnapshotAlgorithmsPrefix, &snapshot);
+  if (snapshot.Flush() != 0) {
+    return MaceStatus(MaceStatus::MACE_OUT_OF_RESOURCES,
+                      "failed to write the snapshot to " + file_path);
+  }
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngine::Impl::LoadSnapshot(const std::string &file_path,
+                                          NetDef *net_def) {
+  FileStorage snapshot(file_path);
+  if (snapshot.Load() != 0) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      "failed to load the snapshot " + file_path);
+  }
+  const std::vector<unsigned char> *device =
+      snapshot.Find(kSnapshotDeviceKey);
+  if (device == nullptr ||
+      std::string(device->begin(), device->end()) !=
+          SnapshotDevice(device_.get())) {
+    LOG(WARNING) << "The snapshot " << file_path << " is not of this device"
+                 << " or build, initialize the engine as usual";
+    return MaceStatus::MACE_SUCCESS;
+  }
+  // another device is expected after an update, another model is not
+  std::map<std::string, InputInfo> input_infos;
+  for (auto &input_info : net_def->input_info()) {
+    input_infos[input_info.name()] = input_info;
+  }
+  const std::vector<unsigned char> *input_shapes =
+      snapshot.Find(kSnapshotInputShapesKey);
+  if (input_shapes == nullptr ||
+      std::string(input_shapes->begin(), input_shapes->end()) !=
+          SnapshotInputShapes(input_infos)) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      "the snapshot " + file_path + " is of other inputs"
+                      " or input shapes than the model");
+  }
+  const std::vector<unsigned char> *memory_plan =
+      snapshot.Find(kSnapshotMemoryPlanKey);
+  if (memory_plan != nullptr &&
+      !net_def->mutable_memory_plan()->ParseFromArray(
+          memory_plan->data(), static_cast<int>(memory_plan->size()))) {
+    net_def->clear_memory_plan();
+  }
+  ws_->packed_weights()->Import(kSnapshotPackedWeightsPrefix, &snapshot);
+  ws_->algorithm_cache()->Import(kSnapshotAlgorithmsPrefix, &snapshot);
+  VLOG(1) << "Load the snapshot " << file_path;
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngine::Impl::Calibrate(
+    const std::vector<std::map<std::string, MaceTensor>> &dataset,
+    const CalibrationMethod method,
+    const float percentile,
+    const unsigned char *model_graph_proto,
+    const size_t model_graph_proto_size,
+    std::vector<unsigned char> *calibrated_model_graph_proto) {
+  MACE_CHECK_NOTNULL(model_graph_proto);
+  MACE_CHECK_NOTNULL(calibrated_model_graph_proto);
+  if (device_type_ != DeviceType::CPU || is_quantized_model_) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      "only float models on CPU could be calibrated");
+  }
+  if (dataset.empty()) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      "no calibration data");
+  }
+  if (method == CALIBRATION_PERCENTILE &&
+      (percentile < 0 || percentile >= 50)) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      MakeString("percentile ", percentile,
+                                 " is not in [0, 50)"));
+  }
+  NetDef net_def;
+  if (!net_def.ParseFromArray(model_graph_proto,
+                              static_cast<int>(model_graph_proto_size))) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      "failed to parse the model graph");
+  }
+
+  RangeCalibrator calibrator(device_->cpu_runtime()->thread_pool());
+  // the ranges of the first pass bound the histograms of the second
+  const int passes = method == CALIBRATION_MIN_MAX ? 1 : 2;
+  for (int pass = 0; pass < passes; ++pass) {
+    if (pass == 1) {
+      calibrator.StartHistograms();
+    }
+    for (auto &inputs : dataset) {
+      // the run records on the net of the input shapes
+      if (!shape_plans_.empty()) {
+        MACE_RETURN_IF_ERROR(SwitchShapePlan(inputs));
+      }
+      std::map<std::string, MaceTensor> outputs;
+      net_->AddObserver(&calibrator);
+      MaceStatus run_status = RunExclusive(inputs, &outputs, nullptr,
+                                           NowMicros());
+      net_->RemoveObserver(&calibrator);
+      MACE_RETURN_IF_ERROR(run_status);
+    }
+  }
+
+  int calibrated_ops = 0;
+  for (auto &op : *net_def.mutable_op()) {
+    std::vector<QuantizeActivationInfo> quantize_info;
+    for (auto &output : op.output()) {
+      float min_val = 0;
+      float max_val = 0;
+      if (!calibrator.GetRange(output, method, percentile,
+                               &min_val, &max_val)) {
+        break;
+      }
+      float scale = 0;
+      int32_t zero_point = 0;
+      AdjustRange<uint8_t>(min_val, max_val, false, &scale, &zero_point);
+      QuantizeActivationInfo info;
+      info.set_scale(scale);
+      info.set_zero_point(zero_point);
+      info.set_minval(-zero_point * scale);
+      info.set_maxval((255 - zero_point) * scale);
+      quantize_info.push_back(info);
+    }
+    if (quantize_info.empty() ||
+        static_cast<int>(quantize_info.size()) != op.output_size()) {
+      continue;
+    }
+    op.clear_quantize_info();
+    for (auto &info : quantize_info) {
+      *op.add_quantize_info() = info;
+    }
+    ++calibrated_ops;
+  }
+  VLOG(1) << "Calibrate " << calibrated_ops << " of " << net_def.op_size()
+          << " ops over " << dataset.size() << " inputs";
+
+  calibrated_model_graph_proto->resize(net_def.ByteSizeLong());
+  if (!net_def.SerializeToArray(calibrated_model_graph_proto->data(),
+                                static_cast<int>(
+                                    calibrated_model_graph_proto->size()))) {
+    return MaceStatus(MaceStatus::MACE_OUT_OF_RESOURCES,
+                      "failed to serialize the model graph");
+  }
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngine::Impl::LoadNextModel(
+    const NetDef *net_def,
+    const std::vector<std::string> &input_nodes,
+    const std::vector<std::string> &output_nodes,
+    const unsigned char *model_data,
+    std::shared_ptr<RunFuture> *future) {
+  MACE_CHECK_NOTNULL(net_def);
+  if (device_type_ == DeviceType::HEXAGON) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      "the DSP runs one graph, a next model could not be"
+                      " loaded beside it");
+  }
+  if (max_concurrent_runs_ > 1) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      "a next model could not be switched to with"
+                      " concurrent runs");
+  }
+  // a version loaded but not switched to yet is replaced
+  if (next_loader_.joinable()) {
+    next_loader_.join();
+  }
+  next_impl_.reset();
+  next_loaded_ = false;
+
+  std::shared_ptr<NetDef> next_net_def = std::make_shared<NetDef>(*net_def);
+  std::shared_ptr<RunFuture> load_future = std::make_shared<RunFuture>();
+  if (future != nullptr) {
+    *future = load_future;
+  }
+  next_loader_ = std::thread([this, next_net_def, input_nodes, output_nodes,
+                              model_data, load_future]() {
+    std::unique_ptr<Impl> next(new Impl(config_, base_device_));
+    MaceStatus status = next->Init(next_net_def.get(), input_nodes,
+                                   output_nodes, model_data);
+    {
+      std::lock_guard<std::mutex> lock(next_mutex_);
+      if (status == MaceStatus::MACE_SUCCESS) {
+        next_impl_ = std::move(next);
+      } else {
+        LOG(WARNING) << "Loading the next model failed, keep running the"
+                     << " current one: " << status.information();
+      }
+      next_loaded_ = true;
+    }
+    load_future->impl_->Finish(status);
+  });
+  return MaceStatus::MACE_SUCCESS;
+}
+
+std::unique_ptr<MaceEngine::Impl> MaceEngine::Impl::TakeNextModel() {
+  if (!next_loader_.joinable()) {
+    return nullptr;
+  }
+  {
+    std::lock_guard<std::mutex> lock(next_mutex_);
+    if (!next_loaded_) {
+      return nullptr;
+    }
+  }
+  next_loader_.join();
+  return std::move(next_impl_);
+}
+
+MaceStatus MaceEngine::Impl::WarmUpContexts(const WarmUpOptions &options) {
+  if (options.prefault_weights) {
+    const int64_t start_micros = NowMicros();
+    const index_t bytes = ws_->PrefaultWeights();
+    VLOG(1) << "Prefault " << bytes << " bytes of weights in "
+            << NowMicros() - start_micros << " us";
+  }
+  // hexagon nets are prepared by the DSP at init
+  if (options.synthetic_run && net_ != nullptr) {
+    MACE_RETURN_IF_ERROR(RunOnZeros());
+  }
+  for (auto &context : contexts_) {
+    MACE_RETURN_IF_ERROR(context->WarmUpContexts(options));
+  }
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngine::Impl::WarmUp(const WarmUpOptions &options,
+                                    RunCallback callback,
+                                    std::shared_ptr<RunFuture> *future) {
+  WaitWarmUp();
+  WaitAsyncRuns();
+  std::shared_ptr<RunFuture> warm_up_future = std::make_shared<RunFuture>();
+  if (future != nullptr) {
+    *future = warm_up_future;
+  }
+  auto warm_up = [this, options, callback, warm_up_future]() {
+    Tracer::Scope trace_scope(tracer_.get());
+    MaceStatus status = WarmUpContexts(options);
+    if (status != MaceStatus::MACE_SUCCESS) {
+      LOG(WARNING) << "Warming up failed: " << status.information();
+    }
+    if (callback) {
+      callback(status);
+    }
+    warm_up_future->impl_->Finish(status);
+    return status;
+  };
+  if (options.background) {
+    warm_up_worker_ = std::thread(warm_up);
+    return MaceStatus::MACE_SUCCESS;
+  }
+  return warm_up();
+}
+
+void MaceEngine::Impl::WaitWarmUp() {
+  if (warm_up_worker_.joinable()) {
+    warm_up_worker_.join();
+  }
+}
+
+MaceStatus MaceEngine::Impl::Run(
+    const std::map<std::string, MaceTensor> &inputs,
+    std::map<std::string, MaceTensor> *outputs,
+    RunMetadata *run_metadata) {
+  MACE_SYSTEM_TRACE("MaceEngine::Run");
+  if (NeedsTiles(inputs)) {
+    return RunTiled(inputs, outputs, run_metadata);
+  }
+  const int64_t call_micros = NowMicros();
+  RuntimeArbiter::Lease lease;
+  if (runtime_arbiter_ != nullptr) {
+    // a CPU run holds the threads of all its workers
+    const int units = device_type_ == DeviceType::CPU ?
+        device_->cpu_runtime()->thread_pool()->thread_count() *
+            std::max(inter_op_parallelism_, 1) : 1;
+    MACE_RETURN_IF_ERROR(runtime_arbiter_->Acquire(
+        device_type_, units, run_priority_, run_deadline_micros_, &lease));
+  }
+  if (max_concurrent_runs_ == 1) {
+    return RunExclusive(inputs, outputs, run_metadata, call_micros);
+  }
+  Impl *context = nullptr;
+  MACE_RETURN_IF_ERROR(AcquireContext(&context));
+  MaceStatus status =
+      context->RunExclusive(inputs, outputs, run_metadata, call_micros);
+  ReleaseContext(context);
+  return status;
+}
+
+MaceStatus MaceEngine::Impl::RunOnZeros() {
+  // garbage inputs could index out of bounds, e.g. those of a Gather
+  for (auto &input : input_info_map_) {
+    if (!ws_->HasTensor(input.first)) {
+      continue;
+    }
+    Tensor *input_tensor = ws_->GetTensor(input.first);
+    if (input_tensor->UnderlyingBuffer() == nullptr ||
+        input_tensor->has_opencl_image()) {
+      continue;
+    }
+    Tensor::MappingGuard guard(input_tensor);
+    input_tensor->Clear();
+  }
+  MACE_RETURN_IF_ERROR(ws_->ReacquireActivations());
+  if (gpu_kernel_replay_) {
+    net_->SetReplayKey("");
+  }
+  // the scratch buffers grow, the outputs are resized and the GPU kernels
+  // and their buffers are created by the first run
+  MaceStatus run_status = net_->Run(nullptr);
+  if (allocation_monitor_ != nullptr) {
+    AllocationMonitor::Unwatch();
+  }
+  MACE_RETURN_IF_ERROR(run_status);
+#ifdef MACE_ENABLE_OPENCL
+  if (device_type_ == GPU) {
+    device_->gpu_runtime()->opencl_runtime()->command_queue().finish();
+  }
+#endif  // MACE_ENABLE_OPENCL
+  // the states of the warm-up run are not those of the first frame, and
+  // the incremental inputs are no longer those of the last run
+  net_->ResetStates();
+  last_inputs_.clear();
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngine::Impl::PreallocateRuns() {
+  MACE_RETURN_IF_ERROR(RunOnZeros());
+  allocation_monitor_.reset(
+      new AllocationMonitor(config_->fail_run_allocations()));
+  allocation_observer_.reset(
+      new AllocationObserver(allocation_monitor_.get()));
+  net_->AddObserver(allocation_observer_.get());
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngine::Impl::InitTiles(
+    const NetDef &net_def,
+    const std::vector<std::string> &input_nodes,
+    const std::vector<std::string> &output_nodes) {
+  if (is_quantized_model_ || input_nodes.size() != 1) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      "only float models of a single input are tiled");
+  }
+  const InputInfo &input_info = input_info_map_.at(input_nodes[0]);
+  const DataFormat input_format =
+      static_cast<DataFormat>(input_info.data_format());
+  if (input_info.dims_size() != 4 || input_format == DataFormat::DF_NONE) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      "the tiled input must be an image: " + input_nodes[0]);
+  }
+  const int input_h_axis = input_format == DataFormat::NCHW ? 2 : 1;
+  tile_size_[0] = input_info.dims(input_h_axis);
+  tile_size_[1] = input_info.dims(input_h_axis + 1);
+  MACE_RETURN_IF_ERROR(ComputeSpatialReach(net_def, output_nodes,
+                                           &tile_reaches_));
+  for (auto &output_name : output_nodes) {
+    const OutputInfo &output_info = output_info_map_.at(output_name);
+    const SpatialReach &reach = tile_reaches_.at(output_name);
+    const int output_h_axis =
+        static_cast<DataFormat>(output_info.data_format()) ==
+        DataFormat::NCHW ? 2 : 1;
+    for (int axis = 0; axis < 2; ++axis) {
+      // the outputs must follow the pixels of the input to be stitched
+      if (output_info.dims_size() != 4 ||
+          output_info.dims(output_h_axis + axis) * reach.stride[axis] !=
+              tile_size_[axis]) {
+        return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                          "can't tile the net: output " + output_name +
+                          " is not an image of a stride of the input");
+      }
+      tile_halo_[axis] = std::max<index_t>(tile_halo_[axis],
+                                           reach.halo[axis]);
+      // the origins of the tiles are multiples of all the strides
+      index_t a = tile_align_[axis];
+      index_t b = reach.stride[axis];
+      while (b != 0) {
+        const index_t r = a % b;
+        a = b;
+        b = r;
+      }
+      tile_align_[axis] = tile_align_[axis] / a * reach.stride[axis];
+    }
+  }
+  // the tile alone must have some pixels out of its halo
+  for (int axis = 0; axis < 2; ++axis) {
+    std::vector<TileSpan> spans;
+    MACE_RETURN_IF_ERROR(PlanTileSpans(tile_size_[axis], tile_size_[axis],
+                                       tile_halo_[axis], tile_align_[axis],
+                                       &spans));
+  }
+  tiled_input_ = input_nodes[0];
+  VLOG(1) << "Tile " << tiled_input_ << " by " << tile_size_[0] << "x"
+          << tile_size_[1] << " with halos of " << tile_halo_[0] << "x"
+          << tile_halo_[1];
+  return MaceStatus::MACE_SUCCESS;
+}
+
+bool MaceEngine::Impl::NeedsTiles(
+    const std::map<std::string, MaceTensor> &inputs) const {
+  if (tiled_input_.empty()) {
+    return false;
+  }
+  auto input = inputs.find(tiled_input_);
+  if (input == inputs.end() || input->second.data() == nullptr ||
+      input->second.shape().size() != 4) {
+    return false;
+  }
+  const int h_axis = input->second.data_format() == DataFormat::NCHW ? 2 : 1;
+  return input->second.shape()[h_axis] > tile_size_[0] ||
+         input->second.shape()[h_axis + 1] > tile_size_[1];
+}
+
+MaceStatus MaceEngine::Impl::RunTiled(
+    const std::map<std::string, MaceTensor> &inputs,
+    std::map<std::string, MaceTensor> *outputs,
+    RunMetadata *run_metadata) {
+  MACE_CHECK_NOTNULL(outputs);
+  const MaceTensor &image = inputs.at(tiled_input_);
+  const DataFormat data_format = image.data_format();
+  const int h_axis = data_format == DataFormat::NCHW ? 2 : 1;
+  const std::vector<int64_t> &image_shape = image.shape();
+  std::vector<TileSpan> spans[2];
+  for (int axis = 0; axis < 2; ++axis) {
+    MACE_RETURN_IF_ERROR(PlanTileSpans(image_shape[h_axis + axis],
+                                       tile_size_[axis], tile_halo_[axis],
+                                       tile_align_[axis], &spans[axis]));
+  }
+  // the buffers of a tile, reused by all of them
+  std::vector<int64_t> tile_shape = image_shape;
+  tile_shape[h_axis] = tile_size_[0];
+  tile_shape[h_axis + 1] = tile_size_[1];
+  const int64_t tile_size = std::accumulate(
+      tile_shape.begin(), tile_shape.end(), static_cast<int64_t>(1),
+      std::multiplies<int64_t>());
+  std::map<std::string, MaceTensor> tile_inputs;
+  tile_inputs[tiled_input_] = MaceTensor(
+      tile_shape, std::shared_ptr<float>(new float[tile_size],
+                                         std::default_delete<float[]>()),
+      data_format);
+  std::map<std::string, MaceTensor> tile_outputs;
+  for (auto &output : *outputs) {
+    auto reach = tile_reaches_.find(output.first);
+    if (reach == tile_reaches_.end()) {
+      return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                        "'" + output.first + "' is not an output of init");
+    }
+    const std::vector<int64_t> &shape = output.second.shape();
+    const int output_h_axis =
+        output.second.data_format() == DataFormat::NCHW ? 2 : 1;
+    if (output.second.data() == nullptr || shape.size() != 4 ||
+        shape[output_h_axis] * reach->second.stride[0] !=
+            image_shape[h_axis] ||
+        shape[output_h_axis + 1] * reach->second.stride[1] !=
+            image_shape[h_axis + 1]) {
+      return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                        "the tiled output " + output.first + " must be a "
+                        "host buffer of the size of the image over " +
+                        MakeString(reach->second.stride[0], "x",
+                                   reach->second.stride[1]));
+    }
+    std::vector<int64_t> tile_output_shape = shape;
+    tile_output_shape[output_h_axis] =
+        tile_size_[0] / reach->second.stride[0];
+    tile_output_shape[output_h_axis + 1] =
+        tile_size_[1] / reach->second.stride[1];
+    const int64_t output_size = std::accumulate(
+        tile_output_shape.begin(), tile_output_shape.end(),
+        static_cast<int64_t>(1), std::multiplies<int64_t>());
+    tile_outputs[output.first] = MaceTensor(
+        tile_output_shape,
+        std::shared_ptr<float>(new float[output_size],
+                               std::default_delete<float[]>()),
+        output.second.data_format());
+    output.second.impl_->valid = true;
+  }
+  VLOG(2) << "Run " << spans[0].size() << "x" << spans[1].size()
+          << " tiles of " << tiled_input_;
+  for (const TileSpan &row : spans[0]) {
+    for (const TileSpan &col : spans[1]) {
+      CopySpatialWindow(image.data().get(), image_shape, row.begin,
+                        col.begin, tile_inputs[tiled_input_].data().get(),
+                        tile_shape, 0, 0, tile_size_[0], tile_size_[1],
+                        data_format);
+      MACE_RETURN_IF_ERROR(Run(tile_inputs, &tile_outputs, run_metadata));
+      for (auto &output : *outputs) {
+        const MaceTensor &tile_output = tile_outputs.at(output.first);
+        if (!tile_output.valid()) {
+          output.second.impl_->valid = false;
+          continue;
+        }
+        const int *stride = tile_reaches_.at(output.first).stride;
+        CopySpatialWindow(tile_output.data().get(), tile_output.shape(),
+                          (row.core_begin - row.begin) / stride[0],
+                          (col.core_begin - col.begin) / stride[1],
+                          output.second.data().get(), output.second.shape(),
+                          row.core_begin / stride[0],
+                          col.core_begin / stride[1],
+                          (row.core_end - row.core_begin) / stride[0],
+                          (col.core_end - col.core_begin) / stride[1],
+                          output.second.data_format());
+      }
+    }
+  }
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngine::Impl::AcquireContext(Impl **context) {
+  size_t context_idx = 0;
+  {
+    std::unique_lock<std::mutex> lock(context_mutex_);
+    context_cond_.wait(lock, [this] {
+      return !free_contexts_.empty() || num_contexts_ < max_contexts_;
+    });
+    if (!free_contexts_.empty()) {
+      *context = free_contexts_.back();
+      free_contexts_.pop_back();
+      return MaceStatus::MACE_SUCCESS;
+    }
+    context_idx = num_contexts_++;
+  }
+  // created out of the lock, the other runs go on meanwhile
+  VLOG(1) << "Create execution context " << context_idx;
+  std::unique_ptr<Impl> new_context(new Impl(config_, base_device_, this));
+  MaceStatus status = new_context->Init(context_net_def_.get(),
+                                        context_inputs_, context_outputs_,
+                                        context_model_data_);
+  std::lock_guard<std::mutex> lock(context_mutex_);
+  if (status != MaceStatus::MACE_SUCCESS) {
+    --num_contexts_;
+    context_cond_.notify_one();
+    return status;
+  }
+  *context = new_context.get();
+  contexts_.push_back(std::move(new_context));
+  return MaceStatus::MACE_SUCCESS;
+}
+
+void MaceEngine::Impl::ReleaseContext(Impl *context) {
+  {
+    std::lock_guard<std::mutex> lock(context_mutex_);
+    free_contexts_.push_back(context);
+  }
+  context_cond_.notify_one();
+}
+
+MaceStatus MaceEngine::Impl::RunExclusive(
+    const std::map<std::string, MaceTensor> &inputs,
+    std::map<std::string, MaceTensor> *outputs,
+    RunMetadata *run_metadata,
+    int64_t call_micros) {
+  MACE_CHECK_NOTNULL(outputs);
+  WaitAsyncRuns();
+  Tracer::Scope trace_scope(tracer_.get());
+  const int64_t start_micros = NowMicros();
+  std::vector<Tensor *> input_tensors;
+  std::vector<Tensor *> output_tensors;
+  ZeroCopyBinding zero_copy_binding;
+  for (auto &input : inputs) {
+    if (input_info_map_.find(input.first) == input_info_map_.end()) {
+      LOG(FATAL) << "'" << input.first
+                 << "' does not belong to model's inputs: "
+                 << MakeString(MapKeys(input_info_map_));
+    }
+  }
+  if (!shape_plans_.empty()) {
+    MACE_RETURN_IF_ERROR(SwitchShapePlan(inputs));
+  }
+  for (auto &input : inputs) {
+    auto input_tensor_iter = input_tensor_map_.find(input.first);
+    if (input_tensor_iter == input_tensor_map_.end()) {
+      return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                        "'" + input.first + "' is not an input of init");
+    }
+    Tensor *input_tensor = input_tensor_iter->second;
+    if (input.second.opencl_memory() != nullptr) {
+      MACE_RETURN_IF_ERROR(
+          BindOpenCLInput(input, input_tensor, &zero_copy_binding));
+    } else if (CanBindInput(input.first, input.second)) {
+      VLOG(1) << "Bind input " << input.first << " without copy";
+      zero_copy_binding.Bind(input_tensor, input.second.data().get(),
+                             input.second.impl_->buffer_size);
+      input_tensor->set_data_format(input.second.data_format());
+      MACE_RETURN_IF_ERROR(input_tensor->Resize(input.second.shape()));
+    } else {
+      const int64_t transform_start_micros = NowMicros();
+      MACE_RETURN_IF_ERROR(TransposeInput(input, input_tensor));
+      TraceSpan(input.first, "TransformInput", transform_start_micros);
+    }
+    MACE_RETURN_IF_ERROR(CheckFoldedInputShape(input.first, input_tensor));
+    input_tensors.push_back(input_tensor);
+  }
+  for (auto &output : *outputs) {
+    if (output_info_map_.find(output.first) == output_info_map_.end()) {
+      LOG(FATAL) << "'" << output.first
+                 << "' does not belong to model's outputs: "
+                 << MakeString(MapKeys(output_info_map_));
+    }
+    auto output_tensor_iter = output_tensor_map_.find(output.first);
+    if (output_tensor_iter == output_tensor_map_.end()) {
+      return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                        "'" + output.first + "' is not an output of init");
+    }
+    Tensor *output_tensor = output_tensor_iter->second;
+    if (output.second.opencl_memory() != nullptr) {
+      MACE_RETURN_IF_ERROR(
+          BindOpenCLOutput(output, output_tensor, &zero_copy_binding));
+    } else if (CanBindOutput(output.second, output_tensor)) {
+      VLOG(1) << "Bind output " << output.first << " without copy";
+      zero_copy_binding.Bind(output_tensor, output.second.data().get(),
+                             output.second.impl_->buffer_size);
+    }
+    output_tensors.push_back(output_tensor);
+  }
+  UpdateChangedInputs(inputs);
+  if (gpu_kernel_replay_) {
+    // the kernels read the bound buffers of the recorded run
+    std::string replay_key;
+    if (run_metadata == nullptr && zero_copy_binding.empty()) {
+      for (const Tensor *input_tensor : input_tensors) {
+        replay_key += input_tensor->name() + ":" +
+            MakeString(input_tensor->shape()) + ";";
+      }
+    }
+    net_->SetReplayKey(replay_key);
+  }
+  std::vector<void *> egl_images;
+  MACE_RETURN_IF_ERROR(AcquireEGLImages(inputs, *outputs, &egl_images));
+  MaceStatus run_status =
+      ExecuteNet(input_tensors, &output_tensors, run_metadata);
+  bool writes_images = false;
+  size_t image_output_idx = 0;
+  for (auto &output : *outputs) {
+    Tensor *output_tensor = output_tensors[image_output_idx++];
+    if (run_status == MaceStatus::MACE_SUCCESS &&
+        output.second.opencl_memory() != nullptr &&
+        output.second.impl_->opencl_memory_type == OPENCL_IMAGE &&
+        !IsOutputSkipped(output.first)) {
+      run_status = WriteOpenCLImageOutput(output, output_tensor);
+      writes_images = true;
+    }
+  }
+  MaceStatus release_status = ReleaseEGLImages(egl_images);
+  if (run_status == MaceStatus::MACE_SUCCESS) {
+    run_status = release_status;
+  }
+  if (run_status != MaceStatus::MACE_SUCCESS) {
+    // the ops which failed to run are run again next time
+    last_inputs_.clear();
+    return run_status;
+  }
+
+#ifdef MACE_ENABLE_OPENCL
+  if (device_type_ == GPU) {
+    auto opencl_runtime = device_->gpu_runtime()->opencl_runtime();
+    // a batching queue synchronizes on the blocking maps of the outputs,
+    // unless the run borrowed memory it must hand back completed
+    if (opencl_runtime->IsQueueBatching() && zero_copy_binding.empty() &&
+        egl_images.empty() && !writes_images) {
+      opencl_runtime->command_queue().flush();
+    } else {
+      opencl_runtime->command_queue().finish();
+    }
+    opencl_runtime->SaveBuiltCLProgram();
+    if (opencl_runtime->tuner() != nullptr) {
+      opencl_runtime->tuner()->FinishRun();
+    }
+  }
+#else
+  MACE_UNUSED(writes_images);
+#endif
+  size_t output_idx = 0;
+  for (auto &output : *outputs) {
+    Tensor *output_tensor = output_tensors[output_idx++];
+    output.second.impl_->valid = !IsOutputSkipped(output.first);
+    if (!output.second.valid()) {
+      continue;
+    }
+    if (zero_copy_binding.IsBound(output_tensor) ||
+        (output.second.opencl_memory() != nullptr &&
+            output.second.impl_->opencl_memory_type == OPENCL_IMAGE)) {
+      output.second.impl_->shape = output_tensor->shape();
+      continue;
+    }
+    if (output.second.opencl_memory() != nullptr) {
+      return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                        "output could not be written into its OpenCL "
+                        "buffer: " + output.first);
+    }
+    // save output
+    const int64_t transform_start_micros = NowMicros();
+    MACE_RETURN_IF_ERROR(TransposeOutput(output_tensor, &output));
+    TraceSpan(output.first, "TransformOutput", transform_start_micros);
+  }
+  TraceSpan("Run", "engine", start_micros);
+  RecordRunLatency(call_micros, start_micros);
+  if (device_type_ == DeviceType::CPU && primary_ == nullptr &&
+      max_concurrent_runs_ == 1) {
+    device_->cpu_runtime()->RecordRun(NowMicros() - start_micros);
+  }
+  return MaceStatus::MACE_SUCCESS;
+}
+
+void MaceEngine::Impl::TraceSpan(const std::string &name,
+                                 const std::string &category,
+                                 int64_t start_micros) {
+  if (tracer_ != nullptr) {
+    tracer_->AddSpan(name, category, start_micros, NowMicros());
+  }
+}
+
+void MaceEngine::Impl::RecordRunLatency(int64_t call_micros,
+                                        int64_t start_micros) {
+  if (latency_metrics_) {
+    // the latencies of all the contexts are of the primary one
+    Impl *owner = primary_ != nullptr ? primary_ : this;
+    const int64_t end_micros = NowMicros();
+    owner->queued_latency_.Record(start_micros - call_micros);
+    owner->exec_latency_.Record(end_micros - start_micros);
+    owner->total_latency_.Record(end_micros - call_micros);
+  }
+}
+
+void MaceEngine::Impl::EndInitPhase(const std::string &name) {
+  const int64_t now_micros = NowMicros();
+  init_phases_.push_back({name, now_micros - init_phase_start_micros_});
+  init_phase_start_micros_ = now_micros;
+}
+
+std::vector<int64_t> MaceEngine::Impl::ShapePlanInputShape(
+    const std::string &input_name,
+    const std::map<std::string, MaceTensor> &inputs) const {
+  const auto &input_info = input_info_map_.at(input_name);
+  auto input = inputs.find(input_name);
+  if (input == inputs.end() || input_preprocess_.count(input_name) == 1) {
+    return std::vector<int64_t>(input_info.dims().begin(),
+                                input_info.dims().end());
+  }
+  std::vector<int64_t> shape = input->second.shape();
+  const DataFormat model_format =
+      static_cast<DataFormat>(input_info.data_format());
+  const DataFormat data_format = input->second.data_format();
+  if (shape.size() == 4 && model_format != DataFormat::DF_NONE &&
+      data_format != DataFormat::DF_NONE && data_format != model_format) {
+    const std::vector<int> dst_dims = model_format == DataFormat::NHWC ?
+        std::vector<int>{0, 2, 3, 1} : std::vector<int>{0, 3, 1, 2};
+    shape = TransposeShape<int64_t, int64_t>(shape, dst_dims);
+  }
+  return shape;
+}
+
+std::string MaceEngine::Impl::ShapePlanKey(
+    const std::map<std::string, MaceTensor> &inputs) const {
+  std::string key;
+  for (auto &input_name : shape_plan_inputs_) {
+    key += input_name + ":";
+    for (int64_t dim : ShapePlanInputShape(input_name, inputs)) {
+      key += std::to_string(dim) + ",";
+    }
+    key += ";";
+  }
+  return key;
+}
+
+MaceStatus MaceEngine::Impl::InitShapePlans(
+    const NetDef &net_def,
+    const std::vector<std::string> &input_nodes,
+    const std::vector<std::string> &output_nodes,
+    const unsigned char *model_data) {
+  if (device_type_ != DeviceType::CPU || inter_op_parallelism_ > 1 ||
+      cpu_half_precision_ || cpu_bfloat16_ || cpu_channel_block_ > 0 ||
+      cpu_data_format_ == DataFormat::NHWC || cpu_constant_folding_ ||
+      nnapi_delegation_) {
+    LOG(WARNING) << "Shape plans are only kept on CPU, run serially without"
+                 << " half precision, bfloat16, blocked layout, NHWC data"
+                 << " format,"
+                 << " constant folding or NNAPI delegation, inputs of other"
+                 << " shapes are resized";
+    return MaceStatus::MACE_SUCCESS;
+  }
+  ShareModelWeights(net_def, model_data);
+  shape_plan_net_def_.reset(new NetDef(net_def));
+  shape_plan_model_data_ = model_data;
+  shape_plan_inputs_ = input_nodes;
+  shape_plan_outputs_ = output_nodes;
+  // the plan of init, made of the shapes of the model
+  ShapePlan plan;
+  plan.key = ShapePlanKey({});
+  shape_plans_.push_front(std::move(plan));
+  return MaceStatus::MACE_SUCCESS;
+}
+
+void MaceEngine::Impl::ShareModelWeights(const NetDef &net_def,
+                                         const unsigned char *model_data) {
+  if (model_weights_ != nullptr) {
+    return;
+  }
+  size_t model_data_size = 0;
+  for (auto &const_tensor : net_def.tensors()) {
+    model_data_size = std::max(model_data_size, static_cast<size_t>(
+        const_tensor.offset() +
+            const_tensor.data_size() *
+                GetEnumTypeSize(const_tensor.data_type())));
+  }
+  model_weights_ = std::make_shared<ModelWeights>(model_data,
+                                                  model_data_size);
+  ws_->set_model_weights(model_weights_);
+}
+
+MaceStatus MaceEngine::Impl::SwitchShapePlan(
+    const std::map<std::string, MaceTensor> &inputs) {
+  const std::string key = ShapePlanKey(inputs);
+  if (key == shape_plans_.front().key) {
+    return MaceStatus::MACE_SUCCESS;
+  }
+  ShapePlan &active_plan = shape_plans_.front();
+  active_plan.ws = std::move(ws_);
+  active_plan.net = std::move(net_);
+  auto plan = std::find_if(shape_plans_.begin(), shape_plans_.end(),
+                           [&key](const ShapePlan &candidate) {
+                             return candidate.key == key;
+                           });
+  if (plan != shape_plans_.end()) {
+    shape_plans_.splice(shape_plans_.begin(), shape_plans_, plan);
+  } else {
+    VLOG(1) << "Plan the memory of input shapes " << key;
+    ShapePlan new_plan;
+    new_plan.key = key;
+    MaceStatus status = BuildShapePlan(inputs, &new_plan);
+    if (status != MaceStatus::MACE_SUCCESS) {
+      ws_ = std::move(active_plan.ws);
+      net_ = std::move(active_plan.net);
+      return status;
+    }
+    shape_plans_.push_front(std::move(new_plan));
+    if (shape_plans_.size() > shape_plan_cache_size_) {
+      shape_plans_.pop_back();
+    }
+  }
+  ws_ = std::move(shape_plans_.front().ws);
+  net_ = std::move(shape_plans_.front().net);
+  ResolveIOTensors();
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngine::Impl::BuildShapePlan(
+    const std::map<std::string, MaceTensor> &inputs,
+    ShapePlan *plan) {
+  NetDef net_def = *shape_plan_net_def_;
+  DataFormat data_format_flag = DataFormat::NHWC;
+  for (auto &input_info : *net_def.mutable_input_info()) {
+    const std::vector<int64_t> shape =
+        ShapePlanInputShape(input_info.name(), inputs);
+    input_info.clear_dims();
+    for (int64_t dim : shape) {
+      input_info.add_dims(dim);
+    }
+    if (static_cast<DataFormat>(input_info.data_format()) ==
+        DataFormat::DF_NONE) {
+      data_format_flag = DataFormat::DF_NONE;
+    }
+  }
+  {
+    // the output shapes of the ops, run without a memory plan
+    std::unique_ptr<Workspace> ws;
+    MACE_RETURN_IF_ERROR(NewShapePlanWorkspace(net_def, &ws));
+    MemoryOptimizer mem_optimizer;
+    SerialNet net(op_registry_.get(), &net_def, ws.get(), device_.get(),
+                  &mem_optimizer);
+    MACE_RETURN_IF_ERROR(net.Init());
+    for (auto &input : inputs) {
+      MACE_RETURN_IF_ERROR(TransposeInput(input, ws->GetTensor(input.first)));
+    }
+    MACE_RETURN_IF_ERROR(net.Run());
+    for (auto &op : *net_def.mutable_op()) {
+      if (op.output_size() != op.output_shape_size()) {
+        continue;
+      }
+      for (int i = 0; i < op.output_size(); ++i) {
+        const Tensor *tensor = ws->GetTensor(op.output(i));
+        if (tensor == nullptr) {
+          continue;
+        }
+        std::vector<index_t> shape = tensor->shape();
+        // the CPU float ops keep 4D tensors in NCHW, see CreateOperation
+        if (!is_quantized_model_ && data_format_flag == DataFormat::NHWC &&
+            shape.size() == 4) {
+          shape = TransposeShape<index_t, index_t>(shape, {0, 2, 3, 1});
+        }
+        OutputShape *output_shape = op.mutable_output_shape(i);
+        output_shape->clear_dims();
+        for (index_t dim : shape) {
+          output_shape->add_dims(dim);
+        }
+      }
+    }
+  }
+  MACE_RETURN_IF_ERROR(NewShapePlanWorkspace(net_def, &plan->ws));
+  MemoryOptimizer mem_optimizer;
+  mem_optimizer.set_incremental_inputs(incremental_inputs_);
+  mem_optimizer.set_min_peak(low_memory_);
+  plan->net.reset(new SerialNet(op_registry_.get(), &net_def,
+                                plan->ws.get(), device_.get(),
+                                &mem_optimizer));
+  MACE_RETURN_IF_ERROR(plan->ws->PreallocateOutputTensor(net_def,
+                                                         &mem_optimizer,
+                                                         device_.get()));
+  MACE_RETURN_IF_ERROR(plan->net->Init());
+  plan->ws->packed_weights()->Flush();
+  plan->net->set_tracer(tracer_.get());
+  if (latency_metrics_) {
+    plan->net->EnableLatencyMetrics();
+  }
+  if (cpu_weight_prefetch_) {
+    plan->net->EnableWeightPrefetch();
+  }
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngine::Impl::NewShapePlanWorkspace(
+    const NetDef &net_def,
+    std::unique_ptr<Workspace> *ws) {
+  ws->reset(new Workspace());
+  (*ws)->set_packed_weights(packed_weights_);
+  (*ws)->set_algorithm_cache(algorithm_cache_);
+  (*ws)->set_model_weights(model_weights_);
+  MACE_RETURN_IF_ERROR((*ws)->LoadModelTensor(net_def, device_.get(),
+                                              shape_plan_model_data_));
+  for (auto &input_info : net_def.input_info()) {
+    if (std::find(shape_plan_inputs_.begin(), shape_plan_inputs_.end(),
+                  input_info.name()) == shape_plan_inputs_.end()) {
+      continue;
+    }
+    Tensor *input_tensor = (*ws)->CreateTensor(
+        input_info.name(), device_->allocator(), DT_FLOAT);
+    MACE_RETURN_IF_ERROR(input_tensor->Resize(std::vector<index_t>(
+        input_info.dims().begin(), input_info.dims().end())));
+  }
+  for (auto &output_name : shape_plan_outputs_) {
+    (*ws)->CreateTensor(output_name, device_->allocator(), DT_FLOAT);
+  }
+  return MaceStatus::MACE_SUCCESS;
+}
+
+void MaceEngine::Impl::ResolveIOTensors() {
+  input_tensor_map_.clear();
+  for (auto &input_info : input_info_map_) {
+    Tensor *input_tensor = ws_->GetTensor(input_info.first);
+    if (input_tensor != nullptr) {
+      input_tensor_map_[input_info.first] = input_tensor;
+    }
+  }
+  output_tensor_map_.clear();
+  for (auto &output_info : output_info_map_) {
+    Tensor *output_tensor = ws_->GetTensor(output_info.first);
+    if (output_tensor != nullptr) {
+      output_tensor_map_[output_info.first] = output_tensor;
+    }
+  }
+}
+
+MaceStatus MaceEngine::Impl::ExecuteNet(
+    const std::vector<Tensor *> &input_tensors,
+    std::vector<Tensor *> *output_tensors,
+    RunMetadata *run_metadata) {
+#ifdef MACE_ENABLE_HEXAGON
+  // voted back after the run, by the whole graph or the partitions
+  std::unique_ptr<DSPPerfVote> perf_vote;
+  if (device_type_ == DeviceType::HEXAGON) {
+    perf_vote.reset(new DSPPerfVote(dsp_perf_hint_));
+  }
+  if (hexagon_controller_ != nullptr) {
+    MACE_CHECK(input_tensors.size() == 1 && output_tensors->size() == 1,
+               "HEXAGON not support multiple inputs and outputs yet.");
+    const int64_t start_micros = NowMicros();
+    hexagon_controller_->ExecuteGraphNew(input_tensors, output_tensors, true);
+    if (run_metadata != nullptr) {
+      hexagon_controller_->GetRunMetadata(start_micros, run_metadata);
+    }
+    return MaceStatus::MACE_SUCCESS;
+  }
+#else
+  MACE_UNUSED(input_tensors);
+  MACE_UNUSED(output_tensors);
+#endif
+  MACE_RETURN_IF_ERROR(ws_->ReacquireActivations());
+  MaceStatus status = net_->Run(run_metadata);
+  if (allocation_monitor_ != nullptr) {
+    // an operation which failed left its thread watched
+    AllocationMonitor::Unwatch();
+  }
+  if (low_memory_ && !config_->allocation_free_runs()) {
+    ReleaseScratch();
+  }
+  return status;
+}
+
+void MaceEngine::Impl::UpdateChangedInputs(
+    const std::map<std::string, MaceTensor> &inputs) {
+  if (incremental_inputs_.empty() || net_ == nullptr) {
+    return;
+  }
+  // the ops of another net, e.g. of a shape plan, kept nothing
+  if (net_.get() != incremental_net_) {
+    incremental_net_ = net_.get();
+    last_inputs_.clear();
+  }
+  std::set<std::string> changed;
+  for (auto &input_name : incremental_inputs_) {
+    auto input = inputs.find(input_name);
+    const char *data = nullptr;
+    size_t bytes = 0;
+    if (input != inputs.end() && input->second.opencl_memory() == nullptr) {
+      const MaceTensor &tensor = input->second;
+      const size_t size = std::accumulate(
+          tensor.shape().begin(), tensor.shape().end(),
+          static_cast<size_t>(1), std::multiplies<size_t>());
+      if (tensor.pixels() != nullptr) {
+        data = reinterpret_cast<const char *>(tensor.pixels().get());
+        bytes = size;
+      } else {
+        data = reinterpret_cast<const char *>(tensor.raw_data().get());
+        bytes = size * IDataTypeSize(tensor.data_type());
+      }
+    }
+    if (data == nullptr) {
+      // the content of the device memory is not compared
+      changed.insert(input_name);
+      last_inputs_.erase(input_name);
+      continue;
+    }
+    auto last = last_inputs_.find(input_name);
+    if (last != last_inputs_.end() &&
+        last->second.shape == input->second.shape() &&
+        last->second.format == input->second.data_format() &&
+        last->second.data.size() == bytes &&
+        memcmp(last->second.data.data(), data, bytes) == 0) {
+      continue;
+    }
+    changed.insert(input_name);
+    IncrementalInput &saved = last_inputs_[input_name];
+    saved.shape = input->second.shape();
+    saved.format = input->second.data_format();
+    saved.data.assign(data, data + bytes);
+  }
+  net_->SetChangedInputs(changed);
+}
+
+MaceStatus MaceEngine::Impl::RunAsync(
+    const std::map<std::string, MaceTensor> &inputs,
+    std::map<std::string, MaceTensor> *outputs,
+    RunCallback callback,
+    std::shared_ptr<RunFuture> *future) {
+  MACE_CHECK_NOTNULL(outputs);
+  const int64_t call_micros = NowMicros();
+  for (auto &input : inputs) {
+    if (input.second.opencl_memory() != nullptr ||
+        opencl_image_inputs_.count(input.first) == 1) {
+      return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                        "OpenCL memory is only supported by Run: " +
+                            input.first);
+    }
+  }
+  for (auto &output : *outputs) {
+    if (output.second.opencl_memory() != nullptr) {
+      return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                        "OpenCL memory is only supported by Run: " +
+                            output.first);
+    }
+  }
+  // only GPU and DSP graph runs could overlap, the others share the
+  // workspace tensors
+  const size_t max_in_flight =
+      (device_type_ == GPU || RunsHexagonGraph()) ?
+      async_inputs_.size() : 1;
+  {
+    std::unique_lock<std::mutex> lock(async_mutex_);
+    if (!async_worker_.joinable()) {
+      async_worker_ = std::thread(&MaceEngine::Impl::AsyncLoop, this);
+    }
+    async_cond_.wait(lock, [this, max_in_flight] {
+      return async_in_flight_ < max_in_flight;
+    });
+  }
+  auto run = make_unique<AsyncRun>();
+  run->outputs = outputs;
+  run->slot = async_slot_;
+  run->call_micros = call_micros;
+  run->callback = callback;
+  run->future = std::make_shared<RunFuture>();
+  async_slot_ = (async_slot_ + 1) % static_cast<int>(async_inputs_.size());
+  MACE_RETURN_IF_ERROR(EnqueueAsyncRun(inputs, run.get()));
+  if (future != nullptr) {
+    *future = run->future;
+  }
+  std::lock_guard<std::mutex> lock(async_mutex_);
+  async_queue_.push_back(std::move(run));
+  ++async_in_flight_;
+  async_cond_.notify_all();
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngine::Impl::EnqueueAsyncRun(
+    const std::map<std::string, MaceTensor> &inputs,
+    AsyncRun *run) {
+#ifdef MACE_ENABLE_OPENCL
+  OpenCLRuntime *opencl_runtime = nullptr;
+  cl::CommandQueue *transfer_queue = nullptr;
+  if (device_type_ == GPU) {
+    opencl_runtime = device_->gpu_runtime()->opencl_runtime();
+    transfer_queue = opencl_runtime->transfer_command_queue();
+    if (transfer_queue == nullptr) {
+      return MaceStatus(MaceStatus::MACE_OUT_OF_RESOURCES,
+                        "failed to create the OpenCL transfer queue");
+    }
+  }
+  // the uploads into the device buffers of the slot, and the copies of
+  // them into the input tensors the net waits for
+  std::vector<cl::Event> upload_events;
+  std::vector<std::pair<Tensor *, Tensor *>> input_copies;
+#endif
+  for (auto &input : inputs) {
+    if (input_info_map_.find(input.first) == input_info_map_.end()) {
+      LOG(FATAL) << "'" << input.first
+                 << "' does not belong to model's inputs: "
+                 << MakeString(MapKeys(input_info_map_));
+    }
+    Tensor *input_tensor = ws_->GetTensor(input.first);
+#ifdef MACE_ENABLE_HEXAGON
+    if (hexagon_controller_ != nullptr) {
+      // the next frame is transposed into the other slot while the DSP
+      // reads this one
+      auto &shared_input = async_inputs_[run->slot][input.first];
+      if (shared_input == nullptr) {
+        shared_input = make_unique<Tensor>(device_->allocator(), DT_FLOAT);
+      }
+      MACE_RETURN_IF_ERROR(TransposeInput(input, shared_input.get()));
+      run->input_tensors.push_back(shared_input.get());
+      continue;
+    }
+#endif
+    run->input_tensors.push_back(input_tensor);
+#ifdef MACE_ENABLE_OPENCL
+    if (device_type_ == GPU) {
+      // fill the host staging tensor of this slot and upload it to the
+      // device buffer of the slot on the transfer queue, while the command
+      // queue still runs the previous frames
+      auto &staging = async_inputs_[run->slot][input.first];
+      if (staging == nullptr) {
+        staging = make_unique<Tensor>(GetCPUAllocator(), DT_FLOAT);
+      }
+      MACE_RETURN_IF_ERROR(TransposeInput(input, staging.get()));
+      auto &device_input = async_device_inputs_[run->slot][input.first];
+      if (device_input == nullptr) {
+        device_input = make_unique<Tensor>(device_->allocator(), DT_FLOAT);
+      }
+      MACE_RETURN_IF_ERROR(device_input->Resize(staging->shape()));
+      input_tensor->set_data_format(staging->data_format());
+      MACE_RETURN_IF_ERROR(input_tensor->Resize(staging->shape()));
+      cl::Event event;
+      cl_int error = transfer_queue->enqueueWriteBuffer(
+          *device_input->opencl_buffer(), CL_FALSE,
+          device_input->buffer_offset(), staging->raw_size(),
+          staging->raw_data(), nullptr, &event);
+      MACE_CL_RET_STATUS(error);
+      upload_events.push_back(event);
+      input_copies.emplace_back(device_input.get(), input_tensor);
+      continue;
+    }
+#endif
+    MACE_RETURN_IF_ERROR(TransposeInput(input, input_tensor));
+    MACE_RETURN_IF_ERROR(CheckFoldedInputShape(input.first, input_tensor));
+  }
+  for (auto &output : *run->outputs) {
+    if (output_info_map_.find(output.first) == output_info_map_.end()) {
+      LOG(FATAL) << "'" << output.first
+                 << "' does not belong to model's outputs: "
+                 << MakeString(MapKeys(output_info_map_));
+    }
+  }
+  // the CPU runs do not overlap, the net set now is the one run next
+  UpdateChangedInputs(inputs);
+#ifdef MACE_ENABLE_OPENCL
+  if (device_type_ == GPU) {
+    cl_int error = transfer_queue->flush();
+    MACE_CL_RET_STATUS(error);
+    // the net of the previous frame is before the copies on the in-order
+    // command queue, so the input tensors are free to be overwritten
+    cl::CommandQueue &command_queue = opencl_runtime->command_queue();
+    if (!upload_events.empty()) {
+      MACE_RETURN_IF_ERROR(opencl_runtime->EnqueueBarrier(upload_events));
+    }
+    for (auto &copy : input_copies) {
+      error = command_queue.enqueueCopyBuffer(
+          *copy.first->opencl_buffer(), *copy.second->opencl_buffer(),
+          copy.first->buffer_offset(), copy.second->buffer_offset(),
+          copy.first->raw_size());
+      MACE_CL_RET_STATUS(error);
+    }
+    MACE_RETURN_IF_ERROR(ws_->ReacquireActivations());
+    if (gpu_kernel_replay_) {
+      // the copies of the inputs are enqueued with the run
+      net_->SetReplayKey("");
+    }
+    MaceStatus run_status = net_->Run(nullptr);
+    if (allocation_monitor_ != nullptr) {
+      AllocationMonitor::Unwatch();
+    }
+    if (run_status != MaceStatus::MACE_SUCCESS) {
+      last_inputs_.clear();
+      return run_status;
+    }
+    // copy the outputs into the device buffers of the slot, so that the
+    // next frame could overwrite them while they are read back
+    std::vector<std::pair<Tensor *, Tensor *>> readbacks;
+    for (auto &output : *run->outputs) {
+      if (IsOutputSkipped(output.first)) {
+        run->skipped_outputs.insert(output.first);
+        continue;
+      }
+      Tensor *output_tensor = ws_->GetTensor(output.first);
+      auto &staging = async_outputs_[run->slot][output.first];
+      if (staging == nullptr) {
+        staging = make_unique<Tensor>(GetCPUAllocator(), DT_FLOAT);
+      }
+      staging->set_data_format(output_tensor->data_format());
+      if (output_tensor->has_opencl_buffer()) {
+        MACE_RETURN_IF_ERROR(staging->Resize(output_tensor->shape()));
+        auto &device_output = async_device_outputs_[run->slot][output.first];
+        if (device_output == nullptr) {
+          device_output = make_unique<Tensor>(device_->allocator(),
+                                              output_tensor->dtype());
+        }
+        MACE_RETURN_IF_ERROR(device_output->Resize(output_tensor->shape()));
+        error = command_queue.enqueueCopyBuffer(
+            *output_tensor->opencl_buffer(), *device_output->opencl_buffer(),
+            output_tensor->buffer_offset(), device_output->buffer_offset(),
+            output_tensor->raw_size());
+        MACE_CL_RET_STATUS(error);
+        readbacks.emplace_back(device_output.get(), staging.get());
+      } else {
+        staging->Copy(*output_tensor);
+      }
+    }
+    std::vector<cl::Event> compute_events(1);
+    MACE_RETURN_IF_ERROR(opencl_runtime->EnqueueMarker(&compute_events[0]));
+    for (auto &readback : readbacks) {
+      cl::Event event;
+      error = transfer_queue->enqueueReadBuffer(
+          *readback.first->opencl_buffer(), CL_FALSE,
+          readback.first->buffer_offset(), readback.first->raw_size(),
+          readback.second->raw_mutable_data(), &compute_events, &event);
+      MACE_CL_RET_STATUS(error);
+      run->events.push_back(event);
+    }
+    error = transfer_queue->flush();
+    MACE_CL_RET_STATUS(error);
+    opencl_runtime->SaveBuiltCLProgram();
+    if (opencl_runtime->tuner() != nullptr) {
+      opencl_runtime->tuner()->FinishRun();
+    }
+  }
+#endif
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngine::Impl::FinishAsyncRun(AsyncRun *run) {
+#ifdef MACE_ENABLE_OPENCL
+  if (device_type_ == GPU) {
+    for (auto &event : run->events) {
+      event.wait();
+    }
+    for (auto &output : *run->outputs) {
+      output.second.impl_->valid =
+          run->skipped_outputs.count(output.first) == 0;
+      if (!output.second.valid()) {
+        continue;
+      }
+      MACE_RETURN_IF_ERROR(TransposeOutput(
+          async_outputs_[run->slot][output.first].get(), &output));
+    }
+    return MaceStatus::MACE_SUCCESS;
+  }
+#endif
+  std::vector<Tensor *> output_tensors;
+  for (auto &output : *run->outputs) {
+    output_tensors.push_back(ws_->GetTensor(output.first));
+  }
+  MaceStatus run_status =
+      ExecuteNet(run->input_tensors, &output_tensors, nullptr);
+  if (run_status != MaceStatus::MACE_SUCCESS) {
+    // the ops which failed to run are run again next time
+    last_inputs_.clear();
+    return run_status;
+  }
+  for (auto &output : *run->outputs) {
+    output.second.impl_->valid = !IsOutputSkipped(output.first);
+    if (!output.second.valid()) {
+      continue;
+    }
+    MACE_RETURN_IF_ERROR(
+        TransposeOutput(ws_->GetTensor(output.first), &output));
+  }
+  return MaceStatus::MACE_SUCCESS;
+}
+
+void MaceEngine::Impl::AsyncLoop() {
+  if (async_priority_ != 0) {
+    utils::SetThreadPriority(async_priority_);
+  }
+  std::unique_lock<std::mutex> lock(async_mutex_);
+  while (true) {
+    async_cond_.wait(lock, [this] {
+      return async_stop_ || !async_queue_.empty();
+    });
+    if (async_queue_.empty()) {
+      return;
+    }
+    AsyncRun *run = async_queue_.front().get();
+    lock.unlock();
+    const int64_t start_micros = NowMicros();
+    MaceStatus status = FinishAsyncRun(run);
+    RecordRunLatency(run->call_micros, start_micros);
+    if (run->callback) {
+      run->callback(status);
+    }
+    run->future->impl_->Finish(status);
+    lock.lock();
+    async_queue_.pop_front();
+    --async_in_flight_;
+    async_cond_.notify_all();
+  }
+}
+
+void MaceEngine::Impl::WaitAsyncRuns() {
+  std::unique_lock<std::mutex> lock(async_mutex_);
+  async_cond_.wait(lock, [this] { return async_in_flight_ == 0; });
+}
+
+MaceStatus MaceEngine::Impl::RunBatch(
+    const std::vector<std::map<std::string, MaceTensor>> &inputs,
+    std::vector<std::map<std::string, MaceTensor>> *outputs) {
+  MACE_CHECK_NOTNULL(outputs);
+  if (inputs.size() != outputs->size()) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      "the number of input and output requests differs");
+  }
+  size_t begin = 0;
+  while (begin < inputs.size()) {
+    int64_t batch = RequestBatchSize(inputs[begin]);
+    size_t end = begin + 1;
+    if (batch > 0) {
+      while (end < inputs.size() &&
+          CanStackRequests(inputs[begin], (*outputs)[begin],
+                           inputs[end], (*outputs)[end])) {
+        int64_t request_batch = RequestBatchSize(inputs[end]);
+        if (request_batch <= 0 || batch + request_batch > max_batch_size_) {
+          break;
+        }
+        batch += request_batch;
+        ++end;
+      }
+    }
+    if (end - begin == 1) {
+      MACE_RETURN_IF_ERROR(Run(inputs[begin], &(*outputs)[begin], nullptr));
+    } else {
+      MACE_RETURN_IF_ERROR(RunStacked(inputs, outputs, begin, end, batch));
+    }
+    begin = end;
+  }
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceEngine::Impl::RunStacked(
+    const std::vector<std::map<std::string, MaceTensor>> &inputs,
+    std::vector<std::map<std::string, MaceTensor>> *outputs,
+    const size_t begin,
+    const size_t end,
+    const int64_t batch) {
+  VLOG(2) << "Stack requests [" << begin << ", " << end
+          << ") to batch " << batch;
+  // stack inputs along N
+  std::map<std::string, MaceTensor> batch_inputs;
+  for (auto &input : inputs[begin]) {
+    std::vector<int64_t> shape = input.second.shape();
+    shape[0] = batch;
+    const int64_t sample_size = ShapeSizeFrom(shape, 1);
+    auto buffer = std::shared_ptr<float>(new float[batch * sample_size],
+                                         std::default_delete<float[]>());
+    float *dst = buffer.get();
+    for (size_t i = begin; i < end; ++i) {
+      const MaceTensor &tensor = inputs[i].at(input.first);
+      const int64_t size = tensor.shape()[0] * sample_size;
+      std::memcpy(dst, tensor.data().get(), size * sizeof(float));
+      dst += size;
+    }
+    batch_inputs[input.first] =
+        MaceTensor(shape, buffer, input.second.data_format());
+  }
+  // output buffer holds all requests' output buffers
+  std::map<std::string, MaceTensor> batch_outputs;
+  for (auto &output : (*outputs)[begin]) {
+    int64_t buffer_size = 0;
+    for (size_t i = begin; i < end; ++i) {
+      buffer_size += (*outputs)[i].at(output.first).impl_->buffer_size;
+    }
+    std::vector<int64_t> shape = output.second.shape();
+    if (!shape.empty()) {
+      shape[0] = batch;
+    }
+    auto buffer = std::shared_ptr<float>(new float[buffer_size],
+                                         std::default_delete<float[]>());
+    MaceTensor tensor(shape, buffer, output.second.data_format());
+    tensor.impl_->buffer_size = buffer_size;
+    batch_outputs[output.first] = tensor;
+  }
+
+  MACE_RETURN_IF_ERROR(Run(batch_inputs, &batch_outputs, nullptr));
+
+  // split outputs along N
+  for (auto &batch_output : batch_outputs) {
+    if (!batch_output.second.valid()) {
+      for (size_t i = begin; i < end; ++i) {
+        (*outputs)[i].at(batch_output.first).impl_->valid = false;
+      }
+      continue;
+    }
+    auto &shape = batch_output.second.shape();
+    if (shape.empty() || shape[0] != batch) {
+      return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                        "output " + batch_output.first +
+                            " has no batch dimension to split");
+    }
+    const int64_t sample_size = ShapeSizeFrom(shape, 1);
+    const float *src = batch_output.second.data().get();
+    for (size_t i = begin; i < end; ++i) {
+      MaceTensor &tensor = (*outputs)[i].at(batch_output.first);
+      std::vector<int64_t> request_shape = shape;
+      request_shape[0] = inputs[i].begin()->second.shape()[0];
+      const int64_t size = request_shape[0] * sample_size;
+      MACE_CHECK(size <= tensor.impl_->buffer_size)
+        << "Output size exceeds buffer size: shape"
+        << MakeString<int64_t>(request_shape) << " vs buffer size "
+        << tensor.impl_->buffer_size;
+      tensor.impl_->shape = request_shape;
+      tensor.impl_->valid = true;
+      std::memcpy(tensor.data().get(), src, size * sizeof(float));
+      src += size;
+    }
+  }
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceEngine::MaceEngine(const MaceEngineConfig &config):
+    impl_(make_unique<MaceEngine::Impl>(
+        std::make_shared<MaceEngineConfig::Impl>(*config.impl_), nullptr)) {}
+
+MaceEngine::~MaceEngine() = default;
+
+MaceStatus MaceEngine::Init(const NetDef *net_def,
+                            const std::vector<std::string> &input_nodes,
+                            const std::vector<std::string> &output_nodes,
+                            const unsigned char *model_data) {
+  return impl_->Init(net_def, input_nodes, output_nodes, model_data);
+}
+
+
+MaceStatus MaceEngine::Init(const NetDef *net_def,
+                            const std::vector<std::string> &input_nodes,
+                            const std::vector<std::string> &output_nodes,
+                            const std::string &model_data_file) {
+  return impl_->Init(net_def, input_nodes, output_nodes, model_data_file);
+}
+
+MaceStatus MaceEngine::LoadNextModel(
+    const NetDef *net_def,
+    const std::vector<std::string> &input_nodes,
+    const std::vector<std::string> &output_nodes,
+    const unsigned char *model_data,
+    std::shared_ptr<RunFuture> *future) {
+  return impl_->LoadNextModel(net_def, input_nodes, output_nodes, model_data,
+                              future);
+}
+
+MaceStatus MaceEngine::WarmUp(const WarmUpOptions &options,
+                              RunCallback callback,
+                              std::shared_ptr<RunFuture> *future) {
+  return impl_->WarmUp(options, callback, future);
+}
+
+void MaceEngine::SwitchToNextModel() {
+  impl_->WaitWarmUp();
+  std::unique_ptr<Impl> next = impl_->TakeNextModel();
+  if (next != nullptr) {
+    // the destruction of the previous version waits for its async runs
+    impl_ = std::move(next);
+  }
 }
 
 MaceStatus MaceEngine::Run(const std::map<std::string, MaceTensor> &inputs,
                            std::map<std::string, MaceTensor> *outputs,
                            RunMetadata *run_metadata) {
+  SwitchToNextModel();
   return impl_->Run(inputs, outputs, run_metadata);
 }
 
-MaceStatus MaceEngine::Run(const std::map<std::string, MaceTensor> &inputs,
-                           std::map<std::string, MaceTensor> *outputs) {
-  return impl_->Run(inputs, outputs, nullptr);
+MaceStatus MaceEngine::Run(const std::map<std::string, MaceTensor> &inputs,
+                           std::map<std::string, MaceTensor> *outputs) {
+  SwitchToNextModel();
+  return impl_->Run(inputs, outputs, nullptr);
+}
+
+MaceStatus MaceEngine::RunBatch(
+    const std::vector<std::map<std::string, MaceTensor>> &inputs,
+    std::vector<std::map<std::string, MaceTensor>> *outputs) {
+  SwitchToNextModel();
+  return impl_->RunBatch(inputs, outputs);
+}
+
+MaceStatus MaceEngine::RunAsync(
+    const std::map<std::string, MaceTensor> &inputs,
+    std::map<std::string, MaceTensor> *outputs,
+    RunCallback callback,
+    std::shared_ptr<RunFuture> *future) {
+  SwitchToNextModel();
+  return impl_->RunAsync(inputs, outputs, callback, future);
+}
+
+MaceStatus MaceEngine::GetOpenCLContext(void **cl_context,
+                                        void **cl_command_queue) {
+  return impl_->GetOpenCLContext(cl_context, cl_command_queue);
+}
+
+MaceStatus MaceEngine::CreateOpenCLImageFromEGLImage(void *egl_display,
+                                                     void *egl_image,
+                                                     void **opencl_image) {
+  return impl_->CreateOpenCLImageFromEGLImage(egl_display, egl_image,
+                                              opencl_image);
+}
+
+MaceStatus MaceEngine::ReleaseOpenCLImage(void *opencl_image) {
+  return impl_->ReleaseOpenCLImage(opencl_image);
+}
+
+MaceStatus MaceEngine::SetEGLSync(void *egl_display, void *egl_sync) {
+  return impl_->SetEGLSync(egl_display, egl_sync);
+}
+
+MaceStatus MaceEngine::ResetStates() {
+  return impl_->ResetStates();
+}
+
+MaceStatus MaceEngine::GetLatencyMetrics(LatencyMetrics *metrics,
+                                         bool reset) {
+  return impl_->GetLatencyMetrics(metrics, reset);
+}
+
+MaceStatus MaceEngine::GetInitStats(InitStats *stats) const {
+  return impl_->GetInitStats(stats);
+}
+
+MaceStatus MaceEngine::GetMemoryStats(EngineMemoryStats *stats) const {
+  return impl_->GetMemoryStats(stats);
+}
+
+MaceStatus MaceEngine::Trim(TrimLevel level) {
+  return impl_->Trim(level);
+}
+
+MaceStatus MaceEngine::ExportMemoryPlan(
+    const unsigned char *model_graph_proto,
+    const size_t model_graph_proto_size,
+    std::vector<unsigned char> *planned_model_graph_proto) const {
+  return impl_->ExportMemoryPlan(model_graph_proto, model_graph_proto_size,
+                                 planned_model_graph_proto);
+}
+
+MaceStatus MaceEngine::SaveSnapshot(const std::string &file_path) const {
+  return impl_->SaveSnapshot(file_path);
+}
+
+MaceStatus MaceEngine::LoadSnapshot(const std::string &file_path,
+                                    NetDef *net_def) {
+  return impl_->LoadSnapshot(file_path, net_def);
+}
+
+MaceStatus MaceEngine::Calibrate(
+    const std::vector<std::map<std::string, MaceTensor>> &dataset,
+    const CalibrationMethod method,
+    const float percentile,
+    const unsigned char *model_graph_proto,
+    const size_t model_graph_proto_size,
+    std::vector<unsigned char> *calibrated_model_graph_proto) {
+  return impl_->Calibrate(dataset, method, percentile, model_graph_proto,
+                          model_graph_proto_size,
+                          calibrated_model_graph_proto);
+}
+
+// Mace Request Batcher
+class MaceRequestBatcher::Impl {
+ public:
+  Impl(std::shared_ptr<MaceEngine> engine,
+       const int max_batch_size,
+       const int64_t timeout_micros);
+  ~Impl();
+
+  MaceStatus Run(const std::map<std::string, MaceTensor> &inputs,
+                 std::map<std::string, MaceTensor> *outputs);
+
+ private:
+  struct Request {
+    const std::map<std::string, MaceTensor> *inputs;
+    std::map<std::string, MaceTensor> *outputs;
+    std::chrono::steady_clock::time_point arrival;
+    MaceStatus status;
+    bool done;
+  };
+
+  void Loop();
+
+ private:
+  std::shared_ptr<MaceEngine> engine_;
+  const size_t max_batch_size_;
+  const std::chrono::microseconds timeout_;
+  std::mutex mutex_;
+  std::condition_variable request_cond_;
+  std::condition_variable done_cond_;
+  std::deque<Request *> queue_;
+  bool stop_;
+  std::thread worker_;
+
+  MACE_DISABLE_COPY_AND_ASSIGN(Impl);
+};
+
+MaceRequestBatcher::Impl::Impl(std::shared_ptr<MaceEngine> engine,
+                               const int max_batch_size,
+                               const int64_t timeout_micros)
+    : engine_(engine),
+      max_batch_size_(static_cast<size_t>(std::max(max_batch_size, 1))),
+      timeout_(std::max<int64_t>(timeout_micros, 0)),
+      stop_(false) {
+  MACE_CHECK_NOTNULL(engine_);
+  worker_ = std::thread(&MaceRequestBatcher::Impl::Loop, this);
+}
+
+MaceRequestBatcher::Impl::~Impl() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  request_cond_.notify_all();
+  worker_.join();
+}
+
+MaceStatus MaceRequestBatcher::Impl::Run(
+    const std::map<std::string, MaceTensor> &inputs,
+    std::map<std::string, MaceTensor> *outputs) {
+  MACE_CHECK_NOTNULL(outputs);
+  Request request = {&inputs, outputs, std::chrono::steady_clock::now(),
+                     MaceStatus::MACE_SUCCESS, false};
+  std::unique_lock<std::mutex> lock(mutex_);
+  queue_.push_back(&request);
+  request_cond_.notify_all();
+  done_cond_.wait(lock, [&request] { return request.done; });
+  return request.status;
+}
+
+void MaceRequestBatcher::Impl::Loop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    request_cond_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+    if (queue_.empty()) {
+      return;
+    }
+    // wait for more requests until the batch is full or the oldest expires
+    request_cond_.wait_until(lock, queue_.front()->arrival + timeout_,
+                             [this] {
+                               return stop_ ||
+                                   queue_.size() >= max_batch_size_;
+                             });
+    const size_t batch = std::min(queue_.size(), max_batch_size_);
+    std::vector<Request *> requests(queue_.begin(), queue_.begin() + batch);
+    queue_.erase(queue_.begin(), queue_.begin() + batch);
+    lock.unlock();
+
+    std::vector<std::map<std::string, MaceTensor>> inputs;
+    std::vector<std::map<std::string, MaceTensor>> outputs;
+    for (auto request : requests) {
+      inputs.push_back(*request->inputs);
+      outputs.push_back(*request->outputs);
+    }
+    MaceStatus status = engine_->RunBatch(inputs, &outputs);
+
+    lock.lock();
+    for (size_t i = 0; i < batch; ++i) {
+      *requests[i]->outputs = outputs[i];
+      requests[i]->status = status;
+      requests[i]->done = true;
+    }
+    done_cond_.notify_all();
+  }
+}
+
+MaceRequestBatcher::MaceRequestBatcher(std::shared_ptr<MaceEngine> engine,
+                                       const int max_batch_size,
+                                       const int64_t timeout_micros)
+    : impl_(make_unique<MaceRequestBatcher::Impl>(engine,
+                                                  max_batch_size,
+                                                  timeout_micros)) {}
+
+MaceRequestBatcher::~MaceRequestBatcher() = default;
+
+MaceStatus MaceRequestBatcher::Run(
+    const std::map<std::string, MaceTensor> &inputs,
+    std::map<std::string, MaceTensor> *outputs) {
+  return impl_->Run(inputs, outputs);
+}
+
+// Mace Pipeline
+class MacePipeline::Impl {
+ public:
+  Impl(const MaceEngineConfig &first_config,
+       const MaceEngineConfig &second_config);
+  ~Impl();
+
+  MaceStatus Init(const NetDef *net_def,
+                  const std::vector<std::string> &input_nodes,
+                  const std::vector<std::string> &output_nodes,
+                  const unsigned char *model_data,
+                  const RunMetadata &first_costs,
+                  const RunMetadata &second_costs);
+
+  MaceStatus Run(const std::map<std::string, MaceTensor> &inputs,
+                 std::map<std::string, MaceTensor> *outputs,
+                 RunCallback callback,
+                 std::shared_ptr<RunFuture> *future);
+
+ private:
+  // boundary tensor sets, one per in-flight input
+  static constexpr int kSlots = 2;
+
+  struct Frame {
+    const std::map<std::string, MaceTensor> *inputs;
+    std::map<std::string, MaceTensor> *outputs;
+    int slot;
+    MaceStatus status;
+    RunCallback callback;
+    std::shared_ptr<RunFuture> future;
+  };
+
+  void StageLoop(int stage);
+  MaceStatus RunStage(int stage, Frame *frame);
+
+ private:
+  std::unique_ptr<MaceEngine> engines_[2];
+  NetPartition partition_;
+  std::map<std::string, MaceTensor> boundary_tensors_[kSlots];
+  int next_slot_;
+  size_t in_flight_;
+  bool stop_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::deque<std::unique_ptr<Frame>> queues_[2];
+  std::vector<std::thread> workers_;
+
+  MACE_DISABLE_COPY_AND_ASSIGN(Impl);
+};
+
+MacePipeline::Impl::Impl(const MaceEngineConfig &first_config,
+                         const MaceEngineConfig &second_config)
+    : next_slot_(0), in_flight_(0), stop_(false) {
+  engines_[0] = make_unique<MaceEngine>(first_config);
+  engines_[1] = make_unique<MaceEngine>(second_config);
+}
+
+MacePipeline::Impl::~Impl() {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait(lock, [this] { return in_flight_ == 0; });
+    stop_ = true;
+  }
+  cond_.notify_all();
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+}
+
+MaceStatus MacePipeline::Impl::Init(
+    const NetDef *net_def,
+    const std::vector<std::string> &input_nodes,
+    const std::vector<std::string> &output_nodes,
+    const unsigned char *model_data,
+    const RunMetadata &first_costs,
+    const RunMetadata &second_costs) {
+  MACE_CHECK_NOTNULL(net_def);
+  MaceStatus partition_status(MaceStatus::MACE_INVALID_ARGS,
+                              "the net could not be cut into two stages");
+  for (int cut : BalancedCuts(*net_def, first_costs, second_costs)) {
+    partition_ = NetPartition();
+    partition_status = PartitionNet(*net_def, input_nodes, output_nodes,
+                                    cut, &partition_);
+    if (partition_status == MaceStatus::MACE_SUCCESS) {
+      VLOG(1) << "Cut the net before operation " << net_def->op(cut).name()
+              << ", boundary tensors: "
+              << MakeString(MapKeys(partition_.boundary));
+      break;
+    }
+  }
+  MACE_RETURN_IF_ERROR(partition_status);
+  for (int stage = 0; stage < 2; ++stage) {
+    MACE_RETURN_IF_ERROR(engines_[stage]->Init(&partition_.nets[stage],
+                                               partition_.inputs[stage],
+                                               partition_.outputs[stage],
+                                               model_data));
+  }
+  for (int slot = 0; slot < kSlots; ++slot) {
+    for (auto &boundary : partition_.boundary) {
+      auto &shape = boundary.second;
+      int64_t size = ShapeSizeFrom(shape, 0);
+      auto buffer = std::shared_ptr<float>(new float[size],
+                                           std::default_delete<float[]>());
+      boundary_tensors_[slot][boundary.first] =
+          MaceTensor(shape, buffer, DataFormat::NHWC);
+    }
+  }
+  for (int stage = 0; stage < 2; ++stage) {
+    workers_.emplace_back(&MacePipeline::Impl::StageLoop, this, stage);
+  }
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MacePipeline::Impl::Run(
+    const std::map<std::string, MaceTensor> &inputs,
+    std::map<std::string, MaceTensor> *outputs,
+    RunCallback callback,
+    std::shared_ptr<RunFuture> *future) {
+  MACE_CHECK_NOTNULL(outputs);
+  if (workers_.empty()) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      "the pipeline is not initialized");
+  }
+  auto frame = make_unique<Frame>();
+  frame->inputs = &inputs;
+  frame->outputs = outputs;
+  frame->status = MaceStatus::MACE_SUCCESS;
+  frame->callback = callback;
+  frame->future = std::make_shared<RunFuture>();
+  if (future != nullptr) {
+    *future = frame->future;
+  }
+  std::unique_lock<std::mutex> lock(mutex_);
+  cond_.wait(lock, [this] { return in_flight_ < kSlots; });
+  frame->slot = next_slot_;
+  next_slot_ = (next_slot_ + 1) % kSlots;
+  ++in_flight_;
+  queues_[0].push_back(std::move(frame));
+  cond_.notify_all();
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MacePipeline::Impl::RunStage(int stage, Frame *frame) {
+  auto &boundary = boundary_tensors_[frame->slot];
+  // the requested model outputs of the first stage are used in place of
+  // boundary tensors, so they are fed to the second stage as well
+  std::map<std::string, MaceTensor> inputs;
+  for (auto &name : partition_.inputs[stage]) {
+    if (frame->inputs->count(name) == 1) {
+      inputs[name] = frame->inputs->at(name);
+    } else if (frame->outputs->count(name) == 1) {
+      inputs[name] = frame->outputs->at(name);
+    } else if (boundary.count(name) == 1) {
+      inputs[name] = boundary.at(name);
+    } else {
+      return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                        "missing input " + name);
+    }
+  }
+  std::map<std::string, MaceTensor> outputs;
+  for (auto &name : partition_.outputs[stage]) {
+    if (frame->outputs->count(name) == 1) {
+      outputs[name] = frame->outputs->at(name);
+    } else if (boundary.count(name) == 1) {
+      outputs[name] = boundary.at(name);
+    }
+  }
+  MACE_RETURN_IF_ERROR(engines_[stage]->Run(inputs, &outputs));
+  // output shapes are updated in the copies
+  for (auto &output : outputs) {
+    if (frame->outputs->count(output.first) == 1) {
+      frame->outputs->at(output.first) = output.second;
+    }
+  }
+  return MaceStatus::MACE_SUCCESS;
+}
+
+void MacePipeline::Impl::StageLoop(int stage) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    cond_.wait(lock, [this, stage] {
+      return stop_ || !queues_[stage].empty();
+    });
+    if (queues_[stage].empty()) {
+      return;
+    }
+    std::unique_ptr<Frame> frame = std::move(queues_[stage].front());
+    queues_[stage].pop_front();
+    lock.unlock();
+    if (frame->status == MaceStatus::MACE_SUCCESS) {
+      frame->status = RunStage(stage, frame.get());
+    }
+    if (stage == 0) {
+      lock.lock();
+      queues_[1].push_back(std::move(frame));
+      cond_.notify_all();
+      continue;
+    }
+    if (frame->callback) {
+      frame->callback(frame->status);
+    }
+    frame->future->impl_->Finish(frame->status);
+    lock.lock();
+    --in_flight_;
+    cond_.notify_all();
+  }
+}
+
+MacePipeline::MacePipeline(const MaceEngineConfig &first_config,
+                           const MaceEngineConfig &second_config)
+    : impl_(make_unique<MacePipeline::Impl>(first_config, second_config)) {}
+
+MacePipeline::~MacePipeline() = default;
+
+MaceStatus MacePipeline::Init(const NetDef *net_def,
+                              const std::vector<std::string> &input_nodes,
+                              const std::vector<std::string> &output_nodes,
+                              const unsigned char *model_data,
+                              const RunMetadata &first_costs,
+                              const RunMetadata &second_costs) {
+  return impl_->Init(net_def, input_nodes, output_nodes, model_data,
+                     first_costs, second_costs);
+}
+
+MaceStatus MacePipeline::Run(const std::map<std::string, MaceTensor> &inputs,
+                             std::map<std::string, MaceTensor> *outputs,
+                             RunCallback callback,
+                             std::shared_ptr<RunFuture> *future) {
+  return impl_->Run(inputs, outputs, callback, future);
+}
+
+// Mace Batch Splitter
+class MaceBatchSplitter::Impl {
+ public:
+  Impl(const MaceEngineConfig &first_config,
+       const MaceEngineConfig &second_config);
+  ~Impl();
+
+  MaceStatus Init(const NetDef *net_def,
+                  const std::vector<std::string> &input_nodes,
+                  const std::vector<std::string> &output_nodes,
+                  const unsigned char *model_data);
+
+  MaceStatus Run(const std::map<std::string, MaceTensor> &inputs,
+                 std::map<std::string, MaceTensor> *outputs);
+
+  float FirstShare() const;
+
+ private:
+  // the engine which ran more samples per second, the first one at first
+  int Faster() const;
+  // the samples of a batch the first engine runs
+  int64_t FirstPart(int64_t batch) const;
+  MaceStatus RunPart(int engine,
+                     const std::map<std::string, MaceTensor> &inputs,
+                     std::map<std::string, MaceTensor> *outputs,
+                     int64_t samples);
+  void Loop();
+
+ private:
+  std::unique_ptr<MaceEngine> engines_[2];
+  // samples per second of each engine, averaged over the runs, 0 until it
+  // has run
+  double throughputs_[2];
+  // the part of the second engine, run by the worker
+  std::function<MaceStatus()> task_;
+  MaceStatus task_status_;
+  bool task_done_;
+  bool stop_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::thread worker_;
+
+  MACE_DISABLE_COPY_AND_ASSIGN(Impl);
+};
+
+namespace {
+// the samples [begin, end) of a float tensor, in the buffer of the tensor
+MaceTensor SliceBatch(const MaceTensor &tensor, int64_t begin, int64_t end) {
+  std::vector<int64_t> shape = tensor.shape();
+  const int64_t sample_size = ShapeSizeFrom(shape, 1);
+  shape[0] = end - begin;
+  std::shared_ptr<float> data(tensor.data(),
+                              tensor.data().get() + begin * sample_size);
+  return MaceTensor(shape, data, tensor.data_format());
+}
+
+bool HasBatch(const std::map<std::string, MaceTensor> &outputs,
+              int64_t batch) {
+  for (auto &output : outputs) {
+    if (output.second.shape().empty() || output.second.data() == nullptr ||
+        output.second.shape()[0] != batch) {
+      return false;
+    }
+  }
+  return true;
+}
+}  // namespace
+
+MaceBatchSplitter::Impl::Impl(const MaceEngineConfig &first_config,
+                              const MaceEngineConfig &second_config)
+    : throughputs_{0, 0}, task_done_(false), stop_(false) {
+  engines_[0] = make_unique<MaceEngine>(first_config);
+  engines_[1] = make_unique<MaceEngine>(second_config);
+}
+
+MaceBatchSplitter::Impl::~Impl() {
+  if (!worker_.joinable()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cond_.notify_all();
+  worker_.join();
+}
+
+MaceStatus MaceBatchSplitter::Impl::Init(
+    const NetDef *net_def,
+    const std::vector<std::string> &input_nodes,
+    const std::vector<std::string> &output_nodes,
+    const unsigned char *model_data) {
+  MACE_CHECK_NOTNULL(net_def);
+  for (auto &engine : engines_) {
+    MACE_RETURN_IF_ERROR(engine->Init(net_def, input_nodes, output_nodes,
+                                      model_data));
+  }
+  if (!worker_.joinable()) {
+    worker_ = std::thread(&MaceBatchSplitter::Impl::Loop, this);
+  }
+  return MaceStatus::MACE_SUCCESS;
+}
+
+int MaceBatchSplitter::Impl::Faster() const {
+  return throughputs_[1] > throughputs_[0] ? 1 : 0;
+}
+
+int64_t MaceBatchSplitter::Impl::FirstPart(int64_t batch) const {
+  if (batch == 1) {
+    return Faster() == 0 ? 1 : 0;
+  }
+  const int64_t part = std::llround(batch * FirstShare());
+  return std::min(std::max<int64_t>(part, 1), batch - 1);
+}
+
+float MaceBatchSplitter::Impl::FirstShare() const {
+  if (throughputs_[0] <= 0 || throughputs_[1] <= 0) {
+    return 0.5f;
+  }
+  return static_cast<float>(throughputs_[0] /
+      (throughputs_[0] + throughputs_[1]));
+}
+
+MaceStatus MaceBatchSplitter::Impl::RunPart(
+    int engine,
+    const std::map<std::string, MaceTensor> &inputs,
+    std::map<std::string, MaceTensor> *outputs,
+    int64_t samples) {
+  const int64_t start_micros = NowMicros();
+  MACE_RETURN_IF_ERROR(engines_[engine]->Run(inputs, outputs));
+  const int64_t micros = std::max<int64_t>(NowMicros() - start_micros, 1);
+  const double throughput = samples * 1e6 / micros;
+  // averaged, a run slowed down by the other work of the device moves the
+  // split by a part
+  throughputs_[engine] = throughputs_[engine] <= 0 ? throughput :
+      0.75 * throughputs_[engine] + 0.25 * throughput;
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus MaceBatchSplitter::Impl::Run(
+    const std::map<std::string, MaceTensor> &inputs,
+    std::map<std::string, MaceTensor> *outputs) {
+  MACE_CHECK_NOTNULL(outputs);
+  if (!worker_.joinable()) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      "the batch splitter is not initialized");
+  }
+  const int64_t batch = RequestBatchSize(inputs);
+  if (batch <= 0 || !HasBatch(*outputs, batch)) {
+    const int engine = Faster();
+    return engines_[engine]->Run(inputs, outputs);
+  }
+  const int64_t first_part = FirstPart(batch);
+  if (first_part == 0 || first_part == batch) {
+    return RunPart(first_part == 0 ? 1 : 0, inputs, outputs, batch);
+  }
+  VLOG(2) << "Split batch " << batch << " into " << first_part << " and "
+          << batch - first_part;
+  std::map<std::string, MaceTensor> part_inputs[2];
+  std::map<std::string, MaceTensor> part_outputs[2];
+  for (auto &input : inputs) {
+    part_inputs[0][input.first] = SliceBatch(input.second, 0, first_part);
+    part_inputs[1][input.first] = SliceBatch(input.second, first_part, batch);
+  }
+  for (auto &output : *outputs) {
+    part_outputs[0][output.first] = SliceBatch(output.second, 0, first_part);
+    part_outputs[1][output.first] =
+        SliceBatch(output.second, first_part, batch);
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    task_ = [this, &part_inputs, &part_outputs, batch, first_part] {
+      return RunPart(1, part_inputs[1], &part_outputs[1], batch - first_part);
+    };
+    task_done_ = false;
+  }
+  cond_.notify_all();
+  MaceStatus run_status = RunPart(0, part_inputs[0], &part_outputs[0],
+                                  first_part);
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait(lock, [this] { return task_done_; });
+    if (run_status == MaceStatus::MACE_SUCCESS) {
+      run_status = task_status_;
+    }
+  }
+  MACE_RETURN_IF_ERROR(run_status);
+
+  for (auto &output : *outputs) {
+    const MaceTensor &first = part_outputs[0].at(output.first);
+    const MaceTensor &second = part_outputs[1].at(output.first);
+    std::vector<int64_t> shape = first.shape();
+    if (shape.empty() || second.shape().size() != shape.size() ||
+        !std::equal(shape.begin() + 1, shape.end(),
+                    second.shape().begin() + 1)) {
+      return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                        "the parts of output " + output.first +
+                            " have other shapes than by batch");
+    }
+    shape[0] = batch;
+    output.second.impl_->shape = shape;
+    output.second.impl_->valid = first.valid() && second.valid();
+  }
+  return MaceStatus::MACE_SUCCESS;
+}
+
+void MaceBatchSplitter::Impl::Loop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    cond_.wait(lock, [this] { return stop_ || task_ != nullptr; });
+    if (task_ == nullptr) {
+      return;
+    }
+    std::function<MaceStatus()> task = std::move(task_);
+    task_ = nullptr;
+    lock.unlock();
+    MaceStatus status = task();
+    lock.lock();
+    task_status_ = status;
+    task_done_ = true;
+    cond_.notify_all();
+  }
+}
+
+MaceBatchSplitter::MaceBatchSplitter(const MaceEngineConfig &first_config,
+                                     const MaceEngineConfig &second_config)
+    : impl_(make_unique<MaceBatchSplitter::Impl>(first_config,
+                                                 second_config)) {}
+
+MaceBatchSplitter::~MaceBatchSplitter() = default;
+
+MaceStatus MaceBatchSplitter::Init(
+    const NetDef *net_def,
+    const std::vector<std::string> &input_nodes,
+    const std::vector<std::string> &output_nodes,
+    const unsigned char *model_data) {
+  return impl_->Init(net_def, input_nodes, output_nodes, model_data);
+}
+
+MaceStatus MaceBatchSplitter::Run(
+    const std::map<std::string, MaceTensor> &inputs,
+    std::map<std::string, MaceTensor> *outputs) {
+  return impl_->Run(inputs, outputs);
+}
+
+float MaceBatchSplitter::FirstShare() const {
+  return impl_->FirstShare();
 }
 
 MaceStatus CreateMaceEngineFromProto(
@@ -784,6 +5858,34 @@ MaceStatus CreateMaceEngineFromProto(
   return status;
 }
 
+MaceStatus CreateMaceEngineFromSnapshot(
+    const std::string &snapshot_file,
+    const unsigned char *model_graph_proto,
+    const size_t model_graph_proto_size,
+    const unsigned char *model_weights_data,
+    const size_t model_weights_data_size,
+    const std::vector<std::string> &input_nodes,
+    const std::vector<std::string> &output_nodes,
+    const MaceEngineConfig &config,
+    std::shared_ptr<MaceEngine> *engine) {
+  MACE_UNUSED(model_weights_data_size);
+  LOG(INFO) << "Create MaceEngine from model graph proto, weights data and"
+            << " snapshot " << snapshot_file;
+
+  if (engine == nullptr) {
+    return MaceStatus::MACE_INVALID_ARGS;
+  }
+
+  auto net_def = std::make_shared<NetDef>();
+  net_def->ParseFromArray(model_graph_proto, model_graph_proto_size);
+
+  engine->reset(new mace::MaceEngine(config));
+  MACE_RETURN_IF_ERROR((*engine)->LoadSnapshot(snapshot_file,
+                                               net_def.get()));
+  return (*engine)->Init(
+      net_def.get(), input_nodes, output_nodes, model_weights_data);
+}
+
 // Deprecated, will be removed in future version.
 MaceStatus CreateMaceEngineFromProto(
     const std::vector<unsigned char> &model_pb,
@@ -809,4 +5911,48 @@ MaceStatus CreateMaceEngineFromProto(
   return status;
 }
 
+std::shared_ptr<ModelWeights> NewModelWeights(
+    const unsigned char *model_weights_data,
+    const size_t model_weights_data_size) {
+  return std::make_shared<ModelWeights>(model_weights_data,
+                                        model_weights_data_size);
+}
+
+std::shared_ptr<float> NewHexagonBuffer(size_t nbytes) {
+#ifdef MACE_ENABLE_HEXAGON
+  Allocator *allocator = GetHexagonAllocator();
+#else
+  Allocator *allocator = GetCPUAllocator();
+#endif  // MACE_ENABLE_HEXAGON
+  void *data = nullptr;
+  if (allocator->New(nbytes, &data) != MaceStatus::MACE_SUCCESS ||
+      data == nullptr) {
+    return nullptr;
+  }
+  return std::shared_ptr<float>(static_cast<float *>(data),
+                                [allocator](float *data) {
+                                  allocator->Delete(data);
+                                });
+}
+
+MaceStatus RegisterHexagonBuffer(void *data, size_t nbytes, int fd) {
+#ifdef MACE_ENABLE_HEXAGON
+  return GetHexagonAllocator()->Register(data, nbytes, fd);
+#else
+  MACE_UNUSED(data);
+  MACE_UNUSED(nbytes);
+  MACE_UNUSED(fd);
+  return MaceStatus(MaceStatus::MACE_OUT_OF_RESOURCES,
+                    "HEXAGON is not enabled");
+#endif  // MACE_ENABLE_HEXAGON
+}
+
+void UnregisterHexagonBuffer(void *data) {
+#ifdef MACE_ENABLE_HEXAGON
+  GetHexagonAllocator()->Unregister(data);
+#else
+  MACE_UNUSED(data);
+#endif  // MACE_ENABLE_HEXAGON
+}
+
 }  // namespace mace
@@ -36,6 +36,12 @@ def if_arm_linux_armhf(a):
       "//conditions:default": []
   })
 
+def if_x86_64(a):
+  return select({
+      "//mace:x86_64": a,
+      "//conditions:default": [],
+  })
+
 def if_neon_enabled(a):
   return select({
       "//mace:neon_enabled": a,
@@ -48,6 +54,24 @@ def if_neon_enabled_str(a):
       "//conditions:default": "",
   })
 
+def if_fp16_neon_enabled(a):
+  return select({
+      "//mace:fp16_neon_enabled": a,
+      "//conditions:default": [],
+  })
+
+def if_fp16_neon_enabled_str(a):
+  return select({
+      "//mace:fp16_neon_enabled": a,
+      "//conditions:default": "",
+  })
+
+def if_not_fp16_neon_enabled(a):
+  return select({
+      "//mace:fp16_neon_enabled": [],
+      "//conditions:default": a,
+  })
+
 def if_hexagon_enabled(a):
   return select({
       "//mace:hexagon_enabled": a,
@@ -84,6 +108,18 @@ def if_quantize_enabled(a):
       "//conditions:default": [],
   })
 
+def if_quantize_enabled_str(a):
+  return select({
+      "//mace:quantize_enabled": a,
+      "//conditions:default": "",
+  })
+
+def if_selective_build_enabled(a):
+  return select({
+      "//mace:selective_build_enabled": a,
+      "//conditions:default": [],
+  })
+
 def mace_version_genrule():
   native.genrule(
       name = "mace_version_gen",
@@ -18,10 +18,20 @@
 
 #include "mace/core/operator.h"
 
+#ifdef MACE_ENABLE_QUANTIZE
+#include "mace/ops/common/lookup_table.h"
+#ifdef MACE_ENABLE_NEON
+#include "mace/ops/arm/q8/lookup_table.h"
+#endif  // MACE_ENABLE_NEON
+#endif  // MACE_ENABLE_QUANTIZE
 #ifdef MACE_ENABLE_OPENCL
 #include "mace/ops/opencl/buffer_transformer.h"
+#include "mace/ops/opencl/buffer/activation.h"
 #include "mace/ops/opencl/image/activation.h"
 #endif  // MACE_ENABLE_OPENCL
+#ifdef MACE_ENABLE_FP16_NEON
+#include "mace/ops/arm/fp16/activation.h"
+#endif  // MACE_ENABLE_FP16_NEON
 #include "mace/utils/memory.h"
 
 namespace mace {
@@ -66,12 +76,115 @@ class ActivationOp<DeviceType::CPU, float> : public Operation {
     return MaceStatus::MACE_SUCCESS;
   }
 
+  int InplaceInputIndex() const override { return 0; }
+
+ private:
+  ActivationType activation_;
+  float relux_max_limit_;
+  float leakyrelu_coefficient_;
+};
+
+#ifdef MACE_ENABLE_FP16_NEON
+template <>
+class ActivationOp<DeviceType::CPU, half> : public Operation {
+ public:
+  explicit ActivationOp(OpConstructContext *context)
+      : Operation(context),
+        activation_(ops::StringToActivationType(
+            Operation::GetOptionalArg<std::string>("activation",
+                                                   "NOOP"))),
+        relux_max_limit_(Operation::GetOptionalArg<float>("max_limit",
+                                                          0.0f)),
+        leakyrelu_coefficient_(Operation::GetOptionalArg<float>(
+              "leakyrelu_coefficient", 0.0f)) {}
+
+  MaceStatus Run(OpContext *context) override {
+    MACE_UNUSED(context);
+    const Tensor *input = this->Input(0);
+    Tensor *output = this->Output(0);
+    MACE_RETURN_IF_ERROR(output->ResizeLike(input));
+
+    const half *input_ptr = input->data<half>();
+    half *output_ptr = output->mutable_data<half>();
+    if (activation_ == PRELU) {
+      MACE_CHECK(this->InputSize() > 1);
+      const Tensor *alpha = this->Input(1);
+      arm::fp16::BiasActivation(input_ptr, nullptr,
+                                alpha->data<half>(),
+                                output->dim(0), output->dim(1),
+                                output->dim(2) * output->dim(3),
+                                activation_, relux_max_limit_,
+                                leakyrelu_coefficient_, output_ptr);
+    } else {
+      arm::fp16::BiasActivation(input_ptr, nullptr, nullptr,
+                                1, 1, output->size(),
+                                activation_, relux_max_limit_,
+                                leakyrelu_coefficient_, output_ptr);
+    }
+    return MaceStatus::MACE_SUCCESS;
+  }
+
+  int InplaceInputIndex() const override { return 0; }
+
  private:
   ActivationType activation_;
   float relux_max_limit_;
   float leakyrelu_coefficient_;
 };
+#endif  // MACE_ENABLE_FP16_NEON
 
+#ifdef MACE_ENABLE_QUANTIZE
+// Any activation of uint8 values is a lookup of the 256 float activations
+// of their real values, quantized by the output.
+template <>
+class ActivationOp<DeviceType::CPU, uint8_t> : public Operation {
+ public:
+  explicit ActivationOp(OpConstructContext *context)
+      : Operation(context),
+        activation_(ops::StringToActivationType(
+            Operation::GetOptionalArg<std::string>("activation",
+                                                   "NOOP"))),
+        relux_max_limit_(Operation::GetOptionalArg<float>("max_limit",
+                                                          0.0f)),
+        leakyrelu_coefficient_(Operation::GetOptionalArg<float>(
+              "leakyrelu_coefficient", 0.0f)) {
+    MACE_CHECK(activation_ != PRELU,
+               "Quantized Activation does not support PRELU");
+  }
+
+  MaceStatus Run(OpContext *context) override {
+    MACE_UNUSED(context);
+    const Tensor *input = this->Input(0);
+    Tensor *output = this->Output(0);
+    MACE_RETURN_IF_ERROR(output->ResizeLike(input));
+
+    // the scales are known at run time only for the inputs quantized then
+    table_.Update(input, output, [this](float *values) {
+      DoActivation(values, values, QuantizedLookupTable::kSize, activation_,
+                   relux_max_limit_, leakyrelu_coefficient_);
+    });
+
+    Tensor::MappingGuard input_guard(input);
+    Tensor::MappingGuard output_guard(output);
+    const uint8_t *input_ptr = input->data<uint8_t>();
+    uint8_t *output_ptr = output->mutable_data<uint8_t>();
+#ifdef MACE_ENABLE_NEON
+    arm::q8::LookupTable(table_.data(), input_ptr, input->size(), output_ptr);
+#else
+    table_.Lookup(input_ptr, input->size(), output_ptr);
+#endif  // MACE_ENABLE_NEON
+    return MaceStatus::MACE_SUCCESS;
+  }
+
+  int InplaceInputIndex() const override { return 0; }
+
+ private:
+  ActivationType activation_;
+  float relux_max_limit_;
+  float leakyrelu_coefficient_;
+  QuantizedLookupTable table_;
+};
+#endif  // MACE_ENABLE_QUANTIZE
 
 #ifdef MACE_ENABLE_OPENCL
 template <typename T>
@@ -92,7 +205,10 @@ class ActivationOp<DeviceType::GPU, T> : public Operation {
       kernel_ = make_unique<opencl::image::ActivationKernel<T>>(
           type, relux_max_limit, leakyrelu_coefficient);
     } else {
-      MACE_NOT_IMPLEMENTED;
+      mem_type = MemoryType::GPU_BUFFER;
+      context->set_output_mem_type(mem_type);
+      kernel_ = make_unique<opencl::buffer::ActivationKernel<T>>(
+          type, relux_max_limit, leakyrelu_coefficient);
     }
     if (type == ActivationType::PRELU) {
       MACE_CHECK(TransformFilter<T>(
@@ -119,6 +235,16 @@ void RegisterActivation(OpRegistryBase *op_registry) {
   MACE_REGISTER_OP(op_registry, "Activation", ActivationOp,
                    DeviceType::CPU, float);
 
+#ifdef MACE_ENABLE_FP16_NEON
+  MACE_REGISTER_OP(op_registry, "Activation", ActivationOp,
+                   DeviceType::CPU, half);
+#endif  // MACE_ENABLE_FP16_NEON
+
+#ifdef MACE_ENABLE_QUANTIZE
+  MACE_REGISTER_OP(op_registry, "Activation", ActivationOp,
+                   DeviceType::CPU, uint8_t);
+#endif  // MACE_ENABLE_QUANTIZE
+
 #ifdef MACE_ENABLE_OPENCL
   MACE_REGISTER_OP(op_registry, "Activation", ActivationOp,
                    DeviceType::GPU, float);
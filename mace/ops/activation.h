@@ -42,6 +42,8 @@ inline ActivationType StringToActivationType(const std::string type) {
     return ActivationType::NOOP;
   } else if (type == "LEAKYRELU") {
     return ActivationType ::LEAKYRELU;
+  } else if (type == "GELU") {
+    return ActivationType::GELU;
   } else {
     LOG(FATAL) << "Unknown activation type: " << type;
   }
@@ -92,6 +94,14 @@ void DoActivation(const T *input_ptr,
           + leakyrelu_coefficient * std::min(input_ptr[i], static_cast<T>(0));
       }
       break;
+    case GELU:
+#pragma omp parallel for schedule(runtime)
+      for (index_t i = 0; i < size; ++i) {
+        const float x = input_ptr[i];
+        output_ptr[i] = 0.5f * x * (1.f + std::tanh(
+            0.7978845608f * (x + 0.044715f * x * x * x)));
+      }
+      break;
     default:
       LOG(FATAL) << "Unknown activation type: " << type;
   }
@@ -114,20 +124,17 @@ inline void DoActivation(const float *input_ptr,
       ReluxNeon(input_ptr, relux_max_limit, size, output_ptr);
       break;
     case TANH:
-#pragma omp parallel for schedule(runtime)
-      for (index_t i = 0; i < size; ++i) {
-        output_ptr[i] = std::tanh(input_ptr[i]);
-      }
+      TanhNeon(input_ptr, size, output_ptr);
       break;
     case SIGMOID:
-#pragma omp parallel for schedule(runtime)
-      for (index_t i = 0; i < size; ++i) {
-        output_ptr[i] = 1 / (1 + std::exp(-input_ptr[i]));
-      }
+      SigmoidNeon(input_ptr, size, output_ptr);
       break;
     case LEAKYRELU:
       LeakyReluNeon(input_ptr, leakyrelu_coefficient, size, output_ptr);
       break;
+    case GELU:
+      GeluNeon(input_ptr, size, output_ptr);
+      break;
     default:
       LOG(FATAL) << "Unknown activation type: " << type;
   }
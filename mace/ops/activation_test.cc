@@ -12,6 +12,8 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <string>
+
 #include "mace/ops/ops_test_util.h"
 
 namespace mace {
@@ -306,6 +308,112 @@ TEST_F(ActivationOpTest, OPENCLSimpleSigmoid) {
   TestSimpleSigmoid<DeviceType::GPU>();
 }
 
+namespace {
+template <DeviceType D>
+void TestSimpleGelu() {
+  OpsTestNet net;
+
+  // Add input data
+  net.AddInputFromArray<D, float>(
+      "Input", {2, 2, 2, 2},
+      {-7, 7, -6, 6, -5, 5, -4, 4, -3, 3, -2, 2, -1, 1, 0, 0.5});
+
+  OpDefBuilder("Activation", "GeluTest")
+      .Input("Input")
+      .Output("Output")
+      .AddStringArg("activation", "GELU")
+      .Finalize(net.NewOperatorDef());
+
+  // Run
+  net.RunOp(D);
+
+  // 0.5 * x * (1 + tanh(sqrt(2 / pi) * (x + 0.044715 * x^3)))
+  auto expected = net.CreateTensor<float>(
+      {2, 2, 2, 2},
+      {-2.3314684e-15, 7, -8.439649e-11, 6, -2.2917962e-07, 4.9999998,
+       -7.0245948e-05, 3.9999298, -0.0036373921, 2.9963626, -0.045402306,
+       1.9545977, -0.15880801, 0.84119199, 0, 0.34571401});
+
+  ExpectTensorNear<float>(*expected, *net.GetOutput("Output"), 1e-4, 1e-6);
+}
+}  // namespace
+
+TEST_F(ActivationOpTest, CPUSimpleGelu) {
+  TestSimpleGelu<DeviceType::CPU>();
+}
+
+TEST_F(ActivationOpTest, OPENCLSimpleGelu) {
+  TestSimpleGelu<DeviceType::GPU>();
+}
+
+namespace {
+void TestQuantized(const std::string &activation) {
+  OpsTestNet net;
+  net.AddRandomInput<DeviceType::CPU, float>("Input", {3, 17, 19, 21}, false,
+                                             false, true);
+
+  OpDefBuilder("Activation", "ActivationTest")
+      .Input("Input")
+      .Output("Output")
+      .AddStringArg("activation", activation.c_str())
+      .AddFloatArg("max_limit", 0.5f)
+      .AddFloatArg("leakyrelu_coefficient", 0.1f)
+      .Finalize(net.NewOperatorDef());
+  net.RunOp();
+
+  OpDefBuilder("Quantize", "QuantizeInput")
+      .Input("Input")
+      .Output("QuantizedInput")
+      .OutputType({DT_UINT8})
+      .AddIntArg("T", DT_UINT8)
+      .Finalize(net.NewOperatorDef());
+  net.RunOp();
+  OpDefBuilder("Quantize", "QuantizeOutput")
+      .Input("Output")
+      .Output("ExpectedQuantizedOutput")
+      .OutputType({DT_UINT8})
+      .AddIntArg("T", DT_UINT8)
+      .Finalize(net.NewOperatorDef());
+  net.RunOp();
+
+  OpDefBuilder("Activation", "QuantizeActivationTest")
+      .Input("QuantizedInput")
+      .Output("QuantizedOutput")
+      .AddStringArg("activation", activation.c_str())
+      .AddFloatArg("max_limit", 0.5f)
+      .AddFloatArg("leakyrelu_coefficient", 0.1f)
+      .OutputType({DT_UINT8})
+      .AddIntArg("T", DT_UINT8)
+      .Finalize(net.NewOperatorDef());
+  net.Setup(DeviceType::CPU);
+  Tensor *eq_output = net.GetTensor("ExpectedQuantizedOutput");
+  Tensor *q_output = net.GetTensor("QuantizedOutput");
+  q_output->SetScale(eq_output->scale());
+  q_output->SetZeroPoint(eq_output->zero_point());
+  net.Run();
+
+  OpDefBuilder("Dequantize", "DeQuantizeTest")
+      .Input("QuantizedOutput")
+      .Output("DequantizedOutput")
+      .OutputType({DT_FLOAT})
+      .AddIntArg("T", DT_UINT8)
+      .Finalize(net.NewOperatorDef());
+  net.RunOp();
+
+  // the input and the output both lose half a step of their quantization
+  ExpectTensorSimilar<float>(*net.GetOutput("Output"),
+                             *net.GetTensor("DequantizedOutput"), 0.01);
+}
+}  // namespace
+
+TEST_F(ActivationOpTest, QuantizeTest) {
+  TestQuantized("SIGMOID");
+  TestQuantized("TANH");
+  TestQuantized("RELUX");
+  TestQuantized("LEAKYRELU");
+  TestQuantized("GELU");
+}
+
 }  // namespace test
 }  // namespace ops
 }  // namespace mace
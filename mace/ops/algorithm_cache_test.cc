@@ -0,0 +1,160 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "mace/core/algorithm_cache.h"
+#include "mace/ops/ops_test_util.h"
+
+namespace mace {
+namespace ops {
+namespace test {
+
+class AlgorithmCacheTest : public OpsTestBase {
+ protected:
+  void SetUp() override {
+    const char *storage_path = getenv("MACE_INTERNAL_STORAGE_PATH");
+    file_path_ = std::string(storage_path == nullptr ? "." : storage_path) +
+        "/algorithm_cache_test.bin";
+    std::remove(file_path_.c_str());
+  }
+
+  void TearDown() override {
+    std::remove(file_path_.c_str());
+  }
+
+  // two algorithms flushed to the file
+  void WriteCache() {
+    AlgorithmCache cache(file_path_);
+    EXPECT_TRUE(cache.tuning());
+    cache.Insert("Conv2D/a", 2);
+    cache.Insert("Conv2D/b", 3);
+    cache.Flush();
+  }
+
+  std::string ReadFile() {
+    std::ifstream file(file_path_, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file),
+                       std::istreambuf_iterator<char>());
+  }
+
+  void WriteFile(const std::string &data) {
+    std::ofstream file(file_path_, std::ios::binary | std::ios::trunc);
+    file.write(data.data(), data.size());
+  }
+
+  std::string file_path_;
+};
+
+TEST_F(AlgorithmCacheTest, Reload) {
+  WriteCache();
+  AlgorithmCache cache(file_path_);
+  int algorithm = -1;
+  ASSERT_TRUE(cache.Find("Conv2D/a", &algorithm));
+  EXPECT_EQ(2, algorithm);
+  ASSERT_TRUE(cache.Find("Conv2D/b", &algorithm));
+  EXPECT_EQ(3, algorithm);
+  EXPECT_FALSE(cache.Find("Conv2D/c", &algorithm));
+}
+
+TEST_F(AlgorithmCacheTest, NoFile) {
+  AlgorithmCache cache;
+  EXPECT_FALSE(cache.tuning());
+  cache.Insert("Conv2D/a", 2);
+  // nothing is written without a file
+  cache.Flush();
+  int algorithm = -1;
+  ASSERT_TRUE(cache.Find("Conv2D/a", &algorithm));
+  EXPECT_EQ(2, algorithm);
+}
+
+TEST_F(AlgorithmCacheTest, CorruptEntry) {
+  WriteCache();
+  std::string data = ReadFile();
+  const size_t key = data.find("Conv2D/a");
+  ASSERT_NE(std::string::npos, key);
+  // the first byte of the value, which follows the key
+  data[key + 8] ^= 0x5a;
+  WriteFile(data);
+
+  AlgorithmCache cache(file_path_);
+  int algorithm = -1;
+  EXPECT_FALSE(cache.Find("Conv2D/a", &algorithm));
+  ASSERT_TRUE(cache.Find("Conv2D/b", &algorithm));
+  EXPECT_EQ(3, algorithm);
+}
+
+TEST_F(AlgorithmCacheTest, TruncatedFile) {
+  WriteCache();
+  const std::string data = ReadFile();
+  for (size_t size : {data.size() - 1, data.size() / 2, size_t(12)}) {
+    WriteFile(data.substr(0, size));
+    AlgorithmCache cache(file_path_);
+    int algorithm = -1;
+    EXPECT_FALSE(cache.Find("Conv2D/b", &algorithm)) << size;
+  }
+}
+
+TEST_F(AlgorithmCacheTest, StaleVersion) {
+  WriteCache();
+  std::string data = ReadFile();
+  // the version follows the magic of 8 bytes
+  data[8] += 1;
+  WriteFile(data);
+
+  AlgorithmCache cache(file_path_);
+  int algorithm = -1;
+  EXPECT_FALSE(cache.Find("Conv2D/a", &algorithm));
+  EXPECT_FALSE(cache.Find("Conv2D/b", &algorithm));
+}
+
+TEST_F(AlgorithmCacheTest, NotACache) {
+  // 16 entries of the unversioned format, the first key past the end
+  const char key_past_end[] = "\x10\0\0\0\0\0\0\0\xff\xff\0\0";
+  // too short, no entries, and a key past the end
+  for (const std::string &data : {std::string("garbage"),
+                                  std::string(32, '\0'),
+                                  std::string(key_past_end, 12)}) {
+    WriteFile(data);
+    AlgorithmCache cache(file_path_);
+    int algorithm = -1;
+    EXPECT_FALSE(cache.Find("Conv2D/a", &algorithm));
+    // the file is replaced on flush
+    cache.Insert("Conv2D/a", 1);
+    cache.Flush();
+    AlgorithmCache reloaded(file_path_);
+    ASSERT_TRUE(reloaded.Find("Conv2D/a", &algorithm));
+    EXPECT_EQ(1, algorithm);
+  }
+}
+
+TEST_F(AlgorithmCacheTest, WrongValueSize) {
+  // an entry of another storage under the same key
+  FileStorage storage(file_path_);
+  storage.Insert("Conv2D/a", {1, 2});
+  storage.Flush();
+
+  AlgorithmCache cache(file_path_);
+  int algorithm = -1;
+  EXPECT_FALSE(cache.Find("Conv2D/a", &algorithm));
+}
+
+}  // namespace test
+}  // namespace ops
+}  // namespace mace
@@ -0,0 +1,271 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/ops/aot_net.h"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <numeric>
+
+#include "mace/ops/activation.h"
+#include "mace/ops/common/transpose.h"
+
+namespace mace {
+namespace ops {
+
+AotNet::AotNet(int num_threads,
+               const unsigned char *model_data,
+               index_t model_data_size,
+               index_t arena_size,
+               int num_tensors)
+    : device_(num_threads, CPUAffinityPolicy::AFFINITY_NONE, false),
+      context_(&ws_, &device_),
+      model_buffer_(GetCPUAllocator(),
+                    const_cast<unsigned char *>(model_data),
+                    model_data_size),
+      arena_(GetCPUAllocator()),
+      tensors_(num_tensors) {
+  MACE_CHECK(arena_.Allocate(arena_size) == MaceStatus::MACE_SUCCESS,
+             "failed to allocate the arena of ", arena_size, " bytes");
+}
+
+void AotNet::AddWeight(int id,
+                       index_t offset,
+                       const std::vector<index_t> &shape) {
+  std::unique_ptr<Tensor> tensor(new Tensor(
+      BufferSlice(&model_buffer_, offset,
+                  std::accumulate(shape.begin(), shape.end(), 1,
+                                  std::multiplies<index_t>()) *
+                      sizeof(float)),
+      DT_FLOAT, true));
+  tensor->Reshape(shape);
+  tensors_[id] = std::move(tensor);
+}
+
+void AotNet::AddActivation(int id,
+                           index_t offset,
+                           index_t size,
+                           const std::vector<index_t> &shape) {
+  std::unique_ptr<Tensor> tensor(new Tensor(
+      BufferSlice(&arena_, offset, size), DT_FLOAT));
+  tensor->Reshape(shape);
+  tensors_[id] = std::move(tensor);
+}
+
+void AotNet::AddAlias(int id, int src_id, const std::vector<index_t> &shape) {
+  const Tensor *src = tensors_[src_id].get();
+  std::unique_ptr<Tensor> tensor(new Tensor(
+      BufferSlice(src->UnderlyingBuffer(), 0, src->UnderlyingBuffer()->size()),
+      DT_FLOAT));
+  tensor->Reshape(shape);
+  tensors_[id] = std::move(tensor);
+}
+
+MaceStatus AotNet::FeedInput(const MaceTensor &input,
+                             DataFormat model_format,
+                             int id) {
+  Tensor *tensor = tensors_[id].get();
+  const std::vector<int64_t> &shape = input.shape();
+  Tensor::MappingGuard guard(tensor);
+  float *data = tensor->mutable_data<float>();
+  if (shape.size() == 4 && model_format != DataFormat::DF_NONE) {
+    std::vector<int> dst_dims = {0, 1, 2, 3};
+    if (input.data_format() == DataFormat::NHWC) {
+      dst_dims = {0, 3, 1, 2};
+    }
+    const std::vector<index_t> nchw_shape =
+        TransposeShape<int64_t, index_t>(shape, dst_dims);
+    if (nchw_shape != tensor->shape()) {
+      return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                        "input shape " + MakeString(shape) +
+                            " is not the one of the compiled model");
+    }
+    return Transpose(input.data().get(), shape, dst_dims, data);
+  }
+  if (std::vector<index_t>(shape.begin(), shape.end()) != tensor->shape()) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      "input shape " + MakeString(shape) +
+                          " is not the one of the compiled model");
+  }
+  memcpy(data, input.data().get(), tensor->size() * sizeof(float));
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus AotNet::FetchOutput(int id,
+                               DataFormat model_format,
+                               MaceTensor *output) {
+  const Tensor *tensor = tensors_[id].get();
+  const std::vector<int64_t> &shape = output->shape();
+  const std::vector<index_t> &tensor_shape = tensor->shape();
+  Tensor::MappingGuard guard(tensor);
+  const float *data = tensor->data<float>();
+  if (tensor_shape.size() == 4 && model_format != DataFormat::DF_NONE) {
+    std::vector<int> dst_dims = {0, 1, 2, 3};
+    if (output->data_format() == DataFormat::NHWC) {
+      dst_dims = {0, 2, 3, 1};
+    }
+    if (TransposeShape<index_t, int64_t>(tensor_shape, dst_dims) != shape) {
+      return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                        "output shape " + MakeString(shape) +
+                            " is not the one of the compiled model");
+    }
+    return Transpose(data, std::vector<int64_t>(tensor_shape.begin(),
+                                                tensor_shape.end()),
+                     dst_dims, output->data().get());
+  }
+  if (std::vector<index_t>(shape.begin(), shape.end()) != tensor_shape) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      "output shape " + MakeString(shape) +
+                          " is not the one of the compiled model");
+  }
+  memcpy(output->data().get(), data, tensor->size() * sizeof(float));
+  return MaceStatus::MACE_SUCCESS;
+}
+
+AotConv2d::AotConv2d(int kernel_h, int kernel_w, int pad_h, int pad_w,
+                     int stride_h, int stride_w, int dilation_h,
+                     int dilation_w, ActivationType activation,
+                     float relux_max_limit, float leakyrelu_coefficient)
+    : is_1x1_(kernel_h == 1 && kernel_w == 1 && pad_h == 0 && pad_w == 0 &&
+              stride_h == 1 && stride_w == 1 && dilation_h == 1 &&
+              dilation_w == 1),
+      ref_conv2d_(pad_h, pad_w, stride_h, stride_w, dilation_h, dilation_w),
+      activation_(activation),
+      relux_max_limit_(relux_max_limit),
+      leakyrelu_coefficient_(leakyrelu_coefficient) {}
+
+MaceStatus AotConv2d::Compute(const OpContext *context,
+                              const Tensor *input,
+                              const Tensor *filter,
+                              const Tensor *bias,
+                              Tensor *output) {
+#ifdef MACE_ENABLE_NEON
+  if (is_1x1_) {
+    MACE_RETURN_IF_ERROR(
+        conv2d_1x1_.Compute(context, input, filter, output));
+  } else {
+    MACE_RETURN_IF_ERROR(
+        ref_conv2d_.Compute(context, input, filter, output));
+  }
+#else
+  MACE_RETURN_IF_ERROR(ref_conv2d_.Compute(context, input, filter, output));
+#endif
+  if (bias != nullptr) {
+    MACE_RETURN_IF_ERROR(AotBiasAdd(output, bias, output));
+  }
+  return AotActivation(output, activation_, relux_max_limit_,
+                       leakyrelu_coefficient_, output);
+}
+
+MaceStatus AotBiasAdd(const Tensor *input, const Tensor *bias,
+                      Tensor *output) {
+  const index_t channel_axis = input->dim_size() == 4 ? 1 :
+                               input->dim_size() - 1;
+  const index_t channels = input->dim(channel_axis);
+  const index_t outer = std::accumulate(
+      input->shape().begin(), input->shape().begin() + channel_axis, 1,
+      std::multiplies<index_t>());
+  const index_t inner = input->size() / outer / channels;
+  Tensor::MappingGuard input_guard(input);
+  Tensor::MappingGuard bias_guard(bias);
+  Tensor::MappingGuard output_guard(output);
+  const float *input_data = input->data<float>();
+  const float *bias_data = bias->data<float>();
+  float *output_data = output->mutable_data<float>();
+#pragma omp parallel for collapse(2) schedule(runtime)
+  for (index_t i = 0; i < outer; ++i) {
+    for (index_t c = 0; c < channels; ++c) {
+      const index_t base = (i * channels + c) * inner;
+      for (index_t j = 0; j < inner; ++j) {
+        output_data[base + j] = input_data[base + j] + bias_data[c];
+      }
+    }
+  }
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus AotActivation(const Tensor *input,
+                         ActivationType activation,
+                         float relux_max_limit,
+                         float leakyrelu_coefficient,
+                         Tensor *output) {
+  if (activation == NOOP) {
+    if (input != output) {
+      output->Copy(*input);
+    }
+    return MaceStatus::MACE_SUCCESS;
+  }
+  Tensor::MappingGuard input_guard(input);
+  Tensor::MappingGuard output_guard(output);
+  DoActivation(input->data<float>(), output->mutable_data<float>(),
+               input->size(), activation, relux_max_limit,
+               leakyrelu_coefficient);
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus AotEltwise(EltwiseType type,
+                      const Tensor *input0,
+                      const Tensor *input1,
+                      Tensor *output) {
+  MACE_CHECK(input0->shape() == input1->shape(),
+             "compiled eltwise ops need inputs of the same shape");
+  Tensor::MappingGuard input0_guard(input0);
+  Tensor::MappingGuard input1_guard(input1);
+  Tensor::MappingGuard output_guard(output);
+  const float *in0 = input0->data<float>();
+  const float *in1 = input1->data<float>();
+  float *out = output->mutable_data<float>();
+  const index_t size = input0->size();
+  switch (type) {
+    case SUM:
+#pragma omp parallel for schedule(runtime)
+      for (index_t i = 0; i < size; ++i) {
+        out[i] = in0[i] + in1[i];
+      }
+      break;
+    case SUB:
+#pragma omp parallel for schedule(runtime)
+      for (index_t i = 0; i < size; ++i) {
+        out[i] = in0[i] - in1[i];
+      }
+      break;
+    case PROD:
+#pragma omp parallel for schedule(runtime)
+      for (index_t i = 0; i < size; ++i) {
+        out[i] = in0[i] * in1[i];
+      }
+      break;
+    case MIN:
+#pragma omp parallel for schedule(runtime)
+      for (index_t i = 0; i < size; ++i) {
+        out[i] = std::min(in0[i], in1[i]);
+      }
+      break;
+    case MAX:
+#pragma omp parallel for schedule(runtime)
+      for (index_t i = 0; i < size; ++i) {
+        out[i] = std::max(in0[i], in1[i]);
+      }
+      break;
+    default:
+      return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                        MakeString("compiled eltwise type ", type,
+                                   " is not supported"));
+  }
+  return MaceStatus::MACE_SUCCESS;
+}
+
+}  // namespace ops
+}  // namespace mace
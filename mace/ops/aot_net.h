@@ -0,0 +1,132 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_OPS_AOT_NET_H_
+#define MACE_OPS_AOT_NET_H_
+
+#include <memory>
+#include <vector>
+
+#include "mace/core/buffer.h"
+#include "mace/core/device.h"
+#include "mace/core/op_context.h"
+#include "mace/core/tensor.h"
+#include "mace/core/workspace.h"
+#include "mace/ops/common/activation_type.h"
+#include "mace/ops/common/eltwise_type.h"
+#include "mace/ops/ref/conv_2d.h"
+#ifdef MACE_ENABLE_NEON
+#include "mace/ops/arm/fp32/conv_2d_1x1.h"
+#endif
+#include "mace/public/mace.h"
+
+namespace mace {
+namespace ops {
+
+// The runtime of the models compiled to C++ ahead of time by the converter
+// (--aot). The generated code holds the kernels of the ops with their
+// arguments and calls them in order on the tensors of a flat table, so no
+// NetDef, registry or memory optimizer is used at runtime. The weights are
+// views of the model data and the activations are slices of one arena, at
+// the offsets planned by the converter. The 4D activations are NCHW.
+class AotNet {
+ public:
+  AotNet(int num_threads,
+         const unsigned char *model_data,
+         index_t model_data_size,
+         index_t arena_size,
+         int num_tensors);
+
+  void AddWeight(int id, index_t offset, const std::vector<index_t> &shape);
+
+  void AddActivation(int id,
+                     index_t offset,
+                     index_t size,
+                     const std::vector<index_t> &shape);
+
+  // the memory of tensor src_id in another shape, for Reshape and Squeeze
+  void AddAlias(int id, int src_id, const std::vector<index_t> &shape);
+
+  inline Tensor *tensor(int id) const {
+    return tensors_[id].get();
+  }
+
+  inline const OpContext *context() {
+    return &context_;
+  }
+
+  // the input of the model, in model_format, into tensor id
+  MaceStatus FeedInput(const MaceTensor &input,
+                       DataFormat model_format,
+                       int id);
+
+  // tensor id into an output of the shape of the model
+  MaceStatus FetchOutput(int id, DataFormat model_format, MaceTensor *output);
+
+ private:
+  CPUDevice device_;
+  Workspace ws_;
+  OpContext context_;
+  Buffer model_buffer_;
+  Buffer arena_;
+  std::vector<std::unique_ptr<Tensor>> tensors_;
+
+  MACE_DISABLE_COPY_AND_ASSIGN(AotNet);
+};
+
+// Conv2D on NCHW float with the bias and activation folded into it
+class AotConv2d {
+ public:
+  AotConv2d(int kernel_h, int kernel_w, int pad_h, int pad_w,
+            int stride_h, int stride_w, int dilation_h, int dilation_w,
+            ActivationType activation, float relux_max_limit,
+            float leakyrelu_coefficient);
+
+  MaceStatus Compute(const OpContext *context,
+                     const Tensor *input,
+                     const Tensor *filter,
+                     const Tensor *bias,
+                     Tensor *output);
+
+ private:
+  const bool is_1x1_;
+  ref::Conv2d<float> ref_conv2d_;
+#ifdef MACE_ENABLE_NEON
+  arm::fp32::Conv2dK1x1 conv2d_1x1_;
+#endif
+  const ActivationType activation_;
+  const float relux_max_limit_;
+  const float leakyrelu_coefficient_;
+};
+
+// adds bias to the channels, axis 1 of 4D tensors and the last one of others
+MaceStatus AotBiasAdd(const Tensor *input, const Tensor *bias,
+                      Tensor *output);
+
+MaceStatus AotActivation(const Tensor *input,
+                         ActivationType activation,
+                         float relux_max_limit,
+                         float leakyrelu_coefficient,
+                         Tensor *output);
+
+// of two tensors of the same shape
+MaceStatus AotEltwise(EltwiseType type,
+                      const Tensor *input0,
+                      const Tensor *input1,
+                      Tensor *output);
+
+}  // namespace ops
+}  // namespace mace
+
+#endif  // MACE_OPS_AOT_NET_H_
@@ -17,7 +17,9 @@
 #endif
 
 #include <algorithm>
+#include <cmath>
 #include "mace/ops/arm/activation_neon.h"
+#include "mace/ops/arm/common_neon.h"
 
 namespace mace {
 namespace ops {
@@ -93,5 +95,80 @@ void LeakyReluNeon(const float *input, const float alpha,
 #endif
 }
 
+namespace {
+
+// -2 * sqrt(2 / pi) and its product with the cubic coefficient 0.044715
+constexpr float kGeluScale = -1.5957691216f;
+constexpr float kGeluCubicScale = -0.0713548162f;
+
+inline float Gelu(const float x) {
+  return x / (1.f + std::exp(x * (kGeluScale + kGeluCubicScale * x * x)));
+}
+
+inline float Sigmoid(const float x) {
+  return 1.f / (1.f + std::exp(-x));
+}
+
+}  // namespace
+
+void GeluNeon(const float *input, const index_t size, float *output) {
+#if defined(MACE_ENABLE_NEON)
+  const float32x4_t vone = vdupq_n_f32(1.f);
+#pragma omp parallel for schedule(runtime)
+  for (index_t i = 0; i <= size - 4; i += 4) {
+    float32x4_t x = vld1q_f32(input + i);
+    float32x4_t t = vmlaq_n_f32(vdupq_n_f32(kGeluScale),
+                                vmulq_f32(x, x), kGeluCubicScale);
+    float32x4_t d = vaddq_f32(vone, neon_vexpq_f32(vmulq_f32(x, t)));
+    vst1q_f32(output + i, vmulq_f32(x, neon_vrecpq_f32(d)));
+  }
+  // remain
+  for (index_t i = (size >> 2) << 2; i < size; ++i) {
+    output[i] = Gelu(input[i]);
+  }
+#else
+#pragma omp parallel for schedule(runtime)
+  for (index_t i = 0; i < size; ++i) {
+    output[i] = Gelu(input[i]);
+  }
+#endif
+}
+
+void SigmoidNeon(const float *input, const index_t size, float *output) {
+#if defined(MACE_ENABLE_NEON)
+#pragma omp parallel for schedule(runtime)
+  for (index_t i = 0; i <= size - 4; i += 4) {
+    vst1q_f32(output + i, neon_vsigmoidq_f32(vld1q_f32(input + i)));
+  }
+  // remain
+  for (index_t i = (size >> 2) << 2; i < size; ++i) {
+    output[i] = Sigmoid(input[i]);
+  }
+#else
+#pragma omp parallel for schedule(runtime)
+  for (index_t i = 0; i < size; ++i) {
+    output[i] = Sigmoid(input[i]);
+  }
+#endif
+}
+
+void TanhNeon(const float *input, const index_t size, float *output) {
+#if defined(MACE_ENABLE_NEON)
+#pragma omp parallel for schedule(runtime)
+  for (index_t i = 0; i <= size - 4; i += 4) {
+    vst1q_f32(output + i, neon_vtanhq_f32(vld1q_f32(input + i)));
+  }
+  // remain
+  for (index_t i = (size >> 2) << 2; i < size; ++i) {
+    output[i] = std::tanh(input[i]);
+  }
+#else
+#pragma omp parallel for schedule(runtime)
+  for (index_t i = 0; i < size; ++i) {
+    output[i] = std::tanh(input[i]);
+  }
+#endif
+}
+
 }  // namespace ops
 }  // namespace mace
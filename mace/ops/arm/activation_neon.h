@@ -28,6 +28,15 @@ void ReluxNeon(const float *input, const float limit,
 void LeakyReluNeon(const float *input, const float alpha,
                    const index_t size, float *output);
 
+// the tanh approximation of GELU, as x * sigmoid(2 * tanh's argument)
+void GeluNeon(const float *input, const index_t size, float *output);
+
+// of the polynomials of common_neon.h, see neon_vsigmoidq_f32 and
+// neon_vtanhq_f32 for their errors
+void SigmoidNeon(const float *input, const index_t size, float *output);
+
+void TanhNeon(const float *input, const index_t size, float *output);
+
 }  // namespace ops
 }  // namespace mace
 
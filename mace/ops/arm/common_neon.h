@@ -62,6 +62,68 @@ inline float32x4_t neon_vfma_lane_3(float32x4_t a,
   return vmlaq_lane_f32(a, b, vget_high_f32(c), 1);
 #endif
 }
+
+// 1 / x of the estimate refined by two Newton steps
+inline float32x4_t neon_vrecpq_f32(float32x4_t x) {
+  float32x4_t inv = vrecpeq_f32(x);
+  inv = vmulq_f32(vrecpsq_f32(x, inv), inv);
+  return vmulq_f32(vrecpsq_f32(x, inv), inv);
+}
+
+// exp of a polynomial of the reduced argument, of a relative error < 2e-7
+inline float32x4_t neon_vexpq_f32(float32x4_t x) {
+  x = vminq_f32(vmaxq_f32(x, vdupq_n_f32(-87.3f)), vdupq_n_f32(88.3f));
+  // x = n * ln2 + r, |r| <= ln2 / 2
+  float32x4_t fn = vmlaq_n_f32(vdupq_n_f32(0.5f), x, 1.44269504f);
+  int32x4_t n = vcvtq_s32_f32(fn);
+  // round towards -inf for the negative
+  n = vsubq_s32(n, vreinterpretq_s32_u32(
+      vshrq_n_u32(vcltq_f32(fn, vcvtq_f32_s32(n)), 31)));
+  fn = vcvtq_f32_s32(n);
+  float32x4_t r = vmlsq_n_f32(x, fn, 0.693359375f);
+  r = vmlsq_n_f32(r, fn, -2.12194440e-4f);
+
+  float32x4_t p = vdupq_n_f32(1.9875691500e-4f);
+  p = vmlaq_f32(vdupq_n_f32(1.3981999507e-3f), p, r);
+  p = vmlaq_f32(vdupq_n_f32(8.3334519073e-3f), p, r);
+  p = vmlaq_f32(vdupq_n_f32(4.1665795894e-2f), p, r);
+  p = vmlaq_f32(vdupq_n_f32(1.6666665459e-1f), p, r);
+  p = vmlaq_f32(vdupq_n_f32(5.0000001201e-1f), p, r);
+  p = vmlaq_f32(vaddq_f32(r, vdupq_n_f32(1.f)), p, vmulq_f32(r, r));
+
+  // 2^n from the exponent bits
+  const int32x4_t pow2n = vshlq_n_s32(vaddq_s32(n, vdupq_n_s32(127)), 23);
+  return vmulq_f32(p, vreinterpretq_f32_s32(pow2n));
+}
+
+// 1 / (1 + exp(-x)), of a relative error < 3e-7
+inline float32x4_t neon_vsigmoidq_f32(float32x4_t x) {
+  return neon_vrecpq_f32(
+      vaddq_f32(vdupq_n_f32(1.f), neon_vexpq_f32(vnegq_f32(x))));
+}
+
+// tanh of a rational function of odd degree 13 over even degree 6, of a
+// relative error < 4e-7, which saturates past |x| of 7.9 and is x itself
+// below 4e-4
+inline float32x4_t neon_vtanhq_f32(float32x4_t x) {
+  const float32x4_t c = vminq_f32(vmaxq_f32(x, vdupq_n_f32(-7.9053111f)),
+                                  vdupq_n_f32(7.9053111f));
+  const float32x4_t c2 = vmulq_f32(c, c);
+  float32x4_t p = vdupq_n_f32(-2.76076847742355e-16f);
+  p = vmlaq_f32(vdupq_n_f32(2.00018790482477e-13f), p, c2);
+  p = vmlaq_f32(vdupq_n_f32(-8.60467152213735e-11f), p, c2);
+  p = vmlaq_f32(vdupq_n_f32(5.12229709037114e-08f), p, c2);
+  p = vmlaq_f32(vdupq_n_f32(1.48572235717979e-05f), p, c2);
+  p = vmlaq_f32(vdupq_n_f32(6.37261928875436e-04f), p, c2);
+  p = vmlaq_f32(vdupq_n_f32(4.89352455891786e-03f), p, c2);
+  p = vmulq_f32(p, c);
+  float32x4_t q = vdupq_n_f32(1.19825839466702e-06f);
+  q = vmlaq_f32(vdupq_n_f32(1.18534705686654e-04f), q, c2);
+  q = vmlaq_f32(vdupq_n_f32(2.26843463243900e-03f), q, c2);
+  q = vmlaq_f32(vdupq_n_f32(4.89352518554385e-03f), q, c2);
+  const float32x4_t result = vmulq_f32(p, neon_vrecpq_f32(q));
+  return vbslq_f32(vcltq_f32(vabsq_f32(x), vdupq_n_f32(4e-4f)), x, result);
+}
 #endif
 
 }  // namespace ops
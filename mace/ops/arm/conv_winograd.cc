@@ -13,6 +13,7 @@
 // limitations under the License.
 
 #include <algorithm>
+#include <string>
 
 #include "mace/ops/arm/conv_winograd.h"
 #include "mace/utils/memory.h"
@@ -116,6 +117,100 @@ void TransformInput4x4(const float *input,
   }
 }
 
+// NCHW => NTCB (T: in tile pixels, B: tile indices)
+/**
+ * BT =
+⎡4   0   -5   0   1   0⎤
+⎢                      ⎥
+⎢0  -4   -4   1   1   0⎥
+⎢                      ⎥
+⎢0   4   -4  -1   1   0⎥
+⎢                      ⎥
+⎢0  -2   -1   2   1   0⎥
+⎢                      ⎥
+⎢0   2   -1  -2   1   0⎥
+⎢                      ⎥
+⎣0   4    0  -5   0   1⎦
+ */
+void TransformInput6x6(const float *input,
+                       const index_t batch,
+                       const index_t in_height,
+                       const index_t in_width,
+                       const index_t in_channels,
+                       const index_t tile_count,
+                       float *output) {
+  const index_t stride = in_channels * tile_count;
+  const index_t in_height_width = in_height * in_width;
+  const index_t input_batch_size = in_height_width * in_channels;
+  const index_t output_batch_size = 36 * in_channels * tile_count;
+
+#pragma omp parallel for collapse(2) schedule(runtime)
+  for (index_t n = 0; n < batch; ++n) {
+    for (index_t c = 0; c < in_channels; ++c) {
+      index_t tile_index = 0;
+      float s[6][6];
+      for (index_t h = 0; h < in_height - 2; h += 4) {
+        for (index_t w = 0; w < in_width - 2; w += 4) {
+          const float *input_ptr = input + n * input_batch_size +
+                                   c * in_height_width + h * in_width + w;
+
+          for (int i = 0; i < 6; ++i) {
+            float d0, d1, d2, d3, d4, d5;
+            d0 = input_ptr[0];
+            d1 = input_ptr[1];
+            d2 = input_ptr[2];
+            d3 = input_ptr[3];
+            d4 = input_ptr[4];
+            d5 = input_ptr[5];
+
+            s[i][0] = d0 * 4 - d2 * 5 + d4;
+            s[i][5] = d1 * 4 - d3 * 5 + d5;
+
+            float u = d4 - d2 * 4;
+            float v = d3 - d1 * 4;
+            s[i][1] = u + v;
+            s[i][2] = u - v;
+
+            u = d4 - d2;
+            v = (d3 - d1) * 2;
+            s[i][3] = u + v;
+            s[i][4] = u - v;
+
+            input_ptr += in_width;
+          }
+
+          float *output_ptr =
+              output + n * output_batch_size + c * tile_count + tile_index;
+          for (int i = 0; i < 6; ++i) {
+            float d0, d1, d2, d3, d4, d5;
+            d0 = s[0][i];
+            d1 = s[1][i];
+            d2 = s[2][i];
+            d3 = s[3][i];
+            d4 = s[4][i];
+            d5 = s[5][i];
+
+            output_ptr[i * stride] = d0 * 4 - d2 * 5 + d4;
+            output_ptr[(30 + i) * stride] = d1 * 4 - d3 * 5 + d5;
+
+            float u = d4 - d2 * 4;
+            float v = d3 - d1 * 4;
+            output_ptr[(6 + i) * stride] = u + v;
+            output_ptr[(12 + i) * stride] = u - v;
+
+            u = d4 - d2;
+            v = (d3 - d1) * 2;
+            output_ptr[(18 + i) * stride] = u + v;
+            output_ptr[(24 + i) * stride] = u - v;
+          }
+
+          ++tile_index;
+        }
+      }
+    }
+  }
+}
+
 // NCHW => NTCB (T: in tile pixels, B: tile indices)
 /**
  * BT =
@@ -259,6 +354,9 @@ void BatchGemm(const float *input,
   // so we loop batch using single thread.
   // Scratch buffer should be rewind to the initial position to use same
   // scratch memory for each batch.
+  // The filter is not cached by sgemm as a weight: it is owned by the packed
+  // weights, which sgemm must not advise to free, and it is packed anew for
+  // the tile size of each run.
   for (int b = 0; b < batch; ++b) {
     if (scratch_buffer) {
       scratch_buffer->Rewind(scratch_buffer_offset);
@@ -272,7 +370,7 @@ void BatchGemm(const float *input,
                tile_count,
                false,
                false,
-               true,
+               false,
                false,
                output + b * out_batch_size,
                scratch_buffer);
@@ -353,6 +451,91 @@ void TransformOutput4x4(const float *input,
   }
 }
 
+// NTOB => NToOB => NOHoWo
+/**
+ * AT =
+⎡1  1   1  1   1  0⎤
+⎢                  ⎥
+⎢0  1  -1  2  -2  0⎥
+⎢                  ⎥
+⎢0  1   1  4   4  0⎥
+⎢                  ⎥
+⎣0  1  -1  8  -8  1⎦
+ */
+void TransformOutput6x6(const float *input,
+                        index_t batch,
+                        index_t out_height,
+                        index_t out_width,
+                        index_t out_channels,
+                        index_t tile_count,
+                        float *output) {
+  const index_t stride = out_channels * tile_count;
+  const index_t input_batch_size = 36 * stride;
+  const index_t out_image_size = out_height * out_width;
+  const index_t output_batch_size = out_channels * out_image_size;
+
+#pragma omp parallel for collapse(2) schedule(runtime)
+  for (index_t n = 0; n < batch; ++n) {
+    for (index_t m = 0; m < out_channels; ++m) {
+      index_t tile_offset = 0;
+      float s[6][4];
+      for (index_t h = 0; h < out_height; h += 4) {
+        for (index_t w = 0; w < out_width; w += 4) {
+          const float *input_ptr =
+              input + n * input_batch_size + m * tile_count + tile_offset;
+          for (int i = 0; i < 6; ++i) {
+            float d0, d1, d2, d3, d4, d5;
+
+            d0 = input_ptr[0];
+            d1 = input_ptr[1 * stride];
+            d2 = input_ptr[2 * stride];
+            d3 = input_ptr[3 * stride];
+            d4 = input_ptr[4 * stride];
+            d5 = input_ptr[5 * stride];
+
+            float u = d1 + d2;
+            float v = d1 - d2;
+            float w = d3 + d4;
+            float x = d3 - d4;
+
+            s[i][0] = d0 + u + w;
+            s[i][1] = v + x * 2;
+            s[i][2] = u + w * 4;
+            s[i][3] = v + x * 8 + d5;
+
+            input_ptr += 6 * stride;
+          }
+
+          float *output_ptr = output + n * output_batch_size +
+                              m * out_image_size + h * out_width + w;
+
+          for (int i = 0; i < 4; ++i) {
+            float d0, d1, d2, d3, d4, d5;
+            d0 = s[0][i];
+            d1 = s[1][i];
+            d2 = s[2][i];
+            d3 = s[3][i];
+            d4 = s[4][i];
+            d5 = s[5][i];
+
+            float u = d1 + d2;
+            float v = d1 - d2;
+            float w = d3 + d4;
+            float x = d3 - d4;
+
+            output_ptr[i] = d0 + u + w;
+            output_ptr[1 * out_width + i] = v + x * 2;
+            output_ptr[2 * out_width + i] = u + w * 4;
+            output_ptr[3 * out_width + i] = v + x * 8 + d5;
+          }
+
+          ++tile_offset;
+        }
+      }
+    }
+  }
+}
+
 // NTOB => NToOB => NOHoWo
 /**
  * AT =
@@ -533,6 +716,70 @@ void TransformFilter4x4(const float *filter,
   }
 }
 
+// OCHW => TOC
+// no need to optimize, it will exist in converter
+/**
+ * G =
+⎡ 1/4     0     0  ⎤
+⎢                  ⎥
+⎢-1/6   -1/6  -1/6 ⎥
+⎢                  ⎥
+⎢-1/6    1/6  -1/6 ⎥
+⎢                  ⎥
+⎢1/24   1/12   1/6 ⎥
+⎢                  ⎥
+⎢1/24  -1/12   1/6 ⎥
+⎢                  ⎥
+⎣  0      0     1  ⎦
+ */
+void TransformFilter6x6(const float *filter,
+                        const index_t in_channels,
+                        const index_t out_channels,
+                        float *output) {
+  const index_t stride = out_channels * in_channels;
+
+  const float G[6][3] = {{1.0f / 4, 0.0f, 0.0f},
+                         {-1.0f / 6, -1.0f / 6, -1.0f / 6},
+                         {-1.0f / 6, 1.0f / 6, -1.0f / 6},
+                         {1.0f / 24, 1.0f / 12, 1.0f / 6},
+                         {1.0f / 24, -1.0f / 12, 1.0f / 6},
+                         {0.0f, 0.0f, 1.0f}};
+
+#pragma omp parallel for collapse(2) schedule(runtime)
+  for (index_t m = 0; m < out_channels; ++m) {
+    for (index_t c = 0; c < in_channels; ++c) {
+      // load filter
+      index_t filter_offset = (m * in_channels + c) * 9;
+      float g0, g1, g2, g3, g4, g5, g6, g7, g8;
+      g0 = filter[filter_offset];
+      g1 = filter[filter_offset + 1];
+      g2 = filter[filter_offset + 2];
+      g3 = filter[filter_offset + 3];
+      g4 = filter[filter_offset + 4];
+      g5 = filter[filter_offset + 5];
+      g6 = filter[filter_offset + 6];
+      g7 = filter[filter_offset + 7];
+      g8 = filter[filter_offset + 8];
+
+      float s[3][6];
+      for (int i = 0; i < 6; ++i) {
+        s[0][i] = g0 * G[i][0] + g1 * G[i][1] + g2 * G[i][2];
+        s[1][i] = g3 * G[i][0] + g4 * G[i][1] + g5 * G[i][2];
+        s[2][i] = g6 * G[i][0] + g7 * G[i][1] + g8 * G[i][2];
+      }
+
+      // store output
+      index_t output_offset = m * in_channels + c;
+      for (int i = 0; i < 6; ++i) {
+        for (int j = 0; j < 6; ++j) {
+          output[output_offset + (i * 6 + j) * stride] =
+              G[i][0] * s[0][j] + G[i][1] * s[1][j] + G[i][2] * s[2][j];
+        }
+      }
+    }
+  }
+}
+
 // OCHW => TOC
 // no need to optimize, it will exist in converter
 /**
@@ -608,6 +855,80 @@ void TransformFilter8x8(const float *filter,
   }
 }
 
+void TransformFilter(const float *filter,
+                     const index_t in_channels,
+                     const index_t out_channels,
+                     const int out_tile_size,
+                     float *output) {
+  switch (out_tile_size) {
+    case 2:
+      TransformFilter4x4(filter, in_channels, out_channels, output);
+      break;
+    case 4:
+      TransformFilter6x6(filter, in_channels, out_channels, output);
+      break;
+    case 6:
+      TransformFilter8x8(filter, in_channels, out_channels, output);
+      break;
+    default:
+      MACE_NOT_IMPLEMENTED;
+  }
+}
+
+const float *GetTransformedFilter(PackedWeights *packed_weights,
+                                  const Tensor *filter,
+                                  const int out_tile_size) {
+  const index_t out_channels = filter->dim(0);
+  const index_t in_channels = filter->dim(1);
+  const index_t in_tile_size = out_tile_size + 2;
+  const std::string layout = MakeString(
+      "winograd_fp32_", in_tile_size, "x", in_tile_size, "_", out_channels,
+      "x", in_channels);
+  return packed_weights->GetOrPack(
+      layout, filter, in_tile_size * in_tile_size * out_channels * in_channels,
+      [&](float *transformed_filter) {
+        Tensor::MappingGuard filter_guard(filter);
+        TransformFilter(filter->data<float>(), in_channels, out_channels,
+                        out_tile_size, transformed_filter);
+      });
+}
+
+int WinogradOutTileSize(const index_t in_channels,
+                        const index_t out_channels,
+                        const index_t out_height,
+                        const index_t out_width) {
+  // Per in tile pixel and tile, the gemm takes in_channels * out_channels
+  // multiply-adds, and the input and output transforms take about two passes
+  // of in_tile_size operations over each of the in and out channels. More
+  // tiles are wasted on the edges of the output as the tile size grows.
+  int best_out_tile_size = 2;
+  index_t best_cost = 0;
+  for (int out_tile_size = 2; out_tile_size <= 6; out_tile_size += 2) {
+    const index_t in_tile_size = out_tile_size + 2;
+    const index_t tile_count =
+        RoundUpDiv(out_height, static_cast<index_t>(out_tile_size))
+            * RoundUpDiv(out_width, static_cast<index_t>(out_tile_size));
+    const index_t cost = tile_count * in_tile_size * in_tile_size
+        * (in_channels * out_channels
+            + 2 * in_tile_size * (in_channels + out_channels));
+    if (out_tile_size == 2 || cost < best_cost) {
+      best_out_tile_size = out_tile_size;
+      best_cost = cost;
+    }
+  }
+  return best_out_tile_size;
+}
+
+index_t WinogradGemmScratchSize(const index_t in_channels,
+                                const index_t out_channels,
+                                const index_t tile_count,
+                                const int out_tile_size) {
+  const index_t in_tile_area = (out_tile_size + 2) * (out_tile_size + 2);
+  // sgemm packs the filter, the transformed input and the result
+  return in_tile_area * (out_channels * in_channels + in_channels * tile_count
+      + out_channels * tile_count) * static_cast<index_t>(sizeof(float));
+}
+
 void WinogradConv3x3s1(const float *input,
                        const float *transformed_filter,
                        const index_t batch,
@@ -634,6 +955,10 @@ void WinogradConv3x3s1(const float *input,
       TransformInput4x4(input, batch, in_height, in_width, in_channels,
                         tile_count, transformed_input);
       break;
+    case 4:
+      TransformInput6x6(input, batch, in_height, in_width, in_channels,
+                        tile_count, transformed_input);
+      break;
     case 6:
       TransformInput8x8(input, batch, in_height, in_width, in_channels,
                         tile_count, transformed_input);
@@ -651,6 +976,10 @@ void WinogradConv3x3s1(const float *input,
       TransformOutput4x4(transformed_output, batch, out_height, out_width,
                          out_channels, tile_count, output);
       break;
+    case 4:
+      TransformOutput6x6(transformed_output, batch, out_height, out_width,
+                         out_channels, tile_count, output);
+      break;
     case 6:
       TransformOutput8x8(transformed_output, batch, out_height, out_width,
                          out_channels, tile_count, output);
@@ -692,18 +1021,8 @@ void WinogradConv3x3s1(const float *input,
   auto transformed_output =
     make_unique<float[]>(transformed_output_size);  // NOLINT
 
-  switch (out_tile_size) {
-    case 2:
-      TransformFilter4x4(filter, in_channels, out_channels,
-                         transformed_filter.get());
-      break;
-    case 6:
-      TransformFilter8x8(filter, in_channels, out_channels,
-                         transformed_filter.get());
-      break;
-    default:
-      MACE_NOT_IMPLEMENTED;
-  }
+  TransformFilter(filter, in_channels, out_channels, out_tile_size,
+                  transformed_filter.get());
 
   WinogradConv3x3s1(input, transformed_filter.get(), batch, in_height,
                     in_width, in_channels, out_channels, out_tile_size,
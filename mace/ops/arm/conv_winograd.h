@@ -19,6 +19,8 @@
 #include <arm_neon.h>
 #endif
 
+#include "mace/core/packed_weights.h"
+#include "mace/core/tensor.h"
 #include "mace/core/types.h"
 #include "mace/ops/sgemm.h"
 
@@ -30,11 +32,43 @@ void TransformFilter4x4(const float *filter,
                         const index_t out_channels,
                         float *output);
 
+void TransformFilter6x6(const float *filter,
+                        const index_t in_channels,
+                        const index_t out_channels,
+                        float *output);
+
 void TransformFilter8x8(const float *filter,
                         const index_t in_channels,
                         const index_t out_channels,
                         float *output);
 
+// OCHW => TOC, T of (out_tile_size + 2) x (out_tile_size + 2)
+void TransformFilter(const float *filter,
+                     const index_t in_channels,
+                     const index_t out_channels,
+                     const int out_tile_size,
+                     float *output);
+
+// The constant OIHW filter transformed for out_tile_size, looked up in or
+// added to the packed weights, so it is transformed once for all runs.
+const float *GetTransformedFilter(PackedWeights *packed_weights,
+                                  const Tensor *filter,
+                                  const int out_tile_size);
+
+// The out tile size of F(m x m, 3 x 3), 2, 4 or 6, of the least estimated
+// cost for the channels and the size of the output.
+int WinogradOutTileSize(const index_t in_channels,
+                        const index_t out_channels,
+                        const index_t out_height,
+                        const index_t out_width);
+
+// Bytes of the scratch buffer taken by the gemm of one batch, besides the
+// transformed input and output.
+index_t WinogradGemmScratchSize(const index_t in_channels,
+                                const index_t out_channels,
+                                const index_t tile_count,
+                                const int out_tile_size);
+
 void WinogradConv3x3s1(const float *input,
                        const float *filter,
                        const index_t batch,
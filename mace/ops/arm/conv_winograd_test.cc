@@ -24,10 +24,12 @@
 namespace mace {
 namespace ops {
 
-TEST(ConvWinogradTest, winograd) {
+namespace {
+
+void TestWinograd(const index_t in_height,
+                  const index_t in_width,
+                  const int out_tile_size) {
   index_t batch = 1;
-  index_t in_height = 32;
-  index_t in_width = 32;
   index_t in_channels = 64;
   index_t out_channels = 128;
 
@@ -50,7 +52,7 @@ TEST(ConvWinogradTest, winograd) {
   float *input_data = input.mutable_data<float>();
   float *filter_data = filter.mutable_data<float>();
   float *output_data = output.mutable_data<float>();
-  float *output_data_ref = output.mutable_data<float>();
+  float *output_data_ref = output_ref.mutable_data<float>();
 
   std::random_device rd;
   std::mt19937 gen(rd());
@@ -67,8 +69,8 @@ TEST(ConvWinogradTest, winograd) {
 
   SGemm sgemm;
   ops::WinogradConv3x3s1(input_data, filter_data, batch, in_height,
-                             in_width, in_channels, out_channels, 6,
-                             output_data, &sgemm, nullptr);
+                             in_width, in_channels, out_channels,
+                             out_tile_size, output_data, &sgemm, nullptr);
 
   // test
   for (index_t i = 0; i < output_size; ++i) {
@@ -76,5 +78,26 @@ TEST(ConvWinogradTest, winograd) {
   }
 }
 
+}  // namespace
+
+TEST(ConvWinogradTest, winograd) {
+  TestWinograd(32, 32, 6);
+}
+
+TEST(ConvWinogradTest, winograd4x4) {
+  TestWinograd(34, 34, 4);
+  TestWinograd(18, 18, 4);
+}
+
+TEST(ConvWinogradTest, winograd2x2) {
+  TestWinograd(32, 32, 2);
+}
+
+TEST(ConvWinogradTest, OutTileSize) {
+  EXPECT_EQ(6, WinogradOutTileSize(64, 64, 56, 56));
+  EXPECT_EQ(4, WinogradOutTileSize(256, 256, 14, 14));
+  EXPECT_EQ(4, WinogradOutTileSize(512, 512, 7, 7));
+}
+
 }  // namespace ops
 }  // namespace mace
@@ -20,6 +20,18 @@
 namespace mace {
 namespace ops {
 
+// The kernel of the 2x4 output blocks of DepthwiseConv2dNeonK3x3S1. The
+// AArch64 assembly is scheduled for the in-order cores, such as Cortex-A55,
+// or for the out-of-order ones; all of them are bit-identical.
+enum DepthwiseConv2dK3x3S1Kernel {
+  // the assembly of the core the calling thread runs on, the intrinsics
+  // off AArch64
+  DEPTHWISE_K3X3S1_AUTO = 0,
+  DEPTHWISE_K3X3S1_INTRINSICS = 1,
+  DEPTHWISE_K3X3S1_ASM_IN_ORDER = 2,
+  DEPTHWISE_K3X3S1_ASM_OUT_OF_ORDER = 3,
+};
+
 void DepthwiseConv2dNeonK3x3S1(const float *input,
                                const float *filter,
                                const index_t *in_shape,
@@ -29,7 +41,9 @@ void DepthwiseConv2dNeonK3x3S1(const float *input,
                                const index_t valid_h_stop,
                                const index_t valid_w_start,
                                const index_t valid_w_stop,
-                               float *output);
+                               float *output,
+                               DepthwiseConv2dK3x3S1Kernel kernel =
+                                   DEPTHWISE_K3X3S1_AUTO);
 
 void DepthwiseConv2dNeonK3x3S2(const float *input,
                                const float *filter,
@@ -42,6 +56,40 @@ void DepthwiseConv2dNeonK3x3S2(const float *input,
                                const index_t valid_w_stop,
                                float *output);
 
+void DepthwiseConv2dNeonK3x3Dilated(const float *input,
+                                    const float *filter,
+                                    const index_t *in_shape,
+                                    const index_t *out_shape,
+                                    const int *pad_hw,
+                                    const int *dilation_hw,
+                                    const index_t valid_h_start,
+                                    const index_t valid_h_stop,
+                                    const index_t valid_w_start,
+                                    const index_t valid_w_stop,
+                                    float *output);
+
+void DepthwiseConv2dNeonK5x5S1(const float *input,
+                               const float *filter,
+                               const index_t *in_shape,
+                               const index_t *out_shape,
+                               const int *pad_hw,
+                               const index_t valid_h_start,
+                               const index_t valid_h_stop,
+                               const index_t valid_w_start,
+                               const index_t valid_w_stop,
+                               float *output);
+
+void DepthwiseConv2dNeonK5x5S2(const float *input,
+                               const float *filter,
+                               const index_t *in_shape,
+                               const index_t *out_shape,
+                               const int *pad_hw,
+                               const index_t valid_h_start,
+                               const index_t valid_h_stop,
+                               const index_t valid_w_start,
+                               const index_t valid_w_stop,
+                               float *output);
+
 }  // namespace ops
 }  // namespace mace
 
@@ -17,6 +17,7 @@
 #endif
 
 #include "mace/core/macros.h"
+#include "mace/core/runtime/cpu/cpu_runtime.h"
 #include "mace/ops/arm/depthwise_conv2d_neon.h"
 
 namespace mace {
@@ -47,6 +48,184 @@ void DepthwiseConv2dPixel(const float *in_base,
   }
   out_base[out_h * out_width + out_w] = sum;
 }
+
+void DepthwiseConv2dDilatedPixel(const float *in_base,
+                                 const float *filter,
+                                 const index_t out_h,
+                                 const index_t out_w,
+                                 const index_t in_h_start,
+                                 const index_t in_w_start,
+                                 const index_t out_width,
+                                 const index_t in_height,
+                                 const index_t in_width,
+                                 const int *dilation_hw,
+                                 float *out_base) {
+  float sum = 0;
+  for (int i = 0; i < 3; ++i) {
+    for (int j = 0; j < 3; ++j) {
+      index_t in_h = in_h_start + i * dilation_hw[0];
+      index_t in_w = in_w_start + j * dilation_hw[1];
+      if (in_h >= 0 && in_h < in_height && in_w >= 0 && in_w < in_width) {
+        sum += in_base[in_h * in_width + in_w] * filter[i * 3 + j];
+      }
+    }
+  }
+  out_base[out_h * out_width + out_w] = sum;
+}
+
+#if defined(MACE_ENABLE_NEON) && defined(__aarch64__)
+// The 2x4 output blocks of the rows out and out + out_width, from left to
+// right, of the 4 input rows from in. The fmla of each output are in the
+// order of the intrinsics, so are the sums.
+//
+// An in-order core, such as Cortex-A55, stalls on an fmla of the result of
+// the one before it, so the fmla of the two output rows alternate and the
+// loads and ext of the rows below are issued between them.
+void DepthwiseConv2dK3x3S1BlocksInOrder(const float *in,
+                                        const index_t in_width,
+                                        const float *filter,
+                                        float *out,
+                                        const index_t out_width,
+                                        index_t blocks) {
+  const float *in0 = in;
+  const float *in1 = in0 + in_width;
+  const float *in2 = in1 + in_width;
+  const float *in3 = in2 + in_width;
+  float *out0 = out;
+  float *out1 = out + out_width;
+  asm volatile(
+      "ldr q0, [%[filter]]                  \n"
+      "ldur q1, [%[filter], #12]            \n"
+      "ldur q2, [%[filter], #20]            \n"
+
+      "0:                                   \n"
+      "ldp q4, q5, [%[in0]]                 \n"
+      "ldp q8, q9, [%[in1]]                 \n"
+      "ldr q20, [%[out0]]                   \n"
+      "ext v6.16b, v4.16b, v5.16b, #4       \n"
+      "ldr q21, [%[out1]]                   \n"
+      "ext v7.16b, v4.16b, v5.16b, #8       \n"
+      "ext v10.16b, v8.16b, v9.16b, #4      \n"
+      "fmla v20.4s, v4.4s, v0.s[0]          \n"
+      "ext v11.16b, v8.16b, v9.16b, #8      \n"
+      "fmla v21.4s, v8.4s, v0.s[0]          \n"
+      "ldp q12, q13, [%[in2]]               \n"
+      "fmla v20.4s, v6.4s, v0.s[1]          \n"
+      "fmla v21.4s, v10.4s, v0.s[1]         \n"
+      "ldp q16, q17, [%[in3]]               \n"
+      "fmla v20.4s, v7.4s, v0.s[2]          \n"
+      "fmla v21.4s, v11.4s, v0.s[2]         \n"
+      "ext v14.16b, v12.16b, v13.16b, #4    \n"
+      "fmla v20.4s, v8.4s, v1.s[0]          \n"
+      "ext v15.16b, v12.16b, v13.16b, #8    \n"
+      "fmla v21.4s, v12.4s, v1.s[0]         \n"
+      "ext v18.16b, v16.16b, v17.16b, #4    \n"
+      "fmla v20.4s, v10.4s, v1.s[1]         \n"
+      "ext v19.16b, v16.16b, v17.16b, #8    \n"
+      "fmla v21.4s, v14.4s, v1.s[1]         \n"
+      "add %[in0], %[in0], #16              \n"
+      "fmla v20.4s, v11.4s, v1.s[2]         \n"
+      "add %[in1], %[in1], #16              \n"
+      "fmla v21.4s, v15.4s, v1.s[2]         \n"
+      "add %[in2], %[in2], #16              \n"
+      "fmla v20.4s, v12.4s, v2.s[1]         \n"
+      "add %[in3], %[in3], #16              \n"
+      "fmla v21.4s, v16.4s, v2.s[1]         \n"
+      "fmla v20.4s, v14.4s, v2.s[2]         \n"
+      "fmla v21.4s, v18.4s, v2.s[2]         \n"
+      "subs %[blocks], %[blocks], #1        \n"
+      "fmla v20.4s, v15.4s, v2.s[3]         \n"
+      "fmla v21.4s, v19.4s, v2.s[3]         \n"
+      "str q20, [%[out0]], #16              \n"
+      "str q21, [%[out1]], #16              \n"
+      "bne 0b                               \n"
+      : [in0] "+r"(in0),
+        [in1] "+r"(in1),
+        [in2] "+r"(in2),
+        [in3] "+r"(in3),
+        [out0] "+r"(out0),
+        [out1] "+r"(out1),
+        [blocks] "+r"(blocks)
+      : [filter] "r"(filter)
+      : "cc", "memory",
+        "v0", "v1", "v2", "v4", "v5", "v6", "v7", "v8", "v9", "v10", "v11",
+        "v12", "v13", "v14", "v15", "v16", "v17", "v18", "v19", "v20", "v21");
+}
+
+// The blocks as above for the out-of-order cores, such as Cortex-A76, which
+// reorder the instructions themselves: all the loads of a block are issued
+// first, for the most of them to be in flight at once, then the fmla of one
+// output row after the other.
+void DepthwiseConv2dK3x3S1BlocksOutOfOrder(const float *in,
+                                           const index_t in_width,
+                                           const float *filter,
+                                           float *out,
+                                           const index_t out_width,
+                                           index_t blocks) {
+  const float *in0 = in;
+  const float *in1 = in0 + in_width;
+  const float *in2 = in1 + in_width;
+  const float *in3 = in2 + in_width;
+  float *out0 = out;
+  float *out1 = out + out_width;
+  asm volatile(
+      "ldr q0, [%[filter]]                  \n"
+      "ldur q1, [%[filter], #12]            \n"
+      "ldur q2, [%[filter], #20]            \n"
+
+      "0:                                   \n"
+      "ldp q4, q5, [%[in0]], #16            \n"
+      "ldp q8, q9, [%[in1]], #16            \n"
+      "ldp q12, q13, [%[in2]], #16          \n"
+      "ldp q16, q17, [%[in3]], #16          \n"
+      "ldr q20, [%[out0]]                   \n"
+      "ldr q21, [%[out1]]                   \n"
+      "ext v6.16b, v4.16b, v5.16b, #4       \n"
+      "ext v7.16b, v4.16b, v5.16b, #8       \n"
+      "ext v10.16b, v8.16b, v9.16b, #4      \n"
+      "ext v11.16b, v8.16b, v9.16b, #8      \n"
+      "ext v14.16b, v12.16b, v13.16b, #4    \n"
+      "ext v15.16b, v12.16b, v13.16b, #8    \n"
+      "ext v18.16b, v16.16b, v17.16b, #4    \n"
+      "ext v19.16b, v16.16b, v17.16b, #8    \n"
+
+      "fmla v20.4s, v4.4s, v0.s[0]          \n"
+      "fmla v20.4s, v6.4s, v0.s[1]          \n"
+      "fmla v20.4s, v7.4s, v0.s[2]          \n"
+      "fmla v20.4s, v8.4s, v1.s[0]          \n"
+      "fmla v20.4s, v10.4s, v1.s[1]         \n"
+      "fmla v20.4s, v11.4s, v1.s[2]         \n"
+      "fmla v20.4s, v12.4s, v2.s[1]         \n"
+      "fmla v20.4s, v14.4s, v2.s[2]         \n"
+      "fmla v20.4s, v15.4s, v2.s[3]         \n"
+
+      "fmla v21.4s, v8.4s, v0.s[0]          \n"
+      "fmla v21.4s, v10.4s, v0.s[1]         \n"
+      "fmla v21.4s, v11.4s, v0.s[2]         \n"
+      "fmla v21.4s, v12.4s, v1.s[0]         \n"
+      "fmla v21.4s, v14.4s, v1.s[1]         \n"
+      "fmla v21.4s, v15.4s, v1.s[2]         \n"
+      "fmla v21.4s, v16.4s, v2.s[1]         \n"
+      "fmla v21.4s, v18.4s, v2.s[2]         \n"
+      "fmla v21.4s, v19.4s, v2.s[3]         \n"
+
+      "str q20, [%[out0]], #16              \n"
+      "str q21, [%[out1]], #16              \n"
+      "subs %[blocks], %[blocks], #1        \n"
+      "bne 0b                               \n"
+      : [in0] "+r"(in0),
+        [in1] "+r"(in1),
+        [in2] "+r"(in2),
+        [in3] "+r"(in3),
+        [out0] "+r"(out0),
+        [out1] "+r"(out1),
+        [blocks] "+r"(blocks)
+      : [filter] "r"(filter)
+      : "cc", "memory",
+        "v0", "v1", "v2", "v4", "v5", "v6", "v7", "v8", "v9", "v10", "v11",
+        "v12", "v13", "v14", "v15", "v16", "v17", "v18", "v19", "v20", "v21");
+}
+#endif  // MACE_ENABLE_NEON && __aarch64__
 }  // namespace
 
 // Ho = 2, Wo = 4, Co = 1
@@ -59,10 +238,14 @@ void DepthwiseConv2dNeonK3x3S1(const float *input,
                                const index_t valid_h_stop,
                                const index_t valid_w_start,
                                const index_t valid_w_stop,
-                               float *output) {
+                               float *output,
+                               DepthwiseConv2dK3x3S1Kernel kernel) {
 #if !defined(MACE_ENABLE_NEON)
   MACE_UNUSED(valid_w_start);
   MACE_UNUSED(valid_w_stop);
+#endif
+#if !defined(MACE_ENABLE_NEON) || !defined(__aarch64__)
+  MACE_UNUSED(kernel);
 #endif
   const index_t multiplier = out_shape[1] / in_shape[1];
   const index_t in_image_size = in_shape[2] * in_shape[3];
@@ -101,6 +284,17 @@ void DepthwiseConv2dNeonK3x3S1(const float *input,
       vf01 = vld1q_f32(filter_ptr + 3);
       vf02 = vld1q_f32(filter_ptr + 5);
 
+#if defined(__aarch64__)
+      // by the core of the channel, the threads may move to another one
+      const bool use_in_order_asm = kernel == DEPTHWISE_K3X3S1_ASM_IN_ORDER ||
+          (kernel == DEPTHWISE_K3X3S1_AUTO && CurrentCPUIsInOrder());
+      const bool use_asm =
+          use_in_order_asm || kernel == DEPTHWISE_K3X3S1_ASM_OUT_OF_ORDER ||
+          kernel == DEPTHWISE_K3X3S1_AUTO;
+      const index_t blocks = valid_w_stop > valid_w_start ?
+          (valid_w_stop - valid_w_start) / 4 : 0;
+#endif
+
       for (h = valid_h_start; h + 1 < valid_h_stop; h += 2) {
         // left
         for (w = 0; w < valid_w_start; ++w) {
@@ -112,7 +306,24 @@ void DepthwiseConv2dNeonK3x3S1(const float *input,
                                3, out_base);
         }
 
-        for (w = valid_w_start; w + 3 < valid_w_stop; w += 4) {
+        w = valid_w_start;
+#if defined(__aarch64__)
+        if (use_asm && blocks > 0) {
+          const float *in_ptr =
+              in_base + (h - pad_top) * in_width + w - pad_left;
+          float *out_ptr = out_base + h * out_width + w;
+          if (use_in_order_asm) {
+            DepthwiseConv2dK3x3S1BlocksInOrder(in_ptr, in_width, filter_ptr,
+                                               out_ptr, out_width, blocks);
+          } else {
+            DepthwiseConv2dK3x3S1BlocksOutOfOrder(in_ptr, in_width,
+                                                  filter_ptr, out_ptr,
+                                                  out_width, blocks);
+          }
+          w += blocks * 4;
+        }
+#endif
+        for (; w + 3 < valid_w_stop; w += 4) {
           // input (4 height x 3 slide): vi_height_slide
           float32x4_t vi00, vi01, vi02, vi0n;
           float32x4_t vi10, vi11, vi12, vi1n;
@@ -381,5 +592,150 @@ void DepthwiseConv2dNeonK3x3S2(const float *input,
   }    // b
 }
 
+// Ho = 1, Wo = 4, Co = 1, stride 1
+void DepthwiseConv2dNeonK3x3Dilated(const float *input,
+                                    const float *filter,
+                                    const index_t *in_shape,
+                                    const index_t *out_shape,
+                                    const int *pad_hw,
+                                    const int *dilation_hw,
+                                    const index_t valid_h_start,
+                                    const index_t valid_h_stop,
+                                    const index_t valid_w_start,
+                                    const index_t valid_w_stop,
+                                    float *output) {
+#if !defined(MACE_ENABLE_NEON)
+  MACE_UNUSED(valid_w_start);
+  MACE_UNUSED(valid_w_stop);
+#endif
+  const index_t multiplier = out_shape[1] / in_shape[1];
+  const index_t in_image_size = in_shape[2] * in_shape[3];
+  const index_t out_image_size = out_shape[2] * out_shape[3];
+  const index_t in_batch_size = in_shape[1] * in_image_size;
+  const index_t out_batch_size = out_shape[1] * out_image_size;
+
+#pragma omp parallel for collapse(2) schedule(runtime)
+  for (index_t b = 0; b < in_shape[0]; ++b) {
+    for (index_t m = 0; m < out_shape[1]; ++m) {
+      index_t c = m / multiplier;
+      index_t multi_index = m % multiplier;
+      const float *in_base = input + b * in_batch_size + c * in_image_size;
+      const float *filter_ptr = filter + multi_index * in_shape[1] * 9 + c * 9;
+      float *out_base = output + b * out_batch_size + m * out_image_size;
+      index_t h, w;
+      const index_t pad_top = pad_hw[0];
+      const index_t pad_left = pad_hw[1];
+      const index_t out_width = out_shape[3];
+      const index_t in_height = in_shape[2];
+      const index_t in_width = in_shape[3];
+
+      // top
+      for (h = 0; h < valid_h_start; ++h) {
+        for (w = 0; w < out_width; ++w) {
+          DepthwiseConv2dDilatedPixel(in_base, filter_ptr, h, w, h - pad_top,
+                                      w - pad_left, out_width, in_height,
+                                      in_width, dilation_hw, out_base);
+        }
+      }
+
+#if defined(MACE_ENABLE_NEON)
+      // load filter (1 outch x 3 height x 3 width): vf_outch_height
+      float32x4_t vf00, vf01, vf02;
+      vf00 = vld1q_f32(filter_ptr);
+      vf01 = vld1q_f32(filter_ptr + 3);
+      vf02 = vld1q_f32(filter_ptr + 5);
+      const index_t dilation_h = dilation_hw[0] * in_width;
+      const index_t dilation_w = dilation_hw[1];
+
+      for (h = valid_h_start; h < valid_h_stop; ++h) {
+        // left
+        for (w = 0; w < valid_w_start; ++w) {
+          DepthwiseConv2dDilatedPixel(in_base, filter_ptr, h, w, h - pad_top,
+                                      w - pad_left, out_width, in_height,
+                                      in_width, dilation_hw, out_base);
+        }
+
+        for (w = valid_w_start; w + 3 < valid_w_stop; w += 4) {
+          // input (3 height x 3 slide): vi_height_slide
+          float32x4_t vi00, vi01, vi02;
+          float32x4_t vi10, vi11, vi12;
+          float32x4_t vi20, vi21, vi22;
+
+          // output (1 outch x 1 height x 4 width): vo
+          float32x4_t vo;
+
+          // load input, the slides are dilation_w apart
+          index_t in_h = h - pad_top;
+          index_t in_w = w - pad_left;
+          const float *in_ptr = in_base + in_h * in_width + in_w;
+          vi00 = vld1q_f32(in_ptr);
+          vi01 = vld1q_f32(in_ptr + dilation_w);
+          vi02 = vld1q_f32(in_ptr + 2 * dilation_w);
+          vi10 = vld1q_f32(in_ptr + dilation_h);
+          vi11 = vld1q_f32(in_ptr + dilation_h + dilation_w);
+          vi12 = vld1q_f32(in_ptr + dilation_h + 2 * dilation_w);
+          vi20 = vld1q_f32(in_ptr + 2 * dilation_h);
+          vi21 = vld1q_f32(in_ptr + 2 * dilation_h + dilation_w);
+          vi22 = vld1q_f32(in_ptr + 2 * dilation_h + 2 * dilation_w);
+
+          // load ouptut
+          index_t out_offset = h * out_width + w;
+          vo = vld1q_f32(out_base + out_offset);
+
+#if defined(__aarch64__)
+          // outch 0, height 0
+          vo = vfmaq_laneq_f32(vo, vi00, vf00, 0);
+          vo = vfmaq_laneq_f32(vo, vi01, vf00, 1);
+          vo = vfmaq_laneq_f32(vo, vi02, vf00, 2);
+          vo = vfmaq_laneq_f32(vo, vi10, vf01, 0);
+          vo = vfmaq_laneq_f32(vo, vi11, vf01, 1);
+          vo = vfmaq_laneq_f32(vo, vi12, vf01, 2);
+          vo = vfmaq_laneq_f32(vo, vi20, vf02, 1);
+          vo = vfmaq_laneq_f32(vo, vi21, vf02, 2);
+          vo = vfmaq_laneq_f32(vo, vi22, vf02, 3);
+#else
+          // outch 0, height 0
+          vo = vmlaq_lane_f32(vo, vi00, vget_low_f32(vf00), 0);
+          vo = vmlaq_lane_f32(vo, vi01, vget_low_f32(vf00), 1);
+          vo = vmlaq_lane_f32(vo, vi02, vget_high_f32(vf00), 0);
+          vo = vmlaq_lane_f32(vo, vi10, vget_low_f32(vf01), 0);
+          vo = vmlaq_lane_f32(vo, vi11, vget_low_f32(vf01), 1);
+          vo = vmlaq_lane_f32(vo, vi12, vget_high_f32(vf01), 0);
+          vo = vmlaq_lane_f32(vo, vi20, vget_low_f32(vf02), 1);
+          vo = vmlaq_lane_f32(vo, vi21, vget_high_f32(vf02), 0);
+          vo = vmlaq_lane_f32(vo, vi22, vget_high_f32(vf02), 1);
+#endif
+          vst1q_f32(out_base + out_offset, vo);
+        }  // w
+
+        // right
+        for (; w < out_width; ++w) {
+          DepthwiseConv2dDilatedPixel(in_base, filter_ptr, h, w, h - pad_top,
+                                      w - pad_left, out_width, in_height,
+                                      in_width, dilation_hw, out_base);
+        }
+      }  // h
+#else
+      for (; h < valid_h_stop; ++h) {
+        for (w = 0; w < out_width; ++w) {
+          DepthwiseConv2dDilatedPixel(in_base, filter_ptr, h, w, h - pad_top,
+                                      w - pad_left, out_width, in_height,
+                                      in_width, dilation_hw, out_base);
+        }
+      }
+#endif
+
+      // bottom
+      for (; h < out_shape[2]; ++h) {
+        for (w = 0; w < out_width; ++w) {
+          DepthwiseConv2dDilatedPixel(in_base, filter_ptr, h, w, h - pad_top,
+                                      w - pad_left, out_width, in_height,
+                                      in_width, dilation_hw, out_base);
+        }
+      }
+    }  // m
+  }    // b
+}
+
 }  // namespace ops
 }  // namespace mace
@@ -0,0 +1,305 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#if defined(MACE_ENABLE_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "mace/core/macros.h"
+#include "mace/ops/arm/depthwise_conv2d_neon.h"
+
+namespace mace {
+namespace ops {
+
+namespace {
+void DepthwiseConv2dPixel(const float *in_base,
+                          const float *filter,
+                          const index_t out_h,
+                          const index_t out_w,
+                          const index_t in_h_start,
+                          const index_t in_w_start,
+                          const index_t out_width,
+                          const index_t in_height,
+                          const index_t in_width,
+                          float *out_base) {
+  float sum = 0;
+  for (int i = 0; i < 5; ++i) {
+    for (int j = 0; j < 5; ++j) {
+      index_t in_h = in_h_start + i;
+      index_t in_w = in_w_start + j;
+      if (in_h >= 0 && in_h < in_height && in_w >= 0 && in_w < in_width) {
+        sum += in_base[in_h * in_width + in_w] * filter[i * 5 + j];
+      }
+    }
+  }
+  out_base[out_h * out_width + out_w] = sum;
+}
+
+#if defined(MACE_ENABLE_NEON)
+inline float32x4_t MulAdd(float32x4_t vo, float32x4_t vi, const float f) {
+#if defined(__aarch64__)
+  return vfmaq_n_f32(vo, vi, f);
+#else
+  return vmlaq_n_f32(vo, vi, f);
+#endif
+}
+
+// vo += the 5 slides (vi0 ~ vi4) of an input row x a filter row
+inline float32x4_t MulAddRow(float32x4_t vo,
+                             float32x4_t vi0,
+                             float32x4_t vi1,
+                             float32x4_t vi2,
+                             float32x4_t vi3,
+                             float32x4_t vi4,
+                             const float *filter) {
+  vo = MulAdd(vo, vi0, filter[0]);
+  vo = MulAdd(vo, vi1, filter[1]);
+  vo = MulAdd(vo, vi2, filter[2]);
+  vo = MulAdd(vo, vi3, filter[3]);
+  return MulAdd(vo, vi4, filter[4]);
+}
+#endif
+}  // namespace
+
+// Ho = 2, Wo = 4, Co = 1
+void DepthwiseConv2dNeonK5x5S1(const float *input,
+                               const float *filter,
+                               const index_t *in_shape,
+                               const index_t *out_shape,
+                               const int *pad_hw,
+                               const index_t valid_h_start,
+                               const index_t valid_h_stop,
+                               const index_t valid_w_start,
+                               const index_t valid_w_stop,
+                               float *output) {
+#if !defined(MACE_ENABLE_NEON)
+  MACE_UNUSED(valid_w_start);
+  MACE_UNUSED(valid_w_stop);
+#endif
+  const index_t multiplier = out_shape[1] / in_shape[1];
+  const index_t in_image_size = in_shape[2] * in_shape[3];
+  const index_t out_image_size = out_shape[2] * out_shape[3];
+  const index_t in_batch_size = in_shape[1] * in_image_size;
+  const index_t out_batch_size = out_shape[1] * out_image_size;
+
+#pragma omp parallel for collapse(2) schedule(runtime)
+  for (index_t b = 0; b < in_shape[0]; ++b) {
+    for (index_t m = 0; m < out_shape[1]; ++m) {
+      index_t c = m / multiplier;
+      index_t multi_index = m % multiplier;
+      const float *in_base = input + b * in_batch_size + c * in_image_size;
+      const float *filter_ptr =
+          filter + multi_index * in_shape[1] * 25 + c * 25;
+      float *out_base = output + b * out_batch_size + m * out_image_size;
+      index_t h, w;
+      const index_t pad_top = pad_hw[0];
+      const index_t pad_left = pad_hw[1];
+      const index_t out_width = out_shape[3];
+      const index_t in_height = in_shape[2];
+      const index_t in_width = in_shape[3];
+
+      // top
+      for (h = 0; h < valid_h_start; ++h) {
+        for (w = 0; w < out_width; ++w) {
+          DepthwiseConv2dPixel(in_base, filter_ptr, h, w, h - pad_top,
+                               w - pad_left, out_width, in_height, in_width,
+                               out_base);
+        }
+      }
+
+#if defined(MACE_ENABLE_NEON)
+      for (h = valid_h_start; h + 1 < valid_h_stop; h += 2) {
+        // left
+        for (w = 0; w < valid_w_start; ++w) {
+          DepthwiseConv2dPixel(in_base, filter_ptr, h, w, h - pad_top,
+                               w - pad_left, out_width, in_height, in_width,
+                               out_base);
+          DepthwiseConv2dPixel(in_base, filter_ptr, h + 1, w, h + 1 - pad_top,
+                               w - pad_left, out_width, in_height, in_width,
+                               out_base);
+        }
+
+        for (w = valid_w_start; w + 3 < valid_w_stop; w += 4) {
+          // output (1 outch x 2 height x 4 width): vo_outch_height
+          index_t out_offset = h * out_width + w;
+          float32x4_t vo00 = vld1q_f32(out_base + out_offset);
+          float32x4_t vo01 = vld1q_f32(out_base + out_offset + out_width);
+
+          // input rows 0 ~ 4 make output row 0, rows 1 ~ 5 output row 1
+          const float *in_ptr =
+              in_base + (h - pad_top) * in_width + w - pad_left;
+          for (int r = 0; r < 6; ++r) {
+            // input (1 height x 5 slide): vi_slide
+            float32x4_t vi0 = vld1q_f32(in_ptr + r * in_width);
+            float32x4_t vi4 = vld1q_f32(in_ptr + r * in_width + 4);
+            float32x4_t vi1 = vextq_f32(vi0, vi4, 1);
+            float32x4_t vi2 = vextq_f32(vi0, vi4, 2);
+            float32x4_t vi3 = vextq_f32(vi0, vi4, 3);
+            if (r < 5) {
+              vo00 = MulAddRow(vo00, vi0, vi1, vi2, vi3, vi4,
+                               filter_ptr + r * 5);
+            }
+            if (r > 0) {
+              vo01 = MulAddRow(vo01, vi0, vi1, vi2, vi3, vi4,
+                               filter_ptr + (r - 1) * 5);
+            }
+          }
+
+          vst1q_f32(out_base + out_offset, vo00);
+          vst1q_f32(out_base + out_offset + out_width, vo01);
+        }  // w
+
+        // right
+        for (; w < out_width; ++w) {
+          DepthwiseConv2dPixel(in_base, filter_ptr, h, w, h - pad_top,
+                               w - pad_left, out_width, in_height, in_width,
+                               out_base);
+          DepthwiseConv2dPixel(in_base, filter_ptr, h + 1, w, h + 1 - pad_top,
+                               w - pad_left, out_width, in_height, in_width,
+                               out_base);
+        }
+      }  // h
+#else
+      for (; h < valid_h_stop; ++h) {
+        for (w = 0; w < out_width; ++w) {
+          DepthwiseConv2dPixel(in_base, filter_ptr, h, w, h - pad_top,
+                               w - pad_left, out_width, in_height, in_width,
+                               out_base);
+        }
+      }
+#endif
+
+      // bottom
+      for (; h < out_shape[2]; ++h) {
+        for (w = 0; w < out_width; ++w) {
+          DepthwiseConv2dPixel(in_base, filter_ptr, h, w, h - pad_top,
+                               w - pad_left, out_width, in_height, in_width,
+                               out_base);
+        }
+      }
+    }  // m
+  }    // b
+}
+
+// Ho = 1, Wo = 4, Co = 1
+void DepthwiseConv2dNeonK5x5S2(const float *input,
+                               const float *filter,
+                               const index_t *in_shape,
+                               const index_t *out_shape,
+                               const int *pad_hw,
+                               const index_t valid_h_start,
+                               const index_t valid_h_stop,
+                               const index_t valid_w_start,
+                               const index_t valid_w_stop,
+                               float *output) {
+#if !defined(MACE_ENABLE_NEON)
+  MACE_UNUSED(valid_w_start);
+  MACE_UNUSED(valid_w_stop);
+#endif
+  const index_t multiplier = out_shape[1] / in_shape[1];
+  const index_t in_image_size = in_shape[2] * in_shape[3];
+  const index_t out_image_size = out_shape[2] * out_shape[3];
+  const index_t in_batch_size = in_shape[1] * in_image_size;
+  const index_t out_batch_size = out_shape[1] * out_image_size;
+
+#pragma omp parallel for collapse(2) schedule(runtime)
+  for (index_t b = 0; b < in_shape[0]; ++b) {
+    for (index_t m = 0; m < out_shape[1]; ++m) {
+      index_t c = m / multiplier;
+      index_t multi_index = m % multiplier;
+      const float *in_base = input + b * in_batch_size + c * in_image_size;
+      const float *filter_ptr =
+          filter + multi_index * in_shape[1] * 25 + c * 25;
+      float *out_base = output + b * out_batch_size + m * out_image_size;
+      index_t h, w;
+      const index_t pad_top = pad_hw[0];
+      const index_t pad_left = pad_hw[1];
+      const index_t out_width = out_shape[3];
+      const index_t in_height = in_shape[2];
+      const index_t in_width = in_shape[3];
+
+      // top
+      for (h = 0; h < valid_h_start; ++h) {
+        for (w = 0; w < out_width; ++w) {
+          DepthwiseConv2dPixel(in_base, filter_ptr, h, w, h * 2 - pad_top,
+                               w * 2 - pad_left, out_width, in_height,
+                               in_width, out_base);
+        }
+      }
+
+#if defined(MACE_ENABLE_NEON)
+      for (h = valid_h_start; h < valid_h_stop; ++h) {
+        // left
+        for (w = 0; w < valid_w_start; ++w) {
+          DepthwiseConv2dPixel(in_base, filter_ptr, h, w, h * 2 - pad_top,
+                               w * 2 - pad_left, out_width, in_height,
+                               in_width, out_base);
+        }
+
+        for (w = valid_w_start; w + 3 < valid_w_stop; w += 4) {
+          // output (1 outch x 1 height x 4 width): vo
+          index_t out_offset = h * out_width + w;
+          float32x4_t vo = vld1q_f32(out_base + out_offset);
+
+          const float *in_ptr =
+              in_base + (h * 2 - pad_top) * in_width + w * 2 - pad_left;
+          for (int r = 0; r < 5; ++r) {
+            const float *in_row = in_ptr + r * in_width;
+            float32x4x2_t vi = vld2q_f32(in_row);  // [0.2.4.6, 1.3.5.7]
+            float32x4_t vin = vld1q_f32(in_row + 8);  // [8.9.10.11]
+            float32x4x2_t vin2 = vuzpq_f32(vin, vin);  // [8.10.., 9.11..]
+
+            // input (1 height x 5 slide): vi_slide
+            float32x4_t vi0 = vi.val[0];                      // [0.2.4.6]
+            float32x4_t vi1 = vi.val[1];                      // [1.3.5.7]
+            float32x4_t vi2 = vextq_f32(vi0, vin2.val[0], 1);  // [2.4.6.8]
+            float32x4_t vi3 = vextq_f32(vi1, vin2.val[1], 1);  // [3.5.7.9]
+            float32x4_t vi4 = vextq_f32(vi0, vin2.val[0], 2);  // [4.6.8.10]
+            vo = MulAddRow(vo, vi0, vi1, vi2, vi3, vi4, filter_ptr + r * 5);
+          }
+
+          vst1q_f32(out_base + out_offset, vo);
+        }  // w
+
+        // right
+        for (; w < out_width; ++w) {
+          DepthwiseConv2dPixel(in_base, filter_ptr, h, w, h * 2 - pad_top,
+                               w * 2 - pad_left, out_width, in_height,
+                               in_width, out_base);
+        }
+      }  // h
+#else
+      for (; h < valid_h_stop; ++h) {
+        for (w = 0; w < out_width; ++w) {
+          DepthwiseConv2dPixel(in_base, filter_ptr, h, w, h * 2 - pad_top,
+                               w * 2 - pad_left, out_width, in_height,
+                               in_width, out_base);
+        }
+      }
+#endif
+
+      // bottom
+      for (; h < out_shape[2]; ++h) {
+        for (w = 0; w < out_width; ++w) {
+          DepthwiseConv2dPixel(in_base, filter_ptr, h, w, h * 2 - pad_top,
+                               w * 2 - pad_left, out_width, in_height,
+                               in_width, out_base);
+        }
+      }
+    }  // m
+  }    // b
+}
+
+}  // namespace ops
+}  // namespace mace
@@ -0,0 +1,165 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "mace/ops/arm/depthwise_conv2d_neon.h"
+#include "mace/ops/testing/test_utils.h"
+
+namespace mace {
+namespace ops {
+namespace test {
+
+namespace {
+
+// a depthwise conv of multiplier 1 over the channels of the input, whose
+// output is returned
+std::vector<float> TestDepthwiseConv2d(
+    const std::vector<index_t> &in_shape,
+    const std::vector<float> &input,
+    const std::vector<float> &filter,
+    const int kernel,
+    const int stride,
+    const int dilation,
+    const int pad,
+    const DepthwiseConv2dK3x3S1Kernel k3x3s1_kernel = DEPTHWISE_K3X3S1_AUTO) {
+  const int span = (kernel - 1) * dilation + 1;
+  const std::vector<index_t> out_shape = {
+      in_shape[0], in_shape[1], (in_shape[2] + 2 * pad - span) / stride + 1,
+      (in_shape[3] + 2 * pad - span) / stride + 1};
+  const int pad_hw[2] = {pad, pad};
+  const int dilation_hw[2] = {dilation, dilation};
+
+  // the output rows and columns whose filter windows are inside the input
+  const index_t valid_h_start = std::min<index_t>(
+      out_shape[2], (pad + stride - 1) / stride);
+  const index_t valid_h_stop = out_shape[2] - (pad + stride - 1) / stride;
+  const index_t valid_w_start = std::min<index_t>(
+      out_shape[3], (pad + stride - 1) / stride);
+  const index_t valid_w_stop = out_shape[3] - (pad + stride - 1) / stride;
+
+  std::vector<float> output(
+      out_shape[0] * out_shape[1] * out_shape[2] * out_shape[3], 0);
+  if (dilation > 1) {
+    DepthwiseConv2dNeonK3x3Dilated(input.data(), filter.data(),
+                                   in_shape.data(), out_shape.data(), pad_hw,
+                                   dilation_hw, valid_h_start, valid_h_stop,
+                                   valid_w_start, valid_w_stop,
+                                   output.data());
+  } else if (kernel == 3 && stride == 1) {
+    DepthwiseConv2dNeonK3x3S1(input.data(), filter.data(), in_shape.data(),
+                              out_shape.data(), pad_hw, valid_h_start,
+                              valid_h_stop, valid_w_start, valid_w_stop,
+                              output.data(), k3x3s1_kernel);
+  } else if (kernel == 5 && stride == 1) {
+    DepthwiseConv2dNeonK5x5S1(input.data(), filter.data(), in_shape.data(),
+                              out_shape.data(), pad_hw, valid_h_start,
+                              valid_h_stop, valid_w_start, valid_w_stop,
+                              output.data());
+  } else {
+    DepthwiseConv2dNeonK5x5S2(input.data(), filter.data(), in_shape.data(),
+                              out_shape.data(), pad_hw, valid_h_start,
+                              valid_h_stop, valid_w_start, valid_w_stop,
+                              output.data());
+  }
+
+  for (index_t b = 0; b < out_shape[0]; ++b) {
+    for (index_t c = 0; c < out_shape[1]; ++c) {
+      for (index_t h = 0; h < out_shape[2]; ++h) {
+        for (index_t w = 0; w < out_shape[3]; ++w) {
+          float sum = 0;
+          for (index_t kh = 0; kh < kernel; ++kh) {
+            for (index_t kw = 0; kw < kernel; ++kw) {
+              const index_t ih = h * stride + kh * dilation - pad;
+              const index_t iw = w * stride + kw * dilation - pad;
+              if (ih < 0 || ih >= in_shape[2] || iw < 0 ||
+                  iw >= in_shape[3]) {
+                continue;
+              }
+              sum += input[((b * in_shape[1] + c) * in_shape[2] + ih)
+                               * in_shape[3] + iw] *
+                  filter[(c * kernel + kh) * kernel + kw];
+            }
+          }
+          const index_t index =
+              ((b * out_shape[1] + c) * out_shape[2] + h) * out_shape[3] + w;
+          EXPECT_NEAR(sum, output[index], 1e-5) << " with index " << index;
+        }
+      }
+    }
+  }
+  return output;
+}
+
+std::vector<float> TestDepthwiseConv2d(const std::vector<index_t> &in_shape,
+                                       const int kernel,
+                                       const int stride,
+                                       const int dilation,
+                                       const int pad) {
+  std::vector<float> input, filter;
+  GenerateRandomRealTypeData(in_shape, &input, false);
+  GenerateRandomRealTypeData({in_shape[1], kernel, kernel}, &filter, false);
+  return TestDepthwiseConv2d(in_shape, input, filter, kernel, stride,
+                             dilation, pad);
+}
+
+}  // namespace
+
+TEST(DepthwiseConv2dNeonTest, K3x3S1) {
+  const std::vector<std::vector<index_t>> in_shapes = {
+      {1, 3, 16, 16}, {2, 4, 13, 19}, {1, 2, 10, 35}, {1, 2, 2, 3}};
+  for (const auto &in_shape : in_shapes) {
+    std::vector<float> input, filter;
+    GenerateRandomRealTypeData(in_shape, &input, false);
+    GenerateRandomRealTypeData({in_shape[1], 3, 3}, &filter, false);
+    for (int pad : {0, 1}) {
+      // the assembly of either kind of core sums as the intrinsics do
+      const std::vector<float> expected = TestDepthwiseConv2d(
+          in_shape, input, filter, 3, 1, 1, pad, DEPTHWISE_K3X3S1_INTRINSICS);
+      for (auto k3x3s1_kernel : {DEPTHWISE_K3X3S1_ASM_IN_ORDER,
+                                 DEPTHWISE_K3X3S1_ASM_OUT_OF_ORDER,
+                                 DEPTHWISE_K3X3S1_AUTO}) {
+        EXPECT_EQ(expected, TestDepthwiseConv2d(in_shape, input, filter, 3, 1,
+                                                1, pad, k3x3s1_kernel));
+      }
+    }
+  }
+}
+
+TEST(DepthwiseConv2dNeonTest, K5x5S1) {
+  TestDepthwiseConv2d({1, 3, 16, 16}, 5, 1, 1, 2);
+  TestDepthwiseConv2d({2, 4, 13, 19}, 5, 1, 1, 2);
+  TestDepthwiseConv2d({1, 2, 11, 10}, 5, 1, 1, 0);
+  TestDepthwiseConv2d({1, 2, 1, 3}, 5, 1, 1, 2);
+}
+
+TEST(DepthwiseConv2dNeonTest, K5x5S2) {
+  TestDepthwiseConv2d({1, 3, 16, 16}, 5, 2, 1, 2);
+  TestDepthwiseConv2d({2, 4, 23, 17}, 5, 2, 1, 2);
+  TestDepthwiseConv2d({1, 2, 15, 21}, 5, 2, 1, 0);
+}
+
+TEST(DepthwiseConv2dNeonTest, K3x3Dilated) {
+  TestDepthwiseConv2d({1, 3, 16, 16}, 3, 1, 2, 2);
+  TestDepthwiseConv2d({2, 4, 19, 23}, 3, 1, 4, 4);
+  TestDepthwiseConv2d({1, 2, 14, 15}, 3, 1, 2, 0);
+  TestDepthwiseConv2d({1, 2, 5, 6}, 3, 1, 6, 6);
+}
+
+}  // namespace test
+}  // namespace ops
+}  // namespace mace
@@ -0,0 +1,180 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/ops/arm/depthwise_pointwise_conv2d.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "mace/ops/activation.h"
+
+namespace mace {
+namespace ops {
+
+namespace {
+
+// floats of the depthwise output of a tile, to stay in the L2 cache
+constexpr index_t kScratchSize = 16 * 1024;
+// output channels of the 1x1 conv computed together, which reuse each row
+// of the depthwise output
+constexpr index_t kPointwiseBlock = 4;
+
+// a row of the depthwise 3x3 output of a channel
+void DepthwiseRow(const float *in_plane,
+                  const index_t in_height,
+                  const index_t in_width,
+                  const float *filter,
+                  const float bias,
+                  const int *stride_hw,
+                  const int *pad_hw,
+                  const index_t out_h,
+                  const index_t out_width,
+                  float *out_row) {
+  std::fill(out_row, out_row + out_width, bias);
+  const int stride_w = stride_hw[1];
+  for (int kh = 0; kh < 3; ++kh) {
+    const index_t ih = out_h * stride_hw[0] - pad_hw[0] + kh;
+    if (ih < 0 || ih >= in_height) {
+      continue;
+    }
+    const float *in_row = in_plane + ih * in_width;
+    for (int kw = 0; kw < 3; ++kw) {
+      // the output pixels reading inside the row
+      const index_t offset = kw - pad_hw[1];
+      const index_t begin =
+          offset >= 0 ? 0 : (-offset + stride_w - 1) / stride_w;
+      const index_t last = in_width - 1 - offset;
+      const index_t end =
+          last < 0 ? 0 : std::min<index_t>(out_width, last / stride_w + 1);
+      const float weight = filter[kh * 3 + kw];
+      for (index_t ow = begin; ow < end; ++ow) {
+        out_row[ow] += weight * in_row[ow * stride_w + offset];
+      }
+    }
+  }
+}
+
+// output[co] = bias[co] + sum(filter[co][c] * input[c]) for size pixels,
+// out_image_size apart between the planes of the output
+void PointwiseTile(const float *input,
+                   const index_t channels,
+                   const index_t size,
+                   const float *filter,
+                   const float *bias,
+                   const index_t out_channels,
+                   const index_t out_image_size,
+                   float *output) {
+  index_t co = 0;
+  for (; co + kPointwiseBlock <= out_channels; co += kPointwiseBlock) {
+    float *out[kPointwiseBlock];
+    for (index_t k = 0; k < kPointwiseBlock; ++k) {
+      out[k] = output + (co + k) * out_image_size;
+      std::fill(out[k], out[k] + size, bias == nullptr ? 0.f : bias[co + k]);
+    }
+    float *out0 = out[0];
+    float *out1 = out[1];
+    float *out2 = out[2];
+    float *out3 = out[3];
+    for (index_t c = 0; c < channels; ++c) {
+      const float *in = input + c * size;
+      const float w0 = filter[co * channels + c];
+      const float w1 = filter[(co + 1) * channels + c];
+      const float w2 = filter[(co + 2) * channels + c];
+      const float w3 = filter[(co + 3) * channels + c];
+      for (index_t i = 0; i < size; ++i) {
+        out0[i] += w0 * in[i];
+        out1[i] += w1 * in[i];
+        out2[i] += w2 * in[i];
+        out3[i] += w3 * in[i];
+      }
+    }
+  }
+  for (; co < out_channels; ++co) {
+    float *out = output + co * out_image_size;
+    std::fill(out, out + size, bias == nullptr ? 0.f : bias[co]);
+    for (index_t c = 0; c < channels; ++c) {
+      const float *in = input + c * size;
+      const float w = filter[co * channels + c];
+      for (index_t i = 0; i < size; ++i) {
+        out[i] += w * in[i];
+      }
+    }
+  }
+}
+
+}  // namespace
+
+void DepthwisePointwiseConv2d(const float *input,
+                              const float *dw_filter,
+                              const float *dw_bias,
+                              const ActivationParams &dw_activation,
+                              const float *pw_filter,
+                              const float *pw_bias,
+                              const ActivationParams &pw_activation,
+                              const index_t *in_shape,
+                              const index_t *out_shape,
+                              const int *stride_hw,
+                              const int *pad_hw,
+                              float *output) {
+  const index_t batch = in_shape[0];
+  const index_t channels = in_shape[1];
+  const index_t in_height = in_shape[2];
+  const index_t in_width = in_shape[3];
+  const index_t out_channels = out_shape[1];
+  const index_t out_height = out_shape[2];
+  const index_t out_width = out_shape[3];
+  const index_t in_image_size = in_height * in_width;
+  const index_t out_image_size = out_height * out_width;
+
+  const index_t tile_height = std::max<index_t>(
+      1, std::min(out_height, kScratchSize / (channels * out_width)));
+  const index_t tiles = (out_height + tile_height - 1) / tile_height;
+
+#pragma omp parallel
+  {
+    std::vector<float> scratch(channels * tile_height * out_width);
+#pragma omp for collapse(2) schedule(runtime)
+    for (index_t b = 0; b < batch; ++b) {
+      for (index_t t = 0; t < tiles; ++t) {
+        const index_t h_begin = t * tile_height;
+        const index_t h_end = std::min(out_height, h_begin + tile_height);
+        const index_t size = (h_end - h_begin) * out_width;
+        for (index_t c = 0; c < channels; ++c) {
+          const float *in_plane =
+              input + (b * channels + c) * in_image_size;
+          for (index_t h = h_begin; h < h_end; ++h) {
+            DepthwiseRow(in_plane, in_height, in_width, dw_filter + c * 9,
+                         dw_bias == nullptr ? 0.f : dw_bias[c], stride_hw,
+                         pad_hw, h, out_width,
+                         scratch.data() + c * size + (h - h_begin) * out_width);
+          }
+        }
+        DoActivation(scratch.data(), scratch.data(), channels * size,
+                     dw_activation.type, dw_activation.relux_max_limit,
+                     dw_activation.leakyrelu_coefficient);
+        PointwiseTile(scratch.data(), channels, size, pw_filter, pw_bias,
+                      out_channels, out_image_size,
+                      output + b * out_channels * out_image_size +
+                          h_begin * out_width);
+      }
+    }
+  }
+
+  DoActivation(output, output, batch * out_channels * out_image_size,
+               pw_activation.type, pw_activation.relux_max_limit,
+               pw_activation.leakyrelu_coefficient);
+}
+
+}  // namespace ops
+}  // namespace mace
@@ -0,0 +1,54 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_OPS_ARM_DEPTHWISE_POINTWISE_CONV2D_H_
+#define MACE_OPS_ARM_DEPTHWISE_POINTWISE_CONV2D_H_
+
+#include "mace/core/types.h"
+#include "mace/ops/common/activation_type.h"
+
+// The depthwise 3x3 conv of multiplier 1 and the 1x1 conv reading it, as in
+// the blocks of MobileNet, run together over tiles of output rows. The
+// depthwise output of a tile stays in a scratch sized for the cache and is
+// read there by the 1x1 conv, instead of a whole tensor written to and read
+// back from the memory. Tensors are NCHW.
+
+namespace mace {
+namespace ops {
+
+struct ActivationParams {
+  ActivationType type;
+  float relux_max_limit;
+  float leakyrelu_coefficient;
+};
+
+// dw_filter is [1, C, 3, 3] and pw_filter [C_out, C, 1, 1], the biases may
+// be null. in_shape and out_shape are NCHW, of C and C_out channels.
+void DepthwisePointwiseConv2d(const float *input,
+                              const float *dw_filter,
+                              const float *dw_bias,
+                              const ActivationParams &dw_activation,
+                              const float *pw_filter,
+                              const float *pw_bias,
+                              const ActivationParams &pw_activation,
+                              const index_t *in_shape,
+                              const index_t *out_shape,
+                              const int *stride_hw,
+                              const int *pad_hw,
+                              float *output);
+
+}  // namespace ops
+}  // namespace mace
+
+#endif  // MACE_OPS_ARM_DEPTHWISE_POINTWISE_CONV2D_H_
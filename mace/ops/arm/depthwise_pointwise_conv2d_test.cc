@@ -0,0 +1,138 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "mace/ops/arm/depthwise_pointwise_conv2d.h"
+#include "mace/ops/testing/test_utils.h"
+
+namespace mace {
+namespace ops {
+namespace test {
+
+namespace {
+
+float Activate(const float value, const ActivationParams &activation) {
+  switch (activation.type) {
+    case RELU:
+      return std::max(value, 0.f);
+    case RELUX:
+      return std::min(std::max(value, 0.f), activation.relux_max_limit);
+    default:
+      return value;
+  }
+}
+
+index_t OutputSize(const index_t in_size, const int stride, const int pad) {
+  return (in_size + 2 * pad - 3) / stride + 1;
+}
+
+void TestDepthwisePointwiseConv2d(const std::vector<index_t> &in_shape,
+                                  const index_t out_channels,
+                                  const int stride,
+                                  const int pad,
+                                  const ActivationParams &dw_activation,
+                                  const ActivationParams &pw_activation) {
+  const index_t channels = in_shape[1];
+  const std::vector<index_t> out_shape = {
+      in_shape[0], out_channels, OutputSize(in_shape[2], stride, pad),
+      OutputSize(in_shape[3], stride, pad)};
+  std::vector<float> input, dw_filter, dw_bias, pw_filter, pw_bias;
+  GenerateRandomRealTypeData(in_shape, &input, false);
+  GenerateRandomRealTypeData({channels, 3, 3}, &dw_filter, false);
+  GenerateRandomRealTypeData({channels}, &dw_bias, false);
+  GenerateRandomRealTypeData({out_channels, channels}, &pw_filter, false);
+  GenerateRandomRealTypeData({out_channels}, &pw_bias, false);
+  const int stride_hw[2] = {stride, stride};
+  const int pad_hw[2] = {pad, pad};
+
+  const index_t out_height = out_shape[2];
+  const index_t out_width = out_shape[3];
+  std::vector<float> output(
+      out_shape[0] * out_channels * out_height * out_width);
+  DepthwisePointwiseConv2d(input.data(), dw_filter.data(), dw_bias.data(),
+                           dw_activation, pw_filter.data(), pw_bias.data(),
+                           pw_activation, in_shape.data(), out_shape.data(),
+                           stride_hw, pad_hw, output.data());
+
+  std::vector<float> depthwise(channels * out_height * out_width);
+  for (index_t b = 0; b < in_shape[0]; ++b) {
+    for (index_t c = 0; c < channels; ++c) {
+      for (index_t h = 0; h < out_height; ++h) {
+        for (index_t w = 0; w < out_width; ++w) {
+          float sum = dw_bias[c];
+          for (index_t kh = 0; kh < 3; ++kh) {
+            for (index_t kw = 0; kw < 3; ++kw) {
+              const index_t ih = h * stride + kh - pad;
+              const index_t iw = w * stride + kw - pad;
+              if (ih < 0 || ih >= in_shape[2] || iw < 0 ||
+                  iw >= in_shape[3]) {
+                continue;
+              }
+              sum += input[((b * channels + c) * in_shape[2] + ih)
+                               * in_shape[3] + iw] *
+                  dw_filter[c * 9 + kh * 3 + kw];
+            }
+          }
+          depthwise[(c * out_height + h) * out_width + w] =
+              Activate(sum, dw_activation);
+        }
+      }
+    }
+    for (index_t m = 0; m < out_channels; ++m) {
+      for (index_t i = 0; i < out_height * out_width; ++i) {
+        float sum = pw_bias[m];
+        for (index_t c = 0; c < channels; ++c) {
+          sum += pw_filter[m * channels + c] *
+              depthwise[c * out_height * out_width + i];
+        }
+        const index_t index = (b * out_channels + m) * out_height * out_width
+            + i;
+        EXPECT_NEAR(Activate(sum, pw_activation), output[index], 1e-4)
+            << " with index " << index;
+      }
+    }
+  }
+}
+
+}  // namespace
+
+TEST(DepthwisePointwiseConv2dTest, Conv2d) {
+  const ActivationParams noop = {NOOP, 0.f, 0.f};
+  TestDepthwisePointwiseConv2d({1, 8, 9, 11}, 16, 1, 1, noop, noop);
+  TestDepthwisePointwiseConv2d({2, 5, 10, 13}, 7, 2, 1, noop, noop);
+  TestDepthwisePointwiseConv2d({1, 6, 8, 7}, 3, 1, 0, noop, noop);
+  TestDepthwisePointwiseConv2d({1, 4, 12, 9}, 6, 2, 0, noop, noop);
+}
+
+TEST(DepthwisePointwiseConv2dTest, Tiles) {
+  // the depthwise output spans several tiles
+  const ActivationParams noop = {NOOP, 0.f, 0.f};
+  TestDepthwisePointwiseConv2d({1, 64, 30, 40}, 33, 1, 1, noop, noop);
+  TestDepthwisePointwiseConv2d({2, 96, 29, 57}, 24, 2, 1, noop, noop);
+}
+
+TEST(DepthwisePointwiseConv2dTest, Activation) {
+  const ActivationParams relu = {RELU, 0.f, 0.f};
+  const ActivationParams relux = {RELUX, 0.5f, 0.f};
+  TestDepthwisePointwiseConv2d({1, 16, 14, 14}, 12, 1, 1, relu, relux);
+  TestDepthwisePointwiseConv2d({1, 16, 14, 14}, 9, 2, 1, relux, relu);
+}
+
+}  // namespace test
+}  // namespace ops
+}  // namespace mace
@@ -0,0 +1,143 @@
+// Copyright 2018 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/ops/arm/fp16/activation.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "mace/ops/arm/fp16/fp16.h"
+#include "mace/utils/logging.h"
+
+namespace mace {
+namespace ops {
+namespace arm {
+namespace fp16 {
+
+namespace {
+
+// one loop per type, so that the compiler vectorizes them
+void BiasActivationRow(const fp16_t *input,
+                       const index_t size,
+                       const fp16_t bias,
+                       const fp16_t alpha,
+                       const ActivationType type,
+                       const fp16_t relux_max_limit,
+                       const fp16_t leakyrelu_coefficient,
+                       fp16_t *output) {
+  const fp16_t zero = static_cast<fp16_t>(0.f);
+  switch (type) {
+    case NOOP:
+      for (index_t i = 0; i < size; ++i) {
+        output[i] = input[i] + bias;
+      }
+      break;
+    case RELU:
+      for (index_t i = 0; i < size; ++i) {
+        output[i] = std::max<fp16_t>(input[i] + bias, zero);
+      }
+      break;
+    case RELUX:
+      for (index_t i = 0; i < size; ++i) {
+        output[i] = std::min<fp16_t>(std::max<fp16_t>(input[i] + bias, zero),
+                                     relux_max_limit);
+      }
+      break;
+    case PRELU:
+      for (index_t i = 0; i < size; ++i) {
+        const fp16_t value = input[i] + bias;
+        output[i] = value < zero ? static_cast<fp16_t>(value * alpha) : value;
+      }
+      break;
+    case LEAKYRELU:
+      for (index_t i = 0; i < size; ++i) {
+        const fp16_t value = input[i] + bias;
+        output[i] = value < zero ?
+                    static_cast<fp16_t>(value * leakyrelu_coefficient) : value;
+      }
+      break;
+    case TANH:
+      for (index_t i = 0; i < size; ++i) {
+        output[i] = static_cast<fp16_t>(
+            std::tanh(static_cast<float>(input[i] + bias)));
+      }
+      break;
+    case SIGMOID:
+      for (index_t i = 0; i < size; ++i) {
+        output[i] = static_cast<fp16_t>(
+            1.f / (1.f + std::exp(-static_cast<float>(input[i] + bias))));
+      }
+      break;
+    case GELU:
+      for (index_t i = 0; i < size; ++i) {
+        const float x = static_cast<float>(input[i] + bias);
+        output[i] = static_cast<fp16_t>(0.5f * x * (1.f + std::tanh(
+            0.7978845608f * (x + 0.044715f * x * x * x))));
+      }
+      break;
+    default:
+      LOG(FATAL) << "Unknown activation type: " << type;
+  }
+}
+
+}  // namespace
+
+void BiasActivation(const half *input_data,
+                    const half *bias_data,
+                    const half *prelu_alpha_data,
+                    const index_t batch,
+                    const index_t channels,
+                    const index_t inner_size,
+                    const ActivationType type,
+                    const float relux_max_limit,
+                    const float leakyrelu_coefficient,
+                    half *output_data) {
+  const fp16_t *input = AsFp16(input_data);
+  const fp16_t *bias = AsFp16(bias_data);
+  const fp16_t *prelu_alpha = AsFp16(prelu_alpha_data);
+  fp16_t *output = AsFp16(output_data);
+  const fp16_t zero = static_cast<fp16_t>(0.f);
+  const fp16_t max_limit = static_cast<fp16_t>(relux_max_limit);
+  const fp16_t coefficient = static_cast<fp16_t>(leakyrelu_coefficient);
+#pragma omp parallel for collapse(2) schedule(runtime)
+  for (index_t b = 0; b < batch; ++b) {
+    for (index_t c = 0; c < channels; ++c) {
+      const index_t offset = (b * channels + c) * inner_size;
+      BiasActivationRow(input + offset,
+                        inner_size,
+                        bias == nullptr ? zero : bias[c],
+                        prelu_alpha == nullptr ? zero : prelu_alpha[c],
+                        type,
+                        max_limit,
+                        coefficient,
+                        output + offset);
+    }
+  }
+}
+
+void AddResidual(const half *residual_data,
+                 const index_t size,
+                 half *output_data) {
+  const fp16_t *residual = AsFp16(residual_data);
+  fp16_t *output = AsFp16(output_data);
+#pragma omp parallel for schedule(runtime)
+  for (index_t i = 0; i < size; ++i) {
+    output[i] += residual[i];
+  }
+}
+
+}  // namespace fp16
+}  // namespace arm
+}  // namespace ops
+}  // namespace mace
@@ -0,0 +1,47 @@
+// Copyright 2018 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_OPS_ARM_FP16_ACTIVATION_H_
+#define MACE_OPS_ARM_FP16_ACTIVATION_H_
+
+#include "mace/core/types.h"
+#include "mace/ops/common/activation_type.h"
+
+namespace mace {
+namespace ops {
+namespace arm {
+namespace fp16 {
+
+// output = activation(input + bias[c]) for NCHW tensors, in place if output
+// is input. bias and the per channel alpha of PRELU may be null.
+void BiasActivation(const half *input,
+                    const half *bias,
+                    const half *prelu_alpha,
+                    const index_t batch,
+                    const index_t channels,
+                    const index_t inner_size,
+                    const ActivationType type,
+                    const float relux_max_limit,
+                    const float leakyrelu_coefficient,
+                    half *output);
+
+// output += residual, of size elements
+void AddResidual(const half *residual, const index_t size, half *output);
+
+}  // namespace fp16
+}  // namespace arm
+}  // namespace ops
+}  // namespace mace
+
+#endif  // MACE_OPS_ARM_FP16_ACTIVATION_H_
@@ -0,0 +1,148 @@
+// Copyright 2018 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "mace/ops/arm/fp16/activation.h"
+#include "mace/ops/testing/test_utils.h"
+
+namespace mace {
+namespace ops {
+namespace test {
+
+namespace {
+
+// values rounded to half, and the floats they hold
+void GenerateHalfData(const index_t size,
+                      std::vector<half> *data,
+                      std::vector<float> *values) {
+  GenerateRandomRealTypeData<float>({size}, values, false);
+  data->resize(size);
+  for (index_t i = 0; i < size; ++i) {
+    (*data)[i] = half_float::half_cast<half>((*values)[i]);
+    (*values)[i] = (*data)[i];
+  }
+}
+
+float Activate(const float x,
+               const float alpha,
+               const ActivationType type,
+               const float relux_max_limit,
+               const float leakyrelu_coefficient) {
+  switch (type) {
+    case RELU:
+      return std::max(x, 0.f);
+    case RELUX:
+      return std::min(std::max(x, 0.f), relux_max_limit);
+    case PRELU:
+      return x < 0 ? x * alpha : x;
+    case LEAKYRELU:
+      return x < 0 ? x * leakyrelu_coefficient : x;
+    case TANH:
+      return std::tanh(x);
+    case SIGMOID:
+      return 1.f / (1.f + std::exp(-x));
+    case GELU:
+      return 0.5f * x * (1.f + std::tanh(
+          0.7978845608f * (x + 0.044715f * x * x * x)));
+    default:
+      return x;
+  }
+}
+
+}  // namespace
+
+void TestBiasActivationFp16(const index_t batch,
+                            const index_t channels,
+                            const index_t inner_size,
+                            const ActivationType type,
+                            const bool has_bias,
+                            const bool in_place) {
+  const index_t size = batch * channels * inner_size;
+  std::vector<half> input;
+  std::vector<half> bias;
+  std::vector<half> alpha;
+  std::vector<float> input_data;
+  std::vector<float> bias_data(channels, 0.f);
+  std::vector<float> alpha_data;
+  GenerateHalfData(size, &input, &input_data);
+  if (has_bias) {
+    GenerateHalfData(channels, &bias, &bias_data);
+  }
+  GenerateHalfData(channels, &alpha, &alpha_data);
+  const float relux_max_limit = 0.75f;
+  const float leakyrelu_coefficient = 0.125f;
+
+  std::vector<half> output(size);
+  half *output_data = in_place ? input.data() : output.data();
+  arm::fp16::BiasActivation(input.data(),
+                            has_bias ? bias.data() : nullptr,
+                            type == PRELU ? alpha.data() : nullptr,
+                            batch, channels, inner_size, type,
+                            relux_max_limit, leakyrelu_coefficient,
+                            output_data);
+
+  for (index_t b = 0; b < batch; ++b) {
+    for (index_t c = 0; c < channels; ++c) {
+      for (index_t i = 0; i < inner_size; ++i) {
+        const index_t index = (b * channels + c) * inner_size + i;
+        const float x = input_data[index] + bias_data[c];
+        const float expected = Activate(x, alpha_data[c], type,
+                                        relux_max_limit,
+                                        leakyrelu_coefficient);
+        // the sum and the result are both rounded to half
+        EXPECT_NEAR(expected, static_cast<float>(output_data[index]),
+                    2e-3 * (std::abs(x) + std::abs(expected)) + 1e-6)
+            << "with type " << type << ", index " << index;
+      }
+    }
+  }
+}
+
+TEST(ArmActivationFp16, BiasActivation) {
+  const ActivationType types[] = {NOOP, RELU, RELUX, PRELU, LEAKYRELU,
+                                  TANH, SIGMOID, GELU};
+  for (auto type : types) {
+    TestBiasActivationFp16(1, 16, 64, type, true, false);
+    // odd channels and inner sizes, which leave vector tails
+    TestBiasActivationFp16(2, 7, 13, type, true, false);
+    TestBiasActivationFp16(3, 5, 1, type, false, false);
+    TestBiasActivationFp16(1, 9, 31, type, true, true);
+  }
+}
+
+TEST(ArmActivationFp16, AddResidual) {
+  for (index_t size : {1, 7, 64, 1001}) {
+    std::vector<half> residual;
+    std::vector<half> output;
+    std::vector<float> residual_data;
+    std::vector<float> output_data;
+    GenerateHalfData(size, &residual, &residual_data);
+    GenerateHalfData(size, &output, &output_data);
+    arm::fp16::AddResidual(residual.data(), size, output.data());
+    for (index_t i = 0; i < size; ++i) {
+      const float expected = residual_data[i] + output_data[i];
+      EXPECT_NEAR(expected, static_cast<float>(output[i]),
+                  1e-3 * std::abs(expected) + 1e-6) << "with index " << i;
+    }
+  }
+}
+
+}  // namespace test
+}  // namespace ops
+}  // namespace mace
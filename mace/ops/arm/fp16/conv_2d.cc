@@ -0,0 +1,123 @@
+// Copyright 2018 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/ops/arm/fp16/conv_2d.h"
+
+#include <algorithm>
+
+#include "mace/ops/arm/fp16/fp16.h"
+
+namespace mace {
+namespace ops {
+namespace arm {
+namespace fp16 {
+
+namespace {
+
+void Im2Col(const fp16_t *input,
+            const index_t *in_shape,
+            const index_t *filter_shape,
+            const index_t *out_shape,
+            const int *stride_hw,
+            const int *dilation_hw,
+            const int *pad_hw,
+            fp16_t *col) {
+  const index_t in_height = in_shape[2];
+  const index_t in_width = in_shape[3];
+  const index_t filter_height = filter_shape[2];
+  const index_t filter_width = filter_shape[3];
+  const index_t out_height = out_shape[2];
+  const index_t out_width = out_shape[3];
+  const fp16_t zero = static_cast<fp16_t>(0.f);
+  // row (c, kh, kw) of col holds the input pixels that meet filter tap
+  // (kh, kw) of channel c over all the outputs
+#pragma omp parallel for collapse(3) schedule(runtime)
+  for (index_t c = 0; c < in_shape[1]; ++c) {
+    for (index_t kh = 0; kh < filter_height; ++kh) {
+      for (index_t kw = 0; kw < filter_width; ++kw) {
+        const fp16_t *in_channel = input + c * in_height * in_width;
+        fp16_t *col_row = col + ((c * filter_height + kh) * filter_width + kw)
+            * out_height * out_width;
+        for (index_t h = 0; h < out_height; ++h) {
+          const index_t ih = h * stride_hw[0] + kh * dilation_hw[0] - pad_hw[0];
+          fp16_t *col_ptr = col_row + h * out_width;
+          if (ih < 0 || ih >= in_height) {
+            std::fill(col_ptr, col_ptr + out_width, zero);
+            continue;
+          }
+          for (index_t w = 0; w < out_width; ++w) {
+            const index_t iw =
+                w * stride_hw[1] + kw * dilation_hw[1] - pad_hw[1];
+            col_ptr[w] = iw >= 0 && iw < in_width ?
+                         in_channel[ih * in_width + iw] : zero;
+          }
+        }
+      }
+    }
+  }
+}
+
+}  // namespace
+
+MaceStatus Conv2d::Compute(const OpContext *context,
+                           const Tensor *input,
+                           const Tensor *filter,
+                           const int *pad_hw,
+                           Tensor *output) {
+  const index_t in_shape[4] =
+      {input->dim(0), input->dim(1), input->dim(2), input->dim(3)};
+  const index_t filter_shape[4] =
+      {filter->dim(0), filter->dim(1), filter->dim(2), filter->dim(3)};
+  const index_t out_shape[4] =
+      {output->dim(0), output->dim(1), output->dim(2), output->dim(3)};
+  const index_t depth = filter_shape[1] * filter_shape[2] * filter_shape[3];
+  const index_t out_image_size = out_shape[2] * out_shape[3];
+  const index_t in_image_size = in_shape[1] * in_shape[2] * in_shape[3];
+  const bool use_input = filter_shape[2] == 1 && filter_shape[3] == 1
+      && strides_[0] == 1 && strides_[1] == 1
+      && pad_hw[0] == 0 && pad_hw[1] == 0
+      && out_shape[2] == in_shape[2] && out_shape[3] == in_shape[3];
+
+  ScratchBuffer *scratch = context->device()->scratch_buffer();
+  scratch->Rewind();
+  const index_t col_size = use_input ? 0 :
+      PadAlignSize(sizeof(half) * depth * out_image_size);
+  MACE_RETURN_IF_ERROR(scratch->GrowSize(
+      col_size + Gemm::ScratchSize(out_image_size, depth)));
+  half *col = use_input ? nullptr :
+      scratch->Scratch(col_size).mutable_data<half>();
+
+  Tensor::MappingGuard input_guard(input);
+  Tensor::MappingGuard output_guard(output);
+  const half *input_data = input->data<half>();
+  half *output_data = output->mutable_data<half>();
+  for (index_t b = 0; b < in_shape[0]; ++b) {
+    const half *rhs = input_data + b * in_image_size;
+    if (!use_input) {
+      Im2Col(AsFp16(rhs), in_shape, filter_shape, out_shape,
+             strides_.data(), dilations_.data(), pad_hw, AsFp16(col));
+      rhs = col;
+    }
+    MACE_RETURN_IF_ERROR(gemm_.Compute(
+        context, filter, rhs, out_shape[1], out_image_size, depth,
+        output_data + b * out_shape[1] * out_image_size));
+    scratch->Rewind(col_size);
+  }
+  return MaceStatus::MACE_SUCCESS;
+}
+
+}  // namespace fp16
+}  // namespace arm
+}  // namespace ops
+}  // namespace mace
@@ -0,0 +1,57 @@
+// Copyright 2018 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_OPS_ARM_FP16_CONV_2D_H_
+#define MACE_OPS_ARM_FP16_CONV_2D_H_
+
+#include <vector>
+
+#include "mace/core/op_context.h"
+#include "mace/core/tensor.h"
+#include "mace/ops/arm/fp16/gemm.h"
+#include "mace/public/mace.h"
+
+namespace mace {
+namespace ops {
+namespace arm {
+namespace fp16 {
+
+// NCHW half conv as the gemm of the OIHW filter, seen as a matrix of
+// out_channels x (in_channels * kh * kw), and the im2col matrix of the
+// input. 1x1 convs of stride 1 without padding use the input as it is.
+class Conv2d {
+ public:
+  Conv2d(const std::vector<int> &strides, const std::vector<int> &dilations)
+      : strides_(strides), dilations_(dilations) {}
+  ~Conv2d() {}
+
+  // pad_hw: padding at the top and at the left, output: resized
+  MaceStatus Compute(const OpContext *context,
+                     const Tensor *input,
+                     const Tensor *filter,
+                     const int *pad_hw,
+                     Tensor *output);
+
+ private:
+  const std::vector<int> strides_;
+  const std::vector<int> dilations_;
+  Gemm gemm_;
+};
+
+}  // namespace fp16
+}  // namespace arm
+}  // namespace ops
+}  // namespace mace
+
+#endif  // MACE_OPS_ARM_FP16_CONV_2D_H_
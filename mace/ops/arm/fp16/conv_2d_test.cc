@@ -0,0 +1,146 @@
+// Copyright 2018 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <vector>
+
+#include "mace/core/device.h"
+#include "mace/core/op_context.h"
+#include "mace/core/tensor.h"
+#include "mace/core/workspace.h"
+#include "mace/ops/arm/fp16/conv_2d.h"
+#include "mace/ops/testing/test_utils.h"
+
+namespace mace {
+namespace ops {
+namespace test {
+
+namespace {
+
+constexpr float kHalfEpsilon = 4.8828125e-4f;
+
+// random values of the shape, rounded to half
+void GenerateHalfTensor(const std::vector<index_t> &shape,
+                        Tensor *tensor,
+                        std::vector<float> *values) {
+  tensor->Resize(shape);
+  GenerateRandomRealTypeData<float>(shape, values, false);
+  Tensor::MappingGuard guard(tensor);
+  half *data = tensor->mutable_data<half>();
+  for (index_t i = 0; i < tensor->size(); ++i) {
+    data[i] = half_float::half_cast<half>((*values)[i]);
+    (*values)[i] = data[i];
+  }
+}
+
+}  // namespace
+
+void TestConv2dFp16(const std::vector<index_t> &in_shape,
+                    const index_t out_channels,
+                    const int kernel,
+                    const int stride,
+                    const int dilation,
+                    const int pad) {
+  CPUDevice device(1, AFFINITY_NONE, false);
+  Workspace ws;
+  OpContext context(&ws, &device);
+
+  const index_t in_channels = in_shape[1];
+  const int span = (kernel - 1) * dilation + 1;
+  const std::vector<index_t> out_shape = {
+      in_shape[0], out_channels,
+      (in_shape[2] + 2 * pad - span) / stride + 1,
+      (in_shape[3] + 2 * pad - span) / stride + 1};
+  Tensor input(GetCPUAllocator(), DataType::DT_HALF);
+  Tensor filter(GetCPUAllocator(), DataType::DT_HALF);
+  Tensor output(GetCPUAllocator(), DataType::DT_HALF);
+  std::vector<float> input_data;
+  std::vector<float> filter_data;
+  GenerateHalfTensor(in_shape, &input, &input_data);
+  GenerateHalfTensor({out_channels, in_channels, kernel, kernel}, &filter,
+                     &filter_data);
+  output.Resize(out_shape);
+
+  ::mace::ops::arm::fp16::Conv2d conv2d({stride, stride},
+                                        {dilation, dilation});
+  const int pad_hw[2] = {pad, pad};
+  ASSERT_EQ(conv2d.Compute(&context, &input, &filter, pad_hw, &output),
+            MaceStatus::MACE_SUCCESS);
+
+  Tensor::MappingGuard output_guard(&output);
+  const half *output_data = output.data<half>();
+  const index_t depth = in_channels * kernel * kernel;
+  for (index_t b = 0; b < out_shape[0]; ++b) {
+    for (index_t m = 0; m < out_channels; ++m) {
+      for (index_t h = 0; h < out_shape[2]; ++h) {
+        for (index_t w = 0; w < out_shape[3]; ++w) {
+          double expected = 0;
+          double abs_sum = 0;
+          for (index_t c = 0; c < in_channels; ++c) {
+            for (int kh = 0; kh < kernel; ++kh) {
+              for (int kw = 0; kw < kernel; ++kw) {
+                const index_t ih = h * stride + kh * dilation - pad;
+                const index_t iw = w * stride + kw * dilation - pad;
+                if (ih < 0 || ih >= in_shape[2] || iw < 0 ||
+                    iw >= in_shape[3]) {
+                  continue;
+                }
+                const double product =
+                    input_data[((b * in_channels + c) * in_shape[2] + ih)
+                                   * in_shape[3] + iw] *
+                    filter_data[((m * in_channels + c) * kernel + kh)
+                                    * kernel + kw];
+                expected += product;
+                abs_sum += std::abs(product);
+              }
+            }
+          }
+          const index_t index =
+              ((b * out_channels + m) * out_shape[2] + h) * out_shape[3] + w;
+          EXPECT_NEAR(expected, static_cast<float>(output_data[index]),
+                      kHalfEpsilon * (depth * abs_sum + std::abs(expected))
+                          + 1e-6)
+              << "with index " << index;
+        }
+      }
+    }
+  }
+}
+
+TEST(ArmConv2dFp16, K1x1) {
+  // the input is read as the rhs of the gemm
+  TestConv2dFp16({1, 16, 8, 8}, 32, 1, 1, 1, 0);
+  TestConv2dFp16({2, 7, 5, 3}, 11, 1, 1, 1, 0);
+  // im2col for stride and padding
+  TestConv2dFp16({1, 9, 10, 11}, 5, 1, 2, 1, 0);
+  TestConv2dFp16({1, 3, 6, 7}, 13, 1, 1, 1, 1);
+}
+
+TEST(ArmConv2dFp16, K3x3) {
+  TestConv2dFp16({1, 8, 16, 16}, 16, 3, 1, 1, 1);
+  TestConv2dFp16({2, 5, 13, 11}, 19, 3, 1, 1, 0);
+  TestConv2dFp16({1, 3, 15, 17}, 9, 3, 2, 1, 1);
+  TestConv2dFp16({1, 4, 12, 12}, 7, 3, 1, 2, 2);
+}
+
+TEST(ArmConv2dFp16, K5x5) {
+  TestConv2dFp16({1, 6, 14, 9}, 10, 5, 1, 1, 2);
+  TestConv2dFp16({1, 3, 19, 21}, 17, 5, 2, 1, 2);
+}
+
+}  // namespace test
+}  // namespace ops
+}  // namespace mace
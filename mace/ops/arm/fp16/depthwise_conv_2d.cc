@@ -0,0 +1,100 @@
+// Copyright 2018 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/ops/arm/fp16/depthwise_conv_2d.h"
+
+#include <algorithm>
+
+#include "mace/ops/arm/fp16/fp16.h"
+
+namespace mace {
+namespace ops {
+namespace arm {
+namespace fp16 {
+
+void DepthwiseConv2d(const half *input_data,
+                     const half *filter_data,
+                     const index_t *in_shape,
+                     const index_t *out_shape,
+                     const index_t *filter_shape,
+                     const int *stride_hw,
+                     const int *dilation_hw,
+                     const int *pad_hw,
+                     half *output_data) {
+  const fp16_t *input = AsFp16(input_data);
+  const fp16_t *filter = AsFp16(filter_data);
+  fp16_t *output = AsFp16(output_data);
+  const index_t out_channels = filter_shape[0];
+  const index_t in_channels = filter_shape[1];
+  const index_t multiplier = out_channels / in_channels;
+  const index_t filter_height = filter_shape[2];
+  const index_t filter_width = filter_shape[3];
+  const index_t in_height = in_shape[2];
+  const index_t in_width = in_shape[3];
+  const index_t out_height = out_shape[2];
+  const index_t out_width = out_shape[3];
+  const fp16_t zero = static_cast<fp16_t>(0.f);
+#pragma omp parallel for collapse(2) schedule(runtime)
+  for (index_t b = 0; b < in_shape[0]; ++b) {
+    for (index_t m = 0; m < out_channels; ++m) {
+      const index_t c = m / multiplier;
+      const index_t o = m % multiplier;
+      const fp16_t *in_channel =
+          input + (b * in_channels + c) * in_height * in_width;
+      const fp16_t *filter_channel =
+          filter + (o * in_channels + c) * filter_height * filter_width;
+      fp16_t *out_channel =
+          output + (b * out_channels + m) * out_height * out_width;
+      std::fill(out_channel, out_channel + out_height * out_width, zero);
+      // accumulate a filter tap over a row of outputs at a time, so that
+      // the inner loop is vectorized for stride 1
+      for (index_t kh = 0; kh < filter_height; ++kh) {
+        for (index_t kw = 0; kw < filter_width; ++kw) {
+          const fp16_t weight = filter_channel[kh * filter_width + kw];
+          const index_t w_offset = kw * dilation_hw[1] - pad_hw[1];
+          // outputs whose input column is inside the image
+          const index_t w_start = w_offset >= 0 ? 0 :
+              (-w_offset + stride_hw[1] - 1) / stride_hw[1];
+          const index_t w_stop = std::min(
+              out_width,
+              std::max<index_t>(
+                  0, (in_width - w_offset + stride_hw[1] - 1) / stride_hw[1]));
+          for (index_t h = 0; h < out_height; ++h) {
+            const index_t ih =
+                h * stride_hw[0] + kh * dilation_hw[0] - pad_hw[0];
+            if (ih < 0 || ih >= in_height) {
+              continue;
+            }
+            const fp16_t *in_row = in_channel + ih * in_width + w_offset;
+            fp16_t *out_row = out_channel + h * out_width;
+            if (stride_hw[1] == 1) {
+              for (index_t w = w_start; w < w_stop; ++w) {
+                out_row[w] += in_row[w] * weight;
+              }
+            } else {
+              for (index_t w = w_start; w < w_stop; ++w) {
+                out_row[w] += in_row[w * stride_hw[1]] * weight;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+}  // namespace fp16
+}  // namespace arm
+}  // namespace ops
+}  // namespace mace
@@ -0,0 +1,43 @@
+// Copyright 2018 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_OPS_ARM_FP16_DEPTHWISE_CONV_2D_H_
+#define MACE_OPS_ARM_FP16_DEPTHWISE_CONV_2D_H_
+
+#include "mace/core/types.h"
+
+namespace mace {
+namespace ops {
+namespace arm {
+namespace fp16 {
+
+// NCHW half depthwise conv. filter_shape is {out_channels, in_channels,
+// kh, kw} of the [multiplier, in_channels, kh, kw] CPU filter, out channel
+// m reads in channel m / multiplier.
+void DepthwiseConv2d(const half *input,
+                     const half *filter,
+                     const index_t *in_shape,
+                     const index_t *out_shape,
+                     const index_t *filter_shape,
+                     const int *stride_hw,
+                     const int *dilation_hw,
+                     const int *pad_hw,
+                     half *output);
+
+}  // namespace fp16
+}  // namespace arm
+}  // namespace ops
+}  // namespace mace
+
+#endif  // MACE_OPS_ARM_FP16_DEPTHWISE_CONV_2D_H_
@@ -0,0 +1,119 @@
+// Copyright 2018 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <vector>
+
+#include "mace/ops/arm/fp16/depthwise_conv_2d.h"
+#include "mace/ops/testing/test_utils.h"
+
+namespace mace {
+namespace ops {
+namespace test {
+
+void TestDepthwiseConv2dFp16(const std::vector<index_t> &in_shape,
+                             const index_t multiplier,
+                             const int kernel,
+                             const int stride,
+                             const int dilation,
+                             const int pad) {
+  const index_t in_channels = in_shape[1];
+  const index_t out_channels = in_channels * multiplier;
+  const int span = (kernel - 1) * dilation + 1;
+  const std::vector<index_t> out_shape = {
+      in_shape[0], out_channels,
+      (in_shape[2] + 2 * pad - span) / stride + 1,
+      (in_shape[3] + 2 * pad - span) / stride + 1};
+  const std::vector<index_t> filter_shape =
+      {out_channels, in_channels, kernel, kernel};
+  std::vector<float> input_data;
+  std::vector<float> filter_data;
+  GenerateRandomRealTypeData<float>(in_shape, &input_data, false);
+  GenerateRandomRealTypeData<float>(
+      {multiplier, in_channels, kernel, kernel}, &filter_data, false);
+  std::vector<half> input(input_data.begin(), input_data.end());
+  std::vector<half> filter(filter_data.begin(), filter_data.end());
+  // the reference reads the values rounded to half
+  input_data.assign(input.begin(), input.end());
+  filter_data.assign(filter.begin(), filter.end());
+
+  const int stride_hw[2] = {stride, stride};
+  const int dilation_hw[2] = {dilation, dilation};
+  const int pad_hw[2] = {pad, pad};
+  std::vector<half> output(
+      out_shape[0] * out_channels * out_shape[2] * out_shape[3]);
+  arm::fp16::DepthwiseConv2d(input.data(), filter.data(), in_shape.data(),
+                             out_shape.data(), filter_shape.data(),
+                             stride_hw, dilation_hw, pad_hw, output.data());
+
+  // unit roundoff of half, for a sum of kernel * kernel products
+  const double epsilon = 4.8828125e-4 * kernel * kernel;
+  for (index_t b = 0; b < out_shape[0]; ++b) {
+    for (index_t m = 0; m < out_channels; ++m) {
+      const index_t c = m / multiplier;
+      const index_t o = m % multiplier;
+      for (index_t h = 0; h < out_shape[2]; ++h) {
+        for (index_t w = 0; w < out_shape[3]; ++w) {
+          double expected = 0;
+          double abs_sum = 0;
+          for (int kh = 0; kh < kernel; ++kh) {
+            for (int kw = 0; kw < kernel; ++kw) {
+              const index_t ih = h * stride + kh * dilation - pad;
+              const index_t iw = w * stride + kw * dilation - pad;
+              if (ih < 0 || ih >= in_shape[2] || iw < 0 ||
+                  iw >= in_shape[3]) {
+                continue;
+              }
+              const double product =
+                  input_data[((b * in_channels + c) * in_shape[2] + ih)
+                                 * in_shape[3] + iw] *
+                  filter_data[((o * in_channels + c) * kernel + kh)
+                                  * kernel + kw];
+              expected += product;
+              abs_sum += std::abs(product);
+            }
+          }
+          const index_t index =
+              ((b * out_channels + m) * out_shape[2] + h) * out_shape[3] + w;
+          EXPECT_NEAR(expected, static_cast<float>(output[index]),
+                      epsilon * (abs_sum + std::abs(expected)) + 1e-6)
+              << "with index " << index;
+        }
+      }
+    }
+  }
+}
+
+TEST(ArmDepthwiseConv2dFp16, K3x3) {
+  TestDepthwiseConv2dFp16({1, 16, 9, 11}, 1, 3, 1, 1, 1);
+  TestDepthwiseConv2dFp16({2, 21, 14, 13}, 1, 3, 2, 1, 1);
+  TestDepthwiseConv2dFp16({1, 8, 12, 12}, 1, 3, 1, 2, 2);
+  TestDepthwiseConv2dFp16({1, 5, 7, 8}, 1, 3, 1, 1, 0);
+}
+
+TEST(ArmDepthwiseConv2dFp16, K5x5) {
+  TestDepthwiseConv2dFp16({1, 24, 10, 9}, 1, 5, 1, 1, 2);
+  TestDepthwiseConv2dFp16({1, 19, 15, 16}, 1, 5, 2, 1, 2);
+}
+
+TEST(ArmDepthwiseConv2dFp16, Multiplier) {
+  TestDepthwiseConv2dFp16({1, 3, 10, 11}, 2, 3, 1, 1, 1);
+  TestDepthwiseConv2dFp16({2, 7, 9, 8}, 3, 3, 2, 1, 0);
+}
+
+}  // namespace test
+}  // namespace ops
+}  // namespace mace
@@ -0,0 +1,56 @@
+// Copyright 2018 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_OPS_ARM_FP16_FP16_H_
+#define MACE_OPS_ARM_FP16_FP16_H_
+
+#if defined(__ARM_FEATURE_FP16_VECTOR_ARITHMETIC)
+#include <arm_neon.h>
+#endif
+
+#include "mace/core/types.h"
+
+// Kernels of this directory are built with the ARMv8.2 half precision
+// arithmetic (-march=armv8.2-a+fp16) and must only run on cores reporting
+// it, see CPUFeatures::asimdhp. Only their sources include this header, the
+// ops built without the flag call them through half.
+
+namespace mace {
+namespace ops {
+namespace arm {
+namespace fp16 {
+
+// the half type of the cores, emulated when not built for them
+#if defined(__ARM_FEATURE_FP16_VECTOR_ARITHMETIC)
+typedef float16_t fp16_t;
+#else
+typedef half fp16_t;
+#endif
+
+static_assert(sizeof(fp16_t) == sizeof(half), "fp16_t must be 16 bits");
+
+inline const fp16_t *AsFp16(const half *data) {
+  return reinterpret_cast<const fp16_t *>(data);
+}
+
+inline fp16_t *AsFp16(half *data) {
+  return reinterpret_cast<fp16_t *>(data);
+}
+
+}  // namespace fp16
+}  // namespace arm
+}  // namespace ops
+}  // namespace mace
+
+#endif  // MACE_OPS_ARM_FP16_FP16_H_
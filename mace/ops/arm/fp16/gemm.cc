@@ -0,0 +1,203 @@
+// Copyright 2018 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/ops/arm/fp16/gemm.h"
+
+#include <algorithm>
+
+#include "mace/ops/arm/fp16/fp16.h"
+
+namespace mace {
+namespace ops {
+namespace arm {
+namespace fp16 {
+
+namespace {
+constexpr index_t kRowBlockSize = 8;
+constexpr index_t kColBlockSize = 16;
+
+void PackLhs(const fp16_t *lhs,
+             const index_t rows,
+             const index_t depth,
+             fp16_t *packed_lhs) {
+  // by blocks of 8 rows, the 8 rows of a depth next to each other
+  const fp16_t zero = static_cast<fp16_t>(0.f);
+  for (index_t start_row = 0; start_row < rows; start_row += kRowBlockSize) {
+    for (index_t d = 0; d < depth; ++d) {
+      for (index_t r = 0; r < kRowBlockSize; ++r) {
+        *packed_lhs++ = start_row + r < rows ?
+                        lhs[(start_row + r) * depth + d] : zero;
+      }
+    }
+  }
+}
+
+void PackRhs(const fp16_t *rhs,
+             const index_t depth,
+             const index_t cols,
+             const index_t start_col,
+             fp16_t *packed_rhs) {
+  // 16 columns of a depth next to each other
+  const index_t col_block_len = std::min(kColBlockSize, cols - start_col);
+  const fp16_t zero = static_cast<fp16_t>(0.f);
+  for (index_t d = 0; d < depth; ++d) {
+    const fp16_t *rhs_row = rhs + d * cols + start_col;
+    std::copy_n(rhs_row, col_block_len, packed_rhs);
+    std::fill(packed_rhs + col_block_len, packed_rhs + kColBlockSize, zero);
+    packed_rhs += kColBlockSize;
+  }
+}
+
+// 8x16 block of output at packed_output, with a stride of 16
+void ComputeBlock(const fp16_t *packed_lhs,
+                  const fp16_t *packed_rhs,
+                  const index_t depth,
+                  fp16_t *packed_output) {
+#if defined(__ARM_FEATURE_FP16_VECTOR_ARITHMETIC)
+  // c{r}{j} accumulates row r and columns [8j, 8j + 8) of the block
+  const float16x8_t vzero = vdupq_n_f16(0);
+  float16x8_t c00 = vzero, c01 = vzero;
+  float16x8_t c10 = vzero, c11 = vzero;
+  float16x8_t c20 = vzero, c21 = vzero;
+  float16x8_t c30 = vzero, c31 = vzero;
+  float16x8_t c40 = vzero, c41 = vzero;
+  float16x8_t c50 = vzero, c51 = vzero;
+  float16x8_t c60 = vzero, c61 = vzero;
+  float16x8_t c70 = vzero, c71 = vzero;
+
+  for (index_t d = 0; d < depth; ++d) {
+    float16x8_t a = vld1q_f16(packed_lhs);
+    float16x8_t b0 = vld1q_f16(packed_rhs);
+    float16x8_t b1 = vld1q_f16(packed_rhs + 8);
+    packed_lhs += 8;
+    packed_rhs += 16;
+
+    c00 = vfmaq_laneq_f16(c00, b0, a, 0);
+    c01 = vfmaq_laneq_f16(c01, b1, a, 0);
+    c10 = vfmaq_laneq_f16(c10, b0, a, 1);
+    c11 = vfmaq_laneq_f16(c11, b1, a, 1);
+    c20 = vfmaq_laneq_f16(c20, b0, a, 2);
+    c21 = vfmaq_laneq_f16(c21, b1, a, 2);
+    c30 = vfmaq_laneq_f16(c30, b0, a, 3);
+    c31 = vfmaq_laneq_f16(c31, b1, a, 3);
+    c40 = vfmaq_laneq_f16(c40, b0, a, 4);
+    c41 = vfmaq_laneq_f16(c41, b1, a, 4);
+    c50 = vfmaq_laneq_f16(c50, b0, a, 5);
+    c51 = vfmaq_laneq_f16(c51, b1, a, 5);
+    c60 = vfmaq_laneq_f16(c60, b0, a, 6);
+    c61 = vfmaq_laneq_f16(c61, b1, a, 6);
+    c70 = vfmaq_laneq_f16(c70, b0, a, 7);
+    c71 = vfmaq_laneq_f16(c71, b1, a, 7);
+  }
+
+  vst1q_f16(packed_output + 0, c00);
+  vst1q_f16(packed_output + 8, c01);
+  vst1q_f16(packed_output + 16, c10);
+  vst1q_f16(packed_output + 24, c11);
+  vst1q_f16(packed_output + 32, c20);
+  vst1q_f16(packed_output + 40, c21);
+  vst1q_f16(packed_output + 48, c30);
+  vst1q_f16(packed_output + 56, c31);
+  vst1q_f16(packed_output + 64, c40);
+  vst1q_f16(packed_output + 72, c41);
+  vst1q_f16(packed_output + 80, c50);
+  vst1q_f16(packed_output + 88, c51);
+  vst1q_f16(packed_output + 96, c60);
+  vst1q_f16(packed_output + 104, c61);
+  vst1q_f16(packed_output + 112, c70);
+  vst1q_f16(packed_output + 120, c71);
+#else
+  const fp16_t zero = static_cast<fp16_t>(0.f);
+  std::fill(packed_output, packed_output + kRowBlockSize * kColBlockSize,
+            zero);
+  for (index_t d = 0; d < depth; ++d) {
+    for (index_t r = 0; r < kRowBlockSize; ++r) {
+      for (index_t c = 0; c < kColBlockSize; ++c) {
+        packed_output[r * kColBlockSize + c] +=
+            packed_lhs[r] * packed_rhs[c];
+      }
+    }
+    packed_lhs += kRowBlockSize;
+    packed_rhs += kColBlockSize;
+  }
+#endif
+}
+
+}  // namespace
+
+MaceStatus Gemm::Compute(const OpContext *context,
+                         const Tensor *lhs,
+                         const half *rhs_data,
+                         const index_t rows,
+                         const index_t cols,
+                         const index_t depth,
+                         half *output_data) {
+  const fp16_t *rhs = AsFp16(rhs_data);
+  fp16_t *output = AsFp16(output_data);
+  const index_t row_block_count = RoundUpDiv(rows, kRowBlockSize);
+  const index_t col_block_count = RoundUpDiv(cols, kColBlockSize);
+  if (!lhs_packed_) {
+    MACE_RETURN_IF_ERROR(packed_lhs_.Resize(
+        sizeof(fp16_t) * row_block_count * kRowBlockSize * depth));
+    Tensor::MappingGuard lhs_guard(lhs);
+    PackLhs(AsFp16(lhs->data<half>()), rows, depth,
+            packed_lhs_.mutable_data<fp16_t>());
+    lhs_packed_ = true;
+  }
+  const fp16_t *packed_lhs = packed_lhs_.data<fp16_t>();
+
+  const index_t packed_rhs_size = ScratchSize(cols, depth);
+  ScratchBuffer *scratch = context->device()->scratch_buffer();
+  MACE_RETURN_IF_ERROR(scratch->GrowSize(packed_rhs_size));
+  fp16_t *packed_rhs =
+      scratch->Scratch(packed_rhs_size).mutable_data<fp16_t>();
+
+#pragma omp parallel for schedule(runtime)
+  for (index_t col_block_idx = 0; col_block_idx < col_block_count;
+       ++col_block_idx) {
+    const index_t start_col = col_block_idx * kColBlockSize;
+    const index_t col_block_len = std::min(kColBlockSize, cols - start_col);
+    fp16_t *packed_rhs_block =
+        packed_rhs + col_block_idx * kColBlockSize * depth;
+    PackRhs(rhs, depth, cols, start_col, packed_rhs_block);
+
+    fp16_t packed_output[kRowBlockSize * kColBlockSize];
+    for (index_t row_block_idx = 0; row_block_idx < row_block_count;
+         ++row_block_idx) {
+      const index_t start_row = row_block_idx * kRowBlockSize;
+      const index_t row_block_len = std::min(kRowBlockSize, rows - start_row);
+      ComputeBlock(packed_lhs + row_block_idx * kRowBlockSize * depth,
+                   packed_rhs_block,
+                   depth,
+                   packed_output);
+      for (index_t r = 0; r < row_block_len; ++r) {
+        std::copy_n(packed_output + r * kColBlockSize,
+                    col_block_len,
+                    output + (start_row + r) * cols + start_col);
+      }
+    }  // row_block_idx
+  }  // col_block_idx
+
+  return MaceStatus::MACE_SUCCESS;
+}
+
+index_t Gemm::ScratchSize(const index_t cols, const index_t depth) {
+  return PadAlignSize(
+      sizeof(fp16_t) * RoundUp(cols, kColBlockSize) * depth);
+}
+
+}  // namespace fp16
+}  // namespace arm
+}  // namespace ops
+}  // namespace mace
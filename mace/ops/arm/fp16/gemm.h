@@ -0,0 +1,60 @@
+// Copyright 2018 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_OPS_ARM_FP16_GEMM_H_
+#define MACE_OPS_ARM_FP16_GEMM_H_
+
+#include "mace/core/op_context.h"
+#include "mace/core/tensor.h"
+#include "mace/core/types.h"
+#include "mace/public/mace.h"
+
+namespace mace {
+namespace ops {
+namespace arm {
+namespace fp16 {
+
+// Row major half precision gemm, output = lhs * rhs. lhs is the constant
+// weight of the op, packed once by the first Compute; rhs and output change
+// every run. Accumulates in half, like the fp16 kernels of other engines.
+class Gemm {
+ public:
+  Gemm() : packed_lhs_(GetCPUAllocator()), lhs_packed_(false) {}
+  ~Gemm() {}
+
+  // lhs: rows x depth, rhs: depth x cols, output: rows x cols
+  MaceStatus Compute(const OpContext *context,
+                     const Tensor *lhs,
+                     const half *rhs,
+                     const index_t rows,
+                     const index_t cols,
+                     const index_t depth,
+                     half *output);
+
+  // bytes of the device scratch buffer Compute takes
+  static index_t ScratchSize(const index_t cols, const index_t depth);
+
+ private:
+  Buffer packed_lhs_;
+  bool lhs_packed_;
+
+  MACE_DISABLE_COPY_AND_ASSIGN(Gemm);
+};
+
+}  // namespace fp16
+}  // namespace arm
+}  // namespace ops
+}  // namespace mace
+
+#endif  // MACE_OPS_ARM_FP16_GEMM_H_
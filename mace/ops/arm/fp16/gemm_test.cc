@@ -0,0 +1,107 @@
+// Copyright 2018 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <vector>
+
+#include "mace/core/device.h"
+#include "mace/core/op_context.h"
+#include "mace/core/tensor.h"
+#include "mace/core/workspace.h"
+#include "mace/ops/arm/fp16/gemm.h"
+#include "mace/ops/testing/test_utils.h"
+
+namespace mace {
+namespace ops {
+namespace test {
+
+namespace {
+// unit roundoff of half
+constexpr float kHalfEpsilon = 4.8828125e-4f;
+}  // namespace
+
+void TestGemmFp16(const index_t rows,
+                  const index_t cols,
+                  const index_t depth) {
+  CPUDevice device(1, AFFINITY_NONE, false);
+  Workspace ws;
+  OpContext context(&ws, &device);
+
+  Tensor lhs(GetCPUAllocator(), DataType::DT_HALF);
+  lhs.Resize({rows, depth});
+  std::vector<float> lhs_data;
+  GenerateRandomRealTypeData<float>({rows, depth}, &lhs_data, false);
+  {
+    Tensor::MappingGuard lhs_guard(&lhs);
+    half *lhs_half = lhs.mutable_data<half>();
+    for (index_t i = 0; i < rows * depth; ++i) {
+      lhs_half[i] = half_float::half_cast<half>(lhs_data[i]);
+      lhs_data[i] = lhs_half[i];
+    }
+  }
+
+  ::mace::ops::arm::fp16::Gemm gemm;
+  // the second run reads the lhs packed by the first one
+  for (int run = 0; run < 2; ++run) {
+    std::vector<float> rhs_data;
+    GenerateRandomRealTypeData<float>({depth, cols}, &rhs_data, false);
+    std::vector<half> rhs(rhs_data.size());
+    for (size_t i = 0; i < rhs.size(); ++i) {
+      rhs[i] = half_float::half_cast<half>(rhs_data[i]);
+      rhs_data[i] = rhs[i];
+    }
+    std::vector<half> output(rows * cols);
+    device.scratch_buffer()->Rewind();
+    ASSERT_EQ(gemm.Compute(&context, &lhs, rhs.data(), rows, cols, depth,
+                           output.data()),
+              MaceStatus::MACE_SUCCESS);
+
+    for (index_t r = 0; r < rows; ++r) {
+      for (index_t c = 0; c < cols; ++c) {
+        double expected = 0;
+        double abs_sum = 0;
+        for (index_t d = 0; d < depth; ++d) {
+          const double product = lhs_data[r * depth + d] *
+              rhs_data[d * cols + c];
+          expected += product;
+          abs_sum += std::abs(product);
+        }
+        // the error bound of a sum accumulated in half
+        const double error =
+            kHalfEpsilon * (depth * abs_sum + std::abs(expected)) + 1e-6;
+        EXPECT_NEAR(expected, static_cast<float>(output[r * cols + c]),
+                    error) << "with row " << r << ", col " << c;
+      }
+    }
+  }
+}
+
+TEST(ArmGemmFp16, Blocks) {
+  TestGemmFp16(8, 16, 16);
+  TestGemmFp16(32, 64, 27);
+}
+
+TEST(ArmGemmFp16, Tails) {
+  // rows and cols which leave partial 8x16 blocks
+  TestGemmFp16(1, 1, 1);
+  TestGemmFp16(7, 15, 9);
+  TestGemmFp16(19, 37, 43);
+  TestGemmFp16(33, 5, 3);
+}
+
+}  // namespace test
+}  // namespace ops
+}  // namespace mace
@@ -0,0 +1,209 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/ops/arm/fp32/block_sparse.h"
+
+#include <arm_neon.h>
+#include <algorithm>
+#include <string>
+
+#include "mace/utils/logging.h"
+
+namespace mace {
+namespace ops {
+namespace arm {
+namespace fp32 {
+
+namespace {
+
+bool IsZeroBlock(const float *row, const index_t col, const index_t cols) {
+  const index_t end = std::min(col + kSparseBlockSize, cols);
+  for (index_t c = col; c < end; ++c) {
+    if (row[c] != 0.f) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// the pixels of an output row accumulated in registers
+constexpr index_t kGemmTileSize = 8;
+
+}  // namespace
+
+index_t CountNonzeroBlocks(const float *weight,
+                           const index_t rows,
+                           const index_t cols) {
+  index_t count = 0;
+  for (index_t r = 0; r < rows; ++r) {
+    for (index_t c = 0; c < cols; c += kSparseBlockSize) {
+      count += IsZeroBlock(weight + r * cols, c, cols) ? 0 : 1;
+    }
+  }
+  return count;
+}
+
+index_t BlockSparseSize(const index_t rows, const index_t nonzero_blocks) {
+  return rows + 1 + nonzero_blocks * (1 + kSparseBlockSize);
+}
+
+void PackBlockSparseWeight(const float *weight,
+                           const index_t rows,
+                           const index_t cols,
+                           float *packed_weight) {
+  int32_t *row_blocks = reinterpret_cast<int32_t *>(packed_weight);
+  const index_t nonzero_blocks = CountNonzeroBlocks(weight, rows, cols);
+  int32_t *block_cols = row_blocks + rows + 1;
+  float *values = packed_weight + rows + 1 + nonzero_blocks;
+  int32_t block = 0;
+  for (index_t r = 0; r < rows; ++r) {
+    row_blocks[r] = block;
+    const float *row = weight + r * cols;
+    for (index_t c = 0; c < cols; c += kSparseBlockSize) {
+      if (IsZeroBlock(row, c, cols)) {
+        continue;
+      }
+      block_cols[block] = static_cast<int32_t>(c / kSparseBlockSize);
+      for (index_t i = 0; i < kSparseBlockSize; ++i) {
+        values[block * kSparseBlockSize + i] =
+            c + i < cols ? row[c + i] : 0.f;
+      }
+      ++block;
+    }
+  }
+  row_blocks[rows] = block;
+}
+
+const float *GetBlockSparseWeight(PackedWeights *packed_weights,
+                                  const Tensor *weight,
+                                  const index_t rows,
+                                  const index_t cols) {
+  MACE_CHECK(rows * cols == weight->size(), "Sparse weight of ",
+             MakeString(weight->shape()), " is not ", rows, "x", cols);
+  Tensor::MappingGuard weight_guard(weight);
+  const float *weight_data = weight->data<float>();
+  const index_t nonzero_blocks = CountNonzeroBlocks(weight_data, rows, cols);
+  VLOG(1) << "Sparse weight " << weight->name() << ": " << nonzero_blocks
+          << " of " << rows * RoundUpDiv(cols, kSparseBlockSize)
+          << " blocks of 1x" << kSparseBlockSize << " are nonzero";
+  return packed_weights->GetOrPack(
+      "block_sparse_fp32_1x4", weight,
+      BlockSparseSize(rows, nonzero_blocks), [&](float *packed_weight) {
+        PackBlockSparseWeight(weight_data, rows, cols, packed_weight);
+      });
+}
+
+void BlockSparseGemv(const float *packed_weight,
+                     const index_t rows,
+                     const index_t cols,
+                     const float *input,
+                     const float *bias,
+                     const index_t batch,
+                     float *output) {
+  const int32_t *row_blocks = reinterpret_cast<const int32_t *>(packed_weight);
+  const index_t nonzero_blocks = row_blocks[rows];
+  const int32_t *block_cols = row_blocks + rows + 1;
+  const float *values = packed_weight + rows + 1 + nonzero_blocks;
+  // the column blocks read as whole vectors of the input
+  const index_t whole_blocks = cols / kSparseBlockSize;
+
+#pragma omp parallel for collapse(2) schedule(runtime)
+  for (index_t b = 0; b < batch; ++b) {
+    for (index_t r = 0; r < rows; ++r) {
+      const float *input_ptr = input + b * cols;
+      float32x4_t vsum = vdupq_n_f32(0.f);
+      float sum = bias == nullptr ? 0.f : bias[r];
+      for (index_t k = row_blocks[r]; k < row_blocks[r + 1]; ++k) {
+        const index_t col = block_cols[k];
+        const float *value = values + k * kSparseBlockSize;
+        if (col < whole_blocks) {
+          vsum = vmlaq_f32(vsum, vld1q_f32(value),
+                           vld1q_f32(input_ptr + col * kSparseBlockSize));
+        } else {
+          for (index_t c = col * kSparseBlockSize; c < cols; ++c) {
+            sum += value[c - col * kSparseBlockSize] * input_ptr[c];
+          }
+        }
+      }
+      output[b * rows + r] =
+          sum + vgetq_lane_f32(vsum, 0) + vgetq_lane_f32(vsum, 1)
+              + vgetq_lane_f32(vsum, 2) + vgetq_lane_f32(vsum, 3);
+    }
+  }
+}
+
+void BlockSparseGemm(const float *packed_weight,
+                     const index_t rows,
+                     const index_t cols,
+                     const float *input,
+                     const index_t batch,
+                     const index_t size,
+                     float *output) {
+  const int32_t *row_blocks = reinterpret_cast<const int32_t *>(packed_weight);
+  const index_t nonzero_blocks = row_blocks[rows];
+  const int32_t *block_cols = row_blocks + rows + 1;
+  const float *values = packed_weight + rows + 1 + nonzero_blocks;
+  const index_t tile_count = RoundUpDiv(size, kGemmTileSize);
+
+#pragma omp parallel for collapse(3) schedule(runtime)
+  for (index_t b = 0; b < batch; ++b) {
+    for (index_t r = 0; r < rows; ++r) {
+      for (index_t t = 0; t < tile_count; ++t) {
+        const index_t p = t * kGemmTileSize;
+        const float *input_ptr = input + b * cols * size + p;
+        float *output_ptr = output + (b * rows + r) * size + p;
+        const index_t block_begin = row_blocks[r];
+        const index_t block_end = row_blocks[r + 1];
+        if (p + kGemmTileSize <= size) {
+          float32x4_t vo0 = vdupq_n_f32(0.f);
+          float32x4_t vo1 = vdupq_n_f32(0.f);
+          for (index_t k = block_begin; k < block_end; ++k) {
+            const index_t channel = block_cols[k] * kSparseBlockSize;
+            const float *value = values + k * kSparseBlockSize;
+            const index_t count =
+                std::min(kSparseBlockSize, cols - channel);
+            for (index_t i = 0; i < count; ++i) {
+              const float *in = input_ptr + (channel + i) * size;
+              vo0 = vmlaq_n_f32(vo0, vld1q_f32(in), value[i]);
+              vo1 = vmlaq_n_f32(vo1, vld1q_f32(in + 4), value[i]);
+            }
+          }
+          vst1q_f32(output_ptr, vo0);
+          vst1q_f32(output_ptr + 4, vo1);
+        } else {
+          const index_t pixels = size - p;
+          float sums[kGemmTileSize] = {0.f};
+          for (index_t k = block_begin; k < block_end; ++k) {
+            const index_t channel = block_cols[k] * kSparseBlockSize;
+            const float *value = values + k * kSparseBlockSize;
+            const index_t count =
+                std::min(kSparseBlockSize, cols - channel);
+            for (index_t i = 0; i < count; ++i) {
+              const float *in = input_ptr + (channel + i) * size;
+              for (index_t j = 0; j < pixels; ++j) {
+                sums[j] += value[i] * in[j];
+              }
+            }
+          }
+          std::copy(sums, sums + pixels, output_ptr);
+        }
+      }
+    }
+  }
+}
+
+}  // namespace fp32
+}  // namespace arm
+}  // namespace ops
+}  // namespace mace
@@ -0,0 +1,86 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_OPS_ARM_FP32_BLOCK_SPARSE_H_
+#define MACE_OPS_ARM_FP32_BLOCK_SPARSE_H_
+
+#include "mace/core/packed_weights.h"
+#include "mace/core/tensor.h"
+#include "mace/core/types.h"
+
+// Float weights pruned in blocks of 1x4, 4 adjacent columns of a row. The
+// blocks which are not all zero are packed row by row as
+//   [the first block of each row, rows + 1][the column block of each block]
+//   [the 4 values of each block]
+// with the first two parts stored as int32, so a pruned FullyConnected or
+// 1x1 conv only multiplies its nonzero blocks. The last column block of a
+// width not of whole blocks is padded with zeros.
+
+namespace mace {
+namespace ops {
+namespace arm {
+namespace fp32 {
+
+// set by the converter on the FullyConnected and 1x1 Conv2D ops whose
+// weights are sparse enough for the block-sparse kernels
+constexpr const char *kSparseWeightArg = "sparse_weight";
+
+constexpr index_t kSparseBlockSize = 4;
+
+// the number of the nonzero 1x4 blocks of a row-major [rows, cols] weight
+index_t CountNonzeroBlocks(const float *weight,
+                           const index_t rows,
+                           const index_t cols);
+
+// the packed size in floats of a weight of nonzero_blocks
+index_t BlockSparseSize(const index_t rows, const index_t nonzero_blocks);
+
+void PackBlockSparseWeight(const float *weight,
+                           const index_t rows,
+                           const index_t cols,
+                           float *packed_weight);
+
+// The constant weight, row-major [rows, cols] whatever its dims, packed into
+// nonzero blocks, looked up in or added to the packed weights.
+const float *GetBlockSparseWeight(PackedWeights *packed_weights,
+                                  const Tensor *weight,
+                                  const index_t rows,
+                                  const index_t cols);
+
+// output[b, r] = sum of weight[r, c] * input[b, c] + bias[r] over c, the
+// FullyConnected of [batch, cols] inputs, bias may be null
+void BlockSparseGemv(const float *packed_weight,
+                     const index_t rows,
+                     const index_t cols,
+                     const float *input,
+                     const float *bias,
+                     const index_t batch,
+                     float *output);
+
+// output[b, r, p] = sum of weight[r, c] * input[b, c, p] over c, the 1x1
+// conv of [batch, cols, size] inputs
+void BlockSparseGemm(const float *packed_weight,
+                     const index_t rows,
+                     const index_t cols,
+                     const float *input,
+                     const index_t batch,
+                     const index_t size,
+                     float *output);
+
+}  // namespace fp32
+}  // namespace arm
+}  // namespace ops
+}  // namespace mace
+
+#endif  // MACE_OPS_ARM_FP32_BLOCK_SPARSE_H_
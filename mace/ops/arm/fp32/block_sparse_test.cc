@@ -0,0 +1,142 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "mace/ops/arm/fp32/block_sparse.h"
+#include "mace/ops/testing/test_utils.h"
+
+namespace mace {
+namespace ops {
+namespace test {
+
+namespace {
+
+// a random weight with about the fraction of its 1x4 blocks zeroed
+std::vector<float> PrunedWeight(const index_t rows,
+                                const index_t cols,
+                                const float sparsity) {
+  std::mt19937 gen(rows * cols);
+  std::uniform_real_distribution<float> dist(-1, 1);
+  std::vector<float> weight(rows * cols);
+  for (index_t r = 0; r < rows; ++r) {
+    for (index_t c = 0; c < cols; c += arm::fp32::kSparseBlockSize) {
+      const bool pruned = (dist(gen) + 1) / 2 < sparsity;
+      for (index_t i = c;
+           i < std::min(c + arm::fp32::kSparseBlockSize, cols); ++i) {
+        weight[r * cols + i] = pruned ? 0.f : dist(gen);
+      }
+    }
+  }
+  return weight;
+}
+
+std::vector<float> Packed(const std::vector<float> &weight,
+                          const index_t rows,
+                          const index_t cols) {
+  std::vector<float> packed(arm::fp32::BlockSparseSize(
+      rows, arm::fp32::CountNonzeroBlocks(weight.data(), rows, cols)));
+  arm::fp32::PackBlockSparseWeight(weight.data(), rows, cols, packed.data());
+  return packed;
+}
+
+void TestBlockSparseGemv(const index_t batch,
+                         const index_t rows,
+                         const index_t cols,
+                         const float sparsity) {
+  const std::vector<float> weight = PrunedWeight(rows, cols, sparsity);
+  std::vector<float> input, bias;
+  GenerateRandomRealTypeData({batch, cols}, &input, false);
+  GenerateRandomRealTypeData({rows}, &bias, false);
+  std::vector<float> output(batch * rows);
+  arm::fp32::BlockSparseGemv(Packed(weight, rows, cols).data(), rows, cols,
+                             input.data(), bias.data(), batch,
+                             output.data());
+  for (index_t b = 0; b < batch; ++b) {
+    for (index_t r = 0; r < rows; ++r) {
+      float expected = bias[r];
+      for (index_t c = 0; c < cols; ++c) {
+        expected += weight[r * cols + c] * input[b * cols + c];
+      }
+      EXPECT_NEAR(expected, output[b * rows + r], 1e-4)
+          << " with batch " << b << " row " << r;
+    }
+  }
+}
+
+void TestBlockSparseGemm(const index_t batch,
+                         const index_t rows,
+                         const index_t cols,
+                         const index_t size,
+                         const float sparsity) {
+  const std::vector<float> weight = PrunedWeight(rows, cols, sparsity);
+  std::vector<float> input;
+  GenerateRandomRealTypeData({batch, cols, size}, &input, false);
+  std::vector<float> output(batch * rows * size);
+  arm::fp32::BlockSparseGemm(Packed(weight, rows, cols).data(), rows, cols,
+                             input.data(), batch, size, output.data());
+  for (index_t b = 0; b < batch; ++b) {
+    for (index_t r = 0; r < rows; ++r) {
+      for (index_t p = 0; p < size; ++p) {
+        float expected = 0.f;
+        for (index_t c = 0; c < cols; ++c) {
+          expected +=
+              weight[r * cols + c] * input[(b * cols + c) * size + p];
+        }
+        EXPECT_NEAR(expected, output[(b * rows + r) * size + p], 1e-4)
+            << " with batch " << b << " row " << r << " pixel " << p;
+      }
+    }
+  }
+}
+
+}  // namespace
+
+TEST(BlockSparseTest, Pack) {
+  const std::vector<float> weight = {
+      0, 0, 0, 0, 1, 2, 0, 0, 3,
+      0, 0, 0, 0, 0, 0, 0, 0, 0,
+      4, 0, 0, 5, 0, 0, 0, 0, 6};
+  ASSERT_EQ(4, arm::fp32::CountNonzeroBlocks(weight.data(), 3, 9));
+  const std::vector<float> packed = Packed(weight, 3, 9);
+  ASSERT_EQ(4 + 4 * 5, static_cast<index_t>(packed.size()));
+  const int32_t *ints = reinterpret_cast<const int32_t *>(packed.data());
+  EXPECT_EQ(std::vector<int32_t>({0, 2, 2, 4, 1, 2, 0, 2}),
+            std::vector<int32_t>(ints, ints + 8));
+  EXPECT_EQ(std::vector<float>({1, 2, 0, 0, 3, 0, 0, 0,
+                                4, 0, 0, 5, 6, 0, 0, 0}),
+            std::vector<float>(packed.begin() + 8, packed.end()));
+}
+
+TEST(BlockSparseTest, Gemv) {
+  TestBlockSparseGemv(1, 32, 64, 0.8f);
+  TestBlockSparseGemv(3, 17, 131, 0.7f);
+  TestBlockSparseGemv(8, 64, 256, 0.9f);
+  TestBlockSparseGemv(2, 5, 7, 0.f);
+  TestBlockSparseGemv(2, 9, 12, 1.f);
+}
+
+TEST(BlockSparseTest, Gemm) {
+  TestBlockSparseGemm(1, 16, 32, 64, 0.8f);
+  TestBlockSparseGemm(2, 13, 30, 37, 0.7f);
+  TestBlockSparseGemm(1, 32, 64, 7, 0.9f);
+  TestBlockSparseGemm(1, 8, 6, 9, 0.f);
+}
+
+}  // namespace test
+}  // namespace ops
+}  // namespace mace
@@ -47,6 +47,14 @@ MaceStatus Conv2dK1x1::Compute(const OpContext *context,
                        output);
 }
 
+void Conv2dK1x1::PackFilter(Workspace *workspace, const Tensor *filter) {
+  gemm_.PackLhsWeight(workspace,
+                      filter,
+                      filter->dim(0),
+                      filter->dim(1),
+                      RowMajor);
+}
+
 }  // namespace fp32
 }  // namespace arm
 }  // namespace ops
@@ -37,6 +37,9 @@ class Conv2dK1x1 : public Conv2dBase {
       const Tensor *filter,
       Tensor *output);
 
+  // pack the filter into the packed weights of the workspace
+  void PackFilter(Workspace *workspace, const Tensor *filter);
+
  private:
   Gemm gemm_;
 };
@@ -0,0 +1,130 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "mace/ops/arm/fp32/conv_2d_implicit_gemm.h"
+
+namespace mace {
+namespace ops {
+namespace arm {
+namespace fp32 {
+
+namespace {
+// the widest rhs block of gemm
+constexpr index_t kMaxColBlockSize = 12;
+}  // namespace
+
+MaceStatus Conv2dImplicitGemm::Compute(const OpContext *context,
+                                       const Tensor *input,
+                                       const Tensor *filter,
+                                       Tensor *output) {
+  std::vector<index_t> output_shape(4);
+  std::vector<int> paddings(2);
+  if (paddings_.empty()) {
+    CalcNCHWPaddingAndOutputSize(input->shape().data(),
+                                 filter->shape().data(),
+                                 dilations_.data(),
+                                 strides_.data(),
+                                 padding_type_,
+                                 output_shape.data(),
+                                 paddings.data());
+  } else {
+    paddings = paddings_;
+    CalcNCHWOutputSize(input->shape().data(),
+                       filter->shape().data(),
+                       paddings_.data(),
+                       dilations_.data(),
+                       strides_.data(),
+                       RoundType::FLOOR,
+                       output_shape.data());
+  }
+  MACE_RETURN_IF_ERROR(output->Resize(output_shape));
+
+  const index_t batch = input->dim(0);
+  const index_t in_channels = input->dim(1);
+  const index_t in_height = input->dim(2);
+  const index_t in_width = input->dim(3);
+  const index_t out_channels = filter->dim(0);
+  const index_t filter_h = filter->dim(2);
+  const index_t filter_w = filter->dim(3);
+  const index_t out_height = output_shape[2];
+  const index_t out_width = output_shape[3];
+  const index_t depth = in_channels * filter_h * filter_w;
+  const index_t out_image_size = out_height * out_width;
+  const int pad_top = paddings[0] >> 1;
+  const int pad_left = paddings[1] >> 1;
+  const int stride_h = strides_[0];
+  const int stride_w = strides_[1];
+  const int dilation_h = dilations_[0];
+  const int dilation_w = dilations_[1];
+
+  Tensor::MappingGuard input_guard(input);
+  const float *input_data = input->data<float>();
+
+  // column c of the block is output pixel start_col + c, and row d, for
+  // (ic, kh, kw), holds the input pixels multiplied by filter[:, ic, kh, kw],
+  // zero in the padding
+  auto pack_patches = [=](const index_t b,
+                          const index_t start_col,
+                          const index_t cols,
+                          const index_t col_block_size,
+                          float *packed_block) {
+    MACE_CHECK(col_block_size <= kMaxColBlockSize);
+    index_t in_h[kMaxColBlockSize];
+    index_t in_w[kMaxColBlockSize];
+    for (index_t c = 0; c < cols; ++c) {
+      in_h[c] = (start_col + c) / out_width * stride_h - pad_top;
+      in_w[c] = (start_col + c) % out_width * stride_w - pad_left;
+    }
+    const float *in_batch =
+        input_data + b * in_channels * in_height * in_width;
+    index_t ic = 0;
+    index_t kh = 0;
+    index_t kw = 0;
+    for (index_t d = 0; d < depth; ++d) {
+      const float *in_ptr = in_batch + ic * in_height * in_width;
+      float *packed_ptr = packed_block + d * col_block_size;
+      for (index_t c = 0; c < cols; ++c) {
+        const index_t ih = in_h[c] + kh * dilation_h;
+        const index_t iw = in_w[c] + kw * dilation_w;
+        packed_ptr[c] = (ih >= 0 && ih < in_height && iw >= 0
+            && iw < in_width) ? in_ptr[ih * in_width + iw] : 0.f;
+      }
+      for (index_t c = cols; c < col_block_size; ++c) {
+        packed_ptr[c] = 0.f;
+      }
+      if (++kw == filter_w) {
+        kw = 0;
+        if (++kh == filter_h) {
+          kh = 0;
+          ++ic;
+        }
+      }
+    }
+  };
+
+  context->device()->scratch_buffer()->Rewind();
+  return gemm_.Compute(context,
+                       filter,
+                       pack_patches,
+                       batch,
+                       out_channels,
+                       out_image_size,
+                       depth,
+                       RowMajor,
+                       output);
+}
+
+}  // namespace fp32
+}  // namespace arm
+}  // namespace ops
+}  // namespace mace
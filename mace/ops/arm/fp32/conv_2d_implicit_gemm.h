@@ -0,0 +1,67 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef MACE_OPS_ARM_FP32_CONV_2D_IMPLICIT_GEMM_H_
+#define MACE_OPS_ARM_FP32_CONV_2D_IMPLICIT_GEMM_H_
+
+#include <vector>
+
+#include "mace/public/mace.h"
+#include "mace/core/tensor.h"
+#include "mace/core/op_context.h"
+#include "mace/ops/arm/fp32/gemm.h"
+#include "mace/ops/arm/fp32/conv_2d.h"
+#include "mace/ops/common/conv_pool_2d_util.h"
+
+namespace mace {
+namespace ops {
+namespace arm {
+namespace fp32 {
+
+// Convolution of any filter size, stride and dilation as the gemm of the
+// filter and the matrix of the input patches. The patches are packed into
+// the rhs blocks of gemm as they are multiplied, so the patch matrix, k * k
+// times the size of the input, is never materialized.
+class Conv2dImplicitGemm : public Conv2dBase {
+ public:
+  Conv2dImplicitGemm(const std::vector<int> &strides,
+                     const std::vector<int> &dilations,
+                     const std::vector<int> &paddings,
+                     const Padding padding_type)
+      : gemm_(true),
+        strides_(strides),
+        dilations_(dilations),
+        paddings_(paddings),
+        padding_type_(padding_type) {}
+  virtual ~Conv2dImplicitGemm() {}
+
+  MaceStatus Compute(
+      const OpContext *context,
+      const Tensor *input,
+      const Tensor *filter,
+      Tensor *output);
+
+ private:
+  Gemm gemm_;
+  const std::vector<int> strides_;
+  const std::vector<int> dilations_;
+  const std::vector<int> paddings_;
+  const Padding padding_type_;
+};
+
+}  // namespace fp32
+}  // namespace arm
+}  // namespace ops
+}  // namespace mace
+
+#endif  // MACE_OPS_ARM_FP32_CONV_2D_IMPLICIT_GEMM_H_
@@ -0,0 +1,185 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "mace/ops/arm/fp32/deconv_2d_gemm.h"
+
+#include <algorithm>
+
+#include "mace/utils/utils.h"
+
+namespace mace {
+namespace ops {
+namespace arm {
+namespace fp32 {
+
+namespace {
+// floats of the column buffer, about the L2 cache
+constexpr index_t kColumnBufferSize = 256 * 1024;
+// input pixels multiplied at once, at least, to keep gemm efficient
+constexpr index_t kMinChunkSize = 64;
+// channels from which gemm beats the direct kernels
+constexpr index_t kGemmMinInChannels = 64;
+constexpr index_t kGemmMinOutChannels = 16;
+
+// the input pixels of a chunk, for rows columns of gemm
+index_t ChunkSize(const index_t in_image_size, const index_t rows) {
+  return std::min(in_image_size,
+                  std::max(kMinChunkSize, kColumnBufferSize / rows));
+}
+}  // namespace
+
+bool Deconv2dGemm::Preferred(const index_t *in_shape,
+                             const index_t *filter_shape,
+                             const int *strides) {
+  const index_t kernel_h = filter_shape[2];
+  const index_t kernel_w = filter_shape[3];
+  const bool has_direct_kernel = kernel_h == kernel_w && kernel_h >= 2
+      && kernel_h <= 4 && strides[0] == strides[1] && strides[0] <= 2;
+  if (!has_direct_kernel) {
+    return true;
+  }
+  // the direct kernels stream the whole input once per output channel
+  return in_shape[1] >= kGemmMinInChannels
+      && filter_shape[0] >= kGemmMinOutChannels;
+}
+
+index_t Deconv2dGemm::ScratchSize(const index_t *in_shape,
+                                  const index_t *filter_shape) const {
+  const index_t in_channels = in_shape[1];
+  const index_t rows = filter_shape[0] * filter_shape[2] * filter_shape[3];
+  const index_t chunk_size = ChunkSize(in_shape[2] * in_shape[3], rows);
+  return PadAlignSize(sizeof(float) * rows * chunk_size) +
+      gemm_.ScratchSize(rows, chunk_size, in_channels);
+}
+
+MaceStatus Deconv2dGemm::Compute(const OpContext *context,
+                                 const Tensor *input,
+                                 const Tensor *filter,
+                                 const int *strides,
+                                 const index_t *padded_out_shape,
+                                 float *padded_output) {
+  const index_t batch = input->dim(0);
+  const index_t in_channels = input->dim(1);
+  const index_t in_height = input->dim(2);
+  const index_t in_width = input->dim(3);
+  const index_t out_channels = filter->dim(0);
+  const index_t kernel_h = filter->dim(2);
+  const index_t kernel_w = filter->dim(3);
+  const index_t kernel_size = kernel_h * kernel_w;
+  const index_t out_height = padded_out_shape[2];
+  const index_t out_width = padded_out_shape[3];
+  const index_t in_image_size = in_height * in_width;
+  const index_t out_image_size = out_height * out_width;
+  const int stride_h = strides[0];
+  const int stride_w = strides[1];
+  const index_t rows = out_channels * kernel_size;
+
+  Tensor::MappingGuard input_guard(input);
+  Tensor::MappingGuard filter_guard(filter);
+  const float *input_data = input->data<float>();
+
+  if (!filter_transposed_) {
+    MACE_RETURN_IF_ERROR(transposed_filter_.Resize({rows, in_channels}));
+    const float *filter_data = filter->data<float>();
+    float *transposed_data = transposed_filter_.mutable_data<float>();
+#pragma omp parallel for collapse(2) schedule(runtime)
+    for (index_t oc = 0; oc < out_channels; ++oc) {
+      for (index_t k = 0; k < kernel_size; ++k) {
+        const float *filter_ptr =
+            filter_data + oc * in_channels * kernel_size + k;
+        float *row = transposed_data + (oc * kernel_size + k) * in_channels;
+        for (index_t ic = 0; ic < in_channels; ++ic) {
+          row[ic] = filter_ptr[ic * kernel_size];
+        }
+      }
+    }
+    filter_transposed_ = filter->is_weight();
+  }
+
+  // the columns follow the buffers of the caller in the scratch, and the
+  // buffers of gemm follow the columns
+  const index_t chunk_size = ChunkSize(in_image_size, rows);
+  ScratchBuffer *scratch = context->device()->scratch_buffer();
+  Tensor columns(scratch->Scratch(
+      PadAlignSize(sizeof(float) * rows * chunk_size)), DT_FLOAT);
+  const index_t gemm_offset = scratch->offset();
+  for (index_t b = 0; b < batch; ++b) {
+    const float *in_batch = input_data + b * in_channels * in_image_size;
+    float *out_batch = padded_output + b * out_channels * out_image_size;
+    for (index_t chunk_start = 0; chunk_start < in_image_size;
+         chunk_start += chunk_size) {
+      const index_t chunk = std::min(chunk_size, in_image_size - chunk_start);
+      columns.Reshape({rows, chunk});
+
+      // row d of the block is input channel d at the chunk pixels
+      auto pack_pixels = [=](const index_t,
+                             const index_t start_col,
+                             const index_t cols,
+                             const index_t col_block_size,
+                             float *packed_block) {
+        for (index_t d = 0; d < in_channels; ++d) {
+          const float *in_ptr =
+              in_batch + d * in_image_size + chunk_start + start_col;
+          float *packed_ptr = packed_block + d * col_block_size;
+          std::copy(in_ptr, in_ptr + cols, packed_ptr);
+          std::fill(packed_ptr + cols, packed_ptr + col_block_size, 0.f);
+        }
+      };
+      scratch->Rewind(gemm_offset);
+      MACE_RETURN_IF_ERROR(gemm_.Compute(context,
+                                         &transposed_filter_,
+                                         pack_pixels,
+                                         1,
+                                         rows,
+                                         chunk,
+                                         in_channels,
+                                         RowMajor,
+                                         &columns));
+
+      // Output rows of different residues modulo the stride are written by
+      // different kernel rows only, so the residues of each channel scatter
+      // in parallel without overlapping.
+      const float *columns_data = columns.data<float>();
+      const index_t residues = std::min<index_t>(stride_h, kernel_h);
+#pragma omp parallel for collapse(2) schedule(runtime)
+      for (index_t oc = 0; oc < out_channels; ++oc) {
+        for (index_t r = 0; r < residues; ++r) {
+          float *out_base = out_batch + oc * out_image_size;
+          for (index_t kh = r; kh < kernel_h; kh += stride_h) {
+            for (index_t kw = 0; kw < kernel_w; ++kw) {
+              const float *column = columns_data
+                  + (oc * kernel_size + kh * kernel_w + kw) * chunk;
+              index_t h = chunk_start / in_width;
+              index_t w = chunk_start % in_width;
+              for (index_t p = 0; p < chunk; ++p) {
+                out_base[(h * stride_h + kh) * out_width
+                    + w * stride_w + kw] += column[p];
+                if (++w == in_width) {
+                  w = 0;
+                  ++h;
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+
+  return MaceStatus::MACE_SUCCESS;
+}
+
+}  // namespace fp32
+}  // namespace arm
+}  // namespace ops
+}  // namespace mace
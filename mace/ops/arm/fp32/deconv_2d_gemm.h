@@ -0,0 +1,71 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_OPS_ARM_FP32_DECONV_2D_GEMM_H_
+#define MACE_OPS_ARM_FP32_DECONV_2D_GEMM_H_
+
+#include "mace/public/mace.h"
+#include "mace/core/tensor.h"
+#include "mace/core/op_context.h"
+#include "mace/ops/arm/fp32/gemm.h"
+
+namespace mace {
+namespace ops {
+namespace arm {
+namespace fp32 {
+
+// Transposed convolution of any filter size and stride as the gemm of the
+// filter, viewed as [out_channels * kernel_h * kernel_w, in_channels], and
+// the input pixels, whose output columns are then added into the output
+// patches they cover (col2im). The pixels are multiplied a chunk at a time
+// to bound the column buffer.
+class Deconv2dGemm {
+ public:
+  Deconv2dGemm() : filter_transposed_(false) {}
+  ~Deconv2dGemm() {}
+
+  // Whether gemm is expected to beat the direct kernels for an NCHW input
+  // and OIHW filter: always for the shapes without a direct kernel, and for
+  // the others once the channels are wide enough to be worth blocking.
+  static bool Preferred(const index_t *in_shape,
+                        const index_t *filter_shape,
+                        const int *strides);
+
+  // The scratch bytes taken by Compute, from the offset of the scratch, so
+  // that the caller could keep the padded output in the scratch before.
+  index_t ScratchSize(const index_t *in_shape,
+                      const index_t *filter_shape) const;
+
+  // Accumulates into the padded output, which has to be cleared first, as
+  // the direct kernels do. The scratch must have ScratchSize bytes left.
+  MaceStatus Compute(const OpContext *context,
+                     const Tensor *input,
+                     const Tensor *filter,
+                     const int *strides,
+                     const index_t *padded_out_shape,
+                     float *padded_output);
+
+ private:
+  Gemm gemm_;
+  // filter as [out_channels, kernel_h, kernel_w, in_channels]
+  Tensor transposed_filter_;
+  bool filter_transposed_;
+};
+
+}  // namespace fp32
+}  // namespace arm
+}  // namespace ops
+}  // namespace mace
+
+#endif  // MACE_OPS_ARM_FP32_DECONV_2D_GEMM_H_
@@ -17,8 +17,12 @@
 
 #include <arm_neon.h>
 #include <algorithm>
+#include <cstring>
+#include <string>
 #include <utility>
 
+#include "mace/core/runtime/cpu/cpu_runtime.h"
+
 namespace mace {
 namespace ops {
 namespace arm {
@@ -26,6 +30,55 @@ namespace fp32 {
 
 enum { kNoCache, kCacheLhs, kCacheRhs };
 
+#ifdef __aarch64__
+constexpr index_t kRowBlockSize = 8;
+#else
+constexpr index_t kRowBlockSize = 4;
+#endif
+constexpr index_t kDepthBlockSize = 4;
+
+// bytes of the rhs blocks packed at a time by an RhsPacker, or multiplied
+// by all the row blocks before the next ones, about the L2 cache of a core
+index_t PanelBytes() {
+  return static_cast<index_t>(GetCPUCacheSizes().l2);
+}
+
+// The depth of the chunks a GEMM of block_count output blocks is split
+// into, so that the threads have blocks of chunks to compute when there
+// are fewer blocks than threads, e.g. of a fully connected layer. Their
+// partial sums are added after. depth_padded if not split.
+index_t SplitDepth(const index_t block_count,
+                   const index_t col_block_size,
+                   const index_t depth_padded) {
+  const index_t threads = std::max(1, MaceOpenMPThreadCount);
+  if (block_count >= threads) {
+    return depth_padded;
+  }
+  // the lhs and rhs chunks of a block fill half of the L1 cache at least
+  const index_t min_split_depth = std::max(
+      kDepthBlockSize,
+      static_cast<index_t>(GetCPUCacheSizes().l1d / 2 / sizeof(float)) /
+          (kRowBlockSize + col_block_size) / kDepthBlockSize *
+          kDepthBlockSize);
+  const index_t splits = std::min(RoundUpDiv(threads, block_count),
+                                  depth_padded / min_split_depth);
+  if (splits <= 1) {
+    return depth_padded;
+  }
+  return RoundUp(RoundUpDiv(depth_padded, splits), kDepthBlockSize);
+}
+
+index_t Gemm::ColBlockSize() {
+#ifdef __aarch64__
+  // ARMv8.2 cores, told apart from older ones by the dot product extension,
+  // hide the latency of the 24 accumulators of the wider block
+  if (GetCPUFeatures().asimddp) {
+    return 12;
+  }
+#endif
+  return 8;
+}
+
 MaceStatus Gemm::Compute(const OpContext *context,
                          const Tensor *lhs,
                          const Tensor *rhs,
@@ -39,8 +92,32 @@ MaceStatus Gemm::Compute(const OpContext *context,
                          const bool lhs_batched,
                          const bool rhs_batched,
                          Tensor *output) {
-  MACE_UNUSED(context);
+  return Compute(context,
+                 lhs,
+                 rhs,
+                 MatrixBatch(batch, lhs_batched, lhs_major, rows, depth),
+                 MatrixBatch(batch, rhs_batched, rhs_major, depth, cols),
+                 rows,
+                 cols,
+                 depth,
+                 output_major,
+                 output);
+}
 
+MaceStatus Gemm::Compute(const OpContext *context,
+                         const Tensor *lhs,
+                         const Tensor *rhs,
+                         const MatrixBatch &lhs_batch,
+                         const MatrixBatch &rhs_batch,
+                         const index_t rows,
+                         const index_t cols,
+                         const index_t depth,
+                         const MatrixMajor output_major,
+                         Tensor *output) {
+  const index_t batch = lhs_batch.size();
+  MACE_CHECK(rhs_batch.size() == batch,
+             "lhs and rhs have different batches: ", batch, " vs. ",
+             rhs_batch.size());
   MACE_CHECK(output->size() == batch * rows * cols,
              "Need resize output tensor before call gemm.");
   Tensor::MappingGuard lhs_guard(lhs);
@@ -50,18 +127,25 @@ MaceStatus Gemm::Compute(const OpContext *context,
   const float *rhs_data = rhs->data<float>();
   float *output_data = output->mutable_data<float>();
 
-#ifdef __aarch64__
-  const index_t row_block_size = 8;
-#else
-  const index_t row_block_size = 4;
-#endif
-  const index_t col_block_size = 8;
-  const index_t depth_block_size = 4;
+  const index_t row_block_size = kRowBlockSize;
+  const index_t col_block_size = col_block_size_;
   const index_t row_block_count = RoundUpDiv(rows, row_block_size);
   const index_t col_block_count = RoundUpDiv(cols, col_block_size);
   const index_t rows_padded = RoundUp(rows, row_block_size);
   const index_t cols_padded = RoundUp(cols, col_block_size);
-  const index_t depth_padded = RoundUp(depth, depth_block_size);
+  const index_t depth_padded = RoundUp(depth, kDepthBlockSize);
+  const index_t block_size = row_block_size * col_block_size;
+  const index_t block_count = row_block_count * col_block_count;
+  const index_t split_depth =
+      SplitDepth(block_count, col_block_size, depth_padded);
+  const index_t depth_splits = RoundUpDiv(depth_padded, split_depth);
+  // the col blocks multiplied by all the row blocks before the next ones
+  const index_t panel_block_count = std::min(
+      col_block_count,
+      std::max<index_t>(1, PanelBytes() /
+          static_cast<index_t>(sizeof(float) * col_block_size *
+                               depth_padded)));
+  const index_t panel_count = RoundUpDiv(col_block_count, panel_block_count);
 
   ScratchBuffer *scratch = &tmp_scratch_buffer_;
   if (context != nullptr && context->device()->scratch_buffer() != nullptr) {
@@ -71,8 +155,9 @@ MaceStatus Gemm::Compute(const OpContext *context,
       PadAlignSize(sizeof(float) * rows_padded * depth_padded);
   index_t packed_rhs_size =
       PadAlignSize(sizeof(float) * depth_padded * cols_padded);
-  index_t packed_output_size =
-      PadAlignSize(sizeof(float) * rows_padded * cols_padded);
+  // an output block of each depth chunk
+  index_t packed_output_size = PadAlignSize(
+      sizeof(float) * depth_splits * rows_padded * cols_padded);
   // resize to the total size of lhs & rhs & output anyway,
   // in case we do not cache const tensor for saving memory
   MACE_RETURN_IF_ERROR(scratch->GrowSize(
@@ -84,120 +169,338 @@ MaceStatus Gemm::Compute(const OpContext *context,
   float *packed_output_data =
       scratch->Scratch(packed_output_size).mutable_data<float>();
 
-  int cache_side = kNoCache;
-  if (cached_ == kCacheLhs) {
-    packed_lhs_data = pack_cache_.mutable_data<float>();
-  } else if (cached_ == kCacheRhs) {
-    packed_rhs_data = pack_cache_.mutable_data<float>();
-  } else if (should_cache_pack_) {
-    if (lhs->is_weight() && !lhs_batched) {
-      cache_side = kCacheLhs;
-      pack_cache_.Resize(packed_lhs_size);
-      packed_lhs_data = pack_cache_.mutable_data<float>();
-    } else if (rhs->is_weight() && !rhs_batched) {
-      cache_side = kCacheRhs;
-      pack_cache_.Resize(packed_rhs_size);
-      packed_rhs_data = pack_cache_.mutable_data<float>();
+  if (cached_ == kNoCache && should_cache_pack_ && context != nullptr) {
+    PackedWeights *packed_weights = context->workspace()->packed_weights();
+    if (lhs->is_weight() && lhs_batch.IsSingle(rows, depth)) {
+      packed_weight_ = PackWeight(packed_weights, lhs,
+                                  MatrixMap<const float>(lhs_data,
+                                                         lhs_batch.major,
+                                                         rows,
+                                                         depth),
+                                  true);
+      cached_ = kCacheLhs;
+    } else if (rhs->is_weight() && rhs_batch.IsSingle(depth, cols)) {
+      packed_weight_ = PackWeight(packed_weights, rhs,
+                                  MatrixMap<const float>(rhs_data,
+                                                         rhs_batch.major,
+                                                         depth,
+                                                         cols),
+                                  false);
+      cached_ = kCacheRhs;
     }
   }
+  const float *packed_lhs =
+      cached_ == kCacheLhs ? packed_weight_ : packed_lhs_data;
+  const float *packed_rhs =
+      cached_ == kCacheRhs ? packed_weight_ : packed_rhs_data;
 
   for (index_t b = 0; b < batch; ++b) {
     MatrixMap<const float>
-        lhs_matrix
-        (lhs_data + static_cast<index_t>(lhs_batched) * b * rows * depth,
-         lhs_major,
-         rows,
-         depth);
+        lhs_matrix(lhs_data + lhs_batch.offsets[b],
+                   lhs_batch.major,
+                   rows,
+                   depth,
+                   lhs_batch.stride);
     MatrixMap<const float>
-        rhs_matrix
-        (rhs_data + static_cast<index_t>(rhs_batched) * b * depth * cols,
-         rhs_major,
-         depth,
-         cols);
+        rhs_matrix(rhs_data + rhs_batch.offsets[b],
+                   rhs_batch.major,
+                   depth,
+                   cols,
+                   rhs_batch.stride);
     MatrixMap<float> output_matrix
         (output_data + b * rows * cols, output_major, rows, cols);
 
-    // pack lhs
-    if (cached_ != kCacheLhs) {
-#pragma omp parallel for schedule(runtime)
+    // a broadcast operand is packed once for the batches reading it
+    if (cached_ != kCacheLhs &&
+        (b == 0 || lhs_batch.offsets[b] != lhs_batch.offsets[b - 1])) {
+      PackLhsBlocks(lhs_matrix, packed_lhs_data);
+    }
+    if (cached_ != kCacheRhs &&
+        (b == 0 || rhs_batch.offsets[b] != rhs_batch.offsets[b - 1])) {
+      PackRhsBlocks(rhs_matrix, packed_rhs_data);
+    }
+
+    auto unpack_block = [&](const index_t row_block_idx,
+                            const index_t col_block_idx,
+                            const float *packed_output_block) {
+      const index_t start_row = row_block_idx * row_block_size;
+      const index_t start_col = col_block_idx * col_block_size;
+      MatrixMap<float> output_block =
+          output_matrix.block(start_row,
+                              start_col,
+                              std::min(row_block_size, rows - start_row),
+                              std::min(col_block_size, cols - start_col));
+      UnpackOutput(packed_output_block, &output_block);
+    };
+
+    // multiply the depth chunks of the lhs and rhs blocks, by the row
+    // blocks and the depth chunks of a panel of col blocks at a time
+#pragma omp parallel for collapse(4) schedule(runtime)
+    for (index_t panel_idx = 0; panel_idx < panel_count; ++panel_idx) {
       for (index_t row_block_idx = 0; row_block_idx < row_block_count;
            ++row_block_idx) {
-        const index_t start_row = row_block_idx * row_block_size;
-        const index_t
-            row_block_len = std::min(row_block_size, rows - start_row);
-        float *packed_lhs_data_block =
-            packed_lhs_data + row_block_idx * row_block_size * depth_padded;
-        PackLhs(lhs_matrix.block(start_row, 0, row_block_len, depth),
-                packed_lhs_data_block);
-      }
-      if (cache_side == kCacheLhs) {
-        cached_ = kCacheLhs;
-        if (lhs->UnderlyingBuffer()->OnHost()) {
-          AdviseFree(reinterpret_cast<void *>(const_cast<float *>(lhs->data<
-                         float>())),
-                     lhs->raw_size());
-        }
-      }
+        for (index_t i = 0; i < panel_block_count; ++i) {
+          for (index_t split_idx = 0; split_idx < depth_splits;
+               ++split_idx) {
+            const index_t col_block_idx = panel_idx * panel_block_count + i;
+            if (col_block_idx >= col_block_count) {
+              continue;
+            }
+            const index_t start_depth = split_idx * split_depth;
+            float *packed_output_block = packed_output_data +
+                ((split_idx * row_block_count + row_block_idx) *
+                    col_block_count + col_block_idx) * block_size;
+            ComputeBlock(packed_lhs + row_block_idx * row_block_size *
+                             depth_padded + start_depth * row_block_size,
+                         packed_rhs + col_block_idx * col_block_size *
+                             depth_padded + start_depth * col_block_size,
+                         std::min(split_depth, depth_padded - start_depth),
+                         packed_output_block);
+            if (depth_splits == 1) {
+              unpack_block(row_block_idx, col_block_idx, packed_output_block);
+            }
+          }  // split_idx
+        }  // i
+      }  // row_block_idx
+    }  // panel_idx
+
+    if (depth_splits > 1) {
+      // add the partial sums of the depth chunks to those of the first
+#pragma omp parallel for collapse(2) schedule(runtime)
+      for (index_t row_block_idx = 0; row_block_idx < row_block_count;
+           ++row_block_idx) {
+        for (index_t col_block_idx = 0; col_block_idx < col_block_count;
+             ++col_block_idx) {
+          float *packed_output_block = packed_output_data +
+              (row_block_idx * col_block_count + col_block_idx) * block_size;
+          for (index_t split_idx = 1; split_idx < depth_splits;
+               ++split_idx) {
+            const float *partial_block =
+                packed_output_block + split_idx * block_count * block_size;
+            for (index_t j = 0; j < block_size; j += 4) {
+              vst1q_f32(packed_output_block + j,
+                        vaddq_f32(vld1q_f32(packed_output_block + j),
+                                  vld1q_f32(partial_block + j)));
+            }
+          }
+          unpack_block(row_block_idx, col_block_idx, packed_output_block);
+        }  // col_block_idx
+      }  // row_block_idx
     }
+  }  // b
 
-    // pack rhs
-    if (cached_ != kCacheRhs) {
-#pragma omp parallel for schedule(runtime)
-      for (index_t col_block_idx = 0; col_block_idx < col_block_count;
-           ++col_block_idx) {
-        const index_t start_col = col_block_idx * col_block_size;
-        const index_t
-            col_block_len = std::min(col_block_size, cols - start_col);
-        float *packed_rhs_data_block =
-            packed_rhs_data + col_block_idx * col_block_size * depth_padded;
-        PackRhs(rhs_matrix.block(0, start_col, depth, col_block_len),
-                packed_rhs_data_block);
-      }
-      if (cache_side == kCacheRhs) {
-        cached_ = kCacheRhs;
-        if (rhs->UnderlyingBuffer()->OnHost()) {
-          AdviseFree(reinterpret_cast<void *>(const_cast<float *>(rhs->data<
-                         float>())),
-                     rhs->raw_size());
-        }
-      }
-    }
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus Gemm::Compute(const OpContext *context,
+                         const Tensor *lhs,
+                         const RhsPacker &rhs_packer,
+                         const index_t batch,
+                         const index_t rows,
+                         const index_t cols,
+                         const index_t depth,
+                         const MatrixMajor lhs_major,
+                         Tensor *output) {
+  MACE_CHECK(output->size() == batch * rows * cols,
+             "Need resize output tensor before call gemm.");
+  Tensor::MappingGuard lhs_guard(lhs);
+  Tensor::MappingGuard output_guard(output);
+  const float *lhs_data = lhs->data<float>();
+  float *output_data = output->mutable_data<float>();
+
+  const index_t row_block_size = kRowBlockSize;
+  const index_t col_block_size = col_block_size_;
+  const index_t row_block_count = RoundUpDiv(rows, row_block_size);
+  const index_t col_block_count = RoundUpDiv(cols, col_block_size);
+  const index_t rows_padded = RoundUp(rows, row_block_size);
+  const index_t depth_padded = RoundUp(depth, kDepthBlockSize);
+  // rhs blocks of a panel, as many as fit in PanelBytes()
+  const index_t block_bytes = sizeof(float) * col_block_size * depth_padded;
+  const index_t panel_block_count = std::min(
+      col_block_count, std::max<index_t>(1, PanelBytes() / block_bytes));
+
+  ScratchBuffer *scratch = &tmp_scratch_buffer_;
+  if (context != nullptr && context->device()->scratch_buffer() != nullptr) {
+    scratch = context->device()->scratch_buffer();
+  }
+  index_t packed_lhs_size =
+      PadAlignSize(sizeof(float) * rows_padded * depth_padded);
+  index_t packed_panel_size = PadAlignSize(block_bytes * panel_block_count);
+  index_t packed_output_size = PadAlignSize(
+      sizeof(float) * rows_padded * col_block_size * panel_block_count);
+  MACE_RETURN_IF_ERROR(scratch->GrowSize(ScratchSize(rows, cols, depth)));
+  float *packed_lhs_data =
+      scratch->Scratch(packed_lhs_size).mutable_data<float>();
+  float *packed_panel_data =
+      scratch->Scratch(packed_panel_size).mutable_data<float>();
+  float *packed_output_data =
+      scratch->Scratch(packed_output_size).mutable_data<float>();
+
+  const MatrixMap<const float> lhs_matrix(lhs_data, lhs_major, rows, depth);
+  if (cached_ == kNoCache && should_cache_pack_ && context != nullptr
+      && lhs->is_weight()) {
+    packed_weight_ = PackWeight(context->workspace()->packed_weights(), lhs,
+                                lhs_matrix, true);
+    cached_ = kCacheLhs;
+  }
+  const float *packed_lhs = packed_lhs_data;
+  if (cached_ == kCacheLhs) {
+    packed_lhs = packed_weight_;
+  } else {
+    PackLhsBlocks(lhs_matrix, packed_lhs_data);
+  }
+
+  for (index_t b = 0; b < batch; ++b) {
+    MatrixMap<float> output_matrix
+        (output_data + b * rows * cols, RowMajor, rows, cols);
+    for (index_t panel_start = 0; panel_start < col_block_count;
+         panel_start += panel_block_count) {
+      const index_t panel_blocks =
+          std::min(panel_block_count, col_block_count - panel_start);
 
-    // multiply lhs and rhs
 #pragma omp parallel for schedule(runtime)
-    for (index_t row_block_idx = 0; row_block_idx < row_block_count;
-         ++row_block_idx) {
-      const index_t start_row = row_block_idx * row_block_size;
-      const index_t row_block_len = std::min(row_block_size, rows - start_row);
-      const float *packed_lhs_data_block =
-          packed_lhs_data + row_block_idx * row_block_size * depth_padded;
+      for (index_t i = 0; i < panel_blocks; ++i) {
+        const index_t start_col = (panel_start + i) * col_block_size;
+        float *packed_block = packed_panel_data
+            + i * col_block_size * depth_padded;
+        rhs_packer(b, start_col, std::min(col_block_size, cols - start_col),
+                   col_block_size, packed_block);
+        memset(packed_block + depth * col_block_size, 0,
+               sizeof(float) * (depth_padded - depth) * col_block_size);
+      }
 
-      for (index_t col_block_idx = 0; col_block_idx < col_block_count;
-           ++col_block_idx) {
-        const index_t start_col = col_block_idx * col_block_size;
-        const index_t
-            col_block_len = std::min(col_block_size, cols - start_col);
-        const float *packed_rhs_data_block =
-            packed_rhs_data + col_block_idx * col_block_size * depth_padded;
-        float *packed_output_data_block =
-            packed_output_data + row_block_idx * row_block_size * cols_padded
-                + col_block_idx * col_block_size;
-        ComputeBlock(packed_lhs_data_block,
-                     packed_rhs_data_block,
-                     depth_padded,
-                     packed_output_data_block);
-        MatrixMap<float> output_block = output_matrix.block(start_row,
-                                                            start_col,
-                                                            row_block_len,
-                                                            col_block_len);
-        UnpackOutput(packed_output_data_block, &output_block);
-      }  // col_block_idx
-    }  // row_block_idx
+      // multiply lhs and the panel
+#pragma omp parallel for collapse(2) schedule(runtime)
+      for (index_t row_block_idx = 0; row_block_idx < row_block_count;
+           ++row_block_idx) {
+        for (index_t i = 0; i < panel_blocks; ++i) {
+          const index_t start_row = row_block_idx * row_block_size;
+          const index_t row_block_len =
+              std::min(row_block_size, rows - start_row);
+          const index_t start_col = (panel_start + i) * col_block_size;
+          const index_t col_block_len =
+              std::min(col_block_size, cols - start_col);
+          float *packed_output_data_block = packed_output_data
+              + (row_block_idx * panel_block_count + i)
+                  * row_block_size * col_block_size;
+          ComputeBlock(packed_lhs + row_block_idx * row_block_size
+                           * depth_padded,
+                       packed_panel_data + i * col_block_size * depth_padded,
+                       depth_padded,
+                       packed_output_data_block);
+          MatrixMap<float> output_block = output_matrix.block(start_row,
+                                                              start_col,
+                                                              row_block_len,
+                                                              col_block_len);
+          UnpackOutput(packed_output_data_block, &output_block);
+        }  // i
+      }  // row_block_idx
+    }  // panel_start
   }  // b
 
   return MaceStatus::MACE_SUCCESS;
 }
 
+index_t Gemm::ScratchSize(const index_t rows,
+                          const index_t cols,
+                          const index_t depth) const {
+  const index_t col_block_count = RoundUpDiv(cols, col_block_size_);
+  const index_t rows_padded = RoundUp(rows, kRowBlockSize);
+  const index_t depth_padded = RoundUp(depth, kDepthBlockSize);
+  const index_t block_bytes = sizeof(float) * col_block_size_ * depth_padded;
+  const index_t panel_block_count = std::min(
+      col_block_count, std::max<index_t>(1, PanelBytes() / block_bytes));
+  return PadAlignSize(sizeof(float) * rows_padded * depth_padded) +
+      PadAlignSize(block_bytes * panel_block_count) +
+      PadAlignSize(sizeof(float) * rows_padded * col_block_size_ *
+                   panel_block_count);
+}
+
+void Gemm::PackLhsWeight(Workspace *workspace,
+                         const Tensor *lhs,
+                         const index_t rows,
+                         const index_t depth,
+                         const MatrixMajor lhs_major) {
+  if (!should_cache_pack_ || !lhs->is_weight() || cached_ != kNoCache) {
+    return;
+  }
+  Tensor::MappingGuard lhs_guard(lhs);
+  packed_weight_ = PackWeight(workspace->packed_weights(), lhs,
+                              MatrixMap<const float>(lhs->data<float>(),
+                                                     lhs_major,
+                                                     rows,
+                                                     depth),
+                              true);
+  cached_ = kCacheLhs;
+}
+
+const float *Gemm::PackWeight(PackedWeights *packed_weights,
+                              const Tensor *weight,
+                              const MatrixMap<const float> &matrix,
+                              const bool is_lhs) {
+  const index_t rows = matrix.rows();
+  const index_t cols = matrix.cols();
+  // lhs is packed by row blocks along its cols, rhs by col blocks along
+  // its rows
+  const index_t width_block_size = is_lhs ? kRowBlockSize : col_block_size_;
+  const index_t width = is_lhs ? rows : cols;
+  const index_t depth = is_lhs ? cols : rows;
+  const std::string layout = MakeString(
+      "gemm_fp32_", is_lhs ? "lhs_" : "rhs_", width_block_size, "x",
+      kDepthBlockSize, "_", rows, "x", cols, "_",
+      static_cast<int>(matrix.matrix_major()));
+  const index_t size = RoundUp(width, width_block_size)
+      * RoundUp(depth, kDepthBlockSize);
+  const float *packed = packed_weights->GetOrPack(
+      layout, weight, size, [&](float *packed_data) {
+        if (is_lhs) {
+          PackLhsBlocks(matrix, packed_data);
+        } else {
+          PackRhsBlocks(matrix, packed_data);
+        }
+      });
+  if (weight->UnderlyingBuffer()->OnHost()) {
+    AdviseFree(reinterpret_cast<void *>(const_cast<float *>(weight->data<
+                   float>())),
+               weight->raw_size());
+  }
+  return packed;
+}
+
+void Gemm::PackLhsBlocks(const MatrixMap<const float> &lhs,
+                         float *packed_lhs) {
+  const index_t rows = lhs.rows();
+  const index_t depth = lhs.cols();
+  const index_t row_block_count = RoundUpDiv(rows, kRowBlockSize);
+  const index_t depth_padded = RoundUp(depth, kDepthBlockSize);
+#pragma omp parallel for schedule(runtime)
+  for (index_t row_block_idx = 0; row_block_idx < row_block_count;
+       ++row_block_idx) {
+    const index_t start_row = row_block_idx * kRowBlockSize;
+    const index_t row_block_len = std::min(kRowBlockSize, rows - start_row);
+    float *packed_lhs_block =
+        packed_lhs + row_block_idx * kRowBlockSize * depth_padded;
+    PackLhs(lhs.block(start_row, 0, row_block_len, depth), packed_lhs_block);
+  }
+}
+
+void Gemm::PackRhsBlocks(const MatrixMap<const float> &rhs,
+                         float *packed_rhs) {
+  const index_t depth = rhs.rows();
+  const index_t cols = rhs.cols();
+  const index_t col_block_count = RoundUpDiv(cols, col_block_size_);
+  const index_t depth_padded = RoundUp(depth, kDepthBlockSize);
+#pragma omp parallel for schedule(runtime)
+  for (index_t col_block_idx = 0; col_block_idx < col_block_count;
+       ++col_block_idx) {
+    const index_t start_col = col_block_idx * col_block_size_;
+    const index_t col_block_len = std::min(col_block_size_, cols - start_col);
+    float *packed_rhs_block =
+        packed_rhs + col_block_idx * col_block_size_ * depth_padded;
+    PackRhs(rhs.block(0, start_col, depth, col_block_len), packed_rhs_block);
+  }
+}
+
 void Gemm::ComputeBlock(const float *packed_lhs_data,
                         const float *packed_rhs_data,
                         const index_t depth_padded,
@@ -215,6 +518,15 @@ void Gemm::ComputeBlock(const float *packed_lhs_data,
     }
   }
   */
+#ifdef __aarch64__
+  if (col_block_size_ == 12) {
+    ComputeBlock8x12(packed_lhs_data,
+                     packed_rhs_data,
+                     depth_padded,
+                     packed_output_data);
+    return;
+  }
+#endif
   const float *lhs_ptr = packed_lhs_data;
   const float *rhs_ptr = packed_rhs_data;
 
@@ -678,6 +990,87 @@ void Gemm::ComputeBlock(const float *packed_lhs_data,
 #endif
 }
 
+#ifdef __aarch64__
+void Gemm::ComputeBlock8x12(const float *packed_lhs_data,
+                            const float *packed_rhs_data,
+                            const index_t depth_padded,
+                            float *packed_output_data) {
+  // c{r}{j} accumulates row r and columns [4j, 4j + 4) of the block
+  const float32x4_t vzero = vdupq_n_f32(0.f);
+  float32x4_t c00 = vzero, c01 = vzero, c02 = vzero;
+  float32x4_t c10 = vzero, c11 = vzero, c12 = vzero;
+  float32x4_t c20 = vzero, c21 = vzero, c22 = vzero;
+  float32x4_t c30 = vzero, c31 = vzero, c32 = vzero;
+  float32x4_t c40 = vzero, c41 = vzero, c42 = vzero;
+  float32x4_t c50 = vzero, c51 = vzero, c52 = vzero;
+  float32x4_t c60 = vzero, c61 = vzero, c62 = vzero;
+  float32x4_t c70 = vzero, c71 = vzero, c72 = vzero;
+
+  const float *lhs_ptr = packed_lhs_data;
+  const float *rhs_ptr = packed_rhs_data;
+  for (index_t d = 0; d < depth_padded; ++d) {
+    float32x4_t a0 = vld1q_f32(lhs_ptr);
+    float32x4_t a1 = vld1q_f32(lhs_ptr + 4);
+    float32x4_t b0 = vld1q_f32(rhs_ptr);
+    float32x4_t b1 = vld1q_f32(rhs_ptr + 4);
+    float32x4_t b2 = vld1q_f32(rhs_ptr + 8);
+    lhs_ptr += 8;
+    rhs_ptr += 12;
+
+    c00 = vfmaq_laneq_f32(c00, b0, a0, 0);
+    c01 = vfmaq_laneq_f32(c01, b1, a0, 0);
+    c02 = vfmaq_laneq_f32(c02, b2, a0, 0);
+    c10 = vfmaq_laneq_f32(c10, b0, a0, 1);
+    c11 = vfmaq_laneq_f32(c11, b1, a0, 1);
+    c12 = vfmaq_laneq_f32(c12, b2, a0, 1);
+    c20 = vfmaq_laneq_f32(c20, b0, a0, 2);
+    c21 = vfmaq_laneq_f32(c21, b1, a0, 2);
+    c22 = vfmaq_laneq_f32(c22, b2, a0, 2);
+    c30 = vfmaq_laneq_f32(c30, b0, a0, 3);
+    c31 = vfmaq_laneq_f32(c31, b1, a0, 3);
+    c32 = vfmaq_laneq_f32(c32, b2, a0, 3);
+
+    c40 = vfmaq_laneq_f32(c40, b0, a1, 0);
+    c41 = vfmaq_laneq_f32(c41, b1, a1, 0);
+    c42 = vfmaq_laneq_f32(c42, b2, a1, 0);
+    c50 = vfmaq_laneq_f32(c50, b0, a1, 1);
+    c51 = vfmaq_laneq_f32(c51, b1, a1, 1);
+    c52 = vfmaq_laneq_f32(c52, b2, a1, 1);
+    c60 = vfmaq_laneq_f32(c60, b0, a1, 2);
+    c61 = vfmaq_laneq_f32(c61, b1, a1, 2);
+    c62 = vfmaq_laneq_f32(c62, b2, a1, 2);
+    c70 = vfmaq_laneq_f32(c70, b0, a1, 3);
+    c71 = vfmaq_laneq_f32(c71, b1, a1, 3);
+    c72 = vfmaq_laneq_f32(c72, b2, a1, 3);
+  }
+
+  vst1q_f32(packed_output_data + 0, c00);
+  vst1q_f32(packed_output_data + 4, c01);
+  vst1q_f32(packed_output_data + 8, c02);
+  vst1q_f32(packed_output_data + 12, c10);
+  vst1q_f32(packed_output_data + 16, c11);
+  vst1q_f32(packed_output_data + 20, c12);
+  vst1q_f32(packed_output_data + 24, c20);
+  vst1q_f32(packed_output_data + 28, c21);
+  vst1q_f32(packed_output_data + 32, c22);
+  vst1q_f32(packed_output_data + 36, c30);
+  vst1q_f32(packed_output_data + 40, c31);
+  vst1q_f32(packed_output_data + 44, c32);
+  vst1q_f32(packed_output_data + 48, c40);
+  vst1q_f32(packed_output_data + 52, c41);
+  vst1q_f32(packed_output_data + 56, c42);
+  vst1q_f32(packed_output_data + 60, c50);
+  vst1q_f32(packed_output_data + 64, c51);
+  vst1q_f32(packed_output_data + 68, c52);
+  vst1q_f32(packed_output_data + 72, c60);
+  vst1q_f32(packed_output_data + 76, c61);
+  vst1q_f32(packed_output_data + 80, c62);
+  vst1q_f32(packed_output_data + 84, c70);
+  vst1q_f32(packed_output_data + 88, c71);
+  vst1q_f32(packed_output_data + 92, c72);
+}
+#endif  // __aarch64__
+
 void Gemm::PackLhs(const MatrixMap<const float> &lhs,
                    float *packed_lhs) {
 #ifdef __aarch64__
@@ -689,12 +1082,20 @@ void Gemm::PackLhs(const MatrixMap<const float> &lhs,
 
 void Gemm::PackRhs(const MatrixMap<const float> &rhs,
                    float *packed_rhs) {
-  Pack<8, 4>(rhs, RowMajor, packed_rhs);
+  if (col_block_size_ == 12) {
+    Pack<12, 4>(rhs, RowMajor, packed_rhs);
+  } else {
+    Pack<8, 4>(rhs, RowMajor, packed_rhs);
+  }
 }
 
 void Gemm::UnpackOutput(const float *packed_output, MatrixMap<float> *output) {
 #ifdef __aarch64__
-  Unpack<8, 8>(packed_output, output);
+  if (col_block_size_ == 12) {
+    Unpack<8, 12>(packed_output, output);
+  } else {
+    Unpack<8, 8>(packed_output, output);
+  }
 #else
   Unpack<4, 8>(packed_output, output);
 #endif
@@ -961,6 +1362,48 @@ void Gemm::Pack<8, 4>(const MatrixMap<const float> &matrix,
   }
 }
 
+template<>
+void Gemm::Pack<12, 4>(const MatrixMap<const float> &matrix,
+                       MatrixMajor dst_major,
+                       float *packed_matrix) {
+  // only rhs of the 8x12 microkernel is packed by blocks of 12
+  MACE_CHECK(dst_major == RowMajor);
+  const index_t width = matrix.cols();
+  const index_t depth = matrix.rows();
+  const index_t width_stride = matrix.cols_stride();
+  const index_t depth_stride = matrix.rows_stride();
+  const float *data = matrix.data();
+  float *packed_ptr = packed_matrix;
+
+  const index_t block_size = 12;
+  const index_t depth_padded = RoundUp(depth, static_cast<index_t>(4));
+
+  if (depth_padded > depth) {
+    memset(packed_ptr + depth * block_size,
+           0,
+           sizeof(float) * (depth_padded - depth) * block_size);
+  }
+
+  if (matrix.matrix_major() == RowMajor && width == block_size) {
+    for (index_t d = 0; d < depth; ++d) {
+      vst1q_f32(packed_ptr, vld1q_f32(data));
+      vst1q_f32(packed_ptr + 4, vld1q_f32(data + 4));
+      vst1q_f32(packed_ptr + 8, vld1q_f32(data + 8));
+      data += depth_stride;
+      packed_ptr += block_size;
+    }
+  } else {
+    const index_t width_remain = block_size - width;
+    for (index_t d = 0; d < depth; ++d) {
+      for (index_t w = 0; w < width; ++w) {
+        packed_ptr[w] = data[d * depth_stride + w * width_stride];
+      }  // w
+      memset(packed_ptr + width, 0, sizeof(float) * width_remain);
+      packed_ptr += block_size;
+    }  // d
+  }
+}
+
 template<>
 void Gemm::Unpack<4, 8>(const float *packed_output, MatrixMap<float> *output) {
   const index_t rows = output->rows();
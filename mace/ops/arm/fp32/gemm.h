@@ -15,6 +15,8 @@
 #ifndef MACE_OPS_ARM_FP32_GEMM_H_
 #define MACE_OPS_ARM_FP32_GEMM_H_
 
+#include <functional>
+
 #include "mace/public/mace.h"
 #include "mace/core/tensor.h"
 #include "mace/core/op_context.h"
@@ -32,7 +34,8 @@ class Gemm {
  public:
   explicit Gemm(const bool should_cache_pack)
       : tmp_scratch_buffer_(GetCPUAllocator()),
-        pack_cache_(GetCPUAllocator()),
+        col_block_size_(ColBlockSize()),
+        packed_weight_(nullptr),
         should_cache_pack_(should_cache_pack),
         cached_(0) {}
   Gemm() : Gemm(false) {}
@@ -53,6 +56,21 @@ class Gemm {
       const bool rhs_batched,
       Tensor *output);
 
+  // Multiply the matrices of lhs_batch by those of rhs_batch, of the same
+  // count, e.g. of broadcast batch dims or read through a transpose in
+  // place, into the output of [batch, rows, cols] in output_major.
+  MaceStatus Compute(
+      const OpContext *context,
+      const Tensor *lhs,
+      const Tensor *rhs,
+      const MatrixBatch &lhs_batch,
+      const MatrixBatch &rhs_batch,
+      const index_t rows,
+      const index_t cols,
+      const index_t depth,
+      const MatrixMajor output_major,
+      Tensor *output);
+
   // Original matrix before transpose has row-major
   MaceStatus Compute(
       const OpContext *context,
@@ -70,12 +88,73 @@ class Gemm {
       const bool rhs_batched,
       Tensor *output);
 
+  // Fill the packed block of the rhs columns [start_col, start_col + cols)
+  // of a batch: block[d * col_block_size + c] = rhs(d, start_col + c) for
+  // d < depth, and zero for c >= cols. The padded depth is zeroed by gemm.
+  typedef std::function<void(const index_t /* batch */,
+                             const index_t /* start_col */,
+                             const index_t /* cols */,
+                             const index_t /* col_block_size */,
+                             float * /* packed_block */)> RhsPacker;
+
+  // Multiply lhs by an rhs which is never materialized: its column blocks
+  // are packed by rhs_packer into a panel of a few blocks at a time, e.g.
+  // the input patches of a convolution. The output is row-major.
+  MaceStatus Compute(
+      const OpContext *context,
+      const Tensor *lhs,
+      const RhsPacker &rhs_packer,
+      const index_t batch,
+      const index_t rows,
+      const index_t cols,
+      const index_t depth,
+      const MatrixMajor lhs_major,
+      Tensor *output);
+
+  // The scratch bytes taken by Compute with an rhs packer, from the offset
+  // of the scratch, for callers keeping their own buffers in it before.
+  index_t ScratchSize(const index_t rows,
+                      const index_t cols,
+                      const index_t depth) const;
+
+  // Pack the constant lhs of the following Computes into the packed weights
+  // of the workspace now instead of in the first Compute. No-op if packs
+  // are not cached.
+  void PackLhsWeight(Workspace *workspace,
+                     const Tensor *lhs,
+                     const index_t rows,
+                     const index_t depth,
+                     const MatrixMajor lhs_major);
+
  private:
+  // columns of an output block of the microkernel picked for the cores
+  static index_t ColBlockSize();
+
+  // the packed data of a weight, looked up in or added to packed_weights
+  const float *PackWeight(PackedWeights *packed_weights,
+                          const Tensor *weight,
+                          const MatrixMap<const float> &matrix,
+                          const bool is_lhs);
+
+  void PackLhsBlocks(const MatrixMap<const float> &lhs,
+                     float *packed_lhs);
+
+  void PackRhsBlocks(const MatrixMap<const float> &rhs,
+                     float *packed_rhs);
+
   void ComputeBlock(const float *packed_lhs_data,
                     const float *packed_rhs_data,
                     const index_t depth_padded,
                     float *packed_output_data);
 
+#ifdef __aarch64__
+  // 8x12 output block for ARMv8.2 cores, using 24 accumulator registers
+  void ComputeBlock8x12(const float *packed_lhs_data,
+                        const float *packed_rhs_data,
+                        const index_t depth_padded,
+                        float *packed_output_data);
+#endif
+
   void PackLhs(const MatrixMap<const float> &lhs,
                float *packed_lhs);
 
@@ -126,7 +205,9 @@ class Gemm {
   }
 
   ScratchBuffer tmp_scratch_buffer_;
-  Buffer pack_cache_;
+  const index_t col_block_size_;
+  // owned by the packed weights of the workspace
+  const float *packed_weight_;
 
   bool should_cache_pack_;
   int cached_;
@@ -142,6 +223,11 @@ void Gemm::Pack<8, 4>(const MatrixMap<const float> &matrix,
                       MatrixMajor dst_major,
                       float *packed_matrix);
 
+template<>
+void Gemm::Pack<12, 4>(const MatrixMap<const float> &matrix,
+                       MatrixMajor dst_major,
+                       float *packed_matrix);
+
 template<>
 void Gemm::Unpack<4, 8>(const float *packed_output, MatrixMap<float> *output);
 
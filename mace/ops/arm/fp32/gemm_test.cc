@@ -108,6 +108,79 @@ TEST(ArmGemm, TestGemmFloat32) {
   TestGemmFloat32(3, 47, 69, 37, RowMajor, RowMajor, RowMajor, false, true);
 
   TestGemmFloat32(16, 31, 61, 67, RowMajor, ColMajor, RowMajor, true, true);
+
+  // few output blocks of a large depth, split across the threads
+  TestGemmFloat32(1, 3, 5, 4099, RowMajor, ColMajor, RowMajor, true, true);
+  TestGemmFloat32(2, 17, 9, 2053, ColMajor, RowMajor, RowMajor, true, true);
+}
+
+void TestGemmFloat32RhsPacker(const index_t batch,
+                              const index_t rows,
+                              const index_t cols,
+                              const index_t depth,
+                              const MatrixMajor lhs_major) {
+  Tensor lhs(GetCPUAllocator(), DataType::DT_FLOAT);
+  Tensor rhs(GetCPUAllocator(), DataType::DT_FLOAT);
+  Tensor output(GetCPUAllocator(), DataType::DT_FLOAT);
+  lhs.Resize({1, rows, depth});
+  rhs.Resize({batch, depth, cols});
+  output.Resize({batch, rows, cols});
+  {
+    Tensor::MappingGuard lhs_guard(&lhs);
+    Tensor::MappingGuard rhs_guard(&rhs);
+    GenerateRandomRealTypeData<float>(lhs.shape(), lhs.mutable_data<float>());
+    GenerateRandomRealTypeData<float>(rhs.shape(), rhs.mutable_data<float>());
+  }
+  const float *rhs_data = rhs.data<float>();
+  auto rhs_packer = [=](const index_t b,
+                        const index_t start_col,
+                        const index_t block_cols,
+                        const index_t col_block_size,
+                        float *packed_block) {
+    for (index_t d = 0; d < depth; ++d) {
+      for (index_t c = 0; c < col_block_size; ++c) {
+        packed_block[d * col_block_size + c] = c < block_cols
+            ? rhs_data[(b * depth + d) * cols + start_col + c] : 0.f;
+      }
+    }
+  };
+  ::mace::ops::arm::fp32::Gemm gemm;
+  gemm.Compute(nullptr,
+               &lhs,
+               rhs_packer,
+               batch,
+               rows,
+               cols,
+               depth,
+               lhs_major,
+               &output);
+
+  Tensor expected_output(GetCPUAllocator(), DataType::DT_FLOAT);
+  expected_output.Resize({batch, rows, cols});
+  ::mace::ops::ref::Gemm<float> gemm_ref;
+  gemm_ref.Compute(nullptr,
+                   &lhs,
+                   &rhs,
+                   batch,
+                   rows,
+                   cols,
+                   depth,
+                   lhs_major,
+                   RowMajor,
+                   RowMajor,
+                   false,
+                   true,
+                   &expected_output);
+
+  ExpectTensorNear<float>(expected_output, output);
+}
+
+TEST(ArmGemm, TestGemmFloat32RhsPacker) {
+  TestGemmFloat32RhsPacker(1, 47, 69, 37, RowMajor);
+  TestGemmFloat32RhsPacker(1, 47, 69, 37, ColMajor);
+  TestGemmFloat32RhsPacker(3, 47, 69, 37, RowMajor);
+  // rhs blocks of several panels
+  TestGemmFloat32RhsPacker(2, 17, 1031, 2305, RowMajor);
 }
 
 }  // namespace test
@@ -34,6 +34,68 @@ namespace ops {
 namespace arm {
 namespace fp32 {
 
+namespace {
+
+// rows of a weight shared by the whole batch are streamed once for up to
+// kMaxBatchPerPass vectors
+const index_t kMaxBatchPerPass = 8;
+
+template <index_t N>
+void MultiBatchRow(const float *lhs_ptr,
+                   const float *rhs_ptr,
+                   const index_t width,
+                   const float bias,
+                   const index_t output_stride,
+                   float *ret_ptr) {
+  float32x4_t vo[N];
+  for (index_t n = 0; n < N; ++n) {
+    vo[n] = vdupq_n_f32(0);
+  }
+  index_t w = 0;
+  for (; w + 4 <= width; w += 4) {
+    const float32x4_t vl = vld1q_f32(lhs_ptr + w);
+    for (index_t n = 0; n < N; ++n) {
+      vo[n] = vmlaq_f32(vo[n], vl, vld1q_f32(rhs_ptr + n * width + w));
+    }
+  }
+  for (index_t n = 0; n < N; ++n) {
+    float s = bias + vaddvq_f32(vo[n]);
+    for (index_t r = w; r < width; ++r) {
+      s += lhs_ptr[r] * rhs_ptr[n * width + r];
+    }
+    ret_ptr[n * output_stride] = s;
+  }
+}
+
+void MultiBatchRow(const index_t count,
+                   const float *lhs_ptr,
+                   const float *rhs_ptr,
+                   const index_t width,
+                   const float bias,
+                   const index_t output_stride,
+                   float *ret_ptr) {
+  switch (count) {
+#define MACE_MULTI_BATCH_ROW(N)                                       \
+    case N:                                                           \
+      MultiBatchRow<N>(lhs_ptr, rhs_ptr, width, bias, output_stride,  \
+                       ret_ptr);                                      \
+      break;
+    MACE_MULTI_BATCH_ROW(1)
+    MACE_MULTI_BATCH_ROW(2)
+    MACE_MULTI_BATCH_ROW(3)
+    MACE_MULTI_BATCH_ROW(4)
+    MACE_MULTI_BATCH_ROW(5)
+    MACE_MULTI_BATCH_ROW(6)
+    MACE_MULTI_BATCH_ROW(7)
+    MACE_MULTI_BATCH_ROW(8)
+#undef MACE_MULTI_BATCH_ROW
+    default:
+      LOG(FATAL) << "Unsupported batch per pass: " << count;
+  }
+}
+
+}  // namespace
+
 MaceStatus Gemv::Compute(const OpContext *context,
                          const Tensor *lhs,
                          const Tensor *rhs,
@@ -62,6 +124,25 @@ MaceStatus Gemv::Compute(const OpContext *context,
   }
   float *output_data = output->mutable_data<float>();
 
+  if (!lhs_batched && rhs_batched && batch > 1) {
+    // the weight of FullyConnected, each row is read once per pass
+#pragma omp parallel for schedule(runtime)
+    for (index_t h = 0; h < lhs_height; ++h) {
+      const float *lhs_ptr = lhs_data + h * lhs_width;
+      const float bias_value = bias ? bias_data[h] : 0;
+      for (index_t b = 0; b < batch; b += kMaxBatchPerPass) {
+        MultiBatchRow(std::min(kMaxBatchPerPass, batch - b),
+                      lhs_ptr,
+                      rhs_data + b * lhs_width,
+                      lhs_width,
+                      bias_value,
+                      lhs_height,
+                      output_data + b * lhs_height + h);
+      }
+    }
+    return MaceStatus::MACE_SUCCESS;
+  }
+
   const index_t h_block_size = 4;
   const index_t h_block_count = RoundUpDiv(lhs_height, h_block_size);
   const index_t w_block_size = 8;
@@ -86,6 +86,8 @@ TEST(ArmGemv, TestGemvFloat32) {
 
   TestGemvFloat32(2, 16, 256, false, true);
   TestGemvFloat32(3, 63, 257, false, true);
+  TestGemvFloat32(8, 63, 257, false, true);
+  TestGemvFloat32(11, 16, 256, false, true);
   TestGemvFloat32(2, 16, 256, true, false);
   TestGemvFloat32(3, 63, 257, true, false);
 }
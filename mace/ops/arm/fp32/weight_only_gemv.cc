@@ -0,0 +1,160 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/ops/arm/fp32/weight_only_gemv.h"
+
+#include <arm_neon.h>
+#include <algorithm>
+#include <vector>
+
+namespace mace {
+namespace ops {
+namespace arm {
+namespace fp32 {
+
+namespace {
+
+// the weights read as one vector of bytes
+constexpr index_t kVectorSize = 16;
+
+// the 16 weights of 8 bits at col
+inline uint8x16_t LoadInt8(const uint8_t *row, const index_t col) {
+  return vld1q_u8(row + col);
+}
+
+// the 16 weights of 4 bits at an even col, unpacked to a byte each
+inline uint8x16_t LoadInt4(const uint8_t *row, const index_t col) {
+  const uint8x8_t packed = vld1_u8(row + col / 2);
+  const uint8x8x2_t values =
+      vzip_u8(vand_u8(packed, vdup_n_u8(15)), vshr_n_u8(packed, 4));
+  return vcombine_u8(values.val[0], values.val[1]);
+}
+
+// the 4 floats (q - zero_point) of the 4 bytes of u16
+inline float32x4_t ToFloat(const uint16x4_t u16, const float32x4_t vzero) {
+  return vsubq_f32(vcvtq_f32_u32(vmovl_u16(u16)), vzero);
+}
+
+inline float32x4_t MultiplyAccumulate(const uint8x16_t q,
+                                      const float *input,
+                                      const float32x4_t vzero,
+                                      float32x4_t acc) {
+  const uint16x8_t lo = vmovl_u8(vget_low_u8(q));
+  const uint16x8_t hi = vmovl_u8(vget_high_u8(q));
+  acc = vmlaq_f32(acc, ToFloat(vget_low_u16(lo), vzero), vld1q_f32(input));
+  acc = vmlaq_f32(acc, ToFloat(vget_high_u16(lo), vzero),
+                  vld1q_f32(input + 4));
+  acc = vmlaq_f32(acc, ToFloat(vget_low_u16(hi), vzero),
+                  vld1q_f32(input + 8));
+  acc = vmlaq_f32(acc, ToFloat(vget_high_u16(hi), vzero),
+                  vld1q_f32(input + 12));
+  return acc;
+}
+
+inline float Sum(const float32x4_t v) {
+  return vgetq_lane_f32(v, 0) + vgetq_lane_f32(v, 1)
+      + vgetq_lane_f32(v, 2) + vgetq_lane_f32(v, 3);
+}
+
+float RowDot(const WeightOnlyMatrix &weight,
+             const index_t r,
+             const float *input) {
+  const uint8_t *row = weight.data + r * weight.row_bytes();
+  const float *scales = weight.scales + r * weight.groups();
+  const float32x4_t vzero =
+      vdupq_n_f32(static_cast<float>(weight.zero_point));
+  float sum = 0.f;
+  for (index_t start = 0, g = 0; start < weight.cols;
+       start += weight.group_size, ++g) {
+    const index_t end = std::min(weight.cols, start + weight.group_size);
+    float32x4_t acc = vdupq_n_f32(0.f);
+    index_t c = start;
+    if (weight.bits == 4) {
+      for (; c + kVectorSize <= end; c += kVectorSize) {
+        acc = MultiplyAccumulate(LoadInt4(row, c), input + c, vzero, acc);
+      }
+    } else {
+      for (; c + kVectorSize <= end; c += kVectorSize) {
+        acc = MultiplyAccumulate(LoadInt8(row, c), input + c, vzero, acc);
+      }
+    }
+    float group_sum = Sum(acc);
+    for (; c < end; ++c) {
+      group_sum += (WeightOnlyValue(row, weight.bits, c) - weight.zero_point)
+          * input[c];
+    }
+    sum += scales[g] * group_sum;
+  }
+  return sum;
+}
+
+void DequantizeRow(const WeightOnlyMatrix &weight,
+                   const index_t r,
+                   float *values) {
+  const uint8_t *row = weight.data + r * weight.row_bytes();
+  const float *scales = weight.scales + r * weight.groups();
+  for (index_t c = 0; c < weight.cols; ++c) {
+    values[c] = scales[c / weight.group_size]
+        * (WeightOnlyValue(row, weight.bits, c) - weight.zero_point);
+  }
+}
+
+float Dot(const float *a, const float *b, const index_t size) {
+  float32x4_t acc = vdupq_n_f32(0.f);
+  index_t i = 0;
+  for (; i + 4 <= size; i += 4) {
+    acc = vmlaq_f32(acc, vld1q_f32(a + i), vld1q_f32(b + i));
+  }
+  float sum = Sum(acc);
+  for (; i < size; ++i) {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+
+}  // namespace
+
+void WeightOnlyGemv(const WeightOnlyMatrix &weight,
+                    const float *input,
+                    const float *bias,
+                    const index_t batch,
+                    float *output) {
+  const index_t rows = weight.rows;
+  const index_t cols = weight.cols;
+  if (batch == 1) {
+#pragma omp parallel for schedule(runtime)
+    for (index_t r = 0; r < rows; ++r) {
+      output[r] = RowDot(weight, r, input) + (bias == nullptr ? 0.f : bias[r]);
+    }
+    return;
+  }
+
+#pragma omp parallel
+  {
+    std::vector<float> values(cols);
+#pragma omp for schedule(runtime)
+    for (index_t r = 0; r < rows; ++r) {
+      DequantizeRow(weight, r, values.data());
+      for (index_t b = 0; b < batch; ++b) {
+        output[b * rows + r] = Dot(values.data(), input + b * cols, cols)
+            + (bias == nullptr ? 0.f : bias[r]);
+      }
+    }
+  }
+}
+
+}  // namespace fp32
+}  // namespace arm
+}  // namespace ops
+}  // namespace mace
@@ -0,0 +1,432 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "mace/ops/arm/nchwc.h"
+
+#include <algorithm>
+#include <limits>
+#include <string>
+
+#include "mace/utils/logging.h"
+
+namespace mace {
+namespace ops {
+
+namespace {
+
+// output pixels of a row computed together by conv, which reuse each
+// block of the filter for a few pixels
+constexpr index_t kConvTileWidth = 4;
+
+template <int kBlock>
+void BlockChannelsImpl(const float *input,
+                       const index_t *shape,
+                       float *output) {
+  const index_t batch = shape[0];
+  const index_t channels = shape[1];
+  const index_t blocks = channels / kBlock;
+  const index_t image_size = shape[2] * shape[3];
+
+#pragma omp parallel for collapse(2) schedule(runtime)
+  for (index_t b = 0; b < batch; ++b) {
+    for (index_t cb = 0; cb < blocks; ++cb) {
+      const float *in_ptr = input + (b * channels + cb * kBlock) * image_size;
+      float *out_ptr = output + (b * blocks + cb) * image_size * kBlock;
+      for (index_t i = 0; i < image_size; ++i) {
+        for (int c = 0; c < kBlock; ++c) {
+          out_ptr[i * kBlock + c] = in_ptr[c * image_size + i];
+        }
+      }
+    }
+  }
+}
+
+template <int kBlock>
+void UnblockChannelsImpl(const float *input,
+                         const index_t *shape,
+                         float *output) {
+  const index_t batch = shape[0];
+  const index_t channels = shape[1];
+  const index_t blocks = channels / kBlock;
+  const index_t image_size = shape[2] * shape[3];
+
+#pragma omp parallel for collapse(2) schedule(runtime)
+  for (index_t b = 0; b < batch; ++b) {
+    for (index_t cb = 0; cb < blocks; ++cb) {
+      const float *in_ptr = input + (b * blocks + cb) * image_size * kBlock;
+      float *out_ptr = output + (b * channels + cb * kBlock) * image_size;
+      for (int c = 0; c < kBlock; ++c) {
+        for (index_t i = 0; i < image_size; ++i) {
+          out_ptr[c * image_size + i] = in_ptr[i * kBlock + c];
+        }
+      }
+    }
+  }
+}
+
+template <int kBlock>
+void Conv2dNCHWcImpl(const float *input,
+                     const float *packed_filter,
+                     const float *bias,
+                     const index_t *in_shape,
+                     const index_t *out_shape,
+                     const index_t *filter_shape,
+                     const int *stride_hw,
+                     const int *dilation_hw,
+                     const int *pad_hw,
+                     float *output) {
+  const index_t batch = out_shape[0];
+  const index_t in_blocks = in_shape[1] / kBlock;
+  const index_t in_height = in_shape[2];
+  const index_t in_width = in_shape[3];
+  const index_t out_blocks = out_shape[1] / kBlock;
+  const index_t out_height = out_shape[2];
+  const index_t out_width = out_shape[3];
+  const index_t filter_h = filter_shape[2];
+  const index_t filter_w = filter_shape[3];
+  const index_t in_image_size = in_height * in_width * kBlock;
+  const index_t filter_block_size = filter_h * filter_w * kBlock * kBlock;
+
+#pragma omp parallel for collapse(3) schedule(runtime)
+  for (index_t b = 0; b < batch; ++b) {
+    for (index_t ob = 0; ob < out_blocks; ++ob) {
+      for (index_t h = 0; h < out_height; ++h) {
+        const float *in_base = input + b * in_blocks * in_image_size;
+        const float *filter_base =
+            packed_filter + ob * in_blocks * filter_block_size;
+        float *out_row =
+            output + ((b * out_blocks + ob) * out_height + h) * out_width
+                * kBlock;
+        for (index_t w0 = 0; w0 < out_width; w0 += kConvTileWidth) {
+          const index_t tile = std::min(kConvTileWidth, out_width - w0);
+          float sum[kConvTileWidth][kBlock];
+          for (index_t t = 0; t < kConvTileWidth; ++t) {
+            for (int o = 0; o < kBlock; ++o) {
+              sum[t][o] = bias == nullptr ? 0 : bias[ob * kBlock + o];
+            }
+          }
+          for (index_t ib = 0; ib < in_blocks; ++ib) {
+            const float *in_ptr = in_base + ib * in_image_size;
+            const float *filter_ptr = filter_base + ib * filter_block_size;
+            for (index_t kh = 0; kh < filter_h; ++kh) {
+              const index_t ih =
+                  h * stride_hw[0] + kh * dilation_hw[0] - pad_hw[0];
+              if (ih < 0 || ih >= in_height) {
+                continue;
+              }
+              for (index_t kw = 0; kw < filter_w; ++kw) {
+                const float *f_ptr =
+                    filter_ptr + (kh * filter_w + kw) * kBlock * kBlock;
+                for (index_t t = 0; t < tile; ++t) {
+                  const index_t iw = (w0 + t) * stride_hw[1]
+                      + kw * dilation_hw[1] - pad_hw[1];
+                  if (iw < 0 || iw >= in_width) {
+                    continue;
+                  }
+                  const float *in_pixel =
+                      in_ptr + (ih * in_width + iw) * kBlock;
+                  for (int i = 0; i < kBlock; ++i) {
+                    const float in_value = in_pixel[i];
+                    const float *f_row = f_ptr + i * kBlock;
+                    for (int o = 0; o < kBlock; ++o) {
+                      sum[t][o] += in_value * f_row[o];
+                    }
+                  }
+                }
+              }
+            }
+          }
+          for (index_t t = 0; t < tile; ++t) {
+            float *out_pixel = out_row + (w0 + t) * kBlock;
+            for (int o = 0; o < kBlock; ++o) {
+              out_pixel[o] = sum[t][o];
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+template <int kBlock>
+void DepthwiseConv2dNCHWcImpl(const float *input,
+                              const float *packed_filter,
+                              const float *bias,
+                              const index_t *in_shape,
+                              const index_t *out_shape,
+                              const int *filter_hw,
+                              const int *stride_hw,
+                              const int *dilation_hw,
+                              const int *pad_hw,
+                              float *output) {
+  const index_t batch = out_shape[0];
+  const index_t blocks = out_shape[1] / kBlock;
+  const index_t in_height = in_shape[2];
+  const index_t in_width = in_shape[3];
+  const index_t out_height = out_shape[2];
+  const index_t out_width = out_shape[3];
+  const index_t filter_size = filter_hw[0] * filter_hw[1] * kBlock;
+
+#pragma omp parallel for collapse(3) schedule(runtime)
+  for (index_t b = 0; b < batch; ++b) {
+    for (index_t cb = 0; cb < blocks; ++cb) {
+      for (index_t h = 0; h < out_height; ++h) {
+        const float *in_ptr =
+            input + (b * blocks + cb) * in_height * in_width * kBlock;
+        const float *filter_ptr = packed_filter + cb * filter_size;
+        float *out_row =
+            output + ((b * blocks + cb) * out_height + h) * out_width
+                * kBlock;
+        for (index_t w = 0; w < out_width; ++w) {
+          float sum[kBlock];
+          for (int c = 0; c < kBlock; ++c) {
+            sum[c] = bias == nullptr ? 0 : bias[cb * kBlock + c];
+          }
+          for (index_t kh = 0; kh < filter_hw[0]; ++kh) {
+            const index_t ih =
+                h * stride_hw[0] + kh * dilation_hw[0] - pad_hw[0];
+            if (ih < 0 || ih >= in_height) {
+              continue;
+            }
+            for (index_t kw = 0; kw < filter_hw[1]; ++kw) {
+              const index_t iw =
+                  w * stride_hw[1] + kw * dilation_hw[1] - pad_hw[1];
+              if (iw < 0 || iw >= in_width) {
+                continue;
+              }
+              const float *in_pixel = in_ptr + (ih * in_width + iw) * kBlock;
+              const float *f_ptr =
+                  filter_ptr + (kh * filter_hw[1] + kw) * kBlock;
+              for (int c = 0; c < kBlock; ++c) {
+                sum[c] += in_pixel[c] * f_ptr[c];
+              }
+            }
+          }
+          float *out_pixel = out_row + w * kBlock;
+          for (int c = 0; c < kBlock; ++c) {
+            out_pixel[c] = sum[c];
+          }
+        }
+      }
+    }
+  }
+}
+
+template <int kBlock>
+void PoolingNCHWcImpl(const float *input,
+                      const index_t *in_shape,
+                      const index_t *out_shape,
+                      const int *filter_hw,
+                      const int *stride_hw,
+                      const int *dilation_hw,
+                      const int *pad_hw,
+                      const PoolingType pooling_type,
+                      float *output) {
+  const index_t batch = out_shape[0];
+  const index_t blocks = out_shape[1] / kBlock;
+  const index_t in_height = in_shape[2];
+  const index_t in_width = in_shape[3];
+  const index_t out_height = out_shape[2];
+  const index_t out_width = out_shape[3];
+  const bool is_max = pooling_type == PoolingType::MAX;
+
+#pragma omp parallel for collapse(3) schedule(runtime)
+  for (index_t b = 0; b < batch; ++b) {
+    for (index_t cb = 0; cb < blocks; ++cb) {
+      for (index_t h = 0; h < out_height; ++h) {
+        const float *in_ptr =
+            input + (b * blocks + cb) * in_height * in_width * kBlock;
+        float *out_row =
+            output + ((b * blocks + cb) * out_height + h) * out_width
+                * kBlock;
+        for (index_t w = 0; w < out_width; ++w) {
+          float res[kBlock];
+          for (int c = 0; c < kBlock; ++c) {
+            res[c] = is_max ? std::numeric_limits<float>::lowest() : 0;
+          }
+          int block_size = 0;
+          for (index_t fh = 0; fh < filter_hw[0]; ++fh) {
+            const index_t ih =
+                h * stride_hw[0] + fh * dilation_hw[0] - pad_hw[0];
+            if (ih < 0 || ih >= in_height) {
+              continue;
+            }
+            for (index_t fw = 0; fw < filter_hw[1]; ++fw) {
+              const index_t iw =
+                  w * stride_hw[1] + fw * dilation_hw[1] - pad_hw[1];
+              if (iw < 0 || iw >= in_width) {
+                continue;
+              }
+              const float *in_pixel = in_ptr + (ih * in_width + iw) * kBlock;
+              if (is_max) {
+                for (int c = 0; c < kBlock; ++c) {
+                  res[c] = std::max(res[c], in_pixel[c]);
+                }
+              } else {
+                for (int c = 0; c < kBlock; ++c) {
+                  res[c] += in_pixel[c];
+                }
+              }
+              ++block_size;
+            }
+          }
+          float *out_pixel = out_row + w * kBlock;
+          for (int c = 0; c < kBlock; ++c) {
+            out_pixel[c] = is_max ? res[c] : res[c] / block_size;
+          }
+        }
+      }
+    }
+  }
+}
+
+}  // namespace
+
+#define MACE_NCHWC_DISPATCH(block, func, ...)                          \
+  switch (block) {                                                     \
+    case 4:                                                            \
+      func<4>(__VA_ARGS__);                                            \
+      break;                                                           \
+    case 8:                                                            \
+      func<8>(__VA_ARGS__);                                            \
+      break;                                                           \
+    default:                                                           \
+      LOG(FATAL) << "NCHWc supports blocks of 4 or 8, not " << block;  \
+  }
+
+void BlockChannels(const float *input,
+                   const index_t *shape,
+                   const int block,
+                   float *output) {
+  MACE_NCHWC_DISPATCH(block, BlockChannelsImpl, input, shape, output);
+}
+
+void UnblockChannels(const float *input,
+                     const index_t *shape,
+                     const int block,
+                     float *output) {
+  MACE_NCHWC_DISPATCH(block, UnblockChannelsImpl, input, shape, output);
+}
+
+void PackConv2dNCHWcFilter(const float *filter,
+                           const index_t *filter_shape,
+                           const int block,
+                           float *packed_filter) {
+  const index_t out_channels = filter_shape[0];
+  const index_t in_channels = filter_shape[1];
+  const index_t filter_size = filter_shape[2] * filter_shape[3];
+  const index_t in_blocks = in_channels / block;
+  for (index_t o = 0; o < out_channels; ++o) {
+    for (index_t i = 0; i < in_channels; ++i) {
+      const float *src = filter + (o * in_channels + i) * filter_size;
+      float *dst = packed_filter
+          + ((o / block) * in_blocks + i / block) * filter_size * block * block
+          + (i % block) * block + o % block;
+      for (index_t k = 0; k < filter_size; ++k) {
+        dst[k * block * block] = src[k];
+      }
+    }
+  }
+}
+
+const float *GetConv2dNCHWcFilter(PackedWeights *packed_weights,
+                                  const Tensor *filter,
+                                  const int block) {
+  const std::string layout = MakeString("nchwc_conv2d_fp32_", block);
+  return packed_weights->GetOrPack(
+      layout, filter, filter->size(), [&](float *packed_filter) {
+        Tensor::MappingGuard filter_guard(filter);
+        PackConv2dNCHWcFilter(filter->data<float>(), filter->shape().data(),
+                              block, packed_filter);
+      });
+}
+
+void Conv2dNCHWc(const float *input,
+                 const float *packed_filter,
+                 const float *bias,
+                 const index_t *in_shape,
+                 const index_t *out_shape,
+                 const index_t *filter_shape,
+                 const int *stride_hw,
+                 const int *dilation_hw,
+                 const int *pad_hw,
+                 const int block,
+                 float *output) {
+  MACE_NCHWC_DISPATCH(block, Conv2dNCHWcImpl, input, packed_filter, bias,
+                      in_shape, out_shape, filter_shape, stride_hw,
+                      dilation_hw, pad_hw, output);
+}
+
+void PackDepthwiseConv2dNCHWcFilter(const float *filter,
+                                    const index_t *filter_shape,
+                                    const int block,
+                                    float *packed_filter) {
+  const index_t channels = filter_shape[1];
+  const index_t filter_size = filter_shape[2] * filter_shape[3];
+  for (index_t c = 0; c < channels; ++c) {
+    const float *src = filter + c * filter_size;
+    float *dst = packed_filter + (c / block) * filter_size * block + c % block;
+    for (index_t k = 0; k < filter_size; ++k) {
+      dst[k * block] = src[k];
+    }
+  }
+}
+
+const float *GetDepthwiseConv2dNCHWcFilter(PackedWeights *packed_weights,
+                                           const Tensor *filter,
+                                           const int block) {
+  const std::string layout = MakeString("nchwc_depthwise_fp32_", block);
+  return packed_weights->GetOrPack(
+      layout, filter, filter->size(), [&](float *packed_filter) {
+        Tensor::MappingGuard filter_guard(filter);
+        PackDepthwiseConv2dNCHWcFilter(filter->data<float>(),
+                                       filter->shape().data(), block,
+                                       packed_filter);
+      });
+}
+
+void DepthwiseConv2dNCHWc(const float *input,
+                          const float *packed_filter,
+                          const float *bias,
+                          const index_t *in_shape,
+                          const index_t *out_shape,
+                          const int *filter_hw,
+                          const int *stride_hw,
+                          const int *dilation_hw,
+                          const int *pad_hw,
+                          const int block,
+                          float *output) {
+  MACE_NCHWC_DISPATCH(block, DepthwiseConv2dNCHWcImpl, input, packed_filter,
+                      bias, in_shape, out_shape, filter_hw, stride_hw,
+                      dilation_hw, pad_hw, output);
+}
+
+void PoolingNCHWc(const float *input,
+                  const index_t *in_shape,
+                  const index_t *out_shape,
+                  const int *filter_hw,
+                  const int *stride_hw,
+                  const int *dilation_hw,
+                  const int *pad_hw,
+                  const PoolingType pooling_type,
+                  const int block,
+                  float *output) {
+  MACE_NCHWC_DISPATCH(block, PoolingNCHWcImpl, input, in_shape, out_shape,
+                      filter_hw, stride_hw, dilation_hw, pad_hw,
+                      pooling_type, output);
+}
+
+#undef MACE_NCHWC_DISPATCH
+
+}  // namespace ops
+}  // namespace mace
@@ -0,0 +1,104 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef MACE_OPS_ARM_NCHWC_H_
+#define MACE_OPS_ARM_NCHWC_H_
+
+#include "mace/core/packed_weights.h"
+#include "mace/core/tensor.h"
+#include "mace/core/types.h"
+#include "mace/ops/pooling.h"
+
+// Float kernels of the NCHWc layout [N, C / block, H, W, block], which keeps
+// a block of 4 or 8 channels of each pixel together, so the inner loops of
+// conv, depthwise conv and pooling run over whole vectors of channels with
+// no transpose or channel tail. The shapes passed are the logical NCHW ones.
+
+namespace mace {
+namespace ops {
+
+// NCHW => NCHWc, channels a multiple of the block
+void BlockChannels(const float *input,
+                   const index_t *shape,
+                   const int block,
+                   float *output);
+
+// NCHWc => NCHW
+void UnblockChannels(const float *input,
+                     const index_t *shape,
+                     const int block,
+                     float *output);
+
+// OIHW => [O / block, I / block, H, W, block of I, block of O]
+void PackConv2dNCHWcFilter(const float *filter,
+                           const index_t *filter_shape,
+                           const int block,
+                           float *packed_filter);
+
+// The constant OIHW filter packed for the block, looked up in or added to
+// the packed weights.
+const float *GetConv2dNCHWcFilter(PackedWeights *packed_weights,
+                                  const Tensor *filter,
+                                  const int block);
+
+void Conv2dNCHWc(const float *input,
+                 const float *packed_filter,
+                 const float *bias,
+                 const index_t *in_shape,
+                 const index_t *out_shape,
+                 const index_t *filter_shape,
+                 const int *stride_hw,
+                 const int *dilation_hw,
+                 const int *pad_hw,
+                 const int block,
+                 float *output);
+
+// [1, C, H, W] => [C / block, H, W, block]
+void PackDepthwiseConv2dNCHWcFilter(const float *filter,
+                                    const index_t *filter_shape,
+                                    const int block,
+                                    float *packed_filter);
+
+const float *GetDepthwiseConv2dNCHWcFilter(PackedWeights *packed_weights,
+                                           const Tensor *filter,
+                                           const int block);
+
+// depthwise conv of multiplier 1
+void DepthwiseConv2dNCHWc(const float *input,
+                          const float *packed_filter,
+                          const float *bias,
+                          const index_t *in_shape,
+                          const index_t *out_shape,
+                          const int *filter_hw,
+                          const int *stride_hw,
+                          const int *dilation_hw,
+                          const int *pad_hw,
+                          const int block,
+                          float *output);
+
+// avg pooling divides by the number of the pixels inside the input
+void PoolingNCHWc(const float *input,
+                  const index_t *in_shape,
+                  const index_t *out_shape,
+                  const int *filter_hw,
+                  const int *stride_hw,
+                  const int *dilation_hw,
+                  const int *pad_hw,
+                  const PoolingType pooling_type,
+                  const int block,
+                  float *output);
+
+}  // namespace ops
+}  // namespace mace
+
+#endif  // MACE_OPS_ARM_NCHWC_H_
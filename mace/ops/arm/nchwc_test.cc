@@ -0,0 +1,264 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include "mace/ops/arm/nchwc.h"
+#include "mace/ops/testing/test_utils.h"
+
+namespace mace {
+namespace ops {
+namespace test {
+
+namespace {
+
+std::vector<float> Blocked(const std::vector<float> &data,
+                           const std::vector<index_t> &shape,
+                           const int block) {
+  std::vector<float> blocked(data.size());
+  BlockChannels(data.data(), shape.data(), block, blocked.data());
+  return blocked;
+}
+
+std::vector<float> Unblocked(const std::vector<float> &data,
+                             const std::vector<index_t> &shape,
+                             const int block) {
+  std::vector<float> unblocked(data.size());
+  UnblockChannels(data.data(), shape.data(), block, unblocked.data());
+  return unblocked;
+}
+
+// depthwise convs are of multiplier 1
+void ConvRef(const std::vector<float> &input,
+             const std::vector<float> &filter,
+             const std::vector<float> &bias,
+             const std::vector<index_t> &in_shape,
+             const std::vector<index_t> &out_shape,
+             const std::vector<index_t> &filter_shape,
+             const bool depthwise,
+             const int *stride_hw,
+             const int *dilation_hw,
+             const int *pad_hw,
+             std::vector<float> *output) {
+  const index_t in_channels = depthwise ? 1 : filter_shape[1];
+  for (index_t b = 0; b < out_shape[0]; ++b) {
+    for (index_t m = 0; m < out_shape[1]; ++m) {
+      for (index_t h = 0; h < out_shape[2]; ++h) {
+        for (index_t w = 0; w < out_shape[3]; ++w) {
+          float sum = bias[m];
+          for (index_t c = 0; c < in_channels; ++c) {
+            const index_t in_c = depthwise ? m : c;
+            for (index_t kh = 0; kh < filter_shape[2]; ++kh) {
+              for (index_t kw = 0; kw < filter_shape[3]; ++kw) {
+                const index_t ih =
+                    h * stride_hw[0] + kh * dilation_hw[0] - pad_hw[0];
+                const index_t iw =
+                    w * stride_hw[1] + kw * dilation_hw[1] - pad_hw[1];
+                if (ih < 0 || ih >= in_shape[2] || iw < 0 ||
+                    iw >= in_shape[3]) {
+                  continue;
+                }
+                sum += input[((b * in_shape[1] + in_c) * in_shape[2] + ih)
+                                 * in_shape[3] + iw] *
+                    filter[((m * in_channels + c) * filter_shape[2] + kh)
+                               * filter_shape[3] + kw];
+              }
+            }
+          }
+          (*output)[((b * out_shape[1] + m) * out_shape[2] + h)
+                        * out_shape[3] + w] = sum;
+        }
+      }
+    }
+  }
+}
+
+void PoolingRef(const std::vector<float> &input,
+                const std::vector<index_t> &in_shape,
+                const std::vector<index_t> &out_shape,
+                const int *filter_hw,
+                const int *stride_hw,
+                const int *pad_hw,
+                const PoolingType pooling_type,
+                std::vector<float> *output) {
+  for (index_t b = 0; b < out_shape[0]; ++b) {
+    for (index_t c = 0; c < out_shape[1]; ++c) {
+      for (index_t h = 0; h < out_shape[2]; ++h) {
+        for (index_t w = 0; w < out_shape[3]; ++w) {
+          float res = pooling_type == PoolingType::MAX ?
+                      std::numeric_limits<float>::lowest() : 0;
+          int count = 0;
+          for (index_t fh = 0; fh < filter_hw[0]; ++fh) {
+            for (index_t fw = 0; fw < filter_hw[1]; ++fw) {
+              const index_t ih = h * stride_hw[0] + fh - pad_hw[0];
+              const index_t iw = w * stride_hw[1] + fw - pad_hw[1];
+              if (ih < 0 || ih >= in_shape[2] || iw < 0 ||
+                  iw >= in_shape[3]) {
+                continue;
+              }
+              const float value = input[
+                  ((b * in_shape[1] + c) * in_shape[2] + ih) * in_shape[3]
+                      + iw];
+              res = pooling_type == PoolingType::MAX ? std::max(res, value)
+                                                     : res + value;
+              ++count;
+            }
+          }
+          (*output)[((b * out_shape[1] + c) * out_shape[2] + h)
+                        * out_shape[3] + w] =
+              pooling_type == PoolingType::MAX ? res : res / count;
+        }
+      }
+    }
+  }
+}
+
+index_t OutputSize(const index_t in_size, const index_t filter_size,
+                   const int stride, const int dilation, const int pad) {
+  return (in_size + 2 * pad - (filter_size - 1) * dilation - 1) / stride + 1;
+}
+
+void TestConv2d(const int block,
+                const bool depthwise,
+                const std::vector<index_t> &in_shape,
+                const index_t out_channels,
+                const int kernel,
+                const int stride,
+                const int dilation) {
+  const int pad = (kernel - 1) * dilation / 2;
+  const std::vector<index_t> filter_shape = depthwise ?
+      std::vector<index_t>{1, in_shape[1], kernel, kernel} :
+      std::vector<index_t>{out_channels, in_shape[1], kernel, kernel};
+  const std::vector<index_t> out_shape = {
+      in_shape[0], depthwise ? in_shape[1] : out_channels,
+      OutputSize(in_shape[2], kernel, stride, dilation, pad),
+      OutputSize(in_shape[3], kernel, stride, dilation, pad)};
+  std::vector<float> input, filter, bias;
+  GenerateRandomRealTypeData(in_shape, &input, false);
+  GenerateRandomRealTypeData(filter_shape, &filter, false);
+  GenerateRandomRealTypeData({out_shape[1]}, &bias, false);
+  const int stride_hw[2] = {stride, stride};
+  const int dilation_hw[2] = {dilation, dilation};
+  const int pad_hw[2] = {pad, pad};
+  const int filter_hw[2] = {kernel, kernel};
+
+  std::vector<float> packed_filter(filter.size());
+  std::vector<float> output(
+      out_shape[0] * out_shape[1] * out_shape[2] * out_shape[3]);
+  const std::vector<float> blocked_input = Blocked(input, in_shape, block);
+  if (depthwise) {
+    PackDepthwiseConv2dNCHWcFilter(filter.data(), filter_shape.data(), block,
+                                   packed_filter.data());
+    DepthwiseConv2dNCHWc(blocked_input.data(), packed_filter.data(),
+                         bias.data(), in_shape.data(), out_shape.data(),
+                         filter_hw, stride_hw, dilation_hw, pad_hw, block,
+                         output.data());
+  } else {
+    PackConv2dNCHWcFilter(filter.data(), filter_shape.data(), block,
+                          packed_filter.data());
+    Conv2dNCHWc(blocked_input.data(), packed_filter.data(), bias.data(),
+                in_shape.data(), out_shape.data(), filter_shape.data(),
+                stride_hw, dilation_hw, pad_hw, block, output.data());
+  }
+  output = Unblocked(output, out_shape, block);
+
+  std::vector<float> expected(output.size());
+  ConvRef(input, filter, bias, in_shape, out_shape, filter_shape, depthwise,
+          stride_hw, dilation_hw, pad_hw, &expected);
+  for (size_t i = 0; i < output.size(); ++i) {
+    EXPECT_NEAR(expected[i], output[i], 1e-4) << " with index " << i;
+  }
+}
+
+void TestPooling(const int block,
+                 const PoolingType pooling_type,
+                 const std::vector<index_t> &in_shape,
+                 const int kernel,
+                 const int stride,
+                 const int pad) {
+  const std::vector<index_t> out_shape = {
+      in_shape[0], in_shape[1],
+      OutputSize(in_shape[2], kernel, stride, 1, pad),
+      OutputSize(in_shape[3], kernel, stride, 1, pad)};
+  std::vector<float> input;
+  GenerateRandomRealTypeData(in_shape, &input, false);
+  const int filter_hw[2] = {kernel, kernel};
+  const int stride_hw[2] = {stride, stride};
+  const int dilation_hw[2] = {1, 1};
+  const int pad_hw[2] = {pad, pad};
+
+  std::vector<float> output(
+      out_shape[0] * out_shape[1] * out_shape[2] * out_shape[3]);
+  PoolingNCHWc(Blocked(input, in_shape, block).data(), in_shape.data(),
+               out_shape.data(), filter_hw, stride_hw, dilation_hw, pad_hw,
+               pooling_type, block, output.data());
+  output = Unblocked(output, out_shape, block);
+
+  std::vector<float> expected(output.size());
+  PoolingRef(input, in_shape, out_shape, filter_hw, stride_hw, pad_hw,
+             pooling_type, &expected);
+  for (size_t i = 0; i < output.size(); ++i) {
+    EXPECT_NEAR(expected[i], output[i], 1e-5) << " with index " << i;
+  }
+}
+
+}  // namespace
+
+TEST(NCHWcTest, BlockChannels) {
+  for (int block : {4, 8}) {
+    const std::vector<index_t> shape = {2, 16, 5, 7};
+    std::vector<float> data;
+    GenerateRandomRealTypeData(shape, &data, false);
+    const std::vector<float> blocked = Blocked(data, shape, block);
+    // channel 9 of pixel (3, 4) of batch 1
+    const index_t blocks = 16 / block;
+    EXPECT_EQ(data[((1 * 16 + 9) * 5 + 3) * 7 + 4],
+              blocked[(((1 * blocks + 9 / block) * 5 + 3) * 7 + 4) * block
+                          + 9 % block]);
+    EXPECT_EQ(data, Unblocked(blocked, shape, block));
+  }
+}
+
+TEST(NCHWcTest, Conv2d) {
+  for (int block : {4, 8}) {
+    TestConv2d(block, false, {1, 16, 9, 11}, 8, 1, 1, 1);
+    TestConv2d(block, false, {2, 8, 10, 13}, 16, 3, 1, 1);
+    TestConv2d(block, false, {1, 16, 15, 14}, 8, 3, 2, 1);
+    TestConv2d(block, false, {1, 8, 12, 9}, 8, 5, 1, 2);
+  }
+}
+
+TEST(NCHWcTest, DepthwiseConv2d) {
+  for (int block : {4, 8}) {
+    TestConv2d(block, true, {2, 16, 9, 11}, 0, 3, 1, 1);
+    TestConv2d(block, true, {1, 8, 15, 14}, 0, 3, 2, 1);
+    TestConv2d(block, true, {1, 24, 12, 9}, 0, 5, 1, 2);
+  }
+}
+
+TEST(NCHWcTest, Pooling) {
+  for (int block : {4, 8}) {
+    for (PoolingType type : {PoolingType::MAX, PoolingType::AVG}) {
+      TestPooling(block, type, {2, 16, 9, 11}, 2, 2, 0);
+      TestPooling(block, type, {1, 8, 15, 14}, 3, 2, 1);
+      TestPooling(block, type, {1, 24, 7, 7}, 3, 1, 1);
+    }
+  }
+}
+
+}  // namespace test
+}  // namespace ops
+}  // namespace mace
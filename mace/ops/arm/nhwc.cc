@@ -0,0 +1,293 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "mace/ops/arm/nhwc.h"
+
+#include <algorithm>
+#include <limits>
+#include <string>
+
+#include "mace/utils/logging.h"
+
+namespace mace {
+namespace ops {
+
+namespace {
+
+// pixels of the 1x1 conv computed together, which reuse each row of the
+// filter for a few pixels
+constexpr index_t kGemmTilePixels = 4;
+// output channels of the tile, whose sums stay in the registers and cache
+constexpr index_t kGemmTileChannels = 64;
+
+}  // namespace
+
+void PackConv2dK1x1NHWCFilter(const float *filter,
+                              const index_t *filter_shape,
+                              float *packed_filter) {
+  const index_t out_channels = filter_shape[0];
+  const index_t in_channels = filter_shape[1];
+  for (index_t o = 0; o < out_channels; ++o) {
+    for (index_t i = 0; i < in_channels; ++i) {
+      packed_filter[i * out_channels + o] = filter[o * in_channels + i];
+    }
+  }
+}
+
+const float *GetConv2dK1x1NHWCFilter(PackedWeights *packed_weights,
+                                     const Tensor *filter) {
+  return packed_weights->GetOrPack(
+      "nhwc_conv2d_k1x1_fp32", filter, filter->size(),
+      [&](float *packed_filter) {
+        Tensor::MappingGuard filter_guard(filter);
+        PackConv2dK1x1NHWCFilter(filter->data<float>(),
+                                 filter->shape().data(), packed_filter);
+      });
+}
+
+namespace {
+
+// The sums of a tile of pixels by output channels over all input channels.
+// The full tiles, of kGemmTilePixels pixels out of the padding and of
+// kGemmTileChannels channels, take the bounds at compile time, so their
+// loops are unrolled and vectorized without remainders or padding checks.
+template <bool FullTile>
+void Conv2dK1x1NHWCTile(const float *const *in_pixels,
+                        const float *packed_filter,
+                        const float *bias,
+                        const index_t in_channels,
+                        const index_t out_channels,
+                        const index_t o0,
+                        const index_t tile_pixels,
+                        const index_t tile_channels,
+                        float *output) {
+  const index_t tile = FullTile ? kGemmTilePixels : tile_pixels;
+  const index_t channels = FullTile ? kGemmTileChannels : tile_channels;
+  float sum[kGemmTilePixels][kGemmTileChannels];
+  for (index_t t = 0; t < tile; ++t) {
+    for (index_t o = 0; o < channels; ++o) {
+      sum[t][o] = bias == nullptr ? 0 : bias[o0 + o];
+    }
+  }
+  for (index_t i = 0; i < in_channels; ++i) {
+    const float *f_row = packed_filter + i * out_channels + o0;
+    for (index_t t = 0; t < tile; ++t) {
+      if (!FullTile && in_pixels[t] == nullptr) {
+        continue;
+      }
+      const float in_value = in_pixels[t][i];
+      for (index_t o = 0; o < channels; ++o) {
+        sum[t][o] += in_value * f_row[o];
+      }
+    }
+  }
+  for (index_t t = 0; t < tile; ++t) {
+    std::copy(sum[t], sum[t] + channels, output + t * out_channels + o0);
+  }
+}
+
+}  // namespace
+
+void Conv2dK1x1NHWC(const float *input,
+                    const float *packed_filter,
+                    const float *bias,
+                    const index_t *in_shape,
+                    const index_t *out_shape,
+                    const int *stride_hw,
+                    const int *pad_hw,
+                    float *output) {
+  const index_t in_height = in_shape[1];
+  const index_t in_width = in_shape[2];
+  const index_t in_channels = in_shape[3];
+  const index_t out_height = out_shape[1];
+  const index_t out_width = out_shape[2];
+  const index_t out_channels = out_shape[3];
+  const index_t out_image_size = out_height * out_width;
+  const index_t pixels = out_shape[0] * out_image_size;
+  const index_t tiles = (pixels + kGemmTilePixels - 1) / kGemmTilePixels;
+
+#pragma omp parallel for schedule(runtime)
+  for (index_t tile_idx = 0; tile_idx < tiles; ++tile_idx) {
+    const index_t p0 = tile_idx * kGemmTilePixels;
+    const index_t tile = std::min(kGemmTilePixels, pixels - p0);
+    // the input pixel of each output pixel, nullptr in the padding
+    const float *in_pixels[kGemmTilePixels];
+    bool full_tile = tile == kGemmTilePixels;
+    for (index_t t = 0; t < tile; ++t) {
+      const index_t b = (p0 + t) / out_image_size;
+      const index_t hw = (p0 + t) % out_image_size;
+      const index_t ih = (hw / out_width) * stride_hw[0] - pad_hw[0];
+      const index_t iw = (hw % out_width) * stride_hw[1] - pad_hw[1];
+      in_pixels[t] = ih < 0 || ih >= in_height || iw < 0 || iw >= in_width ?
+          nullptr :
+          input + ((b * in_height + ih) * in_width + iw) * in_channels;
+      full_tile = full_tile && in_pixels[t] != nullptr;
+    }
+    float *out_tile = output + p0 * out_channels;
+    for (index_t o0 = 0; o0 < out_channels; o0 += kGemmTileChannels) {
+      const index_t channels = std::min(kGemmTileChannels, out_channels - o0);
+      if (full_tile && channels == kGemmTileChannels) {
+        Conv2dK1x1NHWCTile<true>(in_pixels, packed_filter, bias,
+                                 in_channels, out_channels, o0, tile,
+                                 channels, out_tile);
+      } else {
+        Conv2dK1x1NHWCTile<false>(in_pixels, packed_filter, bias,
+                                  in_channels, out_channels, o0, tile,
+                                  channels, out_tile);
+      }
+    }
+  }
+}
+
+void PackDepthwiseConv2dNHWCFilter(const float *filter,
+                                   const index_t *filter_shape,
+                                   float *packed_filter) {
+  const index_t channels = filter_shape[1];
+  const index_t filter_size = filter_shape[2] * filter_shape[3];
+  for (index_t c = 0; c < channels; ++c) {
+    for (index_t k = 0; k < filter_size; ++k) {
+      packed_filter[k * channels + c] = filter[c * filter_size + k];
+    }
+  }
+}
+
+const float *GetDepthwiseConv2dNHWCFilter(PackedWeights *packed_weights,
+                                          const Tensor *filter) {
+  return packed_weights->GetOrPack(
+      "nhwc_depthwise_fp32", filter, filter->size(),
+      [&](float *packed_filter) {
+        Tensor::MappingGuard filter_guard(filter);
+        PackDepthwiseConv2dNHWCFilter(filter->data<float>(),
+                                      filter->shape().data(), packed_filter);
+      });
+}
+
+void DepthwiseConv2dNHWC(const float *input,
+                         const float *packed_filter,
+                         const float *bias,
+                         const index_t *in_shape,
+                         const index_t *out_shape,
+                         const int *filter_hw,
+                         const int *stride_hw,
+                         const int *dilation_hw,
+                         const int *pad_hw,
+                         float *output) {
+  const index_t batch = out_shape[0];
+  const index_t in_height = in_shape[1];
+  const index_t in_width = in_shape[2];
+  const index_t out_height = out_shape[1];
+  const index_t out_width = out_shape[2];
+  const index_t channels = out_shape[3];
+
+#pragma omp parallel for collapse(2) schedule(runtime)
+  for (index_t b = 0; b < batch; ++b) {
+    for (index_t h = 0; h < out_height; ++h) {
+      const float *in_ptr = input + b * in_height * in_width * channels;
+      float *out_row =
+          output + (b * out_height + h) * out_width * channels;
+      for (index_t w = 0; w < out_width; ++w) {
+        float *out_pixel = out_row + w * channels;
+        for (index_t c = 0; c < channels; ++c) {
+          out_pixel[c] = bias == nullptr ? 0 : bias[c];
+        }
+        for (index_t kh = 0; kh < filter_hw[0]; ++kh) {
+          const index_t ih =
+              h * stride_hw[0] + kh * dilation_hw[0] - pad_hw[0];
+          if (ih < 0 || ih >= in_height) {
+            continue;
+          }
+          for (index_t kw = 0; kw < filter_hw[1]; ++kw) {
+            const index_t iw =
+                w * stride_hw[1] + kw * dilation_hw[1] - pad_hw[1];
+            if (iw < 0 || iw >= in_width) {
+              continue;
+            }
+            const float *in_pixel = in_ptr + (ih * in_width + iw) * channels;
+            const float *f_ptr =
+                packed_filter + (kh * filter_hw[1] + kw) * channels;
+            for (index_t c = 0; c < channels; ++c) {
+              out_pixel[c] += in_pixel[c] * f_ptr[c];
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+void PoolingNHWC(const float *input,
+                 const index_t *in_shape,
+                 const index_t *out_shape,
+                 const int *filter_hw,
+                 const int *stride_hw,
+                 const int *dilation_hw,
+                 const int *pad_hw,
+                 const PoolingType pooling_type,
+                 float *output) {
+  const index_t batch = out_shape[0];
+  const index_t in_height = in_shape[1];
+  const index_t in_width = in_shape[2];
+  const index_t out_height = out_shape[1];
+  const index_t out_width = out_shape[2];
+  const index_t channels = out_shape[3];
+  const bool is_max = pooling_type == PoolingType::MAX;
+
+#pragma omp parallel for collapse(2) schedule(runtime)
+  for (index_t b = 0; b < batch; ++b) {
+    for (index_t h = 0; h < out_height; ++h) {
+      const float *in_ptr = input + b * in_height * in_width * channels;
+      float *out_row =
+          output + (b * out_height + h) * out_width * channels;
+      for (index_t w = 0; w < out_width; ++w) {
+        float *out_pixel = out_row + w * channels;
+        std::fill(out_pixel, out_pixel + channels,
+                  is_max ? std::numeric_limits<float>::lowest() : 0);
+        int block_size = 0;
+        for (index_t fh = 0; fh < filter_hw[0]; ++fh) {
+          const index_t ih =
+              h * stride_hw[0] + fh * dilation_hw[0] - pad_hw[0];
+          if (ih < 0 || ih >= in_height) {
+            continue;
+          }
+          for (index_t fw = 0; fw < filter_hw[1]; ++fw) {
+            const index_t iw =
+                w * stride_hw[1] + fw * dilation_hw[1] - pad_hw[1];
+            if (iw < 0 || iw >= in_width) {
+              continue;
+            }
+            const float *in_pixel = in_ptr + (ih * in_width + iw) * channels;
+            if (is_max) {
+              for (index_t c = 0; c < channels; ++c) {
+                out_pixel[c] = std::max(out_pixel[c], in_pixel[c]);
+              }
+            } else {
+              for (index_t c = 0; c < channels; ++c) {
+                out_pixel[c] += in_pixel[c];
+              }
+            }
+            ++block_size;
+          }
+        }
+        if (!is_max) {
+          const float scale = 1.f / block_size;
+          for (index_t c = 0; c < channels; ++c) {
+            out_pixel[c] *= scale;
+          }
+        }
+      }
+    }
+  }
+}
+
+}  // namespace ops
+}  // namespace mace
@@ -0,0 +1,82 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef MACE_OPS_ARM_NHWC_H_
+#define MACE_OPS_ARM_NHWC_H_
+
+#include "mace/core/packed_weights.h"
+#include "mace/core/tensor.h"
+#include "mace/core/types.h"
+#include "mace/ops/pooling.h"
+
+// Float kernels of NHWC activations, whose inner loops run over the
+// contiguous channels of a pixel. The shapes passed are the NHWC ones.
+
+namespace mace {
+namespace ops {
+
+// OIHW of 1x1 => [I, O]
+void PackConv2dK1x1NHWCFilter(const float *filter,
+                              const index_t *filter_shape,
+                              float *packed_filter);
+
+// The constant OIHW filter packed for the NHWC kernel, looked up in or added
+// to the packed weights.
+const float *GetConv2dK1x1NHWCFilter(PackedWeights *packed_weights,
+                                     const Tensor *filter);
+
+// the GEMM of the pixels [N * H * W, I] and the packed filter [I, O]
+void Conv2dK1x1NHWC(const float *input,
+                    const float *packed_filter,
+                    const float *bias,
+                    const index_t *in_shape,
+                    const index_t *out_shape,
+                    const int *stride_hw,
+                    const int *pad_hw,
+                    float *output);
+
+// [1, C, H, W] => [H, W, C]
+void PackDepthwiseConv2dNHWCFilter(const float *filter,
+                                   const index_t *filter_shape,
+                                   float *packed_filter);
+
+const float *GetDepthwiseConv2dNHWCFilter(PackedWeights *packed_weights,
+                                          const Tensor *filter);
+
+// depthwise conv of multiplier 1
+void DepthwiseConv2dNHWC(const float *input,
+                         const float *packed_filter,
+                         const float *bias,
+                         const index_t *in_shape,
+                         const index_t *out_shape,
+                         const int *filter_hw,
+                         const int *stride_hw,
+                         const int *dilation_hw,
+                         const int *pad_hw,
+                         float *output);
+
+// avg pooling divides by the number of the pixels inside the input
+void PoolingNHWC(const float *input,
+                 const index_t *in_shape,
+                 const index_t *out_shape,
+                 const int *filter_hw,
+                 const int *stride_hw,
+                 const int *dilation_hw,
+                 const int *pad_hw,
+                 const PoolingType pooling_type,
+                 float *output);
+
+}  // namespace ops
+}  // namespace mace
+
+#endif  // MACE_OPS_ARM_NHWC_H_
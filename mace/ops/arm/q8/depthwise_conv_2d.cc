@@ -0,0 +1,177 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/ops/arm/q8/depthwise_conv_2d.h"
+
+#include <arm_neon.h>
+#include <algorithm>
+
+#include "mace/core/tensor.h"
+#include "mace/utils/logging.h"
+#include "mace/utils/quantize.h"
+
+namespace mace {
+namespace ops {
+namespace arm {
+namespace q8 {
+
+namespace {
+
+// x / 2^shift per lane, rounded half away from zero like the scalar
+// RoundingDivideByPOT
+inline int32x4_t RoundingDivideByPOT(const int32x4_t x,
+                                     const int32x4_t shift) {
+  const int32x4_t neg_shift = vnegq_s32(shift);
+  const int32x4_t fixup = vshrq_n_s32(vandq_s32(x, neg_shift), 31);
+  return vrshlq_s32(vqaddq_s32(x, fixup), neg_shift);
+}
+
+inline int32x4_t Requantize(const int32x4_t sum,
+                            const int32_t *multipliers,
+                            const int *right_shifts) {
+  const int32x4_t scaled = vqrdmulhq_s32(sum, vld1q_s32(multipliers));
+  return RoundingDivideByPOT(
+      scaled, vld1q_s32(reinterpret_cast<const int32_t *>(right_shifts)));
+}
+
+template <int K>
+void DepthwiseConv2dKxK(const uint8_t *input,
+                        const uint8_t *filter,
+                        const int32_t *bias,
+                        const index_t *in_shape,
+                        const index_t *out_shape,
+                        const int32_t input_zero,
+                        const int32_t filter_zero,
+                        const int32_t output_zero,
+                        const int32_t *multipliers,
+                        const int *right_shifts,
+                        const int *stride_hw,
+                        const int *dilation_hw,
+                        const int *pad_hw,
+                        uint8_t *output) {
+  const index_t in_height = in_shape[1];
+  const index_t in_width = in_shape[2];
+  const index_t channels = in_shape[3];
+  const index_t out_height = out_shape[1];
+  const index_t out_width = out_shape[2];
+  const int16x8_t vinput_zero = vdupq_n_s16(static_cast<int16_t>(input_zero));
+  const int16x8_t vfilter_zero =
+      vdupq_n_s16(static_cast<int16_t>(filter_zero));
+  const int16x8_t voutput_zero =
+      vdupq_n_s16(static_cast<int16_t>(output_zero));
+
+#pragma omp parallel for collapse(2) schedule(runtime)
+  for (index_t b = 0; b < out_shape[0]; ++b) {
+    for (index_t h = 0; h < out_height; ++h) {
+      const uint8_t *in_base = input + b * in_height * in_width * channels;
+      for (index_t w = 0; w < out_width; ++w) {
+        const index_t ih_base = h * stride_hw[0] - pad_hw[0];
+        const index_t iw_base = w * stride_hw[1] - pad_hw[1];
+        // the taps of the filter inside the input
+        const uint8_t *in_ptrs[K * K];
+        const uint8_t *filter_ptrs[K * K];
+        int taps = 0;
+        for (int kh = 0; kh < K; ++kh) {
+          const index_t ih = ih_base + kh * dilation_hw[0];
+          if (ih < 0 || ih >= in_height) {
+            continue;
+          }
+          for (int kw = 0; kw < K; ++kw) {
+            const index_t iw = iw_base + kw * dilation_hw[1];
+            if (iw < 0 || iw >= in_width) {
+              continue;
+            }
+            in_ptrs[taps] = in_base + (ih * in_width + iw) * channels;
+            filter_ptrs[taps] = filter + (kh * K + kw) * channels;
+            ++taps;
+          }
+        }
+        uint8_t *out_ptr =
+            output + ((b * out_height + h) * out_width + w) * channels;
+
+        index_t c = 0;
+        for (; c + 8 <= channels; c += 8) {
+          int32x4_t vsum0 = bias == nullptr ? vdupq_n_s32(0)
+                                            : vld1q_s32(bias + c);
+          int32x4_t vsum1 = bias == nullptr ? vdupq_n_s32(0)
+                                            : vld1q_s32(bias + c + 4);
+          for (int t = 0; t < taps; ++t) {
+            const int16x8_t vin = vsubq_s16(
+                vreinterpretq_s16_u16(vmovl_u8(vld1_u8(in_ptrs[t] + c))),
+                vinput_zero);
+            const int16x8_t vf = vsubq_s16(
+                vreinterpretq_s16_u16(vmovl_u8(vld1_u8(filter_ptrs[t] + c))),
+                vfilter_zero);
+            vsum0 = vmlal_s16(vsum0, vget_low_s16(vin), vget_low_s16(vf));
+            vsum1 = vmlal_s16(vsum1, vget_high_s16(vin), vget_high_s16(vf));
+          }
+          vsum0 = Requantize(vsum0, multipliers + c, right_shifts + c);
+          vsum1 = Requantize(vsum1, multipliers + c + 4,
+                             right_shifts + c + 4);
+          const int16x8_t vout = vqaddq_s16(
+              vcombine_s16(vqmovn_s32(vsum0), vqmovn_s32(vsum1)),
+              voutput_zero);
+          vst1_u8(out_ptr + c, vqmovun_s16(vout));
+        }
+        for (; c < channels; ++c) {
+          int32_t sum = bias == nullptr ? 0 : bias[c];
+          for (int t = 0; t < taps; ++t) {
+            sum += (in_ptrs[t][c] - input_zero) *
+                (filter_ptrs[t][c] - filter_zero);
+          }
+          sum = MultiplyByQuantizedMultiplier(sum, multipliers[c],
+                                              right_shifts[c]) + output_zero;
+          out_ptr[c] = static_cast<uint8_t>(std::min(255, std::max(0, sum)));
+        }
+      }
+    }
+  }
+}
+
+}  // namespace
+
+void DepthwiseConv2d(const uint8_t *input,
+                     const uint8_t *filter,
+                     const int32_t *bias,
+                     const index_t *in_shape,
+                     const index_t *out_shape,
+                     const int kernel,
+                     const int32_t input_zero,
+                     const int32_t filter_zero,
+                     const int32_t output_zero,
+                     const int32_t *multipliers,
+                     const int *right_shifts,
+                     const int *stride_hw,
+                     const int *dilation_hw,
+                     const int *pad_hw,
+                     uint8_t *output) {
+  if (kernel == 3) {
+    DepthwiseConv2dKxK<3>(input, filter, bias, in_shape, out_shape,
+                          input_zero, filter_zero, output_zero, multipliers,
+                          right_shifts, stride_hw, dilation_hw, pad_hw,
+                          output);
+  } else if (kernel == 5) {
+    DepthwiseConv2dKxK<5>(input, filter, bias, in_shape, out_shape,
+                          input_zero, filter_zero, output_zero, multipliers,
+                          right_shifts, stride_hw, dilation_hw, pad_hw,
+                          output);
+  } else {
+    LOG(FATAL) << "Unsupported quantized depthwise kernel " << kernel;
+  }
+}
+
+}  // namespace q8
+}  // namespace arm
+}  // namespace ops
+}  // namespace mace
@@ -0,0 +1,50 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_OPS_ARM_Q8_DEPTHWISE_CONV_2D_H_
+#define MACE_OPS_ARM_Q8_DEPTHWISE_CONV_2D_H_
+
+#include "mace/core/types.h"
+
+namespace mace {
+namespace ops {
+namespace arm {
+namespace q8 {
+
+// NHWC uint8 depthwise conv of multiplier 1 with a 3x3 or 5x5 filter of
+// [kh, kw, channels, 1]. The int32 sums are requantized per channel by the
+// multipliers and right shifts of GetOutputMultipliersAndShifts, bias may be
+// null.
+void DepthwiseConv2d(const uint8_t *input,
+                     const uint8_t *filter,
+                     const int32_t *bias,
+                     const index_t *in_shape,
+                     const index_t *out_shape,
+                     const int kernel,
+                     const int32_t input_zero,
+                     const int32_t filter_zero,
+                     const int32_t output_zero,
+                     const int32_t *multipliers,
+                     const int *right_shifts,
+                     const int *stride_hw,
+                     const int *dilation_hw,
+                     const int *pad_hw,
+                     uint8_t *output);
+
+}  // namespace q8
+}  // namespace arm
+}  // namespace ops
+}  // namespace mace
+
+#endif  // MACE_OPS_ARM_Q8_DEPTHWISE_CONV_2D_H_
@@ -0,0 +1,118 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "mace/core/tensor.h"
+#include "mace/ops/arm/q8/depthwise_conv_2d.h"
+#include "mace/ops/testing/test_utils.h"
+#include "mace/utils/quantize.h"
+
+namespace mace {
+namespace ops {
+namespace test {
+
+void TestDepthwiseConv2dUint8(const std::vector<index_t> &in_shape,
+                              const int kernel,
+                              const int stride,
+                              const int dilation,
+                              const int pad) {
+  const index_t channels = in_shape[3];
+  const int span = (kernel - 1) * dilation + 1;
+  const std::vector<index_t> out_shape = {
+      in_shape[0], (in_shape[1] + 2 * pad - span) / stride + 1,
+      (in_shape[2] + 2 * pad - span) / stride + 1, channels};
+  const std::vector<index_t> filter_shape = {kernel, kernel, channels, 1};
+  std::vector<uint8_t> input;
+  std::vector<uint8_t> filter;
+  std::vector<int32_t> bias;
+  GenerateRandomIntTypeData<uint8_t>(in_shape, &input);
+  GenerateRandomIntTypeData<uint8_t>(filter_shape, &filter);
+  GenerateRandomIntTypeData<int32_t>({channels}, &bias, -1000, 1000);
+  const int32_t input_zero = 102;
+  const int32_t filter_zero = 131;
+  const int32_t output_zero = 87;
+
+  // per channel scales of the filter
+  std::vector<float> filter_scales(channels);
+  for (index_t c = 0; c < channels; ++c) {
+    filter_scales[c] = 0.002f + 0.0005f * (c % 7);
+  }
+  std::vector<int32_t> multipliers;
+  std::vector<int> right_shifts;
+  GetOutputMultipliersAndShifts(0.f, filter_scales, channels, 0.05f, 0.5f,
+                                &multipliers, &right_shifts);
+
+  const int stride_hw[2] = {stride, stride};
+  const int dilation_hw[2] = {dilation, dilation};
+  const int pad_hw[2] = {pad, pad};
+  std::vector<uint8_t> output(
+      out_shape[0] * out_shape[1] * out_shape[2] * channels);
+  arm::q8::DepthwiseConv2d(input.data(), filter.data(), bias.data(),
+                           in_shape.data(), out_shape.data(), kernel,
+                           input_zero, filter_zero, output_zero,
+                           multipliers.data(), right_shifts.data(),
+                           stride_hw, dilation_hw, pad_hw, output.data());
+
+  for (index_t b = 0; b < out_shape[0]; ++b) {
+    for (index_t h = 0; h < out_shape[1]; ++h) {
+      for (index_t w = 0; w < out_shape[2]; ++w) {
+        for (index_t c = 0; c < channels; ++c) {
+          int32_t sum = bias[c];
+          for (index_t kh = 0; kh < kernel; ++kh) {
+            for (index_t kw = 0; kw < kernel; ++kw) {
+              const index_t ih = h * stride + kh * dilation - pad;
+              const index_t iw = w * stride + kw * dilation - pad;
+              if (ih < 0 || ih >= in_shape[1] || iw < 0 ||
+                  iw >= in_shape[2]) {
+                continue;
+              }
+              sum += (input[((b * in_shape[1] + ih) * in_shape[2] + iw)
+                                * channels + c] - input_zero) *
+                  (filter[(kh * kernel + kw) * channels + c] - filter_zero);
+            }
+          }
+          const int32_t expected = std::min(255, std::max(0,
+              MultiplyByQuantizedMultiplier(sum, multipliers[c],
+                                            right_shifts[c])
+                  + output_zero));
+          const index_t index =
+              ((b * out_shape[1] + h) * out_shape[2] + w) * channels + c;
+          // the vector doubling high multiply rounds ties up
+          EXPECT_NEAR(expected, output[index], 1) << " with index " << index;
+        }
+      }
+    }
+  }
+}
+
+TEST(ArmDepthwiseConv2dUint8, K3x3) {
+  TestDepthwiseConv2dUint8({1, 9, 11, 16}, 3, 1, 1, 1);
+  TestDepthwiseConv2dUint8({2, 14, 13, 21}, 3, 2, 1, 1);
+  TestDepthwiseConv2dUint8({1, 12, 12, 8}, 3, 1, 2, 2);
+  TestDepthwiseConv2dUint8({1, 7, 8, 5}, 3, 1, 1, 0);
+}
+
+TEST(ArmDepthwiseConv2dUint8, K5x5) {
+  TestDepthwiseConv2dUint8({1, 10, 9, 24}, 5, 1, 1, 2);
+  TestDepthwiseConv2dUint8({1, 15, 16, 19}, 5, 2, 1, 2);
+  TestDepthwiseConv2dUint8({1, 16, 16, 8}, 5, 1, 3, 6);
+}
+
+}  // namespace test
+}  // namespace ops
+}  // namespace mace
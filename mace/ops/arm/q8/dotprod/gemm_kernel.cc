@@ -0,0 +1,119 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/ops/arm/q8/dotprod/gemm_kernel.h"
+
+#if defined(__aarch64__) && defined(__ARM_FEATURE_DOTPROD)
+#include <arm_neon.h>
+#endif
+
+#include "mace/core/macros.h"
+#include "mace/utils/logging.h"
+
+namespace mace {
+namespace ops {
+namespace arm {
+namespace q8 {
+
+#if defined(__aarch64__) && defined(__ARM_FEATURE_DOTPROD)
+
+bool HasDotProdKernel() {
+  return true;
+}
+
+// Register layout: each udot adds the 4 depth values of 4 rows of lhs times
+// those of one column of rhs, picked by the lane, into 4 accumulators.
+// 16 accumulators hold the 8x8 block, rows 0-3 in vo0x and rows 4-7 in
+// vo1x of column x.
+void ComputeBlockDotProd(const uint8_t *packed_lhs,
+                         const uint8_t *packed_rhs,
+                         const index_t depth_padded,
+                         uint32_t *output) {
+  uint32x4_t vo00 = vdupq_n_u32(0), vo10 = vdupq_n_u32(0);
+  uint32x4_t vo01 = vdupq_n_u32(0), vo11 = vdupq_n_u32(0);
+  uint32x4_t vo02 = vdupq_n_u32(0), vo12 = vdupq_n_u32(0);
+  uint32x4_t vo03 = vdupq_n_u32(0), vo13 = vdupq_n_u32(0);
+  uint32x4_t vo04 = vdupq_n_u32(0), vo14 = vdupq_n_u32(0);
+  uint32x4_t vo05 = vdupq_n_u32(0), vo15 = vdupq_n_u32(0);
+  uint32x4_t vo06 = vdupq_n_u32(0), vo16 = vdupq_n_u32(0);
+  uint32x4_t vo07 = vdupq_n_u32(0), vo17 = vdupq_n_u32(0);
+
+  const index_t depth_block_count = depth_padded / 4;
+  for (index_t d = 0; d < depth_block_count; ++d) {
+    const uint8x16_t vl0 = vld1q_u8(packed_lhs);
+    const uint8x16_t vl1 = vld1q_u8(packed_lhs + 16);
+    const uint8x16_t vr0 = vld1q_u8(packed_rhs);
+    const uint8x16_t vr1 = vld1q_u8(packed_rhs + 16);
+    packed_lhs += 32;
+    packed_rhs += 32;
+
+    vo00 = vdotq_laneq_u32(vo00, vl0, vr0, 0);
+    vo10 = vdotq_laneq_u32(vo10, vl1, vr0, 0);
+    vo01 = vdotq_laneq_u32(vo01, vl0, vr0, 1);
+    vo11 = vdotq_laneq_u32(vo11, vl1, vr0, 1);
+    vo02 = vdotq_laneq_u32(vo02, vl0, vr0, 2);
+    vo12 = vdotq_laneq_u32(vo12, vl1, vr0, 2);
+    vo03 = vdotq_laneq_u32(vo03, vl0, vr0, 3);
+    vo13 = vdotq_laneq_u32(vo13, vl1, vr0, 3);
+    vo04 = vdotq_laneq_u32(vo04, vl0, vr1, 0);
+    vo14 = vdotq_laneq_u32(vo14, vl1, vr1, 0);
+    vo05 = vdotq_laneq_u32(vo05, vl0, vr1, 1);
+    vo15 = vdotq_laneq_u32(vo15, vl1, vr1, 1);
+    vo06 = vdotq_laneq_u32(vo06, vl0, vr1, 2);
+    vo16 = vdotq_laneq_u32(vo16, vl1, vr1, 2);
+    vo07 = vdotq_laneq_u32(vo07, vl0, vr1, 3);
+    vo17 = vdotq_laneq_u32(vo17, vl1, vr1, 3);
+  }
+
+  vst1q_u32(output, vo00);
+  vst1q_u32(output + 4, vo10);
+  vst1q_u32(output + 8, vo01);
+  vst1q_u32(output + 12, vo11);
+  vst1q_u32(output + 16, vo02);
+  vst1q_u32(output + 20, vo12);
+  vst1q_u32(output + 24, vo03);
+  vst1q_u32(output + 28, vo13);
+  vst1q_u32(output + 32, vo04);
+  vst1q_u32(output + 36, vo14);
+  vst1q_u32(output + 40, vo05);
+  vst1q_u32(output + 44, vo15);
+  vst1q_u32(output + 48, vo06);
+  vst1q_u32(output + 52, vo16);
+  vst1q_u32(output + 56, vo07);
+  vst1q_u32(output + 60, vo17);
+}
+
+#else
+
+bool HasDotProdKernel() {
+  return false;
+}
+
+void ComputeBlockDotProd(const uint8_t *packed_lhs,
+                         const uint8_t *packed_rhs,
+                         const index_t depth_padded,
+                         uint32_t *output) {
+  MACE_UNUSED(packed_lhs);
+  MACE_UNUSED(packed_rhs);
+  MACE_UNUSED(depth_padded);
+  MACE_UNUSED(output);
+  LOG(FATAL) << "Built without the dot product extension";
+}
+
+#endif  // __aarch64__ && __ARM_FEATURE_DOTPROD
+
+}  // namespace q8
+}  // namespace arm
+}  // namespace ops
+}  // namespace mace
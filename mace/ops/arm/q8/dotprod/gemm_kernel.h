@@ -0,0 +1,50 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_OPS_ARM_Q8_DOTPROD_GEMM_KERNEL_H_
+#define MACE_OPS_ARM_Q8_DOTPROD_GEMM_KERNEL_H_
+
+#include <cstdint>
+
+#include "mace/core/types.h"
+
+// Int8 gemm microkernel of ARMv8.2 dot product instructions, only called on
+// cores with the dot product extension, see CPUFeatures::asimddp.
+
+namespace mace {
+namespace ops {
+namespace arm {
+namespace q8 {
+
+// rows and columns of the output block of ComputeBlockDotProd
+constexpr index_t kDotProdBlockSize = 8;
+
+// whether this build has ComputeBlockDotProd, false unless compiled for
+// ARMv8.2 with +dotprod
+bool HasDotProdKernel();
+
+// 8x8 column-major block of the sums of products of packed lhs and rhs:
+// both are 4 depth values of each of the 8 rows or columns, repeatedly for
+// depth_padded / 4 times
+void ComputeBlockDotProd(const uint8_t *packed_lhs,
+                         const uint8_t *packed_rhs,
+                         const index_t depth_padded,
+                         uint32_t *output);
+
+}  // namespace q8
+}  // namespace arm
+}  // namespace ops
+}  // namespace mace
+
+#endif  // MACE_OPS_ARM_Q8_DOTPROD_GEMM_KERNEL_H_
@@ -0,0 +1,294 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/ops/arm/q8/gemm.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "mace/core/runtime/cpu/cpu_runtime.h"
+#include "mace/ops/arm/q8/dotprod/gemm_kernel.h"
+#include "mace/utils/quantize.h"
+#include "mace/utils/utils.h"
+
+namespace mace {
+namespace ops {
+namespace arm {
+namespace q8 {
+
+namespace {
+
+constexpr index_t kBlockSize = kDotProdBlockSize;
+constexpr index_t kDepthBlockSize = 4;
+
+// requantization of a uint8 output, multipliers and shifts are of the rows
+struct OutputStage {
+  const int32_t *multipliers;
+  const int *shifts;
+  int32_t zero_point;
+  int32_t min;
+  int32_t max;
+};
+
+// Pack width x depth values, value (w, k) at data[w * width_stride +
+// k * depth_stride], into blocks of the kernel: 4 depth values of each of
+// the 8 rows or columns of a block in turn, zero padded. sums gets the sum
+// of each row or column, for the zero point of the other side.
+void PackBlocks(const uint8_t *data,
+                const index_t width,
+                const index_t depth,
+                const index_t width_stride,
+                const index_t depth_stride,
+                uint8_t *packed,
+                int32_t *sums) {
+  const index_t block_count = RoundUpDiv(width, kBlockSize);
+  const index_t depth_padded = RoundUp(depth, kDepthBlockSize);
+#pragma omp parallel for schedule(runtime)
+  for (index_t block_idx = 0; block_idx < block_count; ++block_idx) {
+    const index_t start = block_idx * kBlockSize;
+    const index_t block_len = std::min(kBlockSize, width - start);
+    uint8_t *packed_block = packed + start * depth_padded;
+    memset(packed_block, 0, kBlockSize * depth_padded);
+    for (index_t w = 0; w < kBlockSize; ++w) {
+      int32_t sum = 0;
+      if (w < block_len) {
+        const uint8_t *src = data + (start + w) * width_stride;
+        uint8_t *dst = packed_block + w * kDepthBlockSize;
+        for (index_t k = 0; k < depth; ++k) {
+          const uint8_t value = src[k * depth_stride];
+          dst[(k / kDepthBlockSize) * kBlockSize * kDepthBlockSize
+              + k % kDepthBlockSize] = value;
+          sum += value;
+        }
+      }
+      sums[start + w] = sum;
+    }
+  }
+}
+
+// portable version of ComputeBlockDotProd
+void ComputeBlock(const uint8_t *packed_lhs,
+                  const uint8_t *packed_rhs,
+                  const index_t depth_padded,
+                  uint32_t *output) {
+  std::fill_n(output, kBlockSize * kBlockSize, 0);
+  for (index_t d = 0; d < depth_padded; d += kDepthBlockSize) {
+    for (index_t c = 0; c < kBlockSize; ++c) {
+      const uint8_t *rhs = packed_rhs + c * kDepthBlockSize;
+      for (index_t r = 0; r < kBlockSize; ++r) {
+        const uint8_t *lhs = packed_lhs + r * kDepthBlockSize;
+        output[c * kBlockSize + r] +=
+            static_cast<uint32_t>(lhs[0]) * rhs[0]
+                + static_cast<uint32_t>(lhs[1]) * rhs[1]
+                + static_cast<uint32_t>(lhs[2]) * rhs[2]
+                + static_cast<uint32_t>(lhs[3]) * rhs[3];
+      }
+    }
+    packed_lhs += kBlockSize * kDepthBlockSize;
+    packed_rhs += kBlockSize * kDepthBlockSize;
+  }
+}
+
+template<typename OUTPUT_TYPE>
+OUTPUT_TYPE OutputValue(const int32_t value,
+                        const index_t row,
+                        const OutputStage &stage);
+
+template<>
+inline uint8_t OutputValue<uint8_t>(const int32_t value,
+                                    const index_t row,
+                                    const OutputStage &stage) {
+  const int32_t scaled = MultiplyByQuantizedMultiplier(
+      value, stage.multipliers[row], stage.shifts[row]) + stage.zero_point;
+  return static_cast<uint8_t>(
+      std::max(stage.min, std::min(stage.max, scaled)));
+}
+
+template<>
+inline int32_t OutputValue<int32_t>(const int32_t value,
+                                    const index_t row,
+                                    const OutputStage &stage) {
+  MACE_UNUSED(row);
+  MACE_UNUSED(stage);
+  return value;
+}
+
+}  // namespace
+
+template<typename OUTPUT_TYPE>
+bool Gemm<OUTPUT_TYPE>::HasDotProd() {
+#ifdef __aarch64__
+  return GetCPUFeatures().asimddp && HasDotProdKernel();
+#else
+  return false;
+#endif
+}
+
+template<typename OUTPUT_TYPE>
+index_t Gemm<OUTPUT_TYPE>::ScratchSize(const index_t rows,
+                                       const index_t cols,
+                                       const index_t depth) {
+  const index_t rows_padded = RoundUp(rows, kBlockSize);
+  const index_t cols_padded = RoundUp(cols, kBlockSize);
+  const index_t depth_padded = RoundUp(depth, kDepthBlockSize);
+  return PadAlignSize(rows_padded * depth_padded)
+      + PadAlignSize(sizeof(int32_t) * rows_padded)
+      + PadAlignSize(cols_padded * depth_padded)
+      + PadAlignSize(sizeof(int32_t) * cols_padded);
+}
+
+template<typename OUTPUT_TYPE>
+MaceStatus Gemm<OUTPUT_TYPE>::Compute(const OpContext *context,
+                                      const Tensor *lhs,
+                                      const Tensor *rhs,
+                                      const int32_t *bias,
+                                      const index_t batch,
+                                      const index_t rows,
+                                      const index_t cols,
+                                      const index_t depth,
+                                      const MatrixMajor lhs_major,
+                                      const MatrixMajor rhs_major,
+                                      const MatrixMajor output_major,
+                                      const bool lhs_batched,
+                                      const bool rhs_batched,
+                                      Tensor *output) {
+  MACE_CHECK(output->size() == batch * rows * cols,
+             "Need resize output tensor before call gemm.");
+  Tensor::MappingGuard lhs_guard(lhs);
+  Tensor::MappingGuard rhs_guard(rhs);
+  Tensor::MappingGuard output_guard(output);
+  const uint8_t *lhs_data = lhs->data<uint8_t>();
+  const uint8_t *rhs_data = rhs->data<uint8_t>();
+  OUTPUT_TYPE *output_data = output->mutable_data<OUTPUT_TYPE>();
+
+  // lhs may be quantized per row
+  OutputStage stage = {nullptr, nullptr, 0, output_min_, output_max_};
+  if (DataTypeToEnum<OUTPUT_TYPE>::value == DataType::DT_UINT8) {
+    MACE_CHECK(output->scale() > 0, "output scale must not be zero");
+    GetOutputMultipliersAndShifts(lhs->scale(),
+                                  lhs->scales(),
+                                  rows,
+                                  rhs->scale(),
+                                  output->scale(),
+                                  &output_multipliers_,
+                                  &output_shifts_);
+    stage.multipliers = output_multipliers_.data();
+    stage.shifts = output_shifts_.data();
+    stage.zero_point = output->zero_point();
+  }
+  // the correction of the zero points is done in uint32 as the sums of the
+  // kernels, which wrap around the same way
+  const uint32_t lhs_zero_point = static_cast<uint32_t>(lhs->zero_point());
+  const uint32_t rhs_zero_point = static_cast<uint32_t>(rhs->zero_point());
+  const uint32_t zero_points_product =
+      static_cast<uint32_t>(depth) * lhs_zero_point * rhs_zero_point;
+
+  const index_t row_block_count = RoundUpDiv(rows, kBlockSize);
+  const index_t col_block_count = RoundUpDiv(cols, kBlockSize);
+  const index_t rows_padded = RoundUp(rows, kBlockSize);
+  const index_t cols_padded = RoundUp(cols, kBlockSize);
+  const index_t depth_padded = RoundUp(depth, kDepthBlockSize);
+
+  ScratchBuffer *scratch = &tmp_scratch_buffer_;
+  if (context != nullptr && context->device()->scratch_buffer() != nullptr) {
+    scratch = context->device()->scratch_buffer();
+  }
+  MACE_RETURN_IF_ERROR(scratch->GrowSize(
+      scratch->offset() + ScratchSize(rows, cols, depth)));
+  uint8_t *packed_lhs = scratch->Scratch(
+      PadAlignSize(rows_padded * depth_padded)).mutable_data<uint8_t>();
+  int32_t *lhs_sums = scratch->Scratch(
+      PadAlignSize(sizeof(int32_t) * rows_padded)).mutable_data<int32_t>();
+  uint8_t *packed_rhs = scratch->Scratch(
+      PadAlignSize(cols_padded * depth_padded)).mutable_data<uint8_t>();
+  int32_t *rhs_sums = scratch->Scratch(
+      PadAlignSize(sizeof(int32_t) * cols_padded)).mutable_data<int32_t>();
+
+  const bool use_dot_prod = HasDotProd();
+
+  for (index_t b = 0; b < batch; ++b) {
+    MatrixMap<const uint8_t>
+        lhs_matrix
+        (lhs_data + static_cast<index_t>(lhs_batched) * b * rows * depth,
+         lhs_major,
+         rows,
+         depth);
+    MatrixMap<const uint8_t>
+        rhs_matrix
+        (rhs_data + static_cast<index_t>(rhs_batched) * b * depth * cols,
+         rhs_major,
+         depth,
+         cols);
+    MatrixMap<OUTPUT_TYPE> output_matrix
+        (output_data + b * rows * cols, output_major, rows, cols);
+
+    if (b == 0 || lhs_batched) {
+      PackBlocks(lhs_matrix.data(), rows, depth, lhs_matrix.rows_stride(),
+                 lhs_matrix.cols_stride(), packed_lhs, lhs_sums);
+    }
+    if (b == 0 || rhs_batched) {
+      PackBlocks(rhs_matrix.data(), cols, depth, rhs_matrix.cols_stride(),
+                 rhs_matrix.rows_stride(), packed_rhs, rhs_sums);
+    }
+
+#pragma omp parallel for collapse(2) schedule(runtime)
+    for (index_t row_block_idx = 0; row_block_idx < row_block_count;
+         ++row_block_idx) {
+      for (index_t col_block_idx = 0; col_block_idx < col_block_count;
+           ++col_block_idx) {
+        const index_t start_row = row_block_idx * kBlockSize;
+        const index_t start_col = col_block_idx * kBlockSize;
+        const index_t row_block_len = std::min(kBlockSize, rows - start_row);
+        const index_t col_block_len = std::min(kBlockSize, cols - start_col);
+        const uint8_t *packed_lhs_block = packed_lhs + start_row * depth_padded;
+        const uint8_t *packed_rhs_block = packed_rhs + start_col * depth_padded;
+
+        uint32_t block[kBlockSize * kBlockSize];
+        if (use_dot_prod) {
+          ComputeBlockDotProd(packed_lhs_block, packed_rhs_block,
+                              depth_padded, block);
+        } else {
+          ComputeBlock(packed_lhs_block, packed_rhs_block, depth_padded,
+                       block);
+        }
+
+        for (index_t c = 0; c < col_block_len; ++c) {
+          const uint32_t col_correction = zero_points_product
+              - lhs_zero_point * static_cast<uint32_t>(rhs_sums[start_col + c]);
+          for (index_t r = 0; r < row_block_len; ++r) {
+            int32_t value = static_cast<int32_t>(
+                block[c * kBlockSize + r] + col_correction
+                    - rhs_zero_point
+                        * static_cast<uint32_t>(lhs_sums[start_row + r]));
+            if (bias != nullptr) {
+              value += bias[start_row + r];
+            }
+            output_matrix(start_row + r, start_col + c) =
+                OutputValue<OUTPUT_TYPE>(value, start_row + r, stage);
+          }
+        }
+      }  // col_block_idx
+    }  // row_block_idx
+  }  // b
+
+  return MaceStatus::MACE_SUCCESS;
+}
+
+template class Gemm<uint8_t>;
+template class Gemm<int32_t>;
+
+}  // namespace q8
+}  // namespace arm
+}  // namespace ops
+}  // namespace mace
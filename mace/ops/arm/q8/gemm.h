@@ -0,0 +1,96 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// This implements matrix-matrix multiplication of uint8 matrices.
+// In the case of matrix-vector multiplication, use gemv.h/gemv.cc instead
+
+#ifndef MACE_OPS_ARM_Q8_GEMM_H_
+#define MACE_OPS_ARM_Q8_GEMM_H_
+
+#include <vector>
+
+#include "mace/public/mace.h"
+#include "mace/core/tensor.h"
+#include "mace/core/op_context.h"
+#include "mace/ops/common/matrix.h"
+
+namespace mace {
+namespace ops {
+namespace arm {
+namespace q8 {
+
+// output = (lhs - lhs zero point) * (rhs - rhs zero point) + bias of rows.
+// A uint8 output is requantized to its scale and zero point and clamped to
+// the output range, with the scale of each row if lhs is quantized per
+// channel. An int32 output keeps the sums of lhs * rhs scale.
+//
+// Both inputs are packed into 8-wide blocks of 4 depth values, multiplied
+// by the dot product kernel on cores with the ARMv8.2 dot product extension
+// and by a portable kernel otherwise, and the output stage runs on each
+// block as it is computed.
+template<typename OUTPUT_TYPE>
+class Gemm {
+ public:
+  Gemm()
+      : tmp_scratch_buffer_(GetCPUAllocator()),
+        output_min_(0),
+        output_max_(255) {}
+  ~Gemm() {}
+
+  // bias has rows values, or is nullptr
+  MaceStatus Compute(
+      const OpContext *context,
+      const Tensor *lhs,
+      const Tensor *rhs,
+      const int32_t *bias,
+      const index_t batch,
+      const index_t rows,
+      const index_t cols,
+      const index_t depth,
+      const MatrixMajor lhs_major,
+      const MatrixMajor rhs_major,
+      const MatrixMajor output_major,
+      const bool lhs_batched,
+      const bool rhs_batched,
+      Tensor *output);
+
+  // Quantized range of a uint8 output, narrower than [0, 255] to fuse
+  // ReLU or ReLUX into the output stage.
+  void SetOutputRange(const int32_t output_min, const int32_t output_max) {
+    output_min_ = output_min;
+    output_max_ = output_max;
+  }
+
+  // whether Compute runs the dot product kernel on these cores
+  static bool HasDotProd();
+
+  // bytes of the scratch buffer Compute takes
+  static index_t ScratchSize(const index_t rows,
+                             const index_t cols,
+                             const index_t depth);
+
+ private:
+  ScratchBuffer tmp_scratch_buffer_;
+  std::vector<int32_t> output_multipliers_;
+  std::vector<int> output_shifts_;
+  int32_t output_min_;
+  int32_t output_max_;
+};
+
+}  // namespace q8
+}  // namespace arm
+}  // namespace ops
+}  // namespace mace
+
+#endif  // MACE_OPS_ARM_Q8_GEMM_H_
@@ -0,0 +1,171 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#include "mace/core/tensor.h"
+#include "mace/core/op_context.h"
+#include "mace/ops/arm/q8/gemm.h"
+#include "mace/ops/testing/test_utils.h"
+#include "mace/utils/quantize.h"
+
+namespace mace {
+namespace ops {
+namespace test {
+
+namespace {
+
+// sum of (lhs - lhs zero point) * (rhs - rhs zero point) + bias
+std::vector<int32_t> ReferenceGemm(const Tensor &lhs,
+                                   const Tensor &rhs,
+                                   const Tensor &bias,
+                                   const index_t batch,
+                                   const index_t rows,
+                                   const index_t cols,
+                                   const index_t depth,
+                                   const MatrixMajor lhs_major,
+                                   const MatrixMajor rhs_major,
+                                   const bool lhs_batched,
+                                   const bool rhs_batched) {
+  Tensor::MappingGuard lhs_guard(&lhs);
+  Tensor::MappingGuard rhs_guard(&rhs);
+  Tensor::MappingGuard bias_guard(&bias);
+  const int32_t *bias_data = bias.data<int32_t>();
+  std::vector<int32_t> result(batch * rows * cols);
+  for (index_t b = 0; b < batch; ++b) {
+    MatrixMap<const uint8_t> lhs_matrix(
+        lhs.data<uint8_t>() + static_cast<index_t>(lhs_batched) * b * rows
+            * depth, lhs_major, rows, depth);
+    MatrixMap<const uint8_t> rhs_matrix(
+        rhs.data<uint8_t>() + static_cast<index_t>(rhs_batched) * b * depth
+            * cols, rhs_major, depth, cols);
+    for (index_t r = 0; r < rows; ++r) {
+      for (index_t c = 0; c < cols; ++c) {
+        int32_t sum = bias_data[r];
+        for (index_t k = 0; k < depth; ++k) {
+          sum += (lhs_matrix(r, k) - lhs.zero_point())
+              * (rhs_matrix(k, c) - rhs.zero_point());
+        }
+        result[(b * rows + r) * cols + c] = sum;
+      }
+    }
+  }
+  return result;
+}
+
+void TestGemm(const index_t batch,
+              const index_t rows,
+              const index_t cols,
+              const index_t depth,
+              const MatrixMajor lhs_major,
+              const MatrixMajor rhs_major,
+              const bool lhs_batched,
+              const bool rhs_batched,
+              const bool per_channel = false) {
+  Tensor lhs(GetCPUAllocator(), DataType::DT_UINT8);
+  Tensor rhs(GetCPUAllocator(), DataType::DT_UINT8);
+  Tensor bias(GetCPUAllocator(), DataType::DT_INT32);
+  Tensor output_int32(GetCPUAllocator(), DataType::DT_INT32);
+  Tensor output_uint8(GetCPUAllocator(), DataType::DT_UINT8);
+  lhs.SetScale(0.02);
+  if (per_channel) {
+    std::vector<float> lhs_scales(rows);
+    for (index_t r = 0; r < rows; ++r) {
+      lhs_scales[r] = 0.005f + 0.001f * (r % 16);
+    }
+    lhs.SetScales(lhs_scales);
+  }
+  rhs.SetScale(0.03);
+  output_uint8.SetScale(2.5);
+  lhs.SetZeroPoint(23);
+  rhs.SetZeroPoint(145);
+  output_uint8.SetZeroPoint(57);
+  lhs.Resize({lhs_batched ? batch : 1, rows, depth});
+  rhs.Resize({rhs_batched ? batch : 1, depth, cols});
+  bias.Resize({rows});
+  output_int32.Resize({batch, rows, cols});
+  output_uint8.Resize({batch, rows, cols});
+  {
+    Tensor::MappingGuard lhs_guard(&lhs);
+    Tensor::MappingGuard rhs_guard(&rhs);
+    Tensor::MappingGuard bias_guard(&bias);
+    GenerateRandomIntTypeData<uint8_t>(lhs.shape(),
+                                       lhs.mutable_data<uint8_t>());
+    GenerateRandomIntTypeData<uint8_t>(rhs.shape(),
+                                       rhs.mutable_data<uint8_t>());
+    GenerateRandomIntTypeData<int32_t>(bias.shape(),
+                                       bias.mutable_data<int32_t>());
+  }
+  const std::vector<int32_t> expected = ReferenceGemm(
+      lhs, rhs, bias, batch, rows, cols, depth, lhs_major, rhs_major,
+      lhs_batched, rhs_batched);
+
+  mace::ops::arm::q8::Gemm<int32_t> gemm_int32;
+  gemm_int32.Compute(nullptr, &lhs, &rhs, bias.data<int32_t>(), batch, rows,
+                     cols, depth, lhs_major, rhs_major, RowMajor,
+                     lhs_batched, rhs_batched, &output_int32);
+  {
+    Tensor::MappingGuard output_guard(&output_int32);
+    const int32_t *output_data = output_int32.data<int32_t>();
+    for (index_t i = 0; i < output_int32.size(); ++i) {
+      EXPECT_EQ(expected[i], output_data[i]);
+    }
+  }
+
+  // a fused ReLUX clamping to [zero point, 200]
+  mace::ops::arm::q8::Gemm<uint8_t> gemm_uint8;
+  gemm_uint8.SetOutputRange(output_uint8.zero_point(), 200);
+  gemm_uint8.Compute(nullptr, &lhs, &rhs, bias.data<int32_t>(), batch, rows,
+                     cols, depth, lhs_major, rhs_major, RowMajor,
+                     lhs_batched, rhs_batched, &output_uint8);
+  {
+    Tensor::MappingGuard output_guard(&output_uint8);
+    const uint8_t *output_data = output_uint8.data<uint8_t>();
+    for (index_t i = 0; i < output_uint8.size(); ++i) {
+      const float multiplier = lhs.scale((i / cols) % rows) * rhs.scale()
+          / output_uint8.scale();
+      const int32_t value = std::max(
+          output_uint8.zero_point(),
+          std::min(200, static_cast<int32_t>(
+              std::roundf(expected[i] * multiplier))
+              + output_uint8.zero_point()));
+      EXPECT_LE(std::abs(value - output_data[i]), 1);
+    }
+  }
+}
+
+}  // namespace
+
+TEST(ArmGemm, TestGemmQ8) {
+  TestGemm(1, 1, 1, 1, RowMajor, ColMajor, true, true);
+  TestGemm(1, 8, 8, 4, RowMajor, ColMajor, true, true);
+  TestGemm(1, 31, 65, 27, RowMajor, ColMajor, true, true);
+  TestGemm(2, 17, 9, 257, ColMajor, RowMajor, true, true);
+  TestGemm(3, 63, 33, 100, RowMajor, RowMajor, false, true);
+  TestGemm(3, 5, 70, 33, ColMajor, ColMajor, true, false);
+}
+
+TEST(ArmGemm, TestGemmQ8PerChannel) {
+  TestGemm(1, 31, 65, 27, RowMajor, ColMajor, true, true, true);
+  TestGemm(2, 17, 9, 257, ColMajor, RowMajor, true, true, true);
+}
+
+}  // namespace test
+}  // namespace ops
+}  // namespace mace
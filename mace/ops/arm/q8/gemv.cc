@@ -17,6 +17,7 @@
 
 #include <arm_neon.h>
 #include <algorithm>
+#include <vector>
 
 #include "mace/utils/utils.h"
 #include "mace/utils/quantize.h"
@@ -34,6 +35,75 @@ namespace ops {
 namespace arm {
 namespace q8 {
 
+namespace {
+
+// rows of a weight shared by the whole batch are streamed once for up to
+// kMaxBatchPerPass vectors
+const index_t kMaxBatchPerPass = 8;
+
+template <index_t N>
+void MultiBatchRow(const uint8_t *lhs_ptr,
+                   const uint8_t *rhs_ptr,
+                   const index_t width,
+                   const uint8_t lhs_zero_point,
+                   const uint8_t rhs_zero_point,
+                   int32_t *sums) {
+  const uint8x8_t vlhs_zero_point = vdup_n_u8(lhs_zero_point);
+  const uint8x8_t vrhs_zero_point = vdup_n_u8(rhs_zero_point);
+  int32x4_t vo[N];
+  for (index_t n = 0; n < N; ++n) {
+    vo[n] = vdupq_n_s32(0);
+  }
+  index_t w = 0;
+  for (; w + 8 <= width; w += 8) {
+    const int16x8_t vxl = vreinterpretq_s16_u16(
+        vsubl_u8(vld1_u8(lhs_ptr + w), vlhs_zero_point));
+    for (index_t n = 0; n < N; ++n) {
+      const int16x8_t vxr = vreinterpretq_s16_u16(
+          vsubl_u8(vld1_u8(rhs_ptr + n * width + w), vrhs_zero_point));
+      vo[n] = vmlal_s16(vo[n], vget_low_s16(vxl), vget_low_s16(vxr));
+      vo[n] = vmlal_high_s16(vo[n], vxl, vxr);
+    }
+  }
+  for (index_t n = 0; n < N; ++n) {
+    int32_t s = vaddvq_s32(vo[n]);
+    for (index_t r = w; r < width; ++r) {
+      s += (lhs_ptr[r] - lhs_zero_point)
+          * (rhs_ptr[n * width + r] - rhs_zero_point);
+    }
+    sums[n] = s;
+  }
+}
+
+void MultiBatchRow(const index_t count,
+                   const uint8_t *lhs_ptr,
+                   const uint8_t *rhs_ptr,
+                   const index_t width,
+                   const uint8_t lhs_zero_point,
+                   const uint8_t rhs_zero_point,
+                   int32_t *sums) {
+  switch (count) {
+#define MACE_MULTI_BATCH_ROW(N)                                         \
+    case N:                                                             \
+      MultiBatchRow<N>(lhs_ptr, rhs_ptr, width, lhs_zero_point,         \
+                       rhs_zero_point, sums);                           \
+      break;
+    MACE_MULTI_BATCH_ROW(1)
+    MACE_MULTI_BATCH_ROW(2)
+    MACE_MULTI_BATCH_ROW(3)
+    MACE_MULTI_BATCH_ROW(4)
+    MACE_MULTI_BATCH_ROW(5)
+    MACE_MULTI_BATCH_ROW(6)
+    MACE_MULTI_BATCH_ROW(7)
+    MACE_MULTI_BATCH_ROW(8)
+#undef MACE_MULTI_BATCH_ROW
+    default:
+      LOG(FATAL) << "Unsupported batch per pass: " << count;
+  }
+}
+
+}  // namespace
+
 template<typename OUTPUT_TYPE>
 MaceStatus Gemv<OUTPUT_TYPE>::Compute(const OpContext *context,
                                       const Tensor *lhs,
@@ -54,18 +124,64 @@ MaceStatus Gemv<OUTPUT_TYPE>::Compute(const OpContext *context,
   Tensor::MappingGuard bias_guard(bias);
   Tensor::MappingGuard output_guard(output);
 
-  float output_multiplier_float = 0.0;
-  int32_t output_multiplier = 0;
-  int32_t output_shift = 0;
+  // of each row, lhs may be quantized per channel
+  std::vector<float> output_multipliers_float;
+  std::vector<int32_t> output_multipliers;
+  std::vector<int> output_shifts;
+  std::vector<int32_t> output_shifts_left;
   if (is_output_type_uint8) {
     MACE_CHECK(output->scale() > 0, "output scale must not be zero");
-    output_multiplier_float = lhs->scale() * rhs->scale() / output->scale();
-    GetOutputMultiplierAndShift(lhs->scale(),
-                                rhs->scale(),
-                                output->scale(),
-                                &output_multiplier,
-                                &output_shift);
+    GetOutputMultipliersAndShifts(lhs->scale(),
+                                  lhs->scales(),
+                                  lhs_height,
+                                  rhs->scale(),
+                                  output->scale(),
+                                  &output_multipliers,
+                                  &output_shifts);
+    output_multipliers_float.resize(lhs_height);
+    output_shifts_left.resize(lhs_height);
+    for (index_t h = 0; h < lhs_height; ++h) {
+      output_multipliers_float[h] =
+          lhs->scale(h) * rhs->scale() / output->scale();
+      output_shifts_left[h] = -output_shifts[h];
+    }
   }
+  const float *output_multipliers_float_data =
+      output_multipliers_float.data();
+  const int32_t *output_multipliers_data = output_multipliers.data();
+  const int32_t *output_shifts_left_data = output_shifts_left.data();
+
+  if (!lhs_batched && rhs_batched && batch > 1) {
+    // the weight of FullyConnected, each row is read once per pass
+    const uint8_t lhs_zero_point = static_cast<uint8_t>(lhs->zero_point());
+    const uint8_t rhs_zero_point = static_cast<uint8_t>(rhs->zero_point());
+    const uint8_t *lhs_data = lhs->data<uint8_t>();
+    const uint8_t *rhs_data = rhs->data<uint8_t>();
+    const int32_t *bias_data = bias ? bias->data<int32_t>() : nullptr;
+    OUTPUT_TYPE *output_data = output->mutable_data<OUTPUT_TYPE>();
+#pragma omp parallel for schedule(runtime)
+    for (index_t h = 0; h < lhs_height; ++h) {
+      int32_t sums[kMaxBatchPerPass];
+      for (index_t b = 0; b < batch; b += kMaxBatchPerPass) {
+        const index_t count = std::min(kMaxBatchPerPass, batch - b);
+        MultiBatchRow(count, lhs_data + h * lhs_width,
+                      rhs_data + b * lhs_width, lhs_width, lhs_zero_point,
+                      rhs_zero_point, sums);
+        for (index_t n = 0; n < count; ++n) {
+          const int32_t s = sums[n] + (bias ? bias_data[h] : 0);
+          OUTPUT_TYPE *ret_ptr = output_data + (b + n) * lhs_height + h;
+          if (is_output_type_uint8) {
+            *ret_ptr = Saturate<uint8_t>(
+                std::roundf(s * output_multipliers_float_data[h]));
+          } else {
+            *ret_ptr = s;
+          }
+        }
+      }
+    }
+    return MaceStatus::MACE_SUCCESS;
+  }
+
   const index_t h_block_size = 4;
   const index_t h_block_count = RoundUpDiv(lhs_height, h_block_size);
 
@@ -89,9 +205,6 @@ MaceStatus Gemv<OUTPUT_TYPE>::Compute(const OpContext *context,
       }
       OUTPUT_TYPE *output_data = output->mutable_data<OUTPUT_TYPE>();
 
-      int32x4_t voutput_multiplier = vdupq_n_s32(output_multiplier);
-      int32x4_t voutput_shift_left = vdupq_n_s32(-output_shift);
-
       uint8x8_t
           vlhs_zero_point = vdup_n_u8(lhs_zero_point);
       uint8x8_t
@@ -383,6 +496,10 @@ MaceStatus Gemv<OUTPUT_TYPE>::Compute(const OpContext *context,
         }
 
         if (is_output_type_uint8) {
+          int32x4_t voutput_multiplier =
+              vld1q_s32(output_multipliers_data + h_offset);
+          int32x4_t voutput_shift_left =
+              vld1q_s32(output_shifts_left_data + h_offset);
           int32x4_t vo_mul = vqrdmulhq_s32(vo, voutput_multiplier);
           int32x4_t
               fixup = vshrq_n_s32(vandq_s32(vo_mul, voutput_shift_left), 31);
@@ -443,8 +560,8 @@ MaceStatus Gemv<OUTPUT_TYPE>::Compute(const OpContext *context,
           }  // w
 
           if (is_output_type_uint8) {
-            ret_ptr[h] =
-                Saturate<uint8_t>(std::roundf(s0 * output_multiplier_float));
+            ret_ptr[h] = Saturate<uint8_t>(std::roundf(
+                s0 * output_multipliers_float_data[h_offset + h]));
           } else {
             ret_ptr[h] = s0;
           }
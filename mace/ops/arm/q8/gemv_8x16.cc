@@ -0,0 +1,94 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/ops/arm/q8/gemv_8x16.h"
+
+#include <arm_neon.h>
+#include <algorithm>
+
+#if !defined(__aarch64__)
+
+#define vmlal_high_s16(c, a, b) vmlal_s16(c, vget_high_s16(a), vget_high_s16(b))
+
+#endif
+
+namespace mace {
+namespace ops {
+namespace arm {
+namespace q8 {
+
+namespace {
+
+// each int32 lane adds a product of at most 255 * 32768 for every 4 columns,
+// so the lanes are folded into int64 every kBlockCols columns
+const index_t kBlockCols = 1024;
+
+int64_t RowDot(const uint8_t *weight,
+               const uint8x8_t vzero_point,
+               const int32_t zero_point,
+               const int16_t *input,
+               const index_t cols) {
+  int64x2_t vsum64 = vdupq_n_s64(0);
+  int64_t sum = 0;
+  for (index_t block = 0; block < cols; block += kBlockCols) {
+    const index_t end = std::min(cols, block + kBlockCols);
+    int32x4_t vsum = vdupq_n_s32(0);
+    index_t c = block;
+    for (; c + 8 <= end; c += 8) {
+      const int16x8_t vw = vreinterpretq_s16_u16(
+          vsubl_u8(vld1_u8(weight + c), vzero_point));
+      const int16x8_t vx = vld1q_s16(input + c);
+      vsum = vmlal_s16(vsum, vget_low_s16(vw), vget_low_s16(vx));
+      vsum = vmlal_high_s16(vsum, vw, vx);
+    }
+    vsum64 = vpadalq_s32(vsum64, vsum);
+    for (; c < end; ++c) {
+      sum += (weight[c] - zero_point) * input[c];
+    }
+  }
+  return sum + vgetq_lane_s64(vsum64, 0) + vgetq_lane_s64(vsum64, 1);
+}
+
+}  // namespace
+
+void Gemv8x16(const uint8_t *weight,
+              const float *weight_scales,
+              const int32_t weight_zero_point,
+              const int16_t *input,
+              const float input_scale,
+              const float *bias,
+              const index_t rows,
+              const index_t cols,
+              const index_t batch,
+              float *output) {
+  const uint8x8_t vzero_point =
+      vdup_n_u8(static_cast<uint8_t>(weight_zero_point));
+#pragma omp parallel for schedule(runtime)
+  for (index_t r = 0; r < rows; ++r) {
+    const uint8_t *row = weight + r * cols;
+    const float scale = weight_scales[r] * input_scale;
+    const float bias_value = bias == nullptr ? 0.f : bias[r];
+    // the row stays in the cache across the batch
+    for (index_t b = 0; b < batch; ++b) {
+      const int64_t sum = RowDot(row, vzero_point, weight_zero_point,
+                                 input + b * cols, cols);
+      output[b * rows + r] = scale * sum + bias_value;
+    }
+  }
+}
+
+}  // namespace q8
+}  // namespace arm
+}  // namespace ops
+}  // namespace mace
@@ -15,6 +15,8 @@
 
 #include <gtest/gtest.h>
 
+#include <vector>
+
 #include "mace/core/tensor.h"
 #include "mace/core/op_context.h"
 #include "mace/ops/arm/q8/gemv.h"
@@ -94,12 +96,20 @@ void TestGemvUint8(const index_t batch,
                    const index_t height,
                    const index_t width,
                    const bool lhs_batched,
-                   const bool rhs_batched) {
+                   const bool rhs_batched,
+                   const bool per_channel = false) {
   Tensor lhs(GetCPUAllocator(), DataType::DT_UINT8);
   Tensor rhs(GetCPUAllocator(), DataType::DT_UINT8);
   Tensor bias(GetCPUAllocator(), DataType::DT_INT32);
   Tensor output(GetCPUAllocator(), DataType::DT_UINT8);
   lhs.SetScale(0.5);
+  if (per_channel) {
+    std::vector<float> lhs_scales(height);
+    for (index_t h = 0; h < height; ++h) {
+      lhs_scales[h] = 0.1f + 0.05f * (h % 8);
+    }
+    lhs.SetScales(lhs_scales);
+  }
   rhs.SetScale(0.3);
   output.SetScale(0.6);
   lhs.SetZeroPoint(23);
@@ -168,6 +178,8 @@ TEST(ArmGemv, TestGemvInt32) {
 
   TestGemvInt32(2, 16, 256, false, true);
   TestGemvInt32(3, 63, 257, false, true);
+  TestGemvInt32(8, 63, 257, false, true);
+  TestGemvInt32(11, 16, 256, false, true);
   TestGemvInt32(2, 16, 256, true, false);
   TestGemvInt32(3, 63, 257, true, false);
 }
@@ -180,10 +192,17 @@ TEST(ArmGemv, TestGemvUint8) {
 
   TestGemvUint8(2, 16, 256, false, true);
   TestGemvUint8(3, 63, 257, false, true);
+  TestGemvUint8(8, 63, 257, false, true);
+  TestGemvUint8(11, 16, 256, false, true);
   TestGemvUint8(2, 16, 256, true, false);
   TestGemvUint8(3, 63, 257, true, false);
 }
 
+TEST(ArmGemv, TestGemvUint8PerChannel) {
+  TestGemvUint8(1, 16, 256, true, true, true);
+  TestGemvUint8(3, 63, 257, true, true, true);
+}
+
 }  // namespace test
 }  // namespace ops
 }  // namespace mace
@@ -0,0 +1,67 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/ops/arm/q8/lookup_table.h"
+
+#include <arm_neon.h>
+
+namespace mace {
+namespace ops {
+namespace arm {
+namespace q8 {
+
+void LookupTable(const uint8_t *table,
+                 const uint8_t *input,
+                 const index_t size,
+                 uint8_t *output) {
+  index_t vec_size = 0;
+#if defined(__aarch64__)
+  // The table as four quarters of 64 bytes, each looked up by the indices
+  // less its offset: tbl gives 0 and tbx keeps the result for the indices
+  // out of a quarter, which those below the offset wrap around to.
+  uint8x16x4_t quarters[4];
+  for (int i = 0; i < 4; ++i) {
+    for (int j = 0; j < 4; ++j) {
+      quarters[i].val[j] = vld1q_u8(table + i * 64 + j * 16);
+    }
+  }
+  const uint8x16_t offset = vdupq_n_u8(64);
+  vec_size = size & ~15;
+
+#pragma omp parallel for schedule(runtime)
+  for (index_t i = 0; i < vec_size; i += 16) {
+    uint8x16_t index = vld1q_u8(input + i);
+    uint8x16_t result = vqtbl4q_u8(quarters[0], index);
+    index = vsubq_u8(index, offset);
+    result = vqtbx4q_u8(result, quarters[1], index);
+    index = vsubq_u8(index, offset);
+    result = vqtbx4q_u8(result, quarters[2], index);
+    index = vsubq_u8(index, offset);
+    result = vqtbx4q_u8(result, quarters[3], index);
+    vst1q_u8(output + i, result);
+  }
+#endif  // __aarch64__
+  // armv7 looks up 32 bytes a vtbl, whose eight tables would not fit its
+  // registers, so it stays with the byte loads
+
+#pragma omp parallel for schedule(runtime)
+  for (index_t i = vec_size; i < size; ++i) {
+    output[i] = table[input[i]];
+  }
+}
+
+}  // namespace q8
+}  // namespace arm
+}  // namespace ops
+}  // namespace mace
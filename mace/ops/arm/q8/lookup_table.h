@@ -0,0 +1,39 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_OPS_ARM_Q8_LOOKUP_TABLE_H_
+#define MACE_OPS_ARM_Q8_LOOKUP_TABLE_H_
+
+#include <cstdint>
+
+#include "mace/core/types.h"
+
+namespace mace {
+namespace ops {
+namespace arm {
+namespace q8 {
+
+// output[i] = table[input[i]] for a table of 256 bytes, see
+// QuantizedLookupTable
+void LookupTable(const uint8_t *table,
+                 const uint8_t *input,
+                 const index_t size,
+                 uint8_t *output);
+
+}  // namespace q8
+}  // namespace arm
+}  // namespace ops
+}  // namespace mace
+
+#endif  // MACE_OPS_ARM_Q8_LOOKUP_TABLE_H_
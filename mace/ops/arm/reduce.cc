@@ -0,0 +1,274 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/ops/arm/reduce.h"
+
+#if defined(MACE_ENABLE_NEON)
+#include <arm_neon.h>
+#endif
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include "mace/utils/logging.h"
+#include "mace/utils/utils.h"
+
+namespace mace {
+namespace ops {
+
+namespace {
+
+// floats reduced by a task, to stay in the L1 cache
+constexpr index_t kChunkSize = 4 * 1024;
+// columns reduced by a task when reducing down the columns
+constexpr index_t kColumnBlock = 256;
+// tasks below which a reduction is also split along its reduced axis
+constexpr index_t kMinTasks = 8;
+
+struct SumReducer {
+  static float Init() { return 0.f; }
+  static float Apply(const float a, const float b) { return a + b; }
+#if defined(MACE_ENABLE_NEON)
+  static float32x4_t Apply(const float32x4_t a, const float32x4_t b) {
+    return vaddq_f32(a, b);
+  }
+  static float Horizontal(const float32x4_t v) {
+#if defined(__aarch64__)
+    return vaddvq_f32(v);
+#else
+    const float32x2_t sum = vadd_f32(vget_low_f32(v), vget_high_f32(v));
+    return vget_lane_f32(vpadd_f32(sum, sum), 0);
+#endif
+  }
+#endif
+};
+
+struct MinReducer {
+  static float Init() { return std::numeric_limits<float>::infinity(); }
+  static float Apply(const float a, const float b) { return std::min(a, b); }
+#if defined(MACE_ENABLE_NEON)
+  static float32x4_t Apply(const float32x4_t a, const float32x4_t b) {
+    return vminq_f32(a, b);
+  }
+  static float Horizontal(const float32x4_t v) {
+#if defined(__aarch64__)
+    return vminvq_f32(v);
+#else
+    const float32x2_t min = vmin_f32(vget_low_f32(v), vget_high_f32(v));
+    return vget_lane_f32(vpmin_f32(min, min), 0);
+#endif
+  }
+#endif
+};
+
+struct MaxReducer {
+  static float Init() { return -std::numeric_limits<float>::infinity(); }
+  static float Apply(const float a, const float b) { return std::max(a, b); }
+#if defined(MACE_ENABLE_NEON)
+  static float32x4_t Apply(const float32x4_t a, const float32x4_t b) {
+    return vmaxq_f32(a, b);
+  }
+  static float Horizontal(const float32x4_t v) {
+#if defined(__aarch64__)
+    return vmaxvq_f32(v);
+#else
+    const float32x2_t max = vmax_f32(vget_low_f32(v), vget_high_f32(v));
+    return vget_lane_f32(vpmax_f32(max, max), 0);
+#endif
+  }
+#endif
+};
+
+struct ProdReducer {
+  static float Init() { return 1.f; }
+  static float Apply(const float a, const float b) { return a * b; }
+#if defined(MACE_ENABLE_NEON)
+  static float32x4_t Apply(const float32x4_t a, const float32x4_t b) {
+    return vmulq_f32(a, b);
+  }
+  static float Horizontal(const float32x4_t v) {
+    const float32x2_t prod = vmul_f32(vget_low_f32(v), vget_high_f32(v));
+    return vget_lane_f32(prod, 0) * vget_lane_f32(prod, 1);
+  }
+#endif
+};
+
+template <typename Reducer>
+float ReduceRow(const float *input, const index_t size) {
+  float result = Reducer::Init();
+  index_t i = 0;
+#if defined(MACE_ENABLE_NEON)
+  float32x4_t acc0 = vdupq_n_f32(Reducer::Init());
+  float32x4_t acc1 = acc0;
+  for (; i + 8 <= size; i += 8) {
+    acc0 = Reducer::Apply(acc0, vld1q_f32(input + i));
+    acc1 = Reducer::Apply(acc1, vld1q_f32(input + i + 4));
+  }
+  result = Reducer::Horizontal(Reducer::Apply(acc0, acc1));
+#endif
+  for (; i < size; ++i) {
+    result = Reducer::Apply(result, input[i]);
+  }
+  return result;
+}
+
+// reduces `reduce` rows, `stride` apart, of `width` columns each
+template <typename Reducer>
+void ReduceColumns(const float *input,
+                   const index_t reduce,
+                   const index_t stride,
+                   const index_t width,
+                   float *output) {
+  index_t j = 0;
+#if defined(MACE_ENABLE_NEON)
+  for (; j + 8 <= width; j += 8) {
+    const float *in_ptr = input + j;
+    float32x4_t acc0 = vld1q_f32(in_ptr);
+    float32x4_t acc1 = vld1q_f32(in_ptr + 4);
+    for (index_t r = 1; r < reduce; ++r) {
+      in_ptr += stride;
+      acc0 = Reducer::Apply(acc0, vld1q_f32(in_ptr));
+      acc1 = Reducer::Apply(acc1, vld1q_f32(in_ptr + 4));
+    }
+    vst1q_f32(output + j, acc0);
+    vst1q_f32(output + j + 4, acc1);
+  }
+  for (; j + 4 <= width; j += 4) {
+    const float *in_ptr = input + j;
+    float32x4_t acc = vld1q_f32(in_ptr);
+    for (index_t r = 1; r < reduce; ++r) {
+      in_ptr += stride;
+      acc = Reducer::Apply(acc, vld1q_f32(in_ptr));
+    }
+    vst1q_f32(output + j, acc);
+  }
+#endif
+  // row by row, which the compiler vectorizes along the columns
+  std::copy(input + j, input + width, output + j);
+  for (index_t r = 1; r < reduce; ++r) {
+    const float *in_ptr = input + r * stride;
+    for (index_t k = j; k < width; ++k) {
+      output[k] = Reducer::Apply(output[k], in_ptr[k]);
+    }
+  }
+}
+
+template <typename Reducer>
+void ReduceAxisImpl(const float *input,
+                    const index_t outer,
+                    const index_t reduce,
+                    const index_t inner,
+                    float *output) {
+  const index_t column_blocks = RoundUpDiv(inner, kColumnBlock);
+  const index_t chunk_rows =
+      std::max<index_t>(1, kChunkSize / std::min(inner, kColumnBlock));
+  const index_t chunks = outer * column_blocks >= kMinTasks ?
+                         1 : RoundUpDiv(reduce, chunk_rows);
+
+  if (inner == 1) {
+    if (chunks == 1) {
+#pragma omp parallel for schedule(runtime)
+      for (index_t o = 0; o < outer; ++o) {
+        output[o] = ReduceRow<Reducer>(input + o * reduce, reduce);
+      }
+      return;
+    }
+
+    std::vector<float> partial(outer * chunks);
+#pragma omp parallel for collapse(2) schedule(runtime)
+    for (index_t o = 0; o < outer; ++o) {
+      for (index_t c = 0; c < chunks; ++c) {
+        const index_t begin = c * chunk_rows;
+        partial[o * chunks + c] = ReduceRow<Reducer>(
+            input + o * reduce + begin, std::min(chunk_rows, reduce - begin));
+      }
+    }
+    for (index_t o = 0; o < outer; ++o) {
+      output[o] = ReduceRow<Reducer>(partial.data() + o * chunks, chunks);
+    }
+    return;
+  }
+
+  std::vector<float> partial;
+  if (chunks > 1) {
+    partial.resize(outer * chunks * inner);
+  }
+  float *chunk_output = chunks > 1 ? partial.data() : output;
+#pragma omp parallel for collapse(3) schedule(runtime)
+  for (index_t o = 0; o < outer; ++o) {
+    for (index_t c = 0; c < chunks; ++c) {
+      for (index_t b = 0; b < column_blocks; ++b) {
+        const index_t begin = c * chunk_rows;
+        const index_t column = b * kColumnBlock;
+        ReduceColumns<Reducer>(
+            input + (o * reduce + begin) * inner + column,
+            std::min(chunk_rows, reduce - begin), inner,
+            std::min(kColumnBlock, inner - column),
+            chunk_output + (o * chunks + c) * inner + column);
+      }
+    }
+  }
+  if (chunks > 1) {
+#pragma omp parallel for collapse(2) schedule(runtime)
+    for (index_t o = 0; o < outer; ++o) {
+      for (index_t b = 0; b < column_blocks; ++b) {
+        const index_t column = b * kColumnBlock;
+        ReduceColumns<Reducer>(partial.data() + o * chunks * inner + column,
+                               chunks, inner,
+                               std::min(kColumnBlock, inner - column),
+                               output + o * inner + column);
+      }
+    }
+  }
+}
+
+}  // namespace
+
+void ReduceAxis(const float *input,
+                const index_t outer,
+                const index_t reduce,
+                const index_t inner,
+                const ReduceType type,
+                float *output) {
+  switch (type) {
+    case ReduceType::MEAN: {
+      ReduceAxisImpl<SumReducer>(input, outer, reduce, inner, output);
+      const float scale = 1.f / reduce;
+      const index_t size = outer * inner;
+#pragma omp parallel for schedule(runtime)
+      for (index_t i = 0; i < size; ++i) {
+        output[i] *= scale;
+      }
+      break;
+    }
+    case ReduceType::SUM:
+      ReduceAxisImpl<SumReducer>(input, outer, reduce, inner, output);
+      break;
+    case ReduceType::MIN:
+      ReduceAxisImpl<MinReducer>(input, outer, reduce, inner, output);
+      break;
+    case ReduceType::MAX:
+      ReduceAxisImpl<MaxReducer>(input, outer, reduce, inner, output);
+      break;
+    case ReduceType::PROD:
+      ReduceAxisImpl<ProdReducer>(input, outer, reduce, inner, output);
+      break;
+    default:
+      MACE_NOT_IMPLEMENTED;
+  }
+}
+
+}  // namespace ops
+}  // namespace mace
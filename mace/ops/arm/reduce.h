@@ -0,0 +1,40 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_OPS_ARM_REDUCE_H_
+#define MACE_OPS_ARM_REDUCE_H_
+
+#include "mace/core/types.h"
+#include "mace/ops/reduce.h"
+
+namespace mace {
+namespace ops {
+
+// Reduces the middle axis of an input viewed as [outer, reduce, inner] into
+// an output of [outer, inner]. Inner of 1 is the innermost axis, reduced
+// along contiguous rows; otherwise the reduction runs down the columns,
+// vectorized across the inner axis. Long reductions are split into chunks
+// reduced in parallel and then combined, so that a single row or a few
+// columns still run on all threads.
+void ReduceAxis(const float *input,
+                const index_t outer,
+                const index_t reduce,
+                const index_t inner,
+                const ReduceType type,
+                float *output);
+
+}  // namespace ops
+}  // namespace mace
+
+#endif  // MACE_OPS_ARM_REDUCE_H_
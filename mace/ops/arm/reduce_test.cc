@@ -0,0 +1,111 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "mace/ops/arm/reduce.h"
+
+namespace mace {
+namespace ops {
+namespace test {
+
+namespace {
+
+void ReduceRef(const std::vector<float> &input,
+               const index_t outer,
+               const index_t reduce,
+               const index_t inner,
+               const ReduceType type,
+               std::vector<float> *output) {
+  for (index_t o = 0; o < outer; ++o) {
+    for (index_t i = 0; i < inner; ++i) {
+      double res = input[o * reduce * inner + i];
+      for (index_t r = 1; r < reduce; ++r) {
+        const float value = input[(o * reduce + r) * inner + i];
+        if (type == ReduceType::MIN) {
+          res = std::min<double>(res, value);
+        } else if (type == ReduceType::MAX) {
+          res = std::max<double>(res, value);
+        } else if (type == ReduceType::PROD) {
+          res *= value;
+        } else {
+          res += value;
+        }
+      }
+      if (type == ReduceType::MEAN) {
+        res /= reduce;
+      }
+      (*output)[o * inner + i] = static_cast<float>(res);
+    }
+  }
+}
+
+void TestReduceAxis(const index_t outer,
+                    const index_t reduce,
+                    const index_t inner) {
+  std::mt19937 gen(outer * reduce + inner);
+  std::uniform_real_distribution<float> dist(-1, 1);
+  std::vector<float> input(outer * reduce * inner);
+  std::generate(input.begin(), input.end(), [&] { return dist(gen); });
+  // values around 1 to keep the products in range
+  std::vector<float> prod_input(input.size());
+  std::transform(input.begin(), input.end(), prod_input.begin(),
+                 [](float x) { return std::exp(x * 1e-3f); });
+
+  for (ReduceType type : {ReduceType::MEAN, ReduceType::MIN, ReduceType::MAX,
+                          ReduceType::PROD, ReduceType::SUM}) {
+    const std::vector<float> &in =
+        type == ReduceType::PROD ? prod_input : input;
+    std::vector<float> output(outer * inner);
+    std::vector<float> expected(outer * inner);
+    ReduceAxis(in.data(), outer, reduce, inner, type, output.data());
+    ReduceRef(in, outer, reduce, inner, type, &expected);
+    for (size_t i = 0; i < output.size(); ++i) {
+      EXPECT_NEAR(expected[i], output[i],
+                  1e-5 + 1e-5 * std::fabs(expected[i]) * std::sqrt(reduce))
+          << "type " << type << " with index " << i;
+    }
+  }
+}
+
+}  // namespace
+
+TEST(ReduceAxisTest, Innermost) {
+  TestReduceAxis(64, 49, 1);
+  TestReduceAxis(3, 7, 1);
+  TestReduceAxis(1, 1, 1);
+  // split along the reduced axis
+  TestReduceAxis(1, 100003, 1);
+  TestReduceAxis(2, 9000, 1);
+}
+
+TEST(ReduceAxisTest, Outer) {
+  TestReduceAxis(1, 49, 64);
+  TestReduceAxis(1, 5, 3);
+  TestReduceAxis(1, 3, 1001);
+  TestReduceAxis(2, 1000, 13);
+}
+
+TEST(ReduceAxisTest, Middle) {
+  TestReduceAxis(4, 17, 9);
+  TestReduceAxis(3, 2048, 32);
+  TestReduceAxis(16, 3, 300);
+}
+
+}  // namespace test
+}  // namespace ops
+}  // namespace mace
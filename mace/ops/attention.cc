@@ -0,0 +1,436 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#if defined(MACE_ENABLE_NEON)
+#include <arm_neon.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <set>
+#include <vector>
+
+#include "mace/core/operator.h"
+#ifdef MACE_ENABLE_OPENCL
+#include "mace/ops/opencl/image/attention.h"
+#endif  // MACE_ENABLE_OPENCL
+#include "mace/utils/memory.h"
+
+namespace mace {
+namespace ops {
+
+// Attention computes softmax(Q K^T * scale + mask) V, one row of scores at a
+// time, so the [queries, keys] score matrix is never materialized:
+//   Q [batch, heads, queries, depth], K [batch, heads, keys, depth],
+//   V [batch, heads, keys, value_depth] and the output
+//   [batch, heads, queries, value_depth].
+// Rank 3 tensors are of a single head. With seq_first, the rank 4 tensors
+// are [batch, seq, heads, depth] instead, the transposes to and from the
+// heads folded. With transpose_k, K is given as [..., depth, keys]. The
+// optional additive mask broadcasts to the [batch, heads, queries, keys]
+// scores.
+class AttentionOpBase : public Operation {
+ public:
+  explicit AttentionOpBase(OpConstructContext *context)
+      : Operation(context),
+        scale_(Operation::GetOptionalArg<float>("scale", 1.0f)),
+        seq_first_(Operation::GetOptionalArg<int>("seq_first", 0) == 1),
+        transpose_k_(Operation::GetOptionalArg<int>("transpose_k", 0) == 1) {}
+
+ protected:
+  // the dims of the tensors of the heads of the op
+  struct Dims {
+    index_t batch;
+    index_t heads;
+    index_t queries;
+    index_t keys;
+    index_t depth;
+    index_t value_depth;
+  };
+
+  MaceStatus Validate(Dims *dims) {
+    const Tensor *q = this->Input(QUERY);
+    const Tensor *k = this->Input(KEY);
+    const Tensor *v = this->Input(VALUE);
+    const index_t rank = q->dim_size();
+    MACE_CHECK((rank == 3 || rank == 4) && k->dim_size() == rank &&
+                   v->dim_size() == rank,
+               "Attention takes Q, K and V of the same rank 3 or 4, got ",
+               MakeString(q->shape()), ", ", MakeString(k->shape()), " and ",
+               MakeString(v->shape()));
+    MACE_CHECK(rank == 4 || !seq_first_, "seq_first needs rank 4 tensors");
+    // the index of the seq dim, the heads are at 1 or 2 of rank 4
+    const index_t seq = seq_first_ ? 1 : rank - 2;
+    dims->batch = q->dim(0);
+    dims->heads = rank == 3 ? 1 : q->dim(seq_first_ ? 2 : 1);
+    dims->queries = q->dim(seq);
+    dims->depth = q->dim(rank - 1);
+    dims->keys = transpose_k_ ? k->dim(rank - 1) : k->dim(seq);
+    dims->value_depth = v->dim(rank - 1);
+    const index_t k_depth = transpose_k_ ? k->dim(seq) : k->dim(rank - 1);
+    const index_t k_heads = rank == 3 ? 1 : k->dim(seq_first_ ? 2 : 1);
+    const index_t v_heads = rank == 3 ? 1 : v->dim(seq_first_ ? 2 : 1);
+    MACE_CHECK(k->dim(0) == dims->batch && v->dim(0) == dims->batch &&
+                   k_heads == dims->heads && v_heads == dims->heads &&
+                   k_depth == dims->depth && v->dim(seq) == dims->keys,
+               "the shapes of Q ", MakeString(q->shape()), ", K ",
+               MakeString(k->shape()), " and V ", MakeString(v->shape()),
+               " of Attention do not match");
+    if (this->InputSize() > MASK) {
+      const Tensor *mask = this->Input(MASK);
+      const std::vector<index_t> scores = {dims->batch, dims->heads,
+                                           dims->queries, dims->keys};
+      MACE_CHECK(mask->dim_size() <= 4,
+                 "the mask of Attention has rank <= 4");
+      for (int i = 0; i < mask->dim_size(); ++i) {
+        const index_t dim = mask->dim(mask->dim_size() - 1 - i);
+        MACE_CHECK(dim == 1 || dim == scores[3 - i], "mask ",
+                   MakeString(mask->shape()), " does not broadcast to ",
+                   MakeString(scores));
+      }
+    }
+    return MaceStatus::MACE_SUCCESS;
+  }
+
+  std::vector<index_t> OutputShape(const Dims &dims) {
+    std::vector<index_t> shape = this->Input(QUERY)->shape();
+    shape.back() = dims.value_depth;
+    return shape;
+  }
+
+  const float scale_;
+  const bool seq_first_;
+  const bool transpose_k_;
+
+  MACE_OP_INPUT_TAGS(QUERY, KEY, VALUE, MASK);
+  MACE_OP_OUTPUT_TAGS(OUTPUT);
+};
+
+template <DeviceType D, class T>
+class AttentionOp;
+
+template <>
+class AttentionOp<DeviceType::CPU, float> : public AttentionOpBase {
+ public:
+  explicit AttentionOp(OpConstructContext *context)
+      : AttentionOpBase(context) {}
+
+  MaceStatus Run(OpContext *context) override {
+    MACE_UNUSED(context);
+    Dims dims;
+    MACE_RETURN_IF_ERROR(Validate(&dims));
+    const Tensor *q = this->Input(QUERY);
+    const Tensor *k = this->Input(KEY);
+    const Tensor *v = this->Input(VALUE);
+    const Tensor *mask = this->InputSize() > MASK ? this->Input(MASK)
+                                                  : nullptr;
+    Tensor *output = this->Output(OUTPUT);
+    MACE_RETURN_IF_ERROR(output->Resize(OutputShape(dims)));
+
+    Tensor::MappingGuard q_guard(q);
+    Tensor::MappingGuard k_guard(k);
+    Tensor::MappingGuard v_guard(v);
+    Tensor::MappingGuard mask_guard(mask);
+    Tensor::MappingGuard output_guard(output);
+    Layout layout = MakeLayout(dims, mask);
+    const float *q_data = q->data<float>();
+    const float *k_data = k->data<float>();
+    const float *v_data = v->data<float>();
+    const float *mask_data = mask == nullptr ? nullptr : mask->data<float>();
+    float *output_data = output->mutable_data<float>();
+
+    const index_t query_tiles = RoundUpDiv(dims.queries, kQueryTile);
+#pragma omp parallel
+    {
+      // the scores of a block of keys and the running sums of the values
+      std::vector<float> scores(kQueryTile * kKeyBlock);
+      std::vector<float> sums(kQueryTile * dims.value_depth);
+      // the keys of a block packed to rows of depth for transpose_k
+      std::vector<float> packed_keys(transpose_k_ ? kKeyBlock * dims.depth
+                                                  : 0);
+#pragma omp for collapse(2) schedule(runtime)
+      for (index_t bh = 0; bh < dims.batch * dims.heads; ++bh) {
+        for (index_t tile = 0; tile < query_tiles; ++tile) {
+          const index_t b = bh / dims.heads;
+          const index_t h = bh % dims.heads;
+          const index_t query = tile * kQueryTile;
+          const index_t rows = std::min(kQueryTile, dims.queries - query);
+          AttendTile(dims, layout, b, h, query, rows, q_data, k_data, v_data,
+                     mask_data, scores.data(), sums.data(),
+                     packed_keys.data(), output_data);
+        }
+      }
+    }
+    return MaceStatus::MACE_SUCCESS;
+  }
+
+ private:
+  // the query rows sharing the reads of the keys and values
+  static constexpr index_t kQueryTile = 4;
+  // the keys of a step of the online softmax
+  static constexpr index_t kKeyBlock = 64;
+
+  // the strides of the [batch, heads, seq, depth] of Q, K, V and the output,
+  // and of the [batch, heads, queries, keys] of the mask, 0 if broadcast
+  struct Strides {
+    index_t batch;
+    index_t head;
+    index_t seq;
+    index_t depth;
+  };
+
+  struct Layout {
+    Strides q;
+    Strides k;
+    Strides v;
+    Strides output;
+    Strides mask;
+  };
+
+  Strides MakeStrides(const Dims &dims, const index_t seq,
+                      const index_t depth) const {
+    Strides strides;
+    strides.depth = 1;
+    if (seq_first_) {
+      strides.head = depth;
+      strides.seq = dims.heads * depth;
+    } else {
+      strides.seq = depth;
+      strides.head = seq * depth;
+    }
+    strides.batch = dims.heads * seq * depth;
+    return strides;
+  }
+
+  Layout MakeLayout(const Dims &dims, const Tensor *mask) const {
+    Layout layout;
+    layout.q = MakeStrides(dims, dims.queries, dims.depth);
+    layout.k = MakeStrides(dims, dims.keys, dims.depth);
+    if (transpose_k_) {
+      // [..., depth, keys], the depth is where the seq is
+      std::swap(layout.k.seq, layout.k.depth);
+      if (seq_first_) {
+        layout.k.head = dims.keys;
+        layout.k.depth = dims.heads * dims.keys;
+      } else {
+        layout.k.depth = dims.keys;
+      }
+    }
+    layout.v = MakeStrides(dims, dims.keys, dims.value_depth);
+    layout.output = MakeStrides(dims, dims.queries, dims.value_depth);
+    layout.mask = {0, 0, 0, 0};
+    if (mask != nullptr) {
+      const index_t scores[4] = {dims.batch, dims.heads, dims.queries,
+                                 dims.keys};
+      index_t *strides[4] = {&layout.mask.batch, &layout.mask.head,
+                             &layout.mask.seq, &layout.mask.depth};
+      index_t stride = 1;
+      for (int i = 0; i < mask->dim_size(); ++i) {
+        const index_t dim = mask->dim(mask->dim_size() - 1 - i);
+        *strides[3 - i] = dim == scores[3 - i] && dim != 1 ? stride : 0;
+        stride *= dim;
+      }
+    }
+    return layout;
+  }
+
+  void AttendTile(const Dims &dims, const Layout &layout,
+                  const index_t b, const index_t h,
+                  const index_t query, const index_t rows,
+                  const float *q_data, const float *k_data,
+                  const float *v_data, const float *mask_data,
+                  float *scores, float *sums, float *packed_keys,
+                  float *output_data) const {
+    const float *q_rows[kQueryTile];
+    float max_scores[kQueryTile];
+    float exp_sums[kQueryTile];
+    for (index_t r = 0; r < rows; ++r) {
+      q_rows[r] = q_data + b * layout.q.batch + h * layout.q.head
+          + (query + r) * layout.q.seq;
+      max_scores[r] = std::numeric_limits<float>::lowest();
+      exp_sums[r] = 0.f;
+    }
+    std::fill(sums, sums + rows * dims.value_depth, 0.f);
+    const float *k_head = k_data + b * layout.k.batch + h * layout.k.head;
+    const float *v_head = v_data + b * layout.v.batch + h * layout.v.head;
+
+    for (index_t key = 0; key < dims.keys; key += kKeyBlock) {
+      const index_t block = std::min(kKeyBlock, dims.keys - key);
+      // the keys as rows of depth
+      const float *keys = k_head + key * layout.k.seq;
+      index_t key_stride = layout.k.seq;
+      if (transpose_k_) {
+        for (index_t d = 0; d < dims.depth; ++d) {
+          const float *k_row = k_head + d * layout.k.depth + key;
+          for (index_t j = 0; j < block; ++j) {
+            packed_keys[j * dims.depth + d] = k_row[j];
+          }
+        }
+        keys = packed_keys;
+        key_stride = dims.depth;
+      }
+
+      for (index_t r = 0; r < rows; ++r) {
+        float *row_scores = scores + r * kKeyBlock;
+        const float *mask_row = mask_data == nullptr ? nullptr :
+            mask_data + b * layout.mask.batch + h * layout.mask.head
+                + (query + r) * layout.mask.seq + key * layout.mask.depth;
+        float block_max = std::numeric_limits<float>::lowest();
+        for (index_t j = 0; j < block; ++j) {
+          float score =
+              Dot(q_rows[r], keys + j * key_stride, dims.depth) * scale_;
+          if (mask_row != nullptr) {
+            score += mask_row[j * layout.mask.depth];
+          }
+          row_scores[j] = score;
+          block_max = std::max(block_max, score);
+        }
+
+        // rescale the sums of the former blocks to the new max
+        const float max_score = std::max(max_scores[r], block_max);
+        const float correction = std::exp(max_scores[r] - max_score);
+        max_scores[r] = max_score;
+        float *row_sums = sums + r * dims.value_depth;
+        if (correction != 1.f) {
+          exp_sums[r] *= correction;
+          Scale(correction, dims.value_depth, row_sums);
+        }
+        for (index_t j = 0; j < block; ++j) {
+          const float p = std::exp(row_scores[j] - max_score);
+          exp_sums[r] += p;
+          ScaleAdd(p, v_head + (key + j) * layout.v.seq, dims.value_depth,
+                   row_sums);
+        }
+      }
+    }
+
+    for (index_t r = 0; r < rows; ++r) {
+      float *out = output_data + b * layout.output.batch
+          + h * layout.output.head + (query + r) * layout.output.seq;
+      const float *row_sums = sums + r * dims.value_depth;
+      const float inverse = exp_sums[r] > 0.f ? 1.f / exp_sums[r] : 0.f;
+      for (index_t d = 0; d < dims.value_depth; ++d) {
+        out[d] = row_sums[d] * inverse;
+      }
+    }
+  }
+
+  static float Dot(const float *a, const float *b, const index_t size) {
+    index_t i = 0;
+    float sum = 0.f;
+#if defined(MACE_ENABLE_NEON)
+    float32x4_t vsum = vdupq_n_f32(0.f);
+    for (; i + 4 <= size; i += 4) {
+      vsum = vmlaq_f32(vsum, vld1q_f32(a + i), vld1q_f32(b + i));
+    }
+    sum = vgetq_lane_f32(vsum, 0) + vgetq_lane_f32(vsum, 1)
+        + vgetq_lane_f32(vsum, 2) + vgetq_lane_f32(vsum, 3);
+#endif
+    for (; i < size; ++i) {
+      sum += a[i] * b[i];
+    }
+    return sum;
+  }
+
+  static void Scale(const float scale, const index_t size, float *out) {
+    index_t i = 0;
+#if defined(MACE_ENABLE_NEON)
+    for (; i + 4 <= size; i += 4) {
+      vst1q_f32(out + i, vmulq_n_f32(vld1q_f32(out + i), scale));
+    }
+#endif
+    for (; i < size; ++i) {
+      out[i] *= scale;
+    }
+  }
+
+  static void ScaleAdd(const float scale, const float *in,
+                       const index_t size, float *out) {
+    index_t i = 0;
+#if defined(MACE_ENABLE_NEON)
+    for (; i + 4 <= size; i += 4) {
+      vst1q_f32(out + i,
+                vmlaq_n_f32(vld1q_f32(out + i), vld1q_f32(in + i), scale));
+    }
+#endif
+    for (; i < size; ++i) {
+      out[i] += scale * in[i];
+    }
+  }
+};
+
+#ifdef MACE_ENABLE_OPENCL
+template <typename T>
+class AttentionOp<DeviceType::GPU, T> : public AttentionOpBase {
+ public:
+  explicit AttentionOp(OpConstructContext *context)
+      : AttentionOpBase(context) {
+    if (context->device()->gpu_runtime()->UseImageMemory()) {
+      kernel_ = make_unique<opencl::image::AttentionKernel<T>>();
+    } else {
+      MACE_NOT_IMPLEMENTED;
+    }
+  }
+
+  MaceStatus Run(OpContext *context) override {
+    Dims dims;
+    MACE_RETURN_IF_ERROR(Validate(&dims));
+    MACE_CHECK(this->Input(QUERY)->dim_size() == 4 && !transpose_k_,
+               "GPU Attention takes rank 4 tensors and untransposed keys");
+    const Tensor *mask = this->InputSize() > MASK ? this->Input(MASK)
+                                                  : nullptr;
+    return kernel_->Compute(context, this->Input(QUERY), this->Input(KEY),
+                            this->Input(VALUE), mask, scale_, seq_first_,
+                            OutputShape(dims), this->Output(OUTPUT));
+  }
+
+ private:
+  std::unique_ptr<OpenCLAttentionKernel> kernel_;
+};
+#endif  // MACE_ENABLE_OPENCL
+
+void RegisterAttention(OpRegistryBase *op_registry) {
+  MACE_REGISTER_OP(op_registry, "Attention", AttentionOp,
+                   DeviceType::CPU, float);
+
+#ifdef MACE_ENABLE_OPENCL
+  MACE_REGISTER_OP(op_registry, "Attention", AttentionOp,
+                   DeviceType::GPU, float);
+
+  MACE_REGISTER_OP(op_registry, "Attention", AttentionOp,
+                   DeviceType::GPU, half);
+#endif  // MACE_ENABLE_OPENCL
+
+  MACE_REGISTER_OP_CONDITION(
+      op_registry,
+      OpConditionBuilder("Attention")
+          .SetDevicePlacerFunc(
+              [](OpConstructContext *context) -> std::set<DeviceType> {
+                // the GPU kernel reads rank 4 images of keys of depth, and a
+                // mask of all the keys
+                auto op = context->operator_def();
+                if (op->output_shape_size() != op->output_size() ||
+                    op->output_shape(0).dims_size() != 4 ||
+                    ProtoArgHelper::GetOptionalArg<OperatorDef, int>(
+                        *op, "transpose_k", 0) == 1) {
+                  return { DeviceType::CPU };
+                }
+                return { DeviceType::CPU, DeviceType::GPU };
+              }));
+}
+
+}  // namespace ops
+}  // namespace mace
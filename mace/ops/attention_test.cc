@@ -0,0 +1,215 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "mace/ops/ops_test_util.h"
+
+namespace mace {
+namespace ops {
+namespace test {
+
+class AttentionOpTest : public OpsTestBase {};
+
+namespace {
+// the [batch, heads, seq, depth] index of a rank 4 tensor of the op
+index_t Offset(const std::vector<index_t> &shape, const bool seq_first,
+               const index_t b, const index_t h, const index_t s,
+               const index_t d) {
+  if (seq_first) {
+    return ((b * shape[1] + s) * shape[2] + h) * shape[3] + d;
+  }
+  return ((b * shape[1] + h) * shape[2] + s) * shape[3] + d;
+}
+
+// softmax(Q K^T * scale + mask) V of the whole score rows
+std::vector<float> NaiveAttention(const Tensor &query, const Tensor &key,
+                                  const Tensor &value, const Tensor *mask,
+                                  const float scale, const bool seq_first,
+                                  const bool transpose_k) {
+  const std::vector<index_t> &q_shape = query.shape();
+  const std::vector<index_t> &k_shape = key.shape();
+  const std::vector<index_t> &v_shape = value.shape();
+  const index_t batch = q_shape[0];
+  const index_t heads = q_shape[seq_first ? 2 : 1];
+  const index_t queries = q_shape[seq_first ? 1 : 2];
+  const index_t depth = q_shape[3];
+  const index_t keys = v_shape[seq_first ? 1 : 2];
+  const index_t value_depth = v_shape[3];
+  Tensor::MappingGuard q_guard(&query);
+  Tensor::MappingGuard k_guard(&key);
+  Tensor::MappingGuard v_guard(&value);
+  Tensor::MappingGuard mask_guard(mask);
+  const float *q = query.data<float>();
+  const float *k = key.data<float>();
+  const float *v = value.data<float>();
+
+  std::vector<index_t> out_shape = q_shape;
+  out_shape[3] = value_depth;
+  std::vector<float> output(batch * heads * queries * value_depth);
+  std::vector<float> scores(keys);
+  for (index_t b = 0; b < batch; ++b) {
+    for (index_t h = 0; h < heads; ++h) {
+      for (index_t i = 0; i < queries; ++i) {
+        float max_score = -INFINITY;
+        for (index_t j = 0; j < keys; ++j) {
+          float score = 0;
+          for (index_t d = 0; d < depth; ++d) {
+            const index_t k_offset =
+                transpose_k ? Offset(k_shape, seq_first, b, h, d, j)
+                            : Offset(k_shape, seq_first, b, h, j, d);
+            score += q[Offset(q_shape, seq_first, b, h, i, d)] * k[k_offset];
+          }
+          score *= scale;
+          if (mask != nullptr) {
+            const std::vector<index_t> &m_shape = mask->shape();
+            const index_t m_offset =
+                (((b % m_shape[0]) * m_shape[1] + h % m_shape[1]) *
+                     m_shape[2] + i % m_shape[2]) * m_shape[3] +
+                j % m_shape[3];
+            score += mask->data<float>()[m_offset];
+          }
+          scores[j] = score;
+          max_score = std::max(max_score, score);
+        }
+        float sum = 0;
+        for (index_t j = 0; j < keys; ++j) {
+          scores[j] = std::exp(scores[j] - max_score);
+          sum += scores[j];
+        }
+        for (index_t d = 0; d < value_depth; ++d) {
+          float out = 0;
+          for (index_t j = 0; j < keys; ++j) {
+            out += scores[j] * v[Offset(v_shape, seq_first, b, h, j, d)];
+          }
+          output[Offset(out_shape, seq_first, b, h, i, d)] = out / sum;
+        }
+      }
+    }
+  }
+  return output;
+}
+
+template <DeviceType D, typename T>
+void AttentionTest(const index_t batch, const index_t heads,
+                   const index_t queries, const index_t keys,
+                   const index_t depth, const index_t value_depth,
+                   const bool seq_first, const bool transpose_k,
+                   const std::vector<index_t> &mask_shape) {
+  OpsTestNet net;
+
+  auto shape = [&](const index_t seq, const index_t dim) {
+    return seq_first ? std::vector<index_t>{batch, seq, heads, dim}
+                     : std::vector<index_t>{batch, heads, seq, dim};
+  };
+  std::vector<index_t> key_shape = shape(keys, depth);
+  if (transpose_k) {
+    key_shape = seq_first ? std::vector<index_t>{batch, depth, heads, keys}
+                          : std::vector<index_t>{batch, heads, depth, keys};
+  }
+  net.AddRandomInput<D, float>("Query", shape(queries, depth), false, false);
+  net.AddRandomInput<D, float>("Key", key_shape, false, false);
+  net.AddRandomInput<D, float>("Value", shape(keys, value_depth), false,
+                               false);
+  const bool use_mask = !mask_shape.empty();
+  if (use_mask) {
+    net.AddRandomInput<D, float>("Mask", mask_shape, false, false);
+  }
+  const float scale = 1.f / std::sqrt(static_cast<float>(depth));
+
+  auto builder = OpDefBuilder("Attention", "AttentionTest")
+      .Input("Query")
+      .Input("Key")
+      .Input("Value");
+  if (use_mask) {
+    builder.Input("Mask");
+  }
+  builder.Output("Output")
+      .AddFloatArg("scale", scale)
+      .AddIntArg("seq_first", seq_first ? 1 : 0)
+      .AddIntArg("transpose_k", transpose_k ? 1 : 0)
+      .AddIntArg("T", static_cast<int>(DataTypeToEnum<T>::value))
+      .Finalize(net.NewOperatorDef());
+  net.RunOp(D);
+
+  std::vector<float> expected = NaiveAttention(
+      *net.GetTensor("Query"), *net.GetTensor("Key"),
+      *net.GetTensor("Value"), use_mask ? net.GetTensor("Mask") : nullptr,
+      scale, seq_first, transpose_k);
+  auto expected_tensor = net.CreateTensor<float>(
+      shape(queries, value_depth), expected);
+  if (DataTypeToEnum<T>::value == DT_FLOAT) {
+    ExpectTensorNear<float>(*expected_tensor, *net.GetOutput("Output"),
+                            1e-4, 1e-3);
+  } else {
+    ExpectTensorNear<float>(*expected_tensor, *net.GetOutput("Output"),
+                            1e-2, 1e-2);
+  }
+}
+}  // namespace
+
+TEST_F(AttentionOpTest, CPUSimple) {
+  AttentionTest<DeviceType::CPU, float>(1, 1, 1, 3, 4, 4, false, false, {});
+  AttentionTest<DeviceType::CPU, float>(2, 3, 7, 9, 16, 8, false, false, {});
+}
+
+TEST_F(AttentionOpTest, CPUKeyBlocks) {
+  // the online softmax across several blocks of keys and tiles of queries
+  AttentionTest<DeviceType::CPU, float>(1, 2, 13, 200, 64, 64, false, false,
+                                        {});
+  AttentionTest<DeviceType::CPU, float>(2, 4, 5, 129, 33, 17, false, false,
+                                        {});
+}
+
+TEST_F(AttentionOpTest, CPUSeqFirst) {
+  AttentionTest<DeviceType::CPU, float>(2, 3, 7, 70, 16, 8, true, false, {});
+}
+
+TEST_F(AttentionOpTest, CPUTransposeK) {
+  AttentionTest<DeviceType::CPU, float>(2, 3, 7, 70, 16, 8, false, true, {});
+  AttentionTest<DeviceType::CPU, float>(2, 3, 7, 70, 16, 8, true, true, {});
+}
+
+TEST_F(AttentionOpTest, CPUMask) {
+  AttentionTest<DeviceType::CPU, float>(2, 3, 7, 70, 16, 8, false, false,
+                                        {2, 3, 7, 70});
+  AttentionTest<DeviceType::CPU, float>(2, 3, 7, 70, 16, 8, false, false,
+                                        {2, 1, 1, 70});
+  AttentionTest<DeviceType::CPU, float>(2, 3, 7, 70, 16, 8, true, false,
+                                        {1, 1, 7, 70});
+}
+
+TEST_F(AttentionOpTest, GPUFloat) {
+  AttentionTest<DeviceType::GPU, float>(1, 1, 1, 3, 4, 4, false, false, {});
+  AttentionTest<DeviceType::GPU, float>(2, 4, 5, 129, 33, 17, false, false,
+                                        {});
+  AttentionTest<DeviceType::GPU, float>(2, 3, 7, 70, 16, 8, true, false, {});
+  AttentionTest<DeviceType::GPU, float>(2, 3, 7, 70, 16, 8, false, false,
+                                        {2, 1, 1, 70});
+  AttentionTest<DeviceType::GPU, float>(2, 3, 7, 70, 16, 8, true, false,
+                                        {1, 1, 7, 70});
+}
+
+TEST_F(AttentionOpTest, GPUHalf) {
+  AttentionTest<DeviceType::GPU, half>(2, 4, 5, 129, 32, 16, false, false,
+                                       {});
+  AttentionTest<DeviceType::GPU, half>(2, 3, 7, 70, 16, 8, true, false,
+                                       {2, 3, 7, 70});
+}
+
+}  // namespace test
+}  // namespace ops
+}  // namespace mace
@@ -20,6 +20,7 @@
 #include "mace/ops/activation.h"
 #ifdef MACE_ENABLE_OPENCL
 #include "mace/ops/opencl/buffer_transformer.h"
+#include "mace/ops/opencl/buffer/batch_norm.h"
 #include "mace/ops/opencl/image/batch_norm.h"
 #endif  // MACE_ENABLE_OPENCL
 #include "mace/utils/memory.h"
@@ -129,6 +130,8 @@ class BatchNormOp<DeviceType::CPU, float> : public Operation {
     return MaceStatus::MACE_SUCCESS;
   }
 
+  int InplaceInputIndex() const override { return INPUT; }
+
  private:
   float epsilon_;
   const ActivationType activation_;
@@ -160,7 +163,10 @@ class BatchNormOp<DeviceType::GPU, T> : public Operation {
       kernel_ = make_unique<opencl::image::BatchNormKernel<T>>(
           epsilon, activation, relux_max_limit, leakyrelu_coefficient);
     } else {
-      MACE_NOT_IMPLEMENTED;
+      mem_type = MemoryType::GPU_BUFFER;
+      context->set_output_mem_type(mem_type);
+      kernel_ = make_unique<opencl::buffer::BatchNormKernel<T>>(
+          epsilon, activation, relux_max_limit, leakyrelu_coefficient);
     }
     // Transform filters
     int input_size = operator_def_->input_size();
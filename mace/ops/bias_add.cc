@@ -89,6 +89,8 @@ class BiasAddOp<DeviceType::CPU, float> : public Operation {
     return MaceStatus::MACE_SUCCESS;
   }
 
+  int InplaceInputIndex() const override { return 0; }
+
  private:
   DataFormat data_format_;
 };
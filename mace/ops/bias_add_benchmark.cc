@@ -65,6 +65,7 @@ void BiasAdd(int iters, int batch, int channels, int height, int width) {
   static void MACE_BM_BIAS_ADD_##N##_##C##_##H##_##W##_##TYPE##_##DEVICE( \
       int iters) {                                                        \
     const int64_t tot = static_cast<int64_t>(iters) * N * C * H * W;      \
+    mace::testing::MacsProcessed(tot);                                    \
     mace::testing::BytesProcessed(tot *(sizeof(TYPE)));                   \
     BiasAdd<DEVICE, TYPE>(iters, N, C, H, W);                             \
   }                                                                       \
@@ -44,6 +44,8 @@ class BufferTransformOp<DeviceType::GPU, T> : public Operation {
 
     MemoryType in_mem_type = context->workspace()->GetTensor(
         operator_def_->input(0))->memory_type();
+    output->SetScale(input->scale());
+    output->SetZeroPoint(input->zero_point());
     return OpenCLBufferTransformer<T>(in_mem_type, out_mem_type_).Transform(
         context, input, type, out_mem_type_, wino_blk_size_,
         data_format, output);
@@ -61,6 +63,11 @@ void RegisterBufferTransform(OpRegistryBase *op_registry) {
 
   MACE_REGISTER_OP(op_registry, "BufferTransform",
                    BufferTransformOp, DeviceType::GPU, half);
+
+#ifdef MACE_ENABLE_QUANTIZE
+  MACE_REGISTER_OP(op_registry, "BufferTransform",
+                   BufferTransformOp, DeviceType::GPU, uint8_t);
+#endif  // MACE_ENABLE_QUANTIZE
 }
 
 }  // namespace ops
@@ -55,6 +55,10 @@ void RegisterCast(OpRegistryBase *op_registry) {
                    DeviceType::CPU, float);
   MACE_REGISTER_OP(op_registry, "Cast", CastOp,
                    DeviceType::CPU, int32_t);
+#ifdef MACE_ENABLE_FP16_NEON
+  MACE_REGISTER_OP(op_registry, "Cast", CastOp,
+                   DeviceType::CPU, half);
+#endif  // MACE_ENABLE_FP16_NEON
 }
 
 }  // namespace ops
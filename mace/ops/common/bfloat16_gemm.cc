@@ -0,0 +1,221 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/ops/common/bfloat16_gemm.h"
+
+#include "mace/core/macros.h"
+#include "mace/core/runtime/cpu/cpu_runtime.h"
+#include "mace/utils/utils.h"
+
+namespace mace {
+namespace ops {
+
+namespace {
+
+// the depth values of a row in each operand of BFMMLA
+constexpr index_t kDepthBlock = 4;
+// the rows, and the columns, of the 4x4 block of 2x2 BFMMLA blocks
+constexpr index_t kBlockSize = 4;
+
+// The rows r of a [count, depth] matrix, whose value (r, k) is
+// src[r * stride + k * depth_stride], in pairs 2p and 2p + 1 of the blocks of
+// kDepthBlock depth values: [(2p, k..k+3), (2p + 1, k..k+3)] for each k of
+// the padded depth. The rows up to padded_count are zeros.
+template <typename T>
+void PackPairs(const T *src,
+               const index_t count,
+               const index_t padded_count,
+               const index_t depth,
+               const index_t stride,
+               const index_t depth_stride,
+               const index_t depth_padded,
+               BFloat16 *packed) {
+  for (index_t p = 0; p < padded_count / 2; ++p) {
+    BFloat16 *pair = packed + p * 2 * depth_padded;
+    for (index_t k0 = 0; k0 < depth_padded; k0 += kDepthBlock) {
+      for (index_t r = 2 * p; r < 2 * p + 2; ++r) {
+        for (index_t k = k0; k < k0 + kDepthBlock; ++k) {
+          const float value = r < count && k < depth ?
+              static_cast<float>(src[r * stride + k * depth_stride]) : 0.f;
+          *pair++ = BFloat16(value);
+        }
+      }
+    }
+  }
+}
+
+// The sums of the 4x4 block of the row pairs lhs0 and lhs1 by the column
+// pairs rhs0 and rhs1, over depth_blocks blocks of depth. The 2x2 sums of
+// the pairs (i, j) are at sums + (i * 2 + j) * 4, in the order of BFMMLA:
+// (2i, 2j), (2i, 2j + 1), (2i + 1, 2j) and (2i + 1, 2j + 1).
+void ComputeBlockScalar(const BFloat16 *lhs0,
+                        const BFloat16 *lhs1,
+                        const BFloat16 *rhs0,
+                        const BFloat16 *rhs1,
+                        const index_t depth_blocks,
+                        float *sums) {
+  const BFloat16 *lhs[2] = {lhs0, lhs1};
+  const BFloat16 *rhs[2] = {rhs0, rhs1};
+  for (int i = 0; i < 2; ++i) {
+    for (int j = 0; j < 2; ++j) {
+      for (int r = 0; r < 2; ++r) {
+        for (int c = 0; c < 2; ++c) {
+          float sum = 0;
+          for (index_t b = 0; b < depth_blocks; ++b) {
+            const BFloat16 *l = lhs[i] + (b * 2 + r) * kDepthBlock;
+            const BFloat16 *h = rhs[j] + (b * 2 + c) * kDepthBlock;
+            for (index_t k = 0; k < kDepthBlock; ++k) {
+              sum += static_cast<float>(l[k]) * static_cast<float>(h[k]);
+            }
+          }
+          sums[(i * 2 + j) * 4 + r * 2 + c] = sum;
+        }
+      }
+    }
+  }
+}
+
+#if defined(__aarch64__)
+// The block as ComputeBlockScalar with BFMMLA, encoded by hand for the
+// assemblers which do not know ARMv8.6, and only run on the cores which
+// report it, see CPUFeatures::bf16.
+void ComputeBlockBFMMLA(const BFloat16 *lhs0,
+                        const BFloat16 *lhs1,
+                        const BFloat16 *rhs0,
+                        const BFloat16 *rhs1,
+                        index_t depth_blocks,
+                        float *sums) {
+  asm volatile(
+      "movi v16.4s, #0                      \n"
+      "movi v17.4s, #0                      \n"
+      "movi v18.4s, #0                      \n"
+      "movi v19.4s, #0                      \n"
+
+      "0:                                   \n"
+      "ldr q0, [%[lhs0]], #16               \n"
+      "ldr q1, [%[lhs1]], #16               \n"
+      "ldr q2, [%[rhs0]], #16               \n"
+      "ldr q3, [%[rhs1]], #16               \n"
+      ".inst 0x6e42ec10                     \n"  // bfmmla v16, v0, v2
+      ".inst 0x6e43ec11                     \n"  // bfmmla v17, v0, v3
+      ".inst 0x6e42ec32                     \n"  // bfmmla v18, v1, v2
+      ".inst 0x6e43ec33                     \n"  // bfmmla v19, v1, v3
+      "subs %[depth_blocks], %[depth_blocks], #1 \n"
+      "bne 0b                               \n"
+
+      "st1 {v16.4s, v17.4s, v18.4s, v19.4s}, [%[sums]] \n"
+      : [lhs0] "+r"(lhs0),
+        [lhs1] "+r"(lhs1),
+        [rhs0] "+r"(rhs0),
+        [rhs1] "+r"(rhs1),
+        [depth_blocks] "+r"(depth_blocks)
+      : [sums] "r"(sums)
+      : "cc", "memory", "v0", "v1", "v2", "v3", "v16", "v17", "v18", "v19");
+}
+#endif  // __aarch64__
+
+}  // namespace
+
+bool HasBFloat16Kernel() {
+#if defined(__aarch64__)
+  return GetCPUFeatures().bf16;
+#else
+  return false;
+#endif
+}
+
+const BFloat16 *BFloat16Gemm::PackWeight(PackedWeights *packed_weights,
+                                         const Tensor *weight,
+                                         const index_t rows,
+                                         const index_t depth) {
+  MACE_CHECK(weight->dtype() == DT_BFLOAT16 &&
+                 weight->size() == rows * depth,
+             "the bfloat16 weight should be of ", rows, "x", depth);
+  const index_t padded_rows = RoundUp<index_t>(rows, kBlockSize);
+  const index_t depth_padded = RoundUp<index_t>(depth, kDepthBlock);
+  // the store keeps floats, two bfloat16 values each
+  const float *packed = packed_weights->GetOrPack(
+      "bf16_gemm_pairs", weight, padded_rows * depth_padded / 2,
+      [&](float *packed_weight) {
+        Tensor::MappingGuard weight_guard(weight);
+        PackPairs(weight->data<BFloat16>(), rows, padded_rows, depth, depth,
+                  1, depth_padded,
+                  reinterpret_cast<BFloat16 *>(packed_weight));
+      });
+  return reinterpret_cast<const BFloat16 *>(packed);
+}
+
+void BFloat16Gemm::Compute(const BFloat16 *packed_weight,
+                           const float *input,
+                           const index_t input_col_stride,
+                           const index_t input_depth_stride,
+                           const float *bias,
+                           const index_t rows,
+                           const index_t cols,
+                           const index_t depth,
+                           const index_t output_row_stride,
+                           const index_t output_col_stride,
+                           float *output) {
+  const index_t depth_padded = RoundUp<index_t>(depth, kDepthBlock);
+  const index_t depth_blocks = depth_padded / kDepthBlock;
+  const index_t padded_cols = RoundUp<index_t>(cols, kBlockSize);
+  packed_input_.resize(padded_cols * depth_padded);
+  BFloat16 *packed_input = packed_input_.data();
+  PackPairs(input, cols, padded_cols, depth, input_col_stride,
+            input_depth_stride, depth_padded, packed_input);
+
+  const bool use_bfmmla = HasBFloat16Kernel();
+  const index_t pair_size = 2 * depth_padded;
+  const index_t row_blocks = RoundUpDiv<index_t>(rows, kBlockSize);
+  const index_t col_blocks = padded_cols / kBlockSize;
+#pragma omp parallel for collapse(2) schedule(runtime)
+  for (index_t rb = 0; rb < row_blocks; ++rb) {
+    for (index_t cb = 0; cb < col_blocks; ++cb) {
+      const BFloat16 *lhs = packed_weight + rb * 2 * pair_size;
+      const BFloat16 *rhs = packed_input + cb * 2 * pair_size;
+      float sums[kBlockSize * kBlockSize];
+#if defined(__aarch64__)
+      if (use_bfmmla) {
+        ComputeBlockBFMMLA(lhs, lhs + pair_size, rhs, rhs + pair_size,
+                           depth_blocks, sums);
+      } else {
+        ComputeBlockScalar(lhs, lhs + pair_size, rhs, rhs + pair_size,
+                           depth_blocks, sums);
+      }
+#else
+      MACE_UNUSED(use_bfmmla);
+      ComputeBlockScalar(lhs, lhs + pair_size, rhs, rhs + pair_size,
+                         depth_blocks, sums);
+#endif  // __aarch64__
+      const index_t r0 = rb * kBlockSize;
+      const index_t c0 = cb * kBlockSize;
+      const index_t block_rows =
+          rows - r0 < kBlockSize ? rows - r0 : kBlockSize;
+      const index_t block_cols =
+          cols - c0 < kBlockSize ? cols - c0 : kBlockSize;
+      for (index_t r = 0; r < block_rows; ++r) {
+        const float b = bias == nullptr ? 0.f : bias[r0 + r];
+        for (index_t c = 0; c < block_cols; ++c) {
+          const float sum =
+              sums[(r / 2 * 2 + c / 2) * 4 + r % 2 * 2 + c % 2];
+          output[(r0 + r) * output_row_stride +
+                 (c0 + c) * output_col_stride] = sum + b;
+        }
+      }
+    }
+  }
+}
+
+}  // namespace ops
+}  // namespace mace
@@ -0,0 +1,70 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_OPS_COMMON_BFLOAT16_GEMM_H_
+#define MACE_OPS_COMMON_BFLOAT16_GEMM_H_
+
+#include <vector>
+
+#include "mace/core/packed_weights.h"
+#include "mace/core/tensor.h"
+#include "mace/core/types.h"
+
+namespace mace {
+namespace ops {
+
+// Whether the BFMMLA kernel of ARMv8.6 runs on this CPU, otherwise
+// BFloat16Gemm sums the same bfloat16 products in scalar code.
+bool HasBFloat16Kernel();
+
+// The product of a bfloat16 weight by float activations, which are rounded
+// to bfloat16 as they are packed, summed in float. The rows of the weight
+// are packed once in pairs of 4 depth values, the layout of the operands of
+// BFMMLA, which multiplies a 2x4 block by a 4x2 block into a 2x2 block of
+// float sums. The depth and the rows and columns are padded with zeros.
+class BFloat16Gemm {
+ public:
+  BFloat16Gemm() = default;
+
+  // the [rows, depth] bfloat16 weight packed, kept in packed_weights
+  static const BFloat16 *PackWeight(PackedWeights *packed_weights,
+                                    const Tensor *weight,
+                                    const index_t rows,
+                                    const index_t depth);
+
+  // output(r, c) = bias[r] + sum of weight(r, k) * input(c, k) over the
+  // depth, where input(c, k) is input[c * input_col_stride +
+  // k * input_depth_stride] and output(r, c) is output[r * output_row_stride
+  // + c * output_col_stride]. bias may be nullptr.
+  void Compute(const BFloat16 *packed_weight,
+               const float *input,
+               const index_t input_col_stride,
+               const index_t input_depth_stride,
+               const float *bias,
+               const index_t rows,
+               const index_t cols,
+               const index_t depth,
+               const index_t output_row_stride,
+               const index_t output_col_stride,
+               float *output);
+
+ private:
+  // the columns of the input of a run packed as the weight
+  std::vector<BFloat16> packed_input_;
+};
+
+}  // namespace ops
+}  // namespace mace
+
+#endif  // MACE_OPS_COMMON_BFLOAT16_GEMM_H_
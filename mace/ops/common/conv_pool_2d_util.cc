@@ -384,7 +384,6 @@ MaceStatus ConstructNCHWInputWithSpecificPadding(const Tensor *input_tensor,
   std::vector<index_t> output_shape(
     {batch, channels, height + pad_height, width + pad_width});
   MACE_RETURN_IF_ERROR(output_tensor->Resize(output_shape));
-  output_tensor->Clear();
   Tensor::MappingGuard padded_output_mapper(output_tensor);
   float *output_data = output_tensor->mutable_data<float>();
 
@@ -395,16 +394,23 @@ MaceStatus ConstructNCHWInputWithSpecificPadding(const Tensor *input_tensor,
   const index_t in_batch_size = channels * in_image_size;
   const index_t out_batch_size = channels * out_image_size;
 
+  // only the borders are zeroed, the copy of the input writes the others
 #pragma omp parallel for collapse(2) schedule(runtime)
   for (int i = 0; i < batch; ++i) {
     for (int j = 0; j < channels; ++j) {
+      float *out_image = output_data + i * out_batch_size + j * out_image_size;
+      const float *in_image =
+          input + i * in_batch_size + j * in_image_size;
+      memset(out_image, 0, pad_top * output_width * sizeof(float));
       for (int k = 0; k < height; ++k) {
-        memcpy(output_data + i * out_batch_size + j * out_image_size
-                 + (pad_top + k) * output_width + pad_left,
-               input + i * in_batch_size + j * in_image_size + k * width,
+        float *out_row = out_image + (pad_top + k) * output_width;
+        memset(out_row, 0, pad_left * sizeof(float));
+        memcpy(out_row + pad_left, in_image + k * width,
                width * sizeof(float));
+        memset(out_row + pad_left + width, 0, pad_right * sizeof(float));
       }
-      // Skip the padded bottom in this channel and top in the next channel
+      memset(out_image + (pad_top + height) * output_width, 0,
+             pad_bottom * output_width * sizeof(float));
     }
   }
 
@@ -0,0 +1,255 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/ops/common/fft.h"
+
+#include <cmath>
+
+#if defined(MACE_ENABLE_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "mace/utils/logging.h"
+
+namespace mace {
+namespace ops {
+
+namespace {
+
+#if defined(MACE_ENABLE_NEON)
+// (a_re + i a_im) * (b_re + i b_im) of 4 values
+inline void ComplexMul(const float32x4_t a_re, const float32x4_t a_im,
+                       const float32x4_t b_re, const float32x4_t b_im,
+                       float32x4_t *re, float32x4_t *im) {
+  *re = vmlsq_f32(vmulq_f32(a_re, b_re), a_im, b_im);
+  *im = vmlaq_f32(vmulq_f32(a_re, b_im), a_im, b_re);
+}
+#endif  // MACE_ENABLE_NEON
+
+// x0 to x3 of the j of the sub-transforms of 4 * m values at re and im
+void Radix4(const index_t m,
+            const float *w_re,
+            const float *w_im,
+            float *re,
+            float *im) {
+  index_t j = 0;
+#if defined(MACE_ENABLE_NEON)
+  for (; j + 3 < m; j += 4) {
+    float *re0 = re + j, *re1 = re0 + m, *re2 = re1 + m, *re3 = re2 + m;
+    float *im0 = im + j, *im1 = im0 + m, *im2 = im1 + m, *im3 = im2 + m;
+    const float32x4_t x0_re = vld1q_f32(re0), x0_im = vld1q_f32(im0);
+    const float32x4_t x1_re = vld1q_f32(re1), x1_im = vld1q_f32(im1);
+    const float32x4_t x2_re = vld1q_f32(re2), x2_im = vld1q_f32(im2);
+    const float32x4_t x3_re = vld1q_f32(re3), x3_im = vld1q_f32(im3);
+    const float32x4_t a0_re = vaddq_f32(x0_re, x2_re);
+    const float32x4_t a0_im = vaddq_f32(x0_im, x2_im);
+    const float32x4_t a1_re = vsubq_f32(x0_re, x2_re);
+    const float32x4_t a1_im = vsubq_f32(x0_im, x2_im);
+    const float32x4_t a2_re = vaddq_f32(x1_re, x3_re);
+    const float32x4_t a2_im = vaddq_f32(x1_im, x3_im);
+    // -i (x1 - x3)
+    const float32x4_t a3_re = vsubq_f32(x1_im, x3_im);
+    const float32x4_t a3_im = vsubq_f32(x3_re, x1_re);
+    vst1q_f32(re0, vaddq_f32(a0_re, a2_re));
+    vst1q_f32(im0, vaddq_f32(a0_im, a2_im));
+    float32x4_t y_re, y_im;
+    ComplexMul(vaddq_f32(a1_re, a3_re), vaddq_f32(a1_im, a3_im),
+               vld1q_f32(w_re + j), vld1q_f32(w_im + j), &y_re, &y_im);
+    vst1q_f32(re1, y_re);
+    vst1q_f32(im1, y_im);
+    ComplexMul(vsubq_f32(a0_re, a2_re), vsubq_f32(a0_im, a2_im),
+               vld1q_f32(w_re + m + j), vld1q_f32(w_im + m + j),
+               &y_re, &y_im);
+    vst1q_f32(re2, y_re);
+    vst1q_f32(im2, y_im);
+    ComplexMul(vsubq_f32(a1_re, a3_re), vsubq_f32(a1_im, a3_im),
+               vld1q_f32(w_re + 2 * m + j), vld1q_f32(w_im + 2 * m + j),
+               &y_re, &y_im);
+    vst1q_f32(re3, y_re);
+    vst1q_f32(im3, y_im);
+  }
+#endif  // MACE_ENABLE_NEON
+  for (; j < m; ++j) {
+    float *re0 = re + j, *re1 = re0 + m, *re2 = re1 + m, *re3 = re2 + m;
+    float *im0 = im + j, *im1 = im0 + m, *im2 = im1 + m, *im3 = im2 + m;
+    const float a0_re = *re0 + *re2, a0_im = *im0 + *im2;
+    const float a1_re = *re0 - *re2, a1_im = *im0 - *im2;
+    const float a2_re = *re1 + *re3, a2_im = *im1 + *im3;
+    const float a3_re = *im1 - *im3, a3_im = *re3 - *re1;
+    *re0 = a0_re + a2_re;
+    *im0 = a0_im + a2_im;
+    float y_re = a1_re + a3_re, y_im = a1_im + a3_im;
+    float w_r = w_re[j], w_i = w_im[j];
+    *re1 = y_re * w_r - y_im * w_i;
+    *im1 = y_re * w_i + y_im * w_r;
+    y_re = a0_re - a2_re;
+    y_im = a0_im - a2_im;
+    w_r = w_re[m + j];
+    w_i = w_im[m + j];
+    *re2 = y_re * w_r - y_im * w_i;
+    *im2 = y_re * w_i + y_im * w_r;
+    y_re = a1_re - a3_re;
+    y_im = a1_im - a3_im;
+    w_r = w_re[2 * m + j];
+    w_i = w_im[2 * m + j];
+    *re3 = y_re * w_r - y_im * w_i;
+    *im3 = y_re * w_i + y_im * w_r;
+  }
+}
+
+void Radix2(const index_t m,
+            const float *w_re,
+            const float *w_im,
+            float *re,
+            float *im) {
+  index_t j = 0;
+#if defined(MACE_ENABLE_NEON)
+  for (; j + 3 < m; j += 4) {
+    const float32x4_t x0_re = vld1q_f32(re + j);
+    const float32x4_t x0_im = vld1q_f32(im + j);
+    const float32x4_t x1_re = vld1q_f32(re + m + j);
+    const float32x4_t x1_im = vld1q_f32(im + m + j);
+    vst1q_f32(re + j, vaddq_f32(x0_re, x1_re));
+    vst1q_f32(im + j, vaddq_f32(x0_im, x1_im));
+    float32x4_t y_re, y_im;
+    ComplexMul(vsubq_f32(x0_re, x1_re), vsubq_f32(x0_im, x1_im),
+               vld1q_f32(w_re + j), vld1q_f32(w_im + j), &y_re, &y_im);
+    vst1q_f32(re + m + j, y_re);
+    vst1q_f32(im + m + j, y_im);
+  }
+#endif  // MACE_ENABLE_NEON
+  for (; j < m; ++j) {
+    const float x0_re = re[j], x0_im = im[j];
+    const float x1_re = re[m + j], x1_im = im[m + j];
+    re[j] = x0_re + x1_re;
+    im[j] = x0_im + x1_im;
+    const float y_re = x0_re - x1_re, y_im = x0_im - x1_im;
+    re[m + j] = y_re * w_re[j] - y_im * w_im[j];
+    im[m + j] = y_re * w_im[j] + y_im * w_re[j];
+  }
+}
+
+}  // namespace
+
+RealFft::RealFft(const index_t length)
+    : length_(length), half_(length / 2) {
+  MACE_CHECK(length >= 2 && (length & (length - 1)) == 0,
+             "The FFT length should be a power of 2, not ", length);
+  index_t log2_half = 0;
+  while ((static_cast<index_t>(1) << log2_half) < half_) {
+    ++log2_half;
+  }
+  std::vector<int> radices;
+  if (log2_half % 2 == 1) {
+    radices.push_back(2);
+  }
+  for (index_t i = 0; i < log2_half / 2; ++i) {
+    radices.push_back(4);
+  }
+
+  index_t size = half_;
+  for (int radix : radices) {
+    Stage stage;
+    stage.radix = radix;
+    stage.span = size / radix;
+    stage.twiddle_re.resize((radix - 1) * stage.span);
+    stage.twiddle_im.resize((radix - 1) * stage.span);
+    for (int q = 1; q < radix; ++q) {
+      for (index_t j = 0; j < stage.span; ++j) {
+        const double angle = -2.0 * M_PI * q * j / size;
+        stage.twiddle_re[(q - 1) * stage.span + j] =
+            static_cast<float>(std::cos(angle));
+        stage.twiddle_im[(q - 1) * stage.span + j] =
+            static_cast<float>(std::sin(angle));
+      }
+    }
+    stages_.push_back(stage);
+    size = stage.span;
+  }
+
+  // the output q of the butterflies of a stage goes to the sub-transform q,
+  // which holds the bins q modulo the radix
+  bin_position_.resize(half_);
+  for (index_t position = 0; position < half_; ++position) {
+    index_t rest = position;
+    index_t span = half_;
+    index_t bin = 0;
+    index_t step = 1;
+    for (int radix : radices) {
+      span /= radix;
+      bin += rest / span * step;
+      rest %= span;
+      step *= radix;
+    }
+    bin_position_[bin] = position;
+  }
+
+  split_re_.resize(half_ + 1);
+  split_im_.resize(half_ + 1);
+  for (index_t k = 0; k <= half_; ++k) {
+    const double angle = -2.0 * M_PI * k / length_;
+    split_re_[k] = static_cast<float>(std::cos(angle));
+    split_im_[k] = static_cast<float>(std::sin(angle));
+  }
+}
+
+void RealFft::ComplexFft(float *re, float *im) const {
+  for (const Stage &stage : stages_) {
+    const index_t size = stage.span * stage.radix;
+    for (index_t begin = 0; begin < half_; begin += size) {
+      if (stage.radix == 4) {
+        Radix4(stage.span, stage.twiddle_re.data(), stage.twiddle_im.data(),
+               re + begin, im + begin);
+      } else {
+        Radix2(stage.span, stage.twiddle_re.data(), stage.twiddle_im.data(),
+               re + begin, im + begin);
+      }
+    }
+  }
+}
+
+void RealFft::Spectrum(const float *frame,
+                       const bool power,
+                       float *scratch,
+                       float *output) const {
+  // the even values are the real part and the odd ones the imaginary part
+  float *re = scratch;
+  float *im = scratch + half_;
+  for (index_t i = 0; i < half_; ++i) {
+    re[i] = frame[2 * i];
+    im[i] = frame[2 * i + 1];
+  }
+  ComplexFft(re, im);
+
+  // X(k) = E(k) + e^(-2 pi i k / length) O(k), of the FFTs of the even and
+  // the odd values E(k) = (Z(k) + Z*(half - k)) / 2 and
+  // O(k) = -i (Z(k) - Z*(half - k)) / 2
+  for (index_t k = 0; k <= half_; ++k) {
+    const index_t position = bin_position_[k % half_];
+    const index_t mirror = bin_position_[(half_ - k) % half_];
+    const float z_re = re[position], z_im = im[position];
+    const float m_re = re[mirror], m_im = im[mirror];
+    const float e_re = 0.5f * (z_re + m_re);
+    const float e_im = 0.5f * (z_im - m_im);
+    const float o_re = 0.5f * (z_im + m_im);
+    const float o_im = 0.5f * (m_re - z_re);
+    const float x_re = e_re + split_re_[k] * o_re - split_im_[k] * o_im;
+    const float x_im = e_im + split_re_[k] * o_im + split_im_[k] * o_re;
+    const float x_power = x_re * x_re + x_im * x_im;
+    output[k] = power ? x_power : std::sqrt(x_power);
+  }
+}
+
+}  // namespace ops
+}  // namespace mace
@@ -0,0 +1,73 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_OPS_COMMON_FFT_H_
+#define MACE_OPS_COMMON_FFT_H_
+
+#include <vector>
+
+#include "mace/core/types.h"
+
+namespace mace {
+namespace ops {
+
+// The FFT of real frames of a power of two length, by the complex FFT of
+// half of it: decimation in frequency stages of radix 4, after one of radix
+// 2 if the half is not a power of 4. The complex values are kept in separate
+// real and imaginary arrays, so that the butterflies of a stage run on 4 of
+// them at once with NEON.
+class RealFft {
+ public:
+  explicit RealFft(const index_t length);
+
+  index_t length() const { return length_; }
+  // the bins 0 to length / 2
+  index_t num_bins() const { return length_ / 2 + 1; }
+  // the floats of the scratch of a transform
+  index_t scratch_size() const { return 2 * half_; }
+
+  // The power of the bins of a frame of length values, or their magnitude
+  // if power is false. The frames of several threads take a scratch each.
+  void Spectrum(const float *frame,
+                const bool power,
+                float *scratch,
+                float *output) const;
+
+ private:
+  struct Stage {
+    int radix;
+    // the butterflies of a sub-transform
+    index_t span;
+    // the twiddles of its butterflies, of the outputs 1 to radix - 1
+    std::vector<float> twiddle_re;
+    std::vector<float> twiddle_im;
+  };
+
+  void ComplexFft(float *re, float *im) const;
+
+  const index_t length_;
+  const index_t half_;
+  std::vector<Stage> stages_;
+  // the position of each bin of the complex FFT after the stages
+  std::vector<index_t> bin_position_;
+  // e^(-2 pi i k / length) of the bins, which split the complex FFT into
+  // those of the even and the odd values
+  std::vector<float> split_re_;
+  std::vector<float> split_im_;
+};
+
+}  // namespace ops
+}  // namespace mace
+
+#endif  // MACE_OPS_COMMON_FFT_H_
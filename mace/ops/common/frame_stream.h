@@ -0,0 +1,111 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_OPS_COMMON_FRAME_STREAM_H_
+#define MACE_OPS_COMMON_FRAME_STREAM_H_
+
+#include <algorithm>
+#include <vector>
+
+#include "mace/core/types.h"
+#include "mace/utils/logging.h"
+
+namespace mace {
+namespace ops {
+
+// The frames of one stream fed chunk by chunk to a stateful Kaldi op.
+// Only the frames within the context of the next outputs are kept across
+// runs. The output of time t is emitted once the frame of t + right
+// context arrived, so the outputs lag the inputs by the right context and
+// the first chunk gives that many outputs less. Times before the start of
+// the stream are clamped to the first frame, as for a whole utterance.
+template <typename T>
+class FrameStream {
+ public:
+  FrameStream(const index_t left_context, const index_t right_context)
+      : left_context_(left_context), right_context_(right_context) {
+    Reset();
+  }
+
+  void Reset() {
+    history_.clear();
+    history_begin_ = 0;
+    chunk_ = nullptr;
+    frames_ = 0;
+    outputs_ = 0;
+    dim_ = 0;
+  }
+
+  // Add the frames of this run, they must stay alive until Commit.
+  void Feed(const T *chunk, const index_t count, const index_t dim) {
+    MACE_CHECK(frames_ == 0 || dim == dim_,
+               "Frame dim of the stream changed from ", dim_, " to ", dim,
+               ", reset the state first");
+    chunk_ = chunk;
+    dim_ = dim;
+    frames_ += count;
+  }
+
+  // time of the first output of this run
+  index_t output_begin() const { return outputs_; }
+
+  index_t output_count() const {
+    return std::max<index_t>(frames_ - right_context_ - outputs_, 0);
+  }
+
+  // the fed frame of a time, times before the stream are clamped
+  const T *Frame(const index_t time) const {
+    const index_t t = std::max<index_t>(time, 0);
+    const index_t chunk_begin = history_begin_ +
+        static_cast<index_t>(history_.size()) / std::max<index_t>(dim_, 1);
+    MACE_CHECK(t >= history_begin_ && t < frames_,
+               "Frame ", t, " is out of the stream context");
+    if (t >= chunk_begin) {
+      return chunk_ + (t - chunk_begin) * dim_;
+    }
+    return history_.data() + (t - history_begin_) * dim_;
+  }
+
+  // Emit the outputs of this run and keep the context of the next ones.
+  void Commit() {
+    outputs_ += output_count();
+    const index_t keep_begin = std::max<index_t>(outputs_ - left_context_, 0);
+    std::vector<T> history;
+    history.reserve((frames_ - keep_begin) * dim_);
+    for (index_t t = keep_begin; t < frames_; ++t) {
+      const T *frame = Frame(t);
+      history.insert(history.end(), frame, frame + dim_);
+    }
+    history_.swap(history);
+    history_begin_ = keep_begin;
+    chunk_ = nullptr;
+  }
+
+ private:
+  const index_t left_context_;
+  const index_t right_context_;
+  // frames of [history_begin_, the first frame of this run)
+  std::vector<T> history_;
+  index_t history_begin_;
+  const T *chunk_;
+  // frames fed and outputs emitted since the start of the stream
+  index_t frames_;
+  index_t outputs_;
+  index_t dim_;
+};
+
+}  // namespace ops
+}  // namespace mace
+
+#endif  // MACE_OPS_COMMON_FRAME_STREAM_H_
@@ -15,7 +15,9 @@
 #ifndef MACE_OPS_COMMON_GEMMLOWP_UTIL_H_
 #define MACE_OPS_COMMON_GEMMLOWP_UTIL_H_
 
+#include <algorithm>
 #include <tuple>
+#include <vector>
 
 #include "public/gemmlowp.h"
 #include "mace/core/types.h"
@@ -72,6 +74,44 @@ struct GemmlowpOutputPipeline {
     gemmlowp::OutputStageSaturatingCastToUint8 saturating_cast_stage;
     return std::make_tuple(quantize_down_stage, saturating_cast_stage);
   }
+
+  // gemmlowp has no per-channel fixed point stage at the pinned revision, so
+  // a lhs quantized per row is multiplied with this empty pipeline to int32
+  // and then requantized by RequantizePerChannel.
+  typedef std::tuple<> Int32Pipeline;
+
+  static Int32Pipeline MakeInt32() {
+    return std::make_tuple();
+  }
+
+  // output(r, c) of the column-major int32 input of rows x cols, plus bias(r),
+  // requantized with the scale of lhs row r
+  static void RequantizePerChannel(
+      const int32_t *input, const int32_t *bias_data, const index_t rows,
+      const index_t cols, const float lhs_scale,
+      const std::vector<float> &lhs_scales, const float rhs_scale,
+      const float output_scale, const int32_t output_zero_point,
+      uint8_t *output) {
+    std::vector<int32_t> multipliers;
+    std::vector<int> right_shifts;
+    GetOutputMultipliersAndShifts(lhs_scale, lhs_scales, rows, rhs_scale,
+                                  output_scale, &multipliers, &right_shifts);
+    const int32_t *multipliers_data = multipliers.data();
+    const int *right_shifts_data = right_shifts.data();
+#pragma omp parallel for schedule(runtime)
+    for (index_t c = 0; c < cols; ++c) {
+      const int32_t *input_col = input + c * rows;
+      uint8_t *output_col = output + c * rows;
+      for (index_t r = 0; r < rows; ++r) {
+        int32_t value = input_col[r] + (bias_data ? bias_data[r] : 0);
+        value = MultiplyByQuantizedMultiplier(value, multipliers_data[r],
+                                              right_shifts_data[r])
+            + output_zero_point;
+        output_col[r] = static_cast<uint8_t>(
+            std::min<int32_t>(255, std::max<int32_t>(0, value)));
+      }
+    }
+  }
 };
 }  // namespace mace
 
@@ -0,0 +1,70 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/ops/common/lookup_table.h"
+
+#include <cmath>
+
+#include "mace/utils/logging.h"
+#include "mace/utils/quantize.h"
+
+namespace mace {
+namespace ops {
+
+QuantizedLookupTable::QuantizedLookupTable()
+    : built_(false), input_scale_(0.f), input_zero_point_(0),
+      output_scale_(0.f), output_zero_point_(0) {}
+
+void QuantizedLookupTable::Update(
+    const Tensor *input, const Tensor *output,
+    const std::function<void(float *values)> &function) {
+  MACE_CHECK(output->scale() != 0.f, "the quantized output ", output->name(),
+             " has no scale");
+  if (built_ && input->scale() == input_scale_ &&
+      input->zero_point() == input_zero_point_ &&
+      output->scale() == output_scale_ &&
+      output->zero_point() == output_zero_point_) {
+    return;
+  }
+  input_scale_ = input->scale();
+  input_zero_point_ = input->zero_point();
+  output_scale_ = output->scale();
+  output_zero_point_ = output->zero_point();
+
+  float values[kSize];
+  for (int q = 0; q < kSize; ++q) {
+    values[q] = input_scale_ * (q - input_zero_point_);
+  }
+  function(values);
+  const float recip_scale = 1.f / output_scale_;
+  for (int q = 0; q < kSize; ++q) {
+    // the undefined values, e.g. of pow(-1, 0.5), to the real zero
+    table_[q] = std::isnan(values[q]) ?
+        Saturate<uint8_t>(output_zero_point_) :
+        Saturate<uint8_t>(roundf(output_zero_point_ +
+                                 recip_scale * values[q]));
+  }
+  built_ = true;
+}
+
+void QuantizedLookupTable::Lookup(const uint8_t *input, const index_t size,
+                                  uint8_t *output) const {
+#pragma omp parallel for schedule(runtime)
+  for (index_t i = 0; i < size; ++i) {
+    output[i] = table_[input[i]];
+  }
+}
+
+}  // namespace ops
+}  // namespace mace
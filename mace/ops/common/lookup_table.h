@@ -0,0 +1,60 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_OPS_COMMON_LOOKUP_TABLE_H_
+#define MACE_OPS_COMMON_LOOKUP_TABLE_H_
+
+#include <cstdint>
+#include <functional>
+
+#include "mace/core/tensor.h"
+#include "mace/core/types.h"
+
+namespace mace {
+namespace ops {
+
+// The 256 outputs of a unary function of the uint8 values of a tensor, so
+// that a quantized op of any such function is a byte lookup per value. The
+// table maps the quantization of the input onto that of the output.
+class QuantizedLookupTable {
+ public:
+  static constexpr int kSize = 256;
+
+  QuantizedLookupTable();
+
+  // Fills the table unless it is of the current scales and zero points of
+  // input and output. function maps the kSize real values of the input, in
+  // the order of their uint8 values, to their real outputs in place.
+  void Update(const Tensor *input, const Tensor *output,
+              const std::function<void(float *values)> &function);
+
+  const uint8_t *data() const { return table_; }
+
+  // the reference lookup
+  void Lookup(const uint8_t *input, const index_t size,
+              uint8_t *output) const;
+
+ private:
+  bool built_;
+  float input_scale_;
+  int32_t input_zero_point_;
+  float output_scale_;
+  int32_t output_zero_point_;
+  uint8_t table_[kSize];
+};
+
+}  // namespace ops
+}  // namespace mace
+
+#endif  // MACE_OPS_COMMON_LOOKUP_TABLE_H_
@@ -16,6 +16,10 @@
 #ifndef MACE_OPS_COMMON_MATRIX_H_
 #define MACE_OPS_COMMON_MATRIX_H_
 
+#include <vector>
+
+#include "mace/core/types.h"
+
 namespace mace {
 namespace ops {
 
@@ -101,6 +105,48 @@ class MatrixMap {
   index_t stride_;
 };
 
+// The rows x cols matrices of a batched gemm operand: matrix b starts at
+// offsets[b] of the data, in major with stride between its rows (RowMajor)
+// or its columns (ColMajor). The offsets repeat along broadcast batch dims,
+// and the stride differs from cols (rows) for matrices read through a
+// transpose of the tensor.
+struct MatrixBatch {
+  MatrixBatch() : major(RowMajor), stride(0) {}
+  // batch contiguous matrices, or the first one batch times if not batched
+  MatrixBatch(const index_t batch,
+              const bool batched,
+              const MatrixMajor major,
+              const index_t rows,
+              const index_t cols)
+      : offsets(batch, 0),
+        major(major),
+        stride(major == RowMajor ? cols : rows) {
+    for (index_t b = 0; batched && b < batch; ++b) {
+      offsets[b] = b * rows * cols;
+    }
+  }
+
+  index_t size() const { return static_cast<index_t>(offsets.size()); }
+
+  // whether all are the contiguous matrix at the start of the data, e.g.
+  // of a weight which could be packed once
+  bool IsSingle(const index_t rows, const index_t cols) const {
+    if (stride != (major == RowMajor ? cols : rows)) {
+      return false;
+    }
+    for (index_t offset : offsets) {
+      if (offset != 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  std::vector<index_t> offsets;
+  MatrixMajor major;
+  index_t stride;
+};
+
 }  // namespace ops
 }  // namespace mace
 
@@ -0,0 +1,228 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/ops/common/preprocess.h"
+
+#include <algorithm>
+#include <vector>
+
+#if defined(MACE_ENABLE_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "mace/utils/logging.h"
+
+namespace mace {
+namespace ops {
+
+namespace {
+constexpr int kMaxChannels = 4;
+
+struct Interpolation {
+  index_t lower;
+  index_t upper;
+  float lerp;
+};
+
+void ComputeInterpolation(const index_t out_size,
+                          const index_t in_size,
+                          std::vector<Interpolation> *interpolation) {
+  // the scale of ResizeBilinear without align_corners
+  const float scale = in_size / static_cast<float>(out_size);
+  interpolation->resize(out_size);
+  for (index_t i = 0; i < out_size; ++i) {
+    const float in = i * scale;
+    Interpolation &weight = (*interpolation)[i];
+    weight.lower = static_cast<index_t>(in);
+    weight.upper = std::min(weight.lower + 1, in_size - 1);
+    weight.lerp = in - weight.lower;
+  }
+}
+
+#if defined(MACE_ENABLE_NEON)
+inline void LoadFloat(const uint8x8_t value,
+                      float32x4_t *low,
+                      float32x4_t *high) {
+  const uint16x8_t value16 = vmovl_u8(value);
+  *low = vcvtq_f32_u32(vmovl_u16(vget_low_u16(value16)));
+  *high = vcvtq_f32_u32(vmovl_u16(vget_high_u16(value16)));
+}
+#endif
+
+// Normalizes a row of pixels, channel c of pixel w is written to
+// dst[c * channel_stride + w * pixel_stride].
+void NormalizeRow(const uint8_t *src,
+                  const index_t width,
+                  const int pixel_channels,
+                  const int *channel_map,
+                  const float *scale,
+                  const float *bias,
+                  const int channels,
+                  const index_t channel_stride,
+                  const index_t pixel_stride,
+                  float *dst) {
+  index_t w = 0;
+#if defined(MACE_ENABLE_NEON)
+  if (pixel_stride == 1) {
+    for (; w + 8 <= width; w += 8) {
+      uint8x8_t pixels[kMaxChannels];
+      if (pixel_channels == 4) {
+        const uint8x8x4_t value = vld4_u8(src + w * 4);
+        for (int k = 0; k < 4; ++k) {
+          pixels[k] = value.val[k];
+        }
+      } else if (pixel_channels == 3) {
+        const uint8x8x3_t value = vld3_u8(src + w * 3);
+        for (int k = 0; k < 3; ++k) {
+          pixels[k] = value.val[k];
+        }
+      } else {
+        pixels[0] = vld1_u8(src + w);
+      }
+      for (int c = 0; c < channels; ++c) {
+        float32x4_t low, high;
+        LoadFloat(pixels[channel_map[c]], &low, &high);
+        const float32x4_t vbias = vdupq_n_f32(bias[c]);
+        float *out = dst + c * channel_stride + w;
+        vst1q_f32(out, vmlaq_n_f32(vbias, low, scale[c]));
+        vst1q_f32(out + 4, vmlaq_n_f32(vbias, high, scale[c]));
+      }
+    }
+  }
+#endif
+  for (; w < width; ++w) {
+    const uint8_t *pixel = src + w * pixel_channels;
+    float *out = dst + w * pixel_stride;
+    for (int c = 0; c < channels; ++c) {
+      out[c * channel_stride] = pixel[channel_map[c]] * scale[c] + bias[c];
+    }
+  }
+}
+
+// Blends two rows of the input with the vertical weight, the channels of
+// the pixels stay interleaved.
+void BlendRows(const uint8_t *top,
+               const uint8_t *bottom,
+               const index_t size,
+               const float lerp,
+               float *dst) {
+  index_t i = 0;
+#if defined(MACE_ENABLE_NEON)
+  const float32x4_t vlerp = vdupq_n_f32(lerp);
+  for (; i + 8 <= size; i += 8) {
+    float32x4_t top0, top1, bottom0, bottom1;
+    LoadFloat(vld1_u8(top + i), &top0, &top1);
+    LoadFloat(vld1_u8(bottom + i), &bottom0, &bottom1);
+    vst1q_f32(dst + i, vmlaq_f32(top0, vsubq_f32(bottom0, top0), vlerp));
+    vst1q_f32(dst + i + 4, vmlaq_f32(top1, vsubq_f32(bottom1, top1), vlerp));
+  }
+#endif
+  for (; i < size; ++i) {
+    dst[i] = top[i] + (bottom[i] - top[i]) * lerp;
+  }
+}
+
+// Interpolates a blended row horizontally and normalizes it, written as
+// NormalizeRow does.
+void InterpolateRow(const float *row,
+                    const Interpolation *xs,
+                    const index_t width,
+                    const int pixel_channels,
+                    const int *channel_map,
+                    const float *scale,
+                    const float *bias,
+                    const int channels,
+                    const index_t channel_stride,
+                    const index_t pixel_stride,
+                    float *dst) {
+  for (index_t w = 0; w < width; ++w) {
+    const float *left = row + xs[w].lower * pixel_channels;
+    const float *right = row + xs[w].upper * pixel_channels;
+    const float lerp = xs[w].lerp;
+    float *out = dst + w * pixel_stride;
+    for (int c = 0; c < channels; ++c) {
+      const int k = channel_map[c];
+      const float value = left[k] + (right[k] - left[k]) * lerp;
+      out[c * channel_stride] = value * scale[c] + bias[c];
+    }
+  }
+}
+
+}  // namespace
+
+void PreprocessPixels(const uint8_t *input,
+                      const index_t batch,
+                      const index_t in_height,
+                      const index_t in_width,
+                      const int pixel_channels,
+                      const int *channel_map,
+                      const float *mean,
+                      const float *scale,
+                      const int out_channels,
+                      const index_t out_height,
+                      const index_t out_width,
+                      const DataFormat output_format,
+                      float *output) {
+  MACE_CHECK(pixel_channels > 0 && pixel_channels <= kMaxChannels &&
+      out_channels > 0 && out_channels <= kMaxChannels,
+             "pixels should have 1 to 4 channels");
+  float bias[kMaxChannels];
+  for (int c = 0; c < out_channels; ++c) {
+    MACE_CHECK(channel_map[c] >= 0 && channel_map[c] < pixel_channels);
+    bias[c] = -mean[c] * scale[c];
+  }
+  const index_t out_image_size = out_height * out_width;
+  const index_t channel_stride = output_format == NCHW ? out_image_size : 1;
+  const index_t pixel_stride = output_format == NCHW ? 1 : out_channels;
+  const index_t in_row_size = in_width * pixel_channels;
+
+  if (in_height == out_height && in_width == out_width) {
+#pragma omp parallel for collapse(2) schedule(runtime)
+    for (index_t b = 0; b < batch; ++b) {
+      for (index_t h = 0; h < out_height; ++h) {
+        NormalizeRow(input + (b * in_height + h) * in_row_size, out_width,
+                     pixel_channels, channel_map, scale, bias, out_channels,
+                     channel_stride, pixel_stride,
+                     output + b * out_channels * out_image_size
+                         + h * out_width * pixel_stride);
+      }
+    }
+    return;
+  }
+
+  std::vector<Interpolation> ys, xs;
+  ComputeInterpolation(out_height, in_height, &ys);
+  ComputeInterpolation(out_width, in_width, &xs);
+#pragma omp parallel
+  {
+    std::vector<float> row(in_row_size);
+#pragma omp for collapse(2) schedule(runtime)
+    for (index_t b = 0; b < batch; ++b) {
+      for (index_t h = 0; h < out_height; ++h) {
+        const uint8_t *image = input + b * in_height * in_row_size;
+        BlendRows(image + ys[h].lower * in_row_size,
+                  image + ys[h].upper * in_row_size, in_row_size, ys[h].lerp,
+                  row.data());
+        InterpolateRow(row.data(), xs.data(), out_width, pixel_channels,
+                       channel_map, scale, bias, out_channels,
+                       channel_stride, pixel_stride,
+                       output + b * out_channels * out_image_size
+                           + h * out_width * pixel_stride);
+      }
+    }
+  }
+}
+
+}  // namespace ops
+}  // namespace mace
@@ -0,0 +1,48 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_OPS_COMMON_PREPROCESS_H_
+#define MACE_OPS_COMMON_PREPROCESS_H_
+
+#include <cstdint>
+
+#include "mace/core/types.h"
+#include "mace/public/mace.h"
+
+namespace mace {
+namespace ops {
+
+// Turns uint8 pixels of [batch, in_height, in_width, pixel_channels] into a
+// float tensor of out_channels in one pass, resized bilinearly (as
+// ResizeBilinear without align_corners) when the sizes differ. Channel c of
+// the output is (pixel[channel_map[c]] - mean[c]) * scale[c], written as
+// NCHW or NHWC by output_format.
+void PreprocessPixels(const uint8_t *input,
+                      const index_t batch,
+                      const index_t in_height,
+                      const index_t in_width,
+                      const int pixel_channels,
+                      const int *channel_map,
+                      const float *mean,
+                      const float *scale,
+                      const int out_channels,
+                      const index_t out_height,
+                      const index_t out_width,
+                      const DataFormat output_format,
+                      float *output);
+
+}  // namespace ops
+}  // namespace mace
+
+#endif  // MACE_OPS_COMMON_PREPROCESS_H_
@@ -0,0 +1,225 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/ops/common/quantize.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#if defined(MACE_ENABLE_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "mace/core/tensor.h"
+#include "mace/utils/quantize.h"
+
+namespace mace {
+namespace ops {
+
+namespace {
+// the values scanned then converted by a thread, the blocks of both passes
+// are split with a static schedule to land on the same threads
+constexpr index_t kBlockSize = 16384;
+// the pixels of a tile of the NHWC to NCHW dequantization
+constexpr index_t kPixelTile = 64;
+
+index_t BlockCount(const index_t size) {
+  return (size + kBlockSize - 1) / kBlockSize;
+}
+
+#if defined(MACE_ENABLE_NEON)
+// rounds half away from zero, as roundf
+inline int32x4_t RoundToInt(const float32x4_t value) {
+#if defined(__aarch64__)
+  return vcvtaq_s32_f32(value);
+#else
+  const uint32x4_t negative = vcltq_f32(value, vdupq_n_f32(0.f));
+  return vcvtq_s32_f32(vaddq_f32(
+      value, vbslq_f32(negative, vdupq_n_f32(-0.5f), vdupq_n_f32(0.5f))));
+#endif
+}
+#endif  // MACE_ENABLE_NEON
+
+void FindBlockMinMax(const float *input,
+                     const index_t size,
+                     float *min_val,
+                     float *max_val) {
+  float min_v = std::numeric_limits<float>::max();
+  float max_v = std::numeric_limits<float>::lowest();
+  index_t i = 0;
+#if defined(MACE_ENABLE_NEON)
+  if (size >= 4) {
+    float32x4_t vmin = vld1q_f32(input);
+    float32x4_t vmax = vmin;
+    for (i = 4; i + 4 <= size; i += 4) {
+      const float32x4_t value = vld1q_f32(input + i);
+      vmin = vminq_f32(vmin, value);
+      vmax = vmaxq_f32(vmax, value);
+    }
+#if defined(__aarch64__)
+    min_v = vminvq_f32(vmin);
+    max_v = vmaxvq_f32(vmax);
+#else
+    float32x2_t min2 = vpmin_f32(vget_low_f32(vmin), vget_high_f32(vmin));
+    float32x2_t max2 = vpmax_f32(vget_low_f32(vmax), vget_high_f32(vmax));
+    min_v = vget_lane_f32(vpmin_f32(min2, min2), 0);
+    max_v = vget_lane_f32(vpmax_f32(max2, max2), 0);
+#endif
+  }
+#endif  // MACE_ENABLE_NEON
+  for (; i < size; ++i) {
+    min_v = std::min(min_v, input[i]);
+    max_v = std::max(max_v, input[i]);
+  }
+  *min_val = min_v;
+  *max_val = max_v;
+}
+
+void QuantizeBlock(const float *input,
+                   const index_t size,
+                   const float recip_scale,
+                   const int32_t zero_point,
+                   uint8_t *output) {
+  index_t i = 0;
+#if defined(MACE_ENABLE_NEON)
+  const float32x4_t vzero_point = vdupq_n_f32(zero_point);
+  for (; i + 8 <= size; i += 8) {
+    const int32x4_t low = RoundToInt(
+        vmlaq_n_f32(vzero_point, vld1q_f32(input + i), recip_scale));
+    const int32x4_t high = RoundToInt(
+        vmlaq_n_f32(vzero_point, vld1q_f32(input + i + 4), recip_scale));
+    vst1_u8(output + i,
+            vqmovn_u16(vcombine_u16(vqmovun_s32(low), vqmovun_s32(high))));
+  }
+#endif  // MACE_ENABLE_NEON
+  for (; i < size; ++i) {
+    output[i] = Saturate<uint8_t>(roundf(zero_point + recip_scale * input[i]));
+  }
+}
+
+void DequantizeBlock(const uint8_t *input,
+                     const index_t size,
+                     const float scale,
+                     const int32_t zero_point,
+                     float *output) {
+  index_t i = 0;
+#if defined(MACE_ENABLE_NEON)
+  const int32x4_t vzero_point = vdupq_n_s32(zero_point);
+  for (; i + 8 <= size; i += 8) {
+    const uint16x8_t value = vmovl_u8(vld1_u8(input + i));
+    const int32x4_t low = vsubq_s32(
+        vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(value))), vzero_point);
+    const int32x4_t high = vsubq_s32(
+        vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(value))), vzero_point);
+    vst1q_f32(output + i, vmulq_n_f32(vcvtq_f32_s32(low), scale));
+    vst1q_f32(output + i + 4, vmulq_n_f32(vcvtq_f32_s32(high), scale));
+  }
+#endif  // MACE_ENABLE_NEON
+  for (; i < size; ++i) {
+    output[i] = scale * (input[i] - zero_point);
+  }
+}
+}  // namespace
+
+void QuantizeUint8(const float *input,
+                   const index_t size,
+                   const float scale,
+                   const int32_t zero_point,
+                   uint8_t *output) {
+  const float recip_scale = 1 / scale;
+  const index_t blocks = BlockCount(size);
+#pragma omp parallel for schedule(static)
+  for (index_t b = 0; b < blocks; ++b) {
+    const index_t begin = b * kBlockSize;
+    QuantizeBlock(input + begin, std::min(kBlockSize, size - begin),
+                  recip_scale, zero_point, output + begin);
+  }
+}
+
+void QuantizeUint8(const float *input,
+                   const index_t size,
+                   const bool non_zero,
+                   uint8_t *output,
+                   float *scale,
+                   int32_t *zero_point) {
+  const index_t blocks = BlockCount(size);
+  std::vector<float> min_vals(blocks);
+  std::vector<float> max_vals(blocks);
+#pragma omp parallel for schedule(static)
+  for (index_t b = 0; b < blocks; ++b) {
+    const index_t begin = b * kBlockSize;
+    FindBlockMinMax(input + begin, std::min(kBlockSize, size - begin),
+                    &min_vals[b], &max_vals[b]);
+  }
+  float min_val = std::numeric_limits<float>::max();
+  float max_val = std::numeric_limits<float>::lowest();
+  for (index_t b = 0; b < blocks; ++b) {
+    min_val = std::min(min_val, min_vals[b]);
+    max_val = std::max(max_val, max_vals[b]);
+  }
+
+  AdjustRange<uint8_t>(min_val, max_val, non_zero, scale, zero_point);
+  QuantizeUint8(input, size, *scale, *zero_point, output);
+}
+
+void DequantizeUint8(const uint8_t *input,
+                     const index_t size,
+                     const float scale,
+                     const int32_t zero_point,
+                     float *output) {
+  const index_t blocks = BlockCount(size);
+#pragma omp parallel for schedule(runtime)
+  for (index_t b = 0; b < blocks; ++b) {
+    const index_t begin = b * kBlockSize;
+    DequantizeBlock(input + begin, std::min(kBlockSize, size - begin), scale,
+                    zero_point, output + begin);
+  }
+}
+
+void DequantizeUint8ToNCHW(const uint8_t *input,
+                           const index_t batch,
+                           const index_t height,
+                           const index_t width,
+                           const index_t channels,
+                           const float scale,
+                           const int32_t zero_point,
+                           float *output) {
+  const index_t image_size = height * width;
+  if (channels == 1 || image_size == 1) {
+    DequantizeUint8(input, batch * image_size * channels, scale, zero_point,
+                    output);
+    return;
+  }
+  // a tile of pixels keeps its bytes in the cache while each channel is
+  // written as a contiguous row
+#pragma omp parallel for collapse(2) schedule(runtime)
+  for (index_t b = 0; b < batch; ++b) {
+    for (index_t p = 0; p < image_size; p += kPixelTile) {
+      const index_t pixels = std::min(kPixelTile, image_size - p);
+      const uint8_t *in_tile = input + (b * image_size + p) * channels;
+      float *out_tile = output + b * channels * image_size + p;
+      for (index_t c = 0; c < channels; ++c) {
+        float *out_row = out_tile + c * image_size;
+        for (index_t i = 0; i < pixels; ++i) {
+          out_row[i] = scale * (in_tile[i * channels + c] - zero_point);
+        }
+      }
+    }
+  }
+}
+
+}  // namespace ops
+}  // namespace mace
@@ -0,0 +1,67 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_OPS_COMMON_QUANTIZE_H_
+#define MACE_OPS_COMMON_QUANTIZE_H_
+
+#include <cstdint>
+
+#include "mace/core/types.h"
+
+namespace mace {
+namespace ops {
+
+// Threaded NEON versions of the uint8 conversions of mace/utils/quantize.h,
+// with the same rounding and saturation.
+
+// output = saturate(round(zero_point + input / scale))
+void QuantizeUint8(const float *input,
+                   const index_t size,
+                   const float scale,
+                   const int32_t zero_point,
+                   uint8_t *output);
+
+// Quantize with the range of the input, as Quantize of mace/utils/quantize.h.
+// The range and the conversion split the input into the same blocks of the
+// same threads, so the second pass reads each block from the cache of the
+// thread that scanned it.
+void QuantizeUint8(const float *input,
+                   const index_t size,
+                   const bool non_zero,
+                   uint8_t *output,
+                   float *scale,
+                   int32_t *zero_point);
+
+// output = scale * (input - zero_point)
+void DequantizeUint8(const uint8_t *input,
+                     const index_t size,
+                     const float scale,
+                     const int32_t zero_point,
+                     float *output);
+
+// Dequantize an NHWC input of [batch, height, width, channels] straight into
+// an NCHW output, folding the layout change into the conversion.
+void DequantizeUint8ToNCHW(const uint8_t *input,
+                           const index_t batch,
+                           const index_t height,
+                           const index_t width,
+                           const index_t channels,
+                           const float scale,
+                           const int32_t zero_point,
+                           float *output);
+
+}  // namespace ops
+}  // namespace mace
+
+#endif  // MACE_OPS_COMMON_QUANTIZE_H_
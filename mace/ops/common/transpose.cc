@@ -22,82 +22,162 @@
 
 #include "mace/core/types.h"
 #include "mace/utils/logging.h"
+#include "mace/utils/utils.h"
 
 namespace mace {
 namespace ops {
 
 namespace {
+// pixels moved by a task of the 2 and 3 channel transposes
+constexpr index_t kPixelBlock = 1024;
+
 void TransposeNHWCToNCHWC3(const float *input,
                            float *output,
-                           const index_t height,
-                           const index_t width) {
-  index_t image_size = height * width;
-
-#pragma omp parallel for
-  for (index_t h = 0; h < height; ++h) {
-    index_t in_offset = h * width * 3;
-    index_t out_offset = h * width;
-
+                           const index_t image_size) {
+  const index_t blocks = RoundUpDiv(image_size, kPixelBlock);
+#pragma omp parallel for schedule(runtime)
+  for (index_t block = 0; block < blocks; ++block) {
+    const index_t begin = block * kPixelBlock;
+    const index_t end = std::min(begin + kPixelBlock, image_size);
+    index_t i = begin;
 #if defined(MACE_ENABLE_NEON)
-    index_t w;
-    for (w = 0; w + 3 < width; w += 4) {
-      float32x4x3_t vi = vld3q_f32(input + in_offset);
-      vst1q_f32(output + out_offset, vi.val[0]);
-      vst1q_f32(output + out_offset + image_size, vi.val[1]);
-      vst1q_f32(output + out_offset + image_size * 2, vi.val[2]);
-
-      in_offset += 12;
-      out_offset += 4;
+    for (; i + 3 < end; i += 4) {
+      float32x4x3_t vi = vld3q_f32(input + i * 3);
+      vst1q_f32(output + i, vi.val[0]);
+      vst1q_f32(output + i + image_size, vi.val[1]);
+      vst1q_f32(output + i + image_size * 2, vi.val[2]);
     }
-    for (; w < width; ++w) {
-      for (index_t c = 0; c < 3; ++c) {
-        output[h * width + image_size * c + w] =
-          input[h * width * 3 + w * 3 + c];
-      }
-    }
-#else
-    for (index_t w = 0; w < width; ++w) {
+#endif
+    for (; i < end; ++i) {
       for (index_t c = 0; c < 3; ++c) {
-        output[out_offset + c * image_size + w] = input[in_offset + w * 3 + c];
+        output[c * image_size + i] = input[i * 3 + c];
       }
     }
-#endif
   }
 }
 
 void TransposeNCHWToNHWCC2(const float *input,
                            float *output,
-                           const index_t height,
-                           const index_t width) {
-  index_t image_size = height * width;
-#pragma omp parallel for
-  for (index_t h = 0; h < height; ++h) {
-    index_t in_offset = h * width;
-    index_t out_offset = h * width * 2;
-
+                           const index_t image_size) {
+  const index_t blocks = RoundUpDiv(image_size, kPixelBlock);
+#pragma omp parallel for schedule(runtime)
+  for (index_t block = 0; block < blocks; ++block) {
+    const index_t begin = block * kPixelBlock;
+    const index_t end = std::min(begin + kPixelBlock, image_size);
+    index_t i = begin;
 #if defined(MACE_ENABLE_NEON)
-    index_t w;
-    for (w = 0; w + 3 < width; w += 4) {
-      float32x4_t vi0 = vld1q_f32(input + in_offset);
-      float32x4_t vi1 = vld1q_f32(input + in_offset + image_size);
+    for (; i + 3 < end; i += 4) {
+      float32x4_t vi0 = vld1q_f32(input + i);
+      float32x4_t vi1 = vld1q_f32(input + i + image_size);
       float32x4x2_t vi = {vi0, vi1};
-      vst2q_f32(output + out_offset, vi);
-      in_offset += 4;
-      out_offset += 8;
+      vst2q_f32(output + i * 2, vi);
     }
-    for (; w < width; ++w) {
+#endif
+    for (; i < end; ++i) {
       for (index_t c = 0; c < 2; ++c) {
-        output[h * width * 2 + w * 2 + c] =
-          input[h * width + image_size * c + w];
+        output[i * 2 + c] = input[c * image_size + i];
       }
     }
-#else
-    for (index_t w = 0; w < width; ++w) {
-      for (index_t c = 0; c < 2; ++c) {
-        output[out_offset + w * 2 + c] = input[in_offset + c * image_size + w];
+  }
+}
+
+// block of rows and columns moved by a task, to stay in the L1 cache
+constexpr index_t kTileSize = 32;
+
+// dst[j * dst_stride + i] = src[i * src_stride + j] for the rows [0, rows)
+// and the columns [0, cols) of a tile
+void TransposeTile(const float *src,
+                   const index_t src_stride,
+                   const index_t rows,
+                   const index_t cols,
+                   const index_t dst_stride,
+                   float *dst) {
+  index_t i = 0;
+#if defined(MACE_ENABLE_NEON)
+  for (; i + 4 <= rows; i += 4) {
+    const float *src_ptr = src + i * src_stride;
+    float *dst_ptr = dst + i;
+    index_t j = 0;
+    for (; j + 4 <= cols; j += 4) {
+      const float32x4_t r0 = vld1q_f32(src_ptr + j);
+      const float32x4_t r1 = vld1q_f32(src_ptr + src_stride + j);
+      const float32x4_t r2 = vld1q_f32(src_ptr + 2 * src_stride + j);
+      const float32x4_t r3 = vld1q_f32(src_ptr + 3 * src_stride + j);
+      const float32x4x2_t t01 = vtrnq_f32(r0, r1);
+      const float32x4x2_t t23 = vtrnq_f32(r2, r3);
+      vst1q_f32(dst_ptr + j * dst_stride,
+                vcombine_f32(vget_low_f32(t01.val[0]),
+                             vget_low_f32(t23.val[0])));
+      vst1q_f32(dst_ptr + (j + 1) * dst_stride,
+                vcombine_f32(vget_low_f32(t01.val[1]),
+                             vget_low_f32(t23.val[1])));
+      vst1q_f32(dst_ptr + (j + 2) * dst_stride,
+                vcombine_f32(vget_high_f32(t01.val[0]),
+                             vget_high_f32(t23.val[0])));
+      vst1q_f32(dst_ptr + (j + 3) * dst_stride,
+                vcombine_f32(vget_high_f32(t01.val[1]),
+                             vget_high_f32(t23.val[1])));
+    }
+    for (; j < cols; ++j) {
+      for (index_t k = 0; k < 4; ++k) {
+        dst_ptr[j * dst_stride + k] = src_ptr[k * src_stride + j];
       }
     }
+  }
 #endif
+  for (; i < rows; ++i) {
+    for (index_t j = 0; j < cols; ++j) {
+      dst[j * dst_stride + i] = src[i * src_stride + j];
+    }
+  }
+}
+
+// Drops the dims of size 1 and merges the dims staying next to each other,
+// so that NHWC <-> NCHW becomes a batched 2D transpose of [N, HW, C] and
+// [N, C, HW].
+void SimplifyTranspose(const std::vector<int64_t> &input_shape,
+                       const std::vector<int> &dst_dims,
+                       std::vector<index_t> *shape,
+                       std::vector<int> *dims) {
+  const int rank = static_cast<int>(input_shape.size());
+  std::vector<int> kept(rank, -1);
+  std::vector<index_t> kept_shape;
+  for (int i = 0; i < rank; ++i) {
+    if (input_shape[i] != 1) {
+      kept[i] = static_cast<int>(kept_shape.size());
+      kept_shape.push_back(input_shape[i]);
+    }
+  }
+  std::vector<int> kept_dims;
+  for (int d : dst_dims) {
+    if (kept[d] >= 0) {
+      kept_dims.push_back(kept[d]);
+    }
+  }
+
+  // input dims starting a run of dims adjacent in the output too
+  const int kept_rank = static_cast<int>(kept_dims.size());
+  std::vector<bool> merged(kept_rank, false);
+  for (int i = 1; i < kept_rank; ++i) {
+    if (kept_dims[i] == kept_dims[i - 1] + 1) {
+      merged[kept_dims[i]] = true;
+    }
+  }
+  std::vector<int> merged_index(kept_rank, -1);
+  shape->clear();
+  for (int i = 0; i < kept_rank; ++i) {
+    if (merged[i]) {
+      shape->back() *= kept_shape[i];
+    } else {
+      merged_index[i] = static_cast<int>(shape->size());
+      shape->push_back(kept_shape[i]);
+    }
+  }
+  dims->clear();
+  for (int d : kept_dims) {
+    if (!merged[d]) {
+      dims->push_back(merged_index[d]);
+    }
   }
 }
 }  // namespace
@@ -106,109 +186,128 @@ MaceStatus Transpose(const float *input,
                      const std::vector<int64_t> &input_shape,
                      const std::vector<int> &dst_dims,
                      float *output) {
-  MACE_CHECK((input_shape.size() == 2 && dst_dims.size() == 2) ||
-               (input_shape.size() == 4 && dst_dims.size() == 4),
-             "Only support 2D or 4D transpose");
-
-  std::vector<index_t> output_shape;
-  for (size_t i = 0; i < dst_dims.size(); ++i) {
-    output_shape.push_back(input_shape[dst_dims[i]]);
-  }
-
-  if (input_shape.size() == 2) {
-    MACE_CHECK(dst_dims[0] == 1 && dst_dims[1] == 0, "no need transform");
-    index_t height = input_shape[0];
-    index_t width = input_shape[1];
-    index_t stride_i = height;
-    index_t stride_j = width;
-    index_t tile_size = height > 512 || width > 512 ? 64 : 32;
-#pragma omp parallel for collapse(2)
-    for (index_t i = 0; i < height; i += tile_size) {
-      for (index_t j = 0; j < width; j += tile_size) {
-        index_t end_i = std::min(i + tile_size, height);
-        index_t end_j = std::min(j + tile_size, width);
-        for (index_t tile_i = i; tile_i < end_i; ++tile_i) {
-          for (index_t tile_j = j; tile_j < end_j; ++tile_j) {
-            output[tile_j * stride_i + tile_i] =
-              input[tile_i * stride_j + tile_j];
-          }
-        }
-      }
-    }
-  } else if (input_shape.size() == 4) {
-    std::vector<int> transpose_order_from_NHWC_to_NCHW{0, 3, 1, 2};
-    std::vector<int> transpose_order_from_NCHW_to_NHWC{0, 2, 3, 1};
-    index_t batch_size = input_shape[1] * input_shape[2] * input_shape[3];
-
-    if (dst_dims == transpose_order_from_NHWC_to_NCHW && input_shape[3] == 3) {
-      for (index_t b = 0; b < input_shape[0]; ++b) {
-        TransposeNHWCToNCHWC3(input + b * batch_size,
-                              output + b * batch_size,
-                              input_shape[1],
-                              input_shape[2]);
+  MACE_CHECK(input_shape.size() == dst_dims.size(),
+             "Transpose dims should be of the input rank");
+  std::vector<bool> used(dst_dims.size(), false);
+  for (int d : dst_dims) {
+    MACE_CHECK(d >= 0 && d < static_cast<int>(dst_dims.size()) && !used[d],
+               "Transpose dims should be a permutation");
+    used[d] = true;
+  }
+
+  std::vector<index_t> shape;
+  std::vector<int> dims;
+  SimplifyTranspose(input_shape, dst_dims, &shape, &dims);
+  const int rank = static_cast<int>(shape.size());
+  index_t size = 1;
+  for (index_t dim : shape) {
+    size *= dim;
+  }
+
+  if (rank <= 1) {
+    std::copy(input, input + size, output);
+    return MaceStatus::MACE_SUCCESS;
+  }
+  if (rank == 3 && dims == std::vector<int>{0, 2, 1}) {
+    if (shape[2] == 3) {
+      for (index_t b = 0; b < shape[0]; ++b) {
+        TransposeNHWCToNCHWC3(input + b * shape[1] * 3,
+                              output + b * shape[1] * 3, shape[1]);
       }
-    } else if (dst_dims == transpose_order_from_NCHW_to_NHWC
-      && input_shape[1] == 2) {
-      for (index_t b = 0; b < input_shape[0]; ++b) {
-        TransposeNCHWToNHWCC2(input + b * batch_size,
-                              output + b * batch_size,
-                              input_shape[2],
-                              input_shape[3]);
+      return MaceStatus::MACE_SUCCESS;
+    } else if (shape[1] == 2) {
+      for (index_t b = 0; b < shape[0]; ++b) {
+        TransposeNCHWToNHWCC2(input + b * shape[2] * 2,
+                              output + b * shape[2] * 2, shape[2]);
       }
-    } else if (dst_dims == std::vector<int>{0, 2, 1, 3}) {
-      index_t height = input_shape[1];
-      index_t width = input_shape[2];
-      index_t channel = input_shape[3];
-      index_t channel_raw_size = channel * sizeof(float);
-      index_t stride_i = height;
-      index_t stride_j = width;
-      index_t tile_size = std::max(static_cast<index_t>(1),
-                                   static_cast<index_t>(std::sqrt(
-                                     8 * 1024 / channel)));
-#pragma omp parallel for collapse(2)
-      for (index_t i = 0; i < height; i += tile_size) {
-        for (index_t j = 0; j < width; j += tile_size) {
-          index_t end_i = std::min(i + tile_size, height);
-          index_t end_j = std::min(j + tile_size, width);
-          for (index_t tile_i = i; tile_i < end_i; ++tile_i) {
-            for (index_t tile_j = j; tile_j < end_j; ++tile_j) {
-              memcpy(output + (tile_j * stride_i + tile_i) * channel,
-                     input + (tile_i * stride_j + tile_j) * channel,
-                     channel_raw_size);
-            }
-          }
-        }
+      return MaceStatus::MACE_SUCCESS;
+    }
+  }
+
+  std::vector<index_t> in_stride(rank, 1);
+  for (int i = rank - 2; i >= 0; --i) {
+    in_stride[i] = in_stride[i + 1] * shape[i + 1];
+  }
+  std::vector<index_t> out_shape(rank);
+  std::vector<index_t> out_stride(rank, 1);
+  for (int i = 0; i < rank; ++i) {
+    out_shape[i] = shape[dims[i]];
+  }
+  for (int i = rank - 2; i >= 0; --i) {
+    out_stride[i] = out_stride[i + 1] * out_shape[i + 1];
+  }
+
+  // the stride in the input and in the output of each output dim, the
+  // innermost dim of the input is moved to out_dim of the output
+  std::vector<index_t> src_stride(rank);
+  int out_dim = 0;
+  for (int i = 0; i < rank; ++i) {
+    src_stride[i] = in_stride[dims[i]];
+    if (dims[i] == rank - 1) {
+      out_dim = i;
+    }
+  }
+
+  if (out_dim == rank - 1) {
+    // the innermost dim stays, e.g., {0, 2, 1, 3}: copies of whole rows
+    const index_t row_size = out_shape[rank - 1];
+    const index_t row_count = size / row_size;
+#pragma omp parallel for schedule(runtime)
+    for (index_t o = 0; o < row_count; ++o) {
+      index_t src_offset = 0;
+      index_t remain = o;
+      for (int i = rank - 2; i >= 0; --i) {
+        src_offset += (remain % out_shape[i]) * src_stride[i];
+        remain /= out_shape[i];
       }
-    } else {
-      std::vector<index_t>
-        in_stride{input_shape[1] * input_shape[2] * input_shape[3],
-                  input_shape[2] * input_shape[3], input_shape[3], 1};
-      std::vector<index_t>
-        out_stride{output_shape[1] * output_shape[2] * output_shape[3],
-                   output_shape[2] * output_shape[3], output_shape[3], 1};
-
-      std::vector<index_t> idim(4, 0);
-      std::vector<index_t> odim(4, 0);
-      for (odim[0] = 0; odim[0] < output_shape[0]; ++odim[0]) {
-        for (odim[1] = 0; odim[1] < output_shape[1]; ++odim[1]) {
-          for (odim[2] = 0; odim[2] < output_shape[2]; ++odim[2]) {
-            for (odim[3] = 0; odim[3] < output_shape[3]; ++odim[3]) {
-              idim[dst_dims[0]] = odim[0];
-              idim[dst_dims[1]] = odim[1];
-              idim[dst_dims[2]] = odim[2];
-              idim[dst_dims[3]] = odim[3];
-
-              output[odim[0] * out_stride[0] + odim[1] * out_stride[1]
-                + odim[2] * out_stride[2] + odim[3]] =
-                input[idim[0] * in_stride[0] + idim[1] * in_stride[1]
-                  + idim[2] * in_stride[2] + idim[3]];
-            }
+      std::copy(input + src_offset, input + src_offset + row_size,
+                output + o * row_size);
+    }
+    return MaceStatus::MACE_SUCCESS;
+  }
+
+  // Tiles of the input innermost rows and the output innermost columns,
+  // over all the other dims of the output. With its innermost dim last,
+  // an output reads rows of the input and writes rows of the output.
+  const index_t rows = out_shape[rank - 1];
+  const index_t cols = out_shape[out_dim];
+  const index_t row_stride = src_stride[rank - 1];
+  const index_t col_stride = out_stride[out_dim];
+  index_t outer = 1;
+  for (int i = 0; i < rank - 1; ++i) {
+    if (i != out_dim) {
+      outer *= out_shape[i];
+    }
+  }
+  const index_t row_tiles = RoundUpDiv(rows, kTileSize);
+  const index_t col_tiles = RoundUpDiv(cols, kTileSize);
+
+#pragma omp parallel for collapse(3) schedule(runtime)
+  for (index_t o = 0; o < outer; ++o) {
+    for (index_t rt = 0; rt < row_tiles; ++rt) {
+      for (index_t ct = 0; ct < col_tiles; ++ct) {
+        index_t src_offset = 0;
+        index_t dst_offset = 0;
+        index_t remain = o;
+        for (int i = rank - 2; i >= 0; --i) {
+          if (i == out_dim) {
+            continue;
           }
+          const index_t idx = remain % out_shape[i];
+          remain /= out_shape[i];
+          src_offset += idx * src_stride[i];
+          dst_offset += idx * out_stride[i];
         }
+        const index_t r = rt * kTileSize;
+        const index_t c = ct * kTileSize;
+        TransposeTile(input + src_offset + r * row_stride + c,
+                      row_stride,
+                      std::min(kTileSize, rows - r),
+                      std::min(kTileSize, cols - c),
+                      col_stride,
+                      output + dst_offset + c * col_stride + r);
       }
     }
-  } else {
-    MACE_NOT_IMPLEMENTED;
   }
 
   return MaceStatus::MACE_SUCCESS;
@@ -0,0 +1,68 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/ops/common/weight_only.h"
+
+#include <string>
+
+#include "mace/utils/logging.h"
+
+namespace mace {
+namespace ops {
+
+MaceStatus MakeWeightOnlyMatrix(const Tensor *weight,
+                                const int bits,
+                                const index_t group_size,
+                                const index_t cols,
+                                WeightOnlyMatrix *matrix) {
+  const std::string &name = weight->name();
+  if (weight->dtype() != DT_UINT8 || weight->dim_size() < 1 ||
+      (bits != 8 && bits != 4)) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      MakeString("weight-only weight ", name,
+                                 " should be uint8 of 8 or 4 bits"));
+  }
+  matrix->data = weight->data<uint8_t>();
+  matrix->rows = weight->dim(0);
+  matrix->cols = cols;
+  matrix->bits = bits;
+  matrix->group_size = group_size > 0 ? group_size : cols;
+  matrix->zero_point = weight->zero_point();
+  // a group of 4 bits values starts at a whole byte
+  if (bits == 4 && matrix->group_size % 2 != 0 &&
+      matrix->group_size < cols) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      MakeString("the groups of the 4 bits weight ", name,
+                                 " should be of an even size"));
+  }
+  if (weight->size() != matrix->rows * matrix->row_bytes()) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      MakeString("weight-only weight ", name, " of shape ",
+                                 MakeString(weight->shape()),
+                                 " does not hold ", matrix->rows, "x", cols,
+                                 " values of ", bits, " bits"));
+  }
+  if (static_cast<index_t>(weight->scales().size()) !=
+      matrix->rows * matrix->groups()) {
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      MakeString("weight-only weight ", name, " has ",
+                                 weight->scales().size(), " scales, not ",
+                                 matrix->rows * matrix->groups()));
+  }
+  matrix->scales = weight->scales().data();
+  return MaceStatus::MACE_SUCCESS;
+}
+
+}  // namespace ops
+}  // namespace mace
@@ -0,0 +1,72 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_OPS_COMMON_WEIGHT_ONLY_H_
+#define MACE_OPS_COMMON_WEIGHT_ONLY_H_
+
+#include <cstdint>
+
+#include "mace/core/tensor.h"
+#include "mace/core/types.h"
+#include "mace/public/mace.h"
+
+namespace mace {
+namespace ops {
+
+// set by the converter on the float FullyConnected and MatMul ops whose
+// weight is quantized for the weight-only kernels, 8 or 4 bits
+constexpr const char *kWeightBitsArg = "weight_bits";
+// the number of the weights of a row sharing a scale, 0 for a scale per row
+constexpr const char *kWeightGroupSizeArg = "weight_group_size";
+
+// A row-major [rows, cols] weight of uint8 values q, whose real values are
+// scales[r * groups + c / group_size] * (q - zero_point). The values of 8
+// bits take a byte each, those of 4 bits two bytes each, the lower nibble
+// first, with each row padded to whole bytes. The activations stay float.
+struct WeightOnlyMatrix {
+  const uint8_t *data;
+  const float *scales;
+  index_t rows;
+  index_t cols;
+  int bits;
+  index_t group_size;
+  int32_t zero_point;
+
+  index_t row_bytes() const {
+    return bits == 4 ? (cols + 1) / 2 : cols;
+  }
+
+  index_t groups() const {
+    return (cols + group_size - 1) / group_size;
+  }
+};
+
+inline uint8_t WeightOnlyValue(const uint8_t *row, const int bits,
+                               const index_t col) {
+  return bits == 4 ? static_cast<uint8_t>((row[col / 2] >> (col % 2 * 4)) & 15)
+                   : row[col];
+}
+
+// Describe a weight tensor of an op of kWeightBitsArg, whose rows are its
+// first dim, as a matrix of cols columns.
+MaceStatus MakeWeightOnlyMatrix(const Tensor *weight,
+                                const int bits,
+                                const index_t group_size,
+                                const index_t cols,
+                                WeightOnlyMatrix *matrix);
+
+}  // namespace ops
+}  // namespace mace
+
+#endif  // MACE_OPS_COMMON_WEIGHT_ONLY_H_
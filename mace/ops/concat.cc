@@ -12,7 +12,11 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#if defined(MACE_ENABLE_NEON)
+#include <arm_neon.h>
+#endif
 #include <memory>
+#include <vector>
 
 #include "mace/core/operator.h"
 #include "mace/utils/quantize.h"
@@ -98,14 +102,33 @@ class ConcatOp<DeviceType::CPU, T> : public ConcatOpBase {
     MACE_RETURN_IF_ERROR(output->Resize(output_shape));
 
     T *output_ptr = output->mutable_data<T>();
+    const T *output_end = output_ptr + output->size();
 
+    // the memory optimizer plans the inputs as views into the output when
+    // they are contiguous slices of it, those are already in place
     std::vector<const T *> input_ptrs(inputs.size(), nullptr);
+    std::vector<bool> in_place(inputs_count, false);
+    std::vector<std::vector<T>> input_copies;
+    input_copies.reserve(inputs_count);
+    index_t output_offset = 0;
     for (size_t i = 0; i < inputs_count; ++i) {
       input_ptrs[i] = inputs[i]->data<T>();
+      in_place[i] = inner_size == 1 &&
+          input_ptrs[i] == output_ptr + output_offset;
+      output_offset += outer_sizes[i];
+      if (!in_place[i] && input_ptrs[i] < output_end &&
+          input_ptrs[i] + inputs[i]->size() > output_ptr) {
+        // a view whose shape changed, don't overwrite it before it is read
+        input_copies.emplace_back(input_ptrs[i],
+                                  input_ptrs[i] + inputs[i]->size());
+        input_ptrs[i] = input_copies.back().data();
+      }
     }
     for (int inner_idx = 0; inner_idx < inner_size; ++inner_idx) {
       for (size_t i = 0; i < inputs_count; ++i) {
-        if (DataTypeCanUseMemcpy(DataTypeToEnum<T>::v())) {
+        if (in_place[i]) {
+          output_ptr += outer_sizes[i];
+        } else if (DataTypeCanUseMemcpy(DataTypeToEnum<T>::v())) {
           memcpy(output_ptr, input_ptrs[i], outer_sizes[i] * sizeof(T));
           output_ptr += outer_sizes[i];
           input_ptrs[i] += outer_sizes[i];
@@ -178,12 +201,31 @@ class ConcatOp<DeviceType::CPU, uint8_t> : public ConcatOpBase {
           const float scale = inputs[i]->scale() / output->scale();
           const float offset =
               -inputs[i]->zero_point() * scale + output->zero_point();
-          for (index_t k = 0; k < outer_sizes[i]; ++k) {
-            float out = (*input_ptrs[i]) * scale + offset;
-            *output_ptr = Saturate<uint8_t>(roundf(out));
-            ++output_ptr;
-            ++input_ptrs[i];
+          const uint8_t *input_ptr = input_ptrs[i];
+          index_t k = 0;
+#if defined(MACE_ENABLE_NEON)
+          const float32x4_t vscale = vdupq_n_f32(scale);
+          // round half up by truncating, negatives saturate to 0 anyway
+          const float32x4_t voffset = vdupq_n_f32(offset + 0.5f);
+          for (; k + 8 <= outer_sizes[i]; k += 8) {
+            const uint16x8_t vin = vmovl_u8(vld1_u8(input_ptr + k));
+            const float32x4_t vout0 = vmlaq_f32(
+                voffset, vcvtq_f32_u32(vmovl_u16(vget_low_u16(vin))), vscale);
+            const float32x4_t vout1 = vmlaq_f32(
+                voffset, vcvtq_f32_u32(vmovl_u16(vget_high_u16(vin))),
+                vscale);
+            const int16x8_t vout = vcombine_s16(
+                vqmovn_s32(vcvtq_s32_f32(vout0)),
+                vqmovn_s32(vcvtq_s32_f32(vout1)));
+            vst1_u8(output_ptr + k, vqmovun_s16(vout));
           }
+#endif
+          for (; k < outer_sizes[i]; ++k) {
+            float out = input_ptr[k] * scale + offset;
+            output_ptr[k] = Saturate<uint8_t>(roundf(out));
+          }
+          output_ptr += outer_sizes[i];
+          input_ptrs[i] += outer_sizes[i];
         }
       }
     }
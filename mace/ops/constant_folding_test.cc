@@ -0,0 +1,177 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "mace/core/constant_folding.h"
+#include "mace/ops/common/eltwise_type.h"
+#include "mace/ops/ops_test_util.h"
+
+namespace mace {
+namespace ops {
+namespace test {
+
+class ConstantFoldingTest : public OpsTestBase {};
+
+namespace {
+
+const std::vector<index_t> kInputShape = {2, 12};
+const std::vector<index_t> kWeightShape = {4, 6};
+
+void AddActivation(const std::string &input,
+                   const std::string &output,
+                   const std::vector<index_t> &shape,
+                   const char *activation,
+                   NetDef *net_def) {
+  OpDefBuilder("Activation", output + "Op")
+      .Input(input)
+      .Output(output)
+      .OutputShape(shape)
+      .AddStringArg("activation", activation)
+      .Finalize(net_def->add_op());
+}
+
+void AddEltwise(const std::string &input0,
+                const std::string &input1,
+                const std::string &output,
+                const std::vector<index_t> &shape,
+                const EltwiseType type,
+                NetDef *net_def) {
+  OpDefBuilder("Eltwise", output + "Op")
+      .Input(input0)
+      .Input(input1)
+      .Output(output)
+      .OutputShape(shape)
+      .AddIntArg("type", static_cast<int>(type))
+      .Finalize(net_def->add_op());
+}
+
+void AddReshape(const std::string &input,
+                const std::string &shape_input,
+                const std::string &output,
+                const std::vector<index_t> &shape,
+                NetDef *net_def) {
+  OpDefBuilder("Reshape", output + "Op")
+      .Input(input)
+      .Input(shape_input)
+      .Output(output)
+      .OutputShape(shape)
+      .Finalize(net_def->add_op());
+}
+
+// Input is flattened to 4x6 and scaled by the constant tanh(W0 + W1), then
+// reshaped back to the shape read by Shape from a relu of the input, which
+// nothing else reads.
+NetDef BuildNet() {
+  NetDef net_def;
+  AddNetInput("Input", kInputShape, &net_def);
+  net_def.add_output_info()->set_name("Output");
+  AddActivation("Input", "Relu", kInputShape, "RELU", &net_def);
+  OpDefBuilder("Shape", "ReluShapeOp")
+      .Input("Relu")
+      .Output("ReluShape")
+      .OutputType({DT_INT32})
+      .OutputShape({2})
+      .Finalize(net_def.add_op());
+  AddReshape("Input", "FlatShape", "Flat", kWeightShape, &net_def);
+  AddEltwise("W0", "W1", "Sum", kWeightShape, EltwiseType::SUM, &net_def);
+  AddActivation("Sum", "Scale", kWeightShape, "TANH", &net_def);
+  AddEltwise("Flat", "Scale", "Scaled", kWeightShape, EltwiseType::PROD,
+             &net_def);
+  AddReshape("Scaled", "ReluShape", "Output", kInputShape, &net_def);
+  return net_def;
+}
+
+void AddInputs(const std::vector<float> &input,
+               const std::vector<float> &w0,
+               const std::vector<float> &w1,
+               OpsTestNet *net) {
+  net->AddInputFromArray<DeviceType::CPU, float>("Input", kInputShape, input);
+  net->AddInputFromArray<DeviceType::CPU, float>("W0", kWeightShape, w0,
+                                                 true);
+  net->AddInputFromArray<DeviceType::CPU, float>("W1", kWeightShape, w1,
+                                                 true);
+  net->AddInputFromArray<DeviceType::CPU, int32_t>("FlatShape", {2}, {4, 6},
+                                                   true);
+}
+
+std::vector<std::string> OpOutputs(const NetDef &net_def) {
+  std::vector<std::string> outputs;
+  for (auto &op : net_def.op()) {
+    outputs.push_back(op.output(0));
+  }
+  return outputs;
+}
+
+void TestFolding(const bool fixed_input_shapes,
+                 const std::vector<std::string> &kept_outputs) {
+  std::vector<float> input;
+  std::vector<float> w0;
+  std::vector<float> w1;
+  GenerateRandomRealTypeData(kInputShape, &input, false);
+  GenerateRandomRealTypeData(kWeightShape, &w0, false);
+  GenerateRandomRealTypeData(kWeightShape, &w1, false);
+
+  const NetDef net_def = BuildNet();
+  OpsTestNet net;
+  AddInputs(input, w0, w1, &net);
+  ASSERT_EQ(net.RunNet(net_def, DeviceType::CPU), MaceStatus::MACE_SUCCESS);
+
+  NetDef folded_def = net_def;
+  OpsTestNet folded;
+  AddInputs(input, w0, w1, &folded);
+  std::map<std::string, std::vector<index_t>> input_shapes;
+  ASSERT_EQ(FoldCPUConstantOps(folded.op_registry_.get(), folded.ws(),
+                               OpTestContext::Get()->GetDevice(
+                                   DeviceType::CPU),
+                               fixed_input_shapes, &input_shapes,
+                               &folded_def),
+            MaceStatus::MACE_SUCCESS);
+  EXPECT_LT(folded_def.op_size(), net_def.op_size());
+  EXPECT_EQ(kept_outputs, OpOutputs(folded_def));
+  // the weights only the folded ops read are dropped
+  EXPECT_FALSE(folded.ws()->HasTensor("W0"));
+  EXPECT_FALSE(folded.ws()->HasTensor("W1"));
+  ASSERT_TRUE(folded.ws()->HasTensor("Scale"));
+  EXPECT_TRUE(folded.ws()->GetTensor("Scale")->is_weight());
+  if (fixed_input_shapes) {
+    ASSERT_EQ(1u, input_shapes.count("Input"));
+    EXPECT_EQ(kInputShape, input_shapes["Input"]);
+  } else {
+    EXPECT_TRUE(input_shapes.empty());
+  }
+
+  ASSERT_EQ(folded.RunNet(folded_def, DeviceType::CPU),
+            MaceStatus::MACE_SUCCESS);
+  ExpectTensorNear<float>(*net.GetOutput("Output"),
+                          *folded.GetOutput("Output"), 1e-5);
+}
+
+}  // namespace
+
+TEST_F(ConstantFoldingTest, FixedInputShapes) {
+  // Shape is folded over the input shape, so its relu input is dead
+  TestFolding(true, {"Flat", "Scaled", "Output"});
+}
+
+TEST_F(ConstantFoldingTest, VariableInputShapes) {
+  // only the ops of the weights are folded
+  TestFolding(false, {"Relu", "ReluShape", "Flat", "Scaled", "Output"});
+}
+
+}  // namespace test
+}  // namespace ops
+}  // namespace mace
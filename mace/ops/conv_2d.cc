@@ -16,34 +16,55 @@
 #include <arm_neon.h>
 #endif
 #include <algorithm>
+#include <cmath>
 #include <functional>
 #include <limits>
+#include <map>
 #include <memory>
 #include <string>
 #include <tuple>
+#include <utility>
 #include <vector>
 
+#include "mace/core/cpu_blocked_layout.h"
+#include "mace/core/cpu_nhwc_layout.h"
 #include "mace/core/future.h"
 #include "mace/core/operator.h"
 #include "mace/core/tensor.h"
 #include "mace/ops/activation.h"
 #include "mace/ops/arm/conv_2d_neon.h"
 #include "mace/ops/arm/conv_winograd.h"
+#include "mace/ops/arm/nchwc.h"
+#include "mace/ops/arm/nhwc.h"
 #include "mace/ops/conv_pool_2d_base.h"
+#include "mace/ops/common/bfloat16_gemm.h"
 #include "mace/ops/common/conv_pool_2d_util.h"
+#include "mace/utils/env_time.h"
 #include "mace/utils/memory.h"
 #include "mace/utils/utils.h"
 
 #ifdef MACE_ENABLE_NEON
+#include "mace/ops/arm/fp32/block_sparse.h"
 #include "mace/ops/arm/fp32/conv_2d.h"
 #include "mace/ops/arm/fp32/conv_2d_1x1.h"
+#include "mace/ops/arm/fp32/conv_2d_implicit_gemm.h"
+#elif defined(__x86_64__)
+#include "mace/ops/x86/fp32/conv_2d.h"
 #else
 #include "mace/ops/ref/conv_2d.h"
 #endif  // MACE_ENABLE_NEON
 
+#ifdef MACE_ENABLE_FP16_NEON
+#include "mace/ops/arm/fp16/activation.h"
+#include "mace/ops/arm/fp16/conv_2d.h"
+#endif  // MACE_ENABLE_FP16_NEON
+
 #ifdef MACE_ENABLE_QUANTIZE
 #include "mace/ops/common/gemmlowp_util.h"
 #include "mace/ops/quantization_util.h"
+#ifdef MACE_ENABLE_NEON
+#include "mace/ops/arm/q8/gemm.h"
+#endif  // MACE_ENABLE_NEON
 #endif  // MACE_ENABLE_QUANTIZE
 
 #ifdef MACE_ENABLE_OPENCL
@@ -55,6 +76,64 @@
 namespace mace {
 namespace ops {
 
+namespace {
+// Stores the NCHW conv output, of the channels of a depth to space (DCR) of
+// the block, moved by the depth to space into the output, adding the bias
+// of the conv channels if any. The output is written a row at a time, and
+// row_done runs on each row while it is in the cache.
+template <typename T, typename RowFunc>
+MaceStatus StoreDepthToSpace(const Tensor *conv_output,
+                             const Tensor *bias,
+                             const int block,
+                             RowFunc row_done,
+                             Tensor *output) {
+  const index_t batch = conv_output->dim(0);
+  const index_t in_channels = conv_output->dim(1);
+  const index_t in_height = conv_output->dim(2);
+  const index_t in_width = conv_output->dim(3);
+  MACE_CHECK(in_channels % (block * block) == 0, "Conv2D output channels ",
+             in_channels, " should be dividable by the depth to space of ",
+             block, "x", block);
+  const index_t channels = in_channels / (block * block);
+  const index_t height = in_height * block;
+  const index_t width = in_width * block;
+  MACE_RETURN_IF_ERROR(output->Resize({batch, channels, height, width}));
+
+  Tensor::MappingGuard conv_output_guard(conv_output);
+  Tensor::MappingGuard bias_guard(bias);
+  Tensor::MappingGuard output_guard(output);
+  const T *conv_data = conv_output->data<T>();
+  const T *bias_data = bias == nullptr ? nullptr : bias->data<T>();
+  T *output_data = output->mutable_data<T>();
+#pragma omp parallel for collapse(3) schedule(runtime)
+  for (index_t b = 0; b < batch; ++b) {
+    for (index_t c = 0; c < channels; ++c) {
+      for (index_t h = 0; h < height; ++h) {
+        T *out_row = output_data + ((b * channels + c) * height + h) * width;
+        for (int dx = 0; dx < block; ++dx) {
+          const index_t in_c = ((h % block) * block + dx) * channels + c;
+          const T *in_row = conv_data
+              + ((b * in_channels + in_c) * in_height + h / block) * in_width;
+          T *out = out_row + dx;
+          if (bias_data == nullptr) {
+            for (index_t w = 0; w < in_width; ++w) {
+              out[w * block] = in_row[w];
+            }
+          } else {
+            const T bias_value = bias_data[in_c];
+            for (index_t w = 0; w < in_width; ++w) {
+              out[w * block] = in_row[w] + bias_value;
+            }
+          }
+        }
+        row_done(out_row, width);
+      }
+    }
+  }
+  return MaceStatus::MACE_SUCCESS;
+}
+}  // namespace
+
 template <DeviceType D, class T>
 class Conv2dOp;
 
@@ -69,26 +148,170 @@ class Conv2dOp<DeviceType::CPU, float> : public ConvPool2dOpBase {
         relux_max_limit_(Operation::GetOptionalArg<float>("max_limit", 0.0f)),
         leakyrelu_coefficient_(Operation::GetOptionalArg<float>(
               "leakyrelu_coefficient", 0.0f)),
-        is_filter_transformed_(false),
+        has_residual_(Operation::GetOptionalArg<int>("residual", 0) == 1),
+        depth_to_space_(Operation::GetOptionalArg<int>("depth_to_space", 1)),
+        channel_block_(Operation::GetOptionalArg<int>(kChannelBlockArg, 0)),
+        nchwc_filter_(nullptr),
+        nhwc_(Operation::GetOptionalArg<int>(kNHWCArg, 0) == 1),
+        nhwc_filter_(nullptr),
+        sparse_filter_(nullptr),
+        bf16_filter_(nullptr),
         conv2d_delegator_(nullptr) {}
 
+  MaceStatus Init(OpInitContext *context) override {
+    MACE_RETURN_IF_ERROR(Operation::Init(context));
+    Workspace *ws = context->workspace();
+    const Tensor *filter = this->Input(FILTER);
+    // packed concurrently with the weights of the other ops
+    return context->RunOrDefer([this, ws, filter]() {
+      return PackWeights(ws, filter);
+    });
+  }
+
   MaceStatus Run(OpContext *context) override {
     const Tensor *input = this->Input(INPUT);
     const Tensor *filter = this->Input(FILTER);
-    const Tensor *bias = this->InputSize() >= 3 ? this->Input(BIAS) : nullptr;
+    const Tensor *bias = this->InputSize() >= (has_residual_ ? 4 : 3) ?
+                         this->Input(BIAS) : nullptr;
+    // the residual, added before the activation, is the last input
+    const Tensor *residual =
+        has_residual_ ? this->Input(this->InputSize() - 1) : nullptr;
     Tensor *output = this->Output(OUTPUT);
+    if (channel_block_ > 0) {
+      return RunNCHWc(input, filter, bias, residual, output);
+    }
+    if (nhwc_) {
+      return RunNHWC(input, filter, bias, residual, output);
+    }
+    if (depth_to_space_ > 1) {
+      // the conv output is stored moved by the depth to space, with the bias
+      // and the activation
+      MACE_CHECK(residual == nullptr,
+                 "Conv2D reads no residual with depth to space");
+      MACE_RETURN_IF_ERROR(RunConv(context, input, filter, &conv_output_));
+      return StoreDepthToSpace<float>(
+          &conv_output_, bias, depth_to_space_,
+          [this](float *row, const index_t size) {
+            DoActivation(row, row, size, activation_, relux_max_limit_,
+                         leakyrelu_coefficient_);
+          }, output);
+    }
+    MACE_RETURN_IF_ERROR(RunConv(context, input, filter, output));
+
+    const index_t batch = output->dim(0);
+    const index_t channels = output->dim(1);
+    const index_t height = output->dim(2);
+    const index_t width = output->dim(3);
+
+    if (residual != nullptr) {
+      MACE_CHECK(residual->shape() == output->shape(),
+                 "Conv2D residual should be of the output shape");
+    }
+    Tensor::MappingGuard bias_guard(bias);
+    Tensor::MappingGuard residual_guard(residual);
+    Tensor::MappingGuard output_guard(output);
+    auto bias_data = bias == nullptr ? nullptr : bias->data<float>();
+    auto residual_data =
+        residual == nullptr ? nullptr : residual->data<float>();
+    auto output_data = output->mutable_data<float>();
+    if (bias_data != nullptr || residual_data != nullptr) {
+      const index_t image_size = height * width;
+#pragma omp parallel for collapse(2) schedule(runtime)
+      for (index_t b = 0; b < batch; ++b) {
+        for (index_t c = 0; c < channels; ++c) {
+          const index_t offset = (b * channels + c) * image_size;
+          float *output_ptr = output_data + offset;
+          const float bias = bias_data == nullptr ? 0.f : bias_data[c];
+          if (residual_data != nullptr) {
+            AddBiasAndResidual(bias, residual_data + offset, image_size,
+                               output_ptr);
+            continue;
+          }
+#if defined(MACE_ENABLE_NEON)
+          float32x4_t vbias = vdupq_n_f32(bias);
+          for (index_t i = 0; i <= image_size - 4; i += 4) {
+            float32x4_t v = vld1q_f32(output_ptr + i);
+            v = vaddq_f32(v, vbias);
+            vst1q_f32(output_ptr + i, v);
+          }
+          for (index_t i = (image_size >> 2) << 2; i < image_size; ++i) {
+            output_ptr[i] += bias;
+          }
+#else
+          for (index_t i = 0; i < image_size; ++i) {
+            output_ptr[i] += bias;
+          }
+#endif
+        }
+      }
+    }
+
+    DoActivation(output_data, output_data, output->size(), activation_,
+                 relux_max_limit_, leakyrelu_coefficient_);
+
+    return MaceStatus::MACE_SUCCESS;
+  }
+
+ private:
+  MaceStatus PackWeights(Workspace *ws, const Tensor *filter) {
+    if (filter->dtype() == DT_BFLOAT16) {
+      // the 1x1 filter converted to bfloat16 for the engine, see
+      // ConvertToCPUBFloat16
+      bf16_filter_ = BFloat16Gemm::PackWeight(
+          ws->packed_weights(), filter, filter->dim(0), filter->dim(1));
+      return MaceStatus::MACE_SUCCESS;
+    }
+    if (channel_block_ > 0) {
+      // the constant filter in the blocks of the NCHWc kernel
+      nchwc_filter_ = GetConv2dNCHWcFilter(ws->packed_weights(), filter,
+                                           channel_block_);
+      return MaceStatus::MACE_SUCCESS;
+    }
+    if (nhwc_) {
+      // the constant 1x1 filter as [I, O] of the NHWC GEMM
+      nhwc_filter_ = GetConv2dK1x1NHWCFilter(ws->packed_weights(), filter);
+      return MaceStatus::MACE_SUCCESS;
+    }
+#ifdef MACE_ENABLE_NEON
+    // pack the constant filter of 1x1 conv once, before the first run, the
+    // nonzero blocks only if the converter found it pruned
+    if (filter->is_weight() && Applicable(CONV2D_GEMM_1X1, filter) &&
+        Operation::GetOptionalArg<int>(arm::fp32::kSparseWeightArg, 0) == 1) {
+      sparse_filter_ = arm::fp32::GetBlockSparseWeight(
+          ws->packed_weights(), filter, filter->dim(0), filter->dim(1));
+    } else if (filter->is_weight() && Applicable(CONV2D_GEMM_1X1, filter)) {
+      auto conv2d_k1x1 = make_unique<arm::fp32::Conv2dK1x1>();
+      conv2d_k1x1->PackFilter(ws, filter);
+      conv2d_delegator_ = std::move(conv2d_k1x1);
+    }
+    // transform the constant filter of winograd for the output shape, if it
+    // is known, once for all runs
+    if (filter->is_weight() && UseWinograd(filter)
+        && operator_def_->output_shape_size() > 0
+        && operator_def_->output_shape(0).dims_size() == 4) {
+      // the output shape after the depth to space of the conv output
+      const auto &output_shape = operator_def_->output_shape(0);
+      const int out_tile_size = WinogradOutTileSize(
+          filter->dim(1), filter->dim(0),
+          output_shape.dims(2) / depth_to_space_,
+          output_shape.dims(3) / depth_to_space_);
+      transformed_filters_[out_tile_size] = GetTransformedFilter(
+          ws->packed_weights(), filter, out_tile_size);
+    }
+#endif  // MACE_ENABLE_NEON
+    return MaceStatus::MACE_SUCCESS;
+  }
 
+  // the conv, without the bias, the residual and the activation
+  MaceStatus RunConv(OpContext *context,
+                     const Tensor *input,
+                     const Tensor *filter,
+                     Tensor *output) {
     index_t input_batch = input->dim(0);
     index_t input_channels = input->dim(1);
     std::vector<index_t> filter_shape(4);
     filter_shape = filter->shape();
 
-    index_t stride_h = strides_[0];
-    index_t stride_w = strides_[1];
-
-    index_t dilation_h = dilations_[0];
-    index_t dilation_w = dilations_[1];
-
     std::vector<index_t> output_shape(4);
     std::vector<int> paddings(2);
     if (paddings_.empty()) {
@@ -113,449 +336,744 @@ class Conv2dOp<DeviceType::CPU, float> : public ConvPool2dOpBase {
 
     index_t batch = output->dim(0);
     index_t channels = output->dim(1);
-    index_t height = output->dim(2);
-    index_t width = output->dim(3);
 
     MACE_CHECK(batch == input_batch, "Input/Output batch size mismatch");
     MACE_CHECK(filter_shape[0] == channels, filter_shape[0], " != ", channels);
     MACE_CHECK(filter_shape[1] == input_channels, filter_shape[1], " != ",
                input_channels);
 
+    if (bf16_filter_ != nullptr) {
+      return RunBFloat16K1x1(input, output);
+    }
+
 #ifdef MACE_ENABLE_NEON
-    index_t input_height = input->dim(2);
-    index_t input_width = input->dim(3);
-    index_t filter_h = filter->dim(2);
-    index_t filter_w = filter->dim(3);
-
-    if (filter_h == 1 && filter_w == 1 && stride_h == 1 && stride_w == 1
-        && dilation_h == 1 && dilation_w == 1) {
-      if (conv2d_delegator_.get() == nullptr) {
-        conv2d_delegator_ = make_unique<arm::fp32::Conv2dK1x1>();
-      }
-      conv2d_delegator_->Compute(context, input, filter, output);
+    const Conv2dAlgorithm algorithm =
+        SelectAlgorithm(context, input, filter, paddings, output);
+    MACE_RETURN_IF_ERROR(
+        Compute(algorithm, context, input, filter, paddings, output));
+#elif defined(__x86_64__)
+    if (conv2d_delegator_.get() == nullptr) {
+      conv2d_delegator_ = make_unique<x86::fp32::Conv2d>(paddings[0],
+                                                         paddings[1],
+                                                         strides_[0],
+                                                         strides_[1],
+                                                         dilations_[0],
+                                                         dilations_[1]);
+    }
+    MACE_RETURN_IF_ERROR(
+        conv2d_delegator_->Compute(context, input, filter, output));
+#else
+    if (conv2d_delegator_.get() == nullptr) {
+      conv2d_delegator_ = make_unique<ref::Conv2d<float>>(paddings[0],
+                                                          paddings[1],
+                                                          strides_[0],
+                                                          strides_[1],
+                                                          dilations_[0],
+                                                          dilations_[1]);
+    }
+    conv2d_delegator_->Compute(context, input, filter, output);
+#endif
+    return MaceStatus::MACE_SUCCESS;
+  }
+
+  static void AddBiasAndResidual(const float bias,
+                                 const float *residual,
+                                 const index_t size,
+                                 float *output) {
+    index_t i = 0;
+#if defined(MACE_ENABLE_NEON)
+    float32x4_t vbias = vdupq_n_f32(bias);
+    for (; i + 4 <= size; i += 4) {
+      float32x4_t v = vaddq_f32(vld1q_f32(output + i), vbias);
+      vst1q_f32(output + i, vaddq_f32(v, vld1q_f32(residual + i)));
+    }
+#endif
+    for (; i < size; ++i) {
+      output[i] += bias + residual[i];
+    }
+  }
+
+  // the input and the output in NCHWc, [N, C / block, H, W, block]
+  // the 1x1 conv of stride 1 of each image as the product of the filter by
+  // the [channels, pixels] input, without the bias
+  MaceStatus RunBFloat16K1x1(const Tensor *input, Tensor *output) {
+    const index_t batch = input->dim(0);
+    const index_t in_channels = input->dim(1);
+    const index_t out_channels = output->dim(1);
+    const index_t image_size = input->dim(2) * input->dim(3);
+    MACE_CHECK(output->dim(2) * output->dim(3) == image_size,
+               "bfloat16 Conv2D is a 1x1 conv of stride 1 without padding");
+    Tensor::MappingGuard input_guard(input);
+    Tensor::MappingGuard output_guard(output);
+    const float *input_data = input->data<float>();
+    float *output_data = output->mutable_data<float>();
+    for (index_t b = 0; b < batch; ++b) {
+      bf16_gemm_.Compute(bf16_filter_,
+                         input_data + b * in_channels * image_size, 1,
+                         image_size, nullptr, out_channels, image_size,
+                         in_channels, image_size, 1,
+                         output_data + b * out_channels * image_size);
+    }
+    return MaceStatus::MACE_SUCCESS;
+  }
+
+  MaceStatus RunNCHWc(const Tensor *input,
+                      const Tensor *filter,
+                      const Tensor *bias,
+                      const Tensor *residual,
+                      Tensor *output) {
+    MACE_CHECK(input->dim_size() == 5 && input->dim(4) == channel_block_,
+               "NCHWc input should be 5D of block ", channel_block_);
+    const std::vector<index_t> input_shape = {
+        input->dim(0), input->dim(1) * channel_block_, input->dim(2),
+        input->dim(3)};
+    MACE_CHECK(filter->dim(1) == input_shape[1], filter->dim(1), " != ",
+               input_shape[1]);
+    std::vector<index_t> output_shape(4);
+    std::vector<int> paddings(2);
+    CalcNCHWOutputShape(input_shape.data(), filter->shape().data(),
+                        RoundType::FLOOR, output_shape.data(),
+                        paddings.data());
+    MACE_RETURN_IF_ERROR(output->Resize(
+        {output_shape[0], output_shape[1] / channel_block_, output_shape[2],
+         output_shape[3], channel_block_}));
+
+    Tensor::MappingGuard input_guard(input);
+    Tensor::MappingGuard bias_guard(bias);
+    Tensor::MappingGuard output_guard(output);
+    float *output_data = output->mutable_data<float>();
+    const int pad_hw[2] = {paddings[0] >> 1, paddings[1] >> 1};
+    Conv2dNCHWc(input->data<float>(), nchwc_filter_,
+                bias == nullptr ? nullptr : bias->data<float>(),
+                input_shape.data(), output_shape.data(),
+                filter->shape().data(), strides_.data(), dilations_.data(),
+                pad_hw, channel_block_, output_data);
+    if (residual != nullptr) {
+      // the residual is blocked as the output
+      MACE_CHECK(residual->shape() == output->shape(),
+                 "Conv2D residual should be of the output shape");
+      Tensor::MappingGuard residual_guard(residual);
+      AddBiasAndResidual(0.f, residual->data<float>(), output->size(),
+                         output_data);
+    }
+    DoActivation(output_data, output_data, output->size(), activation_,
+                 relux_max_limit_, leakyrelu_coefficient_);
+    return MaceStatus::MACE_SUCCESS;
+  }
+
+  // the 1x1 conv of the input and the output in NHWC
+  MaceStatus RunNHWC(const Tensor *input,
+                     const Tensor *filter,
+                     const Tensor *bias,
+                     const Tensor *residual,
+                     Tensor *output) {
+    MACE_CHECK(input->dim_size() == 4 && filter->dim(2) == 1 &&
+               filter->dim(3) == 1, "NHWC conv should be 1x1 of 4D input");
+    MACE_CHECK(filter->dim(1) == input->dim(3), filter->dim(1), " != ",
+               input->dim(3));
+    const std::vector<index_t> input_shape = {
+        input->dim(0), input->dim(3), input->dim(1), input->dim(2)};
+    std::vector<index_t> output_shape(4);
+    std::vector<int> paddings(2);
+    CalcNCHWOutputShape(input_shape.data(), filter->shape().data(),
+                        RoundType::FLOOR, output_shape.data(),
+                        paddings.data());
+    output_shape = {output_shape[0], output_shape[2], output_shape[3],
+                    output_shape[1]};
+    MACE_RETURN_IF_ERROR(output->Resize(output_shape));
+
+    Tensor::MappingGuard input_guard(input);
+    Tensor::MappingGuard bias_guard(bias);
+    Tensor::MappingGuard output_guard(output);
+    float *output_data = output->mutable_data<float>();
+    const int pad_hw[2] = {paddings[0] >> 1, paddings[1] >> 1};
+    Conv2dK1x1NHWC(input->data<float>(), nhwc_filter_,
+                   bias == nullptr ? nullptr : bias->data<float>(),
+                   input->shape().data(), output_shape.data(),
+                   strides_.data(), pad_hw, output_data);
+    if (residual != nullptr) {
+      MACE_CHECK(residual->shape() == output->shape(),
+                 "Conv2D residual should be of the output shape");
+      Tensor::MappingGuard residual_guard(residual);
+      AddBiasAndResidual(0.f, residual->data<float>(), output->size(),
+                         output_data);
+    }
+    DoActivation(output_data, output_data, output->size(), activation_,
+                 relux_max_limit_, leakyrelu_coefficient_);
+    return MaceStatus::MACE_SUCCESS;
+  }
+
+#ifdef MACE_ENABLE_NEON
+  // the CPU kernels of float conv, the values are kept in the files of the
+  // algorithm cache and must not change
+  enum Conv2dAlgorithm {
+    CONV2D_GEMM_1X1 = 0,
+    CONV2D_IMPLICIT_GEMM = 1,
+    CONV2D_WINOGRAD = 2,
+    CONV2D_DIRECT = 3,
+    CONV2D_SPARSE_1X1 = 4,
+  };
+
+  bool Applicable(const Conv2dAlgorithm algorithm,
+                  const Tensor *filter) const {
+    switch (algorithm) {
+      case CONV2D_GEMM_1X1:
+        return filter->dim(2) == 1 && filter->dim(3) == 1
+            && strides_[0] == 1 && strides_[1] == 1
+            && dilations_[0] == 1 && dilations_[1] == 1;
+      case CONV2D_WINOGRAD:
+        return UseWinograd(filter);
+      case CONV2D_IMPLICIT_GEMM:
+      case CONV2D_DIRECT:
+        return true;
+      case CONV2D_SPARSE_1X1:
+        return sparse_filter_ != nullptr;
+    }
+    return false;
+  }
+
+  // whether a NEON kernel is specialized for the filter size and strides,
+  // the other shapes run the generic loops of Conv2dGeneral
+  bool HasDirectKernel(const Tensor *filter) const {
+    const index_t filter_h = filter->dim(2);
+    const index_t filter_w = filter->dim(3);
+    const int stride = strides_[0];
+    if (dilations_[0] != 1 || dilations_[1] != 1 || strides_[1] != stride) {
+      return false;
+    }
+    if (filter_h == filter_w) {
+      return (filter_h == 3 && stride <= 2) || (filter_h == 5 && stride == 1)
+          || (filter_h == 7 && stride <= 3);
+    }
+    return stride == 1 && std::min(filter_h, filter_w) == 1
+        && (std::max(filter_h, filter_w) == 7
+            || std::max(filter_h, filter_w) == 15);
+  }
+
+  // the block-sparse gemm for pruned 1x1 convs, gemm for the other 1x1 convs,
+  // winograd where it applies, the direct kernels specialized for the shape
+  // and implicit gemm for the others, if the algorithms are not benchmarked
+  Conv2dAlgorithm DefaultAlgorithm(const Tensor *filter) const {
+    if (Applicable(CONV2D_SPARSE_1X1, filter)) {
+      return CONV2D_SPARSE_1X1;
+    } else if (Applicable(CONV2D_GEMM_1X1, filter)) {
+      return CONV2D_GEMM_1X1;
+    } else if (Applicable(CONV2D_WINOGRAD, filter)) {
+      return CONV2D_WINOGRAD;
+    } else if (HasDirectKernel(filter)) {
+      return CONV2D_DIRECT;
     } else {
-      // TODO(liyin): the code below needs to be refactored.
-      // delegate to each of kernels instead of ruling them all
-      index_t padded_input_height = input_height + paddings[0];
-      index_t padded_input_width = input_width + paddings[1];
-      index_t extra_input_height = padded_input_height;
-      index_t extra_input_width = padded_input_width;
-      index_t extra_output_height = height;
-      index_t extra_output_width = width;
-
-      int pad_top = paddings[0] >> 1;
-      int pad_bottom = paddings[0] - pad_top;
-      int pad_left = paddings[1] >> 1;
-      int pad_right = paddings[1] - pad_left;
-
-      Tensor::MappingGuard input_guard(input);
-      Tensor::MappingGuard filter_guard(filter);
-      Tensor::MappingGuard output_guard(output);
-
-      auto filter_data = filter->data<float>();
-      auto output_data = output->mutable_data<float>();
-
-      std::function<void(const float *input, float *output)> conv_func;
-
-      bool
-          use_winograd = filter_h == 3 && filter_w == 3
-          && stride_h == 1 && stride_w == 1 && dilation_h == 1
-          && dilation_w == 1
-          && input_channels >= 8 && channels >= 8;
-      bool use_neon_3x3_s1 = filter_h == 3 && filter_w == 3
-          && stride_h == 1 && stride_w == 1 && dilation_h == 1
-          && dilation_w == 1;
-      bool use_neon_3x3_s2 = filter_h == 3 && filter_w == 3
-          && stride_h == 2 && stride_w == 2 && dilation_h == 1
-          && dilation_w == 1;
-      bool use_neon_5x5_s1 = filter_h == 5 && filter_w == 5
-          && stride_h == 1 && stride_w == 1 && dilation_h == 1
-          && dilation_w == 1;
-      bool use_neon_1x7_s1 = filter_h == 1 && filter_w == 7
-          && stride_h == 1 && stride_w == 1 && dilation_h == 1
-          && dilation_w == 1;
-      bool use_neon_7x1_s1 = filter_h == 7 && filter_w == 1
-          && stride_h == 1 && stride_w == 1 && dilation_h == 1
-          && dilation_w == 1;
-      bool use_neon_7x7_s1 = filter_h == 7 && filter_w == 7
-          && stride_h == 1 && stride_w == 1 && dilation_h == 1
-          && dilation_w == 1;
-      bool use_neon_7x7_s2 = filter_h == 7 && filter_w == 7
-          && stride_h == 2 && stride_w == 2 && dilation_h == 1
-          && dilation_w == 1;
-      bool use_neon_7x7_s3 = filter_h == 7 && filter_w == 7
-          && stride_h == 3 && stride_w == 3 && dilation_h == 1
-          && dilation_w == 1;
-      bool use_neon_1x15_s1 = filter_h == 1 && filter_w == 15
-          && stride_h == 1 && stride_w == 1 && dilation_h == 1
-          && dilation_w == 1;
-      bool use_neon_15x1_s1 = filter_h == 15 && filter_w == 1
-          && stride_h == 1 && stride_w == 1 && dilation_h == 1
-          && dilation_w == 1;
-
-      std::vector<index_t> transformed_input_shape;
-      std::vector<index_t> transformed_output_shape;
-      std::vector<index_t> transformed_filter_shape;
-
-      // When size of input feature map is bigger than 16x16,
-      // set winograd out tile size to 6 to get higher performance.
-      index_t winograd_out_tile_size = 2;
-      if (input_height > 16 && input_width > 16) {
-        winograd_out_tile_size = 6;
-      }
+      return CONV2D_IMPLICIT_GEMM;
+    }
+  }
+
+  // the algorithm of the input shape, looked up in the algorithm cache, or
+  // benchmarked and added to it if the cache is tuning
+  Conv2dAlgorithm SelectAlgorithm(const OpContext *context,
+                                  const Tensor *input,
+                                  const Tensor *filter,
+                                  const std::vector<int> &paddings,
+                                  Tensor *output) {
+    if (input->shape() == algorithm_input_shape_) {
+      return algorithm_;
+    }
+    algorithm_input_shape_ = input->shape();
+    algorithm_ = DefaultAlgorithm(filter);
+    AlgorithmCache *cache = context->workspace()->algorithm_cache();
+    const std::string key = MakeString(
+        "Conv2D/fp32/", MakeString(input->shape()), "/",
+        MakeString(filter->shape()), "/", MakeString(strides_), "/",
+        MakeString(dilations_), "/", MakeString(paddings), "/",
+        context->device()->cpu_runtime()->num_threads());
+    int cached = 0;
+    if (cache->Find(key, &cached) && cached >= CONV2D_GEMM_1X1
+        && cached <= CONV2D_SPARSE_1X1
+        && Applicable(static_cast<Conv2dAlgorithm>(cached), filter)) {
+      algorithm_ = static_cast<Conv2dAlgorithm>(cached);
+    } else if (cache->tuning()) {
+      algorithm_ = TuneAlgorithm(context, input, filter, paddings, output);
+      cache->Insert(key, algorithm_);
+    }
+    cache->Selected(algorithm_);
+    return algorithm_;
+  }
 
-      if (use_winograd) {
-        extra_output_height = RoundUp<index_t>(height, winograd_out_tile_size);
-        extra_input_height =
-            std::max(padded_input_height, extra_output_height + 2);
-        extra_output_width = RoundUp<index_t>(width, winograd_out_tile_size);
-        extra_input_width =
-            std::max(padded_input_width, extra_output_width + 2);
-        if (extra_input_height != padded_input_height) {
-          pad_bottom += (extra_input_height - padded_input_height);
+  // the fastest of the algorithms which apply, timed by the best of a few
+  // runs after a warm-up run, which also packs the weights of the algorithm
+  Conv2dAlgorithm TuneAlgorithm(const OpContext *context,
+                                const Tensor *input,
+                                const Tensor *filter,
+                                const std::vector<int> &paddings,
+                                Tensor *output) {
+    constexpr int kTuningRuns = 3;
+    Conv2dAlgorithm best_algorithm = DefaultAlgorithm(filter);
+    int64_t best_time = std::numeric_limits<int64_t>::max();
+    for (int i = CONV2D_GEMM_1X1; i <= CONV2D_SPARSE_1X1; ++i) {
+      const Conv2dAlgorithm algorithm = static_cast<Conv2dAlgorithm>(i);
+      if (!Applicable(algorithm, filter)) {
+        continue;
+      }
+      int64_t time = std::numeric_limits<int64_t>::max();
+      for (int run = 0; run <= kTuningRuns; ++run) {
+        const int64_t start = NowMicros();
+        if (Compute(algorithm, context, input, filter, paddings, output)
+            != MaceStatus::MACE_SUCCESS) {
+          time = std::numeric_limits<int64_t>::max();
+          break;
         }
-        if (extra_input_width != padded_input_width) {
-          pad_right += (extra_input_width - padded_input_width);
+        if (run > 0) {
+          time = std::min(time, NowMicros() - start);
         }
+      }
+      VLOG(2) << "Conv2D " << operator_def_->name() << " algorithm "
+              << algorithm << ": " << time << " us";
+      if (time < best_time) {
+        best_algorithm = algorithm;
+        best_time = time;
+      }
+    }
+    return best_algorithm;
+  }
 
-        index_t
-            tile_height_count = extra_output_height / winograd_out_tile_size;
-        index_t tile_width_count = extra_output_width / winograd_out_tile_size;
-        index_t tile_count = tile_height_count * tile_width_count;
-        index_t in_tile_area =
-            (winograd_out_tile_size + 2) * (winograd_out_tile_size + 2);
-
-        transformed_input_shape.insert(transformed_input_shape.end(),
-                                       {in_tile_area, batch, input_channels,
-                                        tile_count});
-        transformed_output_shape.insert(transformed_output_shape.end(),
-                                        {in_tile_area, batch, channels,
-                                         tile_count});
-        transformed_filter_shape.insert(transformed_filter_shape.end(),
-                                        {in_tile_area, channels,
-                                         input_channels});
-      } else {
-        index_t tile_h, tile_w;
-        if (use_neon_3x3_s1) {
-          tile_h = 2;
-          tile_w = 4;
-        } else if (use_neon_7x1_s1 || use_neon_15x1_s1) {
-          tile_h = 4;
-          tile_w = 1;
-        } else {
-          tile_h = 1;
-          tile_w = 4;
+  MaceStatus Compute(const Conv2dAlgorithm algorithm,
+                     const OpContext *context,
+                     const Tensor *input,
+                     const Tensor *filter,
+                     const std::vector<int> &paddings,
+                     Tensor *output) {
+    switch (algorithm) {
+      case CONV2D_GEMM_1X1:
+        if (conv2d_delegator_.get() == nullptr) {
+          conv2d_delegator_ = make_unique<arm::fp32::Conv2dK1x1>();
         }
-        extra_output_height = RoundUp<index_t>(height, tile_h);
-        extra_input_height =
-            std::max(padded_input_height, (extra_output_height - 1) * stride_h
-                + (filter_h - 1) * dilation_h + 1);
-        extra_output_width = RoundUp<index_t>(width, tile_w);
-        extra_input_width =
-            std::max(padded_input_width, (extra_output_width - 1) * stride_w
-                + (filter_w - 1) * dilation_w + 1);
-        if (extra_input_height != padded_input_height) {
-          pad_bottom += (extra_input_height - padded_input_height);
-        }
-        if (extra_input_width != padded_input_width) {
-          pad_right += (extra_input_width - padded_input_width);
+        return conv2d_delegator_->Compute(context, input, filter, output);
+      case CONV2D_IMPLICIT_GEMM:
+        if (implicit_gemm_delegator_.get() == nullptr) {
+          implicit_gemm_delegator_ =
+              make_unique<arm::fp32::Conv2dImplicitGemm>(
+                  strides_, dilations_, paddings_, padding_type_);
         }
+        return implicit_gemm_delegator_->Compute(context, input, filter,
+                                                 output);
+      case CONV2D_WINOGRAD:
+      case CONV2D_DIRECT:
+        return ComputePadded(context, input, filter, paddings,
+                             algorithm == CONV2D_WINOGRAD, output);
+      case CONV2D_SPARSE_1X1: {
+        Tensor::MappingGuard input_guard(input);
+        Tensor::MappingGuard output_guard(output);
+        arm::fp32::BlockSparseGemm(sparse_filter_, filter->dim(0),
+                                   filter->dim(1), input->data<float>(),
+                                   input->dim(0),
+                                   input->dim(2) * input->dim(3),
+                                   output->mutable_data<float>());
+        return MaceStatus::MACE_SUCCESS;
       }
+    }
+    return MaceStatus::MACE_INVALID_ARGS;
+  }
 
-      // decide scratch size before allocate it
-      index_t total_scratch_size = 0;
-      index_t transformed_input_size = 0;
-      index_t transformed_output_size = 0;
-      index_t padded_input_size = 0;
-      index_t padded_output_size = 0;
-      if (use_winograd) {
-        transformed_input_size =
-            std::accumulate(transformed_input_shape.begin(),
-                            transformed_input_shape.end(),
-                            1,
-                            std::multiplies<index_t>()) * sizeof(float);
-        transformed_output_size =
-            std::accumulate(transformed_output_shape.begin(),
-                            transformed_output_shape.end(),
-                            1,
-                            std::multiplies<index_t>()) * sizeof(float);
-        total_scratch_size += transformed_input_size + transformed_output_size;
-      }
-      if (extra_input_height != input_height
-          || extra_input_width != input_width) {
-        padded_input_size =
-            batch * input_channels * (input_height + pad_top + pad_bottom)
-                * (input_width + pad_left + pad_right) * sizeof(float) +
-                MACE_EXTRA_BUFFER_PAD_SIZE;
-        total_scratch_size += padded_input_size;
-      }
-      if (extra_output_height != height || extra_output_width != width) {
-        padded_output_size =
-            batch * channels * extra_output_height * extra_output_width
-                * sizeof(float);
-        total_scratch_size += padded_output_size;
-      }
+  // winograd or the direct kernels of the filter size, on the input padded
+  // to the tiles of the kernel
+  MaceStatus ComputePadded(const OpContext *context,
+                           const Tensor *input,
+                           const Tensor *filter,
+                           const std::vector<int> &paddings,
+                           const bool use_winograd,
+                           Tensor *output) {
+    const index_t batch = output->dim(0);
+    const index_t channels = output->dim(1);
+    const index_t height = output->dim(2);
+    const index_t width = output->dim(3);
+    const index_t input_channels = input->dim(1);
+    const index_t input_height = input->dim(2);
+    const index_t input_width = input->dim(3);
+    const std::vector<index_t> filter_shape = filter->shape();
+    const index_t filter_h = filter_shape[2];
+    const index_t filter_w = filter_shape[3];
+    const index_t stride_h = strides_[0];
+    const index_t stride_w = strides_[1];
+    const index_t dilation_h = dilations_[0];
+    const index_t dilation_w = dilations_[1];
+
+    index_t padded_input_height = input_height + paddings[0];
+    index_t padded_input_width = input_width + paddings[1];
+    index_t extra_input_height = padded_input_height;
+    index_t extra_input_width = padded_input_width;
+    index_t extra_output_height = height;
+    index_t extra_output_width = width;
+
+    int pad_top = paddings[0] >> 1;
+    int pad_bottom = paddings[0] - pad_top;
+    int pad_left = paddings[1] >> 1;
+    int pad_right = paddings[1] - pad_left;
 
-      if (use_winograd) {
-        total_scratch_size += transformed_input_size + transformed_output_size;
-      }
+    Tensor::MappingGuard input_guard(input);
+    Tensor::MappingGuard filter_guard(filter);
+    Tensor::MappingGuard output_guard(output);
 
-      // Init scratch buffer
-      ScratchBuffer *scratch = context->device()->scratch_buffer();
-      scratch->Rewind();
-      scratch->GrowSize(total_scratch_size);
-      Tensor
-          transformed_input(scratch->Scratch(transformed_input_size), DT_FLOAT);
-      Tensor
-          transformed_output
-          (scratch->Scratch(transformed_output_size), DT_FLOAT);
-      Tensor padded_input(scratch->Scratch(padded_input_size), DT_FLOAT);
-      Tensor padded_output(scratch->Scratch(padded_output_size), DT_FLOAT);
-      const index_t extra_input_shape[4] =
-          {batch, input_channels, extra_input_height, extra_input_width};
-      const index_t extra_output_shape[4] =
-          {batch, channels, extra_output_height, extra_output_width};
-
-      // make host compiler happy
-      MACE_UNUSED(extra_input_shape);
-      MACE_UNUSED(extra_output_shape);
-
-      Tensor transformed_filter;
-
-      // decide which convolution function to call
-      if (use_winograd) {
-        transformed_input.Reshape(transformed_input_shape);
-        transformed_output.Reshape(transformed_output_shape);
-        const float *transformed_filter_data = nullptr;
-        // filter only needs to be transformed once, set transformed_filter_data
-        // to null after the first run.
-        if (!is_filter_transformed_) {
-          transformed_filter.Resize(transformed_filter_shape);
-          switch (winograd_out_tile_size) {
-            case 2:
-              TransformFilter4x4(filter_data,
-                                 filter_shape[1],
-                                 filter_shape[0],
-                                 transformed_filter.mutable_data<float>());
-              break;
-            case 6:
-              TransformFilter8x8(filter_data,
-                                 filter_shape[1],
-                                 filter_shape[0],
-                                 transformed_filter.mutable_data<float>());
-              break;
-            default:MACE_NOT_IMPLEMENTED;
-          }
-          transformed_filter_data = transformed_filter.data<float>();
-          is_filter_transformed_ = true;
-        }
+    auto filter_data = filter->data<float>();
+    auto output_data = output->mutable_data<float>();
 
-        float *transformed_input_data = transformed_input.mutable_data<float>();
-        float
-            *transformed_output_data = transformed_output.mutable_data<float>();
-
-        conv_func = [=](const float *pad_input, float *pad_output) {
-          WinogradConv3x3s1(pad_input,
-                            transformed_filter_data,
-                            batch,
-                            extra_input_height,
-                            extra_input_width,
-                            input_channels,
-                            channels,
-                            winograd_out_tile_size,
-                            transformed_input_data,
-                            transformed_output_data,
-                            pad_output,
-                            &sgemm_,
-                            scratch);
-        };
-      } else if (use_neon_3x3_s1) {
-        conv_func = [=](const float *pad_input, float *pad_output) {
-          Conv2dNeonK3x3S1(pad_input,
-                           filter_data,
-                           extra_input_shape,
-                           extra_output_shape,
-                           pad_output);
-        };
-      } else if (use_neon_3x3_s2) {
-        conv_func = [=](const float *pad_input, float *pad_output) {
-          Conv2dNeonK3x3S2(pad_input,
-                           filter_data,
-                           extra_input_shape,
-                           extra_output_shape,
-                           pad_output);
-        };
-      } else if (use_neon_5x5_s1) {
-        conv_func = [=](const float *pad_input, float *pad_output) {
-          Conv2dNeonK5x5S1(pad_input,
-                           filter_data,
-                           extra_input_shape,
-                           extra_output_shape,
-                           pad_output);
-        };
-      } else if (use_neon_1x7_s1) {
-        conv_func = [=](const float *pad_input, float *pad_output) {
-          Conv2dNeonK1x7S1(pad_input,
-                           filter_data,
-                           extra_input_shape,
-                           extra_output_shape,
-                           pad_output);
-        };
-      } else if (use_neon_7x1_s1) {
-        conv_func = [=](const float *pad_input, float *pad_output) {
-          Conv2dNeonK7x1S1(pad_input,
-                           filter_data,
-                           extra_input_shape,
-                           extra_output_shape,
-                           pad_output);
-        };
-      } else if (use_neon_7x7_s1) {
-        conv_func = [=](const float *pad_input, float *pad_output) {
-          Conv2dNeonK7x7S1(pad_input,
-                           filter_data,
-                           extra_input_shape,
-                           extra_output_shape,
-                           pad_output);
-        };
-      } else if (use_neon_7x7_s2) {
-        conv_func = [=](const float *pad_input, float *pad_output) {
-          Conv2dNeonK7x7S2(pad_input,
-                           filter_data,
-                           extra_input_shape,
-                           extra_output_shape,
-                           pad_output);
-        };
-      } else if (use_neon_7x7_s3) {
-        conv_func = [=](const float *pad_input, float *pad_output) {
-          Conv2dNeonK7x7S3(pad_input,
-                           filter_data,
-                           extra_input_shape,
-                           extra_output_shape,
-                           pad_output);
-        };
-      } else if (use_neon_1x15_s1) {
-        conv_func = [=](const float *pad_input, float *pad_output) {
-          Conv2dNeonK1x15S1(pad_input,
-                            filter_data,
-                            extra_input_shape,
-                            extra_output_shape,
-                            pad_output);
-        };
-      } else if (use_neon_15x1_s1) {
-        conv_func = [=](const float *pad_input, float *pad_output) {
-          Conv2dNeonK15x1S1(pad_input,
-                            filter_data,
-                            extra_input_shape,
-                            extra_output_shape,
-                            pad_output);
-        };
-      } else {
-        conv_func = [=](const float *pad_input, float *pad_output) {
-          Conv2dGeneral(pad_input,
-                        filter_data,
-                        extra_input_shape,
-                        extra_output_shape,
-                        filter_shape.data(),
-                        strides_.data(),
-                        dilations_.data(),
-                        pad_output);
-        };
+    std::function<void(const float *input, float *output)> conv_func;
+
+    bool use_neon_3x3_s1 = filter_h == 3 && filter_w == 3
+        && stride_h == 1 && stride_w == 1 && dilation_h == 1
+        && dilation_w == 1;
+    bool use_neon_3x3_s2 = filter_h == 3 && filter_w == 3
+        && stride_h == 2 && stride_w == 2 && dilation_h == 1
+        && dilation_w == 1;
+    bool use_neon_5x5_s1 = filter_h == 5 && filter_w == 5
+        && stride_h == 1 && stride_w == 1 && dilation_h == 1
+        && dilation_w == 1;
+    bool use_neon_1x7_s1 = filter_h == 1 && filter_w == 7
+        && stride_h == 1 && stride_w == 1 && dilation_h == 1
+        && dilation_w == 1;
+    bool use_neon_7x1_s1 = filter_h == 7 && filter_w == 1
+        && stride_h == 1 && stride_w == 1 && dilation_h == 1
+        && dilation_w == 1;
+    bool use_neon_7x7_s1 = filter_h == 7 && filter_w == 7
+        && stride_h == 1 && stride_w == 1 && dilation_h == 1
+        && dilation_w == 1;
+    bool use_neon_7x7_s2 = filter_h == 7 && filter_w == 7
+        && stride_h == 2 && stride_w == 2 && dilation_h == 1
+        && dilation_w == 1;
+    bool use_neon_7x7_s3 = filter_h == 7 && filter_w == 7
+        && stride_h == 3 && stride_w == 3 && dilation_h == 1
+        && dilation_w == 1;
+    bool use_neon_1x15_s1 = filter_h == 1 && filter_w == 15
+        && stride_h == 1 && stride_w == 1 && dilation_h == 1
+        && dilation_w == 1;
+    bool use_neon_15x1_s1 = filter_h == 15 && filter_w == 1
+        && stride_h == 1 && stride_w == 1 && dilation_h == 1
+        && dilation_w == 1;
+
+    std::vector<index_t> transformed_input_shape;
+    std::vector<index_t> transformed_output_shape;
+    std::vector<index_t> transformed_filter_shape;
+
+    int winograd_out_tile_size = 2;
+    index_t winograd_tile_count = 0;
+
+    if (use_winograd) {
+      winograd_out_tile_size =
+          WinogradOutTileSize(input_channels, channels, height, width);
+      extra_output_height = RoundUp<index_t>(height, winograd_out_tile_size);
+      extra_input_height =
+          std::max(padded_input_height, extra_output_height + 2);
+      extra_output_width = RoundUp<index_t>(width, winograd_out_tile_size);
+      extra_input_width =
+          std::max(padded_input_width, extra_output_width + 2);
+      if (extra_input_height != padded_input_height) {
+        pad_bottom += (extra_input_height - padded_input_height);
       }
-
-      // pad input and output
-      const Tensor *pad_input_ptr = input;
-      if (extra_input_height != input_height
-          || extra_input_width != input_width) {
-        MACE_RETURN_IF_ERROR(ConstructNCHWInputWithSpecificPadding(
-            input, pad_top, pad_bottom, pad_left, pad_right, &padded_input));
-        pad_input_ptr = &padded_input;
+      if (extra_input_width != padded_input_width) {
+        pad_right += (extra_input_width - padded_input_width);
       }
 
-      // TODO(libin): don't need clear after bias is integrated in each conv
-      Tensor *pad_output_ptr = output;
-      if (extra_output_height != height || extra_output_width != width) {
-        padded_output.Reshape({batch, channels, extra_output_height,
-                               extra_output_width});
-        padded_output.Clear();
-        pad_output_ptr = &padded_output;
+      index_t
+          tile_height_count = extra_output_height / winograd_out_tile_size;
+      index_t tile_width_count = extra_output_width / winograd_out_tile_size;
+      index_t tile_count = tile_height_count * tile_width_count;
+      winograd_tile_count = tile_count;
+      index_t in_tile_area =
+          (winograd_out_tile_size + 2) * (winograd_out_tile_size + 2);
+
+      transformed_input_shape.insert(transformed_input_shape.end(),
+                                     {in_tile_area, batch, input_channels,
+                                      tile_count});
+      transformed_output_shape.insert(transformed_output_shape.end(),
+                                      {in_tile_area, batch, channels,
+                                       tile_count});
+      transformed_filter_shape.insert(transformed_filter_shape.end(),
+                                      {in_tile_area, channels,
+                                       input_channels});
+    } else {
+      index_t tile_h, tile_w;
+      if (use_neon_3x3_s1) {
+        tile_h = 2;
+        tile_w = 4;
+      } else if (use_neon_7x1_s1 || use_neon_15x1_s1) {
+        tile_h = 4;
+        tile_w = 1;
       } else {
-        output->Clear();
+        tile_h = 1;
+        tile_w = 4;
+      }
+      extra_output_height = RoundUp<index_t>(height, tile_h);
+      extra_input_height =
+          std::max(padded_input_height, (extra_output_height - 1) * stride_h
+              + (filter_h - 1) * dilation_h + 1);
+      extra_output_width = RoundUp<index_t>(width, tile_w);
+      extra_input_width =
+          std::max(padded_input_width, (extra_output_width - 1) * stride_w
+              + (filter_w - 1) * dilation_w + 1);
+      if (extra_input_height != padded_input_height) {
+        pad_bottom += (extra_input_height - padded_input_height);
       }
+      if (extra_input_width != padded_input_width) {
+        pad_right += (extra_input_width - padded_input_width);
+      }
+    }
 
-      const float *pad_input_data = pad_input_ptr->data<float>();
-      float *pad_output_data = pad_output_ptr->mutable_data<float>();
+    // decide scratch size before allocate it
+    index_t total_scratch_size = 0;
+    index_t transformed_input_size = 0;
+    index_t transformed_output_size = 0;
+    index_t padded_input_size = 0;
+    index_t padded_output_size = 0;
+    index_t transformed_filter_size = 0;
+    if (use_winograd) {
+      transformed_input_size =
+          std::accumulate(transformed_input_shape.begin(),
+                          transformed_input_shape.end(),
+                          1,
+                          std::multiplies<index_t>()) * sizeof(float);
+      transformed_output_size =
+          std::accumulate(transformed_output_shape.begin(),
+                          transformed_output_shape.end(),
+                          1,
+                          std::multiplies<index_t>()) * sizeof(float);
+      total_scratch_size += transformed_input_size + transformed_output_size;
+      if (!filter->is_weight()) {
+        transformed_filter_size =
+            std::accumulate(transformed_filter_shape.begin(),
+                            transformed_filter_shape.end(),
+                            1,
+                            std::multiplies<index_t>()) * sizeof(float);
+        total_scratch_size += transformed_filter_size;
+      }
+    }
+    if (extra_input_height != input_height
+        || extra_input_width != input_width) {
+      padded_input_size =
+          batch * input_channels * (input_height + pad_top + pad_bottom)
+              * (input_width + pad_left + pad_right) * sizeof(float) +
+              MACE_EXTRA_BUFFER_PAD_SIZE;
+      total_scratch_size += padded_input_size;
+    }
+    if (extra_output_height != height || extra_output_width != width) {
+      padded_output_size =
+          batch * channels * extra_output_height * extra_output_width
+              * sizeof(float);
+      total_scratch_size += padded_output_size;
+    }
 
-      conv_func(pad_input_data, pad_output_data);
+    // sgemm of winograd takes the scratch after the buffers above
+    if (use_winograd) {
+      total_scratch_size += WinogradGemmScratchSize(
+          input_channels, channels, winograd_tile_count,
+          winograd_out_tile_size);
+    }
 
-      // unpack output
-      if (extra_output_height != height || extra_output_width != width) {
-#pragma omp parallel for collapse(2) schedule(runtime)
-        for (index_t b = 0; b < batch; ++b) {
-          for (index_t c = 0; c < channels; ++c) {
-            for (index_t h = 0; h < height; ++h) {
-              memcpy(
-                  output_data + b * channels * height * width
-                      + c * height * width
-                      + h * width,
-                  pad_output_data
-                      + b * channels * extra_output_height * extra_output_width
-                      + c * extra_output_height * extra_output_width
-                      + h * extra_output_width,
-                  sizeof(float) * width);
-            }
-          }
+    // Init scratch buffer
+    ScratchBuffer *scratch = context->device()->scratch_buffer();
+    scratch->Rewind();
+    scratch->GrowSize(total_scratch_size);
+    Tensor
+        transformed_input(scratch->Scratch(transformed_input_size), DT_FLOAT);
+    Tensor
+        transformed_output
+        (scratch->Scratch(transformed_output_size), DT_FLOAT);
+    Tensor padded_input(scratch->Scratch(padded_input_size), DT_FLOAT);
+    Tensor padded_output(scratch->Scratch(padded_output_size), DT_FLOAT);
+    Tensor transformed_filter(scratch->Scratch(transformed_filter_size),
+                              DT_FLOAT);
+    const index_t extra_input_shape[4] =
+        {batch, input_channels, extra_input_height, extra_input_width};
+    const index_t extra_output_shape[4] =
+        {batch, channels, extra_output_height, extra_output_width};
+
+    // make host compiler happy
+    MACE_UNUSED(extra_input_shape);
+    MACE_UNUSED(extra_output_shape);
+
+    // decide which convolution function to call
+    if (use_winograd) {
+      transformed_input.Reshape(transformed_input_shape);
+      transformed_output.Reshape(transformed_output_shape);
+      const float *transformed_filter_data = nullptr;
+      if (filter->is_weight()) {
+        // transformed once for each tile size
+        auto iter = transformed_filters_.find(winograd_out_tile_size);
+        if (iter == transformed_filters_.end()) {
+          iter = transformed_filters_.emplace(
+              winograd_out_tile_size,
+              GetTransformedFilter(context->workspace()->packed_weights(),
+                                   filter,
+                                   winograd_out_tile_size)).first;
         }
+        transformed_filter_data = iter->second;
+      } else {
+        transformed_filter.Reshape(transformed_filter_shape);
+        TransformFilter(filter_data,
+                        filter_shape[1],
+                        filter_shape[0],
+                        winograd_out_tile_size,
+                        transformed_filter.mutable_data<float>());
+        transformed_filter_data = transformed_filter.data<float>();
       }
+
+      float *transformed_input_data = transformed_input.mutable_data<float>();
+      float
+          *transformed_output_data = transformed_output.mutable_data<float>();
+
+      conv_func = [=](const float *pad_input, float *pad_output) {
+        WinogradConv3x3s1(pad_input,
+                          transformed_filter_data,
+                          batch,
+                          extra_input_height,
+                          extra_input_width,
+                          input_channels,
+                          channels,
+                          winograd_out_tile_size,
+                          transformed_input_data,
+                          transformed_output_data,
+                          pad_output,
+                          &sgemm_,
+                          scratch);
+      };
+    } else if (use_neon_3x3_s1) {
+      conv_func = [=](const float *pad_input, float *pad_output) {
+        Conv2dNeonK3x3S1(pad_input,
+                         filter_data,
+                         extra_input_shape,
+                         extra_output_shape,
+                         pad_output);
+      };
+    } else if (use_neon_3x3_s2) {
+      conv_func = [=](const float *pad_input, float *pad_output) {
+        Conv2dNeonK3x3S2(pad_input,
+                         filter_data,
+                         extra_input_shape,
+                         extra_output_shape,
+                         pad_output);
+      };
+    } else if (use_neon_5x5_s1) {
+      conv_func = [=](const float *pad_input, float *pad_output) {
+        Conv2dNeonK5x5S1(pad_input,
+                         filter_data,
+                         extra_input_shape,
+                         extra_output_shape,
+                         pad_output);
+      };
+    } else if (use_neon_1x7_s1) {
+      conv_func = [=](const float *pad_input, float *pad_output) {
+        Conv2dNeonK1x7S1(pad_input,
+                         filter_data,
+                         extra_input_shape,
+                         extra_output_shape,
+                         pad_output);
+      };
+    } else if (use_neon_7x1_s1) {
+      conv_func = [=](const float *pad_input, float *pad_output) {
+        Conv2dNeonK7x1S1(pad_input,
+                         filter_data,
+                         extra_input_shape,
+                         extra_output_shape,
+                         pad_output);
+      };
+    } else if (use_neon_7x7_s1) {
+      conv_func = [=](const float *pad_input, float *pad_output) {
+        Conv2dNeonK7x7S1(pad_input,
+                         filter_data,
+                         extra_input_shape,
+                         extra_output_shape,
+                         pad_output);
+      };
+    } else if (use_neon_7x7_s2) {
+      conv_func = [=](const float *pad_input, float *pad_output) {
+        Conv2dNeonK7x7S2(pad_input,
+                         filter_data,
+                         extra_input_shape,
+                         extra_output_shape,
+                         pad_output);
+      };
+    } else if (use_neon_7x7_s3) {
+      conv_func = [=](const float *pad_input, float *pad_output) {
+        Conv2dNeonK7x7S3(pad_input,
+                         filter_data,
+                         extra_input_shape,
+                         extra_output_shape,
+                         pad_output);
+      };
+    } else if (use_neon_1x15_s1) {
+      conv_func = [=](const float *pad_input, float *pad_output) {
+        Conv2dNeonK1x15S1(pad_input,
+                          filter_data,
+                          extra_input_shape,
+                          extra_output_shape,
+                          pad_output);
+      };
+    } else if (use_neon_15x1_s1) {
+      conv_func = [=](const float *pad_input, float *pad_output) {
+        Conv2dNeonK15x1S1(pad_input,
+                          filter_data,
+                          extra_input_shape,
+                          extra_output_shape,
+                          pad_output);
+      };
+    } else {
+      conv_func = [=](const float *pad_input, float *pad_output) {
+        Conv2dGeneral(pad_input,
+                      filter_data,
+                      extra_input_shape,
+                      extra_output_shape,
+                      filter_shape.data(),
+                      strides_.data(),
+                      dilations_.data(),
+                      pad_output);
+      };
     }
-#else
-    if (conv2d_delegator_.get() == nullptr) {
-      conv2d_delegator_ = make_unique<ref::Conv2d<float>>(paddings[0],
-                                                          paddings[1],
-                                                          stride_h,
-                                                          stride_w,
-                                                          dilation_h,
-                                                          dilation_w);
+
+    // pad input and output
+    const Tensor *pad_input_ptr = input;
+    if (extra_input_height != input_height
+        || extra_input_width != input_width) {
+      MACE_RETURN_IF_ERROR(ConstructNCHWInputWithSpecificPadding(
+          input, pad_top, pad_bottom, pad_left, pad_right, &padded_input));
+      pad_input_ptr = &padded_input;
     }
-    conv2d_delegator_->Compute(context, input, filter, output);
-#endif
 
-    Tensor::MappingGuard bias_guard(bias);
-    Tensor::MappingGuard output_guard(output);
-    auto bias_data = bias == nullptr ? nullptr : bias->data<float>();
-    auto output_data = output->mutable_data<float>();
-    if (bias_data != nullptr) {
-      const index_t image_size = height * width;
+    // TODO(libin): don't need clear after bias is integrated in each conv
+    Tensor *pad_output_ptr = output;
+    if (extra_output_height != height || extra_output_width != width) {
+      padded_output.Reshape({batch, channels, extra_output_height,
+                             extra_output_width});
+      padded_output.Clear();
+      pad_output_ptr = &padded_output;
+    } else {
+      output->Clear();
+    }
+
+    const float *pad_input_data = pad_input_ptr->data<float>();
+    float *pad_output_data = pad_output_ptr->mutable_data<float>();
+
+    conv_func(pad_input_data, pad_output_data);
+
+    // unpack output
+    if (extra_output_height != height || extra_output_width != width) {
 #pragma omp parallel for collapse(2) schedule(runtime)
       for (index_t b = 0; b < batch; ++b) {
         for (index_t c = 0; c < channels; ++c) {
-          float *output_ptr = output_data + (b * channels + c) * image_size;
-          const float bias = bias_data[c];
-#if defined(MACE_ENABLE_NEON)
-          float32x4_t vbias = vdupq_n_f32(bias);
-          for (index_t i = 0; i <= image_size - 4; i += 4) {
-            float32x4_t v = vld1q_f32(output_ptr + i);
-            v = vaddq_f32(v, vbias);
-            vst1q_f32(output_ptr + i, v);
+          for (index_t h = 0; h < height; ++h) {
+            memcpy(
+                output_data + b * channels * height * width
+                    + c * height * width
+                    + h * width,
+                pad_output_data
+                    + b * channels * extra_output_height * extra_output_width
+                    + c * extra_output_height * extra_output_width
+                    + h * extra_output_width,
+                sizeof(float) * width);
           }
-          for (index_t i = (image_size >> 2) << 2; i < image_size; ++i) {
-            output_ptr[i] += bias;
-          }
-#else
-          for (index_t i = 0; i < image_size; ++i) {
-            output_ptr[i] += bias;
-          }
-#endif
         }
       }
     }
-
-    DoActivation(output_data, output_data, output->size(), activation_,
-                 relux_max_limit_, leakyrelu_coefficient_);
-
     return MaceStatus::MACE_SUCCESS;
   }
+#endif  // MACE_ENABLE_NEON
 
- private:
   void Conv2dGeneral(const float *input,
                      const float *filter,
                      const index_t *in_shape,
@@ -729,13 +1247,49 @@ class Conv2dOp<DeviceType::CPU, float> : public ConvPool2dOpBase {
       }  // m
     }  // b
   }
+  // winograd for 3x3 convs of stride 1, other strides fall back to direct
+  // convolution
+  bool UseWinograd(const Tensor *filter) const {
+    return filter->dim(2) == 3 && filter->dim(3) == 3
+        && strides_[0] == 1 && strides_[1] == 1
+        && dilations_[0] == 1 && dilations_[1] == 1
+        && filter->dim(1) >= 8 && filter->dim(0) >= 8;
+  }
+
   const ActivationType activation_;
   const float relux_max_limit_;
   const float leakyrelu_coefficient_;
-  bool is_filter_transformed_;
+  // whether the last input is a residual added before the activation
+  const bool has_residual_;
+  // the block size of a depth to space fused into the output store, the
+  // conv output is kept in conv_output_ until it is stored
+  const int depth_to_space_;
+  Tensor conv_output_;
+  // channels of a block of the NCHWc layout, 0 for NCHW
+  const int channel_block_;
+  // the filter packed for the NCHWc kernel, owned by the packed weights
+  const float *nchwc_filter_;
+  // whether the input and the output are NHWC, of a 1x1 conv
+  const bool nhwc_;
+  // the filter packed for the NHWC kernel, owned by the packed weights
+  const float *nhwc_filter_;
+  // the nonzero blocks of a pruned 1x1 filter, owned by the packed weights
+  const float *sparse_filter_;
+  // the bfloat16 1x1 filter packed for bf16_gemm_, owned by the packed
+  // weights
+  const BFloat16 *bf16_filter_;
+  BFloat16Gemm bf16_gemm_;
   SGemm sgemm_;
+  // winograd filters of each out tile size, owned by the packed weights
+  std::map<int, const float *> transformed_filters_;
 #ifdef MACE_ENABLE_NEON
   std::unique_ptr<arm::fp32::Conv2dBase> conv2d_delegator_;
+  std::unique_ptr<arm::fp32::Conv2dBase> implicit_gemm_delegator_;
+  // the algorithm picked for the last input shape
+  std::vector<index_t> algorithm_input_shape_;
+  Conv2dAlgorithm algorithm_;
+#elif defined(__x86_64__)
+  std::unique_ptr<x86::fp32::Conv2d> conv2d_delegator_;
 #else
   std::unique_ptr<ref::Conv2d<float>> conv2d_delegator_;
 #endif  // MACE_ENABLE_NEON
@@ -746,6 +1300,111 @@ class Conv2dOp<DeviceType::CPU, float> : public ConvPool2dOpBase {
 };
 
 
+#ifdef MACE_ENABLE_FP16_NEON
+template <>
+class Conv2dOp<DeviceType::CPU, half> : public ConvPool2dOpBase {
+ public:
+  explicit Conv2dOp(OpConstructContext *context)
+      : ConvPool2dOpBase(context),
+        activation_(ops::StringToActivationType(
+            Operation::GetOptionalArg<std::string>("activation",
+                                                  "NOOP"))),
+        relux_max_limit_(Operation::GetOptionalArg<float>("max_limit", 0.0f)),
+        leakyrelu_coefficient_(Operation::GetOptionalArg<float>(
+              "leakyrelu_coefficient", 0.0f)),
+        has_residual_(Operation::GetOptionalArg<int>("residual", 0) == 1),
+        depth_to_space_(Operation::GetOptionalArg<int>("depth_to_space", 1)),
+        conv_output_(GetCPUAllocator(), DT_HALF),
+        conv2d_(strides_, dilations_) {}
+
+  MaceStatus Run(OpContext *context) override {
+    const Tensor *input = this->Input(INPUT);
+    const Tensor *filter = this->Input(FILTER);
+    const Tensor *bias = this->InputSize() >= (has_residual_ ? 4 : 3) ?
+                         this->Input(BIAS) : nullptr;
+    const Tensor *residual =
+        has_residual_ ? this->Input(this->InputSize() - 1) : nullptr;
+    // a depth to space fused into the store moves the activated conv output
+    Tensor *output = depth_to_space_ > 1 ? &conv_output_
+                                         : this->Output(OUTPUT);
+    MACE_CHECK(residual == nullptr || depth_to_space_ == 1,
+               "Conv2D reads no residual with depth to space");
+
+    std::vector<index_t> output_shape(4);
+    std::vector<int> paddings(2);
+    if (paddings_.empty()) {
+      CalcNCHWPaddingAndOutputSize(input->shape().data(),
+                                   filter->shape().data(),
+                                   dilations_.data(),
+                                   strides_.data(),
+                                   padding_type_,
+                                   output_shape.data(),
+                                   paddings.data());
+    } else {
+      paddings = paddings_;
+      CalcNCHWOutputSize(input->shape().data(),
+                         filter->shape().data(),
+                         paddings_.data(),
+                         dilations_.data(),
+                         strides_.data(),
+                         RoundType::FLOOR,
+                         output_shape.data());
+    }
+    MACE_RETURN_IF_ERROR(output->Resize(output_shape));
+    MACE_CHECK(filter->dim(0) == output->dim(1), filter->dim(0), " != ",
+               output->dim(1));
+    MACE_CHECK(filter->dim(1) == input->dim(1), filter->dim(1), " != ",
+               input->dim(1));
+
+    const int pad_hw[2] = {paddings[0] >> 1, paddings[1] >> 1};
+    MACE_RETURN_IF_ERROR(
+        conv2d_.Compute(context, input, filter, pad_hw, output));
+
+    Tensor::MappingGuard bias_guard(bias);
+    Tensor::MappingGuard output_guard(output);
+    half *output_data = output->mutable_data<half>();
+    if (residual != nullptr) {
+      MACE_CHECK(residual->shape() == output->shape(),
+                 "Conv2D residual should be of the output shape");
+      Tensor::MappingGuard residual_guard(residual);
+      arm::fp16::AddResidual(residual->data<half>(), output->size(),
+                             output_data);
+    }
+    arm::fp16::BiasActivation(
+        output_data,
+        bias == nullptr ? nullptr : bias->data<half>(),
+        nullptr,
+        output->dim(0),
+        output->dim(1),
+        output->dim(2) * output->dim(3),
+        activation_,
+        relux_max_limit_,
+        leakyrelu_coefficient_,
+        output_data);
+    if (depth_to_space_ > 1) {
+      return StoreDepthToSpace<half>(
+          output, nullptr, depth_to_space_,
+          [](half *, const index_t) {}, this->Output(OUTPUT));
+    }
+    return MaceStatus::MACE_SUCCESS;
+  }
+
+ private:
+  const ActivationType activation_;
+  const float relux_max_limit_;
+  const float leakyrelu_coefficient_;
+  const bool has_residual_;
+  // the block size of a depth to space fused into the output store
+  const int depth_to_space_;
+  Tensor conv_output_;
+  arm::fp16::Conv2d conv2d_;
+
+ private:
+  MACE_OP_INPUT_TAGS(INPUT, FILTER, BIAS);
+  MACE_OP_OUTPUT_TAGS(OUTPUT);
+};
+#endif  // MACE_ENABLE_FP16_NEON
+
 #ifdef MACE_ENABLE_QUANTIZE
 template <>
 class Conv2dOp<DeviceType::CPU, uint8_t> : public ConvPool2dOpBase {
@@ -768,9 +1427,6 @@ class Conv2dOp<DeviceType::CPU, uint8_t> : public ConvPool2dOpBase {
     MACE_CHECK(dilations_[0] == 1 && dilations_[1] == 1,
                "Quantization convolution does not support dilation > 1 yet.");
 
-    auto gemm_context = context->device()->cpu_runtime()->GetGemmlowpContext();
-    MACE_CHECK_NOTNULL(gemm_context);
-
     std::vector<index_t> output_shape(4);
     std::vector<int> paddings(2);
     if (paddings_.empty()) {
@@ -835,28 +1491,76 @@ class Conv2dOp<DeviceType::CPU, uint8_t> : public ConvPool2dOpBase {
     auto output_data = output->mutable_data<uint8_t>();
     auto bias_data = GetBiasData(bias,
                                  input->scale(),
-                                 filter->scale(),
+                                 filter,
                                  channels,
                                  &bias_);
 
+    // a filter quantized per output channel is multiplied to int32 by
+    // gemmlowp and then requantized channel by channel
+    const bool per_channel = !filter->scales().empty();
+    index_t gemm_scratch_size = 0;
+#ifdef MACE_ENABLE_NEON
+    const bool use_dot_prod = arm::q8::Gemm<uint8_t>::HasDotProd();
+    if (use_dot_prod) {
+      gemm_scratch_size =
+          arm::q8::Gemm<uint8_t>::ScratchSize(channels, columns, depth);
+    } else if (per_channel) {
+      gemm_scratch_size = PadAlignSize(channels * columns * sizeof(int32_t));
+    }
+#else
+    if (per_channel) {
+      gemm_scratch_size = PadAlignSize(channels * columns * sizeof(int32_t));
+    }
+#endif  // MACE_ENABLE_NEON
+
     auto gemm_input_data = input_data;
     std::unique_ptr<Tensor> im2col;
     bool im2col_required =
         filter_h != 1 || filter_w != 1 || stride_h != 1 || stride_w != 1;
+    ScratchBuffer *scratch = context->device()->scratch_buffer();
+    scratch->Rewind();
     if (im2col_required) {
       // prepare im2col
-      index_t im2col_size = depth * columns * sizeof(uint8_t);
-      ScratchBuffer *scratch = context->device()->scratch_buffer();
-      scratch->Rewind();
-      scratch->GrowSize(im2col_size);
+      index_t im2col_size = PadAlignSize(depth * columns * sizeof(uint8_t));
+      MACE_RETURN_IF_ERROR(
+          scratch->GrowSize(im2col_size + gemm_scratch_size));
       im2col = make_unique<Tensor>(scratch->Scratch(im2col_size), DT_UINT8);
+      im2col->SetScale(input->scale());
+      im2col->SetZeroPoint(input->zero_point());
       uint8_t *im2col_data = im2col->mutable_data<uint8_t>();
       Im2col(input_data, input->shape(), filter_h, filter_w, stride_h,
              stride_w, static_cast<uint8_t>(input->zero_point()),
              paddings[0], paddings[1], output->shape(), depth, im2col_data);
       gemm_input_data = im2col_data;
+    } else {
+      MACE_RETURN_IF_ERROR(scratch->GrowSize(gemm_scratch_size));
     }
 
+#ifdef MACE_ENABLE_NEON
+    if (use_dot_prod) {
+      // ReLU and ReLUX are fused into the clamp of the output stage
+      int32_t output_min = 0;
+      int32_t output_max = 255;
+      if (activation_ == RELU || activation_ == RELUX) {
+        output_min = std::max(output_min, output->zero_point());
+      }
+      if (activation_ == RELUX) {
+        output_max = std::min<int32_t>(
+            output_max, output->zero_point()
+                + static_cast<int32_t>(
+                    std::roundf(relux_max_limit_ / output->scale())));
+      }
+      gemm_.SetOutputRange(output_min, output_max);
+      const Tensor *gemm_input = im2col_required ? im2col.get() : input;
+      return gemm_.Compute(context, filter, gemm_input, bias_data, 1,
+                           channels, columns, depth, RowMajor, ColMajor,
+                           ColMajor, false, false, output);
+    }
+#endif  // MACE_ENABLE_NEON
+
+    auto gemm_context = context->device()->cpu_runtime()->GetGemmlowpContext();
+    MACE_CHECK_NOTNULL(gemm_context);
+
     const int gemm_filter_rows = static_cast<int>(channels);
     const int gemm_filter_cols = static_cast<int>(depth);
     const int gemm_input_rows = static_cast<int>(depth);
@@ -870,11 +1574,28 @@ class Conv2dOp<DeviceType::CPU, uint8_t> : public ConvPool2dOpBase {
     gemmlowp::MatrixMap<uint8_t, gemmlowp::MapOrder::ColMajor>
         output_matrix(output_data, gemm_output_rows, gemm_output_cols);
 
+    using BitDepthParams = gemmlowp::L8R8WithLhsNonzeroBitDepthParams;
+    if (per_channel) {
+      int32_t *accumulator_data =
+          scratch->Scratch(gemm_scratch_size).mutable_data<int32_t>();
+      gemmlowp::MatrixMap<int32_t, gemmlowp::MapOrder::ColMajor>
+          accumulator_matrix(accumulator_data, gemm_output_rows,
+                             gemm_output_cols);
+      gemmlowp::GemmWithOutputPipeline<uint8_t, int32_t, BitDepthParams>(
+          gemm_context, filter_matrix, input_matrix, &accumulator_matrix,
+          -filter->zero_point(), -input->zero_point(),
+          GemmlowpOutputPipeline::MakeInt32());
+      GemmlowpOutputPipeline::RequantizePerChannel(
+          accumulator_data, bias_data, channels, columns, filter->scale(),
+          filter->scales(), input->scale(), output->scale(),
+          output->zero_point(), output_data);
+      return MaceStatus::MACE_SUCCESS;
+    }
+
     const auto &output_pipeline = GemmlowpOutputPipeline::Make(
         bias_data, channels, filter->scale(), input->scale(), output->scale(),
         output->zero_point());
 
-    using BitDepthParams = gemmlowp::L8R8WithLhsNonzeroBitDepthParams;
     gemmlowp::GemmWithOutputPipeline<uint8_t, uint8_t, BitDepthParams>(
         gemm_context, filter_matrix, input_matrix, &output_matrix,
         -filter->zero_point(), -input->zero_point(), output_pipeline);
@@ -971,6 +1692,9 @@ class Conv2dOp<DeviceType::CPU, uint8_t> : public ConvPool2dOpBase {
   const float relux_max_limit_;
   const float leakyrelu_coefficient_;
   std::vector<int32_t> bias_;
+#ifdef MACE_ENABLE_NEON
+  arm::q8::Gemm<uint8_t> gemm_;
+#endif  // MACE_ENABLE_NEON
 
  private:
   MACE_OP_INPUT_TAGS(INPUT, FILTER, BIAS);
@@ -990,7 +1714,9 @@ class Conv2dOp<DeviceType::GPU, T> : public ConvPool2dOpBase {
         relux_max_limit_(Operation::GetOptionalArg<float>("max_limit", 0.0f)),
         leakyrelu_coefficient_(Operation::GetOptionalArg<float>(
               "leakyrelu_coefficient", 0.0f)),
-        wino_block_size_(Operation::GetOptionalArg<int>("wino_block_size", 0)) {
+        wino_block_size_(Operation::GetOptionalArg<int>("wino_block_size", 0)),
+        has_residual_(Operation::GetOptionalArg<int>("residual", 0) == 1),
+        depth_to_space_(Operation::GetOptionalArg<int>("depth_to_space", 1)) {
     MemoryType mem_type;
     if (context->device()->gpu_runtime()->UseImageMemory()) {
       mem_type = MemoryType::GPU_IMAGE;
@@ -1000,8 +1726,10 @@ class Conv2dOp<DeviceType::GPU, T> : public ConvPool2dOpBase {
       kernel_ = make_unique<opencl::buffer::Conv2dKernel<T>>();
     }
     context->set_output_mem_type(mem_type);
-    // Transform filter tensor to target format
-    if ((wino_block_size_ == 2 || wino_block_size_ == 4) &&
+    // Transform filter tensor to target format, the winograd output
+    // transform adds no residual and stores no depth to space
+    if (!has_residual_ && depth_to_space_ == 1 &&
+        (wino_block_size_ == 2 || wino_block_size_ == 4) &&
         (kernel_->CheckUseWinograd(
           context->device()->gpu_runtime()->opencl_runtime(),
           context->workspace()->GetTensor(
@@ -1022,7 +1750,7 @@ class Conv2dOp<DeviceType::GPU, T> : public ConvPool2dOpBase {
           OpenCLBufferType::CONV2D_FILTER, mem_type)
                      == MaceStatus::MACE_SUCCESS);
     }
-    if (operator_def_->input_size() > 2) {
+    if (operator_def_->input_size() > (has_residual_ ? 3 : 2)) {
       MACE_CHECK(TransformFilter<T>(
           context, operator_def_.get(), 2, OpenCLBufferType::ARGUMENT, mem_type)
                      == MaceStatus::MACE_SUCCESS);
@@ -1031,12 +1759,16 @@ class Conv2dOp<DeviceType::GPU, T> : public ConvPool2dOpBase {
   MaceStatus Run(OpContext *context) override {
     const Tensor *input = this->Input(INPUT);
     const Tensor *filter = this->Input(FILTER);
-    const Tensor *bias = this->InputSize() >= 3 ? this->Input(BIAS) : nullptr;
+    const Tensor *bias = this->InputSize() >= (has_residual_ ? 4 : 3) ?
+                         this->Input(BIAS) : nullptr;
+    const Tensor *residual =
+        has_residual_ ? this->Input(this->InputSize() - 1) : nullptr;
     Tensor *output = this->Output(OUTPUT);
-    return kernel_->Compute(context, input, filter, bias,
-                            strides_.data(), padding_type_, paddings_,
-                            dilations_.data(), activation_, relux_max_limit_,
-                            leakyrelu_coefficient_, wino_block_size_, output);
+    return kernel_->Compute(context, input, filter, bias, residual,
+                            depth_to_space_, strides_.data(), padding_type_,
+                            paddings_, dilations_.data(), activation_,
+                            relux_max_limit_, leakyrelu_coefficient_,
+                            wino_block_size_, output);
   }
 
  private:
@@ -1045,6 +1777,9 @@ class Conv2dOp<DeviceType::GPU, T> : public ConvPool2dOpBase {
   const float leakyrelu_coefficient_;
   std::unique_ptr<OpenCLConv2dKernel> kernel_;
   int wino_block_size_;
+  const bool has_residual_;
+  // the block size of a depth to space fused into the output store
+  const int depth_to_space_;
 
  private:
   MACE_OP_INPUT_TAGS(INPUT, FILTER, BIAS);
@@ -1057,6 +1792,11 @@ void RegisterConv2D(OpRegistryBase *op_registry) {
   MACE_REGISTER_OP(op_registry, "Conv2D", Conv2dOp,
                    DeviceType::CPU, float);
 
+#ifdef MACE_ENABLE_FP16_NEON
+  MACE_REGISTER_OP(op_registry, "Conv2D", Conv2dOp,
+                   DeviceType::CPU, half);
+#endif  // MACE_ENABLE_FP16_NEON
+
 #ifdef MACE_ENABLE_QUANTIZE
   MACE_REGISTER_OP(op_registry, "Conv2D", Conv2dOp,
                    DeviceType::CPU, uint8_t);
@@ -12,11 +12,21 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
 #include <fstream>
+#include <memory>
+#include <random>
+#include <string>
 #include <vector>
 
+#include "mace/core/algorithm_cache.h"
+#include "mace/core/kv_storage.h"
 #include "mace/ops/common/conv_pool_2d_util.h"
+#include "mace/ops/common/eltwise_type.h"
 #include "mace/ops/ops_test_util.h"
+#include "mace/ops/ref/conv_2d.h"
 
 namespace mace {
 namespace ops {
@@ -506,6 +516,55 @@ TEST_F(Conv2dOpTest, CPUConv1x1) { TestConv1x1<DeviceType::CPU>(); }
 
 TEST_F(Conv2dOpTest, OPENCLConv1x1) { TestConv1x1<DeviceType::GPU>(); }
 
+namespace {
+void TestSparseConv1x1(const std::vector<index_t> &shape,
+                       const index_t output_channels,
+                       const float sparsity) {
+  const index_t input_channels = shape[3];
+  OpsTestNet net;
+  net.AddRandomInput<DeviceType::CPU, float>("Input", shape);
+  // zero the pruned blocks of 4 input channels
+  std::mt19937 gen(input_channels);
+  std::uniform_real_distribution<float> dist(0, 1);
+  std::vector<float> filter(output_channels * input_channels);
+  for (index_t o = 0; o < output_channels; ++o) {
+    for (index_t c = 0; c < input_channels; c += 4) {
+      const bool pruned = dist(gen) < sparsity;
+      for (index_t i = c; i < std::min<index_t>(c + 4, input_channels); ++i) {
+        filter[o * input_channels + i] = pruned ? 0.f : dist(gen) - 0.5f;
+      }
+    }
+  }
+  net.AddInputFromArray<DeviceType::CPU, float>(
+      "Filter", {output_channels, input_channels, 1, 1}, filter, true);
+  net.AddRandomInput<DeviceType::CPU, float>("Bias", {output_channels}, true);
+  net.TransformDataFormat<DeviceType::CPU, float>("Input", NHWC, "InputNCHW",
+                                                  NCHW);
+  for (const std::string output : {"Expected", "Output"}) {
+    OpDefBuilder("Conv2D", "Conv2DTest")
+        .Input("InputNCHW")
+        .Input("Filter")
+        .Input("Bias")
+        .Output(output)
+        .AddIntsArg("strides", {1, 1})
+        .AddIntArg("padding", Padding::VALID)
+        .AddIntsArg("dilations", {1, 1})
+        .AddStringArg("activation", "RELU")
+        .AddIntArg("sparse_weight", output == "Output" ? 1 : 0)
+        .Finalize(net.NewOperatorDef());
+    net.RunOp();
+  }
+  ExpectTensorNear<float>(*net.GetOutput("Expected"),
+                          *net.GetOutput("Output"), 1e-4, 1e-4);
+}
+}  // namespace
+
+TEST_F(Conv2dOpTest, CPUSparseConv1x1) {
+  TestSparseConv1x1({1, 14, 14, 64}, 32, 0.8f);
+  TestSparseConv1x1({2, 7, 9, 30}, 19, 0.7f);
+  TestSparseConv1x1({1, 1, 3, 128}, 64, 0.9f);
+}
+
 namespace {
 template <DeviceType D, typename T>
 void TestComplexConvNxNS12(const std::vector<index_t> &shape,
@@ -610,6 +669,203 @@ TEST_F(Conv2dOpTest, OPENCLUnalignedConvNxNS34) {
   TestComplexConvNxNS12<DeviceType::GPU, float>({32, 32, 13, 17}, 4);
 }
 
+namespace {
+template <DeviceType D>
+void TestResidual(const std::vector<index_t> &shape,
+                  const int kernel,
+                  const int stride) {
+  const index_t batch = 2;
+  const index_t height = shape[0];
+  const index_t width = shape[1];
+  const index_t input_channels = shape[2];
+  const index_t output_channels = shape[3];
+  const index_t out_height = (height - 1) / stride + 1;
+  const index_t out_width = (width - 1) / stride + 1;
+
+  OpsTestNet net;
+  net.AddRandomInput<D, float>("Input",
+                               {batch, height, width, input_channels});
+  net.AddRandomInput<D, float>(
+      "Filter", {output_channels, input_channels, kernel, kernel}, true,
+      false);
+  net.AddRandomInput<D, float>("Bias", {output_channels}, true, false);
+  net.AddRandomInput<D, float>(
+      "Residual", {batch, out_height, out_width, output_channels});
+  net.TransformDataFormat<DeviceType::CPU, float>("Input", NHWC, "InputNCHW",
+                                                  NCHW);
+  net.TransformDataFormat<DeviceType::CPU, float>("Residual", NHWC,
+                                                  "ResidualNCHW", NCHW);
+
+  // conv, residual add and activation, one by one
+  OpDefBuilder("Conv2D", "Conv2dTest")
+      .Input("InputNCHW")
+      .Input("Filter")
+      .Input("Bias")
+      .Output("ConvNCHW")
+      .AddIntsArg("strides", {stride, stride})
+      .AddIntArg("padding", Padding::SAME)
+      .AddIntsArg("dilations", {1, 1})
+      .Finalize(net.NewOperatorDef());
+  net.RunOp();
+  OpDefBuilder("Eltwise", "EltwiseTest")
+      .Input("ConvNCHW")
+      .Input("ResidualNCHW")
+      .Output("SumNCHW")
+      .AddIntArg("type", static_cast<int>(ops::EltwiseType::SUM))
+      .Finalize(net.NewOperatorDef());
+  net.RunOp();
+  OpDefBuilder("Activation", "ActivationTest")
+      .Input("SumNCHW")
+      .Output("ExpectedNCHW")
+      .AddStringArg("activation", "RELU")
+      .Finalize(net.NewOperatorDef());
+  net.RunOp();
+  net.TransformDataFormat<DeviceType::CPU, float>("ExpectedNCHW", NCHW,
+                                                  "Expected", NHWC);
+  auto expected = net.CreateTensor<float>();
+  expected->Copy(*net.GetOutput("Expected"));
+
+  // the conv with the residual
+  if (D == DeviceType::CPU) {
+    OpDefBuilder("Conv2D", "Conv2dTest")
+        .Input("InputNCHW")
+        .Input("Filter")
+        .Input("Bias")
+        .Input("ResidualNCHW")
+        .Output("OutputNCHW")
+        .AddIntsArg("strides", {stride, stride})
+        .AddIntArg("padding", Padding::SAME)
+        .AddIntsArg("dilations", {1, 1})
+        .AddStringArg("activation", "RELU")
+        .AddIntArg("residual", 1)
+        .Finalize(net.NewOperatorDef());
+    net.RunOp(D);
+    net.TransformDataFormat<DeviceType::CPU, float>("OutputNCHW", NCHW,
+                                                    "Output", NHWC);
+  } else {
+    OpDefBuilder("Conv2D", "Conv2dTest")
+        .Input("Input")
+        .Input("Filter")
+        .Input("Bias")
+        .Input("Residual")
+        .Output("Output")
+        .OutputShape(expected->shape())
+        .AddIntsArg("strides", {stride, stride})
+        .AddIntArg("padding", Padding::SAME)
+        .AddIntsArg("dilations", {1, 1})
+        .AddStringArg("activation", "RELU")
+        .AddIntArg("residual", 1)
+        .Finalize(net.NewOperatorDef());
+    net.RunOp(D);
+  }
+  ExpectTensorNear<float>(*expected, *net.GetOutput("Output"), 1e-4, 1e-4);
+}
+}  // namespace
+
+TEST_F(Conv2dOpTest, CPUResidual) {
+  TestResidual<DeviceType::CPU>({17, 13, 5, 7}, 1, 1);
+  TestResidual<DeviceType::CPU>({17, 13, 5, 7}, 3, 1);
+  TestResidual<DeviceType::CPU>({32, 32, 16, 16}, 3, 2);
+}
+
+TEST_F(Conv2dOpTest, OPENCLResidual) {
+  TestResidual<DeviceType::GPU>({17, 13, 5, 7}, 1, 1);
+  TestResidual<DeviceType::GPU>({17, 13, 5, 7}, 3, 1);
+  TestResidual<DeviceType::GPU>({32, 32, 16, 16}, 5, 2);
+}
+
+namespace {
+template <DeviceType D>
+void TestDepthToSpace(const std::vector<index_t> &shape,
+                      const int kernel,
+                      const int block_size) {
+  const index_t batch = 2;
+  const index_t height = shape[0];
+  const index_t width = shape[1];
+  const index_t input_channels = shape[2];
+  const index_t output_channels = shape[3];
+  const index_t conv_channels = output_channels * block_size * block_size;
+
+  OpsTestNet net;
+  net.AddRandomInput<D, float>("Input",
+                               {batch, height, width, input_channels});
+  net.AddRandomInput<D, float>(
+      "Filter", {conv_channels, input_channels, kernel, kernel}, true,
+      false);
+  net.AddRandomInput<D, float>("Bias", {conv_channels}, true, false);
+  net.TransformDataFormat<DeviceType::CPU, float>("Input", NHWC, "InputNCHW",
+                                                  NCHW);
+
+  // conv and depth to space, one by one
+  OpDefBuilder("Conv2D", "Conv2dTest")
+      .Input("InputNCHW")
+      .Input("Filter")
+      .Input("Bias")
+      .Output("ConvNCHW")
+      .AddIntsArg("strides", {1, 1})
+      .AddIntArg("padding", Padding::SAME)
+      .AddIntsArg("dilations", {1, 1})
+      .AddStringArg("activation", "RELU")
+      .Finalize(net.NewOperatorDef());
+  net.RunOp();
+  OpDefBuilder("DepthToSpace", "DepthToSpaceTest")
+      .Input("ConvNCHW")
+      .Output("ExpectedNCHW")
+      .AddIntArg("block_size", block_size)
+      .Finalize(net.NewOperatorDef());
+  net.RunOp();
+  net.TransformDataFormat<DeviceType::CPU, float>("ExpectedNCHW", NCHW,
+                                                  "Expected", NHWC);
+  auto expected = net.CreateTensor<float>();
+  expected->Copy(*net.GetOutput("Expected"));
+
+  // the conv storing the depth to space
+  if (D == DeviceType::CPU) {
+    OpDefBuilder("Conv2D", "Conv2dTest")
+        .Input("InputNCHW")
+        .Input("Filter")
+        .Input("Bias")
+        .Output("OutputNCHW")
+        .AddIntsArg("strides", {1, 1})
+        .AddIntArg("padding", Padding::SAME)
+        .AddIntsArg("dilations", {1, 1})
+        .AddStringArg("activation", "RELU")
+        .AddIntArg("depth_to_space", block_size)
+        .Finalize(net.NewOperatorDef());
+    net.RunOp(D);
+    net.TransformDataFormat<DeviceType::CPU, float>("OutputNCHW", NCHW,
+                                                    "Output", NHWC);
+  } else {
+    OpDefBuilder("Conv2D", "Conv2dTest")
+        .Input("Input")
+        .Input("Filter")
+        .Input("Bias")
+        .Output("Output")
+        .OutputShape(expected->shape())
+        .AddIntsArg("strides", {1, 1})
+        .AddIntArg("padding", Padding::SAME)
+        .AddIntsArg("dilations", {1, 1})
+        .AddStringArg("activation", "RELU")
+        .AddIntArg("depth_to_space", block_size)
+        .Finalize(net.NewOperatorDef());
+    net.RunOp(D);
+  }
+  ExpectTensorNear<float>(*expected, *net.GetOutput("Output"), 1e-4, 1e-4);
+}
+}  // namespace
+
+TEST_F(Conv2dOpTest, CPUDepthToSpace) {
+  TestDepthToSpace<DeviceType::CPU>({17, 13, 5, 3}, 1, 2);
+  TestDepthToSpace<DeviceType::CPU>({17, 13, 5, 3}, 3, 3);
+  TestDepthToSpace<DeviceType::CPU>({32, 32, 16, 8}, 3, 2);
+}
+
+TEST_F(Conv2dOpTest, OPENCLDepthToSpace) {
+  TestDepthToSpace<DeviceType::GPU>({17, 13, 5, 4}, 1, 2);
+  TestDepthToSpace<DeviceType::GPU>({17, 13, 5, 8}, 3, 3);
+  TestDepthToSpace<DeviceType::GPU>({32, 32, 16, 4}, 5, 2);
+}
+
 namespace {
 template <DeviceType D>
 void TestHalfComplexConvNxNS12(const std::vector<index_t> &input_shape,
@@ -1223,6 +1479,162 @@ TEST_F(Conv2dOpTest, Quant) {
   TestQuant(1, 128, 64, 32, 32, 7, 7, SAME, {3, 3});
 }
 
+#ifdef MACE_ENABLE_NEON
+namespace {
+// the Conv2dAlgorithm values of conv_2d.cc, as kept in the cache files
+const int kConv2dGemm1x1 = 0;
+const int kConv2dImplicitGemm = 1;
+const int kConv2dWinograd = 2;
+const int kConv2dDirect = 3;
+
+struct ConvCase {
+  std::vector<index_t> input_shape;
+  std::vector<index_t> filter_shape;
+  std::vector<int> strides;
+  std::vector<int> dilations;
+  std::vector<int> paddings;
+};
+
+// Runs the conv of an NCHW input with the algorithm cache, expects the
+// output of the reference conv and returns the algorithm run.
+int RunConvWithCache(const ConvCase &conv,
+                     const std::shared_ptr<AlgorithmCache> &cache) {
+  OpsTestNet net;
+  net.AddRandomInput<DeviceType::CPU, float>("Input", conv.input_shape,
+                                             false, false);
+  net.AddRandomInput<DeviceType::CPU, float>("Filter", conv.filter_shape,
+                                             true, false);
+  net.ws()->set_algorithm_cache(cache);
+  OpDefBuilder("Conv2D", "Conv2DTest")
+      .Input("Input")
+      .Input("Filter")
+      .Output("Output")
+      .AddIntsArg("strides", conv.strides)
+      .AddIntsArg("padding_values", conv.paddings)
+      .AddIntsArg("dilations", conv.dilations)
+      .Finalize(net.NewOperatorDef());
+  net.RunOp();
+
+  ref::Conv2d<float> conv2d(conv.paddings[0], conv.paddings[1],
+                            conv.strides[0], conv.strides[1],
+                            conv.dilations[0], conv.dilations[1]);
+  Tensor *expected = net.ws()->CreateTensor("Expected", GetCPUAllocator(),
+                                            DT_FLOAT);
+  expected->Resize(net.GetOutput("Output")->shape());
+  OpContext context(net.ws(),
+                    OpTestContext::Get()->GetDevice(DeviceType::CPU));
+  conv2d.Compute(&context, net.GetTensor("Input"), net.GetTensor("Filter"),
+                 expected);
+  ExpectTensorNear<float>(*expected, *net.GetOutput("Output"), 1e-4, 1e-4);
+  return cache->last_selected();
+}
+
+// the key of the only algorithm in the cache
+std::string CachedKey(AlgorithmCache *cache) {
+  FileStorage storage("");
+  cache->Export("", &storage);
+  const std::vector<std::string> keys = storage.Keys();
+  MACE_CHECK(keys.size() == 1, "expected one key, got ", keys.size());
+  return keys[0];
+}
+
+std::string AlgorithmCachePath() {
+  const char *storage_path = getenv("MACE_INTERNAL_STORAGE_PATH");
+  return std::string(storage_path == nullptr ? "." : storage_path) +
+      "/conv_2d_algorithm_cache.bin";
+}
+
+const ConvCase kConv3x3 = {{1, 8, 10, 12}, {8, 8, 3, 3}, {1, 1}, {1, 1},
+                           {2, 2}};
+}  // namespace
+
+TEST_F(Conv2dOpTest, CPUForcedAlgorithms) {
+  const ConvCase cases[] = {
+      {{1, 16, 9, 11}, {16, 16, 1, 1}, {1, 1}, {1, 1}, {0, 0}},
+      kConv3x3,
+      {{2, 5, 13, 11}, {7, 5, 3, 3}, {2, 2}, {1, 1}, {2, 2}},
+      {{1, 3, 15, 17}, {4, 3, 5, 5}, {1, 1}, {2, 2}, {4, 4}},
+      {{1, 4, 9, 20}, {6, 4, 1, 7}, {1, 1}, {1, 1}, {0, 6}},
+  };
+  for (const ConvCase &conv : cases) {
+    for (int algorithm : {kConv2dGemm1x1, kConv2dImplicitGemm,
+                          kConv2dWinograd, kConv2dDirect}) {
+      auto cache = std::make_shared<AlgorithmCache>();
+      cache->Force(algorithm);
+      const int selected = RunConvWithCache(conv, cache);
+      // the forced algorithm runs if it applies to the conv
+      const bool is_1x1 = conv.filter_shape[2] == 1 &&
+          conv.filter_shape[3] == 1 && conv.strides[0] == 1;
+      if (algorithm == kConv2dImplicitGemm || algorithm == kConv2dDirect ||
+          (algorithm == kConv2dGemm1x1 && is_1x1) ||
+          (algorithm == kConv2dWinograd && &conv == &cases[1])) {
+        EXPECT_EQ(algorithm, selected) << "filter "
+                                       << MakeString(conv.filter_shape);
+      }
+    }
+  }
+}
+
+TEST_F(Conv2dOpTest, CPUTunedAlgorithmReload) {
+  const std::string path = AlgorithmCachePath();
+  std::remove(path.c_str());
+  std::string key;
+  int tuned = -1;
+  {
+    auto cache = std::make_shared<AlgorithmCache>(path);
+    tuned = RunConvWithCache(kConv3x3, cache);
+    key = CachedKey(cache.get());
+    cache->Flush();
+  }
+  {
+    auto cache = std::make_shared<AlgorithmCache>(path);
+    int cached = -1;
+    ASSERT_TRUE(cache->Find(key, &cached));
+    EXPECT_EQ(tuned, cached);
+    EXPECT_EQ(tuned, RunConvWithCache(kConv3x3, cache));
+  }
+  // another algorithm in the file is run as is, without benchmarking
+  const int other =
+      tuned == kConv2dDirect ? kConv2dImplicitGemm : kConv2dDirect;
+  {
+    AlgorithmCache cache(path);
+    cache.Insert(key, other);
+    cache.Flush();
+  }
+  EXPECT_EQ(other, RunConvWithCache(
+      kConv3x3, std::make_shared<AlgorithmCache>(path)));
+  std::remove(path.c_str());
+}
+
+TEST_F(Conv2dOpTest, CPUStaleAlgorithm) {
+  const std::string path = AlgorithmCachePath();
+  std::remove(path.c_str());
+  std::string key;
+  {
+    auto cache = std::make_shared<AlgorithmCache>(path);
+    RunConvWithCache(kConv3x3, cache);
+    key = CachedKey(cache.get());
+  }
+  // 1x1 gemm does not apply to the 3x3 conv, and the value is of no
+  // algorithm, e.g. of a later version
+  for (int stale : {kConv2dGemm1x1, 99}) {
+    {
+      AlgorithmCache cache(path);
+      cache.Insert(key, stale);
+      cache.Flush();
+    }
+    auto cache = std::make_shared<AlgorithmCache>(path);
+    const int selected = RunConvWithCache(kConv3x3, cache);
+    EXPECT_NE(stale, selected);
+    // benchmarked again, in place of the stale one
+    int cached = -1;
+    ASSERT_TRUE(cache->Find(key, &cached));
+    EXPECT_EQ(selected, cached);
+  }
+  std::remove(path.c_str());
+}
+#endif  // MACE_ENABLE_NEON
+
 }  // namespace test
 }  // namespace ops
 }  // namespace mace
@@ -34,6 +34,26 @@ class ConvPool2dOpBase : public Operation {
         dilations_(Operation::GetRepeatedArgs<int>("dilations", {1, 1})) {}
 
  protected:
+  // output shape and paddings of an NCHW input shape, the logical shape of
+  // the input of the NCHWc kernels
+  void CalcNCHWOutputShape(const index_t *input_shape,
+                           const index_t *filter_shape,
+                           const RoundType round_type,
+                           index_t *output_shape,
+                           int *paddings) const {
+    if (paddings_.empty()) {
+      CalcNCHWPaddingAndOutputSize(input_shape, filter_shape,
+                                   dilations_.data(), strides_.data(),
+                                   padding_type_, output_shape, paddings);
+    } else {
+      paddings[0] = paddings_[0];
+      paddings[1] = paddings_[1];
+      CalcNCHWOutputSize(input_shape, filter_shape, paddings_.data(),
+                         dilations_.data(), strides_.data(), round_type,
+                         output_shape);
+    }
+  }
+
   std::vector<int> strides_;
   Padding padding_type_;
   std::vector<int> paddings_;
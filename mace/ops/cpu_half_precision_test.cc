@@ -0,0 +1,184 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <vector>
+
+#include "mace/core/cpu_half_precision.h"
+#include "mace/ops/ops_test_util.h"
+
+namespace mace {
+namespace ops {
+namespace test {
+
+// half tensors are only built with OpenCL or the fp16 kernels
+#if defined(MACE_ENABLE_OPENCL) || defined(MACE_ENABLE_FP16_NEON)
+class CPUHalfPrecisionTest : public OpsTestBase {};
+
+namespace {
+
+// the conversion only looks the kernels up, it never creates them
+std::unique_ptr<Operation> UnusedCreator(OpConstructContext *context) {
+  MACE_UNUSED(context);
+  return nullptr;
+}
+
+void AddWeight(const std::string &name,
+               const std::vector<index_t> &shape,
+               Workspace *ws,
+               NetDef *net_def) {
+  Tensor *tensor = ws->CreateTensor(name, GetCPUAllocator(), DT_FLOAT, true);
+  tensor->Resize(shape);
+  float *data = tensor->mutable_data<float>();
+  for (index_t i = 0; i < tensor->size(); ++i) {
+    data[i] = 0.25f * (i % 9) - 1.f;
+  }
+  ConstTensor *const_tensor = net_def->add_tensors();
+  const_tensor->set_name(name);
+  const_tensor->set_data_type(DT_FLOAT);
+  for (auto dim : shape) {
+    const_tensor->add_dims(dim);
+  }
+}
+
+std::vector<std::string> OpInputs(const OperatorDef &op) {
+  return std::vector<std::string>(op.input().begin(), op.input().end());
+}
+
+}  // namespace
+
+TEST_F(CPUHalfPrecisionTest, CastsAtBoundaries) {
+  OpRegistryBase registry;
+  registry.Register("Conv2D", DeviceType::CPU, DT_FLOAT, UnusedCreator);
+  registry.Register("Conv2D", DeviceType::CPU, DT_HALF, UnusedCreator);
+  registry.Register("Pooling", DeviceType::CPU, DT_FLOAT, UnusedCreator);
+  registry.Register("BiasAdd", DeviceType::CPU, DT_FLOAT, UnusedCreator);
+
+  Workspace ws;
+  NetDef net_def;
+  const std::vector<index_t> shape = {1, 3, 8, 8};
+  AddWeight("filter", {3, 3, 3, 3}, &ws, &net_def);
+  AddWeight("bias", {3}, &ws, &net_def);
+  AddWeight("filter2", {3, 3, 1, 1}, &ws, &net_def);
+  InputInfo *input_info = net_def.add_input_info();
+  input_info->set_name("input");
+  for (auto dim : shape) {
+    input_info->add_dims(static_cast<int>(dim));
+  }
+  net_def.add_output_info()->set_name("output");
+  // half conv, float pooling and bias add, half conv
+  OpDefBuilder("Conv2D", "ConvOp")
+      .Input("input").Input("filter").Input("bias")
+      .Output("conv").OutputShape(shape)
+      .Finalize(net_def.add_op());
+  OpDefBuilder("Pooling", "PoolOp")
+      .Input("conv").Output("pool").OutputShape(shape)
+      .Finalize(net_def.add_op());
+  OpDefBuilder("BiasAdd", "BiasAddOp")
+      .Input("pool").Input("bias").Output("biased").OutputShape(shape)
+      .Finalize(net_def.add_op());
+  OpDefBuilder("Conv2D", "Conv2Op")
+      .Input("biased").Input("filter2").Output("output").OutputShape(shape)
+      .Finalize(net_def.add_op());
+
+  ASSERT_EQ(ConvertToCPUHalfPrecision(&registry, &ws, &net_def),
+            MaceStatus::MACE_SUCCESS);
+
+  const std::vector<std::string> types = {
+      "Cast", "Conv2D", "Cast", "Pooling", "BiasAdd", "Cast", "Conv2D",
+      "Cast"};
+  ASSERT_EQ(net_def.op_size(), static_cast<int>(types.size()));
+  for (int i = 0; i < net_def.op_size(); ++i) {
+    EXPECT_EQ(types[i], net_def.op(i).type()) << "op " << i;
+  }
+  auto op_type = [&net_def](int i) {
+    return static_cast<DataType>(ProtoArgHelper::GetOptionalArg<
+        OperatorDef, int>(net_def.op(i), "T", DT_FLOAT));
+  };
+  auto half_precision = [&net_def](int i) {
+    return ProtoArgHelper::GetOptionalArg<OperatorDef, int>(
+        net_def.op(i), kHalfPrecisionArg, 0);
+  };
+
+  EXPECT_EQ(std::vector<std::string>({"input"}), OpInputs(net_def.op(0)));
+  EXPECT_EQ(DT_HALF, net_def.op(0).output_type(0));
+  EXPECT_EQ(std::vector<std::string>(
+                {"input_half", "filter_half", "bias_half"}),
+            OpInputs(net_def.op(1)));
+  EXPECT_EQ(DT_HALF, op_type(1));
+  EXPECT_EQ(1, half_precision(1));
+  // the half output is cast back for the float ops
+  EXPECT_EQ(std::vector<std::string>({"conv"}), OpInputs(net_def.op(2)));
+  EXPECT_EQ(DT_HALF, op_type(2));
+  EXPECT_EQ(std::vector<std::string>({"conv_float"}),
+            OpInputs(net_def.op(3)));
+  EXPECT_EQ(DT_FLOAT, op_type(3));
+  EXPECT_EQ(0, half_precision(3));
+  EXPECT_EQ(std::vector<std::string>({"pool", "bias"}),
+            OpInputs(net_def.op(4)));
+  EXPECT_EQ(std::vector<std::string>({"biased_half", "filter2_half"}),
+            OpInputs(net_def.op(6)));
+  // the output of the net stays float
+  EXPECT_EQ("output_half", net_def.op(6).output(0));
+  EXPECT_EQ(std::vector<std::string>({"output_half"}),
+            OpInputs(net_def.op(7)));
+  EXPECT_EQ("output", net_def.op(7).output(0));
+  EXPECT_EQ(DT_FLOAT, net_def.op(7).output_type(0));
+
+  // the float weights read by half ops only are dropped
+  EXPECT_FALSE(ws.HasTensor("filter"));
+  EXPECT_FALSE(ws.HasTensor("filter2"));
+  EXPECT_TRUE(ws.HasTensor("bias"));
+  for (auto name : {"filter_half", "bias_half", "filter2_half"}) {
+    ASSERT_TRUE(ws.HasTensor(name)) << name;
+    EXPECT_EQ(DT_HALF, ws.GetTensor(name)->dtype()) << name;
+  }
+  const Tensor *filter_half = ws.GetTensor("filter_half");
+  EXPECT_EQ(std::vector<index_t>({3, 3, 3, 3}), filter_half->shape());
+  const half *filter_data = filter_half->data<half>();
+  for (index_t i = 0; i < filter_half->size(); ++i) {
+    EXPECT_EQ(0.25f * (i % 9) - 1.f, static_cast<float>(filter_data[i]));
+  }
+}
+
+TEST_F(CPUHalfPrecisionTest, KeepsOpsWithoutHalfKernels) {
+  OpRegistryBase registry;
+  registry.Register("Pooling", DeviceType::CPU, DT_FLOAT, UnusedCreator);
+
+  Workspace ws;
+  NetDef net_def;
+  const std::vector<index_t> shape = {1, 3, 8, 8};
+  InputInfo *input_info = net_def.add_input_info();
+  input_info->set_name("input");
+  for (auto dim : shape) {
+    input_info->add_dims(static_cast<int>(dim));
+  }
+  net_def.add_output_info()->set_name("output");
+  OpDefBuilder("Pooling", "PoolOp")
+      .Input("input").Output("output").OutputShape(shape)
+      .Finalize(net_def.add_op());
+  NetDef expected = net_def;
+
+  ASSERT_EQ(ConvertToCPUHalfPrecision(&registry, &ws, &net_def),
+            MaceStatus::MACE_SUCCESS);
+  ASSERT_EQ(expected.op_size(), net_def.op_size());
+  EXPECT_EQ(expected.op(0).SerializeAsString(),
+            net_def.op(0).SerializeAsString());
+}
+
+#endif  // MACE_ENABLE_OPENCL || MACE_ENABLE_FP16_NEON
+
+}  // namespace test
+}  // namespace ops
+}  // namespace mace
@@ -0,0 +1,65 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifdef MACE_ENABLE_OPENMP
+#include <omp.h>
+#endif
+
+#include <thread>  // NOLINT(build/c++11)
+
+#include "mace/core/runtime/cpu/cpu_runtime.h"
+#include "mace/ops/ops_test_util.h"
+
+namespace mace {
+namespace ops {
+namespace test {
+
+class CPURuntimeTest : public OpsTestBase {};
+
+#ifdef MACE_ENABLE_OPENMP
+TEST_F(CPURuntimeTest, OpenMPThreadsPerRuntime) {
+  CPURuntime first(2, CPUAffinityPolicy::AFFINITY_NONE, false);
+  CPURuntime second(3, CPUAffinityPolicy::AFFINITY_NONE, false);
+  // each run binds the team of the calling thread to its runtime
+  for (CPURuntime *runtime : {&first, &second, &first}) {
+    runtime->BindOpenMPThreads();
+    EXPECT_EQ(runtime->thread_count(), omp_get_max_threads());
+    EXPECT_EQ(runtime->thread_count(), MaceOpenMPThreadCount);
+  }
+
+  // the team of another thread is its own
+  std::thread thread([&second] {
+    second.BindOpenMPThreads();
+    EXPECT_EQ(second.thread_count(), omp_get_max_threads());
+    EXPECT_EQ(second.thread_count(), MaceOpenMPThreadCount);
+  });
+  thread.join();
+  EXPECT_EQ(first.thread_count(), omp_get_max_threads());
+  EXPECT_EQ(first.thread_count(), MaceOpenMPThreadCount);
+
+  // a team bound to a runtime is bound again once its settings change
+  omp_set_num_threads(1);
+  first.BindOpenMPThreads();
+  EXPECT_EQ(1, omp_get_max_threads());
+  ASSERT_EQ(first.SetScheduling(CPUSchedulingPolicy::CPU_SCHED_NORMAL, 0),
+            MaceStatus::MACE_SUCCESS);
+  omp_set_num_threads(1);
+  first.BindOpenMPThreads();
+  EXPECT_EQ(first.thread_count(), omp_get_max_threads());
+}
+#endif  // MACE_ENABLE_OPENMP
+
+}  // namespace test
+}  // namespace ops
+}  // namespace mace
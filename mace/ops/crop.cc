@@ -13,6 +13,7 @@
 // limitations under the License.
 
 #include <memory>
+#include <vector>
 
 #include "mace/core/operator.h"
 #ifdef MACE_ENABLE_OPENCL
@@ -68,6 +69,20 @@ class CropOp : public Operation {
 
     const T * input_data = input0->data<T>();
 
+    // the memory optimizer plans the output as a view into the input when
+    // it is a contiguous range of it, which is already in place
+    if (IsInPlace(input_data, output_data, input0->shape(), output_shape,
+                  offsets.data())) {
+      return MaceStatus::MACE_SUCCESS;
+    }
+    std::vector<T> input_copy;
+    if (output_data < input_data + input0->size() &&
+        output_data + output->size() > input_data) {
+      // a view whose shape changed, don't overwrite the input before reading
+      input_copy.assign(input_data, input_data + input0->size());
+      input_data = input_copy.data();
+    }
+
     crop_copy(input_data, output_data, input0->shape(),
               output_shape, offsets.data());
 
@@ -75,6 +90,30 @@ class CropOp : public Operation {
   }
 
  private:
+  // whether the output is the range of the input it crops, the dims
+  // before the last cropped one being 1 and those after it whole
+  bool IsInPlace(const T *input_data, const T *output_data,
+                 const std::vector<index_t> &input_shape,
+                 const std::vector<index_t> &output_shape,
+                 const int32_t *offsets) {
+    int last_cropped = -1;
+    for (int i = 0; i < 4; ++i) {
+      if (offsets[i] != 0 || output_shape[i] != input_shape[i]) {
+        last_cropped = i;
+      }
+    }
+    index_t offset = 0;
+    index_t stride = 1;
+    for (int i = 3; i >= 0; --i) {
+      if (i < last_cropped && output_shape[i] != 1) {
+        return false;
+      }
+      offset += offsets[i] * stride;
+      stride *= input_shape[i];
+    }
+    return output_data == input_data + offset;
+  }
+
   void crop_copy(const T* input_data, T* output_data,
                  const std::vector<index_t> &input_shape,
                  const std::vector<index_t> &output_shape,
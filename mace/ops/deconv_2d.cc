@@ -30,6 +30,9 @@
 #include "mace/ops/arm/deconv_2d_neon.h"
 #include "mace/utils/memory.h"
 #include "mace/utils/utils.h"
+#ifdef MACE_ENABLE_NEON
+#include "mace/ops/arm/fp32/deconv_2d_gemm.h"
+#endif  // MACE_ENABLE_NEON
 #ifdef MACE_ENABLE_OPENCL
 #include "mace/ops/opencl/buffer_transformer.h"
 #include "mace/ops/opencl/image/deconv_2d.h"
@@ -138,18 +141,41 @@ class Deconv2dOp<DeviceType::CPU, float> : public Deconv2dOpBase {
     const index_t pad_h = out_paddings[0] / 2;
     const index_t pad_w = out_paddings[1] / 2;
 
-    index_t padded_out_size =
+    bool no_pad =
+        (padded_out_shape[2] == out_shape[2]) &&
+            (padded_out_shape[3] == out_shape[3]);
+#ifdef MACE_ENABLE_NEON
+    const bool use_gemm = arm::fp32::Deconv2dGemm::Preferred(
+        in_shape, filter->shape().data(), strides_.data());
+#else
+    const bool use_gemm = false;
+#endif  // MACE_ENABLE_NEON
+
+    // the padded output is kept in the scratch, before the buffers of gemm
+    const index_t padded_out_size = use_gemm && no_pad ? 0 : PadAlignSize(
         std::accumulate(padded_out_shape.begin(),
                         padded_out_shape.end(),
                         1,
-                        std::multiplies<index_t>()) * sizeof(float);
+                        std::multiplies<index_t>()) * sizeof(float));
+    index_t scratch_size = padded_out_size;
+#ifdef MACE_ENABLE_NEON
+    if (use_gemm) {
+      scratch_size += deconv_gemm_.ScratchSize(in_shape,
+                                               filter->shape().data());
+    }
+#endif  // MACE_ENABLE_NEON
     ScratchBuffer *scratch = context->device()->scratch_buffer();
     scratch->Rewind();
-    scratch->GrowSize(padded_out_size);
-    Tensor padded_out(scratch->Scratch(padded_out_size), DT_FLOAT);
-    padded_out.Reshape(padded_out_shape);
-    padded_out.Clear();
-    auto *padded_out_data = padded_out.mutable_data<float>();
+    MACE_RETURN_IF_ERROR(scratch->GrowSize(scratch_size));
+    float *padded_out_data = nullptr;
+    std::unique_ptr<Tensor> padded_out;
+    if (padded_out_size > 0) {
+      padded_out = make_unique<Tensor>(scratch->Scratch(padded_out_size),
+                                       DT_FLOAT);
+      padded_out->Reshape(padded_out_shape);
+      padded_out->Clear();
+      padded_out_data = padded_out->mutable_data<float>();
+    }
 
     bool use_neon_2x2_s1 = kernel_h == kernel_w && kernel_h == 2 &&
         strides_[0] == strides_[1] && strides_[0] == 1;
@@ -255,16 +281,22 @@ class Deconv2dOp<DeviceType::CPU, float> : public Deconv2dOpBase {
       };
     }
 
-    bool no_pad =
-        (padded_out_shape[2] == out_shape[2]) &&
-            (padded_out_shape[3] == out_shape[3]);
     float *out_data = no_pad ? output_data : padded_out_data;
 
-    deconv_func(input_data,
-                filter_data,
-                in_shape,
-                padded_out_shape.data(),
-                out_data);
+    if (use_gemm) {
+#ifdef MACE_ENABLE_NEON
+      MACE_RETURN_IF_ERROR(deconv_gemm_.Compute(context, input, filter,
+                                                strides_.data(),
+                                                padded_out_shape.data(),
+                                                out_data));
+#endif  // MACE_ENABLE_NEON
+    } else {
+      deconv_func(input_data,
+                  filter_data,
+                  in_shape,
+                  padded_out_shape.data(),
+                  out_data);
+    }
     if (!no_pad) {
       CropPadOut<float>(out_data,
                         padded_out_shape.data(),
@@ -353,6 +385,10 @@ class Deconv2dOp<DeviceType::CPU, float> : public Deconv2dOpBase {
       }
     }
   }
+
+#ifdef MACE_ENABLE_NEON
+  arm::fp32::Deconv2dGemm deconv_gemm_;
+#endif  // MACE_ENABLE_NEON
 };
 
 #ifdef MACE_ENABLE_OPENCL
@@ -128,6 +128,8 @@ MACE_BM_DECONV_2D(1, 3, 224, 224, 3, 3, 2, 448, 448, SAME, 32);
 
 MACE_BM_DECONV_2D(1, 32, 1014, 762, 9, 9, 2, 2035, 1531, VALID, 1);
 
+MACE_BM_DECONV_2D(1, 64, 90, 160, 8, 8, 4, 360, 640, SAME, 3);
+
 }  // namespace test
 }  // namespace ops
 }  // namespace mace
@@ -12,6 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include <fstream>
 #include <vector>
 
@@ -358,6 +359,89 @@ TEST_F(Deconv2dOpTest, OPENCLSimple3X3PaddingValid_S2) {
   TestNHWCSimple3x3VALID_S2<DeviceType::GPU>();
 }
 
+namespace {
+// NCHW caffe deconv of any kernel and stride against the direct definition
+void TestCPUDeconvNxN(const std::vector<index_t> &input_shape,
+                      const index_t out_channels,
+                      const int kernel,
+                      const int stride,
+                      const int padding) {
+  OpsTestNet net;
+  const index_t batch = input_shape[0];
+  const index_t in_channels = input_shape[1];
+  const index_t in_height = input_shape[2];
+  const index_t in_width = input_shape[3];
+  net.AddRandomInput<DeviceType::CPU, float>("Input", input_shape, false,
+                                             false);
+  net.AddRandomInput<DeviceType::CPU, float>(
+      "Filter", {out_channels, in_channels, kernel, kernel}, true, false);
+  net.AddRandomInput<DeviceType::CPU, float>("Bias", {out_channels}, true,
+                                             false);
+  OpDefBuilder("Deconv2D", "Deconv2dTest")
+      .Input("Input")
+      .Input("Filter")
+      .Input("Bias")
+      .Output("Output")
+      .AddIntsArg("strides", {stride, stride})
+      .AddIntsArg("padding_values", {padding, padding})
+      .AddIntArg("framework_type", ops::FrameworkType::CAFFE)
+      .Finalize(net.NewOperatorDef());
+  net.RunOp(DeviceType::CPU);
+
+  const index_t out_height = (in_height - 1) * stride + kernel - padding;
+  const index_t out_width = (in_width - 1) * stride + kernel - padding;
+  const float *input = net.GetTensor("Input")->data<float>();
+  const float *filter = net.GetTensor("Filter")->data<float>();
+  const float *bias = net.GetTensor("Bias")->data<float>();
+  std::vector<float> expected_data(
+      batch * out_channels * out_height * out_width);
+  for (index_t b = 0; b < batch; ++b) {
+    for (index_t oc = 0; oc < out_channels; ++oc) {
+      float *out = expected_data.data()
+          + (b * out_channels + oc) * out_height * out_width;
+      std::fill(out, out + out_height * out_width, bias[oc]);
+      for (index_t ic = 0; ic < in_channels; ++ic) {
+        for (index_t h = 0; h < in_height; ++h) {
+          for (index_t w = 0; w < in_width; ++w) {
+            const float value = input[((b * in_channels + ic) * in_height
+                + h) * in_width + w];
+            for (index_t kh = 0; kh < kernel; ++kh) {
+              for (index_t kw = 0; kw < kernel; ++kw) {
+                const index_t oh = h * stride + kh - padding / 2;
+                const index_t ow = w * stride + kw - padding / 2;
+                if (oh < 0 || oh >= out_height || ow < 0
+                    || ow >= out_width) {
+                  continue;
+                }
+                out[oh * out_width + ow] += value * filter[
+                    ((oc * in_channels + ic) * kernel + kh) * kernel + kw];
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+  auto expected = net.CreateTensor<float>(
+      {batch, out_channels, out_height, out_width}, expected_data);
+  ExpectTensorNear<float>(*expected, *net.GetOutput("Output"), 1e-4, 1e-4);
+}
+}  // namespace
+
+TEST_F(Deconv2dOpTest, CPUDeconvNxN) {
+  // the shapes without direct kernels
+  TestCPUDeconvNxN({1, 16, 13, 11}, 3, 8, 4, 4);
+  TestCPUDeconvNxN({2, 5, 7, 9}, 7, 5, 3, 2);
+  TestCPUDeconvNxN({1, 3, 6, 6}, 4, 3, 3, 0);
+  TestCPUDeconvNxN({1, 8, 5, 5}, 8, 1, 2, 0);
+  // wide enough for gemm to replace the direct kernels
+  TestCPUDeconvNxN({1, 64, 9, 10}, 16, 3, 1, 2);
+  TestCPUDeconvNxN({2, 64, 6, 5}, 32, 4, 2, 2);
+  // the direct kernels
+  TestCPUDeconvNxN({1, 8, 9, 10}, 4, 3, 1, 2);
+  TestCPUDeconvNxN({1, 8, 9, 10}, 4, 2, 2, 0);
+}
+
 namespace {
 template <DeviceType D, typename T>
 void TestComplexDeconvNxN(const int batch,
@@ -25,12 +25,19 @@
 // We reuse TensorFlow Lite's optimized depthwiseconv_uint8 and parallelized it
 // using OpenMP for MACE's quantized depthwise_conv2d.
 #include "tensorflow/contrib/lite/kernels/internal/optimized/depthwiseconv_uint8.h"
+#ifdef MACE_ENABLE_NEON
+#include "mace/ops/arm/q8/depthwise_conv_2d.h"
+#endif  // MACE_ENABLE_NEON
 #endif  // MACE_ENABLE_QUANTIZE
 
+#include "mace/core/cpu_blocked_layout.h"
+#include "mace/core/cpu_nhwc_layout.h"
 #include "mace/core/future.h"
 #include "mace/core/operator.h"
 #include "mace/ops/activation.h"
 #include "mace/ops/arm/depthwise_conv2d_neon.h"
+#include "mace/ops/arm/nchwc.h"
+#include "mace/ops/arm/nhwc.h"
 #include "mace/ops/conv_pool_2d_base.h"
 #include "mace/public/mace.h"
 #include "mace/utils/memory.h"
@@ -40,6 +47,10 @@
 #include "mace/ops/opencl/buffer/depthwise_conv2d.h"
 #include "mace/ops/opencl/image/depthwise_conv2d.h"
 #endif  // MACE_ENABLE_OPENCL
+#ifdef MACE_ENABLE_FP16_NEON
+#include "mace/ops/arm/fp16/activation.h"
+#include "mace/ops/arm/fp16/depthwise_conv_2d.h"
+#endif  // MACE_ENABLE_FP16_NEON
 
 namespace mace {
 namespace ops {
@@ -67,7 +78,29 @@ template <>
 class DepthwiseConv2dOp<DeviceType::CPU, float> : public DepthwiseConv2dOpBase {
  public:
   explicit DepthwiseConv2dOp(OpConstructContext *context)
-      : DepthwiseConv2dOpBase(context) {}
+      : DepthwiseConv2dOpBase(context),
+        channel_block_(Operation::GetOptionalArg<int>(kChannelBlockArg, 0)),
+        nchwc_filter_(nullptr),
+        nhwc_(Operation::GetOptionalArg<int>(kNHWCArg, 0) == 1),
+        nhwc_filter_(nullptr) {}
+
+  MaceStatus Init(OpInitContext *context) override {
+    MACE_RETURN_IF_ERROR(Operation::Init(context));
+    PackedWeights *packed_weights = context->workspace()->packed_weights();
+    const Tensor *filter = this->Input(FILTER);
+    // packed concurrently with the weights of the other ops
+    return context->RunOrDefer([this, packed_weights, filter]() {
+      if (channel_block_ > 0) {
+        // the constant filter in the blocks of the NCHWc kernel
+        nchwc_filter_ = GetDepthwiseConv2dNCHWcFilter(packed_weights, filter,
+                                                      channel_block_);
+      } else if (nhwc_) {
+        // the constant filter as [H, W, C] of the NHWC kernel
+        nhwc_filter_ = GetDepthwiseConv2dNHWCFilter(packed_weights, filter);
+      }
+      return MaceStatus::MACE_SUCCESS;
+    });
+  }
 
   MaceStatus Run(OpContext *context) override {
     MACE_UNUSED(context);
@@ -81,6 +114,12 @@ class DepthwiseConv2dOp<DeviceType::CPU, float> : public DepthwiseConv2dOpBase {
     MACE_CHECK_NOTNULL(input);
     MACE_CHECK_NOTNULL(filter);
     MACE_CHECK_NOTNULL(output);
+    if (channel_block_ > 0) {
+      return RunNCHWc(input, filter, bias, output);
+    }
+    if (nhwc_) {
+      return RunNHWC(input, filter, bias, output);
+    }
 
     std::vector<index_t> output_shape(4);
     std::vector<int> paddings(2);
@@ -138,11 +177,14 @@ class DepthwiseConv2dOp<DeviceType::CPU, float> : public DepthwiseConv2dOpBase {
     int pad_left = paddings[1] >> 1;
     int pad_right = paddings[1] - pad_left;
 
-    index_t valid_h_start = pad_top == 0 ? 0 : (pad_top - 1) / stride_h + 1;
+    // the paddings of 5x5 or dilated filters may outsize a small output
+    index_t valid_h_start = std::min(
+        height, pad_top == 0 ? 0 : (pad_top - 1) / stride_h + 1);
     index_t valid_h_stop = pad_bottom == 0
                            ? height
                            : height - ((pad_bottom - 1) / stride_h + 1);
-    index_t valid_w_start = pad_left == 0 ? 0 : (pad_left - 1) / stride_w + 1;
+    index_t valid_w_start = std::min(
+        width, pad_left == 0 ? 0 : (pad_left - 1) / stride_w + 1);
     index_t valid_w_stop = pad_right == 0
                            ? width
                            : width - ((pad_right - 1) / stride_w + 1);
@@ -194,6 +236,51 @@ class DepthwiseConv2dOp<DeviceType::CPU, float> : public DepthwiseConv2dOpBase {
                                   valid_w_stop,
                                   output);
       };
+    } else if (filter_h == 3 && filter_w == 3 && stride_h == 1 && stride_w == 1
+        && (dilation_h > 1 || dilation_w > 1)) {
+      const int dilation_hw[2] = {static_cast<int>(dilation_h),
+                                  static_cast<int>(dilation_w)};
+      conv_func = [=](const float *input, float *output) {
+        DepthwiseConv2dNeonK3x3Dilated(input,
+                                       filter_data,
+                                       input_shape,
+                                       output_shape.data(),
+                                       pad_hw,
+                                       dilation_hw,
+                                       valid_h_start,
+                                       valid_h_stop,
+                                       valid_w_start,
+                                       valid_w_stop,
+                                       output);
+      };
+    } else if (filter_h == 5 && filter_w == 5 && stride_h == 1 && stride_w == 1
+        && dilation_h == 1 && dilation_w == 1) {
+      conv_func = [=](const float *input, float *output) {
+        DepthwiseConv2dNeonK5x5S1(input,
+                                  filter_data,
+                                  input_shape,
+                                  output_shape.data(),
+                                  pad_hw,
+                                  valid_h_start,
+                                  valid_h_stop,
+                                  valid_w_start,
+                                  valid_w_stop,
+                                  output);
+      };
+    } else if (filter_h == 5 && filter_w == 5 && stride_h == 2 && stride_w == 2
+        && dilation_h == 1 && dilation_w == 1) {
+      conv_func = [=](const float *input, float *output) {
+        DepthwiseConv2dNeonK5x5S2(input,
+                                  filter_data,
+                                  input_shape,
+                                  output_shape.data(),
+                                  pad_hw,
+                                  valid_h_start,
+                                  valid_h_stop,
+                                  valid_w_start,
+                                  valid_w_stop,
+                                  output);
+      };
     } else {
       conv_func = [=](const float *input, float *output) {
         DepthwiseConv2dGeneral(input,
@@ -229,6 +316,86 @@ class DepthwiseConv2dOp<DeviceType::CPU, float> : public DepthwiseConv2dOpBase {
   }
 
  private:
+  // the input and the output in NCHWc, [N, C / block, H, W, block]
+  MaceStatus RunNCHWc(const Tensor *input,
+                      const Tensor *filter,
+                      const Tensor *bias,
+                      Tensor *output) {
+    MACE_CHECK(input->dim_size() == 5 && input->dim(4) == channel_block_,
+               "NCHWc input should be 5D of block ", channel_block_);
+    MACE_CHECK(filter->dim(0) == 1, "NCHWc needs multiplier 1");
+    const std::vector<index_t> input_shape = {
+        input->dim(0), input->dim(1) * channel_block_, input->dim(2),
+        input->dim(3)};
+    MACE_CHECK(filter->dim(1) == input_shape[1], filter->dim(1), " != ",
+               input_shape[1]);
+    const std::vector<index_t> filter_shape = {
+        filter->dim(1), filter->dim(1), filter->dim(2), filter->dim(3)};
+    std::vector<index_t> output_shape(4);
+    std::vector<int> paddings(2);
+    CalcNCHWOutputShape(input_shape.data(), filter_shape.data(),
+                        RoundType::FLOOR, output_shape.data(),
+                        paddings.data());
+    MACE_RETURN_IF_ERROR(output->Resize(
+        {output_shape[0], output_shape[1] / channel_block_, output_shape[2],
+         output_shape[3], channel_block_}));
+
+    Tensor::MappingGuard input_guard(input);
+    Tensor::MappingGuard bias_guard(bias);
+    Tensor::MappingGuard output_guard(output);
+    float *output_data = output->mutable_data<float>();
+    const int filter_hw[2] = {static_cast<int>(filter->dim(2)),
+                              static_cast<int>(filter->dim(3))};
+    const int pad_hw[2] = {paddings[0] >> 1, paddings[1] >> 1};
+    DepthwiseConv2dNCHWc(input->data<float>(), nchwc_filter_,
+                         bias == nullptr ? nullptr : bias->data<float>(),
+                         input_shape.data(), output_shape.data(), filter_hw,
+                         strides_.data(), dilations_.data(), pad_hw,
+                         channel_block_, output_data);
+    DoActivation(output_data, output_data, output->size(), activation_,
+                 relux_max_limit_, leakyrelu_coefficient_);
+    return MaceStatus::MACE_SUCCESS;
+  }
+
+  // the input and the output in NHWC
+  MaceStatus RunNHWC(const Tensor *input,
+                     const Tensor *filter,
+                     const Tensor *bias,
+                     Tensor *output) {
+    MACE_CHECK(input->dim_size() == 4, "NHWC input should be 4D");
+    MACE_CHECK(filter->dim(0) == 1, "NHWC needs multiplier 1");
+    MACE_CHECK(filter->dim(1) == input->dim(3), filter->dim(1), " != ",
+               input->dim(3));
+    const std::vector<index_t> input_shape = {
+        input->dim(0), input->dim(3), input->dim(1), input->dim(2)};
+    const std::vector<index_t> filter_shape = {
+        filter->dim(1), filter->dim(1), filter->dim(2), filter->dim(3)};
+    std::vector<index_t> output_shape(4);
+    std::vector<int> paddings(2);
+    CalcNCHWOutputShape(input_shape.data(), filter_shape.data(),
+                        RoundType::FLOOR, output_shape.data(),
+                        paddings.data());
+    output_shape = {output_shape[0], output_shape[2], output_shape[3],
+                    output_shape[1]};
+    MACE_RETURN_IF_ERROR(output->Resize(output_shape));
+
+    Tensor::MappingGuard input_guard(input);
+    Tensor::MappingGuard bias_guard(bias);
+    Tensor::MappingGuard output_guard(output);
+    float *output_data = output->mutable_data<float>();
+    const int filter_hw[2] = {static_cast<int>(filter->dim(2)),
+                              static_cast<int>(filter->dim(3))};
+    const int pad_hw[2] = {paddings[0] >> 1, paddings[1] >> 1};
+    DepthwiseConv2dNHWC(input->data<float>(), nhwc_filter_,
+                        bias == nullptr ? nullptr : bias->data<float>(),
+                        input->shape().data(), output_shape.data(), filter_hw,
+                        strides_.data(), dilations_.data(), pad_hw,
+                        output_data);
+    DoActivation(output_data, output_data, output->size(), activation_,
+                 relux_max_limit_, leakyrelu_coefficient_);
+    return MaceStatus::MACE_SUCCESS;
+  }
+
   void DepthwiseConv2dGeneral(const float *input,
                               const float *filter,
                               const index_t *in_shape,
@@ -279,10 +446,95 @@ class DepthwiseConv2dOp<DeviceType::CPU, float> : public DepthwiseConv2dOpBase {
     }
   }
 
+  // channels of a block of the NCHWc layout, 0 for NCHW
+  const int channel_block_;
+  // the filter packed for the NCHWc kernel, owned by the packed weights
+  const float *nchwc_filter_;
+  // whether the input and the output are NHWC
+  const bool nhwc_;
+  // the filter packed for the NHWC kernel, owned by the packed weights
+  const float *nhwc_filter_;
+
+ protected:
+  MACE_OP_INPUT_TAGS(INPUT, FILTER, BIAS);
+  MACE_OP_OUTPUT_TAGS(OUTPUT);
+};
+
+#ifdef MACE_ENABLE_FP16_NEON
+template <>
+class DepthwiseConv2dOp<DeviceType::CPU, half> : public DepthwiseConv2dOpBase {
+ public:
+  explicit DepthwiseConv2dOp(OpConstructContext *context)
+      : DepthwiseConv2dOpBase(context) {}
+
+  MaceStatus Run(OpContext *context) override {
+    MACE_UNUSED(context);
+    const Tensor *input = this->Input(INPUT);
+    const Tensor *filter = this->Input(FILTER);
+    const Tensor *bias = this->InputSize() >= 3 ? this->Input(BIAS) : nullptr;
+    Tensor *output = this->Output(OUTPUT);
+
+    std::vector<index_t> output_shape(4);
+    std::vector<int> paddings(2);
+    std::vector<index_t> filter_shape
+        {filter->dim(0) * filter->dim(1), filter->dim(1), filter->dim(2),
+         filter->dim(3)};
+    if (paddings_.empty()) {
+      CalcNCHWPaddingAndOutputSize(input->shape().data(),
+                                   filter_shape.data(),
+                                   dilations_.data(),
+                                   strides_.data(),
+                                   padding_type_,
+                                   output_shape.data(),
+                                   paddings.data());
+    } else {
+      paddings = paddings_;
+      CalcNCHWOutputSize(input->shape().data(),
+                         filter_shape.data(),
+                         paddings_.data(),
+                         dilations_.data(),
+                         strides_.data(),
+                         RoundType::FLOOR,
+                         output_shape.data());
+    }
+    MACE_RETURN_IF_ERROR(output->Resize(output_shape));
+    MACE_CHECK(filter_shape[1] == input->dim(1), filter_shape[1], " != ",
+               input->dim(1));
+
+    Tensor::MappingGuard input_guard(input);
+    Tensor::MappingGuard filter_guard(filter);
+    Tensor::MappingGuard bias_guard(bias);
+    Tensor::MappingGuard output_guard(output);
+    half *output_data = output->mutable_data<half>();
+    const int pad_hw[2] = {paddings[0] >> 1, paddings[1] >> 1};
+    arm::fp16::DepthwiseConv2d(input->data<half>(),
+                               filter->data<half>(),
+                               input->shape().data(),
+                               output_shape.data(),
+                               filter_shape.data(),
+                               strides_.data(),
+                               dilations_.data(),
+                               pad_hw,
+                               output_data);
+    arm::fp16::BiasActivation(
+        output_data,
+        bias == nullptr ? nullptr : bias->data<half>(),
+        nullptr,
+        output_shape[0],
+        output_shape[1],
+        output_shape[2] * output_shape[3],
+        activation_,
+        relux_max_limit_,
+        leakyrelu_coefficient_,
+        output_data);
+    return MaceStatus::MACE_SUCCESS;
+  }
+
  protected:
   MACE_OP_INPUT_TAGS(INPUT, FILTER, BIAS);
   MACE_OP_OUTPUT_TAGS(OUTPUT);
 };
+#endif  // MACE_ENABLE_FP16_NEON
 
 #ifdef MACE_ENABLE_QUANTIZE
 template <>
@@ -359,11 +611,14 @@ class DepthwiseConv2dOp<DeviceType::CPU, uint8_t>
     auto output_data = output->mutable_data<uint8_t>();
     auto bias_data = GetBiasData(bias,
                                  input->scale(),
-                                 filter->scale(),
+                                 filter,
                                  out_channels,
                                  &bias_);
 
-    if (dilation_h == 1 && dilation_w == 1) {
+    // a filter quantized per channel takes the general path, tflite kernels
+    // only requantize with one multiplier
+    const bool per_channel = !filter->scales().empty();
+    if (dilation_h == 1 && dilation_w == 1 && !per_channel) {
       int32_t quantized_multiplier;
       int32_t right_shift;
       GetOutputMultiplierAndShift(input->scale(), filter->scale(),
@@ -382,14 +637,45 @@ class DepthwiseConv2dOp<DeviceType::CPU, uint8_t>
           quantized_multiplier, right_shift, 0, 255, output_data,
           ShapeToTfliteDims(output->shape()));
     } else {
-      float output_multiplier =
-          input->scale() * filter->scale() / output->scale();
+      MACE_CHECK(!per_channel ||
+                     static_cast<index_t>(filter->scales().size())
+                         == out_channels,
+                 filter->scales().size(), " scales for ", out_channels,
+                 " channels");
+      std::vector<float> output_multipliers(out_channels);
+      for (index_t m = 0; m < out_channels; ++m) {
+        output_multipliers[m] =
+            input->scale() * filter->scale(m) / output->scale();
+      }
       const int pad_hw[2] = {pad_top, pad_left};
+#ifdef MACE_ENABLE_NEON
+      // 3x3 and 5x5 filters of multiplier 1, requantized in fixed point
+      const index_t kernel = filter->dim(0);
+      if ((kernel == 3 || kernel == 5) && filter->dim(1) == kernel
+          && filter->dim(3) == 1
+          && *std::max_element(output_multipliers.begin(),
+                               output_multipliers.end()) < 1.f) {
+        std::vector<int32_t> quantized_multipliers;
+        std::vector<int> right_shifts;
+        GetOutputMultipliersAndShifts(filter->scale(), filter->scales(),
+                                      out_channels, input->scale(),
+                                      output->scale(), &quantized_multipliers,
+                                      &right_shifts);
+        arm::q8::DepthwiseConv2d(
+            input_data, filter_data, bias_data, input->shape().data(),
+            output_shape.data(), static_cast<int>(kernel),
+            input->zero_point(), filter->zero_point(), output->zero_point(),
+            quantized_multipliers.data(), right_shifts.data(),
+            strides_.data(), dilations_.data(), pad_hw, output_data);
+        return MaceStatus::MACE_SUCCESS;
+      }
+#endif  // MACE_ENABLE_NEON
       DepthwiseConv2dGeneral(
           input_data, filter_data, bias_data, input->shape().data(),
           output_shape.data(), filter->shape().data(), input->zero_point(),
-          filter->zero_point(), output->zero_point(), output_multiplier,
-          strides_.data(), dilations_.data(), pad_hw, output_data);
+          filter->zero_point(), output->zero_point(),
+          output_multipliers.data(), strides_.data(), dilations_.data(),
+          pad_hw, output_data);
     }
 
     return MaceStatus::MACE_SUCCESS;
@@ -404,7 +690,7 @@ class DepthwiseConv2dOp<DeviceType::CPU, uint8_t>
                               const int32_t input_zero,
                               const int32_t filter_zero,
                               const int32_t output_zero,
-                              const float output_multiplier,
+                              const float *output_multipliers,
                               const int *stride_hw,
                               const int *dilation_hw,
                               const int *pad_hw,
@@ -449,7 +735,8 @@ class DepthwiseConv2dOp<DeviceType::CPU, uint8_t>
             if (bias) {
               sum += bias[m];
             }
-            sum = static_cast<int32_t>(std::round(sum * output_multiplier));
+            sum = static_cast<int32_t>(
+                std::round(sum * output_multipliers[m]));
             sum += output_zero;
             output[out_offset] =
                 static_cast<uint8_t>(std::min(255, std::max(0, sum)));
@@ -541,6 +828,11 @@ void RegisterDepthwiseConv2d(OpRegistryBase *op_registry) {
   MACE_REGISTER_OP(op_registry, "DepthwiseConv2d",
                    DepthwiseConv2dOp, DeviceType::CPU, float);
 
+#ifdef MACE_ENABLE_FP16_NEON
+  MACE_REGISTER_OP(op_registry, "DepthwiseConv2d",
+                   DepthwiseConv2dOp, DeviceType::CPU, half);
+#endif  // MACE_ENABLE_FP16_NEON
+
 #ifdef MACE_ENABLE_QUANTIZE
   MACE_REGISTER_OP(op_registry, "DepthwiseConv2d",
                    DepthwiseConv2dOp, DeviceType::CPU, uint8_t);
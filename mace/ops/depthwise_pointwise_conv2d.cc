@@ -0,0 +1,109 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <vector>
+
+#include "mace/core/operator.h"
+#include "mace/ops/activation.h"
+#include "mace/ops/arm/depthwise_pointwise_conv2d.h"
+#include "mace/ops/conv_pool_2d_base.h"
+
+namespace mace {
+namespace ops {
+
+template <DeviceType D, class T>
+class DepthwisePointwiseConv2dOp;
+
+// a depthwise 3x3 conv followed by a 1x1 conv, fused by the converter
+template <>
+class DepthwisePointwiseConv2dOp<DeviceType::CPU, float>
+    : public ConvPool2dOpBase {
+ public:
+  explicit DepthwisePointwiseConv2dOp(OpConstructContext *context)
+      : ConvPool2dOpBase(context),
+        dw_activation_(GetActivationParams("dw_activation", "dw_max_limit",
+                                           "dw_leakyrelu_coefficient")),
+        pw_activation_(GetActivationParams("activation", "max_limit",
+                                           "leakyrelu_coefficient")) {}
+
+  MaceStatus Run(OpContext *context) override {
+    MACE_UNUSED(context);
+    const Tensor *input = this->Input(INPUT);
+    const Tensor *dw_filter = this->Input(DW_FILTER);
+    const Tensor *dw_bias = this->Input(DW_BIAS);
+    const Tensor *pw_filter = this->Input(PW_FILTER);
+    const Tensor *pw_bias = this->Input(PW_BIAS);
+    Tensor *output = this->Output(OUTPUT);
+    MACE_CHECK(dw_filter->dim(0) == 1 && dw_filter->dim(1) == input->dim(1)
+                   && dw_filter->dim(2) == 3 && dw_filter->dim(3) == 3,
+               "fused depthwise filter should be 1x", input->dim(1), "x3x3");
+    MACE_CHECK(pw_filter->dim(1) == input->dim(1) && pw_filter->dim(2) == 1
+                   && pw_filter->dim(3) == 1,
+               "fused pointwise filter should be Nx", input->dim(1), "x1x1");
+    MACE_CHECK(dilations_[0] == 1 && dilations_[1] == 1,
+               "fused depthwise conv does not support dilations");
+
+    const index_t filter_shape[4] = {input->dim(1), input->dim(1), 3, 3};
+    std::vector<index_t> output_shape(4);
+    int paddings[2];
+    CalcNCHWOutputShape(input->shape().data(), filter_shape, FLOOR,
+                        output_shape.data(), paddings);
+    output_shape[1] = pw_filter->dim(0);
+    MACE_RETURN_IF_ERROR(output->Resize(output_shape));
+    const int pad_hw[2] = {paddings[0] >> 1, paddings[1] >> 1};
+
+    Tensor::MappingGuard input_guard(input);
+    Tensor::MappingGuard dw_filter_guard(dw_filter);
+    Tensor::MappingGuard dw_bias_guard(dw_bias);
+    Tensor::MappingGuard pw_filter_guard(pw_filter);
+    Tensor::MappingGuard pw_bias_guard(pw_bias);
+    Tensor::MappingGuard output_guard(output);
+    DepthwisePointwiseConv2d(input->data<float>(), dw_filter->data<float>(),
+                             dw_bias->data<float>(), dw_activation_,
+                             pw_filter->data<float>(), pw_bias->data<float>(),
+                             pw_activation_, input->shape().data(),
+                             output_shape.data(), strides_.data(), pad_hw,
+                             output->mutable_data<float>());
+    return MaceStatus::MACE_SUCCESS;
+  }
+
+ private:
+  ActivationParams GetActivationParams(const std::string &type_arg,
+                                       const std::string &max_limit_arg,
+                                       const std::string &coefficient_arg) {
+    ActivationParams params;
+    params.type = ops::StringToActivationType(
+        Operation::GetOptionalArg<std::string>(type_arg, "NOOP"));
+    params.relux_max_limit =
+        Operation::GetOptionalArg<float>(max_limit_arg, 0.0f);
+    params.leakyrelu_coefficient =
+        Operation::GetOptionalArg<float>(coefficient_arg, 0.0f);
+    return params;
+  }
+
+  const ActivationParams dw_activation_;
+  const ActivationParams pw_activation_;
+
+  MACE_OP_INPUT_TAGS(INPUT, DW_FILTER, DW_BIAS, PW_FILTER, PW_BIAS);
+  MACE_OP_OUTPUT_TAGS(OUTPUT);
+};
+
+void RegisterDepthwisePointwiseConv2d(OpRegistryBase *op_registry) {
+  MACE_REGISTER_OP(op_registry, "DepthwisePointwiseConv2d",
+                   DepthwisePointwiseConv2dOp, DeviceType::CPU, float);
+}
+
+}  // namespace ops
+}  // namespace mace
@@ -0,0 +1,336 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#if defined(MACE_ENABLE_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "mace/core/operator.h"
+
+namespace mace {
+namespace ops {
+
+namespace {
+
+// the priors decoded by one task
+const index_t kDecodeBlockSize = 256;
+
+struct Candidate {
+  float score;
+  int prior;
+  int label;
+};
+
+// of higher score first, and of the smaller label and prior on a tie so the
+// detections don't depend on the thread count
+inline bool Better(const Candidate &lhs, const Candidate &rhs) {
+  return lhs.score > rhs.score ||
+      (lhs.score == rhs.score && (lhs.label < rhs.label ||
+          (lhs.label == rhs.label && lhs.prior < rhs.prior)));
+}
+
+#if defined(MACE_ENABLE_NEON)
+// exp of the cephes polynomial, of relative error below 2e-7
+inline float32x4_t NeonExp(float32x4_t x) {
+  x = vminq_f32(vmaxq_f32(x, vdupq_n_f32(-87.3f)), vdupq_n_f32(88.3f));
+  // n = floor(x / ln2 + 0.5), the truncation rounds negatives up
+  float32x4_t n = vmlaq_n_f32(vdupq_n_f32(0.5f), x, 1.44269504088896341f);
+  const float32x4_t truncated = vcvtq_f32_s32(vcvtq_s32_f32(n));
+  const uint32x4_t rounded_up = vcgtq_f32(truncated, n);
+  n = vsubq_f32(truncated, vreinterpretq_f32_u32(
+      vandq_u32(rounded_up, vreinterpretq_u32_f32(vdupq_n_f32(1.f)))));
+  // r = x - n * ln2, of ln2 split in two for precision
+  x = vmlsq_f32(x, n, vdupq_n_f32(0.693359375f));
+  x = vmlsq_f32(x, n, vdupq_n_f32(-2.12194440e-4f));
+  float32x4_t y = vdupq_n_f32(1.9875691500e-4f);
+  y = vmlaq_f32(vdupq_n_f32(1.3981999507e-3f), y, x);
+  y = vmlaq_f32(vdupq_n_f32(8.3334519073e-3f), y, x);
+  y = vmlaq_f32(vdupq_n_f32(4.1665795894e-2f), y, x);
+  y = vmlaq_f32(vdupq_n_f32(1.6666665459e-1f), y, x);
+  y = vmlaq_f32(vdupq_n_f32(5.0000001201e-1f), y, x);
+  y = vmlaq_f32(vaddq_f32(x, vdupq_n_f32(1.f)), y, vmulq_f32(x, x));
+  // times 2^n built in the exponent bits
+  const int32x4_t exponent = vshlq_n_s32(
+      vaddq_s32(vcvtq_s32_f32(n), vdupq_n_s32(127)), 23);
+  return vmulq_f32(y, vreinterpretq_f32_s32(exponent));
+}
+#endif
+
+// the corners of [begin, end) of the boxes from their center-size offsets
+// to the priors, scaled by the variances of the priors
+void DecodeBoxes(const float *loc,
+                 const float *prior,
+                 const float *variance,
+                 const index_t begin,
+                 const index_t end,
+                 float *boxes) {
+  index_t i = begin;
+#if defined(MACE_ENABLE_NEON)
+  const float32x4_t half = vdupq_n_f32(0.5f);
+  for (; i + 4 <= end; i += 4) {
+    // the four coordinates of four boxes, one vector each
+    const float32x4x4_t p = vld4q_f32(prior + i * 4);
+    const float32x4x4_t v = vld4q_f32(variance + i * 4);
+    const float32x4x4_t l = vld4q_f32(loc + i * 4);
+    const float32x4_t prior_w = vsubq_f32(p.val[2], p.val[0]);
+    const float32x4_t prior_h = vsubq_f32(p.val[3], p.val[1]);
+    const float32x4_t prior_cx =
+        vmulq_f32(vaddq_f32(p.val[0], p.val[2]), half);
+    const float32x4_t prior_cy =
+        vmulq_f32(vaddq_f32(p.val[1], p.val[3]), half);
+    const float32x4_t cx =
+        vmlaq_f32(prior_cx, vmulq_f32(v.val[0], l.val[0]), prior_w);
+    const float32x4_t cy =
+        vmlaq_f32(prior_cy, vmulq_f32(v.val[1], l.val[1]), prior_h);
+    const float32x4_t half_w = vmulq_f32(
+        vmulq_f32(NeonExp(vmulq_f32(v.val[2], l.val[2])), prior_w), half);
+    const float32x4_t half_h = vmulq_f32(
+        vmulq_f32(NeonExp(vmulq_f32(v.val[3], l.val[3])), prior_h), half);
+    float32x4x4_t box;
+    box.val[0] = vsubq_f32(cx, half_w);
+    box.val[1] = vsubq_f32(cy, half_h);
+    box.val[2] = vaddq_f32(cx, half_w);
+    box.val[3] = vaddq_f32(cy, half_h);
+    vst4q_f32(boxes + i * 4, box);
+  }
+#endif
+  for (; i < end; ++i) {
+    const float *p = prior + i * 4;
+    const float *v = variance + i * 4;
+    const float *l = loc + i * 4;
+    const float prior_w = p[2] - p[0];
+    const float prior_h = p[3] - p[1];
+    const float cx = v[0] * l[0] * prior_w + (p[0] + p[2]) * 0.5f;
+    const float cy = v[1] * l[1] * prior_h + (p[1] + p[3]) * 0.5f;
+    const float half_w = std::exp(v[2] * l[2]) * prior_w * 0.5f;
+    const float half_h = std::exp(v[3] * l[3]) * prior_h * 0.5f;
+    float *box = boxes + i * 4;
+    box[0] = cx - half_w;
+    box[1] = cy - half_h;
+    box[2] = cx + half_w;
+    box[3] = cy + half_h;
+  }
+}
+
+inline float Area(const float *box) {
+  return std::max(0.f, box[2] - box[0]) * std::max(0.f, box[3] - box[1]);
+}
+
+// greedy nms of the candidates sorted by score, the boxes kept are copied
+// together with their areas so that each candidate scans them in order
+void Suppress(const float *boxes,
+              const std::vector<Candidate> &candidates,
+              const float nms_threshold,
+              const index_t max_kept,
+              std::vector<float> *kept_boxes,
+              std::vector<Candidate> *kept) {
+  kept_boxes->clear();
+  for (const Candidate &candidate : candidates) {
+    if (static_cast<index_t>(kept->size()) >= max_kept) {
+      break;
+    }
+    const float *box = boxes + candidate.prior * 4;
+    const float area = Area(box);
+    bool keep = true;
+    for (size_t k = 0; k < kept_boxes->size(); k += 5) {
+      const float *other = kept_boxes->data() + k;
+      const float overlap_w =
+          std::min(box[2], other[2]) - std::max(box[0], other[0]);
+      const float overlap_h =
+          std::min(box[3], other[3]) - std::max(box[1], other[1]);
+      if (overlap_w <= 0 || overlap_h <= 0) {
+        continue;
+      }
+      const float overlap = overlap_w * overlap_h;
+      if (overlap > nms_threshold * (area + other[4] - overlap)) {
+        keep = false;
+        break;
+      }
+    }
+    if (keep) {
+      kept_boxes->insert(kept_boxes->end(), box, box + 4);
+      kept_boxes->push_back(area);
+      kept->push_back(candidate);
+    }
+  }
+}
+
+}  // namespace
+
+template <DeviceType D, class T>
+class DetectionOutputOp;
+
+// The detections of SSD of the boxes shared by the classes: the box offsets
+// are decoded against the priors of PriorBox, each class keeps the top_k
+// boxes above the confidence threshold and suppresses their overlaps, and
+// the keep_top_k of all classes are output by descending confidence, as
+// rows of [image_id, label, confidence, xmin, ymin, xmax, ymax].
+template <>
+class DetectionOutputOp<DeviceType::CPU, float> : public Operation {
+ public:
+  explicit DetectionOutputOp(OpConstructContext *context)
+      : Operation(context),
+        num_classes_(Operation::GetOptionalArg<int>("num_classes", 0)),
+        background_label_id_(
+            Operation::GetOptionalArg<int>("background_label_id", 0)),
+        nms_threshold_(
+            Operation::GetOptionalArg<float>("nms_threshold", 0.3f)),
+        top_k_(Operation::GetOptionalArg<int>("top_k", -1)),
+        keep_top_k_(Operation::GetOptionalArg<int>("keep_top_k", -1)),
+        confidence_threshold_(Operation::GetOptionalArg<float>(
+            "confidence_threshold", std::numeric_limits<float>::lowest())) {}
+
+  MaceStatus Run(OpContext *context) override {
+    MACE_UNUSED(context);
+    const Tensor *loc = this->Input(LOC);
+    const Tensor *conf = this->Input(CONF);
+    const Tensor *prior = this->Input(PRIOR);
+    Tensor *output = this->Output(OUTPUT);
+    MACE_CHECK(num_classes_ > 0, "DetectionOutput needs num_classes");
+    MACE_CHECK(prior->dim_size() == 3 && prior->dim(1) == 2
+                   && prior->dim(2) % 4 == 0,
+               "DetectionOutput priors should be of shape [1, 2, 4 * n]");
+    const index_t num_prior = prior->dim(2) / 4;
+    const index_t batch = loc->dim(0);
+    MACE_CHECK(loc->size() == batch * num_prior * 4,
+               "DetectionOutput loc should be of 4 values per prior");
+    MACE_CHECK(conf->size() == batch * num_prior * num_classes_,
+               "DetectionOutput conf should be of num_classes per prior");
+
+    Tensor::MappingGuard loc_guard(loc);
+    Tensor::MappingGuard conf_guard(conf);
+    Tensor::MappingGuard prior_guard(prior);
+    const float *loc_data = loc->data<float>();
+    const float *conf_data = conf->data<float>();
+    const float *prior_data = prior->data<float>();
+
+    boxes_.resize(batch * num_prior * 4);
+    const index_t blocks = RoundUpDiv(num_prior, kDecodeBlockSize);
+#pragma omp parallel for collapse(2) schedule(runtime)
+    for (index_t b = 0; b < batch; ++b) {
+      for (index_t block = 0; block < blocks; ++block) {
+        DecodeBoxes(loc_data + b * num_prior * 4, prior_data,
+                    prior_data + num_prior * 4, block * kDecodeBlockSize,
+                    std::min((block + 1) * kDecodeBlockSize, num_prior),
+                    boxes_.data() + b * num_prior * 4);
+      }
+    }
+
+    // a class keeps no more boxes than all the classes output
+    const index_t top_k = top_k_ < 0 ? num_prior : top_k_;
+    const index_t max_kept = keep_top_k_ < 0 ? top_k : keep_top_k_;
+    const index_t tasks = batch * num_classes_;
+    candidates_.resize(tasks);
+    kept_boxes_.resize(tasks);
+    kept_.resize(tasks);
+#pragma omp parallel for schedule(runtime)
+    for (index_t t = 0; t < tasks; ++t) {
+      const index_t b = t / num_classes_;
+      const int label = static_cast<int>(t % num_classes_);
+      std::vector<Candidate> &candidates = candidates_[t];
+      candidates.clear();
+      kept_[t].clear();
+      if (label == background_label_id_) {
+        continue;
+      }
+      const float *scores = conf_data + b * num_prior * num_classes_ + label;
+      for (index_t i = 0; i < num_prior; ++i) {
+        const float score = scores[i * num_classes_];
+        if (score > confidence_threshold_) {
+          candidates.push_back({score, static_cast<int>(i), label});
+        }
+      }
+      // only the top_k are sorted and suppressed
+      if (static_cast<index_t>(candidates.size()) > top_k) {
+        std::nth_element(candidates.begin(), candidates.begin() + top_k,
+                         candidates.end(), Better);
+        candidates.resize(top_k);
+      }
+      std::sort(candidates.begin(), candidates.end(), Better);
+      Suppress(boxes_.data() + b * num_prior * 4, candidates, nms_threshold_,
+               max_kept, &kept_boxes_[t], &kept_[t]);
+    }
+
+    std::vector<std::vector<Candidate>> detections(batch);
+    index_t num_detections = 0;
+    for (index_t b = 0; b < batch; ++b) {
+      std::vector<Candidate> &image_detections = detections[b];
+      for (int label = 0; label < num_classes_; ++label) {
+        const std::vector<Candidate> &kept = kept_[b * num_classes_ + label];
+        image_detections.insert(image_detections.end(), kept.begin(),
+                                kept.end());
+      }
+      const index_t num_kept = keep_top_k_ < 0 ?
+          image_detections.size() :
+          std::min<index_t>(keep_top_k_, image_detections.size());
+      std::partial_sort(image_detections.begin(),
+                        image_detections.begin() + num_kept,
+                        image_detections.end(), Better);
+      image_detections.resize(num_kept);
+      num_detections += num_kept;
+    }
+
+    // a single row of -1 if nothing is detected, as caffe does
+    MACE_RETURN_IF_ERROR(
+        output->Resize({1, 1, std::max<index_t>(num_detections, 1), 7}));
+    Tensor::MappingGuard output_guard(output);
+    float *output_data = output->mutable_data<float>();
+    if (num_detections == 0) {
+      std::fill_n(output_data, 7, -1.f);
+      return MaceStatus::MACE_SUCCESS;
+    }
+    for (index_t b = 0; b < batch; ++b) {
+      for (const Candidate &detection : detections[b]) {
+        const float *box =
+            boxes_.data() + (b * num_prior + detection.prior) * 4;
+        output_data[0] = static_cast<float>(b);
+        output_data[1] = static_cast<float>(detection.label);
+        output_data[2] = detection.score;
+        std::copy_n(box, 4, output_data + 3);
+        output_data += 7;
+      }
+    }
+    return MaceStatus::MACE_SUCCESS;
+  }
+
+ private:
+  const int num_classes_;
+  const int background_label_id_;
+  const float nms_threshold_;
+  const int top_k_;
+  const int keep_top_k_;
+  const float confidence_threshold_;
+  std::vector<float> boxes_;
+  // of each class of each image
+  std::vector<std::vector<Candidate>> candidates_;
+  std::vector<std::vector<float>> kept_boxes_;
+  std::vector<std::vector<Candidate>> kept_;
+
+  MACE_OP_INPUT_TAGS(LOC, CONF, PRIOR);
+  MACE_OP_OUTPUT_TAGS(OUTPUT);
+};
+
+void RegisterDetectionOutput(OpRegistryBase *op_registry) {
+  MACE_REGISTER_OP(op_registry, "DetectionOutput", DetectionOutputOp,
+                   DeviceType::CPU, float);
+}
+
+}  // namespace ops
+}  // namespace mace
@@ -0,0 +1,228 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "mace/ops/ops_test_util.h"
+
+namespace mace {
+namespace ops {
+namespace test {
+
+class DetectionOutputOpTest : public OpsTestBase {};
+
+namespace {
+
+struct Detection {
+  float score;
+  int label;
+  int prior;
+};
+
+float IoU(const float *a, const float *b) {
+  const float w = std::min(a[2], b[2]) - std::max(a[0], b[0]);
+  const float h = std::min(a[3], b[3]) - std::max(a[1], b[1]);
+  if (w <= 0 || h <= 0) {
+    return 0;
+  }
+  const float area_a = (a[2] - a[0]) * (a[3] - a[1]);
+  const float area_b = (b[2] - b[0]) * (b[3] - b[1]);
+  return w * h / (area_a + area_b - w * h);
+}
+
+// decodes all the boxes, sorts all the boxes of a class and suppresses them
+// in order, then keeps the best of all classes
+std::vector<float> DetectionOutputRef(const std::vector<float> &loc,
+                                      const std::vector<float> &conf,
+                                      const std::vector<float> &prior,
+                                      const int batch,
+                                      const int num_prior,
+                                      const int num_classes,
+                                      const float nms_threshold,
+                                      const int top_k,
+                                      const int keep_top_k,
+                                      const float confidence_threshold) {
+  std::vector<float> output;
+  for (int b = 0; b < batch; ++b) {
+    std::vector<float> boxes(num_prior * 4);
+    for (int i = 0; i < num_prior; ++i) {
+      const float *p = &prior[i * 4];
+      const float *v = &prior[(num_prior + i) * 4];
+      const float *l = &loc[(b * num_prior + i) * 4];
+      const float w = p[2] - p[0];
+      const float h = p[3] - p[1];
+      const float cx = v[0] * l[0] * w + (p[0] + p[2]) / 2;
+      const float cy = v[1] * l[1] * h + (p[1] + p[3]) / 2;
+      const float bw = std::exp(v[2] * l[2]) * w;
+      const float bh = std::exp(v[3] * l[3]) * h;
+      boxes[i * 4] = cx - bw / 2;
+      boxes[i * 4 + 1] = cy - bh / 2;
+      boxes[i * 4 + 2] = cx + bw / 2;
+      boxes[i * 4 + 3] = cy + bh / 2;
+    }
+    std::vector<Detection> detections;
+    for (int c = 1; c < num_classes; ++c) {
+      std::vector<Detection> candidates;
+      for (int i = 0; i < num_prior; ++i) {
+        const float score = conf[(b * num_prior + i) * num_classes + c];
+        if (score > confidence_threshold) {
+          candidates.push_back({score, c, i});
+        }
+      }
+      std::stable_sort(candidates.begin(), candidates.end(),
+                       [](const Detection &x, const Detection &y) {
+                         return x.score > y.score;
+                       });
+      if (static_cast<int>(candidates.size()) > top_k) {
+        candidates.resize(top_k);
+      }
+      std::vector<Detection> kept;
+      for (const Detection &candidate : candidates) {
+        bool keep = true;
+        for (const Detection &other : kept) {
+          if (IoU(&boxes[candidate.prior * 4], &boxes[other.prior * 4])
+              > nms_threshold) {
+            keep = false;
+            break;
+          }
+        }
+        if (keep) {
+          kept.push_back(candidate);
+        }
+      }
+      detections.insert(detections.end(), kept.begin(), kept.end());
+    }
+    std::stable_sort(detections.begin(), detections.end(),
+                     [](const Detection &x, const Detection &y) {
+                       return x.score > y.score;
+                     });
+    if (static_cast<int>(detections.size()) > keep_top_k) {
+      detections.resize(keep_top_k);
+    }
+    for (const Detection &detection : detections) {
+      output.insert(output.end(), {static_cast<float>(b),
+                                   static_cast<float>(detection.label),
+                                   detection.score});
+      output.insert(output.end(), &boxes[detection.prior * 4],
+                    &boxes[detection.prior * 4] + 4);
+    }
+  }
+  return output;
+}
+
+void RunDetectionOutput(OpsTestNet *net,
+                        const int num_classes,
+                        const float nms_threshold,
+                        const int top_k,
+                        const int keep_top_k,
+                        const float confidence_threshold) {
+  OpDefBuilder("DetectionOutput", "DetectionOutputTest")
+      .Input("Loc")
+      .Input("Conf")
+      .Input("Prior")
+      .Output("Output")
+      .AddIntArg("num_classes", num_classes)
+      .AddFloatArg("nms_threshold", nms_threshold)
+      .AddIntArg("top_k", top_k)
+      .AddIntArg("keep_top_k", keep_top_k)
+      .AddFloatArg("confidence_threshold", confidence_threshold)
+      .Finalize(net->NewOperatorDef());
+  net->RunOp(CPU);
+}
+
+void TestRandom(const int batch, const int num_prior, const int num_classes,
+                const int top_k, const int keep_top_k) {
+  std::mt19937 gen(num_prior);
+  std::uniform_real_distribution<float> coord(0, 1);
+  std::uniform_real_distribution<float> offset(-2, 2);
+  std::vector<float> prior(num_prior * 8);
+  for (int i = 0; i < num_prior; ++i) {
+    const float x = coord(gen);
+    const float y = coord(gen);
+    prior[i * 4] = x;
+    prior[i * 4 + 1] = y;
+    prior[i * 4 + 2] = x + 0.05f + 0.2f * coord(gen);
+    prior[i * 4 + 3] = y + 0.05f + 0.2f * coord(gen);
+    std::copy_n(std::vector<float>({0.1f, 0.1f, 0.2f, 0.2f}).begin(), 4,
+                prior.begin() + (num_prior + i) * 4);
+  }
+  std::vector<float> loc(batch * num_prior * 4);
+  std::generate(loc.begin(), loc.end(), [&] { return offset(gen); });
+  std::vector<float> conf(batch * num_prior * num_classes);
+  std::generate(conf.begin(), conf.end(), [&] { return coord(gen); });
+
+  OpsTestNet net;
+  net.AddInputFromArray<CPU, float>("Loc", {batch, num_prior * 4}, loc);
+  net.AddInputFromArray<CPU, float>("Conf", {batch, num_prior * num_classes},
+                                    conf);
+  net.AddInputFromArray<CPU, float>("Prior", {1, 2, num_prior * 4}, prior);
+  RunDetectionOutput(&net, num_classes, 0.45f, top_k, keep_top_k, 0.3f);
+
+  const std::vector<float> expected = DetectionOutputRef(
+      loc, conf, prior, batch, num_prior, num_classes, 0.45f, top_k,
+      keep_top_k, 0.3f);
+  auto expected_tensor = net.CreateTensor<float>(
+      {1, 1, static_cast<index_t>(expected.size() / 7), 7}, expected);
+  ExpectTensorNear<float>(*expected_tensor, *net.GetOutput("Output"), 1e-5,
+                          1e-4);
+}
+
+}  // namespace
+
+TEST_F(DetectionOutputOpTest, Simple) {
+  OpsTestNet net;
+  // the second box overlaps the first one, the third one is of class 1 only
+  // by the threshold
+  net.AddInputFromArray<CPU, float>("Loc", {1, 12}, std::vector<float>(12));
+  net.AddInputFromArray<CPU, float>(
+      "Conf", {1, 9}, {0.1, 0.9, 0.1, 0.2, 0.8, 0.3, 0.5, 0.05, 0.6});
+  net.AddInputFromArray<CPU, float>(
+      "Prior", {1, 2, 12},
+      {0.1, 0.1, 0.5, 0.5, 0.12, 0.12, 0.52, 0.52, 0.6, 0.6, 0.9, 0.9,
+       0.1, 0.1, 0.2, 0.2, 0.1, 0.1, 0.2, 0.2, 0.1, 0.1, 0.2, 0.2});
+  RunDetectionOutput(&net, 3, 0.45f, 10, 10, 0.25f);
+
+  auto expected = net.CreateTensor<float>(
+      {1, 1, 3, 7},
+      {0, 1, 0.9, 0.1, 0.1, 0.5, 0.5,
+       0, 2, 0.6, 0.6, 0.6, 0.9, 0.9,
+       0, 2, 0.3, 0.12, 0.12, 0.52, 0.52});
+  ExpectTensorNear<float>(*expected, *net.GetOutput("Output"), 1e-5);
+}
+
+TEST_F(DetectionOutputOpTest, NoDetection) {
+  OpsTestNet net;
+  net.AddInputFromArray<CPU, float>("Loc", {1, 4}, std::vector<float>(4));
+  net.AddInputFromArray<CPU, float>("Conf", {1, 2}, {0.9, 0.1});
+  net.AddInputFromArray<CPU, float>(
+      "Prior", {1, 2, 4}, {0.1, 0.1, 0.5, 0.5, 0.1, 0.1, 0.2, 0.2});
+  RunDetectionOutput(&net, 2, 0.45f, 10, 10, 0.25f);
+
+  auto expected =
+      net.CreateTensor<float>({1, 1, 1, 7}, std::vector<float>(7, -1));
+  ExpectTensorNear<float>(*expected, *net.GetOutput("Output"), 1e-5);
+}
+
+TEST_F(DetectionOutputOpTest, Random) {
+  TestRandom(1, 37, 3, 400, 200);
+  TestRandom(2, 1000, 5, 100, 50);
+  TestRandom(1, 2003, 21, 50, 20);
+}
+
+}  // namespace test
+}  // namespace ops
+}  // namespace mace
@@ -0,0 +1,65 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <limits>
+
+#include "mace/core/operator.h"
+
+namespace mace {
+namespace ops {
+
+// Exit the net when the max of the input, e.g. the confidence of a cheap
+// head, reaches the threshold: the ops after it are skipped and the outputs
+// they produce are marked invalid. The output is 1 if the net exited, 0
+// otherwise.
+template <DeviceType D, class T>
+class EarlyExitOp : public Operation {
+ public:
+  explicit EarlyExitOp(OpConstructContext *context)
+      : Operation(context),
+        threshold_(Operation::GetOptionalArg<float>("threshold", 0.5f)) {}
+
+  MaceStatus Run(OpContext *context) override {
+    const Tensor *input = this->Input(0);
+    Tensor *output = this->Output(0);
+    MACE_CHECK(input->size() > 0, "EarlyExit input should not be empty");
+    MACE_RETURN_IF_ERROR(output->Resize({1}));
+
+    Tensor::MappingGuard input_guard(input);
+    Tensor::MappingGuard output_guard(output);
+    const T *input_data = input->data<T>();
+    T max_value = std::numeric_limits<T>::lowest();
+    for (index_t i = 0; i < input->size(); ++i) {
+      max_value = std::max(max_value, input_data[i]);
+    }
+    const bool exit = max_value >= threshold_;
+    output->mutable_data<T>()[0] = exit ? 1 : 0;
+    context->set_early_exit(exit);
+    return MaceStatus::MACE_SUCCESS;
+  }
+
+  bool AlwaysRuns() const override { return true; }
+
+ private:
+  float threshold_;
+};
+
+void RegisterEarlyExit(OpRegistryBase *op_registry) {
+  MACE_REGISTER_OP(op_registry, "EarlyExit", EarlyExitOp,
+                   DeviceType::CPU, float);
+}
+
+}  // namespace ops
+}  // namespace mace
@@ -0,0 +1,66 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/ops/ops_test_util.h"
+
+namespace mace {
+namespace ops {
+namespace test {
+
+class EarlyExitOpTest : public OpsTestBase {};
+
+namespace {
+void TestEarlyExit(const std::vector<float> &input, bool exit) {
+  // Construct graph
+  OpsTestNet net;
+  OpDefBuilder("EarlyExit", "EarlyExitTest")
+      .Input("Input")
+      .Output("Exited")
+      .AddFloatArg("threshold", 0.9f)
+      .Finalize(net.NewOperatorDef());
+  OpDefBuilder("Identity", "IdentityTest")
+      .Input("Input")
+      .Output("Output")
+      .Finalize(net.AddNewOperatorDef());
+
+  // Add input data
+  net.AddInputFromArray<DeviceType::CPU, float>(
+      "Input", {static_cast<index_t>(input.size())}, input);
+
+  // Run
+  ASSERT_TRUE(net.Setup(DeviceType::CPU));
+  ASSERT_EQ(net.Run(), MaceStatus::MACE_SUCCESS);
+
+  EXPECT_EQ(net.GetOutput("Exited")->data<float>()[0], exit ? 1 : 0);
+  EXPECT_FALSE(net.net_->IsSkipped("Exited"));
+  EXPECT_EQ(net.net_->IsSkipped("Output"), exit);
+  if (!exit) {
+    ExpectTensorNear<float>(*net.GetTensor("Input"), *net.GetOutput("Output"));
+  }
+}
+}  // namespace
+
+TEST_F(EarlyExitOpTest, Exit) {
+  TestEarlyExit({0.05f, 0.95f, 0.f}, true);
+  TestEarlyExit({0.9f}, true);
+}
+
+TEST_F(EarlyExitOpTest, Continue) {
+  TestEarlyExit({0.3f, 0.4f, 0.3f}, false);
+  TestEarlyExit({-1.f}, false);
+}
+
+}  // namespace test
+}  // namespace ops
+}  // namespace mace
@@ -15,24 +15,36 @@
 #ifdef MACE_ENABLE_NEON
 #ifdef MACE_ENABLE_QUANTIZE
 #include "mace/ops/arm/q8/eltwise.h"
+#include "mace/ops/arm/q8/lookup_table.h"
 #endif  // MACE_ENABLE_QUANTIZE
 #endif  // MACE_ENABLE_NEON
 
 #include "mace/ops/eltwise.h"
 
+#if defined(MACE_ENABLE_NEON)
+#include <arm_neon.h>
+#endif
+
 #include <algorithm>
 #include <cmath>
 #include <functional>
 #include <memory>
+#include <numeric>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
 #include "mace/core/future.h"
 #include "mace/core/operator.h"
 #include "mace/core/tensor.h"
+#ifdef MACE_ENABLE_QUANTIZE
+#include "mace/ops/common/lookup_table.h"
+#endif  // MACE_ENABLE_QUANTIZE
 #include "mace/utils/memory.h"
 #include "mace/utils/quantize.h"
+#include "mace/utils/utils.h"
 #ifdef MACE_ENABLE_OPENCL
+#include "mace/ops/opencl/buffer/eltwise.h"
 #include "mace/ops/opencl/buffer_transformer.h"
 #include "mace/ops/opencl/image/eltwise.h"
 #endif  // MACE_ENABLE_OPENCL
@@ -40,852 +52,401 @@
 namespace mace {
 namespace ops {
 
+namespace {
+
+// output elements computed by a task, large enough to amortize the fork
+// and small enough to spread a single big row across the threads
+constexpr index_t kGrainSize = 4 * 1024;
+
+// The output viewed as the fewest dims that broadcast the inputs uniformly:
+// consecutive dims merge when each input either spans them both or
+// broadcasts along them both, so that e.g. an NCHW tensor plus a per-channel
+// vector becomes [N * C, H * W] with the vector read by row. The strides of
+// an input are 0 along the dims it broadcasts.
+struct BroadcastPlan {
+  std::vector<index_t> dims;
+  std::vector<index_t> strides0;
+  std::vector<index_t> strides1;
+};
 
-inline index_t GetIndex(const std::vector<index_t> &shape,
-                        const std::vector<index_t> &index) {
-  index_t idx = 0;
-  for (size_t i = 0; i < shape.size(); ++i) {
-    if (shape[i] > 1) {
-      idx = idx * shape[i] + index[i];
+// shape0 and shape1 are of the same rank, each dim either equal or 1
+BroadcastPlan PlanBroadcast(const std::vector<index_t> &shape0,
+                            const std::vector<index_t> &shape1) {
+  MACE_CHECK(shape0.size() == shape1.size());
+  std::vector<index_t> dims;
+  std::vector<bool> spans0;
+  std::vector<bool> spans1;
+  for (size_t i = 0; i < shape0.size(); ++i) {
+    MACE_CHECK(shape0[i] == shape1[i] || shape0[i] == 1 || shape1[i] == 1,
+               "Element-Wise op can not broadcast dim ", i, ": ", shape0[i],
+               " vs ", shape1[i]);
+    const index_t dim = std::max(shape0[i], shape1[i]);
+    if (dim == 1) {
+      continue;
     }
-  }
-  return idx;
-}
-
-inline void IncreaseIndex(const std::vector<index_t> &shape,
-                          std::vector<index_t> *index) {
-  for (index_t i = static_cast<index_t>(shape.size()) - 1; i >= 0; --i) {
-    ++(*index)[i];
-    if ((*index)[i] >= shape[i]) {
-      (*index)[i] -= shape[i];
+    const bool span0 = shape0[i] > 1;
+    const bool span1 = shape1[i] > 1;
+    if (!dims.empty() && spans0.back() == span0 && spans1.back() == span1) {
+      dims.back() *= dim;
     } else {
-      break;
+      dims.push_back(dim);
+      spans0.push_back(span0);
+      spans1.push_back(span1);
     }
   }
-}
+  if (dims.empty()) {
+    dims.push_back(1);
+    spans0.push_back(true);
+    spans1.push_back(true);
+  }
 
-template <typename T, typename DstType>
-inline void TensorGeneralBroadcastEltwise(
-    const EltwiseType type,
-    const T *input0,
-    const T *input1,
-    const std::vector<float> &coeff,
-    const bool swapped,
-    const std::vector<index_t> &input0_shape,
-    const std::vector<index_t> &input1_shape,
-    const std::vector<index_t> &output_shape,
-    DstType *output) {
-  const index_t output_size = std::accumulate(
-      output_shape.begin(), output_shape.end(), 1, std::multiplies<index_t>());
-  std::vector<index_t> out_index(output_shape.size(), 0);
-  switch (type) {
-    case SUM:
-      if (coeff.empty()) {
-        for (index_t i = 0; i < output_size; ++i) {
-          const index_t idx0 = GetIndex(input0_shape, out_index);
-          const index_t idx1 = GetIndex(input1_shape, out_index);
-          output[i] = input0[idx0] + input1[idx1];
-          IncreaseIndex(output_shape, &out_index);
-        }
-      } else {
-        std::vector<float> coeff_copy = coeff;
-        if (swapped) {
-          std::swap(coeff_copy[0], coeff_copy[1]);
-        }
-        for (index_t i = 0; i < output_size; ++i) {
-          const index_t idx0 = GetIndex(input0_shape, out_index);
-          const index_t idx1 = GetIndex(input1_shape, out_index);
-          output[i] =
-              input0[idx0] * coeff_copy[0] + input1[idx1] * coeff_copy[1];
-          IncreaseIndex(output_shape, &out_index);
-        }
-      }
-      break;
-    case SUB:
-      if (!swapped) {
-        for (index_t i = 0; i < output_size; ++i) {
-          const index_t idx0 = GetIndex(input0_shape, out_index);
-          const index_t idx1 = GetIndex(input1_shape, out_index);
-          output[i] = input0[idx0] - input1[idx1];
-          IncreaseIndex(output_shape, &out_index);
-        }
-      } else {
-        for (index_t i = 0; i < output_size; ++i) {
-          const index_t idx0 = GetIndex(input0_shape, out_index);
-          const index_t idx1 = GetIndex(input1_shape, out_index);
-          output[i] = input1[idx1] - input0[idx0];
-          IncreaseIndex(output_shape, &out_index);
-        }
-      }
-      break;
-    case PROD:
-      for (index_t i = 0; i < output_size; ++i) {
-        const index_t idx0 = GetIndex(input0_shape, out_index);
-        const index_t idx1 = GetIndex(input1_shape, out_index);
-        output[i] = input0[idx0] * input1[idx1];
-        IncreaseIndex(output_shape, &out_index);
-      }
-      break;
-    case DIV:
-      if (!swapped) {
-        for (index_t i = 0; i < output_size; ++i) {
-          const index_t idx0 = GetIndex(input0_shape, out_index);
-          const index_t idx1 = GetIndex(input1_shape, out_index);
-          output[i] = input0[idx0] / input1[idx1];
-          IncreaseIndex(output_shape, &out_index);
-        }
-      } else {
-        for (index_t i = 0; i < output_size; ++i) {
-          const index_t idx0 = GetIndex(input0_shape, out_index);
-          const index_t idx1 = GetIndex(input1_shape, out_index);
-          output[i] = input1[idx1] / input0[idx0];
-          IncreaseIndex(output_shape, &out_index);
-        }
-      }
-      break;
-    case FLOOR_DIV:
-      if (!swapped) {
-        for (index_t i = 0; i < output_size; ++i) {
-          const index_t idx0 = GetIndex(input0_shape, out_index);
-          const index_t idx1 = GetIndex(input1_shape, out_index);
-          output[i] = std::floor(input0[idx0] / input1[idx1]);
-          IncreaseIndex(output_shape, &out_index);
-        }
-      } else {
-        for (index_t i = 0; i < output_size; ++i) {
-          const index_t idx0 = GetIndex(input0_shape, out_index);
-          const index_t idx1 = GetIndex(input1_shape, out_index);
-          output[i] = std::floor(input1[idx1] / input0[idx0]);
-          IncreaseIndex(output_shape, &out_index);
-        }
-      }
-      break;
-    case MIN:
-      for (index_t i = 0; i < output_size; ++i) {
-        const index_t idx0 = GetIndex(input0_shape, out_index);
-        const index_t idx1 = GetIndex(input1_shape, out_index);
-        output[i] = std::min(input1[idx1], input0[idx0]);
-        IncreaseIndex(output_shape, &out_index);
-      }
-      break;
-    case MAX:
-      for (index_t i = 0; i < output_size; ++i) {
-        const index_t idx0 = GetIndex(input0_shape, out_index);
-        const index_t idx1 = GetIndex(input1_shape, out_index);
-        output[i] = std::max(input1[idx1], input0[idx0]);
-        IncreaseIndex(output_shape, &out_index);
-      }
-      break;
-    case SQR_DIFF:
-      for (index_t i = 0; i < output_size; ++i) {
-        const index_t idx0 = GetIndex(input0_shape, out_index);
-        const index_t idx1 = GetIndex(input1_shape, out_index);
-        output[i] = std::pow(input1[idx1] - input0[idx0], 2.f);
-        IncreaseIndex(output_shape, &out_index);
-      }
-      break;
-    case POW:
-      if (!swapped) {
-        for (index_t i = 0; i < output_size; ++i) {
-          const index_t idx0 = GetIndex(input0_shape, out_index);
-          const index_t idx1 = GetIndex(input1_shape, out_index);
-          output[i] = std::pow(input0[idx0], input1[idx1]);
-          IncreaseIndex(output_shape, &out_index);
-        }
-      } else {
-        for (index_t i = 0; i < output_size; ++i) {
-          const index_t idx0 = GetIndex(input0_shape, out_index);
-          const index_t idx1 = GetIndex(input1_shape, out_index);
-          output[i] = std::pow(input1[idx1], input0[idx0]);
-          IncreaseIndex(output_shape, &out_index);
-        }
-      }
-      break;
-    case EQUAL:
-      for (index_t i = 0; i < output_size; ++i) {
-        const index_t idx0 = GetIndex(input0_shape, out_index);
-        const index_t idx1 = GetIndex(input1_shape, out_index);
-        output[i] = input1[idx1] == input0[idx0];
-        IncreaseIndex(output_shape, &out_index);
-      }
-      break;
-    default:
-      LOG(FATAL) << "Eltwise op not support type " << type;
+  BroadcastPlan plan;
+  plan.dims = dims;
+  plan.strides0.resize(dims.size());
+  plan.strides1.resize(dims.size());
+  index_t stride0 = 1;
+  index_t stride1 = 1;
+  for (index_t i = static_cast<index_t>(dims.size()) - 1; i >= 0; --i) {
+    plan.strides0[i] = spans0[i] ? stride0 : 0;
+    plan.strides1[i] = spans1[i] ? stride1 : 0;
+    stride0 *= spans0[i] ? dims[i] : 1;
+    stride1 *= spans1[i] ? dims[i] : 1;
   }
+  return plan;
 }
 
-template <typename T, typename DstType>
-inline void TensorBroadcastEltwise(const EltwiseType type,
-                                   const T *input0,
-                                   const T *input1,
-                                   const std::vector<float> &coeff,
-                                   const index_t diff_size,
-                                   const index_t common_size,
-                                   const bool swapped,
-                                   DstType *output) {
-  switch (type) {
-    case SUM:
-      if (coeff.empty()) {
-#pragma omp parallel for collapse(2) schedule(runtime)
-        for (index_t d = 0; d < diff_size; ++d) {
-          for (index_t i = 0; i < common_size; ++i) {
-            output[i + d * common_size] =
-                input0[i + d * common_size] + input1[i];
-          }
-        }
-      } else {
-        std::vector<float> coeff_copy = coeff;
-        if (swapped) {
-          std::swap(coeff_copy[0], coeff_copy[1]);
-        }
-#pragma omp parallel for collapse(2) schedule(runtime)
-        for (index_t d = 0; d < diff_size; ++d) {
-          for (index_t i = 0; i < common_size; ++i) {
-            output[i + d * common_size] =
-                input0[i + d * common_size] * coeff_copy[0] +
-                    input1[i] * coeff_copy[1];
-          }
-        }
-      }
-      break;
-    case SUB:
-      if (!swapped) {
-#pragma omp parallel for collapse(2) schedule(runtime)
-        for (index_t d = 0; d < diff_size; ++d) {
-          for (index_t i = 0; i < common_size; ++i) {
-            output[i + d * common_size] =
-                input0[i + d * common_size] - input1[i];
-          }
-        }
-      } else {
-#pragma omp parallel for collapse(2) schedule(runtime)
-        for (index_t d = 0; d < diff_size; ++d) {
-          for (index_t i = 0; i < common_size; ++i) {
-            output[i + d * common_size] =
-                input1[i] - input0[i + d * common_size];
-          }
-        }
-      }
-      break;
-    case PROD:
-#pragma omp parallel for collapse(2) schedule(runtime)
-      for (index_t d = 0; d < diff_size; ++d) {
-        for (index_t i = 0; i < common_size; ++i) {
-          output[i + d * common_size] = input0[i + d * common_size] * input1[i];
-        }
-      }
-      break;
-    case DIV:
-      if (!swapped) {
-#pragma omp parallel for collapse(2) schedule(runtime)
-        for (index_t d = 0; d < diff_size; ++d) {
-          for (index_t i = 0; i < common_size; ++i) {
-            output[i + d * common_size] =
-                input0[i + d * common_size] / input1[i];
-          }
-        }
-      } else {
-#pragma omp parallel for collapse(2) schedule(runtime)
-        for (index_t d = 0; d < diff_size; ++d) {
-          for (index_t i = 0; i < common_size; ++i) {
-            output[i + d * common_size] =
-                input1[i] / input0[i + d * common_size];
-          }
-        }
-      }
-      break;
-    case FLOOR_DIV:
-      if (!swapped) {
-#pragma omp parallel for collapse(2) schedule(runtime)
-        for (index_t d = 0; d < diff_size; ++d) {
-          for (index_t i = 0; i < common_size; ++i) {
-            output[i + d * common_size] =
-                std::floor(input0[i + d * common_size] / input1[i]);
-          }
-        }
-      } else {
-#pragma omp parallel for collapse(2) schedule(runtime)
-        for (index_t d = 0; d < diff_size; ++d) {
-          for (index_t i = 0; i < common_size; ++i) {
-            output[i + d * common_size] =
-                std::floor(input1[i] / input0[i + d * common_size]);
-          }
-        }
-      }
-      break;
-    case MIN:
-#pragma omp parallel for collapse(2) schedule(runtime)
-      for (index_t d = 0; d < diff_size; ++d) {
-        for (index_t i = 0; i < common_size; ++i) {
-          output[i + d * common_size] =
-              std::min(input0[i + d * common_size], input1[i]);
-        }
-      }
-      break;
-    case MAX:
-#pragma omp parallel for collapse(2) schedule(runtime)
-      for (index_t d = 0; d < diff_size; ++d) {
-        for (index_t i = 0; i < common_size; ++i) {
-          output[i + d * common_size] =
-              std::max(input0[i + d * common_size], input1[i]);
-        }
-      }
-      break;
-    case SQR_DIFF:
-#pragma omp parallel for collapse(2) schedule(runtime)
-      for (index_t d = 0; d < diff_size; ++d) {
-        for (index_t i = 0; i < common_size; ++i) {
-          output[i + d * common_size] =
-              std::pow(input0[i + d * common_size] - input1[i], 2.f);
-        }
-      }
-      break;
-    case POW:
-      if (!swapped) {
-#pragma omp parallel for collapse(2) schedule(runtime)
-        for (index_t d = 0; d < diff_size; ++d) {
-          for (index_t i = 0; i < common_size; ++i) {
-            output[i + d * common_size] =
-                std::pow(input0[i + d * common_size], input1[i]);
-          }
-        }
-      } else {
-#pragma omp parallel for collapse(2) schedule(runtime)
-        for (index_t d = 0; d < diff_size; ++d) {
-          for (index_t i = 0; i < common_size; ++i) {
-            output[i + d * common_size] =
-                std::pow(input1[i], input0[i + d * common_size]);
-          }
-        }
-      }
-      break;
-    case NEG:
-#pragma omp parallel for schedule(runtime)
-      for (index_t i = 0; i < diff_size * common_size; ++i) {
-        output[i] = -input0[i];
-      }
-      break;
-    case ABS:
-#pragma omp parallel for schedule(runtime)
-      for (index_t i = 0; i < diff_size * common_size; ++i) {
-        output[i] = std::fabs(input0[i]);
-      }
-      break;
-    case EQUAL:
-#pragma omp parallel for collapse(2) schedule(runtime)
-      for (index_t d = 0; d < diff_size; ++d) {
-        for (index_t i = 0; i < common_size; ++i) {
-          output[i + d * common_size] =
-              input0[i + d * common_size] == input1[i];
-        }
-      }
-      break;
-    default:
-      LOG(FATAL) << "Eltwise op not support type " << type;
+// Element functors. The float ones with a NEON form set kVectorized.
+struct SumFunctor {
+  template <typename T>
+  T operator()(const T a, const T b) const { return a + b; }
+#if defined(MACE_ENABLE_NEON)
+  static constexpr bool kVectorized = true;
+  float32x4_t operator()(const float32x4_t a, const float32x4_t b) const {
+    return vaddq_f32(a, b);
   }
-}
+#endif
+};
 
-// Multiplication is costly, so we specialize the following case.
-template <typename T, typename DstType>
-inline void TensorEltwise(const EltwiseType type,
-                          const T *input0,
-                          const T *input1,
-                          const std::vector<float> &coeff,
-                          const index_t size,
-                          const bool swapped,
-                          DstType *output) {
-  switch (type) {
-    case SUM:
-      if (coeff.empty()) {
-#pragma omp parallel for schedule(runtime)
-        for (index_t i = 0; i < size; ++i) {
-          output[i] = input0[i] + input1[i];
-        }
+struct CoeffSumFunctor {
+  CoeffSumFunctor(const float coeff0, const float coeff1)
+      : coeff0(coeff0), coeff1(coeff1) {}
+  template <typename T>
+  float operator()(const T a, const T b) const {
+    return a * coeff0 + b * coeff1;
+  }
+#if defined(MACE_ENABLE_NEON)
+  static constexpr bool kVectorized = true;
+  float32x4_t operator()(const float32x4_t a, const float32x4_t b) const {
+    return vmlaq_n_f32(vmulq_n_f32(a, coeff0), b, coeff1);
+  }
+#endif
+  const float coeff0;
+  const float coeff1;
+};
 
-      } else {
-        std::vector<float> coeff_copy = coeff;
-        if (swapped) {
-          std::swap(coeff_copy[0], coeff_copy[1]);
-        }
-#pragma omp parallel for schedule(runtime)
-        for (index_t i = 0; i < size; ++i) {
-          output[i] = input0[i] * coeff_copy[0] + input1[i] * coeff_copy[1];
-        }
-      }
-      break;
-    case SUB:
-      if (!swapped) {
-#pragma omp parallel for schedule(runtime)
-        for (index_t i = 0; i < size; ++i) {
-          output[i] = input0[i] - input1[i];
-        }
+struct SubFunctor {
+  template <typename T>
+  T operator()(const T a, const T b) const { return a - b; }
+#if defined(MACE_ENABLE_NEON)
+  static constexpr bool kVectorized = true;
+  float32x4_t operator()(const float32x4_t a, const float32x4_t b) const {
+    return vsubq_f32(a, b);
+  }
+#endif
+};
 
-      } else {
-#pragma omp parallel for schedule(runtime)
-        for (index_t i = 0; i < size; ++i) {
-          output[i] = input1[i] - input0[i];
-        }
-      }
-      break;
-    case PROD:
-#pragma omp parallel for schedule(runtime)
-      for (index_t i = 0; i < size; ++i) {
-        output[i] = input0[i] * input1[i];
-      }
+struct ProdFunctor {
+  template <typename T>
+  T operator()(const T a, const T b) const { return a * b; }
+#if defined(MACE_ENABLE_NEON)
+  static constexpr bool kVectorized = true;
+  float32x4_t operator()(const float32x4_t a, const float32x4_t b) const {
+    return vmulq_f32(a, b);
+  }
+#endif
+};
 
-      break;
-    case DIV:
-      if (!swapped) {
-#pragma omp parallel for schedule(runtime)
-        for (index_t i = 0; i < size; ++i) {
-          output[i] = input0[i] / input1[i];
-        }
+struct DivFunctor {
+  template <typename T>
+  T operator()(const T a, const T b) const { return a / b; }
+#if defined(MACE_ENABLE_NEON) && defined(__aarch64__)
+  static constexpr bool kVectorized = true;
+  float32x4_t operator()(const float32x4_t a, const float32x4_t b) const {
+    return vdivq_f32(a, b);
+  }
+#else
+  static constexpr bool kVectorized = false;
+#endif
+};
 
-      } else {
-#pragma omp parallel for schedule(runtime)
-        for (index_t i = 0; i < size; ++i) {
-          output[i] = input1[i] / input0[i];
-        }
-      }
-      break;
-    case FLOOR_DIV:
-      if (!swapped) {
-#pragma omp parallel for schedule(runtime)
-        for (index_t i = 0; i < size; ++i) {
-          output[i] = std::floor(input0[i] / input1[i]);
-        }
-      } else {
-#pragma omp parallel for schedule(runtime)
-        for (index_t i = 0; i < size; ++i) {
-          output[i] = std::floor(input1[i] / input0[i]);
-        }
-      }
-      break;
-    case MIN:
-#pragma omp parallel for schedule(runtime)
-      for (index_t i = 0; i < size; ++i) {
-        output[i] = std::min(input0[i], input1[i]);
-      }
+struct FloorDivFunctor {
+  static constexpr bool kVectorized = false;
+  template <typename T>
+  T operator()(const T a, const T b) const { return std::floor(a / b); }
+};
 
-      break;
-    case MAX:
-#pragma omp parallel for schedule(runtime)
-      for (index_t i = 0; i < size; ++i) {
-        output[i] = std::max(input0[i], input1[i]);
-      }
+struct MinFunctor {
+  template <typename T>
+  T operator()(const T a, const T b) const { return std::min(b, a); }
+#if defined(MACE_ENABLE_NEON)
+  static constexpr bool kVectorized = true;
+  float32x4_t operator()(const float32x4_t a, const float32x4_t b) const {
+    return vminq_f32(a, b);
+  }
+#endif
+};
 
-      break;
-    case SQR_DIFF:
-#pragma omp parallel for schedule(runtime)
-      for (index_t i = 0; i < size; ++i) {
-        output[i] = std::pow(input0[i] - input1[i], 2.f);
-      }
+struct MaxFunctor {
+  template <typename T>
+  T operator()(const T a, const T b) const { return std::max(b, a); }
+#if defined(MACE_ENABLE_NEON)
+  static constexpr bool kVectorized = true;
+  float32x4_t operator()(const float32x4_t a, const float32x4_t b) const {
+    return vmaxq_f32(a, b);
+  }
+#endif
+};
 
-      break;
-    case POW:
-      if (!swapped) {
-#pragma omp parallel for schedule(runtime)
-        for (index_t i = 0; i < size; ++i) {
-          output[i] = std::pow(input0[i], input1[i]);
-        }
-      } else {
-#pragma omp parallel for schedule(runtime)
-        for (index_t i = 0; i < size; ++i) {
-          output[i] = std::pow(input1[i], input0[i]);
-        }
-      }
-      break;
-    case NEG:
-#pragma omp parallel for schedule(runtime)
-      for (index_t i = 0; i < size; ++i) {
-        output[i] = -input0[i];
-      }
-      break;
-    case ABS:
-#pragma omp parallel for schedule(runtime)
-      for (index_t i = 0; i < size; ++i) {
-        output[i] = std::fabs(input0[i]);
-      }
-      break;
-    case EQUAL:
-#pragma omp parallel for schedule(runtime)
-      for (index_t i = 0; i < size; ++i) {
-        output[i] = input0[i] == input1[i];
-      }
-      break;
-    default:
-      LOG(FATAL) << "Eltwise op not support type " << type;
+struct NegFunctor {
+  template <typename T>
+  T operator()(const T a, const T) const { return -a; }
+#if defined(MACE_ENABLE_NEON)
+  static constexpr bool kVectorized = true;
+  float32x4_t operator()(const float32x4_t a, const float32x4_t) const {
+    return vnegq_f32(a);
   }
-}
+#endif
+};
 
-// Multiplication is costly, so we specialize the following case.
-template <typename T, typename DstType>
-inline void TensorScalarEltwise(const EltwiseType type,
-                                const T *input0,
-                                const T input1,
-                                const std::vector<float> &coeff,
-                                const index_t size,
-                                const bool swapped,
-                                DstType *output) {
-  switch (type) {
-    case SUM:
-      if (coeff.empty()) {
-#pragma omp parallel for schedule(runtime)
-        for (index_t i = 0; i < size; ++i) {
-          output[i] = input0[i] + input1;
-        }
+struct AbsFunctor {
+  template <typename T>
+  T operator()(const T a, const T) const { return std::fabs(a); }
+#if defined(MACE_ENABLE_NEON)
+  static constexpr bool kVectorized = true;
+  float32x4_t operator()(const float32x4_t a, const float32x4_t) const {
+    return vabsq_f32(a);
+  }
+#endif
+};
 
-      } else {
-        std::vector<float> coeff_copy = coeff;
-        if (swapped) {
-          std::swap(coeff_copy[0], coeff_copy[1]);
-        }
-#pragma omp parallel for schedule(runtime)
-        for (index_t i = 0; i < size; ++i) {
-          output[i] = input0[i] * coeff_copy[0] + input1 * coeff_copy[1];
-        }
-      }
-      break;
-    case SUB:
-      if (!swapped) {
-#pragma omp parallel for schedule(runtime)
-        for (index_t i = 0; i < size; ++i) {
-          output[i] = input0[i] - input1;
-        }
+struct SqrDiffFunctor {
+  template <typename T>
+  T operator()(const T a, const T b) const { return (b - a) * (b - a); }
+#if defined(MACE_ENABLE_NEON)
+  static constexpr bool kVectorized = true;
+  float32x4_t operator()(const float32x4_t a, const float32x4_t b) const {
+    const float32x4_t diff = vsubq_f32(b, a);
+    return vmulq_f32(diff, diff);
+  }
+#endif
+};
 
-      } else {
-#pragma omp parallel for schedule(runtime)
-        for (index_t i = 0; i < size; ++i) {
-          output[i] = input1 - input0[i];
-        }
-      }
-      break;
-    case PROD:
-#pragma omp parallel for schedule(runtime)
-      for (index_t i = 0; i < size; ++i) {
-        output[i] = input0[i] * input1;
-      }
+struct PowFunctor {
+  static constexpr bool kVectorized = false;
+  template <typename T>
+  T operator()(const T a, const T b) const { return std::pow(a, b); }
+};
 
-      break;
-    case DIV:
-      if (!swapped) {
-#pragma omp parallel for schedule(runtime)
-        for (index_t i = 0; i < size; ++i) {
-          output[i] = input0[i] / input1;
-        }
+struct EqualFunctor {
+  static constexpr bool kVectorized = false;
+  template <typename T>
+  T operator()(const T a, const T b) const { return a == b; }
+};
 
-      } else {
-#pragma omp parallel for schedule(runtime)
-        for (index_t i = 0; i < size; ++i) {
-          output[i] = input1 / input0[i];
-        }
-      }
-      break;
-    case FLOOR_DIV:
-      if (!swapped) {
-#pragma omp parallel for schedule(runtime)
-        for (index_t i = 0; i < size; ++i) {
-          output[i] = std::floor(input0[i] / input1);
-        }
-      } else {
-#pragma omp parallel for schedule(runtime)
-        for (index_t i = 0; i < size; ++i) {
-          output[i] = std::floor(input1 / input0[i]);
-        }
-      }
-      break;
-    case MIN:
-#pragma omp parallel for schedule(runtime)
-      for (index_t i = 0; i < size; ++i) {
-        output[i] = std::min(input0[i], input1);
-      }
+template <typename Functor, typename T, typename DstType>
+struct UseNeon {
+#if defined(MACE_ENABLE_NEON)
+  static constexpr bool value = Functor::kVectorized &&
+      std::is_same<T, float>::value && std::is_same<DstType, float>::value;
+#else
+  static constexpr bool value = false;
+#endif
+};
 
-      break;
-    case MAX:
-#pragma omp parallel for schedule(runtime)
-      for (index_t i = 0; i < size; ++i) {
-        output[i] = std::max(input0[i], input1);
-      }
+// Computes a run of the innermost dim, along which either input may be a
+// scalar: the same-shape, row-broadcast (stride1 of 0) and reversed
+// (stride0 of 0) kernels.
+template <typename Functor, typename T, typename DstType>
+void EltwiseRun(const Functor &functor,
+                const T *input0,
+                const index_t stride0,
+                const T *input1,
+                const index_t stride1,
+                const index_t size,
+                DstType *output,
+                std::false_type) {
+  if (stride0 != 0 && stride1 != 0) {
+    for (index_t i = 0; i < size; ++i) {
+      output[i] = functor(input0[i], input1[i]);
+    }
+  } else if (stride0 != 0) {
+    const T in1 = input1[0];
+    for (index_t i = 0; i < size; ++i) {
+      output[i] = functor(input0[i], in1);
+    }
+  } else {
+    const T in0 = input0[0];
+    for (index_t i = 0; i < size; ++i) {
+      output[i] = functor(in0, input1[i]);
+    }
+  }
+}
 
-      break;
-    case SQR_DIFF:
-#pragma omp parallel for schedule(runtime)
-      for (index_t i = 0; i < size; ++i) {
-        output[i] = std::pow(input0[i] - input1, 2.f);
-      }
+#if defined(MACE_ENABLE_NEON)
+template <typename Functor>
+void EltwiseRun(const Functor &functor,
+                const float *input0,
+                const index_t stride0,
+                const float *input1,
+                const index_t stride1,
+                const index_t size,
+                float *output,
+                std::true_type) {
+  const index_t vec_size = size & ~3;
+  if (stride0 != 0 && stride1 != 0) {
+    for (index_t i = 0; i < vec_size; i += 4) {
+      vst1q_f32(output + i,
+                functor(vld1q_f32(input0 + i), vld1q_f32(input1 + i)));
+    }
+  } else if (stride0 != 0) {
+    const float32x4_t in1 = vdupq_n_f32(input1[0]);
+    for (index_t i = 0; i < vec_size; i += 4) {
+      vst1q_f32(output + i, functor(vld1q_f32(input0 + i), in1));
+    }
+  } else {
+    const float32x4_t in0 = vdupq_n_f32(input0[0]);
+    for (index_t i = 0; i < vec_size; i += 4) {
+      vst1q_f32(output + i, functor(in0, vld1q_f32(input1 + i)));
+    }
+  }
+  EltwiseRun(functor, input0 + vec_size * stride0, stride0,
+             input1 + vec_size * stride1, stride1, size - vec_size,
+             output + vec_size, std::false_type());
+}
+#endif  // MACE_ENABLE_NEON
 
-      break;
-    case POW:
-      if (!swapped) {
-#pragma omp parallel for schedule(runtime)
-        for (index_t i = 0; i < size; ++i) {
-          output[i] = std::pow(input0[i], input1);
-        }
-      } else {
-#pragma omp parallel for schedule(runtime)
-        for (index_t i = 0; i < size; ++i) {
-          output[i] = std::pow(input1, input0[i]);
-        }
-      }
-      break;
-    case NEG:
-#pragma omp parallel for schedule(runtime)
-      for (index_t i = 0; i < size; ++i) {
-        output[i] = -input0[i];
-      }
-      break;
-    case ABS:
-#pragma omp parallel for schedule(runtime)
-      for (index_t i = 0; i < size; ++i) {
-        output[i] = std::fabs(input0[i]);
-      }
-      break;
-    case EQUAL:
-#pragma omp parallel for schedule(runtime)
-      for (index_t i = 0; i < size; ++i) {
-        output[i] = input0[i] == input1;
-      }
+// Splits the output into tasks of kGrainSize elements. Each task locates
+// its first element in the plan once and then walks the innermost dim run
+// by run, carrying the input offsets across the outer dims.
+template <typename Functor, typename T, typename DstType>
+void BroadcastEltwise(const Functor &functor,
+                      const BroadcastPlan &plan,
+                      const T *input0,
+                      const T *input1,
+                      DstType *output) {
+  const index_t rank = static_cast<index_t>(plan.dims.size());
+  const index_t inner = plan.dims.back();
+  const index_t inner_stride0 = plan.strides0.back();
+  const index_t inner_stride1 = plan.strides1.back();
+  const index_t size = std::accumulate(plan.dims.begin(), plan.dims.end(),
+                                       index_t(1),
+                                       std::multiplies<index_t>());
+  const index_t tasks = RoundUpDiv(size, kGrainSize);
+
+#pragma omp parallel for schedule(runtime)
+  for (index_t t = 0; t < tasks; ++t) {
+    const index_t begin = t * kGrainSize;
+    const index_t end = std::min(size, begin + kGrainSize);
+    std::vector<index_t> index(rank);
+    index_t offset0 = 0;
+    index_t offset1 = 0;
+    index_t remain = begin;
+    for (index_t d = rank - 1; d >= 0; --d) {
+      index[d] = remain % plan.dims[d];
+      remain /= plan.dims[d];
+      offset0 += index[d] * plan.strides0[d];
+      offset1 += index[d] * plan.strides1[d];
+    }
 
-      break;
-    default:
-      LOG(FATAL) << "Eltwise op not support type " << type;
+    for (index_t i = begin; i < end;) {
+      const index_t run = std::min(inner - index[rank - 1], end - i);
+      EltwiseRun(functor, input0 + offset0, inner_stride0,
+                 input1 + offset1, inner_stride1, run, output + i,
+                 std::integral_constant<
+                     bool, UseNeon<Functor, T, DstType>::value>());
+      i += run;
+      offset0 += run * inner_stride0;
+      offset1 += run * inner_stride1;
+      index[rank - 1] += run;
+      for (index_t d = rank - 1; d > 0 && index[d] == plan.dims[d]; --d) {
+        offset0 += plan.strides0[d - 1] - plan.dims[d] * plan.strides0[d];
+        offset1 += plan.strides1[d - 1] - plan.dims[d] * plan.strides1[d];
+        index[d] = 0;
+        ++index[d - 1];
+      }
+    }
   }
 }
 
+// Runs the functor of type over the plan, input0 being the first operand
 template <typename T, typename DstType>
-inline void TensorEltwisePerChannel(const EltwiseType type,
-                                    const T *input0,
-                                    const T *input1,
-                                    const std::vector<float> &coeff,
-                                    const index_t batch0,
-                                    const index_t batch1,
-                                    const index_t channel,
-                                    const index_t image_size,
-                                    const bool swapped,
-                                    DstType *output) {
+void EltwiseByType(const EltwiseType type,
+                   const std::vector<float> &coeff,
+                   const BroadcastPlan &plan,
+                   const T *input0_ptr,
+                   const T *input1_ptr,
+                   DstType *output_ptr) {
   switch (type) {
     case SUM:
       if (coeff.empty()) {
-#pragma omp parallel for collapse(2) schedule(runtime)
-        for (index_t b = 0; b < batch0; ++b) {
-          for (index_t c = 0; c < channel; ++c) {
-            const T *in0_ptr = input0 + ((b * channel) + c) * image_size;
-            const T *in1_ptr = input1 + (batch1 > 1 ? b * channel : 0);
-            DstType *out_ptr = output + ((b * channel) + c) * image_size;
-            for (index_t i = 0; i < image_size; ++i) {
-              out_ptr[i] = in0_ptr[i] + in1_ptr[c];
-            }
-          }
-        }
+        BroadcastEltwise(SumFunctor(), plan, input0_ptr, input1_ptr,
+                         output_ptr);
       } else {
-        std::vector<float> coeff_copy = coeff;
-        if (swapped) {
-          std::swap(coeff_copy[0], coeff_copy[1]);
-        }
-#pragma omp parallel for collapse(2) schedule(runtime)
-        for (index_t b = 0; b < batch0; ++b) {
-          for (index_t c = 0; c < channel; ++c) {
-            const T *in0_ptr = input0 + ((b * channel) + c) * image_size;
-            const T *in1_ptr = input1 + (batch1 > 1 ? b * channel : 0);
-            DstType *out_ptr = output + ((b * channel) + c) * image_size;
-            for (index_t i = 0; i < image_size; ++i) {
-              out_ptr[i] =
-                  in0_ptr[i] * coeff_copy[0] + in1_ptr[c] * coeff_copy[1];
-            }
-          }
-        }
+        BroadcastEltwise(CoeffSumFunctor(coeff[0], coeff[1]), plan,
+                         input0_ptr, input1_ptr, output_ptr);
       }
       break;
     case SUB:
-      if (!swapped) {
-#pragma omp parallel for collapse(2) schedule(runtime)
-        for (index_t b = 0; b < batch0; ++b) {
-          for (index_t c = 0; c < channel; ++c) {
-            const T *in0_ptr = input0 + ((b * channel) + c) * image_size;
-            const T *in1_ptr = input1 + (batch1 > 1 ? b * channel : 0);
-            DstType *out_ptr = output + ((b * channel) + c) * image_size;
-            for (index_t i = 0; i < image_size; ++i) {
-              out_ptr[i] = in0_ptr[i] - in1_ptr[c];
-            }
-          }
-        }
-      } else {
-#pragma omp parallel for collapse(2) schedule(runtime)
-        for (index_t b = 0; b < batch0; ++b) {
-          for (index_t c = 0; c < channel; ++c) {
-            const T *in0_ptr = input0 + ((b * channel) + c) * image_size;
-            const T *in1_ptr = input1 + (batch1 > 1 ? b * channel : 0);
-            DstType *out_ptr = output + ((b * channel) + c) * image_size;
-            for (index_t i = 0; i < image_size; ++i) {
-              out_ptr[i] = in1_ptr[c] - in0_ptr[i];
-            }
-          }
-        }
-      }
+      BroadcastEltwise(SubFunctor(), plan, input0_ptr, input1_ptr,
+                       output_ptr);
       break;
     case PROD:
-#pragma omp parallel for collapse(2) schedule(runtime)
-      for (index_t b = 0; b < batch0; ++b) {
-        for (index_t c = 0; c < channel; ++c) {
-          const T *in0_ptr = input0 + ((b * channel) + c) * image_size;
-          const T *in1_ptr = input1 + (batch1 > 1 ? b * channel : 0);
-          DstType *out_ptr = output + ((b * channel) + c) * image_size;
-          for (index_t i = 0; i < image_size; ++i) {
-            out_ptr[i] = in0_ptr[i] * in1_ptr[c];
-          }
-        }
-      }
+      BroadcastEltwise(ProdFunctor(), plan, input0_ptr, input1_ptr,
+                       output_ptr);
       break;
     case DIV:
-      if (!swapped) {
-#pragma omp parallel for collapse(2) schedule(runtime)
-        for (index_t b = 0; b < batch0; ++b) {
-          for (index_t c = 0; c < channel; ++c) {
-            const T *in0_ptr = input0 + ((b * channel) + c) * image_size;
-            const T *in1_ptr = input1 + (batch1 > 1 ? b * channel : 0);
-            DstType *out_ptr = output + ((b * channel) + c) * image_size;
-            for (index_t i = 0; i < image_size; ++i) {
-              out_ptr[i] = in0_ptr[i] / in1_ptr[c];
-            }
-          }
-        }
-      } else {
-#pragma omp parallel for collapse(2) schedule(runtime)
-        for (index_t b = 0; b < batch0; ++b) {
-          for (index_t c = 0; c < channel; ++c) {
-            const T *in0_ptr = input0 + ((b * channel) + c) * image_size;
-            const T *in1_ptr = input1 + (batch1 > 1 ? b * channel : 0);
-            DstType *out_ptr = output + ((b * channel) + c) * image_size;
-            for (index_t i = 0; i < image_size; ++i) {
-              out_ptr[i] = in1_ptr[c] / in0_ptr[i];
-            }
-          }
-        }
-      }
+      BroadcastEltwise(DivFunctor(), plan, input0_ptr, input1_ptr,
+                       output_ptr);
       break;
     case FLOOR_DIV:
-      if (!swapped) {
-#pragma omp parallel for collapse(2) schedule(runtime)
-        for (index_t b = 0; b < batch0; ++b) {
-          for (index_t c = 0; c < channel; ++c) {
-            const T *in0_ptr = input0 + ((b * channel) + c) * image_size;
-            const T *in1_ptr = input1 + (batch1 > 1 ? b * channel : 0);
-            DstType *out_ptr = output + ((b * channel) + c) * image_size;
-            for (index_t i = 0; i < image_size; ++i) {
-              out_ptr[i] = std::floor(in0_ptr[i] / in1_ptr[c]);
-            }
-          }
-        }
-      } else {
-#pragma omp parallel for collapse(2) schedule(runtime)
-        for (index_t b = 0; b < batch0; ++b) {
-          for (index_t c = 0; c < channel; ++c) {
-            const T *in0_ptr = input0 + ((b * channel) + c) * image_size;
-            const T *in1_ptr = input1 + (batch1 > 1 ? b * channel : 0);
-            DstType *out_ptr = output + ((b * channel) + c) * image_size;
-            for (index_t i = 0; i < image_size; ++i) {
-              out_ptr[i] = std::floor(in1_ptr[c] / in0_ptr[i]);
-            }
-          }
-        }
-      }
+      BroadcastEltwise(FloorDivFunctor(), plan, input0_ptr, input1_ptr,
+                       output_ptr);
       break;
     case MIN:
-#pragma omp parallel for collapse(2) schedule(runtime)
-      for (index_t b = 0; b < batch0; ++b) {
-        for (index_t c = 0; c < channel; ++c) {
-          const T *in0_ptr = input0 + ((b * channel) + c) * image_size;
-          const T *in1_ptr = input1 + (batch1 > 1 ? b * channel : 0);
-          DstType *out_ptr = output + ((b * channel) + c) * image_size;
-          for (index_t i = 0; i < image_size; ++i) {
-            out_ptr[i] = std::min(in0_ptr[i], in1_ptr[c]);
-          }
-        }
-      }
+      BroadcastEltwise(MinFunctor(), plan, input0_ptr, input1_ptr,
+                       output_ptr);
       break;
     case MAX:
-#pragma omp parallel for collapse(2) schedule(runtime)
-      for (index_t b = 0; b < batch0; ++b) {
-        for (index_t c = 0; c < channel; ++c) {
-          const T *in0_ptr = input0 + ((b * channel) + c) * image_size;
-          const T *in1_ptr = input1 + (batch1 > 1 ? b * channel : 0);
-          DstType *out_ptr = output + ((b * channel) + c) * image_size;
-          for (index_t i = 0; i < image_size; ++i) {
-            out_ptr[i] = std::max(in0_ptr[i], in1_ptr[c]);
-          }
-        }
-      }
-      break;
-    case SQR_DIFF:
-#pragma omp parallel for collapse(2) schedule(runtime)
-      for (index_t b = 0; b < batch0; ++b) {
-        for (index_t c = 0; c < channel; ++c) {
-          const T *in0_ptr = input0 + ((b * channel) + c) * image_size;
-          const T *in1_ptr = input1 + (batch1 > 1 ? b * channel : 0);
-          DstType *out_ptr = output + ((b * channel) + c) * image_size;
-          for (index_t i = 0; i < image_size; ++i) {
-            out_ptr[i] = std::pow(in0_ptr[i] - in1_ptr[c], 2.f);
-          }
-        }
-      }
-      break;
-    case POW:
-      if (!swapped) {
-#pragma omp parallel for collapse(2) schedule(runtime)
-        for (index_t b = 0; b < batch0; ++b) {
-          for (index_t c = 0; c < channel; ++c) {
-            const T *in0_ptr = input0 + ((b * channel) + c) * image_size;
-            const T *in1_ptr = input1 + (batch1 > 1 ? b * channel : 0);
-            DstType *out_ptr = output + ((b * channel) + c) * image_size;
-            for (index_t i = 0; i < image_size; ++i) {
-              out_ptr[i] = std::pow(in0_ptr[i], in1_ptr[c]);
-            }
-          }
-        }
-      } else {
-#pragma omp parallel for collapse(2) schedule(runtime)
-        for (index_t b = 0; b < batch0; ++b) {
-          for (index_t c = 0; c < channel; ++c) {
-            const T *in0_ptr = input0 + ((b * channel) + c) * image_size;
-            const T *in1_ptr = input1 + (batch1 > 1 ? b * channel : 0);
-            DstType *out_ptr = output + ((b * channel) + c) * image_size;
-            for (index_t i = 0; i < image_size; ++i) {
-              out_ptr[i] = std::pow(in1_ptr[c], in0_ptr[i]);
-            }
-          }
-        }
-      }
+      BroadcastEltwise(MaxFunctor(), plan, input0_ptr, input1_ptr,
+                       output_ptr);
       break;
     case NEG:
-#pragma omp parallel for schedule(runtime)
-      for (index_t i = 0; i < batch0 * channel * image_size; ++i) {
-        output[i] = -input0[i];
-      }
+      BroadcastEltwise(NegFunctor(), plan, input0_ptr, input1_ptr,
+                       output_ptr);
       break;
     case ABS:
-#pragma omp parallel for schedule(runtime)
-      for (index_t i = 0; i < batch0 * channel * image_size; ++i) {
-        output[i] = std::fabs(input0[i]);
-      }
+      BroadcastEltwise(AbsFunctor(), plan, input0_ptr, input1_ptr,
+                       output_ptr);
+      break;
+    case SQR_DIFF:
+      BroadcastEltwise(SqrDiffFunctor(), plan, input0_ptr, input1_ptr,
+                       output_ptr);
+      break;
+    case POW:
+      BroadcastEltwise(PowFunctor(), plan, input0_ptr, input1_ptr,
+                       output_ptr);
       break;
     case EQUAL:
-#pragma omp parallel for collapse(2) schedule(runtime)
-      for (index_t b = 0; b < batch0; ++b) {
-        for (index_t c = 0; c < channel; ++c) {
-          const T *in0_ptr = input0 + ((b * channel) + c) * image_size;
-          const T *in1_ptr = input1 + (batch1 > 1 ? b * channel : 0);
-          DstType *out_ptr = output + ((b * channel) + c) * image_size;
-          for (index_t i = 0; i < image_size; ++i) {
-            out_ptr[i] = in0_ptr[i] == in1_ptr[c];
-          }
-        }
-      }
+      BroadcastEltwise(EqualFunctor(), plan, input0_ptr, input1_ptr,
+                       output_ptr);
       break;
     default:
       LOG(FATAL) << "Eltwise op not support type " << type;
   }
 }
 
+}  // namespace
+
 template <DeviceType D, class T>
 class EltwiseOp : public Operation {
  public:
@@ -921,6 +482,10 @@ class EltwiseOp : public Operation {
     }
   }
 
+  // each output element only reads the input element at the same index
+  // when the input has the output shape, which the optimizer checks
+  int InplaceInputIndex() const override { return 0; }
+
  private:
   template <typename DstType>
   MaceStatus DoEltwise(const Tensor *input0,
@@ -940,6 +505,8 @@ class EltwiseOp : public Operation {
     // check if we can broadcast tensor
     uint32_t rank_diff =
         static_cast<uint32_t>(input0->dim_size() - input1->dim_size());
+    const std::vector<index_t> &input0_shape = input0->shape();
+    std::vector<index_t> input1_shape;
     if (data_format_ == NCHW) {
       MACE_CHECK(
           (input0->dim_size() == 4) &&
@@ -951,74 +518,49 @@ class EltwiseOp : public Operation {
                   (input1->dim_size() == 1 &&
                       input1->dim(0) == input0->dim(1))),
           "only support broadcast channel dimension");
+      if (input1->dim_size() == 4) {
+        input1_shape = input1->shape();
+      } else {
+        input1_shape = {1, input1->size(), 1, 1};
+      }
     } else {
       for (uint32_t i = 0; i < input1->dim_size(); ++i) {
         MACE_CHECK(input0->dim(rank_diff + i) == 1 || input1->dim(i) == 1 ||
             input0->dim(rank_diff + i) == input1->dim(i),
                    "Element-Wise op only support tail dimensions broadcast");
       }
+      input1_shape.assign(rank_diff, 1);
+      input1_shape.insert(input1_shape.end(), input1->shape().begin(),
+                          input1->shape().end());
+    }
+
+    std::vector<index_t> output_shape(input0_shape.size());
+    for (size_t i = 0; i < input0_shape.size(); ++i) {
+      output_shape[i] = std::max(input0_shape[i], input1_shape[i]);
     }
+    MACE_RETURN_IF_ERROR(output->Resize(output_shape));
 
     Tensor::MappingGuard input0_guard(input0);
     Tensor::MappingGuard input1_guard(input1);
+    Tensor::MappingGuard output_guard(output);
 
+    // the kernels take the operands in their op order, the tensor input
+    // first for the unary types
+    if (type_ == NEG || type_ == ABS) {
+      swapped = false;
+    }
     const T *input0_ptr = input0->data<T>();
     const T *input1_ptr = input1->data<T>();
-
-    if (data_format_ == NCHW && input1->dim_size() > 0) {
-      MACE_RETURN_IF_ERROR(output->ResizeLike(input0));
-      Tensor::MappingGuard output_guard(output);
-      DstType *output_ptr = output->mutable_data<DstType>();
-      if (input1->size() < input0->size()) {
-        TensorEltwisePerChannel(
-            type_, input0_ptr, input1_ptr, coeff_, input0->dim(0),
-            input1->dim_size() == 1 ? 1 : input1->dim(0), input0->dim(1),
-            input0->dim(2) * input0->dim(3), swapped, output_ptr);
-      } else {
-        TensorEltwise(type_, input0_ptr, input1_ptr, coeff_, input0->size(),
-                      swapped, output_ptr);
-      }
-    } else {
-      const std::vector<index_t> &input0_shape = input0->shape();
-      std::vector<index_t> input1_shape(rank_diff, 1);
-      input1_shape.insert(input1_shape.end(), input1->shape().begin(),
-                          input1->shape().end());
-
-      std::vector<index_t> output_shape(input0->dim_size(), 0);
-      for (unsigned int i = 0; i < input0_shape.size(); ++i) {
-        output_shape[i] = std::max(input0_shape[i], input1_shape[i]);
-      }
-      MACE_RETURN_IF_ERROR(output->Resize(output_shape));
-      Tensor::MappingGuard output_guard(output);
-      DstType *output_ptr = output->mutable_data<DstType>();
-
-      bool need_general_broadcast = false;
-      for (uint32_t i = 0; i < input1->dim_size(); ++i) {
-        if ((input0->dim(rank_diff + i) == 1 && input1->dim(i) > 1) ||
-            (input0->dim(rank_diff + i) > 1 && input1->dim(i) == 1)) {
-          need_general_broadcast = true;
-          break;
-        }
-      }
-
-      if (input1->size() == 1) {
-        TensorScalarEltwise(type_, input0_ptr, input1_ptr[0], coeff_,
-                            input0->size(), swapped, output_ptr);
-      } else if (input0_shape == input1_shape) {
-        TensorEltwise(type_, input0_ptr, input1_ptr, coeff_, input0->size(),
-                      swapped, output_ptr);
-      } else if (need_general_broadcast) {
-        TensorGeneralBroadcastEltwise(type_, input0_ptr, input1_ptr, coeff_,
-                                      swapped, input0_shape, input1_shape,
-                                      output_shape, output_ptr);
-      } else {
-        index_t common_size = input1->size();
-        index_t diff_size = input0->size() / common_size;
-        TensorBroadcastEltwise(type_, input0_ptr, input1_ptr, coeff_,
-                               diff_size, common_size, swapped, output_ptr);
-      }
+    DstType *output_ptr = output->mutable_data<DstType>();
+    const BroadcastPlan plan = swapped ?
+                               PlanBroadcast(input1_shape, input0_shape) :
+                               PlanBroadcast(input0_shape, input1_shape);
+    if (swapped) {
+      std::swap(input0_ptr, input1_ptr);
     }
 
+    EltwiseByType(type_, coeff_, plan, input0_ptr, input1_ptr, output_ptr);
+
     return MaceStatus::MACE_SUCCESS;
   }
 
@@ -1054,6 +596,9 @@ class EltwiseOp<DeviceType::CPU, uint8_t> : public Operation {
   MaceStatus Run(OpContext *context) override {
     MACE_UNUSED(context);
     const Tensor *input0 = this->Input(0);
+    if (this->InputSize() == 1) {
+      return RunLookupTable(input0, this->Output(0));
+    }
     MACE_CHECK(this->InputSize() == 2,
                "Quantized Elementwise don't support broadcast now.");
     const Tensor *input1 = this->Input(1);
@@ -1135,12 +680,41 @@ class EltwiseOp<DeviceType::CPU, uint8_t> : public Operation {
   }
 
  private:
+  // With the scalar arg the op is a function of the values of its tensor
+  // alone, looked up from the float eltwise of the 256 uint8 values.
+  MaceStatus RunLookupTable(const Tensor *input, Tensor *output) {
+    MACE_RETURN_IF_ERROR(output->ResizeLike(input));
+    table_.Update(input, output, [this](float *values) {
+      const std::vector<index_t> table_shape = {QuantizedLookupTable::kSize};
+      const float scalar = scalar_input_;
+      if (scalar_input_index_ == 0 && type_ != NEG && type_ != ABS) {
+        EltwiseByType(type_, coeff_, PlanBroadcast({1}, table_shape),
+                      &scalar, values, values);
+      } else {
+        EltwiseByType(type_, coeff_, PlanBroadcast(table_shape, {1}),
+                      values, &scalar, values);
+      }
+    });
+
+    Tensor::MappingGuard input_guard(input);
+    Tensor::MappingGuard output_guard(output);
+    const uint8_t *input_ptr = input->data<uint8_t>();
+    uint8_t *output_ptr = output->mutable_data<uint8_t>();
+#ifdef MACE_ENABLE_NEON
+    arm::q8::LookupTable(table_.data(), input_ptr, input->size(), output_ptr);
+#else
+    table_.Lookup(input_ptr, input->size(), output_ptr);
+#endif  // MACE_ENABLE_NEON
+    return MaceStatus::MACE_SUCCESS;
+  }
+
   EltwiseType type_;
   std::vector<float> coeff_;
   float scalar_input_;
   int32_t scalar_input_index_;
   DataFormat data_format_;
   Tensor scalar_tensor_;
+  QuantizedLookupTable table_;
 #ifdef MACE_ENABLE_NEON
   arm::q8::Eltwise eltwise_;
 #endif
@@ -1166,7 +740,10 @@ class EltwiseOp<DeviceType::GPU, T> : public Operation {
       kernel_ = make_unique<opencl::image::EltwiseKernel<T>>(
           type, coeff, scalar_input, scalar_input_index);
     } else {
-      MACE_NOT_IMPLEMENTED;
+      mem_type = MemoryType::GPU_BUFFER;
+      context->set_output_mem_type(mem_type);
+      kernel_ = make_unique<opencl::buffer::EltwiseKernel<T>>(
+          type, coeff, scalar_input, scalar_input_index);
     }
     // Transform filters
     int input_size = operator_def_->input_size();
@@ -12,6 +12,10 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <numeric>
 #include <vector>
 
 #include "mace/ops/common/conv_pool_2d_util.h"
@@ -729,6 +733,145 @@ void RandomTensorEltwise(const ops::EltwiseType type,
   }
 }
 
+// The GPU op on image and on buffer against the CPU one.
+template <typename T>
+void GPUBroadcastPatterns(const ops::EltwiseType type,
+                          const std::vector<index_t> &shape0,
+                          const std::vector<index_t> &shape1,
+                          const std::vector<float> &coeff = {}) {
+  // Construct graph
+  OpsTestNet net;
+
+  // Add input data
+  net.AddRandomInput<DeviceType::GPU, float>("Input0", shape0, false, true,
+                                             true, 0.5f, 2.f);
+  net.AddRandomInput<DeviceType::GPU, float>("Input1", shape1, false, true,
+                                             true, 0.5f, 2.f);
+
+  OpDefBuilder("Eltwise", "EltwiseTest")
+      .Input("Input0")
+      .Input("Input1")
+      .AddIntArg("type", static_cast<int>(type))
+      .AddFloatsArg("coeff", coeff)
+      .Output("Output")
+      .Finalize(net.NewOperatorDef());
+  net.RunOp(DeviceType::CPU);
+  auto expected = net.CreateTensor<float>();
+  expected->Copy(*net.GetOutput("Output"));
+
+  for (bool use_image : {true, false}) {
+    if (use_image) {
+      OpTestContext::Get()->SetOCLImageTestFlag();
+    } else {
+      OpTestContext::Get()->SetOCLBufferTestFlag();
+    }
+    OpDefBuilder("Eltwise", "EltwiseTest")
+        .Input("Input0")
+        .Input("Input1")
+        .AddIntArg("type", static_cast<int>(type))
+        .AddFloatsArg("coeff", coeff)
+        .AddIntArg("T", static_cast<int>(DataTypeToEnum<T>::value))
+        .Output("Output")
+        .Finalize(net.NewOperatorDef());
+    net.RunOp(DeviceType::GPU);
+
+    if (DataTypeToEnum<T>::value == DT_FLOAT) {
+      ExpectTensorNear<float>(*expected, *net.GetOutput("Output"), 1e-5);
+    } else {
+      ExpectTensorNear<float>(*expected, *net.GetOutput("Output"), 1e-2,
+                              1e-2);
+    }
+  }
+}
+
+void BroadcastPatterns(const ops::EltwiseType type,
+                       const std::vector<index_t> &shape0,
+                       const std::vector<index_t> &shape1,
+                       const std::vector<float> &coeff = {}) {
+  // Construct graph
+  OpsTestNet net;
+
+  // Add input data
+  net.AddRandomInput<DeviceType::CPU, float>("Input0", shape0, false, true,
+                                             true, 0.5f, 2.f);
+  net.AddRandomInput<DeviceType::CPU, float>("Input1", shape1, false, true,
+                                             true, 0.5f, 2.f);
+
+  OpDefBuilder("Eltwise", "EltwiseTest")
+      .Input("Input0")
+      .Input("Input1")
+      .AddIntArg("type", static_cast<int>(type))
+      .AddFloatsArg("coeff", coeff)
+      .Output("Output")
+      .Finalize(net.NewOperatorDef());
+
+  // Run
+  net.RunOp(DeviceType::CPU);
+
+  // the inputs in op order, right-aligned to the output rank
+  const size_t rank = std::max(shape0.size(), shape1.size());
+  std::vector<index_t> a_shape(rank - shape0.size(), 1);
+  a_shape.insert(a_shape.end(), shape0.begin(), shape0.end());
+  std::vector<index_t> b_shape(rank - shape1.size(), 1);
+  b_shape.insert(b_shape.end(), shape1.begin(), shape1.end());
+  const float *a = net.GetTensor("Input0")->data<float>();
+  const float *b = net.GetTensor("Input1")->data<float>();
+  std::vector<index_t> output_shape(rank);
+  for (size_t i = 0; i < rank; ++i) {
+    output_shape[i] = std::max(a_shape[i], b_shape[i]);
+  }
+  const index_t size = std::accumulate(output_shape.begin(),
+                                       output_shape.end(), index_t(1),
+                                       std::multiplies<index_t>());
+  std::vector<float> expected_data(size);
+  for (index_t i = 0; i < size; ++i) {
+    index_t remain = i;
+    index_t a_idx = 0;
+    index_t b_idx = 0;
+    index_t a_stride = 1;
+    index_t b_stride = 1;
+    for (index_t d = static_cast<index_t>(rank) - 1; d >= 0; --d) {
+      const index_t coord = remain % output_shape[d];
+      remain /= output_shape[d];
+      a_idx += (a_shape[d] > 1 ? coord : 0) * a_stride;
+      b_idx += (b_shape[d] > 1 ? coord : 0) * b_stride;
+      a_stride *= a_shape[d];
+      b_stride *= b_shape[d];
+    }
+    const float x = a[a_idx];
+    const float y = b[b_idx];
+    float res = 0;
+    switch (type) {
+      case ops::EltwiseType::SUM:
+        res = coeff.empty() ? x + y : x * coeff[0] + y * coeff[1];
+        break;
+      case ops::EltwiseType::SUB:
+        res = x - y;
+        break;
+      case ops::EltwiseType::PROD:
+        res = x * y;
+        break;
+      case ops::EltwiseType::DIV:
+        res = x / y;
+        break;
+      case ops::EltwiseType::MAX:
+        res = std::max(x, y);
+        break;
+      case ops::EltwiseType::SQR_DIFF:
+        res = (x - y) * (x - y);
+        break;
+      case ops::EltwiseType::POW:
+        res = std::pow(x, y);
+        break;
+      default:
+        MACE_NOT_IMPLEMENTED;
+    }
+    expected_data[i] = res;
+  }
+  auto expected = net.CreateTensor<float>(output_shape, expected_data);
+  ExpectTensorNear<float>(*expected, *net.GetOutput("Output"), 1e-5);
+}
+
 void Quantized(const std::vector<index_t> &shape,
                const ops::EltwiseType type) {
   // Construct graph
@@ -817,6 +960,65 @@ void Quantized(const std::vector<index_t> &shape,
   ExpectTensorSimilar<float>(*net.GetOutput("Output"),
                              *net.GetTensor("DequantizedOutput"), 0.01);
 }
+
+void QuantizedScalar(const std::vector<index_t> &shape,
+                     const ops::EltwiseType type,
+                     const float scalar,
+                     const int scalar_input_index) {
+  OpsTestNet net;
+  net.AddRandomInput<DeviceType::CPU, float>("Input", shape, false, false,
+                                             true);
+
+  OpDefBuilder("Eltwise", "EltwiseTest")
+      .Input("Input")
+      .AddIntArg("type", static_cast<int>(type))
+      .AddFloatArg("scalar_input", scalar)
+      .AddIntArg("scalar_input_index", scalar_input_index)
+      .Output("Output")
+      .Finalize(net.NewOperatorDef());
+  net.RunOp(DeviceType::CPU);
+
+  OpDefBuilder("Quantize", "QuantizeInput")
+      .Input("Input")
+      .Output("QuantizedInput")
+      .OutputType({DT_UINT8})
+      .AddIntArg("T", DT_UINT8)
+      .Finalize(net.NewOperatorDef());
+  net.RunOp();
+  OpDefBuilder("Quantize", "QuantizeOutput")
+      .Input("Output")
+      .Output("ExpectedQuantizedOutput")
+      .OutputType({DT_UINT8})
+      .AddIntArg("T", DT_UINT8)
+      .Finalize(net.NewOperatorDef());
+  net.RunOp();
+
+  OpDefBuilder("Eltwise", "QuantizeEltwiseTest")
+      .Input("QuantizedInput")
+      .Output("QuantizedOutput")
+      .AddIntArg("type", static_cast<int>(type))
+      .AddFloatArg("scalar_input", scalar)
+      .AddIntArg("scalar_input_index", scalar_input_index)
+      .AddIntArg("T", static_cast<int>(DT_UINT8))
+      .Finalize(net.NewOperatorDef());
+  net.Setup(DeviceType::CPU);
+  Tensor *eq_output = net.GetTensor("ExpectedQuantizedOutput");
+  Tensor *q_output = net.GetTensor("QuantizedOutput");
+  q_output->SetScale(eq_output->scale());
+  q_output->SetZeroPoint(eq_output->zero_point());
+  net.Run();
+
+  OpDefBuilder("Dequantize", "DeQuantizeTest")
+      .Input("QuantizedOutput")
+      .Output("DequantizedOutput")
+      .OutputType({DT_FLOAT})
+      .AddIntArg("T", DT_UINT8)
+      .Finalize(net.NewOperatorDef());
+  net.RunOp();
+
+  ExpectTensorSimilar<float>(*net.GetOutput("Output"),
+                             *net.GetTensor("DequantizedOutput"), 0.01);
+}
 }  // namespace
 
 TEST_F(EltwiseOpTest, RandomTensorScalarFloat) {
@@ -1010,6 +1212,54 @@ TEST_F(EltwiseOpTest, TensorGeneralBroadcastGPU) {
       {1, 1, 2, 1}, {2, 3}, {1, 1, 2, 5}, {4, 1, 0, 1, 4, 4, 9, 16, 25, 36});
 }
 
+TEST_F(EltwiseOpTest, BroadcastPatternsCPU) {
+  for (ops::EltwiseType type : {ops::EltwiseType::SUM, ops::EltwiseType::SUB,
+                                ops::EltwiseType::PROD, ops::EltwiseType::DIV,
+                                ops::EltwiseType::MAX,
+                                ops::EltwiseType::SQR_DIFF,
+                                ops::EltwiseType::POW}) {
+    // same shape, across several tasks
+    BroadcastPatterns(type, {2, 37, 61, 5}, {2, 37, 61, 5});
+    // row broadcast: a vector along the channels or a row of a matrix
+    BroadcastPatterns(type, {3, 13, 17, 19}, {19});
+    BroadcastPatterns(type, {19}, {3, 13, 17, 19});
+    BroadcastPatterns(type, {64, 300}, {1, 300});
+    // column broadcast: a squeeze-excitation scale and an attention mask
+    BroadcastPatterns(type, {2, 1, 1, 24}, {2, 9, 11, 24});
+    BroadcastPatterns(type, {2, 24, 9, 11}, {2, 24, 1, 1});
+    BroadcastPatterns(type, {8, 1, 123}, {8, 123, 123});
+    BroadcastPatterns(type, {1000, 7}, {1000, 1});
+    // both inputs broadcast
+    BroadcastPatterns(type, {5, 1, 33}, {1, 7, 33});
+    BroadcastPatterns(type, {5, 1}, {1, 4099});
+    // scalar
+    BroadcastPatterns(type, {3, 41, 43}, {1});
+    BroadcastPatterns(type, {1}, {3, 41, 43});
+  }
+  BroadcastPatterns(ops::EltwiseType::SUM, {4, 1, 33}, {4, 12, 33},
+                    {0.5f, -2.f});
+}
+
+TEST_F(EltwiseOpTest, BroadcastPatternsGPU) {
+  for (ops::EltwiseType type : {ops::EltwiseType::SUM, ops::EltwiseType::SUB,
+                                ops::EltwiseType::PROD, ops::EltwiseType::DIV,
+                                ops::EltwiseType::MAX,
+                                ops::EltwiseType::SQR_DIFF}) {
+    // the broadcasts the GPU op took before, on both sides
+    GPUBroadcastPatterns<float>(type, {3, 13, 17, 19}, {1, 1, 1, 19});
+    GPUBroadcastPatterns<float>(type, {2, 1, 1, 24}, {2, 9, 11, 24});
+    GPUBroadcastPatterns<float>(type, {2, 9, 11, 5}, {2, 9, 11, 1});
+    // any dims of 1 of either input
+    GPUBroadcastPatterns<float>(type, {2, 1, 9, 24}, {2, 7, 1, 24});
+    GPUBroadcastPatterns<float>(type, {1, 5, 7, 1}, {1, 1, 1, 6});
+    GPUBroadcastPatterns<float>(type, {3, 1, 17, 13}, {1, 11, 17, 1});
+    GPUBroadcastPatterns<float>(type, {1, 5, 1, 6}, {1, 1, 5, 6});
+    GPUBroadcastPatterns<half>(type, {2, 1, 9, 24}, {2, 7, 1, 24});
+  }
+  GPUBroadcastPatterns<float>(ops::EltwiseType::SUM, {4, 1, 7, 33},
+                              {4, 12, 1, 33}, {0.5f, -2.f});
+}
+
 TEST_F(EltwiseOpTest, Quantized) {
   Quantized({1, 32, 32, 16}, ops::EltwiseType::SUM);
   Quantized({1, 31, 31, 17}, ops::EltwiseType::SUM);
@@ -1017,6 +1267,17 @@ TEST_F(EltwiseOpTest, Quantized) {
   Quantized({1, 31, 31, 17}, ops::EltwiseType::SUB);
 }
 
+TEST_F(EltwiseOpTest, QuantizedScalar) {
+  QuantizedScalar({1, 32, 32, 16}, ops::EltwiseType::SUM, 0.5f, 1);
+  QuantizedScalar({1, 31, 31, 17}, ops::EltwiseType::SUB, 0.5f, 0);
+  QuantizedScalar({1, 31, 31, 17}, ops::EltwiseType::PROD, -2.f, 1);
+  QuantizedScalar({1, 31, 31, 17}, ops::EltwiseType::DIV, 3.f, 1);
+  QuantizedScalar({1, 32, 32, 16}, ops::EltwiseType::MAX, 0.2f, 1);
+  QuantizedScalar({1, 32, 32, 16}, ops::EltwiseType::ABS, 0.f, 1);
+  QuantizedScalar({1, 32, 32, 16}, ops::EltwiseType::SQR_DIFF, 0.3f, 1);
+  QuantizedScalar({1, 32, 32, 16}, ops::EltwiseType::POW, 3.f, 1);
+}
+
 }  // namespace test
 }  // namespace ops
 }  // namespace mace
@@ -20,19 +20,31 @@
 #include "mace/core/operator.h"
 #include "mace/core/tensor.h"
 #include "mace/ops/activation.h"
+#include "mace/ops/common/bfloat16_gemm.h"
+#include "mace/ops/common/weight_only.h"
 
 #ifdef MACE_ENABLE_NEON
 
+#include "mace/ops/arm/fp32/block_sparse.h"
 #include "mace/ops/arm/fp32/gemv.h"
+#include "mace/ops/arm/fp32/weight_only_gemv.h"
 
 #ifdef MACE_ENABLE_QUANTIZE
 #include "mace/ops/arm/q8/gemv.h"
+#include "mace/ops/arm/q8/gemv_8x16.h"
 #endif  // MACE_ENABLE_QUANTIZE
 
+#elif defined(__x86_64__)
+#include "mace/ops/x86/fp32/gemv.h"
 #else
 #include "mace/ops/ref/gemv.h"
 #endif  // MACE_ENABLE_NEON
 
+#ifndef MACE_ENABLE_NEON
+#include "mace/ops/ref/gemv_8x16.h"
+#include "mace/ops/ref/weight_only_gemv.h"
+#endif  // MACE_ENABLE_NEON
+
 #ifdef MACE_ENABLE_OPENCL
 #include "mace/ops/opencl/buffer_transformer.h"
 #include "mace/ops/opencl/image/fully_connected.h"
@@ -69,7 +81,43 @@ template<>
 class FullyConnectedOp<DeviceType::CPU, float> : public FullyConnectedOpBase {
  public:
   explicit FullyConnectedOp(OpConstructContext *context)
-      : FullyConnectedOpBase(context) {}
+      : FullyConnectedOpBase(context),
+        weight_bits_(Operation::GetOptionalArg<int>(kWeightBitsArg, 0)),
+        weight_group_size_(
+            Operation::GetOptionalArg<int>(kWeightGroupSizeArg, 0)),
+        sparse_weight_(nullptr),
+        bf16_weight_(nullptr) {}
+
+  MaceStatus Init(OpInitContext *context) override {
+    MACE_RETURN_IF_ERROR(Operation::Init(context));
+    const Tensor *weight = this->Input(WEIGHT);
+    // the weight converted to bfloat16 for the engine, see
+    // ConvertToCPUBFloat16, packed once concurrently with the others
+    if (weight->dtype() == DT_BFLOAT16) {
+      PackedWeights *packed_weights = context->workspace()->packed_weights();
+      return context->RunOrDefer([this, packed_weights, weight]() {
+        bf16_weight_ = BFloat16Gemm::PackWeight(
+            packed_weights, weight, weight->dim(0),
+            weight->size() / weight->dim(0));
+        return MaceStatus::MACE_SUCCESS;
+      });
+    }
+#ifdef MACE_ENABLE_NEON
+    // pack the nonzero blocks of the pruned weight once, before the first
+    // run, concurrently with the weights of the other ops
+    if (weight->is_weight() &&
+        Operation::GetOptionalArg<int>(arm::fp32::kSparseWeightArg, 0) == 1) {
+      PackedWeights *packed_weights = context->workspace()->packed_weights();
+      return context->RunOrDefer([this, packed_weights, weight]() {
+        sparse_weight_ = arm::fp32::GetBlockSparseWeight(
+            packed_weights, weight, weight->dim(0),
+            weight->size() / weight->dim(0));
+        return MaceStatus::MACE_SUCCESS;
+      });
+    }
+#endif  // MACE_ENABLE_NEON
+    return MaceStatus::MACE_SUCCESS;
+  }
 
   MaceStatus Run(OpContext *context) override {
     MACE_UNUSED(context);
@@ -78,6 +126,25 @@ class FullyConnectedOp<DeviceType::CPU, float> : public FullyConnectedOpBase {
     const Tensor *bias = this->InputSize() >= 3 ? this->Input(BIAS) : nullptr;
     Tensor *output = this->Output(OUTPUT);
 
+    if (weight_bits_ > 0) {
+      MACE_RETURN_IF_ERROR(RunWeightOnly(input, weight, bias, output));
+    } else {
+      MACE_RETURN_IF_ERROR(RunFloat(context, input, weight, bias, output));
+    }
+    Tensor::MappingGuard guard_output(output);
+    float *output_ptr = output->mutable_data<float>();
+    DoActivation(output_ptr, output_ptr, output->size(), activation_,
+                 relux_max_limit_, leakyrelu_coefficient_);
+
+    return MaceStatus::MACE_SUCCESS;
+  }
+
+ private:
+  MaceStatus RunFloat(OpContext *context,
+                      const Tensor *input,
+                      const Tensor *weight,
+                      const Tensor *bias,
+                      Tensor *output) {
     MACE_CHECK(
         input->dim(1) == weight->dim(1) && input->dim(2) == weight->dim(2) &&
             input->dim(3) == weight->dim(3),
@@ -96,30 +163,87 @@ class FullyConnectedOp<DeviceType::CPU, float> : public FullyConnectedOpBase {
     const index_t input_size = weight->dim(1) * weight->dim(2) * weight->dim(3);
     const index_t output_size = weight->dim(0);
 
-    gemv_.Compute(context,
-                  weight,
-                  input,
-                  bias,
-                  batch,
-                  output_size,
-                  input_size,
-                  false,
-                  true,
-                  output);
-    Tensor::MappingGuard guard_output(output);
-    float *output_ptr = output->mutable_data<float>();
-    DoActivation(output_ptr, output_ptr, output->size(), activation_,
-                 relux_max_limit_, leakyrelu_coefficient_);
+    if (bf16_weight_ != nullptr) {
+      Tensor::MappingGuard guard_input(input);
+      Tensor::MappingGuard guard_bias(bias);
+      Tensor::MappingGuard guard_output(output);
+      bf16_gemm_.Compute(bf16_weight_, input->data<float>(), input_size, 1,
+                         bias == nullptr ? nullptr : bias->data<float>(),
+                         output_size, batch, input_size, 1, output_size,
+                         output->mutable_data<float>());
+    } else if (sparse_weight_ != nullptr) {
+#ifdef MACE_ENABLE_NEON
+      Tensor::MappingGuard guard_input(input);
+      Tensor::MappingGuard guard_bias(bias);
+      Tensor::MappingGuard guard_output(output);
+      arm::fp32::BlockSparseGemv(
+          sparse_weight_, output_size, input_size, input->data<float>(),
+          bias == nullptr ? nullptr : bias->data<float>(), batch,
+          output->mutable_data<float>());
+#endif  // MACE_ENABLE_NEON
+    } else {
+      gemv_.Compute(context,
+                    weight,
+                    input,
+                    bias,
+                    batch,
+                    output_size,
+                    input_size,
+                    false,
+                    true,
+                    output);
+    }
+    return MaceStatus::MACE_SUCCESS;
+  }
 
+  // the weight of [output_size, input_size] values of weight_bits_ bits,
+  // dequantized as it is multiplied
+  MaceStatus RunWeightOnly(const Tensor *input,
+                           const Tensor *weight,
+                           const Tensor *bias,
+                           Tensor *output) {
+    const index_t batch = input->dim(0);
+    const index_t input_size = input->size() / batch;
+    WeightOnlyMatrix matrix;
+    MACE_RETURN_IF_ERROR(MakeWeightOnlyMatrix(
+        weight, weight_bits_, weight_group_size_, input_size, &matrix));
+    if (bias) {
+      MACE_CHECK(matrix.rows == bias->dim(0),
+                 "The shape of Weight: ", MakeString(weight->shape()),
+                 " and shape of Bias: ", bias->dim(0),
+                 " don't match.");
+    }
+    MACE_RETURN_IF_ERROR(output->Resize({batch, matrix.rows, 1, 1}));
+    Tensor::MappingGuard guard_input(input);
+    Tensor::MappingGuard guard_weight(weight);
+    Tensor::MappingGuard guard_bias(bias);
+    Tensor::MappingGuard guard_output(output);
+#ifdef MACE_ENABLE_NEON
+    arm::fp32::WeightOnlyGemv(
+#else
+    ref::WeightOnlyGemv(
+#endif  // MACE_ENABLE_NEON
+        matrix, input->data<float>(),
+        bias == nullptr ? nullptr : bias->data<float>(), batch,
+        output->mutable_data<float>());
     return MaceStatus::MACE_SUCCESS;
   }
 
- private:
 #ifdef MACE_ENABLE_NEON
   arm::fp32::Gemv gemv_;
+#elif defined(__x86_64__)
+  x86::fp32::Gemv gemv_;
 #else
   ref::Gemv<float> gemv_;
 #endif  // MACE_ENABLE_NEON
+  // the bits of a weight quantized for the weight-only kernels, 0 if float
+  const int weight_bits_;
+  const int weight_group_size_;
+  // the block-sparse weight, owned by the packed weights of the workspace
+  const float *sparse_weight_;
+  // the bfloat16 weight packed for bf16_gemm_, owned by the packed weights
+  const BFloat16 *bf16_weight_;
+  BFloat16Gemm bf16_gemm_;
 };
 
 #ifdef MACE_ENABLE_QUANTIZE
@@ -177,6 +301,66 @@ class FullyConnectedOp<DeviceType::CPU, uint8_t>
   ref::Gemv<uint8_t> gemv_;
 #endif  // MACE_ENABLE_NEON
 };
+
+// The 8x16 scheme: a uint8 weight, int16 activations quantized around zero
+// and a float output, for the models losing too much accuracy at 8 bits.
+template<>
+class FullyConnectedOp<DeviceType::CPU, int16_t>
+    : public FullyConnectedOpBase {
+ public:
+  explicit FullyConnectedOp(OpConstructContext *context)
+      : FullyConnectedOpBase(context) {}
+
+  MaceStatus Run(OpContext *context) override {
+    MACE_UNUSED(context);
+    const Tensor *input = this->Input(INPUT);
+    const Tensor *weight = this->Input(WEIGHT);  // OIHW
+    const Tensor *bias = this->InputSize() >= 3 ? this->Input(BIAS) : nullptr;
+    Tensor *output = this->Output(OUTPUT);
+
+    const index_t batch = input->dim(0);
+    const index_t input_size = input->size() / batch;
+    const index_t output_size = weight->dim(0);
+    MACE_CHECK(weight->size() == output_size * input_size,
+               "The shape of Input: ", MakeString(input->shape()),
+               "The shape of Weight: ", MakeString(weight->shape()),
+               " don't match.");
+    MACE_CHECK(input->zero_point() == 0,
+               "the int16 input of FullyConnected should be symmetric");
+    if (bias) {
+      MACE_CHECK(weight->dim(0) == bias->dim(0),
+                 "The shape of Weight: ", MakeString(weight->shape()),
+                 " and shape of Bias: ", bias->dim(0),
+                 " don't match.");
+    }
+    MACE_RETURN_IF_ERROR(output->Resize({batch, output_size, 1, 1}));
+    weight_scales_.resize(output_size);
+    for (index_t r = 0; r < output_size; ++r) {
+      weight_scales_[r] = weight->scale(r);
+    }
+
+    Tensor::MappingGuard guard_input(input);
+    Tensor::MappingGuard guard_weight(weight);
+    Tensor::MappingGuard guard_bias(bias);
+    Tensor::MappingGuard guard_output(output);
+    float *output_ptr = output->mutable_data<float>();
+#ifdef MACE_ENABLE_NEON
+    arm::q8::Gemv8x16(
+#else
+    ref::Gemv8x16(
+#endif  // MACE_ENABLE_NEON
+        weight->data<uint8_t>(), weight_scales_.data(), weight->zero_point(),
+        input->data<int16_t>(), input->scale(),
+        bias == nullptr ? nullptr : bias->data<float>(), output_size,
+        input_size, batch, output_ptr);
+    DoActivation(output_ptr, output_ptr, output->size(), activation_,
+                 relux_max_limit_, leakyrelu_coefficient_);
+    return MaceStatus::MACE_SUCCESS;
+  }
+
+ private:
+  std::vector<float> weight_scales_;
+};
 #endif  // MACE_ENABLE_QUANTIZE
 
 #ifdef MACE_ENABLE_OPENCL
@@ -234,6 +418,8 @@ void RegisterFullyConnected(OpRegistryBase *op_registry) {
 #ifdef MACE_ENABLE_QUANTIZE
   MACE_REGISTER_OP(op_registry, "FullyConnected",
                    FullyConnectedOp, DeviceType::CPU, uint8_t);
+  MACE_REGISTER_OP(op_registry, "FullyConnected",
+                   FullyConnectedOp, DeviceType::CPU, int16_t);
 #endif  // MACE_ENABLE_QUANTIZE
 
 #ifdef MACE_ENABLE_OPENCL
@@ -12,7 +12,11 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <cmath>
 #include <fstream>
+#include <random>
+#include <vector>
 
 #include "mace/ops/ops_test_util.h"
 
@@ -184,6 +188,7 @@ TEST_F(FullyConnectedOpTest, ComplexUnAlignedWithoutBatch) {
   Random<float>(1, 13, 11, 11, 17);
   Random<float>(1, 23, 29, 23, 113);
   Random<float>(1, 14, 14, 13, 23);
+  Random<float>(1, 1, 1, 4093, 1001);
 }
 
 TEST_F(FullyConnectedOpTest, ComplexMultiBatch) {
@@ -200,6 +205,187 @@ TEST_F(FullyConnectedOpTest, ComplexHalfWidthFormatAligned) {
   Random<half>(1, 14, 14, 13, 23);
 }
 
+namespace {
+void SparseRandom(const index_t batch,
+                  const index_t channels,
+                  const index_t out_channel,
+                  const float sparsity) {
+  OpsTestNet net;
+  net.AddRandomInput<DeviceType::CPU, float>("Input", {batch, channels, 1, 1});
+  // zero the pruned blocks of 4 input channels
+  std::mt19937 gen(channels);
+  std::uniform_real_distribution<float> dist(0, 1);
+  std::vector<float> weight(out_channel * channels);
+  for (index_t o = 0; o < out_channel; ++o) {
+    for (index_t c = 0; c < channels; c += 4) {
+      const bool pruned = dist(gen) < sparsity;
+      for (index_t i = c; i < std::min<index_t>(c + 4, channels); ++i) {
+        weight[o * channels + i] = pruned ? 0.f : dist(gen) - 0.5f;
+      }
+    }
+  }
+  net.AddInputFromArray<DeviceType::CPU, float>(
+      "Weight", {out_channel, channels, 1, 1}, weight, true);
+  net.AddRandomInput<DeviceType::CPU, float>("Bias", {out_channel}, true);
+
+  OpDefBuilder("FullyConnected", "FullyConnectedTest")
+      .Input("Input")
+      .Input("Weight")
+      .Input("Bias")
+      .Output("Expected")
+      .AddStringArg("activation", "RELU")
+      .Finalize(net.NewOperatorDef());
+  net.RunOp();
+  auto expected = net.CreateTensor<float>();
+  expected->Copy(*net.GetOutput("Expected"));
+
+  OpDefBuilder("FullyConnected", "FullyConnectedTest")
+      .Input("Input")
+      .Input("Weight")
+      .Input("Bias")
+      .Output("Output")
+      .AddStringArg("activation", "RELU")
+      .AddIntArg("sparse_weight", 1)
+      .Finalize(net.NewOperatorDef());
+  net.RunOp();
+  ExpectTensorNear<float>(*expected, *net.GetOutput("Output"), 1e-4, 1e-4);
+}
+}  // namespace
+
+TEST_F(FullyConnectedOpTest, SparseWeight) {
+  SparseRandom(1, 256, 64, 0.8f);
+  SparseRandom(4, 130, 37, 0.7f);
+  SparseRandom(3, 1024, 128, 0.9f);
+}
+
+namespace {
+void WeightOnlyRandom(const index_t batch,
+                      const index_t channels,
+                      const index_t out_channel,
+                      const int bits,
+                      const index_t group_size) {
+  OpsTestNet net;
+  net.AddRandomInput<DeviceType::CPU, float>("Input", {batch, channels, 1, 1});
+  net.AddRandomInput<DeviceType::CPU, float>("Bias", {out_channel}, true);
+
+  // quantize symmetrically per group of a row like the converter, the float
+  // weight is the dequantized one
+  const index_t groups_size = group_size > 0 ? group_size : channels;
+  const index_t groups = (channels + groups_size - 1) / groups_size;
+  const index_t row_bytes = bits == 4 ? (channels + 1) / 2 : channels;
+  const int max_q = (1 << (bits - 1)) - 1;
+  std::mt19937 gen(channels);
+  std::uniform_real_distribution<float> dist(-1, 1);
+  std::vector<float> weight(out_channel * channels);
+  std::vector<uint8_t> quantized_weight(out_channel * row_bytes, 0);
+  std::vector<float> scales(out_channel * groups);
+  for (index_t o = 0; o < out_channel; ++o) {
+    for (index_t g = 0; g < groups; ++g) {
+      const index_t begin = g * groups_size;
+      const index_t end = std::min(channels, begin + groups_size);
+      const float scale = (dist(gen) + 1.5f) / max_q;
+      scales[o * groups + g] = scale;
+      for (index_t c = begin; c < end; ++c) {
+        const int q = static_cast<int>(std::round(dist(gen) * max_q));
+        weight[o * channels + c] = scale * q;
+        const uint8_t value = static_cast<uint8_t>(q + max_q + 1);
+        if (bits == 4) {
+          quantized_weight[o * row_bytes + c / 2] |= value << (c % 2 * 4);
+        } else {
+          quantized_weight[o * row_bytes + c] = value;
+        }
+      }
+    }
+  }
+  net.AddInputFromArray<DeviceType::CPU, float>(
+      "Weight", {out_channel, channels, 1, 1}, weight, true);
+  net.AddInputFromArray<DeviceType::CPU, uint8_t>(
+      "QuantizedWeight", {out_channel, row_bytes}, quantized_weight, true,
+      0.f, max_q + 1);
+  net.GetTensor("QuantizedWeight")->SetScales(scales);
+
+  OpDefBuilder("FullyConnected", "FullyConnectedTest")
+      .Input("Input")
+      .Input("Weight")
+      .Input("Bias")
+      .Output("Expected")
+      .AddStringArg("activation", "RELU")
+      .Finalize(net.NewOperatorDef());
+  net.RunOp();
+  auto expected = net.CreateTensor<float>();
+  expected->Copy(*net.GetOutput("Expected"));
+
+  OpDefBuilder("FullyConnected", "FullyConnectedTest")
+      .Input("Input")
+      .Input("QuantizedWeight")
+      .Input("Bias")
+      .Output("Output")
+      .AddStringArg("activation", "RELU")
+      .AddIntArg("weight_bits", bits)
+      .AddIntArg("weight_group_size", static_cast<int>(group_size))
+      .Finalize(net.NewOperatorDef());
+  net.RunOp();
+  ExpectTensorNear<float>(*expected, *net.GetOutput("Output"), 1e-4, 1e-4);
+}
+}  // namespace
+
+TEST_F(FullyConnectedOpTest, WeightOnly) {
+  WeightOnlyRandom(1, 256, 64, 8, 0);
+  WeightOnlyRandom(3, 131, 37, 8, 0);
+  WeightOnlyRandom(1, 256, 64, 4, 32);
+  WeightOnlyRandom(2, 75, 19, 4, 32);
+  WeightOnlyRandom(1, 31, 5, 4, 0);
+}
+
+namespace {
+void BFloat16Random(const index_t batch,
+                    const index_t channels,
+                    const index_t out_channel) {
+  OpsTestNet net;
+  net.AddRandomInput<DeviceType::CPU, float>("Input", {batch, channels, 1, 1});
+  net.AddRandomInput<DeviceType::CPU, float>("Bias", {out_channel}, true);
+
+  // the float weight is the bfloat16 one, the activations are still rounded
+  std::mt19937 gen(channels);
+  std::uniform_real_distribution<float> dist(-1, 1);
+  std::vector<float> weight(out_channel * channels);
+  std::vector<BFloat16> bf16_weight(out_channel * channels);
+  for (size_t i = 0; i < weight.size(); ++i) {
+    bf16_weight[i] = BFloat16(dist(gen));
+    weight[i] = bf16_weight[i];
+  }
+  net.AddInputFromArray<DeviceType::CPU, float>(
+      "Weight", {out_channel, channels, 1, 1}, weight, true);
+  net.AddInputFromArray<DeviceType::CPU, BFloat16>(
+      "BFloat16Weight", {out_channel, channels, 1, 1}, bf16_weight, true);
+
+  OpDefBuilder("FullyConnected", "FullyConnectedTest")
+      .Input("Input")
+      .Input("Weight")
+      .Input("Bias")
+      .Output("Expected")
+      .Finalize(net.NewOperatorDef());
+  net.RunOp();
+  auto expected = net.CreateTensor<float>();
+  expected->Copy(*net.GetOutput("Expected"));
+
+  OpDefBuilder("FullyConnected", "FullyConnectedTest")
+      .Input("Input")
+      .Input("BFloat16Weight")
+      .Input("Bias")
+      .Output("Output")
+      .Finalize(net.NewOperatorDef());
+  net.RunOp();
+  ExpectTensorNear<float>(*expected, *net.GetOutput("Output"), 1e-2, 1e-1);
+}
+}  // namespace
+
+TEST_F(FullyConnectedOpTest, BFloat16) {
+  BFloat16Random(1, 256, 64);
+  BFloat16Random(3, 131, 37);
+  BFloat16Random(5, 7, 3);
+}
+
 namespace {
 void QuantRandom(const index_t batch,
                  const index_t height,
@@ -301,6 +487,71 @@ TEST_F(FullyConnectedOpTest, Quant) {
   QuantRandom(1, 1, 1, 2048, 1024);
 }
 
+namespace {
+void Quant8x16Random(const index_t batch,
+                     const index_t height,
+                     const index_t width,
+                     const index_t channels,
+                     const index_t out_channel) {
+  // Construct graph
+  OpsTestNet net;
+
+  // Add input data
+  net.AddRandomInput<CPU, float>(
+      "Input", {batch, channels, height, width});
+  net.AddRandomInput<CPU, float>(
+      "Weight", {out_channel, channels, height, width}, true);
+  net.AddRandomInput<CPU, float>("Bias", {out_channel}, true);
+
+  OpDefBuilder("FullyConnected", "FullyConnectedTest")
+      .Input("Input")
+      .Input("Weight")
+      .Input("Bias")
+      .Output("Output")
+      .AddIntArg("T", DT_FLOAT)
+      .Finalize(net.NewOperatorDef());
+  net.RunOp();
+
+  OpDefBuilder("Quantize", "QuantizeWeight")
+      .Input("Weight")
+      .Output("QuantizedWeight")
+      .OutputType({DT_UINT8})
+      .AddIntArg("T", DT_UINT8)
+      .Finalize(net.NewOperatorDef());
+  net.RunOp();
+
+  OpDefBuilder("Quantize", "QuantizeInput")
+      .Input("Input")
+      .Output("QuantizedInput")
+      .OutputType({DT_INT16})
+      .AddIntArg("T", DT_INT16)
+      .AddIntArg("find_range_every_time", 1)
+      .Finalize(net.NewOperatorDef());
+  net.RunOp();
+
+  OpDefBuilder("FullyConnected", "Quantize8x16FullyConnectedTest")
+      .Input("QuantizedInput")
+      .Input("QuantizedWeight")
+      .Input("Bias")
+      .Output("QuantizedOutput")
+      .OutputType({DT_FLOAT})
+      .AddIntArg("T", DT_INT16)
+      .Finalize(net.NewOperatorDef());
+  net.RunOp();
+
+  // Check
+  ExpectTensorSimilar<float>(*net.GetOutput("Output"),
+                             *net.GetTensor("QuantizedOutput"), 1e-3);
+}
+}  // namespace
+
+TEST_F(FullyConnectedOpTest, Quant8x16) {
+  Quant8x16Random(1, 1, 1, 7, 3);
+  Quant8x16Random(3, 1, 1, 440, 1024);
+  Quant8x16Random(2, 7, 7, 32, 16);
+  Quant8x16Random(1, 1, 1, 2500, 256);
+}
+
 }  // namespace test
 }  // namespace ops
 }  // namespace mace
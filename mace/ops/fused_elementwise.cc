@@ -0,0 +1,113 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mace/core/gpu_elementwise_fusion.h"
+#include "mace/core/operator.h"
+#include "mace/ops/activation.h"
+#include "mace/ops/common/eltwise_type.h"
+#include "mace/ops/opencl/buffer_transformer.h"
+#include "mace/ops/opencl/image/fused_elementwise.h"
+#include "mace/utils/memory.h"
+
+namespace mace {
+namespace ops {
+
+// A chain of BiasAdd, Activation and Eltwise ops fused by
+// FuseGPUElementwiseOps, run as one kernel.
+template <DeviceType D, class T>
+class FusedElementwiseOp;
+
+template <typename T>
+class FusedElementwiseOp<DeviceType::GPU, T> : public Operation {
+ public:
+  explicit FusedElementwiseOp(OpConstructContext *context)
+      : Operation(context) {
+    const int step_count = Operation::GetOptionalArg<int>(kFusedStepsArg, 0);
+    MACE_CHECK(step_count > 0, "fused op ", operator_def_->name(),
+               " has no steps");
+    std::vector<FusedElementwiseStep> steps(step_count);
+    for (int i = 0; i < step_count; ++i) {
+      FusedElementwiseStep &step = steps[i];
+      const std::string type = Operation::GetOptionalArg<std::string>(
+          FusedStepArgName(i, "op"), "");
+      step.operand = Operation::GetOptionalArg<int>(
+          FusedStepArgName(i, "operand"), -1);
+      step.swapped = Operation::GetOptionalArg<int>(
+          FusedStepArgName(i, "swapped"), 0) == 1;
+      step.value = 0.f;
+      if (type == "BiasAdd") {
+        step.kind = FUSED_BIAS_ADD;
+        step.type = 0;
+      } else if (type == "Activation") {
+        step.kind = FUSED_ACTIVATION;
+        step.type = StringToActivationType(
+            Operation::GetOptionalArg<std::string>(
+                FusedStepArgName(i, "activation"), "NOOP"));
+        step.value = Operation::GetOptionalArg<float>(
+            FusedStepArgName(i, step.type == RELUX ? "max_limit"
+                                                   : "leakyrelu_coefficient"),
+            0.f);
+      } else if (type == "Eltwise") {
+        step.kind = FUSED_ELTWISE;
+        step.type = Operation::GetOptionalArg<int>(
+            FusedStepArgName(i, "type"),
+            static_cast<int>(EltwiseType::NONE));
+        step.value = Operation::GetOptionalArg<float>(
+            FusedStepArgName(i, "scalar_input"), 1.f);
+      } else {
+        LOG(FATAL) << "Unsupported fused op type: " << type;
+      }
+      // the bias and the PRELU alpha are read as images of the channels
+      if (step.kind != FUSED_ELTWISE && step.operand >= 0) {
+        MACE_CHECK(TransformFilter<T>(
+            context, operator_def_.get(), step.operand,
+            OpenCLBufferType::ARGUMENT, MemoryType::GPU_IMAGE)
+                       == MaceStatus::MACE_SUCCESS);
+      }
+    }
+    if (context->device()->gpu_runtime()->UseImageMemory()) {
+      kernel_ = make_unique<opencl::image::FusedElementwiseKernel<T>>(steps);
+    } else {
+      MACE_NOT_IMPLEMENTED;
+    }
+  }
+  MaceStatus Run(OpContext *context) override {
+    std::vector<const Tensor *> inputs(this->InputSize());
+    for (size_t i = 0; i < inputs.size(); ++i) {
+      inputs[i] = this->Input(i);
+    }
+    Tensor *output = this->Output(0);
+    MACE_RETURN_IF_ERROR(output->ResizeLike(inputs[0]));
+
+    return kernel_->Compute(context, inputs, output);
+  }
+
+ private:
+  std::unique_ptr<OpenCLFusedElementwiseKernel> kernel_;
+};
+
+void RegisterFusedElementwise(OpRegistryBase *op_registry) {
+  MACE_REGISTER_OP(op_registry, "FusedElementwise", FusedElementwiseOp,
+                   DeviceType::GPU, float);
+
+  MACE_REGISTER_OP(op_registry, "FusedElementwise", FusedElementwiseOp,
+                   DeviceType::GPU, half);
+}
+
+}  // namespace ops
+}  // namespace mace
@@ -0,0 +1,147 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/core/gpu_elementwise_fusion.h"
+#include "mace/ops/common/eltwise_type.h"
+#include "mace/ops/ops_test_util.h"
+
+namespace mace {
+namespace ops {
+namespace test {
+
+class FusedElementwiseOpTest : public OpsTestBase {};
+
+namespace {
+
+template <typename T>
+void TestFusedChain(const std::vector<index_t> &shape,
+                    const char *activation) {
+  OpsTestNet net;
+  const DataType dt = DataTypeToEnum<T>::value;
+  net.AddRandomInput<DeviceType::GPU, float>("Input", shape, false, false);
+  net.AddRandomInput<DeviceType::GPU, float>("Other", shape, false, false);
+  net.AddRandomInput<DeviceType::GPU, float>("Bias", {shape[3]}, true);
+  net.AddRandomInput<DeviceType::GPU, float>("Alpha", {shape[3]}, true);
+
+  // BiasAdd -> Activation -> Eltwise(Other - x) -> Eltwise(x * 0.5)
+  NetDef net_def;
+  AddNetInput("Input", shape, &net_def);
+  AddNetInput("Other", shape, &net_def);
+  net_def.add_output_info()->set_name("Output");
+  OpDefBuilder("BiasAdd", "BiasAddTest")
+      .Input("Input")
+      .Input("Bias")
+      .Output("BiasOutput")
+      .OutputShape(shape)
+      .AddIntArg("T", static_cast<int>(dt))
+      .Finalize(net_def.add_op());
+  OpDefBuilder activation_def("Activation", "ActivationTest");
+  activation_def.Input("BiasOutput");
+  if (std::string(activation) == "PRELU") {
+    activation_def.Input("Alpha");
+  }
+  activation_def.Output("ActivationOutput")
+      .OutputShape(shape)
+      .AddStringArg("activation", activation)
+      .AddFloatArg("max_limit", 0.5f)
+      .AddFloatArg("leakyrelu_coefficient", 0.1f)
+      .AddIntArg("T", static_cast<int>(dt))
+      .Finalize(net_def.add_op());
+  OpDefBuilder("Eltwise", "SubTest")
+      .Input("Other")
+      .Input("ActivationOutput")
+      .Output("SubOutput")
+      .OutputShape(shape)
+      .AddIntArg("type", static_cast<int>(EltwiseType::SUB))
+      .AddIntArg("T", static_cast<int>(dt))
+      .Finalize(net_def.add_op());
+  OpDefBuilder("Eltwise", "ProdTest")
+      .Input("SubOutput")
+      .Output("Output")
+      .OutputShape(shape)
+      .AddIntArg("type", static_cast<int>(EltwiseType::PROD))
+      .AddFloatArg("scalar_input", 0.5f)
+      .AddIntArg("T", static_cast<int>(dt))
+      .Finalize(net_def.add_op());
+
+  // run the ops one by one
+  for (auto &op : net_def.op()) {
+    net.NewOperatorDef()->CopyFrom(op);
+    net.RunOp(DeviceType::GPU);
+  }
+  auto expected = net.CreateTensor<float>();
+  expected->Copy(*net.GetOutput("Output"));
+
+  MACE_CHECK(FuseGPUElementwiseOps(net.ws(), &net_def) ==
+      MaceStatus::MACE_SUCCESS);
+  ASSERT_EQ(1, net_def.op_size());
+  EXPECT_EQ(kFusedElementwiseOpType, net_def.op(0).type());
+  net.NewOperatorDef()->CopyFrom(net_def.op(0));
+  net.RunOp(DeviceType::GPU);
+
+  if (dt == DT_HALF) {
+    ExpectTensorNear<float>(*expected, *net.GetOutput("Output"), 1e-2,
+                            1e-2);
+  } else {
+    ExpectTensorNear<float>(*expected, *net.GetOutput("Output"), 1e-5,
+                            1e-4);
+  }
+}
+
+}  // namespace
+
+TEST_F(FusedElementwiseOpTest, ChainOPENCL) {
+  TestFusedChain<float>({1, 17, 23, 32}, "RELUX");
+  TestFusedChain<float>({3, 13, 11, 30}, "PRELU");
+  TestFusedChain<float>({1, 9, 15, 7}, "SIGMOID");
+  TestFusedChain<float>({2, 8, 8, 5}, "LEAKYRELU");
+}
+
+TEST_F(FusedElementwiseOpTest, ChainHalfOPENCL) {
+  TestFusedChain<half>({1, 17, 23, 32}, "RELU");
+  TestFusedChain<half>({3, 13, 11, 30}, "TANH");
+}
+
+TEST_F(FusedElementwiseOpTest, KeepsSharedTensors) {
+  OpsTestNet net;
+  const std::vector<index_t> shape = {1, 8, 8, 16};
+  net.AddRandomInput<DeviceType::CPU, float>("Bias", {16}, true);
+  NetDef net_def;
+  AddNetInput("Input", shape, &net_def);
+  net_def.add_output_info()->set_name("Output");
+  net_def.add_output_info()->set_name("BiasOutput");
+  OpDefBuilder("BiasAdd", "BiasAddTest")
+      .Input("Input")
+      .Input("Bias")
+      .Output("BiasOutput")
+      .OutputShape(shape)
+      .Finalize(net_def.add_op());
+  OpDefBuilder("Activation", "ReluTest")
+      .Input("BiasOutput")
+      .Output("Output")
+      .OutputShape(shape)
+      .AddStringArg("activation", "RELU")
+      .Finalize(net_def.add_op());
+
+  // the output of the net is read, so BiasAdd is not fused away
+  MACE_CHECK(FuseGPUElementwiseOps(net.ws(), &net_def) ==
+      MaceStatus::MACE_SUCCESS);
+  ASSERT_EQ(2, net_def.op_size());
+  EXPECT_EQ("BiasAdd", net_def.op(0).type());
+  EXPECT_EQ("Activation", net_def.op(1).type());
+}
+
+}  // namespace test
+}  // namespace ops
+}  // namespace mace
@@ -13,12 +13,83 @@
 // limitations under the License.
 
 #include <algorithm>
+#include <functional>
+#include <numeric>
+#include <vector>
+
+#if defined(MACE_ENABLE_NEON)
+#include <arm_neon.h>
+#endif
 
 #include "mace/core/operator.h"
 
 namespace mace {
 namespace ops {
 
+namespace {
+
+// the rows of the indices this far ahead are prefetched, the rows of large
+// embedding tables are seldom in the cache
+const index_t kPrefetchDistance = 4;
+
+template <typename SrcType, typename DstType>
+void CopyRow(const SrcType *src, const index_t size, const float scale,
+             const int32_t zero_point, DstType *dst) {
+  MACE_UNUSED(src);
+  MACE_UNUSED(size);
+  MACE_UNUSED(scale);
+  MACE_UNUSED(zero_point);
+  MACE_UNUSED(dst);
+  MACE_NOT_IMPLEMENTED;
+}
+
+template <typename T>
+void CopyRow(const T *src, const index_t size, const float scale,
+             const int32_t zero_point, T *dst) {
+  MACE_UNUSED(scale);
+  MACE_UNUSED(zero_point);
+  memcpy(dst, src, size * sizeof(T));
+}
+
+// the half rows of an fp16 table expanded to float
+void CopyRow(const half *src, const index_t size, const float scale,
+             const int32_t zero_point, float *dst) {
+  MACE_UNUSED(scale);
+  MACE_UNUSED(zero_point);
+  index_t i = 0;
+#if defined(MACE_ENABLE_NEON) && defined(__aarch64__)
+  for (; i + 4 <= size; i += 4) {
+    vst1q_f32(dst + i, vcvt_f32_f16(vreinterpret_f16_u16(
+        vld1_u16(reinterpret_cast<const uint16_t *>(src + i)))));
+  }
+#endif
+  for (; i < size; ++i) {
+    dst[i] = half_float::half_cast<float>(src[i]);
+  }
+}
+
+// the uint8 rows of a quantized table dequantized to float
+void CopyRow(const uint8_t *src, const index_t size, const float scale,
+             const int32_t zero_point, float *dst) {
+  index_t i = 0;
+#if defined(MACE_ENABLE_NEON)
+  const int16x8_t vzero = vdupq_n_s16(static_cast<int16_t>(zero_point));
+  for (; i + 8 <= size; i += 8) {
+    const int16x8_t v = vsubq_s16(
+        vreinterpretq_s16_u16(vmovl_u8(vld1_u8(src + i))), vzero);
+    vst1q_f32(dst + i,
+              vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), scale));
+    vst1q_f32(dst + i + 4,
+              vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), scale));
+  }
+#endif
+  for (; i < size; ++i) {
+    dst[i] = scale * (src[i] - zero_point);
+  }
+}
+
+}  // namespace
+
 template <DeviceType D, class T>
 class GatherOp : public Operation {
  public:
@@ -49,8 +120,34 @@ class GatherOp : public Operation {
     Tensor::MappingGuard indices_guard(indices);
     Tensor::MappingGuard params_guard(params);
     Tensor::MappingGuard output_guard(output);
+    // fp16 and uint8 tables of float ops are kept as they are in the model
+    // and only the gathered rows are expanded
+    const DataType params_type = params->dtype();
+    if (params_type == DataTypeToEnum<T>::value) {
+      Gather(params, params->data<T>(), indices, output);
+    } else if (params_type == DataType::DT_HALF) {
+      Gather(params, params->data<half>(), indices, output);
+    } else if (params_type == DataType::DT_UINT8) {
+      Gather(params, params->data<uint8_t>(), indices, output);
+    } else {
+      MACE_NOT_IMPLEMENTED;
+    }
+
+    if (params_type == DataTypeToEnum<T>::value) {
+      output->SetScale(params->scale());
+      output->SetZeroPoint(params->zero_point());
+    }
+
+    return MaceStatus::MACE_SUCCESS;
+  }
+
+ private:
+  template <typename SrcType>
+  void Gather(const Tensor *params,
+              const SrcType *params_data,
+              const Tensor *indices,
+              Tensor *output) {
     const int32_t *indices_data = indices->data<int32_t>();
-    const T *params_data = params->data<T>();
     T *output_data = output->mutable_data<T>();
 
     index_t axis_dim_size = params->dim(axis_);
@@ -61,26 +158,32 @@ class GatherOp : public Operation {
         std::accumulate(params->shape().begin() + (axis_ + 1),
                         params->shape().end(), 1, std::multiplies<index_t>());
     index_t index_size = indices->size();
+    // the per-channel scales are of the first dim
+    const std::vector<float> &scales = params->scales();
+    const index_t channel_size =
+        params->dim_size() > 0 ? params->size() / params->dim(0) : 1;
+    const float scale = params->scale();
+    const int32_t zero_point = params->zero_point();
 
 #pragma omp parallel for collapse(2) schedule(runtime)
     for (index_t l = 0; l < lhs_size; ++l) {
       for (index_t idx = 0; idx < index_size; ++idx) {
         MACE_ASSERT(indices_data[idx] < axis_dim_size, "idx out of bound: ",
                     indices_data[idx]);
-        memcpy(
-            output_data + ((l * index_size) + idx) * rhs_size,
-            params_data + ((l * axis_dim_size) + indices_data[idx]) * rhs_size,
-            sizeof(T) * rhs_size);
+        if (idx + kPrefetchDistance < index_size) {
+          __builtin_prefetch(
+              params_data + ((l * axis_dim_size)
+                  + indices_data[idx + kPrefetchDistance]) * rhs_size);
+        }
+        const index_t offset =
+            ((l * axis_dim_size) + indices_data[idx]) * rhs_size;
+        CopyRow(params_data + offset, rhs_size,
+                scales.empty() ? scale : scales[offset / channel_size],
+                zero_point, output_data + ((l * index_size) + idx) * rhs_size);
       }
     }
-
-    output->SetScale(params->scale());
-    output->SetZeroPoint(params->zero_point());
-
-    return MaceStatus::MACE_SUCCESS;
   }
 
- private:
   int axis_;
   MACE_OP_INPUT_TAGS(PARAMS, INDICES);
   MACE_OP_OUTPUT_TAGS(OUTPUT);
@@ -88,6 +88,67 @@ TEST_F(GatherOpTest, CPURankHighIndex) {
              {1, 3}, {2, 4, 6}, 0, {1, 3, 2}, {4, 5, 8, 9, 12, 13});
 }
 
+#if defined(MACE_ENABLE_OPENCL) || defined(MACE_ENABLE_FP16_NEON)
+TEST_F(GatherOpTest, CPUHalfTable) {
+  OpsTestNet net;
+  std::vector<half> weight;
+  for (int i = 0; i < 60; ++i) {
+    weight.push_back(half_float::half_cast<half>(i * 0.25f));
+  }
+  net.AddInputFromArray<CPU, half>("Params", {6, 10}, weight, true);
+  net.AddInputFromArray<CPU, int32_t>("Indices", {3}, {4, 0, 4});
+
+  OpDefBuilder("Gather", "GatherTest")
+      .Input("Params")
+      .Input("Indices")
+      .AddIntArg("T", DT_FLOAT)
+      .AddIntArg("axis", 0)
+      .Output("Output")
+      .Finalize(net.NewOperatorDef());
+  net.RunOp(CPU);
+
+  std::vector<float> output;
+  for (int row : {4, 0, 4}) {
+    for (int i = 0; i < 10; ++i) {
+      output.push_back((row * 10 + i) * 0.25f);
+    }
+  }
+  auto expected = net.CreateTensor<float>({3, 10}, output);
+  ExpectTensorNear<float>(*expected, *net.GetOutput("Output"), 1e-5);
+}
+#endif
+
+TEST_F(GatherOpTest, CPUQuantizedTable) {
+  OpsTestNet net;
+  std::vector<uint8_t> weight;
+  for (int i = 0; i < 4 * 19; ++i) {
+    weight.push_back(static_cast<uint8_t>((i * 37) % 256));
+  }
+  const std::vector<float> scales = {0.5f, 0.25f, 2.f, 0.125f};
+  net.AddInputFromArray<CPU, uint8_t>("Params", {4, 19}, weight, true);
+  net.GetTensor("Params")->SetScales(scales);
+  net.GetTensor("Params")->SetZeroPoint(128);
+  net.AddInputFromArray<CPU, int32_t>("Indices", {5}, {3, 1, 2, 0, 1});
+
+  OpDefBuilder("Gather", "GatherTest")
+      .Input("Params")
+      .Input("Indices")
+      .AddIntArg("T", DT_FLOAT)
+      .AddIntArg("axis", 0)
+      .Output("Output")
+      .Finalize(net.NewOperatorDef());
+  net.RunOp(CPU);
+
+  std::vector<float> output;
+  for (int row : {3, 1, 2, 0, 1}) {
+    for (int i = 0; i < 19; ++i) {
+      output.push_back(scales[row] * (weight[row * 19 + i] - 128));
+    }
+  }
+  auto expected = net.CreateTensor<float>({5, 19}, output);
+  ExpectTensorNear<float>(*expected, *net.GetOutput("Output"), 1e-5);
+}
+
 }  // namespace test
 }  // namespace ops
 }  // namespace mace
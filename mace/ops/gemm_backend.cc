@@ -0,0 +1,185 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/ops/gemm_backend.h"
+
+#include "mace/utils/logging.h"
+
+namespace mace {
+namespace ops {
+
+namespace {
+
+void AddBias(const Tensor *bias,
+             const index_t rows,
+             const index_t cols,
+             Tensor *output) {
+  if (bias == nullptr) {
+    return;
+  }
+  Tensor::MappingGuard bias_guard(bias);
+  Tensor::MappingGuard output_guard(output);
+  const float *bias_data = bias->data<float>();
+  float *output_data = output->mutable_data<float>();
+#pragma omp parallel for collapse(2) schedule(runtime)
+  for (index_t i = 0; i < rows; ++i) {
+    for (index_t w = 0; w < cols; ++w) {
+      output_data[i * cols + w] += bias_data[w];
+    }
+  }
+}
+
+}  // namespace
+
+MaceStatus ReferenceGemmBackend::Compute(const OpContext *context,
+                                         const Tensor *lhs,
+                                         const Tensor *rhs,
+                                         const Tensor *bias,
+                                         const index_t batch,
+                                         const index_t rows,
+                                         const index_t cols,
+                                         const index_t depth,
+                                         const MatrixMajor lhs_major,
+                                         const MatrixMajor rhs_major,
+                                         const bool lhs_batched,
+                                         const bool rhs_batched,
+                                         Tensor *output) {
+  MACE_RETURN_IF_ERROR(gemm_.Compute(context, lhs, rhs, batch, rows, cols,
+                                     depth, lhs_major, rhs_major, RowMajor,
+                                     lhs_batched, rhs_batched, output));
+  AddBias(bias, batch * rows, cols, output);
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus PackedGemmBackend::Compute(const OpContext *context,
+                                      const Tensor *lhs,
+                                      const Tensor *rhs,
+                                      const Tensor *bias,
+                                      const index_t batch,
+                                      const index_t rows,
+                                      const index_t cols,
+                                      const index_t depth,
+                                      const MatrixMajor lhs_major,
+                                      const MatrixMajor rhs_major,
+                                      const bool lhs_batched,
+                                      const bool rhs_batched,
+                                      Tensor *output) {
+  if (context != nullptr) {
+    context->device()->scratch_buffer()->Rewind();
+  }
+  MACE_RETURN_IF_ERROR(gemm_.Compute(context, lhs, rhs, batch, rows, cols,
+                                     depth, lhs_major, rhs_major, RowMajor,
+                                     lhs_batched, rhs_batched, output));
+  AddBias(bias, batch * rows, cols, output);
+  return MaceStatus::MACE_SUCCESS;
+}
+
+bool GemvBackend::Supports(const index_t rows,
+                           const index_t cols,
+                           const MatrixMajor lhs_major,
+                           const MatrixMajor rhs_major) const {
+  // the rows of the lhs, or the columns of the rhs, are contiguous
+  return (cols == 1 && lhs_major == RowMajor) ||
+      (rows == 1 && rhs_major == ColMajor);
+}
+
+MaceStatus GemvBackend::Compute(const OpContext *context,
+                                const Tensor *lhs,
+                                const Tensor *rhs,
+                                const Tensor *bias,
+                                const index_t batch,
+                                const index_t rows,
+                                const index_t cols,
+                                const index_t depth,
+                                const MatrixMajor lhs_major,
+                                const MatrixMajor rhs_major,
+                                const bool lhs_batched,
+                                const bool rhs_batched,
+                                Tensor *output) {
+  MACE_CHECK(Supports(rows, cols, lhs_major, rhs_major),
+             "gemv does not support the GEMM of ", rows, "x", depth, " by ",
+             depth, "x", cols);
+  if (cols == 1 && lhs_major == RowMajor) {
+    // the bias of gemv is added to each output of a row, not of a column
+    MACE_RETURN_IF_ERROR(gemv_.Compute(context, lhs, rhs, nullptr, batch,
+                                       rows, depth, lhs_batched, rhs_batched,
+                                       output));
+    AddBias(bias, batch * rows, cols, output);
+    return MaceStatus::MACE_SUCCESS;
+  }
+  // the transposed product of the rows of the rhs by the lhs vector
+  return gemv_.Compute(context, rhs, lhs, bias, batch, cols, depth,
+                       rhs_batched, lhs_batched, output);
+}
+
+GemmDispatcher::GemmDispatcher() {
+  backends_[GEMM_TALL_SKINNY] = {&gemv_, &packed_};
+  backends_[GEMM_SMALL] = {&reference_, &packed_};
+  backends_[GEMM_LARGE] = {&packed_};
+}
+
+GemmShapeClass GemmDispatcher::Classify(const index_t batch,
+                                        const index_t rows,
+                                        const index_t cols,
+                                        const index_t depth) {
+  if (batch * rows * cols * depth <= kSmallGemmMacs) {
+    return GEMM_SMALL;
+  } else if (rows == 1 || cols == 1) {
+    return GEMM_TALL_SKINNY;
+  }
+  return GEMM_LARGE;
+}
+
+GemmBackend *GemmDispatcher::Select(const index_t batch,
+                                    const index_t rows,
+                                    const index_t cols,
+                                    const index_t depth,
+                                    const MatrixMajor lhs_major,
+                                    const MatrixMajor rhs_major) {
+  const GemmShapeClass shape_class = Classify(batch, rows, cols, depth);
+  for (GemmBackend *backend : backends_[shape_class]) {
+    if (backend->Supports(rows, cols, lhs_major, rhs_major)) {
+      return backend;
+    }
+  }
+  return &packed_;
+}
+
+MaceStatus GemmDispatcher::Compute(const OpContext *context,
+                                   const Tensor *lhs,
+                                   const Tensor *rhs,
+                                   const Tensor *bias,
+                                   const index_t batch,
+                                   const index_t rows,
+                                   const index_t cols,
+                                   const index_t depth,
+                                   const MatrixMajor lhs_major,
+                                   const MatrixMajor rhs_major,
+                                   const bool lhs_batched,
+                                   const bool rhs_batched,
+                                   Tensor *output) {
+  MACE_CHECK(bias == nullptr || (bias->dim_size() == 1 &&
+                                 bias->dim(0) == cols),
+             "bias' dim should be <= 2.");
+  GemmBackend *backend =
+      Select(batch, rows, cols, depth, lhs_major, rhs_major);
+  VLOG(3) << "Run the GEMM of " << rows << "x" << depth << " by " << depth
+          << "x" << cols << " on " << backend->name();
+  return backend->Compute(context, lhs, rhs, bias, batch, rows, cols, depth,
+                          lhs_major, rhs_major, lhs_batched, rhs_batched,
+                          output);
+}
+
+}  // namespace ops
+}  // namespace mace
@@ -0,0 +1,223 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_OPS_GEMM_BACKEND_H_
+#define MACE_OPS_GEMM_BACKEND_H_
+
+#include <vector>
+
+#include "mace/core/macros.h"
+#include "mace/core/op_context.h"
+#include "mace/core/tensor.h"
+#include "mace/ops/common/matrix.h"
+#include "mace/public/mace.h"
+
+#ifdef MACE_ENABLE_NEON
+#include "mace/ops/arm/fp32/gemm.h"
+#include "mace/ops/arm/fp32/gemv.h"
+#elif defined(__x86_64__)
+#include "mace/ops/x86/fp32/gemm.h"
+#include "mace/ops/x86/fp32/gemv.h"
+#else
+#include "mace/ops/ref/gemv.h"
+#endif  // MACE_ENABLE_NEON
+
+#include "mace/ops/ref/gemm.h"
+
+namespace mace {
+namespace ops {
+
+// The shape classes of a float GEMM, each run by the backends which suit it.
+enum GemmShapeClass {
+  // a matrix times a vector, of 1 row or 1 column
+  GEMM_TALL_SKINNY = 0,
+  // few multiply-adds, which pay more for packing and threads than they save,
+  // whatever the shape
+  GEMM_SMALL = 1,
+  GEMM_LARGE = 2,
+  GEMM_SHAPE_CLASS_COUNT = 3,
+};
+
+// A float GEMM of the [batch,] rows x depth lhs and depth x cols rhs into
+// the row-major output of [batch, rows, cols], adding the bias of [cols],
+// if any, to each row. The lhs or the rhs not batched is shared by all the
+// matrices of the batch. The output is resized by the caller.
+class GemmBackend {
+ public:
+  virtual ~GemmBackend() {}
+
+  virtual const char *name() const = 0;
+
+  // whether the backend multiplies matrices of these shapes and majors
+  virtual bool Supports(const index_t rows,
+                        const index_t cols,
+                        const MatrixMajor lhs_major,
+                        const MatrixMajor rhs_major) const {
+    MACE_UNUSED(rows);
+    MACE_UNUSED(cols);
+    MACE_UNUSED(lhs_major);
+    MACE_UNUSED(rhs_major);
+    return true;
+  }
+
+  virtual MaceStatus Compute(const OpContext *context,
+                             const Tensor *lhs,
+                             const Tensor *rhs,
+                             const Tensor *bias,
+                             const index_t batch,
+                             const index_t rows,
+                             const index_t cols,
+                             const index_t depth,
+                             const MatrixMajor lhs_major,
+                             const MatrixMajor rhs_major,
+                             const bool lhs_batched,
+                             const bool rhs_batched,
+                             Tensor *output) = 0;
+};
+
+// the plain loops of ref::Gemm, without packing or threads
+class ReferenceGemmBackend : public GemmBackend {
+ public:
+  const char *name() const override { return "reference"; }
+
+  MaceStatus Compute(const OpContext *context,
+                     const Tensor *lhs,
+                     const Tensor *rhs,
+                     const Tensor *bias,
+                     const index_t batch,
+                     const index_t rows,
+                     const index_t cols,
+                     const index_t depth,
+                     const MatrixMajor lhs_major,
+                     const MatrixMajor rhs_major,
+                     const bool lhs_batched,
+                     const bool rhs_batched,
+                     Tensor *output) override;
+
+ private:
+  ref::Gemm<float> gemm_;
+};
+
+// the blocked GEMM of the CPU, packing both operands
+class PackedGemmBackend : public GemmBackend {
+ public:
+  const char *name() const override { return "packed"; }
+
+  MaceStatus Compute(const OpContext *context,
+                     const Tensor *lhs,
+                     const Tensor *rhs,
+                     const Tensor *bias,
+                     const index_t batch,
+                     const index_t rows,
+                     const index_t cols,
+                     const index_t depth,
+                     const MatrixMajor lhs_major,
+                     const MatrixMajor rhs_major,
+                     const bool lhs_batched,
+                     const bool rhs_batched,
+                     Tensor *output) override;
+
+ private:
+#ifdef MACE_ENABLE_NEON
+  arm::fp32::Gemm gemm_;
+#elif defined(__x86_64__)
+  x86::fp32::Gemm gemm_;
+#else
+  ref::Gemm<float> gemm_;
+#endif  // MACE_ENABLE_NEON
+};
+
+// the GEMV of the CPU, for a matrix of contiguous rows times a vector
+class GemvBackend : public GemmBackend {
+ public:
+  const char *name() const override { return "gemv"; }
+
+  bool Supports(const index_t rows,
+                const index_t cols,
+                const MatrixMajor lhs_major,
+                const MatrixMajor rhs_major) const override;
+
+  MaceStatus Compute(const OpContext *context,
+                     const Tensor *lhs,
+                     const Tensor *rhs,
+                     const Tensor *bias,
+                     const index_t batch,
+                     const index_t rows,
+                     const index_t cols,
+                     const index_t depth,
+                     const MatrixMajor lhs_major,
+                     const MatrixMajor rhs_major,
+                     const bool lhs_batched,
+                     const bool rhs_batched,
+                     Tensor *output) override;
+
+ private:
+#ifdef MACE_ENABLE_NEON
+  arm::fp32::Gemv gemv_;
+#elif defined(__x86_64__)
+  x86::fp32::Gemv gemv_;
+#else
+  ref::Gemv<float> gemv_;
+#endif  // MACE_ENABLE_NEON
+};
+
+// Runs each GEMM on the first backend of its shape class which supports
+// its majors, so the ops need not pick a GEMM of their own.
+class GemmDispatcher : public GemmBackend {
+ public:
+  // GEMMs of at most these multiply-adds in all are small
+  static constexpr index_t kSmallGemmMacs = 4096;
+
+  GemmDispatcher();
+
+  const char *name() const override { return "dispatcher"; }
+
+  static GemmShapeClass Classify(const index_t batch,
+                                 const index_t rows,
+                                 const index_t cols,
+                                 const index_t depth);
+
+  GemmBackend *Select(const index_t batch,
+                      const index_t rows,
+                      const index_t cols,
+                      const index_t depth,
+                      const MatrixMajor lhs_major,
+                      const MatrixMajor rhs_major);
+
+  MaceStatus Compute(const OpContext *context,
+                     const Tensor *lhs,
+                     const Tensor *rhs,
+                     const Tensor *bias,
+                     const index_t batch,
+                     const index_t rows,
+                     const index_t cols,
+                     const index_t depth,
+                     const MatrixMajor lhs_major,
+                     const MatrixMajor rhs_major,
+                     const bool lhs_batched,
+                     const bool rhs_batched,
+                     Tensor *output) override;
+
+ private:
+  ReferenceGemmBackend reference_;
+  PackedGemmBackend packed_;
+  GemvBackend gemv_;
+  // the backends of each shape class, in the order of preference
+  std::vector<GemmBackend *> backends_[GEMM_SHAPE_CLASS_COUNT];
+};
+
+}  // namespace ops
+}  // namespace mace
+
+#endif  // MACE_OPS_GEMM_BACKEND_H_
@@ -0,0 +1,112 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <string>
+
+#include "mace/ops/gemm_backend.h"
+#include "mace/ops/ref/gemm.h"
+#include "mace/ops/testing/test_utils.h"
+
+namespace mace {
+namespace ops {
+namespace test {
+
+namespace {
+
+void TestGemmDispatch(const index_t batch,
+                      const index_t rows,
+                      const index_t cols,
+                      const index_t depth,
+                      const MatrixMajor lhs_major,
+                      const MatrixMajor rhs_major,
+                      const bool lhs_batched,
+                      const bool rhs_batched,
+                      const std::string &expected_backend) {
+  Tensor lhs(GetCPUAllocator(), DataType::DT_FLOAT);
+  Tensor rhs(GetCPUAllocator(), DataType::DT_FLOAT);
+  Tensor bias(GetCPUAllocator(), DataType::DT_FLOAT);
+  Tensor output(GetCPUAllocator(), DataType::DT_FLOAT);
+  lhs.Resize({lhs_batched ? batch : 1, rows, depth});
+  rhs.Resize({rhs_batched ? batch : 1, depth, cols});
+  bias.Resize({cols});
+  output.Resize({batch, rows, cols});
+  {
+    Tensor::MappingGuard lhs_guard(&lhs);
+    Tensor::MappingGuard rhs_guard(&rhs);
+    Tensor::MappingGuard bias_guard(&bias);
+    GenerateRandomRealTypeData<float>(lhs.shape(), lhs.mutable_data<float>());
+    GenerateRandomRealTypeData<float>(rhs.shape(), rhs.mutable_data<float>());
+    GenerateRandomRealTypeData<float>(bias.shape(),
+                                      bias.mutable_data<float>());
+  }
+  GemmDispatcher dispatcher;
+  EXPECT_EQ(expected_backend,
+            dispatcher.Select(batch, rows, cols, depth, lhs_major,
+                              rhs_major)->name());
+  dispatcher.Compute(nullptr, &lhs, &rhs, &bias, batch, rows, cols, depth,
+                     lhs_major, rhs_major, lhs_batched, rhs_batched, &output);
+
+  Tensor expected_output(GetCPUAllocator(), DataType::DT_FLOAT);
+  expected_output.Resize({batch, rows, cols});
+  ::mace::ops::ref::Gemm<float> gemm_ref;
+  gemm_ref.Compute(nullptr, &lhs, &rhs, batch, rows, cols, depth, lhs_major,
+                   rhs_major, RowMajor, lhs_batched, rhs_batched,
+                   &expected_output);
+  {
+    Tensor::MappingGuard bias_guard(&bias);
+    Tensor::MappingGuard expected_guard(&expected_output);
+    const float *bias_data = bias.data<float>();
+    float *expected_data = expected_output.mutable_data<float>();
+    for (index_t i = 0; i < batch * rows; ++i) {
+      for (index_t c = 0; c < cols; ++c) {
+        expected_data[i * cols + c] += bias_data[c];
+      }
+    }
+  }
+
+  ExpectTensorNear<float>(expected_output, output);
+}
+
+}  // namespace
+
+TEST(GemmBackendTest, Classify) {
+  EXPECT_EQ(GEMM_SMALL, GemmDispatcher::Classify(1, 8, 8, 8));
+  EXPECT_EQ(GEMM_SMALL, GemmDispatcher::Classify(1, 1, 16, 16));
+  EXPECT_EQ(GEMM_LARGE, GemmDispatcher::Classify(64, 8, 8, 8));
+  EXPECT_EQ(GEMM_TALL_SKINNY, GemmDispatcher::Classify(1, 1, 256, 128));
+  EXPECT_EQ(GEMM_TALL_SKINNY, GemmDispatcher::Classify(1, 256, 1, 128));
+  EXPECT_EQ(GEMM_LARGE, GemmDispatcher::Classify(1, 47, 69, 37));
+}
+
+TEST(GemmBackendTest, Dispatch) {
+  TestGemmDispatch(1, 5, 7, 3, RowMajor, RowMajor, true, true, "reference");
+  TestGemmDispatch(2, 5, 7, 3, ColMajor, ColMajor, true, false, "reference");
+
+  TestGemmDispatch(1, 1, 256, 128, RowMajor, ColMajor, true, true, "gemv");
+  TestGemmDispatch(3, 1, 256, 128, RowMajor, ColMajor, false, true, "gemv");
+  TestGemmDispatch(1, 256, 1, 128, RowMajor, RowMajor, true, true, "gemv");
+  TestGemmDispatch(3, 256, 1, 128, RowMajor, ColMajor, true, false, "gemv");
+  // the vector of the rhs is not contiguous in the gemv of the rhs rows
+  TestGemmDispatch(1, 1, 256, 128, RowMajor, RowMajor, true, true, "packed");
+  TestGemmDispatch(1, 256, 1, 128, ColMajor, RowMajor, true, true, "packed");
+
+  TestGemmDispatch(1, 47, 69, 37, RowMajor, RowMajor, true, true, "packed");
+  TestGemmDispatch(3, 47, 69, 37, ColMajor, ColMajor, true, true, "packed");
+  TestGemmDispatch(3, 47, 69, 37, RowMajor, ColMajor, false, true, "packed");
+}
+
+}  // namespace test
+}  // namespace ops
+}  // namespace mace
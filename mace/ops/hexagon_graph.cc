@@ -0,0 +1,141 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mace/core/operator.h"
+#include "mace/core/runtime/hexagon/hexagon_allocator.h"
+#include "mace/core/runtime/hexagon/hexagon_control_wrapper.h"
+
+namespace mace {
+namespace ops {
+
+// A partition of a quantized net run on the DSP, the other ops of which
+// run on CPU. The graph is set up on the DSP at init, from the converted
+// NetDef of the partition with its const tensors inline. The uint8 inputs
+// and outputs are tensors of the arena of the net, which is shared with the
+// DSP, so they are passed without a copy.
+template <DeviceType D, class T>
+class HexagonGraphOp;
+
+template <>
+class HexagonGraphOp<DeviceType::CPU, uint8_t> : public Operation {
+ public:
+  explicit HexagonGraphOp(OpConstructContext *context)
+      : Operation(context) {
+    const std::string graph =
+        Operation::GetOptionalArg<std::string>(kHexagonGraphArg, "");
+    MACE_CHECK(graph_.ParseFromString(graph),
+               "invalid DSP graph of op ", operator_def_->name());
+  }
+
+  ~HexagonGraphOp() {
+    if (controller_ != nullptr) {
+      MACE_CHECK(controller_->TeardownGraph(), "hexagon teardown error");
+      MACE_CHECK(controller_->Finalize(), "hexagon finalize error");
+    }
+  }
+
+  MaceStatus Init(OpInitContext *context) override {
+    MACE_RETURN_IF_ERROR(Operation::Init(context));
+    // lay the inline const data out as the model data of the graph
+    std::vector<std::string> const_data(graph_.tensors_size());
+    size_t model_data_size = 0;
+    for (int i = 0; i < graph_.tensors_size(); ++i) {
+      ConstTensor *tensor = graph_.mutable_tensors(i);
+      std::string &data = const_data[i];
+      if (tensor->data_type() == DT_FLOAT) {
+        data.assign(
+            reinterpret_cast<const char *>(tensor->float_data().data()),
+            tensor->float_data_size() * sizeof(float));
+        tensor->set_data_size(tensor->float_data_size());
+      } else if (tensor->data_type() == DT_INT32) {
+        data.assign(
+            reinterpret_cast<const char *>(tensor->int32_data().data()),
+            tensor->int32_data_size() * sizeof(int32_t));
+        tensor->set_data_size(tensor->int32_data_size());
+      } else if (tensor->data_type() == DT_UINT8) {
+        data.resize(tensor->int32_data_size());
+        for (int j = 0; j < tensor->int32_data_size(); ++j) {
+          data[j] = static_cast<char>(tensor->int32_data(j));
+        }
+        tensor->set_data_size(tensor->int32_data_size());
+      } else {
+        return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                          "unsupported data type of DSP const tensor " +
+                              tensor->name());
+      }
+      // 4 bytes aligned like the model data of the converter
+      model_data_size = (model_data_size + 3) / 4 * 4;
+      tensor->set_offset(model_data_size);
+      model_data_size += data.size();
+    }
+
+    HexagonAllocator *allocator = GetHexagonAllocator();
+    void *model_data = nullptr;
+    MACE_RETURN_IF_ERROR(allocator->New(std::max<size_t>(model_data_size, 1),
+                                        &model_data));
+    std::unique_ptr<void, std::function<void(void *)>> model_data_guard(
+        model_data, [allocator](void *data) { allocator->Delete(data); });
+    for (int i = 0; i < graph_.tensors_size(); ++i) {
+      ConstTensor *tensor = graph_.mutable_tensors(i);
+      memcpy(static_cast<char *>(model_data) + tensor->offset(),
+             const_data[i].data(), const_data[i].size());
+      tensor->clear_float_data();
+      tensor->clear_int32_data();
+    }
+
+    controller_.reset(new HexagonControlWrapper());
+    MACE_CHECK(controller_->Config(), "hexagon config error");
+    MACE_CHECK(controller_->Init(), "hexagon init error");
+    controller_->SetDebugLevel(
+        static_cast<int>(mace::logging::LogMessage::MinVLogLevel()));
+    MACE_CHECK(controller_->SetupGraph(
+        graph_, static_cast<const unsigned char *>(model_data)),
+               "hexagon setup graph error");
+    if (VLOG_IS_ON(2)) {
+      controller_->PrintGraph();
+    }
+    VLOG(1) << "Set up " << graph_.op_size() << " DSP ops of "
+            << operator_def_->name();
+    return MaceStatus::MACE_SUCCESS;
+  }
+
+  MaceStatus Run(OpContext *context) override {
+    MACE_UNUSED(context);
+    if (!controller_->ExecuteQuantizedGraph(inputs_, outputs_)) {
+      return MaceStatus(MaceStatus::MACE_OUT_OF_RESOURCES,
+                        "failed to execute DSP graph " +
+                            operator_def_->name());
+    }
+    return MaceStatus::MACE_SUCCESS;
+  }
+
+ private:
+  NetDef graph_;
+  std::unique_ptr<HexagonControlWrapper> controller_;
+};
+
+void RegisterHexagonGraph(OpRegistryBase *op_registry) {
+  MACE_REGISTER_OP(op_registry, kHexagonGraphOpType, HexagonGraphOp,
+                   DeviceType::CPU, uint8_t);
+}
+
+}  // namespace ops
+}  // namespace mace
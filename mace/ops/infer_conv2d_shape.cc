@@ -103,12 +103,6 @@ void RegisterInferConv2dShape(OpRegistryBase *op_registry) {
                    InferConv2dShapeOp, DeviceType::CPU, float);
   MACE_REGISTER_OP(op_registry, "InferConv2dShape",
                    InferConv2dShapeOp, DeviceType::CPU, int32_t);
-#ifdef MACE_ENABLE_OPENCL
-  MACE_REGISTER_OP(op_registry, "InferConv2dShape",
-                   InferConv2dShapeOp, DeviceType::GPU, float);
-  MACE_REGISTER_OP(op_registry, "InferConv2dShape",
-                   InferConv2dShapeOp, DeviceType::GPU, half);
-#endif  // MACE_ENABLE_OPENCL
 }
 
 }  // namespace ops
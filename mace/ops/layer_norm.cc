@@ -0,0 +1,263 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#if defined(MACE_ENABLE_NEON)
+#include <arm_neon.h>
+#endif
+
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <numeric>
+#include <set>
+
+#include "mace/core/operator.h"
+#ifdef MACE_ENABLE_OPENCL
+#include "mace/ops/opencl/buffer_transformer.h"
+#include "mace/ops/opencl/image/layer_norm.h"
+#endif  // MACE_ENABLE_OPENCL
+#include "mace/utils/memory.h"
+
+namespace mace {
+namespace ops {
+
+// LayerNorm normalizes the input over its dims from axis on:
+//   output = (input - mean) / sqrt(variance + epsilon) * gamma + beta,
+// gamma and beta being optional tensors of the normalized dims. The mean
+// and the variance are gathered in a single Welford pass.
+class LayerNormOpBase : public Operation {
+ public:
+  explicit LayerNormOpBase(OpConstructContext *context)
+      : Operation(context),
+        epsilon_(Operation::GetOptionalArg<float>("epsilon", 1e-5f)),
+        axis_(Operation::GetOptionalArg<int>("axis", -1)) {}
+
+ protected:
+  // the size of the normalized dims
+  index_t NormalizedSize() {
+    const Tensor *input = this->Input(INPUT);
+    const int axis = axis_ < 0 ? axis_ + input->dim_size() : axis_;
+    MACE_CHECK(axis >= 0 && axis < input->dim_size(), "LayerNorm axis ",
+               axis_, " is out of the rank ", input->dim_size());
+    const index_t size = std::accumulate(input->shape().begin() + axis,
+                                         input->shape().end(), 1,
+                                         std::multiplies<index_t>());
+    for (int i = GAMMA; i < this->InputSize(); ++i) {
+      MACE_CHECK(this->Input(i)->size() == size, "the gamma and beta of ",
+                 "LayerNorm should have the ", size, " normalized values");
+    }
+    return size;
+  }
+
+  const float epsilon_;
+  const int axis_;
+
+  MACE_OP_INPUT_TAGS(INPUT, GAMMA, BETA);
+  MACE_OP_OUTPUT_TAGS(OUTPUT);
+};
+
+template <DeviceType D, class T>
+class LayerNormOp;
+
+template <>
+class LayerNormOp<DeviceType::CPU, float> : public LayerNormOpBase {
+ public:
+  explicit LayerNormOp(OpConstructContext *context)
+      : LayerNormOpBase(context) {}
+
+  MaceStatus Run(OpContext *context) override {
+    MACE_UNUSED(context);
+    const Tensor *input = this->Input(INPUT);
+    const Tensor *gamma = this->InputSize() > GAMMA ? this->Input(GAMMA)
+                                                    : nullptr;
+    const Tensor *beta = this->InputSize() > BETA ? this->Input(BETA)
+                                                  : nullptr;
+    Tensor *output = this->Output(OUTPUT);
+    const index_t inner_size = NormalizedSize();
+    const index_t outer_size = input->size() / inner_size;
+    MACE_RETURN_IF_ERROR(output->ResizeLike(input));
+
+    Tensor::MappingGuard input_guard(input);
+    Tensor::MappingGuard gamma_guard(gamma);
+    Tensor::MappingGuard beta_guard(beta);
+    Tensor::MappingGuard output_guard(output);
+    const float *input_data = input->data<float>();
+    const float *gamma_data = gamma == nullptr ? nullptr
+                                               : gamma->data<float>();
+    const float *beta_data = beta == nullptr ? nullptr : beta->data<float>();
+    float *output_data = output->mutable_data<float>();
+
+#pragma omp parallel for schedule(runtime)
+    for (index_t i = 0; i < outer_size; ++i) {
+      Normalize(input_data + i * inner_size, inner_size, gamma_data,
+                beta_data, output_data + i * inner_size);
+    }
+    return MaceStatus::MACE_SUCCESS;
+  }
+
+ private:
+  // the count, mean and sum of the squared deviations of some values
+  struct Moments {
+    float count;
+    float mean;
+    float m2;
+
+    void Push(const float value) {
+      count += 1.f;
+      const float delta = value - mean;
+      mean += delta / count;
+      m2 += delta * (value - mean);
+    }
+
+    void Merge(const Moments &other) {
+      const float total = count + other.count;
+      if (total > 0.f) {
+        const float delta = other.mean - mean;
+        mean += delta * other.count / total;
+        m2 += other.m2 + delta * delta * count * other.count / total;
+        count = total;
+      }
+    }
+  };
+
+  void Normalize(const float *input, const index_t size,
+                 const float *gamma, const float *beta,
+                 float *output) const {
+    Moments moments = {0.f, 0.f, 0.f};
+    index_t i = 0;
+#if defined(MACE_ENABLE_NEON)
+    // a Welford pass per lane, the lanes merged after
+    float32x4_t vmean = vdupq_n_f32(0.f);
+    float32x4_t vm2 = vdupq_n_f32(0.f);
+    for (; i + 4 <= size; i += 4) {
+      const float32x4_t x = vld1q_f32(input + i);
+      const float32x4_t delta = vsubq_f32(x, vmean);
+      vmean = vmlaq_n_f32(vmean, delta, 4.f / (i + 4));
+      vm2 = vmlaq_f32(vm2, delta, vsubq_f32(x, vmean));
+    }
+    const float lane_count = static_cast<float>(i / 4);
+    moments = {lane_count, vgetq_lane_f32(vmean, 0), vgetq_lane_f32(vm2, 0)};
+    moments.Merge({lane_count, vgetq_lane_f32(vmean, 1),
+                   vgetq_lane_f32(vm2, 1)});
+    moments.Merge({lane_count, vgetq_lane_f32(vmean, 2),
+                   vgetq_lane_f32(vm2, 2)});
+    moments.Merge({lane_count, vgetq_lane_f32(vmean, 3),
+                   vgetq_lane_f32(vm2, 3)});
+#endif
+    for (; i < size; ++i) {
+      moments.Push(input[i]);
+    }
+
+    // output = input * scale + shift
+    const float inv_std = 1.f / std::sqrt(moments.m2 / size + epsilon_);
+    i = 0;
+#if defined(MACE_ENABLE_NEON)
+    if (gamma != nullptr && beta != nullptr) {
+      for (; i + 4 <= size; i += 4) {
+        const float32x4_t scale = vmulq_n_f32(vld1q_f32(gamma + i), inv_std);
+        const float32x4_t shift =
+            vmlaq_n_f32(vld1q_f32(beta + i), scale, -moments.mean);
+        vst1q_f32(output + i, vmlaq_f32(shift, vld1q_f32(input + i), scale));
+      }
+    } else if (gamma == nullptr && beta == nullptr) {
+      const float32x4_t shift = vdupq_n_f32(-moments.mean * inv_std);
+      for (; i + 4 <= size; i += 4) {
+        vst1q_f32(output + i,
+                  vmlaq_n_f32(shift, vld1q_f32(input + i), inv_std));
+      }
+    }
+#endif
+    for (; i < size; ++i) {
+      const float scale = gamma == nullptr ? inv_std : gamma[i] * inv_std;
+      const float shift = (beta == nullptr ? 0.f : beta[i])
+          - moments.mean * scale;
+      output[i] = input[i] * scale + shift;
+    }
+  }
+};
+
+#ifdef MACE_ENABLE_OPENCL
+template <typename T>
+class LayerNormOp<DeviceType::GPU, T> : public LayerNormOpBase {
+ public:
+  explicit LayerNormOp(OpConstructContext *context)
+      : LayerNormOpBase(context) {
+    if (context->device()->gpu_runtime()->UseImageMemory()) {
+      kernel_ = make_unique<opencl::image::LayerNormKernel<T>>();
+    } else {
+      MACE_NOT_IMPLEMENTED;
+    }
+    // gamma and beta are read as images of the channels
+    for (int i = GAMMA; i < operator_def_->input_size(); ++i) {
+      MACE_CHECK(TransformFilter<T>(
+          context, operator_def_.get(), i, OpenCLBufferType::ARGUMENT,
+          MemoryType::GPU_IMAGE) == MaceStatus::MACE_SUCCESS);
+    }
+  }
+
+  MaceStatus Run(OpContext *context) override {
+    const Tensor *input = this->Input(INPUT);
+    MACE_CHECK(NormalizedSize() == input->dim(input->dim_size() - 1),
+               "GPU LayerNorm normalizes the last dim only");
+    Tensor *output = this->Output(OUTPUT);
+    MACE_RETURN_IF_ERROR(output->ResizeLike(input));
+    return kernel_->Compute(
+        context, input,
+        this->InputSize() > GAMMA ? this->Input(GAMMA) : nullptr,
+        this->InputSize() > BETA ? this->Input(BETA) : nullptr,
+        epsilon_, output);
+  }
+
+ private:
+  std::unique_ptr<OpenCLLayerNormKernel> kernel_;
+};
+#endif  // MACE_ENABLE_OPENCL
+
+void RegisterLayerNorm(OpRegistryBase *op_registry) {
+  MACE_REGISTER_OP(op_registry, "LayerNorm", LayerNormOp,
+                   DeviceType::CPU, float);
+
+#ifdef MACE_ENABLE_OPENCL
+  MACE_REGISTER_OP(op_registry, "LayerNorm", LayerNormOp,
+                   DeviceType::GPU, float);
+
+  MACE_REGISTER_OP(op_registry, "LayerNorm", LayerNormOp,
+                   DeviceType::GPU, half);
+#endif  // MACE_ENABLE_OPENCL
+
+  MACE_REGISTER_OP_CONDITION(
+      op_registry,
+      OpConditionBuilder("LayerNorm")
+          .SetDevicePlacerFunc(
+              [](OpConstructContext *context) -> std::set<DeviceType> {
+                // the GPU kernel normalizes the channels of rank 2 or 4
+                // images
+                auto op = context->operator_def();
+                if (op->output_shape_size() != op->output_size()) {
+                  return { DeviceType::CPU, DeviceType::GPU };
+                }
+                const int rank = op->output_shape(0).dims_size();
+                const int axis = ProtoArgHelper::GetOptionalArg<OperatorDef,
+                                                                int>(
+                    *op, "axis", -1);
+                if ((rank != 2 && rank != 4) ||
+                    (axis != -1 && axis != rank - 1)) {
+                  return { DeviceType::CPU };
+                }
+                return { DeviceType::CPU, DeviceType::GPU };
+              }));
+}
+
+}  // namespace ops
+}  // namespace mace
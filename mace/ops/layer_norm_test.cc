@@ -0,0 +1,181 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cmath>
+#include <functional>
+#include <numeric>
+#include <vector>
+
+#include "mace/ops/ops_test_util.h"
+
+namespace mace {
+namespace ops {
+namespace test {
+
+class LayerNormOpTest : public OpsTestBase {};
+
+namespace {
+void SimpleTest(const bool use_gamma, const bool use_beta) {
+  OpsTestNet net;
+
+  net.AddInputFromArray<CPU, float>("Input", {2, 4},
+                                    {1, 2, 3, 4, -2, 0, 2, 8});
+  net.AddInputFromArray<CPU, float>("Gamma", {4}, {1, 2, 0.5, -1}, true);
+  net.AddInputFromArray<CPU, float>("Beta", {4}, {0, 1, -1, 2}, true);
+
+  auto builder = OpDefBuilder("LayerNorm", "LayerNormTest").Input("Input");
+  if (use_gamma) {
+    builder.Input("Gamma");
+  }
+  if (use_beta) {
+    builder.Input("Beta");
+  }
+  builder.Output("Output")
+      .AddFloatArg("epsilon", 0.f)
+      .Finalize(net.NewOperatorDef());
+  net.RunOp(CPU);
+
+  // the rows normalized to [-3, -1, 1, 3] / sqrt(5) and [-1, -0.5, 0, 1.5]
+  const float a = 1.f / std::sqrt(5.f);
+  const float b = 1.f / std::sqrt(0.875f);
+  std::vector<float> expected = {-3 * a, -a, a, 3 * a,
+                                 -b, -0.5f * b, 0, 1.5f * b};
+  const std::vector<float> gamma = {1, 2, 0.5, -1};
+  const std::vector<float> beta = {0, 1, -1, 2};
+  for (size_t i = 0; i < expected.size(); ++i) {
+    if (use_gamma) {
+      expected[i] *= gamma[i % 4];
+    }
+    if (use_beta) {
+      expected[i] += beta[i % 4];
+    }
+  }
+  auto expected_tensor = net.CreateTensor<float>({2, 4}, expected);
+  ExpectTensorNear<float>(*expected_tensor, *net.GetOutput("Output"), 1e-5,
+                          1e-5);
+}
+
+void RandomTest(const std::vector<index_t> &shape, const int axis) {
+  OpsTestNet net;
+
+  const int rank = static_cast<int>(shape.size());
+  const int begin = axis < 0 ? axis + rank : axis;
+  const index_t inner_size = std::accumulate(shape.begin() + begin,
+                                             shape.end(), 1,
+                                             std::multiplies<index_t>());
+  net.AddRandomInput<CPU, float>("Input", shape, false, false);
+  net.AddRandomInput<CPU, float>("Gamma", {inner_size}, true, false);
+  net.AddRandomInput<CPU, float>("Beta", {inner_size}, true, false);
+
+  OpDefBuilder("LayerNorm", "LayerNormTest")
+      .Input("Input")
+      .Input("Gamma")
+      .Input("Beta")
+      .Output("Output")
+      .AddIntArg("axis", axis)
+      .AddFloatArg("epsilon", 1e-5f)
+      .Finalize(net.NewOperatorDef());
+  net.RunOp(CPU);
+
+  // the two pass mean and variance in double
+  const Tensor *input = net.GetTensor("Input");
+  const float *input_data = input->data<float>();
+  const float *gamma = net.GetTensor("Gamma")->data<float>();
+  const float *beta = net.GetTensor("Beta")->data<float>();
+  std::vector<float> expected(input->size());
+  for (index_t i = 0; i < input->size(); i += inner_size) {
+    const float *row = input_data + i;
+    double mean = 0;
+    for (index_t j = 0; j < inner_size; ++j) {
+      mean += row[j];
+    }
+    mean /= inner_size;
+    double variance = 0;
+    for (index_t j = 0; j < inner_size; ++j) {
+      variance += (row[j] - mean) * (row[j] - mean);
+    }
+    variance /= inner_size;
+    for (index_t j = 0; j < inner_size; ++j) {
+      expected[i + j] = static_cast<float>(
+          (row[j] - mean) / std::sqrt(variance + 1e-5) * gamma[j] + beta[j]);
+    }
+  }
+  auto expected_tensor = net.CreateTensor<float>(shape, expected);
+  ExpectTensorNear<float>(*expected_tensor, *net.GetOutput("Output"), 1e-4,
+                          1e-4);
+}
+
+template <typename T>
+void OpenCLTest(const std::vector<index_t> &shape) {
+  OpsTestNet net;
+
+  const index_t channels = shape.back();
+  net.AddRandomInput<GPU, float>("Input", shape, false, false);
+  net.AddRandomInput<GPU, float>("Gamma", {channels}, true, false);
+  net.AddRandomInput<GPU, float>("Beta", {channels}, true, false);
+
+  OpDefBuilder("LayerNorm", "LayerNormTest")
+      .Input("Input")
+      .Input("Gamma")
+      .Input("Beta")
+      .Output("Output")
+      .Finalize(net.NewOperatorDef());
+  net.RunOp(CPU);
+  auto expected = net.CreateTensor<float>();
+  expected->Copy(*net.GetOutput("Output"));
+
+  OpDefBuilder("LayerNorm", "LayerNormTest")
+      .Input("Input")
+      .Input("Gamma")
+      .Input("Beta")
+      .Output("Output")
+      .AddIntArg("T", static_cast<int>(DataTypeToEnum<T>::value))
+      .Finalize(net.NewOperatorDef());
+  net.RunOp(GPU);
+
+  if (DataTypeToEnum<T>::value == DT_FLOAT) {
+    ExpectTensorNear<float>(*expected, *net.GetOutput("Output"), 1e-4, 1e-4);
+  } else {
+    ExpectTensorNear<float>(*expected, *net.GetOutput("Output"), 1e-2, 1e-2);
+  }
+}
+}  // namespace
+
+TEST_F(LayerNormOpTest, CPUSimple) {
+  SimpleTest(false, false);
+  SimpleTest(true, false);
+  SimpleTest(true, true);
+}
+
+TEST_F(LayerNormOpTest, CPURandom) {
+  RandomTest({3, 17, 768}, -1);
+  RandomTest({2, 5, 33}, 2);
+  RandomTest({2, 5, 6, 7}, 2);
+  RandomTest({4, 3}, -1);
+}
+
+TEST_F(LayerNormOpTest, OPENCLFloat) {
+  OpenCLTest<float>({4, 768});
+  OpenCLTest<float>({2, 3, 5, 30});
+  OpenCLTest<float>({1, 1, 7, 3});
+}
+
+TEST_F(LayerNormOpTest, OPENCLHalf) {
+  OpenCLTest<half>({4, 768});
+  OpenCLTest<half>({2, 3, 5, 30});
+}
+
+}  // namespace test
+}  // namespace ops
+}  // namespace mace
@@ -13,12 +13,27 @@
 // limitations under the License.
 
 #include <algorithm>
+#include <cmath>
 #include <memory>
+#include <vector>
 
 #include "mace/core/operator.h"
+#include "mace/ops/gemm_backend.h"
+#include "mace/utils/memory.h"
+
+#ifdef MACE_ENABLE_NEON
+#include "mace/ops/arm/common_neon.h"
+#include "mace/ops/arm/fp32/gemv.h"
+#elif defined(__x86_64__)
+#include "mace/ops/x86/fp32/gemv.h"
+#else
+#include "mace/ops/ref/gemv.h"
+#endif  // MACE_ENABLE_NEON
+
+#ifdef MACE_ENABLE_OPENCL
 #include "mace/ops/opencl/buffer_transformer.h"
 #include "mace/ops/opencl/image/lstm_cell.h"
-#include "mace/utils/memory.h"
+#endif  // MACE_ENABLE_OPENCL
 
 namespace mace {
 namespace ops {
@@ -26,6 +41,203 @@ namespace ops {
 template <DeviceType D, class T>
 class LSTMCellOp;
 
+// The input is one step of [batch, input_size] or a sequence of
+// [timesteps, batch, input_size], whose input projections are computed by
+// one gemm before the recurrent gemv of every step. The output holds the
+// hidden state of every step and the cell the one of the last step.
+// With "stateful", the states are kept across runs and the pre output and
+// pre cell inputs are only the initial states, used again after ResetState.
+template <>
+class LSTMCellOp<DeviceType::CPU, float> : public Operation {
+ public:
+  explicit LSTMCellOp(OpConstructContext *context)
+      : Operation(context),
+        forget_bias_(Operation::GetOptionalArg<float>("scalar_input", 0.0)),
+        stateful_(Operation::GetOptionalArg<int>("stateful", 0) != 0),
+        has_state_(false),
+        weight_(nullptr) {}
+
+  MaceStatus Run(OpContext *context) override {
+    const Tensor *input = this->Input(INPUT);
+    const Tensor *weight = this->Input(WEIGHT);
+    const Tensor *bias = this->Input(BIAS);
+    Tensor *cell = this->Output(CELL);
+    Tensor *output = this->Output(OUTPUT);
+    MACE_CHECK(input->dim_size() == 2 || input->dim_size() == 3,
+               "LSTMCell's input should be 2D or 3D, but got ",
+               input->dim_size(), "D");
+    const bool is_sequence = input->dim_size() == 3;
+    const index_t steps = is_sequence ? input->dim(0) : 1;
+    const index_t batch = input->dim(input->dim_size() - 2);
+    const index_t input_size = input->dim(input->dim_size() - 1);
+    MACE_CHECK(weight->dim_size() == 2 && weight->dim(1) % 4 == 0,
+               "LSTMCell's weight should be [input + units, 4 * units]");
+    const index_t units = weight->dim(1) / 4;
+    MACE_CHECK(weight->dim(0) == input_size + units &&
+                   bias->dim_size() == 1 && bias->dim(0) == 4 * units,
+               "LSTMCell's weight or bias doesn't match the input");
+    if (weight != weight_) {
+      SplitWeight(weight, input_size, units);
+    }
+
+    if (!stateful_ || !has_state_) {
+      MACE_RETURN_IF_ERROR(InitState(this->Input(PRE_OUTPUT), &h_state_,
+                                     batch, units));
+      MACE_RETURN_IF_ERROR(InitState(this->Input(PRE_CELL), &c_state_,
+                                     batch, units));
+      has_state_ = true;
+    }
+    MACE_CHECK(h_state_.dim(0) == batch,
+               "LSTMCell's batch changed from ", h_state_.dim(0), " to ",
+               batch, ", reset the state first");
+
+    std::vector<index_t> output_shape = {batch, units};
+    if (is_sequence) {
+      output_shape.insert(output_shape.begin(), steps);
+    }
+    MACE_RETURN_IF_ERROR(output->Resize(output_shape));
+    MACE_RETURN_IF_ERROR(cell->Resize({batch, units}));
+    MACE_RETURN_IF_ERROR(input_gates_.Resize({steps * batch, 4 * units}));
+    MACE_RETURN_IF_ERROR(recurrent_gates_.Resize({batch, 4 * units}));
+
+    // the input projection of all the steps at once
+    MACE_RETURN_IF_ERROR(gemm_.Compute(context, input, &input_weight_,
+                                       nullptr, 1, steps * batch, 4 * units,
+                                       input_size, RowMajor, RowMajor, false,
+                                       false, &input_gates_));
+
+    const float *input_gates = input_gates_.data<float>();
+    const float *recurrent_gates = recurrent_gates_.data<float>();
+    float *h_data = h_state_.mutable_data<float>();
+    float *c_data = c_state_.mutable_data<float>();
+    float *output_data = output->mutable_data<float>();
+    for (index_t t = 0; t < steps; ++t) {
+      MACE_RETURN_IF_ERROR(gemv_.Compute(context, &recurrent_weight_,
+                                         &h_state_, bias, batch, 4 * units,
+                                         units, false, true,
+                                         &recurrent_gates_));
+#pragma omp parallel for schedule(runtime)
+      for (index_t b = 0; b < batch; ++b) {
+        const float *x_gates = input_gates + (t * batch + b) * 4 * units;
+        const float *h_gates = recurrent_gates + b * 4 * units;
+        float *h = h_data + b * units;
+        float *c = c_data + b * units;
+        float *out = output_data + (t * batch + b) * units;
+        index_t u = 0;
+#if defined(MACE_ENABLE_NEON)
+        const float32x4_t vforget_bias = vdupq_n_f32(forget_bias_);
+        for (; u + 4 <= units; u += 4) {
+          const float32x4_t in_gate = neon_vsigmoidq_f32(
+              vaddq_f32(vld1q_f32(x_gates + u), vld1q_f32(h_gates + u)));
+          const float32x4_t new_input = neon_vtanhq_f32(
+              vaddq_f32(vld1q_f32(x_gates + units + u),
+                        vld1q_f32(h_gates + units + u)));
+          const float32x4_t forget_gate = neon_vsigmoidq_f32(vaddq_f32(
+              vaddq_f32(vld1q_f32(x_gates + 2 * units + u),
+                        vld1q_f32(h_gates + 2 * units + u)),
+              vforget_bias));
+          const float32x4_t out_gate = neon_vsigmoidq_f32(
+              vaddq_f32(vld1q_f32(x_gates + 3 * units + u),
+                        vld1q_f32(h_gates + 3 * units + u)));
+          const float32x4_t new_c = vmlaq_f32(
+              vmulq_f32(in_gate, new_input), forget_gate, vld1q_f32(c + u));
+          const float32x4_t new_h = vmulq_f32(out_gate,
+                                              neon_vtanhq_f32(new_c));
+          vst1q_f32(c + u, new_c);
+          vst1q_f32(h + u, new_h);
+          vst1q_f32(out + u, new_h);
+        }
+#endif  // MACE_ENABLE_NEON
+        for (; u < units; ++u) {
+          const float in_gate = Sigmoid(x_gates[u] + h_gates[u]);
+          const float new_input =
+              std::tanh(x_gates[units + u] + h_gates[units + u]);
+          const float forget_gate = Sigmoid(
+              x_gates[2 * units + u] + h_gates[2 * units + u] + forget_bias_);
+          const float out_gate =
+              Sigmoid(x_gates[3 * units + u] + h_gates[3 * units + u]);
+          c[u] = in_gate * new_input + forget_gate * c[u];
+          h[u] = out_gate * std::tanh(c[u]);
+          out[u] = h[u];
+        }
+      }
+    }
+    memcpy(cell->mutable_data<float>(), c_data,
+           batch * units * sizeof(float));
+
+    return MaceStatus::MACE_SUCCESS;
+  }
+
+  void ResetState() override {
+    has_state_ = false;
+  }
+
+  bool AlwaysRuns() const override { return true; }
+
+ private:
+  static float Sigmoid(const float x) {
+    return 1.f / (1.f + std::exp(-x));
+  }
+
+  // the input part of the weight as is and the transposed recurrent part,
+  // the lhs of the gemv
+  void SplitWeight(const Tensor *weight,
+                   const index_t input_size,
+                   const index_t units) {
+    MACE_CHECK(input_weight_.Resize({input_size, 4 * units}) ==
+        MaceStatus::MACE_SUCCESS);
+    MACE_CHECK(recurrent_weight_.Resize({4 * units, units}) ==
+        MaceStatus::MACE_SUCCESS);
+    const float *weight_data = weight->data<float>();
+    memcpy(input_weight_.mutable_data<float>(), weight_data,
+           input_size * 4 * units * sizeof(float));
+    float *recurrent_data = recurrent_weight_.mutable_data<float>();
+    for (index_t u = 0; u < units; ++u) {
+      const float *row = weight_data + (input_size + u) * 4 * units;
+      for (index_t g = 0; g < 4 * units; ++g) {
+        recurrent_data[g * units + u] = row[g];
+      }
+    }
+    weight_ = weight;
+  }
+
+  static MaceStatus InitState(const Tensor *init,
+                              Tensor *state,
+                              const index_t batch,
+                              const index_t units) {
+    MACE_CHECK(init->size() == batch * units,
+               "LSTMCell's initial state should be [", batch, ", ", units,
+               "]");
+    MACE_RETURN_IF_ERROR(state->Resize({batch, units}));
+    memcpy(state->mutable_data<float>(), init->data<float>(),
+           batch * units * sizeof(float));
+    return MaceStatus::MACE_SUCCESS;
+  }
+
+ private:
+  float forget_bias_;
+  bool stateful_;
+  bool has_state_;
+  const Tensor *weight_;
+  Tensor input_weight_;
+  Tensor recurrent_weight_;
+  Tensor input_gates_;
+  Tensor recurrent_gates_;
+  Tensor h_state_;
+  Tensor c_state_;
+  GemmDispatcher gemm_;
+#ifdef MACE_ENABLE_NEON
+  arm::fp32::Gemv gemv_;
+#elif defined(__x86_64__)
+  x86::fp32::Gemv gemv_;
+#else
+  ref::Gemv<float> gemv_;
+#endif  // MACE_ENABLE_NEON
+
+  MACE_OP_INPUT_TAGS(INPUT, PRE_OUTPUT, WEIGHT, BIAS, PRE_CELL);
+  MACE_OP_OUTPUT_TAGS(CELL, OUTPUT);
+};
+
 #ifdef MACE_ENABLE_OPENCL
 template <typename T>
 class LSTMCellOp<DeviceType::GPU, T> : public Operation {
@@ -35,6 +247,8 @@ class LSTMCellOp<DeviceType::GPU, T> : public Operation {
     T forget_bias = static_cast<T>(
         Operation::GetOptionalArg<float>("scalar_input",
                                          0.0));
+    MACE_CHECK(Operation::GetOptionalArg<int>("stateful", 0) == 0,
+               "Stateful LSTMCell is only supported on CPU");
     MemoryType mem_type = MemoryType::GPU_IMAGE;
     if (context->device()->gpu_runtime()->UseImageMemory()) {
       kernel_ = make_unique<opencl::image::LSTMCellKernel<T>>(forget_bias);
@@ -93,11 +307,16 @@ class LSTMCellOp<DeviceType::GPU, T> : public Operation {
 #endif
 
 void RegisterLSTMCell(OpRegistryBase *op_registry) {
+  MACE_REGISTER_OP(op_registry, "LSTMCell", LSTMCellOp,
+                   DeviceType::CPU, float);
+
+#ifdef MACE_ENABLE_OPENCL
   MACE_REGISTER_OP(op_registry, "LSTMCell", LSTMCellOp,
                    DeviceType::GPU, float);
 
   MACE_REGISTER_OP(op_registry, "LSTMCell", LSTMCellOp,
                    DeviceType::GPU, half);
+#endif  // MACE_ENABLE_OPENCL
 }
 
 }  // namespace ops
@@ -79,6 +79,140 @@ void TestLSTMCell(const uint32_t &batch,
 }
 }  // namespace
 
+TEST_F(LSTMCellTest, CPURandomFloat) {
+  TestLSTMCell<CPU, float>(1, 3, 8, 0.0f);
+  TestLSTMCell<CPU, float>(2, 16, 24, 0.0f);
+  TestLSTMCell<CPU, float>(2, 200, 280, 0.5f);
+}
+
+TEST_F(LSTMCellTest, CPUStatefulSequence) {
+  const index_t steps = 5;
+  const index_t batch = 2;
+  const index_t input_size = 7;
+  const index_t units = 8;
+  OpsTestNet net;
+  net.AddRandomInput<CPU, float>("Input", {steps, batch, input_size});
+  net.AddRandomInput<CPU, float>("PreOutput", {batch, units}, true);
+  net.AddRandomInput<CPU, float>("Weight", {input_size + units, 4 * units},
+                                 true);
+  net.AddRandomInput<CPU, float>("Bias", {4 * units}, true);
+  net.AddRandomInput<CPU, float>("PreCell", {batch, units}, true);
+
+  // the whole sequence in one run
+  OpDefBuilder("LSTMCell", "LSTMCellTest")
+      .Input("Input")
+      .Input("PreOutput")
+      .Input("Weight")
+      .Input("Bias")
+      .Input("PreCell")
+      .AddFloatArg("scalar_input", 0.5f)
+      .Output("Cell")
+      .Output("Output")
+      .Finalize(net.NewOperatorDef());
+  net.RunOp(CPU);
+  Tensor expected_cell, expected_output;
+  expected_cell.Copy(*net.GetOutput("Cell"));
+  expected_output.Copy(*net.GetOutput("Output"));
+
+  // streamed as two steps and three steps, twice with a reset in between
+  const float *input_data = net.GetTensor("Input")->data<float>();
+  const float *expected_data = expected_output.data<float>();
+  net.AddInputFromArray<CPU, float>(
+      "Step", {2, batch, input_size},
+      std::vector<float>(input_data, input_data + 2 * batch * input_size));
+  OpDefBuilder("LSTMCell", "LSTMCellTest")
+      .Input("Step")
+      .Input("PreOutput")
+      .Input("Weight")
+      .Input("Bias")
+      .Input("PreCell")
+      .AddFloatArg("scalar_input", 0.5f)
+      .AddIntArg("stateful", 1)
+      .Output("StreamCell")
+      .Output("StreamOutput")
+      .Finalize(net.NewOperatorDef());
+  net.Setup(CPU);
+  for (int pass = 0; pass < 2; ++pass) {
+    index_t begin = 0;
+    for (index_t chunk : {2, 3}) {
+      net.AddInputFromArray<CPU, float>(
+          "Step", {chunk, batch, input_size},
+          std::vector<float>(input_data + begin * batch * input_size,
+                             input_data + (begin + chunk) * batch *
+                                 input_size));
+      net.Run();
+      const Tensor *output = net.GetOutput("StreamOutput");
+      ASSERT_EQ(chunk * batch * units, output->size());
+      for (index_t i = 0; i < output->size(); ++i) {
+        EXPECT_NEAR(expected_data[begin * batch * units + i],
+                    output->data<float>()[i], 1e-5);
+      }
+      begin += chunk;
+    }
+    ExpectTensorNear<float>(expected_cell, *net.GetOutput("StreamCell"),
+                            1e-5);
+    net.ResetStates();
+  }
+}
+
+namespace {
+void TestLSTMSequence(const index_t steps,
+                      const index_t batch,
+                      const index_t input_size,
+                      const index_t units) {
+  OpsTestNet net;
+  net.AddRandomInput<GPU, float>("Input", {steps, batch, input_size});
+  net.AddRandomInput<GPU, float>("PreOutput", {batch, units}, true);
+  net.AddRandomInput<GPU, float>("Weight", {input_size + units, 4 * units},
+                                 true);
+  net.AddRandomInput<GPU, float>("Bias", {4 * units}, true);
+  net.AddRandomInput<GPU, float>("PreCell", {batch, units}, true);
+
+  net.CopyData<DeviceType::CPU, float>("Input", "InputCPU");
+  net.CopyData<DeviceType::CPU, float>("PreOutput", "PreOutputCPU");
+  net.CopyData<DeviceType::CPU, float>("Weight", "WeightCPU");
+  net.CopyData<DeviceType::CPU, float>("Bias", "BiasCPU");
+  net.CopyData<DeviceType::CPU, float>("PreCell", "PreCellCPU");
+
+  OpDefBuilder("LSTMCell", "LSTMCellTest")
+      .Input("InputCPU")
+      .Input("PreOutputCPU")
+      .Input("WeightCPU")
+      .Input("BiasCPU")
+      .Input("PreCellCPU")
+      .AddFloatArg("scalar_input", 0.5f)
+      .Output("CellCPU")
+      .Output("OutputCPU")
+      .Finalize(net.NewOperatorDef());
+  net.RunOp(CPU);
+
+  OpDefBuilder("LSTMCell", "LSTMCellTest")
+      .Input("Input")
+      .Input("PreOutput")
+      .Input("Weight")
+      .Input("Bias")
+      .Input("PreCell")
+      .AddFloatArg("scalar_input", 0.5f)
+      .Output("Cell")
+      .Output("Output")
+      .Finalize(net.NewOperatorDef());
+  net.RunOp(GPU);
+
+  ExpectTensorNear<float>(*net.GetOutput("CellCPU"), *net.GetOutput("Cell"),
+                          1e-5);
+  ExpectTensorNear<float>(*net.GetOutput("OutputCPU"),
+                          *net.GetOutput("Output"), 1e-5);
+}
+}  // namespace
+
+TEST_F(LSTMCellTest, OPENCLSequence) {
+  TestLSTMSequence(1, 1, 3, 8);
+  TestLSTMSequence(5, 2, 16, 24);
+  TestLSTMSequence(13, 3, 200, 280);
+  // the states don't fit local memory
+  TestLSTMSequence(3, 20, 320, 1024);
+}
+
 TEST_F(LSTMCellTest, OPENCLRandomHalf) {
   TestLSTMCell<GPU, half>(1, 3, 8, 0.0f);
   TestLSTMCell<GPU, half>(2, 16, 24, 0.0f);
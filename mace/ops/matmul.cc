@@ -21,20 +21,29 @@
 
 #include "mace/core/operator.h"
 #include "mace/core/tensor.h"
+#include "mace/ops/common/bfloat16_gemm.h"
+#include "mace/ops/common/weight_only.h"
+#include "mace/ops/gemm_backend.h"
 #include "mace/ops/sgemm.h"
 #include "mace/utils/utils.h"
 
 #ifdef MACE_ENABLE_NEON
 #include "mace/ops/arm/fp32/gemm.h"
-#include "mace/ops/arm/fp32/gemv.h"
+#include "mace/ops/arm/fp32/weight_only_gemv.h"
 
 #ifdef MACE_ENABLE_QUANTIZE
+#include "mace/ops/arm/q8/gemm.h"
 #include "mace/ops/arm/q8/gemv.h"
 #endif  // MACE_ENABLE_QUANTIZE
 
+#elif defined(__x86_64__)
+#include "mace/ops/x86/fp32/gemm.h"
 #else
 #include "mace/ops/ref/gemm.h"
-#include "mace/ops/ref/gemv.h"
+#endif  // MACE_ENABLE_NEON
+
+#ifndef MACE_ENABLE_NEON
+#include "mace/ops/ref/weight_only_gemv.h"
 #endif  // MACE_ENABLE_NEON
 
 #ifdef MACE_ENABLE_QUANTIZE
@@ -101,14 +110,47 @@ template<>
 class MatMulOp<CPU, float> : public MatMulOpBase {
  public:
   explicit MatMulOp(OpConstructContext *context)
-      : MatMulOpBase(context) {}
+      : MatMulOpBase(context),
+        weight_bits_(Operation::GetOptionalArg<int>(kWeightBitsArg, 0)),
+        weight_group_size_(
+            Operation::GetOptionalArg<int>(kWeightGroupSizeArg, 0)),
+        perm_a_(Operation::GetRepeatedArgs<int>("perm_a")),
+        perm_b_(Operation::GetRepeatedArgs<int>("perm_b")),
+        bf16_weight_(nullptr) {}
+
+  MaceStatus Init(OpInitContext *context) override {
+    MACE_RETURN_IF_ERROR(Operation::Init(context));
+    const Tensor *rhs = this->Input(INPUT_B);
+    // the transposed weight B converted to bfloat16 for the engine, see
+    // ConvertToCPUBFloat16, packed once concurrently with the others
+    if (rhs->dtype() == DT_BFLOAT16) {
+      MACE_CHECK(!transpose_a_ && transpose_b_ && rhs->dim_size() == 2,
+                 "bfloat16 MatMul takes a transposed 2D weight");
+      PackedWeights *packed_weights = context->workspace()->packed_weights();
+      return context->RunOrDefer([this, packed_weights, rhs]() {
+        bf16_weight_ = BFloat16Gemm::PackWeight(packed_weights, rhs,
+                                                rhs->dim(0), rhs->dim(1));
+        return MaceStatus::MACE_SUCCESS;
+      });
+    }
+    return MaceStatus::MACE_SUCCESS;
+  }
 
   MaceStatus Run(OpContext *context) override {
-    Validate();
     const Tensor *lhs = this->Input(INPUT_A);
     const Tensor *rhs = this->Input(INPUT_B);
     const Tensor *bias = this->InputSize() >= 3 ? this->Input(BIAS) : nullptr;
     Tensor *C = this->Output(OUTPUT);
+    if (weight_bits_ > 0) {
+      return RunWeightOnly(lhs, rhs, bias, C);
+    }
+    if (bf16_weight_ != nullptr) {
+      return RunBFloat16(lhs, rhs, bias, C);
+    }
+    if (!perm_a_.empty() || !perm_b_.empty() || IsBroadcast(lhs, rhs)) {
+      return RunStrided(context, lhs, rhs, bias, C);
+    }
+    Validate();
 
     const index_t lhs_rank = lhs->dim_size();
     const index_t lhs_rows = lhs->dim(lhs_rank - 2);
@@ -151,74 +193,297 @@ class MatMulOp<CPU, float> : public MatMulOpBase {
 
     MACE_RETURN_IF_ERROR(C->Resize(output_shape));
 
-    if (rows == 1 && transpose_b_) {
-      return gemv_.Compute(context,
-                           rhs,
-                           lhs,
-                           bias,
-                           batch,
-                           cols,
-                           depth,
-                           rhs_batched,
-                           lhs_batched,
-                           C);
-    } else if (cols == 1 && !transpose_a_) {
-      return gemv_.Compute(context,
-                           lhs,
-                           rhs,
-                           bias,
-                           batch,
-                           rows,
-                           depth,
-                           lhs_batched,
-                           rhs_batched,
-                           C);
-    } else {
-      context->device()->scratch_buffer()->Rewind();
-      MaceStatus ret = gemm_.Compute(context,
-                                     lhs,
-                                     rhs,
-                                     batch,
-                                     lhs_rows,
-                                     lhs_cols,
-                                     rhs_rows,
-                                     rhs_cols,
-                                     transpose_a_,
-                                     transpose_b_,
-                                     false,
-                                     lhs_batched,
-                                     rhs_batched,
-                                     C);
-      if (bias != nullptr) {
-        MACE_CHECK(bias->dim_size() == 1 && bias->dim(0) == cols,
-                   "bias' dim should be <= 2.");
-        Tensor::MappingGuard bias_guard(bias);
-        Tensor::MappingGuard c_guard(C);
-        const float *bias_data = bias->data<float>();
-        float *c_data = C->mutable_data<float>();
+    return gemm_dispatcher_.Compute(context,
+                                    lhs,
+                                    rhs,
+                                    bias,
+                                    batch,
+                                    rows,
+                                    cols,
+                                    depth,
+                                    transpose_a_ ? ColMajor : RowMajor,
+                                    transpose_b_ ? ColMajor : RowMajor,
+                                    lhs_batched,
+                                    rhs_batched,
+                                    C);
+  }
+
+ private:
+  static void AddBias(const Tensor *bias,
+                      const index_t rows,
+                      const index_t cols,
+                      Tensor *C) {
+    if (bias == nullptr) {
+      return;
+    }
+    MACE_CHECK(bias->dim_size() == 1 && bias->dim(0) == cols,
+               "bias' dim should be <= 2.");
+    Tensor::MappingGuard bias_guard(bias);
+    Tensor::MappingGuard c_guard(C);
+    const float *bias_data = bias->data<float>();
+    float *c_data = C->mutable_data<float>();
 #pragma omp parallel for collapse(2) schedule(runtime)
-        for (index_t i = 0; i < batch * rows; ++i) {
-          for (index_t w = 0; w < cols; ++w) {
-            c_data[i * cols + w] += bias_data[w];
-          }
+    for (index_t i = 0; i < rows; ++i) {
+      for (index_t w = 0; w < cols; ++w) {
+        c_data[i * cols + w] += bias_data[w];
+      }
+    }
+  }
+
+  // whether the batch dims differ in other ways than the ones of a rank 2
+  // operand, which are run by the strided gemm
+  static bool IsBroadcast(const Tensor *lhs, const Tensor *rhs) {
+    const index_t lhs_rank = lhs->dim_size();
+    const index_t rhs_rank = rhs->dim_size();
+    if (lhs_rank == 2 || rhs_rank == 2) {
+      return false;
+    }
+    if (lhs_rank != rhs_rank) {
+      return true;
+    }
+    for (index_t i = 0; i < lhs_rank - 2; ++i) {
+      if (lhs->dim(i) != rhs->dim(i)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // The shape and the element strides of an input read through the
+  // transpose folded into the op, see fold_transpose_matmul of the
+  // converter.
+  static void PermutedShape(const Tensor *input,
+                            const std::vector<int> &perm,
+                            std::vector<index_t> *shape,
+                            std::vector<index_t> *strides) {
+    const index_t rank = input->dim_size();
+    std::vector<index_t> input_strides(rank, 1);
+    for (index_t i = rank - 2; i >= 0; --i) {
+      input_strides[i] = input_strides[i + 1] * input->dim(i + 1);
+    }
+    if (perm.empty()) {
+      *shape = input->shape();
+      *strides = input_strides;
+      return;
+    }
+    MACE_CHECK(static_cast<index_t>(perm.size()) == rank,
+               "perm should be of the input rank");
+    shape->resize(rank);
+    strides->resize(rank);
+    for (index_t i = 0; i < rank; ++i) {
+      MACE_CHECK(perm[i] >= 0 && perm[i] < rank, "invalid perm ", perm[i]);
+      (*shape)[i] = input->dim(perm[i]);
+      (*strides)[i] = input_strides[perm[i]];
+    }
+  }
+
+  // the major and stride of a matrix of row_stride and col_stride between
+  // its elements, false if neither is 1
+  static bool MatrixLayout(const index_t rows,
+                           const index_t cols,
+                           const index_t row_stride,
+                           const index_t col_stride,
+                           MatrixBatch *batch) {
+    if (col_stride == 1 || (cols == 1 && row_stride != 1)) {
+      batch->major = RowMajor;
+      batch->stride = row_stride;
+    } else if (row_stride == 1 || rows == 1) {
+      batch->major = ColMajor;
+      batch->stride = col_stride;
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+  // Multiply the inputs of numpy-style broadcast batch dims, read in place
+  // through their folded transposes, e.g. the heads of an attention.
+  MaceStatus RunStrided(OpContext *context,
+                        const Tensor *lhs,
+                        const Tensor *rhs,
+                        const Tensor *bias,
+                        Tensor *C) {
+    std::vector<index_t> lhs_shape, lhs_strides, rhs_shape, rhs_strides;
+    PermutedShape(lhs, perm_a_, &lhs_shape, &lhs_strides);
+    PermutedShape(rhs, perm_b_, &rhs_shape, &rhs_strides);
+    const index_t lhs_rank = lhs_shape.size();
+    const index_t rhs_rank = rhs_shape.size();
+    MACE_CHECK(lhs_rank >= 2 && rhs_rank >= 2,
+               "rank should be greater than or equal to 2");
+
+    const index_t rows = lhs_shape[lhs_rank - (transpose_a_ ? 1 : 2)];
+    const index_t depth = lhs_shape[lhs_rank - (transpose_a_ ? 2 : 1)];
+    const index_t rhs_depth = rhs_shape[rhs_rank - (transpose_b_ ? 1 : 2)];
+    const index_t cols = rhs_shape[rhs_rank - (transpose_b_ ? 2 : 1)];
+    MACE_CHECK(depth == rhs_depth, "the number of A's column ", depth,
+               " must be equal to B's row ", rhs_depth);
+
+    // the batch dims aligned from the last, a missing dim is of size 1
+    const index_t batch_rank = std::max(lhs_rank, rhs_rank) - 2;
+    std::vector<index_t> output_shape(batch_rank);
+    std::vector<index_t> lhs_batch_strides(batch_rank, 0);
+    std::vector<index_t> rhs_batch_strides(batch_rank, 0);
+    for (index_t i = 0; i < batch_rank; ++i) {
+      const index_t lhs_i = i - (batch_rank - (lhs_rank - 2));
+      const index_t rhs_i = i - (batch_rank - (rhs_rank - 2));
+      const index_t lhs_dim = lhs_i >= 0 ? lhs_shape[lhs_i] : 1;
+      const index_t rhs_dim = rhs_i >= 0 ? rhs_shape[rhs_i] : 1;
+      MACE_CHECK(lhs_dim == rhs_dim || lhs_dim == 1 || rhs_dim == 1,
+                 "batch dimensions can not be broadcast: ", lhs_dim,
+                 " vs. ", rhs_dim);
+      output_shape[i] = std::max(lhs_dim, rhs_dim);
+      if (lhs_dim > 1) {
+        lhs_batch_strides[i] = lhs_strides[lhs_i];
+      }
+      if (rhs_dim > 1) {
+        rhs_batch_strides[i] = rhs_strides[rhs_i];
+      }
+    }
+    const index_t batch =
+        std::accumulate(output_shape.begin(), output_shape.end(),
+                        static_cast<index_t>(1), std::multiplies<index_t>());
+    output_shape.push_back(rows);
+    output_shape.push_back(cols);
+    MACE_RETURN_IF_ERROR(C->Resize(output_shape));
+
+    // the strides of the gemm lhs of rows x depth and rhs of depth x cols
+    const index_t lhs_row_stride = lhs_strides[lhs_rank - 2];
+    const index_t lhs_col_stride = lhs_strides[lhs_rank - 1];
+    const index_t rhs_row_stride = rhs_strides[rhs_rank - 2];
+    const index_t rhs_col_stride = rhs_strides[rhs_rank - 1];
+    MatrixBatch lhs_batch;
+    MatrixBatch rhs_batch;
+    if (!MatrixLayout(rows, depth,
+                      transpose_a_ ? lhs_col_stride : lhs_row_stride,
+                      transpose_a_ ? lhs_row_stride : lhs_col_stride,
+                      &lhs_batch) ||
+        !MatrixLayout(depth, cols,
+                      transpose_b_ ? rhs_col_stride : rhs_row_stride,
+                      transpose_b_ ? rhs_row_stride : rhs_col_stride,
+                      &rhs_batch)) {
+      return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                        "the last dim of a permuted input must be one of"
+                        " its last two dims");
+    }
+    lhs_batch.offsets.resize(batch);
+    rhs_batch.offsets.resize(batch);
+    std::vector<index_t> index(batch_rank, 0);
+    for (index_t b = 0; b < batch; ++b) {
+      index_t lhs_offset = 0;
+      index_t rhs_offset = 0;
+      for (index_t i = 0; i < batch_rank; ++i) {
+        lhs_offset += index[i] * lhs_batch_strides[i];
+        rhs_offset += index[i] * rhs_batch_strides[i];
+      }
+      lhs_batch.offsets[b] = lhs_offset;
+      rhs_batch.offsets[b] = rhs_offset;
+      for (index_t i = batch_rank - 1; i >= 0; --i) {
+        if (++index[i] < output_shape[i]) {
+          break;
         }
+        index[i] = 0;
       }
+    }
+
+    context->device()->scratch_buffer()->Rewind();
+    MACE_RETURN_IF_ERROR(gemm_.Compute(context, lhs, rhs, lhs_batch,
+                                       rhs_batch, rows, cols, depth,
+                                       RowMajor, C));
+    AddBias(bias, batch * rows, cols, C);
+    return MaceStatus::MACE_SUCCESS;
+  }
 
-      return ret;
+  // A of [..., depth] by the transposed weight B of [cols, depth] values of
+  // weight_bits_ bits, dequantized as it is multiplied
+  MaceStatus RunWeightOnly(const Tensor *lhs,
+                           const Tensor *rhs,
+                           const Tensor *bias,
+                           Tensor *C) {
+    MACE_CHECK(!transpose_a_ && transpose_b_ && rhs->dim_size() == 2,
+               "weight-only MatMul takes a transposed 2D weight");
+    const index_t lhs_rank = lhs->dim_size();
+    MACE_CHECK(lhs_rank >= 2, "rank should be greater than or equal to 2");
+    const index_t depth = lhs->dim(lhs_rank - 1);
+    const index_t batch = lhs->size() / depth;
+    WeightOnlyMatrix matrix;
+    MACE_RETURN_IF_ERROR(MakeWeightOnlyMatrix(
+        rhs, weight_bits_, weight_group_size_, depth, &matrix));
+    if (bias != nullptr) {
+      MACE_CHECK(bias->dim_size() == 1 && bias->dim(0) == matrix.rows,
+                 "bias' dim should be <= 2.");
     }
+    std::vector<index_t> output_shape = lhs->shape();
+    output_shape[lhs_rank - 1] = matrix.rows;
+    MACE_RETURN_IF_ERROR(C->Resize(output_shape));
+    Tensor::MappingGuard lhs_guard(lhs);
+    Tensor::MappingGuard rhs_guard(rhs);
+    Tensor::MappingGuard bias_guard(bias);
+    Tensor::MappingGuard c_guard(C);
+#ifdef MACE_ENABLE_NEON
+    arm::fp32::WeightOnlyGemv(
+#else
+    ref::WeightOnlyGemv(
+#endif  // MACE_ENABLE_NEON
+        matrix, lhs->data<float>(),
+        bias == nullptr ? nullptr : bias->data<float>(), batch,
+        C->mutable_data<float>());
+    return MaceStatus::MACE_SUCCESS;
   }
 
- private:
+  // A of [..., depth] by the transposed bfloat16 weight B of [cols, depth]
+  MaceStatus RunBFloat16(const Tensor *lhs,
+                         const Tensor *rhs,
+                         const Tensor *bias,
+                         Tensor *C) {
+    const index_t lhs_rank = lhs->dim_size();
+    MACE_CHECK(lhs_rank >= 2, "rank should be greater than or equal to 2");
+    const index_t depth = lhs->dim(lhs_rank - 1);
+    MACE_CHECK(rhs->dim(1) == depth, "the depths of A and B should match");
+    const index_t batch = lhs->size() / depth;
+    const index_t cols = rhs->dim(0);
+    if (bias != nullptr) {
+      MACE_CHECK(bias->dim_size() == 1 && bias->dim(0) == cols,
+                 "bias' dim should be <= 2.");
+    }
+    std::vector<index_t> output_shape = lhs->shape();
+    output_shape[lhs_rank - 1] = cols;
+    MACE_RETURN_IF_ERROR(C->Resize(output_shape));
+    Tensor::MappingGuard lhs_guard(lhs);
+    Tensor::MappingGuard bias_guard(bias);
+    Tensor::MappingGuard c_guard(C);
+    bf16_gemm_.Compute(bf16_weight_, lhs->data<float>(), depth, 1,
+                       bias == nullptr ? nullptr : bias->data<float>(), cols,
+                       batch, depth, 1, cols, C->mutable_data<float>());
+    return MaceStatus::MACE_SUCCESS;
+  }
+
+  // picks the GEMM or GEMV of the shapes of each run
+  GemmDispatcher gemm_dispatcher_;
+  // the strided GEMM of broadcast or transposed batches
 #ifdef MACE_ENABLE_NEON
   arm::fp32::Gemm gemm_;
-  arm::fp32::Gemv gemv_;
+#elif defined(__x86_64__)
+  x86::fp32::Gemm gemm_;
 #else
-  ref::Gemv<float> gemv_;
   ref::Gemm<float> gemm_;
 #endif  // MACE_ENABLE_NEON
+  // the bits of a weight B quantized for the weight-only kernels, 0 if float
+  const int weight_bits_;
+  const int weight_group_size_;
+  // the permutations of the transposes of the inputs folded into the op,
+  // the dims of input A are perm_a_, empty if not transposed
+  const std::vector<int> perm_a_;
+  const std::vector<int> perm_b_;
+  // the bfloat16 weight B packed for bf16_gemm_, owned by the packed weights
+  const BFloat16 *bf16_weight_;
+  BFloat16Gemm bf16_gemm_;
 };
 
 #ifdef MACE_ENABLE_QUANTIZE
+inline MatrixMajor ToMatrixMajor(const gemmlowp::MapOrder order) {
+  return order == gemmlowp::MapOrder::RowMajor ? RowMajor : ColMajor;
+}
+
 template<gemmlowp::MapOrder AOrder, gemmlowp::MapOrder BOrder,
     typename OutputType>
 class MatMulFixpointImpl;
@@ -259,6 +524,22 @@ class MatMulFixpointImpl<AOrder, BOrder, uint8_t> {
                            lhs_batched,
                            rhs_batched,
                            C);
+    } else if (gemm_kernel_.HasDotProd()) {
+      context->device()->scratch_buffer()->Rewind();
+      gemm_kernel_.Compute(context,
+                           A,
+                           B,
+                           nullptr,
+                           batch,
+                           height,
+                           width,
+                           K,
+                           ToMatrixMajor(AOrder),
+                           ToMatrixMajor(BOrder),
+                           RowMajor,
+                           lhs_batched,
+                           rhs_batched,
+                           C);
     } else {
 #endif  // MACE_ENABLE_NEON
       Tensor::MappingGuard guarda(A);
@@ -304,6 +585,7 @@ class MatMulFixpointImpl<AOrder, BOrder, uint8_t> {
 
  private:
   arm::q8::Gemv<uint8_t> gemv_kernel_;
+  arm::q8::Gemm<uint8_t> gemm_kernel_;
 #endif  // MACE_ENABLE_NEON
 };
 
@@ -346,6 +628,22 @@ class MatMulFixpointImpl<AOrder, BOrder, int32_t> {
                            lhs_batched,
                            rhs_batched,
                            C);
+    } else if (gemm_kernel_.HasDotProd()) {
+      context->device()->scratch_buffer()->Rewind();
+      gemm_kernel_.Compute(context,
+                           A,
+                           B,
+                           nullptr,
+                           batch,
+                           height,
+                           width,
+                           K,
+                           ToMatrixMajor(AOrder),
+                           ToMatrixMajor(BOrder),
+                           RowMajor,
+                           lhs_batched,
+                           rhs_batched,
+                           C);
     } else {
 #endif  // MACE_ENABLE_NEON
       Tensor::MappingGuard guarda(A);
@@ -390,6 +688,7 @@ class MatMulFixpointImpl<AOrder, BOrder, int32_t> {
 
  private:
   arm::q8::Gemv<int32_t> gemv_kernel_;
+  arm::q8::Gemm<int32_t> gemm_kernel_;
 #endif  // MACE_ENABLE_NEON
 };
 
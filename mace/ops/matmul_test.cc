@@ -12,8 +12,13 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include <fstream>
+#include <functional>
+#include <numeric>
+#include <vector>
 
+#include "mace/ops/common/transpose.h"
 #include "mace/ops/ops_test_util.h"
 #include "mace/ops/ref/gemm.h"
 
@@ -71,6 +76,43 @@ TEST_F(MatMulOpTest, SimpleCPUWithBatch) {
                           {2, 2, 2}, {22, 28, 49, 64, 22, 28, 49, 64});
 }
 
+namespace {
+void WeightOnly(const int bits,
+                const std::vector<index_t> &B_shape,
+                const std::vector<uint8_t> &B_value,
+                const std::vector<float> &B_scales,
+                const int32_t B_zero_point) {
+  OpsTestNet net;
+
+  net.AddInputFromArray<DeviceType::CPU, float>("A", {1, 2, 3},
+                                                {1, 2, 3, 4, 5, 6});
+  net.AddInputFromArray<DeviceType::CPU, uint8_t>("B", B_shape, B_value,
+                                                  true, 0.f, B_zero_point);
+  net.GetTensor("B")->SetScales(B_scales);
+  net.AddInputFromArray<DeviceType::CPU, float>("Bias", {2}, {1, -1}, true);
+
+  OpDefBuilder("MatMul", "MatMulTest")
+      .Input("A")
+      .Input("B")
+      .Input("Bias")
+      .Output("Output")
+      .AddIntArg("transpose_b", 1)
+      .AddIntArg("weight_bits", bits)
+      .Finalize(net.NewOperatorDef());
+  net.RunOp(DeviceType::CPU);
+
+  // B^T is {{1, 1}, {2, 2}, {3, -1}}
+  auto expected = net.CreateTensor<float>({1, 2, 2}, {15, 1, 33, 7});
+  ExpectTensorNear<float>(*expected, *net.GetOutput("Output"), 1e-5);
+}
+}  // namespace
+
+TEST_F(MatMulOpTest, WeightOnlyCPU) {
+  WeightOnly(8, {2, 3}, {130, 132, 134, 132, 136, 124}, {0.5f, 0.25f}, 128);
+  // two values of 4 bits to a byte, the lower nibble first
+  WeightOnly(4, {2, 2}, {202, 14, 202, 6}, {0.5f, 0.5f}, 8);
+}
+
 namespace {
 
 template<DeviceType D>
@@ -155,6 +197,115 @@ TEST_F(MatMulOpTest, ComplexCPUWithBatch) {
 }
 
 namespace {
+
+// the tensor read through perm, i.e. the input of a folded Transpose
+std::vector<float> Permute(const std::vector<index_t> &shape,
+                           const std::vector<float> &data,
+                           const std::vector<int> &perm,
+                           std::vector<index_t> *logical_shape) {
+  *logical_shape = shape;
+  if (perm.empty()) {
+    return data;
+  }
+  std::vector<float> output(data.size());
+  MACE_CHECK(Transpose(data.data(), shape, perm, output.data()) ==
+             MaceStatus::MACE_SUCCESS);
+  for (size_t i = 0; i < perm.size(); ++i) {
+    (*logical_shape)[i] = shape[perm[i]];
+  }
+  return output;
+}
+
+void Strided(const std::vector<index_t> &A_shape,
+             const std::vector<int> &perm_a,
+             const std::vector<index_t> &B_shape,
+             const std::vector<int> &perm_b,
+             const bool transpose_a,
+             const bool transpose_b) {
+  OpsTestNet net;
+  net.AddRandomInput<CPU, float>("A", A_shape);
+  net.AddRandomInput<CPU, float>("B", B_shape);
+  OpDefBuilder("MatMul", "MatMulTest")
+      .Input("A")
+      .Input("B")
+      .Output("Output")
+      .AddIntArg("transpose_a", transpose_a ? 1 : 0)
+      .AddIntArg("transpose_b", transpose_b ? 1 : 0)
+      .AddIntsArg("perm_a", perm_a)
+      .AddIntsArg("perm_b", perm_b)
+      .Finalize(net.NewOperatorDef());
+  net.RunOp(CPU);
+
+  // broadcast the batches of the transposed inputs
+  const Tensor *A = net.GetTensor("A");
+  const Tensor *B = net.GetTensor("B");
+  std::vector<index_t> a_shape, b_shape;
+  std::vector<float> a = Permute(
+      A_shape, std::vector<float>(A->data<float>(),
+                                  A->data<float>() + A->size()),
+      perm_a, &a_shape);
+  std::vector<float> b = Permute(
+      B_shape, std::vector<float>(B->data<float>(),
+                                  B->data<float>() + B->size()),
+      perm_b, &b_shape);
+  const size_t a_rank = a_shape.size();
+  const size_t b_rank = b_shape.size();
+  const index_t a_rows = a_shape[a_rank - 2], a_cols = a_shape[a_rank - 1];
+  const index_t b_rows = b_shape[b_rank - 2], b_cols = b_shape[b_rank - 1];
+  const index_t rows = transpose_a ? a_cols : a_rows;
+  const index_t depth = transpose_a ? a_rows : a_cols;
+  const index_t cols = transpose_b ? b_rows : b_cols;
+  const size_t batch_rank = std::max(a_rank, b_rank) - 2;
+  std::vector<index_t> c_shape(batch_rank);
+  for (size_t i = 0; i < batch_rank; ++i) {
+    const index_t a_dim = i + a_rank >= batch_rank + 2 ?
+        a_shape[i + a_rank - batch_rank - 2] : 1;
+    const index_t b_dim = i + b_rank >= batch_rank + 2 ?
+        b_shape[i + b_rank - batch_rank - 2] : 1;
+    c_shape[i] = std::max(a_dim, b_dim);
+  }
+  const index_t batch = std::accumulate(c_shape.begin(), c_shape.end(),
+                                        1, std::multiplies<index_t>());
+  c_shape.push_back(rows);
+  c_shape.push_back(cols);
+  std::vector<float> c(batch * rows * cols);
+  for (index_t n = 0; n < batch; ++n) {
+    // the matrix of each input of the batch index n
+    index_t a_index = 0, b_index = 0, a_size = 1, b_size = 1;
+    index_t rest = n;
+    for (size_t i = batch_rank; i-- > 0;) {
+      const index_t idx = rest % c_shape[i];
+      rest /= c_shape[i];
+      if (i + a_rank >= batch_rank + 2) {
+        const index_t dim = a_shape[i + a_rank - batch_rank - 2];
+        a_index += (dim == 1 ? 0 : idx) * a_size;
+        a_size *= dim;
+      }
+      if (i + b_rank >= batch_rank + 2) {
+        const index_t dim = b_shape[i + b_rank - batch_rank - 2];
+        b_index += (dim == 1 ? 0 : idx) * b_size;
+        b_size *= dim;
+      }
+    }
+    const float *a_data = a.data() + a_index * a_rows * a_cols;
+    const float *b_data = b.data() + b_index * b_rows * b_cols;
+    for (index_t r = 0; r < rows; ++r) {
+      for (index_t col = 0; col < cols; ++col) {
+        float sum = 0;
+        for (index_t d = 0; d < depth; ++d) {
+          sum += (transpose_a ? a_data[d * a_cols + r]
+                              : a_data[r * a_cols + d]) *
+              (transpose_b ? b_data[col * b_cols + d]
+                           : b_data[d * b_cols + col]);
+        }
+        c[(n * rows + r) * cols + col] = sum;
+      }
+    }
+  }
+  auto expected = net.CreateTensor<float>(c_shape, c);
+  ExpectTensorNear<float>(*expected, *net.GetOutput("Output"), 1e-4, 1e-2);
+}
+
 void QuantOutputUint8(const std::vector<index_t> &batch,
                       const index_t rows,
                       const index_t depth,
@@ -330,6 +481,22 @@ void QuantOutputInt32(const std::vector<index_t> &batch,
 }
 }  // namespace
 
+TEST_F(MatMulOpTest, BroadcastCPU) {
+  Strided({2, 1, 31, 61}, {}, {3, 61, 67}, {}, false, false);
+  Strided({5, 1, 13, 7}, {}, {1, 4, 13, 9}, {}, true, false);
+  Strided({2, 3, 31, 61}, {}, {1, 67, 61}, {}, false, true);
+}
+
+TEST_F(MatMulOpTest, PermutedCPU) {
+  // the heads of an attention: [batch, seq, heads, dim] read as
+  // [batch, heads, seq, dim] and its keys as [batch, heads, dim, seq]
+  Strided({2, 17, 3, 16}, {0, 2, 1, 3}, {2, 19, 3, 16}, {0, 2, 3, 1},
+          false, false);
+  Strided({2, 17, 3, 16}, {0, 2, 1, 3}, {2, 19, 3, 16}, {0, 2, 1, 3},
+          false, true);
+  Strided({1, 16, 4, 9}, {0, 2, 3, 1}, {4, 16, 5}, {}, true, false);
+}
+
 TEST_F(MatMulOpTest, QuantOutputUint8) {
   QuantOutputUint8({1}, 64, 128, 32, false, false);
   QuantOutputUint8({1}, 64, 32, 128, false, false);
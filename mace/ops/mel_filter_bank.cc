@@ -0,0 +1,164 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// This Op computes the mel filter bank energies of the power spectrum of
+// frames, the fbank features of Kaldi, from the output of Spectrogram.
+// The input is [..., bins] of the bins 0 to fft_length / 2 of the frames of
+// audio of sample_rate, and the output [..., num_mel_bins]. The triangular
+// filters are equally spaced on the mel scale, mel(f) = 1127 ln(1 + f / 700),
+// from low_freq to high_freq, which is relative to the Nyquist frequency if
+// it is not positive. They are multiplied with the frames by a Gemv, and
+// the energies are floored by log_floor and their log taken if use_log.
+// Each frame is on its own, so the chunks of a stream need no state.
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "mace/core/operator.h"
+
+#ifdef MACE_ENABLE_NEON
+#include "mace/ops/arm/fp32/gemv.h"
+#elif defined(__x86_64__)
+#include "mace/ops/x86/fp32/gemv.h"
+#else
+#include "mace/ops/ref/gemv.h"
+#endif  // MACE_ENABLE_NEON
+
+namespace mace {
+namespace ops {
+
+template <DeviceType D, typename T>
+class MelFilterBankOp;
+
+template <>
+class MelFilterBankOp<DeviceType::CPU, float> : public Operation {
+ public:
+  explicit MelFilterBankOp(OpConstructContext *context)
+      : Operation(context),
+        sample_rate_(Operation::GetOptionalArg<float>("sample_rate", 16000)),
+        num_mel_bins_(Operation::GetOptionalArg<int>("num_mel_bins", 23)),
+        low_freq_(Operation::GetOptionalArg<float>("low_freq", 20)),
+        high_freq_(Operation::GetOptionalArg<float>("high_freq", 0)),
+        use_log_(Operation::GetOptionalArg<int>("use_log", 1) != 0),
+        log_floor_(Operation::GetOptionalArg<float>(
+            "log_floor", std::numeric_limits<float>::epsilon())),
+        filters_(GetCPUAllocator(), DT_FLOAT) {
+    MACE_CHECK(num_mel_bins_ > 0 && sample_rate_ > 0,
+               "MelFilterBank's mel bins and sample rate should be greater"
+               " than zero.");
+  }
+
+  MaceStatus Run(OpContext *context) override {
+    const Tensor *input = this->Input(0);
+    Tensor *output = this->Output(0);
+    const index_t rank = input->dim_size();
+    MACE_CHECK(rank >= 1, "MelFilterBank only supports input dim size >= 1");
+    const index_t num_bins = input->dim(rank - 1);
+    MACE_CHECK(num_bins >= 2, "MelFilterBank takes at least 2 bins");
+    if (filters_.dim_size() != 2 || filters_.dim(1) != num_bins) {
+      MACE_RETURN_IF_ERROR(ComputeFilters(num_bins));
+    }
+
+    std::vector<index_t> output_shape = input->shape();
+    output_shape[rank - 1] = num_mel_bins_;
+    MACE_RETURN_IF_ERROR(output->Resize(output_shape));
+    const index_t frames = input->size() / num_bins;
+    if (frames == 0) {
+      return MaceStatus::MACE_SUCCESS;
+    }
+    MACE_RETURN_IF_ERROR(gemv_.Compute(context,
+                                       &filters_,
+                                       input,
+                                       nullptr,
+                                       frames,
+                                       num_mel_bins_,
+                                       num_bins,
+                                       false,
+                                       true,
+                                       output));
+    if (use_log_) {
+      Tensor::MappingGuard output_guard(output);
+      float *output_data = output->mutable_data<float>();
+      const index_t size = output->size();
+#pragma omp parallel for schedule(runtime)
+      for (index_t i = 0; i < size; ++i) {
+        output_data[i] = std::log(std::max(output_data[i], log_floor_));
+      }
+    }
+    return MaceStatus::MACE_SUCCESS;
+  }
+
+ private:
+  static float Mel(const float freq) {
+    return 1127.0f * std::log(1.0f + freq / 700.0f);
+  }
+
+  // the filters of [num_mel_bins, num_bins] as the MelBanks of Kaldi, which
+  // leave out the Nyquist bin
+  MaceStatus ComputeFilters(const index_t num_bins) {
+    const float nyquist = 0.5f * sample_rate_;
+    const float high_freq = high_freq_ > 0 ? high_freq_ : nyquist + high_freq_;
+    MACE_CHECK(low_freq_ >= 0 && low_freq_ < high_freq && high_freq <= nyquist,
+               "MelFilterBank's frequencies should be in [0, ", nyquist,
+               "], not [", low_freq_, ", ", high_freq, "]");
+    MACE_RETURN_IF_ERROR(filters_.Resize({num_mel_bins_, num_bins}));
+    Tensor::MappingGuard filters_guard(&filters_);
+    float *filters = filters_.mutable_data<float>();
+    std::fill(filters, filters + filters_.size(), 0.0f);
+
+    const float bin_width = nyquist / (num_bins - 1);
+    const float mel_low = Mel(low_freq_);
+    const float mel_delta = (Mel(high_freq) - mel_low) / (num_mel_bins_ + 1);
+    for (index_t m = 0; m < num_mel_bins_; ++m) {
+      const float left = mel_low + m * mel_delta;
+      const float center = left + mel_delta;
+      const float right = center + mel_delta;
+      for (index_t i = 0; i + 1 < num_bins; ++i) {
+        const float mel = Mel(bin_width * i);
+        if (mel > left && mel < right) {
+          filters[m * num_bins + i] = mel <= center ?
+              (mel - left) / (center - left) : (right - mel) / (right - center);
+        }
+      }
+    }
+    return MaceStatus::MACE_SUCCESS;
+  }
+
+  const float sample_rate_;
+  const index_t num_mel_bins_;
+  const float low_freq_;
+  const float high_freq_;
+  const bool use_log_;
+  const float log_floor_;
+  // computed for the bins of the first run
+  Tensor filters_;
+#ifdef MACE_ENABLE_NEON
+  arm::fp32::Gemv gemv_;
+#elif defined(__x86_64__)
+  x86::fp32::Gemv gemv_;
+#else
+  ref::Gemv<float> gemv_;
+#endif  // MACE_ENABLE_NEON
+};
+
+void RegisterMelFilterBank(OpRegistryBase *op_registry) {
+  MACE_REGISTER_OP(op_registry, "MelFilterBank", MelFilterBankOp,
+                   DeviceType::CPU, float);
+}
+
+}  // namespace ops
+}  // namespace mace
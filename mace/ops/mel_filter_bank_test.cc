@@ -0,0 +1,120 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "mace/ops/ops_test_util.h"
+
+namespace mace {
+namespace ops {
+namespace test {
+
+class MelFilterBankOpTest : public OpsTestBase {};
+
+namespace {
+double Mel(const double freq) {
+  return 1127.0 * std::log(1.0 + freq / 700.0);
+}
+
+// A frame of a single bin gives the weights of that bin in the filters.
+void TestFilters(const index_t num_bins,
+                 const int num_mel_bins,
+                 const float low_freq,
+                 const float high_freq) {
+  const float sample_rate = 16000;
+  std::vector<float> input(num_bins * num_bins, 0);
+  for (index_t i = 0; i < num_bins; ++i) {
+    input[i * num_bins + i] = 1;
+  }
+  OpsTestNet net;
+  net.AddInputFromArray<CPU, float>("Input", {num_bins, num_bins}, input);
+  OpDefBuilder("MelFilterBank", "MelFilterBankTest")
+      .Input("Input")
+      .Output("Output")
+      .AddFloatArg("sample_rate", sample_rate)
+      .AddIntArg("num_mel_bins", num_mel_bins)
+      .AddFloatArg("low_freq", low_freq)
+      .AddFloatArg("high_freq", high_freq)
+      .AddIntArg("use_log", 0)
+      .Finalize(net.NewOperatorDef());
+  net.RunOp();
+
+  const double nyquist = sample_rate / 2;
+  const double high = high_freq > 0 ? high_freq : nyquist + high_freq;
+  const double mel_low = Mel(low_freq);
+  const double delta = (Mel(high) - mel_low) / (num_mel_bins + 1);
+  std::vector<float> expected(num_bins * num_mel_bins, 0);
+  for (index_t i = 0; i + 1 < num_bins; ++i) {
+    const double mel = Mel(nyquist * i / (num_bins - 1));
+    for (int m = 0; m < num_mel_bins; ++m) {
+      const double left = mel_low + m * delta;
+      const double center = left + delta;
+      const double right = center + delta;
+      if (mel > left && mel <= center) {
+        expected[i * num_mel_bins + m] = (mel - left) / delta;
+      } else if (mel > center && mel < right) {
+        expected[i * num_mel_bins + m] = (right - mel) / delta;
+      }
+    }
+  }
+  net.AddInputFromArray<CPU, float>("ExpectedOutput",
+                                    {num_bins, num_mel_bins}, expected);
+  ExpectTensorNear<float>(*net.GetOutput("ExpectedOutput"),
+                          *net.GetOutput("Output"), 1e-3, 1e-4);
+}
+}  // namespace
+
+TEST_F(MelFilterBankOpTest, Filters) {
+  TestFilters(257, 23, 20, 0);
+  TestFilters(257, 40, 20, -400);
+  TestFilters(129, 80, 0, 4000);
+}
+
+TEST_F(MelFilterBankOpTest, Log) {
+  OpsTestNet net;
+  net.AddInputFromArray<CPU, float>("Input", {2, 1, 5},
+                                    {0, 0, 0, 0, 0, 1, 2, 4, 8, 16});
+  OpDefBuilder("MelFilterBank", "MelFilterBankTest")
+      .Input("Input")
+      .Output("Output")
+      .AddIntArg("num_mel_bins", 1)
+      .AddFloatArg("sample_rate", 8)
+      .AddFloatArg("low_freq", 0)
+      .Finalize(net.NewOperatorDef());
+  net.RunOp();
+
+  // the single filter of 0 to 4 Hz on the bins of 1 Hz each, without the
+  // Nyquist one, and the silent frame gets the floor
+  std::vector<float> weights(5, 0);
+  const double center = Mel(4) / 2;
+  for (int i = 1; i < 4; ++i) {
+    const double mel = Mel(i);
+    weights[i] = mel <= center ? mel / center : (2 * center - mel) / center;
+  }
+  float energy = 0;
+  for (int i = 0; i < 5; ++i) {
+    energy += weights[i] * (1 << i);
+  }
+  net.AddInputFromArray<CPU, float>(
+      "ExpectedOutput", {2, 1, 1},
+      {std::log(std::numeric_limits<float>::epsilon()), std::log(energy)});
+  ExpectTensorNear<float>(*net.GetOutput("ExpectedOutput"),
+                          *net.GetOutput("Output"), 1e-4, 1e-4);
+}
+
+}  // namespace test
+}  // namespace ops
+}  // namespace mace
@@ -88,6 +88,19 @@ void MemoryAccessBenchmark_NHCW(
   }
 }
 
+// The triad of the device profile, from arrays in the L1 cache to the memory
+void TriadBenchmark(int iters, int size) {
+  mace::testing::StopTiming();
+  std::vector<float> a(size, 0), b(size, 1), c(size, 2);
+  mace::testing::StartTiming();
+
+  while (iters--) {
+    for (int i = 0; i < size; ++i) {
+      a[i] = b[i] + 3.0f * c[i];
+    }
+  }
+}
+
 }  // namespace
 
 #define MACE_BM_MEMORY_ACCESS(N, H, W, C, ORDER)                     \
@@ -105,6 +118,19 @@ MACE_BM_MEMORY_ACCESS(10, 64, 64, 1024, NWCH);
 MACE_BM_MEMORY_ACCESS(10, 64, 1024, 64, NHCW);
 MACE_BM_MEMORY_ACCESS(10, 64, 1024, 64, NWCH);
 
+#define MACE_BM_TRIAD(SIZE)                                            \
+  static void MACE_BM_TRIAD_##SIZE(int iters) {                        \
+    const int64_t tot = static_cast<int64_t>(iters) * SIZE;            \
+    mace::testing::BytesProcessed(tot * 3 * sizeof(float));            \
+    TriadBenchmark(iters, SIZE);                                       \
+  }                                                                    \
+  MACE_BENCHMARK(MACE_BM_TRIAD_##SIZE)
+
+MACE_BM_TRIAD(1024);
+MACE_BM_TRIAD(16384);
+MACE_BM_TRIAD(262144);
+MACE_BM_TRIAD(4194304);
+
 }  // namespace test
 }  // namespace ops
 }  // namespace mace
@@ -0,0 +1,589 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "mace/core/memory_optimizer.h"
+#include "mace/ops/common/conv_pool_2d_util.h"
+#include "mace/ops/common/eltwise_type.h"
+#include "mace/ops/ops_test_util.h"
+#include "mace/ops/pooling.h"
+
+namespace mace {
+namespace ops {
+namespace test {
+
+class MemoryOptimizerOpTest : public OpsTestBase {};
+
+namespace {
+
+void AddActivation(const std::string &input,
+                   const std::string &output,
+                   const std::vector<index_t> &shape,
+                   const char *activation,
+                   NetDef *net_def) {
+  OpDefBuilder("Activation", output + "Op")
+      .Input(input)
+      .Output(output)
+      .OutputShape(shape)
+      .AddStringArg("activation", activation)
+      .Finalize(net_def->add_op());
+}
+
+void AddEltwise(const std::string &input0,
+                const std::string &input1,
+                const std::string &output,
+                const std::vector<index_t> &shape,
+                const EltwiseType type,
+                NetDef *net_def) {
+  OpDefBuilder("Eltwise", output + "Op")
+      .Input(input0)
+      .Input(input1)
+      .Output(output)
+      .OutputShape(shape)
+      .AddIntArg("type", static_cast<int>(type))
+      .Finalize(net_def->add_op());
+}
+
+// 2x2 pooling of stride 2 of an NCHW input
+void AddPooling(const std::string &input,
+                const std::string &output,
+                const std::vector<index_t> &shape,
+                const PoolingType type,
+                NetDef *net_def) {
+  OpDefBuilder("Pooling", output + "Op")
+      .Input(input)
+      .Output(output)
+      .OutputShape(shape)
+      .AddIntArg("pooling_type", type)
+      .AddIntsArg("kernels", {2, 2})
+      .AddIntsArg("strides", {2, 2})
+      .AddIntArg("padding", Padding::VALID)
+      .AddIntsArg("dilations", {1, 1})
+      .Finalize(net_def->add_op());
+}
+
+void AddConcat(const std::string &input0,
+               const std::string &input1,
+               const std::string &output,
+               const std::vector<index_t> &shape,
+               NetDef *net_def) {
+  OpDefBuilder("Concat", output + "Op")
+      .Input(input0)
+      .Input(input1)
+      .Output(output)
+      .OutputShape(shape)
+      .AddIntArg("axis", 1)
+      .Finalize(net_def->add_op());
+}
+
+void AddSlice(const std::string &input,
+              const std::string &output,
+              const std::vector<index_t> &shape,
+              const int start,
+              NetDef *net_def) {
+  OpDefBuilder("Slice", output + "Op")
+      .Input(input)
+      .Output(output)
+      .OutputShape(shape)
+      .AddIntsArg("axes", {-1})
+      .AddIntsArg("starts", {start})
+      .AddIntsArg("ends", {start + static_cast<int>(shape.back())})
+      .Finalize(net_def->add_op());
+}
+
+// crops input to the shape of reference from the offsets of the dims from
+// the axis, as converted NHWC, the args are NCHW ones
+void AddCrop(const std::string &input,
+             const std::string &reference,
+             const std::string &output,
+             const std::vector<index_t> &shape,
+             const int axis,
+             const std::vector<int> &offset,
+             NetDef *net_def) {
+  OpDefBuilder("Crop", output + "Op")
+      .Input(input)
+      .Input(reference)
+      .Output(output)
+      .OutputShape(shape)
+      .AddIntArg("axis", axis)
+      .AddIntsArg("offset", offset)
+      .AddIntArg("data_format", DataFormat::NHWC)
+      .Finalize(net_def->add_op());
+}
+
+// whether the data of the tensor named inner lies in that of outer
+bool DataWithin(OpsTestNet *net, const char *inner, const char *outer) {
+  const char *inner_data =
+      static_cast<const char *>(net->GetTensor(inner)->raw_data());
+  const char *outer_data =
+      static_cast<const char *>(net->GetTensor(outer)->raw_data());
+  return inner_data >= outer_data &&
+      inner_data < outer_data + net->GetTensor(outer)->raw_size();
+}
+
+// Runs the net on CPU once as planned by the memory optimizer into net, and
+// once with the output shapes dropped, so that every tensor gets a buffer
+// of its own, and expects the same outputs and untouched inputs.
+void RunAsUnplanned(
+    const NetDef &net_def,
+    const std::map<std::string, std::vector<index_t>> &inputs,
+    OpsTestNet *net) {
+  NetDef unplanned_def(net_def);
+  for (auto &op_def : *unplanned_def.mutable_op()) {
+    op_def.clear_output_shape();
+  }
+  OpsTestNet unplanned;
+  std::map<std::string, std::vector<float>> input_data;
+  for (auto &input : inputs) {
+    std::vector<float> &data = input_data[input.first];
+    GenerateRandomRealTypeData(input.second, &data, false);
+    net->AddInputFromArray<DeviceType::CPU, float>(input.first, input.second,
+                                                   data);
+    unplanned.AddInputFromArray<DeviceType::CPU, float>(input.first,
+                                                        input.second, data);
+  }
+  ASSERT_EQ(net->RunNet(net_def, DeviceType::CPU), MaceStatus::MACE_SUCCESS);
+  ASSERT_EQ(unplanned.RunNet(unplanned_def, DeviceType::CPU),
+            MaceStatus::MACE_SUCCESS);
+
+  for (auto &output_info : net_def.output_info()) {
+    const char *name = output_info.name().c_str();
+    ExpectTensorNear<float>(*unplanned.GetOutput(name), *net->GetOutput(name),
+                            1e-5);
+  }
+  for (auto &input : input_data) {
+    auto expected = net->CreateTensor<float>(inputs.at(input.first),
+                                             input.second);
+    ExpectTensorNear<float>(*expected, *net->GetTensor(input.first.c_str()),
+                            0);
+  }
+}
+
+}  // namespace
+
+TEST_F(MemoryOptimizerOpTest, ArenaOfBranches) {
+  const std::vector<index_t> shape = {1, 8, 16, 16};
+  const std::vector<index_t> pooled_shape = {1, 8, 8, 8};
+  // two branches of the input which meet twice, A is read by both
+  NetDef net_def;
+  AddNetInput("Input", shape, &net_def);
+  net_def.add_output_info()->set_name("Output");
+  AddActivation("Input", "A", shape, "RELU", &net_def);
+  AddPooling("A", "P", pooled_shape, PoolingType::MAX, &net_def);
+  AddActivation("Input", "B", shape, "TANH", &net_def);
+  AddPooling("B", "Q", pooled_shape, PoolingType::AVG, &net_def);
+  AddEltwise("P", "Q", "S", pooled_shape, EltwiseType::SUM, &net_def);
+  AddActivation("A", "C", shape, "SIGMOID", &net_def);
+  AddPooling("C", "R", pooled_shape, PoolingType::MAX, &net_def);
+  AddEltwise("S", "R", "Output", pooled_shape, EltwiseType::PROD, &net_def);
+
+  OpsTestNet net;
+  RunAsUnplanned(net_def, {{"Input", shape}}, &net);
+
+  // the operations producing and last reading each tensor, the outputs of
+  // the net live to the end
+  std::map<std::string, std::pair<int, int>> lifetimes;
+  for (int i = 0; i < net_def.op_size(); ++i) {
+    for (auto &input : net_def.op(i).input()) {
+      if (lifetimes.count(input) == 1) {
+        lifetimes[input].second = i;
+      }
+    }
+    lifetimes[net_def.op(i).output(0)] = std::make_pair(i, i);
+  }
+  for (auto &output_info : net_def.output_info()) {
+    lifetimes[output_info.name()].second = net_def.op_size();
+  }
+  const char *arena_begin = nullptr;
+  const char *arena_end = nullptr;
+  index_t tensor_bytes = 0;
+  for (auto &lifetime : lifetimes) {
+    const Tensor *tensor = net.GetTensor(lifetime.first.c_str());
+    const char *data = static_cast<const char *>(tensor->raw_data());
+    if (arena_begin == nullptr || data < arena_begin) {
+      arena_begin = data;
+    }
+    if (arena_end == nullptr || data + tensor->raw_size() > arena_end) {
+      arena_end = data + tensor->raw_size();
+    }
+    tensor_bytes += tensor->raw_size();
+  }
+  // some bytes are reused, or there would be nothing to check
+  EXPECT_LT(arena_end - arena_begin, tensor_bytes);
+  for (auto &lhs : lifetimes) {
+    for (auto &rhs : lifetimes) {
+      if (lhs.first >= rhs.first ||
+          lhs.second.first >= rhs.second.second ||
+          rhs.second.first >= lhs.second.second) {
+        continue;
+      }
+      const Tensor *lhs_tensor = net.GetTensor(lhs.first.c_str());
+      const Tensor *rhs_tensor = net.GetTensor(rhs.first.c_str());
+      const char *lhs_data = static_cast<const char *>(lhs_tensor->raw_data());
+      const char *rhs_data = static_cast<const char *>(rhs_tensor->raw_data());
+      EXPECT_TRUE(lhs_data + lhs_tensor->raw_size() <= rhs_data ||
+                  rhs_data + rhs_tensor->raw_size() <= lhs_data)
+          << lhs.first << " and " << rhs.first << " overlap";
+    }
+  }
+}
+
+TEST_F(MemoryOptimizerOpTest, InplaceChain) {
+  const std::vector<index_t> shape = {1, 3, 5, 7};
+  NetDef net_def;
+  AddNetInput("Input", shape, &net_def);
+  AddNetInput("Other", shape, &net_def);
+  net_def.add_output_info()->set_name("Output");
+  AddEltwise("Input", "Other", "A", shape, EltwiseType::SUM, &net_def);
+  AddActivation("A", "B", shape, "TANH", &net_def);
+  AddEltwise("B", "Other", "Output", shape, EltwiseType::PROD, &net_def);
+
+  OpsTestNet net;
+  RunAsUnplanned(net_def, {{"Input", shape}, {"Other", shape}}, &net);
+  // each operation writes over the input which dies there
+  EXPECT_EQ(net.GetTensor("A")->raw_data(), net.GetTensor("B")->raw_data());
+  EXPECT_EQ(net.GetTensor("B")->raw_data(),
+            net.GetTensor("Output")->raw_data());
+}
+
+TEST_F(MemoryOptimizerOpTest, InplaceInputIsOutput) {
+  const std::vector<index_t> shape = {1, 3, 5, 7};
+  NetDef net_def;
+  AddNetInput("Input", shape, &net_def);
+  AddNetInput("Other", shape, &net_def);
+  net_def.add_output_info()->set_name("A");
+  net_def.add_output_info()->set_name("Output");
+  AddEltwise("Input", "Other", "A", shape, EltwiseType::SUB, &net_def);
+  AddActivation("A", "B", shape, "RELU", &net_def);
+  AddEltwise("B", "Other", "Output", shape, EltwiseType::PROD, &net_def);
+
+  OpsTestNet net;
+  RunAsUnplanned(net_def, {{"Input", shape}, {"Other", shape}}, &net);
+}
+
+TEST_F(MemoryOptimizerOpTest, InplaceInputOfSeveralConsumers) {
+  const std::vector<index_t> shape = {1, 3, 5, 7};
+  NetDef net_def;
+  AddNetInput("Input", shape, &net_def);
+  AddNetInput("Other", shape, &net_def);
+  net_def.add_output_info()->set_name("Output");
+  AddEltwise("Input", "Other", "A", shape, EltwiseType::SUB, &net_def);
+  AddActivation("A", "B", shape, "SIGMOID", &net_def);
+  AddEltwise("A", "B", "C", shape, EltwiseType::PROD, &net_def);
+  AddActivation("A", "D", shape, "TANH", &net_def);
+  AddEltwise("C", "D", "Output", shape, EltwiseType::SUM, &net_def);
+
+  OpsTestNet net;
+  RunAsUnplanned(net_def, {{"Input", shape}, {"Other", shape}}, &net);
+}
+
+TEST_F(MemoryOptimizerOpTest, InplaceGraphInput) {
+  const std::vector<index_t> shape = {1, 3, 5, 7};
+  NetDef net_def;
+  AddNetInput("Input", shape, &net_def);
+  AddNetInput("Other", shape, &net_def);
+  net_def.add_output_info()->set_name("Output");
+  AddActivation("Input", "A", shape, "RELU", &net_def);
+  AddEltwise("Other", "A", "B", shape, EltwiseType::SUB, &net_def);
+  AddEltwise("B", "Input", "Output", shape, EltwiseType::SUM, &net_def);
+
+  OpsTestNet net;
+  RunAsUnplanned(net_def, {{"Input", shape}, {"Other", shape}}, &net);
+}
+
+TEST_F(MemoryOptimizerOpTest, ConcatInputReadElsewhere) {
+  const std::vector<index_t> shape = {1, 3, 5, 7};
+  const std::vector<index_t> concat_shape = {1, 6, 5, 7};
+  NetDef net_def;
+  AddNetInput("Input", shape, &net_def);
+  AddNetInput("Other", shape, &net_def);
+  net_def.add_output_info()->set_name("D");
+  net_def.add_output_info()->set_name("E");
+  AddActivation("Input", "A", shape, "RELU", &net_def);
+  AddActivation("Other", "B", shape, "TANH", &net_def);
+  AddConcat("A", "B", "C", concat_shape, &net_def);
+  AddActivation("C", "D", concat_shape, "SIGMOID", &net_def);
+  AddActivation("A", "E", shape, "TANH", &net_def);
+
+  OpsTestNet net;
+  RunAsUnplanned(net_def, {{"Input", shape}, {"Other", shape}}, &net);
+  // A and B are written into C
+  const char *concat_data =
+      static_cast<const char *>(net.GetTensor("C")->raw_data());
+  EXPECT_EQ(concat_data, net.GetTensor("A")->raw_data());
+  EXPECT_EQ(concat_data + net.GetTensor("A")->raw_size(),
+            net.GetTensor("B")->raw_data());
+}
+
+TEST_F(MemoryOptimizerOpTest, ConcatOfGraphInput) {
+  const std::vector<index_t> shape = {1, 3, 5, 7};
+  const std::vector<index_t> concat_shape = {1, 6, 5, 7};
+  NetDef net_def;
+  AddNetInput("Input", shape, &net_def);
+  AddNetInput("Other", shape, &net_def);
+  net_def.add_output_info()->set_name("Output");
+  AddActivation("Other", "A", shape, "TANH", &net_def);
+  AddConcat("Input", "A", "B", concat_shape, &net_def);
+  AddActivation("B", "Output", concat_shape, "RELU", &net_def);
+
+  OpsTestNet net;
+  RunAsUnplanned(net_def, {{"Input", shape}, {"Other", shape}}, &net);
+}
+
+TEST_F(MemoryOptimizerOpTest, SplitThenInplace) {
+  const std::vector<index_t> shape = {1, 6, 5, 7};
+  const std::vector<index_t> split_shape = {1, 3, 5, 7};
+  NetDef net_def;
+  AddNetInput("Input", shape, &net_def);
+  net_def.add_output_info()->set_name("Output");
+  AddActivation("Input", "A", shape, "RELU", &net_def);
+  OpDefBuilder("Split", "SplitOp")
+      .Input("A")
+      .Output("S0")
+      .Output("S1")
+      .OutputShape(split_shape)
+      .OutputShape(split_shape)
+      .AddIntArg("axis", 1)
+      .Finalize(net_def.add_op());
+  AddActivation("S0", "B", split_shape, "TANH", &net_def);
+  AddEltwise("B", "S1", "Output", split_shape, EltwiseType::SUB, &net_def);
+
+  OpsTestNet net;
+  RunAsUnplanned(net_def, {{"Input", shape}}, &net);
+  // the slices are views into A
+  const char *split_data =
+      static_cast<const char *>(net.GetTensor("A")->raw_data());
+  EXPECT_EQ(split_data, net.GetTensor("S0")->raw_data());
+  EXPECT_EQ(split_data + net.GetTensor("S0")->raw_size(),
+            net.GetTensor("S1")->raw_data());
+}
+
+TEST_F(MemoryOptimizerOpTest, SliceInputReadElsewhere) {
+  const std::vector<index_t> shape = {1, 16};
+  const std::vector<index_t> slice_shape = {1, 6};
+  NetDef net_def;
+  AddNetInput("Input", shape, &net_def);
+  net_def.add_output_info()->set_name("B");
+  net_def.add_output_info()->set_name("C");
+  AddActivation("Input", "A", shape, "RELU", &net_def);
+  AddSlice("A", "S", slice_shape, 4, &net_def);
+  AddActivation("A", "B", shape, "TANH", &net_def);
+  AddActivation("S", "C", slice_shape, "SIGMOID", &net_def);
+
+  OpsTestNet net;
+  RunAsUnplanned(net_def, {{"Input", shape}}, &net);
+  // S is a view into A, which neither B nor C may write over
+  const char *slice_data =
+      static_cast<const char *>(net.GetTensor("A")->raw_data());
+  EXPECT_EQ(slice_data + 4 * sizeof(float), net.GetTensor("S")->raw_data());
+  EXPECT_FALSE(DataWithin(&net, "B", "A"));
+  EXPECT_FALSE(DataWithin(&net, "C", "A"));
+}
+
+TEST_F(MemoryOptimizerOpTest, SliceNotContiguous) {
+  const std::vector<index_t> shape = {3, 16};
+  const std::vector<index_t> slice_shape = {3, 6};
+  NetDef net_def;
+  AddNetInput("Input", shape, &net_def);
+  net_def.add_output_info()->set_name("Output");
+  AddActivation("Input", "A", shape, "RELU", &net_def);
+  AddSlice("A", "S", slice_shape, 4, &net_def);
+  AddActivation("S", "Output", slice_shape, "TANH", &net_def);
+
+  OpsTestNet net;
+  RunAsUnplanned(net_def, {{"Input", shape}}, &net);
+  // the rows of the slice are strided in A, so they are copied
+  EXPECT_FALSE(DataWithin(&net, "S", "A"));
+}
+
+TEST_F(MemoryOptimizerOpTest, CropOfInplace) {
+  // the 4D shapes of the net are NHWC, the tensors are NCHW at run time
+  const std::vector<index_t> shape = {1, 6, 5, 4};
+  const std::vector<index_t> crop_shape = {1, 6, 5, 2};
+  const std::vector<index_t> run_shape = {1, 4, 6, 5};
+  const std::vector<index_t> run_crop_shape = {1, 2, 6, 5};
+  NetDef net_def;
+  AddNetInput("Input", shape, &net_def);
+  AddNetInput("Reference", crop_shape, &net_def);
+  net_def.add_output_info()->set_name("Output");
+  AddActivation("Input", "A", shape, "RELU", &net_def);
+  AddActivation("A", "B", shape, "TANH", &net_def);
+  AddCrop("B", "Reference", "C", crop_shape, 1, {1, 0, 0}, &net_def);
+  AddActivation("C", "D", crop_shape, "SIGMOID", &net_def);
+  AddEltwise("D", "C", "Output", crop_shape, EltwiseType::SUB, &net_def);
+
+  OpsTestNet net;
+  RunAsUnplanned(net_def,
+                 {{"Input", run_shape}, {"Reference", run_crop_shape}}, &net);
+  // B is written over A, and C is a view into it from the second channel
+  EXPECT_EQ(net.GetTensor("A")->raw_data(), net.GetTensor("B")->raw_data());
+  const char *crop_data =
+      static_cast<const char *>(net.GetTensor("B")->raw_data());
+  EXPECT_EQ(crop_data + 6 * 5 * sizeof(float),
+            net.GetTensor("C")->raw_data());
+  // the view is not written over in place
+  EXPECT_FALSE(DataWithin(&net, "D", "B"));
+}
+
+TEST_F(MemoryOptimizerOpTest, CropNotContiguous) {
+  const std::vector<index_t> shape = {1, 6, 5, 4};
+  const std::vector<index_t> crop_shape = {1, 3, 5, 4};
+  const std::vector<index_t> run_shape = {1, 4, 6, 5};
+  const std::vector<index_t> run_crop_shape = {1, 4, 3, 5};
+  NetDef net_def;
+  AddNetInput("Input", shape, &net_def);
+  AddNetInput("Reference", crop_shape, &net_def);
+  net_def.add_output_info()->set_name("Output");
+  AddActivation("Input", "A", shape, "RELU", &net_def);
+  AddCrop("A", "Reference", "C", crop_shape, 2, {2, 0}, &net_def);
+  AddActivation("C", "Output", crop_shape, "TANH", &net_def);
+
+  OpsTestNet net;
+  RunAsUnplanned(net_def,
+                 {{"Input", run_shape}, {"Reference", run_crop_shape}}, &net);
+  // the rows of each channel are cropped, so they are copied
+  EXPECT_FALSE(DataWithin(&net, "C", "A"));
+}
+
+TEST_F(MemoryOptimizerOpTest, SplitOfNHWC) {
+  // split along H, which is outer in NCHW as there is one channel
+  const std::vector<index_t> shape = {1, 6, 7, 1};
+  const std::vector<index_t> split_shape = {1, 3, 7, 1};
+  const std::vector<index_t> run_shape = {1, 1, 6, 7};
+  NetDef net_def;
+  AddNetInput("Input", shape, &net_def);
+  net_def.add_output_info()->set_name("Output");
+  AddActivation("Input", "A", shape, "RELU", &net_def);
+  OpDefBuilder("Split", "SplitOp")
+      .Input("A")
+      .Output("S0")
+      .Output("S1")
+      .OutputShape(split_shape)
+      .OutputShape(split_shape)
+      .AddIntArg("axis", 1)
+      .AddIntArg("data_format", DataFormat::NHWC)
+      .Finalize(net_def.add_op());
+  AddEltwise("S0", "S1", "Output", split_shape, EltwiseType::SUB, &net_def);
+
+  OpsTestNet net;
+  RunAsUnplanned(net_def, {{"Input", run_shape}}, &net);
+  const char *split_data =
+      static_cast<const char *>(net.GetTensor("A")->raw_data());
+  EXPECT_EQ(split_data, net.GetTensor("S0")->raw_data());
+  EXPECT_EQ(split_data + net.GetTensor("S0")->raw_size(),
+            net.GetTensor("S1")->raw_data());
+}
+
+TEST_F(MemoryOptimizerOpTest, UnstackThenStack) {
+  const std::vector<index_t> shape = {2, 3, 4};
+  const std::vector<index_t> slice_shape = {3, 4};
+  NetDef net_def;
+  AddNetInput("Input", shape, &net_def);
+  net_def.add_output_info()->set_name("Output");
+  AddActivation("Input", "A", shape, "RELU", &net_def);
+  OpDefBuilder("Unstack", "UnstackOp")
+      .Input("A")
+      .Output("U0")
+      .Output("U1")
+      .OutputShape(slice_shape)
+      .OutputShape(slice_shape)
+      .Finalize(net_def.add_op());
+  AddActivation("U0", "B0", slice_shape, "TANH", &net_def);
+  AddActivation("U1", "B1", slice_shape, "SIGMOID", &net_def);
+  OpDefBuilder("Stack", "StackOp")
+      .Input("B0")
+      .Input("B1")
+      .Output("C")
+      .OutputShape(shape)
+      .Finalize(net_def.add_op());
+  AddActivation("C", "Output", shape, "RELU", &net_def);
+
+  OpsTestNet net;
+  RunAsUnplanned(net_def, {{"Input", shape}}, &net);
+  // U0 and U1 are views into A, B0 and B1 into C
+  const char *unstack_data =
+      static_cast<const char *>(net.GetTensor("A")->raw_data());
+  EXPECT_EQ(unstack_data, net.GetTensor("U0")->raw_data());
+  EXPECT_EQ(unstack_data + net.GetTensor("U0")->raw_size(),
+            net.GetTensor("U1")->raw_data());
+  const char *stack_data =
+      static_cast<const char *>(net.GetTensor("C")->raw_data());
+  EXPECT_EQ(stack_data, net.GetTensor("B0")->raw_data());
+  EXPECT_EQ(stack_data + net.GetTensor("B0")->raw_size(),
+            net.GetTensor("B1")->raw_data());
+}
+
+TEST_F(MemoryOptimizerOpTest, StackInputReadElsewhere) {
+  const std::vector<index_t> shape = {3, 4};
+  const std::vector<index_t> stack_shape = {2, 3, 4};
+  NetDef net_def;
+  AddNetInput("Input", shape, &net_def);
+  AddNetInput("Other", shape, &net_def);
+  net_def.add_output_info()->set_name("D");
+  net_def.add_output_info()->set_name("E");
+  AddActivation("Input", "A", shape, "RELU", &net_def);
+  AddActivation("Other", "B", shape, "TANH", &net_def);
+  OpDefBuilder("Stack", "StackOp")
+      .Input("A")
+      .Input("B")
+      .Output("C")
+      .OutputShape(stack_shape)
+      .Finalize(net_def.add_op());
+  AddActivation("C", "D", stack_shape, "SIGMOID", &net_def);
+  AddActivation("A", "E", shape, "TANH", &net_def);
+
+  OpsTestNet net;
+  RunAsUnplanned(net_def, {{"Input", shape}, {"Other", shape}}, &net);
+  // A and B are written into C
+  const char *stack_data =
+      static_cast<const char *>(net.GetTensor("C")->raw_data());
+  EXPECT_EQ(stack_data, net.GetTensor("A")->raw_data());
+  EXPECT_EQ(stack_data + net.GetTensor("A")->raw_size(),
+            net.GetTensor("B")->raw_data());
+}
+
+TEST_F(MemoryOptimizerOpTest, UnstackNotContiguous) {
+  const std::vector<index_t> shape = {2, 3, 4};
+  const std::vector<index_t> slice_shape = {2, 4};
+  NetDef net_def;
+  AddNetInput("Input", shape, &net_def);
+  net_def.add_output_info()->set_name("Output");
+  AddActivation("Input", "A", shape, "RELU", &net_def);
+  OpDefBuilder("Unstack", "UnstackOp")
+      .Input("A")
+      .Output("U0")
+      .Output("U1")
+      .Output("U2")
+      .OutputShape(slice_shape)
+      .OutputShape(slice_shape)
+      .OutputShape(slice_shape)
+      .AddIntArg("axis", 1)
+      .Finalize(net_def.add_op());
+  AddEltwise("U0", "U2", "B", slice_shape, EltwiseType::SUB, &net_def);
+  AddEltwise("B", "U1", "Output", slice_shape, EltwiseType::PROD, &net_def);
+
+  OpsTestNet net;
+  RunAsUnplanned(net_def, {{"Input", shape}}, &net);
+  // the slices along the inner axis are strided, so they are copied
+  for (auto name : {"U0", "U1", "U2"}) {
+    EXPECT_FALSE(DataWithin(&net, name, "A")) << name;
+  }
+}
+
+}  // namespace test
+}  // namespace ops
+}  // namespace mace
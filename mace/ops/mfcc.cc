@@ -0,0 +1,127 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// This Op computes the mel frequency cepstral coefficients of frames as
+// Kaldi does, from the log mel energies of MelFilterBank.
+// The input is [..., num_mel_bins] and the output [..., num_ceps], the first
+// num_ceps coefficients of the orthonormal DCT-II of each frame, liftered by
+// 1 + cepstral_lifter / 2 * sin(pi * i / cepstral_lifter) unless the lifter
+// is 0. The lifter is folded into the DCT matrix, which a Gemv multiplies
+// with the frames. Each frame is on its own, so the chunks of a stream need
+// no state.
+
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include "mace/core/operator.h"
+
+#ifdef MACE_ENABLE_NEON
+#include "mace/ops/arm/fp32/gemv.h"
+#elif defined(__x86_64__)
+#include "mace/ops/x86/fp32/gemv.h"
+#else
+#include "mace/ops/ref/gemv.h"
+#endif  // MACE_ENABLE_NEON
+
+namespace mace {
+namespace ops {
+
+template <DeviceType D, typename T>
+class MFCCOp;
+
+template <>
+class MFCCOp<DeviceType::CPU, float> : public Operation {
+ public:
+  explicit MFCCOp(OpConstructContext *context)
+      : Operation(context),
+        num_ceps_(Operation::GetOptionalArg<int>("num_ceps", 13)),
+        cepstral_lifter_(
+            Operation::GetOptionalArg<float>("cepstral_lifter", 22)),
+        dct_(GetCPUAllocator(), DT_FLOAT) {
+    MACE_CHECK(num_ceps_ > 0,
+               "MFCC's number of cepstra should be greater than zero.");
+  }
+
+  MaceStatus Run(OpContext *context) override {
+    const Tensor *input = this->Input(0);
+    Tensor *output = this->Output(0);
+    const index_t rank = input->dim_size();
+    MACE_CHECK(rank >= 1, "MFCC only supports input dim size >= 1");
+    const index_t num_mel_bins = input->dim(rank - 1);
+    MACE_CHECK(num_ceps_ <= num_mel_bins,
+               "MFCC's number of cepstra should not be greater than the mel"
+               " bins, ", num_mel_bins);
+    if (dct_.dim_size() != 2 || dct_.dim(1) != num_mel_bins) {
+      MACE_RETURN_IF_ERROR(ComputeDct(num_mel_bins));
+    }
+
+    std::vector<index_t> output_shape = input->shape();
+    output_shape[rank - 1] = num_ceps_;
+    MACE_RETURN_IF_ERROR(output->Resize(output_shape));
+    const index_t frames = input->size() / num_mel_bins;
+    if (frames == 0) {
+      return MaceStatus::MACE_SUCCESS;
+    }
+    return gemv_.Compute(context,
+                         &dct_,
+                         input,
+                         nullptr,
+                         frames,
+                         num_ceps_,
+                         num_mel_bins,
+                         false,
+                         true,
+                         output);
+  }
+
+ private:
+  // the rows of the DCT matrix of Kaldi, times the lifter
+  MaceStatus ComputeDct(const index_t num_mel_bins) {
+    MACE_RETURN_IF_ERROR(dct_.Resize({num_ceps_, num_mel_bins}));
+    Tensor::MappingGuard dct_guard(&dct_);
+    float *dct = dct_.mutable_data<float>();
+    for (index_t k = 0; k < num_ceps_; ++k) {
+      const double lifter = cepstral_lifter_ != 0 ? 1.0 + 0.5 *
+          cepstral_lifter_ * std::sin(M_PI * k / cepstral_lifter_) : 1.0;
+      const double scale =
+          std::sqrt((k == 0 ? 1.0 : 2.0) / num_mel_bins) * lifter;
+      for (index_t n = 0; n < num_mel_bins; ++n) {
+        dct[k * num_mel_bins + n] = static_cast<float>(
+            scale * std::cos(M_PI / num_mel_bins * (n + 0.5) * k));
+      }
+    }
+    return MaceStatus::MACE_SUCCESS;
+  }
+
+  const index_t num_ceps_;
+  const float cepstral_lifter_;
+  // computed for the mel bins of the first run
+  Tensor dct_;
+#ifdef MACE_ENABLE_NEON
+  arm::fp32::Gemv gemv_;
+#elif defined(__x86_64__)
+  x86::fp32::Gemv gemv_;
+#else
+  ref::Gemv<float> gemv_;
+#endif  // MACE_ENABLE_NEON
+};
+
+void RegisterMFCC(OpRegistryBase *op_registry) {
+  MACE_REGISTER_OP(op_registry, "MFCC", MFCCOp,
+                   DeviceType::CPU, float);
+}
+
+}  // namespace ops
+}  // namespace mace
@@ -0,0 +1,91 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cmath>
+#include <vector>
+
+#include "mace/ops/ops_test_util.h"
+
+namespace mace {
+namespace ops {
+namespace test {
+
+class MFCCOpTest : public OpsTestBase {};
+
+namespace {
+void TestMFCC(const std::vector<index_t> &input_shape,
+              const int num_ceps,
+              const float cepstral_lifter) {
+  OpsTestNet net;
+  net.AddRandomInput<CPU, float>("Input", input_shape);
+  OpDefBuilder("MFCC", "MFCCTest")
+      .Input("Input")
+      .Output("Output")
+      .AddIntArg("num_ceps", num_ceps)
+      .AddFloatArg("cepstral_lifter", cepstral_lifter)
+      .Finalize(net.NewOperatorDef());
+  net.RunOp();
+
+  const Tensor *input = net.GetTensor("Input");
+  const index_t num_mel_bins = input_shape.back();
+  const index_t frames = input->size() / num_mel_bins;
+  const float *input_data = input->data<float>();
+  std::vector<float> expected(frames * num_ceps);
+  for (index_t f = 0; f < frames; ++f) {
+    for (int k = 0; k < num_ceps; ++k) {
+      double sum = 0;
+      for (index_t n = 0; n < num_mel_bins; ++n) {
+        sum += input_data[f * num_mel_bins + n] *
+            std::cos(M_PI / num_mel_bins * (n + 0.5) * k);
+      }
+      sum *= std::sqrt((k == 0 ? 1.0 : 2.0) / num_mel_bins);
+      if (cepstral_lifter != 0) {
+        sum *= 1 + 0.5 * cepstral_lifter * std::sin(M_PI * k / cepstral_lifter);
+      }
+      expected[f * num_ceps + k] = static_cast<float>(sum);
+    }
+  }
+  std::vector<index_t> output_shape = input_shape;
+  output_shape.back() = num_ceps;
+  net.AddInputFromArray<CPU, float>("ExpectedOutput", output_shape, expected);
+  ExpectTensorNear<float>(*net.GetOutput("ExpectedOutput"),
+                          *net.GetOutput("Output"), 1e-4, 1e-4);
+}
+}  // namespace
+
+TEST_F(MFCCOpTest, Simple) {
+  TestMFCC({7, 23}, 13, 22);
+  TestMFCC({2, 5, 40}, 40, 0);
+  TestMFCC({1, 80}, 20, 22);
+}
+
+TEST_F(MFCCOpTest, Constant) {
+  // the frames of a constant have its scaled mean as c0 and no other
+  OpsTestNet net;
+  net.AddInputFromArray<CPU, float>("Input", {1, 4}, {2, 2, 2, 2});
+  OpDefBuilder("MFCC", "MFCCTest")
+      .Input("Input")
+      .Output("Output")
+      .AddIntArg("num_ceps", 3)
+      .Finalize(net.NewOperatorDef());
+  net.RunOp();
+
+  net.AddInputFromArray<CPU, float>("ExpectedOutput", {1, 3}, {4, 0, 0});
+  ExpectTensorNear<float>(*net.GetOutput("ExpectedOutput"),
+                          *net.GetOutput("Output"), 1e-5, 1e-5);
+}
+
+}  // namespace test
+}  // namespace ops
+}  // namespace mace
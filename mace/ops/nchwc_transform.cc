@@ -0,0 +1,75 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <vector>
+
+#include "mace/core/cpu_blocked_layout.h"
+#include "mace/core/operator.h"
+#include "mace/ops/arm/nchwc.h"
+
+namespace mace {
+namespace ops {
+
+template <DeviceType D, class T>
+class NCHWcTransformOp;
+
+// NCHW => NCHWc of channel_block, or NCHWc => NCHW if it is 0
+template <>
+class NCHWcTransformOp<DeviceType::CPU, float> : public Operation {
+ public:
+  explicit NCHWcTransformOp(OpConstructContext *context)
+      : Operation(context),
+        channel_block_(Operation::GetOptionalArg<int>(kChannelBlockArg, 0)) {}
+
+  MaceStatus Run(OpContext *context) override {
+    MACE_UNUSED(context);
+    const Tensor *input = this->Input(INPUT);
+    Tensor *output = this->Output(OUTPUT);
+    Tensor::MappingGuard input_guard(input);
+    if (channel_block_ > 0) {
+      MACE_CHECK(input->dim_size() == 4 &&
+                     input->dim(1) % channel_block_ == 0,
+                 "NCHWc needs NCHW channels a multiple of ", channel_block_);
+      MACE_RETURN_IF_ERROR(output->Resize(
+          {input->dim(0), input->dim(1) / channel_block_, input->dim(2),
+           input->dim(3), channel_block_}));
+      Tensor::MappingGuard output_guard(output);
+      BlockChannels(input->data<float>(), input->shape().data(),
+                    channel_block_, output->mutable_data<float>());
+    } else {
+      MACE_CHECK(input->dim_size() == 5, "NCHWc input should be 5D");
+      const int block = static_cast<int>(input->dim(4));
+      const std::vector<index_t> shape = {
+          input->dim(0), input->dim(1) * block, input->dim(2), input->dim(3)};
+      MACE_RETURN_IF_ERROR(output->Resize(shape));
+      Tensor::MappingGuard output_guard(output);
+      UnblockChannels(input->data<float>(), shape.data(), block,
+                      output->mutable_data<float>());
+    }
+    return MaceStatus::MACE_SUCCESS;
+  }
+
+ private:
+  const int channel_block_;
+
+  MACE_OP_INPUT_TAGS(INPUT);
+  MACE_OP_OUTPUT_TAGS(OUTPUT);
+};
+
+void RegisterNCHWcTransform(OpRegistryBase *op_registry) {
+  MACE_REGISTER_OP(op_registry, "NCHWcTransform", NCHWcTransformOp,
+                   DeviceType::CPU, float);
+}
+
+}  // namespace ops
+}  // namespace mace
@@ -0,0 +1,479 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mace/core/nnapi_delegation.h"
+#include "mace/core/operator.h"
+#include "mace/core/runtime/nnapi/nnapi_wrapper.h"
+#include "mace/ops/common/conv_pool_2d_util.h"
+#include "mace/ops/common/transpose.h"
+
+namespace mace {
+namespace ops {
+
+#define MACE_NNAPI_RET_STATUS(stmt)                                  \
+  {                                                                  \
+    int nnapi_result = (stmt);                                       \
+    if (nnapi_result != nnapi::NO_ERROR) {                           \
+      LOG(ERROR) << #stmt << " failed with NNAPI error "             \
+                 << nnapi_result;                                    \
+      return MaceStatus::MACE_OUT_OF_RESOURCES;                      \
+    }                                                                \
+  }
+
+namespace {
+
+const std::vector<int> kNCHWToNHWC = {0, 2, 3, 1};
+const std::vector<int> kNHWCToNCHW = {0, 3, 1, 2};
+
+// the 32 bytes of a compilation cache token of a subgraph, 4 FNV-1a hashes
+// of its ops of different seeds
+void CacheToken(const std::string &key, uint8_t *token) {
+  for (size_t part = 0; part < nnapi::kCacheTokenSize / 8; ++part) {
+    uint64_t hash = 14695981039346656037ULL ^ part;
+    for (unsigned char c : key) {
+      hash = (hash ^ c) * 1099511628211ULL;
+    }
+    for (size_t i = 0; i < 8; ++i) {
+      token[part * 8 + i] = static_cast<uint8_t>(hash >> (i * 8));
+    }
+  }
+}
+
+int32_t FuseCode(const OperatorDef &op) {
+  const std::string activation =
+      ProtoArgHelper::GetOptionalArg<OperatorDef, std::string>(
+          op, "activation", "NOOP");
+  if (activation == "RELU") {
+    return nnapi::FUSED_RELU;
+  } else if (activation == "RELUX") {
+    return ProtoArgHelper::GetOptionalArg<OperatorDef, float>(
+        op, "max_limit", 0.f) == 1.f ? nnapi::FUSED_RELU1
+                                     : nnapi::FUSED_RELU6;
+  }
+  return nnapi::FUSED_NONE;
+}
+
+}  // namespace
+
+// A subgraph of CPU ops handed to NNAPI by DelegateToNNAPI. The NNAPI model
+// is built at the first run, from the shapes of the inputs, and compiled
+// for the drivers of the device, in NHWC like the ops of the converter. The
+// inputs and outputs are transposed from and to the NCHW of the CPU ops.
+template <DeviceType D, class T>
+class NNAPIDelegateOp;
+
+template <>
+class NNAPIDelegateOp<DeviceType::CPU, float> : public Operation {
+ public:
+  explicit NNAPIDelegateOp(OpConstructContext *context)
+      : Operation(context),
+        nnapi_(nnapi::NNAPILibrary::Get()),
+        cache_dir_(Operation::GetOptionalArg<std::string>(
+            kNNAPICacheDirArg, "")) {
+    const int step_count = Operation::GetOptionalArg<int>(kNNAPIStepsArg, 0);
+    MACE_CHECK(step_count > 0, "NNAPI delegate op ", operator_def_->name(),
+               " has no steps");
+    steps_.resize(step_count);
+    for (int i = 0; i < step_count; ++i) {
+      const std::string step = Operation::GetOptionalArg<std::string>(
+          NNAPIStepArgName(i), "");
+      MACE_CHECK(steps_[i].ParseFromString(step),
+                 "invalid step ", i, " of NNAPI delegate op ",
+                 operator_def_->name());
+      cache_key_ += step;
+    }
+  }
+
+  ~NNAPIDelegateOp() {
+    if (compilation_ != nullptr) {
+      nnapi_->ANeuralNetworksCompilation_free(compilation_);
+    }
+    if (model_ != nullptr) {
+      nnapi_->ANeuralNetworksModel_free(model_);
+    }
+  }
+
+  MaceStatus Run(OpContext *context) override {
+    MACE_UNUSED(context);
+    MACE_CHECK(nnapi_->available(), "NNAPI is not available");
+    if (compilation_ == nullptr) {
+      MACE_RETURN_IF_ERROR(Compile());
+    }
+
+    ANeuralNetworksExecution *execution = nullptr;
+    MACE_NNAPI_RET_STATUS(nnapi_->ANeuralNetworksExecution_create(
+        compilation_, &execution));
+    MaceStatus execute_status = Execute(execution);
+    nnapi_->ANeuralNetworksExecution_free(execution);
+    MACE_RETURN_IF_ERROR(execute_status);
+
+    for (size_t i = 0; i < output_shapes_.size(); ++i) {
+      Tensor *output = this->Output(i);
+      MACE_RETURN_IF_ERROR(output->Resize(
+          TransposeShape<int64_t, index_t>(output_shapes_[i], kNHWCToNCHW)));
+      Tensor::MappingGuard output_guard(output);
+      MACE_RETURN_IF_ERROR(Transpose(nhwc_outputs_[i].data(),
+                                     output_shapes_[i], kNHWCToNCHW,
+                                     output->mutable_data<float>()));
+    }
+    return MaceStatus::MACE_SUCCESS;
+  }
+
+ private:
+  MaceStatus Execute(ANeuralNetworksExecution *execution) {
+    for (size_t i = 0; i < input_indices_.size(); ++i) {
+      const Tensor *input = this->Input(input_indices_[i]);
+      const std::vector<int64_t> nhwc_shape =
+          TransposeShape<index_t, int64_t>(input->shape(), kNCHWToNHWC);
+      if (nhwc_shape != input_shapes_[i]) {
+        return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                          "input shape " + MakeString(nhwc_shape) +
+                              " is not the one of the NNAPI model");
+      }
+      Tensor::MappingGuard input_guard(input);
+      MACE_RETURN_IF_ERROR(Transpose(
+          input->data<float>(),
+          std::vector<int64_t>(input->shape().begin(), input->shape().end()),
+          kNCHWToNHWC, nhwc_inputs_[i].data()));
+      MACE_NNAPI_RET_STATUS(nnapi_->ANeuralNetworksExecution_setInput(
+          execution, i, nullptr, nhwc_inputs_[i].data(),
+          nhwc_inputs_[i].size() * sizeof(float)));
+    }
+    for (size_t i = 0; i < nhwc_outputs_.size(); ++i) {
+      MACE_NNAPI_RET_STATUS(nnapi_->ANeuralNetworksExecution_setOutput(
+          execution, i, nullptr, nhwc_outputs_[i].data(),
+          nhwc_outputs_[i].size() * sizeof(float)));
+    }
+    ANeuralNetworksEvent *event = nullptr;
+    MACE_NNAPI_RET_STATUS(nnapi_->ANeuralNetworksExecution_startCompute(
+        execution, &event));
+    const int wait_result = nnapi_->ANeuralNetworksEvent_wait(event);
+    nnapi_->ANeuralNetworksEvent_free(event);
+    MACE_NNAPI_RET_STATUS(wait_result);
+    return MaceStatus::MACE_SUCCESS;
+  }
+
+  uint32_t AddOperand(const int32_t type,
+                      const std::vector<int64_t> &shape) {
+    dims_.emplace_back(shape.begin(), shape.end());
+    nnapi::OperandType operand_type = {
+        type, static_cast<uint32_t>(shape.size()),
+        shape.empty() ? nullptr : dims_.back().data(), 0.f, 0};
+    MACE_CHECK(nnapi_->ANeuralNetworksModel_addOperand(
+        model_, &operand_type) == nnapi::NO_ERROR, "failed to add operand");
+    return operand_count_++;
+  }
+
+  uint32_t AddInt(const int32_t value) {
+    const uint32_t operand = AddOperand(nnapi::INT32, {});
+    MACE_CHECK(nnapi_->ANeuralNetworksModel_setOperandValue(
+        model_, operand, &value, sizeof(value)) == nnapi::NO_ERROR);
+    return operand;
+  }
+
+  uint32_t AddFloat(const float value) {
+    const uint32_t operand = AddOperand(nnapi::FLOAT32, {});
+    MACE_CHECK(nnapi_->ANeuralNetworksModel_setOperandValue(
+        model_, operand, &value, sizeof(value)) == nnapi::NO_ERROR);
+    return operand;
+  }
+
+  // NNAPI refers to values larger than 128 bytes until the model is freed,
+  // so the weights stay in the workspace or in weight_buffers_
+  uint32_t AddWeight(const std::vector<int64_t> &shape, const float *data) {
+    const uint32_t operand = AddOperand(nnapi::TENSOR_FLOAT32, shape);
+    int64_t size = 1;
+    for (auto dim : shape) {
+      size *= dim;
+    }
+    MACE_CHECK(nnapi_->ANeuralNetworksModel_setOperandValue(
+        model_, operand, data, size * sizeof(float)) == nnapi::NO_ERROR);
+    return operand;
+  }
+
+  const Tensor *WeightTensor(const std::string &name) {
+    for (int i = 0; i < operator_def_->input_size(); ++i) {
+      if (operator_def_->input(i) == name) {
+        return this->Input(i);
+      }
+    }
+    LOG(FATAL) << "weight " << name << " is not an input of "
+               << operator_def_->name();
+    return nullptr;
+  }
+
+  // the explicit NNAPI paddings, left, right, top and bottom, which give
+  // the output shape of the step
+  std::vector<int32_t> Paddings(const OperatorDef &op,
+                                const std::vector<int64_t> &input_shape,
+                                const std::vector<int64_t> &output_shape,
+                                const index_t kernel_h,
+                                const index_t kernel_w,
+                                const std::vector<int> &strides) {
+    std::vector<int> paddings =
+        ProtoArgHelper::GetRepeatedArgs<OperatorDef, int>(
+            op, "padding_values");
+    if (paddings.empty()) {
+      const index_t nhwc_input[4] = {input_shape[0], input_shape[1],
+                                     input_shape[2], input_shape[3]};
+      const index_t filter[4] = {output_shape[3], input_shape[3],
+                                 kernel_h, kernel_w};
+      const int dilations[2] = {1, 1};
+      index_t unused_output[4];
+      paddings.resize(2);
+      CalcNHWCPaddingAndOutputSize(
+          nhwc_input, filter, dilations, strides.data(),
+          static_cast<Padding>(ProtoArgHelper::GetOptionalArg<OperatorDef,
+                                                              int>(
+              op, "padding", static_cast<int>(SAME))),
+          unused_output, paddings.data());
+    }
+    const int32_t top = paddings[0] / 2;
+    const int32_t left = paddings[1] / 2;
+    const int32_t bottom = std::max<int32_t>(0, static_cast<int32_t>(
+        (output_shape[1] - 1) * strides[0] + kernel_h - input_shape[1] - top));
+    const int32_t right = std::max<int32_t>(0, static_cast<int32_t>(
+        (output_shape[2] - 1) * strides[1] + kernel_w - input_shape[2] - left));
+    return {left, right, top, bottom};
+  }
+
+  MaceStatus AddStep(const OperatorDef &op) {
+    const std::string &type = op.type();
+    const std::vector<int64_t> output_shape(op.output_shape(0).dims().begin(),
+                                            op.output_shape(0).dims().end());
+    const std::vector<int64_t> &input_shape = shapes_.at(op.input(0));
+    std::vector<uint32_t> inputs;
+    int32_t operation = -1;
+    if (type == "Conv2D" || type == "DepthwiseConv2d") {
+      const Tensor *filter = WeightTensor(op.input(1));
+      const index_t kernel_h = filter->dim(2);
+      const index_t kernel_w = filter->dim(3);
+      const std::vector<int> strides =
+          ProtoArgHelper::GetRepeatedArgs<OperatorDef, int>(
+              op, "strides", {1, 1});
+      const int64_t out_channels = output_shape[3];
+      const float *filter_data = filter->data<float>();
+      weight_buffers_.emplace_back(filter->size());
+      float *nnapi_filter = weight_buffers_.back().data();
+      std::vector<int64_t> filter_shape;
+      if (type == "Conv2D") {
+        // OIHW => OHWI
+        filter_shape = {filter->dim(0), kernel_h, kernel_w, filter->dim(1)};
+        MACE_RETURN_IF_ERROR(Transpose(
+            filter_data,
+            std::vector<int64_t>(filter->shape().begin(),
+                                 filter->shape().end()),
+            kNCHWToNHWC, nnapi_filter));
+      } else {
+        // [M, C, H, W] => [1, H, W, C * M], channel c * M + m
+        const index_t multiplier = filter->dim(0);
+        const index_t channels = filter->dim(1);
+        filter_shape = {1, kernel_h, kernel_w, channels * multiplier};
+        for (index_t m = 0; m < multiplier; ++m) {
+          for (index_t c = 0; c < channels; ++c) {
+            for (index_t k = 0; k < kernel_h * kernel_w; ++k) {
+              nnapi_filter[k * channels * multiplier + c * multiplier + m] =
+                  filter_data[(m * channels + c) * kernel_h * kernel_w + k];
+            }
+          }
+        }
+      }
+      const float *bias_data = nullptr;
+      if (op.input_size() == 3) {
+        bias_data = WeightTensor(op.input(2))->data<float>();
+      } else {
+        weight_buffers_.emplace_back(out_channels, 0.f);
+        bias_data = weight_buffers_.back().data();
+      }
+      inputs.push_back(tensors_.at(op.input(0)));
+      inputs.push_back(AddWeight(filter_shape, nnapi_filter));
+      inputs.push_back(AddWeight({out_channels}, bias_data));
+      for (auto padding : Paddings(op, input_shape, output_shape,
+                                   kernel_h, kernel_w, strides)) {
+        inputs.push_back(AddInt(padding));
+      }
+      inputs.push_back(AddInt(strides[1]));
+      inputs.push_back(AddInt(strides[0]));
+      if (type == "Conv2D") {
+        operation = nnapi::CONV_2D;
+      } else {
+        inputs.push_back(AddInt(static_cast<int32_t>(filter->dim(0))));
+        operation = nnapi::DEPTHWISE_CONV_2D;
+      }
+      inputs.push_back(AddInt(FuseCode(op)));
+    } else if (type == "Pooling") {
+      const std::vector<int> kernels =
+          ProtoArgHelper::GetRepeatedArgs<OperatorDef, int>(op, "kernels");
+      const std::vector<int> strides =
+          ProtoArgHelper::GetRepeatedArgs<OperatorDef, int>(op, "strides");
+      MACE_CHECK(kernels.size() == 2 && strides.size() == 2,
+                 "pooling ", op.name(), " needs kernels and strides");
+      inputs.push_back(tensors_.at(op.input(0)));
+      for (auto padding : Paddings(op, input_shape, output_shape,
+                                   kernels[0], kernels[1], strides)) {
+        inputs.push_back(AddInt(padding));
+      }
+      inputs.push_back(AddInt(strides[1]));
+      inputs.push_back(AddInt(strides[0]));
+      inputs.push_back(AddInt(kernels[1]));
+      inputs.push_back(AddInt(kernels[0]));
+      inputs.push_back(AddInt(nnapi::FUSED_NONE));
+      // PoolingType AVG is 1, MAX is 2
+      operation = ProtoArgHelper::GetOptionalArg<OperatorDef, int>(
+          op, "pooling_type", 0) == 2 ? nnapi::MAX_POOL_2D
+                                      : nnapi::AVERAGE_POOL_2D;
+    } else if (type == "Activation") {
+      const std::string activation =
+          ProtoArgHelper::GetOptionalArg<OperatorDef, std::string>(
+              op, "activation", "NOOP");
+      inputs.push_back(tensors_.at(op.input(0)));
+      if (activation == "TANH") {
+        operation = nnapi::TANH;
+      } else if (activation == "SIGMOID") {
+        operation = nnapi::LOGISTIC;
+      } else {
+        const int32_t fuse_code = FuseCode(op);
+        operation = fuse_code == nnapi::FUSED_RELU ? nnapi::RELU :
+            fuse_code == nnapi::FUSED_RELU1 ? nnapi::RELU1 : nnapi::RELU6;
+      }
+    } else if (type == "Eltwise") {
+      inputs.push_back(tensors_.at(op.input(0)));
+      inputs.push_back(tensors_.at(op.input(1)));
+      inputs.push_back(AddInt(nnapi::FUSED_NONE));
+      // EltwiseType SUM is 0, PROD is 2
+      operation = ProtoArgHelper::GetOptionalArg<OperatorDef, int>(
+          op, "type", 0) == 2 ? nnapi::MUL : nnapi::ADD;
+    } else if (type == "Softmax") {
+      inputs.push_back(tensors_.at(op.input(0)));
+      inputs.push_back(AddFloat(1.f));
+      operation = nnapi::SOFTMAX;
+    } else if (type == "Concat") {
+      for (auto &input : op.input()) {
+        inputs.push_back(tensors_.at(input));
+      }
+      int axis = ProtoArgHelper::GetOptionalArg<OperatorDef, int>(
+          op, "axis", 3);
+      inputs.push_back(AddInt(axis < 0 ? axis + 4 : axis));
+      operation = nnapi::CONCATENATION;
+    } else {
+      return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                        "NNAPI does not run " + type);
+    }
+
+    const uint32_t output = AddOperand(nnapi::TENSOR_FLOAT32, output_shape);
+    tensors_[op.output(0)] = output;
+    shapes_[op.output(0)] = output_shape;
+    MACE_NNAPI_RET_STATUS(nnapi_->ANeuralNetworksModel_addOperation(
+        model_, operation, static_cast<uint32_t>(inputs.size()),
+        inputs.data(), 1, &output));
+    return MaceStatus::MACE_SUCCESS;
+  }
+
+  MaceStatus Compile() {
+    MACE_NNAPI_RET_STATUS(nnapi_->ANeuralNetworksModel_create(&model_));
+    std::vector<uint32_t> model_inputs;
+    for (int i = 0; i < operator_def_->input_size(); ++i) {
+      const Tensor *input = this->Input(i);
+      if (input->is_weight()) {
+        continue;
+      }
+      const std::vector<int64_t> nhwc_shape =
+          TransposeShape<index_t, int64_t>(input->shape(), kNCHWToNHWC);
+      const uint32_t operand = AddOperand(nnapi::TENSOR_FLOAT32, nhwc_shape);
+      tensors_[operator_def_->input(i)] = operand;
+      shapes_[operator_def_->input(i)] = nhwc_shape;
+      model_inputs.push_back(operand);
+      input_indices_.push_back(i);
+      input_shapes_.push_back(nhwc_shape);
+      nhwc_inputs_.emplace_back(input->size());
+    }
+    for (auto &step : steps_) {
+      MACE_RETURN_IF_ERROR(AddStep(step));
+    }
+    std::vector<uint32_t> model_outputs;
+    for (int i = 0; i < operator_def_->output_size(); ++i) {
+      const std::string &name = operator_def_->output(i);
+      model_outputs.push_back(tensors_.at(name));
+      output_shapes_.push_back(shapes_.at(name));
+      int64_t size = 1;
+      for (auto dim : output_shapes_.back()) {
+        size *= dim;
+      }
+      nhwc_outputs_.emplace_back(size);
+    }
+    MACE_NNAPI_RET_STATUS(
+        nnapi_->ANeuralNetworksModel_identifyInputsAndOutputs(
+            model_, static_cast<uint32_t>(model_inputs.size()),
+            model_inputs.data(), static_cast<uint32_t>(model_outputs.size()),
+            model_outputs.data()));
+    MACE_NNAPI_RET_STATUS(nnapi_->ANeuralNetworksModel_finish(model_));
+
+    MACE_NNAPI_RET_STATUS(nnapi_->ANeuralNetworksCompilation_create(
+        model_, &compilation_));
+    MACE_NNAPI_RET_STATUS(nnapi_->ANeuralNetworksCompilation_setPreference(
+        compilation_, nnapi::PREFER_FAST_SINGLE_ANSWER));
+    if (!cache_dir_.empty() && nnapi_->has_caching()) {
+      // the shapes of the inputs are part of the compiled model
+      std::string key = cache_key_;
+      for (auto &shape : input_shapes_) {
+        key += MakeString(shape);
+      }
+      uint8_t token[nnapi::kCacheTokenSize];
+      CacheToken(key, token);
+      MACE_NNAPI_RET_STATUS(nnapi_->ANeuralNetworksCompilation_setCaching(
+          compilation_, cache_dir_.c_str(), token));
+    }
+    MACE_NNAPI_RET_STATUS(
+        nnapi_->ANeuralNetworksCompilation_finish(compilation_));
+    VLOG(1) << "Compiled " << steps_.size() << " ops of "
+            << operator_def_->name() << " with NNAPI";
+    return MaceStatus::MACE_SUCCESS;
+  }
+
+  nnapi::NNAPILibrary *nnapi_;
+  std::string cache_dir_;
+  std::string cache_key_;
+  std::vector<OperatorDef> steps_;
+
+  ANeuralNetworksModel *model_ = nullptr;
+  ANeuralNetworksCompilation *compilation_ = nullptr;
+  uint32_t operand_count_ = 0;
+  // the operands and the NHWC shapes of the tensors of the model
+  std::unordered_map<std::string, uint32_t> tensors_;
+  std::unordered_map<std::string, std::vector<int64_t>> shapes_;
+  // the dims of the operands, referred to by NNAPI when they are added
+  std::vector<std::vector<uint32_t>> dims_;
+  std::vector<std::vector<float>> weight_buffers_;
+
+  std::vector<int> input_indices_;
+  std::vector<std::vector<int64_t>> input_shapes_;
+  std::vector<std::vector<int64_t>> output_shapes_;
+  std::vector<std::vector<float>> nhwc_inputs_;
+  std::vector<std::vector<float>> nhwc_outputs_;
+};
+
+#undef MACE_NNAPI_RET_STATUS
+
+void RegisterNNAPIDelegate(OpRegistryBase *op_registry) {
+  MACE_REGISTER_OP(op_registry, kNNAPIDelegateOpType, NNAPIDelegateOp,
+                   DeviceType::CPU, float);
+}
+
+}  // namespace ops
+}  // namespace mace
@@ -0,0 +1,148 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/core/nnapi_delegation.h"
+#include "mace/ops/common/conv_pool_2d_util.h"
+#include "mace/ops/ops_test_util.h"
+
+namespace mace {
+namespace ops {
+namespace test {
+
+class NNAPIDelegateOpTest : public OpsTestBase {};
+
+namespace {
+
+// Conv2D -> Activation -> Pooling(MAX) -> Pad -> Pooling(AVG)
+NetDef ConvNet(OpsTestNet *net, const std::vector<int> &dilations) {
+  net->AddRandomInput<DeviceType::CPU, float>("Filter", {16, 3, 3, 3}, true);
+  net->AddRandomInput<DeviceType::CPU, float>("Bias", {16}, true);
+  NetDef net_def;
+  AddNetInput("Input", {1, 8, 8, 3}, &net_def);
+  net_def.add_output_info()->set_name("Output");
+  OpDefBuilder("Conv2D", "ConvTest")
+      .Input("Input")
+      .Input("Filter")
+      .Input("Bias")
+      .Output("ConvOutput")
+      .OutputShape({1, 8, 8, 16})
+      .AddIntsArg("strides", {1, 1})
+      .AddIntArg("padding", Padding::SAME)
+      .AddIntsArg("dilations", dilations)
+      .AddIntArg("data_format", NHWC)
+      .Finalize(net_def.add_op());
+  OpDefBuilder("Activation", "ReluTest")
+      .Input("ConvOutput")
+      .Output("ReluOutput")
+      .OutputShape({1, 8, 8, 16})
+      .AddStringArg("activation", "RELU")
+      .AddIntArg("data_format", NHWC)
+      .Finalize(net_def.add_op());
+  OpDefBuilder("Pooling", "MaxPoolTest")
+      .Input("ReluOutput")
+      .Output("PoolOutput")
+      .OutputShape({1, 4, 4, 16})
+      .AddIntArg("pooling_type", 2)
+      .AddIntsArg("kernels", {2, 2})
+      .AddIntsArg("strides", {2, 2})
+      .AddIntArg("padding", Padding::VALID)
+      .AddIntArg("data_format", NHWC)
+      .Finalize(net_def.add_op());
+  OpDefBuilder("Pad", "PadTest")
+      .Input("PoolOutput")
+      .Output("PadOutput")
+      .OutputShape({1, 6, 6, 16})
+      .AddIntsArg("paddings", {0, 0, 1, 1, 1, 1, 0, 0})
+      .AddIntArg("data_format", NHWC)
+      .Finalize(net_def.add_op());
+  OpDefBuilder("Pooling", "AvgPoolTest")
+      .Input("PadOutput")
+      .Output("Output")
+      .OutputShape({1, 3, 3, 16})
+      .AddIntArg("pooling_type", 1)
+      .AddIntsArg("kernels", {2, 2})
+      .AddIntsArg("strides", {2, 2})
+      .AddIntArg("padding", Padding::VALID)
+      .AddIntArg("data_format", NHWC)
+      .Finalize(net_def.add_op());
+  return net_def;
+}
+
+}  // namespace
+
+TEST_F(NNAPIDelegateOpTest, DelegatesConvRuns) {
+  OpsTestNet net;
+  NetDef net_def = ConvNet(&net, {1, 1});
+  MACE_CHECK(DelegateToNNAPI(net.ws(), "/data/local/tmp", &net_def) ==
+      MaceStatus::MACE_SUCCESS);
+
+  // the run of the conv is delegated, the pooling after Pad has no conv
+  ASSERT_EQ(3, net_def.op_size());
+  const OperatorDef &delegate = net_def.op(0);
+  EXPECT_EQ(kNNAPIDelegateOpType, delegate.type());
+  EXPECT_EQ("Pad", net_def.op(1).type());
+  EXPECT_EQ("Pooling", net_def.op(2).type());
+
+  // the activations come first, then the weights
+  ASSERT_EQ(3, delegate.input_size());
+  EXPECT_EQ("Input", delegate.input(0));
+  EXPECT_EQ("Filter", delegate.input(1));
+  EXPECT_EQ("Bias", delegate.input(2));
+  ASSERT_EQ(1, delegate.output_size());
+  EXPECT_EQ("PoolOutput", delegate.output(0));
+  ASSERT_EQ(1, delegate.output_shape_size());
+  EXPECT_EQ(4, delegate.output_shape(0).dims(1));
+
+  EXPECT_EQ(3, (ProtoArgHelper::GetOptionalArg<OperatorDef, int>(
+      delegate, kNNAPIStepsArg, 0)));
+  EXPECT_EQ("/data/local/tmp",
+            (ProtoArgHelper::GetOptionalArg<OperatorDef, std::string>(
+                delegate, kNNAPICacheDirArg, "")));
+  OperatorDef step;
+  ASSERT_TRUE(step.ParseFromString(
+      ProtoArgHelper::GetOptionalArg<OperatorDef, std::string>(
+          delegate, NNAPIStepArgName(0), "")));
+  EXPECT_EQ("Conv2D", step.type());
+}
+
+TEST_F(NNAPIDelegateOpTest, KeepsTensorsReadOutside) {
+  OpsTestNet net;
+  NetDef net_def = ConvNet(&net, {1, 1});
+  net_def.add_output_info()->set_name("ConvOutput");
+  MACE_CHECK(DelegateToNNAPI(net.ws(), "", &net_def) ==
+      MaceStatus::MACE_SUCCESS);
+
+  ASSERT_EQ(3, net_def.op_size());
+  const OperatorDef &delegate = net_def.op(0);
+  ASSERT_EQ(2, delegate.output_size());
+  EXPECT_EQ("ConvOutput", delegate.output(0));
+  EXPECT_EQ("PoolOutput", delegate.output(1));
+}
+
+TEST_F(NNAPIDelegateOpTest, KeepsUnsupportedOps) {
+  OpsTestNet net;
+  // NNAPI 1.0 has no dilated convolution, so no run has a conv
+  NetDef net_def = ConvNet(&net, {2, 2});
+  MACE_CHECK(DelegateToNNAPI(net.ws(), "", &net_def) ==
+      MaceStatus::MACE_SUCCESS);
+
+  ASSERT_EQ(5, net_def.op_size());
+  for (auto &op : net_def.op()) {
+    EXPECT_NE(kNNAPIDelegateOpType, op.type());
+  }
+}
+
+}  // namespace test
+}  // namespace ops
+}  // namespace mace
@@ -217,6 +217,7 @@ MaceStatus TransformArgument(
         cl::NDRange(lws), nullptr, &event);
   }
   MACE_CL_RET_STATUS(error);
+  runtime->RecordKernel(*kernel, &gws, &lws, 1, event);
   MACE_OUT_OF_RANGE_VALIDATION
   if (context->future() != nullptr) {
     context->future()->wait_fn = [runtime, event](CallStats *stats) {
@@ -31,7 +31,7 @@ namespace buffer {
 namespace conv2d {
 
 extern MaceStatus Conv2d1x1(OpContext *context,
-                            cl::Kernel *kernel,
+                            cl::Kernel *kernels[2],
                             const Tensor *padded_input,
                             const Tensor *filter,
                             const Tensor *bias,
@@ -78,6 +78,8 @@ class Conv2dKernel : public OpenCLConv2dKernel {
       const Tensor *input,
       const Tensor *filter,
       const Tensor *bias,
+      const Tensor *residual,
+      const int depth_to_space,
       const int *strides,
       const Padding &padding_type,
       const std::vector<int> &padding_data,
@@ -90,7 +92,7 @@ class Conv2dKernel : public OpenCLConv2dKernel {
 
  private:
   index_t old_scratch_size_;
-  cl::Kernel kernels_[2];
+  cl::Kernel kernels_[3];
   uint32_t kwg_size_;
   std::vector<index_t> input_shape_;
 };
@@ -118,6 +120,8 @@ MaceStatus Conv2dKernel<T>::Compute(
       const Tensor *input,
       const Tensor *filter,
       const Tensor *bias,
+      const Tensor *residual,
+      const int depth_to_space,
       const int *strides,
       const Padding &padding_type,
       const std::vector<int> &padding_data,
@@ -128,6 +132,10 @@ MaceStatus Conv2dKernel<T>::Compute(
       const int winograd_blk_size,
       Tensor *output) {
   MACE_UNUSED(winograd_blk_size);
+  MACE_CHECK(residual == nullptr,
+             "OpenCL buffer conv2d with residual is not implemented");
+  MACE_CHECK(depth_to_space == 1,
+             "OpenCL buffer conv2d with depth to space is not implemented");
   StatsFuture pad_future, conv_future;
   index_t filter_h = filter->dim(2);
   index_t filter_w = filter->dim(3);
@@ -223,8 +231,9 @@ MaceStatus Conv2dKernel<T>::Compute(
 
   if (use_1x1) {
     conv_func = [&](const Tensor *pad_input, Tensor *output) -> MaceStatus {
+      cl::Kernel *kernels[2] = {&kernels_[1], &kernels_[2]};
       return conv2d::Conv2d1x1(
-          context, &kernels_[1], pad_input, filter, bias, strides,
+          context, kernels, pad_input, filter, bias, strides,
           DataTypeToEnum<T>::v(), activation, relux_max_limit,
           leakyrelu_coefficient, input_changed, output, &conv_future);
     };
@@ -23,8 +23,13 @@ namespace opencl {
 namespace buffer {
 namespace conv2d {
 
+namespace {
+// the work group size conv2d_gemm in conv_2d_1x1_buffer.cl is written for
+const uint32_t kGemmLocalWS[2] = {8, 8};
+}  // namespace
+
 MaceStatus Conv2d1x1(OpContext *context,
-                     cl::Kernel *kernel,
+                     cl::Kernel *kernels[2],
                      const Tensor *padded_input,
                      const Tensor *filter,
                      const Tensor *bias,
@@ -43,6 +48,9 @@ MaceStatus Conv2d1x1(OpContext *context,
 
   const index_t in_height = padded_input->dim(1);
   const index_t in_width = padded_input->dim(2);
+  const index_t out_pixels = batch * height * width;
+  cl::Kernel *kernel = kernels[0];
+  cl::Kernel *gemm_kernel = kernels[1];
 
   auto runtime = context->device()->gpu_runtime()->opencl_runtime();
   MACE_OUT_OF_RANGE_DEFINITION;
@@ -79,15 +87,31 @@ MaceStatus Conv2d1x1(OpContext *context,
         LOG(FATAL) << "Unknown activation type: " << activation;
     }
 
+    std::string gemm_kernel_name = MACE_OBFUSCATE_SYMBOL("conv2d_gemm");
+    built_options.emplace("-Dconv2d_gemm=" + gemm_kernel_name);
+
     MACE_RETURN_IF_ERROR(runtime->BuildKernel("conv_2d_1x1_buffer",
                                               kernel_name,
                                               built_options, kernel));
+    // the direct kernel is always usable, so the gemm one is optional
+    if (runtime->BuildKernel("conv_2d_1x1_buffer", gemm_kernel_name,
+                             built_options, gemm_kernel)
+        != MaceStatus::MACE_SUCCESS) {
+      LOG(WARNING) << "Build conv2d gemm kernel failed, use direct kernel";
+      *gemm_kernel = cl::Kernel();
+    }
   }
+  const bool has_gemm_kernel = gemm_kernel->get() != nullptr;
 
   const uint32_t gws[2] = {static_cast<uint32_t>(
                                RoundUpDiv4(channel) *
                                    RoundUpDiv<index_t>(width, 2)),
                            static_cast<uint32_t>(height * batch)};
+  const uint32_t gemm_gws[2] = {
+      RoundUp<uint32_t>(static_cast<uint32_t>(RoundUpDiv4(channel)),
+                        kGemmLocalWS[0]),
+      RoundUp<uint32_t>(static_cast<uint32_t>(RoundUpDiv4(out_pixels)),
+                        kGemmLocalWS[1])};
 
   MACE_OUT_OF_RANGE_INIT(*kernel);
   if (input_changed) {
@@ -113,13 +137,49 @@ MaceStatus Conv2d1x1(OpContext *context,
     kernel->setArg(idx++, leakyrelu_coefficient);
     kernel->setArg(idx++, *(output->opencl_buffer()));
   }
+  if (has_gemm_kernel) {
+    // both kernels write the same output, so they share the check flag
+    if (runtime->IsOutOfRangeCheckEnabled()) {
+      gemm_kernel->setArg(0,
+          *(static_cast<cl::Buffer *>(oorc_flag->buffer())));
+    }
+    if (input_changed) {
+      uint32_t idx = 0;
+      MACE_BUFF_OUT_OF_RANGE_SET_ARGS(*gemm_kernel, output->size());
+      gemm_kernel->setArg(idx++, *(padded_input->opencl_buffer()));
+      gemm_kernel->setArg(idx++, *(filter->opencl_buffer()));
+      if (bias != nullptr) {
+        gemm_kernel->setArg(idx++, *(bias->opencl_buffer()));
+      }
+      gemm_kernel->setArg(idx++, static_cast<int32_t>(in_height));
+      gemm_kernel->setArg(idx++, static_cast<int32_t>(in_width));
+      gemm_kernel->setArg(idx++, static_cast<int32_t>(padded_input->dim(3)));
+      gemm_kernel->setArg(idx++,
+                          static_cast<int32_t>(filter->buffer_shape()[3]));
+      gemm_kernel->setArg(idx++, static_cast<int32_t>(out_pixels));
+      gemm_kernel->setArg(idx++, static_cast<int32_t>(height));
+      gemm_kernel->setArg(idx++, static_cast<int32_t>(width));
+      gemm_kernel->setArg(idx++, static_cast<int32_t>(channel));
+      gemm_kernel->setArg(idx++, strides[0]);
+      gemm_kernel->setArg(idx++, strides[1]);
+      gemm_kernel->setArg(idx++, relux_max_limit);
+      gemm_kernel->setArg(idx++, leakyrelu_coefficient);
+      gemm_kernel->setArg(idx++, *(output->opencl_buffer()));
+    }
+  }
 
   std::string tuning_key =
       Concat("conv2d_1x1_buffer", output->dim(0), output->dim(1),
              output->dim(2), output->dim(3));
-  std::vector<uint32_t> lws = {16, 4, 0};
-  MACE_RETURN_IF_ERROR(TuningOrRun2DKernel(runtime, *kernel, tuning_key, gws,
-                                           lws, future));
+  std::vector<Kernel2DVariant> variants = {
+      {kernel, {gws[0], gws[1]}, {}}};
+  if (has_gemm_kernel) {
+    variants.push_back({gemm_kernel, {gemm_gws[0], gemm_gws[1]},
+                        {kGemmLocalWS[0], kGemmLocalWS[1]}});
+  }
+  std::vector<uint32_t> params = {16, 4, 0, 0};
+  MACE_RETURN_IF_ERROR(TuningOrRunVariant2DKernel(runtime, tuning_key,
+                                                  variants, params, future));
   MACE_OUT_OF_RANGE_VALIDATION;
   return MaceStatus::MACE_SUCCESS;
 }
@@ -0,0 +1,188 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef MACE_OPS_OPENCL_BUFFER_ELTWISE_H_
+#define MACE_OPS_OPENCL_BUFFER_ELTWISE_H_
+
+#include "mace/ops/opencl/eltwise.h"
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include "mace/core/op_context.h"
+#include "mace/core/tensor.h"
+#include "mace/ops/common/eltwise_type.h"
+#include "mace/ops/opencl/helper.h"
+
+namespace mace {
+namespace ops {
+namespace opencl {
+namespace buffer {
+
+// Eltwise of NHWC buffers of up to 4 dims, which broadcasts either input
+// along any of its dims of 1, aligned to the right.
+template <typename T>
+class EltwiseKernel : public OpenCLEltwiseKernel {
+ public:
+  explicit EltwiseKernel(
+      const EltwiseType type,
+      const std::vector<float> &coeff,
+      const float scalar_input,
+      const int32_t scalar_input_index)
+      : type_(type),
+        coeff_(coeff),
+        scalar_input_(scalar_input),
+        scalar_input_index_(scalar_input_index) {}
+  MaceStatus Compute(
+      OpContext *context,
+      const Tensor *input0,
+      const Tensor *input1,
+      Tensor *output) override;
+
+ private:
+  EltwiseType type_;
+  std::vector<float> coeff_;
+  float scalar_input_;
+  int32_t scalar_input_index_;
+  cl::Kernel kernel_;
+  uint32_t kwg_size_;
+  std::vector<index_t> input_shape_;
+  std::vector<index_t> input1_shape_;
+};
+
+// The strides of the input in the 4-D output, with 0 on its broadcast dims.
+inline std::vector<int32_t> EltwiseInputStrides(
+    const std::vector<index_t> &shape) {
+  std::vector<index_t> shape4(4 - shape.size(), 1);
+  shape4.insert(shape4.end(), shape.begin(), shape.end());
+  std::vector<int32_t> strides(4);
+  index_t stride = 1;
+  for (int i = 3; i >= 0; --i) {
+    strides[i] = shape4[i] == 1 ? 0 : static_cast<int32_t>(stride);
+    stride *= shape4[i];
+  }
+  return strides;
+}
+
+template <typename T>
+MaceStatus EltwiseKernel<T>::Compute(
+    OpContext *context,
+    const Tensor *input0,
+    const Tensor *input1,
+    Tensor *output) {
+  MACE_CHECK(type_ != EltwiseType::EQUAL)
+    << "Eltwise op on GPU does not support EQUAL";
+  MACE_CHECK(input0->dim_size() <= 4)
+    << "Eltwise op on GPU buffer supports up to 4-D inputs, but got "
+    << MakeString(input0->shape());
+  std::vector<index_t> output_shape = input0->shape();
+  if (input1 != nullptr) {
+    MACE_CHECK(input1->dim_size() <= 4 &&
+               input0->dtype() == input1->dtype() &&
+               EltwiseBroadcastShape(input0->shape(), input1->shape(),
+                                     &output_shape))
+      << "Inputs not match the broadcast logic, "
+      << MakeString(input0->shape()) << " vs "
+      << MakeString(input1->shape());
+  }
+  MACE_RETURN_IF_ERROR(output->Resize(output_shape));
+
+  std::vector<index_t> shape4(4 - output_shape.size(), 1);
+  shape4.insert(shape4.end(), output_shape.begin(), output_shape.end());
+  const index_t batch = shape4[0];
+  const index_t height = shape4[1];
+  const index_t width = shape4[2];
+  const index_t channels = shape4[3];
+
+  const index_t channel_blocks = RoundUpDiv4(channels);
+
+  auto runtime = context->device()->gpu_runtime()->opencl_runtime();
+  MACE_OUT_OF_RANGE_DEFINITION
+
+  if (kernel_.get() == nullptr) {
+    std::set<std::string> built_options;
+    MACE_OUT_OF_RANGE_CONFIG;
+    MACE_NON_UNIFORM_WG_CONFIG;
+    std::string kernel_name = MACE_OBFUSCATE_SYMBOL("eltwise");
+    built_options.emplace("-Deltwise=" + kernel_name);
+    auto dt = DataTypeToEnum<T>::value;
+    built_options.emplace("-DIN_DATA_TYPE=" + DtToCLDt(input0->dtype()));
+    built_options.emplace("-DOUT_DATA_TYPE=" + DtToCLDt(dt));
+    built_options.emplace("-DDATA_TYPE=" + DtToUpCompatibleCLDt(dt));
+    built_options.emplace(MakeString("-DELTWISE_TYPE=", type_));
+    if (input1 == nullptr) built_options.emplace("-DINPUT_SCALAR");
+    if (scalar_input_index_ == 0) built_options.emplace("-DSWAPPED");
+    if (!coeff_.empty()) built_options.emplace("-DCOEFF_SUM");
+    MACE_RETURN_IF_ERROR(runtime->BuildKernel("eltwise_buffer", kernel_name,
+                                              built_options, &kernel_));
+
+    kwg_size_ =
+        static_cast<uint32_t>(runtime->GetKernelMaxWorkGroupSize(kernel_));
+  }
+
+  const uint32_t gws[3] = {static_cast<uint32_t>(channel_blocks),
+                           static_cast<uint32_t>(width),
+                           static_cast<uint32_t>(height * batch)};
+
+  MACE_OUT_OF_RANGE_INIT(kernel_);
+  if (!IsVecEqual(input_shape_, input0->shape()) ||
+      (input1 != nullptr && !IsVecEqual(input1_shape_, input1->shape()))) {
+    int idx = 0;
+    MACE_BUFF_OUT_OF_RANGE_SET_ARGS(kernel_, output->size());
+    MACE_SET_3D_GWS_ARGS(kernel_, gws);
+    kernel_.setArg(idx++, *(input0->opencl_buffer()));
+    if (input1 == nullptr) {
+      kernel_.setArg(idx++, scalar_input_);
+    } else {
+      kernel_.setArg(idx++, *(input1->opencl_buffer()));
+    }
+    kernel_.setArg(idx++, static_cast<int32_t>(height));
+    kernel_.setArg(idx++, static_cast<int32_t>(channels));
+    for (int32_t stride : EltwiseInputStrides(input0->shape())) {
+      kernel_.setArg(idx++, stride);
+    }
+    if (input1 != nullptr) {
+      for (int32_t stride : EltwiseInputStrides(input1->shape())) {
+        kernel_.setArg(idx++, stride);
+      }
+    }
+    if (!coeff_.empty()) {
+      kernel_.setArg(idx++, coeff_[0]);
+      kernel_.setArg(idx++, coeff_[1]);
+    }
+    kernel_.setArg(idx++, *(output->opencl_buffer()));
+
+    input_shape_ = input0->shape();
+    if (input1 != nullptr) {
+      input1_shape_ = input1->shape();
+    }
+  }
+
+  const std::vector<uint32_t> lws = Default3DLocalWS(runtime, gws, kwg_size_);
+  std::string tuning_key =
+      Concat("eltwise_opencl_kernel", "buffer", batch, height, width,
+             channels);
+  MACE_RETURN_IF_ERROR(TuningOrRun3DKernel(runtime, kernel_, tuning_key,
+                                           gws, lws, context->future()));
+
+  MACE_OUT_OF_RANGE_VALIDATION
+  return MaceStatus::MACE_SUCCESS;
+}
+
+}  // namespace buffer
+}  // namespace opencl
+}  // namespace ops
+}  // namespace mace
+
+#endif  // MACE_OPS_OPENCL_BUFFER_ELTWISE_H_
@@ -90,6 +90,9 @@ MaceStatus PoolingKernel<T>::Compute(
   }
 
   MACE_RETURN_IF_ERROR(output->Resize(output_shape));
+  // the quantized output uses the same scale and zero point with the input
+  output->SetScale(input->scale());
+  output->SetZeroPoint(input->zero_point());
 
   // Mark whether input changed or not
   bool input_changed = !IsVecEqual(input_shape_, input->shape());
@@ -145,7 +148,8 @@ MaceStatus PoolingKernel<T>::Compute(
     std::string kernel_name = MACE_OBFUSCATE_SYMBOL("pooling");
     built_options.emplace("-Dpooling=" + kernel_name);
 
-    if (pooling_type == MAX && input->dtype() == output->dtype()) {
+    if (pooling_type == MAX && input->dtype() == output->dtype() &&
+        dt != DT_UINT8) {
       built_options.emplace("-DIN_DATA_TYPE=" +
           DtToCLDt(input->dtype()));
       built_options.emplace("-DOUT_DATA_TYPE=" + DtToCLDt(dt));
@@ -159,6 +163,9 @@ MaceStatus PoolingKernel<T>::Compute(
     if (pooling_type == AVG) {
       built_options.emplace("-DPOOL_AVG");
     }
+    if (dt == DT_UINT8) {
+      built_options.emplace("-DQUANTIZED");
+    }
     MACE_RETURN_IF_ERROR(runtime->BuildKernel("pooling_buffer",
                                               kernel_name,
                                               built_options,
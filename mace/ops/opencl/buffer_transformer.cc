@@ -14,6 +14,10 @@
 
 #include "mace/ops/opencl/buffer_transformer.h"
 
+#include "mace/core/runtime/opencl/opencl_util.h"
+#include "mace/core/workspace.h"
+#include "mace/ops/opencl/helper.h"
+
 namespace mace {
 namespace ops {
 
@@ -23,5 +27,45 @@ std::string TransformedFilterName(const std::string &name) {
   return name + postfix;
 }
 
+MaceStatus TransformFilterImage(OpContext *context,
+                                const Tensor *filter,
+                                const OpenCLBufferType type,
+                                const int wino_blk_size,
+                                const std::function<MaceStatus()> &transform,
+                                Tensor *output) {
+  PackedWeights *packed_weights = context->workspace()->packed_weights();
+  if (!packed_weights->persistent()) {
+    return transform();
+  }
+  std::vector<size_t> image_shape;
+  OpenCLUtil::CalImage2DShape(FormatBufferShape(filter->shape(), type), type,
+                              &image_shape, wino_blk_size);
+  // the pixels are read and written tightly packed, so they do not depend
+  // on the row pitch of the device
+  const size_t bytes =
+      image_shape[0] * image_shape[1] * 4 * GetEnumTypeSize(output->dtype());
+  const std::string layout = MakeString(
+      "gpu_image_", static_cast<int>(type), "_", wino_blk_size, "_",
+      static_cast<int>(output->dtype()), "_", image_shape[0], "x",
+      image_shape[1]);
+  Allocator *allocator = context->device()->allocator();
+
+  const std::vector<unsigned char> *pixels =
+      packed_weights->Find(layout, filter);
+  if (pixels != nullptr && pixels->size() == bytes) {
+    VLOG(2) << "Write the cached image of " << filter->name();
+    MACE_RETURN_IF_ERROR(output->ResizeImage(filter->shape(), image_shape));
+    return allocator->WriteImage(output->UnderlyingBuffer()->buffer(),
+                                 image_shape, pixels->data());
+  }
+
+  MACE_RETURN_IF_ERROR(transform());
+  std::vector<unsigned char> value(bytes);
+  MACE_RETURN_IF_ERROR(allocator->ReadImage(
+      output->UnderlyingBuffer()->buffer(), image_shape, value.data()));
+  packed_weights->Insert(layout, filter, value);
+  return MaceStatus::MACE_SUCCESS;
+}
+
 }  // namespace ops
 }  // namespace mace
@@ -15,6 +15,7 @@
 #ifndef MACE_OPS_OPENCL_BUFFER_TRANSFORMER_H_
 #define MACE_OPS_OPENCL_BUFFER_TRANSFORMER_H_
 
+#include <functional>
 #include <memory>
 #include <string>
 #include <vector>
@@ -36,6 +37,11 @@ class OpenCLBufferTransformer {
                           const MemoryType out_mem_type) {
     if (out_mem_type == MemoryType::GPU_IMAGE) {
       kernel_ = make_unique<opencl::image::BufferToImage<T>>();
+      if (in_mem_type == MemoryType::GPU_IMAGE) {
+        // images of different data types, e.g. around the ops kept in fp32
+        // of a half model, are converted through a float buffer
+        image_to_buffer_ = make_unique<opencl::image::ImageToBuffer<float>>();
+      }
     } else if (in_mem_type == MemoryType::GPU_IMAGE) {
       kernel_ = make_unique<opencl::image::ImageToBuffer<T>>();
     } else {
@@ -55,7 +61,19 @@ class OpenCLBufferTransformer {
     MemoryType in_mem_type = input->memory_type();
     if (out_mem_type == MemoryType::GPU_IMAGE ||
         out_mem_type == MemoryType::GPU_BUFFER) {
-      if (in_mem_type != MemoryType::CPU_BUFFER) {
+      if (in_mem_type == MemoryType::GPU_IMAGE &&
+          out_mem_type == MemoryType::GPU_IMAGE) {
+        Tensor *internal_tensor = ws->CreateTensor(
+            InternalTransformedName(input->name()),
+            context->device()->allocator(), DT_FLOAT);
+        VLOG(2) << "Transform GPU Image " << input->name()
+                << " to GPU Image " << output->name()
+                << " with data type " << dt;
+        MACE_RETURN_IF_ERROR(image_to_buffer_->Compute(
+            context, input, type, wino_blk_size, internal_tensor));
+        return kernel_->Compute(
+            context, internal_tensor, type, wino_blk_size, output);
+      } else if (in_mem_type != MemoryType::CPU_BUFFER) {
         return kernel_->Compute(
             context, input, type, wino_blk_size, output);
       } else {
@@ -142,10 +160,23 @@ class OpenCLBufferTransformer {
 
  private:
   std::unique_ptr<OpenCLBufferTransformKernel> kernel_;
+  std::unique_ptr<OpenCLBufferTransformKernel> image_to_buffer_;
 };
 
 std::string TransformedFilterName(const std::string &name);
 
+// Run transform, which fills output with the image of filter, unless the
+// packed weights file holds the pixels of that image from an earlier init,
+// which are then written to the image with neither the transform kernel nor
+// its intermediate buffer. The pixels of the new images are read back once
+// and kept in the file. Without a packed weights file, it runs transform.
+MaceStatus TransformFilterImage(OpContext *context,
+                                const Tensor *filter,
+                                const OpenCLBufferType type,
+                                const int wino_blk_size,
+                                const std::function<MaceStatus()> &transform,
+                                Tensor *output);
+
 template <typename T>
 MaceStatus TransformFilter(
     mace::OpConstructContext *context,
@@ -159,16 +190,35 @@ MaceStatus TransformFilter(
   Workspace *ws = context->workspace();
   std::string input_name = op_def->input(input_idx);
   Tensor *input = ws->GetTensor(input_name);
+  // the aliases of a weight transformed the same way share its output
+  const std::string key = MakeString(ws->ConstTensorOrigin(input_name), "/",
+                                     static_cast<int>(buffer_type), "/",
+                                     static_cast<int>(mem_type), "/",
+                                     wino_blk_size, "/", static_cast<int>(dt));
+  const std::string transformed = ws->TransformedWeight(key);
+  if (!transformed.empty()) {
+    op_def->set_input(input_idx, transformed);
+    input->MarkUnused();
+    return MaceStatus::MACE_SUCCESS;
+  }
   std::string output_name = TransformedFilterName(input_name);
   Tensor *output =
       ws->CreateTensor(output_name, context->device()->allocator(), dt, true);
+  ws->AddTransformedWeight(key, output_name);
 
   // update the information
   op_def->set_input(input_idx, output_name);
   input->MarkUnused();
-  return OpenCLBufferTransformer<T>(input->memory_type(), mem_type).
-      Transform(&op_context, input, buffer_type, mem_type, wino_blk_size,
-                DataFormat::DF_NONE, output);
+  auto transform = [&]() -> MaceStatus {
+    return OpenCLBufferTransformer<T>(input->memory_type(), mem_type).
+        Transform(&op_context, input, buffer_type, mem_type, wino_blk_size,
+                  DataFormat::DF_NONE, output);
+  };
+  if (mem_type != MemoryType::GPU_IMAGE) {
+    return transform();
+  }
+  return TransformFilterImage(&op_context, input, buffer_type, wino_blk_size,
+                              transform, output);
 }
 
 }  // namespace ops
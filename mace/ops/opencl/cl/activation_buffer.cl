@@ -0,0 +1,62 @@
+#include <common.h>
+
+__kernel void activation(BUFFER_OUT_OF_RANGE_PARAMS
+                         GLOBAL_WORK_GROUP_SIZE_DIM3
+                         __global IN_DATA_TYPE *input,
+#ifdef USE_PRELU
+                         __global IN_DATA_TYPE *alpha,
+#endif
+                         __private const float relux_max_limit,
+                         __private const float leakyrelu_coefficient,
+                         __private const int channels,
+                         __global OUT_DATA_TYPE *output) {
+  const int ch_blk = get_global_id(0);
+  const int w = get_global_id(1);
+  const int hb = get_global_id(2);
+
+#ifndef NON_UNIFORM_WORK_GROUP
+  if (ch_blk >= global_size_dim0 || w >= global_size_dim1
+      || hb >= global_size_dim2) {
+    return;
+  }
+#endif
+  const int width = global_size_dim1;
+  const int chan_idx = ch_blk << 2;
+  const int offset = mad24(mad24(hb, width, w), channels, chan_idx);
+  const int remain_chan = channels - chan_idx;
+
+  DATA_TYPE4 in = 0;
+  if (remain_chan < 4) {
+    switch (remain_chan) {
+      case 3:
+        in.z = CONVERT(input[offset + 2]);
+      case 2:
+        in.y = CONVERT(input[offset + 1]);
+      case 1:
+        in.x = CONVERT(input[offset]);
+    }
+  } else {
+    in = CONVERT4(vload4(0, input + offset));
+  }
+
+#ifdef USE_PRELU
+  DATA_TYPE4 prelu_alpha = CONVERT4(vload4(0, alpha + chan_idx));
+  DATA_TYPE4 out = do_activation(in, prelu_alpha, relux_max_limit, leakyrelu_coefficient);
+#else
+  DATA_TYPE4 out = do_activation(in, relux_max_limit, leakyrelu_coefficient);
+#endif
+
+  if (remain_chan < 4) {
+    switch (remain_chan) {
+      case 3:
+        output[offset + 2] = out.z;
+      case 2:
+        output[offset + 1] = out.y;
+      case 1:
+        output[offset] = out.x;
+    }
+    CHECK_OUT_OF_RANGE_FOR_BUFFER(offset + remain_chan - 1);
+  } else {
+    VSTORE4(CONVERT_TO(out, OUT_DATA_TYPE4), output, offset);
+  }
+}
@@ -0,0 +1,116 @@
+#include <common.h>
+
+// the pixel of the depth block blk of row seq of a head of a rank 4 tensor of
+// len rows, the image of [batch, heads, len, depth] or, with SEQ_FIRST,
+// [batch, len, heads, depth]
+#ifdef SEQ_FIRST
+#define COORD(blk, b, head, seq, len) \
+  (int2)(mad24((blk), heads, (head)), mad24((b), (len), (seq)))
+#else
+#define COORD(blk, b, head, seq, len) \
+  (int2)(mad24((blk), (len), (seq)), mad24((b), heads, (head)))
+#endif
+
+__kernel void attention(OUT_OF_RANGE_PARAMS
+                        GLOBAL_WORK_GROUP_SIZE_DIM2
+                        __read_only image2d_t query,
+                        __read_only image2d_t key,
+                        __read_only image2d_t value,
+#ifdef USE_MASK
+                        __read_only image2d_t mask,
+                        __private const int mask_batch,
+                        __private const int mask_heads,
+                        __private const int mask_queries,
+#endif
+                        __private const int heads,
+                        __private const int queries,
+                        __private const int keys,
+                        __private const int depth,
+                        __private const float scale,
+                        __write_only image2d_t output) {
+  const int query_idx = get_global_id(0);
+  const int bh_idx = get_global_id(1);
+
+#ifndef NON_UNIFORM_WORK_GROUP
+  if (query_idx >= global_size_dim0 || bh_idx >= global_size_dim1) {
+    return;
+  }
+#endif
+  const int b = bh_idx / heads;
+  const int head = bh_idx - mul24(b, heads);
+
+  float4 q[DEPTH_BLOCKS];
+  for (int i = 0; i < DEPTH_BLOCKS; ++i) {
+    q[i] = convert_float4(READ_IMAGET(
+        query, SAMPLER, COORD(i, b, head, query_idx, queries))) * scale;
+  }
+  // the padding of the last block does not add to the scores
+  const int remain = DEPTH_BLOCKS * 4 - depth;
+  if (remain > 0) {
+    float4 last = q[DEPTH_BLOCKS - 1];
+    last.w = 0;
+    if (remain > 1) last.z = 0;
+    if (remain > 2) last.y = 0;
+    q[DEPTH_BLOCKS - 1] = last;
+  }
+
+  float4 sums[VALUE_BLOCKS];
+  for (int i = 0; i < VALUE_BLOCKS; ++i) {
+    sums[i] = 0;
+  }
+  float max_score = -MAXFLOAT;
+  float exp_sum = 0;
+#ifdef USE_MASK
+  const int mask_x = query_idx % mask_queries;
+  const int mask_y = mad24(b % mask_batch, mask_heads, head % mask_heads);
+#endif
+
+  // 4 keys a step, the mask of which is a pixel
+  for (int key_idx = 0; key_idx < keys; key_idx += 4) {
+    float s[4];
+    for (int j = 0; j < 4; ++j) {
+      const int k = min(key_idx + j, keys - 1);
+      float score = 0;
+      for (int i = 0; i < DEPTH_BLOCKS; ++i) {
+        score += dot(q[i], convert_float4(READ_IMAGET(
+            key, SAMPLER, COORD(i, b, head, k, keys))));
+      }
+      s[j] = key_idx + j < keys ? score : -INFINITY;
+    }
+    float4 scores = (float4)(s[0], s[1], s[2], s[3]);
+#ifdef USE_MASK
+    scores += convert_float4(READ_IMAGET(
+        mask, SAMPLER, (int2)(mad24(key_idx >> 2, mask_queries, mask_x),
+                              mask_y)));
+#endif
+
+    const float new_max = fmax(max_score, fmax(fmax(scores.x, scores.y),
+                                               fmax(scores.z, scores.w)));
+    const float correction = exp(max_score - new_max);
+    const float4 p = exp(scores - new_max);
+    exp_sum = exp_sum * correction + p.x + p.y + p.z + p.w;
+    max_score = new_max;
+
+    const int k1 = min(key_idx + 1, keys - 1);
+    const int k2 = min(key_idx + 2, keys - 1);
+    const int k3 = min(key_idx + 3, keys - 1);
+    for (int i = 0; i < VALUE_BLOCKS; ++i) {
+      float4 sum = sums[i] * correction;
+      sum += p.x * convert_float4(READ_IMAGET(
+          value, SAMPLER, COORD(i, b, head, key_idx, keys)));
+      sum += p.y * convert_float4(READ_IMAGET(
+          value, SAMPLER, COORD(i, b, head, k1, keys)));
+      sum += p.z * convert_float4(READ_IMAGET(
+          value, SAMPLER, COORD(i, b, head, k2, keys)));
+      sum += p.w * convert_float4(READ_IMAGET(
+          value, SAMPLER, COORD(i, b, head, k3, keys)));
+      sums[i] = sum;
+    }
+  }
+
+  const float inverse = exp_sum > 0 ? 1.f / exp_sum : 0.f;
+  for (int i = 0; i < VALUE_BLOCKS; ++i) {
+    WRITE_IMAGET(output, COORD(i, b, head, query_idx, queries),
+                 CONVERT4(sums[i] * inverse));
+  }
+}
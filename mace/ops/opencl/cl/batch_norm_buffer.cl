@@ -0,0 +1,78 @@
+#include <common.h>
+// Supported data types: half/float
+__kernel void batch_norm(BUFFER_OUT_OF_RANGE_PARAMS
+                         GLOBAL_WORK_GROUP_SIZE_DIM3
+                         __global IN_DATA_TYPE *input,
+                         __global IN_DATA_TYPE *scale,
+                         __global IN_DATA_TYPE *offset,
+#ifndef FOLDED_CONSTANT
+                         __global IN_DATA_TYPE *mean,
+                         __global IN_DATA_TYPE *var,
+                         __private const float epsilon,
+#endif
+                         __private const int channels,
+                         __global OUT_DATA_TYPE *output,
+                         __private const float relux_max_limit,
+                         __private const float leakyrelu_coefficient) {
+  const int ch_blk = get_global_id(0);
+  const int w = get_global_id(1);
+  const int hb = get_global_id(2);
+
+#ifndef NON_UNIFORM_WORK_GROUP
+  if (ch_blk >= global_size_dim0 || w >= global_size_dim1
+      || hb >= global_size_dim2) {
+    return;
+  }
+#endif
+  const int width = global_size_dim1;
+  const int chan_idx = ch_blk << 2;
+
+#ifdef FOLDED_CONSTANT
+  DATA_TYPE4 bn_scale = CONVERT4(vload4(0, scale + chan_idx));
+  DATA_TYPE4 bn_offset = CONVERT4(vload4(0, offset + chan_idx));
+#else
+  DATA_TYPE4 scale_value = CONVERT4(vload4(0, scale + chan_idx));
+  DATA_TYPE4 offset_value = CONVERT4(vload4(0, offset + chan_idx));
+  DATA_TYPE4 mean_value = CONVERT4(vload4(0, mean + chan_idx));
+  DATA_TYPE4 var_value = CONVERT4(vload4(0, var + chan_idx));
+
+  DATA_TYPE4 bn_scale = scale_value * rsqrt(var_value + (DATA_TYPE4)epsilon);
+  DATA_TYPE4 bn_offset = mad(0 - mean_value, bn_scale, offset_value);
+#endif
+
+  const int out_offset = mad24(mad24(hb, width, w), channels, chan_idx);
+  const int remain_chan = channels - chan_idx;
+
+  DATA_TYPE4 in = 0;
+  if (remain_chan < 4) {
+    switch (remain_chan) {
+      case 3:
+        in.z = CONVERT(input[out_offset + 2]);
+      case 2:
+        in.y = CONVERT(input[out_offset + 1]);
+      case 1:
+        in.x = CONVERT(input[out_offset]);
+    }
+  } else {
+    in = CONVERT4(vload4(0, input + out_offset));
+  }
+  DATA_TYPE4 out = mad(in, bn_scale, bn_offset);
+
+#if  defined(USE_RELU) || defined(USE_LEAKYRELU) || defined(USE_RELUX) || defined(USE_TANH) || defined(USE_SIGMOID)
+  out = do_activation(out, relux_max_limit, leakyrelu_coefficient);
+#endif
+
+  if (remain_chan < 4) {
+    switch (remain_chan) {
+      case 3:
+        output[out_offset + 2] = out.z;
+      case 2:
+        output[out_offset + 1] = out.y;
+      case 1:
+        output[out_offset] = out.x;
+    }
+    CHECK_OUT_OF_RANGE_FOR_BUFFER(out_offset + remain_chan - 1);
+  } else {
+    VSTORE4(CONVERT_TO(out, OUT_DATA_TYPE4), output, out_offset);
+  }
+}
@@ -81,6 +81,12 @@ inline float4 do_sigmoid(float4 in) {
   return native_recip(1.0f + native_exp(-in));
 }
 
+// the tanh approximation of GELU, in * sigmoid(2 * tanh's argument)
+inline float4 do_gelu(float4 in) {
+  return in * native_recip(1.0f + native_exp(
+      in * (-1.5957691216f - 0.0713548162f * in * in)));
+}
+
 #ifdef DATA_TYPE
 inline DATA_TYPE4 do_activation(DATA_TYPE4 in,
 #ifdef USE_PRELU
@@ -106,6 +112,67 @@ inline DATA_TYPE4 do_activation(DATA_TYPE4 in,
 #endif
 #ifdef USE_LEAKYRELU
   out = select(leakyrelu_coefficient * in, in, in >= (DATA_TYPE)0);
+#endif
+#ifdef USE_GELU
+  out = do_gelu(in);
+#endif
+  return out;
+}
+#endif
+
+#ifdef ELTWISE_TYPE
+// The eltwise op of ELTWISE_TYPE on in0 and in1, swapped under SWAPPED.
+inline DATA_TYPE4 do_eltwise(DATA_TYPE4 in0,
+#ifdef COEFF_SUM
+                             __private const float coeff0,
+                             __private const float coeff1,
+#endif
+                             DATA_TYPE4 in1) {
+  DATA_TYPE4 out;
+#if ELTWISE_TYPE == 0
+  #ifdef COEFF_SUM
+    out = mad(coeff0, in0, mad(coeff1, in1, 0));
+  #else
+    out = in0 + in1;
+  #endif
+#elif ELTWISE_TYPE == 1
+  #ifdef SWAPPED
+    out = in1 - in0;
+  #else
+    out = in0 - in1;
+  #endif
+#elif ELTWISE_TYPE == 2
+  out = in0 * in1;
+#elif ELTWISE_TYPE == 3
+  #ifdef SWAPPED
+    out = in1 / in0;
+  #else
+    out = in0 / in1;
+  #endif
+#elif ELTWISE_TYPE == 4
+  out = fmin(in0, in1);
+#elif ELTWISE_TYPE == 5
+  out = fmax(in0, in1);
+#elif ELTWISE_TYPE == 6
+  in1 = (DATA_TYPE4)(0, 0, 0, 0);
+  out = in1 - in0;
+#elif ELTWISE_TYPE == 7
+  out = fabs(in0);
+#elif ELTWISE_TYPE == 8
+  DATA_TYPE4 diff = in0 - in1;
+  out = diff * diff;
+#elif ELTWISE_TYPE == 9
+  #ifdef SWAPPED
+    out = pow(in1, in0);
+  #else
+    out = pow(in0, in1);
+  #endif
+#elif ELTWISE_TYPE == 11
+  #ifdef SWAPPED
+    out = floor(in1 / in0);
+  #else
+    out = floor(in0 / in1);
+  #endif
 #endif
   return out;
 }
@@ -129,5 +196,31 @@ inline void check_out_of_range_for_buffer(__private const int length,
   }
 }
 
+// The image position of the conv output pixel of channel block ch_blk,
+// width w and height-batch hb, of the conv width. Under DEPTH_TO_SPACE, the
+// block size of a depth to space fused into the conv store, it lands where
+// the depth to space moves it, the output channels being whole blocks.
+#ifdef DEPTH_TO_SPACE
+inline int2 conv_output_coord(__private const int ch_blk,
+                              __private const int ch_blks,
+                              __private const int w,
+                              __private const int hb,
+                              __private const int width) {
+  const int out_ch_blks = ch_blks / (DEPTH_TO_SPACE * DEPTH_TO_SPACE);
+  const int offset = ch_blk / out_ch_blks;
+  const int out_ch_blk = ch_blk - mul24(offset, out_ch_blks);
+  return (int2)(mad24(out_ch_blk, mul24(width, DEPTH_TO_SPACE),
+                      mad24(w, DEPTH_TO_SPACE, offset % DEPTH_TO_SPACE)),
+                mad24(hb, DEPTH_TO_SPACE, offset / DEPTH_TO_SPACE));
+}
+#else
+inline int2 conv_output_coord(__private const int ch_blk,
+                              __private const int ch_blks,
+                              __private const int w,
+                              __private const int hb,
+                              __private const int width) {
+  return (int2)(mad24(ch_blk, width, w), hb);
+}
+#endif
 
 #endif  // MACE_OPS_OPENCL_CL_COMMON_H_
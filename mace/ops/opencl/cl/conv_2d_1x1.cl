@@ -1,11 +1,19 @@
 #include <common.h>
 
+// number of output widths computed by each work item
+#ifndef OUT_W_TILE
+#define OUT_W_TILE 4
+#endif
+
 __kernel void conv_2d_1x1(OUT_OF_RANGE_PARAMS
                           GLOBAL_WORK_GROUP_SIZE_DIM3
                           __read_only image2d_t input, /* [c%4 * w * c/4, h * b] */
                           __read_only image2d_t filter, /* cout%4 * cin, cout/4 */
 #ifdef BIAS
                           __read_only image2d_t bias, /* cout%4 * cout/4 */
+#endif
+#ifdef RESIDUAL
+                          __read_only image2d_t residual, /* same as output */
 #endif
                           __write_only image2d_t output,
                           __private const float relux_max_limit,
@@ -29,32 +37,27 @@ __kernel void conv_2d_1x1(OUT_OF_RANGE_PARAMS
   const int out_w_blks = global_size_dim1;
 
 #ifdef BIAS
-  DATA_TYPE4 out0 = READ_IMAGET(bias, SAMPLER, (int2)(out_ch_blk, 0));
-  DATA_TYPE4 out1 = out0;
-  DATA_TYPE4 out2 = out0;
-  DATA_TYPE4 out3 = out0;
+  const DATA_TYPE4 bias_value = READ_IMAGET(bias, SAMPLER, (int2)(out_ch_blk, 0));
 #else
-  DATA_TYPE4 out0 = 0;
-  DATA_TYPE4 out1 = 0;
-  DATA_TYPE4 out2 = 0;
-  DATA_TYPE4 out3 = 0;
+  const DATA_TYPE4 bias_value = 0;
 #endif
-
-  int4 w;
+  DATA_TYPE4 out[OUT_W_TILE];
+  int w[OUT_W_TILE];
   int in_width_stride = mul24(out_w_blks, stride);
-  w.x = mul24(out_w_blk, stride);
-  w.y = w.x + in_width_stride;
-  w.z = w.y + in_width_stride;
-  w.w = w.z + in_width_stride;
+  w[0] = mul24(out_w_blk, stride);
+#pragma unroll
+  for (int i = 0; i < OUT_W_TILE; ++i) {
+    out[i] = bias_value;
+    if (i > 0) w[i] = w[i - 1] + in_width_stride;
+  }
+#pragma unroll
+  for (int i = 0; i < OUT_W_TILE; ++i) {
+    w[i] = select(w[i], INT_MIN, w[i] >= in_width);
+  }
   int batch = out_hb / height;
   int h_idx = out_hb - mul24(batch, height);
   int out_hb_idx = mul24(h_idx, stride);
 
-  w.x = select(w.x, INT_MIN, w.x >= in_width);
-  w.y = select(w.y, INT_MIN, w.y >= in_width);
-  w.z = select(w.z, INT_MIN, w.z >= in_width);
-  w.w = select(w.w, INT_MIN, w.w >= in_width);
-
   out_hb_idx = select(mad24(batch, in_height, out_hb_idx),
                       -1,
                       out_hb_idx >= in_height);
@@ -63,60 +66,48 @@ __kernel void conv_2d_1x1(OUT_OF_RANGE_PARAMS
   int in_x_base = 0;
   int filter_x_base = 0;
   for (int in_ch_blk = 0; in_ch_blk < in_ch_blks; ++in_ch_blk) {
-    DATA_TYPE4 in0 = READ_IMAGET(input, SAMPLER, (int2)(in_x_base + w.x, out_hb_idx));
-    DATA_TYPE4 in1 = READ_IMAGET(input, SAMPLER, (int2)(in_x_base + w.y, out_hb_idx));
-    DATA_TYPE4 in2 = READ_IMAGET(input, SAMPLER, (int2)(in_x_base + w.z, out_hb_idx));
-    DATA_TYPE4 in3 = READ_IMAGET(input, SAMPLER, (int2)(in_x_base + w.w, out_hb_idx));
-
     DATA_TYPE4 weights0 = READ_IMAGET(filter, SAMPLER, (int2)(filter_x_base + 0, out_ch_blk));
     DATA_TYPE4 weights1 = READ_IMAGET(filter, SAMPLER, (int2)(filter_x_base + 1, out_ch_blk));
     DATA_TYPE4 weights2 = READ_IMAGET(filter, SAMPLER, (int2)(filter_x_base + 2, out_ch_blk));
     DATA_TYPE4 weights3 = READ_IMAGET(filter, SAMPLER, (int2)(filter_x_base + 3, out_ch_blk));
 
-    out0 = mad(in0.x, weights0, out0);
-    out0 = mad(in0.y, weights1, out0);
-    out0 = mad(in0.z, weights2, out0);
-    out0 = mad(in0.w, weights3, out0);
-
-    out1 = mad(in1.x, weights0, out1);
-    out1 = mad(in1.y, weights1, out1);
-    out1 = mad(in1.z, weights2, out1);
-    out1 = mad(in1.w, weights3, out1);
-
-    out2 = mad(in2.x, weights0, out2);
-    out2 = mad(in2.y, weights1, out2);
-    out2 = mad(in2.z, weights2, out2);
-    out2 = mad(in2.w, weights3, out2);
-
-    out3 = mad(in3.x, weights0, out3);
-    out3 = mad(in3.y, weights1, out3);
-    out3 = mad(in3.z, weights2, out3);
-    out3 = mad(in3.w, weights3, out3);
+#pragma unroll
+    for (int i = 0; i < OUT_W_TILE; ++i) {
+      DATA_TYPE4 in = READ_IMAGET(input, SAMPLER, (int2)(in_x_base + w[i], out_hb_idx));
+      out[i] = mad(in.x, weights0, out[i]);
+      out[i] = mad(in.y, weights1, out[i]);
+      out[i] = mad(in.z, weights2, out[i]);
+      out[i] = mad(in.w, weights3, out[i]);
+    }
 
     in_x_base += in_width;
     filter_x_base += 4;
   }
 
+#ifdef RESIDUAL
+  // the residual is added after the bias and before the activation
+  const int residual_x = mad24(out_ch_blk, width, out_w_blk);
+#pragma unroll
+  for (int i = 0; i < OUT_W_TILE; ++i) {
+    out[i] += READ_IMAGET(residual, SAMPLER, (int2)(residual_x + i * out_w_blks, out_hb));
+  }
+#endif
+
 #if  defined(USE_RELU) || defined(USE_LEAKYRELU) || defined(USE_RELUX) || defined(USE_TANH) || defined(USE_SIGMOID)
-  out0 = do_activation(out0, relux_max_limit, leakyrelu_coefficient);
-  out1 = do_activation(out1, relux_max_limit, leakyrelu_coefficient);
-  out2 = do_activation(out2, relux_max_limit, leakyrelu_coefficient);
-  out3 = do_activation(out3, relux_max_limit, leakyrelu_coefficient);
+#pragma unroll
+  for (int i = 0; i < OUT_W_TILE; ++i) {
+    out[i] = do_activation(out[i], relux_max_limit, leakyrelu_coefficient);
+  }
 #endif
 
-  const int out_x_base = mul24(out_ch_blk, width);
   int out_x_idx = out_w_blk;
-  WRITE_IMAGET(output, (int2)(out_x_base + out_x_idx, out_hb), out0);
-
-  out_x_idx += out_w_blks;
-  if (out_x_idx >= width) return;
-  WRITE_IMAGET(output, (int2)(out_x_base + out_x_idx, out_hb), out1);
-
-  out_x_idx += out_w_blks;
-  if (out_x_idx >= width) return;
-  WRITE_IMAGET(output, (int2)(out_x_base + out_x_idx, out_hb), out2);
-
-  out_x_idx += out_w_blks;
-  if (out_x_idx >= width) return;
-  WRITE_IMAGET(output, (int2)(out_x_base + out_x_idx, out_hb), out3);
+#pragma unroll
+  for (int i = 0; i < OUT_W_TILE; ++i) {
+    if (out_x_idx >= width) return;
+    WRITE_IMAGET(output,
+                 conv_output_coord(out_ch_blk, global_size_dim0, out_x_idx,
+                                   out_hb, width),
+                 out[i]);
+    out_x_idx += out_w_blks;
+  }
 }
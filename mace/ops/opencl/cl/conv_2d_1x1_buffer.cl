@@ -111,3 +111,154 @@ __kernel void conv2d(BUFFER_OUT_OF_RANGE_PARAMS
 #undef WRITE_OUTPUT
 
 }
+
+#define DATA_TYPE8 VEC_DATA_TYPE(DATA_TYPE, 8)
+#define CONVERT8(value) CONVERT_TO(value, DATA_TYPE8)
+
+// 1x1 convolution as a GEMM of [pixels, in_chan] x [in_chan, out_chan].
+// A work group of GEMM_WG_C x GEMM_WG_P work items computes
+// GEMM_WG_C * 4 output channels of GEMM_WG_P * GEMM_PIXELS pixels, staging
+// GEMM_K input channels of the input and the filter in local memory at a
+// time. It must be launched with local size (GEMM_WG_C, GEMM_WG_P).
+#define GEMM_WG_C 8
+#define GEMM_WG_P 8
+#define GEMM_PIXELS 4
+#define GEMM_K 16
+#define GEMM_TILE_PIXELS (GEMM_WG_P * GEMM_PIXELS)
+
+__kernel void conv2d_gemm(BUFFER_OUT_OF_RANGE_PARAMS
+                          __global IN_DATA_TYPE *padded_input,
+                          __global IN_DATA_TYPE *filter,
+#ifdef BIAS
+                          __global IN_DATA_TYPE *bias,
+#endif
+                          __private const int in_height,
+                          __private const int in_width,
+                          __private const int in_chan,
+                          __private const int filter_in_chan,
+                          __private const int out_pixels,
+                          __private const int out_height,
+                          __private const int out_width,
+                          __private const int out_chan,
+                          __private const int stride_h,
+                          __private const int stride_w,
+                          __private const float relux_max_limit,
+                          __private const float leakyrelu_coefficient,
+                          __global OUT_DATA_TYPE *output) {
+  __local DATA_TYPE4 in_tile[GEMM_TILE_PIXELS][GEMM_K >> 2];
+  __local DATA_TYPE4 filter_tile[GEMM_WG_C][GEMM_K];
+
+  const int lid_c = get_local_id(0);
+  const int lid_p = get_local_id(1);
+  const int out_chan_blk_idx = get_global_id(0);
+  const int out_chan_blk_base = out_chan_blk_idx - lid_c;
+  const int pixel_base = mul24(get_global_id(1) - lid_p, GEMM_PIXELS);
+  const int out_chan_blk = (out_chan + 3) >> 2;
+  const int out_hw = mul24(out_height, out_width);
+
+  // every work item loads 8 input channels of one pixel and 2 input
+  // channels of one output channel block per step
+  const int lid = mad24(lid_p, GEMM_WG_C, lid_c);
+  const int load_pixel = lid >> 1;
+  const int load_in_chan = (lid & 1) << 3;
+  const int load_filter_blk = lid >> 3;
+  const int load_filter_chan = (lid & 7) << 1;
+
+  const int load_pixel_idx = pixel_base + load_pixel;
+  const bool load_pixel_valid = load_pixel_idx < out_pixels;
+  int in_offset = 0;
+  if (load_pixel_valid) {
+    const int batch_idx = load_pixel_idx / out_hw;
+    const int hw_idx = load_pixel_idx - mul24(batch_idx, out_hw);
+    const int h_idx = hw_idx / out_width;
+    const int w_idx = hw_idx - mul24(h_idx, out_width);
+    in_offset = mul24(mad24(mad24(batch_idx, in_height,
+        mul24(h_idx, stride_h)), in_width, mul24(w_idx, stride_w)), in_chan);
+  }
+  const int load_filter_blk_idx = out_chan_blk_base + load_filter_blk;
+  const bool load_filter_valid = load_filter_blk_idx < out_chan_blk;
+  const int filter_offset = mul24(load_filter_blk_idx, filter_in_chan) << 2;
+
+#ifdef BIAS
+  DATA_TYPE4 bias_value = 0;
+  if (out_chan_blk_idx < out_chan_blk) {
+    bias_value = CONVERT4(vload4(0, bias + (out_chan_blk_idx << 2)));
+  }
+#else
+  DATA_TYPE4 bias_value = 0;
+#endif
+  DATA_TYPE4 out[GEMM_PIXELS];
+#pragma unroll
+  for (int i = 0; i < GEMM_PIXELS; ++i) {
+    out[i] = bias_value;
+  }
+
+  for (int k = 0; k < in_chan; k += GEMM_K) {
+    const int in_chan_idx = k + load_in_chan;
+    DATA_TYPE8 in = 0;
+    if (load_pixel_valid && in_chan_idx < in_chan) {
+      if (in_chan_idx + 8 <= in_chan) {
+        in = CONVERT8(vload8(0, padded_input + in_offset + in_chan_idx));
+      } else {
+        in.lo = CONVERT4(vload4(0, padded_input + in_offset + in_chan_idx));
+      }
+    }
+    in_tile[load_pixel][load_in_chan >> 2] = in.lo;
+    in_tile[load_pixel][(load_in_chan >> 2) + 1] = in.hi;
+
+    const int filter_chan_idx = k + load_filter_chan;
+    DATA_TYPE8 weights = 0;
+    if (load_filter_valid && filter_chan_idx < in_chan) {
+      weights = CONVERT8(vload8(0,
+          filter + filter_offset + (filter_chan_idx << 2)));
+    }
+    filter_tile[load_filter_blk][load_filter_chan] = weights.lo;
+    filter_tile[load_filter_blk][load_filter_chan + 1] = weights.hi;
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+#pragma unroll
+    for (int kk = 0; kk < (GEMM_K >> 2); ++kk) {
+      const DATA_TYPE4 w0 = filter_tile[lid_c][(kk << 2)];
+      const DATA_TYPE4 w1 = filter_tile[lid_c][(kk << 2) + 1];
+      const DATA_TYPE4 w2 = filter_tile[lid_c][(kk << 2) + 2];
+      const DATA_TYPE4 w3 = filter_tile[lid_c][(kk << 2) + 3];
+#pragma unroll
+      for (int i = 0; i < GEMM_PIXELS; ++i) {
+        const DATA_TYPE4 v = in_tile[mad24(i, GEMM_WG_P, lid_p)][kk];
+        out[i] = mad((DATA_TYPE4)(v.x), w0, out[i]);
+        out[i] = mad((DATA_TYPE4)(v.y), w1, out[i]);
+        out[i] = mad((DATA_TYPE4)(v.z), w2, out[i]);
+        out[i] = mad((DATA_TYPE4)(v.w), w3, out[i]);
+      }
+    }
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+
+  if (out_chan_blk_idx >= out_chan_blk) return;
+  const int out_chan_idx = out_chan_blk_idx << 2;
+#pragma unroll
+  for (int i = 0; i < GEMM_PIXELS; ++i) {
+    const int pixel_idx = pixel_base + mad24(i, GEMM_WG_P, lid_p);
+    if (pixel_idx >= out_pixels) return;
+#if  defined(USE_RELU) || defined(USE_LEAKYRELU) || defined(USE_RELUX) || defined(USE_TANH) || defined(USE_SIGMOID)
+    out[i] = do_activation(out[i], relux_max_limit, leakyrelu_coefficient);
+#endif
+    const int out_offset = mad24(pixel_idx, out_chan, out_chan_idx);
+    if (out_chan_idx + 4 > out_chan) {
+      const int diff = out_chan - out_chan_idx;
+      switch(diff) {
+        case 3:
+          output[out_offset + 2] = CONVERT_TO(out[i].z, OUT_DATA_TYPE);
+        case 2:
+          output[out_offset + 1] = CONVERT_TO(out[i].y, OUT_DATA_TYPE);
+        case 1:
+          output[out_offset] = CONVERT_TO(out[i].x, OUT_DATA_TYPE);
+      }
+      CHECK_OUT_OF_RANGE_FOR_BUFFER(out_offset + diff - 1);
+    } else {
+      VSTORE4(CONVERT_TO(out[i], OUT_DATA_TYPE4), output, out_offset);
+    }
+  }
+}
@@ -6,6 +6,9 @@ __kernel void conv_2d_3x3(OUT_OF_RANGE_PARAMS
                           __read_only image2d_t filter, /* cout%4 * cin , kh * kw * cout/4 */
 #ifdef BIAS
                           __read_only image2d_t bias, /* cout%4 * cout/4 */
+#endif
+#ifdef RESIDUAL
+                          __read_only image2d_t residual, /* same as output */
 #endif
                           __write_only image2d_t output,
                           __private const float relux_max_limit,
@@ -129,6 +132,16 @@ __kernel void conv_2d_3x3(OUT_OF_RANGE_PARAMS
     }
   }
 
+#ifdef RESIDUAL
+  // the residual is added after the bias and before the activation
+  const int residual_x = mad24(out_ch_blk, out_width, out_w_blk);
+  out0 += READ_IMAGET(residual, SAMPLER, (int2)(residual_x, out_hb));
+  out1 += READ_IMAGET(residual, SAMPLER, (int2)(residual_x + out_w_blks, out_hb));
+  out2 += READ_IMAGET(residual, SAMPLER, (int2)(residual_x + 2 * out_w_blks, out_hb));
+  out3 += READ_IMAGET(residual, SAMPLER, (int2)(residual_x + 3 * out_w_blks, out_hb));
+  out4 += READ_IMAGET(residual, SAMPLER, (int2)(residual_x + 4 * out_w_blks, out_hb));
+#endif
+
 #if  defined(USE_RELU) || defined(USE_LEAKYRELU) || defined(USE_RELUX) || defined(USE_TANH) || defined(USE_SIGMOID)
   out0 = do_activation(out0, relux_max_limit, leakyrelu_coefficient);
   out1 = do_activation(out1, relux_max_limit, leakyrelu_coefficient);
@@ -137,33 +150,37 @@ __kernel void conv_2d_3x3(OUT_OF_RANGE_PARAMS
   out4 = do_activation(out4, relux_max_limit, leakyrelu_coefficient);
 #endif
 
-  const int out_x_base = mul24(out_ch_blk, out_width);
   int w = out_w_blk;
   WRITE_IMAGET(output,
-               (int2)(out_x_base + w, out_hb),
+               conv_output_coord(out_ch_blk, global_size_dim0, w, out_hb,
+                                 out_width),
                out0);
 
   w += out_w_blks;
   if (w >= out_width) return;
   WRITE_IMAGET(output,
-               (int2)(out_x_base + w, out_hb),
+               conv_output_coord(out_ch_blk, global_size_dim0, w, out_hb,
+                                 out_width),
                out1);
 
   w += out_w_blks;
   if (w >= out_width) return;
   WRITE_IMAGET(output,
-               (int2)(out_x_base + w, out_hb),
+               conv_output_coord(out_ch_blk, global_size_dim0, w, out_hb,
+                                 out_width),
                out2);
 
   w += out_w_blks;
   if (w >= out_width) return;
   WRITE_IMAGET(output,
-               (int2)(out_x_base + w, out_hb),
+               conv_output_coord(out_ch_blk, global_size_dim0, w, out_hb,
+                                 out_width),
                out3);
 
   w += out_w_blks;
   if (w >= out_width) return;
   WRITE_IMAGET(output,
-               (int2)(out_x_base + w, out_hb),
+               conv_output_coord(out_ch_blk, global_size_dim0, w, out_hb,
+                                 out_width),
                out4);
 }
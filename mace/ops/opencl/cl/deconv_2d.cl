@@ -166,3 +166,168 @@ __kernel void deconv_2d(OUT_OF_RANGE_PARAMS
   }
 }
 
+
+// The deconvolution of strides > 1 decomposed into its stride_h * stride_w
+// phases, i.e. the outputs of the same offset modulo the strides, which
+// share the taps of the filter. Each work item gives a tile of 2 rows and 4
+// columns of outputs of a phase, and the neighbouring work items take the
+// same phase, so they loop alike and read the same weights.
+__kernel void deconv_2d_subpixel(OUT_OF_RANGE_PARAMS
+                                 GLOBAL_WORK_GROUP_SIZE_DIM3
+                                 __read_only image2d_t input,
+                                 __read_only image2d_t weights,
+#ifdef BIAS
+                                 __read_only image2d_t bias,
+#endif
+                                 __write_only image2d_t output,
+                                 __private const float relux_max_limit,
+                                 __private const float leakyrelu_coefficient,
+                                 __private const int in_height,
+                                 __private const int in_width,
+                                 __private const int out_height,
+                                 __private const int out_width,
+                                 __private const int stride_h,
+                                 __private const int stride_w,
+                                 __private const int padding_h,
+                                 __private const int padding_w,
+                                 __private const int kernel_h,
+                                 __private const int kernel_w,
+                                 __private const int kernel_size,
+                                 __private const int in_channel_blocks,
+                                 __private const int phase_height_blocks,
+                                 __private const int phase_width_blocks)
+{
+  const int c = get_global_id(0);
+  const int pw_blk = get_global_id(1);
+  const int phb = get_global_id(2);
+
+#ifndef NON_UNIFORM_WORK_GROUP
+  if (c >= global_size_dim0 || pw_blk >= global_size_dim1
+      || phb >= global_size_dim2) {
+    return;
+  }
+#endif
+
+  const int phase_w = pw_blk / phase_width_blocks;
+  const int w_blk = pw_blk - mul24(phase_w, phase_width_blocks);
+  const int batch_blocks = mul24(stride_h, phase_height_blocks);
+  const int b = phb / batch_blocks;
+  const int ph_blk = phb - mul24(b, batch_blocks);
+  const int phase_h = ph_blk / phase_height_blocks;
+  const int h_blk = ph_blk - mul24(phase_h, phase_height_blocks);
+
+  const int h = mad24(h_blk << 1, stride_h, phase_h);
+  const int w = mad24(w_blk << 2, stride_w, phase_w);
+  if (h >= out_height || w >= out_width) return;
+
+  // the first input and the first tap of the filter of the phase, the next
+  // outputs of it start at the next inputs
+  const int rem_h = ((padding_h - phase_h) % stride_h + stride_h) % stride_h;
+  const int rem_w = ((padding_w - phase_w) % stride_w + stride_w) % stride_w;
+  const int start_y = (h - padding_h + rem_h) / stride_h;
+  const int start_x = (w - padding_w + rem_w) / stride_w;
+  const int f_start_y = kernel_h - 1 - rem_h;
+  const int f_start_x = kernel_w - 1 - rem_w;
+
+#ifdef BIAS
+  DATA_TYPE4 out00 =
+     READ_IMAGET(bias, SAMPLER, (int2)(c, 0));
+#else
+  DATA_TYPE4 out00 = 0;
+#endif
+  DATA_TYPE4 out01 = out00;
+  DATA_TYPE4 out02 = out00;
+  DATA_TYPE4 out03 = out00;
+  DATA_TYPE4 out10 = out00;
+  DATA_TYPE4 out11 = out00;
+  DATA_TYPE4 out12 = out00;
+  DATA_TYPE4 out13 = out00;
+
+  int f_pos_x0, f_pos_x1, f_pos_x2, f_pos_x3, f_pos_y;
+  int in_pos_x, in_pos_y0, in_pos_y1;
+  DATA_TYPE4 in00, in01, in02, in03, in10, in11, in12, in13;
+  DATA_TYPE4 weight0, weight1, weight2, weight3;
+  for (int ic = 0; ic < in_channel_blocks; ++ic) {
+    f_pos_x0 = mul24(ic, 4);
+    f_pos_x1 = f_pos_x0 + 1;
+    f_pos_x2 = f_pos_x0 + 2;
+    f_pos_x3 = f_pos_x0 + 3;
+    const int in_x_base = mul24(ic, in_width);
+    for (int f_y = f_start_y, idx_h = start_y; f_y >= 0;
+         f_y -= stride_h, ++idx_h) {
+      in_pos_y0 = select(mad24(b, in_height, idx_h), -1,
+                         idx_h < 0 || idx_h >= in_height);
+      in_pos_y1 = select(mad24(b, in_height, idx_h + 1), -1,
+                         idx_h + 1 < 0 || idx_h + 1 >= in_height);
+      for (int f_x = f_start_x, idx_w = start_x; f_x >= 0;
+           f_x -= stride_w, ++idx_w) {
+        f_pos_y = mad24(f_y, kernel_w, f_x);
+        f_pos_y = mad24(c, kernel_size, f_pos_y);
+        weight0 = READ_IMAGET(weights, SAMPLER, (int2)(f_pos_x0, f_pos_y));
+        weight1 = READ_IMAGET(weights, SAMPLER, (int2)(f_pos_x1, f_pos_y));
+        weight2 = READ_IMAGET(weights, SAMPLER, (int2)(f_pos_x2, f_pos_y));
+        weight3 = READ_IMAGET(weights, SAMPLER, (int2)(f_pos_x3, f_pos_y));
+
+#define READ_INPUT(i)                                                         \
+        in_pos_x = select(in_x_base + idx_w + i, -1,                          \
+                          idx_w + i < 0 || idx_w + i >= in_width);            \
+        in0##i = READ_IMAGET(input, SAMPLER, (int2)(in_pos_x, in_pos_y0));   \
+        in1##i = READ_IMAGET(input, SAMPLER, (int2)(in_pos_x, in_pos_y1));
+
+        READ_INPUT(0);
+        READ_INPUT(1);
+        READ_INPUT(2);
+        READ_INPUT(3);
+#undef READ_INPUT
+
+#define CALC_OUTPUT(i)                                                        \
+        out##i = mad(in##i.x, weight0, out##i);                               \
+        out##i = mad(in##i.y, weight1, out##i);                               \
+        out##i = mad(in##i.z, weight2, out##i);                               \
+        out##i = mad(in##i.w, weight3, out##i);
+
+        CALC_OUTPUT(00);
+        CALC_OUTPUT(01);
+        CALC_OUTPUT(02);
+        CALC_OUTPUT(03);
+        CALC_OUTPUT(10);
+        CALC_OUTPUT(11);
+        CALC_OUTPUT(12);
+        CALC_OUTPUT(13);
+#undef CALC_OUTPUT
+      }
+    }
+  }
+
+#if  defined(USE_RELU) || defined(USE_LEAKYRELU) || defined(USE_RELUX) || defined(USE_TANH) || defined(USE_SIGMOID)
+  out00 = do_activation(out00, relux_max_limit, leakyrelu_coefficient);
+  out01 = do_activation(out01, relux_max_limit, leakyrelu_coefficient);
+  out02 = do_activation(out02, relux_max_limit, leakyrelu_coefficient);
+  out03 = do_activation(out03, relux_max_limit, leakyrelu_coefficient);
+  out10 = do_activation(out10, relux_max_limit, leakyrelu_coefficient);
+  out11 = do_activation(out11, relux_max_limit, leakyrelu_coefficient);
+  out12 = do_activation(out12, relux_max_limit, leakyrelu_coefficient);
+  out13 = do_activation(out13, relux_max_limit, leakyrelu_coefficient);
+#endif
+
+  const int out_x = mad24(c, out_width, w);
+  const int out_y = mad24(b, out_height, h);
+#define WRITE_OUTPUT(r, i)                                                    \
+  if (h + mul24(r, stride_h) < out_height &&                                  \
+      w + mul24(i, stride_w) < out_width) {                                   \
+    WRITE_IMAGET(output,                                                      \
+                 (int2)(out_x + mul24(i, stride_w),                           \
+                        out_y + mul24(r, stride_h)),                          \
+                 out##r##i);                                                  \
+  }
+
+  WRITE_OUTPUT(0, 0);
+  WRITE_OUTPUT(0, 1);
+  WRITE_OUTPUT(0, 2);
+  WRITE_OUTPUT(0, 3);
+  WRITE_OUTPUT(1, 0);
+  WRITE_OUTPUT(1, 1);
+  WRITE_OUTPUT(1, 2);
+  WRITE_OUTPUT(1, 3);
+#undef WRITE_OUTPUT
+}
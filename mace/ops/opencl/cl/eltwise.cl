@@ -1,5 +1,24 @@
 #include <common.h>
 
+#ifdef INPUT_BROADCAST
+// The image position of the output pixel in an input of the shape, which
+// repeats along its dims of 1.
+inline int2 broadcast_pos(__private const int chan_idx,
+                          __private const int width_idx,
+                          __private const int height_idx,
+                          __private const int batch_idx,
+                          __private const int batch,
+                          __private const int height,
+                          __private const int width,
+                          __private const int channel) {
+  const int c = select(chan_idx, 0, channel == 1);
+  const int w = select(width_idx, 0, width == 1);
+  const int h = select(height_idx, 0, height == 1);
+  const int b = select(batch_idx, 0, batch == 1);
+  return (int2)(mad24(c, width, w), mad24(b, height, h));
+}
+#endif
+
 __kernel void eltwise(OUT_OF_RANGE_PARAMS
                       GLOBAL_WORK_GROUP_SIZE_DIM3
                       __read_only image2d_t input0,
@@ -11,6 +30,16 @@ __kernel void eltwise(OUT_OF_RANGE_PARAMS
                       __private const int height,
                       __private const int width,
                       __private const int channel,
+#ifdef INPUT_BROADCAST
+                      __private const int input0_batch,
+                      __private const int input0_height,
+                      __private const int input0_width,
+                      __private const int input0_channel,
+                      __private const int input1_batch,
+                      __private const int input1_height,
+                      __private const int input1_width,
+                      __private const int input1_channel,
+#endif
 #ifdef COEFF_SUM
                       __private const float coeff0,
                       __private const float coeff1,
@@ -27,6 +56,22 @@ __kernel void eltwise(OUT_OF_RANGE_PARAMS
 #endif
 
   const int pos = mad24(chan_idx, width, width_idx);
+#if defined(INPUT_BROADCAST)
+  const int batch_idx = hb / height;
+  const int height_idx = hb - mul24(batch_idx, height);
+  DATA_TYPE4 in0 = READ_IMAGET(input0, SAMPLER,
+      broadcast_pos(chan_idx, width_idx, height_idx, batch_idx, input0_batch,
+                    input0_height, input0_width, input0_channel));
+  DATA_TYPE4 in1 = READ_IMAGET(input1, SAMPLER,
+      broadcast_pos(chan_idx, width_idx, height_idx, batch_idx, input1_batch,
+                    input1_height, input1_width, input1_channel));
+  if (input0_channel == 1) {
+    in0 = (DATA_TYPE4)(in0.x, in0.x, in0.x, in0.x);
+  }
+  if (input1_channel == 1) {
+    in1 = (DATA_TYPE4)(in1.x, in1.x, in1.x, in1.x);
+  }
+#else
   DATA_TYPE4 in0 = READ_IMAGET(input0, SAMPLER, (int2)(pos, hb));
 #if defined(INPUT_SCALAR)
   DATA_TYPE4 in1 = (DATA_TYPE4)(value, value, value, value);
@@ -41,56 +86,17 @@ __kernel void eltwise(OUT_OF_RANGE_PARAMS
 #else
   DATA_TYPE4 in1 = READ_IMAGET(input1, SAMPLER, (int2)(pos, hb));
 #endif
+#endif
 
-  DATA_TYPE4 out;
-#if ELTWISE_TYPE == 0
-  #ifdef COEFF_SUM
-    out = mad(coeff0, in0, mad(coeff1, in1, 0));
-  #else
-    out = in0 + in1;
-  #endif
-#elif ELTWISE_TYPE == 1
-  #ifdef SWAPPED
-    out = in1 - in0;
-  #else
-    out = in0 - in1;
-  #endif
-#elif ELTWISE_TYPE == 2
-  out = in0 * in1;
-#elif ELTWISE_TYPE == 3
-  #ifdef SWAPPED
-    out = in1 / in0;
-  #else
-    out = in0 / in1;
-  #endif
-#elif ELTWISE_TYPE == 4
-  out = fmin(in0, in1);
-#elif ELTWISE_TYPE == 5
-  out = fmax(in0, in1);
-#elif ELTWISE_TYPE == 6
-  in1 = (DATA_TYPE4)(0, 0, 0, 0);
-  out = in1 - in0;
-#elif ELTWISE_TYPE == 7
-  out = fabs(in0);
-#elif ELTWISE_TYPE == 8
-  DATA_TYPE4 diff = in0 - in1;
-  out = diff * diff;
-#elif ELTWISE_TYPE == 9
-  #ifdef SWAPPED
-    out = pow(in1, in0);
-  #else
-    out = pow(in0, in1);
-  #endif
-#elif ELTWISE_TYPE == 11
-  #ifdef SWAPPED
-    out = floor(in1 / in0);
-  #else
-    out = floor(in0 / in1);
-  #endif
+#ifdef COEFF_SUM
+  DATA_TYPE4 out = do_eltwise(in0, coeff0, coeff1, in1);
+#else
+  DATA_TYPE4 out = do_eltwise(in0, in1);
 #endif
 
 #if defined(NOT_DIVISIBLE_FOUR) &&                                       \
     ((ELTWISE_TYPE == 3 || ELTWISE_TYPE == 9 || ELTWISE_TYPE == 11)      \
+     || defined(INPUT_BROADCAST)                                         \
      || ((defined(INPUT_SCALAR) || defined(INPUT_TENSOR_BC_CHAN)) &&     \
          (ELTWISE_TYPE == 0 || ELTWISE_TYPE == 1 || ELTWISE_TYPE == 4 || \
           ELTWISE_TYPE == 5 || ELTWISE_TYPE == 8)))
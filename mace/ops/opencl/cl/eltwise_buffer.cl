@@ -0,0 +1,105 @@
+#include <common.h>
+
+// The 4 channels of the input at the offset, or its one channel repeated
+// if it is broadcast along the channels.
+inline DATA_TYPE4 read_input(__global IN_DATA_TYPE *input,
+                             __private const int offset,
+                             __private const int channel_stride,
+                             __private const int remain_chan) {
+  DATA_TYPE4 in = 0;
+  if (channel_stride == 0) {
+    in = (DATA_TYPE4)(CONVERT(input[offset]));
+  } else if (remain_chan < 4) {
+    switch (remain_chan) {
+      case 3:
+        in.z = CONVERT(input[offset + 2]);
+      case 2:
+        in.y = CONVERT(input[offset + 1]);
+      case 1:
+        in.x = CONVERT(input[offset]);
+    }
+  } else {
+    in = CONVERT4(vload4(0, input + offset));
+  }
+  return in;
+}
+
+__kernel void eltwise(BUFFER_OUT_OF_RANGE_PARAMS
+                      GLOBAL_WORK_GROUP_SIZE_DIM3
+                      __global IN_DATA_TYPE *input0,
+#if defined(INPUT_SCALAR)
+                      __private const float value,
+#else
+                      __global IN_DATA_TYPE *input1,
+#endif
+                      __private const int height,
+                      __private const int channels,
+                      __private const int input0_batch_stride,
+                      __private const int input0_height_stride,
+                      __private const int input0_width_stride,
+                      __private const int input0_channel_stride,
+#ifndef INPUT_SCALAR
+                      __private const int input1_batch_stride,
+                      __private const int input1_height_stride,
+                      __private const int input1_width_stride,
+                      __private const int input1_channel_stride,
+#endif
+#ifdef COEFF_SUM
+                      __private const float coeff0,
+                      __private const float coeff1,
+#endif
+                      __global OUT_DATA_TYPE *output) {
+  const int ch_blk = get_global_id(0);
+  const int w = get_global_id(1);
+  const int hb = get_global_id(2);
+
+#ifndef NON_UNIFORM_WORK_GROUP
+  if (ch_blk >= global_size_dim0 || w >= global_size_dim1
+      || hb >= global_size_dim2) {
+    return;
+  }
+#endif
+  const int width = global_size_dim1;
+  const int b = hb / height;
+  const int h = hb - mul24(b, height);
+  const int chan_idx = ch_blk << 2;
+  const int offset = mad24(mad24(hb, width, w), channels, chan_idx);
+  const int remain_chan = channels - chan_idx;
+
+  const int in0_offset = mad24(b, input0_batch_stride,
+      mad24(h, input0_height_stride,
+            mad24(w, input0_width_stride,
+                  mul24(chan_idx, input0_channel_stride))));
+  DATA_TYPE4 in0 =
+      read_input(input0, in0_offset, input0_channel_stride, remain_chan);
+#if defined(INPUT_SCALAR)
+  DATA_TYPE4 in1 = (DATA_TYPE4)(value, value, value, value);
+#else
+  const int in1_offset = mad24(b, input1_batch_stride,
+      mad24(h, input1_height_stride,
+            mad24(w, input1_width_stride,
+                  mul24(chan_idx, input1_channel_stride))));
+  DATA_TYPE4 in1 =
+      read_input(input1, in1_offset, input1_channel_stride, remain_chan);
+#endif
+
+#ifdef COEFF_SUM
+  DATA_TYPE4 out = do_eltwise(in0, coeff0, coeff1, in1);
+#else
+  DATA_TYPE4 out = do_eltwise(in0, in1);
+#endif
+
+  if (remain_chan < 4) {
+    switch (remain_chan) {
+      case 3:
+        output[offset + 2] = out.z;
+      case 2:
+        output[offset + 1] = out.y;
+      case 1:
+        output[offset] = out.x;
+    }
+    CHECK_OUT_OF_RANGE_FOR_BUFFER(offset + remain_chan - 1);
+  } else {
+    VSTORE4(CONVERT_TO(out, OUT_DATA_TYPE4), output, offset);
+  }
+}
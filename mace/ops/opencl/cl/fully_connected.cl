@@ -64,7 +64,10 @@ __kernel void fully_connected(OUT_OF_RANGE_PARAMS
   WRITE_IMAGET(output, (int2)(out_blk_idx, batch_idx), result);
 }
 
-// output = weight * input + bias
+// output = weight * input + bias, the reduction over the flattened
+// (height, width, channel block) of the input is split into contiguous
+// ranges among the work items of dim 1, summed in local memory, so a
+// 1x1 input of many channels runs on the whole work group.
 __kernel void fully_connected_width(OUT_OF_RANGE_PARAMS
                                     GLOBAL_WORK_GROUP_SIZE_DIM3
                                     __read_only image2d_t input,
@@ -81,55 +84,57 @@ __kernel void fully_connected_width(OUT_OF_RANGE_PARAMS
                                     __private const float relux_max_limit,
                                     __private const float leakyrelu_coefficient) {
   const int inter_out_idx = get_global_id(0);
-  const int width_blk_idx = get_global_id(1);
-  const int width_blk_count = global_size_dim1;
+  const int split_idx = get_global_id(1);
+  const int split_count = get_local_size(1);
   const int batch_out_blk_idx = get_global_id(2);
 
   const int batch_idx = batch_out_blk_idx / out_blks;
   const int out_blk_idx = batch_out_blk_idx - mul24(batch_idx, out_blks);
 
-  const short in_outer_size = mul24(input_width, in_chan_blks);
-  const short weight_y = mad24(out_blk_idx, 4, inter_out_idx);
-
-  int2 input_coord, weight_coord;
+  const int k_blks = mul24(mul24(input_height, input_width), in_chan_blks);
+  const int split_size = (k_blks + split_count - 1) / split_count;
+  int k = mul24(split_idx, split_size);
+  const int k_end = min(k + split_size, k_blks);
+  // the input pixel and channel block of the first k of the range
+  const int hw = k / in_chan_blks;
+  int chan_idx = k - mul24(hw, in_chan_blks);
+  const int h_idx = hw / input_width;
+  int w_idx = hw - mul24(h_idx, input_width);
+
+  int2 input_coord = (int2)(mad24(chan_idx, input_width, w_idx),
+                            mad24(batch_idx, input_height, h_idx));
+  int2 weight_coord = (int2)(k, mad24(out_blk_idx, 4, inter_out_idx));
   DATA_TYPE4 in, w;
   DATA_TYPE sum = 0;
 
-  input_coord = (int2)(0, mul24(batch_idx, input_height));
-
-  for (int h_idx = 0; h_idx < input_height; ++h_idx) {
-    int weight_x_base = mul24(h_idx, in_outer_size);
-    for (int w_idx = width_blk_idx; w_idx < input_width;
-         w_idx += width_blk_count) {
-      int weight_x = mad24(w_idx, in_chan_blks, weight_x_base);
-      weight_coord = (int2)(weight_x, weight_y);
-      input_coord.x = w_idx;
-#pragma unroll
-      for (int chan_idx = 0; chan_idx < in_chan_blks; ++chan_idx) {
-        in = READ_IMAGET(input, SAMPLER, input_coord);
-
-        w = READ_IMAGET(weight, SAMPLER, weight_coord);
-
-        sum += dot(in, w);
-
-        input_coord.x += input_width;
-        weight_coord.x += 1;
+  for (; k < k_end; ++k) {
+    in = READ_IMAGET(input, SAMPLER, input_coord);
+    w = READ_IMAGET(weight, SAMPLER, weight_coord);
+    sum += dot(in, w);
+
+    weight_coord.x += 1;
+    if (++chan_idx < in_chan_blks) {
+      input_coord.x += input_width;
+    } else {
+      chan_idx = 0;
+      if (++w_idx < input_width) {
+        input_coord.x = w_idx;
+      } else {
+        w_idx = 0;
+        input_coord.x = 0;
+        input_coord.y++;
       }
     }
-    input_coord.y++;
   }
 
   const short inter_out_offset = mad24((short)get_local_id(1), (short)4,
                                        (short)get_local_id(0));
-  const short local_width_blk_size = (short)get_local_size(1);
   const short local_size = mul24((short)get_local_size(0),
-                                 local_width_blk_size);
+                                 (short)split_count);
   short inter_idx = mad24((short)get_local_id(2), local_size, inter_out_offset);
   intermediate_output[inter_idx] = sum;
 
-#ifdef NON_QUALCOMM_ADRENO
   barrier(CLK_LOCAL_MEM_FENCE);
-#endif
 
 #ifndef NON_UNIFORM_WORK_GROUP
   if (batch_out_blk_idx >= global_size_dim2) {
@@ -144,7 +149,7 @@ __kernel void fully_connected_width(OUT_OF_RANGE_PARAMS
     DATA_TYPE4 result = (DATA_TYPE4)(0, 0, 0, 0);
 #endif
 
-    for (short i = 0; i < local_width_blk_size; ++i) {
+    for (short i = 0; i < split_count; ++i) {
       result += vload4(0, intermediate_output+inter_idx);
       inter_idx += 4;
     }
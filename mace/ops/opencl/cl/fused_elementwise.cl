@@ -0,0 +1,5 @@
+#include <common.h>
+
+// Base of the kernels of fused elementwise chains, which are generated at
+// run time by the FusedElementwise op and follow this source.
+// Supported data types: half/float
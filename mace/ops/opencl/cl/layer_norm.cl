@@ -0,0 +1,87 @@
+#include <common.h>
+
+// merge the count, mean and sum of the squared deviations of b into a
+inline void merge_moments(float *count, float *mean, float *m2,
+                          const float count_b, const float mean_b,
+                          const float m2_b) {
+  const float total = *count + count_b;
+  if (total > 0) {
+    const float delta = mean_b - *mean;
+    *mean += delta * count_b / total;
+    *m2 += m2_b + delta * delta * *count * count_b / total;
+    *count = total;
+  }
+}
+
+__kernel void layer_norm(OUT_OF_RANGE_PARAMS
+                         GLOBAL_WORK_GROUP_SIZE_DIM2
+                         __read_only image2d_t input,
+#ifdef USE_GAMMA
+                         __read_only image2d_t gamma,
+#endif
+#ifdef USE_BETA
+                         __read_only image2d_t beta,
+#endif
+                         __private const int channels,
+                         __private const float epsilon,
+                         __write_only image2d_t output) {
+  const int width_idx = get_global_id(0);
+  const int hb_idx = get_global_id(1);
+
+#ifndef NON_UNIFORM_WORK_GROUP
+  if (width_idx >= global_size_dim0 || hb_idx >= global_size_dim1) {
+    return;
+  }
+#endif
+  const int width = global_size_dim0;
+  const int full_blocks = channels >> 2;
+  const int remain = channels - (full_blocks << 2);
+
+  // the Welford moments of each lane over the full blocks
+  float4 mean = 0;
+  float4 m2 = 0;
+  int pos = width_idx;
+  for (int i = 0; i < full_blocks; ++i) {
+    const float4 in =
+        convert_float4(READ_IMAGET(input, SAMPLER, (int2)(pos, hb_idx)));
+    const float4 delta = in - mean;
+    mean += delta / (float)(i + 1);
+    m2 += delta * (in - mean);
+    pos += width;
+  }
+  float4 count = (float4)(full_blocks);
+  if (remain > 0) {
+    const float4 valid = (float4)(1, remain > 1, remain > 2, 0);
+    const float4 in =
+        convert_float4(READ_IMAGET(input, SAMPLER, (int2)(pos, hb_idx)));
+    count += valid;
+    const float4 delta = (in - mean) * valid;
+    mean += delta / fmax(count, 1.f);
+    m2 += delta * (in - mean);
+  }
+
+  float total = count.x;
+  float total_mean = mean.x;
+  float total_m2 = m2.x;
+  merge_moments(&total, &total_mean, &total_m2, count.y, mean.y, m2.y);
+  merge_moments(&total, &total_mean, &total_m2, count.z, mean.z, m2.z);
+  merge_moments(&total, &total_mean, &total_m2, count.w, mean.w, m2.w);
+  const float inv_std = rsqrt(total_m2 / channels + epsilon);
+
+  const int channel_blocks = full_blocks + (remain > 0);
+  pos = width_idx;
+  for (int i = 0; i < channel_blocks; ++i) {
+    float4 scale = (float4)(inv_std);
+#ifdef USE_GAMMA
+    scale *= convert_float4(READ_IMAGET(gamma, SAMPLER, (int2)(i, 0)));
+#endif
+    float4 offset = -total_mean * scale;
+#ifdef USE_BETA
+    offset += convert_float4(READ_IMAGET(beta, SAMPLER, (int2)(i, 0)));
+#endif
+    const float4 in =
+        convert_float4(READ_IMAGET(input, SAMPLER, (int2)(pos, hb_idx)));
+    WRITE_IMAGET(output, (int2)(pos, hb_idx), CONVERT4(in * scale + offset));
+    pos += width;
+  }
+}
@@ -141,3 +141,203 @@ __kernel void lstmcell(OUT_OF_RANGE_PARAMS
   WRITE_IMAGET(cell, (int2)(w_blk_idx, h_idx), c);
   WRITE_IMAGET(output, (int2)(w_blk_idx, h_idx), h);
 }
+
+// The input projections of the gates of all the steps of a sequence plus
+// the bias, [steps * batch, 4 * hidden_units], computed at once. A work item
+// computes 4 rows of a gate block, sharing its weight reads.
+__kernel void lstm_input_gates(OUT_OF_RANGE_PARAMS
+                               GLOBAL_WORK_GROUP_SIZE_DIM2
+                               __read_only image2d_t input,
+                               __read_only image2d_t weight,
+                               __read_only image2d_t bias,
+                               __private const int width,
+                               __private const int in_w_blk,
+                               __private const int rows,
+                               __write_only image2d_t gates) {
+  const int gate_blk_idx = get_global_id(0);
+  const int row_blk_idx = get_global_id(1);
+
+#ifndef NON_UNIFORM_WORK_GROUP
+  if (gate_blk_idx >= global_size_dim0 || row_blk_idx >= global_size_dim1) {
+    return;
+  }
+#endif
+
+  const int row = row_blk_idx << 2;
+  DATA_TYPE4 in0, in1, in2, in3;
+  DATA_TYPE4 w0, w1, w2, w3;
+  DATA_TYPE4 res0 = READ_IMAGET(bias, SAMPLER, (int2)(gate_blk_idx, 0));
+  DATA_TYPE4 res1 = res0;
+  DATA_TYPE4 res2 = res0;
+  DATA_TYPE4 res3 = res0;
+
+  for (int i = 0; i < in_w_blk; ++i) {
+    // the rows past the input are read as 0 and not written
+    in0 = READ_IMAGET(input, SAMPLER, (int2)(i, row));
+    in1 = READ_IMAGET(input, SAMPLER, (int2)(i, row + 1));
+    in2 = READ_IMAGET(input, SAMPLER, (int2)(i, row + 2));
+    in3 = READ_IMAGET(input, SAMPLER, (int2)(i, row + 3));
+
+    // the weight rows past the input are the recurrent ones
+    const int k = i << 2;
+    w0 = READ_IMAGET(weight, SAMPLER, (int2)(gate_blk_idx, k));
+    w1 = READ_IMAGET(weight, SAMPLER,
+                     (int2)(gate_blk_idx, select(-1, k + 1, k + 1 < width)));
+    w2 = READ_IMAGET(weight, SAMPLER,
+                     (int2)(gate_blk_idx, select(-1, k + 2, k + 2 < width)));
+    w3 = READ_IMAGET(weight, SAMPLER,
+                     (int2)(gate_blk_idx, select(-1, k + 3, k + 3 < width)));
+
+    res0 = mad(in0.x, w0, res0);
+    res0 = mad(in0.y, w1, res0);
+    res0 = mad(in0.z, w2, res0);
+    res0 = mad(in0.w, w3, res0);
+
+    res1 = mad(in1.x, w0, res1);
+    res1 = mad(in1.y, w1, res1);
+    res1 = mad(in1.z, w2, res1);
+    res1 = mad(in1.w, w3, res1);
+
+    res2 = mad(in2.x, w0, res2);
+    res2 = mad(in2.y, w1, res2);
+    res2 = mad(in2.z, w2, res2);
+    res2 = mad(in2.w, w3, res2);
+
+    res3 = mad(in3.x, w0, res3);
+    res3 = mad(in3.y, w1, res3);
+    res3 = mad(in3.z, w2, res3);
+    res3 = mad(in3.w, w3, res3);
+  }
+
+  WRITE_IMAGET(gates, (int2)(gate_blk_idx, row), res0);
+
+  if (row + 1 >= rows) return;
+  WRITE_IMAGET(gates, (int2)(gate_blk_idx, row + 1), res1);
+
+  if (row + 2 >= rows) return;
+  WRITE_IMAGET(gates, (int2)(gate_blk_idx, row + 2), res2);
+
+  if (row + 3 >= rows) return;
+  WRITE_IMAGET(gates, (int2)(gate_blk_idx, row + 3), res3);
+}
+
+// The recurrence of all the steps of a sequence in one work group, which
+// loops over the steps with the states in STATE_MEM memory, __local or
+// __global when they don't fit, and syncs on a barrier after every step.
+// The state holds the hidden blocks of the previous and of the current
+// step, then the cell blocks, batch * w_blks each.
+__kernel void lstm_sequence(OUT_OF_RANGE_PARAMS
+                            __read_only image2d_t gates,
+                            __read_only image2d_t weight,
+                            __read_only image2d_t pre_output,
+                            __read_only image2d_t pre_cell,
+                            STATE_MEM DATA_TYPE4 *state,
+                            __private const float forget_bias,
+                            __private const int width,
+                            __private const int batch,
+                            __private const int w_blks,
+                            __private const int steps,
+                            __write_only image2d_t cell,
+                            __write_only image2d_t output) {
+  const int lid = get_local_id(0);
+  const int local_size = get_local_size(0);
+  const int count = mul24(batch, w_blks);
+  STATE_MEM DATA_TYPE4 *hidden = state;
+  STATE_MEM DATA_TYPE4 *next_hidden = state + count;
+  STATE_MEM DATA_TYPE4 *cell_state = next_hidden + count;
+
+  for (int i = lid; i < count; i += local_size) {
+    const int b = i / w_blks;
+    const int w_blk_idx = i - mul24(b, w_blks);
+    hidden[i] = READ_IMAGET(pre_output, SAMPLER, (int2)(w_blk_idx, b));
+    cell_state[i] = READ_IMAGET(pre_cell, SAMPLER, (int2)(w_blk_idx, b));
+  }
+  barrier(STATE_MEM_FENCE);
+
+  DATA_TYPE4 pre_h, w0, w1, w2, w3;
+  for (int t = 0; t < steps; ++t) {
+    for (int i = lid; i < count; i += local_size) {
+      const int b = i / w_blks;
+      const int w_blk_idx = i - mul24(b, w_blks);
+      const int row = mad24(t, batch, b);
+      const int pos_x0 = w_blk_idx;
+      const int pos_x1 = pos_x0 + w_blks;
+      const int pos_x2 = pos_x1 + w_blks;
+      const int pos_x3 = pos_x2 + w_blks;
+
+      // fc_res0 -> i
+      // fc_res1 -> j
+      // fc_res2 -> f
+      // fc_res3 -> o
+      DATA_TYPE4 fc_res0 = READ_IMAGET(gates, SAMPLER, (int2)(pos_x0, row));
+      DATA_TYPE4 fc_res1 = READ_IMAGET(gates, SAMPLER, (int2)(pos_x1, row));
+      DATA_TYPE4 fc_res2 = READ_IMAGET(gates, SAMPLER, (int2)(pos_x2, row));
+      DATA_TYPE4 fc_res3 = READ_IMAGET(gates, SAMPLER, (int2)(pos_x3, row));
+
+      STATE_MEM DATA_TYPE4 *pre_hidden = hidden + mul24(b, w_blks);
+      for (int j = 0; j < w_blks; ++j) {
+        pre_h = pre_hidden[j];
+        int k = (j << 2) + width;
+
+        w0 = READ_IMAGET(weight, SAMPLER, (int2)(pos_x0, k));
+        w1 = READ_IMAGET(weight, SAMPLER, (int2)(pos_x1, k));
+        w2 = READ_IMAGET(weight, SAMPLER, (int2)(pos_x2, k));
+        w3 = READ_IMAGET(weight, SAMPLER, (int2)(pos_x3, k));
+        fc_res0 = mad(pre_h.x, w0, fc_res0);
+        fc_res1 = mad(pre_h.x, w1, fc_res1);
+        fc_res2 = mad(pre_h.x, w2, fc_res2);
+        fc_res3 = mad(pre_h.x, w3, fc_res3);
+
+        k += 1;
+        w0 = READ_IMAGET(weight, SAMPLER, (int2)(pos_x0, k));
+        w1 = READ_IMAGET(weight, SAMPLER, (int2)(pos_x1, k));
+        w2 = READ_IMAGET(weight, SAMPLER, (int2)(pos_x2, k));
+        w3 = READ_IMAGET(weight, SAMPLER, (int2)(pos_x3, k));
+        fc_res0 = mad(pre_h.y, w0, fc_res0);
+        fc_res1 = mad(pre_h.y, w1, fc_res1);
+        fc_res2 = mad(pre_h.y, w2, fc_res2);
+        fc_res3 = mad(pre_h.y, w3, fc_res3);
+
+        k += 1;
+        w0 = READ_IMAGET(weight, SAMPLER, (int2)(pos_x0, k));
+        w1 = READ_IMAGET(weight, SAMPLER, (int2)(pos_x1, k));
+        w2 = READ_IMAGET(weight, SAMPLER, (int2)(pos_x2, k));
+        w3 = READ_IMAGET(weight, SAMPLER, (int2)(pos_x3, k));
+        fc_res0 = mad(pre_h.z, w0, fc_res0);
+        fc_res1 = mad(pre_h.z, w1, fc_res1);
+        fc_res2 = mad(pre_h.z, w2, fc_res2);
+        fc_res3 = mad(pre_h.z, w3, fc_res3);
+
+        k += 1;
+        w0 = READ_IMAGET(weight, SAMPLER, (int2)(pos_x0, k));
+        w1 = READ_IMAGET(weight, SAMPLER, (int2)(pos_x1, k));
+        w2 = READ_IMAGET(weight, SAMPLER, (int2)(pos_x2, k));
+        w3 = READ_IMAGET(weight, SAMPLER, (int2)(pos_x3, k));
+        fc_res0 = mad(pre_h.w, w0, fc_res0);
+        fc_res1 = mad(pre_h.w, w1, fc_res1);
+        fc_res2 = mad(pre_h.w, w2, fc_res2);
+        fc_res3 = mad(pre_h.w, w3, fc_res3);
+      }
+
+      // gate
+      DATA_TYPE4 c, h;
+      c = do_sigmoid(fc_res0) * tanh(fc_res1) + do_sigmoid((fc_res2 + (float4)forget_bias)) * cell_state[i];
+      h = do_sigmoid(fc_res3) * tanh(c);
+
+      cell_state[i] = c;
+      next_hidden[i] = h;
+      WRITE_IMAGET(output, (int2)(w_blk_idx, row), h);
+    }
+    // the hidden state of this step is complete before the next reads it
+    barrier(STATE_MEM_FENCE);
+    STATE_MEM DATA_TYPE4 *swap = hidden;
+    hidden = next_hidden;
+    next_hidden = swap;
+  }
+
+  for (int i = lid; i < count; i += local_size) {
+    const int b = i / w_blks;
+    const int w_blk_idx = i - mul24(b, w_blks);
+    WRITE_IMAGET(cell, (int2)(w_blk_idx, b), cell_state[i]);
+  }
+}
@@ -15,7 +15,7 @@ inline int calculate_avg_block_size(const int pool_size_h,
   return mul24((h_end - h_start), (w_end - w_start));
 }
 
-// Supported data type: half/float
+// Supported data type: half/float/uchar
 __kernel void pooling(BUFFER_OUT_OF_RANGE_PARAMS
                       GLOBAL_WORK_GROUP_SIZE_DIM3
                       __global IN_DATA_TYPE *input,
@@ -76,7 +76,12 @@ __kernel void pooling(BUFFER_OUT_OF_RANGE_PARAMS
                                                   in_width_start,
                                                   in_height,
                                                   in_width);
+#ifdef QUANTIZED
+  // round half up as the quantized CPU kernel does
+  res = floor((res + (DATA_TYPE)(block_size >> 1)) / block_size);
+#else
   res /= block_size;
+#endif
 #else
   DATA_TYPE4 res = (DATA_TYPE4)(MIN_VALUE);
   for (int height = 0; height < kernel_h; ++height) {
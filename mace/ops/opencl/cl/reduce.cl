@@ -1,12 +1,50 @@
 #include <common.h>
 
+#ifdef USE_SUBGROUP
+#pragma OPENCL EXTENSION cl_khr_subgroups : enable
+
+// reduces the values of the sub group, every work item gets the result
+inline DATA_TYPE4 sub_group_reduce4(DATA_TYPE4 in) {
+  float4 value = convert_float4(in);
+#if REDUCE_TYPE == 1
+  value = (float4)(sub_group_reduce_min(value.x), sub_group_reduce_min(value.y),
+                   sub_group_reduce_min(value.z), sub_group_reduce_min(value.w));
+#elif REDUCE_TYPE == 2
+  value = (float4)(sub_group_reduce_max(value.x), sub_group_reduce_max(value.y),
+                   sub_group_reduce_max(value.z), sub_group_reduce_max(value.w));
+#else
+  value = (float4)(sub_group_reduce_add(value.x), sub_group_reduce_add(value.y),
+                   sub_group_reduce_add(value.z), sub_group_reduce_add(value.w));
+#endif
+  return CONVERT4(value);
+}
+#endif
+
+#if REDUCE_TYPE == 1
+#define REDUCE_INIT (DATA_TYPE4){MAXFLOAT, MAXFLOAT, MAXFLOAT, MAXFLOAT}
+#define REDUCE(a, b) fmin(a, b)
+#elif REDUCE_TYPE == 2
+#define REDUCE_INIT (DATA_TYPE4){-MAXFLOAT, -MAXFLOAT, -MAXFLOAT, -MAXFLOAT}
+#define REDUCE(a, b) fmax(a, b)
+#elif REDUCE_TYPE == 3
+#define REDUCE_INIT (DATA_TYPE4){1, 1, 1, 1}
+#define REDUCE(a, b) ((a) * (b))
+#else
+#define REDUCE_INIT (DATA_TYPE4){0, 0, 0, 0}
+#define REDUCE(a, b) ((a) + (b))
+#endif
+
+// Reduces the height * width pixels of a channel block, or the part of them
+// of a work group when the reduction is split into parts, whose partial
+// results of [batch, 1, parts, channels] are reduced again by a second pass
+// of a single part. The work items of a group read the pixels interleaved,
+// then combine their results in a tree in local memory.
 __kernel void reduce(OUT_OF_RANGE_PARAMS
                      GLOBAL_WORK_GROUP_SIZE_DIM3
                      __read_only image2d_t input,
                      __local float4 *local_buffer,
-                     __private const int group_num,
-                     __private const int compute_size,
-                     __private const int last_index,
+                     __private const int parts,
+                     __private const int part_size,
                      __private const int in_height,
                      __private const int in_width,
                      __private const float scale,
@@ -14,91 +52,62 @@ __kernel void reduce(OUT_OF_RANGE_PARAMS
                      __write_only image2d_t output) {
   const int w = get_local_id(0);
   const int h = get_local_id(1);
-  const int bc = get_global_id(2);
+  const int bcp = get_global_id(2);
 
 #ifndef NON_UNIFORM_WORK_GROUP
-  if (bc >= global_size_dim2)
+  if (bcp >= global_size_dim2)
     return;
 #endif
   const int width = get_local_size(0);
+  const int group_size = mul24(width, get_local_size(1));
   const int index = mad24(h, width, w);
+  const int bc = bcp / parts;
+  const int part = mad24(bc, -parts, bcp);
   const int b = bc / channel_blocks;
   const int ch = mad24(b, -channel_blocks, bc);
 
+  const int begin = mul24(part, part_size);
+  const int end = min(begin + part_size, mul24(in_height, in_width));
   DATA_TYPE4 in;
-
-#if REDUCE_TYPE == 1
-  DATA_TYPE4 part_result = (DATA_TYPE4){MAXFLOAT, MAXFLOAT, MAXFLOAT, MAXFLOAT};
-#elif REDUCE_TYPE == 2
-  DATA_TYPE4 part_result = (DATA_TYPE4){-MAXFLOAT, -MAXFLOAT, -MAXFLOAT, -MAXFLOAT};
-#elif REDUCE_TYPE == 3
-  DATA_TYPE4 part_result = (DATA_TYPE4){1, 1, 1, 1};
-#else
-  DATA_TYPE4 part_result = (DATA_TYPE4){0, 0, 0, 0};
-#endif
-  const bool after_last = (last_index > 0 && index >= last_index);
-  // After last index, each kernel only computes (compute_size - 1) elements.
-  const int actual_compute_size = select(compute_size,
-                                         compute_size - 1,
-                                         after_last);
-  const int base_offset = mul24(index, actual_compute_size);
-  const int offset= select(base_offset,
-                           base_offset + last_index,
-                           after_last);
-#pragma unroll
-  for (int i = 0; i < actual_compute_size; ++i) {
-    int element_idx = offset + i;
+  DATA_TYPE4 part_result = REDUCE_INIT;
+  for (int element_idx = begin + index; element_idx < end;
+       element_idx += group_size) {
     int h_idx = element_idx / in_width;
     int w_idx = mad24(h_idx, -in_width, element_idx);
     int pos_x = mad24(ch, in_width, w_idx);
     int pos_y = mad24(b, in_height, h_idx);
     in = READ_IMAGET(input, SAMPLER, (int2)(pos_x, pos_y));
-// MIN
-#if REDUCE_TYPE == 1
-   part_result = fmin(part_result, in);
-// MAX
-#elif REDUCE_TYPE == 2
-   part_result = fmax(part_result, in);
-// PROD
-#elif REDUCE_TYPE == 3
-    part_result = part_result * in;
-// MEAN
-#else
-    part_result = part_result + in;
-#endif
+    part_result = REDUCE(part_result, in);
   }
 
 #if REDUCE_TYPE == 0
   part_result = part_result * scale;
 #endif
+#ifdef USE_SUBGROUP
+  // one partial result of each sub group is left to combine
+  part_result = sub_group_reduce4(part_result);
+  if (get_sub_group_local_id() == 0) {
+    local_buffer[get_sub_group_id()] = part_result;
+  }
+  int result_num = get_num_sub_groups();
+#else
   local_buffer[index] = part_result;
-
-#ifdef NON_QUALCOMM_ADRENO
-  barrier(CLK_LOCAL_MEM_FENCE);
+  int result_num = group_size;
 #endif
+  barrier(CLK_LOCAL_MEM_FENCE);
 
-  if (w == 0 && h == 0) {
-#if REDUCE_TYPE == 1
-    DATA_TYPE4 out = (DATA_TYPE4){MAXFLOAT, MAXFLOAT, MAXFLOAT, MAXFLOAT};
-#elif REDUCE_TYPE == 2
-    DATA_TYPE4 out = (DATA_TYPE4){-MAXFLOAT, -MAXFLOAT, -MAXFLOAT, -MAXFLOAT};
-#elif REDUCE_TYPE == 3
-    DATA_TYPE4 out = (DATA_TYPE4){1, 1, 1, 1};
-#else
-    DATA_TYPE4 out = (DATA_TYPE4){0, 0, 0, 0};
-#endif
-#pragma unroll
-    for (int i = 0; i < group_num; ++i) {
-#if REDUCE_TYPE == 1
-      out = fmin(out, local_buffer[i]);
-#elif REDUCE_TYPE == 2
-      out = fmax(out, local_buffer[i]);
-#elif REDUCE_TYPE == 3
-      out = out * local_buffer[i];
-#else
-      out = out + local_buffer[i];
-#endif
+  // halves the partial results of the group until one is left
+  while (result_num > 1) {
+    const int half_num = (result_num + 1) >> 1;
+    if (index + half_num < result_num) {
+      local_buffer[index] = REDUCE(local_buffer[index],
+                                   local_buffer[index + half_num]);
     }
-    WRITE_IMAGET(output, (int2)(ch, b), out);
+    barrier(CLK_LOCAL_MEM_FENCE);
+    result_num = half_num;
+  }
+
+  if (index == 0) {
+    WRITE_IMAGET(output, (int2)(mad24(ch, parts, part), b), local_buffer[0]);
   }
 }
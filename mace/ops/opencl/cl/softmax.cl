@@ -84,3 +84,102 @@ __kernel void softmax(OUT_OF_RANGE_PARAMS
 
   WRITE_IMAGET(output, (int2)(pos, hb_idx), data);
 }
+
+// the lanes of the last channel block past the channels are masked by value
+inline DATA_TYPE4 mask_channels(DATA_TYPE4 data,
+                                const int exceeded,
+                                const DATA_TYPE value) {
+  switch (exceeded) {
+    case 3:
+      data.y = value;
+    case 2:
+      data.z = value;
+    case 1:
+      data.w = value;
+  }
+  return data;
+}
+
+// the tree reduction of a value of every work item of the group, each gets
+// the result
+inline DATA_TYPE group_reduce(__local DATA_TYPE *buffer,
+                              DATA_TYPE value,
+                              const int lid,
+                              const int group_size,
+                              const bool is_max) {
+  buffer[lid] = value;
+  barrier(CLK_LOCAL_MEM_FENCE);
+  for (int num = group_size; num > 1;) {
+    const int half_num = (num + 1) >> 1;
+    if (lid + half_num < num) {
+      buffer[lid] = is_max ? max(buffer[lid], buffer[lid + half_num])
+                           : buffer[lid] + buffer[lid + half_num];
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+    num = half_num;
+  }
+  const DATA_TYPE result = buffer[0];
+  // the buffer is written again by the next reduction
+  barrier(CLK_LOCAL_MEM_FENCE);
+  return result;
+}
+
+// The softmax of a pixel of many channels by a work group of dim 0, whose
+// work items read the channel blocks interleaved and combine the max and
+// the sum of them in local memory, instead of every work item of a channel
+// block reading all the channels again.
+__kernel void softmax_group(OUT_OF_RANGE_PARAMS
+                            GLOBAL_WORK_GROUP_SIZE_DIM3
+                            __read_only image2d_t input,
+                            __local DATA_TYPE *group_buffer,
+                            __private const int channels,
+                            __write_only image2d_t output) {
+  const int lid = get_local_id(0);
+  const int width_idx = get_global_id(1);
+  const int hb_idx = get_global_id(2);
+
+#ifndef NON_UNIFORM_WORK_GROUP
+  if (width_idx >= global_size_dim1 || hb_idx >= global_size_dim2) {
+    return;
+  }
+#endif
+  const int group_size = get_local_size(0);
+  const int chan_blks = (channels + 3) >> 2;
+  const int last_exceeded = (chan_blks << 2) - channels;
+  const int width = global_size_dim1;
+
+  DATA_TYPE4 data;
+  DATA_TYPE4 max4 = (DATA_TYPE4)(-FLT_MAX);
+  for (int i = lid; i < chan_blks; i += group_size) {
+    data = READ_IMAGET(input, SAMPLER,
+                       (int2)(mad24(i, width, width_idx), hb_idx));
+    if (i == chan_blks - 1) {
+      data = mask_channels(data, last_exceeded, -FLT_MAX);
+    }
+    max4 = max(max4, data);
+  }
+  const DATA_TYPE max_value = group_reduce(
+      group_buffer, max(max(max4.x, max4.y), max(max4.z, max4.w)), lid,
+      group_size, true);
+
+  DATA_TYPE4 sum4 = 0;
+  for (int i = lid; i < chan_blks; i += group_size) {
+    data = READ_IMAGET(input, SAMPLER,
+                       (int2)(mad24(i, width, width_idx), hb_idx));
+    data = native_exp(data - max_value);
+    if (i == chan_blks - 1) {
+      data = mask_channels(data, last_exceeded, 0);
+    }
+    sum4 += data;
+  }
+  const DATA_TYPE sum = group_reduce(
+      group_buffer, sum4.x + sum4.y + sum4.z + sum4.w, lid, group_size,
+      false);
+
+  for (int i = lid; i < chan_blks; i += group_size) {
+    const int pos = mad24(i, width, width_idx);
+    data = READ_IMAGET(input, SAMPLER, (int2)(pos, hb_idx));
+    data = native_exp(data - max_value) / sum;
+    WRITE_IMAGET(output, (int2)(pos, hb_idx), data);
+  }
+}
@@ -1,14 +1,12 @@
 #include <common.h>
 
+// The work items of a group read the pixels of a channel block interleaved,
+// then sum their results in a tree in local memory.
 __kernel void sqrdiff_mean(OUT_OF_RANGE_PARAMS
                            GLOBAL_WORK_GROUP_SIZE_DIM3
                            __read_only image2d_t input,
                            __read_only image2d_t input1,
                            __local float4 *group_sum,
-                           __private const int group_size,
-                           __private const int partial_len,
-                           __private const int remain_index,
-                           __private const int batch,
                            __private const int in_height,
                            __private const int in_width,
                            __private const float image_size_reciprocal,
@@ -23,24 +21,17 @@ __kernel void sqrdiff_mean(OUT_OF_RANGE_PARAMS
     return;
 #endif
   const int dim0_size = get_local_size(0);
+  const int group_size = mul24(dim0_size, get_local_size(1));
   float4 tmp = (float4){0, 0, 0, 0};
   const int index = mad24(j, dim0_size, i);
   const int b = k / channel_blocks;
   const int ch = mad24(b, -channel_blocks, k);
 
   DATA_TYPE4 in;
-  const int valid_part_len = select(partial_len,
-                                    partial_len - 1,
-                                    remain_index > 0 && index >= remain_index);
-  const int full_offset = mul24(index, partial_len);
-  const int base_offset = select(full_offset,
-                               full_offset - (index - remain_index),
-                               valid_part_len < partial_len);
   float4 diff = (float4){0, 0, 0, 0};
   DATA_TYPE4 in1 = READ_IMAGET(input1, SAMPLER, (int2)(ch, b));
-#pragma unroll
-  for (int l = 0; l < valid_part_len; ++l) {
-    int offset = base_offset + l;
+  const int image_size = mul24(in_height, in_width);
+  for (int offset = index; offset < image_size; offset += group_size) {
     int h_id = offset / in_width;
     int w_id = mad24(h_id, -in_width, offset);
     int pos_x = mad24(ch, in_width, w_id);
@@ -50,17 +41,19 @@ __kernel void sqrdiff_mean(OUT_OF_RANGE_PARAMS
     tmp = tmp + diff * diff;
   }
   group_sum[index] = tmp * image_size_reciprocal;
-
-#ifdef NON_QUALCOMM_ADRENO
   barrier(CLK_LOCAL_MEM_FENCE);
-#endif
 
-  if (i == 0 && j == 0) {
-    DATA_TYPE4 out = (DATA_TYPE4){0, 0, 0, 0};
-#pragma unroll
-    for (int l = 0; l < group_size; ++l) {
-      out = out + group_sum[l];
+  // halves the partial sums of the group until one is left
+  for (int sum_num = group_size; sum_num > 1;) {
+    const int half_num = (sum_num + 1) >> 1;
+    if (index + half_num < sum_num) {
+      group_sum[index] += group_sum[index + half_num];
     }
-    WRITE_IMAGET(output, (int2)(ch, b), out);
+    barrier(CLK_LOCAL_MEM_FENCE);
+    sum_num = half_num;
+  }
+
+  if (index == 0) {
+    WRITE_IMAGET(output, (int2)(ch, b), group_sum[0]);
   }
 }
@@ -559,3 +559,111 @@ __kernel void winograd_inverse_transform_4x4(OUT_OF_RANGE_PARAMS
     WRITE_IMAGET(output, (int2)(coord_x + i, coord_y + 3), out3[i]);
   }
 }
+
+// Multiplies the transformed filter with the transformed input of one tile
+// and applies the output transform in place, so the blk_sqr products of the
+// tile never leave the registers.
+__kernel void winograd_matmul_inverse_transform_2x2(OUT_OF_RANGE_PARAMS
+                                                    GLOBAL_WORK_GROUP_SIZE_DIM2
+                                                    __read_only image2d_t filter, /* blk_sqr * out_chan, in_chan/4 */
+                                                    __read_only image2d_t input, /* blk_sqr * in_chan/4, round_hw */
+#ifdef BIAS
+                                                    __read_only image2d_t bias, /* cout%4 * cout/4 */
+#endif
+                                                    __write_only image2d_t output,
+                                                    __private const int out_height,
+                                                    __private const int out_width,
+                                                    __private const int round_hw,
+                                                    __private const int round_w,
+                                                    __private const int out_channel,
+                                                    __private const int k_blocks,
+                                                    __private const float relux_max_limit,
+                                                    __private const float leakyrelu_coefficient) {
+  const int width_idx = get_global_id(0);
+  const int height_idx = get_global_id(1);
+
+#ifndef NON_UNIFORM_WORK_GROUP
+  if (width_idx >= global_size_dim0 || height_idx >= global_size_dim1) {
+    return;
+  }
+#endif
+
+  const int batch = width_idx / round_hw;
+  int t = width_idx - mul24(batch, round_hw);
+  const int n_round_w = t / round_w;
+  const int mod_round_w = t - mul24(n_round_w, round_w);
+  const int out_height_idx = n_round_w << 1;
+  const int out_width_idx = mod_round_w << 1;
+  const int out_chan_idx = height_idx;
+  const int coord_x = mad24(out_chan_idx, out_width, out_width_idx);
+  const int coord_y = mad24(batch, out_height, out_height_idx);
+
+#ifdef BIAS
+  DATA_TYPE4 bias_value =
+     READ_IMAGET(bias, SAMPLER, (int2)(out_chan_idx, 0));
+#endif
+
+  DATA_TYPE4 in[16];
+  DATA_TYPE4 a0, a1, a2, a3, b;
+  int filter_y = out_chan_idx << 2;
+  int input_y = 0;
+#pragma unroll
+  for (short i = 0; i < 16; ++i) {
+    in[i] = 0;
+    for (short pos = 0; pos < k_blocks; ++pos) {
+      a0 = READ_IMAGET(filter, SAMPLER, (int2)(pos, filter_y));
+      a1 = READ_IMAGET(filter, SAMPLER, (int2)(pos, filter_y + 1));
+      a2 = READ_IMAGET(filter, SAMPLER, (int2)(pos, filter_y + 2));
+      a3 = READ_IMAGET(filter, SAMPLER, (int2)(pos, filter_y + 3));
+      b = READ_IMAGET(input, SAMPLER, (int2)(width_idx, input_y + pos));
+      in[i] += (DATA_TYPE4)(dot(a0, b), dot(a1, b), dot(a2, b), dot(a3, b));
+    }
+    filter_y += out_channel;
+    input_y += k_blocks;
+  }
+
+  in[0] = in[0] + in[4] + in[8];
+  in[1] = in[1] + in[5] + in[9];
+  in[2] = in[2] + in[6] + in[10];
+  in[3] = in[3] + in[7] + in[11];
+
+  in[0] = in[0] + in[1] + in[2];
+  in[1] = in[1] - in[2] - in[3];
+
+  in[4] = in[4] - in[8] - in[12];
+  in[5] = in[5] - in[9] - in[13];
+  in[6] = in[6] - in[10] - in[14];
+  in[7] = in[7] - in[11] - in[15];
+
+  in[4] = in[4] + in[5] + in[6];
+  in[5] = in[5] - in[6] - in[7];
+
+#ifdef BIAS
+  in[0] += bias_value;
+  in[1] += bias_value;
+  in[4] += bias_value;
+  in[5] += bias_value;
+#endif
+
+#if  defined(USE_RELU) || defined(USE_LEAKYRELU) || defined(USE_RELUX) || defined(USE_TANH) || defined(USE_SIGMOID)
+  in[0] = do_activation(in[0], relux_max_limit, leakyrelu_coefficient);
+  in[1] = do_activation(in[1], relux_max_limit, leakyrelu_coefficient);
+  in[4] = do_activation(in[4], relux_max_limit, leakyrelu_coefficient);
+  in[5] = do_activation(in[5], relux_max_limit, leakyrelu_coefficient);
+#endif
+
+  WRITE_IMAGET(output, (int2)(coord_x, coord_y), in[0]);
+
+  t = 0;
+  if (out_width_idx + 1 < out_width) {
+    WRITE_IMAGET(output, (int2)(coord_x + 1, coord_y), in[1]);
+    t += 1;
+  }
+  if (out_height_idx + 1 < out_height) {
+    WRITE_IMAGET(output, (int2)(coord_x, coord_y + 1), in[4]);
+    t += 1;
+  }
+  if (t == 2) {
+    WRITE_IMAGET(output, (int2)(coord_x + 1, coord_y + 1), in[5]);
+  }
+}
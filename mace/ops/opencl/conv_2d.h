@@ -39,6 +39,8 @@ class OpenCLConv2dKernel {
       const Tensor *input,
       const Tensor *filter,
       const Tensor *bias,
+      const Tensor *residual,
+      const int depth_to_space,
       const int *strides,
       const Padding &padding_type,
       const std::vector<int> &padding_data,
@@ -15,6 +15,10 @@
 #ifndef MACE_OPS_OPENCL_ELTWISE_H_
 #define MACE_OPS_OPENCL_ELTWISE_H_
 
+#include <algorithm>
+#include <vector>
+
+#include "mace/core/types.h"
 #include "mace/public/mace.h"
 #include "mace/utils/utils.h"
 
@@ -34,6 +38,26 @@ class OpenCLEltwiseKernel {
   MACE_EMPTY_VIRTUAL_DESTRUCTOR(OpenCLEltwiseKernel);
 };
 
+// The shape of the broadcast of the two shapes aligned to the right, or false
+// if a dim of them is neither the same nor 1.
+inline bool EltwiseBroadcastShape(const std::vector<index_t> &shape0,
+                                  const std::vector<index_t> &shape1,
+                                  std::vector<index_t> *output_shape) {
+  const size_t rank = std::max(shape0.size(), shape1.size());
+  output_shape->assign(rank, 1);
+  for (size_t i = 0; i < rank; ++i) {
+    const index_t dim0 =
+        i < shape0.size() ? shape0[shape0.size() - 1 - i] : 1;
+    const index_t dim1 =
+        i < shape1.size() ? shape1[shape1.size() - 1 - i] : 1;
+    if (dim0 != dim1 && dim0 != 1 && dim1 != 1) {
+      return false;
+    }
+    (*output_shape)[rank - 1 - i] = std::max(dim0, dim1);
+  }
+  return true;
+}
+
 }  // namespace ops
 }  // namespace mace
 
@@ -0,0 +1,61 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_OPS_OPENCL_FUSED_ELEMENTWISE_H_
+#define MACE_OPS_OPENCL_FUSED_ELEMENTWISE_H_
+
+#include <vector>
+
+#include "mace/public/mace.h"
+#include "mace/utils/utils.h"
+
+namespace mace {
+
+class OpContext;
+class Tensor;
+
+namespace ops {
+
+enum FusedElementwiseKind {
+  FUSED_BIAS_ADD = 0,
+  FUSED_ACTIVATION = 1,
+  FUSED_ELTWISE = 2,
+};
+
+// an op of a fused chain, applied to the output of the previous one
+struct FusedElementwiseStep {
+  FusedElementwiseKind kind;
+  // the ActivationType or the EltwiseType
+  int type;
+  // the input of the fused op read by the step, -1 for none
+  int operand;
+  // whether the chain is the second operand of Eltwise
+  bool swapped;
+  // the RELUX max limit, the LEAKYRELU coefficient or the Eltwise scalar
+  float value;
+};
+
+class OpenCLFusedElementwiseKernel {
+ public:
+  virtual MaceStatus Compute(
+      OpContext *context,
+      const std::vector<const Tensor *> &inputs,
+      Tensor *output) = 0;
+  MACE_EMPTY_VIRTUAL_DESTRUCTOR(OpenCLFusedElementwiseKernel);
+};
+
+}  // namespace ops
+}  // namespace mace
+
+#endif  // MACE_OPS_OPENCL_FUSED_ELEMENTWISE_H_
@@ -34,8 +34,10 @@ std::vector<index_t> FormatBufferShape(
         return buffer_shape;
       } else if (buffer_shape_size == 2) {  // NC
         return {buffer_shape[0], 1, 1, buffer_shape[1]};
+      } else if (buffer_shape_size == 3) {  // TNC, the steps of a sequence
+        return {buffer_shape[0] * buffer_shape[1], 1, 1, buffer_shape[2]};
       } else {
-        LOG(FATAL) << "GPU only support 2D or 4D input and output";
+        LOG(FATAL) << "GPU only support 2D, 3D or 4D input and output";
       }
     case IN_OUT_HEIGHT:
     case IN_OUT_WIDTH:
@@ -59,6 +61,8 @@ std::string DtToCLDt(const DataType dt) {
       return "float";
     case DT_HALF:
       return "half";
+    case DT_UINT8:
+      return "uchar";
     default:
       LOG(FATAL) << "Unsupported data type";
       return "";
@@ -81,6 +85,7 @@ std::string DtToUpCompatibleCLDt(const DataType dt) {
   switch (dt) {
     case DT_FLOAT:
     case DT_HALF:
+    case DT_UINT8:
       return "float";
     default:
       LOG(FATAL) << "Unsupported data type";
@@ -118,75 +123,167 @@ std::vector<uint32_t> Default3DLocalWS(OpenCLRuntime *runtime,
   return lws;
 }
 
-MaceStatus TuningOrRun3DKernel(OpenCLRuntime *runtime,
-                               const cl::Kernel &kernel,
-                               const std::string tuning_key,
-                               const uint32_t *gws,
-                               const std::vector<uint32_t> &lws,
-                               StatsFuture *future) {
-  auto params_generator = [&]() -> std::vector<std::vector<uint32_t>> {
-    const uint32_t kwg_size =
-        static_cast<uint32_t>(runtime->GetKernelMaxWorkGroupSize(kernel));
-    std::vector<std::vector<uint32_t>> results;
-    std::vector<std::vector<uint32_t>> candidates = {
-        // TODO(heliangliang): tuning these magic numbers
-        {gws[0], gws[1], gws[2], 0},
-        {gws[0], gws[1], gws[2] / 8, 0},
-        {gws[0], gws[1], gws[2] / 4, 0},
-        {gws[0], gws[1], 8, 0},
-        {gws[0], gws[1], 4, 0},
-        {gws[0], gws[1], 1, 0},
-        {gws[0] / 4, gws[1], gws[2], 0},
-        {gws[0] / 4, gws[1], gws[2] / 8, 0},
-        {gws[0] / 4, gws[1], gws[2] / 4, 0},
-        {gws[0] / 4, gws[1], 8, 0},
-        {gws[0] / 4, gws[1], 4, 0},
-        {gws[0] / 4, gws[1], 1, 0},
-        {gws[0] / 8, gws[1], gws[2], 0},
-        {gws[0] / 8, gws[1], gws[2] / 8, 0},
-        {gws[0] / 8, gws[1], gws[2] / 4, 0},
-        {gws[0] / 8, gws[1], 8, 0},
-        {gws[0] / 8, gws[1], 4, 0},
-        {gws[0] / 8, gws[1], 1, 0},
-        {4, gws[1], gws[2], 0},
-        {4, gws[1], gws[2] / 8, 0},
-        {4, gws[1], gws[2] / 4, 0},
-        {4, gws[1], 8, 0},
-        {4, gws[1], 4, 0},
-        {4, gws[1], 1, 0},
-        {1, gws[1], gws[2], 0},
-        {1, gws[1], gws[2] / 8, 0},
-        {1, gws[1], gws[2] / 4, 0},
-        {1, gws[1], 8, 0},
-        {1, gws[1], 4, 0},
-        {1, gws[1], 1, 0},
-    };
-    for (auto &ele : candidates) {
-      const uint32_t tmp = ele[0] * ele[1] * ele[2];
-      if (0 < tmp && tmp <= kwg_size) {
-        results.push_back(ele);
-      }
-    }
-    return results;
+namespace {
+// Creating an event per launch costs host time, only ask for one when the
+// launch is timed or somebody waits on it.
+cl::Event *RunEvent(Timer *timer, StatsFuture *future, cl::Event *event) {
+  return timer == nullptr && future == nullptr ? nullptr : event;
+}
+
+// Fits the parameters tuned for another shape of the kernel, {lws..., block},
+// to gws: no local size beyond the global one nor more work items than the
+// kernel allows, the block a multiple of the local size it splits.
+bool FitLocalWS(OpenCLRuntime *runtime,
+                const cl::Kernel &kernel,
+                const uint32_t *gws,
+                const size_t dims,
+                std::vector<uint32_t> *params) {
+  const uint32_t kwg_size =
+      static_cast<uint32_t>(runtime->GetKernelMaxWorkGroupSize(kernel));
+  if (params->size() <= dims || kwg_size == 0) {
+    return false;
+  }
+  std::vector<uint32_t> &lws = *params;
+  uint32_t items = 1;
+  for (size_t i = 0; i < dims; ++i) {
+    lws[i] = std::max<uint32_t>(std::min(lws[i], gws[i]), 1);
+    items *= lws[i];
+  }
+  while (items > kwg_size) {
+    const size_t largest =
+        std::max_element(lws.begin(), lws.begin() + dims) - lws.begin();
+    items = items / lws[largest] * (lws[largest] / 2);
+    lws[largest] /= 2;
+  }
+  if (lws[dims] != 0) {
+    lws[dims] = RoundUp(lws[dims], lws[dims - 1]);
+  }
+  return true;
+}
+
+std::vector<std::vector<uint32_t>> LWSCandidates3D(OpenCLRuntime *runtime,
+                                                   const cl::Kernel &kernel,
+                                                   const uint32_t *gws) {
+  const uint32_t kwg_size =
+      static_cast<uint32_t>(runtime->GetKernelMaxWorkGroupSize(kernel));
+  std::vector<std::vector<uint32_t>> results;
+  std::vector<std::vector<uint32_t>> candidates = {
+      // TODO(heliangliang): tuning these magic numbers
+      {gws[0], gws[1], gws[2], 0},
+      {gws[0], gws[1], gws[2] / 8, 0},
+      {gws[0], gws[1], gws[2] / 4, 0},
+      {gws[0], gws[1], 8, 0},
+      {gws[0], gws[1], 4, 0},
+      {gws[0], gws[1], 1, 0},
+      {gws[0] / 4, gws[1], gws[2], 0},
+      {gws[0] / 4, gws[1], gws[2] / 8, 0},
+      {gws[0] / 4, gws[1], gws[2] / 4, 0},
+      {gws[0] / 4, gws[1], 8, 0},
+      {gws[0] / 4, gws[1], 4, 0},
+      {gws[0] / 4, gws[1], 1, 0},
+      {gws[0] / 8, gws[1], gws[2], 0},
+      {gws[0] / 8, gws[1], gws[2] / 8, 0},
+      {gws[0] / 8, gws[1], gws[2] / 4, 0},
+      {gws[0] / 8, gws[1], 8, 0},
+      {gws[0] / 8, gws[1], 4, 0},
+      {gws[0] / 8, gws[1], 1, 0},
+      {4, gws[1], gws[2], 0},
+      {4, gws[1], gws[2] / 8, 0},
+      {4, gws[1], gws[2] / 4, 0},
+      {4, gws[1], 8, 0},
+      {4, gws[1], 4, 0},
+      {4, gws[1], 1, 0},
+      {1, gws[1], gws[2], 0},
+      {1, gws[1], gws[2] / 8, 0},
+      {1, gws[1], gws[2] / 4, 0},
+      {1, gws[1], 8, 0},
+      {1, gws[1], 4, 0},
+      {1, gws[1], 1, 0},
   };
-  cl::Event event;
-  auto func = [&](const std::vector<uint32_t> &params, Timer *timer,
-                  std::vector<uint32_t> *tuning_result) -> cl_int {
-    MACE_CHECK(params.size() == 4)
-        << "Tuning parameters of 3D kernel must be 4D";
-    cl_int error = CL_SUCCESS;
-    std::vector<uint32_t> internal_gws(gws, gws + 3);
-    if (!runtime->IsNonUniformWorkgroupsSupported()) {
-      for (size_t i = 0; i < 3; ++i) {
-        MACE_CHECK(params[i] != 0);
-        internal_gws[i] = RoundUp(gws[i], params[i]);
+  for (auto &ele : candidates) {
+    const uint32_t tmp = ele[0] * ele[1] * ele[2];
+    if (0 < tmp && tmp <= kwg_size) {
+      results.push_back(ele);
+    }
+  }
+  return results;
+}
+
+cl_int Run3DKernel(OpenCLRuntime *runtime,
+                   const cl::Kernel &kernel,
+                   const uint32_t *gws,
+                   const std::vector<uint32_t> &params,
+                   Timer *timer,
+                   std::vector<uint32_t> *tuning_result,
+                   cl::Event *event) {
+  MACE_CHECK(params.size() >= 4)
+      << "Tuning parameters of 3D kernel must be at least 4D";
+  cl_int error = CL_SUCCESS;
+  std::vector<uint32_t> internal_gws(gws, gws + 3);
+  if (!runtime->IsNonUniformWorkgroupsSupported()) {
+    for (size_t i = 0; i < 3; ++i) {
+      MACE_CHECK(params[i] != 0);
+      internal_gws[i] = RoundUp(gws[i], params[i]);
+    }
+  }
+
+  if (timer == nullptr) {
+    uint32_t block_size = params[3] == 0 ? internal_gws[2] : params[3];
+    const uint32_t num_blocks =
+        RoundUpDiv<uint32_t>(internal_gws[2], block_size);
+    const bool yield = runtime->max_kernel_micros() > 0;
+    for (uint32_t i = 0; i < num_blocks; ++i) {
+      uint32_t gws2 = block_size;
+      if (runtime->IsNonUniformWorkgroupsSupported() &&
+          (i == num_blocks - 1)) {
+        gws2 = (internal_gws[2] - (i * block_size));
+      }
+      // every block gets its own event when the kernels are recorded
+      const bool recording = runtime->is_kernel_recording();
+      cl::Event block_event;
+      error = runtime->command_queue().enqueueNDRangeKernel(
+          kernel, cl::NDRange(0, 0, i * block_size),
+          cl::NDRange(internal_gws[0], internal_gws[1], gws2),
+          cl::NDRange(params[0], params[1], params[2]), nullptr,
+          recording ? &block_event : event);
+      MACE_CL_RET_ERROR(error);
+      if (recording) {
+        const uint32_t block_gws[3] = {internal_gws[0], internal_gws[1], gws2};
+        runtime->RecordKernel(kernel, block_gws, params.data(), 3,
+                              block_event);
+        if (event != nullptr) {
+          *event = block_event;
+        }
+      }
+      runtime->KernelEnqueued();
+      if (yield && i + 1 < num_blocks) {
+        // a point where the GPU can be preempted, e.g. by the compositor
+        error = runtime->command_queue().flush();
+        MACE_CL_RET_ERROR(error);
       }
     }
+  } else {
+    timer->ClearTiming();
+    error = runtime->command_queue().enqueueNDRangeKernel(
+        kernel, cl::NullRange,
+        cl::NDRange(internal_gws[0], internal_gws[1], internal_gws[2]),
+        cl::NDRange(params[0], params[1], params[2]), nullptr, event);
+    MACE_CL_RET_ERROR(error);
+    timer->AccumulateTiming();
+    tuning_result->assign(params.begin(), params.begin() + 4);
 
-    if (timer == nullptr) {
-      uint32_t block_size = params[3] == 0 ? internal_gws[2] : params[3];
-      const uint32_t num_blocks =
-          RoundUpDiv<uint32_t>(internal_gws[2], block_size);
+    if (runtime->max_kernel_micros() > 0) {
+      double elapse_time = timer->AccumulatedMicros();
+      timer->ClearTiming();
+      const double max_micros = runtime->max_kernel_micros();
+      uint32_t num_blocks = std::min(
+          static_cast<uint32_t>(elapse_time / max_micros) + 1, gws[2]);
+      uint32_t block_size = gws[2] / num_blocks;
+      if (!runtime->IsNonUniformWorkgroupsSupported()) {
+        block_size = RoundUp(block_size, params[2]);
+      }
+      (*tuning_result)[3] = block_size;
+      num_blocks = RoundUpDiv<uint32_t>(internal_gws[2], block_size);
       for (uint32_t i = 0; i < num_blocks; ++i) {
         uint32_t gws2 = block_size;
         if (runtime->IsNonUniformWorkgroupsSupported() &&
@@ -196,51 +293,37 @@ MaceStatus TuningOrRun3DKernel(OpenCLRuntime *runtime,
         error = runtime->command_queue().enqueueNDRangeKernel(
             kernel, cl::NDRange(0, 0, i * block_size),
             cl::NDRange(internal_gws[0], internal_gws[1], gws2),
-            cl::NDRange(params[0], params[1], params[2]), nullptr, &event);
+            cl::NDRange(params[0], params[1], params[2]), nullptr, event);
         MACE_CL_RET_ERROR(error);
-      }
-    } else {
-      timer->ClearTiming();
-      error = runtime->command_queue().enqueueNDRangeKernel(
-          kernel, cl::NullRange,
-          cl::NDRange(internal_gws[0], internal_gws[1], internal_gws[2]),
-          cl::NDRange(params[0], params[1], params[2]), nullptr, &event);
-      MACE_CL_RET_ERROR(error);
-      timer->AccumulateTiming();
-      tuning_result->assign(params.begin(), params.end());
-
-      if (LimitKernelTime()) {
-        double elapse_time = timer->AccumulatedMicros();
-        timer->ClearTiming();
-        uint32_t num_blocks = std::min(
-            static_cast<uint32_t>(elapse_time / kMaxKernelExecTime) + 1,
-            gws[2]);
-        uint32_t block_size = gws[2] / num_blocks;
-        if (!runtime->IsNonUniformWorkgroupsSupported()) {
-          block_size = RoundUp(block_size, params[2]);
-        }
-        (*tuning_result)[3] = block_size;
-        num_blocks = RoundUpDiv<uint32_t>(internal_gws[2], block_size);
-        for (uint32_t i = 0; i < num_blocks; ++i) {
-          uint32_t gws2 = block_size;
-          if (runtime->IsNonUniformWorkgroupsSupported() &&
-              (i == num_blocks - 1)) {
-            gws2 = (internal_gws[2] - (i * block_size));
-          }
-          error = runtime->command_queue().enqueueNDRangeKernel(
-              kernel, cl::NDRange(0, 0, i * block_size),
-              cl::NDRange(internal_gws[0], internal_gws[1], gws2),
-              cl::NDRange(params[0], params[1], params[2]), nullptr, &event);
-          MACE_CL_RET_ERROR(error);
-          timer->AccumulateTiming();
-        }
+        timer->AccumulateTiming();
       }
     }
-    return error;
+  }
+  return error;
+}
+}  // namespace
+
+MaceStatus TuningOrRun3DKernel(OpenCLRuntime *runtime,
+                               const cl::Kernel &kernel,
+                               const std::string tuning_key,
+                               const uint32_t *gws,
+                               const std::vector<uint32_t> &lws,
+                               StatsFuture *future) {
+  auto params_generator = [&]() -> std::vector<std::vector<uint32_t>> {
+    return LWSCandidates3D(runtime, kernel, gws);
+  };
+  cl::Event event;
+  auto func = [&](const std::vector<uint32_t> &params, Timer *timer,
+                  std::vector<uint32_t> *tuning_result) -> cl_int {
+    return Run3DKernel(runtime, kernel, gws, params, timer, tuning_result,
+                       RunEvent(timer, future, &event));
+  };
+  auto fit_params = [&](std::vector<uint32_t> *params) -> bool {
+    return FitLocalWS(runtime, kernel, gws, 3, params);
   };
   OpenCLProfilingTimer timer(runtime, &event);
   cl_int err = runtime->tuner()->template TuneOrRun<cl_int>(
-      tuning_key, lws, params_generator, func, &timer);
+      tuning_key, lws, params_generator, func, &timer, fit_params);
   MACE_CL_RET_STATUS(err);
 
   if (future != nullptr) {
@@ -254,25 +337,25 @@ MaceStatus TuningOrRun3DKernel(OpenCLRuntime *runtime,
   return MaceStatus::MACE_SUCCESS;
 }
 
-MaceStatus TuningOrRun2DKernel(OpenCLRuntime *runtime,
-                               const cl::Kernel &kernel,
-                               const std::string tuning_key,
-                               const uint32_t *gws,
-                               const std::vector<uint32_t> &lws,
-                               StatsFuture *future) {
+MaceStatus TuningOrRunTiled3DKernel(OpenCLRuntime *runtime,
+                                    const std::string tuning_key,
+                                    const std::vector<uint32_t> &tiles,
+                                    const std::vector<uint32_t> &default_params,
+                                    const TiledKernelPreparer &prepare,
+                                    StatsFuture *future) {
+  MACE_CHECK(default_params.size() == 5)
+      << "Tuning parameters of tiled 3D kernel must be 5D";
+  MaceStatus prepare_status = MaceStatus::MACE_SUCCESS;
   auto params_generator = [&]() -> std::vector<std::vector<uint32_t>> {
-    const uint32_t kwg_size =
-        static_cast<uint32_t>(runtime->GetKernelMaxWorkGroupSize(kernel));
     std::vector<std::vector<uint32_t>> results;
-    std::vector<std::vector<uint32_t>> candidates = {
-        {kwg_size / 2, 2, 0},     {kwg_size / 4, 4, 0},
-        {kwg_size / 8, 8, 0},     {kwg_size / 16, 16, 0},
-        {kwg_size / 32, 32, 0},   {kwg_size / 64, 64, 0},
-        {kwg_size / 128, 128, 0}, {kwg_size / 256, 256, 0},
-        {kwg_size, 1, 0},         {1, kwg_size, 0}};
-    for (auto &ele : candidates) {
-      const uint32_t tmp = ele[0] * ele[1];
-      if (0 < tmp && tmp <= kwg_size) {
+    for (uint32_t tile : tiles) {
+      cl::Kernel *kernel = nullptr;
+      std::vector<uint32_t> gws;
+      if (prepare(tile, &kernel, &gws) != MaceStatus::MACE_SUCCESS) {
+        continue;
+      }
+      for (auto &ele : LWSCandidates3D(runtime, *kernel, gws.data())) {
+        ele.push_back(tile);
         results.push_back(ele);
       }
     }
@@ -281,74 +364,272 @@ MaceStatus TuningOrRun2DKernel(OpenCLRuntime *runtime,
   cl::Event event;
   auto func = [&](const std::vector<uint32_t> &params, Timer *timer,
                   std::vector<uint32_t> *tuning_result) -> cl_int {
-    MACE_CHECK(params.size() == 3)
-        << "Tuning parameters of 2D kernel must be 3d";
-    cl_int error = CL_SUCCESS;
-    std::vector<uint32_t> internal_gws(gws, gws + 2);
-    if (!runtime->IsNonUniformWorkgroupsSupported()) {
-      for (size_t i = 0; i < 2; ++i) {
-        MACE_CHECK(params[i] != 0);
-        internal_gws[i] = RoundUp(gws[i], params[i]);
+    // parameters tuned before tiling was supported carry no tile
+    const uint32_t tile = params.size() > 4 ? params[4] : default_params[4];
+    cl::Kernel *kernel = nullptr;
+    std::vector<uint32_t> gws;
+    prepare_status = prepare(tile, &kernel, &gws);
+    if (prepare_status != MaceStatus::MACE_SUCCESS) {
+      return CL_INVALID_KERNEL;
+    }
+    cl_int error = Run3DKernel(runtime, *kernel, gws.data(), params, timer,
+                               tuning_result,
+                               RunEvent(timer, future, &event));
+    if (timer != nullptr && tuning_result != nullptr) {
+      tuning_result->push_back(tile);
+    }
+    return error;
+  };
+  auto fit_params = [&](std::vector<uint32_t> *params) -> bool {
+    if (params->size() <= 4 ||
+        std::find(tiles.begin(), tiles.end(), (*params)[4]) == tiles.end()) {
+      return false;
+    }
+    cl::Kernel *kernel = nullptr;
+    std::vector<uint32_t> gws;
+    if (prepare((*params)[4], &kernel, &gws) != MaceStatus::MACE_SUCCESS) {
+      return false;
+    }
+    return FitLocalWS(runtime, *kernel, gws.data(), 3, params);
+  };
+  OpenCLProfilingTimer timer(runtime, &event);
+  cl_int err = runtime->tuner()->template TuneOrRun<cl_int>(
+      tuning_key, default_params, params_generator, func, &timer,
+      fit_params);
+  MACE_RETURN_IF_ERROR(prepare_status);
+  MACE_CL_RET_STATUS(err);
+
+  if (future != nullptr) {
+    future->wait_fn = [runtime, event](CallStats *stats) {
+      event.wait();
+      if (stats != nullptr) {
+        runtime->GetCallStats(event, stats);
       }
+    };
+  }
+  return MaceStatus::MACE_SUCCESS;
+}
+
+namespace {
+std::vector<std::vector<uint32_t>> LWSCandidates2D(OpenCLRuntime *runtime,
+                                                   const cl::Kernel &kernel) {
+  const uint32_t kwg_size =
+      static_cast<uint32_t>(runtime->GetKernelMaxWorkGroupSize(kernel));
+  std::vector<std::vector<uint32_t>> results;
+  std::vector<std::vector<uint32_t>> candidates = {
+      {kwg_size / 2, 2, 0},     {kwg_size / 4, 4, 0},
+      {kwg_size / 8, 8, 0},     {kwg_size / 16, 16, 0},
+      {kwg_size / 32, 32, 0},   {kwg_size / 64, 64, 0},
+      {kwg_size / 128, 128, 0}, {kwg_size / 256, 256, 0},
+      {kwg_size, 1, 0},         {1, kwg_size, 0}};
+  for (auto &ele : candidates) {
+    const uint32_t tmp = ele[0] * ele[1];
+    if (0 < tmp && tmp <= kwg_size) {
+      results.push_back(ele);
+    }
+  }
+  return results;
+}
+
+// `uniform_work_groups` keeps every work group full even when the device
+// supports non-uniform ones, for kernels that synchronize within a group
+cl_int Run2DKernel(OpenCLRuntime *runtime,
+                   const cl::Kernel &kernel,
+                   const uint32_t *gws,
+                   const std::vector<uint32_t> &params,
+                   const bool uniform_work_groups,
+                   Timer *timer,
+                   std::vector<uint32_t> *tuning_result,
+                   cl::Event *event) {
+  MACE_CHECK(params.size() >= 3)
+      << "Tuning parameters of 2D kernel must be at least 3d";
+  const bool non_uniform =
+      runtime->IsNonUniformWorkgroupsSupported() && !uniform_work_groups;
+  cl_int error = CL_SUCCESS;
+  std::vector<uint32_t> internal_gws(gws, gws + 2);
+  if (!non_uniform) {
+    for (size_t i = 0; i < 2; ++i) {
+      MACE_CHECK(params[i] != 0);
+      internal_gws[i] = RoundUp(gws[i], params[i]);
     }
+  }
 
-    if (timer == nullptr) {
-      uint32_t block_size = params[2] == 0 ? internal_gws[1] : params[2];
-      const uint32_t num_blocks =
-          RoundUpDiv<uint32_t>(internal_gws[1], block_size);
+  if (timer == nullptr) {
+    uint32_t block_size = params[2] == 0 ? internal_gws[1] : params[2];
+    const uint32_t num_blocks =
+        RoundUpDiv<uint32_t>(internal_gws[1], block_size);
+    const bool yield = runtime->max_kernel_micros() > 0;
+    for (uint32_t i = 0; i < num_blocks; ++i) {
+      uint32_t gws1 = block_size;
+      if (non_uniform && (i == num_blocks - 1)) {
+        gws1 = (internal_gws[1] - (i * block_size));
+      }
+      const bool recording = runtime->is_kernel_recording();
+      cl::Event block_event;
+      error = runtime->command_queue().enqueueNDRangeKernel(
+          kernel, cl::NDRange(0, i * block_size),
+          cl::NDRange(internal_gws[0], gws1),
+          cl::NDRange(params[0], params[1]), nullptr,
+          recording ? &block_event : event);
+      MACE_CL_RET_ERROR(error);
+      if (recording) {
+        const uint32_t block_gws[2] = {internal_gws[0], gws1};
+        runtime->RecordKernel(kernel, block_gws, params.data(), 2,
+                              block_event);
+        if (event != nullptr) {
+          *event = block_event;
+        }
+      }
+      runtime->KernelEnqueued();
+      if (yield && i + 1 < num_blocks) {
+        // a point where the GPU can be preempted, e.g. by the compositor
+        error = runtime->command_queue().flush();
+        MACE_CL_RET_ERROR(error);
+      }
+    }
+  } else {
+    timer->ClearTiming();
+    error = runtime->command_queue().enqueueNDRangeKernel(
+        kernel, cl::NullRange, cl::NDRange(internal_gws[0], internal_gws[1]),
+        cl::NDRange(params[0], params[1]), nullptr, event);
+    MACE_CL_RET_ERROR(error);
+    timer->AccumulateTiming();
+    tuning_result->assign(params.begin(), params.begin() + 3);
+
+    if (runtime->max_kernel_micros() > 0) {
+      double elapse_time = timer->AccumulatedMicros();
+      timer->ClearTiming();
+      const double max_micros = runtime->max_kernel_micros();
+      uint32_t num_blocks = std::min(
+          static_cast<uint32_t>(elapse_time / max_micros) + 1, gws[1]);
+      uint32_t block_size = gws[1] / num_blocks;
+      if (!non_uniform) {
+        block_size = RoundUp(block_size, params[1]);
+      }
+      (*tuning_result)[2] = block_size;
+      num_blocks = RoundUpDiv<uint32_t>(internal_gws[1], block_size);
       for (uint32_t i = 0; i < num_blocks; ++i) {
         uint32_t gws1 = block_size;
-        if (runtime->IsNonUniformWorkgroupsSupported() &&
-            (i == num_blocks - 1)) {
+        if (non_uniform && (i == num_blocks - 1)) {
           gws1 = (internal_gws[1] - (i * block_size));
         }
         error = runtime->command_queue().enqueueNDRangeKernel(
             kernel, cl::NDRange(0, i * block_size),
             cl::NDRange(internal_gws[0], gws1),
-            cl::NDRange(params[0], params[1]), nullptr, &event);
+            cl::NDRange(params[0], params[1]), nullptr, event);
         MACE_CL_RET_ERROR(error);
+        timer->AccumulateTiming();
       }
-    } else {
-      timer->ClearTiming();
-      error = runtime->command_queue().enqueueNDRangeKernel(
-          kernel, cl::NullRange, cl::NDRange(internal_gws[0], internal_gws[1]),
-          cl::NDRange(params[0], params[1]), nullptr, &event);
-      MACE_CL_RET_ERROR(error);
-      timer->AccumulateTiming();
-      tuning_result->assign(params.begin(), params.end());
+    }
+  }
+  return error;
+}
+}  // namespace
+
+MaceStatus TuningOrRun2DKernel(OpenCLRuntime *runtime,
+                               const cl::Kernel &kernel,
+                               const std::string tuning_key,
+                               const uint32_t *gws,
+                               const std::vector<uint32_t> &lws,
+                               StatsFuture *future) {
+  auto params_generator = [&]() -> std::vector<std::vector<uint32_t>> {
+    return LWSCandidates2D(runtime, kernel);
+  };
+  cl::Event event;
+  auto func = [&](const std::vector<uint32_t> &params, Timer *timer,
+                  std::vector<uint32_t> *tuning_result) -> cl_int {
+    return Run2DKernel(runtime, kernel, gws, params, false, timer,
+                       tuning_result, RunEvent(timer, future, &event));
+  };
+  auto fit_params = [&](std::vector<uint32_t> *params) -> bool {
+    return FitLocalWS(runtime, kernel, gws, 2, params);
+  };
+  OpenCLProfilingTimer timer(runtime, &event);
+  cl_int err = runtime->tuner()->template TuneOrRun<cl_int>(
+      tuning_key, lws, params_generator, func, &timer, fit_params);
+  MACE_CL_RET_STATUS(err);
 
-      if (LimitKernelTime()) {
-        double elapse_time = timer->AccumulatedMicros();
-        timer->ClearTiming();
-        uint32_t num_blocks = std::min(
-            static_cast<uint32_t>(elapse_time / kMaxKernelExecTime) + 1,
-            gws[1]);
-        uint32_t block_size = gws[1] / num_blocks;
-        if (!runtime->IsNonUniformWorkgroupsSupported()) {
-          block_size = RoundUp(block_size, params[1]);
+  if (future != nullptr) {
+    future->wait_fn = [runtime, event](CallStats *stats) {
+      event.wait();
+      if (stats != nullptr) {
+        runtime->GetCallStats(event, stats);
+      }
+    };
+  }
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus TuningOrRunVariant2DKernel(
+    OpenCLRuntime *runtime,
+    const std::string tuning_key,
+    const std::vector<Kernel2DVariant> &variants,
+    const std::vector<uint32_t> &default_params,
+    StatsFuture *future) {
+  MACE_CHECK(default_params.size() == 4)
+      << "Tuning parameters of 2D kernel variants must be 4d";
+  auto params_generator = [&]() -> std::vector<std::vector<uint32_t>> {
+    std::vector<std::vector<uint32_t>> results;
+    for (uint32_t v = 0; v < variants.size(); ++v) {
+      const Kernel2DVariant &variant = variants[v];
+      if (variant.lws.empty()) {
+        for (auto &ele : LWSCandidates2D(runtime, *variant.kernel)) {
+          ele.push_back(v);
+          results.push_back(ele);
         }
-        (*tuning_result)[2] = block_size;
-        num_blocks = RoundUpDiv<uint32_t>(internal_gws[1], block_size);
-        for (uint32_t i = 0; i < num_blocks; ++i) {
-          uint32_t gws1 = block_size;
-          if (runtime->IsNonUniformWorkgroupsSupported() &&
-              (i == num_blocks - 1)) {
-            gws1 = (internal_gws[1] - (i * block_size));
-          }
-          error = runtime->command_queue().enqueueNDRangeKernel(
-              kernel, cl::NDRange(0, i * block_size),
-              cl::NDRange(internal_gws[0], gws1),
-              cl::NDRange(params[0], params[1]), nullptr, &event);
-          MACE_CL_RET_ERROR(error);
-          timer->AccumulateTiming();
+      } else {
+        const uint32_t kwg_size = static_cast<uint32_t>(
+            runtime->GetKernelMaxWorkGroupSize(*variant.kernel));
+        if (variant.lws[0] * variant.lws[1] <= kwg_size) {
+          results.push_back({variant.lws[0], variant.lws[1], 0, v});
         }
       }
     }
+    return results;
+  };
+  cl::Event event;
+  auto func = [&](const std::vector<uint32_t> &params, Timer *timer,
+                  std::vector<uint32_t> *tuning_result) -> cl_int {
+    // parameters tuned before variants were supported, or for a variant
+    // unavailable on this device, select the first one
+    uint32_t v = params.size() > 3 ? params[3] : 0;
+    if (v >= variants.size()) {
+      v = 0;
+    }
+    const Kernel2DVariant &variant = variants[v];
+    cl_int error = CL_SUCCESS;
+    if (variant.lws.empty()) {
+      error = Run2DKernel(runtime, *variant.kernel, variant.gws.data(),
+                          params, false, timer, tuning_result,
+                          RunEvent(timer, future, &event));
+    } else {
+      std::vector<uint32_t> fixed_params = {variant.lws[0], variant.lws[1],
+                                            params[2]};
+      error = Run2DKernel(runtime, *variant.kernel, variant.gws.data(),
+                          fixed_params, true, timer, tuning_result,
+                          RunEvent(timer, future, &event));
+    }
+    if (timer != nullptr && tuning_result != nullptr) {
+      tuning_result->push_back(v);
+    }
     return error;
   };
+  auto fit_params = [&](std::vector<uint32_t> *params) -> bool {
+    if (params->size() <= 3 || (*params)[3] >= variants.size()) {
+      return false;
+    }
+    const Kernel2DVariant &variant = variants[(*params)[3]];
+    if (!variant.lws.empty()) {
+      // the variant runs its own local size
+      return true;
+    }
+    return FitLocalWS(runtime, *variant.kernel, variant.gws.data(), 2,
+                      params);
+  };
   OpenCLProfilingTimer timer(runtime, &event);
   cl_int err = runtime->tuner()->template TuneOrRun<cl_int>(
-      tuning_key, lws, params_generator, func, &timer);
+      tuning_key, default_params, params_generator, func, &timer,
+      fit_params);
   MACE_CL_RET_STATUS(err);
 
   if (future != nullptr) {
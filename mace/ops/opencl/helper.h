@@ -15,6 +15,7 @@
 #ifndef MACE_OPS_OPENCL_HELPER_H_
 #define MACE_OPS_OPENCL_HELPER_H_
 
+#include <functional>
 #include <memory>
 #include <string>
 #include <utility>
@@ -87,9 +88,6 @@ namespace ops {
   (kernel).setArg(idx++, (gws)[0]);       \
   (kernel).setArg(idx++, (gws)[1]);
 
-// Max execution time of OpenCL kernel for tuning to prevent UI stuck.
-const float kMaxKernelExecTime = 1000.0;  // microseconds
-
 // Base GPU cache size used for computing local work group size.
 const int32_t kBaseGPUMemCacheSize = 16384;
 
@@ -123,6 +121,22 @@ MaceStatus TuningOrRun3DKernel(OpenCLRuntime *runtime,
                                const std::vector<uint32_t> &lws,
                                StatsFuture *future);
 
+// Builds (or reuses) the kernel variant compiled for `tile`, sets its
+// arguments and returns the global work size it must be launched with.
+typedef std::function<MaceStatus(uint32_t tile,
+                                 cl::Kernel **kernel,
+                                 std::vector<uint32_t> *gws)>
+    TiledKernelPreparer;
+
+// Tuning or Run OpenCL kernel with 3D work group size and a tunable
+// register tile, the parameters are {lws0, lws1, lws2, block, tile}
+MaceStatus TuningOrRunTiled3DKernel(OpenCLRuntime *runtime,
+                                    const std::string tuning_key,
+                                    const std::vector<uint32_t> &tiles,
+                                    const std::vector<uint32_t> &default_params,
+                                    const TiledKernelPreparer &prepare,
+                                    StatsFuture *future);
+
 // Tuning or Run OpenCL kernel with 2D work group size
 MaceStatus TuningOrRun2DKernel(OpenCLRuntime *runtime,
                                const cl::Kernel &kernel,
@@ -131,11 +145,22 @@ MaceStatus TuningOrRun2DKernel(OpenCLRuntime *runtime,
                                const std::vector<uint32_t> &lws,
                                StatsFuture *future);
 
-// Check whether limit OpenCL kernel time flag open.
-inline bool LimitKernelTime() {
-  const char *flag = getenv("MACE_LIMIT_OPENCL_KERNEL_TIME");
-  return flag != nullptr && strlen(flag) == 1 && flag[0] == '1';
-}
+// One of several kernels computing the same result, a non-empty `lws`
+// pins the local work size the kernel is written for
+struct Kernel2DVariant {
+  cl::Kernel *kernel;
+  std::vector<uint32_t> gws;
+  std::vector<uint32_t> lws;
+};
+
+// Tuning or Run the fastest of several 2D kernel variants, the parameters
+// are {lws0, lws1, block, variant}
+MaceStatus TuningOrRunVariant2DKernel(
+    OpenCLRuntime *runtime,
+    const std::string tuning_key,
+    const std::vector<Kernel2DVariant> &variants,
+    const std::vector<uint32_t> &default_params,
+    StatsFuture *future);
 
 template <typename T>
 bool IsVecEqual(const std::vector<T> &input0, const std::vector<T> &input1) {
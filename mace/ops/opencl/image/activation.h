@@ -106,6 +106,10 @@ MaceStatus ActivationKernel<T>::Compute(
         tuning_key_prefix_ = "leakyrelu_opencl_kernel";
         built_options.emplace("-DUSE_LEAKYRELU");
         break;
+      case GELU:
+        tuning_key_prefix_ = "gelu_opencl_kernel";
+        built_options.emplace("-DUSE_GELU");
+        break;
       default:
         LOG(FATAL) << "Unknown activation type: " << activation_;
     }
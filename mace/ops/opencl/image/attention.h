@@ -0,0 +1,163 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_OPS_OPENCL_IMAGE_ATTENTION_H_
+#define MACE_OPS_OPENCL_IMAGE_ATTENTION_H_
+
+#include "mace/ops/opencl/attention.h"
+
+#include <algorithm>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "mace/core/op_context.h"
+#include "mace/core/tensor.h"
+#include "mace/ops/opencl/helper.h"
+
+namespace mace {
+namespace ops {
+namespace opencl {
+namespace image {
+
+// A work item attends a query row over all the keys with an online softmax,
+// the query and the sums of the values of the row held in registers, so the
+// scores are never written. The rank 4 tensors are images of
+// [batch, heads, seq, depth], or [batch, seq, heads, depth] if seq_first,
+// and the mask an image of its [batch, heads, queries, keys], each dim 1 or
+// that of the scores.
+template <typename T>
+class AttentionKernel : public OpenCLAttentionKernel {
+ public:
+  MaceStatus Compute(
+      OpContext *context,
+      const Tensor *query,
+      const Tensor *key,
+      const Tensor *value,
+      const Tensor *mask,
+      const float scale,
+      const bool seq_first,
+      const std::vector<index_t> &output_shape,
+      Tensor *output) override;
+
+ private:
+  cl::Kernel kernel_;
+  uint32_t kwg_size_;
+  // the depths and the options the kernel is built for
+  std::vector<index_t> built_dims_;
+};
+
+template <typename T>
+MaceStatus AttentionKernel<T>::Compute(
+    OpContext *context,
+    const Tensor *query,
+    const Tensor *key,
+    const Tensor *value,
+    const Tensor *mask,
+    const float scale,
+    const bool seq_first,
+    const std::vector<index_t> &output_shape,
+    Tensor *output) {
+  const index_t batch = query->dim(0);
+  const index_t heads = query->dim(seq_first ? 2 : 1);
+  const index_t queries = query->dim(seq_first ? 1 : 2);
+  const index_t keys = key->dim(seq_first ? 1 : 2);
+  const index_t depth = query->dim(3);
+  const index_t value_depth = value->dim(3);
+  if (mask != nullptr) {
+    MACE_CHECK(mask->dim_size() == 4 && mask->dim(3) == keys,
+               "GPU Attention takes a rank 4 mask of all the keys, got ",
+               MakeString(mask->shape()));
+  }
+
+  std::vector<size_t> output_image_shape;
+  OpenCLUtil::CalImage2DShape(output_shape, OpenCLBufferType::IN_OUT_CHANNEL,
+                              &output_image_shape);
+  MACE_RETURN_IF_ERROR(output->ResizeImage(output_shape, output_image_shape));
+
+  const uint32_t gws[2] = {
+      static_cast<uint32_t>(queries),
+      static_cast<uint32_t>(batch * heads),
+  };
+
+  auto runtime = context->device()->gpu_runtime()->opencl_runtime();
+  MACE_OUT_OF_RANGE_DEFINITION;
+
+  const std::vector<index_t> built_dims = {
+      depth, value_depth, seq_first ? 1 : 0, mask == nullptr ? 0 : 1};
+  if (kernel_.get() == nullptr || built_dims != built_dims_) {
+    std::set<std::string> built_options;
+    MACE_OUT_OF_RANGE_CONFIG;
+    MACE_NON_UNIFORM_WG_CONFIG;
+    auto dt = DataTypeToEnum<T>::value;
+    std::string kernel_name = MACE_OBFUSCATE_SYMBOL("attention");
+    built_options.emplace("-Dattention=" + kernel_name);
+    built_options.emplace("-DDATA_TYPE=" + DtToUpCompatibleCLDt(dt));
+    built_options.emplace("-DCMD_DATA_TYPE=" + DtToUpCompatibleCLCMDDt(dt));
+    // the query and the sums of the values of a row are private arrays
+    built_options.emplace(MakeString("-DDEPTH_BLOCKS=", RoundUpDiv4(depth)));
+    built_options.emplace(
+        MakeString("-DVALUE_BLOCKS=", RoundUpDiv4(value_depth)));
+    if (seq_first) {
+      built_options.emplace("-DSEQ_FIRST");
+    }
+    if (mask != nullptr) {
+      built_options.emplace("-DUSE_MASK");
+    }
+    MACE_RETURN_IF_ERROR(runtime->BuildKernel("attention", kernel_name,
+                                              built_options, &kernel_));
+
+    kwg_size_ =
+        static_cast<uint32_t>(runtime->GetKernelMaxWorkGroupSize(kernel_));
+    built_dims_ = built_dims;
+  }
+  MACE_OUT_OF_RANGE_INIT(kernel_);
+  uint32_t idx = 0;
+  MACE_OUT_OF_RANGE_SET_ARGS(kernel_);
+  MACE_SET_2D_GWS_ARGS(kernel_, gws);
+  kernel_.setArg(idx++, *(query->opencl_image()));
+  kernel_.setArg(idx++, *(key->opencl_image()));
+  kernel_.setArg(idx++, *(value->opencl_image()));
+  if (mask != nullptr) {
+    kernel_.setArg(idx++, *(mask->opencl_image()));
+    kernel_.setArg(idx++, static_cast<int>(mask->dim(0)));
+    kernel_.setArg(idx++, static_cast<int>(mask->dim(1)));
+    kernel_.setArg(idx++, static_cast<int>(mask->dim(2)));
+  }
+  kernel_.setArg(idx++, static_cast<int>(heads));
+  kernel_.setArg(idx++, static_cast<int>(queries));
+  kernel_.setArg(idx++, static_cast<int>(keys));
+  kernel_.setArg(idx++, static_cast<int>(depth));
+  kernel_.setArg(idx++, scale);
+  kernel_.setArg(idx++, *(output->opencl_image()));
+
+  const uint32_t lws1 = std::min<uint32_t>(gws[1], 4);
+  const std::vector<uint32_t> lws = {
+      std::max<uint32_t>(std::min<uint32_t>(gws[0], kwg_size_ / lws1), 1),
+      lws1, 0};
+  std::string tuning_key = Concat("attention_opencl_kernel", batch, heads,
+                                  queries, keys, depth, value_depth);
+  MACE_RETURN_IF_ERROR(TuningOrRun2DKernel(runtime, kernel_, tuning_key,
+                                           gws, lws, context->future()));
+
+  MACE_OUT_OF_RANGE_VALIDATION;
+  return MaceStatus::MACE_SUCCESS;
+}
+
+}  // namespace image
+}  // namespace opencl
+}  // namespace ops
+}  // namespace mace
+
+#endif  // MACE_OPS_OPENCL_IMAGE_ATTENTION_H_
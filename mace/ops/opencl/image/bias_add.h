@@ -110,6 +110,7 @@ MaceStatus BiasAddKernel<T>::Compute(
         cl::NDRange(lws[0], lws[1], lws[2]), nullptr, &event);
   }
   MACE_CL_RET_STATUS(error);
+  runtime->RecordKernel(kernel_, gws, lws.data(), 3, event);
   MACE_OUT_OF_RANGE_VALIDATION;
   if (context->future() != nullptr) {
     context->future()->wait_fn = [runtime, event](CallStats *stats) {
@@ -182,6 +182,7 @@ MaceStatus ConcatN(OpContext *context,
           cl::NDRange(lws[0], lws[1], lws[2]), nullptr, &event);
     }
     MACE_CL_RET_STATUS(error);
+    runtime->RecordKernel(*kernel, gws, lws.data(), 3, event);
     MACE_OUT_OF_RANGE_VALIDATION;
     if (context->future() != nullptr && runtime->is_profiling_enabled()) {
       event.wait();
@@ -16,6 +16,7 @@
 
 #include "mace/ops/opencl/conv_2d.h"
 
+#include <map>
 #include <memory>
 #include <vector>
 
@@ -29,10 +30,12 @@ namespace opencl {
 namespace image {
 
 extern MaceStatus Conv2dK1x1(OpContext *context,
-                             cl::Kernel *kernel,
+                             std::map<uint32_t, cl::Kernel> *kernels,
                              const Tensor *input,
                              const Tensor *filter,
                              const Tensor *bias,
+                             const Tensor *residual,
+                             const int depth_to_space,
                              const int stride,
                              const int *padding,
                              const int *dilations,
@@ -49,6 +52,8 @@ extern MaceStatus Conv2dK3x3(OpContext *context,
                              const Tensor *input,
                              const Tensor *filter,
                              const Tensor *bias,
+                             const Tensor *residual,
+                             const int depth_to_space,
                              const int stride,
                              const int *padding,
                              const int *dilations,
@@ -65,6 +70,8 @@ extern MaceStatus Conv2d(OpContext *context,
                          const Tensor *input,
                          const Tensor *filter,
                          const Tensor *bias,
+                         const Tensor *residual,
+                         const int depth_to_space,
                          const int stride,
                          const int *padding,
                          const int *dilations,
@@ -77,7 +84,7 @@ extern MaceStatus Conv2d(OpContext *context,
                          uint32_t *kwg_size);
 
 extern MaceStatus WinogradConv2dK3x3S1(OpContext *context,
-                                       cl::Kernel *kernels[3],
+                                       cl::Kernel *kernels[4],
                                        const Tensor *input,
                                        const Tensor *filter,
                                        const Tensor *bias,
@@ -89,7 +96,7 @@ extern MaceStatus WinogradConv2dK3x3S1(OpContext *context,
                                        const int wino_blk_size,
                                        std::vector<index_t> *prev_input_shape,
                                        Tensor *output,
-                                       uint32_t *kwg_size[3]);
+                                       uint32_t *kwg_size[4]);
 
 template <typename T>
 class Conv2dKernel : public OpenCLConv2dKernel {
@@ -107,6 +114,8 @@ class Conv2dKernel : public OpenCLConv2dKernel {
       const Tensor *input,
       const Tensor *filter,
       const Tensor *bias,
+      const Tensor *residual,
+      const int depth_to_space,
       const int *strides,
       const Padding &padding_type,
       const std::vector<int> &padding_data,
@@ -118,8 +127,10 @@ class Conv2dKernel : public OpenCLConv2dKernel {
       Tensor *output) override;
 
  private:
-  cl::Kernel kernels_[3];
-  uint32_t kwg_size_[3];
+  cl::Kernel kernels_[4];
+  // conv 1x1 kernels compiled for each tuned output width tile
+  std::map<uint32_t, cl::Kernel> k1x1_kernels_;
+  uint32_t kwg_size_[4];
   std::vector<index_t> input_shape_;
 };
 
@@ -168,6 +179,8 @@ MaceStatus Conv2dKernel<T>::Compute(
       const Tensor *input,
       const Tensor *filter,
       const Tensor *bias,
+      const Tensor *residual,
+      const int depth_to_space,
       const int *strides,
       const Padding &padding_type,
       const std::vector<int> &padding_data,
@@ -203,6 +216,20 @@ MaceStatus Conv2dKernel<T>::Compute(
                    output_shape.data());
   }
 
+  if (depth_to_space > 1) {
+    // the conv stores its output moved by the depth to space, of whole
+    // channel blocks
+    MACE_CHECK(residual == nullptr,
+               "conv2d reads no residual with depth to space");
+    MACE_CHECK(output_shape[3] % (4 * depth_to_space * depth_to_space) == 0,
+               "conv2d output channels ", output_shape[3],
+               " should be of whole blocks after depth to space of block ",
+               depth_to_space);
+    output_shape = {output_shape[0], output_shape[1] * depth_to_space,
+                    output_shape[2] * depth_to_space,
+                    output_shape[3] / (depth_to_space * depth_to_space)};
+  }
+
   std::vector<size_t> output_image_shape;
   OpenCLUtil::CalImage2DShape(output_shape, OpenCLBufferType::IN_OUT_CHANNEL,
                               &output_image_shape);
@@ -210,11 +237,15 @@ MaceStatus Conv2dKernel<T>::Compute(
 
   std::function<MaceStatus()> conv_func;
 
-  if (wino_blk_size != 0) {
+  // the winograd output transform adds no residual and stores no depth to
+  // space
+  if (wino_blk_size != 0 && residual == nullptr && depth_to_space == 1) {
     // use winograd covolution
     conv_func = [&]() -> MaceStatus {
-      cl::Kernel *kernels[3] = {&kernels_[0], &kernels_[1], &kernels_[2]};
-      uint32_t *kwg_size[3] = {&kwg_size_[0], &kwg_size_[1], &kwg_size_[2]};
+      cl::Kernel *kernels[4] = {&kernels_[0], &kernels_[1], &kernels_[2],
+                                &kernels_[3]};
+      uint32_t *kwg_size[4] = {&kwg_size_[0], &kwg_size_[1], &kwg_size_[2],
+                               &kwg_size_[3]};
       return WinogradConv2dK3x3S1(context,
                                   kernels,
                                   input,
@@ -233,10 +264,12 @@ MaceStatus Conv2dKernel<T>::Compute(
   } else if (kernel_h == 1 && kernel_w == 1)  {
     conv_func = [&]() -> MaceStatus {
       return Conv2dK1x1(context,
-                        &kernels_[0],
+                        &k1x1_kernels_,
                         input,
                         filter,
                         bias,
+                        residual,
+                        depth_to_space,
                         strides[0],
                         paddings.data(),
                         dilations,
@@ -255,6 +288,8 @@ MaceStatus Conv2dKernel<T>::Compute(
                         input,
                         filter,
                         bias,
+                        residual,
+                        depth_to_space,
                         strides[0],
                         paddings.data(),
                         dilations,
@@ -273,6 +308,8 @@ MaceStatus Conv2dKernel<T>::Compute(
                     input,
                     filter,
                     bias,
+                    residual,
+                    depth_to_space,
                     strides[0],
                     paddings.data(),
                     dilations,
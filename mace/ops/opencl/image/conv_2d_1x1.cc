@@ -12,6 +12,12 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <iterator>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
 #include "mace/core/op_context.h"
 #include "mace/core/runtime/opencl/opencl_runtime.h"
 #include "mace/ops/common/activation_type.h"
@@ -64,13 +70,70 @@ std::vector<uint32_t> LocalWS(OpenCLRuntime *runtime,
   return lws;
 }
 
+// candidate numbers of output widths computed by each work item
+const uint32_t kOutWidthTiles[] = {1, 2, 4, 8};
+const uint32_t kDefaultOutWidthTile = 4;
+
+MaceStatus BuildTiledKernel(OpenCLRuntime *runtime,
+                            const uint32_t out_width_tile,
+                            const bool has_bias,
+                            const bool has_residual,
+                            const int depth_to_space,
+                            const ActivationType activation,
+                            const DataType dt,
+                            cl::Kernel *kernel) {
+  std::set<std::string> built_options;
+  MACE_OUT_OF_RANGE_CONFIG;
+  MACE_NON_UNIFORM_WG_CONFIG;
+  std::string kernel_name = MACE_OBFUSCATE_SYMBOL("conv_2d_1x1");
+  built_options.emplace("-Dconv_2d_1x1=" + kernel_name);
+  built_options.emplace("-DDATA_TYPE=" + DtToUpCompatibleCLDt(dt));
+  built_options.emplace("-DCMD_DATA_TYPE=" + DtToUpCompatibleCLCMDDt(dt));
+  built_options.emplace(MakeString("-DOUT_W_TILE=", out_width_tile));
+  if (has_bias) {
+    built_options.emplace("-DBIAS");
+  }
+  if (has_residual) {
+    built_options.emplace("-DRESIDUAL");
+  }
+  if (depth_to_space > 1) {
+    built_options.emplace(MakeString("-DDEPTH_TO_SPACE=", depth_to_space));
+  }
+  switch (activation) {
+    case NOOP:
+      break;
+    case RELU:
+      built_options.emplace("-DUSE_RELU");
+      break;
+    case RELUX:
+      built_options.emplace("-DUSE_RELUX");
+      break;
+    case TANH:
+      built_options.emplace("-DUSE_TANH");
+      break;
+    case SIGMOID:
+      built_options.emplace("-DUSE_SIGMOID");
+      break;
+    case LEAKYRELU:
+      built_options.emplace("-DUSE_LEAKYRELU");
+      break;
+    default:
+      LOG(FATAL) << "Unknown activation type: " << activation;
+  }
+
+  return runtime->BuildKernel("conv_2d_1x1", kernel_name,
+                              built_options, kernel);
+}
+
 }  // namespace
 
 extern MaceStatus Conv2dK1x1(OpContext *context,
-                             cl::Kernel *kernel,
+                             std::map<uint32_t, cl::Kernel> *kernels,
                              const Tensor *input,
                              const Tensor *filter,
                              const Tensor *bias,
+                             const Tensor *residual,
+                             const int depth_to_space,
                              const int stride,
                              const int *padding,
                              const int *dilations,
@@ -83,98 +146,90 @@ extern MaceStatus Conv2dK1x1(OpContext *context,
                              uint32_t *kwg_size) {
   MACE_UNUSED(padding);
   MACE_UNUSED(dilations);
+  // the conv shape, the output being moved by the depth to space
   const index_t batch = output->dim(0);
-  const index_t height = output->dim(1);
-  const index_t width = output->dim(2);
-  const index_t channels = output->dim(3);
+  const index_t height = output->dim(1) / depth_to_space;
+  const index_t width = output->dim(2) / depth_to_space;
+  const index_t channels = output->dim(3) * depth_to_space * depth_to_space;
   const index_t input_batch = input->dim(0);
   const index_t input_height = input->dim(1);
   const index_t input_width = input->dim(2);
   const index_t input_channels = input->dim(3);
+  MACE_CHECK(input_batch == batch);
 
   const index_t channel_blocks = RoundUpDiv4(channels);
-  const index_t width_blocks = RoundUpDiv4(width);
   const index_t input_channel_blocks = RoundUpDiv4(input_channels);
 
   auto runtime = context->device()->gpu_runtime()->opencl_runtime();
   MACE_OUT_OF_RANGE_DEFINITION;
 
-  if (kernel->get() == nullptr) {
-    MACE_CHECK(input_batch == batch);
-    std::set<std::string> built_options;
-    MACE_OUT_OF_RANGE_CONFIG;
-    MACE_NON_UNIFORM_WG_CONFIG;
-    std::string kernel_name = MACE_OBFUSCATE_SYMBOL("conv_2d_1x1");
-    built_options.emplace("-Dconv_2d_1x1=" + kernel_name);
-    built_options.emplace("-DDATA_TYPE=" + DtToUpCompatibleCLDt(dt));
-    built_options.emplace("-DCMD_DATA_TYPE=" + DtToUpCompatibleCLCMDDt(dt));
-    if (bias != nullptr) {
-      built_options.emplace("-DBIAS");
-    }
-    switch (activation) {
-      case NOOP:
-        break;
-      case RELU:
-        built_options.emplace("-DUSE_RELU");
-        break;
-      case RELUX:
-        built_options.emplace("-DUSE_RELUX");
-        break;
-      case TANH:
-        built_options.emplace("-DUSE_TANH");
-        break;
-      case SIGMOID:
-        built_options.emplace("-DUSE_SIGMOID");
-        break;
-      case LEAKYRELU:
-        built_options.emplace("-DUSE_LEAKYRELU");
-        break;
-      default:
-        LOG(FATAL) << "Unknown activation type: " << activation;
-    }
-
-    MACE_RETURN_IF_ERROR(runtime->BuildKernel("conv_2d_1x1", kernel_name,
-                                              built_options, kernel));
-
-    *kwg_size =
-        static_cast<uint32_t>(runtime->GetKernelMaxWorkGroupSize(*kernel));
+  // Support different input size, the arguments of every tile variant
+  // are set when it is (re)created
+  if (!IsVecEqual(*prev_input_shape, input->shape())) {
+    kernels->clear();
+    *prev_input_shape = input->shape();
   }
 
-  const uint32_t gws[3] = {static_cast<uint32_t>(channel_blocks),
-                           static_cast<uint32_t>(width_blocks),
-                           static_cast<uint32_t>(height * batch)};
-  MACE_OUT_OF_RANGE_INIT(*kernel);
-
-  // Support different input size
-  if (!IsVecEqual(*prev_input_shape, input->shape())) {
-    uint32_t idx = 0;
-    MACE_OUT_OF_RANGE_SET_ARGS(*kernel);
-    MACE_SET_3D_GWS_ARGS(*kernel, gws);
-    kernel->setArg(idx++, *(input->opencl_image()));
-    kernel->setArg(idx++, *(filter->opencl_image()));
-    if (bias != nullptr) {
-      kernel->setArg(idx++, *(bias->opencl_image()));
+  auto prepare = [&](uint32_t tile, cl::Kernel **kernel,
+                     std::vector<uint32_t> *gws) -> MaceStatus {
+    const index_t width_blocks =
+        RoundUpDiv<index_t>(width, static_cast<index_t>(tile));
+    *gws = {static_cast<uint32_t>(channel_blocks),
+            static_cast<uint32_t>(width_blocks),
+            static_cast<uint32_t>(height * batch)};
+    const bool created = kernels->count(tile) == 0;
+    *kernel = &(*kernels)[tile];
+    if (created) {
+      MACE_RETURN_IF_ERROR(BuildTiledKernel(runtime, tile, bias != nullptr,
+                                            residual != nullptr,
+                                            depth_to_space, activation, dt,
+                                            *kernel));
     }
-    kernel->setArg(idx++, *(output->opencl_image()));
-    // FIXME handle flexable data type: half not supported
-    kernel->setArg(idx++, relux_max_limit);
-    kernel->setArg(idx++, leakyrelu_coefficient);
-    kernel->setArg(idx++, static_cast<int>(input_height));
-    kernel->setArg(idx++, static_cast<int>(input_width));
-    kernel->setArg(idx++, static_cast<int>(input_channel_blocks));
-    kernel->setArg(idx++, static_cast<int>(height));
-    kernel->setArg(idx++, static_cast<int>(width));
-    kernel->setArg(idx++, stride);
+    MACE_OUT_OF_RANGE_INIT(**kernel);
+    if (created) {
+      uint32_t idx = 0;
+      MACE_OUT_OF_RANGE_SET_ARGS(**kernel);
+      MACE_SET_3D_GWS_ARGS(**kernel, *gws);
+      (*kernel)->setArg(idx++, *(input->opencl_image()));
+      (*kernel)->setArg(idx++, *(filter->opencl_image()));
+      if (bias != nullptr) {
+        (*kernel)->setArg(idx++, *(bias->opencl_image()));
+      }
+      if (residual != nullptr) {
+        (*kernel)->setArg(idx++, *(residual->opencl_image()));
+      }
+      (*kernel)->setArg(idx++, *(output->opencl_image()));
+      // FIXME handle flexable data type: half not supported
+      (*kernel)->setArg(idx++, relux_max_limit);
+      (*kernel)->setArg(idx++, leakyrelu_coefficient);
+      (*kernel)->setArg(idx++, static_cast<int>(input_height));
+      (*kernel)->setArg(idx++, static_cast<int>(input_width));
+      (*kernel)->setArg(idx++, static_cast<int>(input_channel_blocks));
+      (*kernel)->setArg(idx++, static_cast<int>(height));
+      (*kernel)->setArg(idx++, static_cast<int>(width));
+      (*kernel)->setArg(idx++, stride);
+    }
+    return MaceStatus::MACE_SUCCESS;
+  };
 
-    *prev_input_shape = input->shape();
-  }
+  cl::Kernel *default_kernel = nullptr;
+  std::vector<uint32_t> default_gws;
+  MACE_RETURN_IF_ERROR(
+      prepare(kDefaultOutWidthTile, &default_kernel, &default_gws));
+  *kwg_size = static_cast<uint32_t>(
+      runtime->GetKernelMaxWorkGroupSize(*default_kernel));
 
-  std::vector<uint32_t> lws = LocalWS(runtime, gws, *kwg_size);
+  std::vector<uint32_t> params =
+      LocalWS(runtime, default_gws.data(), *kwg_size);
+  params.push_back(kDefaultOutWidthTile);
+  std::vector<uint32_t> tiles(std::begin(kOutWidthTiles),
+                              std::end(kOutWidthTiles));
   std::string tuning_key =
-      Concat("conv2d_1x1_opencl_kernel", output->dim(0), output->dim(1),
-             output->dim(2), output->dim(3));
-  MACE_RETURN_IF_ERROR(TuningOrRun3DKernel(runtime, *kernel, tuning_key,
-                                           gws, lws, context->future()));
+      Concat("conv2d_1x1_opencl_kernel", batch, height, width,
+             channels);
+  MACE_RETURN_IF_ERROR(TuningOrRunTiled3DKernel(runtime, tuning_key, tiles,
+                                                params, prepare,
+                                                context->future()));
   MACE_OUT_OF_RANGE_VALIDATION;
   return MaceStatus::MACE_SUCCESS;
 }
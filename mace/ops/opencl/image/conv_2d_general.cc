@@ -72,6 +72,8 @@ extern MaceStatus Conv2d(OpContext *context,
                          const Tensor *input,
                          const Tensor *filter,
                          const Tensor *bias,
+                         const Tensor *residual,
+                         const int depth_to_space,
                          const int stride,
                          const int *padding,
                          const int *dilations,
@@ -82,10 +84,11 @@ extern MaceStatus Conv2d(OpContext *context,
                          std::vector<index_t> *prev_input_shape,
                          Tensor *output,
                          uint32_t *kwg_size) {
+  // the conv shape, the output being moved by the depth to space
   const index_t batch = output->dim(0);
-  const index_t height = output->dim(1);
-  const index_t width = output->dim(2);
-  const index_t channels = output->dim(3);
+  const index_t height = output->dim(1) / depth_to_space;
+  const index_t width = output->dim(2) / depth_to_space;
+  const index_t channels = output->dim(3) * depth_to_space * depth_to_space;
   const index_t input_channels = input->dim(3);
 
   const index_t channel_blocks = RoundUpDiv4(channels);
@@ -104,6 +107,10 @@ extern MaceStatus Conv2d(OpContext *context,
     built_options.emplace("-DDATA_TYPE=" + DtToUpCompatibleCLDt(dt));
     built_options.emplace("-DCMD_DATA_TYPE=" + DtToUpCompatibleCLCMDDt(dt));
     built_options.emplace(bias != nullptr ? "-DBIAS" : "");
+    built_options.emplace(residual != nullptr ? "-DRESIDUAL" : "");
+    if (depth_to_space > 1) {
+      built_options.emplace(MakeString("-DDEPTH_TO_SPACE=", depth_to_space));
+    }
     switch (activation) {
       case NOOP:
         break;
@@ -148,6 +155,9 @@ extern MaceStatus Conv2d(OpContext *context,
     if (bias != nullptr) {
       kernel->setArg(idx++, *(bias->opencl_image()));
     }
+    if (residual != nullptr) {
+      kernel->setArg(idx++, *(residual->opencl_image()));
+    }
     kernel->setArg(idx++, *(output->opencl_image()));
     kernel->setArg(idx++, relux_max_limit);
     kernel->setArg(idx++, leakyrelu_coefficient);
@@ -168,8 +178,8 @@ extern MaceStatus Conv2d(OpContext *context,
   }
 
   std::string tuning_key =
-      Concat("conv2d_general_opencl_kernel", output->dim(0), output->dim(1),
-             output->dim(2), output->dim(3), filter->dim(2), filter->dim(3));
+      Concat("conv2d_general_opencl_kernel", batch, height, width,
+             channels, filter->dim(2), filter->dim(3));
   std::vector<uint32_t> lws =
       LocalWS(runtime, gws, filter->dim(2) * filter->dim(3), *kwg_size);
   MACE_RETURN_IF_ERROR(TuningOrRun3DKernel(runtime, *kernel, tuning_key,
@@ -93,6 +93,13 @@ MaceStatus Deconv2dKernel<T>::Compute(
   const int align_h = stride_h - 1 - padding_h;
   const int align_w = stride_w - 1 - padding_w;
   const int kernel_size = filter->dim(2) * filter->dim(3);
+  // the strided deconvolution runs by the phases of the strides in tiles of
+  // 2 rows and 4 columns of each phase
+  const bool subpixel = stride_h > 1 || stride_w > 1;
+  const index_t phase_height_blocks =
+      RoundUpDiv<index_t>(RoundUpDiv<index_t>(height, stride_h), 2);
+  const index_t phase_width_blocks =
+      RoundUpDiv4(RoundUpDiv<index_t>(width, stride_w));
 
   auto runtime = context->device()->gpu_runtime()->opencl_runtime();
   MACE_OUT_OF_RANGE_DEFINITION;
@@ -101,8 +108,14 @@ MaceStatus Deconv2dKernel<T>::Compute(
     std::set<std::string> built_options;
     MACE_OUT_OF_RANGE_CONFIG;
     MACE_NON_UNIFORM_WG_CONFIG;
-    std::string kernel_name = MACE_OBFUSCATE_SYMBOL("deconv_2d");
-    built_options.emplace("-Ddeconv_2d=" + kernel_name);
+    std::string kernel_name;
+    if (subpixel) {
+      kernel_name = MACE_OBFUSCATE_SYMBOL("deconv_2d_subpixel");
+      built_options.emplace("-Ddeconv_2d_subpixel=" + kernel_name);
+    } else {
+      kernel_name = MACE_OBFUSCATE_SYMBOL("deconv_2d");
+      built_options.emplace("-Ddeconv_2d=" + kernel_name);
+    }
     built_options.emplace("-DDATA_TYPE=" + DtToUpCompatibleCLDt(dt));
     built_options.emplace("-DCMD_DATA_TYPE=" + DtToUpCompatibleCLCMDDt(dt));
     built_options.emplace(bias != nullptr ? "-DBIAS" : "");
@@ -135,9 +148,13 @@ MaceStatus Deconv2dKernel<T>::Compute(
         static_cast<uint32_t>(runtime->GetKernelMaxWorkGroupSize(kernel_));
   }
 
-  const uint32_t gws[3] = {static_cast<uint32_t>(channel_blocks),
-                           static_cast<uint32_t>(width_blocks),
-                           static_cast<uint32_t>(height * batch)};
+  uint32_t gws[3] = {static_cast<uint32_t>(channel_blocks),
+                     static_cast<uint32_t>(width_blocks),
+                     static_cast<uint32_t>(height * batch)};
+  if (subpixel) {
+    gws[1] = static_cast<uint32_t>(stride_w * phase_width_blocks);
+    gws[2] = static_cast<uint32_t>(batch * stride_h * phase_height_blocks);
+  }
 
   MACE_OUT_OF_RANGE_INIT(kernel_);
   if (!IsVecEqual(input_shape_, input->shape())) {
@@ -152,33 +169,52 @@ MaceStatus Deconv2dKernel<T>::Compute(
     kernel_.setArg(idx++, *(output->opencl_image()));
     kernel_.setArg(idx++, relux_max_limit);
     kernel_.setArg(idx++, leakyrelu_coefficient);
-    kernel_.setArg(idx++, static_cast<int32_t>(input->dim(1)));
-    kernel_.setArg(idx++, static_cast<int32_t>(input->dim(2)));
-    kernel_.setArg(idx++, static_cast<int32_t>(input->dim(3)));
-    kernel_.setArg(idx++, static_cast<int32_t>(height));
-    kernel_.setArg(idx++, static_cast<int32_t>(width));
-    kernel_.setArg(idx++, static_cast<int32_t>(channels));
-    kernel_.setArg(idx++, static_cast<int32_t>(stride_h));
-    kernel_.setArg(idx++, static_cast<int32_t>(stride_w));
-    kernel_.setArg(idx++, stride_h_r);
-    kernel_.setArg(idx++, stride_w_r);
-    kernel_.setArg(idx++, static_cast<int32_t>(align_h));
-    kernel_.setArg(idx++, static_cast<int32_t>(align_w));
-    kernel_.setArg(idx++, static_cast<int32_t>(padding_h));
-    kernel_.setArg(idx++, static_cast<int32_t>(padding_w));
-    kernel_.setArg(idx++, static_cast<int32_t>(filter->dim(2)));
-    kernel_.setArg(idx++, static_cast<int32_t>(filter->dim(3)));
-    kernel_.setArg(idx++, static_cast<int32_t>(kernel_size));
-    kernel_.setArg(idx++, static_cast<int32_t>(input_channel_blocks));
-    kernel_.setArg(idx++, static_cast<int32_t>(channel_blocks));
+    if (subpixel) {
+      kernel_.setArg(idx++, static_cast<int32_t>(input->dim(1)));
+      kernel_.setArg(idx++, static_cast<int32_t>(input->dim(2)));
+      kernel_.setArg(idx++, static_cast<int32_t>(height));
+      kernel_.setArg(idx++, static_cast<int32_t>(width));
+      kernel_.setArg(idx++, static_cast<int32_t>(stride_h));
+      kernel_.setArg(idx++, static_cast<int32_t>(stride_w));
+      kernel_.setArg(idx++, static_cast<int32_t>(padding_h));
+      kernel_.setArg(idx++, static_cast<int32_t>(padding_w));
+      kernel_.setArg(idx++, static_cast<int32_t>(filter->dim(2)));
+      kernel_.setArg(idx++, static_cast<int32_t>(filter->dim(3)));
+      kernel_.setArg(idx++, static_cast<int32_t>(kernel_size));
+      kernel_.setArg(idx++, static_cast<int32_t>(input_channel_blocks));
+      kernel_.setArg(idx++, static_cast<int32_t>(phase_height_blocks));
+      kernel_.setArg(idx++, static_cast<int32_t>(phase_width_blocks));
+    } else {
+      kernel_.setArg(idx++, static_cast<int32_t>(input->dim(1)));
+      kernel_.setArg(idx++, static_cast<int32_t>(input->dim(2)));
+      kernel_.setArg(idx++, static_cast<int32_t>(input->dim(3)));
+      kernel_.setArg(idx++, static_cast<int32_t>(height));
+      kernel_.setArg(idx++, static_cast<int32_t>(width));
+      kernel_.setArg(idx++, static_cast<int32_t>(channels));
+      kernel_.setArg(idx++, static_cast<int32_t>(stride_h));
+      kernel_.setArg(idx++, static_cast<int32_t>(stride_w));
+      kernel_.setArg(idx++, stride_h_r);
+      kernel_.setArg(idx++, stride_w_r);
+      kernel_.setArg(idx++, static_cast<int32_t>(align_h));
+      kernel_.setArg(idx++, static_cast<int32_t>(align_w));
+      kernel_.setArg(idx++, static_cast<int32_t>(padding_h));
+      kernel_.setArg(idx++, static_cast<int32_t>(padding_w));
+      kernel_.setArg(idx++, static_cast<int32_t>(filter->dim(2)));
+      kernel_.setArg(idx++, static_cast<int32_t>(filter->dim(3)));
+      kernel_.setArg(idx++, static_cast<int32_t>(kernel_size));
+      kernel_.setArg(idx++, static_cast<int32_t>(input_channel_blocks));
+      kernel_.setArg(idx++, static_cast<int32_t>(channel_blocks));
+    }
 
     input_shape_ = input->shape();
   }
 
   const std::vector<uint32_t> lws = Default3DLocalWS(runtime, gws, kwg_size_);
   std::string tuning_key =
-      Concat("deconv2d_opencl_kernel_", activation, output->dim(0),
-             output->dim(1), output->dim(2), output->dim(3));
+      Concat(subpixel ? "deconv2d_subpixel_opencl_kernel_"
+                      : "deconv2d_opencl_kernel_",
+             activation, output->dim(0), output->dim(1), output->dim(2),
+             output->dim(3));
   MACE_RETURN_IF_ERROR(TuningOrRun3DKernel(runtime, kernel_, tuning_key,
                                            gws, lws, context->future()));
 
@@ -58,6 +58,7 @@ class EltwiseKernel : public OpenCLEltwiseKernel {
   cl::Kernel kernel_;
   uint32_t kwg_size_;
   std::vector<index_t> input_shape_;
+  std::vector<index_t> input1_shape_;
 };
 
 template <typename T>
@@ -68,6 +69,7 @@ MaceStatus EltwiseKernel<T>::Compute(
     Tensor *output) {
   bool swapped = false;
   std::string input1_type = "";
+  std::vector<index_t> broadcast_shape;
   if (input1 == nullptr) {
     input1_type = "INPUT_SCALAR";
   } else {
@@ -77,42 +79,45 @@ MaceStatus EltwiseKernel<T>::Compute(
     MACE_CHECK(type_ != EltwiseType::EQUAL)
       << "Eltwise op on GPU does not support EQUAL";
     // broadcast
-    if (input0->size() != input1->size()) {
+    if (input0->size() != input1->size() ||
+        (input0->dim_size() == 4 && input1->dim_size() == 4 &&
+         input0->shape() != input1->shape())) {
       if (input0->size() < input1->size()) {
         std::swap(input0, input1);
         swapped = true;
       }
-      if (input1->dim_size() == 1
-          || (input1->dim(0) == 1 && input1->dim(1) == 1
-              && input1->dim(2) == 1)) {
+      if ((input1->dim_size() == 1
+           || (input1->dim(0) == 1 && input1->dim(1) == 1
+               && input1->dim(2) == 1))
+          && input0->dim(3) == input1->dim(input1->dim_size()-1)) {
         // Tensor-Vector element wise
-        if (input0->dim(3) == input1->dim(input1->dim_size()-1)) {
-          input1_type = "INPUT_VECTOR";
-        } else {
-          LOG(FATAL) << "Inputs not match the broadcast logic, "
-                     << MakeString(input0->shape()) << " vs "
-                     << MakeString(input1->shape());
-        }
-      } else {  // must be 4-D
-        if (input0->dim(0) == input1->dim(0)
-            && input1->dim(1) == 1
-            && input1->dim(2) == 1
-            && input0->dim(3) == input1->dim(3)) {
-          input1_type = "INPUT_BATCH_VECTOR";
-        } else if (input0->dim(0) == input1->dim(0)
-            && input0->dim(1) == input1->dim(1)
-            && input0->dim(2) == input1->dim(2)
-            && input1->dim(3) == 1) {
-          // broadcast on channel dimension
-          input1_type = "INPUT_TENSOR_BC_CHAN";
-        } else {
-          LOG(FATAL) << "Element-Wise op only support broadcast on"
-                        " channel dimension:"
-                        "Tensor-BatchVector(4D-[N,1,1,C]) "
-                        "and Tensor-Tensor(4D-[N,H,W,1]). but got "
-                     << MakeString(input0->shape()) << " vs "
-                     << MakeString(input1->shape());
+        input1_type = "INPUT_VECTOR";
+      } else if (input1->dim_size() == 4
+          && input0->dim(0) == input1->dim(0)
+          && input1->dim(1) == 1
+          && input1->dim(2) == 1
+          && input0->dim(3) == input1->dim(3)) {
+        input1_type = "INPUT_BATCH_VECTOR";
+      } else if (input1->dim_size() == 4
+          && input0->dim(0) == input1->dim(0)
+          && input0->dim(1) == input1->dim(1)
+          && input0->dim(2) == input1->dim(2)
+          && input1->dim(3) == 1) {
+        // broadcast on channel dimension
+        input1_type = "INPUT_TENSOR_BC_CHAN";
+      } else {
+        // broadcast on any dims of 1 of either input
+        MACE_CHECK(input0->dim_size() == 4 && input1->dim_size() == 4 &&
+                   EltwiseBroadcastShape(input0->shape(), input1->shape(),
+                                         &broadcast_shape))
+          << "Inputs not match the broadcast logic, "
+          << MakeString(input0->shape()) << " vs "
+          << MakeString(input1->shape());
+        if (swapped) {
+          std::swap(input0, input1);
+          swapped = false;
         }
+        input1_type = "INPUT_BROADCAST";
       }
     }
   }
@@ -122,10 +127,14 @@ MaceStatus EltwiseKernel<T>::Compute(
   }
 
   std::vector<index_t> output_shape(4);
-  output_shape[0] = input0->dim(0);
-  output_shape[1] = input0->dim(1);
-  output_shape[2] = input0->dim(2);
-  output_shape[3] = input0->dim(3);
+  if (broadcast_shape.empty()) {
+    output_shape[0] = input0->dim(0);
+    output_shape[1] = input0->dim(1);
+    output_shape[2] = input0->dim(2);
+    output_shape[3] = input0->dim(3);
+  } else {
+    output_shape = broadcast_shape;
+  }
 
   std::vector<size_t> output_image_shape;
   OpenCLUtil::CalImage2DShape(output_shape, OpenCLBufferType::IN_OUT_CHANNEL,
@@ -169,7 +178,8 @@ MaceStatus EltwiseKernel<T>::Compute(
         static_cast<uint32_t>(runtime->GetKernelMaxWorkGroupSize(kernel_));
   }
   MACE_OUT_OF_RANGE_INIT(kernel_);
-  if (!IsVecEqual(input_shape_, input0->shape())) {
+  if (!IsVecEqual(input_shape_, input0->shape()) ||
+      (input1 != nullptr && !IsVecEqual(input1_shape_, input1->shape()))) {
     uint32_t idx = 0;
     MACE_OUT_OF_RANGE_SET_ARGS(kernel_);
     MACE_SET_3D_GWS_ARGS(kernel_, gws);
@@ -182,6 +192,13 @@ MaceStatus EltwiseKernel<T>::Compute(
     kernel_.setArg(idx++, static_cast<int32_t>(height));
     kernel_.setArg(idx++, static_cast<int32_t>(width));
     kernel_.setArg(idx++, static_cast<int32_t>(channels));
+    if (!broadcast_shape.empty()) {
+      for (const Tensor *input : {input0, input1}) {
+        for (int i = 0; i < 4; ++i) {
+          kernel_.setArg(idx++, static_cast<int32_t>(input->dim(i)));
+        }
+      }
+    }
     if (!coeff_.empty()) {
       kernel_.setArg(idx++, coeff_[0]);
       kernel_.setArg(idx++, coeff_[1]);
@@ -189,6 +206,9 @@ MaceStatus EltwiseKernel<T>::Compute(
     kernel_.setArg(idx++, *(output->opencl_image()));
 
     input_shape_ = input0->shape();
+    if (input1 != nullptr) {
+      input1_shape_ = input1->shape();
+    }
   }
 
   const std::vector<uint32_t> lws = Default3DLocalWS(runtime, gws, kwg_size_);
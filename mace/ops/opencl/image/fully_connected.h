@@ -16,6 +16,7 @@
 
 #include "mace/ops/opencl/fully_connected.h"
 
+#include <algorithm>
 #include <memory>
 #include <set>
 #include <string>
@@ -45,8 +46,9 @@ class FullyConnectedKernel : public OpenCLFullyConnectedKernel {
 
  private:
   cl::Kernel kernel_;
-  std::vector<uint32_t> gws_;
-  std::vector<uint32_t> lws_;
+  uint32_t kwg_size_;
+  uint32_t wave_size_;
+  std::vector<uint32_t> params_;
   std::vector<index_t> input_shape_;
 };
 
@@ -70,10 +72,6 @@ MaceStatus FullyConnectedKernel<T>::Compute(
   MACE_OUT_OF_RANGE_DEFINITION;
 
   if (kernel_.get() == nullptr) {
-    const index_t batch = output->dim(0);
-    const index_t output_size = output->dim(3);
-    const index_t output_blocks = RoundUpDiv4(output_size);
-
     std::set<std::string> built_options;
     MACE_OUT_OF_RANGE_CONFIG;
     MACE_NON_UNIFORM_WG_CONFIG;
@@ -106,73 +104,109 @@ MaceStatus FullyConnectedKernel<T>::Compute(
       default:
         LOG(FATAL) << "Unknown activation type: " << activation;
     }
-    if (runtime->gpu_type() != GPUType::QUALCOMM_ADRENO) {
-      built_options.emplace("-DNON_QUALCOMM_ADRENO");
-    }
     MACE_RETURN_IF_ERROR(runtime->BuildKernel("fully_connected", kernel_name,
                                               built_options, &kernel_));
 
-    const uint32_t kwg_size =
+    kwg_size_ =
         static_cast<uint32_t>(runtime->GetKernelMaxWorkGroupSize(kernel_));
-
-    if (runtime->gpu_type() == GPUType::QUALCOMM_ADRENO) {
-      built_options.emplace("-DNON_UNIFORM_WORK_GROUP");
-      const uint32_t wave_size =
-          static_cast<uint32_t>(runtime->GetKernelWaveSize(kernel_));
-
-      gws_ = {4, (wave_size / 4), static_cast<uint32_t>(batch * output_blocks)};
-
-      const uint32_t inter_local_blks = kwg_size / (gws_[0] * gws_[1]);
-      lws_ = {gws_[0], gws_[1], inter_local_blks};
-    } else {
-      gws_ = {4, 8, static_cast<uint32_t>(batch * output_blocks)};
-
-      const uint32_t inter_local_blks = kwg_size / (gws_[0] * gws_[1]);
-      lws_ = {gws_[0], gws_[1], inter_local_blks};
-    }
+    wave_size_ = runtime->gpu_type() == GPUType::QUALCOMM_ADRENO ?
+        static_cast<uint32_t>(runtime->GetKernelWaveSize(kernel_)) : 32;
   }
   MACE_OUT_OF_RANGE_INIT(kernel_);
-  if (!IsVecEqual(input_shape_, input->shape())) {
-    const index_t batch = output->dim(0);
-    const index_t output_blocks = RoundUpDiv4(output->dim(3));
-    gws_[2] = static_cast<uint32_t>(batch * output_blocks);
-
-    uint32_t idx = 0;
-    MACE_OUT_OF_RANGE_SET_ARGS(kernel_);
-    MACE_SET_3D_GWS_ARGS(kernel_, gws_);
-    kernel_.setArg(idx++, *(input->opencl_image()));
-    kernel_.setArg(idx++, *(weight->opencl_image()));
-    if (bias != nullptr) {
-      kernel_.setArg(idx++, *(bias->opencl_image()));
+
+  const index_t batch = output->dim(0);
+  const index_t output_blocks = RoundUpDiv4(output->dim(3));
+  const uint32_t batch_blocks = static_cast<uint32_t>(batch * output_blocks);
+  const index_t k_blocks =
+      input->dim(1) * input->dim(2) * RoundUpDiv4(input->dim(3));
+
+  // the parameters are {split, batch blocks of a work group}, a work group
+  // holds the 4 outputs of a block times the split of their reduction
+  const uint32_t default_split =
+      std::max<uint32_t>(std::min(wave_size_, kwg_size_) / 4, 1);
+  const std::vector<uint32_t> default_params = {
+      default_split, std::max<uint32_t>(kwg_size_ / (4 * default_split), 1)};
+  auto params_generator = [&]() -> std::vector<std::vector<uint32_t>> {
+    std::vector<std::vector<uint32_t>> results;
+    for (uint32_t split = 4; 4 * split <= kwg_size_; split *= 2) {
+      if (split / 2 >= k_blocks) {
+        break;
+      }
+      for (uint32_t blks = 1; 4 * split * blks <= kwg_size_; blks *= 2) {
+        results.push_back({split, blks});
+        if (blks >= batch_blocks) {
+          break;
+        }
+      }
     }
-    kernel_.setArg(idx++, *(output->opencl_image()));
-    kernel_.setArg(idx++, (lws_[0] * lws_[1] * lws_[2] * sizeof(float)),
-                   nullptr);
-    kernel_.setArg(idx++, static_cast<int>(input->dim(1)));
-    kernel_.setArg(idx++, static_cast<int>(input->dim(2)));
-    kernel_.setArg(idx++, static_cast<int>(RoundUpDiv4(input->dim(3))));
-    kernel_.setArg(idx++, static_cast<int>(output_blocks));
-    kernel_.setArg(idx++, relux_max_limit);
-    kernel_.setArg(idx++, leakyrelu_coefficient);
-
-    input_shape_ = input->shape();
-  }
+    return results;
+  };
   cl::Event event;
-  cl_int error;
-  if (runtime->IsNonUniformWorkgroupsSupported()) {
-    error = runtime->command_queue().enqueueNDRangeKernel(
-        kernel_, cl::NullRange, cl::NDRange(gws_[0], gws_[1], gws_[2]),
-        cl::NDRange(lws_[0], lws_[1], lws_[2]), nullptr, &event);
-  } else {
-    std::vector<uint32_t> roundup_gws(lws_.size());
-    for (size_t i = 0; i < lws_.size(); ++i) {
-      roundup_gws[i] = RoundUp(gws_[i], lws_[i]);
+  auto func = [&](const std::vector<uint32_t> &params, Timer *timer,
+                  std::vector<uint32_t> *tuning_result) -> cl_int {
+    const std::vector<uint32_t> gws = {4, params[0], batch_blocks};
+    const std::vector<uint32_t> lws = {4, params[0], params[1]};
+    if (!IsVecEqual(input_shape_, input->shape()) ||
+        !IsVecEqual(params_, params)) {
+      uint32_t idx = 0;
+      MACE_OUT_OF_RANGE_SET_ARGS(kernel_);
+      MACE_SET_3D_GWS_ARGS(kernel_, gws);
+      kernel_.setArg(idx++, *(input->opencl_image()));
+      kernel_.setArg(idx++, *(weight->opencl_image()));
+      if (bias != nullptr) {
+        kernel_.setArg(idx++, *(bias->opencl_image()));
+      }
+      kernel_.setArg(idx++, *(output->opencl_image()));
+      kernel_.setArg(idx++, (lws[0] * lws[1] * lws[2] * sizeof(float)),
+                     nullptr);
+      kernel_.setArg(idx++, static_cast<int>(input->dim(1)));
+      kernel_.setArg(idx++, static_cast<int>(input->dim(2)));
+      kernel_.setArg(idx++, static_cast<int>(RoundUpDiv4(input->dim(3))));
+      kernel_.setArg(idx++, static_cast<int>(output_blocks));
+      kernel_.setArg(idx++, relux_max_limit);
+      kernel_.setArg(idx++, leakyrelu_coefficient);
+
+      input_shape_ = input->shape();
+      params_ = params;
+    }
+    std::vector<uint32_t> roundup_gws(gws);
+    if (!runtime->IsNonUniformWorkgroupsSupported()) {
+      roundup_gws[2] = RoundUp(gws[2], lws[2]);
     }
-    error = runtime->command_queue().enqueueNDRangeKernel(
+    if (timer != nullptr) {
+      timer->ClearTiming();
+    }
+    cl_int error = runtime->command_queue().enqueueNDRangeKernel(
         kernel_, cl::NullRange,
         cl::NDRange(roundup_gws[0], roundup_gws[1], roundup_gws[2]),
-        cl::NDRange(lws_[0], lws_[1], lws_[2]), nullptr, &event);
-  }
+        cl::NDRange(lws[0], lws[1], lws[2]), nullptr, &event);
+    MACE_CL_RET_ERROR(error);
+    if (timer != nullptr) {
+      timer->AccumulateTiming();
+      tuning_result->assign(params.begin(), params.end());
+    } else {
+      runtime->RecordKernel(kernel_, roundup_gws.data(), lws.data(), 3,
+                            event);
+    }
+    return error;
+  };
+  // the split of another shape must still fit the work group
+  auto fit_params = [&](std::vector<uint32_t> *params) -> bool {
+    if (params->size() != 2 || (*params)[0] == 0 ||
+        4 * (*params)[0] > kwg_size_) {
+      return false;
+    }
+    (*params)[1] = std::max<uint32_t>(
+        std::min((*params)[1], kwg_size_ / (4 * (*params)[0])), 1);
+    return true;
+  };
+  std::string tuning_key =
+      Concat("fully_connected_opencl_kernel", batch, input->dim(1),
+             input->dim(2), input->dim(3), output->dim(3));
+  OpenCLProfilingTimer timer(runtime, &event);
+  cl_int error = runtime->tuner()->template TuneOrRun<cl_int>(
+      tuning_key, default_params, params_generator, func, &timer,
+      fit_params);
   MACE_OUT_OF_RANGE_VALIDATION;
   MACE_CL_RET_STATUS(error);
 
@@ -0,0 +1,204 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/ops/opencl/image/fused_elementwise.h"
+
+#include <sstream>
+
+#include "mace/ops/common/activation_type.h"
+#include "mace/ops/common/eltwise_type.h"
+
+namespace mace {
+namespace ops {
+namespace opencl {
+namespace image {
+
+namespace {
+
+std::string ActivationSource(const FusedElementwiseStep &step,
+                             const std::string &value) {
+  switch (step.type) {
+    case RELU:
+      return "out = fmax(out, (DATA_TYPE)0);";
+    case RELUX:
+      return "out = clamp(out, (DATA_TYPE4)0, (DATA_TYPE4)" + value + ");";
+    case PRELU:
+      return MakeString("out = select(READ_IMAGET(input", step.operand,
+                        ", SAMPLER, (int2)(ch_blk, 0)) * out, out,"
+                        " out >= (DATA_TYPE)0);");
+    case TANH:
+      return "out = tanh(out);";
+    case SIGMOID:
+      return "out = do_sigmoid(out);";
+    case GELU:
+      return "out = do_gelu(out);";
+    case LEAKYRELU:
+      return "out = select((DATA_TYPE)" + value +
+          " * out, out, out >= (DATA_TYPE)0);";
+    default:
+      LOG(FATAL) << "Unsupported fused activation: " << step.type;
+  }
+  return "";
+}
+
+std::string EltwiseSource(const FusedElementwiseStep &step,
+                          const std::string &value) {
+  const std::string operand = step.operand < 0 ?
+      "(DATA_TYPE4)" + value :
+      MakeString("READ_IMAGET(input", step.operand,
+                 ", SAMPLER, (int2)(pos, hb))");
+  std::string expression;
+  switch (step.type) {
+    case EltwiseType::SUM:
+      expression = "in0 + in1";
+      break;
+    case EltwiseType::SUB:
+      expression = "in0 - in1";
+      break;
+    case EltwiseType::PROD:
+      expression = "in0 * in1";
+      break;
+    case EltwiseType::DIV:
+      expression = "in0 / in1";
+      break;
+    case EltwiseType::MIN:
+      expression = "fmin(in0, in1)";
+      break;
+    case EltwiseType::MAX:
+      expression = "fmax(in0, in1)";
+      break;
+    case EltwiseType::SQR_DIFF:
+      expression = "(in0 - in1) * (in0 - in1)";
+      break;
+    default:
+      LOG(FATAL) << "Unsupported fused eltwise: " << step.type;
+  }
+  std::stringstream source;
+  source << "{\n"
+         << "    DATA_TYPE4 in0 = " << (step.swapped ? operand : "out")
+         << ";\n"
+         << "    DATA_TYPE4 in1 = " << (step.swapped ? "out" : operand)
+         << ";\n"
+         << "    out = " << expression << ";\n"
+         << "  }";
+  return source.str();
+}
+
+}  // namespace
+
+bool FusedStepHasValue(const FusedElementwiseStep &step) {
+  if (step.kind == FUSED_ACTIVATION) {
+    return step.type == RELUX || step.type == LEAKYRELU;
+  }
+  return step.kind == FUSED_ELTWISE && step.operand < 0;
+}
+
+std::string FusedElementwiseProgramName(
+    const std::vector<FusedElementwiseStep> &steps) {
+  // the program names may not have spaces, see the prebuilt program keys
+  std::stringstream name;
+  name << "fused_elementwise";
+  for (auto &step : steps) {
+    switch (step.kind) {
+      case FUSED_BIAS_ADD:
+        name << "_b";
+        break;
+      case FUSED_ACTIVATION:
+        name << "_a" << step.type;
+        break;
+      case FUSED_ELTWISE:
+        name << "_e" << step.type << (step.operand < 0 ? "s" : "t")
+             << (step.swapped ? "r" : "");
+        break;
+    }
+  }
+  return name.str();
+}
+
+std::string FusedElementwiseSource(
+    const std::vector<FusedElementwiseStep> &steps,
+    const size_t input_count) {
+  // the parameters line up after "__kernel void fused_elementwise("
+  const std::string indent(32, ' ');
+  std::stringstream source;
+  source << "\n__kernel void fused_elementwise(OUT_OF_RANGE_PARAMS\n"
+         << indent << "GLOBAL_WORK_GROUP_SIZE_DIM3\n";
+  for (size_t i = 0; i < input_count; ++i) {
+    source << indent << "__read_only image2d_t input" << i << ",\n";
+  }
+  for (size_t i = 0; i < steps.size(); ++i) {
+    if (FusedStepHasValue(steps[i])) {
+      source << indent << "__private const float value" << i << ",\n";
+    }
+  }
+  source << indent << "__private const int channels,\n"
+         << indent << "__write_only image2d_t output) {\n"
+         << "  const int ch_blk = get_global_id(0);\n"
+         << "  const int w = get_global_id(1);\n"
+         << "  const int hb = get_global_id(2);\n"
+         << "\n"
+         << "#ifndef NON_UNIFORM_WORK_GROUP\n"
+         << "  if (ch_blk >= global_size_dim0 || w >= global_size_dim1\n"
+         << "      || hb >= global_size_dim2) {\n"
+         << "    return;\n"
+         << "  }\n"
+         << "#endif\n"
+         << "  const int width = global_size_dim1;\n"
+         << "\n"
+         << "  const int pos = mad24(ch_blk, width, w);\n"
+         << "  DATA_TYPE4 out =\n"
+         << "      READ_IMAGET(input0, SAMPLER, (int2)(pos, hb));\n";
+  for (size_t i = 0; i < steps.size(); ++i) {
+    const FusedElementwiseStep &step = steps[i];
+    const std::string value = MakeString("value", i);
+    source << "  ";
+    switch (step.kind) {
+      case FUSED_BIAS_ADD:
+        source << "out += READ_IMAGET(input" << step.operand
+               << ", SAMPLER, (int2)(ch_blk, 0));";
+        break;
+      case FUSED_ACTIVATION:
+        source << ActivationSource(step, value);
+        break;
+      case FUSED_ELTWISE:
+        source << EltwiseSource(step, value);
+        break;
+    }
+    source << "\n";
+  }
+  // the padded channels of the last block stay zero
+  source << "\n"
+         << "#ifdef NOT_DIVISIBLE_FOUR\n"
+         << "  const int remain_channel = channels - 4 * ch_blk;\n"
+         << "  if (remain_channel < 4) {\n"
+         << "    switch (remain_channel) {\n"
+         << "      case 1:\n"
+         << "        out.y = 0;\n"
+         << "      case 2:\n"
+         << "        out.z = 0;\n"
+         << "      case 3:\n"
+         << "        out.w = 0;\n"
+         << "    }\n"
+         << "  }\n"
+         << "#endif\n"
+         << "\n"
+         << "  WRITE_IMAGET(output, (int2)(pos, hb), out);\n"
+         << "}\n";
+  return source.str();
+}
+
+}  // namespace image
+}  // namespace opencl
+}  // namespace ops
+}  // namespace mace
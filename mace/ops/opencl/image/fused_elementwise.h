@@ -0,0 +1,139 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef MACE_OPS_OPENCL_IMAGE_FUSED_ELEMENTWISE_H_
+#define MACE_OPS_OPENCL_IMAGE_FUSED_ELEMENTWISE_H_
+
+#include "mace/ops/opencl/fused_elementwise.h"
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include "mace/core/op_context.h"
+#include "mace/core/tensor.h"
+#include "mace/ops/opencl/helper.h"
+
+namespace mace {
+namespace ops {
+namespace opencl {
+namespace image {
+
+// The name of the program of a chain, which tells its source.
+extern std::string FusedElementwiseProgramName(
+    const std::vector<FusedElementwiseStep> &steps);
+
+// The source of the kernel of a chain, which reads the chain input and the
+// operands of the steps, input0 to input_count - 1, and the values of the
+// steps which have one.
+extern std::string FusedElementwiseSource(
+    const std::vector<FusedElementwiseStep> &steps,
+    const size_t input_count);
+
+extern bool FusedStepHasValue(const FusedElementwiseStep &step);
+
+template <typename T>
+class FusedElementwiseKernel : public OpenCLFusedElementwiseKernel {
+ public:
+  explicit FusedElementwiseKernel(
+      const std::vector<FusedElementwiseStep> &steps)
+      : steps_(steps), program_name_(FusedElementwiseProgramName(steps)) {}
+
+  MaceStatus Compute(
+      OpContext *context,
+      const std::vector<const Tensor *> &inputs,
+      Tensor *output) override;
+
+ private:
+  std::vector<FusedElementwiseStep> steps_;
+  std::string program_name_;
+  cl::Kernel kernel_;
+  uint32_t kwg_size_;
+  std::vector<index_t> input_shape_;
+};
+
+template <typename T>
+MaceStatus FusedElementwiseKernel<T>::Compute(
+    OpContext *context,
+    const std::vector<const Tensor *> &inputs,
+    Tensor *output) {
+  const Tensor *input = inputs[0];
+  const index_t batch = input->dim(0);
+  const index_t height = input->dim(1);
+  const index_t width = input->dim(2);
+  const index_t channels = input->dim(3);
+
+  const index_t channel_blocks = RoundUpDiv4(channels);
+
+  auto runtime = context->device()->gpu_runtime()->opencl_runtime();
+  MACE_OUT_OF_RANGE_DEFINITION;
+
+  if (kernel_.get() == nullptr) {
+    std::set<std::string> built_options;
+    MACE_OUT_OF_RANGE_CONFIG;
+    MACE_NON_UNIFORM_WG_CONFIG;
+    std::string kernel_name = MACE_OBFUSCATE_SYMBOL("fused_elementwise");
+    built_options.emplace("-Dfused_elementwise=" + kernel_name);
+    auto dt = DataTypeToEnum<T>::value;
+    built_options.emplace("-DDATA_TYPE=" + DtToUpCompatibleCLDt(dt));
+    built_options.emplace("-DCMD_DATA_TYPE=" + DtToUpCompatibleCLCMDDt(dt));
+    if (channels % 4 != 0) built_options.emplace("-DNOT_DIVISIBLE_FOUR");
+    MACE_RETURN_IF_ERROR(runtime->BuildKernelFromSource(
+        program_name_, "fused_elementwise",
+        FusedElementwiseSource(steps_, inputs.size()), kernel_name,
+        built_options, &kernel_));
+
+    kwg_size_ =
+        static_cast<uint32_t>(runtime->GetKernelMaxWorkGroupSize(kernel_));
+  }
+
+  const uint32_t gws[3] = {static_cast<uint32_t>(channel_blocks),
+                           static_cast<uint32_t>(width),
+                           static_cast<uint32_t>(height * batch)};
+
+  MACE_OUT_OF_RANGE_INIT(kernel_);
+  if (!IsVecEqual(input_shape_, input->shape())) {
+    int idx = 0;
+    MACE_OUT_OF_RANGE_SET_ARGS(kernel_);
+    MACE_SET_3D_GWS_ARGS(kernel_, gws);
+    for (auto operand : inputs) {
+      kernel_.setArg(idx++, *(operand->opencl_image()));
+    }
+    for (auto &step : steps_) {
+      if (FusedStepHasValue(step)) {
+        kernel_.setArg(idx++, step.value);
+      }
+    }
+    kernel_.setArg(idx++, static_cast<int32_t>(channels));
+    kernel_.setArg(idx++, *(output->opencl_image()));
+
+    input_shape_ = input->shape();
+  }
+
+  const std::vector<uint32_t> lws = Default3DLocalWS(runtime, gws, kwg_size_);
+  std::string tuning_key =
+      Concat(program_name_, output->dim(0), output->dim(1), output->dim(2),
+             output->dim(3));
+  MACE_RETURN_IF_ERROR(TuningOrRun3DKernel(runtime, kernel_, tuning_key,
+                                           gws, lws, context->future()));
+
+  MACE_OUT_OF_RANGE_VALIDATION;
+  return MaceStatus::MACE_SUCCESS;
+}
+
+}  // namespace image
+}  // namespace opencl
+}  // namespace ops
+}  // namespace mace
+
+#endif  // MACE_OPS_OPENCL_IMAGE_FUSED_ELEMENTWISE_H_
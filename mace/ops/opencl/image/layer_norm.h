@@ -0,0 +1,144 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_OPS_OPENCL_IMAGE_LAYER_NORM_H_
+#define MACE_OPS_OPENCL_IMAGE_LAYER_NORM_H_
+
+#include "mace/ops/opencl/layer_norm.h"
+
+#include <algorithm>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "mace/core/op_context.h"
+#include "mace/core/tensor.h"
+#include "mace/ops/opencl/helper.h"
+
+namespace mace {
+namespace ops {
+namespace opencl {
+namespace image {
+
+// A work item normalizes the channels of a pixel, the mean and the variance
+// gathered by a Welford pass over the channel blocks, so the input is read
+// twice instead of once per decomposed op.
+template <typename T>
+class LayerNormKernel : public OpenCLLayerNormKernel {
+ public:
+  MaceStatus Compute(
+      OpContext *context,
+      const Tensor *input,
+      const Tensor *gamma,
+      const Tensor *beta,
+      const float epsilon,
+      Tensor *output) override;
+
+ private:
+  cl::Kernel kernel_;
+  uint32_t kwg_size_;
+  std::vector<index_t> input_shape_;
+};
+
+template <typename T>
+MaceStatus LayerNormKernel<T>::Compute(
+    OpContext *context,
+    const Tensor *input,
+    const Tensor *gamma,
+    const Tensor *beta,
+    const float epsilon,
+    Tensor *output) {
+  index_t batch = 0;
+  index_t height = 0;
+  index_t width = 0;
+  index_t channels = 0;
+  if (input->dim_size() == 2) {
+    batch = input->dim(0);
+    height = 1;
+    width = 1;
+    channels = input->dim(1);
+  } else if (input->dim_size() == 4) {
+    batch = input->dim(0);
+    height = input->dim(1);
+    width = input->dim(2);
+    channels = input->dim(3);
+  } else {
+    MACE_NOT_IMPLEMENTED;
+  }
+
+  const uint32_t gws[2] = {static_cast<uint32_t>(width),
+                           static_cast<uint32_t>(height * batch)};
+
+  auto runtime = context->device()->gpu_runtime()->opencl_runtime();
+  MACE_OUT_OF_RANGE_DEFINITION;
+
+  if (kernel_.get() == nullptr) {
+    std::set<std::string> built_options;
+    MACE_OUT_OF_RANGE_CONFIG;
+    MACE_NON_UNIFORM_WG_CONFIG;
+    std::string kernel_name = MACE_OBFUSCATE_SYMBOL("layer_norm");
+    built_options.emplace("-Dlayer_norm=" + kernel_name);
+    auto dt = DataTypeToEnum<T>::value;
+    built_options.emplace("-DDATA_TYPE=" + DtToUpCompatibleCLDt(dt));
+    built_options.emplace("-DCMD_DATA_TYPE=" + DtToUpCompatibleCLCMDDt(dt));
+    if (gamma != nullptr) {
+      built_options.emplace("-DUSE_GAMMA");
+    }
+    if (beta != nullptr) {
+      built_options.emplace("-DUSE_BETA");
+    }
+    MACE_RETURN_IF_ERROR(runtime->BuildKernel("layer_norm", kernel_name,
+                                              built_options, &kernel_));
+
+    kwg_size_ =
+        static_cast<uint32_t>(runtime->GetKernelMaxWorkGroupSize(kernel_));
+  }
+  MACE_OUT_OF_RANGE_INIT(kernel_);
+  if (!IsVecEqual(input_shape_, input->shape())) {
+    uint32_t idx = 0;
+    MACE_OUT_OF_RANGE_SET_ARGS(kernel_);
+    MACE_SET_2D_GWS_ARGS(kernel_, gws);
+    kernel_.setArg(idx++, *(input->opencl_image()));
+    if (gamma != nullptr) {
+      kernel_.setArg(idx++, *(gamma->opencl_image()));
+    }
+    if (beta != nullptr) {
+      kernel_.setArg(idx++, *(beta->opencl_image()));
+    }
+    kernel_.setArg(idx++, static_cast<int>(channels));
+    kernel_.setArg(idx++, epsilon);
+    kernel_.setArg(idx++, *(output->opencl_image()));
+
+    input_shape_ = input->shape();
+  }
+
+  const uint32_t lws1 = std::min<uint32_t>(gws[1], 4);
+  const std::vector<uint32_t> lws = {
+      std::max<uint32_t>(std::min<uint32_t>(gws[0], kwg_size_ / lws1), 1),
+      lws1, 0};
+  std::string tuning_key =
+      Concat("layer_norm_opencl_kernel", batch, height, width, channels);
+  MACE_RETURN_IF_ERROR(TuningOrRun2DKernel(runtime, kernel_, tuning_key,
+                                           gws, lws, context->future()));
+
+  MACE_OUT_OF_RANGE_VALIDATION;
+  return MaceStatus::MACE_SUCCESS;
+}
+
+}  // namespace image
+}  // namespace opencl
+}  // namespace ops
+}  // namespace mace
+
+#endif  // MACE_OPS_OPENCL_IMAGE_LAYER_NORM_H_
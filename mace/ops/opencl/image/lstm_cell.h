@@ -16,12 +16,14 @@
 
 #include "mace/ops/opencl/lstm_cell.h"
 
+#include <algorithm>
 #include <memory>
 #include <vector>
 #include <set>
 #include <string>
 
 #include "mace/core/op_context.h"
+#include "mace/core/runtime/opencl/scratch_image.h"
 #include "mace/core/tensor.h"
 #include "mace/ops/opencl/helper.h"
 
@@ -35,7 +37,7 @@ class LSTMCellKernel : public OpenCLLSTMCellKernel {
  public:
   explicit LSTMCellKernel(
        const T forget_bias)
-      : forget_bias_(forget_bias) {}
+      : forget_bias_(forget_bias), global_state_(false) {}
   MaceStatus Compute(
       OpContext *context,
       const Tensor *input,
@@ -47,10 +49,26 @@ class LSTMCellKernel : public OpenCLLSTMCellKernel {
       Tensor *output) override;
 
  private:
+  MaceStatus ComputeSequence(
+      OpContext *context,
+      const Tensor *input,
+      const Tensor *pre_output,
+      const Tensor *weight,
+      const Tensor *bias,
+      const Tensor *pre_cell,
+      Tensor *cell,
+      Tensor *output);
+
   T forget_bias_;
   cl::Kernel kernel_;
   uint32_t kwg_size_;
   std::vector<index_t> input_shape_;
+  // of a sequence input
+  cl::Kernel gates_kernel_;
+  cl::Kernel sequence_kernel_;
+  uint32_t sequence_kwg_size_;
+  bool global_state_;
+  std::unique_ptr<Buffer> state_buffer_;
 };
 
 template <typename T>
@@ -65,6 +83,10 @@ MaceStatus LSTMCellKernel<T>::Compute(
     Tensor *output) {
   MACE_CHECK(pre_output->dim_size() == 2 && pre_output->dim(1) % 4 == 0,
              "LSTM hidden units should be a multiple of 4");
+  if (input->dim_size() == 3) {
+    return ComputeSequence(context, input, pre_output, weight, bias,
+                           pre_cell, cell, output);
+  }
 
   const index_t height = input->dim(0);
   const index_t width = input->dim(1);
@@ -134,6 +156,171 @@ MaceStatus LSTMCellKernel<T>::Compute(
   return MaceStatus::MACE_SUCCESS;
 }
 
+// The input [steps, batch, width] runs in two kernels whatever the steps:
+// the input projections of all the steps at once, then the recurrence in one
+// work group looping over the steps.
+template <typename T>
+MaceStatus LSTMCellKernel<T>::ComputeSequence(
+    OpContext *context,
+    const Tensor *input,
+    const Tensor *pre_output,
+    const Tensor *weight,
+    const Tensor *bias,
+    const Tensor *pre_cell,
+    Tensor *cell,
+    Tensor *output) {
+  const index_t steps = input->dim(0);
+  const index_t batch = input->dim(1);
+  const index_t width = input->dim(2);
+  const index_t hidden_units = pre_output->dim(1);
+  const index_t w_blocks = hidden_units >> 2;
+  const index_t rows = steps * batch;
+  MACE_CHECK(pre_output->dim(0) == batch,
+             "LSTM initial state should be of the batch of the input");
+
+  auto runtime = context->device()->gpu_runtime()->opencl_runtime();
+  // the previous and the current hidden states and the cell state
+  const index_t state_bytes = 3 * batch * hidden_units * sizeof(float);
+  const bool global_state =
+      static_cast<uint64_t>(state_bytes) >
+          runtime->device().getInfo<CL_DEVICE_LOCAL_MEM_SIZE>();
+  MACE_OUT_OF_RANGE_DEFINITION;
+
+  auto dt = DataTypeToEnum<T>::value;
+  if (gates_kernel_.get() == nullptr) {
+    std::set<std::string> built_options;
+    MACE_OUT_OF_RANGE_CONFIG;
+    MACE_NON_UNIFORM_WG_CONFIG;
+    std::string kernel_name = MACE_OBFUSCATE_SYMBOL("lstm_input_gates");
+    built_options.emplace("-Dlstm_input_gates=" + kernel_name);
+    built_options.emplace("-DDATA_TYPE=" + DtToUpCompatibleCLDt(dt));
+    built_options.emplace("-DCMD_DATA_TYPE=" + DtToUpCompatibleCLCMDDt(dt));
+    MACE_RETURN_IF_ERROR(runtime->BuildKernel("lstmcell", kernel_name,
+                                              built_options, &gates_kernel_));
+  }
+  if (sequence_kernel_.get() == nullptr || global_state != global_state_) {
+    std::set<std::string> built_options;
+    MACE_OUT_OF_RANGE_CONFIG;
+    std::string kernel_name = MACE_OBFUSCATE_SYMBOL("lstm_sequence");
+    built_options.emplace("-Dlstm_sequence=" + kernel_name);
+    built_options.emplace("-DDATA_TYPE=" + DtToUpCompatibleCLDt(dt));
+    built_options.emplace("-DCMD_DATA_TYPE=" + DtToUpCompatibleCLCMDDt(dt));
+    if (global_state) {
+      built_options.emplace("-DSTATE_MEM=__global");
+      built_options.emplace("-DSTATE_MEM_FENCE=CLK_GLOBAL_MEM_FENCE");
+    } else {
+      built_options.emplace("-DSTATE_MEM=__local");
+      built_options.emplace("-DSTATE_MEM_FENCE=CLK_LOCAL_MEM_FENCE");
+    }
+    MACE_RETURN_IF_ERROR(runtime->BuildKernel("lstmcell", kernel_name,
+                                              built_options,
+                                              &sequence_kernel_));
+    sequence_kwg_size_ = static_cast<uint32_t>(
+        runtime->GetKernelMaxWorkGroupSize(sequence_kernel_));
+    global_state_ = global_state;
+  }
+
+  std::vector<size_t> output_image_shape;
+  OpenCLUtil::CalImage2DShape({rows, 1, 1, hidden_units},
+                              OpenCLBufferType::IN_OUT_CHANNEL,
+                              &output_image_shape);
+  MACE_RETURN_IF_ERROR(output->ResizeImage({steps, batch, hidden_units},
+                                           output_image_shape));
+  std::vector<size_t> cell_image_shape;
+  OpenCLUtil::CalImage2DShape({batch, 1, 1, hidden_units},
+                              OpenCLBufferType::IN_OUT_CHANNEL,
+                              &cell_image_shape);
+  MACE_RETURN_IF_ERROR(cell->ResizeImage(pre_cell->shape(),
+                                         cell_image_shape));
+
+  // 1. the input projections of the gates of all the steps
+  std::vector<size_t> gates_image_shape;
+  OpenCLUtil::CalImage2DShape({rows, 1, 1, 4 * hidden_units},
+                              OpenCLBufferType::IN_OUT_CHANNEL,
+                              &gates_image_shape);
+  ScratchImage gates_image(
+      context->device()->gpu_runtime()->scratch_image_manager());
+  std::unique_ptr<Tensor> gates = make_unique<Tensor>(
+      gates_image.Scratch(context->device()->allocator(), gates_image_shape,
+                          dt), dt);
+  MACE_RETURN_IF_ERROR(gates->ResizeImage({rows, 4 * hidden_units},
+                                          gates_image_shape));
+
+  const uint32_t gates_gws[2] = {static_cast<uint32_t>(hidden_units),
+                                 static_cast<uint32_t>(RoundUpDiv4(rows))};
+  MACE_OUT_OF_RANGE_INIT(gates_kernel_);
+  uint32_t idx = 0;
+  MACE_OUT_OF_RANGE_SET_ARGS(gates_kernel_);
+  MACE_SET_2D_GWS_ARGS(gates_kernel_, gates_gws);
+  gates_kernel_.setArg(idx++, *(input->opencl_image()));
+  gates_kernel_.setArg(idx++, *(weight->opencl_image()));
+  gates_kernel_.setArg(idx++, *(bias->opencl_image()));
+  gates_kernel_.setArg(idx++, static_cast<int32_t>(width));
+  gates_kernel_.setArg(idx++, static_cast<int32_t>(RoundUpDiv4(width)));
+  gates_kernel_.setArg(idx++, static_cast<int32_t>(rows));
+  gates_kernel_.setArg(idx++, *(gates->opencl_image()));
+
+  const uint32_t gates_kwg_size = static_cast<uint32_t>(
+      runtime->GetKernelMaxWorkGroupSize(gates_kernel_));
+  const std::vector<uint32_t> gates_lws = {gates_kwg_size / 16, 16, 0};
+  std::string gates_tuning_key =
+      Concat("lstm_input_gates_opencl_kernel", rows, width, hidden_units);
+  StatsFuture gates_future;
+  MACE_RETURN_IF_ERROR(TuningOrRun2DKernel(runtime, gates_kernel_,
+                                           gates_tuning_key, gates_gws,
+                                           gates_lws, &gates_future));
+  MACE_OUT_OF_RANGE_VALIDATION;
+
+  // 2. the recurrence of all the steps in one work group
+  const uint32_t local_size = static_cast<uint32_t>(std::min<index_t>(
+      batch * w_blocks, sequence_kwg_size_));
+  MACE_OUT_OF_RANGE_INIT(sequence_kernel_);
+  idx = 0;
+  MACE_OUT_OF_RANGE_SET_ARGS(sequence_kernel_);
+  sequence_kernel_.setArg(idx++, *(gates->opencl_image()));
+  sequence_kernel_.setArg(idx++, *(weight->opencl_image()));
+  sequence_kernel_.setArg(idx++, *(pre_output->opencl_image()));
+  sequence_kernel_.setArg(idx++, *(pre_cell->opencl_image()));
+  if (global_state) {
+    if (state_buffer_ == nullptr || state_buffer_->size() < state_bytes) {
+      state_buffer_ = make_unique<Buffer>(context->device()->allocator());
+      MACE_RETURN_IF_ERROR(state_buffer_->Allocate(state_bytes));
+    }
+    sequence_kernel_.setArg(
+        idx++, *(static_cast<cl::Buffer *>(state_buffer_->buffer())));
+  } else {
+    sequence_kernel_.setArg(idx++, static_cast<size_t>(state_bytes),
+                            nullptr);
+  }
+  sequence_kernel_.setArg(idx++, static_cast<float>(forget_bias_));
+  sequence_kernel_.setArg(idx++, static_cast<int32_t>(width));
+  sequence_kernel_.setArg(idx++, static_cast<int32_t>(batch));
+  sequence_kernel_.setArg(idx++, static_cast<int32_t>(w_blocks));
+  sequence_kernel_.setArg(idx++, static_cast<int32_t>(steps));
+  sequence_kernel_.setArg(idx++, *(cell->opencl_image()));
+  sequence_kernel_.setArg(idx++, *(output->opencl_image()));
+
+  cl::Event event;
+  cl_int error = runtime->command_queue().enqueueNDRangeKernel(
+      sequence_kernel_, cl::NullRange, cl::NDRange(local_size),
+      cl::NDRange(local_size), nullptr, &event);
+  MACE_CL_RET_STATUS(error);
+  const uint32_t gws[1] = {local_size};
+  runtime->RecordKernel(sequence_kernel_, gws, gws, 1, event);
+  MACE_OUT_OF_RANGE_VALIDATION;
+
+  StatsFuture sequence_future;
+  sequence_future.wait_fn = [runtime, event](CallStats *stats) {
+    event.wait();
+    if (stats != nullptr) {
+      runtime->GetCallStats(event, stats);
+    }
+  };
+  MergeMultipleFutureWaitFn({gates_future, sequence_future},
+                            context->future());
+  return MaceStatus::MACE_SUCCESS;
+}
+
 }  // namespace image
 }  // namespace opencl
 }  // namespace ops
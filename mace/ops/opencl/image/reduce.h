@@ -16,12 +16,14 @@
 
 #include "mace/ops/opencl/reduce.h"
 
+#include <algorithm>
 #include <memory>
 #include <set>
 #include <string>
 #include <vector>
 
 #include "mace/core/op_context.h"
+#include "mace/core/runtime/opencl/scratch_image.h"
 #include "mace/core/tensor.h"
 #include "mace/ops/opencl/helper.h"
 #include "mace/ops/reduce.h"
@@ -45,14 +47,106 @@ class ReduceKernel : public OpenCLReduceKernel {
       Tensor *output) override;
 
  private:
+  // sets the arguments of a pass and enqueues it, the reduction of
+  // in_height * in_width pixels of every channel block in parts
+  MaceStatus RunPass(OpContext *context,
+                     cl::Kernel *kernel,
+                     const Tensor *input,
+                     const index_t batch,
+                     const index_t in_height,
+                     const index_t in_width,
+                     const index_t channel_blocks,
+                     const index_t parts,
+                     const float scale,
+                     Tensor *output,
+                     StatsFuture *future);
+
   ReduceType reduce_type_;
   const std::vector<int> axis_;
   bool keep_dims_;
-  cl::Kernel kernel_;
+  // of the single or the first pass and of the second pass
+  cl::Kernel kernels_[2];
   uint32_t kwg_size_;
-  std::vector<index_t> input_shape_;
 };
 
+namespace reduce {
+// a work item reads 16 pixels at least
+constexpr index_t kMinItemPixels = 16;
+// the work groups of the first pass of a split reduction
+constexpr index_t kMinGroups = 64;
+constexpr uint32_t kMaxGroupSize = 256;
+
+inline uint32_t GroupSize(const index_t pixels, const uint32_t kwg_size) {
+  const uint32_t max_group_size = std::max<uint32_t>(
+      std::min(kwg_size, kMaxGroupSize), 4);
+  return static_cast<uint32_t>(
+      RoundUp<index_t>(std::max<index_t>(std::min<index_t>(
+          pixels / kMinItemPixels, max_group_size), 1), 4));
+}
+}  // namespace reduce
+
+template <typename T>
+MaceStatus ReduceKernel<T>::RunPass(OpContext *context,
+                                    cl::Kernel *kernel,
+                                    const Tensor *input,
+                                    const index_t batch,
+                                    const index_t in_height,
+                                    const index_t in_width,
+                                    const index_t channel_blocks,
+                                    const index_t parts,
+                                    const float scale,
+                                    Tensor *output,
+                                    StatsFuture *future) {
+  auto runtime = context->device()->gpu_runtime()->opencl_runtime();
+  MACE_OUT_OF_RANGE_DEFINITION;
+  const index_t pixels = in_height * in_width;
+  const index_t part_size = RoundUpDiv(pixels, parts);
+  const uint32_t group_size = std::min(
+      reduce::GroupSize(part_size, kwg_size_), kwg_size_);
+  const std::vector<uint32_t> lws = {std::min<uint32_t>(group_size, 4),
+                                     std::max<uint32_t>(group_size / 4, 1),
+                                     1};
+  const std::vector<uint32_t> gws = {
+      lws[0], lws[1], static_cast<uint32_t>(batch * channel_blocks * parts)};
+
+  MACE_OUT_OF_RANGE_INIT(*kernel);
+  uint32_t idx = 0;
+  MACE_OUT_OF_RANGE_SET_ARGS(*kernel);
+  MACE_SET_3D_GWS_ARGS(*kernel, gws);
+  kernel->setArg(idx++, *(input->opencl_image()));
+  kernel->setArg(idx++, (lws[0] * lws[1] * 4 * sizeof(float)), nullptr);
+  kernel->setArg(idx++, static_cast<int32_t>(parts));
+  kernel->setArg(idx++, static_cast<int32_t>(part_size));
+  kernel->setArg(idx++, static_cast<int32_t>(in_height));
+  kernel->setArg(idx++, static_cast<int32_t>(in_width));
+  kernel->setArg(idx++, scale);
+  kernel->setArg(idx++, static_cast<int32_t>(channel_blocks));
+  kernel->setArg(idx++, *(output->opencl_image()));
+
+  cl::Event event;
+  std::vector<uint32_t> roundup_gws(gws);
+  if (!runtime->IsNonUniformWorkgroupsSupported()) {
+    roundup_gws[2] = RoundUp(gws[2], lws[2]);
+  }
+  cl_int error = runtime->command_queue().enqueueNDRangeKernel(
+      *kernel, cl::NullRange,
+      cl::NDRange(roundup_gws[0], roundup_gws[1], roundup_gws[2]),
+      cl::NDRange(lws[0], lws[1], lws[2]), nullptr, &event);
+  MACE_CL_RET_STATUS(error);
+  runtime->RecordKernel(*kernel, gws.data(), lws.data(), 3, event);
+  MACE_OUT_OF_RANGE_VALIDATION;
+
+  if (future != nullptr) {
+    future->wait_fn = [runtime, event](CallStats *stats) {
+      event.wait();
+      if (stats != nullptr) {
+        runtime->GetCallStats(event, stats);
+      }
+    };
+  }
+  return MaceStatus::MACE_SUCCESS;
+}
+
 template <typename T>
 MaceStatus ReduceKernel<T>::Compute(
     OpContext *context,
@@ -69,10 +163,8 @@ MaceStatus ReduceKernel<T>::Compute(
   const index_t in_width = input->dim(2);
   const index_t channels = input->dim(3);
   const index_t channel_blocks = RoundUpDiv4(channels);
-  const uint32_t image_size = static_cast<uint32_t >(in_height * in_width);
+  const index_t image_size = in_height * in_width;
 
-  std::vector<uint32_t> gws(3);
-  std::vector<uint32_t> lws(3);
   std::vector<index_t> output_shape{batch, 1, 1, channels};
   std::vector<size_t> output_image_shape;
   OpenCLUtil::CalImage2DShape(output_shape, OpenCLBufferType::IN_OUT_CHANNEL,
@@ -80,9 +172,8 @@ MaceStatus ReduceKernel<T>::Compute(
   MACE_RETURN_IF_ERROR(output->ResizeImage(output_shape, output_image_shape));
 
   auto runtime = context->device()->gpu_runtime()->opencl_runtime();
-  MACE_OUT_OF_RANGE_DEFINITION;
 
-  if (kernel_.get() == nullptr) {
+  if (kernels_[0].get() == nullptr) {
     const DataType dt = DataTypeToEnum<T>::value;
     std::set<std::string> built_options;
     MACE_OUT_OF_RANGE_CONFIG;
@@ -92,86 +183,56 @@ MaceStatus ReduceKernel<T>::Compute(
     built_options.emplace("-DDATA_TYPE=" + DtToUpCompatibleCLDt(dt));
     built_options.emplace("-DCMD_DATA_TYPE=" + DtToUpCompatibleCLCMDDt(dt));
     built_options.emplace(MakeString("-DREDUCE_TYPE=", reduce_type_));
-    if (runtime->gpu_type() != GPUType::QUALCOMM_ADRENO) {
-      built_options.emplace("-DNON_QUALCOMM_ADRENO");
+    // the sub group reductions have no product
+    if (reduce_type_ != ReduceType::PROD &&
+        runtime->IsExtensionSupported("cl_khr_subgroups")) {
+      built_options.emplace("-DUSE_SUBGROUP");
+      built_options.emplace("-cl-std=CL2.0");
     }
-    MACE_RETURN_IF_ERROR(runtime->BuildKernel("reduce",
-                                              kernel_name,
-                                              built_options,
-                                              &kernel_));
-
-    kwg_size_ =
-        static_cast<uint32_t>(runtime->GetKernelMaxWorkGroupSize(kernel_));
-  }
-
-  if (runtime->gpu_type() == GPUType::QUALCOMM_ADRENO) {
-    const uint32_t wave_size =
-        static_cast<uint32_t>(runtime->GetKernelWaveSize(kernel_));
-    gws = {4, (wave_size / 4), static_cast<uint32_t>(batch * channel_blocks)};
-  } else {
-    // Ensure each kernel has at least 4 input elements.
-    gws = {4, image_size / 16, static_cast<uint32_t>(batch * channel_blocks)};
-    if (gws[1] == 0) {
-      gws[1] = 1;
-    } else if (gws[1] > 16) {
-      gws[1] = 16;
+    for (int i = 0; i < 2; ++i) {
+      MACE_RETURN_IF_ERROR(runtime->BuildKernel("reduce",
+                                                kernel_name,
+                                                built_options,
+                                                &kernels_[i]));
     }
-  }
-  lws = {gws[0], gws[1], 1};
-  const int group_num = lws[0] * lws[1] * lws[2];
-  // Each kernel intends to compute compute_size elements.
-  const int compute_size = (image_size + group_num - 1) / group_num;
-  const int last_index = image_size % group_num;
-  const float scale = 1.f / (in_width * in_height);
 
-  MACE_OUT_OF_RANGE_INIT(kernel_);
-  if (!IsVecEqual(input_shape_, input->shape())) {
-    uint32_t idx = 0;
-    MACE_OUT_OF_RANGE_SET_ARGS(kernel_);
-    MACE_SET_3D_GWS_ARGS(kernel_, gws);
-    kernel_.setArg(idx++, *(input->opencl_image()));
-    kernel_.setArg(idx++, (group_num * 4 * sizeof(float)),
-                   nullptr);
-    kernel_.setArg(idx++, static_cast<int32_t>(group_num));
-    kernel_.setArg(idx++, static_cast<int32_t>(compute_size));
-    kernel_.setArg(idx++, static_cast<int32_t>(last_index));
-    kernel_.setArg(idx++, static_cast<int32_t>(in_height));
-    kernel_.setArg(idx++, static_cast<int32_t>(in_width));
-    kernel_.setArg(idx++, scale);
-    kernel_.setArg(idx++, static_cast<int32_t>(channel_blocks));
-    kernel_.setArg(idx++, *(output->opencl_image()));
-
-    input_shape_ = input->shape();
+    kwg_size_ = static_cast<uint32_t>(
+        runtime->GetKernelMaxWorkGroupSize(kernels_[0]));
   }
 
-  cl::Event event;
-  cl_int error;
-  if (runtime->IsNonUniformWorkgroupsSupported()) {
-    error = runtime->command_queue().enqueueNDRangeKernel(
-        kernel_, cl::NullRange, cl::NDRange(gws[0], gws[1], gws[2]),
-        cl::NDRange(lws[0], lws[1], lws[2]), nullptr, &event);
-  } else {
-    std::vector<uint32_t> roundup_gws(lws.size());
-    for (size_t i = 0; i < lws.size(); ++i) {
-      roundup_gws[i] = RoundUp(gws[i], lws[i]);
-    }
-    error = runtime->command_queue().enqueueNDRangeKernel(
-        kernel_, cl::NullRange,
-        cl::NDRange(roundup_gws[0], roundup_gws[1], roundup_gws[2]),
-        cl::NDRange(lws[0], lws[1], lws[2]), nullptr, &event);
-  }
-  MACE_CL_RET_STATUS(error);
-  MACE_OUT_OF_RANGE_VALIDATION;
-
-  if (context->future() != nullptr) {
-    context->future()->wait_fn = [runtime, event](CallStats *stats) {
-      event.wait();
-      if (stats != nullptr) {
-        runtime->GetCallStats(event, stats);
-      }
-    };
+  // A reduction of few channel blocks over many pixels runs few work
+  // groups, it is split into parts reduced again by a second pass.
+  const index_t group_size = reduce::GroupSize(image_size, kwg_size_);
+  const index_t parts = std::min(
+      image_size / (group_size * reduce::kMinItemPixels),
+      RoundUpDiv(reduce::kMinGroups, batch * channel_blocks));
+  const float scale = 1.f / (in_width * in_height);
+  if (parts < 2) {
+    return RunPass(context, &kernels_[0], input, batch, in_height, in_width,
+                   channel_blocks, 1, scale, output, context->future());
   }
 
+  const DataType dt = DataTypeToEnum<T>::value;
+  std::vector<size_t> partial_image_shape;
+  OpenCLUtil::CalImage2DShape({batch, 1, parts, channels},
+                              OpenCLBufferType::IN_OUT_CHANNEL,
+                              &partial_image_shape);
+  ScratchImage partial_image(
+      context->device()->gpu_runtime()->scratch_image_manager());
+  std::unique_ptr<Tensor> partial = make_unique<Tensor>(
+      partial_image.Scratch(context->device()->allocator(),
+                            partial_image_shape, dt), dt);
+  MACE_RETURN_IF_ERROR(partial->ResizeImage({batch, 1, parts, channels},
+                                            partial_image_shape));
+  std::vector<StatsFuture> futures(2);
+  MACE_RETURN_IF_ERROR(RunPass(context, &kernels_[0], input, batch,
+                               in_height, in_width, channel_blocks, parts,
+                               scale, partial.get(), &futures[0]));
+  // the partial means are scaled already
+  MACE_RETURN_IF_ERROR(RunPass(context, &kernels_[1], partial.get(), batch,
+                               1, parts, channel_blocks, 1, 1.f, output,
+                               &futures[1]));
+  MergeMultipleFutureWaitFn(futures, context->future());
   return MaceStatus::MACE_SUCCESS;
 }
 
@@ -54,6 +54,9 @@ inline std::vector<uint32_t> LocalWS(OpenCLRuntime *runtime,
   }
   return lws;
 }
+
+// the channel blocks from which a work group computes a pixel
+constexpr index_t kGroupChannelBlocks = 16;
 }  // namespace softmax
 
 template <typename T>
@@ -65,9 +68,20 @@ class SoftmaxKernel : public OpenCLSoftmaxKernel {
       Tensor *output) override;
 
  private:
+  MaceStatus ComputeByGroup(OpContext *context,
+                            const Tensor *logits,
+                            const index_t batch,
+                            const index_t height,
+                            const index_t width,
+                            const index_t channels,
+                            Tensor *output);
+
   cl::Kernel kernel_;
   uint32_t kwg_size_;
   std::vector<index_t> input_shape_;
+  cl::Kernel group_kernel_;
+  uint32_t group_kwg_size_;
+  std::vector<index_t> group_input_shape_;
 };
 
 template <typename T>
@@ -97,6 +111,10 @@ MaceStatus SoftmaxKernel<T>::Compute(
 
   const index_t channel_blocks = RoundUpDiv4(channels);
   const int remain_channels = channel_blocks * 4 - channels;
+  if (channel_blocks >= softmax::kGroupChannelBlocks) {
+    return ComputeByGroup(context, logits, batch, height, width, channels,
+                          output);
+  }
 
   const uint32_t gws[3] = {static_cast<uint32_t>(channel_blocks),
                            static_cast<uint32_t>(width),
@@ -143,6 +161,76 @@ MaceStatus SoftmaxKernel<T>::Compute(
   return MaceStatus::MACE_SUCCESS;
 }
 
+template <typename T>
+MaceStatus SoftmaxKernel<T>::ComputeByGroup(OpContext *context,
+                                            const Tensor *logits,
+                                            const index_t batch,
+                                            const index_t height,
+                                            const index_t width,
+                                            const index_t channels,
+                                            Tensor *output) {
+  auto runtime = context->device()->gpu_runtime()->opencl_runtime();
+  MACE_OUT_OF_RANGE_DEFINITION;
+
+  if (group_kernel_.get() == nullptr) {
+    std::set<std::string> built_options;
+    MACE_OUT_OF_RANGE_CONFIG;
+    MACE_NON_UNIFORM_WG_CONFIG;
+    std::string kernel_name = MACE_OBFUSCATE_SYMBOL("softmax_group");
+    built_options.emplace("-Dsoftmax_group=" + kernel_name);
+    auto dt = DataTypeToEnum<T>::value;
+    built_options.emplace("-DDATA_TYPE=" + DtToUpCompatibleCLDt(dt));
+    built_options.emplace("-DCMD_DATA_TYPE=" + DtToUpCompatibleCLCMDDt(dt));
+    MACE_RETURN_IF_ERROR(runtime->BuildKernel("softmax", kernel_name,
+                                              built_options,
+                                              &group_kernel_));
+
+    group_kwg_size_ = static_cast<uint32_t>(
+        runtime->GetKernelMaxWorkGroupSize(group_kernel_));
+  }
+
+  // a work item reads 4 channel blocks, up to 256 items a group
+  uint32_t group_size = 1;
+  while (group_size * 2 <= std::min<uint32_t>(group_kwg_size_, 256) &&
+         group_size * 8 <= RoundUpDiv4(channels)) {
+    group_size *= 2;
+  }
+  const uint32_t gws[3] = {group_size, static_cast<uint32_t>(width),
+                           static_cast<uint32_t>(height * batch)};
+  const uint32_t lws[3] = {group_size, 1, 1};
+
+  MACE_OUT_OF_RANGE_INIT(group_kernel_);
+  if (!IsVecEqual(group_input_shape_, logits->shape())) {
+    uint32_t idx = 0;
+    MACE_OUT_OF_RANGE_SET_ARGS(group_kernel_);
+    MACE_SET_3D_GWS_ARGS(group_kernel_, gws);
+    group_kernel_.setArg(idx++, *(logits->opencl_image()));
+    group_kernel_.setArg(idx++, group_size * sizeof(float), nullptr);
+    group_kernel_.setArg(idx++, static_cast<int>(channels));
+    group_kernel_.setArg(idx++, *(output->opencl_image()));
+
+    group_input_shape_ = logits->shape();
+  }
+
+  cl::Event event;
+  cl_int error = runtime->command_queue().enqueueNDRangeKernel(
+      group_kernel_, cl::NullRange, cl::NDRange(gws[0], gws[1], gws[2]),
+      cl::NDRange(lws[0], lws[1], lws[2]), nullptr, &event);
+  MACE_CL_RET_STATUS(error);
+  runtime->RecordKernel(group_kernel_, gws, lws, 3, event);
+  MACE_OUT_OF_RANGE_VALIDATION;
+
+  if (context->future() != nullptr) {
+    context->future()->wait_fn = [runtime, event](CallStats *stats) {
+      event.wait();
+      if (stats != nullptr) {
+        runtime->GetCallStats(event, stats);
+      }
+    };
+  }
+  return MaceStatus::MACE_SUCCESS;
+}
+
 }  // namespace image
 }  // namespace opencl
 }  // namespace ops
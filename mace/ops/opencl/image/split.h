@@ -122,6 +122,7 @@ MaceStatus SplitKernel<T>::Compute(
           cl::NDRange(lws[0], lws[1], lws[2]), nullptr, &event);
     }
     MACE_CL_RET_STATUS(error);
+    runtime->RecordKernel(kernel_, gws, lws.data(), 3, event);
     MACE_OUT_OF_RANGE_VALIDATION;
     if (context->future() != nullptr && runtime->is_profiling_enabled()) {
       event.wait();
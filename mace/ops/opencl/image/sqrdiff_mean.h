@@ -16,6 +16,7 @@
 
 #include "mace/ops/opencl/sqrdiff_mean.h"
 
+#include <algorithm>
 #include <memory>
 #include <set>
 #include <string>
@@ -84,9 +85,6 @@ MaceStatus SqrDiffMeanKernel<T>::Compute(
     built_options.emplace("-Dsqrdiff_mean=" + kernel_name);
     built_options.emplace("-DDATA_TYPE=" + DtToUpCompatibleCLDt(dt));
     built_options.emplace("-DCMD_DATA_TYPE=" + DtToUpCompatibleCLCMDDt(dt));
-    if (runtime->gpu_type() != GPUType::QUALCOMM_ADRENO) {
-      built_options.emplace("-DNON_QUALCOMM_ADRENO");
-    }
     MACE_RETURN_IF_ERROR(runtime->BuildKernel("sqrdiff_mean",
                                               kernel_name,
                                               built_options,
@@ -96,17 +94,12 @@ MaceStatus SqrDiffMeanKernel<T>::Compute(
         static_cast<uint32_t>(runtime->GetKernelMaxWorkGroupSize(kernel_));
   }
 
-  if (runtime->gpu_type() == GPUType::QUALCOMM_ADRENO) {
-    const uint32_t wave_size =
-        static_cast<uint32_t>(runtime->GetKernelWaveSize(kernel_));
-    gws = {4, (wave_size / 4), static_cast<uint32_t>(batch * channel_blocks)};
-  } else {
-    gws = {4, 16, static_cast<uint32_t>(batch * channel_blocks)};
-  }
+  // a work item reads 16 pixels at least, up to 256 items a group
+  const uint32_t group_size = static_cast<uint32_t>(RoundUp<index_t>(
+      std::max<index_t>(std::min<index_t>(
+          image_size / 16, std::min<uint32_t>(kwg_size_, 256)), 1), 4));
+  gws = {4, group_size / 4, static_cast<uint32_t>(batch * channel_blocks)};
   lws = {gws[0], gws[1], 1};
-  const int group_size = lws[0] * lws[1] * lws[2];
-  const int partial_len = (image_size + group_size - 1) / group_size;
-  const int remain_index = image_size % group_size;
   const float img_size_reciprocal = 1.f / (in_width * in_height);
 
   MACE_OUT_OF_RANGE_INIT(kernel_);
@@ -118,10 +111,6 @@ MaceStatus SqrDiffMeanKernel<T>::Compute(
     kernel_.setArg(idx++, *(input1->opencl_image()));
     kernel_.setArg(idx++, (group_size * 4 * sizeof(float)),
                    nullptr);
-    kernel_.setArg(idx++, static_cast<int32_t>(group_size));
-    kernel_.setArg(idx++, static_cast<int32_t>(partial_len));
-    kernel_.setArg(idx++, static_cast<int32_t>(remain_index));
-    kernel_.setArg(idx++, static_cast<int32_t>(batch));
     kernel_.setArg(idx++, static_cast<int32_t>(in_height));
     kernel_.setArg(idx++, static_cast<int32_t>(in_width));
     kernel_.setArg(idx++, img_size_reciprocal);
@@ -148,6 +137,7 @@ MaceStatus SqrDiffMeanKernel<T>::Compute(
         cl::NDRange(lws[0], lws[1], lws[2]), nullptr, &event);
   }
   MACE_CL_RET_STATUS(error);
+  runtime->RecordKernel(kernel_, gws.data(), lws.data(), 3, event);
   MACE_OUT_OF_RANGE_VALIDATION;
 
   if (context->future() != nullptr) {
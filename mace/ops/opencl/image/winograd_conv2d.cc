@@ -18,6 +18,7 @@
 #include "mace/ops/common/conv_pool_2d_util.h"
 #include "mace/ops/opencl/helper.h"
 #include "mace/utils/memory.h"
+#include "mace/utils/timer.h"
 #include "mace/utils/utils.h"
 
 namespace mace {
@@ -26,6 +27,34 @@ namespace opencl {
 namespace image {
 
 namespace {
+void AddActivationOptions(const ActivationType activation,
+                          std::set<std::string> *built_options) {
+  switch (activation) {
+    case NOOP:
+      break;
+    case RELU:
+      built_options->emplace("-DUSE_RELU");
+      break;
+    case RELUX:
+      built_options->emplace("-DUSE_RELUX");
+      break;
+    case PRELU:
+      built_options->emplace("-DUSE_PRELU");
+      break;
+    case TANH:
+      built_options->emplace("-DUSE_TANH");
+      break;
+    case SIGMOID:
+      built_options->emplace("-DUSE_SIGMOID");
+      break;
+    case LEAKYRELU:
+      built_options->emplace("-DUSE_LEAKYRELU");
+      break;
+    default:
+      LOG(FATAL) << "Unknown activation type: " << activation;
+  }
+}
+
 MaceStatus WinogradInputTransform(OpContext *context,
                                   cl::Kernel *kernel,
                                   const Tensor *input_tensor,
@@ -148,30 +177,7 @@ MaceStatus WinogradOutputTransform(OpContext *context,
     built_options.emplace("-DDATA_TYPE=" + DtToUpCompatibleCLDt(dt));
     built_options.emplace("-DCMD_DATA_TYPE=" + DtToUpCompatibleCLCMDDt(dt));
     built_options.emplace(bias != nullptr ? "-DBIAS" : "");
-    switch (activation) {
-      case NOOP:
-        break;
-      case RELU:
-        built_options.emplace("-DUSE_RELU");
-        break;
-      case RELUX:
-        built_options.emplace("-DUSE_RELUX");
-        break;
-      case PRELU:
-        built_options.emplace("-DUSE_PRELU");
-        break;
-      case TANH:
-        built_options.emplace("-DUSE_TANH");
-        break;
-      case SIGMOID:
-        built_options.emplace("-DUSE_SIGMOID");
-        break;
-      case LEAKYRELU:
-        built_options.emplace("-DUSE_LEAKYRELU");
-        break;
-      default:
-        LOG(FATAL) << "Unknown activation type: " << activation;
-    }
+    AddActivationOptions(activation, &built_options);
 
     MACE_RETURN_IF_ERROR(runtime->BuildKernel("winograd_transform",
                                               obfuscated_kernel_name,
@@ -217,11 +223,110 @@ MaceStatus WinogradOutputTransform(OpContext *context,
   MACE_OUT_OF_RANGE_VALIDATION;
   return MaceStatus::MACE_SUCCESS;
 }
+
+// the matmul with the output transform, bias and activation of F(2x2) fused
+MaceStatus WinogradMatMulOutputTransform(OpContext *context,
+                                         cl::Kernel *kernel,
+                                         const Tensor *filter,
+                                         const Tensor *input_tensor,
+                                         const Tensor *bias,
+                                         const DataType dt,
+                                         const index_t round_h,
+                                         const index_t round_w,
+                                         const ActivationType activation,
+                                         const float relux_max_limit,
+                                         const float leakyrelu_coefficient,
+                                         Tensor *output_tensor,
+                                         uint32_t *kwg_size,
+                                         StatsFuture *future) {
+  OpenCLRuntime *runtime = context->device()->gpu_runtime()->opencl_runtime();
+  auto &output_shape = output_tensor->shape();
+
+  MACE_OUT_OF_RANGE_DEFINITION;
+  if (kernel->get() == nullptr) {
+    std::set<std::string> built_options;
+    MACE_OUT_OF_RANGE_CONFIG;
+    MACE_NON_UNIFORM_WG_CONFIG;
+    std::string obfuscated_kernel_name =
+        MACE_OBFUSCATE_SYMBOL("winograd_matmul_inverse_transform_2x2");
+    built_options.emplace("-Dwinograd_matmul_inverse_transform_2x2="
+                              + obfuscated_kernel_name);
+    built_options.emplace("-DDATA_TYPE=" + DtToUpCompatibleCLDt(dt));
+    built_options.emplace("-DCMD_DATA_TYPE=" + DtToUpCompatibleCLCMDDt(dt));
+    built_options.emplace(bias != nullptr ? "-DBIAS" : "");
+    AddActivationOptions(activation, &built_options);
+    MACE_RETURN_IF_ERROR(runtime->BuildKernel("winograd_transform",
+                                              obfuscated_kernel_name,
+                                              built_options,
+                                              kernel));
+
+    *kwg_size =
+        static_cast<uint32_t>(runtime->GetKernelMaxWorkGroupSize(*kernel));
+  }
+
+  const index_t out_channel = output_shape[3];
+  const uint32_t gws[2] = {
+      static_cast<uint32_t>(input_tensor->dim(2)),
+      static_cast<uint32_t>(RoundUpDiv4(out_channel))};
+  MACE_OUT_OF_RANGE_INIT(*kernel);
+  uint32_t idx = 0;
+  MACE_OUT_OF_RANGE_SET_ARGS(*kernel);
+  MACE_SET_2D_GWS_ARGS(*kernel, gws);
+  kernel->setArg(idx++, *(filter->opencl_image()));
+  kernel->setArg(idx++, *(input_tensor->opencl_image()));
+  if (bias != nullptr) {
+    kernel->setArg(idx++, *(bias->opencl_image()));
+  }
+  kernel->setArg(idx++, *(output_tensor->opencl_image()));
+  kernel->setArg(idx++, static_cast<uint32_t>(output_shape[1]));
+  kernel->setArg(idx++, static_cast<uint32_t>(output_shape[2]));
+  kernel->setArg(idx++, static_cast<uint32_t>(round_h * round_w));
+  kernel->setArg(idx++, static_cast<uint32_t>(round_w));
+  kernel->setArg(idx++, static_cast<int>(out_channel));
+  kernel->setArg(idx++, static_cast<int>(RoundUpDiv4(input_tensor->dim(1))));
+  kernel->setArg(idx++, relux_max_limit);
+  kernel->setArg(idx++, leakyrelu_coefficient);
+
+  const std::vector<uint32_t> lws = {*kwg_size / 8, 8, 0};
+  std::string tuning_key =
+      Concat("winograd_matmul_inverse_transform_kernel", output_shape[0],
+             output_shape[1], output_shape[2], output_shape[3],
+             input_tensor->dim(1));
+  MACE_RETURN_IF_ERROR(TuningOrRun2DKernel(runtime, *kernel, tuning_key,
+                                           gws, lws, future));
+
+  MACE_OUT_OF_RANGE_VALIDATION;
+  return MaceStatus::MACE_SUCCESS;
+}
+
+// Times a run by the profiled device time of the kernels it waits on, so
+// runs of different kernel counts compare with each other.
+class FuturesTimer : public Timer {
+ public:
+  explicit FuturesTimer(const std::vector<StatsFuture> *futures)
+      : futures_(futures), accumulated_micros_(0) {}
+  void StartTiming() override {}
+  void StopTiming() override {}
+  void AccumulateTiming() override {
+    for (auto &future : *futures_) {
+      CallStats stats;
+      future.wait_fn(&stats);
+      accumulated_micros_ += stats.end_micros - stats.start_micros;
+    }
+  }
+  void ClearTiming() override { accumulated_micros_ = 0; }
+  double ElapsedMicros() override { return accumulated_micros_; }
+  double AccumulatedMicros() override { return accumulated_micros_; }
+
+ private:
+  const std::vector<StatsFuture> *futures_;
+  double accumulated_micros_;
+};
 }  // namespace
 
 
 extern MaceStatus WinogradConv2dK3x3S1(OpContext *context,
-                                       cl::Kernel *kernels[3],
+                                       cl::Kernel *kernels[4],
                                        const Tensor *input,
                                        const Tensor *filter,
                                        const Tensor *bias,
@@ -233,11 +338,11 @@ extern MaceStatus WinogradConv2dK3x3S1(OpContext *context,
                                        const int wino_blk_size,
                                        std::vector<index_t> *prev_input_shape,
                                        Tensor *output,
-                                       uint32_t *kwg_size[3]) {
+                                       uint32_t *kwg_size[4]) {
   OpenCLRuntime *runtime = context->device()->gpu_runtime()->opencl_runtime();
   ScratchImageManager *scratch_manager =
       context->device()->gpu_runtime()->scratch_image_manager();
-  StatsFuture t_input_future, mm_future, t_output_future;
+  StatsFuture t_input_future;
   bool input_changed = !IsVecEqual(*prev_input_shape, input->shape());
   *prev_input_shape = input->shape();
 
@@ -279,77 +384,127 @@ extern MaceStatus WinogradConv2dK3x3S1(OpContext *context,
   // 1. mat mul
   // t_filter(blk_sqr, out_chan, in_chan)*t_input(blk_sqr, in_chan, out_width)
   //     -> t_output (blk_sqr, out_chan, out_width)
-  std::vector<index_t> mm_output_shape =
-      {blk_sqr, out_channel, out_width};
-
-  std::vector<index_t> padded_mm_output_shape =
-      {mm_output_shape[0], mm_output_shape[1], mm_output_shape[2], 1};
-  std::vector<size_t> mm_output_image_shape;
-  OpenCLUtil::CalImage2DShape(padded_mm_output_shape,
-                              OpenCLBufferType::IN_OUT_HEIGHT,
-                              &mm_output_image_shape);
-
-  ScratchImage mm_output_image(scratch_manager);
-  std::unique_ptr<Tensor> mm_output = make_unique<Tensor>(
-      mm_output_image.Scratch(context->device()->allocator(),
-                              mm_output_image_shape, dt), dt);
-  MACE_RETURN_IF_ERROR(mm_output->ResizeImage(mm_output_shape,
-                                              mm_output_image_shape));
-
-  const index_t height_blocks = RoundUpDiv4(mm_output_shape[1]);
-  const index_t width_blocks = RoundUpDiv4(mm_output_shape[2]);
-  const uint32_t gws[2] = {
-      static_cast<uint32_t>(width_blocks),
-      static_cast<uint32_t>(height_blocks * blk_sqr),
-  };
-
-  MACE_OUT_OF_RANGE_DEFINITION;
-
-  if (kernels[1]->get() == nullptr) {
-    std::set<std::string> built_options;
-    MACE_OUT_OF_RANGE_CONFIG;
-    MACE_NON_UNIFORM_WG_CONFIG;
-    std::string kernel_name = MACE_OBFUSCATE_SYMBOL("matmul");
-    built_options.emplace("-Dmatmul=" + kernel_name);
-    built_options.emplace("-DDATA_TYPE=" + DtToUpCompatibleCLDt(dt));
-    built_options.emplace("-DCMD_DATA_TYPE=" + DtToUpCompatibleCLCMDDt(dt));
-    MACE_RETURN_IF_ERROR(runtime->BuildKernel("matmul", kernel_name,
-                                              built_options, kernels[1]));
-
-    *kwg_size[1] =
-        static_cast<uint32_t>(runtime->GetKernelMaxWorkGroupSize(*kernels[1]));
-  }
-  MACE_OUT_OF_RANGE_INIT(*kernels[1]);
-  uint32_t idx = 0;
-  MACE_OUT_OF_RANGE_SET_ARGS(*kernels[1]);
-  MACE_SET_2D_GWS_ARGS(*kernels[1], gws);
-  kernels[1]->setArg(idx++, *(filter->opencl_image()));
-  kernels[1]->setArg(idx++, *(transformed_input->opencl_image()));
-  kernels[1]->setArg(idx++, *(mm_output->opencl_image()));
-  kernels[1]->setArg(idx++, static_cast<int>(mm_output_shape[1]));
-  kernels[1]->setArg(idx++, static_cast<int>(mm_output_shape[2]));
-  kernels[1]->setArg(idx++, static_cast<int>(in_channel));
-  kernels[1]->setArg(idx++, static_cast<int>(height_blocks));
-  kernels[1]->setArg(idx++, static_cast<int>(RoundUpDiv4(in_channel)));
-
-  const std::vector<uint32_t> lws = {*kwg_size[1] / 64, 64, 0};
-  std::string tuning_key = Concat("matmul_opencl_kernel", mm_output_shape[0],
-      mm_output_shape[1], mm_output_shape[2]);
-  MACE_RETURN_IF_ERROR(TuningOrRun2DKernel(runtime, *kernels[1], tuning_key,
-                                           gws, lws, &mm_future));
-
-  MACE_OUT_OF_RANGE_VALIDATION;
-
   // 2. transform output
   // t_output (blk_sqr, out_chan, out_width) -> output(NHWC)
-  MACE_RETURN_IF_ERROR(WinogradOutputTransform(
-      context, kernels[2], mm_output.get(), bias,
-      dt, round_h, round_w, wino_blk_size, activation, relux_max_limit,
-      leakyrelu_coefficient, input_changed, output, kwg_size[2],
-      &t_output_future))
-
-  MergeMultipleFutureWaitFn({t_input_future, mm_future, t_output_future},
-                            context->future());
+  // the tuning picks the two kernels or, for F(2x2), the fused one of them
+  const bool fusible = wino_blk_size == 2;
+  std::vector<StatsFuture> futures;
+  MaceStatus run_status = MaceStatus::MACE_SUCCESS;
+  auto run_matmul_and_output_transform = [&]() -> MaceStatus {
+    std::vector<index_t> mm_output_shape =
+        {blk_sqr, out_channel, out_width};
+
+    std::vector<index_t> padded_mm_output_shape =
+        {mm_output_shape[0], mm_output_shape[1], mm_output_shape[2], 1};
+    std::vector<size_t> mm_output_image_shape;
+    OpenCLUtil::CalImage2DShape(padded_mm_output_shape,
+                                OpenCLBufferType::IN_OUT_HEIGHT,
+                                &mm_output_image_shape);
+
+    ScratchImage mm_output_image(scratch_manager);
+    std::unique_ptr<Tensor> mm_output = make_unique<Tensor>(
+        mm_output_image.Scratch(context->device()->allocator(),
+                                mm_output_image_shape, dt), dt);
+    MACE_RETURN_IF_ERROR(mm_output->ResizeImage(mm_output_shape,
+                                                mm_output_image_shape));
+
+    const index_t height_blocks = RoundUpDiv4(mm_output_shape[1]);
+    const index_t width_blocks = RoundUpDiv4(mm_output_shape[2]);
+    const uint32_t gws[2] = {
+        static_cast<uint32_t>(width_blocks),
+        static_cast<uint32_t>(height_blocks * blk_sqr),
+    };
+
+    MACE_OUT_OF_RANGE_DEFINITION;
+
+    if (kernels[1]->get() == nullptr) {
+      std::set<std::string> built_options;
+      MACE_OUT_OF_RANGE_CONFIG;
+      MACE_NON_UNIFORM_WG_CONFIG;
+      std::string kernel_name = MACE_OBFUSCATE_SYMBOL("matmul");
+      built_options.emplace("-Dmatmul=" + kernel_name);
+      built_options.emplace("-DDATA_TYPE=" + DtToUpCompatibleCLDt(dt));
+      built_options.emplace("-DCMD_DATA_TYPE=" + DtToUpCompatibleCLCMDDt(dt));
+      MACE_RETURN_IF_ERROR(runtime->BuildKernel("matmul", kernel_name,
+                                                built_options, kernels[1]));
+
+      *kwg_size[1] = static_cast<uint32_t>(
+          runtime->GetKernelMaxWorkGroupSize(*kernels[1]));
+    }
+    MACE_OUT_OF_RANGE_INIT(*kernels[1]);
+    uint32_t idx = 0;
+    MACE_OUT_OF_RANGE_SET_ARGS(*kernels[1]);
+    MACE_SET_2D_GWS_ARGS(*kernels[1], gws);
+    kernels[1]->setArg(idx++, *(filter->opencl_image()));
+    kernels[1]->setArg(idx++, *(transformed_input->opencl_image()));
+    kernels[1]->setArg(idx++, *(mm_output->opencl_image()));
+    kernels[1]->setArg(idx++, static_cast<int>(mm_output_shape[1]));
+    kernels[1]->setArg(idx++, static_cast<int>(mm_output_shape[2]));
+    kernels[1]->setArg(idx++, static_cast<int>(in_channel));
+    kernels[1]->setArg(idx++, static_cast<int>(height_blocks));
+    kernels[1]->setArg(idx++, static_cast<int>(RoundUpDiv4(in_channel)));
+
+    StatsFuture mm_future, t_output_future;
+    const std::vector<uint32_t> lws = {*kwg_size[1] / 64, 64, 0};
+    std::string tuning_key = Concat("matmul_opencl_kernel",
+        mm_output_shape[0], mm_output_shape[1], mm_output_shape[2]);
+    MACE_RETURN_IF_ERROR(TuningOrRun2DKernel(runtime, *kernels[1], tuning_key,
+                                             gws, lws, &mm_future));
+
+    MACE_OUT_OF_RANGE_VALIDATION;
+
+    // the fused kernel may have run since the arguments were set
+    MACE_RETURN_IF_ERROR(WinogradOutputTransform(
+        context, kernels[2], mm_output.get(), bias,
+        dt, round_h, round_w, wino_blk_size, activation, relux_max_limit,
+        leakyrelu_coefficient, input_changed || fusible, output, kwg_size[2],
+        &t_output_future))
+
+    futures.push_back(mm_future);
+    futures.push_back(t_output_future);
+    return MaceStatus::MACE_SUCCESS;
+  };
+  auto run_fused = [&]() -> MaceStatus {
+    StatsFuture mm_future;
+    MACE_RETURN_IF_ERROR(WinogradMatMulOutputTransform(
+        context, kernels[3], filter, transformed_input.get(), bias, dt,
+        round_h, round_w, activation, relux_max_limit, leakyrelu_coefficient,
+        output, kwg_size[3], &mm_future));
+    futures.push_back(mm_future);
+    return MaceStatus::MACE_SUCCESS;
+  };
+
+  auto params_generator = [&]() -> std::vector<std::vector<uint32_t>> {
+    if (fusible) {
+      return {{0}, {1}};
+    }
+    return {{0}};
+  };
+  auto func = [&](const std::vector<uint32_t> &params, Timer *timer,
+                  std::vector<uint32_t> *tuning_result) -> cl_int {
+    futures.clear();
+    const bool fused = fusible && !params.empty() && params[0] == 1;
+    run_status = fused ? run_fused() : run_matmul_and_output_transform();
+    if (timer != nullptr && run_status == MaceStatus::MACE_SUCCESS) {
+      timer->ClearTiming();
+      timer->AccumulateTiming();
+      if (tuning_result != nullptr) {
+        *tuning_result = {fused ? 1u : 0u};
+      }
+    }
+    return run_status == MaceStatus::MACE_SUCCESS ? CL_SUCCESS
+                                              : CL_INVALID_OPERATION;
+  };
+  FuturesTimer timer(&futures);
+  std::string tuning_key =
+      Concat("winograd_conv2d_fusion", wino_blk_size, output_shape[0],
+             output_shape[1], output_shape[2], in_channel, out_channel);
+  runtime->tuner()->template TuneOrRun<cl_int>(
+      tuning_key, {0}, params_generator, func, &timer);
+  MACE_RETURN_IF_ERROR(run_status);
+
+  futures.insert(futures.begin(), t_input_future);
+  MergeMultipleFutureWaitFn(futures, context->future());
   return MaceStatus::MACE_SUCCESS;
 }
 
@@ -21,6 +21,7 @@ namespace ops {
 extern void RegisterActivation(OpRegistryBase *op_registry);
 extern void RegisterAddN(OpRegistryBase *op_registry);
 extern void RegisterArgMax(OpRegistryBase *op_registry);
+extern void RegisterAttention(OpRegistryBase *op_registry);
 extern void RegisterBatchNorm(OpRegistryBase *op_registry);
 extern void RegisterBatchToSpaceND(OpRegistryBase *op_registry);
 extern void RegisterBiasAdd(OpRegistryBase *op_registry);
@@ -32,7 +33,10 @@ extern void RegisterCrop(OpRegistryBase *op_registry);
 extern void RegisterDeconv2D(OpRegistryBase *op_registry);
 extern void RegisterDepthToSpace(OpRegistryBase *op_registry);
 extern void RegisterDepthwiseConv2d(OpRegistryBase *op_registry);
+extern void RegisterDepthwisePointwiseConv2d(OpRegistryBase *op_registry);
 extern void RegisterDepthwiseDeconv2d(OpRegistryBase *op_registry);
+extern void RegisterDetectionOutput(OpRegistryBase *op_registry);
+extern void RegisterEarlyExit(OpRegistryBase *op_registry);
 extern void RegisterEltwise(OpRegistryBase *op_registry);
 extern void RegisterExpandDims(OpRegistryBase *op_registry);
 extern void RegisterFill(OpRegistryBase *op_registry);
@@ -40,8 +44,14 @@ extern void RegisterFullyConnected(OpRegistryBase *op_registry);
 extern void RegisterGather(OpRegistryBase *op_registry);
 extern void RegisterIdentity(OpRegistryBase *op_registry);
 extern void RegisterInferConv2dShape(OpRegistryBase *op_registry);
+extern void RegisterLayerNorm(OpRegistryBase *op_registry);
 extern void RegisterLocalResponseNorm(OpRegistryBase *op_registry);
+extern void RegisterLSTMCell(OpRegistryBase *op_registry);
 extern void RegisterMatMul(OpRegistryBase *op_registry);
+extern void RegisterMelFilterBank(OpRegistryBase *op_registry);
+extern void RegisterMFCC(OpRegistryBase *op_registry);
+extern void RegisterNCHWcTransform(OpRegistryBase *op_registry);
+extern void RegisterNNAPIDelegate(OpRegistryBase *op_registry);
 extern void RegisterPad(OpRegistryBase *op_registry);
 extern void RegisterPNorm(OpRegistryBase *op_registry);
 extern void RegisterPooling(OpRegistryBase *op_registry);
@@ -56,8 +66,10 @@ extern void RegisterScalarMath(OpRegistryBase *op_registry);
 extern void RegisterShape(OpRegistryBase *op_registry);
 extern void RegisterSlice(OpRegistryBase *op_registry);
 extern void RegisterSoftmax(OpRegistryBase *op_registry);
+extern void RegisterSoftmaxTopK(OpRegistryBase *op_registry);
 extern void RegisterSpaceToBatchND(OpRegistryBase *op_registry);
 extern void RegisterSpaceToDepth(OpRegistryBase *op_registry);
+extern void RegisterSpectrogram(OpRegistryBase *op_registry);
 extern void RegisterSplice(OpRegistryBase *op_registry);
 extern void RegisterSplit(OpRegistryBase *op_registry);
 extern void RegisterSqrDiffMean(OpRegistryBase *op_registry);
@@ -77,16 +89,30 @@ extern void RegisterQuantize(OpRegistryBase *op_registry);
 
 #ifdef MACE_ENABLE_OPENCL
 extern void RegisterBufferTransform(OpRegistryBase *op_registry);
-extern void RegisterLSTMCell(OpRegistryBase *op_registry);
+extern void RegisterFusedElementwise(OpRegistryBase *op_registry);
 #endif  // MACE_ENABLE_OPENCL
+
+#ifdef MACE_ENABLE_HEXAGON
+extern void RegisterHexagonGraph(OpRegistryBase *op_registry);
+#endif  // MACE_ENABLE_HEXAGON
+
+#ifdef MACE_ENABLE_SELECTIVE_BUILD
+// generated by the converter in mace/codegen/ops
+extern void RegisterSelectedOps(OpRegistryBase *op_registry);
+#endif  // MACE_ENABLE_SELECTIVE_BUILD
 }  // namespace ops
 
 
 OpRegistry::OpRegistry() : OpRegistryBase() {
+#ifdef MACE_ENABLE_SELECTIVE_BUILD
+  // only the ops of the converted models, the others are not linked in
+  ops::RegisterSelectedOps(this);
+#else
   // Keep in lexicographical order
   ops::RegisterActivation(this);
   ops::RegisterAddN(this);
   ops::RegisterArgMax(this);
+  ops::RegisterAttention(this);
   ops::RegisterBatchNorm(this);
   ops::RegisterBatchToSpaceND(this);
   ops::RegisterBiasAdd(this);
@@ -98,7 +124,10 @@ OpRegistry::OpRegistry() : OpRegistryBase() {
   ops::RegisterDeconv2D(this);
   ops::RegisterDepthToSpace(this);
   ops::RegisterDepthwiseConv2d(this);
+  ops::RegisterDepthwisePointwiseConv2d(this);
   ops::RegisterDepthwiseDeconv2d(this);
+  ops::RegisterDetectionOutput(this);
+  ops::RegisterEarlyExit(this);
   ops::RegisterEltwise(this);
   ops::RegisterExpandDims(this);
   ops::RegisterFill(this);
@@ -106,8 +135,14 @@ OpRegistry::OpRegistry() : OpRegistryBase() {
   ops::RegisterGather(this);
   ops::RegisterIdentity(this);
   ops::RegisterInferConv2dShape(this);
+  ops::RegisterLayerNorm(this);
   ops::RegisterLocalResponseNorm(this);
+  ops::RegisterLSTMCell(this);
   ops::RegisterMatMul(this);
+  ops::RegisterMelFilterBank(this);
+  ops::RegisterMFCC(this);
+  ops::RegisterNCHWcTransform(this);
+  ops::RegisterNNAPIDelegate(this);
   ops::RegisterPad(this);
   ops::RegisterPNorm(this);
   ops::RegisterPooling(this);
@@ -122,8 +157,10 @@ OpRegistry::OpRegistry() : OpRegistryBase() {
   ops::RegisterShape(this);
   ops::RegisterSlice(this);
   ops::RegisterSoftmax(this);
+  ops::RegisterSoftmaxTopK(this);
   ops::RegisterSpaceToBatchND(this);
   ops::RegisterSpaceToDepth(this);
+  ops::RegisterSpectrogram(this);
   ops::RegisterSplice(this);
   ops::RegisterSplit(this);
   ops::RegisterStack(this);
@@ -143,8 +180,13 @@ OpRegistry::OpRegistry() : OpRegistryBase() {
 
 #ifdef MACE_ENABLE_OPENCL
   ops::RegisterBufferTransform(this);
-  ops::RegisterLSTMCell(this);
+  ops::RegisterFusedElementwise(this);
 #endif  // MACE_ENABLE_OPENCL
+
+#ifdef MACE_ENABLE_HEXAGON
+  ops::RegisterHexagonGraph(this);
+#endif  // MACE_ENABLE_HEXAGON
+#endif  // MACE_ENABLE_SELECTIVE_BUILD
 }
 
 }  // namespace mace
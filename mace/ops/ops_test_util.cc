@@ -101,6 +101,17 @@ void OpDefBuilder::Finalize(OperatorDef *op_def) const {
   *op_def = op_def_;
 }
 
+void AddNetInput(const std::string &name,
+                 const std::vector<index_t> &shape,
+                 NetDef *net_def) {
+  InputInfo *input_info = net_def->add_input_info();
+  input_info->set_name(name);
+  input_info->set_data_format(NHWC);
+  for (auto dim : shape) {
+    input_info->add_dims(static_cast<int>(dim));
+  }
+}
+
 namespace {
 std::string GetStoragePathFromEnv() {
   char *storage_path_str = getenv("MACE_INTERNAL_STORAGE_PATH");
@@ -72,6 +72,11 @@ class OpDefBuilder {
   OperatorDef op_def_;
 };
 
+// Declares an NHWC input of the shape in the input infos of the net.
+void AddNetInput(const std::string &name,
+                 const std::vector<index_t> &shape,
+                 NetDef *net_def);
+
 class OpTestContext {
  public:
   static OpTestContext *Get(
@@ -396,6 +401,11 @@ class OpsTestNet {
 
   MaceStatus RunNet(const NetDef &net_def, const DeviceType device);
 
+  inline void ResetStates() {
+    MACE_CHECK_NOTNULL(net_);
+    net_->ResetStates();
+  }
+
   inline Tensor *GetOutput(const char *output_name) {
     return ws_.GetTensor(output_name);
   }
@@ -21,11 +21,16 @@
 #include <algorithm>
 #include <limits>
 #include <memory>
+#include <set>
 #include <vector>
 
+#include "mace/core/cpu_blocked_layout.h"
+#include "mace/core/cpu_nhwc_layout.h"
 #include "mace/core/future.h"
 #include "mace/core/operator.h"
 #include "mace/core/tensor.h"
+#include "mace/ops/arm/nchwc.h"
+#include "mace/ops/arm/nhwc.h"
 #include "mace/ops/conv_pool_2d_base.h"
 #include "mace/ops/common/conv_pool_2d_util.h"
 #ifdef MACE_ENABLE_OPENCL
@@ -37,6 +42,72 @@
 namespace mace {
 namespace ops {
 
+namespace {
+
+// out[i] = max(out[i], in[i])
+void MaxRow(const float *in, const index_t size, float *out) {
+  index_t i = 0;
+#if defined(MACE_ENABLE_NEON)
+  for (; i + 4 <= size; i += 4) {
+    vst1q_f32(out + i, vmaxq_f32(vld1q_f32(out + i), vld1q_f32(in + i)));
+  }
+#endif
+  for (; i < size; ++i) {
+    out[i] = std::max(out[i], in[i]);
+  }
+}
+
+// out[i] += in[i]
+void AddRow(const float *in, const index_t size, float *out) {
+  index_t i = 0;
+#if defined(MACE_ENABLE_NEON)
+  for (; i + 4 <= size; i += 4) {
+    vst1q_f32(out + i, vaddq_f32(vld1q_f32(out + i), vld1q_f32(in + i)));
+  }
+#endif
+  for (; i < size; ++i) {
+    out[i] += in[i];
+  }
+}
+
+float ReduceMax(const float *in, const index_t size) {
+  float res = std::numeric_limits<float>::lowest();
+  index_t i = 0;
+#if defined(MACE_ENABLE_NEON)
+  if (size >= 4) {
+    float32x4_t vmax = vld1q_f32(in);
+    for (i = 4; i + 4 <= size; i += 4) {
+      vmax = vmaxq_f32(vmax, vld1q_f32(in + i));
+    }
+    float32x2_t vmax2 = vmax_f32(vget_low_f32(vmax), vget_high_f32(vmax));
+    res = std::max(vget_lane_f32(vmax2, 0), vget_lane_f32(vmax2, 1));
+  }
+#endif
+  for (; i < size; ++i) {
+    res = std::max(res, in[i]);
+  }
+  return res;
+}
+
+float ReduceSum(const float *in, const index_t size) {
+  float res = 0;
+  index_t i = 0;
+#if defined(MACE_ENABLE_NEON)
+  float32x4_t vsum = vdupq_n_f32(0);
+  for (; i + 4 <= size; i += 4) {
+    vsum = vaddq_f32(vsum, vld1q_f32(in + i));
+  }
+  float32x2_t vsum2 = vadd_f32(vget_low_f32(vsum), vget_high_f32(vsum));
+  res = vget_lane_f32(vsum2, 0) + vget_lane_f32(vsum2, 1);
+#endif
+  for (; i < size; ++i) {
+    res += in[i];
+  }
+  return res;
+}
+
+}  // namespace
+
 class PoolingOpBase : public ConvPool2dOpBase {
  public:
   explicit PoolingOpBase(OpConstructContext *context)
@@ -46,12 +117,17 @@ class PoolingOpBase : public ConvPool2dOpBase {
             static_cast<PoolingType>(Operation::GetOptionalArg<int>(
                 "pooling_type", static_cast<int>(AVG)))),
         round_type_(static_cast<RoundType>(Operation::GetOptionalArg<int>(
-            "round_mode", static_cast<int>(CEIL)))) {}
+            "round_mode", static_cast<int>(CEIL)))),
+        count_include_pad_(
+            Operation::GetOptionalArg<int>(kCountIncludePadArg, 0) == 1) {}
 
  protected:
   std::vector<int> kernels_;
   PoolingType pooling_type_;
   RoundType round_type_;
+  // avg pooling divides by the pixels of the window inside the padded
+  // input, instead of inside the input
+  const bool count_include_pad_;
 
   MACE_OP_INPUT_TAGS(INPUT);
   MACE_OP_OUTPUT_TAGS(OUTPUT);
@@ -64,12 +140,20 @@ template <>
 class PoolingOp<DeviceType::CPU, float> : public PoolingOpBase {
  public:
   explicit PoolingOp(OpConstructContext *context)
-      : PoolingOpBase(context) {}
+      : PoolingOpBase(context),
+        channel_block_(Operation::GetOptionalArg<int>(kChannelBlockArg, 0)),
+        nhwc_(Operation::GetOptionalArg<int>(kNHWCArg, 0) == 1) {}
 
   MaceStatus Run(OpContext *context) override {
     MACE_UNUSED(context);
     const Tensor *input_tensor = this->Input(0);
     Tensor *output_tensor = this->Output(0);
+    if (channel_block_ > 0) {
+      return RunNCHWc(input_tensor, output_tensor);
+    }
+    if (nhwc_) {
+      return RunNHWC(input_tensor, output_tensor);
+    }
     std::vector<index_t> output_shape(4);
     std::vector<index_t> filter_shape = {
         input_tensor->dim(1), input_tensor->dim(1), kernels_[0], kernels_[1]};
@@ -97,8 +181,21 @@ class PoolingOp<DeviceType::CPU, float> : public PoolingOpBase {
     float *output = output_tensor->mutable_data<float>();
     const index_t *input_shape = input_tensor->shape().data();
     int pad_hw[2] = {paddings[0] / 2, paddings[1] / 2};
+    // the padding after the input, to which the windows of
+    // count_include_pad are clipped
+    int pad_end_hw[2] = {paddings[0] - pad_hw[0], paddings[1] - pad_hw[1]};
 
-    if (pooling_type_ == PoolingType::MAX) {
+    if (pooling_type_ != PoolingType::MAX &&
+        pooling_type_ != PoolingType::AVG) {
+      MACE_NOT_IMPLEMENTED;
+    } else if (output_shape[2] == 1 && output_shape[3] == 1 &&
+               pad_hw[0] == 0 && pad_hw[1] == 0 &&
+               kernels_[0] >= input_shape[2] && kernels_[1] >= input_shape[3]) {
+      GlobalPooling(input, input_shape, output);
+    } else if (dilations_[0] == 1 && dilations_[1] == 1) {
+      PoolingRows(input, input_shape, output_shape.data(), kernels_.data(),
+                  strides_.data(), pad_hw, pad_end_hw, output);
+    } else if (pooling_type_ == PoolingType::MAX) {
       MaxPooling(input,
                  input_shape,
                  output_shape.data(),
@@ -107,7 +204,7 @@ class PoolingOp<DeviceType::CPU, float> : public PoolingOpBase {
                  dilations_.data(),
                  pad_hw,
                  output);
-    } else if (pooling_type_ == PoolingType::AVG) {
+    } else {
       AvgPooling(input,
                  input_shape,
                  output_shape.data(),
@@ -115,15 +212,154 @@ class PoolingOp<DeviceType::CPU, float> : public PoolingOpBase {
                  strides_.data(),
                  dilations_.data(),
                  pad_hw,
+                 pad_end_hw,
                  output);
-    } else {
-      MACE_NOT_IMPLEMENTED;
     }
 
     return MaceStatus::MACE_SUCCESS;
   }
 
  private:
+  // the input and the output in NCHWc, [N, C / block, H, W, block]
+  MaceStatus RunNCHWc(const Tensor *input, Tensor *output) {
+    MACE_CHECK(input->dim_size() == 5 && input->dim(4) == channel_block_,
+               "NCHWc input should be 5D of block ", channel_block_);
+    MACE_CHECK(pooling_type_ == PoolingType::MAX ||
+               pooling_type_ == PoolingType::AVG);
+    const std::vector<index_t> input_shape = {
+        input->dim(0), input->dim(1) * channel_block_, input->dim(2),
+        input->dim(3)};
+    const std::vector<index_t> filter_shape = {
+        input_shape[1], input_shape[1], kernels_[0], kernels_[1]};
+    std::vector<index_t> output_shape(4);
+    std::vector<int> paddings(2);
+    CalcNCHWOutputShape(input_shape.data(), filter_shape.data(), round_type_,
+                        output_shape.data(), paddings.data());
+    MACE_RETURN_IF_ERROR(output->Resize(
+        {output_shape[0], output_shape[1] / channel_block_, output_shape[2],
+         output_shape[3], channel_block_}));
+
+    Tensor::MappingGuard input_guard(input);
+    Tensor::MappingGuard output_guard(output);
+    const int pad_hw[2] = {paddings[0] / 2, paddings[1] / 2};
+    PoolingNCHWc(input->data<float>(), input_shape.data(),
+                 output_shape.data(), kernels_.data(), strides_.data(),
+                 dilations_.data(), pad_hw, pooling_type_, channel_block_,
+                 output->mutable_data<float>());
+    return MaceStatus::MACE_SUCCESS;
+  }
+
+  // the input and the output in NHWC
+  MaceStatus RunNHWC(const Tensor *input, Tensor *output) {
+    MACE_CHECK(input->dim_size() == 4, "NHWC input should be 4D");
+    MACE_CHECK(pooling_type_ == PoolingType::MAX ||
+               pooling_type_ == PoolingType::AVG);
+    const std::vector<index_t> input_shape = {
+        input->dim(0), input->dim(3), input->dim(1), input->dim(2)};
+    const std::vector<index_t> filter_shape = {
+        input_shape[1], input_shape[1], kernels_[0], kernels_[1]};
+    std::vector<index_t> output_shape(4);
+    std::vector<int> paddings(2);
+    CalcNCHWOutputShape(input_shape.data(), filter_shape.data(), round_type_,
+                        output_shape.data(), paddings.data());
+    output_shape = {output_shape[0], output_shape[2], output_shape[3],
+                    output_shape[1]};
+    MACE_RETURN_IF_ERROR(output->Resize(output_shape));
+
+    Tensor::MappingGuard input_guard(input);
+    Tensor::MappingGuard output_guard(output);
+    const int pad_hw[2] = {paddings[0] / 2, paddings[1] / 2};
+    PoolingNHWC(input->data<float>(), input->shape().data(),
+                output_shape.data(), kernels_.data(), strides_.data(),
+                dilations_.data(), pad_hw, pooling_type_,
+                output->mutable_data<float>());
+    return MaceStatus::MACE_SUCCESS;
+  }
+
+  // a window of the whole image of each channel, reduced in vectors
+  void GlobalPooling(const float *input,
+                     const index_t *in_shape,
+                     float *output) {
+    const index_t image_size = in_shape[2] * in_shape[3];
+    const bool is_max = pooling_type_ == PoolingType::MAX;
+
+#pragma omp parallel for schedule(runtime)
+    for (index_t i = 0; i < in_shape[0] * in_shape[1]; ++i) {
+      const float *in_ptr = input + i * image_size;
+      output[i] = is_max ? ReduceMax(in_ptr, image_size)
+                         : ReduceSum(in_ptr, image_size) / image_size;
+    }
+  }
+
+  // Pooling of no dilation, of any kernel, stride and padding. The rows of
+  // the window of each output row are reduced into one row in vectors, whose
+  // windows are then reduced for the output pixels.
+  void PoolingRows(const float *input,
+                   const index_t *in_shape,
+                   const index_t *out_shape,
+                   const int *filter_hw,
+                   const int *stride_hw,
+                   const int *pad_hw,
+                   const int *pad_end_hw,
+                   float *output) {
+    const index_t in_height = in_shape[2];
+    const index_t in_width = in_shape[3];
+    const index_t out_height = out_shape[2];
+    const index_t out_width = out_shape[3];
+    const index_t in_image_size = in_height * in_width;
+    const index_t out_image_size = out_height * out_width;
+    const bool is_max = pooling_type_ == PoolingType::MAX;
+    const float empty_value = is_max ? std::numeric_limits<float>::lowest()
+                                     : 0;
+
+#pragma omp parallel for collapse(2) schedule(runtime)
+    for (index_t b = 0; b < out_shape[0]; ++b) {
+      for (index_t c = 0; c < out_shape[1]; ++c) {
+        const float *in_ptr = input + (b * in_shape[1] + c) * in_image_size;
+        float *out_ptr = output + (b * out_shape[1] + c) * out_image_size;
+        std::vector<float> row(in_width);
+        for (index_t h = 0; h < out_height; ++h) {
+          const index_t h_begin = h * stride_hw[0] - pad_hw[0];
+          const index_t h_end = std::min(h_begin + filter_hw[0], in_height);
+          const index_t ih_begin = std::max<index_t>(h_begin, 0);
+          float *out_row = out_ptr + h * out_width;
+          if (ih_begin >= h_end) {
+            std::fill(out_row, out_row + out_width, empty_value);
+            continue;
+          }
+          std::copy(in_ptr + ih_begin * in_width,
+                    in_ptr + (ih_begin + 1) * in_width, row.begin());
+          for (index_t ih = ih_begin + 1; ih < h_end; ++ih) {
+            if (is_max) {
+              MaxRow(in_ptr + ih * in_width, in_width, row.data());
+            } else {
+              AddRow(in_ptr + ih * in_width, in_width, row.data());
+            }
+          }
+          const index_t padded_height = count_include_pad_ ?
+              std::min(h_begin + filter_hw[0], in_height + pad_end_hw[0])
+                  - h_begin : h_end - ih_begin;
+          for (index_t w = 0; w < out_width; ++w) {
+            const index_t w_begin = w * stride_hw[1] - pad_hw[1];
+            const index_t w_end = std::min(w_begin + filter_hw[1], in_width);
+            const index_t iw_begin = std::max<index_t>(w_begin, 0);
+            if (iw_begin >= w_end) {
+              out_row[w] = empty_value;
+            } else if (is_max) {
+              out_row[w] = ReduceMax(row.data() + iw_begin, w_end - iw_begin);
+            } else {
+              const index_t padded_width = count_include_pad_ ?
+                  std::min(w_begin + filter_hw[1], in_width + pad_end_hw[1])
+                      - w_begin : w_end - iw_begin;
+              out_row[w] = ReduceSum(row.data() + iw_begin, w_end - iw_begin)
+                  / (padded_height * padded_width);
+            }
+          }
+        }
+      }
+    }
+  }
+
   void MaxPooling(const float *input,
                   const index_t *in_shape,
                   const index_t *out_shape,
@@ -177,6 +413,7 @@ class PoolingOp<DeviceType::CPU, float> : public PoolingOpBase {
                   const int *stride_hw,
                   const int *dilation_hw,
                   const int *pad_hw,
+                  const int *pad_end_hw,
                   float *output) {
     const index_t in_image_size = in_shape[2] * in_shape[3];
     const index_t out_image_size = out_shape[2] * out_shape[3];
@@ -207,6 +444,10 @@ class PoolingOp<DeviceType::CPU, float> : public PoolingOpBase {
                   index_t input_offset = in_base + inh * in_width + inw;
                   res += input[input_offset];
                   ++block_size;
+                } else if (count_include_pad_ &&
+                           inh < in_height + pad_end_hw[0] &&
+                           inw < in_width + pad_end_hw[1]) {
+                  ++block_size;
                 }
               }
             }
@@ -216,6 +457,11 @@ class PoolingOp<DeviceType::CPU, float> : public PoolingOpBase {
       }
     }
   }
+
+  // channels of a block of the NCHWc layout, 0 for NCHW
+  const int channel_block_;
+  // whether the input and the output are NHWC
+  const bool nhwc_;
 };
 
 #ifdef MACE_ENABLE_QUANTIZE
@@ -231,6 +477,8 @@ class PoolingOp<DeviceType::CPU, uint8_t> : public PoolingOpBase {
     Tensor *output_tensor = this->Output(0);
     MACE_CHECK(dilations_[0] == 1 && dilations_[1] == 1,
                "Quantized pooling does not support dilation > 1 yet.");
+    MACE_CHECK(!count_include_pad_ || pooling_type_ == PoolingType::MAX,
+               "Quantized pooling does not support count_include_pad yet.");
     // Use the same scale and zero point with input and output.
     output_tensor->SetScale(input_tensor->scale());
     output_tensor->SetZeroPoint(input_tensor->zero_point());
@@ -433,7 +681,9 @@ class PoolingOp<DeviceType::GPU, T> : public PoolingOpBase {
  public:
   explicit PoolingOp(OpConstructContext *context)
       : PoolingOpBase(context) {
-    if (context->device()->gpu_runtime()->UseImageMemory()) {
+    // the quantized kernel is buffer only
+    if (DataTypeToEnum<T>::value != DT_UINT8 &&
+        context->device()->gpu_runtime()->UseImageMemory()) {
       kernel_ = make_unique<opencl::image::PoolingKernel<T>>();
     } else {
       context->set_output_mem_type(MemoryType::GPU_BUFFER);
@@ -470,7 +720,29 @@ void RegisterPooling(OpRegistryBase *op_registry) {
 
   MACE_REGISTER_OP(op_registry, "Pooling", PoolingOp,
                    DeviceType::GPU, half);
+
+#ifdef MACE_ENABLE_QUANTIZE
+  MACE_REGISTER_OP(op_registry, "Pooling", PoolingOp,
+                   DeviceType::GPU, uint8_t);
+#endif  // MACE_ENABLE_QUANTIZE
 #endif  // MACE_ENABLE_OPENCL
+
+  MACE_REGISTER_OP_CONDITION(
+      op_registry,
+      OpConditionBuilder("Pooling")
+          .SetDevicePlacerFunc(
+              [](OpConstructContext *context) -> std::set<DeviceType> {
+                auto op = context->operator_def();
+                // only the CPU kernels divide by the padded windows
+                if (ProtoArgHelper::GetOptionalArg<OperatorDef, int>(
+                        *op, kCountIncludePadArg, 0) == 1 &&
+                    ProtoArgHelper::GetOptionalArg<OperatorDef, int>(
+                        *op, "pooling_type", static_cast<int>(AVG)) ==
+                        static_cast<int>(AVG)) {
+                  return {DeviceType::CPU};
+                }
+                return {DeviceType::CPU, DeviceType::GPU};
+              }));
 }
 
 }  // namespace ops
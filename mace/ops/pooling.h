@@ -21,6 +21,10 @@ enum PoolingType {
   AVG = 1,  // avg_pool
   MAX = 2,  // max_pool
 };
+
+// Arg of avg pooling, 1 to divide by the pixels of the window inside the
+// padded input, as ONNX count_include_pad, instead of inside the input
+constexpr const char *kCountIncludePadArg = "count_include_pad";
 }  // namespace mace
 
 #endif  // MACE_OPS_POOLING_H_
@@ -81,6 +81,7 @@ void Pooling(int iters,
         ##TYPE##_##DEVICE(                                                     \
           int iters) {                                                         \
     const int64_t tot = static_cast<int64_t>(iters) * N * C * H * W;           \
+    mace::testing::MacsProcessed(tot * KE * KE / (STRIDE * STRIDE));           \
     mace::testing::BytesProcessed(tot *(sizeof(TYPE)));                        \
     Pooling<DEVICE, TYPE>(iters, N, C, H, W, KE, STRIDE, Padding::PA,          \
                     PoolingType::PO);                                          \
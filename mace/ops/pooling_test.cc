@@ -12,6 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <numeric>
 #include <vector>
 
 #include "mace/ops/pooling.h"
@@ -330,6 +331,80 @@ TEST_F(PoolingOpTest, AVG_VALID) {
   ExpectTensorNear<float>(*expected, *net.GetOutput("Output"), 1e-5);
 }
 
+TEST_F(PoolingOpTest, AVG_SAME_COUNT_INCLUDE_PAD) {
+  // Construct graph
+  OpsTestNet net;
+
+  // Add input data
+  net.AddInputFromArray<DeviceType::CPU, float>("Input", {1, 3, 3, 1},
+                                                {0, 1, 2, 3, 4, 5, 6, 7, 8});
+
+  net.TransformDataFormat<DeviceType::CPU, float>("Input", NHWC, "InputNCHW",
+                                                  NCHW);
+
+  OpDefBuilder("Pooling", "PoolingTest")
+      .Input("InputNCHW")
+      .Output("OutputNCHW")
+      .AddIntsArg("kernels", {2, 2})
+      .AddIntsArg("strides", {2, 2})
+      .AddIntArg("padding", Padding::SAME)
+      .AddIntsArg("dilations", {1, 1})
+      .AddIntArg("pooling_type", PoolingType::AVG)
+      .AddIntArg(kCountIncludePadArg, 1)
+      .Finalize(net.NewOperatorDef());
+
+  // Run
+  net.RunOp();
+
+  net.TransformDataFormat<DeviceType::CPU, float>("OutputNCHW", NCHW, "Output",
+                                                  NHWC);
+
+  // Check, the windows of the padding after the input are of 4 pixels
+  auto expected =
+      net.CreateTensor<float>({1, 2, 2, 1}, {2, 1.75, 3.25, 2});
+
+  ExpectTensorNear<float>(*expected, *net.GetOutput("Output"), 1e-5);
+}
+
+TEST_F(PoolingOpTest, GLOBAL) {
+  for (PoolingType type : {PoolingType::MAX, PoolingType::AVG}) {
+    // Construct graph
+    OpsTestNet net;
+
+    // Add input data
+    std::vector<float> input(24);
+    std::iota(input.begin(), input.end(), 0);
+    net.AddInputFromArray<DeviceType::CPU, float>("Input", {1, 3, 4, 2},
+                                                  input);
+
+    net.TransformDataFormat<DeviceType::CPU, float>(
+        "Input", NHWC, "InputNCHW", NCHW);
+
+    OpDefBuilder("Pooling", "PoolingTest")
+        .Input("InputNCHW")
+        .Output("OutputNCHW")
+        .AddIntsArg("kernels", {3, 4})
+        .AddIntsArg("strides", {1, 1})
+        .AddIntArg("padding", Padding::VALID)
+        .AddIntsArg("dilations", {1, 1})
+        .AddIntArg("pooling_type", type)
+        .Finalize(net.NewOperatorDef());
+
+    // Run
+    net.RunOp();
+
+    net.TransformDataFormat<DeviceType::CPU, float>(
+        "OutputNCHW", NCHW, "Output", NHWC);
+
+    // Check
+    auto expected = type == PoolingType::MAX ?
+        net.CreateTensor<float>({1, 1, 1, 2}, {22, 23}) :
+        net.CreateTensor<float>({1, 1, 1, 2}, {11, 12});
+
+    ExpectTensorNear<float>(*expected, *net.GetOutput("Output"), 1e-5);
+  }
+}
+
 namespace {
 template <DeviceType D>
 void SimpleAvgPoolingTest() {
@@ -631,6 +706,61 @@ TEST_F(PoolingOpTest, Quant) {
   TestQuant(3, 31, 37, 128, {2, 2}, {2, 2}, Padding::VALID, PoolingType::AVG);
   TestQuant(3, 31, 37, 128, {2, 2}, {2, 2}, Padding::VALID, PoolingType::MAX);
 }
+namespace {
+
+void TestQuantOnGPU(const std::vector<index_t> &input_shape,
+                    const std::vector<int> &kernels,
+                    const std::vector<int> &strides,
+                    enum Padding padding_type,
+                    PoolingType pooling) {
+  OpsTestNet net;
+  net.AddRandomInput<CPU, float>("Input", input_shape, false, false);
+
+  OpDefBuilder("Quantize", "QuantizeInput")
+      .Input("Input")
+      .Output("QuantizedInput")
+      .OutputType({DT_UINT8})
+      .AddIntArg("T", DT_UINT8)
+      .AddIntArg("non_zero", true)
+      .Finalize(net.NewOperatorDef());
+  net.RunOp();
+
+  auto pooling_def = [&](const std::string &output) {
+    OpDefBuilder("Pooling", "PoolingTest")
+        .Input("QuantizedInput")
+        .Output(output)
+        .OutputType({DT_UINT8})
+        .AddIntsArg("kernels", kernels)
+        .AddIntsArg("strides", strides)
+        .AddIntArg("padding", padding_type)
+        .AddIntsArg("dilations", {1, 1})
+        .AddIntArg("pooling_type", pooling)
+        .AddIntArg("T", DT_UINT8)
+        .Finalize(net.NewOperatorDef());
+  };
+  pooling_def("ExpectedOutput");
+  net.RunOp();
+
+  OpTestContext::Get()->SetOCLBufferTestFlag();
+  pooling_def("QuantizedOutput");
+  net.RunOp(DeviceType::GPU);
+
+  ExpectTensorNear<uint8_t>(*net.GetOutput("ExpectedOutput"),
+                            *net.GetOutput("QuantizedOutput"));
+}
+}  // namespace
+
+TEST_F(PoolingOpTest, OPENCLQuant) {
+  TestQuantOnGPU({1, 7, 7, 32}, {7, 7}, {1, 1}, Padding::VALID,
+                 PoolingType::AVG);
+  TestQuantOnGPU({1, 15, 15, 30}, {3, 3}, {2, 2}, Padding::SAME,
+                 PoolingType::AVG);
+  TestQuantOnGPU({1, 15, 15, 30}, {3, 3}, {2, 2}, Padding::SAME,
+                 PoolingType::MAX);
+  TestQuantOnGPU({3, 31, 37, 13}, {2, 2}, {2, 2}, Padding::VALID,
+                 PoolingType::MAX);
+}
+
 }  // namespace test
 }  // namespace ops
 }  // namespace mace
@@ -71,7 +71,33 @@ class PriorBoxOp : public Operation {
     std::vector<index_t> output_shape = {1, 2, dim};
     MACE_RETURN_IF_ERROR(output->Resize(output_shape));
     Tensor::MappingGuard output_guard(output);
-    T *output_data = output->mutable_data<T>();
+    // the priors only depend on the shapes, they are computed once and
+    // copied to the output, whose buffer may be reused by other ops
+    const std::vector<index_t> cached_shape =
+        {input_h, input_w, image_h, image_w};
+    if (cached_shape != cached_shape_) {
+      priors_.resize(2 * dim);
+      ComputePriors(input_h, input_w, image_h, image_w, step_h, step_w,
+                    num_prior, priors_.data());
+      cached_shape_ = cached_shape;
+    }
+    std::copy(priors_.begin(), priors_.end(), output->mutable_data<T>());
+    return MaceStatus::MACE_SUCCESS;
+  }
+
+ private:
+  void ComputePriors(const index_t input_h,
+                     const index_t input_w,
+                     const index_t image_h,
+                     const index_t image_w,
+                     const float step_h,
+                     const float step_w,
+                     const index_t num_prior,
+                     T *output_data) {
+    const index_t num_min_size = min_size_.size();
+    const index_t num_max_size = max_size_.size();
+    const index_t num_aspect_ratio = aspect_ratio_.size();
+    const index_t dim = 4 * input_w * input_h * num_prior;
     float box_w, box_h;
     for (index_t i = 0; i < input_h; ++i) {
       index_t idx = i * input_w * num_prior * 4;
@@ -130,7 +156,6 @@ class PriorBoxOp : public Operation {
       output_data[2 + index] = variance_[2];
       output_data[3 + index] = variance_[3];
     }
-    return MaceStatus::MACE_SUCCESS;
   }
 
  private:
@@ -140,6 +165,8 @@ class PriorBoxOp : public Operation {
   bool clip_;
   std::vector<float> variance_;
   const float offset_;
+  std::vector<index_t> cached_shape_;
+  std::vector<T> priors_;
 
  private:
   MACE_OP_INPUT_TAGS(INPUT, DATA);
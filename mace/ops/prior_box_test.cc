@@ -58,6 +58,38 @@ TEST_F(PriorBoxOpTest, Simple) {
        0.1, 0.1, 0.2, 0.2, 0.1, 0.1, 0.2, 0.2, 0.1, 0.1, 0.2, 0.2});
   ExpectTensorNear<float>(*expected_tensor, *net.GetTensor("OUTPUT"));
 }
+
+TEST_F(PriorBoxOpTest, Cached) {
+  OpsTestNet net;
+  net.AddRandomInput<DeviceType::CPU, float>("INPUT", {1, 16, 3, 5});
+  net.AddRandomInput<DeviceType::CPU, float>("DATA", {1, 3, 30, 50});
+  OpDefBuilder("PriorBox", "PriorBoxTest")
+      .Input("INPUT")
+      .Input("DATA")
+      .Output("OUTPUT")
+      .AddFloatsArg("min_size", {10})
+      .AddFloatsArg("max_size", {20})
+      .AddFloatsArg("aspect_ratio", {1, 2, 0.5})
+      .AddIntArg("clip", 1)
+      .AddFloatsArg("variance", {0.1, 0.1, 0.2, 0.2})
+      .Finalize(net.NewOperatorDef());
+  net.Setup(DeviceType::CPU);
+  net.Run();
+  auto expected = net.CreateTensor<float>();
+  expected->Copy(*net.GetOutput("OUTPUT"));
+
+  // the cached priors are written again over whatever the buffer holds
+  net.GetOutput("OUTPUT")->Clear();
+  net.Run();
+  ExpectTensorNear<float>(*expected, *net.GetOutput("OUTPUT"));
+
+  // and are computed again for a new shape
+  net.AddRandomInput<DeviceType::CPU, float>("INPUT", {1, 16, 1, 1});
+  net.AddRandomInput<DeviceType::CPU, float>("DATA", {1, 3, 10, 10});
+  net.Run();
+  EXPECT_EQ(1 * 4 * 4, net.GetOutput("OUTPUT")->dim(2));
+}
+
 }  // namespace test
 }  // namespace ops
 }  // namespace mace
@@ -19,7 +19,7 @@ namespace ops {
 
 const int32_t *GetBiasData(const Tensor *bias,
                            const float input_scale,
-                           const float filter_scale,
+                           const Tensor *filter,
                            const index_t channels,
                            std::vector<int32_t> *bias_vec) {
   const int32_t *bias_data = nullptr;
@@ -28,14 +28,18 @@ const int32_t *GetBiasData(const Tensor *bias,
     bias_data = bias_vec->data();
   } else {
     auto original_bias_data = bias->data<int32_t>();
-    bool adjust_bias_required =
-        fabs(input_scale * filter_scale - bias->scale()) > 1e-6;
+    // filter and bias may be quantized per channel
+    bool adjust_bias_required = false;
+    for (index_t i = 0; i < channels && !adjust_bias_required; ++i) {
+      adjust_bias_required =
+          fabs(input_scale * filter->scale(i) - bias->scale(i)) > 1e-6;
+    }
     if (!adjust_bias_required) {
       bias_data = original_bias_data;
     } else {
       bias_vec->resize(channels);
-      float adjust_scale = bias->scale() / (input_scale * filter_scale);
       for (index_t i = 0; i < channels; ++i) {
+        float adjust_scale = bias->scale(i) / (input_scale * filter->scale(i));
         (*bias_vec)[i] = static_cast<int32_t>(
             roundf(original_bias_data[i] * adjust_scale));
       }
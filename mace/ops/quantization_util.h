@@ -22,9 +22,11 @@
 namespace mace {
 namespace ops {
 
+// bias of the scale of input * filter, of each channel if the filter is
+// quantized per channel, rescaled into bias_vec if needed
 const int32_t *GetBiasData(const Tensor *bias,
                            const float input_scale,
-                           const float filter_scale,
+                           const Tensor *filter,
                            const index_t channels,
                            std::vector<int32_t> *bias_vec);
 }  // namespace ops
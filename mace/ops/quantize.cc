@@ -13,12 +13,14 @@
 // limitations under the License.
 
 #include <cmath>
+#include <cstring>
 #include <vector>
 #include <algorithm>
 #include <limits>
 
 #include "mace/core/operator.h"
 #include "mace/core/tensor.h"
+#include "mace/ops/common/quantize.h"
 #include "mace/utils/quantize.h"
 
 namespace mace {
@@ -45,37 +47,96 @@ class QuantizeOp<DeviceType::CPU, uint8_t> : public Operation {
     MACE_RETURN_IF_ERROR(output->ResizeLike(input));
     Tensor::MappingGuard input_guard(input);
     Tensor::MappingGuard output_guard(output);
-    const float *input_data = input->data<float>();
     uint8_t *output_data = output->mutable_data<uint8_t>();
+    if (input->dtype() == DT_UINT8) {
+      // an input fed quantized, see MaceTensor
+      std::memcpy(output_data, input->data<uint8_t>(), input->size());
+      output->SetScale(input->scale());
+      output->SetZeroPoint(input->zero_point());
+      return MaceStatus::MACE_SUCCESS;
+    }
+    const float *input_data = input->data<float>();
+    if (!find_range_every_time_ && output->scale() > 0.f) {
+      QuantizeUint8(input_data,
+                    input->size(),
+                    output->scale(),
+                    output->zero_point(),
+                    output_data);
+    } else {
+      float scale;
+      int32_t zero_point;
+      QuantizeUint8(input_data,
+                    input->size(),
+                    non_zero_,
+                    output_data,
+                    &scale,
+                    &zero_point);
+      output->SetScale(scale);
+      output->SetZeroPoint(zero_point);
+    }
+    return MaceStatus::MACE_SUCCESS;
+  }
+
+ private:
+  bool non_zero_;
+  bool find_range_every_time_;
+};
+
+// int16 activations of the 8x16 kernels, quantized symmetrically
+template <>
+class QuantizeOp<DeviceType::CPU, int16_t> : public Operation {
+ public:
+  explicit QuantizeOp(OpConstructContext *context)
+      : Operation(context),
+        find_range_every_time_(static_cast<bool>(Operation::GetOptionalArg<int>(
+            "find_range_every_time",
+            0))) {}
+
+  MaceStatus Run(OpContext *context) override {
+    MACE_UNUSED(context);
+    const Tensor *input = this->Input(0);
+    Tensor *output = this->Output(0);
+    MACE_RETURN_IF_ERROR(output->ResizeLike(input));
+    Tensor::MappingGuard input_guard(input);
+    Tensor::MappingGuard output_guard(output);
+    const float *input_data = input->data<float>();
+    int16_t *output_data = output->mutable_data<int16_t>();
     if (!find_range_every_time_ && output->scale() > 0.f) {
       QuantizeWithScaleAndZeropoint(input_data,
                                     input->size(),
                                     output->scale(),
-                                    output->zero_point(),
+                                    0,
                                     output_data);
     } else {
       float scale;
-      int32_t zero_point;
-      Quantize(input_data,
-               input->size(),
-               non_zero_,
-               output_data,
-               &scale,
-               &zero_point);
+      QuantizeSymmetric(input_data, input->size(), output_data, &scale);
       output->SetScale(scale);
-      output->SetZeroPoint(zero_point);
     }
+    output->SetZeroPoint(0);
     return MaceStatus::MACE_SUCCESS;
   }
 
  private:
-  bool non_zero_;
   bool find_range_every_time_;
 };
 
 template <DeviceType D, class T>
 class DequantizeOp;
 
+namespace {
+template <typename T>
+void DequantizeData(const T *input, const index_t size, const float scale,
+                    const int32_t zero_point, float *output) {
+  Dequantize<T>(input, size, scale, zero_point, output);
+}
+
+void DequantizeData(const uint8_t *input, const index_t size,
+                    const float scale, const int32_t zero_point,
+                    float *output) {
+  DequantizeUint8(input, size, scale, zero_point, output);
+}
+}  // namespace
+
 template <typename T>
 class DequantizeOp<DeviceType::CPU, T> : public Operation {
  public:
@@ -91,11 +152,11 @@ class DequantizeOp<DeviceType::CPU, T> : public Operation {
     Tensor::MappingGuard output_guard(output);
     const T *input_data = input->data<T>();
     float *output_data = output->mutable_data<float>();
-    Dequantize<T>(input_data,
-               input->size(),
-               input->scale(),
-               input->zero_point(),
-               output_data);
+    DequantizeData(input_data,
+                   input->size(),
+                   input->scale(),
+                   input->zero_point(),
+                   output_data);
     return MaceStatus::MACE_SUCCESS;
   }
 };
@@ -103,6 +164,8 @@ class DequantizeOp<DeviceType::CPU, T> : public Operation {
 void RegisterQuantize(OpRegistryBase *op_registry) {
   MACE_REGISTER_OP(op_registry, "Quantize", QuantizeOp,
                    DeviceType::CPU, uint8_t);
+  MACE_REGISTER_OP(op_registry, "Quantize", QuantizeOp,
+                   DeviceType::CPU, int16_t);
 }
 
 void RegisterDequantize(OpRegistryBase *op_registry) {
@@ -110,6 +173,8 @@ void RegisterDequantize(OpRegistryBase *op_registry) {
                    DeviceType::CPU, uint8_t);
   MACE_REGISTER_OP(op_registry, "Dequantize", DequantizeOp,
                    DeviceType::CPU, int32_t);
+  MACE_REGISTER_OP(op_registry, "Dequantize", DequantizeOp,
+                   DeviceType::CPU, int16_t);
 }
 }  // namespace ops
 }  // namespace mace
@@ -13,6 +13,7 @@
 // limitations under the License.
 
 #include "mace/ops/ops_test_util.h"
+#include "mace/utils/quantize.h"
 
 namespace mace {
 namespace ops {
@@ -75,6 +76,57 @@ TEST_F(QuantizeTest, TestQuantize) {
   TestQuantizeDequantize({-2, -4, -6, -8}, true);
 }
 
+TEST_F(QuantizeTest, TestQuantizeBlocks) {
+  // values over several blocks and a remainder, against the scalar quantize
+  OpsTestNet net;
+  const index_t size = 40001;
+  net.AddRandomInput<CPU, float>("Input", {size}, false, false);
+  OpDefBuilder("Quantize", "QuantizeTest")
+      .Input("Input")
+      .Output("QuantizeOutput")
+      .OutputType({DT_UINT8})
+      .AddIntArg("T", DT_UINT8)
+      .Finalize(net.NewOperatorDef());
+  net.RunOp();
+
+  const Tensor *input = net.GetTensor("Input");
+  const Tensor *quantized = net.GetTensor("QuantizeOutput");
+  std::vector<uint8_t> expected(size);
+  float scale;
+  int32_t zero_point;
+  Quantize(input->data<float>(), size, false, expected.data(), &scale,
+           &zero_point);
+  EXPECT_EQ(scale, quantized->scale());
+  EXPECT_EQ(zero_point, quantized->zero_point());
+  const uint8_t *quantized_data = quantized->data<uint8_t>();
+  for (index_t i = 0; i < size; ++i) {
+    ASSERT_EQ(expected[i], quantized_data[i]) << "at " << i;
+  }
+}
+
+TEST_F(QuantizeTest, TestQuantizedInput) {
+  // an input fed quantized by the caller is passed through
+  OpsTestNet net;
+  net.AddInputFromArray<CPU, uint8_t>("Input", {5}, {0, 64, 128, 192, 255});
+  Tensor *input = net.GetTensor("Input");
+  input->SetScale(0.5f);
+  input->SetZeroPoint(128);
+  OpDefBuilder("Quantize", "QuantizeTest")
+      .Input("Input")
+      .Output("Output")
+      .OutputType({DT_UINT8})
+      .AddIntArg("T", DT_UINT8)
+      .AddIntArg("find_range_every_time", 1)
+      .Finalize(net.NewOperatorDef());
+
+  net.RunOp();
+
+  Tensor *output = net.GetTensor("Output");
+  EXPECT_EQ(0.5f, output->scale());
+  EXPECT_EQ(128, output->zero_point());
+  ExpectTensorNear<uint8_t>(*input, *output);
+}
+
 }  // namespace test
 }  // namespace ops
 }  // namespace mace
@@ -0,0 +1,141 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <vector>
+
+#include "mace/core/range_calibrator.h"
+#include "mace/ops/ops_test_util.h"
+
+namespace mace {
+namespace ops {
+namespace test {
+
+class RangeCalibratorTest : public OpsTestBase {};
+
+namespace {
+
+void RecordValues(const std::string &name,
+                  const std::vector<float> &values,
+                  RangeCalibrator *calibrator) {
+  Tensor tensor(GetCPUAllocator(), DT_FLOAT);
+  tensor.Resize({static_cast<index_t>(values.size())});
+  if (!values.empty()) {
+    tensor.Copy(values.data(), values.size());
+  }
+  calibrator->Record(name, &tensor);
+}
+
+utils::ThreadPool *CPUThreadPool() {
+  return OpTestContext::Get()->GetDevice(DeviceType::CPU)->cpu_runtime()
+      ->thread_pool();
+}
+
+}  // namespace
+
+TEST_F(RangeCalibratorTest, MinMax) {
+  RangeCalibrator calibrator(CPUThreadPool());
+  RecordValues("a", {0.5f, -1.f, 2.f}, &calibrator);
+  RecordValues("a", {3.f, -0.25f}, &calibrator);
+  // the blocks of a large tensor are reduced by the threads
+  std::vector<float> large(3 * 16384 + 5, 1.f);
+  large[20000] = 7.f;
+  large.back() = -4.f;
+  RecordValues("b", large, &calibrator);
+
+  float min_val = 0;
+  float max_val = 0;
+  ASSERT_TRUE(calibrator.GetRange("a", CALIBRATION_MIN_MAX, 0,
+                                  &min_val, &max_val));
+  EXPECT_EQ(-1.f, min_val);
+  EXPECT_EQ(3.f, max_val);
+  ASSERT_TRUE(calibrator.GetRange("b", CALIBRATION_MIN_MAX, 0,
+                                  &min_val, &max_val));
+  EXPECT_EQ(-4.f, min_val);
+  EXPECT_EQ(7.f, max_val);
+}
+
+TEST_F(RangeCalibratorTest, Percentile) {
+  std::vector<float> values;
+  for (int i = 0; i < 1000; ++i) {
+    values.push_back(static_cast<float>(i));
+  }
+  RangeCalibrator calibrator(nullptr);
+  RecordValues("a", values, &calibrator);
+  calibrator.StartHistograms();
+  RecordValues("a", values, &calibrator);
+
+  const float bin_width = 999.f / RangeCalibrator::kHistogramBins;
+  float min_val = 0;
+  float max_val = 0;
+  // 1% of the values is clipped on each side, to a bin
+  ASSERT_TRUE(calibrator.GetRange("a", CALIBRATION_PERCENTILE, 1,
+                                  &min_val, &max_val));
+  EXPECT_NEAR(10.f, min_val, bin_width);
+  EXPECT_NEAR(989.f, max_val, bin_width);
+  ASSERT_TRUE(calibrator.GetRange("a", CALIBRATION_PERCENTILE, 0,
+                                  &min_val, &max_val));
+  EXPECT_EQ(0.f, min_val);
+  EXPECT_EQ(999.f, max_val);
+  // the values are uniform, the clipped range keeps most of them
+  ASSERT_TRUE(calibrator.GetRange("a", CALIBRATION_KL_DIVERGENCE, 0,
+                                  &min_val, &max_val));
+  EXPECT_LE(0.f, min_val);
+  EXPECT_GE(999.f, max_val);
+  EXPECT_LT(500.f, max_val - min_val);
+}
+
+TEST_F(RangeCalibratorTest, NoSamples) {
+  RangeCalibrator calibrator(nullptr);
+  float min_val = 0;
+  float max_val = 0;
+  EXPECT_FALSE(calibrator.GetRange("a", CALIBRATION_MIN_MAX, 0,
+                                   &min_val, &max_val));
+  // empty and non float tensors are not recorded
+  RecordValues("a", {}, &calibrator);
+  Tensor int_tensor(GetCPUAllocator(), DT_INT32);
+  int_tensor.Resize({2});
+  calibrator.Record("b", &int_tensor);
+  EXPECT_FALSE(calibrator.GetRange("a", CALIBRATION_MIN_MAX, 0,
+                                   &min_val, &max_val));
+  EXPECT_FALSE(calibrator.GetRange("b", CALIBRATION_MIN_MAX, 0,
+                                   &min_val, &max_val));
+
+  // without values in the histograms, the range is the min and max
+  RecordValues("c", {-2.f, 5.f}, &calibrator);
+  calibrator.StartHistograms();
+  // a tensor first seen in the second pass has no range
+  RecordValues("d", {1.f}, &calibrator);
+  for (auto method : {CALIBRATION_MIN_MAX, CALIBRATION_PERCENTILE,
+                      CALIBRATION_KL_DIVERGENCE}) {
+    ASSERT_TRUE(calibrator.GetRange("c", method, 1, &min_val, &max_val));
+    EXPECT_EQ(-2.f, min_val);
+    EXPECT_EQ(5.f, max_val);
+    EXPECT_FALSE(calibrator.GetRange("d", method, 1, &min_val, &max_val));
+  }
+
+  // a constant tensor keeps its single value
+  RangeCalibrator constant(nullptr);
+  RecordValues("e", {1.5f, 1.5f}, &constant);
+  constant.StartHistograms();
+  RecordValues("e", {1.5f, 1.5f}, &constant);
+  ASSERT_TRUE(constant.GetRange("e", CALIBRATION_KL_DIVERGENCE, 0,
+                                &min_val, &max_val));
+  EXPECT_EQ(1.5f, min_val);
+  EXPECT_EQ(1.5f, max_val);
+}
+
+}  // namespace test
+}  // namespace ops
+}  // namespace mace
@@ -22,6 +22,7 @@
 #include "mace/core/operator.h"
 #include "mace/core/runtime/cpu/cpu_runtime.h"
 #include "mace/core/tensor.h"
+#include "mace/ops/arm/reduce.h"
 #ifdef MACE_ENABLE_OPENCL
 #include "mace/ops/opencl/image/reduce.h"
 #endif  // MACE_ENABLE_OPENCL
@@ -536,6 +537,50 @@ class ReduceOp<DeviceType::CPU, T> : public ReduceOpBase {
   std::vector<index_t> out_shape_;
 };
 
+// Float reductions run group by group of the reduced dims of data_reshape_,
+// innermost first, each as a single axis reduction of [outer, reduce, inner].
+template <>
+void ReduceOp<DeviceType::CPU, float>::Compute(const Tensor *input,
+                                               Tensor *output) {
+  Tensor::MappingGuard input_mapper(input);
+  const float *input_ptr = input->data<float>();
+  Tensor::MappingGuard output_map(output);
+  float *output_ptr = output->mutable_data<float>();
+
+  std::vector<index_t> dims(data_reshape_.begin(), data_reshape_.end());
+  std::vector<int> reduced_dims;
+  for (size_t i = reduce_first_axis_ ? 0 : 1; i < dims.size(); i += 2) {
+    reduced_dims.push_back(static_cast<int>(i));
+  }
+  if (reduced_dims.empty()) {
+    std::copy(input_ptr, input_ptr + output->size(), output_ptr);
+    return;
+  }
+
+  std::vector<float> buffers[2];
+  const float *src = input_ptr;
+  for (size_t p = reduced_dims.size(); p > 0; --p) {
+    const int dim = reduced_dims[p - 1];
+    index_t outer = 1;
+    for (int i = 0; i < dim; ++i) {
+      outer *= dims[i];
+    }
+    index_t inner = 1;
+    for (size_t i = dim + 1; i < dims.size(); ++i) {
+      inner *= dims[i];
+    }
+    float *dst = output_ptr;
+    if (p > 1) {
+      std::vector<float> *buffer = &buffers[p % 2];
+      buffer->resize(outer * inner);
+      dst = buffer->data();
+    }
+    ReduceAxis(src, outer, dims[dim], inner, reduce_type_, dst);
+    dims.erase(dims.begin() + dim);
+    src = dst;
+  }
+}
+
 #ifdef MACE_ENABLE_QUANTIZE
 template <>
 void ReduceOp<DeviceType::CPU, uint8_t>::Reduce1Dims(
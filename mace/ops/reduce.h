@@ -18,13 +18,13 @@
 
 namespace mace {
 enum ReduceType {
-//  SUM = 0,
   MEAN = 0,
   MIN = 1,
   MAX = 2,
   PROD = 3,
-//  SUM_SQR = 4,
-//  SQR_MEAN = 5,
+  SUM = 4,
+//  SUM_SQR = 5,
+//  SQR_MEAN = 6,
 };
 }  // namespace mace
 
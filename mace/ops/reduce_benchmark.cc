@@ -12,8 +12,12 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <string>
+#include <vector>
+
 #include "mace/core/testing/test_benchmark.h"
 #include "mace/ops/ops_test_util.h"
+#include "mace/ops/reduce.h"
 
 namespace mace {
 namespace ops {
@@ -22,12 +26,13 @@ namespace test {
 namespace {
 template <DeviceType D, typename T>
 void Reduce(int iters, int batch, int channels,
-                int height, int width) {
+            int height, int width,
+            const std::vector<int> &axis = {1, 2},
+            const ReduceType type = ReduceType::MEAN) {
   mace::testing::StopTiming();
 
   OpsTestNet net;
   // Add input data
-  std::vector<int> axis = {1, 2};
   if (D == DeviceType::GPU) {
     net.AddRandomInput<D, T>("Input", {batch, height, width, channels});
   } else {
@@ -37,6 +42,7 @@ void Reduce(int iters, int batch, int channels,
   OpDefBuilder("Reduce", "ReduceBM")
       .Input("Input")
       .AddIntsArg("axis", axis)
+      .AddIntArg("reduce_type", type)
       .Output("OutputImage")
       .AddIntArg("T", static_cast<int>(DataTypeToEnum<T>::value))
       .Finalize(net.NewOperatorDef());
@@ -53,6 +59,18 @@ void Reduce(int iters, int batch, int channels,
   }
   net.Sync();
 }
+// the reduced axes of an NCHW input, named by the kernel they run on
+std::vector<int> BenchmarkAxis(const std::string &name) {
+  if (name == "INNER") {
+    return {3};
+  } else if (name == "HW") {
+    return {2, 3};
+  } else if (name == "OUTER") {
+    return {0};
+  } else {
+    return {1};
+  }
+}
 }  // namespace
 
 #define MACE_BM_REDUCE_MACRO(N, C, H, W, TYPE, DEVICE)       \
@@ -60,6 +78,7 @@ void Reduce(int iters, int batch, int channels,
     MACE_BM_REDUCE_##N##_##C##_##H##_##W##_##TYPE##_##DEVICE(\
       int iters) {                                                   \
     const int64_t tot = static_cast<int64_t>(iters) * N * C * H * W; \
+    mace::testing::MacsProcessed(tot);                               \
     mace::testing::BytesProcessed(tot *(sizeof(TYPE)));              \
     Reduce<DEVICE, TYPE>(iters, N, C, H, W);        \
   }                                                                  \
@@ -79,6 +98,34 @@ MACE_BM_REDUCE(16, 32, 112, 112);
 MACE_BM_REDUCE(8, 64, 256, 256);
 MACE_BM_REDUCE(1, 32, 480, 640);
 
+#define MACE_BM_REDUCE_AXIS_MACRO(N, C, H, W, AXIS, TYPE)                 \
+  static void                                                             \
+    MACE_BM_REDUCE_##AXIS##_##TYPE##_##N##_##C##_##H##_##W##_float_CPU(   \
+      int iters) {                                                        \
+    const int64_t tot = static_cast<int64_t>(iters) * N * C * H * W;      \
+    mace::testing::MacsProcessed(tot);                                    \
+    mace::testing::BytesProcessed(tot *(sizeof(float)));                  \
+    Reduce<DeviceType::CPU, float>(iters, N, C, H, W, BenchmarkAxis(#AXIS),  \
+                                   ReduceType::TYPE);                     \
+  }                                                                       \
+  MACE_BENCHMARK(                                                         \
+    MACE_BM_REDUCE_##AXIS##_##TYPE##_##N##_##C##_##H##_##W##_float_CPU)
+
+#define MACE_BM_REDUCE_AXIS(N, C, H, W, AXIS)          \
+  MACE_BM_REDUCE_AXIS_MACRO(N, C, H, W, AXIS, MEAN);   \
+  MACE_BM_REDUCE_AXIS_MACRO(N, C, H, W, AXIS, MAX);    \
+  MACE_BM_REDUCE_AXIS_MACRO(N, C, H, W, AXIS, SUM)
+
+// global average pooling
+MACE_BM_REDUCE_AXIS(1, 1024, 7, 7, HW);
+MACE_BM_REDUCE_AXIS(1, 256, 56, 56, HW);
+// layer norm over the hidden units of a sequence
+MACE_BM_REDUCE_AXIS(1, 1, 128, 768, INNER);
+MACE_BM_REDUCE_AXIS(1, 1, 1, 100000, INNER);
+// across a batch, and across the channels
+MACE_BM_REDUCE_AXIS(32, 64, 28, 28, OUTER);
+MACE_BM_REDUCE_AXIS(1, 64, 56, 56, MIDDLE);
+
 
 }  // namespace test
 }  // namespace ops
@@ -106,18 +106,18 @@ void SimpleMean12Test() {
              10, 11, 12, 13}, ReduceType::MEAN);
 }
 
-// template <DeviceType D>
-// void SimpleSum12Test() {
-//   Simple<D>({2, 2, 3, 4},
-//            {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11,
-//             12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23,
-//             0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11,
-//             12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23},
-//            {1, 2},
-//            {2, 1, 1, 4},
-//            {60, 66, 72, 78,
-//             60, 66, 72, 78}, ReduceType::SUM);
-//}
+template <DeviceType D>
+void SimpleSum12Test() {
+  Simple<D>({2, 2, 3, 4},
+            {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11,
+             12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23,
+             0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11,
+             12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23},
+            {1, 2},
+            {2, 1, 1, 4},
+            {60, 66, 72, 78,
+             60, 66, 72, 78}, ReduceType::SUM);
+}
 
 template <DeviceType D>
 void SimpleMin12Test() {
@@ -537,12 +537,14 @@ TEST_F(ReduceOpTest, CPUSimple12) {
   SimpleMean12Test<DeviceType::CPU>();
   SimpleMin12Test<DeviceType::CPU>();
   SimpleMax12Test<DeviceType::CPU>();
+  SimpleSum12Test<DeviceType::CPU>();
 }
 
 TEST_F(ReduceOpTest, GPUSimple12) {
   SimpleMean12Test<DeviceType::GPU>();
   SimpleMin12Test<DeviceType::GPU>();
   SimpleMax12Test<DeviceType::GPU>();
+  SimpleSum12Test<DeviceType::GPU>();
 }
 
 TEST_F(ReduceOpTest, CPUSimple1Axis) {
@@ -614,7 +616,7 @@ void RandomTest(const std::vector<index_t> &input_shape,
     }
   };
 
-  for (ReduceType type : {MEAN, MIN, MAX, PROD}) {
+  for (ReduceType type : {MEAN, MIN, MAX, PROD, SUM}) {
     func(type);
   }
 }
@@ -32,7 +32,33 @@ MaceStatus Gemm<float>::Compute(const OpContext *context,
                                 const bool lhs_batched,
                                 const bool rhs_batched,
                                 Tensor *output) {
+  return Compute(context,
+                 lhs,
+                 rhs,
+                 MatrixBatch(batch, lhs_batched, lhs_major, rows, depth),
+                 MatrixBatch(batch, rhs_batched, rhs_major, depth, cols),
+                 rows,
+                 cols,
+                 depth,
+                 output_major,
+                 output);
+}
+
+MaceStatus Gemm<float>::Compute(const OpContext *context,
+                                const Tensor *lhs,
+                                const Tensor *rhs,
+                                const MatrixBatch &lhs_batch,
+                                const MatrixBatch &rhs_batch,
+                                const index_t rows,
+                                const index_t cols,
+                                const index_t depth,
+                                const MatrixMajor output_major,
+                                Tensor *output) {
   MACE_UNUSED(context);
+  const index_t batch = lhs_batch.size();
+  MACE_CHECK(rhs_batch.size() == batch,
+             "lhs and rhs have different batches: ", batch, " vs. ",
+             rhs_batch.size());
 
   Tensor::MappingGuard lhs_guard(lhs);
   Tensor::MappingGuard rhs_guard(rhs);
@@ -43,17 +69,17 @@ MaceStatus Gemm<float>::Compute(const OpContext *context,
 
   for (index_t b = 0; b < batch; ++b) {
     MatrixMap<const float>
-        lhs_matrix
-        (lhs_data + static_cast<index_t>(lhs_batched) * b * rows * depth,
-         lhs_major,
-         rows,
-         depth);
+        lhs_matrix(lhs_data + lhs_batch.offsets[b],
+                   lhs_batch.major,
+                   rows,
+                   depth,
+                   lhs_batch.stride);
     MatrixMap<const float>
-        rhs_matrix
-        (rhs_data + static_cast<index_t>(rhs_batched) * b * depth * cols,
-         rhs_major,
-         depth,
-         cols);
+        rhs_matrix(rhs_data + rhs_batch.offsets[b],
+                   rhs_batch.major,
+                   depth,
+                   cols,
+                   rhs_batch.stride);
     MatrixMap<float>
         output_matrix(output_data + b * rows * cols, output_major, rows, cols);
 
@@ -63,6 +63,18 @@ class Gemm<float> {
                      const bool lhs_batched,
                      const bool rhs_batched,
                      Tensor *output);
+  // Multiply the matrices of lhs_batch by those of rhs_batch, of the same
+  // count, into the output of [batch, rows, cols] in output_major.
+  MaceStatus Compute(const OpContext *context,
+                     const Tensor *lhs,
+                     const Tensor *rhs,
+                     const MatrixBatch &lhs_batch,
+                     const MatrixBatch &rhs_batch,
+                     const index_t rows,
+                     const index_t cols,
+                     const index_t depth,
+                     const MatrixMajor output_major,
+                     Tensor *output);
   // Original matrix before transpose has row-major
   MaceStatus Compute(
       const OpContext *context,
@@ -92,8 +92,6 @@ MaceStatus Gemv<uint8_t>::Compute(const OpContext *context,
   uint8_t *output_data = output->mutable_data<uint8_t>();
 
   MACE_CHECK(output->scale() > 0, "output scale must not be zero");
-  const float
-      output_multiplier_float = lhs->scale() * rhs->scale() / output->scale();
   int32_t lhs_zero = lhs->zero_point();
   int32_t rhs_zero = rhs->zero_point();
 
@@ -108,6 +106,9 @@ MaceStatus Gemv<uint8_t>::Compute(const OpContext *context,
                 - rhs_zero);
       }  // w
 
+      // lhs may be quantized per channel
+      const float output_multiplier_float =
+          lhs->scale(h) * rhs->scale() / output->scale();
       output_data[b * lhs_height + h] =
           Saturate<uint8_t>(std::roundf(sum * output_multiplier_float));
     }  // h
@@ -0,0 +1,47 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/ops/ref/gemv_8x16.h"
+
+namespace mace {
+namespace ops {
+namespace ref {
+
+void Gemv8x16(const uint8_t *weight,
+              const float *weight_scales,
+              const int32_t weight_zero_point,
+              const int16_t *input,
+              const float input_scale,
+              const float *bias,
+              const index_t rows,
+              const index_t cols,
+              const index_t batch,
+              float *output) {
+  for (index_t b = 0; b < batch; ++b) {
+    const int16_t *input_ptr = input + b * cols;
+    for (index_t r = 0; r < rows; ++r) {
+      const uint8_t *row = weight + r * cols;
+      int64_t sum = 0;
+      for (index_t c = 0; c < cols; ++c) {
+        sum += (row[c] - weight_zero_point) * input_ptr[c];
+      }
+      output[b * rows + r] = weight_scales[r] * input_scale * sum
+          + (bias == nullptr ? 0.f : bias[r]);
+    }
+  }
+}
+
+}  // namespace ref
+}  // namespace ops
+}  // namespace mace
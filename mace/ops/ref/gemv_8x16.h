@@ -0,0 +1,45 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_OPS_REF_GEMV_8X16_H_
+#define MACE_OPS_REF_GEMV_8X16_H_
+
+#include <cstdint>
+
+#include "mace/core/types.h"
+
+namespace mace {
+namespace ops {
+namespace ref {
+
+// output[b, r] = weight_scales[r] * input_scale * sum over c of
+// (weight[r, c] - weight_zero_point) * input[b, c] + bias[r], of a uint8
+// [rows, cols] weight and int16 [batch, cols] inputs of zero point 0, bias
+// may be null
+void Gemv8x16(const uint8_t *weight,
+              const float *weight_scales,
+              const int32_t weight_zero_point,
+              const int16_t *input,
+              const float input_scale,
+              const float *bias,
+              const index_t rows,
+              const index_t cols,
+              const index_t batch,
+              float *output);
+
+}  // namespace ref
+}  // namespace ops
+}  // namespace mace
+
+#endif  // MACE_OPS_REF_GEMV_8X16_H_
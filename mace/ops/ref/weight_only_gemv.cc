@@ -0,0 +1,52 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/ops/ref/weight_only_gemv.h"
+
+#include <algorithm>
+
+namespace mace {
+namespace ops {
+namespace ref {
+
+void WeightOnlyGemv(const WeightOnlyMatrix &weight,
+                    const float *input,
+                    const float *bias,
+                    const index_t batch,
+                    float *output) {
+  const index_t rows = weight.rows;
+  const index_t cols = weight.cols;
+  const index_t groups = weight.groups();
+  for (index_t b = 0; b < batch; ++b) {
+    const float *input_ptr = input + b * cols;
+    for (index_t r = 0; r < rows; ++r) {
+      const uint8_t *row = weight.data + r * weight.row_bytes();
+      float sum = bias == nullptr ? 0.f : bias[r];
+      for (index_t g = 0; g < groups; ++g) {
+        const index_t end = std::min(cols, (g + 1) * weight.group_size);
+        float group_sum = 0.f;
+        for (index_t c = g * weight.group_size; c < end; ++c) {
+          group_sum += (WeightOnlyValue(row, weight.bits, c) -
+              weight.zero_point) * input_ptr[c];
+        }
+        sum += weight.scales[r * groups + g] * group_sum;
+      }
+      output[b * rows + r] = sum;
+    }
+  }
+}
+
+}  // namespace ref
+}  // namespace ops
+}  // namespace mace
@@ -0,0 +1,36 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_OPS_REF_WEIGHT_ONLY_GEMV_H_
+#define MACE_OPS_REF_WEIGHT_ONLY_GEMV_H_
+
+#include "mace/ops/common/weight_only.h"
+
+namespace mace {
+namespace ops {
+namespace ref {
+
+// output[b, r] = sum of weight[r, c] * input[b, c] + bias[r] over c, of
+// [batch, cols] inputs, bias may be null
+void WeightOnlyGemv(const WeightOnlyMatrix &weight,
+                    const float *input,
+                    const float *bias,
+                    const index_t batch,
+                    float *output);
+
+}  // namespace ref
+}  // namespace ops
+}  // namespace mace
+
+#endif  // MACE_OPS_REF_WEIGHT_ONLY_GEMV_H_
@@ -19,6 +19,10 @@
 #include <memory>
 #include <vector>
 
+#if defined(MACE_ENABLE_NEON)
+#include <arm_neon.h>
+#endif
+
 #include "mace/core/operator.h"
 #ifdef MACE_ENABLE_OPENCL
 #include "mace/ops/opencl/image/resize_bicubic.h"
@@ -71,12 +75,85 @@ inline void GetWeightsAndIndices(float scale, int64_t out_loc, int64_t limit,
               Bound(in_loc + 1, limit), Bound(in_loc + 2, limit)};
 }
 
-inline float Interpolate1D(const std::vector<float> &weights,
-                           const std::vector<float> &values) {
-  return values[0] * weights[0] + values[1] * weights[1] +
-      values[2] * weights[2] + values[3] * weights[3];
+// The 4 source indices and weights of the output positions along one axis,
+// as [4, out_size], so the weights of neighboring positions load as a
+// vector.
+struct CubicInterpolation {
+  std::vector<index_t> indices;
+  std::vector<float> weights;
+};
+
+inline void ComputeCubicInterpolation(const index_t out_size,
+                                      const index_t in_size,
+                                      const float scale,
+                                      CubicInterpolation *interpolation) {
+  interpolation->indices.resize(4 * out_size);
+  interpolation->weights.resize(4 * out_size);
+  std::vector<float> weights;
+  std::vector<int64_t> indices;
+  for (index_t i = 0; i < out_size; ++i) {
+    GetWeightsAndIndices(scale, i, in_size, &weights, &indices);
+    for (int k = 0; k < 4; ++k) {
+      interpolation->indices[k * out_size + i] = indices[k];
+      interpolation->weights[k * out_size + i] = weights[k];
+    }
+  }
+}
+
+// Resizes a row of the input along the width.
+inline void InterpolateRow(const float *input,
+                           const CubicInterpolation &xs,
+                           const index_t out_width,
+                           float *output) {
+  const index_t *indices = xs.indices.data();
+  const float *weights = xs.weights.data();
+  index_t x = 0;
+#if defined(MACE_ENABLE_NEON)
+  for (; x + 4 <= out_width; x += 4) {
+    float32x4_t sum = vdupq_n_f32(0.f);
+    for (int k = 0; k < 4; ++k) {
+      const index_t *index = indices + k * out_width + x;
+      const float values[4] = {input[index[0]], input[index[1]],
+                               input[index[2]], input[index[3]]};
+      sum = vmlaq_f32(sum, vld1q_f32(values),
+                      vld1q_f32(weights + k * out_width + x));
+    }
+    vst1q_f32(output + x, sum);
+  }
+#endif
+  for (; x < out_width; ++x) {
+    float sum = 0;
+    for (int k = 0; k < 4; ++k) {
+      sum += input[indices[k * out_width + x]] * weights[k * out_width + x];
+    }
+    output[x] = sum;
+  }
+}
+
+// Blends four rows resized along the width.
+inline void BlendRows(const float *const *rows,
+                      const float *weights,
+                      const index_t out_width,
+                      float *output) {
+  index_t x = 0;
+#if defined(MACE_ENABLE_NEON)
+  for (; x + 4 <= out_width; x += 4) {
+    float32x4_t sum = vmulq_n_f32(vld1q_f32(rows[0] + x), weights[0]);
+    sum = vmlaq_n_f32(sum, vld1q_f32(rows[1] + x), weights[1]);
+    sum = vmlaq_n_f32(sum, vld1q_f32(rows[2] + x), weights[2]);
+    sum = vmlaq_n_f32(sum, vld1q_f32(rows[3] + x), weights[3]);
+    vst1q_f32(output + x, sum);
+  }
+#endif
+  for (; x < out_width; ++x) {
+    output[x] = rows[0][x] * weights[0] + rows[1][x] * weights[1] +
+        rows[2][x] * weights[2] + rows[3][x] * weights[3];
+  }
 }
 
+// Resizes along the width first and then along the height. The rows resized
+// along the width are kept in 4 slots by their index modulo 4, which never
+// collide as an output row reads 4 consecutive input rows.
 inline void ResizeImage(const float *images,
                         const index_t batch_size,
                         const index_t in_height,
@@ -84,40 +161,36 @@ inline void ResizeImage(const float *images,
                         const index_t out_height,
                         const index_t out_width,
                         const index_t channels,
-                        const float height_scale,
-                        const float width_scale,
+                        const CubicInterpolation &xs,
+                        const CubicInterpolation &ys,
                         float *output) {
-#pragma omp parallel for collapse(2) schedule(runtime)
-  for (index_t b = 0; b < batch_size; ++b) {
-    for (index_t y = 0; y < out_height; ++y) {
-      std::vector<float> y_weights;
-      std::vector<index_t> y_indices;
-      GetWeightsAndIndices(height_scale, y, in_height, &y_weights,
-                           &y_indices);
-      for (index_t x = 0; x < out_width; ++x) {
-        std::vector<float> x_weights;
-        std::vector<index_t> x_indices;
-        GetWeightsAndIndices(width_scale, x, in_width, &x_weights,
-                             &x_indices);
-
-        for (index_t c = 0; c < channels; ++c) {
-          // Use a 4x4 patch to compute the interpolated output value at
-          // (b, y, x, c).
-          const float *channel_input_ptr =
-              images + (b * channels + c) * in_height * in_width;
-          float *channel_output_ptr =
-              output + (b * channels + c) * out_height * out_width;
-          std::vector<float> coeff(4, 0.0);
-          for (index_t i = 0; i < 4; ++i) {
-            const std::vector<float> values = {
-                channel_input_ptr[y_indices[i] * in_width + x_indices[0]],
-                channel_input_ptr[y_indices[i] * in_width + x_indices[1]],
-                channel_input_ptr[y_indices[i] * in_width + x_indices[2]],
-                channel_input_ptr[y_indices[i] * in_width + x_indices[3]]};
-            coeff[i] = Interpolate1D(x_weights, values);
+#pragma omp parallel
+  {
+    std::vector<float> buffer(out_width * 4);
+#pragma omp for collapse(2) schedule(runtime)
+    for (index_t b = 0; b < batch_size; ++b) {
+      for (index_t c = 0; c < channels; ++c) {
+        const float *channel_input_ptr =
+            images + (b * channels + c) * in_height * in_width;
+        float *channel_output_ptr =
+            output + (b * channels + c) * out_height * out_width;
+        index_t slot_rows[4] = {-1, -1, -1, -1};
+        for (index_t y = 0; y < out_height; ++y) {
+          const float *rows[4];
+          float weights[4];
+          for (int k = 0; k < 4; ++k) {
+            const index_t row = ys.indices[k * out_height + y];
+            float *slot = buffer.data() + (row % 4) * out_width;
+            if (slot_rows[row % 4] != row) {
+              InterpolateRow(channel_input_ptr + row * in_width, xs,
+                             out_width, slot);
+              slot_rows[row % 4] = row;
+            }
+            rows[k] = slot;
+            weights[k] = ys.weights[k * out_height + y];
           }
-          channel_output_ptr[y * out_width + x] =
-              Interpolate1D(y_weights, coeff);
+          BlendRows(rows, weights, out_width,
+                    channel_output_ptr + y * out_width);
         }
       }
     }
@@ -166,17 +239,25 @@ class ResizeBicubicOp<DeviceType::CPU, float> : public Operation {
       return MaceStatus::MACE_SUCCESS;
     }
 
-    float height_scale =
-        resize_bicubic::CalculateResizeScale(in_height,
-                                             out_height,
-                                             align_corners_);
-    float width_scale =
-        resize_bicubic::CalculateResizeScale(in_width,
-                                             out_width,
-                                             align_corners_);
+    // the weights are computed once for the sizes
+    const std::vector<index_t> sizes = {in_height, in_width,
+                                        out_height, out_width};
+    if (sizes != cached_sizes_) {
+      ComputeCubicInterpolation(
+          out_height, in_height,
+          resize_bicubic::CalculateResizeScale(in_height, out_height,
+                                               align_corners_),
+          &ys_);
+      ComputeCubicInterpolation(
+          out_width, in_width,
+          resize_bicubic::CalculateResizeScale(in_width, out_width,
+                                               align_corners_),
+          &xs_);
+      cached_sizes_ = sizes;
+    }
 
     ResizeImage(input_data, batch, in_height, in_width, out_height, out_width,
-                channels, height_scale, width_scale, output_data);
+                channels, xs_, ys_, output_data);
 
     return MaceStatus::MACE_SUCCESS;
   }
@@ -184,6 +265,9 @@ class ResizeBicubicOp<DeviceType::CPU, float> : public Operation {
  private:
   bool align_corners_;
   std::vector<index_t> size_;
+  std::vector<index_t> cached_sizes_;
+  CubicInterpolation xs_;
+  CubicInterpolation ys_;
 };
 
 #ifdef MACE_ENABLE_OPENCL
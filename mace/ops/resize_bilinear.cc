@@ -14,8 +14,12 @@
 
 #include "mace/ops/resize_bilinear.h"
 
+#if defined(MACE_ENABLE_NEON)
+#include <arm_neon.h>
+#endif
 #include <algorithm>
 #include <memory>
+#include <utility>
 #include <vector>
 
 #include "mace/core/operator.h"
@@ -84,42 +88,194 @@ inline uint8_t ComputeLerp<uint8_t>(const uint8_t top_left,
 }
 
 template <typename T>
-inline void ResizeImageNCHW(const T *images,
+inline void ComputeLerpChannels(const T *top_left,
+                                const T *top_right,
+                                const T *bottom_left,
+                                const T *bottom_right,
+                                const index_t channels,
+                                const float x_lerp,
+                                const float y_lerp,
+                                T *output) {
+  for (index_t c = 0; c < channels; ++c) {
+    output[c] = ComputeLerp(top_left[c], top_right[c], bottom_left[c],
+                            bottom_right[c], x_lerp, y_lerp);
+  }
+}
+
+#if defined(MACE_ENABLE_NEON)
+inline void LoadU8x8(const uint8_t *ptr, float32x4_t *low, float32x4_t *high) {
+  const uint16x8_t v = vmovl_u8(vld1_u8(ptr));
+  *low = vcvtq_f32_u32(vmovl_u16(vget_low_u16(v)));
+  *high = vcvtq_f32_u32(vmovl_u16(vget_high_u16(v)));
+}
+
+inline float32x4_t ComputeLerpVector(const float32x4_t top_left,
+                                     const float32x4_t top_right,
+                                     const float32x4_t bottom_left,
+                                     const float32x4_t bottom_right,
+                                     const float32x4_t x_lerp,
+                                     const float32x4_t y_lerp) {
+  const float32x4_t top =
+      vmlaq_f32(top_left, vsubq_f32(top_right, top_left), x_lerp);
+  const float32x4_t bottom =
+      vmlaq_f32(bottom_left, vsubq_f32(bottom_right, bottom_left), x_lerp);
+  // round half up by truncating, the values are not negative
+  return vaddq_f32(vmlaq_f32(top, vsubq_f32(bottom, top), y_lerp),
+                   vdupq_n_f32(0.5f));
+}
+
+template <>
+inline void ComputeLerpChannels<uint8_t>(const uint8_t *top_left,
+                                         const uint8_t *top_right,
+                                         const uint8_t *bottom_left,
+                                         const uint8_t *bottom_right,
+                                         const index_t channels,
+                                         const float x_lerp,
+                                         const float y_lerp,
+                                         uint8_t *output) {
+  const float32x4_t vx_lerp = vdupq_n_f32(x_lerp);
+  const float32x4_t vy_lerp = vdupq_n_f32(y_lerp);
+  index_t c = 0;
+  for (; c + 8 <= channels; c += 8) {
+    float32x4_t vtl[2], vtr[2], vbl[2], vbr[2];
+    LoadU8x8(top_left + c, &vtl[0], &vtl[1]);
+    LoadU8x8(top_right + c, &vtr[0], &vtr[1]);
+    LoadU8x8(bottom_left + c, &vbl[0], &vbl[1]);
+    LoadU8x8(bottom_right + c, &vbr[0], &vbr[1]);
+    uint16x4_t vout[2];
+    for (int i = 0; i < 2; ++i) {
+      vout[i] = vqmovn_u32(vcvtq_u32_f32(ComputeLerpVector(
+          vtl[i], vtr[i], vbl[i], vbr[i], vx_lerp, vy_lerp)));
+    }
+    vst1_u8(output + c, vqmovn_u16(vcombine_u16(vout[0], vout[1])));
+  }
+  for (; c < channels; ++c) {
+    output[c] = ComputeLerp(top_left[c], top_right[c], bottom_left[c],
+                            bottom_right[c], x_lerp, y_lerp);
+  }
+}
+#endif  // MACE_ENABLE_NEON
+
+// The source indices and weights of the output positions along one axis,
+// kept apart so the weights of neighboring positions load as a vector.
+struct LinearInterpolation {
+  std::vector<index_t> lower;
+  std::vector<index_t> upper;
+  std::vector<float> lerp;
+};
+
+inline void ComputeLinearInterpolation(const index_t out_size,
+                                       const index_t in_size,
+                                       const float scale,
+                                       LinearInterpolation *interpolation) {
+  std::vector<CachedInterpolation> weights(out_size + 1);
+  ComputeInterpolationWeights(out_size, in_size, scale, weights.data());
+  interpolation->lower.resize(out_size);
+  interpolation->upper.resize(out_size);
+  interpolation->lerp.resize(out_size);
+  for (index_t i = 0; i < out_size; ++i) {
+    interpolation->lower[i] = weights[i].lower;
+    interpolation->upper[i] = weights[i].upper;
+    interpolation->lerp[i] = weights[i].lerp;
+  }
+}
+
+// Resizes a row of the input along the width.
+inline void InterpolateRow(const float *input,
+                           const LinearInterpolation &xs,
+                           const index_t out_width,
+                           float *output) {
+  const index_t *lower = xs.lower.data();
+  const index_t *upper = xs.upper.data();
+  const float *lerp = xs.lerp.data();
+  index_t x = 0;
+#if defined(MACE_ENABLE_NEON)
+  for (; x + 4 <= out_width; x += 4) {
+    float left[4], right[4];
+    for (int i = 0; i < 4; ++i) {
+      left[i] = input[lower[x + i]];
+      right[i] = input[upper[x + i]];
+    }
+    const float32x4_t vleft = vld1q_f32(left);
+    vst1q_f32(output + x,
+              vmlaq_f32(vleft, vsubq_f32(vld1q_f32(right), vleft),
+                        vld1q_f32(lerp + x)));
+  }
+#endif
+  for (; x < out_width; ++x) {
+    const float left = input[lower[x]];
+    output[x] = left + (input[upper[x]] - left) * lerp[x];
+  }
+}
+
+// Blends two rows resized along the width.
+inline void BlendRows(const float *top,
+                      const float *bottom,
+                      const index_t out_width,
+                      const float lerp,
+                      float *output) {
+  if (lerp == 0) {
+    std::copy(top, top + out_width, output);
+    return;
+  }
+  index_t x = 0;
+#if defined(MACE_ENABLE_NEON)
+  const float32x4_t vlerp = vdupq_n_f32(lerp);
+  for (; x + 4 <= out_width; x += 4) {
+    const float32x4_t vtop = vld1q_f32(top + x);
+    vst1q_f32(output + x,
+              vmlaq_f32(vtop, vsubq_f32(vld1q_f32(bottom + x), vtop), vlerp));
+  }
+#endif
+  for (; x < out_width; ++x) {
+    output[x] = top[x] + (bottom[x] - top[x]) * lerp;
+  }
+}
+
+// Resizes along the width first, so each input row is interpolated once and
+// shared by the output rows reading it.
+inline void ResizeImageNCHW(const float *images,
                             const index_t batch_size,
                             const index_t in_height,
                             const index_t in_width,
                             const index_t out_height,
                             const index_t out_width,
                             const index_t channels,
-                            const std::vector<CachedInterpolation> &xs_vec,
-                            const std::vector<CachedInterpolation> &ys,
-                            T *output) {
-  const CachedInterpolation *xs = xs_vec.data();
-
-#pragma omp parallel for collapse(2) schedule(runtime)
-  for (index_t b = 0; b < batch_size; ++b) {
-    for (index_t c = 0; c < channels; ++c) {
-      const T
-          *channel_input_ptr =
-          images + (b * channels + c) * in_height * in_width;
-      T *channel_output_ptr =
-          output + (b * channels + c) * out_height * out_width;
-      for (index_t y = 0; y < out_height; ++y) {
-        const T *y_lower_input_ptr =
-            channel_input_ptr + ys[y].lower * in_width;
-        const T *y_upper_input_ptr =
-            channel_input_ptr + ys[y].upper * in_width;
-        const float ys_lerp = ys[y].lerp;
-
-        for (index_t x = 0; x < out_width; ++x) {
-          const float xs_lerp = xs[x].lerp;
-          const T top_left = y_lower_input_ptr[xs[x].lower];
-          const T top_right = y_lower_input_ptr[xs[x].upper];
-          const T bottom_left = y_upper_input_ptr[xs[x].lower];
-          const T bottom_right = y_upper_input_ptr[xs[x].upper];
-          channel_output_ptr[y * out_width + x] =
-              ComputeLerp(top_left, top_right, bottom_left,
-                          bottom_right, xs_lerp, ys_lerp);
+                            const LinearInterpolation &xs,
+                            const LinearInterpolation &ys,
+                            float *output) {
+#pragma omp parallel
+  {
+    std::vector<float> buffer(out_width * 2);
+#pragma omp for collapse(2) schedule(runtime)
+    for (index_t b = 0; b < batch_size; ++b) {
+      for (index_t c = 0; c < channels; ++c) {
+        const float *channel_input_ptr =
+            images + (b * channels + c) * in_height * in_width;
+        float *channel_output_ptr =
+            output + (b * channels + c) * out_height * out_width;
+        float *rows[2] = {buffer.data(), buffer.data() + out_width};
+        index_t row_indices[2] = {-1, -1};
+        for (index_t y = 0; y < out_height; ++y) {
+          const index_t lower = ys.lower[y];
+          const index_t upper = ys.upper[y];
+          if (row_indices[0] != lower) {
+            if (row_indices[1] == lower) {
+              std::swap(rows[0], rows[1]);
+              std::swap(row_indices[0], row_indices[1]);
+            } else {
+              InterpolateRow(channel_input_ptr + lower * in_width, xs,
+                             out_width, rows[0]);
+              row_indices[0] = lower;
+            }
+          }
+          if (row_indices[1] != upper) {
+            InterpolateRow(channel_input_ptr + upper * in_width, xs,
+                           out_width, rows[1]);
+            row_indices[1] = upper;
+          }
+          BlendRows(rows[0], rows[1], out_width, ys.lerp[y],
+                    channel_output_ptr + y * out_width);
         }
       }
     }
@@ -158,11 +314,8 @@ inline void ResizeImageNHWC(const T *images,
         const T *bottom_right = y_upper_input_ptr + xs[x].upper * channels;
 
         T *output_ptr = output_base + (y * out_width + x) * channels;
-        for (index_t c = 0; c < channels; ++c) {
-          output_ptr[c] =
-              ComputeLerp(top_left[c], top_right[c], bottom_left[c],
-                          bottom_right[c], xs_lerp, ys_lerp);
-        }
+        ComputeLerpChannels(top_left, top_right, bottom_left, bottom_right,
+                            channels, xs_lerp, ys_lerp, output_ptr);
       }
     }
   }
@@ -171,8 +324,8 @@ inline void ResizeImageNHWC(const T *images,
 template <DeviceType D, typename T>
 class ResizeBilinearOp;
 
-template <typename T>
-class ResizeBilinearOp<DeviceType::CPU, T> : public Operation {
+template <>
+class ResizeBilinearOp<DeviceType::CPU, float> : public Operation {
  public:
   explicit ResizeBilinearOp(OpConstructContext *context)
       : Operation(context),
@@ -200,8 +353,8 @@ class ResizeBilinearOp<DeviceType::CPU, T> : public Operation {
 
     Tensor::MappingGuard input_mapper(input);
     Tensor::MappingGuard output_mapper(output);
-    const T *input_data = input->data<T>();
-    T *output_data = output->mutable_data<T>();
+    const float *input_data = input->data<float>();
+    float *output_data = output->mutable_data<float>();
 
     if (out_height == in_height && out_width == in_width) {
       std::copy(input_data,
@@ -210,21 +363,22 @@ class ResizeBilinearOp<DeviceType::CPU, T> : public Operation {
       return MaceStatus::MACE_SUCCESS;
     }
 
-    float height_scale =
-        resize_bilinear::CalculateResizeScale(in_height,
-                                              out_height,
-                                              align_corners_);
-    float width_scale =
-        resize_bilinear::CalculateResizeScale(in_width,
-                                              out_width,
-                                              align_corners_);
-
-    std::vector<CachedInterpolation> ys(out_height + 1);
-    std::vector<CachedInterpolation> xs(out_width + 1);
-
-    // Compute the cached interpolation weights on the x and y dimensions.
-    ComputeInterpolationWeights(out_height, in_height, height_scale, ys.data());
-    ComputeInterpolationWeights(out_width, in_width, width_scale, xs.data());
+    // the weights are computed once for the sizes
+    const std::vector<index_t> sizes = {in_height, in_width,
+                                        out_height, out_width};
+    if (sizes != cached_sizes_) {
+      ComputeLinearInterpolation(
+          out_height, in_height,
+          resize_bilinear::CalculateResizeScale(in_height, out_height,
+                                                align_corners_),
+          &ys_);
+      ComputeLinearInterpolation(
+          out_width, in_width,
+          resize_bilinear::CalculateResizeScale(in_width, out_width,
+                                                align_corners_),
+          &xs_);
+      cached_sizes_ = sizes;
+    }
 
     ResizeImageNCHW(input_data,
                     batch,
@@ -233,8 +387,8 @@ class ResizeBilinearOp<DeviceType::CPU, T> : public Operation {
                     out_height,
                     out_width,
                     channels,
-                    xs,
-                    ys,
+                    xs_,
+                    ys_,
                     output_data);
 
     return MaceStatus::MACE_SUCCESS;
@@ -243,6 +397,9 @@ class ResizeBilinearOp<DeviceType::CPU, T> : public Operation {
  private:
   bool align_corners_;
   std::vector<index_t> size_;
+  std::vector<index_t> cached_sizes_;
+  LinearInterpolation xs_;
+  LinearInterpolation ys_;
 };
 
 #ifdef MACE_ENABLE_QUANTIZE
@@ -81,6 +81,38 @@ TEST_F(ResizeBilinearTest, ResizeBilinearWAlignCorners) {
   ExpectTensorNear<float>(*expected, *net.GetOutput("Output"), 1e-5);
 }
 
+TEST_F(ResizeBilinearTest, CPUResizeBilinearUpsample) {
+  testing::internal::LogToStderr();
+  // Construct graph
+  OpsTestNet net;
+
+  // Add input data
+  std::vector<float> input(6);
+  std::iota(begin(input), end(input), 0);
+  net.AddInputFromArray<DeviceType::CPU, float>("Input", {1, 2, 3, 1}, input);
+  net.TransformDataFormat<DeviceType::CPU, float>("Input", NHWC, "InputNCHW",
+                                                  NCHW);
+
+  OpDefBuilder("ResizeBilinear", "ResizeBilinearTest")
+      .Input("InputNCHW")
+      .Output("OutputNCHW")
+      .AddIntsArg("size", {4, 6})
+      .Finalize(net.NewOperatorDef());
+
+  // Run
+  net.RunOp();
+  net.TransformDataFormat<DeviceType::CPU, float>("OutputNCHW", NCHW, "Output",
+                                                  NHWC);
+
+  // Check
+  auto expected = net.CreateTensor<float>(
+      {1, 4, 6, 1},
+      {0, 0.5, 1, 1.5, 2, 2, 1.5, 2, 2.5, 3, 3.5, 3.5,
+       3, 3.5, 4, 4.5, 5, 5, 3, 3.5, 4, 4.5, 5, 5});
+
+  ExpectTensorNear<float>(*expected, *net.GetOutput("Output"), 1e-5);
+}
+
 namespace {
 template <DeviceType D>
 void TestRandomResizeBilinear() {
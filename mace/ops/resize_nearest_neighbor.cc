@@ -15,6 +15,7 @@
 #include "mace/ops/resize_nearest_neighbor.h"
 
 #include <algorithm>
+#include <cmath>
 #include <memory>
 #include <vector>
 
@@ -26,6 +27,22 @@
 
 namespace mace {
 namespace ops {
+inline void ComputeNearestIndices(const index_t out_size,
+                                  const index_t in_size,
+                                  const float scale,
+                                  const bool align_corners,
+                                  std::vector<index_t> *indices) {
+  indices->resize(out_size);
+  for (index_t i = 0; i < out_size; ++i) {
+    (*indices)[i] = std::min(
+        align_corners ? static_cast<index_t>(roundf(i * scale))
+                      : static_cast<index_t>(floorf(i * scale)),
+        in_size - 1);
+  }
+}
+
+// An output row reading the same input row as the previous one is copied
+// from it.
 template <typename T>
 inline void ResizeImageNCHW(const T *images,
                             const index_t batch_size,
@@ -34,9 +51,8 @@ inline void ResizeImageNCHW(const T *images,
                             const index_t out_height,
                             const index_t out_width,
                             const index_t channels,
-                            const float height_scale,
-                            const float width_scale,
-                            bool align_corners,
+                            const std::vector<index_t> &xs,
+                            const std::vector<index_t> &ys,
                             T *output) {
 #pragma omp parallel for collapse(2) schedule(runtime)
   for (index_t b = 0; b < batch_size; ++b) {
@@ -47,17 +63,14 @@ inline void ResizeImageNCHW(const T *images,
       T *channel_output_ptr =
           output + (b * channels + c) * out_height * out_width;
       for (index_t y = 0; y < out_height; ++y) {
-        const index_t in_y = std::min(
-            (align_corners) ? static_cast<index_t>(roundf(y * height_scale))
-                            : static_cast<index_t>(floorf(y * height_scale)),
-            in_height - 1);
-        for (int x = 0; x < out_width; ++x) {
-          const index_t in_x = std::min(
-              (align_corners) ? static_cast<index_t>(roundf(x * width_scale))
-                              : static_cast<index_t>(floorf(x * width_scale)),
-              in_width - 1);
-          channel_output_ptr[y * out_width + x] =
-              channel_input_ptr[in_y * in_width + in_x];
+        T *output_row = channel_output_ptr + y * out_width;
+        if (y > 0 && ys[y] == ys[y - 1]) {
+          std::copy(output_row - out_width, output_row, output_row);
+          continue;
+        }
+        const T *input_row = channel_input_ptr + ys[y] * in_width;
+        for (index_t x = 0; x < out_width; ++x) {
+          output_row[x] = input_row[xs[x]];
         }
       }
     }
@@ -108,14 +121,24 @@ class ResizeNearestNeighborOp<DeviceType::CPU, T> : public Operation {
       return MaceStatus::MACE_SUCCESS;
     }
 
-    float height_scale =
-        resize_nearest_neighbor::CalculateResizeScale(in_height,
-                                                      out_height,
-                                                      align_corners_);
-    float width_scale =
-        resize_nearest_neighbor::CalculateResizeScale(in_width,
-                                                      out_width,
-                                                      align_corners_);
+    // the indices are computed once for the sizes
+    const std::vector<index_t> sizes = {in_height, in_width,
+                                        out_height, out_width};
+    if (sizes != cached_sizes_) {
+      ComputeNearestIndices(
+          out_height, in_height,
+          resize_nearest_neighbor::CalculateResizeScale(in_height,
+                                                        out_height,
+                                                        align_corners_),
+          align_corners_, &ys_);
+      ComputeNearestIndices(
+          out_width, in_width,
+          resize_nearest_neighbor::CalculateResizeScale(in_width,
+                                                        out_width,
+                                                        align_corners_),
+          align_corners_, &xs_);
+      cached_sizes_ = sizes;
+    }
     ResizeImageNCHW(input_data,
                     batch,
                     in_height,
@@ -123,15 +146,17 @@ class ResizeNearestNeighborOp<DeviceType::CPU, T> : public Operation {
                     out_height,
                     out_width,
                     channels,
-                    height_scale,
-                    width_scale,
-                    align_corners_,
+                    xs_,
+                    ys_,
                     output_data);
     return MaceStatus::MACE_SUCCESS;
   }
 
  private:
   bool align_corners_;
+  std::vector<index_t> cached_sizes_;
+  std::vector<index_t> xs_;
+  std::vector<index_t> ys_;
 };
 
 #ifdef MACE_ENABLE_OPENCL
@@ -0,0 +1,205 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "mace/ops/common/eltwise_type.h"
+#include "mace/ops/ops_test_util.h"
+
+namespace mace {
+namespace ops {
+namespace test {
+
+class SharedWeightsTest : public OpsTestBase {};
+
+namespace {
+
+const std::vector<index_t> kShape = {6};
+const std::vector<float> kWeight = {0.5f, -1.f, 2.f, 0.25f, -3.f, 1.5f};
+const std::vector<uint8_t> kQuantized = {0, 3, 7, 10, 128, 255};
+
+struct QuantParams {
+  float scale;
+  int32_t zero_point;
+};
+// Q0 and Q2 are aliases, Q1 only shares their bytes
+const QuantParams kQuantParams[] = {{0.5f, 3}, {0.25f, 7}, {0.5f, 3}};
+
+ConstTensor *AddConstTensor(const std::string &name,
+                            const DataType data_type,
+                            const void *data,
+                            const index_t bytes,
+                            std::vector<unsigned char> *model_data,
+                            NetDef *net_def) {
+  ConstTensor *const_tensor = net_def->add_tensors();
+  const_tensor->set_name(name);
+  const_tensor->set_data_type(data_type);
+  for (auto dim : kShape) {
+    const_tensor->add_dims(dim);
+  }
+  const_tensor->set_offset(model_data->size());
+  const_tensor->set_data_size(kShape[0]);
+  const unsigned char *bytes_data = static_cast<const unsigned char *>(data);
+  model_data->insert(model_data->end(), bytes_data, bytes_data + bytes);
+  // keep the float data aligned
+  model_data->resize(RoundUp<size_t>(model_data->size(), 4));
+  return const_tensor;
+}
+
+void AddEltwise(const std::string &input0,
+                const std::string &input1,
+                const std::string &output,
+                const EltwiseType type,
+                NetDef *net_def) {
+  OpDefBuilder("Eltwise", output + "Op")
+      .Input(input0)
+      .Input(input1)
+      .Output(output)
+      .OutputShape(kShape)
+      .AddIntArg("type", static_cast<int>(type))
+      .Finalize(net_def->add_op());
+}
+
+// W1 is a copy of W0, and Q0, Q1 and Q2 are of the same bytes. The net
+// reads each of them: ((Input + W0) * W1 + Q0) * Q1 + Q2.
+NetDef BuildNet(const bool quantize_model,
+                std::vector<unsigned char> *model_data) {
+  NetDef net_def;
+  if (quantize_model) {
+    Argument *arg = net_def.add_arg();
+    arg->set_name("quantize_flag");
+    arg->set_i(1);
+  }
+  for (auto name : {"W0", "W1"}) {
+    AddConstTensor(name, DT_FLOAT, kWeight.data(),
+                   kWeight.size() * sizeof(float), model_data, &net_def);
+  }
+  for (int i = 0; i < 3; ++i) {
+    ConstTensor *const_tensor =
+        AddConstTensor(MakeString("Q", i), DT_UINT8, kQuantized.data(),
+                       kQuantized.size(), model_data, &net_def);
+    const_tensor->set_quantized(true);
+    const_tensor->set_scale(kQuantParams[i].scale);
+    const_tensor->set_zero_point(kQuantParams[i].zero_point);
+  }
+  AddNetInput("Input", kShape, &net_def);
+  net_def.add_output_info()->set_name("Output");
+  AddEltwise("Input", "W0", "Sum0", EltwiseType::SUM, &net_def);
+  AddEltwise("Sum0", "W1", "Prod0", EltwiseType::PROD, &net_def);
+  AddEltwise("Prod0", "Q0", "Sum1", EltwiseType::SUM, &net_def);
+  AddEltwise("Sum1", "Q1", "Prod1", EltwiseType::PROD, &net_def);
+  AddEltwise("Prod1", "Q2", "Output", EltwiseType::SUM, &net_def);
+  return net_def;
+}
+
+std::vector<float> Dequantized(const QuantParams &params) {
+  std::vector<float> values;
+  for (auto q : kQuantized) {
+    values.push_back(params.scale * (q - params.zero_point));
+  }
+  return values;
+}
+
+}  // namespace
+
+TEST_F(SharedWeightsTest, FloatModel) {
+  std::vector<unsigned char> model_data;
+  const NetDef net_def = BuildNet(false, &model_data);
+  std::vector<float> input;
+  GenerateRandomRealTypeData(kShape, &input, false);
+
+  OpsTestNet net;
+  Workspace *ws = net.ws();
+  ASSERT_EQ(ws->LoadModelTensor(net_def,
+                                OpTestContext::Get()->GetDevice(
+                                    DeviceType::CPU),
+                                model_data.data()),
+            MaceStatus::MACE_SUCCESS);
+  // the float copies share one buffer
+  EXPECT_EQ(ws->GetTensor("W0")->raw_data(), ws->GetTensor("W1")->raw_data());
+  EXPECT_EQ("W0", ws->ConstTensorOrigin("W1"));
+  // the uint8 weights are expanded by their own quant params, once for the
+  // aliases
+  EXPECT_EQ("Q1", ws->ConstTensorOrigin("Q1"));
+  EXPECT_EQ("Q0", ws->ConstTensorOrigin("Q2"));
+  EXPECT_EQ(ws->GetTensor("Q0")->raw_data(), ws->GetTensor("Q2")->raw_data());
+  EXPECT_NE(ws->GetTensor("Q0")->raw_data(), ws->GetTensor("Q1")->raw_data());
+  for (int i = 0; i < 3; ++i) {
+    const Tensor *tensor = ws->GetTensor(MakeString("Q", i));
+    ASSERT_EQ(DT_FLOAT, tensor->dtype());
+    const std::vector<float> expected = Dequantized(kQuantParams[i]);
+    const float *data = tensor->data<float>();
+    for (index_t j = 0; j < tensor->size(); ++j) {
+      EXPECT_FLOAT_EQ(expected[j], data[j]) << "Q" << i << " at " << j;
+    }
+  }
+  net.AddInputFromArray<DeviceType::CPU, float>("Input", kShape, input);
+  ASSERT_EQ(net.RunNet(net_def, DeviceType::CPU), MaceStatus::MACE_SUCCESS);
+
+  // each weight of its own buffer
+  OpsTestNet unshared;
+  unshared.AddInputFromArray<DeviceType::CPU, float>("Input", kShape, input);
+  for (auto name : {"W0", "W1"}) {
+    unshared.AddInputFromArray<DeviceType::CPU, float>(name, kShape, kWeight,
+                                                       true);
+  }
+  for (int i = 0; i < 3; ++i) {
+    unshared.AddInputFromArray<DeviceType::CPU, float>(
+        MakeString("Q", i), kShape, Dequantized(kQuantParams[i]), true);
+  }
+  ASSERT_EQ(unshared.RunNet(net_def, DeviceType::CPU),
+            MaceStatus::MACE_SUCCESS);
+  ExpectTensorNear<float>(*unshared.GetOutput("Output"),
+                          *net.GetOutput("Output"), 1e-5);
+}
+
+TEST_F(SharedWeightsTest, QuantizedModel) {
+  std::vector<unsigned char> model_data;
+  const NetDef net_def = BuildNet(true, &model_data);
+  Workspace ws;
+  ASSERT_EQ(ws.LoadModelTensor(net_def,
+                               OpTestContext::Get()->GetDevice(
+                                   DeviceType::CPU),
+                               model_data.data()),
+            MaceStatus::MACE_SUCCESS);
+  // the reload of the weights kept on the host shares the copies too
+  for (bool reloaded : {false, true}) {
+    if (reloaded) {
+      ws.RemoveAndReloadBuffer(net_def, model_data.data(), GetCPUAllocator());
+    }
+    EXPECT_EQ(ws.GetTensor("W0")->raw_data(), ws.GetTensor("W1")->raw_data());
+    const void *data = ws.GetTensor("Q0")->raw_data();
+    for (int i = 0; i < 3; ++i) {
+      const Tensor *tensor = ws.GetTensor(MakeString("Q", i));
+      ASSERT_EQ(DT_UINT8, tensor->dtype());
+      // the views of the bytes keep their quant params
+      EXPECT_EQ(data, tensor->raw_data()) << "Q" << i;
+      EXPECT_EQ(kQuantParams[i].scale, tensor->scale()) << "Q" << i;
+      EXPECT_EQ(kQuantParams[i].zero_point, tensor->zero_point()) << "Q" << i;
+      EXPECT_EQ(0, memcmp(kQuantized.data(), tensor->raw_data(),
+                          kQuantized.size())) << "Q" << i;
+    }
+    if (reloaded) {
+      // copies of the model data
+      EXPECT_NE(static_cast<const void *>(model_data.data()),
+                ws.GetTensor("W0")->raw_data());
+    }
+  }
+}
+
+}  // namespace test
+}  // namespace ops
+}  // namespace mace
@@ -14,6 +14,7 @@
 
 #include <functional>
 #include <memory>
+#include <vector>
 
 #include "mace/core/operator.h"
 
@@ -67,6 +68,19 @@ class SliceOp<DeviceType::CPU, T> : public Operation {
     const T *input_data = input->data<T>();
     T *output_data = output->mutable_data<T>();
 
+    // the memory optimizer plans the output as a view into the input when
+    // it is a contiguous range of it, which is already in place
+    if (frames == 1 && output_data == input_data + offset) {
+      return MaceStatus::MACE_SUCCESS;
+    }
+    std::vector<T> input_copy;
+    if (output_data < input_data + input->size() &&
+        output_data + output->size() > input_data) {
+      // a view whose shape changed, don't overwrite the input before reading
+      input_copy.assign(input_data, input_data + input->size());
+      input_data = input_copy.data();
+    }
+
 #pragma omp parallel for schedule(runtime)
     for (index_t i = 0; i < frames; ++i) {
       const T *input_base =
@@ -20,6 +20,9 @@
 
 #include "mace/core/operator.h"
 
+#ifdef MACE_ENABLE_NEON
+#include "mace/ops/arm/common_neon.h"
+#endif  // MACE_ENABLE_NEON
 #ifdef MACE_ENABLE_QUANTIZE
 #include "mace/ops/fixpoint.h"
 #include "mace/ops/common/gemmlowp_util.h"
@@ -61,9 +64,42 @@ class SoftmaxOp<DeviceType::CPU, float> : public Operation {
       const index_t class_size = input->dim(2) * input->dim(3);
       const index_t batch_size = class_count * class_size;
 
+      // the positions are taken four at a time, the remainder one by one
+      index_t vec_class_size = 0;
+#if defined(MACE_ENABLE_NEON)
+      vec_class_size = class_size & ~3;
       for (index_t b = 0; b < batch; ++b) {
 #pragma omp parallel for schedule(runtime)
-        for (index_t k = 0; k < class_size; ++k) {
+        for (index_t k = 0; k < vec_class_size; k += 4) {
+          const float *input_ptr = input_data + b * batch_size + k;
+          float *output_ptr = output_data + b * batch_size + k;
+
+          float32x4_t vmax = vld1q_f32(input_ptr);
+          for (index_t c = 1; c < class_count; ++c) {
+            vmax = vmaxq_f32(vmax, vld1q_f32(input_ptr + c * class_size));
+          }
+          float32x4_t vsum = vdupq_n_f32(0.f);
+          for (index_t c = 0; c < class_count; ++c) {
+            const index_t offset = c * class_size;
+            const float32x4_t exp_value = neon_vexpq_f32(
+                vsubq_f32(vld1q_f32(input_ptr + offset), vmax));
+            vsum = vaddq_f32(vsum, exp_value);
+            vst1q_f32(output_ptr + offset, exp_value);
+          }
+          const float32x4_t vscale = neon_vrecpq_f32(vmaxq_f32(
+              vsum, vdupq_n_f32(std::numeric_limits<float>::min())));
+          for (index_t c = 0; c < class_count; ++c) {
+            const index_t offset = c * class_size;
+            vst1q_f32(output_ptr + offset,
+                      vmulq_f32(vld1q_f32(output_ptr + offset), vscale));
+          }
+        }  // k
+      }  // b
+#endif  // MACE_ENABLE_NEON
+
+      for (index_t b = 0; b < batch; ++b) {
+#pragma omp parallel for schedule(runtime)
+        for (index_t k = vec_class_size; k < class_size; ++k) {
           const float *input_ptr = input_data + b * batch_size + k;
           float *output_ptr = output_data + b * batch_size + k;
 
@@ -111,19 +147,45 @@ class SoftmaxOp<DeviceType::CPU, float> : public Operation {
         float *output_ptr = output_data + k * class_count;
 
         float max_val = std::numeric_limits<float>::lowest();
-        for (index_t c = 0; c < class_count; ++c) {
+        index_t c = 0;
+#if defined(MACE_ENABLE_NEON)
+        if (class_count >= 4) {
+          float32x4_t vmax = vld1q_f32(input_ptr);
+          for (c = 4; c + 4 <= class_count; c += 4) {
+            vmax = vmaxq_f32(vmax, vld1q_f32(input_ptr + c));
+          }
+          float32x2_t vmax2 = vpmax_f32(vget_low_f32(vmax),
+                                        vget_high_f32(vmax));
+          vmax2 = vpmax_f32(vmax2, vmax2);
+          max_val = vget_lane_f32(vmax2, 0);
+        }
+#endif  // MACE_ENABLE_NEON
+        for (; c < class_count; ++c) {
           max_val = std::max(max_val, input_ptr[c]);
         }
 
         float sum = 0;
-        for (index_t c = 0; c < class_count; ++c) {
+        c = 0;
+#if defined(MACE_ENABLE_NEON)
+        const float32x4_t vmax = vdupq_n_f32(max_val);
+        float32x4_t vsum = vdupq_n_f32(0.f);
+        for (; c + 4 <= class_count; c += 4) {
+          const float32x4_t exp_value =
+              neon_vexpq_f32(vsubq_f32(vld1q_f32(input_ptr + c), vmax));
+          vsum = vaddq_f32(vsum, exp_value);
+          vst1q_f32(output_ptr + c, exp_value);
+        }
+        float32x2_t vsum2 = vadd_f32(vget_low_f32(vsum), vget_high_f32(vsum));
+        sum = vget_lane_f32(vpadd_f32(vsum2, vsum2), 0);
+#endif  // MACE_ENABLE_NEON
+        for (; c < class_count; ++c) {
           float exp_value = std::exp(input_ptr[c] - max_val);
           sum += exp_value;
           output_ptr[c] = exp_value;
         }
 
         sum = std::max(sum, std::numeric_limits<float>::min());
-        for (index_t c = 0; c < class_count; ++c) {
+        for (c = 0; c < class_count; ++c) {
           output_ptr[c] /= sum;
         }
       }
@@ -183,6 +245,11 @@ class SoftmaxOp<DeviceType::CPU, uint8_t> : public Operation {
     // If depth is short, do it using float32. Float computation should not
     // be here, but as long as it is on CPU, it is fine.
     if (depth < 32) {
+      // exp of the deltas to the max value, which are at most 255
+      std::vector<float> exp_table(256);
+      for (int i = 0; i < 256; ++i) {
+        exp_table[i] = ::exp(-i * input_scale);
+      }
 #pragma omp parallel for schedule(runtime)
       for (index_t b = 0; b < batch; ++b) {
         const uint8_t *input_ptr = input_data + b * depth;
@@ -192,8 +259,7 @@ class SoftmaxOp<DeviceType::CPU, uint8_t> : public Operation {
         float sum = 0;
         std::vector<float> depth_cache(depth);
         for (index_t d = 0; d < depth; ++d) {
-          float exp_value = ::exp((static_cast<int>(input_ptr[d]) - max_value)
-                                      * input_scale);
+          float exp_value = exp_table[max_value - input_ptr[d]];
           sum += exp_value;
           depth_cache[d] = exp_value;
         }
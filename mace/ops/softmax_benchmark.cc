@@ -98,6 +98,7 @@ void SoftmaxBenchmark<CPU, uint8_t>(
   static void MACE_BM_SOFTMAX_##N##_##C##_##H##_##W##_##TYPE##_##DEVICE(  \
       int iters) {                                                        \
     const int64_t tot = static_cast<int64_t>(iters) * N * C * H * W;      \
+    mace::testing::MacsProcessed(tot);                                    \
     mace::testing::BytesProcessed(tot *(sizeof(TYPE)));                   \
     SoftmaxBenchmark<DEVICE, TYPE>(iters, N, C, H, W);                    \
   }                                                                       \
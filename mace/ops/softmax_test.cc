@@ -140,6 +140,11 @@ TEST_F(SoftmaxOpTest, OPENCLAlignedRank2) {
   Complex<DeviceType::GPU>({3, 1001});
 }
 
+TEST_F(SoftmaxOpTest, OPENCLWideChannels) {
+  Complex<DeviceType::GPU>({1, 7, 9, 64});
+  Complex<DeviceType::GPU>({2, 5, 3, 1003});
+}
+
 namespace {
 
 void TestQuantizedSoftmax(const std::vector<index_t> &input_shape) {
@@ -0,0 +1,208 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "mace/core/operator.h"
+
+namespace mace {
+namespace ops {
+
+namespace {
+
+// a row is scanned in chunks so that a single huge row (e.g., the output
+// layer of a 100k vocabulary) still runs on all threads
+const index_t kChunkSize = 8192;
+// elements of a block are screened by their max before the heap is touched
+const index_t kBlockSize = 16;
+
+typedef std::pair<float, int32_t> Candidate;
+
+// the worse candidate is of smaller value, or of larger index on a tie
+inline bool Better(const Candidate &lhs, const Candidate &rhs) {
+  return lhs.first > rhs.first ||
+      (lhs.first == rhs.first && lhs.second < rhs.second);
+}
+
+struct TopKState {
+  float max_value;
+  float sum;
+  // min-heap of the k best candidates under Better
+  std::vector<Candidate> heap;
+};
+
+inline void PushCandidate(const Candidate &candidate,
+                          const index_t k,
+                          std::vector<Candidate> *heap) {
+  if (static_cast<index_t>(heap->size()) < k) {
+    heap->push_back(candidate);
+    std::push_heap(heap->begin(), heap->end(), Better);
+  } else if (Better(candidate, heap->front())) {
+    std::pop_heap(heap->begin(), heap->end(), Better);
+    heap->back() = candidate;
+    std::push_heap(heap->begin(), heap->end(), Better);
+  }
+}
+
+// one pass over [begin, end) of a row keeping the running max, the sum of
+// exp(x - max) rescaled whenever the max grows, and the k best elements
+void ScanChunk(const float *row,
+               const index_t begin,
+               const index_t end,
+               const index_t k,
+               const bool softmax,
+               TopKState *state) {
+  state->max_value = std::numeric_limits<float>::lowest();
+  state->sum = 0;
+  state->heap.clear();
+  state->heap.reserve(k);
+  for (index_t b = begin; b < end; b += kBlockSize) {
+    const index_t block_end = std::min(b + kBlockSize, end);
+    float block_max = row[b];
+    for (index_t i = b + 1; i < block_end; ++i) {
+      block_max = std::max(block_max, row[i]);
+    }
+
+    if (softmax) {
+      if (block_max > state->max_value) {
+        state->sum *= std::exp(state->max_value - block_max);
+        state->max_value = block_max;
+      }
+      float block_sum = 0;
+      for (index_t i = b; i < block_end; ++i) {
+        block_sum += std::exp(row[i] - state->max_value);
+      }
+      state->sum += block_sum;
+    }
+
+    // indices grow within a chunk, so an element no larger than the worst
+    // kept one can never replace it
+    if (static_cast<index_t>(state->heap.size()) == k &&
+        block_max <= state->heap.front().first) {
+      continue;
+    }
+    for (index_t i = b; i < block_end; ++i) {
+      PushCandidate(Candidate(row[i], static_cast<int32_t>(i)), k,
+                    &state->heap);
+    }
+  }
+}
+
+void MergeState(const TopKState &other,
+                const index_t k,
+                TopKState *state) {
+  const float max_value = std::max(state->max_value, other.max_value);
+  state->sum = state->sum * std::exp(state->max_value - max_value) +
+      other.sum * std::exp(other.max_value - max_value);
+  state->max_value = max_value;
+  for (const Candidate &candidate : other.heap) {
+    PushCandidate(candidate, k, &state->heap);
+  }
+}
+
+}  // namespace
+
+template <DeviceType D, class T>
+class SoftmaxTopKOp;
+
+// The top k values (or softmax probabilities) along the last axis and their
+// indices, sorted in descending order. Unlike Softmax followed by TopK, the
+// full probability tensor is never written or re-read.
+template <>
+class SoftmaxTopKOp<DeviceType::CPU, float> : public Operation {
+ public:
+  explicit SoftmaxTopKOp(OpConstructContext *context)
+      : Operation(context),
+        k_(Operation::GetOptionalArg<int>("k", 1)),
+        softmax_(Operation::GetOptionalArg<bool>("softmax", true)) {}
+
+  MaceStatus Run(OpContext *context) override {
+    MACE_UNUSED(context);
+    const Tensor *input = this->Input(0);
+    Tensor *values = this->Output(0);
+    Tensor *indices = this->Output(1);
+    MACE_CHECK(input->dim_size() > 0,
+               "SoftmaxTopK input should not be a scalar");
+    const index_t depth = input->dim(input->dim_size() - 1);
+    const index_t k = k_;
+    MACE_CHECK(k > 0 && k <= depth, "SoftmaxTopK k ", k,
+               " should be in (0, ", depth, "]");
+
+    std::vector<index_t> output_shape = input->shape();
+    output_shape.back() = k;
+    MACE_RETURN_IF_ERROR(values->Resize(output_shape));
+    MACE_RETURN_IF_ERROR(indices->Resize(output_shape));
+
+    Tensor::MappingGuard input_guard(input);
+    Tensor::MappingGuard values_guard(values);
+    Tensor::MappingGuard indices_guard(indices);
+    const float *input_data = input->data<float>();
+    float *values_data = values->mutable_data<float>();
+    int32_t *indices_data = indices->mutable_data<int32_t>();
+
+    const index_t outer_size = input->size() / depth;
+    const index_t chunks = RoundUpDiv(depth, kChunkSize);
+    states_.resize(outer_size * chunks);
+
+#pragma omp parallel for collapse(2) schedule(runtime)
+    for (index_t i = 0; i < outer_size; ++i) {
+      for (index_t c = 0; c < chunks; ++c) {
+        ScanChunk(input_data + i * depth, c * kChunkSize,
+                  std::min((c + 1) * kChunkSize, depth), k, softmax_,
+                  &states_[i * chunks + c]);
+      }
+    }
+
+#pragma omp parallel for schedule(runtime)
+    for (index_t i = 0; i < outer_size; ++i) {
+      TopKState *state = &states_[i * chunks];
+      for (index_t c = 1; c < chunks; ++c) {
+        MergeState(states_[i * chunks + c], k, state);
+      }
+      std::sort_heap(state->heap.begin(), state->heap.end(), Better);
+      const float max_value = state->max_value;
+      const float scale =
+          1.f / std::max(state->sum, std::numeric_limits<float>::min());
+      float *values_ptr = values_data + i * k;
+      int32_t *indices_ptr = indices_data + i * k;
+      for (index_t j = 0; j < k; ++j) {
+        const Candidate &candidate = state->heap[j];
+        values_ptr[j] = softmax_ ?
+            std::exp(candidate.first - max_value) * scale : candidate.first;
+        indices_ptr[j] = candidate.second;
+      }
+    }
+
+    return MaceStatus::MACE_SUCCESS;
+  }
+
+ private:
+  const int k_;
+  const bool softmax_;
+  std::vector<TopKState> states_;
+};
+
+void RegisterSoftmaxTopK(OpRegistryBase *op_registry) {
+  MACE_REGISTER_OP(op_registry, "SoftmaxTopK", SoftmaxTopKOp,
+                   DeviceType::CPU, float);
+}
+
+}  // namespace ops
+}  // namespace mace
@@ -0,0 +1,132 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+#include "mace/ops/ops_test_util.h"
+
+namespace mace {
+namespace ops {
+namespace test {
+
+class SoftmaxTopKOpTest : public OpsTestBase {};
+
+namespace {
+void TopKTest(const std::vector<index_t> &input_shape,
+              const std::vector<float> &input,
+              const int k,
+              const std::vector<index_t> &output_shape,
+              const std::vector<float> &values,
+              const std::vector<int32_t> &indices) {
+  OpsTestNet net;
+
+  // Add input data
+  net.AddInputFromArray<CPU, float>("Input", input_shape, input);
+
+  OpDefBuilder("SoftmaxTopK", "SoftmaxTopKTest")
+      .Input("Input")
+      .Output("Values")
+      .Output("Indices")
+      .OutputType({DT_FLOAT, DT_INT32})
+      .AddIntArg("k", k)
+      .AddIntArg("softmax", 0)
+      .Finalize(net.NewOperatorDef());
+  // Run
+  net.RunOp(CPU);
+
+  // Check
+  auto expected_values = net.CreateTensor<float>(output_shape, values);
+  ExpectTensorNear<float>(*expected_values, *net.GetOutput("Values"), 1e-5);
+  auto expected_indices = net.CreateTensor<int32_t>(output_shape, indices);
+  ExpectTensorNear<int32_t>(*expected_indices, *net.GetOutput("Indices"),
+                            1e-5);
+}
+
+void SoftmaxTopKTest(const std::vector<index_t> &input_shape, const int k) {
+  OpsTestNet net;
+
+  // Add input data
+  net.AddRandomInput<CPU, float>("Input", input_shape, false, false);
+
+  OpDefBuilder("Softmax", "SoftmaxTest")
+      .Input("Input")
+      .Output("Softmax")
+      .Finalize(net.NewOperatorDef());
+  net.RunOp(CPU);
+
+  OpDefBuilder("SoftmaxTopK", "SoftmaxTopKTest")
+      .Input("Input")
+      .Output("Values")
+      .Output("Indices")
+      .OutputType({DT_FLOAT, DT_INT32})
+      .AddIntArg("k", k)
+      .Finalize(net.NewOperatorDef());
+  net.RunOp(CPU);
+
+  // Check against a full sort of the softmax output
+  const Tensor *softmax = net.GetOutput("Softmax");
+  const float *softmax_data = softmax->data<float>();
+  const index_t depth = input_shape.back();
+  const index_t outer_size = softmax->size() / depth;
+  std::vector<float> values;
+  std::vector<int32_t> indices;
+  for (index_t i = 0; i < outer_size; ++i) {
+    const float *row = softmax_data + i * depth;
+    std::vector<int32_t> order(depth);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [row](int32_t lhs, int32_t rhs) {
+                       return row[lhs] > row[rhs];
+                     });
+    for (int j = 0; j < k; ++j) {
+      values.push_back(row[order[j]]);
+      indices.push_back(order[j]);
+    }
+  }
+
+  std::vector<index_t> output_shape = input_shape;
+  output_shape.back() = k;
+  auto expected_values = net.CreateTensor<float>(output_shape, values);
+  ExpectTensorNear<float>(*expected_values, *net.GetOutput("Values"), 1e-5);
+  auto expected_indices = net.CreateTensor<int32_t>(output_shape, indices);
+  ExpectTensorNear<int32_t>(*expected_indices, *net.GetOutput("Indices"),
+                            1e-5);
+}
+}  // namespace
+
+TEST_F(SoftmaxTopKOpTest, TopK) {
+  TopKTest({2, 5}, {3, 1, 4, 1, 5, 9, 2, 6, 5, 3}, 3, {2, 3},
+           {5, 4, 3, 9, 6, 5}, {4, 2, 0, 0, 2, 3});
+}
+
+TEST_F(SoftmaxTopKOpTest, Ties) {
+  TopKTest({1, 6}, {2, 7, 2, 7, 1, 2}, 4, {1, 4},
+           {7, 7, 2, 2}, {1, 3, 0, 2});
+}
+
+TEST_F(SoftmaxTopKOpTest, Softmax) {
+  SoftmaxTopKTest({3, 37}, 5);
+  SoftmaxTopKTest({1, 2, 100}, 1);
+}
+
+TEST_F(SoftmaxTopKOpTest, LargeVocabulary) {
+  SoftmaxTopKTest({1, 30001}, 10);
+  SoftmaxTopKTest({2, 65536}, 32);
+}
+
+}  // namespace test
+}  // namespace ops
+}  // namespace mace
@@ -0,0 +1,204 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// This Op computes the spectrum of the frames of audio samples as the
+// feature extraction of Kaldi does, the input of MelFilterBank.
+// The input is [..., samples] and the output [..., frames, fft_length / 2 + 1]
+// of the frames of window_length samples every frame_shift samples, those
+// of whole windows only, as snip-edges of Kaldi. Each frame in turn has the
+// mean removed if remove_dc_offset, is pre-emphasized by
+// preemphasis_coefficient, multiplied by the window of window_type, one of
+// povey, hanning, hamming and rectangular, and zero padded to fft_length,
+// the smallest power of 2 above the window by default. The output is the
+// power of the bins, or their magnitude if power is 1.
+// With "stateful", the input is a chunk of [samples] of a stream, or
+// [1, samples], and the samples of the frames not complete yet are kept for
+// the next chunk, so that the chunks give the frames of the whole stream.
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mace/core/operator.h"
+#include "mace/ops/common/fft.h"
+
+namespace mace {
+namespace ops {
+
+template <DeviceType D, typename T>
+class SpectrogramOp;
+
+template <typename T>
+class SpectrogramOp<DeviceType::CPU, T> : public Operation {
+ public:
+  explicit SpectrogramOp(OpConstructContext *context)
+      : Operation(context),
+        window_length_(Operation::GetOptionalArg<int>("window_length", 400)),
+        frame_shift_(Operation::GetOptionalArg<int>("frame_shift", 160)),
+        preemphasis_(Operation::GetOptionalArg<float>(
+            "preemphasis_coefficient", 0.97f)),
+        remove_dc_offset_(
+            Operation::GetOptionalArg<int>("remove_dc_offset", 1) != 0),
+        power_(Operation::GetOptionalArg<int>("power", 2) == 2),
+        stateful_(Operation::GetOptionalArg<int>("stateful", 0) != 0),
+        fft_(FftLength(Operation::GetOptionalArg<int>("fft_length", 0),
+                       window_length_)),
+        window_(Window(Operation::GetOptionalArg<std::string>(
+            "window_type", "povey"), window_length_)) {
+    MACE_CHECK(window_length_ > 0 && frame_shift_ > 0,
+               "Spectrogram's window length and frame shift should be"
+               " greater than zero.");
+  }
+
+  MaceStatus Run(OpContext *context) override {
+    MACE_UNUSED(context);
+    const Tensor *input = this->Input(0);
+    Tensor *output = this->Output(0);
+    const index_t rank = input->dim_size();
+    MACE_CHECK(rank >= 1, "Spectrogram only supports input dim size >= 1");
+    const index_t samples = input->dim(rank - 1);
+    const index_t batch = input->size() / std::max<index_t>(samples, 1);
+
+    Tensor::MappingGuard input_guard(input);
+    const T *input_data = input->data<T>();
+    if (stateful_) {
+      MACE_CHECK(batch == 1,
+                 "Stateful Spectrogram takes one stream of [samples]");
+      stream_.insert(stream_.end(), input_data, input_data + samples);
+      input_data = stream_.data();
+    }
+    const index_t stream_samples =
+        stateful_ ? static_cast<index_t>(stream_.size()) : samples;
+    const index_t frames = stream_samples < window_length_ ?
+        0 : (stream_samples - window_length_) / frame_shift_ + 1;
+    const index_t num_bins = fft_.num_bins();
+
+    std::vector<index_t> output_shape(input->shape().begin(),
+                                      input->shape().end() - 1);
+    output_shape.push_back(frames);
+    output_shape.push_back(num_bins);
+    MACE_RETURN_IF_ERROR(output->Resize(output_shape));
+    Tensor::MappingGuard output_guard(output);
+    T *output_data = output->mutable_data<T>();
+
+#pragma omp parallel
+    {
+      // the padded frame, then the scratch of the FFT
+      std::vector<float> buffer(fft_.length() + fft_.scratch_size(), 0);
+#pragma omp for collapse(2) schedule(runtime)
+      for (index_t b = 0; b < batch; ++b) {
+        for (index_t f = 0; f < frames; ++f) {
+          ComputeFrame(input_data + b * stream_samples + f * frame_shift_,
+                       buffer.data(),
+                       output_data + (b * frames + f) * num_bins);
+        }
+      }
+    }
+
+    if (stateful_) {
+      stream_.erase(stream_.begin(), stream_.begin() + frames * frame_shift_);
+    }
+    return MaceStatus::MACE_SUCCESS;
+  }
+
+  void ResetState() override {
+    stream_.clear();
+  }
+
+  bool AlwaysRuns() const override { return stateful_; }
+
+ private:
+  static index_t FftLength(const int fft_length, const int window_length) {
+    if (fft_length > 0) {
+      MACE_CHECK(fft_length >= window_length,
+                 "Spectrogram's fft length should not be less than the"
+                 " window length.");
+      return fft_length;
+    }
+    index_t length = 2;
+    while (length < window_length) {
+      length *= 2;
+    }
+    return length;
+  }
+
+  static std::vector<float> Window(const std::string &type,
+                                   const int length) {
+    std::vector<float> window(std::max(length, 0));
+    const double a = 2 * M_PI / std::max(length - 1, 1);
+    for (int i = 0; i < length; ++i) {
+      const double hanning = 0.5 - 0.5 * std::cos(a * i);
+      if (type == "povey") {
+        window[i] = static_cast<float>(std::pow(hanning, 0.85));
+      } else if (type == "hanning") {
+        window[i] = static_cast<float>(hanning);
+      } else if (type == "hamming") {
+        window[i] = static_cast<float>(0.54 - 0.46 * std::cos(a * i));
+      } else if (type == "rectangular") {
+        window[i] = 1.0f;
+      } else {
+        LOG(FATAL) << "Unsupported window type of Spectrogram: " << type;
+      }
+    }
+    return window;
+  }
+
+  void ComputeFrame(const T *samples, float *buffer, T *output) const {
+    float *frame = buffer;
+    float mean = 0;
+    for (index_t i = 0; i < window_length_; ++i) {
+      frame[i] = samples[i];
+      mean += frame[i];
+    }
+    if (remove_dc_offset_) {
+      mean /= window_length_;
+      for (index_t i = 0; i < window_length_; ++i) {
+        frame[i] -= mean;
+      }
+    }
+    if (preemphasis_ != 0) {
+      for (index_t i = window_length_ - 1; i > 0; --i) {
+        frame[i] -= preemphasis_ * frame[i - 1];
+      }
+      frame[0] -= preemphasis_ * frame[0];
+    }
+    for (index_t i = 0; i < window_length_; ++i) {
+      frame[i] *= window_[i];
+    }
+    std::fill(frame + window_length_, frame + fft_.length(), 0.0f);
+    fft_.Spectrum(frame, power_, buffer + fft_.length(), output);
+  }
+
+  const index_t window_length_;
+  const index_t frame_shift_;
+  const float preemphasis_;
+  const bool remove_dc_offset_;
+  const bool power_;
+  const bool stateful_;
+  const RealFft fft_;
+  const std::vector<float> window_;
+  // the samples of the stream after the frames of the runs before
+  std::vector<T> stream_;
+};
+
+void RegisterSpectrogram(OpRegistryBase *op_registry) {
+  MACE_REGISTER_OP(op_registry, "Spectrogram", SpectrogramOp,
+                   DeviceType::CPU, float);
+}
+
+}  // namespace ops
+}  // namespace mace
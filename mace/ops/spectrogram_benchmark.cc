@@ -0,0 +1,96 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/core/testing/test_benchmark.h"
+#include "mace/ops/ops_test_util.h"
+
+namespace mace {
+namespace ops {
+namespace test {
+
+namespace {
+// the features of Kaldi of 25ms frames every 10ms at 16kHz, as the
+// spectrogram, the log mel energies or the MFCCs
+template<DeviceType D, typename T>
+void BMAudioFrontendHelper(int iters,
+                           const index_t samples,
+                           const int num_mel_bins,
+                           const int num_ceps) {
+  mace::testing::StopTiming();
+
+  OpsTestNet net;
+  net.AddRandomInput<D, float>("Input", {1, samples});
+
+  OpDefBuilder("Spectrogram", "SpectrogramBM")
+      .Input("Input")
+      .Output("Spectrum")
+      .AddIntArg("T", static_cast<int>(DataTypeToEnum<T>::value))
+      .Finalize(net.AddNewOperatorDef());
+  std::string output = "Spectrum";
+  if (num_mel_bins > 0) {
+    OpDefBuilder("MelFilterBank", "MelFilterBankBM")
+        .Input(output)
+        .Output("MelEnergy")
+        .AddIntArg("num_mel_bins", num_mel_bins)
+        .AddIntArg("T", static_cast<int>(DataTypeToEnum<T>::value))
+        .Finalize(net.AddNewOperatorDef());
+    output = "MelEnergy";
+  }
+  if (num_ceps > 0) {
+    OpDefBuilder("MFCC", "MFCCBM")
+        .Input(output)
+        .Output("Cepstrum")
+        .AddIntArg("num_ceps", num_ceps)
+        .AddIntArg("T", static_cast<int>(DataTypeToEnum<T>::value))
+        .Finalize(net.AddNewOperatorDef());
+  }
+  net.Setup(D);
+
+  // Warm-up
+  for (int i = 0; i < 5; ++i) {
+    net.Run();
+    net.Sync();
+  }
+
+  mace::testing::StartTiming();
+  while (iters--) {
+    net.Run();
+    net.Sync();
+  }
+}
+}  // namespace
+
+#define MACE_BM_AUDIO_FRONTEND_MACRO(S, M, C, TYPE, DEVICE)                  \
+  static void                                                                \
+      MACE_BM_AUDIO_FRONTEND_##S##_##M##_##C##_##TYPE##_##DEVICE(            \
+          int iters) {                                                       \
+        const int64_t tot = static_cast<int64_t>(iters) * S;                 \
+        mace::testing::BytesProcessed(tot *(sizeof(TYPE)));                  \
+        BMAudioFrontendHelper<DEVICE, TYPE>(iters, S, M, C);                 \
+      }                                                                      \
+      MACE_BENCHMARK(                                                        \
+          MACE_BM_AUDIO_FRONTEND_##S##_##M##_##C##_##TYPE##_##DEVICE)
+
+#define MACE_BM_AUDIO_FRONTEND(S, M, C)                 \
+  MACE_BM_AUDIO_FRONTEND_MACRO(S, M, C, float, CPU);
+
+MACE_BM_AUDIO_FRONTEND(16000, 0, 0);
+MACE_BM_AUDIO_FRONTEND(16000, 40, 0);
+MACE_BM_AUDIO_FRONTEND(16000, 80, 0);
+MACE_BM_AUDIO_FRONTEND(16000, 23, 13);
+MACE_BM_AUDIO_FRONTEND(1600, 23, 13);
+
+}  // namespace test
+}  // namespace ops
+}  // namespace mace
@@ -0,0 +1,141 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cmath>
+#include <vector>
+
+#include "mace/ops/ops_test_util.h"
+
+namespace mace {
+namespace ops {
+namespace test {
+
+class SpectrogramOpTest : public OpsTestBase {};
+
+namespace {
+// The rectangular frames without pre-processing give the power of their
+// DFT, for the FFT lengths of radix-4 stages only and of a radix-2 one.
+void TestDft(const index_t length, const int power) {
+  const index_t shift = length / 2;
+  const index_t batch = 2;
+  const index_t samples = 3 * length + 5;
+  const index_t frames = (samples - length) / shift + 1;
+  const index_t num_bins = length / 2 + 1;
+
+  OpsTestNet net;
+  net.AddRandomInput<CPU, float>("Input", {batch, samples});
+  OpDefBuilder("Spectrogram", "SpectrogramTest")
+      .Input("Input")
+      .Output("Output")
+      .AddIntArg("window_length", length)
+      .AddIntArg("frame_shift", shift)
+      .AddStringArg("window_type", "rectangular")
+      .AddFloatArg("preemphasis_coefficient", 0)
+      .AddIntArg("remove_dc_offset", 0)
+      .AddIntArg("power", power)
+      .Finalize(net.NewOperatorDef());
+  net.RunOp();
+
+  const float *input = net.GetTensor("Input")->data<float>();
+  std::vector<float> expected(batch * frames * num_bins);
+  for (index_t b = 0; b < batch; ++b) {
+    for (index_t f = 0; f < frames; ++f) {
+      const float *frame = input + b * samples + f * shift;
+      for (index_t k = 0; k < num_bins; ++k) {
+        double re = 0, im = 0;
+        for (index_t t = 0; t < length; ++t) {
+          const double angle = -2 * M_PI * k * t / length;
+          re += frame[t] * std::cos(angle);
+          im += frame[t] * std::sin(angle);
+        }
+        const double value = re * re + im * im;
+        expected[(b * frames + f) * num_bins + k] =
+            static_cast<float>(power == 2 ? value : std::sqrt(value));
+      }
+    }
+  }
+  net.AddInputFromArray<CPU, float>("ExpectedOutput",
+                                    {batch, frames, num_bins}, expected);
+  ExpectTensorNear<float>(*net.GetOutput("ExpectedOutput"),
+                          *net.GetOutput("Output"), 1e-4, 1e-4);
+}
+
+// The chunks of a stream give the frames of the whole of it.
+void TestStream(const std::vector<index_t> &chunks) {
+  index_t samples = 0;
+  for (index_t chunk : chunks) {
+    samples += chunk;
+  }
+  OpsTestNet net;
+  net.AddRandomInput<CPU, float>("Input", {samples});
+  OpDefBuilder("Spectrogram", "UtteranceTest")
+      .Input("Input")
+      .Output("Output")
+      .Finalize(net.NewOperatorDef());
+  net.RunOp();
+  Tensor expected;
+  expected.Copy(*net.GetOutput("Output"));
+  const float *input_data = net.GetTensor("Input")->data<float>();
+
+  OpsTestNet stream_net;
+  stream_net.AddInputFromArray<CPU, float>(
+      "Chunk", {chunks[0]},
+      std::vector<float>(input_data, input_data + chunks[0]));
+  OpDefBuilder("Spectrogram", "StreamTest")
+      .Input("Chunk")
+      .Output("ChunkOutput")
+      .AddIntArg("stateful", 1)
+      .Finalize(stream_net.NewOperatorDef());
+  stream_net.Setup(CPU);
+  for (int pass = 0; pass < 2; ++pass) {
+    std::vector<float> outputs;
+    index_t begin = 0;
+    for (index_t chunk : chunks) {
+      stream_net.AddInputFromArray<CPU, float>(
+          "Chunk", {chunk},
+          std::vector<float>(input_data + begin,
+                             input_data + begin + chunk));
+      stream_net.Run();
+      const Tensor *output = stream_net.GetOutput("ChunkOutput");
+      EXPECT_EQ(expected.dim(1), output->dim(1));
+      if (output->size() > 0) {
+        outputs.insert(outputs.end(), output->data<float>(),
+                       output->data<float>() + output->size());
+      }
+      begin += chunk;
+    }
+    ASSERT_EQ(expected.size(), static_cast<index_t>(outputs.size()));
+    for (index_t i = 0; i < expected.size(); ++i) {
+      EXPECT_EQ(expected.data<float>()[i], outputs[i]) << " with index " << i;
+    }
+    stream_net.ResetStates();
+  }
+}
+}  // namespace
+
+TEST_F(SpectrogramOpTest, Dft) {
+  for (index_t length : {4, 16, 32, 64, 512}) {
+    TestDft(length, 2);
+  }
+  TestDft(128, 1);
+}
+
+TEST_F(SpectrogramOpTest, Stateful) {
+  TestStream({100, 400, 37, 1200, 160});
+  TestStream({1600});
+}
+
+}  // namespace test
+}  // namespace ops
+}  // namespace mace
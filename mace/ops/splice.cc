@@ -27,11 +27,17 @@
 // if const_component_dim_ != 0, const_dim_ will be used to determine which
 // row of "in" we copy the last part of each row of "out" from (this part is
 // not subject to splicing, it's assumed constant for each frame of "input".
+// With "stateful", the input is a chunk of [frames, input-dim] of a stream
+// and the frames are spliced with the context of the previous chunks, see
+// FrameStream. The outputs lag the inputs by the largest context value.
 
+#include <algorithm>
 #include <functional>
 #include <memory>
+#include <vector>
 
 #include "mace/core/operator.h"
+#include "mace/ops/common/frame_stream.h"
 
 namespace mace {
 namespace ops {
@@ -46,7 +52,12 @@ class SpliceOp<DeviceType::CPU, T> : public Operation {
       : Operation(context),
         context_(Operation::GetRepeatedArgs<int>("context")),
         const_dim_(
-            Operation::GetOptionalArg<int>("const_component_dim", 0)) {}
+            Operation::GetOptionalArg<int>("const_component_dim", 0)),
+        stateful_(Operation::GetOptionalArg<int>("stateful", 0) != 0),
+        stream_(context_.empty() ? 0 : std::max(
+                    -*std::min_element(context_.begin(), context_.end()), 0),
+                context_.empty() ? 0 : std::max(
+                    *std::max_element(context_.begin(), context_.end()), 0)) {}
 
   MaceStatus Run(OpContext *context) override {
     MACE_UNUSED(context);
@@ -56,6 +67,9 @@ class SpliceOp<DeviceType::CPU, T> : public Operation {
 
     Tensor *output = this->Output(0);
     const std::vector<index_t> &input_shape = input->shape();
+    // the int16 frames of the 8x16 fully connected ops keep their scale
+    output->SetScale(input->scale());
+    output->SetZeroPoint(input->zero_point());
 
     const index_t frames =
         std::accumulate(input->shape().begin(), input->shape().end() - 1, 1,
@@ -69,6 +83,9 @@ class SpliceOp<DeviceType::CPU, T> : public Operation {
     MACE_CHECK(input_dim > const_dim_,
                "input dim should be greater than const dim.");
     const index_t output_dim = dim * num_splice + const_dim_;
+    if (stateful_) {
+      return RunStream(input, input_dim, dim, output_dim, output);
+    }
 
     std::vector<index_t> output_shape = input->shape();
     output_shape[rank - 1] = output_dim;
@@ -106,14 +123,68 @@ class SpliceOp<DeviceType::CPU, T> : public Operation {
     return MaceStatus::MACE_SUCCESS;
   }
 
+  void ResetState() override {
+    stream_.Reset();
+  }
+
+  bool AlwaysRuns() const override { return true; }
+
+ private:
+  MaceStatus RunStream(const Tensor *input,
+                       const index_t input_dim,
+                       const index_t dim,
+                       const index_t output_dim,
+                       Tensor *output) {
+    const index_t rank = input->dim_size();
+    MACE_CHECK(rank >= 2 && input->size() == input->dim(rank - 2) * input_dim,
+               "Stateful Splice takes one stream of [frames, input-dim]");
+    Tensor::MappingGuard input_guard(input);
+    stream_.Feed(input->data<T>(), input->dim(rank - 2), input_dim);
+    const index_t begin = stream_.output_begin();
+    const index_t frames = stream_.output_count();
+
+    std::vector<index_t> output_shape = input->shape();
+    output_shape[rank - 2] = frames;
+    output_shape[rank - 1] = output_dim;
+    MACE_RETURN_IF_ERROR(output->Resize(output_shape));
+    if (frames == 0) {
+      stream_.Commit();
+      return MaceStatus::MACE_SUCCESS;
+    }
+    Tensor::MappingGuard output_guard(output);
+    T *output_data = output->mutable_data<T>();
+
+    const index_t num_splice = static_cast<index_t>(context_.size());
+#pragma omp parallel for collapse(2) schedule(runtime)
+    for (index_t i = 0; i < frames; ++i) {
+      for (index_t c = 0; c < num_splice; ++c) {
+        memcpy(output_data + i * output_dim + c * dim,
+               stream_.Frame(begin + i + context_[c]), dim * sizeof(T));
+      }
+    }
+    if (const_dim_ > 0) {
+      for (index_t i = 0; i < frames; ++i) {
+        memcpy(output_data + (i + 1) * output_dim - const_dim_,
+               stream_.Frame(begin + i + context_[0]) + dim,
+               const_dim_ * sizeof(T));
+      }
+    }
+    stream_.Commit();
+    return MaceStatus::MACE_SUCCESS;
+  }
+
  private:
   std::vector<int> context_;
   int const_dim_;
+  bool stateful_;
+  FrameStream<T> stream_;
 };
 
 void RegisterSplice(OpRegistryBase *op_registry) {
   MACE_REGISTER_OP(op_registry, "Splice", SpliceOp,
                    DeviceType::CPU, float);
+  MACE_REGISTER_OP(op_registry, "Splice", SpliceOp,
+                   DeviceType::CPU, int16_t);
 }
 
 }  // namespace ops
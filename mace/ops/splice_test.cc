@@ -12,6 +12,10 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <functional>
+#include <vector>
+
 #include "mace/ops/ops_test_util.h"
 
 namespace mace {
@@ -46,6 +50,71 @@ void TestSplice(const std::vector<index_t> &input_shape,
   ExpectTensorNear<T>(*net.GetOutput("ExpectedOutput"),
                       *net.GetOutput("Output"));
 }
+
+// A stateful op fed the frames chunk by chunk, then the last frame again
+// once per lagged output, gives the outputs of the whole utterance.
+void TestStream(const char *op_type,
+                const std::function<OpDefBuilder(OpDefBuilder)> &add_args,
+                const index_t frames,
+                const index_t input_dim,
+                const std::vector<index_t> &chunks,
+                const index_t lag) {
+  OpsTestNet net;
+  net.AddRandomInput<CPU, float>("Input", {frames, input_dim});
+  add_args(OpDefBuilder(op_type, "UtteranceTest")
+               .Input("Input")
+               .Output("Output"))
+      .Finalize(net.NewOperatorDef());
+  net.RunOp();
+  Tensor expected;
+  expected.Copy(*net.GetOutput("Output"));
+  const index_t output_dim = expected.dim(1);
+
+  const float *input_data = net.GetTensor("Input")->data<float>();
+  std::vector<float> stream(input_data, input_data + frames * input_dim);
+  for (index_t i = 0; i < lag; ++i) {
+    stream.insert(stream.end(), input_data + (frames - 1) * input_dim,
+                  input_data + frames * input_dim);
+  }
+  std::vector<index_t> stream_chunks(chunks);
+  if (lag > 0) {
+    stream_chunks.push_back(lag);
+  }
+  OpsTestNet stream_net;
+  stream_net.AddInputFromArray<CPU, float>(
+      "Chunk", {chunks[0], input_dim},
+      std::vector<float>(stream.begin(),
+                         stream.begin() + chunks[0] * input_dim));
+  add_args(OpDefBuilder(op_type, "StreamTest")
+               .Input("Chunk")
+               .Output("ChunkOutput")
+               .AddIntArg("stateful", 1))
+      .Finalize(stream_net.NewOperatorDef());
+  stream_net.Setup(CPU);
+  for (int pass = 0; pass < 2; ++pass) {
+    std::vector<float> outputs;
+    index_t begin = 0;
+    for (index_t chunk : stream_chunks) {
+      stream_net.AddInputFromArray<CPU, float>(
+          "Chunk", {chunk, input_dim},
+          std::vector<float>(stream.begin() + begin * input_dim,
+                             stream.begin() + (begin + chunk) * input_dim));
+      stream_net.Run();
+      const Tensor *output = stream_net.GetOutput("ChunkOutput");
+      EXPECT_EQ(output_dim, output->dim(1));
+      if (output->size() > 0) {
+        outputs.insert(outputs.end(), output->data<float>(),
+                       output->data<float>() + output->size());
+      }
+      begin += chunk;
+    }
+    ASSERT_EQ(expected.size(), static_cast<index_t>(outputs.size()));
+    for (index_t i = 0; i < expected.size(); ++i) {
+      EXPECT_EQ(expected.data<float>()[i], outputs[i]) << " with index " << i;
+    }
+    stream_net.ResetStates();
+  }
+}
 }  // namespace
 
 TEST_F(SpliceOpTest, WithoutConstDim) {
@@ -79,6 +148,20 @@ TEST_F(SpliceOpTest, WithConstDim) {
      2, 3, 4, 3, 4, 5, 4, 5, 6, 5, 6, 7, 5, 6, 7, 5, 6, 7, 8, 9, 10, 11,
      3, 4, 5, 4, 5, 6, 5, 6, 7, 5, 6, 7, 5, 6, 7, 6, 7, 8, 9, 10, 11, 12});
 }
+
+TEST_F(SpliceOpTest, Stateful) {
+  TestStream("Splice", [](OpDefBuilder builder) {
+    return builder.AddIntsArg("context", {-2, -1, 0, 1, 2});
+  }, 13, 4, {1, 4, 3, 5}, 2);
+  TestStream("Splice", [](OpDefBuilder builder) {
+    return builder.AddIntsArg("context", {-3, 0, 3})
+        .AddIntArg("const_component_dim", 2);
+  }, 12, 6, {5, 7}, 3);
+  TestStream("Splice", [](OpDefBuilder builder) {
+    return builder.AddIntsArg("context", {-4, -2});
+  }, 10, 3, {1, 2, 7}, 0);
+}
+
 }  // namespace test
 }  // namespace ops
 }  // namespace mace
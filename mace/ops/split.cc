@@ -14,6 +14,7 @@
 
 #include <functional>
 #include <memory>
+#include <vector>
 
 #include "mace/core/operator.h"
 #ifdef MACE_ENABLE_OPENCL
@@ -75,13 +76,34 @@ class SplitOp<DeviceType::CPU, T> : public Operation {
       output_ptrs[i] = output_list[i]->mutable_data<T>();
     }
     const T *input_ptr = input->data<T>();
+    const T *input_end = input_ptr + input->size();
+    const index_t output_size = output_channels * inner_size;
+
+    // the memory optimizer plans the outputs as views into the input when
+    // they are contiguous slices of it, those are already in place
+    std::vector<bool> in_place(outputs_count, false);
+    bool overlapped = false;
+    for (size_t i = 0; i < outputs_count; ++i) {
+      in_place[i] = outer_size == 1 &&
+          output_ptrs[i] == input_ptr + i * output_size;
+      overlapped |= !in_place[i] && output_ptrs[i] < input_end &&
+          output_ptrs[i] + output_size * outer_size > input_ptr;
+    }
+    std::vector<T> input_copy;
+    if (overlapped) {
+      // views whose shapes changed, don't overwrite the input before reading
+      input_copy.assign(input_ptr, input_end);
+      input_ptr = input_copy.data();
+    }
 
 #pragma omp parallel for
     for (int outer_idx = 0; outer_idx < outer_size; ++outer_idx) {
       index_t input_idx = outer_idx * input_channels * inner_size;
       index_t output_idx = outer_idx * output_channels * inner_size;
       for (size_t i = 0; i < outputs_count; ++i) {
-        if (DataTypeCanUseMemcpy(DataTypeToEnum<T>::v())) {
+        if (in_place[i]) {
+          // written by the producer of the input
+        } else if (DataTypeCanUseMemcpy(DataTypeToEnum<T>::v())) {
           memcpy(output_ptrs[i]+output_idx, input_ptr+input_idx,
                  output_channels * inner_size * sizeof(T));
         } else {
@@ -63,6 +63,7 @@ void SqrDiffMean(int iters, int batch, int channels,
     MACE_BM_SQRDIFF_MEAN_##N##_##C##_##H##_##W##_##TYPE##_##DEVICE(\
       int iters) {                                                   \
     const int64_t tot = static_cast<int64_t>(iters) * N * C * H * W; \
+    mace::testing::MacsProcessed(tot);                               \
     mace::testing::BytesProcessed(tot *(sizeof(TYPE)));              \
     SqrDiffMean<DEVICE, TYPE>(iters, N, C, H, W);        \
   }                                                                  \
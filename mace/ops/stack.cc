@@ -52,10 +52,7 @@ class StackOp : public Operation {
     // Output is on host, no need to map data
     Tensor::MappingGuard output_guard(output);
     auto *output_data = output->mutable_data<T>();
-    std::vector<const T *> input_data(inputs.size());
-    for (size_t i = 0; i < inputs.size(); ++i) {
-      input_data[i] = inputs[i]->data<T>();
-    }
+    const T *output_end = output_data + output->size();
 
     index_t high_dim_elem_size =
         std::accumulate(input_shape.begin(), input_shape.begin() + axis_, 1,
@@ -63,10 +60,32 @@ class StackOp : public Operation {
     index_t low_dim_elem_size =
         std::accumulate(input_shape.begin() + axis_, input_shape.end(), 1,
                         std::multiplies<index_t>());
+
+    // the memory optimizer plans the inputs as views into the output when
+    // they are contiguous slices of it, those are already in place
+    std::vector<const T *> input_data(inputs.size());
+    std::vector<bool> in_place(inputs.size(), false);
+    std::vector<std::vector<T>> input_copies;
+    input_copies.reserve(inputs.size());
+    for (size_t i = 0; i < inputs.size(); ++i) {
+      input_data[i] = inputs[i]->data<T>();
+      in_place[i] = high_dim_elem_size == 1 &&
+          input_data[i] == output_data + i * low_dim_elem_size;
+      if (!in_place[i] && input_data[i] < output_end &&
+          input_data[i] + inputs[i]->size() > output_data) {
+        // a view whose shape changed, don't overwrite it before it is read
+        input_copies.emplace_back(input_data[i],
+                                  input_data[i] + inputs[i]->size());
+        input_data[i] = input_copies.back().data();
+      }
+    }
+
     for (index_t h = 0; h < high_dim_elem_size; ++h) {
       for (size_t i = 0; i < inputs.size(); ++i) {
-        memcpy(output_data, input_data[i] + h * low_dim_elem_size,
-               sizeof(T) * low_dim_elem_size);
+        if (!in_place[i]) {
+          memcpy(output_data, input_data[i] + h * low_dim_elem_size,
+                 sizeof(T) * low_dim_elem_size);
+        }
         output_data += low_dim_elem_size;
       }
     }
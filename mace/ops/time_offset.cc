@@ -14,11 +14,17 @@
 
 // This Op is for offset descriptor in Kaldi.
 // It defines time offset.
+// With "stateful", the input is a chunk of [frames, dim] of a stream and
+// the offset frames may come from the previous chunks, see FrameStream.
+// The outputs lag the inputs by a positive offset.
 
+#include <algorithm>
 #include <functional>
 #include <memory>
+#include <vector>
 
 #include "mace/core/operator.h"
+#include "mace/ops/common/frame_stream.h"
 
 namespace mace {
 namespace ops {
@@ -31,7 +37,9 @@ class TimeOffsetOp<DeviceType::CPU, T> : public Operation {
  public:
   explicit TimeOffsetOp(OpConstructContext *context)
       : Operation(context),
-        offset_(Operation::GetOptionalArg<int>("offset", 0)) {}
+        offset_(Operation::GetOptionalArg<int>("offset", 0)),
+        stateful_(Operation::GetOptionalArg<int>("stateful", 0) != 0),
+        stream_(std::max(-offset_, 0), std::max(offset_, 0)) {}
 
   MaceStatus Run(OpContext *context) override {
     MACE_UNUSED(context);
@@ -46,6 +54,10 @@ class TimeOffsetOp<DeviceType::CPU, T> : public Operation {
                         std::multiplies<index_t>());
     const index_t frames = input_shape[rank - 2];
     const index_t input_dim = input_shape[rank - 1];
+    if (stateful_) {
+      MACE_CHECK(batch == 1, "Stateful TimeOffset takes one stream");
+      return RunStream(input, frames, input_dim, output);
+    }
     MACE_RETURN_IF_ERROR(output->ResizeLike(input));
 
     Tensor::MappingGuard input_guard(input);
@@ -67,8 +79,43 @@ class TimeOffsetOp<DeviceType::CPU, T> : public Operation {
     return MaceStatus::MACE_SUCCESS;
   }
 
+  void ResetState() override {
+    stream_.Reset();
+  }
+
+  bool AlwaysRuns() const override { return true; }
+
+ private:
+  MaceStatus RunStream(const Tensor *input,
+                       const index_t input_frames,
+                       const index_t input_dim,
+                       Tensor *output) {
+    Tensor::MappingGuard input_guard(input);
+    stream_.Feed(input->data<T>(), input_frames, input_dim);
+    const index_t begin = stream_.output_begin();
+    const index_t frames = stream_.output_count();
+
+    std::vector<index_t> output_shape = input->shape();
+    output_shape[output_shape.size() - 2] = frames;
+    MACE_RETURN_IF_ERROR(output->Resize(output_shape));
+    if (frames == 0) {
+      stream_.Commit();
+      return MaceStatus::MACE_SUCCESS;
+    }
+    Tensor::MappingGuard output_guard(output);
+    T *output_data = output->mutable_data<T>();
+    for (index_t i = 0; i < frames; ++i) {
+      memcpy(output_data + i * input_dim, stream_.Frame(begin + i + offset_),
+             input_dim * sizeof(T));
+    }
+    stream_.Commit();
+    return MaceStatus::MACE_SUCCESS;
+  }
+
  private:
   int offset_;
+  bool stateful_;
+  FrameStream<T> stream_;
 };
 
 void RegisterTimeOffset(OpRegistryBase *op_registry) {
@@ -86,6 +86,10 @@ MACE_BM_TRANSPOSE4D(1, 2, 512, 512, 0, 2, 3, 1);
 MACE_BM_TRANSPOSE4D(1, 64, 64, 512, 0, 3, 1, 2);
 MACE_BM_TRANSPOSE4D(1, 512, 64, 64, 0, 2, 3, 1);
 MACE_BM_TRANSPOSE4D(1, 4, 20, 64, 0, 2, 1, 3);
+MACE_BM_TRANSPOSE4D(1, 720, 1280, 3, 0, 3, 1, 2);
+MACE_BM_TRANSPOSE4D(1, 3, 720, 1280, 0, 2, 3, 1);
+MACE_BM_TRANSPOSE4D(1, 56, 56, 64, 0, 1, 3, 2);
+MACE_BM_TRANSPOSE4D(8, 128, 12, 64, 0, 2, 1, 3);
 MACE_BM_TRANSPOSE2D(128, 128);
 MACE_BM_TRANSPOSE2D(512, 512);
 MACE_BM_TRANSPOSE2D(1024, 1024);
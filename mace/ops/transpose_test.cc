@@ -12,6 +12,9 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <vector>
+
 #include "mace/ops/ops_test_util.h"
 
 namespace mace {
@@ -101,6 +104,73 @@ TEST_F(TransposeOpTest, Rank2) {
                           *net.GetOutput("Output"));
 }
 
+TEST_F(TransposeOpTest, Rank3) {
+  // Construct graph
+  OpsTestNet net;
+  // Add input data
+  net.AddInputFromArray<CPU, float>("Input", {2, 3, 2},
+                                    {1, 2, 3, 4, 5, 6,
+                                     7, 8, 9, 10, 11, 12});
+
+  OpDefBuilder("Transpose", "TransposeRank3Test")
+      .Input("Input")
+      .Output("Output")
+      .AddIntsArg("dims", {2, 0, 1})
+      .Finalize(net.NewOperatorDef());
+
+  // Run on cpu
+  net.RunOp();
+
+  net.AddInputFromArray<CPU, float>("ExpectedOutput", {2, 2, 3},
+                                    {1, 3, 5, 7, 9, 11,
+                                     2, 4, 6, 8, 10, 12});
+
+  ExpectTensorNear<float>(*net.GetOutput("ExpectedOutput"),
+                          *net.GetOutput("Output"));
+}
+
+TEST_F(TransposeOpTest, Permutations) {
+  const std::vector<index_t> input_shape = {2, 9, 37, 5};
+  std::vector<int> dims = {0, 1, 2, 3};
+  do {
+    // Construct graph
+    OpsTestNet net;
+    // Add input data
+    net.AddRandomInput<CPU, float>("Input", input_shape);
+
+    OpDefBuilder("Transpose", "TransposePermutationTest")
+        .Input("Input")
+        .Output("Output")
+        .AddIntsArg("dims", dims)
+        .Finalize(net.NewOperatorDef());
+
+    // Run on cpu
+    net.RunOp();
+
+    const Tensor *input = net.GetTensor("Input");
+    const Tensor *output = net.GetOutput("Output");
+    const float *input_data = input->data<float>();
+    const float *output_data = output->data<float>();
+    index_t idx[4];
+    for (idx[0] = 0; idx[0] < input_shape[0]; ++idx[0]) {
+      for (idx[1] = 0; idx[1] < input_shape[1]; ++idx[1]) {
+        for (idx[2] = 0; idx[2] < input_shape[2]; ++idx[2]) {
+          for (idx[3] = 0; idx[3] < input_shape[3]; ++idx[3]) {
+            const index_t in_offset =
+                ((idx[0] * input_shape[1] + idx[1]) * input_shape[2]
+                    + idx[2]) * input_shape[3] + idx[3];
+            const index_t out_offset =
+                ((idx[dims[0]] * output->dim(1) + idx[dims[1]])
+                    * output->dim(2) + idx[dims[2]]) * output->dim(3)
+                    + idx[dims[3]];
+            ASSERT_EQ(input_data[in_offset], output_data[out_offset]);
+          }
+        }
+      }
+    }
+  } while (std::next_permutation(dims.begin(), dims.end()));
+}
+
 }  // namespace test
 }  // namespace ops
 }  // namespace mace
@@ -57,12 +57,33 @@ class UnstackOp : public Operation {
         std::accumulate(input_shape.begin() + axis_ + 1, input_shape.end(), 1,
                         std::multiplies<index_t>());
 
+    // the memory optimizer plans the outputs as views into the input when
+    // they are contiguous slices of it, those are already in place
+    const index_t outputs_count = input_shape[axis_];
+    const T *input_end = input_data + input->size();
+    std::vector<bool> in_place(outputs_count, false);
+    bool overlapped = false;
+    for (index_t i = 0; i < outputs_count; ++i) {
+      in_place[i] = high_dim_elem_size == 1 &&
+          output_data[i] == input_data + i * low_dim_elem_size;
+      overlapped |= !in_place[i] && output_data[i] < input_end &&
+          output_data[i] + outputs[i]->size() > input_data;
+    }
+    std::vector<T> input_copy;
+    if (overlapped) {
+      // views whose shapes changed, don't overwrite the input before reading
+      input_copy.assign(input_data, input_end);
+      input_data = input_copy.data();
+    }
+
     for (index_t h = 0; h < high_dim_elem_size; ++h) {
       int input_idx = h * input_shape[axis_] * low_dim_elem_size;
       int output_idx = h * low_dim_elem_size;
-      for (index_t i = 0; i < input_shape[axis_]; ++i) {
-        memcpy(output_data[i] + output_idx, input_data + input_idx,
-               sizeof(T) * low_dim_elem_size);
+      for (index_t i = 0; i < outputs_count; ++i) {
+        if (!in_place[i]) {
+          memcpy(output_data[i] + output_idx, input_data + input_idx,
+                 sizeof(T) * low_dim_elem_size);
+        }
         input_idx += low_dim_elem_size;
       }
     }
@@ -0,0 +1,254 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/ops/x86/avx2/sgemm_kernel.h"
+
+#include <algorithm>
+
+#if defined(__x86_64__) && defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#endif
+
+#include "mace/core/macros.h"
+#include "mace/utils/logging.h"
+
+namespace mace {
+namespace ops {
+namespace x86 {
+namespace avx2 {
+
+#if defined(__x86_64__) && defined(__AVX2__) && defined(__FMA__)
+
+namespace {
+
+// rows of the output block of a microkernel: 12 accumulators of 6 rows by
+// 16 columns, 2 of rhs and 1 of lhs fill 15 of the 16 ymm registers
+constexpr int kRowBlock = 6;
+constexpr index_t kColBlock = 16;
+
+// the mask of the first n < 8 lanes
+inline __m256i TailMask(const index_t n) {
+  static const int32_t kLanes[16] = {-1, -1, -1, -1, -1, -1, -1, -1,
+                                     0, 0, 0, 0, 0, 0, 0, 0};
+  return _mm256_loadu_si256(
+      reinterpret_cast<const __m256i *>(kLanes + 8 - n));
+}
+
+inline float HorizontalSum(const __m256 v) {
+  __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v),
+                          _mm256_extractf128_ps(v, 1));
+  sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+  sum = _mm_add_ss(sum, _mm_movehdup_ps(sum));
+  return _mm_cvtss_f32(sum);
+}
+
+// R rows by 16 columns of c
+template <int R>
+void Block16(const float *a,
+             const index_t lda,
+             const float *b,
+             const index_t ldb,
+             const index_t depth,
+             float *c,
+             const index_t ldc) {
+  __m256 vc0[R];
+  __m256 vc1[R];
+  for (int r = 0; r < R; ++r) {
+    vc0[r] = _mm256_setzero_ps();
+    vc1[r] = _mm256_setzero_ps();
+  }
+  for (index_t d = 0; d < depth; ++d) {
+    const __m256 vb0 = _mm256_loadu_ps(b + d * ldb);
+    const __m256 vb1 = _mm256_loadu_ps(b + d * ldb + 8);
+    for (int r = 0; r < R; ++r) {
+      const __m256 va = _mm256_broadcast_ss(a + r * lda + d);
+      vc0[r] = _mm256_fmadd_ps(va, vb0, vc0[r]);
+      vc1[r] = _mm256_fmadd_ps(va, vb1, vc1[r]);
+    }
+  }
+  for (int r = 0; r < R; ++r) {
+    _mm256_storeu_ps(c + r * ldc, vc0[r]);
+    _mm256_storeu_ps(c + r * ldc + 8, vc1[r]);
+  }
+}
+
+// R rows by cols <= 8 columns of c
+template <int R>
+void Block8(const float *a,
+            const index_t lda,
+            const float *b,
+            const index_t ldb,
+            const index_t cols,
+            const index_t depth,
+            float *c,
+            const index_t ldc) {
+  const __m256i mask = TailMask(cols);
+  __m256 vc[R];
+  for (int r = 0; r < R; ++r) {
+    vc[r] = _mm256_setzero_ps();
+  }
+  for (index_t d = 0; d < depth; ++d) {
+    const __m256 vb = _mm256_maskload_ps(b + d * ldb, mask);
+    for (int r = 0; r < R; ++r) {
+      const __m256 va = _mm256_broadcast_ss(a + r * lda + d);
+      vc[r] = _mm256_fmadd_ps(va, vb, vc[r]);
+    }
+  }
+  for (int r = 0; r < R; ++r) {
+    _mm256_maskstore_ps(c + r * ldc, mask, vc[r]);
+  }
+}
+
+template <int R>
+void BlockRows(const float *a,
+               const index_t lda,
+               const float *b,
+               const index_t ldb,
+               const index_t cols,
+               const index_t depth,
+               float *c,
+               const index_t ldc) {
+  index_t col = 0;
+  for (; col + kColBlock <= cols; col += kColBlock) {
+    Block16<R>(a, lda, b + col, ldb, depth, c + col, ldc);
+  }
+  for (; col < cols; col += 8) {
+    Block8<R>(a, lda, b + col, ldb, std::min<index_t>(8, cols - col), depth,
+              c + col, ldc);
+  }
+}
+
+}  // namespace
+
+bool HasAvx2Kernel() {
+  return true;
+}
+
+void Sgemm(const float *a,
+           const index_t lda,
+           const float *b,
+           const index_t ldb,
+           const index_t rows,
+           const index_t cols,
+           const index_t depth,
+           float *c,
+           const index_t ldc) {
+  index_t row = 0;
+  for (; row + kRowBlock <= rows; row += kRowBlock) {
+    BlockRows<kRowBlock>(a + row * lda, lda, b, ldb, cols, depth,
+                         c + row * ldc, ldc);
+  }
+  const float *a_tail = a + row * lda;
+  float *c_tail = c + row * ldc;
+  switch (rows - row) {
+    case 5:
+      BlockRows<5>(a_tail, lda, b, ldb, cols, depth, c_tail, ldc);
+      break;
+    case 4:
+      BlockRows<4>(a_tail, lda, b, ldb, cols, depth, c_tail, ldc);
+      break;
+    case 3:
+      BlockRows<3>(a_tail, lda, b, ldb, cols, depth, c_tail, ldc);
+      break;
+    case 2:
+      BlockRows<2>(a_tail, lda, b, ldb, cols, depth, c_tail, ldc);
+      break;
+    case 1:
+      BlockRows<1>(a_tail, lda, b, ldb, cols, depth, c_tail, ldc);
+      break;
+    default:
+      break;
+  }
+}
+
+void Sgemv(const float *a,
+           const float *x,
+           const float *bias,
+           const index_t rows,
+           const index_t depth,
+           float *y) {
+  for (index_t r = 0; r < rows; ++r) {
+    const float *a_row = a + r * depth;
+    __m256 vsum0 = _mm256_setzero_ps();
+    __m256 vsum1 = _mm256_setzero_ps();
+    index_t d = 0;
+    for (; d + 16 <= depth; d += 16) {
+      vsum0 = _mm256_fmadd_ps(_mm256_loadu_ps(a_row + d),
+                              _mm256_loadu_ps(x + d), vsum0);
+      vsum1 = _mm256_fmadd_ps(_mm256_loadu_ps(a_row + d + 8),
+                              _mm256_loadu_ps(x + d + 8), vsum1);
+    }
+    if (d + 8 <= depth) {
+      vsum0 = _mm256_fmadd_ps(_mm256_loadu_ps(a_row + d),
+                              _mm256_loadu_ps(x + d), vsum0);
+      d += 8;
+    }
+    if (d < depth) {
+      const __m256i mask = TailMask(depth - d);
+      vsum1 = _mm256_fmadd_ps(_mm256_maskload_ps(a_row + d, mask),
+                              _mm256_maskload_ps(x + d, mask), vsum1);
+    }
+    float sum = HorizontalSum(_mm256_add_ps(vsum0, vsum1));
+    y[r] = bias == nullptr ? sum : sum + bias[r];
+  }
+}
+
+#else
+
+bool HasAvx2Kernel() {
+  return false;
+}
+
+void Sgemm(const float *a,
+           const index_t lda,
+           const float *b,
+           const index_t ldb,
+           const index_t rows,
+           const index_t cols,
+           const index_t depth,
+           float *c,
+           const index_t ldc) {
+  MACE_UNUSED(a);
+  MACE_UNUSED(lda);
+  MACE_UNUSED(b);
+  MACE_UNUSED(ldb);
+  MACE_UNUSED(rows);
+  MACE_UNUSED(cols);
+  MACE_UNUSED(depth);
+  MACE_UNUSED(c);
+  MACE_UNUSED(ldc);
+  LOG(FATAL) << "Built without AVX2 and FMA";
+}
+
+void Sgemv(const float *a,
+           const float *x,
+           const float *bias,
+           const index_t rows,
+           const index_t depth,
+           float *y) {
+  MACE_UNUSED(a);
+  MACE_UNUSED(x);
+  MACE_UNUSED(bias);
+  MACE_UNUSED(rows);
+  MACE_UNUSED(depth);
+  MACE_UNUSED(y);
+  LOG(FATAL) << "Built without AVX2 and FMA";
+}
+
+#endif  // __x86_64__ && __AVX2__ && __FMA__
+
+}  // namespace avx2
+}  // namespace x86
+}  // namespace ops
+}  // namespace mace
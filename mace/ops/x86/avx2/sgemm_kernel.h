@@ -0,0 +1,57 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_OPS_X86_AVX2_SGEMM_KERNEL_H_
+#define MACE_OPS_X86_AVX2_SGEMM_KERNEL_H_
+
+#include "mace/core/types.h"
+
+// Float gemm and gemv kernels of AVX2 and FMA instructions, only called on
+// cores with both extensions, see CPUFeatures::avx2 and CPUFeatures::fma.
+
+namespace mace {
+namespace ops {
+namespace x86 {
+namespace avx2 {
+
+// whether this build has the kernels, false unless compiled for x86-64
+// with -mavx2 -mfma
+bool HasAvx2Kernel();
+
+// c = a * b of row-major matrices: a of rows x depth, b of depth x cols and
+// c of rows x cols, whose rows are lda, ldb and ldc floats apart
+void Sgemm(const float *a,
+           const index_t lda,
+           const float *b,
+           const index_t ldb,
+           const index_t rows,
+           const index_t cols,
+           const index_t depth,
+           float *c,
+           const index_t ldc);
+
+// y = a * x + bias of a row-major matrix a of rows x depth, bias may be null
+void Sgemv(const float *a,
+           const float *x,
+           const float *bias,
+           const index_t rows,
+           const index_t depth,
+           float *y);
+
+}  // namespace avx2
+}  // namespace x86
+}  // namespace ops
+}  // namespace mace
+
+#endif  // MACE_OPS_X86_AVX2_SGEMM_KERNEL_H_
@@ -0,0 +1,134 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/ops/x86/fp32/conv_2d.h"
+
+#include <cstring>
+#include <vector>
+
+#include "mace/ops/common/conv_pool_2d_util.h"
+#include "mace/ops/x86/fp32/gemm.h"
+
+namespace mace {
+namespace ops {
+namespace x86 {
+namespace fp32 {
+
+MaceStatus Conv2d::Compute(const OpContext *context,
+                           const Tensor *input,
+                           const Tensor *filter,
+                           Tensor *output) {
+  if (!HasAvx2Gemm()) {
+    return ref_conv2d_.Compute(context, input, filter, output);
+  }
+
+  const std::vector<index_t> in_shape = input->shape();
+  const std::vector<index_t> filter_shape = filter->shape();
+  const std::vector<int> stride_hw{stride_h_, stride_w_};
+  const std::vector<int> dilation_hw{dilation_h_, dilation_w_};
+  const std::vector<int> paddings{pad_h_, pad_w_};
+  const index_t pad_top = pad_h_ >> 1;
+  const index_t pad_left = pad_w_ >> 1;
+
+  std::vector<index_t> output_shape(4);
+  CalcOutputSize(in_shape.data(),
+                 NCHW,
+                 filter_shape.data(),
+                 OIHW,
+                 paddings.data(),
+                 dilation_hw.data(),
+                 stride_hw.data(),
+                 RoundType::FLOOR,
+                 output_shape.data());
+  MACE_RETURN_IF_ERROR(output->Resize(output_shape));
+
+  const index_t in_channels = filter_shape[1];
+  const index_t in_height = in_shape[2];
+  const index_t in_width = in_shape[3];
+  const index_t out_channels = filter_shape[0];
+  const index_t out_height = output_shape[2];
+  const index_t out_width = output_shape[3];
+  const index_t kernel_h = filter_shape[2];
+  const index_t kernel_w = filter_shape[3];
+  const index_t in_image_size = in_height * in_width;
+  const index_t out_image_size = out_height * out_width;
+  // the rows of the im2col, one per input channel and kernel position
+  const index_t depth = in_channels * kernel_h * kernel_w;
+  const bool is_gemm = kernel_h == 1 && kernel_w == 1 && stride_h_ == 1 &&
+      stride_w_ == 1 && pad_h_ == 0 && pad_w_ == 0;
+
+  Tensor::MappingGuard input_guard(input);
+  Tensor::MappingGuard filter_guard(filter);
+  Tensor::MappingGuard output_guard(output);
+  const float *input_data = input->data<float>();
+  const float *filter_data = filter->data<float>();
+  float *output_data = output->mutable_data<float>();
+
+  float *col_data = nullptr;
+  if (!is_gemm) {
+    ScratchBuffer *scratch = &tmp_scratch_buffer_;
+    if (context != nullptr &&
+        context->device()->scratch_buffer() != nullptr) {
+      scratch = context->device()->scratch_buffer();
+    }
+    scratch->Rewind();
+    const index_t col_size =
+        PadAlignSize(sizeof(float) * depth * out_image_size);
+    MACE_RETURN_IF_ERROR(scratch->GrowSize(col_size));
+    col_data = scratch->Scratch(col_size).mutable_data<float>();
+  }
+
+  for (index_t b = 0; b < in_shape[0]; ++b) {
+    const float *in_ptr = input_data + b * in_channels * in_image_size;
+    if (!is_gemm) {
+#pragma omp parallel for collapse(3) schedule(runtime)
+      for (index_t c = 0; c < in_channels; ++c) {
+        for (index_t kh = 0; kh < kernel_h; ++kh) {
+          for (index_t kw = 0; kw < kernel_w; ++kw) {
+            const float *in_channel = in_ptr + c * in_image_size;
+            float *col_ptr = col_data +
+                ((c * kernel_h + kh) * kernel_w + kw) * out_image_size;
+            for (index_t h = 0; h < out_height; ++h) {
+              const index_t ih = -pad_top + h * stride_h_ + kh * dilation_h_;
+              float *col_row = col_ptr + h * out_width;
+              if (ih < 0 || ih >= in_height) {
+                memset(col_row, 0, out_width * sizeof(float));
+                continue;
+              }
+              for (index_t w = 0; w < out_width; ++w) {
+                const index_t iw =
+                    -pad_left + w * stride_w_ + kw * dilation_w_;
+                col_row[w] = iw >= 0 && iw < in_width ?
+                    in_channel[ih * in_width + iw] : 0.f;
+              }
+            }  // h
+          }  // kw
+        }  // kh
+      }  // c
+    }
+    ParallelSgemm(filter_data,
+                  is_gemm ? in_ptr : col_data,
+                  out_channels,
+                  out_image_size,
+                  depth,
+                  output_data + b * out_channels * out_image_size);
+  }  // b
+
+  return MaceStatus::MACE_SUCCESS;
+}
+
+}  // namespace fp32
+}  // namespace x86
+}  // namespace ops
+}  // namespace mace
@@ -0,0 +1,74 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_OPS_X86_FP32_CONV_2D_H_
+#define MACE_OPS_X86_FP32_CONV_2D_H_
+
+#include "mace/public/mace.h"
+#include "mace/core/tensor.h"
+#include "mace/core/op_context.h"
+#include "mace/ops/ref/conv_2d.h"
+
+namespace mace {
+namespace ops {
+namespace x86 {
+namespace fp32 {
+
+// NCHW convolution of an OIHW filter as a gemm of the filter and the
+// im2col of the input, which 1x1 convolutions of stride 1 without padding
+// skip. Of the AVX2 kernels on x86-64 cores with AVX2 and FMA, and of
+// ref::Conv2d on the others.
+class Conv2d {
+ public:
+  Conv2d(int pad_h,
+         int pad_w,
+         int stride_h,
+         int stride_w,
+         int dilation_h,
+         int dilation_w)
+      : pad_h_(pad_h),
+        pad_w_(pad_w),
+        stride_h_(stride_h),
+        stride_w_(stride_w),
+        dilation_h_(dilation_h),
+        dilation_w_(dilation_w),
+        tmp_scratch_buffer_(GetCPUAllocator()),
+        ref_conv2d_(pad_h, pad_w, stride_h, stride_w, dilation_h,
+                    dilation_w) {}
+  ~Conv2d() {}
+
+  MaceStatus Compute(
+      const OpContext *context,
+      const Tensor *input,
+      const Tensor *filter,
+      Tensor *output);
+
+ private:
+  int pad_h_;
+  int pad_w_;
+  int stride_h_;
+  int stride_w_;
+  int dilation_h_;
+  int dilation_w_;
+  // holds the im2col of the input
+  ScratchBuffer tmp_scratch_buffer_;
+  ref::Conv2d<float> ref_conv2d_;
+};
+
+}  // namespace fp32
+}  // namespace x86
+}  // namespace ops
+}  // namespace mace
+
+#endif  // MACE_OPS_X86_FP32_CONV_2D_H_
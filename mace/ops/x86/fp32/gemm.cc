@@ -0,0 +1,237 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/ops/x86/fp32/gemm.h"
+
+#include <algorithm>
+
+#include "mace/core/runtime/cpu/cpu_runtime.h"
+#include "mace/ops/x86/avx2/sgemm_kernel.h"
+#include "mace/utils/utils.h"
+
+namespace mace {
+namespace ops {
+namespace x86 {
+namespace fp32 {
+
+namespace {
+
+// output block of a task: a multiple of the 6 rows of the kernel, and
+// columns whose rhs rows stay in the L2 cache across the rows of the block
+const index_t kRowTaskSize = 48;
+const index_t kColTaskSize = 256;
+
+// dst = src of a rows x cols matrix, row-major
+void ToRowMajor(const MatrixMap<const float> &src, float *dst) {
+  const index_t rows = src.rows();
+  const index_t cols = src.cols();
+#pragma omp parallel for schedule(runtime)
+  for (index_t r = 0; r < rows; ++r) {
+    for (index_t c = 0; c < cols; ++c) {
+      dst[r * cols + c] = src(r, c);
+    }
+  }
+}
+
+}  // namespace
+
+bool HasAvx2Gemm() {
+  const CPUFeatures &features = GetCPUFeatures();
+  return features.avx2 && features.fma && avx2::HasAvx2Kernel();
+}
+
+void ParallelSgemm(const float *a,
+                   const float *b,
+                   const index_t rows,
+                   const index_t cols,
+                   const index_t depth,
+                   float *c) {
+  const index_t row_task_count = RoundUpDiv(rows, kRowTaskSize);
+  const index_t col_task_count = RoundUpDiv(cols, kColTaskSize);
+#pragma omp parallel for collapse(2) schedule(runtime)
+  for (index_t row_task = 0; row_task < row_task_count; ++row_task) {
+    for (index_t col_task = 0; col_task < col_task_count; ++col_task) {
+      const index_t start_row = row_task * kRowTaskSize;
+      const index_t start_col = col_task * kColTaskSize;
+      avx2::Sgemm(a + start_row * depth,
+                  depth,
+                  b + start_col,
+                  cols,
+                  std::min(kRowTaskSize, rows - start_row),
+                  std::min(kColTaskSize, cols - start_col),
+                  depth,
+                  c + start_row * cols + start_col,
+                  cols);
+    }
+  }
+}
+
+MaceStatus Gemm::Compute(const OpContext *context,
+                         const Tensor *lhs,
+                         const Tensor *rhs,
+                         const index_t batch,
+                         const index_t rows,
+                         const index_t cols,
+                         const index_t depth,
+                         const MatrixMajor lhs_major,
+                         const MatrixMajor rhs_major,
+                         const MatrixMajor output_major,
+                         const bool lhs_batched,
+                         const bool rhs_batched,
+                         Tensor *output) {
+  return Compute(context,
+                 lhs,
+                 rhs,
+                 MatrixBatch(batch, lhs_batched, lhs_major, rows, depth),
+                 MatrixBatch(batch, rhs_batched, rhs_major, depth, cols),
+                 rows,
+                 cols,
+                 depth,
+                 output_major,
+                 output);
+}
+
+MaceStatus Gemm::Compute(const OpContext *context,
+                         const Tensor *lhs,
+                         const Tensor *rhs,
+                         const MatrixBatch &lhs_batch,
+                         const MatrixBatch &rhs_batch,
+                         const index_t rows,
+                         const index_t cols,
+                         const index_t depth,
+                         const MatrixMajor output_major,
+                         Tensor *output) {
+  if (!HasAvx2Gemm()) {
+    return ref_gemm_.Compute(context, lhs, rhs, lhs_batch, rhs_batch, rows,
+                             cols, depth, output_major, output);
+  }
+  const index_t batch = lhs_batch.size();
+  MACE_CHECK(rhs_batch.size() == batch,
+             "lhs and rhs have different batches: ", batch, " vs. ",
+             rhs_batch.size());
+  MACE_CHECK(output->size() == batch * rows * cols,
+             "Need resize output tensor before call gemm.");
+  Tensor::MappingGuard lhs_guard(lhs);
+  Tensor::MappingGuard rhs_guard(rhs);
+  Tensor::MappingGuard output_guard(output);
+  const float *lhs_data = lhs->data<float>();
+  const float *rhs_data = rhs->data<float>();
+  float *output_data = output->mutable_data<float>();
+
+  tmp_scratch_buffer_.Rewind();
+  ScratchBuffer *scratch = &tmp_scratch_buffer_;
+  if (context != nullptr && context->device()->scratch_buffer() != nullptr) {
+    scratch = context->device()->scratch_buffer();
+  }
+  // the kernels read contiguous row-major operands
+  const bool lhs_row_major =
+      lhs_batch.major == RowMajor && lhs_batch.stride == depth;
+  const bool rhs_row_major =
+      rhs_batch.major == RowMajor && rhs_batch.stride == cols;
+  const index_t lhs_size = lhs_row_major ?
+      0 : PadAlignSize(sizeof(float) * rows * depth);
+  const index_t rhs_size = rhs_row_major ?
+      0 : PadAlignSize(sizeof(float) * depth * cols);
+  const index_t output_size = output_major == RowMajor ?
+      0 : PadAlignSize(sizeof(float) * rows * cols);
+  MACE_RETURN_IF_ERROR(scratch->GrowSize(lhs_size + rhs_size + output_size));
+  float *row_major_lhs = lhs_size == 0 ?
+      nullptr : scratch->Scratch(lhs_size).mutable_data<float>();
+  float *row_major_rhs = rhs_size == 0 ?
+      nullptr : scratch->Scratch(rhs_size).mutable_data<float>();
+  float *row_major_output = output_size == 0 ?
+      nullptr : scratch->Scratch(output_size).mutable_data<float>();
+
+  for (index_t b = 0; b < batch; ++b) {
+    const float *lhs_ptr = lhs_data + lhs_batch.offsets[b];
+    const float *rhs_ptr = rhs_data + rhs_batch.offsets[b];
+    float *output_ptr = output_data + b * rows * cols;
+
+    // a broadcast operand is copied once for the batches reading it
+    const bool lhs_repeated = b > 0 &&
+        lhs_batch.offsets[b] == lhs_batch.offsets[b - 1];
+    const bool rhs_repeated = b > 0 &&
+        rhs_batch.offsets[b] == rhs_batch.offsets[b - 1];
+    if (!lhs_row_major) {
+      if (!lhs_repeated) {
+        ToRowMajor(MatrixMap<const float>(lhs_ptr, lhs_batch.major, rows,
+                                          depth, lhs_batch.stride),
+                   row_major_lhs);
+      }
+      lhs_ptr = row_major_lhs;
+    }
+    if (!rhs_row_major) {
+      if (!rhs_repeated) {
+        ToRowMajor(MatrixMap<const float>(rhs_ptr, rhs_batch.major, depth,
+                                          cols, rhs_batch.stride),
+                   row_major_rhs);
+      }
+      rhs_ptr = row_major_rhs;
+    }
+    ParallelSgemm(lhs_ptr, rhs_ptr, rows, cols, depth,
+                  output_major == RowMajor ? output_ptr : row_major_output);
+    if (output_major != RowMajor) {
+      // the transpose of the row-major output is its column-major layout
+      ToRowMajor(MatrixMap<const float>(row_major_output, ColMajor,
+                                        cols, rows),
+                 output_ptr);
+    }
+  }
+
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus Gemm::Compute(const OpContext *context,
+                         const Tensor *lhs,
+                         const Tensor *rhs,
+                         const index_t batch,
+                         const index_t lhs_rows,
+                         const index_t lhs_cols,
+                         const index_t rhs_rows,
+                         const index_t rhs_cols,
+                         const bool transpose_lhs,
+                         const bool transpose_rhs,
+                         const bool transpose_out,
+                         const bool lhs_batched,
+                         const bool rhs_batched,
+                         Tensor *output) {
+  index_t rows = transpose_lhs ? lhs_cols : lhs_rows;
+  index_t depth = transpose_lhs ? lhs_rows : lhs_cols;
+  index_t cols = transpose_rhs ? rhs_rows : rhs_cols;
+  index_t depth2 = transpose_rhs ? rhs_cols : rhs_rows;
+  MACE_CHECK(depth == depth2,
+             "Matrices that multiply have inconsistent depth dim: ",
+             depth,
+             " vs. ",
+             depth2);
+
+  return Compute(context,
+                 lhs,
+                 rhs,
+                 batch,
+                 rows,
+                 cols,
+                 depth,
+                 transpose_lhs ? ColMajor : RowMajor,
+                 transpose_rhs ? ColMajor : RowMajor,
+                 transpose_out ? ColMajor : RowMajor,
+                 lhs_batched,
+                 rhs_batched,
+                 output);
+}
+
+}  // namespace fp32
+}  // namespace x86
+}  // namespace ops
+}  // namespace mace
@@ -0,0 +1,107 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_OPS_X86_FP32_GEMM_H_
+#define MACE_OPS_X86_FP32_GEMM_H_
+
+#include "mace/public/mace.h"
+#include "mace/core/tensor.h"
+#include "mace/core/op_context.h"
+#include "mace/ops/common/matrix.h"
+#include "mace/ops/ref/gemm.h"
+
+// Matrix-matrix multiplication of the AVX2 kernels on x86-64 cores with
+// AVX2 and FMA, and of ref::Gemm on the others.
+
+namespace mace {
+namespace ops {
+namespace x86 {
+namespace fp32 {
+
+// whether the cores and this build have the AVX2 kernels
+bool HasAvx2Gemm();
+
+// c = a * b of row-major matrices, in blocks of rows and columns run by
+// the OpenMP threads. Only called when HasAvx2Gemm().
+void ParallelSgemm(const float *a,
+                   const float *b,
+                   const index_t rows,
+                   const index_t cols,
+                   const index_t depth,
+                   float *c);
+
+class Gemm {
+ public:
+  Gemm() : tmp_scratch_buffer_(GetCPUAllocator()) {}
+  ~Gemm() {}
+
+  MaceStatus Compute(
+      const OpContext *context,
+      const Tensor *lhs,
+      const Tensor *rhs,
+      const index_t batch,
+      const index_t rows,
+      const index_t cols,
+      const index_t depth,
+      const MatrixMajor lhs_major,
+      const MatrixMajor rhs_major,
+      const MatrixMajor output_major,
+      const bool lhs_batched,
+      const bool rhs_batched,
+      Tensor *output);
+
+  // Multiply the matrices of lhs_batch by those of rhs_batch, of the same
+  // count, into the output of [batch, rows, cols] in output_major. The
+  // operands not contiguous row-major are copied row-major.
+  MaceStatus Compute(
+      const OpContext *context,
+      const Tensor *lhs,
+      const Tensor *rhs,
+      const MatrixBatch &lhs_batch,
+      const MatrixBatch &rhs_batch,
+      const index_t rows,
+      const index_t cols,
+      const index_t depth,
+      const MatrixMajor output_major,
+      Tensor *output);
+
+  // Original matrix before transpose has row-major
+  MaceStatus Compute(
+      const OpContext *context,
+      const Tensor *lhs,
+      const Tensor *rhs,
+      const index_t batch,
+      const index_t lhs_rows,
+      const index_t lhs_cols,
+      const index_t rhs_rows,
+      const index_t rhs_cols,
+      const bool transpose_lhs,
+      const bool transpose_rhs,
+      const bool transpose_out,
+      const bool lhs_batched,
+      const bool rhs_batched,
+      Tensor *output);
+
+ private:
+  // holds the column-major operands transposed to row-major
+  ScratchBuffer tmp_scratch_buffer_;
+  ref::Gemm<float> ref_gemm_;
+};
+
+}  // namespace fp32
+}  // namespace x86
+}  // namespace ops
+}  // namespace mace
+
+#endif  // MACE_OPS_X86_FP32_GEMM_H_
@@ -0,0 +1,165 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <gtest/gtest.h>
+
+#include "mace/core/tensor.h"
+#include "mace/core/op_context.h"
+#include "mace/ops/ref/conv_2d.h"
+#include "mace/ops/ref/gemm.h"
+#include "mace/ops/ref/gemv.h"
+#include "mace/ops/testing/test_utils.h"
+#include "mace/ops/x86/fp32/conv_2d.h"
+#include "mace/ops/x86/fp32/gemm.h"
+#include "mace/ops/x86/fp32/gemv.h"
+
+namespace mace {
+namespace ops {
+namespace test {
+
+namespace {
+
+void TestGemmFloat32(const index_t batch,
+                     const index_t rows,
+                     const index_t cols,
+                     const index_t depth,
+                     const MatrixMajor lhs_major,
+                     const MatrixMajor rhs_major,
+                     const MatrixMajor output_major,
+                     const bool lhs_batched,
+                     const bool rhs_batched) {
+  Tensor lhs(GetCPUAllocator(), DataType::DT_FLOAT);
+  Tensor rhs(GetCPUAllocator(), DataType::DT_FLOAT);
+  Tensor output(GetCPUAllocator(), DataType::DT_FLOAT);
+  lhs.Resize({lhs_batched ? batch : 1, rows, depth});
+  rhs.Resize({rhs_batched ? batch : 1, depth, cols});
+  output.Resize({batch, rows, cols});
+  {
+    Tensor::MappingGuard lhs_guard(&lhs);
+    Tensor::MappingGuard rhs_guard(&rhs);
+    GenerateRandomRealTypeData<float>(lhs.shape(), lhs.mutable_data<float>());
+    GenerateRandomRealTypeData<float>(rhs.shape(), rhs.mutable_data<float>());
+  }
+  ::mace::ops::x86::fp32::Gemm gemm;
+  gemm.Compute(nullptr, &lhs, &rhs, batch, rows, cols, depth, lhs_major,
+               rhs_major, output_major, lhs_batched, rhs_batched, &output);
+
+  Tensor expected_output(GetCPUAllocator(), DataType::DT_FLOAT);
+  expected_output.Resize({batch, rows, cols});
+  ::mace::ops::ref::Gemm<float> gemm_ref;
+  gemm_ref.Compute(nullptr, &lhs, &rhs, batch, rows, cols, depth, lhs_major,
+                   rhs_major, output_major, lhs_batched, rhs_batched,
+                   &expected_output);
+
+  ExpectTensorNear<float>(expected_output, output);
+}
+
+void TestGemvFloat32(const index_t batch,
+                     const index_t height,
+                     const index_t width,
+                     const bool lhs_batched) {
+  Tensor lhs(GetCPUAllocator(), DataType::DT_FLOAT);
+  Tensor rhs(GetCPUAllocator(), DataType::DT_FLOAT);
+  Tensor bias(GetCPUAllocator(), DataType::DT_FLOAT);
+  Tensor output(GetCPUAllocator(), DataType::DT_FLOAT);
+  lhs.Resize({lhs_batched ? batch : 1, height, width});
+  rhs.Resize({batch, width});
+  bias.Resize({height});
+  output.Resize({batch, height});
+  {
+    Tensor::MappingGuard lhs_guard(&lhs);
+    Tensor::MappingGuard rhs_guard(&rhs);
+    Tensor::MappingGuard bias_guard(&bias);
+    GenerateRandomRealTypeData<float>(lhs.shape(), lhs.mutable_data<float>());
+    GenerateRandomRealTypeData<float>(rhs.shape(), rhs.mutable_data<float>());
+    GenerateRandomRealTypeData<float>(bias.shape(),
+                                      bias.mutable_data<float>());
+  }
+  ::mace::ops::x86::fp32::Gemv gemv;
+  gemv.Compute(nullptr, &lhs, &rhs, &bias, batch, height, width, lhs_batched,
+               true, &output);
+
+  Tensor expected_output(GetCPUAllocator(), DataType::DT_FLOAT);
+  expected_output.Resize({batch, height});
+  ::mace::ops::ref::Gemv<float> gemv_ref;
+  gemv_ref.Compute(nullptr, &lhs, &rhs, &bias, batch, height, width,
+                   lhs_batched, true, &expected_output);
+
+  ExpectTensorNear<float>(expected_output, output);
+}
+
+void TestConv2dFloat32(const std::vector<index_t> &input_shape,
+                       const std::vector<index_t> &filter_shape,
+                       const int pad,
+                       const int stride,
+                       const int dilation) {
+  Tensor input(GetCPUAllocator(), DataType::DT_FLOAT);
+  Tensor filter(GetCPUAllocator(), DataType::DT_FLOAT);
+  Tensor output(GetCPUAllocator(), DataType::DT_FLOAT);
+  input.Resize(input_shape);
+  filter.Resize(filter_shape);
+  {
+    Tensor::MappingGuard input_guard(&input);
+    Tensor::MappingGuard filter_guard(&filter);
+    GenerateRandomRealTypeData<float>(input.shape(),
+                                      input.mutable_data<float>());
+    GenerateRandomRealTypeData<float>(filter.shape(),
+                                      filter.mutable_data<float>());
+  }
+  ::mace::ops::x86::fp32::Conv2d conv2d(pad, pad, stride, stride, dilation,
+                                        dilation);
+  conv2d.Compute(nullptr, &input, &filter, &output);
+
+  Tensor expected_output(GetCPUAllocator(), DataType::DT_FLOAT);
+  ::mace::ops::ref::Conv2d<float> conv2d_ref(pad, pad, stride, stride,
+                                             dilation, dilation);
+  conv2d_ref.Compute(nullptr, &input, &filter, &expected_output);
+
+  ExpectTensorNear<float>(expected_output, output);
+}
+
+}  // namespace
+
+TEST(X86Gemm, TestGemmFloat32) {
+  TestGemmFloat32(1, 47, 69, 37, RowMajor, RowMajor, RowMajor, true, true);
+  TestGemmFloat32(1, 47, 69, 37, RowMajor, RowMajor, ColMajor, true, true);
+  TestGemmFloat32(1, 47, 69, 37, RowMajor, ColMajor, RowMajor, true, true);
+  TestGemmFloat32(1, 47, 69, 37, ColMajor, RowMajor, RowMajor, true, true);
+  TestGemmFloat32(1, 47, 69, 37, ColMajor, ColMajor, ColMajor, true, true);
+
+  TestGemmFloat32(3, 47, 69, 37, RowMajor, RowMajor, RowMajor, true, false);
+  TestGemmFloat32(3, 47, 69, 37, RowMajor, RowMajor, RowMajor, false, true);
+
+  // several tasks of rows and columns
+  TestGemmFloat32(2, 101, 517, 67, RowMajor, ColMajor, RowMajor, true, true);
+}
+
+TEST(X86Gemv, TestGemvFloat32) {
+  TestGemvFloat32(1, 47, 69, true);
+  TestGemvFloat32(3, 47, 7, true);
+  TestGemvFloat32(3, 65, 129, false);
+}
+
+TEST(X86Conv2d, TestConv2dFloat32) {
+  TestConv2dFloat32({1, 16, 15, 17}, {8, 16, 1, 1}, 0, 1, 1);
+  TestConv2dFloat32({2, 5, 15, 17}, {7, 5, 3, 3}, 2, 1, 1);
+  TestConv2dFloat32({1, 5, 15, 17}, {7, 5, 3, 3}, 2, 2, 1);
+  TestConv2dFloat32({1, 5, 15, 17}, {7, 5, 3, 3}, 4, 1, 2);
+  TestConv2dFloat32({1, 3, 31, 29}, {9, 3, 5, 5}, 0, 1, 1);
+}
+
+}  // namespace test
+}  // namespace ops
+}  // namespace mace
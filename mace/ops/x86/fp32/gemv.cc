@@ -0,0 +1,83 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/ops/x86/fp32/gemv.h"
+
+#include <algorithm>
+
+#include "mace/ops/x86/avx2/sgemm_kernel.h"
+#include "mace/ops/x86/fp32/gemm.h"
+#include "mace/utils/utils.h"
+
+namespace mace {
+namespace ops {
+namespace x86 {
+namespace fp32 {
+
+namespace {
+
+// rows of lhs of a task
+const index_t kRowTaskSize = 32;
+
+}  // namespace
+
+MaceStatus Gemv::Compute(const OpContext *context,
+                         const Tensor *lhs,
+                         const Tensor *rhs,
+                         const Tensor *bias,
+                         const index_t batch,
+                         const index_t lhs_height,
+                         const index_t lhs_width,
+                         const bool lhs_batched,
+                         const bool rhs_batched,
+                         Tensor *output) {
+  if (!HasAvx2Gemm()) {
+    return ref_gemv_.Compute(context, lhs, rhs, bias, batch, lhs_height,
+                             lhs_width, lhs_batched, rhs_batched, output);
+  }
+  Tensor::MappingGuard lhs_guard(lhs);
+  Tensor::MappingGuard rhs_guard(rhs);
+  Tensor::MappingGuard bias_guard(bias);
+  Tensor::MappingGuard output_guard(output);
+  const float *lhs_data = lhs->data<float>();
+  const float *rhs_data = rhs->data<float>();
+  const float *bias_data = bias == nullptr ? nullptr : bias->data<float>();
+  float *output_data = output->mutable_data<float>();
+
+  const index_t task_count = RoundUpDiv(lhs_height, kRowTaskSize);
+#pragma omp parallel for collapse(2) schedule(runtime)
+  for (index_t b = 0; b < batch; ++b) {
+    for (index_t task = 0; task < task_count; ++task) {
+      const index_t start_row = task * kRowTaskSize;
+      const float *lhs_ptr = lhs_data
+          + static_cast<index_t>(lhs_batched) * b * lhs_height * lhs_width
+          + start_row * lhs_width;
+      const float *rhs_ptr =
+          rhs_data + static_cast<index_t>(rhs_batched) * b * lhs_width;
+      avx2::Sgemv(lhs_ptr,
+                  rhs_ptr,
+                  bias_data == nullptr ? nullptr : bias_data + start_row,
+                  std::min(kRowTaskSize, lhs_height - start_row),
+                  lhs_width,
+                  output_data + b * lhs_height + start_row);
+    }
+  }
+
+  return MaceStatus::MACE_SUCCESS;
+}
+
+}  // namespace fp32
+}  // namespace x86
+}  // namespace ops
+}  // namespace mace
@@ -19,6 +19,7 @@
 #define MACE_PUBLIC_MACE_H_
 
 #include <cstdint>
+#include <functional>
 #include <map>
 #include <memory>
 #include <string>
@@ -36,6 +37,39 @@ enum DeviceType { CPU = 0, GPU = 2, HEXAGON = 3 };
 
 enum DataFormat { DF_NONE = 0, NHWC = 1, NCHW = 2};
 
+// Type of the elements of the buffer of a MaceTensor.
+enum IDataType {
+  IDT_FLOAT = 0,
+  IDT_UINT8 = 1,
+  IDT_HALF = 2,
+  IDT_INT32 = 3,
+};
+
+// Kind of a user-owned OpenCL memory object carried by MaceTensor.
+enum OpenCLMemoryType { OPENCL_BUFFER = 0, OPENCL_IMAGE = 1 };
+
+// Channels of an 8-bit pixel, see InputPreprocess.
+enum PixelFormat {
+  PIXEL_GRAY = 0,
+  PIXEL_RGB = 1,
+  PIXEL_BGR = 2,
+  PIXEL_RGBA = 3,
+  PIXEL_BGRA = 4,
+};
+
+// How MaceEngine turns uint8 pixels into a float input of the model, see
+// MaceEngineConfig::SetInputPreprocess.
+struct InputPreprocess {
+  // channels of the pixels fed by MaceTensor
+  PixelFormat pixel_format;
+  // channels the model expects, PIXEL_GRAY, PIXEL_RGB or PIXEL_BGR
+  PixelFormat model_format;
+  // channel c of the model input is (pixel - mean[c]) * scale[c], one value
+  // for all the channels or one per channel
+  std::vector<float> mean;
+  std::vector<float> scale;
+};
+
 enum GPUPerfHint {
   PERF_DEFAULT = 0,
   PERF_LOW = 1,
@@ -50,6 +84,19 @@ enum GPUPriorityHint {
   PRIORITY_HIGH = 3
 };
 
+// The clocks voted for the Hexagon DSP during the runs of an engine.
+// DSP_PERF_DEFAULT: no vote, the DSP runs at the clocks of the system.
+// DSP_PERF_BURST: the turbo corner with DCVS disabled, the lowest latency.
+// DSP_PERF_SUSTAINED: the nominal corner with DCVS enabled, for long runs
+// without throttling.
+// DSP_PERF_POWER_SAVE: the SVS corner with DCVS enabled, the lowest power.
+enum DSPPerfHint {
+  DSP_PERF_DEFAULT = 0,
+  DSP_PERF_BURST = 1,
+  DSP_PERF_SUSTAINED = 2,
+  DSP_PERF_POWER_SAVE = 3
+};
+
 // AFFINITY_NONE: initiate 'num_threads_hint' threads with no affinity
 // scheduled.
 // If 'num_threads_hint' is -1 or greater than number of available cores,
@@ -66,12 +113,57 @@ enum GPUPriorityHint {
 // cores with bottom-num_threads_hint frequencies.
 // If 'num_threads_hint' is -1 or greater than number of available cores,
 // 'num_threads_hint' will be reset to number of available cores.
+// AFFINITY_ADAPTIVE: start on the big cores, then follow the latency of the
+// runs and the current frequencies of the cores, e.g. when the big cores
+// are throttled, to move the threads between the biggest cluster, the two
+// biggest and so on, at most 'num_threads_hint' threads. Only the runs
+// which are not concurrent are followed.
 enum CPUAffinityPolicy {
   AFFINITY_NONE = 0,
   AFFINITY_BIG_ONLY = 1,
   AFFINITY_LITTLE_ONLY = 2,
   AFFINITY_HIGH_PERFORMANCE = 3,
   AFFINITY_POWER_SAVE = 4,
+  AFFINITY_ADAPTIVE = 5,
+};
+
+// The scheduling class of the threads the ops run on, see
+// MaceEngineConfig::SetCPUThreadPolicy.
+// CPU_SCHED_NORMAL: left to the system, the threads are time shared.
+// CPU_SCHED_IDLE: SCHED_IDLE, the threads only run on the cores left idle
+// by the others, for background jobs.
+// CPU_SCHED_FIFO, CPU_SCHED_RR: SCHED_FIFO and SCHED_RR, the real-time
+// classes preempting all the time shared threads, for latency critical
+// callers. They need a priority from 1 to 99, and CAP_SYS_NICE or an
+// RLIMIT_RTPRIO allowing it.
+enum CPUSchedulingPolicy {
+  CPU_SCHED_NORMAL = 0,
+  CPU_SCHED_IDLE = 1,
+  CPU_SCHED_FIFO = 2,
+  CPU_SCHED_RR = 3,
+};
+
+// How MaceEngine::Calibrate computes the quantization range of an
+// activation from its values over the calibration data.
+// CALIBRATION_MIN_MAX: the min and the max of the values.
+// CALIBRATION_PERCENTILE: the range clipping a percentage of the values on
+// each side.
+// CALIBRATION_KL_DIVERGENCE: the range whose uint8 quantization keeps the
+// distribution of the values the closest, by KL divergence.
+enum CalibrationMethod {
+  CALIBRATION_MIN_MAX = 0,
+  CALIBRATION_PERCENTILE = 1,
+  CALIBRATION_KL_DIVERGENCE = 2,
+};
+
+// What MaceEngine::Trim releases.
+// TRIM_ACTIVATIONS: the CPU memory of the activations and the scratch
+// memory of the ops.
+// TRIM_PROGRAMS: the activations, the scratch memory and the OpenCL
+// programs which no kernel holds, e.g. those of the weight transforms.
+enum TrimLevel {
+  TRIM_ACTIVATIONS = 0,
+  TRIM_PROGRAMS = 1,
 };
 
 struct CallStats {
@@ -87,17 +179,155 @@ struct ConvPoolArgs {
   std::vector<int64_t> kernels;
 };
 
+// An OpenCL kernel enqueued by an operator, the times are read from the
+// profiling info of its event.
+struct KernelStats {
+  std::string kernel_name;
+  std::vector<uint32_t> gws;
+  std::vector<uint32_t> lws;
+  int64_t queued_micros;
+  int64_t submit_micros;
+  int64_t start_micros;
+  int64_t end_micros;
+};
+
+// The hardware counters of a CPU operator, summed over the threads it ran
+// on, -1 for a counter the CPU or the kernel does not provide.
+struct PerfCounterStats {
+  int64_t cycles;
+  int64_t instructions;
+  int64_t l1d_misses;
+  int64_t llc_misses;
+  int64_t branch_misses;
+  int64_t bus_accesses;
+};
+
 struct OperatorStats {
   std::string operator_name;
   std::string type;
   std::vector<std::vector<int64_t>> output_shape;
   ConvPoolArgs args;
   CallStats stats;
+  // only filled for GPU operators with MACE_OPENCL_PROFILING=1
+  std::vector<KernelStats> kernel_stats;
+  // only filled for the nodes of a graph run on the Hexagon DSP, the cycles
+  // of the node at the clock the graph ran at
+  int64_t dsp_cycles;
+  // only filled for CPU operators with MACE_CPU_PERF_COUNTERS=1
+  PerfCounterStats perf_counters;
+};
+
+// The Hexagon DSP of a run, only filled for HEXAGON runs of a whole graph.
+struct DSPStats {
+  // the cycles of the graph, and the clock in MHz they ran at, from the
+  // cycles and the time of its nodes
+  int64_t cycles;
+  int64_t clock_mhz;
+  // the power save level voted for the DSP, 0 for the highest clock
+  int powersave_level;
 };
 
 class RunMetadata {
  public:
   std::vector<OperatorStats> op_stats;
+  DSPStats dsp_stats = {0, 0, -1};
+};
+
+// Latencies accumulated across runs, percentiles are within 12.5%.
+struct LatencyStats {
+  int64_t count;
+  int64_t min_micros;
+  int64_t max_micros;
+  double mean_micros;
+  int64_t p50_micros;
+  int64_t p90_micros;
+  int64_t p99_micros;
+};
+
+struct OperatorLatencyStats {
+  std::string operator_name;
+  std::string type;
+  // host time of the operator, i.e. the enqueue of GPU operators
+  LatencyStats latency;
+};
+
+struct LatencyMetrics {
+  // from the call of the run to the start of its execution, e.g. waiting for
+  // the previous async runs
+  LatencyStats queued;
+  // from the start of the execution to the outputs being ready
+  LatencyStats exec;
+  // from the call of the run to the outputs being ready
+  LatencyStats total;
+  // not filled for HEXAGON
+  std::vector<OperatorLatencyStats> op_latency;
+};
+
+struct TensorMemoryStats {
+  std::string name;
+  // CPU_BUFFER, GPU_BUFFER or GPU_IMAGE
+  std::string memory_type;
+  // of its buffer, which is shared with other tensors unless it owns it
+  int64_t bytes;
+  bool is_weight;
+  bool owns_buffer;
+};
+
+// Memory held by an engine in bytes. The totals by memory type and by
+// category both sum to the whole memory. The packed weights and the
+// ModelWeights are shared by the engines and not counted.
+struct EngineMemoryStats {
+  int64_t cpu_buffer_bytes;
+  int64_t gpu_buffer_bytes;
+  int64_t gpu_image_bytes;
+  // on CPU, the weights are views of the model data
+  int64_t weight_bytes;
+  // the blocks the activations are planned into, i.e. their peak
+  int64_t activation_bytes;
+  // not planned, e.g. the inputs and outputs
+  int64_t other_tensor_bytes;
+  // scratch memory of the ops, grown by the runs
+  int64_t scratch_bytes;
+  std::vector<TensorMemoryStats> tensors;
+};
+
+struct InitPhaseStats {
+  std::string name;
+  int64_t micros;
+};
+
+// Time spent creating the engine, for the startup cost.
+struct InitStats {
+  // from the construction of the engine to the end of its init
+  int64_t total_micros;
+  // in order, e.g. create_device, load_model_tensors and net_init
+  std::vector<InitPhaseStats> phases;
+  // building OpenCL programs so far, which overlaps the phases and the
+  // first runs, summed over the prebuild threads
+  int64_t opencl_build_micros;
+};
+
+// The runs a MaceRuntimeManager arbitrated on a device since it was
+// created or its stats were reset.
+struct RuntimeDeviceStats {
+  DeviceType device_type;
+  // the CPU threads, or the runs on the other devices, at a time
+  int capacity;
+  // of it, held by the admitted runs now
+  int in_use;
+  // waiting to be admitted now
+  int queued;
+  int64_t admitted_runs;
+  // as the queue was full
+  int64_t rejected_runs;
+  // as their deadline passed while waiting
+  int64_t expired_runs;
+  // from the call of the runs to their admission, summed
+  int64_t wait_micros;
+  // the time the admitted runs held the device, on CPU by their threads
+  int64_t busy_micros;
+  // busy_micros of the capacity over the time, from 0 to 1
+  float utilization;
 };
 
 /// Consistent with Android NNAPI
@@ -167,6 +397,52 @@ class MaceStatus {
   std::unique_ptr<Impl> impl_;
 };
 
+// The latency of a model on a device, see SelectDevice.
+struct DeviceLatency {
+  DeviceType device;
+  // the mean time of a run in milliseconds, negative if the model could not
+  // run on the device
+  float exec_time;
+};
+
+struct DevicePlacement {
+  // the device the model runs the fastest on
+  DeviceType device;
+  std::vector<DeviceLatency> latencies;
+  // whether the latencies were loaded from the storage instead of measured
+  bool cached;
+};
+
+/// \brief Choose the device to run a model on from its own runs.
+///
+/// Unlike GetCapability, which measures a fixed slice of mobilenet-v2, the
+/// model itself is run on zero inputs on each candidate device with the
+/// default config of the device, and the fastest is chosen. The latencies
+/// are kept in the storage path, keyed by a hash of the model and of the
+/// SoC, the OpenCL platform and driver and the MACE version, so that they
+/// are only measured again when one of them changed. The whole model is
+/// placed on a device, the ops a GPU does not support falling back to the
+/// CPU as usual.
+///
+/// \param candidates the devices to choose from
+/// \param net_def the model
+/// \param input_nodes input tensor names of the model
+/// \param output_nodes output tensor names of the model
+/// \param model_data weights of the model
+/// \param model_data_size their size in bytes, for the hash of the model
+/// \param storage_path directory of the cache, could be empty for none
+/// \param placement set to the chosen device and the latencies
+/// \return MaceStatus::MACE_SUCCESS for success, other if the model could
+///         run on none of the candidates.
+MACE_API MaceStatus SelectDevice(const std::vector<DeviceType> &candidates,
+                                 const NetDef *net_def,
+                                 const std::vector<std::string> &input_nodes,
+                                 const std::vector<std::string> &output_nodes,
+                                 const unsigned char *model_data,
+                                 size_t model_data_size,
+                                 const std::string &storage_path,
+                                 DevicePlacement *placement);
+
 
 #define MACE_RETURN_IF_ERROR(stmt)                                         \
   {                                                                        \
@@ -188,6 +464,68 @@ class MaceStatus {
 /// You could use one GPUContext for multiple parallel MaceEngines.
 class GPUContext;
 
+/// \brief The CPU weights of a model, shared by its engines.
+///
+/// Created by NewModelWeights and set to the configs of the engines.
+///
+/// Thread-safe.
+class ModelWeights;
+
+/// \brief The arbiter of the devices of the engines of a process.
+///
+/// Engines configured independently oversubscribe the CPU cores and
+/// interleave their GPU and DSP work. The engines which set the manager by
+/// MaceEngineConfig::SetRuntimeManager have their runs admitted onto their
+/// device by it: a CPU run holds the threads of its engine out of a budget
+/// of the process, a run on another device holds the device for itself, so
+/// a run is not slowed down by the runs of other engines. The waiting runs
+/// are admitted by their priority, then by their deadline, then in their
+/// order of arrival. The runs of an engine of higher priority are admitted
+/// first, but do not preempt the admitted runs. MaceEngine::RunAsync is not
+/// arbitrated.
+///
+/// Thread-safe.
+class MACE_API MaceRuntimeManager {
+  friend class MaceEngineConfig;
+
+ public:
+  /// \brief The manager of the process, created at the first call.
+  static std::shared_ptr<MaceRuntimeManager> Get();
+
+  ~MaceRuntimeManager();
+  MaceRuntimeManager(const MaceRuntimeManager &) = delete;
+  MaceRuntimeManager &operator=(const MaceRuntimeManager &) = delete;
+
+  /// \brief Set the CPU threads the admitted runs use at a time.
+  ///
+  /// A run of an engine of more threads holds the whole budget.
+  ///
+  /// \param num_threads the budget, the number of cores by default
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
+  MaceStatus SetCPUThreadBudget(int num_threads);
+
+  /// \brief Set the runs which wait for a device, past which the runs are
+  /// rejected with MACE_OUT_OF_RESOURCES.
+  ///
+  /// \param max_queue_length the runs per device, 0 by default for no limit
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
+  MaceStatus SetMaxQueueLength(int max_queue_length);
+
+  /// \brief Get the stats of the devices the runs were arbitrated on.
+  ///
+  /// \param stats one per device
+  /// \param reset whether to reset the counters and the time of utilization
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
+  MaceStatus GetStats(std::vector<RuntimeDeviceStats> *stats,
+                      bool reset = false);
+
+ private:
+  MaceRuntimeManager();
+
+  class Impl;
+  std::shared_ptr<Impl> impl_;
+};
+
 /// \brief GPUContext builder.
 ///
 /// Use the GPUContextBuilder to generate GPUContext.
@@ -252,6 +590,26 @@ class MACE_API GPUContextBuilder {
   /// \return
   GPUContextBuilder &SetOpenCLParameter(const unsigned char *data,
                                         const size_t size);
+  /// \brief Set the path of the OpenCL binary package
+  ///
+  /// The package, made by tools/pack_opencl_binaries.py, holds the OpenCL
+  /// binaries and the tuned parameters of many platforms, e.g. the SoCs an
+  /// app is shipped to. The entry of the running platform is used, the
+  /// other ones are never read. Without a matching entry, the kernels are
+  /// built from source and cached in the storage path. The binary and the
+  /// parameters set on their own take precedence.
+  ///
+  /// \param path The package file, which is memory mapped
+  /// \return
+  GPUContextBuilder &SetOpenCLBinaryPackagePath(const std::string &path);
+  /// \brief Set the OpenCL binary package with bytes array
+  ///
+  /// \param data Byte stream of the package, kept until the first engine
+  ///        using the context is created
+  /// \param size Size of byte stream (data)
+  /// \return
+  GPUContextBuilder &SetOpenCLBinaryPackage(const unsigned char *data,
+                                            const size_t size);
 
   std::shared_ptr<GPUContext> Finalize();
 
@@ -280,6 +638,10 @@ class MACE_API MaceEngineConfig {
 
   /// \brief Set GPU hints, currently only supports Adreno GPU.
   ///
+  /// The priority hint is given to the command queues of the engine on
+  /// devices with cl_khr_priority_hints too, so that the engines sharing
+  /// a GPUContext can be prioritized against each other.
+  ///
   /// Caution: this function may hurt performance
   /// if improper parameters provided.
   ///
@@ -306,11 +668,502 @@ class MACE_API MaceEngineConfig {
   /// \param status MACE_SUCCESS for successful, or it can't reliabley
   /// detect big-LITTLE cores (see GetBigLittleCoreIDs). In such cases, it's
   /// suggested to use AFFINITY_NONE to use all cores.
+  /// The threads MACE creates to run the ops, those of OpenMP, of its
+  /// thread pool and of SetInterOpParallelism, get the scheduling class
+  /// sched_policy. With OpenMP, so does the thread calling Init, which is
+  /// bound like them. Their mutexes inherit the priority of the threads
+  /// waiting on them, and idle workers spin longer before sleeping in the
+  /// real-time classes, so that they wake up quickly, and not at all in
+  /// CPU_SCHED_IDLE. The other threads calling Run keep their own class.
+  ///
   /// \param use_gemmlowp use gemmlowp for cpu quantized inference
+  /// \param sched_policy one of CPUSchedulingPolicy
+  /// \param sched_priority the priority of CPU_SCHED_FIFO and CPU_SCHED_RR,
+  /// from 1 to 99, 0 for the other classes
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
+  MaceStatus SetCPUThreadPolicy(
+      int num_threads_hint,
+      CPUAffinityPolicy policy,
+      bool use_gemmlowp = false,
+      CPUSchedulingPolicy sched_policy = CPUSchedulingPolicy::CPU_SCHED_NORMAL,
+      int sched_priority = 0);
+
+  /// \brief Set the threads of some CPU ops by their names.
+  ///
+  /// Each op runs on the threads of SetCPUThreadPolicy it is estimated to
+  /// be worth, from the arithmetic and the memory traffic of its shapes.
+  /// The threads set here override the estimate, e.g. those suggested by
+  /// benchmark_model --thread_sweep, and are truncated to the threads of
+  /// SetCPUThreadPolicy.
+  ///
+  /// \param op_threads the threads of the op names, at least 1 each
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
+  MaceStatus SetCPUOpThreads(const std::map<std::string, int> &op_threads);
+
+  /// \brief Prefetch the weights of the next CPU op while an op runs.
+  ///
+  /// A helper thread reads the weights of the next op into the cache the
+  /// cores share, e.g. the L3 cache, so that the large FullyConnected and
+  /// 1x1 Conv2D weights of bandwidth bound models, e.g. on little cores,
+  /// are not fetched from memory at the start of their ops. An op gets at
+  /// most half of the shared cache, the small weights are skipped. It
+  /// takes a core from the ops, so it is worth it when they wait on the
+  /// memory rather than compute. Ignored on other devices and with
+  /// SetInterOpParallelism.
+  ///
+  /// \param enable whether to prefetch the weights, false by default
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
+  MaceStatus SetCPUWeightPrefetch(bool enable);
+
+  /// \brief Run the high resolution head of the net on strips of rows.
+  ///
+  /// The chain of CPU convolutions, poolings and ops of a single position
+  /// at the head of the net, e.g. the first convs of a high resolution
+  /// image, runs depth first on strips of the rows of its input, which
+  /// overlap by the receptive field of its output, so that the activations
+  /// between its ops stay in the L2 cache rather than in memory. The chain
+  /// ends at the first activation which fits in the cache, an op of
+  /// several inputs or an activation read by several ops, and the rows
+  /// at the borders of the strips are computed twice. The input shape of
+  /// the model is planned, the runs of other shapes run the head whole.
+  /// Ignored on other devices and with SetInterOpParallelism.
+  ///
+  /// \param enable whether to run the head on strips, false by default
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
+  MaceStatus SetCPULineBufferedHead(bool enable);
+
+  /// \brief Set the number of operations run concurrently on CPU or GPU.
+  ///
+  /// When num_workers is larger than 1, independent branches of the net,
+  /// e.g. Inception towers or SSD heads, are dispatched onto num_workers
+  /// threads, each of which runs its operations with the OpenMP threads set
+  /// by SetCPUThreadPolicy. On GPU, the branches are enqueued onto
+  /// num_workers OpenCL command queues ordered by events, so that their
+  /// kernels can overlap; the queues get the priority of SetGPUHints.
+  /// Memory blocks are not shared between branches that could run at the
+  /// same time, so more memory may be used. Other devices run operations
+  /// one by one.
+  ///
+  /// \param num_workers number of concurrent operations, 1 by default
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
+  MaceStatus SetInterOpParallelism(int num_workers);
+
+  /// \brief Use the buffers of inputs and outputs in place on CPU.
+  ///
+  /// When enabled, MaceEngine::Run lets the net read an input and write an
+  /// output directly in the MaceTensor's buffer instead of copying it, if
+  /// the tensor needs no layout transform (its data format is the one used
+  /// by the CPU kernels, NCHW for float models and NHWC for quantized
+  /// models, or it is not 4D) and the buffer is aligned to 64 bytes.
+  /// NEON kernels may read up to 64 bytes past the end of a tensor, so on
+  /// ARM the buffer should also be created with 16 spare floats, see
+  /// MaceTensor. Other tensors are copied as usual.
+  ///
+  /// \param enable whether to enable zero copy, false by default
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
+  MaceStatus SetZeroCopy(bool enable);
+
+  /// \brief Feed the inputs as OpenCL images on GPU.
+  ///
+  /// The net reads these inputs straight from images passed by MaceTensor,
+  /// without the buffer to image transform done for other inputs. The
+  /// images must be RGBA images of float, half or normalized uint8 (read
+  /// as [0, 1]) in the MACE image layout of NHWC tensors: width is
+  /// W * ceil(C / 4) and height is N * H, four channels packed in a pixel.
+  ///
+  /// \param input_names names of the inputs fed as images
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
+  MaceStatus SetOpenCLImageInputs(const std::vector<std::string> &input_names);
+
+  /// \brief Keep the CPU weights packed by the gemm kernels in a file.
+  ///
+  /// Constant weights are repacked into the layout of the gemm kernels when
+  /// the engine is created. With this file, the packs are loaded from it
+  /// instead of packed again, and the new ones are written to it after the
+  /// engine is initialized. Engines of one process using the same file share
+  /// the packed data in memory, e.g. two engines of the same model.
+  ///
+  /// On GPU with image memory, the file keeps the pixels of the filter
+  /// images instead, which are written to the images at the next init
+  /// without the buffer to image transforms.
+  ///
+  /// \param file_path a path the app can read and write, empty to disable
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
+  MaceStatus SetPackedWeightsFile(const std::string &file_path);
+
+  /// \brief Benchmark the CPU kernels of each layer and keep the fastest.
+  ///
+  /// Conv2D has several CPU kernels, e.g. gemm, winograd and direct
+  /// convolution, and which is the fastest depends on the layer and the
+  /// cores. With this file, the first run of each layer shape benchmarks
+  /// the kernels which apply, and the winners are written to the file when
+  /// the engine is destroyed and loaded from it by later engines. Without
+  /// it, the kernels are picked by heuristics.
+  ///
+  /// \param file_path a path the app can read and write, empty to disable
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
+  MaceStatus SetAlgorithmCacheFile(const std::string &file_path);
+
+  /// \brief Share the weights of the model with its other engines on CPU.
+  ///
+  /// The first engine initialized with model_weights loads the weights, the
+  /// next ones use the same and only own their activations and runtime
+  /// state, so several engines of a model can run in parallel without a
+  /// copy of the weights each. The engines must be created from the model
+  /// data of model_weights. The weights converted for SetCPUHalfPrecision,
+  /// SetCPUBFloat16, SetCPUBlockedLayout or SetCPUConstantFolding are still
+  /// of each engine.
+  /// Ignored on other
+  /// devices, whose weights are in the memory of the device.
+  ///
+  /// \param model_weights created by NewModelWeights, empty to disable
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
+  MaceStatus SetModelWeights(std::shared_ptr<ModelWeights> model_weights);
+
+  /// \brief Run the CPU ops in half precision where possible.
+  ///
+  /// Conv2D, DepthwiseConv2d and Activation run with half weights and
+  /// activations, which halves their memory traffic and doubles the lanes of
+  /// the vector units, at the cost of precision. It needs a library built
+  /// with fp16_neon=true and a CPU with half arithmetic (ARMv8.2), it is
+  /// ignored otherwise. The inputs and outputs of the model stay float.
+  ///
+  /// \param enable whether to run in half precision
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
+  MaceStatus SetCPUHalfPrecision(bool enable);
+
+  /// \brief Multiply the weights of the CPU ops in bfloat16 where possible.
+  ///
+  /// FullyConnected, MatMul by a transposed 2D weight and 1x1 Conv2D of
+  /// stride 1 keep their weights in bfloat16, which halves their memory,
+  /// and multiply them by the activations rounded to bfloat16 with the
+  /// BFMMLA instruction, summed in float. The activations, and the inputs
+  /// and outputs of the model, stay float. It needs a CPU with the bfloat16
+  /// extension (ARMv8.6), such as Neoverse V1 and N2, it is ignored
+  /// otherwise.
+  ///
+  /// \param enable whether to multiply the weights in bfloat16
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
+  MaceStatus SetCPUBFloat16(bool enable);
+
+  /// \brief Run the CPU float convs in the NCHWc blocked layout.
+  ///
+  /// Conv2D and DepthwiseConv2d, and the Pooling, Eltwise and Activation
+  /// ops after them, keep their activations as [N, C / block, H, W, block],
+  /// so the kernels load the channels of a pixel as whole vectors. Tensors of
+  /// channels not a multiple of the block, and models with inputs of no data
+  /// format, stay NCHW. The inputs and outputs of the model are not changed.
+  ///
+  /// \param channel_block 4 or 8, 0 to disable
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
+  MaceStatus SetCPUBlockedLayout(int channel_block);
+
+  /// \brief Run the CPU float convs in the given data format.
+  ///
+  /// With NHWC, DepthwiseConv2d of multiplier 1, and the 1x1 Conv2D,
+  /// Pooling, Eltwise and Activation ops after it, keep their activations
+  /// NHWC, so the kernels run over the contiguous channels of a pixel. The
+  /// NHWC inputs of the model such an op reads, and the outputs it writes,
+  /// are fed and fetched as they are, without the transposes to and from
+  /// NCHW, and could be bound without copy with SetZeroCopy. Transposes are
+  /// added between the NHWC ops and the other ops. It is ignored with
+  /// SetCPUBlockedLayout, for quantized models and for models with inputs
+  /// of no data format.
+  ///
+  /// \param data_format NCHW by default, or NHWC
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
+  MaceStatus SetCPUDataFormat(DataFormat data_format);
+
+  /// \brief Run the subgraphs of a CPU model NNAPI supports with NNAPI.
+  ///
+  /// Each run of consecutive float Conv2D, DepthwiseConv2d, Pooling,
+  /// Activation, Eltwise, Softmax and Concat ops with a convolution is
+  /// compiled by NNAPI at the first run, so that the vendor drivers run it on
+  /// their NPU, DSP or GPU, and the other ops stay on the CPU. It needs
+  /// Android 8.1, and is skipped with CPU half precision or blocked layout.
+  /// The subgraphs are built for the input shapes of the first run.
+  ///
+  /// \param enable whether to delegate the subgraphs to NNAPI
+  /// \param cache_dir where NNAPI caches the compilations, on Android 10 and
+  ///        later, empty for no cache
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
+  MaceStatus SetNNAPIDelegation(bool enable,
+                                const std::string &cache_dir = "");
+
+  /// \brief Vote the clocks of the Hexagon DSP for the runs of the engine.
+  ///
+  /// The clock corner and DCVS of the hint are voted before each run on
+  /// HEXAGON, and the power save level of the DSP is voted back after it,
+  /// so that engines of different hints could share the DSP. When runs of
+  /// engines overlap, the last vote holds until all of them are done. It is
+  /// ignored by the other devices.
+  ///
+  /// \param perf_hint the clocks of the runs
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
+  MaceStatus SetDSPPerfHint(DSPPerfHint perf_hint);
+
+  /// \brief Fuse the chains of elementwise GPU ops into one kernel each.
+  ///
+  /// BiasAdd, Activation and Eltwise ops where each op only feeds the next
+  /// one run as a single OpenCL kernel generated for the chain, which reads
+  /// and writes each pixel once instead of once per op. The kernels are
+  /// compiled and cached as the other OpenCL programs. It only applies to
+  /// the GPU image memory.
+  ///
+  /// \param enable whether to fuse the elementwise ops
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
+  MaceStatus SetGPUElementwiseFusion(bool enable);
+
+  /// \brief Bound the time a GPU kernel holds the GPU.
+  ///
+  /// A kernel is enqueued in slices of its work size that each run at most
+  /// about max_micros, with a flush between them, so that the compositor can
+  /// preempt the GPU and the UI keeps its frame rate, at a small throughput
+  /// cost. The slices are measured when the kernels are tuned, with
+  /// MACE_TUNING or online tuning; it overrides
+  /// MACE_LIMIT_OPENCL_KERNEL_TIME, which limits kernels to 1000us.
+  ///
+  /// \param max_micros max execution time of an enqueue, 0 by default for
+  /// no limit
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
+  MaceStatus SetGPUMaxKernelTime(int max_micros);
+
+  /// \brief Set the priority of the worker thread of MaceEngine::RunAsync.
+  ///
+  /// The worker waits for the GPU and issues the calls to the DSP of
+  /// HEXAGON runs. Engines whose models run concurrently, e.g. on the DSP,
+  /// could get their latency ordered by it.
+  ///
+  /// \param nice nice value of the worker, in [-20, 19], 0 by default to
+  /// keep the priority of the process
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
+  MaceStatus SetAsyncPriority(int nice);
+
+  /// \brief Set how many runs of MaceEngine::RunAsync could be in flight.
+  ///
+  /// Each in-flight run has its own staging tensors, on GPU also its own
+  /// device buffers of the inputs and outputs, so a deeper ring lets the
+  /// upload of the next frames and the readback of the previous ones
+  /// overlap the compute of a video stream, at the cost of the memory of
+  /// the ring and of the latency of a frame. It applies to GPU and HEXAGON,
+  /// on the other devices the async runs are serialized.
+  ///
+  /// \param max_runs the runs in flight, 2 by default
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
+  MaceStatus SetMaxAsyncRuns(int max_runs);
+
+  /// \brief Write a timeline of the engine as a Chrome trace.
+  ///
+  /// The trace has a span for each operation on the thread which ran it,
+  /// the transforms of the inputs and outputs, and the allocations of the
+  /// init and of the operations. With MACE_OPENCL_PROFILING=1, it also has
+  /// the OpenCL kernels of each GPU operation, next to the span of their
+  /// enqueue. The file is written when the engine is destroyed, and could be
+  /// opened by chrome://tracing or the Perfetto UI.
+  ///
+  /// \param file_path a path the app can write, empty to disable
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
+  MaceStatus SetTraceFile(const std::string &file_path);
+
+  /// \brief Accumulate the latencies of the runs and of each operator.
+  ///
+  /// Unlike RunMetadata, this is cheap enough to keep on in production:
+  /// the latencies are recorded into preallocated histograms without locks,
+  /// strings or waiting for the GPU, and read by
+  /// MaceEngine::GetLatencyMetrics, e.g. to report p50 and p99 per layer.
+  ///
+  /// \param enable false by default
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
+  MaceStatus SetLatencyMetrics(bool enable);
+
+  /// \brief Feed an input as uint8 pixels, e.g. camera frames.
+  ///
+  /// MaceEngine::Run reads the input from a MaceTensor of uint8 NHWC pixels
+  /// and writes the float input of the model in one pass: it picks the
+  /// channels in the order of the model, normalizes them, resizes the frame
+  /// bilinearly to the height and width of the model input if they differ
+  /// and transposes it to the layout of the kernels, so no float copy of the
+  /// frame is needed. The input of the model must be 4D, with 1 or 3
+  /// channels (as model_format).
+  ///
+  /// \param input_name name of the input fed as pixels
+  /// \param preprocess the channels and the normalization
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
+  MaceStatus SetInputPreprocess(const std::string &input_name,
+                                const InputPreprocess &preprocess);
+
+  /// \brief Keep a memory plan per input shape for inputs of varying shapes.
+  ///
+  /// The engine is planned for the input shapes of the model at the init.
+  /// With the cache, MaceEngine::Run with inputs of other shapes derives the
+  /// output shapes of the ops by running the model once, plans the memory of
+  /// the shapes and keeps the plan, so the runs switch between the plans of
+  /// the last num_plans shapes without a re-init, e.g. for variable
+  /// resolutions or lengths rounded to a few buckets. The plans share the
+  /// weights. It applies to float or quantized models on CPU run serially,
+  /// without SetCPUHalfPrecision, SetCPUBFloat16, SetCPUBlockedLayout or
+  /// SetCPUConstantFolding.
+  ///
+  /// \param num_plans the plans kept, 0 by default to disable
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
+  MaceStatus SetShapePlanCacheSize(int num_plans);
+
+  /// \brief Let several threads call MaceEngine::Run at the same time.
+  ///
+  /// Each run borrows an execution context of the engine, which owns the
+  /// activations, the op instances and the scratch buffer of a run, while
+  /// the weights, the packed weights and the runtimes of the device are
+  /// shared by all of them. The contexts are created on demand, up to
+  /// max_runs, further calls wait for a context to be free. Stateful ops
+  /// keep their states per context. It applies to CPU, on the other devices
+  /// the runs are thread-safe but serialized. RunBatch, RunAsync and
+  /// ResetStates must not overlap the runs of other threads, and
+  /// LoadNextModel is not supported.
+  ///
+  /// \param max_runs the runs at the same time, 1 by default, for which
+  ///                 MaceEngine is not thread-safe
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
+  MaceStatus SetMaxConcurrentRuns(int max_runs);
+
+  /// \brief Re-run only the ops whose inputs changed since the last run.
+  ///
+  /// For the inputs which often stay the same between runs, e.g. the
+  /// image of a multi-query model, Run compares their content with the one
+  /// of the previous run, and the ops which only depend on unchanged
+  /// incremental inputs are skipped. The tensors these ops pass to the
+  /// other ones are kept out of the memory reuse to stay valid, and the
+  /// outputs are not bound to the buffers of the user, see
+  /// SetZeroCopy. Ops with states, e.g. LSTMCell, always run.
+  ///
+  /// \param input_names the incremental inputs, at most 63, all the other
+  ///                    inputs are taken as changed at each run
+  /// \return MaceStatus::MACE_SUCCESS for success, MACE_INVALID_ARGS if
+  ///         there are more than 63 inputs.
+  MaceStatus SetIncrementalInputs(
+      const std::vector<std::string> &input_names);
+
+  /// \brief Run fully convolutional nets on tiles of larger images.
+  ///
+  /// The input shape of the model is taken as the tile: MaceEngine::Run
+  /// cuts a larger image into tiles of this shape, overlapping by the
+  /// receptive field of the outputs, runs the net on each and stitches
+  /// their outputs, so that the activations, e.g. the GPU images, stay of
+  /// the size of a tile whatever the size of the image. The outputs are
+  /// those of the whole image. MaceEngine::Init returns MACE_INVALID_ARGS
+  /// if the net is not made of convolutions, poolings and ops of a single
+  /// position, e.g. activations or eltwise ops, of a single float input.
+  /// The height and width of the image must be multiples of the strides of
+  /// the outputs, and at least those of a tile.
+  ///
+  /// \param enable whether to tile larger images, false by default
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
+  MaceStatus SetTiledExecution(bool enable);
+
+  /// \brief Keep the runs of the input shapes of the model from allocating.
+  ///
+  /// MaceEngine::Init runs the net once, so that the scratch buffers, the
+  /// output tensors and the GPU kernels and images are allocated for the
+  /// input shapes of the model, then resets the states of the ops. The
+  /// allocations of the CPU and OpenCL allocators made by the operations
+  /// of the following runs are logged with the operation, e.g. to find the
+  /// ops of a real-time thread that still allocate. With fail_allocations,
+  /// they fail, and so does the run. Runs of other input shapes allocate
+  /// the larger buffers they need. The allocations of the standard library,
+  /// e.g. of temporary vectors, are not watched.
+  ///
+  /// \param enable whether to preallocate and watch the runs, false by
+  ///               default
+  /// \param fail_allocations fail the allocations of the runs instead of
+  ///                         logging them
+  /// \return MaceStatus::MACE_SUCCESS for success, MACE_INVALID_ARGS if
+  ///         fail_allocations is set without enable.
+  MaceStatus SetAllocationFreeRuns(bool enable, bool fail_allocations);
+
+  /// \brief Set how the CPU buffers of the engine are allocated.
+  ///
+  /// With huge pages, the buffers of at least 2MB, e.g. the arena of the
+  /// activations and the weights, are mapped with 2MB pages to take fewer
+  /// TLB misses in the GEMMs: the pages reserved in
+  /// /proc/sys/vm/nr_hugepages when there are some, or the transparent huge
+  /// pages otherwise. On hosts of several NUMA nodes, bind_numa_nodes
+  /// binds these buffers to the nodes of the cores the threads are bound to
+  /// by SetCPUThreadPolicy, interleaved if they are on several nodes. It
+  /// only applies on Linux and Android, the buffers are allocated as usual
+  /// elsewhere.
+  ///
+  /// \param huge_pages map the large buffers with huge pages, false by
+  ///                   default
+  /// \param bind_numa_nodes bind the huge pages to the NUMA nodes of the
+  ///                        cores, false by default
+  /// \return MaceStatus::MACE_SUCCESS for success, MACE_INVALID_ARGS if
+  ///         bind_numa_nodes is set without huge_pages.
+  MaceStatus SetCPUMemoryPolicy(bool huge_pages, bool bind_numa_nodes);
+
+  /// \brief Fold the constant subgraphs of a float model on CPU at the init.
+  ///
+  /// The ops whose inputs are all weights, e.g. Shape -> StridedSlice ->
+  /// Stack -> Reshape chains on constants, are run once by MaceEngine::Init,
+  /// their outputs are kept as weights and the ops are removed from the net,
+  /// as are the ops whose outputs nothing reads. With fixed_input_shapes,
+  /// Shape, InferConv2dShape and PriorBox over activations are folded too,
+  /// for the input shapes of the model, and MaceEngine::Run returns
+  /// MACE_INVALID_ARGS for inputs of other shapes. Stateful ops and the ops
+  /// of the model outputs are kept.
+  ///
+  /// \param enable whether to fold the constant ops, false by default
+  /// \param fixed_input_shapes fold the shape ops over activations as well,
+  ///                           the model is run with its input shapes only
+  /// \return MaceStatus::MACE_SUCCESS for success, MACE_INVALID_ARGS if
+  ///         fixed_input_shapes is set without enable.
+  MaceStatus SetCPUConstantFolding(bool enable, bool fixed_input_shapes);
+
+  /// \brief Keep the memory of the engine low at some latency cost, e.g.
+  /// on devices whose low memory killer reclaims the apps in the background.
+  ///
+  /// The activations are planned for the smallest arena, at a longer init,
+  /// the ops run one by one whatever SetInterOpParallelism, a single shape
+  /// plan is kept whatever SetShapePlanCacheSize, and the scratch memory
+  /// of the ops is released after each run, so that it is allocated again
+  /// by the next one. With SetAllocationFreeRuns, the scratch memory is
+  /// kept. See MaceEngine::Trim to release the memory between the runs.
+  ///
+  /// \param enable whether to keep the memory low, false by default
   /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
-  MaceStatus SetCPUThreadPolicy(int num_threads_hint,
-                                CPUAffinityPolicy policy,
-                                bool use_gemmlowp = false);
+  MaceStatus SetLowMemoryMode(bool enable);
+
+  /// \brief Replay the GPU kernels of a run instead of running the ops.
+  ///
+  /// For a model of fixed shapes, each run enqueues the same kernels, and
+  /// the host work of the ops, e.g. shape inference and kernel argument
+  /// setting, is a large part of a light model's latency. With replay, the
+  /// kernels and arguments a run enqueues are recorded, and the next runs
+  /// of the same input shapes enqueue them again in a tight loop without
+  /// running the ops. A run is only recorded if its ops run on GPU and do
+  /// nothing on the host a replay would miss, e.g. they map no memory, so
+  /// nets with CPU ops, runs with RunMetadata or zero copy inputs or
+  /// outputs, incremental inputs and the out of range check run their ops
+  /// as usual. The ops must compute the same kernel arguments at each run
+  /// of the same shapes, e.g. they keep no step counter in the arguments.
+  ///
+  /// \param enable whether to replay the kernels, false by default
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
+  MaceStatus SetGPUKernelReplay(bool enable);
+
+  /// \brief Have the runs of the engine admitted by a MaceRuntimeManager.
+  ///
+  /// MaceEngine::Run waits until its run is admitted onto the device, see
+  /// MaceRuntimeManager, and fails with MACE_OUT_OF_RESOURCES if the queue
+  /// of the device is full or the deadline passes while it waits. The
+  /// deadline does not bound the run once it is admitted.
+  ///
+  /// \param manager e.g. MaceRuntimeManager::Get(), empty to run unmanaged
+  /// \param priority the runs of higher priority are admitted first
+  /// \param deadline_micros from the call of a run to its admission, 0 by
+  /// default for no deadline
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
+  MaceStatus SetRuntimeManager(std::shared_ptr<MaceRuntimeManager> manager,
+                               int priority = 0,
+                               int64_t deadline_micros = 0);
 
  private:
   class Impl;
@@ -320,6 +1173,7 @@ class MACE_API MaceEngineConfig {
 // MACE input/output tensor
 class MACE_API MaceTensor {
   friend class MaceEngine;
+  friend class MaceBatchSplitter;
 
  public:
   // shape - the shape of the tensor, with size n, if shape is unknown
@@ -335,6 +1189,47 @@ class MACE_API MaceTensor {
   MaceTensor(const std::vector<int64_t> &shape,
              std::shared_ptr<float> data,
              const DataFormat format = DataFormat::NHWC);
+  // buffer_size - the number of floats the buffer could hold, which should
+  //               not be less than the size of shape.
+  MaceTensor(const std::vector<int64_t> &shape,
+             std::shared_ptr<float> data,
+             const DataFormat format,
+             const int64_t buffer_size);
+  // opencl_memory - a user-owned cl_mem cast to void *, an OpenCL buffer
+  //                 of float or an image (see
+  //                 MaceEngineConfig::SetOpenCLImageInputs), created on the
+  //                 OpenCL context of the engine (see
+  //                 MaceEngine::GetOpenCLContext). MaceEngine::Run uses it in
+  //                 place, so frames already on GPU skip the copies from and
+  //                 to host memory. Buffers must be NHWC if 4D. An output
+  //                 image, in the layout of the input images, is written
+  //                 from the NHWC output on GPU. data() is null for such
+  //                 tensors.
+  // pixels - uint8 pixels of NHWC shape, the channels in the pixel_format
+  //          of the input (see MaceEngineConfig::SetInputPreprocess).
+  //          data() is null for such tensors.
+  MaceTensor(const std::vector<int64_t> &shape,
+             std::shared_ptr<uint8_t> pixels);
+  // data - a buffer of the size of shape, of elements of data_type.
+  //        MaceEngine::Run converts them from and to the float tensors of
+  //        the model. The uint8 inputs read by the Quantize ops of a
+  //        quantized model are taken as quantized by scale and zero_point,
+  //        and the uint8 outputs of its Dequantize ops are given quantized,
+  //        with their scale and zero_point set, both without float values.
+  //        data() is null for such tensors unless data_type is IDT_FLOAT.
+  // scale, zero_point - the quantization of uint8 data, real = scale *
+  //                     (data - zero_point), a scale of 0 for the values
+  //                     as they are (or for the range of an output).
+  MaceTensor(const std::vector<int64_t> &shape,
+             std::shared_ptr<void> data,
+             const IDataType data_type,
+             const DataFormat format = DataFormat::NHWC,
+             const float scale = 0.f,
+             const int32_t zero_point = 0);
+  MaceTensor(const std::vector<int64_t> &shape,
+             void *opencl_memory,
+             const OpenCLMemoryType opencl_memory_type,
+             const DataFormat format = DataFormat::NHWC);
   MaceTensor();
   MaceTensor(const MaceTensor &other);
   MaceTensor(const MaceTensor &&other);
@@ -347,12 +1242,80 @@ class MACE_API MaceTensor {
   const std::shared_ptr<float> data() const;
   std::shared_ptr<float> data();
   DataFormat data_format() const;
+  // the OpenCL memory of the tensor, null if it is on host
+  void *opencl_memory() const;
+  // the uint8 pixels of the tensor, null if it is float
+  const std::shared_ptr<uint8_t> pixels() const;
+  IDataType data_type() const;
+  // the buffer of the tensor of any data type, null for OpenCL memory and
+  // pixels
+  const std::shared_ptr<void> raw_data() const;
+  // the quantization of uint8 data, set for the outputs by the run
+  float scale() const;
+  int32_t zero_point() const;
+  // false if the last run exited early before producing this output, see
+  // the EarlyExit op, its data is then left as it was
+  bool valid() const;
 
  private:
   class Impl;
   std::unique_ptr<Impl> impl_;
 };
 
+/// \brief Completion handle of MaceEngine::RunAsync, like StatsFuture.
+class MACE_API RunFuture {
+  friend class MaceEngine;
+  friend class MacePipeline;
+
+ public:
+  RunFuture();
+  ~RunFuture();
+  RunFuture(const RunFuture &) = delete;
+  RunFuture &operator=(const RunFuture &) = delete;
+
+  /// \brief Block until the run is finished and return its status.
+  MaceStatus Wait();
+
+  /// \brief Whether the run is finished, never blocks.
+  bool IsReady() const;
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+typedef std::function<void(const MaceStatus &)> RunCallback;
+
+// The lazy work of the first run MaceEngine::WarmUp does ahead of it.
+struct WarmUpOptions {
+  // touch the pages of the weights on the host, e.g. those mapped from the
+  // model data file, so that the first run does not fault them in
+  bool prefault_weights;
+  // run the net once on zero inputs of the shapes of the model, which
+  // builds and tunes the OpenCL kernels, packs the weights, transforms the
+  // Winograd filters and grows the scratch buffers; the states of the
+  // stateful ops are reset after it
+  bool synthetic_run;
+  // warm up on a worker thread and return right away
+  bool background;
+
+  WarmUpOptions()
+      : prefault_weights(true), synthetic_run(true), background(false) {}
+};
+
+class MaceEngine;
+
+MACE_API MaceStatus CreateMaceEngineFromSnapshot(
+    const std::string &snapshot_file,
+    const unsigned char *model_graph_proto,
+    const size_t model_graph_proto_size,
+    const unsigned char *model_weights_data,
+    const size_t model_weights_data_size,
+    const std::vector<std::string> &input_nodes,
+    const std::vector<std::string> &output_nodes,
+    const MaceEngineConfig &config,
+    std::shared_ptr<MaceEngine> *engine);
+
 class MACE_API MaceEngine {
  public:
   explicit MaceEngine(const MaceEngineConfig &config);
@@ -375,14 +1338,400 @@ class MACE_API MaceEngine {
                  std::map<std::string, MaceTensor> *outputs,
                  RunMetadata *run_metadata);
 
+  /// \brief Run a batch of requests with as few net executions as possible.
+  ///
+  /// Requests are stacked along the first (batch) dimension, up to the
+  /// batch size of the model's input shapes, and the outputs are split back
+  /// into the per-request output tensors. Adjacent requests whose inputs
+  /// differ in names, non-batch dimensions or data format are run apart.
+  ///
+  /// \param inputs one input map per request
+  /// \param outputs one output map per request, same size as inputs
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
+  MaceStatus RunBatch(
+      const std::vector<std::map<std::string, MaceTensor>> &inputs,
+      std::vector<std::map<std::string, MaceTensor>> *outputs);
+
+  /// \brief Run the net without waiting for it to finish.
+  ///
+  /// The inputs are consumed before returning, so their buffers could be
+  /// refilled with the next frame right away. On GPU, each in-flight run
+  /// has a slot of staging tensors and device buffers: the inputs are
+  /// uploaded into the buffers of the slot on a transfer queue, the net is
+  /// enqueued to the command queue behind the upload, and the outputs are
+  /// read back on the transfer queue behind the net, so the upload of
+  /// frame N + 1 and the readback of frame N - 1 overlap the compute of
+  /// frame N. On HEXAGON, the inputs are transposed into tensors shared
+  /// with the DSP, so frame N + 1 is prepared while the DSP runs frame N.
+  /// At most MaceEngineConfig::SetMaxAsyncRuns runs are in flight, a
+  /// further call blocks until the oldest one is finished.
+  /// The engine is not thread-safe, call it from one thread only.
+  ///
+  /// \param inputs input tensors of this frame
+  /// \param outputs output tensors, must stay alive until the run finished
+  /// \param callback called from a worker thread when the run finished,
+  ///                 could be empty
+  /// \param future set to the completion handle of this run, could be null
+  /// \return MaceStatus::MACE_SUCCESS if the run is enqueued, other for
+  ///         failed.
+  MaceStatus RunAsync(const std::map<std::string, MaceTensor> &inputs,
+                      std::map<std::string, MaceTensor> *outputs,
+                      RunCallback callback,
+                      std::shared_ptr<RunFuture> *future);
+
+  /// \brief Do the lazy work of the first run after Init, e.g. behind a
+  /// splash screen, so that the first run is as fast as the next ones.
+  ///
+  /// In the background, the next Run, RunBatch or RunAsync waits for the
+  /// warm-up to finish; the other calls must not be made before. In-flight
+  /// async runs are waited for.
+  ///
+  /// \param options what is warmed up, and where
+  /// \param callback called when the warm-up finished, from the worker
+  ///                 thread in the background, could be empty
+  /// \param future set to the completion handle of the warm-up, could be
+  ///               null
+  /// \return MaceStatus::MACE_SUCCESS if the warm-up succeeded, or is
+  ///         started in the background, other for failed.
+  MaceStatus WarmUp(const WarmUpOptions &options,
+                    RunCallback callback = nullptr,
+                    std::shared_ptr<RunFuture> *future = nullptr);
+
+  /// \brief Get the OpenCL context and command queue of a GPU engine.
+  ///
+  /// OpenCL memory passed by MaceTensor must be created on this context.
+  /// Writes to inputs enqueued on other queues must be finished before Run,
+  /// and the outputs are ready when Run returns.
+  ///
+  /// \param cl_context set to the cl_context, cast to void *
+  /// \param cl_command_queue set to the cl_command_queue, cast to void *,
+  ///                         could be null
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
+  MaceStatus GetOpenCLContext(void **cl_context, void **cl_command_queue);
+
+  /// \brief Share an EGLImage, e.g. of a GL texture, as an OpenCL image.
+  ///
+  /// The image, created by cl_khr_egl_image, is passed by MaceTensor as an
+  /// OpenCL image input (see MaceEngineConfig::SetOpenCLImageInputs) or
+  /// output, so render pipelines feed and take their frames without the
+  /// copies through host memory. Run acquires the images it uses before its
+  /// kernels and releases them after, and GL may use them once it returns.
+  /// The GL commands writing an input must be finished before Run, or be
+  /// before the fence of SetEGLSync.
+  ///
+  /// \param egl_display the EGLDisplay of the image, cast to void *
+  /// \param egl_image the EGLImageKHR, e.g. of eglCreateImageKHR with
+  ///                  EGL_GL_TEXTURE_2D_KHR, cast to void *
+  /// \param opencl_image set to the cl_mem image, cast to void *
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed, e.g.
+  ///         if the device does not support cl_khr_egl_image.
+  MaceStatus CreateOpenCLImageFromEGLImage(void *egl_display,
+                                           void *egl_image,
+                                           void **opencl_image);
+
+  /// \brief Release an image of CreateOpenCLImageFromEGLImage.
+  ///
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
+  MaceStatus ReleaseOpenCLImage(void *opencl_image);
+
+  /// \brief Set the fence the GPU waits for before the next Run reads its
+  /// EGL images.
+  ///
+  /// E.g. an EGLSyncKHR of eglCreateSyncKHR after the GL commands rendering
+  /// an input, which spares the app a glFinish. Needs cl_khr_egl_event.
+  ///
+  /// \param egl_display the EGLDisplay of the fence, cast to void *
+  /// \param egl_sync the EGLSyncKHR, cast to void *, owned by the app and
+  ///                 kept until the next Run returns
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
+  MaceStatus SetEGLSync(void *egl_display, void *egl_sync);
+
+  /// \brief Reset the states kept across runs by stateful ops.
+  ///
+  /// Stateful ops, e.g. an LSTMCell with the "stateful" argument for
+  /// streaming, continue from the states of the previous run. After the
+  /// reset, the next run starts from the initial states of the model again,
+  /// e.g. for the next utterance. In-flight async runs are waited for.
+  ///
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
+  MaceStatus ResetStates();
+
+  /// \brief Get a snapshot of the latencies accumulated since the init or
+  /// the last reset, see MaceEngineConfig::SetLatencyMetrics.
+  ///
+  /// Thread-safe, could be called while the engine runs.
+  ///
+  /// \param metrics set to the latencies
+  /// \param reset whether to restart accumulating after the snapshot
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
+  MaceStatus GetLatencyMetrics(LatencyMetrics *metrics, bool reset = false);
+
+  /// \brief Get the time spent in the phases of the creation of the engine.
+  ///
+  /// \param stats set to the phases of the construction and the init
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
+  MaceStatus GetInitStats(InitStats *stats) const;
+
+  /// \brief Get the memory held by the engine, e.g. to budget the models
+  /// of low memory devices.
+  ///
+  /// Not thread-safe with the runs.
+  ///
+  /// \param stats set to the memory by memory type and by category
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
+  MaceStatus GetMemoryStats(EngineMemoryStats *stats) const;
+
+  /// \brief Release memory of the engine until the next run, e.g. when the
+  /// app goes to the background.
+  ///
+  /// The CPU blocks of the activations of the net, of all its shape plans
+  /// and execution contexts, are freed, and so is the scratch memory of the
+  /// ops, the next Run, RunBatch or RunAsync allocates them again. The GPU
+  /// images and buffers of the activations are kept, the kernels bind them
+  /// once. The weights, the inputs and the outputs are kept, and so are
+  /// the states of stateful ops; the incremental inputs are all considered
+  /// changed by the next run. Not supported on HEXAGON or with
+  /// MaceEngineConfig::SetAllocationFreeRuns. Not thread-safe with the runs,
+  /// in-flight async runs and the warm-up are waited for.
+  ///
+  /// \param level what to release
+  /// \return MaceStatus::MACE_SUCCESS for success, MACE_INVALID_ARGS if
+  ///         the engine keeps its memory.
+  MaceStatus Trim(TrimLevel level = TRIM_ACTIVATIONS);
+
+  /// \brief Store the memory plan of the engine in its model graph.
+  ///
+  /// Init plans the memory blocks of the activations of the net, the one
+  /// created by the runtime with its transform operations, which takes a
+  /// part of the init time of large models. The engines created from the
+  /// model graph written here load the plan instead, with the same
+  /// footprint, if they create the same net: same config, same outputs and
+  /// same build. Otherwise the plan is ignored and the memory is planned
+  /// as usual.
+  ///
+  /// \param model_graph_proto the model graph the engine was created from
+  /// \param model_graph_proto_size its size in bytes
+  /// \param planned_model_graph_proto set to the model graph with the plan
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
+  MaceStatus ExportMemoryPlan(
+      const unsigned char *model_graph_proto,
+      const size_t model_graph_proto_size,
+      std::vector<unsigned char> *planned_model_graph_proto) const;
+
+  /// \brief Save what the init of the engine derived for the device.
+  ///
+  /// The snapshot keeps the memory plan of the net, the weights packed by
+  /// the CPU kernels, the pixels of the GPU filter images if the engine
+  /// keeps them (see MaceEngineConfig::SetPackedWeightsFile) and the
+  /// kernels picked by benchmarking (see SetAlgorithmCacheFile), in one
+  /// file keyed by the build, the device type, the CPU and the OpenCL
+  /// platform. An engine of the same model and config created from it by
+  /// CreateMaceEngineFromSnapshot loads them instead of planning and
+  /// packing again. The OpenCL binaries and tuned parameters are kept in
+  /// the storage of the GPUContext.
+  ///
+  /// \param file_path a path the app can write
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
+  MaceStatus SaveSnapshot(const std::string &file_path) const;
+
+  /// \brief Calibrate the quantization ranges of the activations of a
+  /// float model on the device.
+  ///
+  /// The calibration data is run twice through the net, the first pass
+  /// finds the min and max of each float activation, the second
+  /// accumulates their histograms of 2048 bins over these, on the CPU
+  /// threads of the engine. The ranges computed with the method are
+  /// written as the quantize_info of the operations of the model graph,
+  /// as the converter does with a quantize_range_file. The
+  /// operations the engine folded or added are left as they are. Only
+  /// float models on CPU; not thread-safe with the runs.
+  ///
+  /// \param dataset the inputs of the calibration runs
+  /// \param method how the range is computed from the values
+  /// \param percentile percentage of the values clipped on each side, in
+  ///                   [0, 50), for CALIBRATION_PERCENTILE
+  /// \param model_graph_proto the model graph the engine was created from
+  /// \param model_graph_proto_size its size in bytes
+  /// \param calibrated_model_graph_proto set to the model graph with the
+  ///                                     ranges
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
+  MaceStatus Calibrate(
+      const std::vector<std::map<std::string, MaceTensor>> &dataset,
+      const CalibrationMethod method,
+      const float percentile,
+      const unsigned char *model_graph_proto,
+      const size_t model_graph_proto_size,
+      std::vector<unsigned char> *calibrated_model_graph_proto);
+
+  /// \brief Load another version of the model in the background and switch
+  /// to it without tearing down the engine.
+  ///
+  /// The next version is initialized on a worker thread on the device of
+  /// the engine, sharing its OpenCL runtime, its compiled programs and its
+  /// CPU threads, while the current version keeps running. The first Run,
+  /// RunBatch or RunAsync after the load switches to it, once the async runs
+  /// in flight on the current version are finished. If the load failed, the
+  /// engine keeps running the current version. Not supported on HEXAGON or
+  /// with MaceEngineConfig::SetMaxConcurrentRuns.
+  ///
+  /// \param net_def the next model, copied before returning
+  /// \param input_nodes input tensor names of the next model
+  /// \param output_nodes output tensor names of the next model
+  /// \param model_data weights of the next model, must stay alive while
+  ///                   the engine runs it
+  /// \param future set to the completion handle of the load, could be null
+  /// \return MaceStatus::MACE_SUCCESS if the load is started, other for
+  ///         failed.
+  MaceStatus LoadNextModel(const NetDef *net_def,
+                           const std::vector<std::string> &input_nodes,
+                           const std::vector<std::string> &output_nodes,
+                           const unsigned char *model_data,
+                           std::shared_ptr<RunFuture> *future = nullptr);
+
  private:
   class Impl;
   std::unique_ptr<Impl> impl_;
 
+  // make the next version of the model current once it is loaded
+  void SwitchToNextModel();
+
+  // load a snapshot of SaveSnapshot before Init, its memory plan into
+  // net_def
+  MaceStatus LoadSnapshot(const std::string &file_path, NetDef *net_def);
+  friend MaceStatus CreateMaceEngineFromSnapshot(
+    const std::string &snapshot_file,
+    const unsigned char *model_graph_proto,
+    const size_t model_graph_proto_size,
+    const unsigned char *model_weights_data,
+    const size_t model_weights_data_size,
+    const std::vector<std::string> &input_nodes,
+    const std::vector<std::string> &output_nodes,
+    const MaceEngineConfig &config,
+    std::shared_ptr<MaceEngine> *engine);
+
   MaceEngine(const MaceEngine &) = delete;
   MaceEngine &operator=(const MaceEngine &) = delete;
 };
 
+/// \brief Dynamic batcher on top of MaceEngine::RunBatch.
+///
+/// Concurrent Run calls are collected until max_batch_size requests are
+/// queued or timeout_micros elapsed since the oldest queued request, then
+/// they are executed together by a worker thread.
+///
+/// Thread-safe. The engine must not be run by others while the batcher is
+/// alive.
+class MACE_API MaceRequestBatcher {
+ public:
+  MaceRequestBatcher(std::shared_ptr<MaceEngine> engine,
+                     const int max_batch_size,
+                     const int64_t timeout_micros);
+  ~MaceRequestBatcher();
+  MaceRequestBatcher(const MaceRequestBatcher &) = delete;
+  MaceRequestBatcher &operator=(const MaceRequestBatcher &) = delete;
+
+  /// \brief Enqueue one request and block until its batch is done.
+  MaceStatus Run(const std::map<std::string, MaceTensor> &inputs,
+                 std::map<std::string, MaceTensor> *outputs);
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+/// \brief Two-stage pipeline of one model over two devices, e.g. GPU+CPU.
+///
+/// Init cuts the net into a prefix run by the first engine and a suffix run
+/// by the second one, at the operation which balances the stage latencies
+/// according to per-op costs measured with RunMetadata on each device.
+/// Every stage runs on its own thread, so for consecutive inputs (e.g. video
+/// frames) the throughput approaches the slower stage instead of the sum.
+///
+/// Not thread-safe, call Run from one thread only.
+class MACE_API MacePipeline {
+ public:
+  MacePipeline(const MaceEngineConfig &first_config,
+               const MaceEngineConfig &second_config);
+  ~MacePipeline();
+  MacePipeline(const MacePipeline &) = delete;
+  MacePipeline &operator=(const MacePipeline &) = delete;
+
+  /// \brief Partition the net and initialize the stage engines.
+  ///
+  /// \param first_costs metadata of a run of the whole net on the first
+  ///                    device, operations missing from it cost nothing
+  /// \param second_costs same as first_costs, on the second device
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
+  MaceStatus Init(const NetDef *net_def,
+                  const std::vector<std::string> &input_nodes,
+                  const std::vector<std::string> &output_nodes,
+                  const unsigned char *model_data,
+                  const RunMetadata &first_costs,
+                  const RunMetadata &second_costs);
+
+  /// \brief Push one input into the pipeline without waiting for it.
+  ///
+  /// At most two inputs are in flight, a third call blocks until the oldest
+  /// one is finished. The inputs and outputs must stay alive until the run
+  /// is finished.
+  ///
+  /// \param callback called when the run is finished, could be empty
+  /// \param future set to the completion handle of this run, could be null
+  /// \return MaceStatus::MACE_SUCCESS if the input is enqueued, other for
+  ///         failed.
+  MaceStatus Run(const std::map<std::string, MaceTensor> &inputs,
+                 std::map<std::string, MaceTensor> *outputs,
+                 RunCallback callback,
+                 std::shared_ptr<RunFuture> *future);
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+/// \brief Data parallel runs of one model over two devices, e.g. GPU+CPU.
+///
+/// Run splits the batch (first) dimension of the inputs between two engines
+/// of the same model, which run their parts at the same time and write them
+/// into the slices of the outputs in place. The parts follow the samples
+/// per second each engine ran in the earlier runs, half and half at first,
+/// so that both finish together. Each engine runs at least one sample of a
+/// batch of two or more to keep being measured, a batch of one runs on the
+/// faster engine. The inputs and outputs are float tensors on host whose
+/// first dimension is the batch, otherwise the whole run is on the faster
+/// engine, and the model must accept the batch sizes of the parts.
+///
+/// Not thread-safe, call Run from one thread only.
+class MACE_API MaceBatchSplitter {
+ public:
+  MaceBatchSplitter(const MaceEngineConfig &first_config,
+                    const MaceEngineConfig &second_config);
+  ~MaceBatchSplitter();
+  MaceBatchSplitter(const MaceBatchSplitter &) = delete;
+  MaceBatchSplitter &operator=(const MaceBatchSplitter &) = delete;
+
+  /// \brief Initialize both engines with the whole net.
+  ///
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
+  MaceStatus Init(const NetDef *net_def,
+                  const std::vector<std::string> &input_nodes,
+                  const std::vector<std::string> &output_nodes,
+                  const unsigned char *model_data);
+
+  /// \brief Run the inputs split over both engines, and wait for them.
+  ///
+  /// \return MaceStatus::MACE_SUCCESS for success, other for failed.
+  MaceStatus Run(const std::map<std::string, MaceTensor> &inputs,
+                 std::map<std::string, MaceTensor> *outputs);
+
+  /// \brief The share of a batch the first engine runs next, from 0 to 1.
+  float FirstShare() const;
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
 /// \brief Create MaceEngine from model graph proto and weights data
 ///
 /// Create MaceEngine object
@@ -411,6 +1760,40 @@ MACE_API MaceStatus CreateMaceEngineFromProto(
     const MaceEngineConfig &config,
     std::shared_ptr<MaceEngine> *engine);
 
+/// \brief Create MaceEngine from the model and a snapshot of its engine
+///
+/// Like CreateMaceEngineFromProto, with the memory plan, the packed weights
+/// and the algorithms of MaceEngine::SaveSnapshot loaded from the snapshot
+/// file. A snapshot of another device or build is ignored with a warning
+/// and the engine is initialized as usual; the memory plan is ignored as
+/// well if the config or the outputs differ, see ExportMemoryPlan. A
+/// snapshot of other inputs or input shapes than the model is rejected.
+///
+/// \param snapshot_file[in]: the file written by MaceEngine::SaveSnapshot
+/// \param model_graph_proto[in]: the content of model graph proto
+/// \param model_graph_proto_size[in]: the size of model graph proto
+/// \param model_weights_data[in]: the content of model weights data, see
+///                                CreateMaceEngineFromProto
+/// \param model_weights_data_size[in]: the size of model weights data
+/// \param input_nodes[in]: the array of input nodes' name
+/// \param output_nodes[in]: the array of output nodes' name
+/// \param config[in]: configurations for MaceEngine.
+/// \param engine[out]: output MaceEngine object
+/// \return MaceStatus::MACE_SUCCESS for success,
+///         MaceStatus::MACE_INVALID_ARGS for wrong arguments or a
+///         snapshot of another model,
+///         MaceStatus::MACE_OUT_OF_RESOURCES for resources is out of range.
+MACE_API MaceStatus CreateMaceEngineFromSnapshot(
+    const std::string &snapshot_file,
+    const unsigned char *model_graph_proto,
+    const size_t model_graph_proto_size,
+    const unsigned char *model_weights_data,
+    const size_t model_weights_data_size,
+    const std::vector<std::string> &input_nodes,
+    const std::vector<std::string> &output_nodes,
+    const MaceEngineConfig &config,
+    std::shared_ptr<MaceEngine> *engine);
+
 /// \brief Create MaceEngine from files (model file + data file)
 /// Deprecated, will be removed in future version
 ///
@@ -433,6 +1816,46 @@ MACE_API MaceStatus CreateMaceEngineFromProto(
     const MaceEngineConfig &config,
     std::shared_ptr<MaceEngine> *engine) __attribute__((deprecated));
 
+/// \brief Create the weights of a model to share among its engines
+///
+/// The weights are loaded by the first engine, see
+/// MaceEngineConfig::SetModelWeights.
+///
+/// \param model_weights_data[in]: the model data of the engines, which must
+///                                 outlive the weights
+/// \param model_weights_data_size[in]: the size of model_weights_data
+/// \return the weights, loaded once
+MACE_API std::shared_ptr<ModelWeights> NewModelWeights(
+    const unsigned char *model_weights_data,
+    const size_t model_weights_data_size);
+
+/// \brief Allocate a buffer shared with the Hexagon DSP
+///
+/// The buffer comes from rpcmem (ION), which FastRPC maps to the DSP instead
+/// of copying it. MaceEngine::Run passes a MaceTensor of such a buffer to the
+/// DSP as it is if it needs no layout transform, e.g. an NHWC input. Without
+/// rpcmem, or on builds without Hexagon, it is an ordinary host buffer.
+///
+/// \param nbytes[in]: the size of the buffer
+/// \return the buffer, freed with its last reference, empty for failure
+MACE_API std::shared_ptr<float> NewHexagonBuffer(size_t nbytes);
+
+/// \brief Share a buffer of an ION or dma-buf file descriptor with the DSP
+///
+/// For buffers allocated by others, e.g. by the camera HAL, to be used like
+/// the ones of NewHexagonBuffer. The buffer should stay mapped until it is
+/// unregistered.
+///
+/// \param data[in]: the address the buffer is mapped at
+/// \param nbytes[in]: the size of the buffer
+/// \param fd[in]: the file descriptor of the buffer
+/// \return MaceStatus::MACE_SUCCESS for success,
+///         MaceStatus::MACE_OUT_OF_RESOURCES if FastRPC is not available.
+MACE_API MaceStatus RegisterHexagonBuffer(void *data, size_t nbytes, int fd);
+
+/// \brief Stop sharing a buffer of RegisterHexagonBuffer with the DSP
+MACE_API void UnregisterHexagonBuffer(void *data);
+
 }  // namespace mace
 
 #endif  // MACE_PUBLIC_MACE_H_
@@ -117,8 +117,15 @@ def main(unused_args):
     option.winograd = FLAGS.winograd
     option.quantize = FLAGS.quantize
     option.quantize_range_file = FLAGS.quantize_range_file
+    option.quantize_per_channel = FLAGS.quantize_per_channel
+    option.quantize_embedding = FLAGS.quantize_embedding
+    option.palettize_weights = FLAGS.palettize_weights
+    option.weight_only_quantize = FLAGS.weight_only_quantize
+    option.quantize_8x16 = FLAGS.quantize_8x16
     option.change_concat_ranges = FLAGS.change_concat_ranges
     option.cl_mem_type = FLAGS.cl_mem_type
+    if FLAGS.fp32_ops:
+        option.fp32_ops = FLAGS.fp32_ops.split(',')
     option.device = device_type_map[FLAGS.runtime]
     option.data_type = parse_data_type(FLAGS.data_type, option.device)
 
@@ -215,7 +222,8 @@ def main(unused_args):
         FLAGS.output_dir,
         FLAGS.embed_model_data,
         FLAGS.winograd,
-        FLAGS.model_graph_format)
+        FLAGS.model_graph_format,
+        FLAGS.aot)
 
 
 def str2bool(v):
@@ -343,6 +351,40 @@ def parse_args():
         type=str,
         default="",
         help="file path of quantize range for each tensor")
+    parser.add_argument(
+        "--quantize_per_channel",
+        type=str2bool,
+        nargs='?',
+        const=False,
+        default=False,
+        help="quantize weights of conv and fc per output channel")
+    parser.add_argument(
+        "--quantize_embedding",
+        type=str2bool,
+        nargs='?',
+        const=False,
+        default=False,
+        help="quantize the tables of gather to uint8 per row")
+    parser.add_argument(
+        "--palettize_weights",
+        type=int,
+        default=0,
+        help="bits of the palette indices of the conv filters and matmul "
+             "weights of float CPU models, 0 to store them as is")
+    parser.add_argument(
+        "--weight_only_quantize",
+        type=int,
+        default=0,
+        help="bits of the weights of the fully connected and matmul ops of "
+             "float CPU models, dequantized as the ops multiply, 0 for float")
+    parser.add_argument(
+        "--quantize_8x16",
+        type=str2bool,
+        nargs='?',
+        const=False,
+        default=False,
+        help="run the fully connected ops of float CPU models with uint8 "
+             "weights and int16 activations")
     parser.add_argument(
         "--change_concat_ranges",
         type=str2bool,
@@ -355,6 +397,19 @@ def parse_args():
         type=str,
         default="image",
         help="which memory type to use.[image|buffer]")
+    parser.add_argument(
+        "--fp32_ops",
+        type=str,
+        default="",
+        help="names of the ops kept in fp32 with fp16_fp32 data type")
+    parser.add_argument(
+        "--aot",
+        type=str2bool,
+        nargs='?',
+        const=False,
+        default=False,
+        help="also compile the CPU model to C++ ahead of time, "
+             "needs code model_graph_format")
     return parser.parse_known_args()
 
 
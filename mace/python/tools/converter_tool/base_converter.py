@@ -65,6 +65,7 @@ class ActivationType(Enum):
     TANH = 4
     SIGMOID = 5
     LEAKYRELU = 6
+    GELU = 7
 
 
 class EltwiseType(Enum):
@@ -87,6 +88,7 @@ class ReduceType(Enum):
     MIN = 1
     MAX = 2
     PROD = 3
+    SUM = 4
 
 
 class PadType(Enum):
@@ -106,6 +108,7 @@ MaceSupportedOps = [
     'AddN',
     'Affine',
     'ArgMax',
+    'Attention',
     'BatchNorm',
     'BatchToSpaceND',
     'BiasAdd',
@@ -118,7 +121,10 @@ MaceSupportedOps = [
     'DepthToSpace',
     'DepthwiseConv2d',
     'DepthwiseDeconv2d',
+    'DepthwisePointwiseConv2d',
+    'DetectionOutput',
     'Dequantize',
+    'EarlyExit',
     'Eltwise',
     'ExpandDims',
     'Fill',
@@ -126,10 +132,13 @@ MaceSupportedOps = [
     'Gather',
     'Identity',
     'InferConv2dShape',
+    'LayerNorm',
     'LocalResponseNorm',
     'LSTMCell',
     # 'LstmNonlinear',
     'MatMul',
+    'MelFilterBank',
+    'MFCC',
     'Pad',
     'PNorm',
     'Pooling',
@@ -152,8 +161,10 @@ MaceSupportedOps = [
     'Unstack',
     'StridedSlice',
     'Softmax',
+    'SoftmaxTopK',
     'SpaceToBatchND',
     'SpaceToDepth',
+    'Spectrogram',
     'SqrDiffMean',
     'SumGroup',
     'TargetRMSNorm',
@@ -186,6 +197,10 @@ class MaceKeyword(object):
     mace_activation_type_str = 'activation'
     mace_activation_max_limit_str = 'max_limit'
     mace_activation_leakyrelu_coefficient_str = 'leakyrelu_coefficient'
+    mace_dw_activation_type_str = 'dw_activation'
+    mace_dw_activation_max_limit_str = 'dw_max_limit'
+    mace_dw_activation_leakyrelu_coefficient_str = \
+        'dw_leakyrelu_coefficient'
     mace_resize_size_str = 'size'
     mace_batch_to_space_crops_str = 'crops'
     mace_paddings_str = 'paddings'
@@ -213,6 +228,8 @@ class MaceKeyword(object):
     mace_shrink_axis_mask_str = 'shrink_axis_mask'
     mace_transpose_a_str = 'transpose_a'
     mace_transpose_b_str = 'transpose_b'
+    mace_perm_a_str = 'perm_a'
+    mace_perm_b_str = 'perm_b'
     mace_op_data_type_str = 'T'
     mace_offset_str = 'offset'
     mace_opencl_max_image_size = "opencl_max_image_size"
@@ -227,6 +244,7 @@ class MaceKeyword(object):
     mace_reduce_type_str = 'reduce_type'
     mace_argmin_str = 'argmin'
     mace_round_mode_str = 'round_mode'
+    mace_count_include_pad_str = 'count_include_pad'
     mace_min_size_str = 'min_size'
     mace_max_size_str = 'max_size'
     mace_aspect_ratio_str = 'aspect_ratio'
@@ -238,6 +256,21 @@ class MaceKeyword(object):
     mace_find_range_every_time = 'find_range_every_time'
     mace_non_zero = 'non_zero'
     mace_pad_type_str = 'pad_type'
+    mace_residual_str = 'residual'
+    mace_depth_to_space_str = 'depth_to_space'
+    mace_coeff_str = 'coeff'
+    mace_top_k_str = 'k'
+    mace_softmax_str = 'softmax'
+    mace_sparse_weight_str = 'sparse_weight'
+    mace_weight_bits_str = 'weight_bits'
+    mace_weight_group_size_str = 'weight_group_size'
+    mace_stateful_str = 'stateful'
+    mace_num_classes_str = 'num_classes'
+    mace_background_label_id_str = 'background_label_id'
+    mace_nms_threshold_str = 'nms_threshold'
+    mace_nms_top_k_str = 'top_k'
+    mace_keep_top_k_str = 'keep_top_k'
+    mace_confidence_threshold_str = 'confidence_threshold'
 
 
 class TransformerRule(Enum):
@@ -281,6 +314,21 @@ class TransformerRule(Enum):
     TRANSFORM_CHANNEL_SHUFFLE = 38
     UPDATE_DATA_FORMAT = 39
     QUANTIZE_MATMUL_ONLY = 40
+    FOLD_RESIDUAL_ADD = 41
+    FOLD_DEPTHWISE_POINTWISE = 42
+    FOLD_SOFTMAX_TOP_K = 43
+    ADD_SPARSE_WEIGHT_ARG = 44
+    FOLD_PAD = 45
+    QUANTIZE_EMBEDDING = 46
+    PALETTIZE_WEIGHTS = 47
+    WEIGHT_ONLY_QUANTIZE = 48
+    FOLD_ATTENTION = 49
+    FOLD_LAYER_NORM = 50
+    FOLD_GELU = 51
+    QUANTIZE_8X16 = 52
+    FOLD_DEPTH_TO_SPACE = 53
+    FOLD_UPSAMPLE_CONV = 54
+    FOLD_TRANSPOSE_MATMUL = 55
 
 
 class ConverterInterface(object):
@@ -347,9 +395,15 @@ class ConverterOption(object):
         self._winograd = 0
         self._quantize = False
         self._quantize_range_file = ""
+        self._quantize_per_channel = False
+        self._quantize_embedding = False
+        self._palettize_weights = 0
+        self._weight_only_quantize = 0
+        self._quantize_8x16 = False
         self._change_concat_ranges = False
         self._transformer_option = None
         self._cl_mem_type = ""
+        self._fp32_ops = []
 
     @property
     def input_nodes(self):
@@ -387,6 +441,26 @@ class ConverterOption(object):
     def quantize_range_file(self):
         return self._quantize_range_file
 
+    @property
+    def quantize_per_channel(self):
+        return self._quantize_per_channel
+
+    @property
+    def quantize_embedding(self):
+        return self._quantize_embedding
+
+    @property
+    def palettize_weights(self):
+        return self._palettize_weights
+
+    @property
+    def weight_only_quantize(self):
+        return self._weight_only_quantize
+
+    @property
+    def quantize_8x16(self):
+        return self._quantize_8x16
+
     @property
     def transformer_option(self):
         return self._transformer_option
@@ -395,6 +469,10 @@ class ConverterOption(object):
     def cl_mem_type(self):
         return self._cl_mem_type
 
+    @property
+    def fp32_ops(self):
+        return self._fp32_ops
+
     @input_nodes.setter
     def input_nodes(self, input_nodes):
         for node in input_nodes.values():
@@ -439,6 +517,26 @@ class ConverterOption(object):
     def quantize_range_file(self, quantize_range_file):
         self._quantize_range_file = quantize_range_file
 
+    @quantize_per_channel.setter
+    def quantize_per_channel(self, quantize_per_channel):
+        self._quantize_per_channel = quantize_per_channel
+
+    @quantize_embedding.setter
+    def quantize_embedding(self, quantize_embedding):
+        self._quantize_embedding = quantize_embedding
+
+    @palettize_weights.setter
+    def palettize_weights(self, palettize_weights):
+        self._palettize_weights = palettize_weights
+
+    @weight_only_quantize.setter
+    def weight_only_quantize(self, weight_only_quantize):
+        self._weight_only_quantize = weight_only_quantize
+
+    @quantize_8x16.setter
+    def quantize_8x16(self, quantize_8x16):
+        self._quantize_8x16 = quantize_8x16
+
     @change_concat_ranges.setter
     def change_concat_ranges(self, change_concat_ranges):
         self._change_concat_ranges = change_concat_ranges
@@ -451,6 +549,10 @@ class ConverterOption(object):
     def cl_mem_type(self, cl_mem_type):
         self._cl_mem_type = cl_mem_type
 
+    @fp32_ops.setter
+    def fp32_ops(self, fp32_ops):
+        self._fp32_ops = fp32_ops
+
     def disable_transpose_filters(self):
         if TransformerRule.TRANSPOSE_FILTERS in self._transformer_option:
             self._transformer_option.remove(TransformerRule.TRANSPOSE_FILTERS)
@@ -478,12 +580,22 @@ class ConverterOption(object):
                 TransformerRule.FOLD_CONV_AND_BN,
                 TransformerRule.FOLD_DECONV_AND_BN,
                 TransformerRule.FOLD_DEPTHWISE_CONV_AND_BN,
+                TransformerRule.FOLD_LAYER_NORM,
+                TransformerRule.FOLD_GELU,
                 TransformerRule.TRANSFORM_ADD_TO_BIASADD,
+                TransformerRule.FLATTEN_ATROUS_CONV,
                 TransformerRule.REARRANGE_BATCH_TO_SPACE,
                 TransformerRule.FOLD_BIASADD,
-                TransformerRule.FLATTEN_ATROUS_CONV,
+                TransformerRule.FOLD_RESIDUAL_ADD,
+                TransformerRule.FOLD_PAD,
+                TransformerRule.FOLD_ACTIVATION,
+                TransformerRule.FOLD_DEPTH_TO_SPACE,
+                # fold the activation after a depth to space folded into
+                # a conv
                 TransformerRule.FOLD_ACTIVATION,
                 TransformerRule.FOLD_SQRDIFF_MEAN,
+                TransformerRule.FOLD_SOFTMAX_TOP_K,
+                TransformerRule.FOLD_ATTENTION,
                 TransformerRule.TRANSFORM_GLOBAL_CONV_TO_FC,
                 TransformerRule.RESHAPE_FC_WEIGHT,
                 TransformerRule.FOLD_FC_RESHAPE,
@@ -492,12 +604,21 @@ class ConverterOption(object):
                 TransformerRule.TRANSPOSE_FILTERS,
                 TransformerRule.TRANSPOSE_DATA_FORMAT,
                 TransformerRule.TRANSPOSE_MATMUL_WEIGHT,
+                TransformerRule.FOLD_TRANSPOSE_MATMUL,
+                TransformerRule.FOLD_UPSAMPLE_CONV,
+                TransformerRule.FOLD_DEPTHWISE_POINTWISE,
+                TransformerRule.ADD_SPARSE_WEIGHT_ARG,
+                TransformerRule.QUANTIZE_EMBEDDING,
+                TransformerRule.PALETTIZE_WEIGHTS,
+                TransformerRule.WEIGHT_ONLY_QUANTIZE,
                 # Add winograd argument
                 TransformerRule.ADD_WINOGRAD_ARG,
                 # Mace model structure related transformation
                 TransformerRule.ADD_IN_OUT_TENSOR_INFO,
                 # Data type related transformation
                 TransformerRule.UPDATE_FLOAT_OP_DATA_TYPE,
+                # Need to be put after UPDATE_FLOAT_OP_DATA_TYPE
+                TransformerRule.QUANTIZE_8X16,
                 # Transform finalization
                 TransformerRule.ADD_OPENCL_INFORMATIONS,
                 # for quantization entropy calibration use
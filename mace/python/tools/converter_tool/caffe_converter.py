@@ -190,6 +190,7 @@ class CaffeConverter(base_converter.ConverterInterface):
             'Permute': self.convert_permute,
             'Flatten': self.convert_flatten,
             'PriorBox': self.convert_prior_box,
+            'DetectionOutput': self.convert_detection_output,
             'Reshape': self.convert_reshape,
         }
         self._option = option
@@ -773,6 +774,42 @@ class CaffeConverter(base_converter.ConverterInterface):
             step_h_arg.f = param.step
             step_w_arg.f = param.step
 
+    def convert_detection_output(self, caffe_op):
+        op = self.convert_general_op(caffe_op)
+        param = caffe_op.layer.detection_output_param
+        op.type = MaceOp.DetectionOutput.name
+        mace_check(param.share_location,
+                   "DetectionOutput only supports shared locations")
+        mace_check(param.code_type ==
+                   caffe_pb2.PriorBoxParameter.CENTER_SIZE,
+                   "DetectionOutput only supports CENTER_SIZE code type")
+        mace_check(not param.variance_encoded_in_target,
+                   "DetectionOutput only supports variances of the priors")
+
+        num_classes_arg = op.arg.add()
+        num_classes_arg.name = MaceKeyword.mace_num_classes_str
+        num_classes_arg.i = param.num_classes
+        background_label_id_arg = op.arg.add()
+        background_label_id_arg.name = \
+            MaceKeyword.mace_background_label_id_str
+        background_label_id_arg.i = param.background_label_id
+        nms_threshold_arg = op.arg.add()
+        nms_threshold_arg.name = MaceKeyword.mace_nms_threshold_str
+        nms_threshold_arg.f = param.nms_param.nms_threshold
+        nms_top_k_arg = op.arg.add()
+        nms_top_k_arg.name = MaceKeyword.mace_nms_top_k_str
+        nms_top_k_arg.i = -1
+        if param.nms_param.HasField('top_k'):
+            nms_top_k_arg.i = param.nms_param.top_k
+        keep_top_k_arg = op.arg.add()
+        keep_top_k_arg.name = MaceKeyword.mace_keep_top_k_str
+        keep_top_k_arg.i = param.keep_top_k
+        if param.HasField('confidence_threshold'):
+            confidence_threshold_arg = op.arg.add()
+            confidence_threshold_arg.name = \
+                MaceKeyword.mace_confidence_threshold_str
+            confidence_threshold_arg.f = param.confidence_threshold
+
     def convert_reshape(self, caffe_op):
         op = self.convert_general_op(caffe_op)
         param = caffe_op.layer.reshape_param
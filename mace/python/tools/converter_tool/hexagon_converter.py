@@ -20,6 +20,7 @@ from operator import mul
 from mace.proto import mace_pb2
 from mace.python.tools.converter_tool import base_converter
 from mace.python.tools.converter_tool.base_converter import ConverterUtil
+from mace.python.tools.converter_tool.base_converter import DataFormat
 from mace.python.tools.converter_tool.base_converter import EltwiseType
 from mace.python.tools.converter_tool.base_converter import MaceKeyword
 from mace.python.tools.converter_tool.base_converter import MaceOp
@@ -49,6 +50,11 @@ HexagonSupportedOps = [
 HexagonOp = Enum('HexagonOp', [(op, op) for op in HexagonSupportedOps],
                  type=str)
 
+# the CPU op running a partition of the graph on the DSP, see
+# mace/ops/hexagon_graph.cc
+HexagonGraphOpType = 'HexagonGraph'
+HexagonGraphArg = 'hexagon_graph'
+
 
 class HexagonOps(object):
     def __init__(self):
@@ -114,13 +120,21 @@ class HexagonConverter(base_converter.ConverterInterface):
         self._quantize_activation_info = quantize_activation_info
 
     def run(self):
+        for tensor in self._model.tensors:
+            self._consts[tensor.name] = tensor
+
+        unsupported_ops = [op for op in self._model.op
+                           if not self.is_supported(op)]
+        if unsupported_ops:
+            print("Hexagon does not support ops: %s" %
+                  ', '.join(['%s(%s)' % (op.name, op.type)
+                             for op in unsupported_ops]))
+            return self.partition_graph()
+
         mace_check(len(self._option.input_nodes) == 1
                    and len(self._option.output_nodes) == 1,
                    'dsp only support single input and output')
 
-        for tensor in self._model.tensors:
-            self._consts[tensor.name] = tensor
-
         # convert op node
         self.convert_ops()
 
@@ -136,6 +150,179 @@ class HexagonConverter(base_converter.ConverterInterface):
 
         return self._model
 
+    def is_supported(self, op):
+        if not self._hexagon_ops.has_op(op.type):
+            return False
+        if op.type == MaceOp.Eltwise.name:
+            return ConverterUtil.get_arg(
+                op, MaceKeyword.mace_element_type_str).i \
+                == EltwiseType.SUM.value
+        if op.type == MaceOp.Reduce.name:
+            # mean over the spatial dims, with the dims kept
+            reduce_type_arg = ConverterUtil.get_arg(
+                op, MaceKeyword.mace_reduce_type_str)
+            keep_dims_arg = ConverterUtil.get_arg(
+                op, MaceKeyword.mace_keepdims_str)
+            axis_arg = ConverterUtil.get_arg(op, MaceKeyword.mace_axis_str)
+            return reduce_type_arg is not None \
+                and reduce_type_arg.i == ReduceType.MEAN.value \
+                and keep_dims_arg is not None and keep_dims_arg.i == 1 \
+                and axis_arg is not None \
+                and 1 <= len(axis_arg.ints) <= 2 \
+                and all([1 <= i <= 2 for i in axis_arg.ints])
+        return True
+
+    def partition_graph(self):
+        """Run each run of consecutive ops the DSP supports as a HexagonGraph
+        op of a graph of its own, and the other ops as quantized CPU ops.
+        The uint8 tensors between them are passed with their ranges, in
+        buffers shared by the CPU and the DSP."""
+        print("Partition mace graph between hexagon and cpu.")
+        model = self._model
+        consts = self._consts
+        ops = list(model.op)
+        producers = {}
+        last_consumers = {}
+        for i, op in enumerate(ops):
+            for output in op.output:
+                producers[output] = op
+            for ipt in op.input:
+                last_consumers[ipt] = i
+
+        def on_dsp(op):
+            # the net inputs and outputs are quantized on CPU
+            return op.type not in [MaceOp.Quantize.name,
+                                   MaceOp.Dequantize.name] \
+                and self.is_supported(op)
+
+        runs = []
+        begin = 0
+        while begin < len(ops):
+            if not on_dsp(ops[begin]):
+                begin += 1
+                continue
+            end = begin
+            while end < len(ops) and on_dsp(ops[end]):
+                end += 1
+            runs.append((begin, end))
+            begin = end
+
+        del model.op[:]
+        next_op = 0
+        for index, (begin, end) in enumerate(runs):
+            model.op.extend(ops[next_op:begin])
+            next_op = end
+            run_ops = ops[begin:end]
+            produced = set([output for op in run_ops for output in op.output])
+            inputs = []
+            for op in run_ops:
+                for ipt in op.input:
+                    if ipt not in produced and ipt not in consts \
+                            and ipt not in inputs:
+                        inputs.append(ipt)
+            outputs = [output for op in run_ops for output in op.output
+                       if last_consumers.get(output, -1) >= end]
+
+            graph_op = model.op.add()
+            graph_op.name = 'hexagon_graph_%d' % index
+            graph_op.type = HexagonGraphOpType
+            graph_op.input.extend(inputs)
+            graph_op.output.extend(outputs)
+            for output in outputs:
+                producer = producers[output]
+                port = list(producer.output).index(output)
+                graph_op.output_shape.add().CopyFrom(
+                    producer.output_shape[port])
+                graph_op.output_type.append(mace_pb2.DT_UINT8)
+                if len(producer.quantize_info) > port:
+                    graph_op.quantize_info.add().CopyFrom(
+                        producer.quantize_info[port])
+            ConverterUtil.add_data_type_arg(graph_op, mace_pb2.DT_UINT8)
+            ConverterUtil.add_data_format_arg(graph_op, DataFormat.NHWC)
+            graph_arg = graph_op.arg.add()
+            graph_arg.name = HexagonGraphArg
+            graph_arg.s = self.convert_partition(
+                run_ops, inputs, outputs, producers).SerializeToString()
+            print('Hexagon graph %d: %d ops, inputs %s, outputs %s' %
+                  (index, len(run_ops), inputs, outputs))
+        model.op.extend(ops[next_op:])
+
+        for op in model.op:
+            # the biases are quantized as the DSP takes them
+            mace_check(op.type not in [MaceOp.Conv2D.name,
+                                       MaceOp.DepthwiseConv2d.name,
+                                       MaceOp.FullyConnected.name]
+                       or len(op.input) < 3,
+                       'Hexagon quantized bias could not run on cpu: %s(%s)'
+                       % (op.name, op.type))
+        used_tensors = set([ipt for op in model.op for ipt in op.input])
+        tensors = [tensor for tensor in model.tensors
+                   if tensor.name in used_tensors]
+        del model.tensors[:]
+        model.tensors.extend(tensors)
+        return model
+
+    def convert_partition(self, run_ops, inputs, outputs, producers):
+        """The graph of a run of ops, fed and read by the nodes which pass
+        the quantized tensors without quantizing them."""
+        graph = mace_pb2.NetDef()
+        for ipt in inputs:
+            producer = producers[ipt]
+            shape = producer.output_shape[
+                list(producer.output).index(ipt)].dims
+            input_name, port = get_op_and_port_from_tensor(ipt)
+            mace_check(port == 0 and len(shape) == 4,
+                       'Hexagon graph input should be a 4D tensor of port 0:'
+                       ' %s' % ipt)
+            input_op = graph.op.add()
+            input_op.name = input_name
+            input_op.type = MaceOp.Quantize.name
+            input_op.output.extend([ipt])
+            input_op.output_shape.add().dims.extend(shape)
+            input_info = graph.input_info.add()
+            input_info.name = ipt
+            input_info.dims.extend(shape)
+            input_info.data_type = mace_pb2.DT_UINT8
+        for op in run_ops:
+            graph.op.add().CopyFrom(op)
+            for ipt in op.input:
+                if ipt in self._consts and ipt not in \
+                        [tensor.name for tensor in graph.tensors]:
+                    graph.tensors.add().CopyFrom(self._consts[ipt])
+        for output in outputs:
+            producer = producers[output]
+            shape = producer.output_shape[
+                list(producer.output).index(output)].dims
+            mace_check(len(shape) == 4,
+                       'Hexagon graph output should be a 4D tensor: %s'
+                       % output)
+            output_op = graph.op.add()
+            output_op.name = normalize_name(output) + '_output'
+            output_op.type = MaceOp.Dequantize.name
+            output_op.input.extend([output])
+            output_op.output.extend([output_op.name])
+            output_op.output_shape.add().dims.extend(shape)
+            output_op.output_type.extend([mace_pb2.DT_FLOAT])
+            output_info = graph.output_info.add()
+            output_info.name = output
+            output_info.dims.extend(shape)
+            output_info.data_type = mace_pb2.DT_UINT8
+
+        model, consts = self._model, self._consts
+        self._model = graph
+        self._consts = {}
+        for tensor in graph.tensors:
+            self._consts[tensor.name] = tensor
+        self.convert_ops()
+        for op in graph.op:
+            if op.type == HexagonOp.DequantizeOUTPUT_8tof.name:
+                del op.output_shape[:]
+                del op.output_type[:]
+                del op.out_max_byte_size[:]
+        self.add_node_id()
+        self._model, self._consts = model, consts
+        return graph
+
     def convert_ops(self):
         print("Convert mace graph to hexagon.")
         for op in self._model.op:
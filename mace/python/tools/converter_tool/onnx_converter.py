@@ -82,6 +82,7 @@ OnnxSupportedOps = [
     # 'Floor',
     # 'GRU',
     'Gather',
+    'Gelu',
     'Gemm',
     'GlobalAveragePool',
     # 'GlobalLpPool',
@@ -96,6 +97,7 @@ OnnxSupportedOps = [
     # 'InstanceNormalization',
     # 'LRN',
     'LSTM',
+    'LayerNormalization',
     # 'LstmNonlinear',
     'LeakyRelu',
     # 'Less',
@@ -110,6 +112,8 @@ OnnxSupportedOps = [
     # 'MaxRoiPool',
     # 'MaxUnpool',
     'Mean',
+    'MelFilterBank',
+    'MFCC',
     'Min',
     'Mul',
     # 'Multinomial',
@@ -155,6 +159,7 @@ OnnxSupportedOps = [
     # 'Softplus',
     # 'Softsign',
     'SpaceToDepth',
+    'Spectrogram',
     'Splice',
     'Split',
     'Sqrt',
@@ -304,6 +309,8 @@ class OnnxConverter(base_converter.ConverterInterface):
         OnnxOpType.PRelu.name: ActivationType.PRELU,
         OnnxOpType.Tanh.name: ActivationType.TANH,
         OnnxOpType.Sigmoid.name: ActivationType.SIGMOID,
+        # the erf form of Gelu runs as its tanh approximation
+        OnnxOpType.Gelu.name: ActivationType.GELU,
     }
 
     def __init__(self, option, src_model_file):
@@ -326,12 +333,14 @@ class OnnxConverter(base_converter.ConverterInterface):
             OnnxOpType.Div.name: self.convert_eltwise,
             OnnxOpType.Equal.name: self.convert_eltwise,
             OnnxOpType.Gather.name: self.convert_gather,
+            OnnxOpType.Gelu.name: self.convert_activation,
             OnnxOpType.Gemm.name: self.convert_gemm,
             OnnxOpType.GlobalAveragePool.name: self.convert_reduce,
             OnnxOpType.GlobalMaxPool.name: self.convert_reduce,
             OnnxOpType.Identity.name: self.convert_identity,
             OnnxOpType.IfDefined.name: self.convert_identity,
             OnnxOpType.ImageScaler.name: self.convert_imagescaler,
+            OnnxOpType.LayerNormalization.name: self.convert_layer_norm,
             OnnxOpType.LeakyRelu.name: self.convert_activation,
             # OnnxOpType.LogSoftmax.name: self.convert_softmax,
             OnnxOpType.LSTM.name: self.convert_lstm,
@@ -339,6 +348,8 @@ class OnnxConverter(base_converter.ConverterInterface):
             OnnxOpType.Max.name: self.convert_eltwise,
             OnnxOpType.MaxPool.name: self.convert_pooling,
             OnnxOpType.MatMul.name: self.convert_matmul,
+            OnnxOpType.MelFilterBank.name: self.convert_audio_frontend,
+            OnnxOpType.MFCC.name: self.convert_audio_frontend,
             OnnxOpType.Min.name: self.convert_eltwise,
             OnnxOpType.Mul.name: self.convert_eltwise,
             OnnxOpType.Neg.name: self.convert_eltwise,
@@ -356,6 +367,7 @@ class OnnxConverter(base_converter.ConverterInterface):
             OnnxOpType.Slice.name: self.convert_slice,
             OnnxOpType.Softmax.name: self.convert_softmax,
             OnnxOpType.SpaceToDepth.name: self.convert_depth_space,
+            OnnxOpType.Spectrogram.name: self.convert_audio_frontend,
             OnnxOpType.Splice.name: self.convert_splice,
             OnnxOpType.Split.name: self.convert_split,
             OnnxOpType.Sqrt.name: self.convert_eltwise,
@@ -579,6 +591,24 @@ class OnnxConverter(base_converter.ConverterInterface):
         alpha_arg.name = MaceKeyword.mace_activation_max_limit_str
         alpha_arg.f = alpha_value
 
+    def convert_layer_norm(self, node):
+        op = self.convert_general_op(node)
+        op.type = MaceOp.LayerNorm.name
+        # the mean and the inverse std outputs are for training only
+        del op.output[1:]
+        del op.output_shape[1:]
+        mace_check(len(op.output_shape) == 0 or
+                   len(op.output_shape[0].dims) != 4 or
+                   self._data_format == DataFormat.DF_NONE,
+                   "LayerNormalization of NCHW images is not supported")
+
+        axis_arg = op.arg.add()
+        axis_arg.name = MaceKeyword.mace_axis_str
+        axis_arg.i = node.attrs.get('axis', -1)
+        epsilon_arg = op.arg.add()
+        epsilon_arg.name = MaceKeyword.mace_epsilon_str
+        epsilon_arg.f = node.attrs.get('epsilon', 1e-5)
+
     def convert_affine(self, node):
         op = self.convert_general_op(node)
         op.type = MaceOp.MatMul.name
@@ -611,6 +641,32 @@ class OnnxConverter(base_converter.ConverterInterface):
             min_arg.name = MaceKeyword.mace_argmin_str
             min_arg.i = 1
 
+    # the args of the feature extraction ops of Kaldi, by their types
+    audio_frontend_args = {
+        'window_length': 'i', 'frame_shift': 'i', 'fft_length': 'i',
+        'window_type': 's', 'preemphasis_coefficient': 'f',
+        'remove_dc_offset': 'i', 'power': 'i', 'sample_rate': 'f',
+        'num_mel_bins': 'i', 'low_freq': 'f', 'high_freq': 'f',
+        'use_log': 'i', 'log_floor': 'f', 'num_ceps': 'i',
+        'cepstral_lifter': 'f',
+    }
+
+    def convert_audio_frontend(self, node):
+        op = self.convert_general_op(node)
+        op.type = MaceOp[node.op_type].name
+        for name, arg_type in self.audio_frontend_args.items():
+            if name not in node.attrs:
+                continue
+            value = node.attrs[name]
+            arg = op.arg.add()
+            arg.name = name
+            if arg_type == 'i':
+                arg.i = int(value)
+            elif arg_type == 'f':
+                arg.f = float(value)
+            else:
+                arg.s = six.b(value)
+
     def convert_biasadd(self, node):
         self.convert_general_op(node)
         op.type = MaceOp.BiasAdd.name
@@ -950,6 +1006,13 @@ class OnnxConverter(base_converter.ConverterInterface):
         round_mode_arg.name = MaceKeyword.mace_round_mode_str
         round_mode_arg.i = RoundMode.FLOOR.value
 
+        if node.op_type == OnnxOpType.AveragePool.name and \
+                node.attrs.get('count_include_pad', 0) == 1:
+            count_include_pad_arg = op.arg.add()
+            count_include_pad_arg.name = \
+                MaceKeyword.mace_count_include_pad_str
+            count_include_pad_arg.i = 1
+
     def convert_reduce(self, node):
         op = self.convert_general_op(node)
         op.type = MaceOp.Reduce.name
@@ -51,6 +51,7 @@ class ShapeInference(object):
             MaceOp.ChannelShuffle.name: self.infer_shape_channel_shuffle,
             MaceOp.Transpose.name: self.infer_shape_permute,
             MaceOp.PriorBox.name: self.infer_shape_prior_box,
+            MaceOp.DetectionOutput.name: self.infer_shape_detection_output,
             MaceOp.Reshape.name: self.infer_shape_reshape,
         }
 
@@ -251,6 +252,22 @@ class ShapeInference(object):
         output_shape[2] = num_prior * input_h * input_w * 4
         self.add_output_shape(op, [output_shape])
 
+    def infer_shape_detection_output(self, op):
+        # the detections are an upper bound of those found at runtime
+        batch = self._output_shape_cache[op.input[0]][0]
+        num_prior = self._output_shape_cache[op.input[2]][2] // 4
+        num_classes = ConverterUtil.get_arg(
+            op, MaceKeyword.mace_num_classes_str).i
+        top_k = ConverterUtil.get_arg(op, MaceKeyword.mace_nms_top_k_str).i
+        keep_top_k = ConverterUtil.get_arg(
+            op, MaceKeyword.mace_keep_top_k_str).i
+        num_detections = num_prior if top_k < 0 else min(top_k, num_prior)
+        num_detections *= num_classes
+        if keep_top_k >= 0:
+            num_detections = min(num_detections, keep_top_k)
+        self.add_output_shape(
+            op, [[1, 1, max(batch * num_detections, 1), 7]])
+
     def infer_shape_reshape(self, op):
         if ConverterUtil.get_arg(op, MaceKeyword.mace_dim_str) is not None:
             dim = ConverterUtil.get_arg(op, MaceKeyword.mace_dim_str).ints
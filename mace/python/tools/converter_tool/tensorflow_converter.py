@@ -101,6 +101,7 @@ TFSupportedOps = [
     'Pad',
     'ConcatV2',
     'Mean',
+    'Sum',
     'Const',
     'Gather',
     'StridedSlice',
@@ -117,6 +118,7 @@ TFSupportedOps = [
     'FloorDiv',
     'Sqrt',
     'MirrorPad',
+    'TopKV2',
 ]
 
 TFOpType = Enum('TFOpType', [(op, op) for op in TFSupportedOps], type=str)
@@ -175,6 +177,11 @@ class TensorflowConverter(base_converter.ConverterInterface):
         TFOpType.MaxPool.name: PoolingType.MAX
     }
 
+    reduce_math_type = {
+        TFOpType.Mean.name: ReduceType.MEAN,
+        TFOpType.Sum.name: ReduceType.SUM,
+    }
+
     eltwise_type = {
         TFOpType.Add.name: EltwiseType.SUM,
         TFOpType.Sub.name: EltwiseType.SUB,
@@ -260,7 +267,8 @@ class TensorflowConverter(base_converter.ConverterInterface):
             TFOpType.SpaceToDepth.name: self.convert_space_depth,
             TFOpType.Pad.name: self.convert_pad,
             TFOpType.ConcatV2.name: self.convert_concat,
-            TFOpType.Mean.name: self.convert_mean,
+            TFOpType.Mean.name: self.convert_reduce,
+            TFOpType.Sum.name: self.convert_reduce,
             TFOpType.Const.name: self.convert_nop,
             TFOpType.Gather.name: self.convert_gather,
             TFOpType.StridedSlice.name: self.convert_stridedslice,
@@ -277,6 +285,7 @@ class TensorflowConverter(base_converter.ConverterInterface):
             TFOpType.FloorDiv.name: self.convert_elementwise,
             TFOpType.Sqrt.name: self.convert_elementwise,
             TFOpType.MirrorPad.name: self.convert_pad,
+            TFOpType.TopKV2.name: self.convert_top_k,
         }
         self._option = option
         self._mace_net_def = mace_pb2.NetDef()
@@ -859,7 +868,7 @@ class TensorflowConverter(base_converter.ConverterInterface):
             dims_arg.name = MaceKeyword.mace_dims_str
             dims_arg.ints.extend(perm)
 
-    def convert_mean(self, tf_op):
+    def convert_reduce(self, tf_op):
         op = self.convert_general_op(tf_op)
         del op.input[1:]
 
@@ -867,7 +876,7 @@ class TensorflowConverter(base_converter.ConverterInterface):
 
         reduce_type_arg = op.arg.add()
         reduce_type_arg.name = MaceKeyword.mace_reduce_type_str
-        reduce_type_arg.i = ReduceType.MEAN.value
+        reduce_type_arg.i = self.reduce_math_type[tf_op.type].value
 
         axis_arg = op.arg.add()
         axis_arg.name = MaceKeyword.mace_axis_str
@@ -984,6 +993,22 @@ class TensorflowConverter(base_converter.ConverterInterface):
         op.type = MaceOp.ArgMax.name
         op.output_type.extend([mace_pb2.DT_INT32])
 
+    def convert_top_k(self, tf_op):
+        op = self.convert_general_op(tf_op)
+        op.type = MaceOp.SoftmaxTopK.name
+        op.output_type.extend([self._option.data_type, mace_pb2.DT_INT32])
+        del op.input[1:]
+
+        k_arg = op.arg.add()
+        k_arg.name = MaceKeyword.mace_top_k_str
+        k_arg.i = tf_op.inputs[1].eval().astype(np.int32)
+
+        softmax_arg = op.arg.add()
+        softmax_arg.name = MaceKeyword.mace_softmax_str
+        softmax_arg.i = 0
+
+        self._skip_tensor.add(tf_op.inputs[1].name)
+
     def convert_split(self, tf_op):
         op = self.convert_general_op(tf_op)
         op.type = MaceOp.Split.name
@@ -20,6 +20,7 @@ import six
 
 from mace.proto import mace_pb2
 from mace.python.tools.converter_tool import base_converter
+from mace.python.tools.converter_tool.base_converter import ActivationType
 from mace.python.tools.converter_tool.base_converter import ConverterUtil
 from mace.python.tools.converter_tool.base_converter import DataFormat
 from mace.python.tools.converter_tool.base_converter import DeviceType
@@ -29,11 +30,21 @@ from mace.python.tools.converter_tool.base_converter import FilterFormat
 from mace.python.tools.converter_tool.base_converter import MaceKeyword
 from mace.python.tools.converter_tool.base_converter import MaceOp
 from mace.python.tools.converter_tool.base_converter import PaddingMode
+from mace.python.tools.converter_tool.base_converter import PadType
 from mace.python.tools.converter_tool.base_converter import ReduceType
 from mace.python.tools.converter_tool.base_converter import TransformerRule
 from mace.python.tools.convert_util import mace_check
 from mace.python.tools.quantization import quantize_util
 
+# the most nonzero 1x4 blocks of a pruned weight, as the fraction of all its
+# blocks, for which the block-sparse CPU kernels beat the dense gemv of
+# FullyConnected and the dense gemm of 1x1 Conv2D
+SPARSE_FC_MAX_DENSITY = 0.5
+SPARSE_CONV_MAX_DENSITY = 0.3
+SPARSE_BLOCK_SIZE = 4
+# the weights of a row sharing a scale when quantized to 4 bits weight-only
+WEIGHT_ONLY_INT4_GROUP_SIZE = 32
+
 
 class Transformer(base_converter.ConverterInterface):
     """A class for transform naive mace model to optimized model.
@@ -59,6 +70,9 @@ class Transformer(base_converter.ConverterInterface):
                 self.transform_matmul_to_fc,
             TransformerRule.FOLD_BATCHNORM: self.fold_batchnorm,
             TransformerRule.FOLD_BIASADD: self.fold_biasadd,
+            TransformerRule.FOLD_RESIDUAL_ADD: self.fold_residual_add,
+            TransformerRule.FOLD_DEPTH_TO_SPACE: self.fold_depth_to_space,
+            TransformerRule.FOLD_UPSAMPLE_CONV: self.fold_upsample_conv,
             TransformerRule.FOLD_CONV_AND_BN:
                 self.fold_conv_and_bn,  # data_format related
             TransformerRule.FOLD_DECONV_AND_BN:
@@ -70,12 +84,15 @@ class Transformer(base_converter.ConverterInterface):
             TransformerRule.REARRANGE_BATCH_TO_SPACE:
                 self.rearrange_batch_to_space,
             TransformerRule.FLATTEN_ATROUS_CONV: self.flatten_atrous_conv,
+            TransformerRule.FOLD_PAD: self.fold_pad,
             TransformerRule.FOLD_ACTIVATION: self.fold_activation,
             TransformerRule.FOLD_SQRDIFF_MEAN: self.fold_squared_diff_mean,
             TransformerRule.FOLD_EMBEDDING_LOOKUP: self.fold_embedding_lookup,
             TransformerRule.TRANSPOSE_FILTERS: self.transpose_filters,
             TransformerRule.TRANSPOSE_MATMUL_WEIGHT:
                 self.transpose_matmul_weight,
+            TransformerRule.FOLD_TRANSPOSE_MATMUL:
+                self.fold_transpose_matmul,
             TransformerRule.FOLD_FC_RESHAPE:
                 self.fold_fc_reshape,
             TransformerRule.TRANSPOSE_DATA_FORMAT: self.transpose_data_format,
@@ -105,6 +122,26 @@ class Transformer(base_converter.ConverterInterface):
                 self.transform_channel_shuffle,
             TransformerRule.QUANTIZE_MATMUL_ONLY:
                 self.quantize_matmul_only,
+            TransformerRule.FOLD_DEPTHWISE_POINTWISE:
+                self.fold_depthwise_pointwise,
+            TransformerRule.ADD_SPARSE_WEIGHT_ARG:
+                self.add_sparse_weight_arg,
+            TransformerRule.QUANTIZE_EMBEDDING:
+                self.quantize_embedding,
+            TransformerRule.PALETTIZE_WEIGHTS:
+                self.palettize_weights,
+            TransformerRule.WEIGHT_ONLY_QUANTIZE:
+                self.weight_only_quantize,
+            TransformerRule.QUANTIZE_8X16:
+                self.quantize_8x16,
+            TransformerRule.FOLD_SOFTMAX_TOP_K:
+                self.fold_softmax_top_k,
+            TransformerRule.FOLD_ATTENTION:
+                self.fold_attention,
+            TransformerRule.FOLD_LAYER_NORM:
+                self.fold_layer_norm,
+            TransformerRule.FOLD_GELU:
+                self.fold_gelu,
         }
 
         self._option = option
@@ -429,6 +466,463 @@ class Transformer(base_converter.ConverterInterface):
 
         return False
 
+    def fold_softmax_top_k(self):
+        """Fold a Softmax into the SoftmaxTopK reading it, which then
+        computes the probabilities of the top k elements only"""
+        net = self._model
+        for op in net.op:
+            if op.type != MaceOp.Softmax.name \
+                    or len(op.output_shape[0].dims) == 4 \
+                    or op.output[0] in self._option.output_nodes \
+                    or self.consumer_count(op.output[0]) != 1:
+                continue
+            consumer_op = self._consumers[op.output[0]][0]
+            if consumer_op.type != MaceOp.SoftmaxTopK.name:
+                continue
+            softmax_arg = ConverterUtil.get_arg(
+                consumer_op, MaceKeyword.mace_softmax_str)
+            if softmax_arg.i != 0:
+                continue
+            print("Fold Softmax TopK: %s" % op.name)
+            softmax_arg.i = 1
+            self.safe_remove_node(op, None)
+            return True
+
+        return False
+
+    def fold_attention(self):
+        """Fold MatMul(Q, K) -> [Eltwise scale] -> [Eltwise add mask] ->
+        Softmax -> MatMul(P, V) into an Attention op, which computes the
+        softmax of the scores of a query block by block without keeping
+        them, along with the [0, 2, 1, 3] Transposes of the inputs and the
+        output of [batch, seq, heads, depth] models"""
+        net = self._model
+        for op in net.op:
+            if op.type != MaceOp.Softmax.name \
+                    or ConverterUtil.data_format(op) is not None \
+                    or len(op.output_shape[0].dims) not in [3, 4] \
+                    or not self.is_single_intermediate(op) \
+                    or op.input[0] not in self._producer:
+                continue
+            pv_op = self._consumers[op.output[0]][0]
+            if pv_op.type != MaceOp.MatMul.name \
+                    or len(pv_op.input) != 2 \
+                    or pv_op.input[0] != op.output[0] \
+                    or self.matmul_transposed(pv_op, 0) \
+                    or self.matmul_transposed(pv_op, 1):
+                continue
+
+            folded_ops = [op]
+            scores = op.input[0]
+            mask = None
+            scale = 1.0
+            producer = self._producer.get(scores)
+            if self.is_attention_eltwise(producer, EltwiseType.SUM) \
+                    and len(producer.input) == 2:
+                score_idx = 0
+                if self.is_attention_scores(
+                        self._producer.get(producer.input[1])):
+                    score_idx = 1
+                mask = producer.input[1 - score_idx]
+                folded_ops.append(producer)
+                scores = producer.input[score_idx]
+                producer = self._producer.get(scores)
+            for elt_type in [EltwiseType.PROD, EltwiseType.DIV]:
+                scalar = self.eltwise_scalar(producer, elt_type)
+                if scalar is None \
+                        or not self.is_single_intermediate(producer):
+                    continue
+                value, scores_input, scalar_first = scalar
+                # a scalar divided by the scores is not a scale
+                if value == 0 or (scalar_first and
+                                  elt_type == EltwiseType.DIV):
+                    break
+                scale = value if elt_type == EltwiseType.PROD \
+                    else 1.0 / value
+                folded_ops.append(producer)
+                scores = scores_input
+                producer = self._producer.get(scores)
+                break
+            qk_op = producer
+            if qk_op is None or qk_op.type != MaceOp.MatMul.name \
+                    or len(qk_op.input) != 2 \
+                    or not self.is_single_intermediate(qk_op) \
+                    or self.matmul_transposed(qk_op, 0):
+                continue
+            folded_ops.append(qk_op)
+            transpose_k = not self.matmul_transposed(qk_op, 1)
+            query, key, value = qk_op.input[0], qk_op.input[1], pv_op.input[1]
+            output = pv_op.output[0]
+            output_shape = pv_op.output_shape[0].dims
+
+            # [batch, seq, heads, depth] inputs read in place
+            seq_first = False
+            perm = [0, 2, 1, 3]
+            key_perm = [0, 2, 3, 1] if transpose_k else perm
+            transpose_ops = [self.attention_transpose(query, perm),
+                             self.attention_transpose(key, key_perm),
+                             self.attention_transpose(value, perm)]
+            if len(output_shape) == 4 \
+                    and self.is_single_intermediate(pv_op):
+                transpose_ops.append(self.attention_transpose(
+                    output, perm, consumer=True))
+            if len(transpose_ops) == 4 and None not in transpose_ops:
+                print("Fold Attention Transposes: %s" % pv_op.name)
+                seq_first = True
+                transpose_k = False
+                query, key, value = [t.input[0] for t in transpose_ops[:3]]
+                output = transpose_ops[3].output[0]
+                output_shape = transpose_ops[3].output_shape[0].dims
+                folded_ops.extend(transpose_ops[:3])
+                folded_ops.append(transpose_ops[3])
+
+            print("Fold Attention: %s" % pv_op.name)
+            pv_op.type = MaceOp.Attention.name
+            del pv_op.input[:]
+            pv_op.input.extend([query, key, value])
+            if mask is not None:
+                pv_op.input.append(mask)
+            pv_op.output[0] = output
+            del pv_op.output_shape[0].dims[:]
+            pv_op.output_shape[0].dims.extend(output_shape)
+            for arg in list(pv_op.arg):
+                if arg.name in [MaceKeyword.mace_transpose_a_str,
+                                MaceKeyword.mace_transpose_b_str]:
+                    pv_op.arg.remove(arg)
+            scale_arg = pv_op.arg.add()
+            scale_arg.name = 'scale'
+            scale_arg.f = scale
+            seq_first_arg = pv_op.arg.add()
+            seq_first_arg.name = 'seq_first'
+            seq_first_arg.i = int(seq_first)
+            transpose_k_arg = pv_op.arg.add()
+            transpose_k_arg.name = 'transpose_k'
+            transpose_k_arg.i = int(transpose_k)
+            # the ops before pv_op in the net, so it stays in order
+            for folded_op in folded_ops:
+                net.op.remove(folded_op)
+            return True
+
+        return False
+
+    def eltwise_scalar(self, op, elt_type):
+        """The scalar operand of an Eltwise op of elt_type, given as an arg
+        or a const of a value, along with its other input and whether the
+        scalar is the first operand, or None"""
+        if op is None or op.type != MaceOp.Eltwise.name:
+            return None
+        type_arg = ConverterUtil.get_arg(
+            op, MaceKeyword.mace_element_type_str)
+        if type_arg is None or type_arg.i != elt_type.value:
+            return None
+        if len(op.input) == 1:
+            value_arg = ConverterUtil.get_arg(
+                op, MaceKeyword.mace_scalar_input_str)
+            if value_arg is None:
+                return None
+            index_arg = ConverterUtil.get_arg(
+                op, MaceKeyword.mace_scalar_input_index_str)
+            return value_arg.f, op.input[0], \
+                index_arg is not None and index_arg.i == 0
+        if len(op.input) == 2:
+            for i in range(2):
+                tensor = self._consts.get(op.input[i])
+                if tensor is not None and len(tensor.float_data) == 1:
+                    return tensor.float_data[0], op.input[1 - i], i == 0
+        return None
+
+    def scalar_operand(self, op, elt_type, value):
+        """The other input of a single intermediate Eltwise op of elt_type
+        by a scalar second operand close to value, or None"""
+        scalar = self.eltwise_scalar(op, elt_type)
+        if scalar is None or abs(scalar[0] - value) > 1e-3 * abs(value) \
+                or (scalar[2] and elt_type not in [EltwiseType.SUM,
+                                                   EltwiseType.PROD]) \
+                or not self.is_single_intermediate(op):
+            return None
+        return scalar[1]
+
+    def is_single_intermediate(self, op):
+        return op.output[0] not in self._option.output_nodes \
+            and self.consumer_count(op.output[0]) == 1
+
+    @staticmethod
+    def matmul_transposed(op, idx):
+        arg = ConverterUtil.get_arg(
+            op, [MaceKeyword.mace_transpose_a_str,
+                 MaceKeyword.mace_transpose_b_str][idx])
+        return arg is not None and arg.i != 0
+
+    def is_attention_eltwise(self, op, elt_type):
+        if op is None or op.type != MaceOp.Eltwise.name \
+                or not self.is_single_intermediate(op):
+            return False
+        type_arg = ConverterUtil.get_arg(
+            op, MaceKeyword.mace_element_type_str)
+        return type_arg is not None and type_arg.i == elt_type.value
+
+    def is_attention_scores(self, op):
+        return op is not None and (
+            op.type == MaceOp.MatMul.name or
+            self.is_attention_eltwise(op, EltwiseType.PROD) or
+            self.is_attention_eltwise(op, EltwiseType.DIV))
+
+    def attention_transpose(self, tensor, perm, consumer=False):
+        if consumer:
+            transpose_op = self._consumers[tensor][0]
+        else:
+            transpose_op = self._producer.get(tensor)
+            if transpose_op is None \
+                    or not self.is_single_intermediate(transpose_op):
+                return None
+        if transpose_op.type != MaceOp.Transpose.name:
+            return None
+        dims_arg = ConverterUtil.get_arg(
+            transpose_op, MaceKeyword.mace_dims_str)
+        if dims_arg is None or list(dims_arg.ints) != perm:
+            return None
+        return transpose_op
+
+    def fold_gelu(self):
+        """Fold the tanh approximation of GELU,
+        0.5 * x * (1 + tanh(sqrt(2 / pi) * (x + 0.044715 * x^3))),
+        into a GELU Activation"""
+        net = self._model
+        for op in net.op:
+            if op.type != MaceOp.Activation.name \
+                    or ConverterUtil.get_arg(
+                        op, MaceKeyword.mace_activation_type_str).s \
+                    != b'TANH' \
+                    or not self.is_single_intermediate(op):
+                continue
+            # sqrt(2 / pi) * (x + 0.044715 * x^3)
+            inner = self.scalar_operand(self._producer.get(op.input[0]),
+                                        EltwiseType.PROD, 0.7978845608)
+            add_op = self._producer.get(inner)
+            if inner is None or add_op is None \
+                    or add_op.type != MaceOp.Eltwise.name \
+                    or len(add_op.input) != 2 \
+                    or ConverterUtil.get_arg(
+                        add_op, MaceKeyword.mace_element_type_str).i \
+                    != EltwiseType.SUM.value \
+                    or not self.is_single_intermediate(add_op):
+                continue
+            x = None
+            cube_ops = None
+            for i in range(2):
+                cubic_op = self._producer.get(add_op.input[i])
+                cube = self.scalar_operand(cubic_op, EltwiseType.PROD,
+                                           0.044715)
+                cube_ops = self.gelu_cube(self._producer.get(cube),
+                                          add_op.input[1 - i])
+                if cube_ops is not None:
+                    x = add_op.input[1 - i]
+                    cube_ops.append(cubic_op)
+                    break
+            if x is None:
+                continue
+
+            # 0.5 * x * (1 + tanh(...)), multiplied in any order
+            one_op = self._consumers[op.output[0]][0]
+            if self.scalar_operand(one_op, EltwiseType.SUM, 1.0) \
+                    != op.output[0]:
+                continue
+            final_op = None
+            half_ops = []
+            first_op = self._consumers[one_op.output[0]][0]
+            if self.scalar_operand(first_op, EltwiseType.PROD, 0.5) \
+                    == one_op.output[0]:
+                second_op = self._consumers[first_op.output[0]][0]
+                if self.is_eltwise_of(second_op, EltwiseType.PROD,
+                                      [first_op.output[0], x]):
+                    final_op = second_op
+                    half_ops = [first_op]
+            elif self.is_eltwise_of(first_op, EltwiseType.PROD,
+                                    [one_op.output[0], x]):
+                if self.is_single_intermediate(first_op):
+                    second_op = self._consumers[first_op.output[0]][0]
+                    half = self.eltwise_scalar(second_op, EltwiseType.PROD)
+                    if half is not None and abs(half[0] - 0.5) < 5e-4 \
+                            and half[1] == first_op.output[0]:
+                        final_op = second_op
+                        half_ops = [first_op]
+            elif first_op.type == MaceOp.Eltwise.name \
+                    and len(first_op.input) == 2 \
+                    and one_op.output[0] in first_op.input:
+                other = [t for t in first_op.input
+                         if t != one_op.output[0]][0]
+                half_op = self._producer.get(other)
+                if self.scalar_operand(half_op, EltwiseType.PROD, 0.5) \
+                        == x and self.is_eltwise_of(
+                            first_op, EltwiseType.PROD,
+                            [one_op.output[0], other]):
+                    final_op = first_op
+                    half_ops = [half_op]
+            if final_op is None:
+                continue
+
+            print("Fold GELU: %s" % final_op.name)
+            final_op.type = MaceOp.Activation.name
+            del final_op.input[:]
+            final_op.input.append(x)
+            self.keep_common_args(final_op)
+            type_arg = final_op.arg.add()
+            type_arg.name = MaceKeyword.mace_activation_type_str
+            type_arg.s = six.b(ActivationType.GELU.name)
+            for folded_op in [op, self._producer[op.input[0]], add_op,
+                              one_op] + cube_ops + half_ops:
+                if folded_op is not final_op:
+                    net.op.remove(folded_op)
+            return True
+
+        return False
+
+    def gelu_cube(self, op, x):
+        """The ops of x^3 ending at op, as x^3 or x * x * x, or None"""
+        if self.scalar_operand(op, EltwiseType.POW, 3.0) == x:
+            return [op]
+        if op is None or not self.is_single_intermediate(op):
+            return None
+        for square in op.input:
+            square_op = self._producer.get(square)
+            if self.is_eltwise_of(op, EltwiseType.PROD, [square, x]) \
+                    and self.is_eltwise_of(square_op, EltwiseType.PROD,
+                                           [x, x]) \
+                    and self.is_single_intermediate(square_op):
+                return [op, square_op]
+        return None
+
+    @staticmethod
+    def is_eltwise_of(op, elt_type, inputs):
+        if op is None or op.type != MaceOp.Eltwise.name:
+            return False
+        type_arg = ConverterUtil.get_arg(
+            op, MaceKeyword.mace_element_type_str)
+        return type_arg is not None and type_arg.i == elt_type.value \
+            and sorted(op.input) == sorted(inputs)
+
+    @staticmethod
+    def keep_common_args(op):
+        """Remove the args of the former type of an op turned into another"""
+        for arg in list(op.arg):
+            if arg.name not in [MaceKeyword.mace_op_data_type_str,
+                                MaceKeyword.mace_data_format_str,
+                                MaceKeyword.mace_framework_type_str]:
+                op.arg.remove(arg)
+
+    def fold_layer_norm(self):
+        """Fold (x - mean(x)) / sqrt(mean((x - mean(x))^2) + epsilon)
+        [* gamma] [+ beta] over the last axis into a LayerNorm, which
+        gathers the mean and the variance in one pass"""
+        net = self._model
+        for op in net.op:
+            if not op.output_shape \
+                    or not self.is_eltwise_of(op, EltwiseType.DIV, op.input) \
+                    or len(op.input) != 2 \
+                    or ConverterUtil.data_format(op) is not None:
+                continue
+            # x - mean(x), read by the square and the division only
+            sub_op = self._producer.get(op.input[0])
+            if sub_op is None or len(sub_op.input) != 2 \
+                    or not self.is_eltwise_of(sub_op, EltwiseType.SUB,
+                                              sub_op.input) \
+                    or sub_op.output[0] in self._option.output_nodes:
+                continue
+            x = sub_op.input[0]
+            mean_op = self._producer.get(sub_op.input[1])
+            if not self.is_last_axis_mean(mean_op, x):
+                continue
+            # sqrt(mean(square) + epsilon)
+            epsilon_out = self.scalar_operand(
+                self._producer.get(op.input[1]), EltwiseType.POW, 0.5)
+            epsilon_op = self._producer.get(epsilon_out)
+            epsilon = self.eltwise_scalar(epsilon_op, EltwiseType.SUM)
+            if epsilon is None or epsilon[0] < 0 \
+                    or not self.is_single_intermediate(epsilon_op):
+                continue
+            var_op = self._producer.get(epsilon[1])
+            if var_op is None or len(var_op.input) != 1:
+                continue
+            square_op = self._producer.get(var_op.input[0])
+            d = sub_op.output[0]
+            if not self.is_last_axis_mean(var_op, var_op.input[0]) \
+                    or not (self.scalar_operand(square_op, EltwiseType.POW,
+                                                2.0) == d or
+                            (self.is_eltwise_of(square_op, EltwiseType.PROD,
+                                                [d, d]) and
+                             self.is_single_intermediate(square_op))) \
+                    or any(consumer is not op and consumer is not square_op
+                           for consumer in self._consumers[d]):
+                continue
+            folded_ops = [mean_op, sub_op, square_op, var_op, epsilon_op,
+                          self._producer[op.input[1]]]
+
+            # the affine of the normalized dim
+            dim = op.output_shape[0].dims[-1]
+            final_op = op
+            gamma = None
+            beta = None
+            for elt_type in [EltwiseType.PROD, EltwiseType.SUM]:
+                if not self.is_single_intermediate(final_op):
+                    break
+                consumer = self._consumers[final_op.output[0]][0]
+                other = [t for t in consumer.input
+                         if t != final_op.output[0]]
+                if len(other) != 1 or other[0] not in self._consts \
+                        or list(self._consts[other[0]].dims) != [dim] \
+                        or not self.is_eltwise_of(
+                            consumer, elt_type,
+                            [final_op.output[0], other[0]]):
+                    continue
+                if elt_type == EltwiseType.PROD:
+                    gamma = other[0]
+                else:
+                    beta = other[0]
+                folded_ops.append(final_op)
+                final_op = consumer
+
+            print("Fold LayerNorm: %s" % final_op.name)
+            final_op.type = MaceOp.LayerNorm.name
+            del final_op.input[:]
+            final_op.input.append(x)
+            if gamma is None and beta is not None:
+                gamma = final_op.name + '_gamma'
+                gamma_tensor = net.tensors.add()
+                gamma_tensor.name = gamma
+                gamma_tensor.dims.extend([dim])
+                gamma_tensor.data_type = mace_pb2.DT_FLOAT
+                gamma_tensor.float_data.extend([1.0] * dim)
+            final_op.input.extend([t for t in [gamma, beta]
+                                   if t is not None])
+            self.keep_common_args(final_op)
+            epsilon_arg = final_op.arg.add()
+            epsilon_arg.name = MaceKeyword.mace_epsilon_str
+            epsilon_arg.f = epsilon[0]
+            axis_arg = final_op.arg.add()
+            axis_arg.name = MaceKeyword.mace_axis_str
+            axis_arg.i = -1
+            for folded_op in folded_ops:
+                net.op.remove(folded_op)
+            return True
+
+        return False
+
+    def is_last_axis_mean(self, op, input_name):
+        """Whether op is the mean of input_name over its last axis, kept"""
+        if op is None or op.type != MaceOp.Reduce.name \
+                or op.input[0] != input_name \
+                or not self.is_single_intermediate(op):
+            return False
+        reduce_type = ConverterUtil.get_arg(
+            op, MaceKeyword.mace_reduce_type_str)
+        axis = ConverterUtil.get_arg(op, MaceKeyword.mace_axis_str)
+        keep_dims = ConverterUtil.get_arg(op, MaceKeyword.mace_keepdims_str)
+        rank = len(op.output_shape[0].dims)
+        return reduce_type is not None \
+            and reduce_type.i == ReduceType.MEAN.value \
+            and axis is not None and list(axis.ints) in [[-1], [rank - 1]] \
+            and keep_dims is not None and keep_dims.i != 0
+
     def fold_embedding_lookup(self):
         net = self._model
         for op in net.op:
@@ -865,63 +1359,788 @@ class Transformer(base_converter.ConverterInterface):
 
         return False
 
+    def fold_residual_add(self):
+        """Fold the residual add after a conv into the conv, which adds the
+        residual, its last input, after the bias and before the activation"""
+        if self._option.quantize or \
+                self._option.device == DeviceType.HEXAGON.value:
+            return False
+
+        net = self._model
+        for op in net.op:
+            if op.type != MaceOp.Conv2D.name \
+                    or len(op.input) < 2 or len(op.input) > 3 \
+                    or len(op.output_shape) != 1 \
+                    or ConverterUtil.get_arg(
+                        op, MaceKeyword.mace_residual_str) is not None \
+                    or ConverterUtil.get_arg(
+                        op, MaceKeyword.mace_activation_type_str) is not None \
+                    or len(self._consumers.get(op.output[0], [])) != 1:
+                continue
+            consumer_op = self._consumers[op.output[0]][0]
+            if consumer_op.type != MaceOp.Eltwise.name \
+                    or len(consumer_op.input) != 2 \
+                    or ConverterUtil.get_arg(
+                        consumer_op,
+                        MaceKeyword.mace_element_type_str).i \
+                    != EltwiseType.SUM.value \
+                    or ConverterUtil.get_arg(
+                        consumer_op, MaceKeyword.mace_coeff_str) is not None \
+                    or ConverterUtil.get_arg(
+                        consumer_op,
+                        MaceKeyword.mace_scalar_input_index_str) is not None:
+                continue
+            residual = consumer_op.input[1] \
+                if consumer_op.input[0] == op.output[0] \
+                else consumer_op.input[0]
+            # no broadcast
+            if residual == op.output[0] or residual in self._consts \
+                    or self.get_tensor_shape(residual) != \
+                    list(op.output_shape[0].dims):
+                continue
+            print("Fold residual add: %s(%s)" % (op.name, op.type))
+            op.name = consumer_op.name
+            op.output[0] = consumer_op.output[0]
+            op.input.append(residual)
+            residual_arg = op.arg.add()
+            residual_arg.name = MaceKeyword.mace_residual_str
+            residual_arg.i = 1
+            self.replace_quantize_info(op, consumer_op)
+            self.safe_remove_node(consumer_op, op)
+            return True
+
+        return False
+
+    def fold_depth_to_space(self):
+        """Fold a DepthToSpace after a conv into the conv, which stores its
+        output moved by the depth to space instead of writing it out for the
+        DepthToSpace to read it back"""
+        if self._option.quantize or \
+                self._option.device not in [DeviceType.CPU.value,
+                                            DeviceType.GPU.value]:
+            return False
+
+        net = self._model
+        for op in net.op:
+            if op.type != MaceOp.Conv2D.name \
+                    or len(op.input) < 2 or len(op.input) > 3 \
+                    or len(op.output_shape) != 1 \
+                    or ConverterUtil.get_arg(
+                        op, MaceKeyword.mace_residual_str) is not None \
+                    or ConverterUtil.get_arg(
+                        op, MaceKeyword.mace_depth_to_space_str) is not None \
+                    or op.output[0] in self._option.output_nodes \
+                    or len(self._consumers.get(op.output[0], [])) != 1:
+                continue
+            consumer_op = self._consumers[op.output[0]][0]
+            if consumer_op.type != MaceOp.DepthToSpace.name \
+                    or len(consumer_op.output_shape) != 1:
+                continue
+            block_size = ConverterUtil.get_arg(
+                consumer_op, MaceKeyword.mace_space_depth_block_size_str).i
+            _, _, _, channels = self.sort_feature_map_shape(
+                consumer_op.output_shape[0].dims,
+                ConverterUtil.data_format(consumer_op))
+            # the GPU kernels move whole blocks of 4 channels
+            if block_size < 2 or \
+                    (self._option.device == DeviceType.GPU.value
+                     and channels % 4 != 0):
+                continue
+            print("Fold depth to space: %s(%s)" % (op.name, op.type))
+            op.name = consumer_op.name
+            op.output[0] = consumer_op.output[0]
+            op.output_shape[0].CopyFrom(consumer_op.output_shape[0])
+            depth_to_space_arg = op.arg.add()
+            depth_to_space_arg.name = MaceKeyword.mace_depth_to_space_str
+            depth_to_space_arg.i = block_size
+            self.replace_quantize_info(op, consumer_op)
+            self.safe_remove_node(consumer_op, op)
+            return True
+
+        return False
+
+    @staticmethod
+    def upsample_conv_taps(kernel, scale):
+        """The low resolution taps of a stride 1 SAME conv of an odd kernel
+        reading a nearest upsample of the scale: the tap of each phase and
+        kernel offset, and the size of the low resolution kernel, whose
+        padding must be SAME too"""
+        pad = (kernel - 1) // 2
+        first = -pad // scale
+        last = (scale + kernel - 2 - pad) // scale
+        size = last - first + 1
+        if -first != (size - 1) // 2:
+            return None, size
+        taps = [[(phase + k - pad) // scale - first
+                 for k in six.moves.range(kernel)]
+                for phase in six.moves.range(scale)]
+        return taps, size
+
+    def fold_upsample_conv(self):
+        """Fold a nearest upsample of an integer scale s, read by a stride 1
+        SAME conv, into the conv. Each output pixel of the phase (py, px)
+        reads the low resolution pixels through a filter summing the taps
+        landing on the same pixel, so the conv runs on the low resolution
+        input with a filter of each of the s * s phases, and stores its
+        output moved by a depth to space of block s. The upsampled tensor is
+        never written, and the conv does the same arithmetic."""
+        if self._option.quantize or \
+                self._option.device not in [DeviceType.CPU.value,
+                                            DeviceType.GPU.value] or \
+                self.filter_format() != FilterFormat.OIHW:
+            return False
+
+        net = self._model
+        for op in net.op:
+            if op.type != MaceOp.ResizeNearestNeighbor.name \
+                    or len(op.output_shape) != 1 \
+                    or op.output[0] in self._option.output_nodes \
+                    or len(self._consumers.get(op.output[0], [])) != 1:
+                continue
+            align_corners_arg = ConverterUtil.get_arg(
+                op, MaceKeyword.mace_align_corners_str)
+            if align_corners_arg is not None and align_corners_arg.i != 0:
+                continue
+            input_shape = self.get_tensor_shape(op.input[0])
+            if input_shape is None or len(input_shape) != 4:
+                continue
+            data_format = ConverterUtil.data_format(op)
+            _, in_height, in_width, _ = self.sort_feature_map_shape(
+                input_shape, data_format)
+            _, out_height, out_width, _ = self.sort_feature_map_shape(
+                op.output_shape[0].dims, data_format)
+            scale = out_height // in_height
+            if scale < 2 or out_height != scale * in_height \
+                    or out_width != scale * in_width:
+                continue
+
+            conv_op = self._consumers[op.output[0]][0]
+            if conv_op.type != MaceOp.Conv2D.name \
+                    or len(conv_op.input) < 2 or len(conv_op.input) > 3 \
+                    or conv_op.input[0] != op.output[0] \
+                    or ConverterUtil.get_arg(
+                        conv_op, MaceKeyword.mace_residual_str) is not None \
+                    or ConverterUtil.get_arg(
+                        conv_op,
+                        MaceKeyword.mace_depth_to_space_str) is not None:
+                continue
+            # the weights are rewritten for this conv only
+            if any(name not in self._consts
+                   or len(self._consumers.get(name, [])) != 1
+                   for name in conv_op.input[1:]):
+                continue
+            filter = self._consts[conv_op.input[1]]
+            out_channels, in_channels, kernel_h, kernel_w = filter.dims
+            strides_arg = ConverterUtil.get_arg(
+                conv_op, MaceKeyword.mace_strides_str)
+            dilations_arg = ConverterUtil.get_arg(
+                conv_op, MaceKeyword.mace_dilations_str)
+            padding_arg = ConverterUtil.get_arg(
+                conv_op, MaceKeyword.mace_padding_str)
+            paddings_arg = ConverterUtil.get_arg(
+                conv_op, MaceKeyword.mace_padding_values_str)
+            if kernel_h % 2 == 0 or kernel_w % 2 == 0 \
+                    or (strides_arg is not None
+                        and list(strides_arg.ints) != [1, 1]) \
+                    or (dilations_arg is not None
+                        and list(dilations_arg.ints) != [1, 1]):
+                continue
+            if paddings_arg is not None:
+                if list(paddings_arg.ints) != [kernel_h - 1, kernel_w - 1]:
+                    continue
+            elif padding_arg is None or \
+                    padding_arg.i not in [PaddingMode.SAME.value,
+                                          PaddingMode.SAME_LOWER.value]:
+                continue
+            taps_h, size_h = self.upsample_conv_taps(kernel_h, scale)
+            taps_w, size_w = self.upsample_conv_taps(kernel_w, scale)
+            # the GPU kernels move whole blocks of 4 channels
+            if taps_h is None or taps_w is None or \
+                    (self._option.device == DeviceType.GPU.value
+                     and out_channels % 4 != 0):
+                continue
+
+            print("Fold upsample conv: %s(%s)" % (conv_op.name, conv_op.type))
+            filter_data = np.array(filter.float_data).reshape(filter.dims)
+            phase_filter = np.zeros((scale, scale, out_channels, in_channels,
+                                     size_h, size_w))
+            for py in six.moves.range(scale):
+                for px in six.moves.range(scale):
+                    for ky in six.moves.range(kernel_h):
+                        for kx in six.moves.range(kernel_w):
+                            phase_filter[py, px, :, :, taps_h[py][ky],
+                                         taps_w[px][kx]] += \
+                                filter_data[:, :, ky, kx]
+            # the channels of a depth to space, (py * s + px) * out_channels
+            # + out_channel
+            phase_filter = phase_filter.reshape(
+                scale * scale * out_channels, in_channels, size_h, size_w)
+            filter.float_data[:] = phase_filter.flat
+            filter.dims[:] = phase_filter.shape
+            if len(conv_op.input) == 3:
+                bias = self._consts[conv_op.input[2]]
+                bias.float_data[:] = np.tile(
+                    np.array(bias.float_data), scale * scale).flat
+                bias.dims[:] = [scale * scale * out_channels]
+            if paddings_arg is not None:
+                paddings_arg.ints[:] = [size_h - 1, size_w - 1]
+            depth_to_space_arg = conv_op.arg.add()
+            depth_to_space_arg.name = MaceKeyword.mace_depth_to_space_str
+            depth_to_space_arg.i = scale
+
+            conv_op.input[0] = op.input[0]
+            for name in op.input[1:]:
+                if name in self._consts and \
+                        len(self._consumers.get(name, [])) == 1:
+                    net.tensors.remove(self._consts[name])
+            net.op.remove(op)
+            return True
+
+        return False
+
+    def fold_depthwise_pointwise(self):
+        """Fold a depthwise 3x3 conv and the 1x1 conv reading it into a
+        DepthwisePointwiseConv2d, which keeps the depthwise output of a tile
+        in the cache instead of writing it out"""
+        if self._option.quantize or \
+                self._option.device != DeviceType.CPU.value or \
+                self.filter_format() != FilterFormat.OIHW:
+            return False
+
+        net = self._model
+        for op in net.op:
+            if op.type != MaceOp.DepthwiseConv2d.name \
+                    or len(op.input) < 2 or len(op.input) > 3 \
+                    or op.input[1] not in self._consts \
+                    or op.output[0] in self._option.output_nodes \
+                    or len(self._consumers.get(op.output[0], [])) != 1:
+                continue
+            filter = self._consts[op.input[1]]
+            dilations_arg = ConverterUtil.get_arg(
+                op, MaceKeyword.mace_dilations_str)
+            if len(filter.dims) != 4 or filter.dims[0] != 1 \
+                    or list(filter.dims[2:]) != [3, 3] \
+                    or (dilations_arg is not None
+                        and list(dilations_arg.ints) != [1, 1]):
+                continue
+            consumer_op = self._consumers[op.output[0]][0]
+            if consumer_op.type != MaceOp.Conv2D.name \
+                    or len(consumer_op.input) < 2 \
+                    or len(consumer_op.input) > 3 \
+                    or consumer_op.input[0] != op.output[0] \
+                    or consumer_op.input[1] not in self._consts \
+                    or ConverterUtil.get_arg(
+                        consumer_op, MaceKeyword.mace_residual_str) is not None:
+                continue
+            pw_filter = self._consts[consumer_op.input[1]]
+            strides_arg = ConverterUtil.get_arg(
+                consumer_op, MaceKeyword.mace_strides_str)
+            paddings_arg = ConverterUtil.get_arg(
+                consumer_op, MaceKeyword.mace_padding_values_str)
+            if len(pw_filter.dims) != 4 \
+                    or pw_filter.dims[1] != filter.dims[1] \
+                    or list(pw_filter.dims[2:]) != [1, 1] \
+                    or (strides_arg is not None
+                        and list(strides_arg.ints) != [1, 1]) \
+                    or (paddings_arg is not None
+                        and any(paddings_arg.ints)):
+                continue
+            print("Fold depthwise pointwise conv: %s(%s)"
+                  % (op.name, op.type))
+            if len(op.input) == 2:
+                self.add_zero_bias(op.name + '_bias', filter.dims[1], op)
+            if len(consumer_op.input) == 2:
+                self.add_zero_bias(consumer_op.name + '_bias',
+                                   pw_filter.dims[0], consumer_op)
+            op.type = MaceOp.DepthwisePointwiseConv2d.name
+            op.name = consumer_op.name
+            op.output[0] = consumer_op.output[0]
+            del op.output_shape[:]
+            op.output_shape.extend(consumer_op.output_shape)
+            op.input.extend(consumer_op.input[1:])
+            for arg in op.arg:
+                if arg.name == MaceKeyword.mace_activation_type_str:
+                    arg.name = MaceKeyword.mace_dw_activation_type_str
+                elif arg.name == MaceKeyword.mace_activation_max_limit_str:
+                    arg.name = MaceKeyword.mace_dw_activation_max_limit_str
+                elif arg.name == \
+                        MaceKeyword.mace_activation_leakyrelu_coefficient_str:
+                    arg.name = MaceKeyword.\
+                        mace_dw_activation_leakyrelu_coefficient_str
+            for arg in consumer_op.arg:
+                if arg.name in [
+                        MaceKeyword.mace_activation_type_str,
+                        MaceKeyword.mace_activation_max_limit_str,
+                        MaceKeyword.mace_activation_leakyrelu_coefficient_str]:
+                    op.arg.extend([arg])
+            self.safe_remove_node(consumer_op, op)
+            return True
+
+        return False
+
+    @staticmethod
+    def block_density(weight):
+        """The fraction of the 1x4 blocks of the rows of weight which are
+        not all zero"""
+        rows = weight.dims[0]
+        data = np.array(weight.float_data).reshape(rows, -1)
+        cols = data.shape[1]
+        blocks = (cols + SPARSE_BLOCK_SIZE - 1) // SPARSE_BLOCK_SIZE
+        padded = np.zeros((rows, blocks * SPARSE_BLOCK_SIZE))
+        padded[:, :cols] = data
+        nonzero = np.any(padded.reshape(rows, blocks, SPARSE_BLOCK_SIZE) != 0,
+                         axis=2)
+        return float(np.mean(nonzero))
+
+    def add_sparse_weight_arg(self):
+        """Mark the FullyConnected and 1x1 Conv2D ops of pruned weights for
+        the block-sparse CPU kernels, if few enough of the 1x4 blocks of the
+        weight are nonzero for the sparse kernel to win"""
+        if self._option.quantize or \
+                self._option.device != DeviceType.CPU.value or \
+                self.filter_format() != FilterFormat.OIHW:
+            return False
+
+        net = self._model
+        for op in net.op:
+            if len(op.input) < 2 or op.input[1] not in self._consts:
+                continue
+            weight = self._consts[op.input[1]]
+            if op.type == MaceOp.FullyConnected.name:
+                max_density = SPARSE_FC_MAX_DENSITY
+            elif op.type == MaceOp.Conv2D.name:
+                strides_arg = ConverterUtil.get_arg(
+                    op, MaceKeyword.mace_strides_str)
+                dilations_arg = ConverterUtil.get_arg(
+                    op, MaceKeyword.mace_dilations_str)
+                paddings_arg = ConverterUtil.get_arg(
+                    op, MaceKeyword.mace_padding_values_str)
+                if len(weight.dims) != 4 or list(weight.dims[2:]) != [1, 1] \
+                        or (strides_arg is not None
+                            and list(strides_arg.ints) != [1, 1]) \
+                        or (dilations_arg is not None
+                            and list(dilations_arg.ints) != [1, 1]) \
+                        or (paddings_arg is not None
+                            and any(paddings_arg.ints)):
+                    continue
+                max_density = SPARSE_CONV_MAX_DENSITY
+            else:
+                continue
+            if weight.data_type != mace_pb2.DT_FLOAT or \
+                    ConverterUtil.get_arg(
+                        op, MaceKeyword.mace_sparse_weight_str) is not None:
+                continue
+            density = self.block_density(weight)
+            if density > max_density:
+                continue
+            print("Sparse weight of %s(%s): %.2f of the 1x%d blocks are "
+                  "nonzero" % (op.name, op.type, density, SPARSE_BLOCK_SIZE))
+            sparse_arg = op.arg.add()
+            sparse_arg.name = MaceKeyword.mace_sparse_weight_str
+            sparse_arg.i = 1
+
+        return False
+
+    def quantize_embedding(self):
+        """Quantize the tables only read by Gather of float CPU models to
+        uint8 with a scale per row, Gather dequantizes the gathered rows"""
+        if not self._option.quantize_embedding or self._option.quantize or \
+                self._option.device != DeviceType.CPU.value:
+            return False
+
+        for tensor in self._model.tensors:
+            if tensor.data_type != mace_pb2.DT_FLOAT:
+                continue
+            ops = self._consumers.get(tensor.name, [])
+            if len(ops) == 0 or any(op.type != MaceOp.Gather.name
+                                    or op.input[0] != tensor.name
+                                    or tensor.name in op.input[1:]
+                                    for op in ops):
+                continue
+            if len(tensor.dims) >= 2:
+                quantized_tensor = quantize_util.quantize_per_channel(
+                    np.array(tensor.float_data).reshape(tensor.dims), 0)
+                quantized_tensor.data = quantized_tensor.data.reshape(-1)
+                tensor.quantize_axis = 0
+            else:
+                quantized_tensor = quantize_util.quantize(
+                    tensor.float_data, True)
+            print("Quantize embedding table %s" % tensor.name)
+            del tensor.float_data[:]
+            tensor.int32_data.extend(quantized_tensor.data)
+            tensor.data_type = mace_pb2.DT_UINT8
+            tensor.scale = quantized_tensor.scale
+            tensor.scales.extend(quantized_tensor.scales)
+            tensor.zero_point = quantized_tensor.zero
+            tensor.minval = quantized_tensor.minval
+            tensor.maxval = quantized_tensor.maxval
+            tensor.quantized = True
+
+        return False
+
+    def palettize_weights(self):
+        """Cluster the filters of the convs and the weights of the matmuls of
+        float CPU models into 2^bits values by k-means, the model data keep
+        the indices of the values, expanded to float when the weights are
+        loaded"""
+        bits = self._option.palettize_weights
+        if not bits or self._option.quantize or \
+                self._option.device != DeviceType.CPU.value:
+            return False
+
+        filter_ops = [MaceOp.Conv2D.name, MaceOp.Deconv2D.name,
+                      MaceOp.DepthwiseConv2d.name,
+                      MaceOp.DepthwiseDeconv2d.name,
+                      MaceOp.FullyConnected.name]
+        for tensor in self._model.tensors:
+            if tensor.data_type != mace_pb2.DT_FLOAT or \
+                    len(tensor.float_data) <= 2 ** bits:
+                continue
+            ops = self._consumers.get(tensor.name, [])
+            if len(ops) == 0 or not all(
+                    op.type == MaceOp.MatMul.name or
+                    (op.type in filter_ops and op.input[1] == tensor.name and
+                     list(op.input).count(tensor.name) == 1)
+                    for op in ops):
+                continue
+            palette, indices = quantize_util.palettize(tensor.float_data,
+                                                       bits)
+            print("Palettize weight %s to %d values" %
+                  (tensor.name, len(palette)))
+            del tensor.float_data[:]
+            tensor.int32_data.extend(indices)
+            tensor.data_type = mace_pb2.DT_UINT8
+            tensor.palette.extend(palette)
+            tensor.palette_bits = bits
+
+        return False
+
+    def weight_only_quantize(self):
+        """Quantize the weights of the FullyConnected ops and the transposed
+        2-D weights of the MatMul ops of float CPU models to 8 bits with a
+        scale per row or to 4 bits with a scale per group of a row, the
+        activations stay float and the kernels dequantize the weights as
+        they multiply"""
+        bits = self._option.weight_only_quantize
+        if not bits or self._option.quantize or \
+                self._option.device != DeviceType.CPU.value or \
+                self.filter_format() != FilterFormat.OIHW:
+            return False
+
+        group_size = WEIGHT_ONLY_INT4_GROUP_SIZE if bits == 4 else 0
+        for op in self._model.op:
+            if len(op.input) < 2 or op.input[1] not in self._consts or \
+                    op.input[0] == op.input[1]:
+                continue
+            weight = self._consts[op.input[1]]
+            if op.type == MaceOp.MatMul.name:
+                transpose_a = ConverterUtil.get_arg(
+                    op, MaceKeyword.mace_transpose_a_str)
+                transpose_b = ConverterUtil.get_arg(
+                    op, MaceKeyword.mace_transpose_b_str)
+                if len(weight.dims) != 2 or \
+                        (transpose_a is not None and transpose_a.i) or \
+                        transpose_b is None or not transpose_b.i:
+                    continue
+            elif op.type != MaceOp.FullyConnected.name or \
+                    ConverterUtil.get_arg(
+                        op, MaceKeyword.mace_sparse_weight_str) is not None:
+                continue
+            if weight.data_type != mace_pb2.DT_FLOAT or \
+                    len(self._consumers.get(weight.name, [])) != 1:
+                continue
+            rows = weight.dims[0]
+            cols = len(weight.float_data) // rows
+            quantized_tensor = quantize_util.quantize_weight_only(
+                np.array(weight.float_data).reshape(rows, cols), bits,
+                group_size)
+            print("Quantize weight %s of %s(%s) to %d bits" %
+                  (weight.name, op.name, op.type, bits))
+            del weight.float_data[:]
+            weight.int32_data.extend(quantized_tensor.data)
+            weight.data_type = mace_pb2.DT_UINT8
+            weight.dims[:] = [rows, len(quantized_tensor.data) // rows]
+            weight.scales.extend(quantized_tensor.scales)
+            weight.zero_point = quantized_tensor.zero
+            weight.quantize_axis = 0
+            bits_arg = op.arg.add()
+            bits_arg.name = MaceKeyword.mace_weight_bits_str
+            bits_arg.i = bits
+            group_size_arg = op.arg.add()
+            group_size_arg.name = MaceKeyword.mace_weight_group_size_str
+            group_size_arg.i = group_size
+
+        return False
+
+    def quantize_8x16(self):
+        """Run the FullyConnected ops of float CPU models with a uint8 weight
+        of a scale per row and int16 activations, quantized symmetrically as
+        the model runs, for the models losing too much accuracy at 8 bits,
+        e.g., speech models. A Splice only feeding such an op moves its int16
+        input instead of the float one."""
+        if not self._option.quantize_8x16 or self._option.quantize or \
+                self._option.device != DeviceType.CPU.value or \
+                self.filter_format() != FilterFormat.OIHW:
+            return False
+
+        for op in list(self._model.op):
+            if op.type != MaceOp.FullyConnected.name or \
+                    len(op.input) < 2 or op.input[1] not in self._consts or \
+                    op.input[0] in self._consts:
+                continue
+            if ConverterUtil.get_arg(
+                    op, MaceKeyword.mace_sparse_weight_str) is not None or \
+                    ConverterUtil.get_arg(
+                        op, MaceKeyword.mace_weight_bits_str) is not None:
+                continue
+            weight = self._consts[op.input[1]]
+            if weight.data_type != mace_pb2.DT_FLOAT or \
+                    len(self._consumers.get(weight.name, [])) != 1:
+                continue
+            rows = weight.dims[0]
+            quantized_tensor = quantize_util.quantize_per_channel(
+                np.array(weight.float_data).reshape(rows, -1), 0)
+            print("Quantize %s(%s) to uint8 weight and int16 activations" %
+                  (op.name, op.type))
+            del weight.float_data[:]
+            weight.int32_data.extend(quantized_tensor.data.reshape(-1))
+            weight.data_type = mace_pb2.DT_UINT8
+            weight.scale = quantized_tensor.scale
+            weight.scales.extend(quantized_tensor.scales)
+            weight.zero_point = quantized_tensor.zero
+            weight.quantize_axis = 0
+
+            # a stateful Splice keeps the frames of the runs before, which
+            # are quantized with other ranges
+            input_op = op
+            producer = self._producer.get(op.input[0], None)
+            if producer is not None and \
+                    producer.type == MaceOp.Splice.name and \
+                    len(producer.output) == 1 and \
+                    not self.is_stateful(producer) and \
+                    len(self._consumers.get(op.input[0], [])) == 1:
+                input_op = producer
+                self.set_op_data_type(producer, mace_pb2.DT_INT16)
+                del producer.output_type[:]
+                producer.output_type.extend([mace_pb2.DT_INT16])
+            self.add_int16_quantize(input_op)
+
+            self.set_op_data_type(op, mace_pb2.DT_INT16)
+            del op.output_type[:]
+            op.output_type.extend([mace_pb2.DT_FLOAT] * len(op.output))
+
+        return False
+
+    @staticmethod
+    def is_stateful(op):
+        stateful_arg = ConverterUtil.get_arg(op, MaceKeyword.mace_stateful_str)
+        return stateful_arg is not None and stateful_arg.i != 0
+
+    @staticmethod
+    def set_op_data_type(op, data_type):
+        data_type_arg = ConverterUtil.get_arg(
+            op, MaceKeyword.mace_op_data_type_str)
+        if data_type_arg is None:
+            data_type_arg = op.arg.add()
+            data_type_arg.name = MaceKeyword.mace_op_data_type_str
+        data_type_arg.i = data_type
+
+    def add_int16_quantize(self, op):
+        """Feed the first input of op through a Quantize to int16 of the range
+        of each run"""
+        quantize_op = self._model.op.add()
+        quantize_op.name = op.name + "_quant"
+        quantize_op.type = MaceOp.Quantize.name
+        quantize_op.input.extend([op.input[0]])
+        quantize_op.output.extend([quantize_op.name + '_0'])
+        input_shape = self.get_tensor_shape(op.input[0])
+        if input_shape:
+            quantize_op.output_shape.add().dims.extend(input_shape)
+        quantize_op.output_type.extend([mace_pb2.DT_INT16])
+        self.set_op_data_type(quantize_op, mace_pb2.DT_INT16)
+        find_range_arg = quantize_op.arg.add()
+        find_range_arg.name = MaceKeyword.mace_find_range_every_time
+        find_range_arg.i = 1
+        op.input[0] = quantize_op.output[0]
+
+    def add_zero_bias(self, name, size, op):
+        bias = self._model.tensors.add()
+        bias.name = name
+        bias.dims.extend([size])
+        bias.data_type = mace_pb2.DT_FLOAT
+        bias.float_data.extend([0.0] * size)
+        op.input.append(name)
+
     def flatten_atrous_conv(self):
-        if self._option.device != DeviceType.GPU.value:
-            return
+        """Fold SpaceToBatchND -> Conv2D/DepthwiseConv2d -> BatchToSpaceND,
+        the way tensorflow exports dilated convs, into a dilated conv, which
+        saves the two reshuffles of the whole tensor. The inner conv is a
+        VALID one of the blocks, so the paddings of SpaceToBatchND less the
+        crops of BatchToSpaceND are the paddings of the dilated conv."""
+        if self._option.device not in [DeviceType.CPU.value,
+                                       DeviceType.GPU.value]:
+            return False
 
         net = self._model
         for op in net.op:
-            if (op.type == MaceOp.SpaceToBatchND.name
-                    and len(self._consumers.get(op.output[0], [])) == 1):
-                conv_op = self._consumers.get(op.output[0])[0]
-                if (conv_op.type == MaceOp.Conv2D.name
-                        or conv_op.type == MaceOp.DepthwiseConv2d.name) \
-                        and len(self._consumers.get(conv_op.output[0], [])) == 1:  # noqa
-                    b2s_op = self._consumers.get(conv_op.output[0])[0]
-                    if b2s_op.type == MaceOp.BatchToSpaceND.name:
-                        six.print_("Flatten atrous convolution")
-                        # Add args.
-                        padding_arg_values = ConverterUtil.get_arg(
-                            op,
-                            MaceKeyword.mace_paddings_str).ints
-                        blocks_arg_values = ConverterUtil.get_arg(
-                            b2s_op,
-                            MaceKeyword.mace_space_batch_block_shape_str).ints
-                        dilation_arg = ConverterUtil.get_arg(
-                            conv_op,
-                            MaceKeyword.mace_dilations_str)
-                        if dilation_arg is None:
-                            dilation_arg = conv_op.arg.add()
-                        dilation_arg.name = MaceKeyword.mace_dilations_str
-                        dilation_arg.ints[:] = blocks_arg_values
-
-                        padding_arg = ConverterUtil.get_arg(
-                            conv_op,
-                            MaceKeyword.mace_padding_str)
-                        if padding_arg is None:
-                            padding_arg = conv_op.arg.add()
-                        padding_arg.name = MaceKeyword.mace_padding_str
-                        if len(padding_arg_values) > 0 \
-                                and padding_arg_values[0] > 0:
-                            padding_arg.i = PaddingMode.SAME.value
-                        else:
-                            padding_arg.i = PaddingMode.VALID.value
-
-                        strides_arg = ConverterUtil.get_arg(
-                            conv_op,
-                            MaceKeyword.mace_strides_str)
-                        if strides_arg is None:
-                            strides_arg = conv_op.arg.add()
-                        strides_arg.name = MaceKeyword.mace_strides_str
-                        strides_arg.ints[:] = [1, 1]
-
-                        # update output shape
-                        conv_op.output_shape[0].dims[:] = \
-                            b2s_op.output_shape[0].dims[:]
-
-                        self.safe_remove_node(op, None)
-                        self.safe_remove_node(b2s_op, conv_op)
-                        return True
+            if op.type != MaceOp.SpaceToBatchND.name \
+                    or self.consumer_count(op.output[0]) != 1:
+                continue
+            conv_op = self._consumers[op.output[0]][0]
+            if (conv_op.type != MaceOp.Conv2D.name
+                    and conv_op.type != MaceOp.DepthwiseConv2d.name) \
+                    or conv_op.input[0] != op.output[0] \
+                    or self.consumer_count(conv_op.output[0]) != 1:
+                continue
+            b2s_op = self._consumers[conv_op.output[0]][0]
+            if b2s_op.type != MaceOp.BatchToSpaceND.name:
+                continue
+            block_shape = ConverterUtil.get_arg(
+                op, MaceKeyword.mace_space_batch_block_shape_str).ints
+            b2s_block_shape = ConverterUtil.get_arg(
+                b2s_op, MaceKeyword.mace_space_batch_block_shape_str).ints
+            paddings = ConverterUtil.get_arg(
+                op, MaceKeyword.mace_paddings_str).ints
+            crops = ConverterUtil.get_arg(
+                b2s_op, MaceKeyword.mace_batch_to_space_crops_str).ints
+            padding_arg = ConverterUtil.get_arg(
+                conv_op, MaceKeyword.mace_padding_str)
+            strides_arg = ConverterUtil.get_arg(
+                conv_op, MaceKeyword.mace_strides_str)
+            dilations_arg = ConverterUtil.get_arg(
+                conv_op, MaceKeyword.mace_dilations_str)
+            if list(block_shape) != list(b2s_block_shape) \
+                    or len(block_shape) != 2 or len(paddings) != 4 \
+                    or len(crops) != 4 \
+                    or (padding_arg is not None
+                        and padding_arg.i != PaddingMode.VALID.value) \
+                    or ConverterUtil.get_arg(
+                        conv_op,
+                        MaceKeyword.mace_padding_values_str) is not None \
+                    or (strides_arg is not None
+                        and list(strides_arg.ints) != [1, 1]) \
+                    or (dilations_arg is not None
+                        and list(dilations_arg.ints) != [1, 1]):
+                continue
+
+            # the convs pad the top and the left by half of the total
+            # padding, rounded down
+            padding_values = []
+            for i in six.moves.range(2):
+                pad_begin = paddings[2 * i] - crops[2 * i]
+                total_padding = pad_begin + paddings[2 * i + 1] \
+                    - crops[2 * i + 1]
+                if pad_begin < 0 or pad_begin != total_padding // 2:
+                    break
+                padding_values.append(total_padding)
+            if len(padding_values) != 2:
+                continue
+
+            print("Flatten atrous convolution: %s(%s)"
+                  % (conv_op.name, conv_op.type))
+            if padding_arg is not None:
+                conv_op.arg.remove(padding_arg)
+            padding_values_arg = conv_op.arg.add()
+            padding_values_arg.name = MaceKeyword.mace_padding_values_str
+            padding_values_arg.ints[:] = padding_values
+            if dilations_arg is None:
+                dilations_arg = conv_op.arg.add()
+                dilations_arg.name = MaceKeyword.mace_dilations_str
+            dilations_arg.ints[:] = block_shape
+            if strides_arg is None:
+                strides_arg = conv_op.arg.add()
+                strides_arg.name = MaceKeyword.mace_strides_str
+            strides_arg.ints[:] = [1, 1]
+            conv_op.output_shape[0].dims[:] = b2s_op.output_shape[0].dims[:]
+
+            self.safe_remove_node(op, None)
+            self.safe_remove_node(b2s_op, conv_op)
+            return True
+
+        return False
+
+    def fold_pad(self):
+        """Fold a zero Pad of the spatial dims into the padding values of
+        the Conv2D or DepthwiseConv2d reading it, which pads the borders
+        itself instead of reading a padded copy of its input"""
+        net = self._model
+        for op in net.op:
+            if op.type != MaceOp.Pad.name or len(op.input) != 1 \
+                    or op.output[0] in self._option.output_nodes \
+                    or len(self._consumers.get(op.output[0], [])) != 1 \
+                    or ConverterUtil.data_format(op) != DataFormat.NHWC:
+                continue
+            pad_type_arg = ConverterUtil.get_arg(
+                op, MaceKeyword.mace_pad_type_str)
+            constant_value_arg = ConverterUtil.get_arg(
+                op, MaceKeyword.mace_constant_value_str)
+            paddings = ConverterUtil.get_arg(
+                op, MaceKeyword.mace_paddings_str).ints
+            if (pad_type_arg is not None
+                    and pad_type_arg.i != PadType.CONSTANT.value) \
+                    or (constant_value_arg is not None
+                        and (constant_value_arg.i != 0
+                             or constant_value_arg.f != 0)) \
+                    or len(paddings) != 8 \
+                    or any(paddings[i] != 0 for i in [0, 1, 6, 7]):
+                continue
+            conv_op = self._consumers[op.output[0]][0]
+            if (conv_op.type != MaceOp.Conv2D.name
+                    and conv_op.type != MaceOp.DepthwiseConv2d.name) \
+                    or conv_op.input[0] != op.output[0] \
+                    or conv_op.input[1] not in self._consts:
+                continue
+            padding_arg = ConverterUtil.get_arg(
+                conv_op, MaceKeyword.mace_padding_str)
+            padding_values_arg = ConverterUtil.get_arg(
+                conv_op, MaceKeyword.mace_padding_values_str)
+            strides_arg = ConverterUtil.get_arg(
+                conv_op, MaceKeyword.mace_strides_str)
+            dilations_arg = ConverterUtil.get_arg(
+                conv_op, MaceKeyword.mace_dilations_str)
+            strides = [1, 1] if strides_arg is None else strides_arg.ints
+            dilations = [1, 1] if dilations_arg is None \
+                else dilations_arg.ints
+            filter_height, filter_width, _, _ = self.sort_filter_shape(
+                self._consts[conv_op.input[1]].dims, self.filter_format())
+            filter_hw = [filter_height, filter_width]
+            in_hw = op.output_shape[0].dims[1:3]
+            out_hw = conv_op.output_shape[0].dims[1:3]
+
+            # the convs pad the top and the left by half of the total
+            # padding, rounded down, as SAME of tensorflow does
+            padding_values = []
+            for i in six.moves.range(2):
+                if padding_values_arg is not None:
+                    conv_padding = padding_values_arg.ints[i]
+                elif padding_arg is None \
+                        or padding_arg.i == PaddingMode.VALID.value:
+                    conv_padding = 0
+                elif padding_arg.i == PaddingMode.SAME.value:
+                    conv_padding = max(
+                        0, (out_hw[i] - 1) * strides[i]
+                        + (filter_hw[i] - 1) * dilations[i] + 1 - in_hw[i])
+                else:
+                    break
+                pad_begin = paddings[2 + 2 * i] + conv_padding // 2
+                total_padding = paddings[2 + 2 * i] \
+                    + paddings[3 + 2 * i] + conv_padding
+                if pad_begin != total_padding // 2:
+                    break
+                padding_values.append(total_padding)
+            if len(padding_values) != 2:
+                continue
+
+            print("Fold pad into conv: %s(%s)" % (op.name, op.type))
+            if padding_arg is not None:
+                conv_op.arg.remove(padding_arg)
+            if padding_values_arg is None:
+                padding_values_arg = conv_op.arg.add()
+                padding_values_arg.name = MaceKeyword.mace_padding_values_str
+            padding_values_arg.ints[:] = padding_values
+            self.safe_remove_node(op, None)
+            return True
+
         return False
 
     def fold_activation(self):
@@ -935,10 +2154,12 @@ class Transformer(base_converter.ConverterInterface):
                 or op.type == MaceOp.WinogradInverseTransform.name) \
                     and len(self._consumers.get(op.output[0], [])) == 1:
                 consumer_op = self._consumers[op.output[0]][0]
+                # the kernels of these ops have no PRELU or GELU
                 if consumer_op.type == MaceOp.Activation.name \
                         and ConverterUtil.get_arg(
                             consumer_op,
-                            MaceKeyword.mace_activation_type_str).s != 'PRELU':
+                            MaceKeyword.mace_activation_type_str).s \
+                        not in [b'PRELU', b'GELU']:
                     print("Fold activation: %s(%s)" % (op.name, op.type))
                     op.name = consumer_op.name
                     op.output[0] = consumer_op.output[0]
@@ -964,7 +2185,11 @@ class Transformer(base_converter.ConverterInterface):
 
         net = self._model
         for op in net.op:
-            if op.type == MaceOp.Conv2D.name:
+            # FullyConnected reads no residual and stores no depth to space
+            if op.type == MaceOp.Conv2D.name and ConverterUtil.get_arg(
+                    op, MaceKeyword.mace_residual_str) is None \
+                    and ConverterUtil.get_arg(
+                        op, MaceKeyword.mace_depth_to_space_str) is None:
                 producer = self._producer[op.input[0]]
                 input_shape = producer.output_shape[0].dims
                 batch, height, width, channels = self.sort_feature_map_shape(
@@ -1132,6 +2357,54 @@ class Transformer(base_converter.ConverterInterface):
                         filter.dims[:] = filter_data.shape
                         arg.i = 1
 
+    def fold_transpose_matmul(self):
+        """Fold a Transpose read only by MatMuls into their perm_a/perm_b
+        args, e.g. the heads of an attention, so the MatMul reads the
+        untransposed input through strides and the transposed tensor is
+        never written. One of the two innermost dims of the MatMul input
+        must be the innermost dim of the Transpose input."""
+        if self._option.quantize or \
+                self._option.device != DeviceType.CPU.value:
+            return False
+
+        net = self._model
+        for op in net.op:
+            if op.type != MaceOp.Transpose.name \
+                    or op.output[0] in self._option.output_nodes \
+                    or op.input[0] in self._consts:
+                continue
+            dims_arg = ConverterUtil.get_arg(op, MaceKeyword.mace_dims_str)
+            consumers = self._consumers.get(op.output[0], [])
+            if dims_arg is None or not consumers:
+                continue
+            perm = list(dims_arg.ints)
+            rank = len(perm)
+            if rank < 2 or rank - 1 not in perm[-2:]:
+                continue
+            perm_args = {0: MaceKeyword.mace_perm_a_str,
+                         1: MaceKeyword.mace_perm_b_str}
+            if any(consumer.type != MaceOp.MatMul.name
+                   or any(ConverterUtil.get_arg(consumer, perm_args[i])
+                          is not None
+                          for i in six.moves.range(2)
+                          if consumer.input[i] == op.output[0])
+                   or op.output[0] in consumer.input[2:]
+                   for consumer in consumers):
+                continue
+
+            print("Fold transpose matmul: %s(%s)" % (op.name, op.type))
+            for consumer in consumers:
+                for i in six.moves.range(2):
+                    if consumer.input[i] == op.output[0]:
+                        consumer.input[i] = op.input[0]
+                        perm_arg = consumer.arg.add()
+                        perm_arg.name = perm_args[i]
+                        perm_arg.ints.extend(perm)
+            net.op.remove(op)
+            return True
+
+        return False
+
     def transpose_filters(self):
         net = self._model
         filter_format = self.filter_format()
@@ -1351,8 +2624,11 @@ class Transformer(base_converter.ConverterInterface):
 
         print("update op with float data type")
         net = self._model
-        data_type = self._option.data_type
+        fp32_ops = set(self._option.fp32_ops)
         for op in net.op:
+            # the accuracy critical ops, e.g. the final layers, keep fp32
+            data_type = mace_pb2.DT_FLOAT if op.name in fp32_ops \
+                else self._option.data_type
             data_type_arg = ConverterUtil.get_arg(
                 op, MaceKeyword.mace_op_data_type_str)
             if not data_type_arg:
@@ -1532,11 +2808,20 @@ class Transformer(base_converter.ConverterInterface):
                         conv_op.input[0]].scale
                     if conv_op.input[1] not in self._quantized_tensor:
                         self.quantize_tensor(self._consts[conv_op.input[1]])
-                    scale_filter = self._consts[conv_op.input[1]].scale
-                    scale = scale_input * scale_filter
-                    quantized_tensor = \
-                        quantize_util.quantize_with_scale_and_zero(
-                            tensor.float_data, scale, 0)
+                    filter_tensor = self._consts[conv_op.input[1]]
+                    if len(filter_tensor.scales) > 0:
+                        scales = np.array(filter_tensor.scales) * scale_input
+                        quantized_tensor = \
+                            quantize_util.quantize_with_scale_and_zero(
+                                np.array(tensor.float_data), scales, 0)
+                        quantized_tensor.scale = float(scales.max())
+                        quantized_tensor.scales = \
+                            [float(scale) for scale in scales]
+                    else:
+                        scale = scale_input * filter_tensor.scale
+                        quantized_tensor = \
+                            quantize_util.quantize_with_scale_and_zero(
+                                tensor.float_data, scale, 0)
                 elif self._option.device == DeviceType.HEXAGON.value:
                     quantized_tensor = \
                         quantize_util.quantize_bias_for_hexagon(
@@ -1545,14 +2830,24 @@ class Transformer(base_converter.ConverterInterface):
                     mace_check(False, "wrong device.")
                 tensor.data_type = mace_pb2.DT_INT32
             else:
-                non_zero = self._option.device == DeviceType.CPU.value
-                quantized_tensor = quantize_util.quantize(tensor.float_data,
-                                                          non_zero)
+                quantize_axis = self.per_channel_quantize_axis(tensor)
+                if quantize_axis >= 0:
+                    quantized_tensor = quantize_util.quantize_per_channel(
+                        np.array(tensor.float_data).reshape(tensor.dims),
+                        quantize_axis)
+                    quantized_tensor.data = \
+                        quantized_tensor.data.reshape(-1)
+                    tensor.quantize_axis = quantize_axis
+                else:
+                    non_zero = self._option.device == DeviceType.CPU.value
+                    quantized_tensor = quantize_util.quantize(
+                        tensor.float_data, non_zero)
                 tensor.data_type = mace_pb2.DT_UINT8
 
             del tensor.float_data[:]
             tensor.int32_data.extend(quantized_tensor.data)
             tensor.scale = quantized_tensor.scale
+            tensor.scales.extend(quantized_tensor.scales)
             tensor.zero_point = quantized_tensor.zero
             tensor.minval = quantized_tensor.minval
             tensor.maxval = quantized_tensor.maxval
@@ -1561,6 +2856,25 @@ class Transformer(base_converter.ConverterInterface):
 
         return False
 
+    def per_channel_quantize_axis(self, tensor):
+        """Axis of the output channels of a filter to be quantized per
+        channel, -1 for per-tensor quantization"""
+        if not self._option.quantize_per_channel or \
+                self._option.device != DeviceType.CPU.value:
+            return -1
+        ops = self._consumers.get(tensor.name, None)
+        if ops is None or len(ops) != 1 or len(ops[0].input) < 2 \
+                or ops[0].input[1] != tensor.name:
+            return -1
+        if ops[0].type in [MaceOp.Conv2D.name, MaceOp.FullyConnected.name]:
+            # OHWI filter of conv and [out, in] weight of fc
+            return 0
+        if ops[0].type == MaceOp.DepthwiseConv2d.name \
+                and len(tensor.dims) == 4 and tensor.dims[3] == 1:
+            # HWIM filter, of one channel per input channel
+            return 2
+        return -1
+
     def quantize_weights(self):
         print("Quantize weights")
         net = self._model
@@ -1759,6 +3073,17 @@ class Transformer(base_converter.ConverterInterface):
                 quantize_info = \
                     self.add_quantize_info(op, 0.0, 1.0)
                 self._quantize_activation_info[op.output[0]] = quantize_info
+            elif (op.type == MaceOp.Activation.name
+                  and not op.quantize_info
+                  and ConverterUtil.get_arg(
+                      op, MaceKeyword.mace_activation_type_str).s
+                  in [b'SIGMOID', b'TANH']):
+                # the ranges of the bounded activations without statistics
+                activation = ConverterUtil.get_arg(
+                    op, MaceKeyword.mace_activation_type_str).s
+                minval = 0.0 if activation == b'SIGMOID' else -1.0
+                quantize_info = self.add_quantize_info(op, minval, 1.0)
+                self._quantize_activation_info[op.output[0]] = quantize_info
             elif (op.type == MaceOp.Eltwise.name
                   and not op.quantize_info
                   and len(op.input) == 2
@@ -0,0 +1,276 @@
+# Copyright 2019 The MACE Authors. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+
+import unittest
+
+from mace.proto import mace_pb2
+from mace.python.tools.converter_tool.base_converter import ConverterOption
+from mace.python.tools.converter_tool.base_converter import ConverterUtil
+from mace.python.tools.converter_tool.base_converter import DataFormat
+from mace.python.tools.converter_tool.base_converter import DeviceType
+from mace.python.tools.converter_tool.base_converter import FilterFormat
+from mace.python.tools.converter_tool.base_converter import MaceKeyword
+from mace.python.tools.converter_tool.base_converter import MaceOp
+from mace.python.tools.converter_tool.base_converter import NodeInfo
+from mace.python.tools.converter_tool.base_converter import PaddingMode
+from mace.python.tools.converter_tool.base_converter import TransformerRule
+from mace.python.tools.converter_tool.transformer import Transformer
+
+
+def build_net(filter_format):
+    net = mace_pb2.NetDef()
+    ConverterUtil.set_filter_format(net, filter_format)
+    return net
+
+
+def add_op(net, op_type, inputs, output, output_shape, args,
+           data_format=DataFormat.NHWC):
+    """Add an op of the args, of ints for a list, i for an int and f for a
+    float"""
+    op = net.op.add()
+    op.name = output + '_op'
+    op.type = op_type
+    op.input.extend(inputs)
+    op.output.append(output)
+    op.output_shape.add().dims.extend(output_shape)
+    ConverterUtil.add_data_format_arg(op, data_format)
+    for name, value in args.items():
+        arg = op.arg.add()
+        arg.name = name
+        if isinstance(value, list):
+            arg.ints.extend(value)
+        elif isinstance(value, float):
+            arg.f = value
+        else:
+            arg.i = value
+    return op
+
+
+def add_tensor(net, name, dims, data):
+    tensor = net.tensors.add()
+    tensor.name = name
+    tensor.dims.extend(dims)
+    tensor.data_type = mace_pb2.DT_FLOAT
+    tensor.float_data.extend(data)
+    return tensor
+
+
+def transform(net, rule, input_shape, device=DeviceType.CPU):
+    """Run the transformer rule on the net, of the input named input and
+    the output named output"""
+    option = ConverterOption()
+    input_node = NodeInfo()
+    input_node.name = 'input'
+    input_node.shape = input_shape
+    option.add_input_node(input_node)
+    output_node = NodeInfo()
+    output_node.name = 'output'
+    option.add_output_node(output_node)
+    option.add_check_node(output_node)
+    option.device = device.value
+    option.transformer_option = [rule]
+    Transformer(option, net).run()
+    return net
+
+
+def arg_ints(op, name):
+    return list(ConverterUtil.get_arg(op, name).ints)
+
+
+class TestTransformer(unittest.TestCase):
+
+    def build_pad_conv_net(self, paddings, conv_args, pad_args=None):
+        """A Pad of the 1x8x8x4 input, read by a 3x3 conv of stride 1"""
+        net = build_net(FilterFormat.HWIO)
+        add_tensor(net, 'filter', [3, 3, 4, 8], [0.5] * (3 * 3 * 4 * 8))
+        pad_args = dict(pad_args or {})
+        pad_args[MaceKeyword.mace_paddings_str] = paddings
+        padded_hw = [8 + paddings[2] + paddings[3],
+                     8 + paddings[4] + paddings[5]]
+        add_op(net, MaceOp.Pad.name, ['input'], 'padded',
+               [1] + padded_hw + [4], pad_args)
+        if conv_args.get(MaceKeyword.mace_padding_str) == \
+                PaddingMode.SAME.value:
+            conv_padding = [2, 2]
+        else:
+            conv_padding = conv_args.get(
+                MaceKeyword.mace_padding_values_str, [0, 0])
+        output_hw = [padded_hw[i] + conv_padding[i] - 2 for i in range(2)]
+        conv_args = dict(conv_args)
+        conv_args[MaceKeyword.mace_strides_str] = [1, 1]
+        add_op(net, MaceOp.Conv2D.name, ['padded', 'filter'], 'output',
+               [1] + output_hw + [8], conv_args)
+        return net
+
+    def test_fold_pad(self):
+        # the pad of the borders is added to the padding of the conv
+        for conv_args, padding_values in [
+                ({MaceKeyword.mace_padding_str: PaddingMode.VALID.value},
+                 [2, 4]),
+                ({MaceKeyword.mace_padding_str: PaddingMode.SAME.value},
+                 [4, 6]),
+                ({MaceKeyword.mace_padding_values_str: [2, 2]}, [4, 6])]:
+            net = self.build_pad_conv_net([0, 0, 1, 1, 2, 2, 0, 0],
+                                          conv_args)
+            transform(net, TransformerRule.FOLD_PAD, [1, 8, 8, 4])
+            self.assertEqual([op.type for op in net.op],
+                             [MaceOp.Conv2D.name])
+            conv_op = net.op[0]
+            self.assertEqual(list(conv_op.input), ['input', 'filter'])
+            self.assertIsNone(ConverterUtil.get_arg(
+                conv_op, MaceKeyword.mace_padding_str))
+            self.assertEqual(arg_ints(
+                conv_op, MaceKeyword.mace_padding_values_str),
+                padding_values)
+
+    def test_not_fold_pad(self):
+        # a pad of nonzero values, a pad of the top and the left only, which
+        # the conv can not pad, and a pad of the channels
+        for paddings, pad_args in [
+                ([0, 0, 1, 1, 1, 1, 0, 0],
+                 {MaceKeyword.mace_constant_value_str: 1}),
+                ([0, 0, 1, 0, 1, 0, 0, 0], {}),
+                ([0, 0, 1, 1, 1, 1, 1, 1], {})]:
+            net = self.build_pad_conv_net(
+                paddings,
+                {MaceKeyword.mace_padding_str: PaddingMode.VALID.value},
+                pad_args)
+            transform(net, TransformerRule.FOLD_PAD, [1, 8, 8, 4])
+            self.assertEqual([op.type for op in net.op],
+                             [MaceOp.Pad.name, MaceOp.Conv2D.name])
+            self.assertEqual(list(net.op[1].input), ['padded', 'filter'])
+
+    def build_atrous_conv_net(self, conv_type, input_size, paddings, crops,
+                              b2s_block_shape=(2, 2)):
+        """A 3x3 VALID conv of the blocks of block shape 2 of the input, of 8
+        channels, the way tensorflow exports a conv of dilation 2"""
+        net = build_net(FilterFormat.HWIO)
+        out_channels = 16 if conv_type == MaceOp.Conv2D.name else 8
+        add_tensor(net, 'filter', [3, 3, 8, out_channels // 8],
+                   [0.5] * (3 * 3 * 8 * out_channels // 8))
+        block_size = (input_size + paddings[0] + paddings[1]) // 2
+        add_op(net, MaceOp.SpaceToBatchND.name, ['input'], 'blocks',
+               [4, block_size, block_size, 8],
+               {MaceKeyword.mace_space_batch_block_shape_str: [2, 2],
+                MaceKeyword.mace_paddings_str: paddings})
+        add_op(net, conv_type, ['blocks', 'filter'], 'conv',
+               [4, block_size - 2, block_size - 2, out_channels],
+               {MaceKeyword.mace_padding_str: PaddingMode.VALID.value,
+                MaceKeyword.mace_strides_str: [1, 1]})
+        output_size = (block_size - 2) * 2 - crops[0] - crops[1]
+        add_op(net, MaceOp.BatchToSpaceND.name, ['conv'], 'output',
+               [1, output_size, output_size, out_channels],
+               {MaceKeyword.mace_space_batch_block_shape_str:
+                list(b2s_block_shape),
+                MaceKeyword.mace_batch_to_space_crops_str: crops})
+        return net
+
+    def test_flatten_atrous_conv(self):
+        # the paddings less the crops are the padding of the dilated conv
+        for conv_type, input_size, paddings, crops in [
+                (MaceOp.Conv2D.name, 16, [2, 2, 2, 2], [0, 0, 0, 0]),
+                (MaceOp.DepthwiseConv2d.name, 15, [2, 3, 2, 3],
+                 [0, 1, 0, 1])]:
+            net = self.build_atrous_conv_net(conv_type, input_size, paddings,
+                                             crops)
+            transform(net, TransformerRule.FLATTEN_ATROUS_CONV,
+                      [1, input_size, input_size, 8])
+            self.assertEqual([op.type for op in net.op], [conv_type])
+            conv_op = net.op[0]
+            self.assertEqual(list(conv_op.input), ['input', 'filter'])
+            self.assertEqual(list(conv_op.output), ['output'])
+            self.assertEqual(list(conv_op.output_shape[0].dims),
+                             [1, input_size, input_size,
+                              16 if conv_type == MaceOp.Conv2D.name else 8])
+            self.assertIsNone(ConverterUtil.get_arg(
+                conv_op, MaceKeyword.mace_padding_str))
+            self.assertEqual(arg_ints(
+                conv_op, MaceKeyword.mace_padding_values_str), [4, 4])
+            self.assertEqual(arg_ints(
+                conv_op, MaceKeyword.mace_dilations_str), [2, 2])
+            self.assertEqual(arg_ints(
+                conv_op, MaceKeyword.mace_strides_str), [1, 1])
+
+    def test_not_flatten_atrous_conv(self):
+        # the blocks of other shapes, and paddings of the bottom and the
+        # right only, which the conv can not pad
+        for paddings, b2s_block_shape in [([2, 2, 2, 2], [3, 3]),
+                                          ([0, 4, 0, 4], [2, 2])]:
+            net = self.build_atrous_conv_net(MaceOp.Conv2D.name, 16,
+                                             paddings, [0, 0, 0, 0],
+                                             b2s_block_shape)
+            transform(net, TransformerRule.FLATTEN_ATROUS_CONV,
+                      [1, 16, 16, 8])
+            self.assertEqual([op.type for op in net.op],
+                             [MaceOp.SpaceToBatchND.name,
+                              MaceOp.Conv2D.name,
+                              MaceOp.BatchToSpaceND.name])
+            self.assertEqual(list(net.op[1].input), ['blocks', 'filter'])
+
+    def build_upsample_conv_net(self, kernel_size):
+        """A 2x nearest upsample of the 1x1x4x4 input, read by a SAME conv
+        of a kernel of 1, 2, ... and a bias of 0.5, after the transpose to
+        NCHW"""
+        net = build_net(FilterFormat.OIHW)
+        add_tensor(net, 'filter', [1, 1, kernel_size, kernel_size],
+                   range(1, kernel_size * kernel_size + 1))
+        add_tensor(net, 'bias', [1], [0.5])
+        add_op(net, MaceOp.ResizeNearestNeighbor.name, ['input'],
+               'upsampled', [1, 1, 8, 8], {}, DataFormat.NCHW)
+        add_op(net, MaceOp.Conv2D.name, ['upsampled', 'filter', 'bias'],
+               'output', [1, 1, 8, 8],
+               {MaceKeyword.mace_padding_str: PaddingMode.SAME.value,
+                MaceKeyword.mace_strides_str: [1, 1]},
+               DataFormat.NCHW)
+        return net
+
+    def test_fold_upsample_conv(self):
+        net = self.build_upsample_conv_net(3)
+        transform(net, TransformerRule.FOLD_UPSAMPLE_CONV, [1, 1, 4, 4])
+        self.assertEqual([op.type for op in net.op], [MaceOp.Conv2D.name])
+        conv_op = net.op[0]
+        self.assertEqual(list(conv_op.input), ['input', 'filter', 'bias'])
+        self.assertEqual(ConverterUtil.get_arg(
+            conv_op, MaceKeyword.mace_depth_to_space_str).i, 2)
+        filter, bias = net.tensors
+        # the output channel of each phase sums the taps of the kernel
+        # landing on the same input pixel: the rows 0, 1, 1 of the phase 0
+        # and 1, 1, 2 of the phase 1
+        self.assertEqual(list(filter.dims), [4, 1, 3, 3])
+        self.assertEqual(list(filter.float_data),
+                         [1, 5, 0, 11, 28, 0, 0, 0, 0,
+                          0, 3, 3, 0, 24, 15, 0, 0, 0,
+                          0, 0, 0, 5, 16, 0, 7, 17, 0,
+                          0, 0, 0, 0, 12, 9, 0, 15, 9])
+        self.assertEqual(list(bias.dims), [4])
+        self.assertEqual(list(bias.float_data), [0.5] * 4)
+
+    def test_not_fold_upsample_conv(self):
+        # an even kernel, and an output of other than blocks of 4 channels
+        # on GPU
+        for kernel_size, device in [(2, DeviceType.CPU),
+                                    (3, DeviceType.GPU)]:
+            net = self.build_upsample_conv_net(kernel_size)
+            transform(net, TransformerRule.FOLD_UPSAMPLE_CONV, [1, 1, 4, 4],
+                      device)
+            self.assertEqual([op.type for op in net.op],
+                             [MaceOp.ResizeNearestNeighbor.name,
+                              MaceOp.Conv2D.name])
+            self.assertEqual(list(net.tensors[0].dims),
+                             [1, 1, kernel_size, kernel_size])
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -37,10 +37,17 @@ def encrypt_code(code_str):
     return encrypted_arr
 
 
-def encrypt_opencl_codegen(cl_kernel_dir, output_path):
+def encrypt_opencl_codegen(cl_kernel_dir, output_path,
+                           cl_kernel_names_file=""):
     if not os.path.exists(cl_kernel_dir):
         print("Input cl_kernel_dir " + cl_kernel_dir + " doesn't exist!")
 
+    # a selective build only embeds the programs its ops build
+    cl_kernel_names = None
+    if cl_kernel_names_file:
+        with open(cl_kernel_names_file, "r") as f:
+            cl_kernel_names = set(line.strip() for line in f)
+
     header_code = ""
     for file_name in os.listdir(cl_kernel_dir):
         file_path = os.path.join(cl_kernel_dir, file_name)
@@ -51,7 +58,8 @@ def encrypt_opencl_codegen(cl_kernel_dir, output_path):
     encrypted_code_maps = {}
     for file_name in os.listdir(cl_kernel_dir):
         file_path = os.path.join(cl_kernel_dir, file_name)
-        if file_path[-3:] == ".cl":
+        if file_path[-3:] == ".cl" and (cl_kernel_names is None or
+                                        file_name[:-3] in cl_kernel_names):
             with open(file_path, "r") as f:
                 code_str = ""
                 for line in f.readlines():
@@ -103,9 +111,16 @@ def parse_args():
         type=str,
         default="./mace/examples/codegen/opencl/opencl_encrypted_program.cc",
         help="The path of encrypted opencl kernels.")
+    parser.add_argument(
+        "--cl_kernel_names_file",
+        type=str,
+        default="",
+        help="The file of the names of the kernels to embed, one per line."
+             " All of them are embedded by default.")
     return parser.parse_known_args()
 
 
 if __name__ == '__main__':
     FLAGS, unparsed = parse_args()
-    encrypt_opencl_codegen(FLAGS.cl_kernel_dir, FLAGS.output_path)
+    encrypt_opencl_codegen(FLAGS.cl_kernel_dir, FLAGS.output_path,
+                           FLAGS.cl_kernel_names_file)
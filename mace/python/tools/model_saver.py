@@ -13,6 +13,7 @@
 # limitations under the License.
 
 import datetime
+import functools
 import os
 import six
 import uuid
@@ -22,11 +23,17 @@ from enum import Enum
 
 from mace.proto import mace_pb2
 from mace.python.tools.converter_tool import base_converter as cvt
+from mace.python.tools.converter_tool.base_converter import MaceKeyword
 from mace.python.tools.convert_util import mace_check
+from mace.python.tools.quantization import quantize_util
 from jinja2 import Environment, FileSystemLoader
 
 GENERATED_NAME = set()
 
+# tensors of at least a page start at a page boundary of the data file, so
+# the pages of one weight are only mapped in when an op reads it
+PAGE_SIZE = 4096
+
 
 class ModelFormat(object):
     file = "file"
@@ -114,6 +121,12 @@ class TensorInfo:
         elif tensor.data_type == mace_pb2.DT_INT32:
             self.data = bytearray(
                 np.array(tensor.int32_data).astype(np.int32).tobytes())
+        elif tensor.data_type == mace_pb2.DT_INT16:
+            self.data = bytearray(
+                np.array(tensor.int32_data).astype(np.int16).tobytes())
+        elif tensor.data_type == mace_pb2.DT_UINT8 and tensor.palette_bits:
+            self.data = bytearray(quantize_util.pack_palette_indices(
+                tensor.int32_data, tensor.palette_bits).tolist())
         elif tensor.data_type == mace_pb2.DT_UINT8:
             self.data = bytearray(
                 np.array(tensor.int32_data).astype(np.uint8).tolist())
@@ -122,32 +135,71 @@ class TensorInfo:
                             tensor.data_type)
 
 
-def update_tensor_infos(net_def, data_type):
+def fp32_op_tensors(net_def):
+    # the weights of the ops kept in fp32 are not stored in half
+    tensors = set()
+    for op in net_def.op:
+        for arg in op.arg:
+            if arg.name == 'T' and arg.i == mace_pb2.DT_FLOAT:
+                tensors.update(op.input)
+    return tensors
+
+
+def update_tensor_infos(net_def, data_type, page_align=False):
     offset = 0
     counter = 0
     tensor_infos = []
+    # the tensors of the same type and bytes, e.g. tied weights, share the
+    # data of the first one
+    data_offsets = {}
+    shared_bytes = 0
+    fp32_tensors = fp32_op_tensors(net_def) \
+        if data_type == mace_pb2.DT_HALF else set()
     for tensor in net_def.tensors:
-        if tensor.data_type == mace_pb2.DT_FLOAT:
+        if tensor.data_type == mace_pb2.DT_FLOAT and \
+                tensor.name not in fp32_tensors:
             tensor.data_type = data_type
 
         # Add offset and data_size
         tensor_info = TensorInfo(counter, tensor)
         tensor_infos.append(tensor_info)
-        # align
-        if tensor_info.data_type != mace_pb2.DT_UINT8 and offset % 4 != 0:
-            padding = 4 - offset % 4
-            offset += padding
+        data_key = (tensor_info.data_type,
+                    hashlib.sha256(tensor_info.data).hexdigest())
+        shared = data_offsets.get(data_key)
+        if shared is not None and shared[1].data != tensor_info.data:
+            shared = None
+        if shared is None:
+            # align
+            if tensor_info.data_type != mace_pb2.DT_UINT8 \
+                    and offset % 4 != 0:
+                padding = 4 - offset % 4
+                offset += padding
+            if page_align and len(tensor_info.data) >= PAGE_SIZE \
+                    and offset % PAGE_SIZE != 0:
+                offset += PAGE_SIZE - offset % PAGE_SIZE
 
         if tensor.data_type == mace_pb2.DT_FLOAT \
                 or tensor.data_type == mace_pb2.DT_HALF:
             tensor.data_size = len(tensor.float_data)
-        elif tensor.data_type == mace_pb2.DT_INT32:
+        elif tensor.data_type == mace_pb2.DT_INT32 \
+                or tensor.data_type == mace_pb2.DT_INT16:
             tensor.data_size = len(tensor.int32_data)
+        elif tensor.data_type == mace_pb2.DT_UINT8 and tensor.palette_bits:
+            # the bytes of the packed indices
+            tensor.data_size = len(tensor_info.data)
         elif tensor.data_type == mace_pb2.DT_UINT8:
             tensor.data_size = len(tensor.int32_data)
-        tensor.offset = offset
-        offset += len(tensor_info.data)
+        if shared is None:
+            tensor.offset = offset
+            data_offsets[data_key] = (offset, tensor_info)
+            offset += len(tensor_info.data)
+        else:
+            tensor.offset = shared[0]
+            shared_bytes += len(tensor_info.data)
         counter += 1
+    if shared_bytes > 0:
+        print("Share the data of duplicate tensors, %d bytes saved"
+              % shared_bytes)
 
 
 def extract_model_data(net_def):
@@ -156,9 +208,16 @@ def extract_model_data(net_def):
     counter = 0
     for tensor in net_def.tensors:
         tensor_info = TensorInfo(counter, tensor)
+        if tensor.offset < offset:
+            # the data of a duplicate tensor, written by the first one
+            end = tensor.offset + len(tensor_info.data)
+            mace_check(model_data[tensor.offset:end] ==
+                       list(tensor_info.data),
+                       "%s shares the data of another tensor which differs"
+                       % tensor.name)
+            counter += 1
+            continue
         # align
-        mace_check(offset <= tensor.offset,
-                   "Current offset should be <= tensor.offset")
         if offset < tensor.offset:
             model_data.extend(bytearray([0] * (tensor.offset - offset)))
             offset = tensor.offset
@@ -180,7 +239,8 @@ def save_model_to_proto(net_def, model_tag, output_dir):
         if tensor.data_type == mace_pb2.DT_FLOAT \
                 or tensor.data_type == mace_pb2.DT_HALF:
             del tensor.float_data[:]
-        elif tensor.data_type == mace_pb2.DT_INT32:
+        elif tensor.data_type == mace_pb2.DT_INT32 \
+                or tensor.data_type == mace_pb2.DT_INT16:
             del tensor.int32_data[:]
         elif tensor.data_type == mace_pb2.DT_UINT8:
             del tensor.int32_data[:]
@@ -269,19 +329,259 @@ def save_model_to_code(net_def, model_tag, device,
         f.write(source)
 
 
+# ops the ahead-of-time code calls kernels for, and the ones that only
+# view the memory of their input in another shape
+AOT_KERNEL_OPS = [cvt.MaceOp.Conv2D.name, cvt.MaceOp.BiasAdd.name,
+                  cvt.MaceOp.Activation.name, cvt.MaceOp.Eltwise.name]
+AOT_ALIAS_OPS = [cvt.MaceOp.Reshape.name, cvt.MaceOp.Squeeze.name,
+                 cvt.MaceOp.Identity.name]
+AOT_ELTWISE_TYPES = [cvt.EltwiseType.SUM.value, cvt.EltwiseType.SUB.value,
+                     cvt.EltwiseType.PROD.value, cvt.EltwiseType.MIN.value,
+                     cvt.EltwiseType.MAX.value]
+# the arena slots are aligned to it and padded with MACE_EXTRA_BUFFER_PAD_SIZE
+AOT_ALIGNMENT = 64
+
+
+def aot_arg(op, name, default=None):
+    for arg in op.arg:
+        if arg.name == name:
+            return arg
+    return default
+
+
+def aot_runtime_shape(op, dims):
+    # the 4D tensors are NCHW at runtime while the converter records NHWC
+    dims = list(dims)
+    data_format = aot_arg(op, MaceKeyword.mace_data_format_str)
+    if len(dims) == 4 and data_format is not None \
+            and data_format.i != cvt.DataFormat.DF_NONE.value:
+        dims = [dims[0], dims[3], dims[1], dims[2]]
+    return dims
+
+
+def aot_activation(op):
+    activation = aot_arg(op, MaceKeyword.mace_activation_type_str)
+    max_limit = aot_arg(op, MaceKeyword.mace_activation_max_limit_str)
+    coefficient = aot_arg(
+        op, MaceKeyword.mace_activation_leakyrelu_coefficient_str)
+    activation = activation.s if activation is not None else b'NOOP'
+    if isinstance(activation, bytes):
+        activation = activation.decode()
+    mace_check(activation != 'PRELU',
+               "%s: PRELU can not be compiled ahead of time" % op.name)
+    return {
+        'activation': activation,
+        'max_limit': max_limit.f if max_limit is not None else 0.0,
+        'coefficient': coefficient.f if coefficient is not None else 0.0,
+    }
+
+
+def aot_conv2d(op, input_shape, filter_shape, output_shape):
+    strides = aot_arg(op, MaceKeyword.mace_strides_str).ints
+    dilations_arg = aot_arg(op, MaceKeyword.mace_dilations_str)
+    dilations = dilations_arg.ints if dilations_arg is not None else [1, 1]
+    padding_values = aot_arg(op, MaceKeyword.mace_padding_values_str)
+    if padding_values is not None and len(padding_values.ints) > 0:
+        paddings = list(padding_values.ints)
+    else:
+        # the total paddings the recorded output shape needs
+        paddings = []
+        for i in range(2):
+            kernel = (filter_shape[2 + i] - 1) * dilations[i] + 1
+            paddings.append(max(0, (output_shape[2 + i] - 1) * strides[i] +
+                                kernel - input_shape[2 + i]))
+    conv2d = aot_activation(op)
+    conv2d.update({
+        'kernel': filter_shape[2:4],
+        'paddings': paddings,
+        'strides': list(strides),
+        'dilations': list(dilations),
+    })
+    return conv2d
+
+
+def plan_aot_net(net_def):
+    tensor_ids = {}
+    weights = []
+    activations = []
+    aliases = []
+    steps = []
+    shapes = {}
+
+    def add_tensor(name):
+        tensor_ids[name] = len(tensor_ids)
+        return tensor_ids[name]
+
+    for tensor in net_def.tensors:
+        mace_check(tensor.data_type == mace_pb2.DT_FLOAT,
+                   "%s: only float weights can be compiled ahead of time"
+                   % tensor.name)
+        weights.append({'id': add_tensor(tensor.name),
+                        'offset': tensor.offset,
+                        'shape': list(tensor.dims)})
+        shapes[tensor.name] = list(tensor.dims)
+
+    # the producer of each activation and its last step, the inputs are
+    # produced before the first step and the outputs live to the end
+    first_step = {}
+    last_step = {}
+    root = {}
+    for input_info in net_def.input_info:
+        mace_check(input_info.data_format != cvt.DataFormat.DF_NONE.value,
+                   "%s: inputs without data format can not be compiled "
+                   "ahead of time" % input_info.name)
+        dims = list(input_info.dims)
+        if len(dims) == 4:
+            dims = [dims[0], dims[3], dims[1], dims[2]]
+        shapes[input_info.name] = dims
+        first_step[input_info.name] = -1
+        root[input_info.name] = input_info.name
+        add_tensor(input_info.name)
+
+    for i, op in enumerate(net_def.op):
+        mace_check(op.type in AOT_KERNEL_OPS or op.type in AOT_ALIAS_OPS,
+                   "%s: op %s can not be compiled ahead of time"
+                   % (op.name, op.type))
+        for name in op.input:
+            mace_check(name in shapes, "%s: unknown input %s"
+                       % (op.name, name))
+            if name in root:
+                last_step[root[name]] = i
+        output = op.output[0]
+        output_shape = aot_runtime_shape(op, op.output_shape[0].dims)
+        input_shape = shapes[op.input[0]]
+        shapes[output] = output_shape
+        step = {'name': op.name, 'type': op.type,
+                'inputs': [tensor_ids[name] for name in op.input]}
+        if op.type in AOT_ALIAS_OPS:
+            mace_check(op.input[0] in root,
+                       "%s: only activations can be reshaped ahead of time"
+                       % op.name)
+            # NCHW and NHWC only agree on the memory order of 4D tensors
+            # whose spatial dims are 1
+            for shape in [input_shape, output_shape]:
+                mace_check(len(shape) != 4 or shape[2:4] == [1, 1] or
+                           input_shape == output_shape,
+                           "%s: only reshapes of 1x1 spatial dims can be "
+                           "compiled ahead of time" % op.name)
+            root[output] = root[op.input[0]]
+            aliases.append({'id': add_tensor(output),
+                            'src_id': tensor_ids[op.input[0]],
+                            'shape': output_shape})
+            continue
+        if op.type == cvt.MaceOp.Conv2D.name:
+            mace_check(len(input_shape) == 4,
+                       "%s: only 4D conv can be compiled ahead of time"
+                       % op.name)
+            step['conv2d'] = aot_conv2d(op, input_shape,
+                                        shapes[op.input[1]], output_shape)
+            step['conv2d_id'] = len([s for s in steps if 'conv2d' in s])
+        elif op.type == cvt.MaceOp.Activation.name:
+            step['activation'] = aot_activation(op)
+        elif op.type == cvt.MaceOp.Eltwise.name:
+            eltwise_type = aot_arg(op, MaceKeyword.mace_element_type_str).i
+            coeff = aot_arg(op, 'coeff')
+            mace_check(eltwise_type in AOT_ELTWISE_TYPES and
+                       len(op.input) == 2 and
+                       shapes[op.input[0]] == shapes[op.input[1]] and
+                       (coeff is None or len(coeff.floats) == 0),
+                       "%s: only eltwise of two tensors of the same shape "
+                       "can be compiled ahead of time" % op.name)
+            step['eltwise_type'] = eltwise_type
+        first_step[output] = i
+        root[output] = output
+        step['output'] = add_tensor(output)
+        steps.append(step)
+
+    output_names = set(info.name for info in net_def.output_info)
+    for name in output_names:
+        mace_check(name in root, "output %s is not computed" % name)
+        last_step[root[name]] = len(net_def.op)
+
+    # first fit of the activations into one arena, in the order of their
+    # producers, reusing the slots of the ones no later step reads
+    arena_size = 0
+    slots = []
+    for name in sorted(first_step, key=lambda n: first_step[n]):
+        size = functools.reduce(lambda a, b: a * b, shapes[name], 1) * 4 \
+            + AOT_ALIGNMENT
+        size = (size + AOT_ALIGNMENT - 1) // AOT_ALIGNMENT * AOT_ALIGNMENT
+        start = first_step[name]
+        end = last_step.get(name, start)
+        live = sorted([s for s in slots if s['end'] >= start],
+                      key=lambda s: s['offset'])
+        offset = 0
+        for slot in live:
+            if offset + size <= slot['offset']:
+                break
+            offset = max(offset, slot['offset'] + slot['size'])
+        slots.append({'offset': offset, 'size': size, 'end': end})
+        arena_size = max(arena_size, offset + size)
+        activations.append({'id': tensor_ids[name], 'offset': offset,
+                            'size': size, 'shape': shapes[name]})
+
+    inputs = [{'name': info.name, 'id': tensor_ids[info.name],
+               'data_format': info.data_format}
+              for info in net_def.input_info]
+    outputs = [{'name': info.name, 'id': tensor_ids[info.name],
+                'data_format': info.data_format}
+               for info in net_def.output_info]
+    return {
+        'num_tensors': len(tensor_ids),
+        'arena_size': arena_size,
+        'weights': weights,
+        'activations': activations,
+        'aliases': aliases,
+        'steps': steps,
+        'inputs': inputs,
+        'outputs': outputs,
+    }
+
+
+def save_model_to_aot(net_def, model_tag, device, template_dir, output_dir):
+    mace_check(device == cvt.DeviceType.CPU.value,
+               "only CPU models can be compiled ahead of time")
+    plan = plan_aot_net(net_def)
+    j2_env = Environment(
+        loader=FileSystemLoader(template_dir), trim_blocks=True)
+    source = j2_env.get_template('aot.jinja2').render(
+        tag=model_tag,
+        net=net_def,
+        plan=plan,
+        model_data_size=len(extract_model_data(net_def)))
+    with open(output_dir + 'aot.cc', "w") as f:
+        f.write(source)
+    source = j2_env.get_template('aot_header.jinja2').render(tag=model_tag)
+    with open(output_dir + model_tag + '_aot.h', "w") as f:
+        f.write(source)
+
+
+def save_model_ops(net_def, model_tag, output_dir):
+    # the op types a selective build registers for the model
+    op_types = sorted(set(op.type for op in net_def.op))
+    with open(output_dir + model_tag + '.ops', "w") as f:
+        f.write('\n'.join(op_types) + '\n')
+
+
 def save_model(option, net_def, model_checksum, weight_checksum, template_dir,
                obfuscate, model_tag, output_dir, embed_model_data,
-               winograd_conv, model_graph_format):
+               winograd_conv, model_graph_format, aot=False):
     if obfuscate:
         obfuscate_name(option, net_def)
 
     output_dir = output_dir + '/'
     # update tensor type
-    update_tensor_infos(net_def, option.data_type)
+    update_tensor_infos(net_def, option.data_type,
+                        model_graph_format == ModelFormat.file or
+                        not embed_model_data)
 
     if model_graph_format == ModelFormat.file or not embed_model_data:
         save_model_data(net_def, model_tag, output_dir)
 
+    # the DSP runs the ops of hexagon nn instead of the registered ones
+    if option.device != cvt.DeviceType.HEXAGON.value:
+        save_model_ops(net_def, model_tag, output_dir)
+
     if model_graph_format == ModelFormat.file:
         save_model_to_proto(net_def, model_tag, output_dir)
     else:
@@ -289,3 +589,6 @@ def save_model(option, net_def, model_checksum, weight_checksum, template_dir,
                            template_dir, output_dir, embed_model_data,
                            model_checksum, weight_checksum,
                            obfuscate, winograd_conv)
+        if aot:
+            save_model_to_aot(net_def, model_tag, option.device,
+                              template_dir, output_dir)
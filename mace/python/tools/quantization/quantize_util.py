@@ -6,6 +6,7 @@ class QuantizedData(object):
     def __init__(self):
         self._data = None
         self._scale = 0
+        self._scales = []
         self._zero = 0
         self._minval = 0.0
         self._maxval = 0.0
@@ -18,6 +19,10 @@ class QuantizedData(object):
     def scale(self):
         return self._scale
 
+    @property
+    def scales(self):
+        return self._scales
+
     @property
     def zero(self):
         return self._zero
@@ -38,6 +43,10 @@ class QuantizedData(object):
     def scale(self, scale):
         self._scale = scale
 
+    @scales.setter
+    def scales(self, scales):
+        self._scales = scales
+
     @zero.setter
     def zero(self, zero):
         self._zero = zero
@@ -125,6 +134,30 @@ def quantize(data, non_zero):
     return quantized_data
 
 
+def quantize_per_channel(data, axis):
+    """Symmetric quantization with a scale for each slice along axis,
+    all channels share the zero point 128."""
+    np_data = np.array(data).astype(float)
+    channels = np_data.shape[axis]
+    channel_data = np.moveaxis(np_data, axis, 0).reshape(channels, -1)
+    max_abs = np.abs(channel_data).max(axis=1)
+    scales = np.maximum(max_abs, 1e-6) / 127.0
+    zero = 128
+    shape = [1] * np_data.ndim
+    shape[axis] = channels
+    output = np.clip(np.round(zero + np_data / scales.reshape(shape)),
+                     0, 255).astype(int)
+
+    quantized_data = QuantizedData()
+    quantized_data.data = output
+    quantized_data.scale = float(scales.max())
+    quantized_data.scales = [float(scale) for scale in scales]
+    quantized_data.zero = zero
+    quantized_data.minval = -float(max_abs.max())
+    quantized_data.maxval = float(max_abs.max())
+    return quantized_data
+
+
 def quantize_bias_for_hexagon(data):
     np_data = np.array(data).astype(float)
     max_val = max(abs(np_data.min()), abs(np_data.max()))
@@ -146,3 +179,88 @@ def quantize_bias_for_hexagon(data):
 
 def dequantize(quantized_data):
     return quantized_data.scale * (quantized_data.data - quantized_data.zero)
+
+
+def palettize(data, bits, iterations=20):
+    """Cluster the values into at most 2^bits values by 1-D k-means,
+    returns the sorted palette and the index of each value into it."""
+    np_data = np.array(data).astype(float).reshape(-1)
+    clusters = min(2 ** bits, np.unique(np_data).size)
+    palette = np.percentile(
+        np_data, (np.arange(clusters) + 0.5) * 100.0 / clusters)
+    for _ in range(iterations):
+        indices = nearest_palette_indices(np_data, palette)
+        sums = np.bincount(indices, weights=np_data, minlength=clusters)
+        counts = np.bincount(indices, minlength=clusters)
+        updated = np.where(counts > 0, sums / np.maximum(counts, 1), palette)
+        updated.sort()
+        if np.allclose(updated, palette):
+            break
+        palette = updated
+    return palette, nearest_palette_indices(np_data, palette)
+
+
+def nearest_palette_indices(data, palette):
+    # the palette is sorted, a value goes to the nearer of its neighbours
+    return np.searchsorted((palette[1:] + palette[:-1]) / 2.0, data)
+
+
+def pack_palette_indices(indices, bits):
+    """Pack the indices of bits bits from the lowest bit of each byte."""
+    np_indices = np.array(indices).astype(np.uint32).reshape(-1)
+    index_bits = (np_indices[:, None] >> np.arange(bits)) & 1
+    index_bits = index_bits.reshape(-1).astype(np.uint8)
+    padding = (8 - index_bits.size % 8) % 8
+    index_bits = np.concatenate([index_bits,
+                                 np.zeros(padding, dtype=np.uint8)])
+    byte_weights = (1 << np.arange(8)).astype(np.uint8)
+    return (index_bits.reshape(-1, 8) * byte_weights).sum(
+        axis=1).astype(np.uint8)
+
+
+def depalettize(palette, indices):
+    return np.array(palette)[np.array(indices)]
+
+
+def quantize_weight_only(data, bits, group_size=0):
+    """Quantize the rows of a 2-D weight symmetrically to bits bits with a
+    scale per group_size values of a row, or per row if group_size is 0.
+    The values of 4 bits are packed two to a byte from the lower nibble,
+    each row padded to whole bytes, to be dequantized by the weight-only
+    kernels as they multiply."""
+    np_data = np.array(data).astype(float)
+    rows, cols = np_data.shape
+    if group_size <= 0:
+        group_size = cols
+    groups = (cols + group_size - 1) // group_size
+    max_q = 2 ** (bits - 1) - 1
+    zero = max_q + 1
+    padded = np.zeros((rows, groups * group_size))
+    padded[:, :cols] = np_data
+    grouped = padded.reshape(rows, groups, group_size)
+    scales = np.abs(grouped).max(axis=2) / max_q
+    scales[scales == 0] = 1.0
+    q = np.clip(np.round(grouped / scales[:, :, None]), -max_q, max_q)
+    q = (q + zero).astype(np.uint8).reshape(rows, -1)[:, :cols]
+    if bits == 4:
+        if cols % 2 != 0:
+            q = np.concatenate([q, np.zeros((rows, 1), dtype=np.uint8)],
+                               axis=1)
+        q = q[:, 0::2] | (q[:, 1::2] << 4)
+
+    quantized_data = QuantizedData()
+    quantized_data.data = q.reshape(-1)
+    quantized_data.scales = list(scales.reshape(-1))
+    quantized_data.zero = zero
+    return quantized_data
+
+
+def dequantize_weight_only(quantized_data, bits, rows, cols, group_size=0):
+    q = np.array(quantized_data.data).astype(np.uint8).reshape(rows, -1)
+    if bits == 4:
+        q = np.stack([q & 15, q >> 4], axis=2).reshape(rows, -1)[:, :cols]
+    if group_size <= 0:
+        group_size = cols
+    scales = np.array(quantized_data.scales).reshape(rows, -1)
+    return np.repeat(scales, group_size, axis=1)[:, :cols] * \
+        (q.astype(float) - quantized_data.zero)
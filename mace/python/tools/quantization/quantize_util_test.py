@@ -11,6 +11,35 @@ class TestQuantize(unittest.TestCase):
         dequantized_output = quantize_util.dequantize(quantized_data)
         np.testing.assert_array_almost_equal(test_input, dequantized_output, 2)
 
+    def test_palettize(self):
+        test_input = np.random.rand(64, 48) * 5
+        palette, indices = quantize_util.palettize(test_input, 6)
+        self.assertLessEqual(len(palette), 64)
+        dequantized_output = quantize_util.depalettize(
+            palette, indices).reshape(test_input.shape)
+        np.testing.assert_array_almost_equal(test_input, dequantized_output, 1)
+
+    def test_pack_palette_indices(self):
+        indices = np.random.randint(0, 64, 13)
+        packed = quantize_util.pack_palette_indices(indices, 6)
+        self.assertEqual(len(packed), 10)
+        bits = np.unpackbits(packed[:, None], axis=1)[:, ::-1].reshape(-1)
+        unpacked = [int(''.join(str(b) for b in bits[i * 6:i * 6 + 6][::-1]),
+                        2) for i in range(len(indices))]
+        self.assertEqual(unpacked, list(indices))
+
+    def test_quantize_weight_only(self):
+        test_input = np.random.rand(8, 75) * 2 - 1
+        for bits, group_size in [(8, 0), (4, 32)]:
+            quantized_data = quantize_util.quantize_weight_only(
+                test_input, bits, group_size)
+            row_bytes = 75 if bits == 8 else 38
+            self.assertEqual(len(quantized_data.data), 8 * row_bytes)
+            dequantized_output = quantize_util.dequantize_weight_only(
+                quantized_data, bits, 8, 75, group_size)
+            np.testing.assert_array_almost_equal(
+                test_input, dequantized_output, 1 if bits == 4 else 2)
+
 
 if __name__ == '__main__':
     unittest.main()
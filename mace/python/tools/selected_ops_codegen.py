@@ -0,0 +1,151 @@
+# Copyright 2019 The MACE Authors. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+import argparse
+import os
+import re
+
+from jinja2 import Environment, FileSystemLoader
+
+FLAGS = None
+
+# ops the runtime creates itself, kept in every selective build
+RUNTIME_OPS = ['BufferTransform', 'Cast', 'Eltwise', 'NCHWcTransform',
+               'NNAPIDelegate']
+
+# the OpenCL programs the GPU ops build, see the BuildKernel calls of
+# mace/ops/opencl
+OPENCL_OP_PROGRAMS = {
+    'Activation': ['activation', 'activation_buffer'],
+    'AddN': ['addn'],
+    'Attention': ['attention'],
+    'BatchNorm': ['batch_norm', 'batch_norm_buffer'],
+    'BatchToSpaceND': ['batch_to_space'],
+    'BiasAdd': ['bias_add'],
+    'ChannelShuffle': ['channel_shuffle'],
+    'Concat': ['concat'],
+    'Conv2D': ['conv_2d', 'conv_2d_1x1', 'conv_2d_3x3', 'conv_2d_buffer',
+               'conv_2d_1x1_buffer', 'matmul', 'winograd_transform'],
+    'Crop': ['crop'],
+    'Deconv2D': ['deconv_2d'],
+    'DepthToSpace': ['depth_to_space'],
+    'DepthwiseConv2d': ['depthwise_conv2d', 'depthwise_conv2d_buffer'],
+    'DepthwiseDeconv2d': ['depthwise_deconv2d'],
+    'Eltwise': ['eltwise'],
+    'FullyConnected': ['fully_connected'],
+    'FusedElementwise': ['fused_elementwise'],
+    'LayerNorm': ['layer_norm'],
+    'LSTMCell': ['lstmcell'],
+    'MatMul': ['matmul'],
+    'Pad': ['pad'],
+    'Pooling': ['pooling', 'pooling_buffer'],
+    'Reduce': ['reduce'],
+    'ResizeBicubic': ['resize_bicubic'],
+    'ResizeBilinear': ['resize_bilinear'],
+    'ResizeNearestNeighbor': ['resize_nearest_neighbor'],
+    'Softmax': ['softmax', 'softmax_buffer'],
+    'SpaceToBatchND': ['space_to_batch'],
+    'SpaceToDepth': ['space_to_depth'],
+    'Split': ['split'],
+    'SqrDiffMean': ['sqrdiff_mean'],
+}
+OPENCL_RUNTIME_PROGRAMS = ['buffer_to_image', 'buffer_transform']
+
+
+def read_op_types(ops_files):
+    op_types = set(RUNTIME_OPS)
+    for ops_file in ops_files:
+        with open(ops_file) as f:
+            op_types.update(line.strip() for line in f if line.strip())
+    return sorted(op_types)
+
+
+def registered_ops(ops_registry_path):
+    # the ops registered in mace/ops/ops_registry.cc, with the macro they
+    # are built under
+    ops = {}
+    guards = []
+    with open(ops_registry_path) as f:
+        for line in f:
+            ifdef = re.match(r'#ifdef (\w+)', line)
+            register = re.match(r'\s*ops::Register(\w+)\(this\);', line)
+            if ifdef:
+                guards.append(ifdef.group(1))
+            elif line.startswith('#endif'):
+                guards.pop()
+            elif register:
+                guard = [g for g in guards
+                         if g != 'MACE_ENABLE_SELECTIVE_BUILD']
+                ops[register.group(1)] = guard[-1] if guard else None
+    return ops
+
+
+def opencl_programs(op_types):
+    programs = set(OPENCL_RUNTIME_PROGRAMS)
+    for op_type in op_types:
+        programs.update(OPENCL_OP_PROGRAMS.get(op_type, []))
+    return sorted(programs)
+
+
+def gen_selected_ops(op_types, template_dir, ops_registry_path,
+                     output_dir):
+    registered = registered_ops(ops_registry_path)
+    unknown = [t for t in op_types if t not in registered]
+    if unknown:
+        raise Exception("ops %s are not registered in %s"
+                        % (unknown, ops_registry_path))
+    j2_env = Environment(
+        loader=FileSystemLoader(template_dir), trim_blocks=True)
+    source = j2_env.get_template('selected_ops.cc.jinja2').render(
+        ops=[(op_type, registered[op_type]) for op_type in op_types])
+    if not os.path.exists(output_dir):
+        os.makedirs(output_dir)
+    with open(output_dir + '/selected_ops.cc', "w") as f:
+        f.write(source)
+    # read by the OpenCL encrypt repository rule
+    with open(output_dir + '/opencl_kernels', "w") as f:
+        f.write('\n'.join(opencl_programs(op_types)) + '\n')
+
+
+def parse_args():
+    """Parses command line arguments."""
+    parser = argparse.ArgumentParser()
+    parser.add_argument(
+        "--ops_files",
+        type=str,
+        default="",
+        help="the op type files of the converted models, comma separated")
+    parser.add_argument(
+        "--template_dir",
+        type=str,
+        default="mace/python/tools",
+        help="template dir")
+    parser.add_argument(
+        "--ops_registry_path",
+        type=str,
+        default="mace/ops/ops_registry.cc",
+        help="the registry of all the ops")
+    parser.add_argument(
+        "--output_dir",
+        type=str,
+        default="mace/codegen/ops",
+        help="output dir")
+    return parser.parse_known_args()
+
+
+if __name__ == '__main__':
+    FLAGS, unparsed = parse_args()
+    gen_selected_ops(read_op_types(FLAGS.ops_files.split(',')),
+                     FLAGS.template_dir, FLAGS.ops_registry_path,
+                     FLAGS.output_dir)
@@ -14,6 +14,13 @@
 
 #include "mace/test/mace_api_test.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <thread>  // NOLINT(build/c++11)
+
+#include "mace/ops/common/eltwise_type.h"
+
 namespace mace {
 namespace test {
 
@@ -84,6 +91,1036 @@ void MaceRun(const int in_out_size,
   CheckOutputs<D, T>(*net_def, inputs, outputs, data);
 }
 
+void ExpectOutputsNear(const std::map<std::string, mace::MaceTensor> &expected,
+                       const std::map<std::string, mace::MaceTensor> &actual,
+                       const float abs_error = 1e-5) {
+  for (auto &output : expected) {
+    auto iter = actual.find(output.first);
+    ASSERT_TRUE(iter != actual.end());
+    EXPECT_EQ(output.second.shape(), iter->second.shape());
+    const int64_t size = std::accumulate(output.second.shape().begin(),
+                                         output.second.shape().end(), 1,
+                                         std::multiplies<int64_t>());
+    for (int64_t j = 0; j < size; ++j) {
+      EXPECT_NEAR(output.second.data().get()[j],
+                  iter->second.data().get()[j], abs_error);
+    }
+  }
+}
+
+// Each request of the batch must produce the same result as a single run.
+template <DeviceType D, typename T>
+void MaceRunBatch(const int request_count,
+                  const std::vector<int64_t> &max_shape,
+                  const std::vector<int64_t> &request_shape,
+                  const std::vector<int64_t> &filter_shape) {
+  std::string input_name = "input";
+  std::string output_name = "output";
+  std::vector<T> data;
+  std::shared_ptr<NetDef> net_def = BuildConvNet<T>(
+      {input_name}, {output_name}, max_shape, filter_shape, &data);
+
+  MaceEngineConfig config(D);
+  std::unique_ptr<MaceEngine> engine;
+  ASSERT_EQ(CreateEngine(config, *net_def, {input_name}, {output_name}, data,
+                         &engine),
+            MaceStatus::MACE_SUCCESS);
+
+  std::vector<std::map<std::string, mace::MaceTensor>> inputs(request_count);
+  std::vector<std::map<std::string, mace::MaceTensor>> outputs(request_count);
+  for (int i = 0; i < request_count; ++i) {
+    GenerateInputs({input_name}, request_shape, &inputs[i]);
+    GenerateOutputs({output_name}, request_shape, &outputs[i]);
+  }
+  EXPECT_EQ(engine->RunBatch(inputs, &outputs), MaceStatus::MACE_SUCCESS);
+
+  for (int i = 0; i < request_count; ++i) {
+    std::map<std::string, mace::MaceTensor> expected_outputs;
+    GenerateOutputs({output_name}, request_shape, &expected_outputs);
+    EXPECT_EQ(engine->Run(inputs[i], &expected_outputs),
+              MaceStatus::MACE_SUCCESS);
+    ExpectOutputsNear(expected_outputs, outputs[i]);
+  }
+}
+
+template <DeviceType D, typename T>
+void MaceRunAsync(const int frame_count,
+                  const std::vector<int64_t> &shape,
+                  const std::vector<int64_t> &filter_shape,
+                  const int max_async_runs = 2) {
+  std::string input_name = "input";
+  std::string output_name = "output";
+  std::vector<T> data;
+  std::shared_ptr<NetDef> net_def = BuildConvNet<T>(
+      {input_name}, {output_name}, shape, filter_shape, &data);
+
+  MaceEngineConfig config(D);
+  EXPECT_EQ(config.SetMaxAsyncRuns(max_async_runs), MaceStatus::MACE_SUCCESS);
+  std::unique_ptr<MaceEngine> engine;
+  ASSERT_EQ(CreateEngine(config, *net_def, {input_name}, {output_name}, data,
+                         &engine),
+            MaceStatus::MACE_SUCCESS);
+
+  std::vector<std::map<std::string, mace::MaceTensor>> inputs(frame_count);
+  std::vector<std::map<std::string, mace::MaceTensor>> outputs(frame_count);
+  std::vector<std::shared_ptr<RunFuture>> futures(frame_count);
+  std::vector<int> callbacks(frame_count, 0);
+  for (int i = 0; i < frame_count; ++i) {
+    GenerateInputs({input_name}, shape, &inputs[i]);
+    GenerateOutputs({output_name}, shape, &outputs[i]);
+    int *called = &callbacks[i];
+    EXPECT_EQ(engine->RunAsync(inputs[i], &outputs[i],
+                               [called](const MaceStatus &) { *called = 1; },
+                               &futures[i]),
+              MaceStatus::MACE_SUCCESS);
+  }
+
+  for (int i = 0; i < frame_count; ++i) {
+    EXPECT_EQ(futures[i]->Wait(), MaceStatus::MACE_SUCCESS);
+    EXPECT_EQ(callbacks[i], 1);
+    std::map<std::string, mace::MaceTensor> expected_outputs;
+    GenerateOutputs({output_name}, shape, &expected_outputs);
+    EXPECT_EQ(engine->Run(inputs[i], &expected_outputs),
+              MaceStatus::MACE_SUCCESS);
+    ExpectOutputsNear(expected_outputs, outputs[i]);
+  }
+}
+
+// Aligned NCHW buffers of CPU are used in place, which must give the same
+// result as copying NHWC buffers.
+template <DeviceType D, typename T>
+void MaceRunZeroCopy(const std::vector<int64_t> &shape,
+                     const std::vector<int64_t> &filter_shape) {
+  std::string input_name = "input";
+  std::string output_name = "output";
+  std::vector<T> data;
+  std::shared_ptr<NetDef> net_def = BuildConvNet<T>(
+      {input_name}, {output_name}, shape, filter_shape, &data);
+
+  MaceEngineConfig config(D);
+  EXPECT_EQ(config.SetZeroCopy(true), MaceStatus::MACE_SUCCESS);
+  std::unique_ptr<MaceEngine> engine;
+  ASSERT_EQ(CreateEngine(config, *net_def, {input_name}, {output_name}, data,
+                         &engine),
+            MaceStatus::MACE_SUCCESS);
+
+  std::map<std::string, mace::MaceTensor> inputs;
+  std::map<std::string, mace::MaceTensor> expected_outputs;
+  GenerateInputs({input_name}, shape, &inputs);
+  GenerateOutputs({output_name}, shape, &expected_outputs);
+  EXPECT_EQ(engine->Run(inputs, &expected_outputs), MaceStatus::MACE_SUCCESS);
+
+  // spare floats for the kernels reading past the end
+  const int64_t pad_size = 16;
+  const int64_t size = std::accumulate(shape.begin(), shape.end(), 1,
+                                       std::multiplies<int64_t>());
+  auto new_aligned_buffer = [size, pad_size]() {
+    void *ptr = nullptr;
+    GetCPUAllocator()->New((size + pad_size) * sizeof(float), &ptr);
+    return std::shared_ptr<float>(static_cast<float *>(ptr), [](float *p) {
+      GetCPUAllocator()->Delete(p);
+    });
+  };
+  const int64_t batch = shape[0];
+  const int64_t height = shape[1];
+  const int64_t width = shape[2];
+  const int64_t channels = shape[3];
+  const std::vector<int64_t> nchw_shape = {batch, channels, height, width};
+  auto nchw_input = new_aligned_buffer();
+  const float *nhwc_input = inputs[input_name].data().get();
+  for (int64_t b = 0; b < batch; ++b) {
+    for (int64_t c = 0; c < channels; ++c) {
+      for (int64_t h = 0; h < height; ++h) {
+        for (int64_t w = 0; w < width; ++w) {
+          nchw_input.get()[((b * channels + c) * height + h) * width + w] =
+              nhwc_input[((b * height + h) * width + w) * channels + c];
+        }
+      }
+    }
+  }
+  auto nchw_output = new_aligned_buffer();
+  std::map<std::string, mace::MaceTensor> zero_copy_inputs;
+  std::map<std::string, mace::MaceTensor> zero_copy_outputs;
+  zero_copy_inputs[input_name] = mace::MaceTensor(
+      nchw_shape, nchw_input, DataFormat::NCHW, size + pad_size);
+  zero_copy_outputs[output_name] = mace::MaceTensor(
+      nchw_shape, nchw_output, DataFormat::NCHW, size + pad_size);
+  EXPECT_EQ(engine->Run(zero_copy_inputs, &zero_copy_outputs),
+            MaceStatus::MACE_SUCCESS);
+
+  auto &actual = zero_copy_outputs[output_name];
+  EXPECT_EQ(nchw_shape, actual.shape());
+  EXPECT_EQ(nchw_output.get(), actual.data().get());
+  const float *expected = expected_outputs[output_name].data().get();
+  for (int64_t b = 0; b < batch; ++b) {
+    for (int64_t c = 0; c < channels; ++c) {
+      for (int64_t h = 0; h < height; ++h) {
+        for (int64_t w = 0; w < width; ++w) {
+          EXPECT_NEAR(
+              expected[((b * height + h) * width + w) * channels + c],
+              actual.data().get()[((b * channels + c) * height + h) * width
+                  + w],
+              1e-5);
+        }
+      }
+    }
+  }
+}
+
+// RGBA frames preprocessed by the engine must give the same result as float
+// inputs resized and normalized on the host.
+template <DeviceType D, typename T>
+void MaceRunInputPreprocess(const std::vector<int64_t> &shape,
+                            const std::vector<int64_t> &frame_shape,
+                            const std::vector<int64_t> &filter_shape) {
+  std::string input_name = "input";
+  std::string output_name = "output";
+  std::vector<T> data;
+  std::shared_ptr<NetDef> net_def = BuildConvNet<T>(
+      {input_name}, {output_name}, shape, filter_shape, &data);
+
+  InputPreprocess preprocess;
+  preprocess.pixel_format = PixelFormat::PIXEL_RGBA;
+  preprocess.model_format = PixelFormat::PIXEL_BGR;
+  preprocess.mean = {104.f, 117.f, 123.f};
+  preprocess.scale = {0.017f};
+  MaceEngineConfig config(D);
+  EXPECT_EQ(config.SetInputPreprocess(input_name, preprocess),
+            MaceStatus::MACE_SUCCESS);
+  std::unique_ptr<MaceEngine> engine;
+  ASSERT_EQ(CreateEngine(config, *net_def, {input_name}, {output_name}, data,
+                         &engine),
+            MaceStatus::MACE_SUCCESS);
+
+  const int64_t frame_size = std::accumulate(
+      frame_shape.begin(), frame_shape.end(), 1, std::multiplies<int64_t>());
+  std::shared_ptr<uint8_t> pixels(new uint8_t[frame_size],
+                                  std::default_delete<uint8_t[]>());
+  for (int64_t i = 0; i < frame_size; ++i) {
+    pixels.get()[i] = static_cast<uint8_t>((i * 37 + i / 5) % 256);
+  }
+
+  // resize bilinearly as ResizeBilinear without align_corners
+  const int64_t batch = shape[0];
+  const int64_t height = shape[1];
+  const int64_t width = shape[2];
+  const int64_t channels = shape[3];
+  const int64_t in_height = frame_shape[1];
+  const int64_t in_width = frame_shape[2];
+  const float height_scale = in_height / static_cast<float>(height);
+  const float width_scale = in_width / static_cast<float>(width);
+  auto pixel = [&](int64_t b, int64_t h, int64_t w, int64_t c) {
+    return static_cast<float>(
+        pixels.get()[((b * in_height + h) * in_width + w) * 4 + c]);
+  };
+  std::map<std::string, mace::MaceTensor> inputs;
+  std::map<std::string, mace::MaceTensor> expected_outputs;
+  GenerateInputs({input_name}, shape, &inputs);
+  GenerateOutputs({output_name}, shape, &expected_outputs);
+  float *input_data = inputs[input_name].data().get();
+  for (int64_t b = 0; b < batch; ++b) {
+    for (int64_t h = 0; h < height; ++h) {
+      const float in_h = h * height_scale;
+      const int64_t top = static_cast<int64_t>(in_h);
+      const int64_t bottom = std::min(top + 1, in_height - 1);
+      const float y_lerp = in_h - top;
+      for (int64_t w = 0; w < width; ++w) {
+        const float in_w = w * width_scale;
+        const int64_t left = static_cast<int64_t>(in_w);
+        const int64_t right = std::min(left + 1, in_width - 1);
+        const float x_lerp = in_w - left;
+        for (int64_t c = 0; c < channels; ++c) {
+          // BGR channels of RGBA pixels
+          const int64_t k = 2 - c;
+          const float top_value = pixel(b, top, left, k) +
+              (pixel(b, top, right, k) - pixel(b, top, left, k)) * x_lerp;
+          const float bottom_value = pixel(b, bottom, left, k) +
+              (pixel(b, bottom, right, k) - pixel(b, bottom, left, k)) *
+                  x_lerp;
+          const float value =
+              top_value + (bottom_value - top_value) * y_lerp;
+          input_data[((b * height + h) * width + w) * channels + c] =
+              (value - preprocess.mean[c]) * preprocess.scale[0];
+        }
+      }
+    }
+  }
+  EXPECT_EQ(engine->Run(inputs, &expected_outputs), MaceStatus::MACE_SUCCESS);
+
+  std::map<std::string, mace::MaceTensor> pixel_inputs;
+  std::map<std::string, mace::MaceTensor> outputs;
+  pixel_inputs[input_name] = mace::MaceTensor(frame_shape, pixels);
+  GenerateOutputs({output_name}, shape, &outputs);
+  EXPECT_EQ(engine->Run(pixel_inputs, &outputs), MaceStatus::MACE_SUCCESS);
+  EXPECT_EQ(shape, outputs[output_name].shape());
+
+  const int64_t size = std::accumulate(shape.begin(), shape.end(), 1,
+                                       std::multiplies<int64_t>());
+  const float *expected = expected_outputs[output_name].data().get();
+  const float *actual = outputs[output_name].data().get();
+  for (int64_t i = 0; i < size; ++i) {
+    EXPECT_NEAR(expected[i], actual[i], 1e-3);
+  }
+}
+
+// Half inputs and outputs, converted by the engine, must give the result of
+// float ones within the precision of half.
+template <DeviceType D, typename T>
+void MaceRunHalfInputOutput(const std::vector<int64_t> &shape,
+                            const std::vector<int64_t> &filter_shape) {
+  std::string input_name = "input";
+  std::string output_name = "output";
+  std::vector<T> data;
+  std::shared_ptr<NetDef> net_def = BuildConvNet<T>(
+      {input_name}, {output_name}, shape, filter_shape, &data);
+
+  MaceEngineConfig config(D);
+  std::unique_ptr<MaceEngine> engine;
+  ASSERT_EQ(CreateEngine(config, *net_def, {input_name}, {output_name}, data,
+                         &engine),
+            MaceStatus::MACE_SUCCESS);
+
+  const int64_t size = std::accumulate(shape.begin(), shape.end(), 1,
+                                       std::multiplies<int64_t>());
+  std::map<std::string, mace::MaceTensor> inputs;
+  std::map<std::string, mace::MaceTensor> expected_outputs;
+  GenerateInputs({input_name}, shape, &inputs);
+  GenerateOutputs({output_name}, shape, &expected_outputs);
+  // the float inputs hold the values of the half ones
+  float *input_data = inputs[input_name].data().get();
+  std::shared_ptr<half> half_input(new half[size],
+                                   std::default_delete<half[]>());
+  for (int64_t i = 0; i < size; ++i) {
+    half_input.get()[i] = half(input_data[i]);
+    input_data[i] = half_input.get()[i];
+  }
+  EXPECT_EQ(engine->Run(inputs, &expected_outputs), MaceStatus::MACE_SUCCESS);
+
+  std::map<std::string, mace::MaceTensor> half_inputs;
+  std::map<std::string, mace::MaceTensor> outputs;
+  std::shared_ptr<half> half_output(new half[size],
+                                    std::default_delete<half[]>());
+  half_inputs[input_name] =
+      mace::MaceTensor(shape, half_input, IDataType::IDT_HALF);
+  outputs[output_name] =
+      mace::MaceTensor(shape, half_output, IDataType::IDT_HALF);
+  EXPECT_EQ(engine->Run(half_inputs, &outputs), MaceStatus::MACE_SUCCESS);
+  EXPECT_EQ(shape, outputs[output_name].shape());
+  EXPECT_EQ(nullptr, outputs[output_name].data());
+
+  const float *expected = expected_outputs[output_name].data().get();
+  for (int64_t i = 0; i < size; ++i) {
+    EXPECT_NEAR(expected[i], static_cast<float>(half_output.get()[i]),
+                1e-2 * std::max(1.f, std::abs(expected[i])));
+  }
+}
+
+#ifdef MACE_ENABLE_OPENCL
+// OpenCL buffers on the engine's context are used in place, which must give
+// the same result as host buffers.
+template <typename T>
+void MaceRunOpenCLBuffer(const std::vector<int64_t> &shape,
+                         const std::vector<int64_t> &filter_shape) {
+  std::string input_name = "input";
+  std::string output_name = "output";
+  std::vector<T> data;
+  std::shared_ptr<NetDef> net_def = BuildConvNet<T>(
+      {input_name}, {output_name}, shape, filter_shape, &data);
+
+  MaceEngineConfig config(GPU);
+  std::unique_ptr<MaceEngine> engine;
+  ASSERT_EQ(CreateEngine(config, *net_def, {input_name}, {output_name}, data,
+                         &engine),
+            MaceStatus::MACE_SUCCESS);
+
+  std::map<std::string, mace::MaceTensor> inputs;
+  std::map<std::string, mace::MaceTensor> expected_outputs;
+  GenerateInputs({input_name}, shape, &inputs);
+  GenerateOutputs({output_name}, shape, &expected_outputs);
+  EXPECT_EQ(engine->Run(inputs, &expected_outputs), MaceStatus::MACE_SUCCESS);
+
+  void *context_handle = nullptr;
+  void *queue_handle = nullptr;
+  EXPECT_EQ(engine->GetOpenCLContext(&context_handle, &queue_handle),
+            MaceStatus::MACE_SUCCESS);
+  cl::Context context(static_cast<cl_context>(context_handle), true);
+  cl::CommandQueue queue(static_cast<cl_command_queue>(queue_handle),
+                         true);
+  const int64_t size = std::accumulate(shape.begin(), shape.end(), 1,
+                                       std::multiplies<int64_t>());
+  cl::Buffer input_buffer(context, CL_MEM_READ_WRITE, size * sizeof(float));
+  cl::Buffer output_buffer(context, CL_MEM_READ_WRITE, size * sizeof(float));
+  EXPECT_EQ(queue.enqueueWriteBuffer(input_buffer, CL_TRUE, 0,
+                                     size * sizeof(float),
+                                     inputs[input_name].data().get()),
+            CL_SUCCESS);
+
+  std::map<std::string, mace::MaceTensor> cl_inputs;
+  std::map<std::string, mace::MaceTensor> cl_outputs;
+  cl_inputs[input_name] = mace::MaceTensor(shape, input_buffer(),
+                                           OpenCLMemoryType::OPENCL_BUFFER);
+  cl_outputs[output_name] = mace::MaceTensor(shape, output_buffer(),
+                                             OpenCLMemoryType::OPENCL_BUFFER);
+  EXPECT_EQ(engine->Run(cl_inputs, &cl_outputs), MaceStatus::MACE_SUCCESS);
+  EXPECT_EQ(shape, cl_outputs[output_name].shape());
+
+  std::vector<float> actual(size);
+  EXPECT_EQ(queue.enqueueReadBuffer(output_buffer, CL_TRUE, 0,
+                                    size * sizeof(float), actual.data()),
+            CL_SUCCESS);
+  const float *expected = expected_outputs[output_name].data().get();
+  for (int64_t i = 0; i < size; ++i) {
+    EXPECT_NEAR(expected[i], actual[i], 1e-5);
+  }
+}
+#endif  // MACE_ENABLE_OPENCL
+
+// The outputs stitched from the tiles must be those of the whole image.
+template <DeviceType D, typename T>
+void MaceRunTiled(const std::vector<int64_t> &tile_shape,
+                  const std::vector<int64_t> &image_shape,
+                  const std::vector<int64_t> &filter_shape) {
+  std::vector<std::string> input_names = {"input"};
+  std::vector<std::string> output_names = {"output"};
+  std::vector<T> data;
+  std::shared_ptr<NetDef> net_def = BuildConvNet<T>(
+      input_names, output_names, tile_shape, filter_shape, &data);
+  for (auto d : tile_shape) {
+    net_def->mutable_output_info(0)->add_dims(static_cast<int>(d));
+  }
+
+  MaceEngineConfig config(D);
+  config.SetTiledExecution(true);
+
+  std::unique_ptr<MaceEngine> engine;
+  ASSERT_EQ(CreateEngine(config, *net_def, input_names, output_names, data,
+                         &engine),
+            MaceStatus::MACE_SUCCESS);
+
+  std::map<std::string, mace::MaceTensor> inputs;
+  std::map<std::string, mace::MaceTensor> outputs;
+  GenerateInputs(input_names, image_shape, &inputs);
+  GenerateOutputs(output_names, image_shape, &outputs);
+  ASSERT_EQ(engine->Run(inputs, &outputs), MaceStatus::MACE_SUCCESS);
+
+  // the reference runs the whole image, with the same filter
+  std::shared_ptr<NetDef> image_net_def = BuildConvNet<T>(
+      input_names, output_names, image_shape, filter_shape, &data);
+  CheckOutputs<D, T>(*image_net_def, inputs, outputs, data);
+}
+
+// The head run on strips of rows must compute the outputs of the whole
+// image, the activation between its convs is larger than the caches.
+template <DeviceType D, typename T>
+void MaceRunLineBufferedHead(const std::vector<int64_t> &shape,
+                             const std::vector<int64_t> &filter_shape) {
+  std::vector<std::string> input_names = {"input"};
+  std::vector<std::string> output_names = {"output"};
+  std::vector<T> data;
+  std::shared_ptr<NetDef> net_def = BuildNet<T>(input_names, output_names,
+                                                shape, filter_shape, &data);
+  for (auto d : shape) {
+    net_def->mutable_output_info(0)->add_dims(static_cast<int>(d));
+  }
+  Conv3x3<T>(input_names[0], "filter", "conv0", shape, net_def.get());
+  Conv3x3<T>("conv0", "filter", output_names[0], shape, net_def.get());
+
+  MaceEngineConfig config(D);
+  config.SetCPULineBufferedHead(true);
+  std::unique_ptr<MaceEngine> engine;
+  ASSERT_EQ(CreateEngine(config, *net_def, input_names, output_names, data,
+                         &engine),
+            MaceStatus::MACE_SUCCESS);
+
+  std::map<std::string, mace::MaceTensor> inputs;
+  std::map<std::string, mace::MaceTensor> outputs;
+  GenerateInputs(input_names, shape, &inputs);
+  GenerateOutputs(output_names, shape, &outputs);
+  ASSERT_EQ(engine->Run(inputs, &outputs), MaceStatus::MACE_SUCCESS);
+
+  CheckOutputs<D, T>(*net_def, inputs, outputs, data);
+}
+
+// After the warm-up run of Init, the runs of the net must not allocate.
+template <DeviceType D, typename T>
+void MaceRunAllocationFree(const std::vector<int64_t> &shape,
+                           const std::vector<int64_t> &filter_shape) {
+  std::vector<std::string> input_names = {"input"};
+  std::vector<std::string> output_names = {"output"};
+  std::vector<T> data;
+  std::shared_ptr<NetDef> net_def = BuildConvNet<T>(
+      input_names, output_names, shape, filter_shape, &data);
+
+  MaceEngineConfig config(D);
+  ASSERT_EQ(config.SetAllocationFreeRuns(true, true),
+            MaceStatus::MACE_SUCCESS);
+
+  std::unique_ptr<MaceEngine> engine;
+  ASSERT_EQ(CreateEngine(config, *net_def, input_names, output_names, data,
+                         &engine),
+            MaceStatus::MACE_SUCCESS);
+
+  std::map<std::string, mace::MaceTensor> inputs;
+  std::map<std::string, mace::MaceTensor> outputs;
+  for (int i = 0; i < 3; ++i) {
+    GenerateInputs(input_names, shape, &inputs);
+    GenerateOutputs(output_names, shape, &outputs);
+    ASSERT_EQ(engine->Run(inputs, &outputs), MaceStatus::MACE_SUCCESS);
+  }
+
+  CheckOutputs<D, T>(*net_def, inputs, outputs, data);
+}
+
+// The runs after a warm-up, in the background or not, must be those of a
+// cold engine.
+template <DeviceType D, typename T>
+void MaceRunWarmUp(const std::vector<int64_t> &shape,
+                   const std::vector<int64_t> &filter_shape,
+                   bool background) {
+  std::vector<std::string> input_names = {"input"};
+  std::vector<std::string> output_names = {"output"};
+  std::vector<T> data;
+  std::shared_ptr<NetDef> net_def = BuildConvNet<T>(
+      input_names, output_names, shape, filter_shape, &data);
+
+  MaceEngineConfig config(D);
+  std::unique_ptr<MaceEngine> engine;
+  ASSERT_EQ(CreateEngine(config, *net_def, input_names, output_names, data,
+                         &engine),
+            MaceStatus::MACE_SUCCESS);
+
+  WarmUpOptions options;
+  options.background = background;
+  std::atomic<int> callback_count(0);
+  std::shared_ptr<RunFuture> future;
+  ASSERT_EQ(engine->WarmUp(options,
+                           [&callback_count](const MaceStatus &status) {
+                             EXPECT_EQ(status, MaceStatus::MACE_SUCCESS);
+                             ++callback_count;
+                           },
+                           &future),
+            MaceStatus::MACE_SUCCESS);
+  ASSERT_EQ(future->Wait(), MaceStatus::MACE_SUCCESS);
+  EXPECT_EQ(1, callback_count.load());
+
+  std::map<std::string, mace::MaceTensor> inputs;
+  std::map<std::string, mace::MaceTensor> outputs;
+  GenerateInputs(input_names, shape, &inputs);
+  GenerateOutputs(output_names, shape, &outputs);
+  ASSERT_EQ(engine->Run(inputs, &outputs), MaceStatus::MACE_SUCCESS);
+
+  CheckOutputs<D, T>(*net_def, inputs, outputs, data);
+}
+
+// The runs after a trim, in low memory mode or not, must be those of an
+// untrimmed engine.
+template <DeviceType D, typename T>
+void MaceRunTrim(const std::vector<int64_t> &shape,
+                 const std::vector<int64_t> &filter_shape,
+                 bool low_memory) {
+  std::vector<std::string> input_names = {"input"};
+  std::vector<std::string> output_names = {"output"};
+  std::vector<T> data;
+  std::shared_ptr<NetDef> net_def = BuildConvNet<T>(
+      input_names, output_names, shape, filter_shape, &data);
+
+  MaceEngineConfig config(D);
+  ASSERT_EQ(config.SetLowMemoryMode(low_memory), MaceStatus::MACE_SUCCESS);
+  std::unique_ptr<MaceEngine> engine;
+  ASSERT_EQ(CreateEngine(config, *net_def, input_names, output_names, data,
+                         &engine),
+            MaceStatus::MACE_SUCCESS);
+
+  std::map<std::string, mace::MaceTensor> inputs;
+  std::map<std::string, mace::MaceTensor> outputs;
+  for (TrimLevel level : {TRIM_ACTIVATIONS, TRIM_PROGRAMS}) {
+    GenerateInputs(input_names, shape, &inputs);
+    GenerateOutputs(output_names, shape, &outputs);
+    ASSERT_EQ(engine->Run(inputs, &outputs), MaceStatus::MACE_SUCCESS);
+    ASSERT_EQ(engine->Trim(level), MaceStatus::MACE_SUCCESS);
+
+    EngineMemoryStats stats;
+    ASSERT_EQ(engine->GetMemoryStats(&stats), MaceStatus::MACE_SUCCESS);
+    EXPECT_EQ(0, stats.scratch_bytes);
+    if (D == DeviceType::CPU) {
+      EXPECT_EQ(0, stats.activation_bytes);
+    }
+
+    GenerateInputs(input_names, shape, &inputs);
+    GenerateOutputs(output_names, shape, &outputs);
+    ASSERT_EQ(engine->Run(inputs, &outputs), MaceStatus::MACE_SUCCESS);
+    CheckOutputs<D, T>(*net_def, inputs, outputs, data);
+  }
+}
+
+template <DeviceType D, typename T>
+void MaceRunKernelReplay(const std::vector<int64_t> &shape,
+                         const std::vector<int64_t> &filter_shape) {
+  std::vector<std::string> input_names = {"input"};
+  std::vector<std::string> output_names = {"output"};
+  std::vector<T> data;
+  std::shared_ptr<NetDef> net_def = BuildConvNet<T>(
+      input_names, output_names, shape, filter_shape, &data);
+
+  MaceEngineConfig config(D);
+  ASSERT_EQ(config.SetGPUKernelReplay(true), MaceStatus::MACE_SUCCESS);
+  std::unique_ptr<MaceEngine> engine;
+  ASSERT_EQ(CreateEngine(config, *net_def, input_names, output_names, data,
+                         &engine),
+            MaceStatus::MACE_SUCCESS);
+
+  // the first runs are recorded, the next ones replayed, and a trim drops
+  // the recorded kernels
+  std::map<std::string, mace::MaceTensor> inputs;
+  std::map<std::string, mace::MaceTensor> outputs;
+  for (int i = 0; i < 6; ++i) {
+    GenerateInputs(input_names, shape, &inputs);
+    GenerateOutputs(output_names, shape, &outputs);
+    ASSERT_EQ(engine->Run(inputs, &outputs), MaceStatus::MACE_SUCCESS);
+    CheckOutputs<D, T>(*net_def, inputs, outputs, data);
+    if (i == 3) {
+      ASSERT_EQ(engine->Trim(), MaceStatus::MACE_SUCCESS);
+    }
+  }
+}
+
+// The incremental runs which skip the convolution of an unchanged image
+// must give the outputs of full runs, also after a run which exited early
+// or failed before the convolution.
+template <DeviceType D, typename T>
+void MaceRunIncremental(const std::vector<int64_t> &shape,
+                        const std::vector<int64_t> &filter_shape) {
+  std::vector<std::string> input_names = {"image", "query"};
+  std::vector<std::string> output_names = {"output"};
+  std::vector<T> data;
+  std::shared_ptr<NetDef> net_def = BuildNet<T>(input_names, output_names,
+                                                shape, filter_shape, &data);
+  // the ops of the query run before the convolution of the image, the
+  // unplanned output of the relu is allocated again for a larger query
+  ops::test::OpDefBuilder("EarlyExit", "EarlyExitTest")
+      .Input("query")
+      .Output("exit")
+      .AddFloatArg("threshold", 10.f)
+      .Finalize(net_def->add_op());
+  Relu<T>("query", "query_relu", D, net_def.get());
+  Conv3x3<T>("image", "filter", "feature", shape, net_def.get());
+  ops::test::OpDefBuilder("Eltwise", "EltwiseTest")
+      .Input("feature")
+      .Input("query_relu")
+      .Output(output_names[0])
+      .AddIntArg("type", static_cast<int>(ops::EltwiseType::SUM))
+      .AddIntArg("T", static_cast<int>(DataTypeToEnum<T>::value))
+      .Finalize(net_def->add_op());
+
+  std::unique_ptr<MaceEngine> full_engine;
+  ASSERT_EQ(CreateEngine(MaceEngineConfig(D), *net_def, input_names,
+                         output_names, data, &full_engine),
+            MaceStatus::MACE_SUCCESS);
+  MaceEngineConfig config(D);
+  ASSERT_EQ(config.SetIncrementalInputs({"image"}), MaceStatus::MACE_SUCCESS);
+  ASSERT_EQ(config.SetAllocationFreeRuns(true, true),
+            MaceStatus::MACE_SUCCESS);
+  std::unique_ptr<MaceEngine> engine;
+  ASSERT_EQ(CreateEngine(config, *net_def, input_names, output_names, data,
+                         &engine),
+            MaceStatus::MACE_SUCCESS);
+
+  std::map<std::string, mace::MaceTensor> images[2];
+  GenerateInputs({"image"}, shape, &images[0]);
+  GenerateInputs({"image"}, shape, &images[1]);
+  std::map<std::string, mace::MaceTensor> inputs;
+  std::map<std::string, mace::MaceTensor> outputs;
+  auto prepare = [&](int image, const std::vector<int64_t> &query_shape) {
+    inputs = images[image];
+    GenerateInputs({"query"}, query_shape, &inputs);
+    GenerateOutputs(output_names, query_shape, &outputs);
+  };
+  auto check = [&](int image) {
+    prepare(image, shape);
+    ASSERT_EQ(engine->Run(inputs, &outputs), MaceStatus::MACE_SUCCESS);
+    std::map<std::string, mace::MaceTensor> expected_outputs;
+    GenerateOutputs(output_names, shape, &expected_outputs);
+    ASSERT_EQ(full_engine->Run(inputs, &expected_outputs),
+              MaceStatus::MACE_SUCCESS);
+    ExpectOutputsNear(expected_outputs, outputs);
+  };
+
+  // the image changes, then only the query
+  check(0);
+  check(0);
+  check(1);
+  check(1);
+
+  // the convolution of a new image is skipped by an early exit, then the
+  // same image must run it
+  prepare(0, shape);
+  const int64_t size = std::accumulate(shape.begin(), shape.end(), 1,
+                                       std::multiplies<int64_t>());
+  std::fill_n(inputs["query"].data().get(), size, 20.f);
+  ASSERT_EQ(engine->Run(inputs, &outputs), MaceStatus::MACE_SUCCESS);
+  EXPECT_FALSE(outputs[output_names[0]].valid());
+  check(0);
+
+  // the convolution of a new image is skipped by a failed allocation for a
+  // larger query, then the same image must run it
+  std::vector<int64_t> large_shape = shape;
+  large_shape[0] *= 2;
+  prepare(1, large_shape);
+  EXPECT_NE(engine->Run(inputs, &outputs), MaceStatus::MACE_SUCCESS);
+  check(1);
+}
+
+// The runs of several threads at the same time must give the outputs of
+// serial runs.
+template <DeviceType D, typename T>
+void MaceRunConcurrent(const int thread_count,
+                       const int run_count,
+                       const std::vector<int64_t> &shape,
+                       const std::vector<int64_t> &filter_shape) {
+  std::vector<std::string> input_names = {"input"};
+  std::vector<std::string> output_names = {"output"};
+  std::vector<T> data;
+  std::shared_ptr<NetDef> net_def = BuildNet<T>(input_names, output_names,
+                                                shape, filter_shape, &data);
+  Conv3x3<T>(input_names[0], "filter", "conv", shape, net_def.get());
+  Relu<T>("conv", output_names[0], D, net_def.get());
+
+  MaceEngineConfig config(D);
+  ASSERT_EQ(config.SetMaxConcurrentRuns(thread_count),
+            MaceStatus::MACE_SUCCESS);
+  std::unique_ptr<MaceEngine> engine;
+  ASSERT_EQ(CreateEngine(config, *net_def, input_names, output_names, data,
+                         &engine),
+            MaceStatus::MACE_SUCCESS);
+
+  const int total_runs = thread_count * run_count;
+  std::vector<std::map<std::string, mace::MaceTensor>> inputs(total_runs);
+  std::vector<std::map<std::string, mace::MaceTensor>> outputs(total_runs);
+  std::vector<MaceStatus> statuses(total_runs);
+  for (int i = 0; i < total_runs; ++i) {
+    GenerateInputs(input_names, shape, &inputs[i]);
+    GenerateOutputs(output_names, shape, &outputs[i]);
+  }
+  // the threads start together to overlap their runs
+  std::atomic<bool> started(false);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < thread_count; ++t) {
+    threads.emplace_back([&, t] {
+      while (!started.load()) {
+        std::this_thread::yield();
+      }
+      for (int i = t * run_count; i < (t + 1) * run_count; ++i) {
+        statuses[i] = engine->Run(inputs[i], &outputs[i]);
+      }
+    });
+  }
+  started = true;
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  for (int i = 0; i < total_runs; ++i) {
+    EXPECT_EQ(statuses[i], MaceStatus::MACE_SUCCESS);
+    std::map<std::string, mace::MaceTensor> expected_outputs;
+    GenerateOutputs(output_names, shape, &expected_outputs);
+    ASSERT_EQ(engine->Run(inputs[i], &expected_outputs),
+              MaceStatus::MACE_SUCCESS);
+    ExpectOutputsNear(expected_outputs, outputs[i]);
+  }
+}
+
+// The runs switching between more input shapes than the plans kept must
+// give the outputs of engines initialized for each shape.
+template <DeviceType D, typename T>
+void MaceRunShapePlans(const std::vector<std::vector<int64_t>> &shapes,
+                       const std::vector<int64_t> &filter_shape) {
+  std::vector<std::string> input_names = {"input"};
+  std::vector<std::string> output_names = {"output"};
+  // the nets of the shapes share the filter
+  std::vector<T> data;
+  std::vector<std::shared_ptr<NetDef>> net_defs;
+  for (auto &shape : shapes) {
+    std::shared_ptr<NetDef> net_def = BuildNet<T>(input_names, output_names,
+                                                  shape, filter_shape, &data);
+    Relu<T>(input_names[0], "relu", D, net_def.get());
+    Conv3x3<T>("relu", "filter", output_names[0], shape, net_def.get());
+    net_defs.push_back(net_def);
+  }
+
+  MaceEngineConfig config(D);
+  ASSERT_EQ(config.SetShapePlanCacheSize(2), MaceStatus::MACE_SUCCESS);
+  std::unique_ptr<MaceEngine> engine;
+  ASSERT_EQ(CreateEngine(config, *net_defs[0], input_names, output_names,
+                         data, &engine),
+            MaceStatus::MACE_SUCCESS);
+  std::vector<std::unique_ptr<MaceEngine>> shape_engines(net_defs.size());
+  for (size_t i = 0; i < net_defs.size(); ++i) {
+    ASSERT_EQ(CreateEngine(MaceEngineConfig(D), *net_defs[i], input_names,
+                           output_names, data, &shape_engines[i]),
+              MaceStatus::MACE_SUCCESS);
+  }
+
+  // the shapes come back while their plans are kept and after they were
+  // dropped
+  std::vector<size_t> order;
+  for (size_t i = 0; i < shapes.size(); ++i) {
+    order.push_back(i);
+    order.push_back((i + 1) % shapes.size());
+    order.push_back(i);
+  }
+  for (size_t idx : order) {
+    std::map<std::string, mace::MaceTensor> inputs;
+    std::map<std::string, mace::MaceTensor> outputs;
+    GenerateInputs(input_names, shapes[idx], &inputs);
+    GenerateOutputs(output_names, shapes[idx], &outputs);
+    ASSERT_EQ(engine->Run(inputs, &outputs), MaceStatus::MACE_SUCCESS);
+    std::map<std::string, mace::MaceTensor> expected_outputs;
+    GenerateOutputs(output_names, shapes[idx], &expected_outputs);
+    ASSERT_EQ(shape_engines[idx]->Run(inputs, &expected_outputs),
+              MaceStatus::MACE_SUCCESS);
+    ExpectOutputsNear(expected_outputs, outputs);
+  }
+}
+
+// The branches of a net run at the same time must give the outputs of a
+// serial net.
+template <DeviceType D, typename T>
+void MaceRunBranches(const int num_workers,
+                     const std::vector<int64_t> &shape,
+                     const std::vector<int64_t> &filter_shape) {
+  std::vector<std::string> input_names = {"input"};
+  std::vector<std::string> output_names = {"output"};
+  std::vector<T> data;
+  std::shared_ptr<NetDef> net_def = BuildNet<T>(input_names, output_names,
+                                                shape, filter_shape, &data);
+  // three branches of the input joined by sums
+  Conv3x3<T>(input_names[0], "filter", "branch0", shape, net_def.get());
+  Relu<T>(input_names[0], "relu", D, net_def.get());
+  Conv3x3<T>("relu", "filter", "branch1", shape, net_def.get());
+  Conv3x3<T>("branch0", "filter", "branch2", shape, net_def.get());
+  const char *sums[][3] = {{"branch0", "branch1", "sum0"},
+                           {"sum0", "branch2", "sum1"}};
+  for (auto &sum : sums) {
+    ops::test::OpDefBuilder("Eltwise", sum[2])
+        .Input(sum[0])
+        .Input(sum[1])
+        .Output(sum[2])
+        .AddIntArg("type", static_cast<int>(ops::EltwiseType::SUM))
+        .AddIntArg("T", static_cast<int>(DataTypeToEnum<T>::value))
+        .OutputShape(shape)
+        .Finalize(net_def->add_op());
+  }
+  Conv3x3<T>("sum1", "filter", output_names[0], shape, net_def.get());
+
+  std::unique_ptr<MaceEngine> serial_engine;
+  ASSERT_EQ(CreateEngine(MaceEngineConfig(D), *net_def, input_names,
+                         output_names, data, &serial_engine),
+            MaceStatus::MACE_SUCCESS);
+  MaceEngineConfig config(D);
+  ASSERT_EQ(config.SetInterOpParallelism(num_workers),
+            MaceStatus::MACE_SUCCESS);
+  std::unique_ptr<MaceEngine> engine;
+  ASSERT_EQ(CreateEngine(config, *net_def, input_names, output_names, data,
+                         &engine),
+            MaceStatus::MACE_SUCCESS);
+
+  for (int i = 0; i < 5; ++i) {
+    std::map<std::string, mace::MaceTensor> inputs;
+    std::map<std::string, mace::MaceTensor> outputs;
+    GenerateInputs(input_names, shape, &inputs);
+    GenerateOutputs(output_names, shape, &outputs);
+    ASSERT_EQ(engine->Run(inputs, &outputs), MaceStatus::MACE_SUCCESS);
+    std::map<std::string, mace::MaceTensor> expected_outputs;
+    GenerateOutputs(output_names, shape, &expected_outputs);
+    ASSERT_EQ(serial_engine->Run(inputs, &expected_outputs),
+              MaceStatus::MACE_SUCCESS);
+    ExpectOutputsNear(expected_outputs, outputs);
+  }
+}
+
+// The two stages of a pipeline must give the outputs of one engine running
+// the whole net.
+template <DeviceType D, typename T>
+void MaceRunPipeline(const int frame_count,
+                     const std::vector<int64_t> &shape,
+                     const std::vector<int64_t> &filter_shape) {
+  std::vector<std::string> input_names = {"input"};
+  std::vector<std::string> output_names = {"output"};
+  std::vector<T> data;
+  std::shared_ptr<NetDef> net_def = BuildNet<T>(input_names, output_names,
+                                                shape, filter_shape, &data);
+  Conv3x3<T>(input_names[0], "filter", "conv0", shape, net_def.get());
+  Relu<T>("conv0", "relu", D, net_def.get());
+  Conv3x3<T>("relu", "filter", "conv1", shape, net_def.get());
+  Conv3x3<T>("conv1", "filter", output_names[0], shape, net_def.get());
+
+  MaceEngineConfig config(D);
+  std::unique_ptr<MaceEngine> engine;
+  ASSERT_EQ(CreateEngine(config, *net_def, input_names, output_names, data,
+                         &engine),
+            MaceStatus::MACE_SUCCESS);
+  RunMetadata costs;
+  {
+    std::map<std::string, mace::MaceTensor> inputs;
+    std::map<std::string, mace::MaceTensor> outputs;
+    GenerateInputs(input_names, shape, &inputs);
+    GenerateOutputs(output_names, shape, &outputs);
+    ASSERT_EQ(engine->Run(inputs, &outputs, &costs),
+              MaceStatus::MACE_SUCCESS);
+  }
+
+  MacePipeline pipeline(config, config);
+  ASSERT_EQ(pipeline.Init(net_def.get(), input_names, output_names,
+                          reinterpret_cast<unsigned char *>(data.data()),
+                          costs, costs),
+            MaceStatus::MACE_SUCCESS);
+
+  // more frames than the pipeline holds, so runs wait for free slots
+  std::vector<std::map<std::string, mace::MaceTensor>> inputs(frame_count);
+  std::vector<std::map<std::string, mace::MaceTensor>> outputs(frame_count);
+  std::vector<std::shared_ptr<RunFuture>> futures(frame_count);
+  for (int i = 0; i < frame_count; ++i) {
+    GenerateInputs(input_names, shape, &inputs[i]);
+    GenerateOutputs(output_names, shape, &outputs[i]);
+    ASSERT_EQ(pipeline.Run(inputs[i], &outputs[i], nullptr, &futures[i]),
+              MaceStatus::MACE_SUCCESS);
+  }
+  for (int i = 0; i < frame_count; ++i) {
+    ASSERT_EQ(futures[i]->Wait(), MaceStatus::MACE_SUCCESS);
+    std::map<std::string, mace::MaceTensor> expected_outputs;
+    GenerateOutputs(output_names, shape, &expected_outputs);
+    ASSERT_EQ(engine->Run(inputs[i], &expected_outputs),
+              MaceStatus::MACE_SUCCESS);
+    ExpectOutputsNear(expected_outputs, outputs[i]);
+  }
+}
+
+// The runs after a next model is loaded must give the outputs of an engine
+// of the next model, and those of the current one if the load failed.
+template <DeviceType D, typename T>
+void MaceRunNextModel(const std::vector<int64_t> &shape,
+                      const std::vector<int64_t> &filter_shape) {
+  std::vector<std::string> input_names = {"input"};
+  std::vector<std::string> output_names = {"output"};
+  std::vector<T> data;
+  std::shared_ptr<NetDef> net_def = BuildConvNet<T>(
+      input_names, output_names, shape, filter_shape, &data);
+  // of other ops and weights
+  std::vector<T> next_data;
+  std::shared_ptr<NetDef> next_net_def = BuildNet<T>(
+      input_names, output_names, shape, filter_shape, &next_data);
+  Conv3x3<T>(input_names[0], "filter", "conv", shape, next_net_def.get());
+  Relu<T>("conv", output_names[0], D, next_net_def.get());
+  // its weights do not fit the shape of the filter
+  std::shared_ptr<NetDef> bad_net_def = std::make_shared<NetDef>(*net_def);
+  bad_net_def->mutable_tensors(0)->set_data_size(data.size() - 1);
+
+  MaceEngineConfig config(D);
+  std::unique_ptr<MaceEngine> engine;
+  ASSERT_EQ(CreateEngine(config, *net_def, input_names, output_names, data,
+                         &engine),
+            MaceStatus::MACE_SUCCESS);
+  std::unique_ptr<MaceEngine> next_engine;
+  ASSERT_EQ(CreateEngine(config, *next_net_def, input_names, output_names,
+                         next_data, &next_engine),
+            MaceStatus::MACE_SUCCESS);
+
+  std::map<std::string, mace::MaceTensor> inputs;
+  std::map<std::string, mace::MaceTensor> outputs;
+  std::map<std::string, mace::MaceTensor> expected_outputs;
+  GenerateInputs(input_names, shape, &inputs);
+  GenerateOutputs(output_names, shape, &outputs);
+  GenerateOutputs(output_names, shape, &expected_outputs);
+  ASSERT_EQ(engine->Run(inputs, &outputs), MaceStatus::MACE_SUCCESS);
+  CheckOutputs<D, T>(*net_def, inputs, outputs, data);
+
+  std::shared_ptr<RunFuture> future;
+  ASSERT_EQ(engine->LoadNextModel(
+                next_net_def.get(), input_names, output_names,
+                reinterpret_cast<const unsigned char *>(next_data.data()),
+                &future),
+            MaceStatus::MACE_SUCCESS);
+  ASSERT_EQ(future->Wait(), MaceStatus::MACE_SUCCESS);
+  ASSERT_EQ(engine->Run(inputs, &outputs), MaceStatus::MACE_SUCCESS);
+  ASSERT_EQ(next_engine->Run(inputs, &expected_outputs),
+            MaceStatus::MACE_SUCCESS);
+  ExpectOutputsNear(expected_outputs, outputs);
+
+  ASSERT_EQ(engine->LoadNextModel(
+                bad_net_def.get(), input_names, output_names,
+                reinterpret_cast<const unsigned char *>(data.data()),
+                &future),
+            MaceStatus::MACE_SUCCESS);
+  EXPECT_NE(future->Wait(), MaceStatus::MACE_SUCCESS);
+  GenerateInputs(input_names, shape, &inputs);
+  ASSERT_EQ(engine->Run(inputs, &outputs), MaceStatus::MACE_SUCCESS);
+  ASSERT_EQ(next_engine->Run(inputs, &expected_outputs),
+            MaceStatus::MACE_SUCCESS);
+  ExpectOutputsNear(expected_outputs, outputs);
+}
+
+// An engine restored from the snapshot of another must give its outputs,
+// and a snapshot of other input shapes must be rejected.
+template <DeviceType D, typename T>
+void MaceRunSnapshot(const std::vector<int64_t> &shape,
+                     const std::vector<int64_t> &other_shape,
+                     const std::vector<int64_t> &filter_shape) {
+  std::vector<std::string> input_names = {"input"};
+  std::vector<std::string> output_names = {"output"};
+  std::vector<T> data;
+  std::shared_ptr<NetDef> net_def = BuildConvNet<T>(
+      input_names, output_names, shape, filter_shape, &data);
+  std::shared_ptr<NetDef> other_net_def = BuildConvNet<T>(
+      input_names, output_names, other_shape, filter_shape, &data);
+  const unsigned char *model_data =
+      reinterpret_cast<const unsigned char *>(data.data());
+  const size_t model_data_size = data.size() * sizeof(T);
+  const char *storage_path = getenv("MACE_INTERNAL_STORAGE_PATH");
+  const std::string snapshot_file =
+      std::string(storage_path == nullptr ? "." : storage_path) +
+      "/mace_api_test_snapshot.bin";
+
+  MaceEngineConfig config(D);
+  std::unique_ptr<MaceEngine> engine;
+  ASSERT_EQ(CreateEngine(config, *net_def, input_names, output_names, data,
+                         &engine),
+            MaceStatus::MACE_SUCCESS);
+  ASSERT_EQ(engine->SaveSnapshot(snapshot_file), MaceStatus::MACE_SUCCESS);
+
+  std::map<std::string, mace::MaceTensor> inputs;
+  std::map<std::string, mace::MaceTensor> outputs;
+  std::map<std::string, mace::MaceTensor> restored_outputs;
+  GenerateInputs(input_names, shape, &inputs);
+  GenerateOutputs(output_names, shape, &outputs);
+  GenerateOutputs(output_names, shape, &restored_outputs);
+  ASSERT_EQ(engine->Run(inputs, &outputs), MaceStatus::MACE_SUCCESS);
+
+  std::string model_graph;
+  ASSERT_TRUE(net_def->SerializeToString(&model_graph));
+  std::shared_ptr<MaceEngine> restored;
+  ASSERT_EQ(CreateMaceEngineFromSnapshot(
+                snapshot_file,
+                reinterpret_cast<const unsigned char *>(model_graph.data()),
+                model_graph.size(), model_data, model_data_size,
+                input_names, output_names, config, &restored),
+            MaceStatus::MACE_SUCCESS);
+  ASSERT_EQ(restored->Run(inputs, &restored_outputs),
+            MaceStatus::MACE_SUCCESS);
+  ExpectOutputsNear(outputs, restored_outputs, 0);
+
+  std::string other_model_graph;
+  ASSERT_TRUE(other_net_def->SerializeToString(&other_model_graph));
+  std::shared_ptr<MaceEngine> other;
+  EXPECT_EQ(CreateMaceEngineFromSnapshot(
+                snapshot_file,
+                reinterpret_cast<const unsigned char *>(
+                    other_model_graph.data()),
+                other_model_graph.size(), model_data, model_data_size,
+                input_names, output_names, config, &other),
+            MaceStatus::MACE_INVALID_ARGS);
+  std::remove(snapshot_file.c_str());
+}
+
 }  // namespace
 
 TEST_F(MaceAPITest, SingleInputOutput) {
@@ -122,6 +1159,226 @@ TEST_F(MaceAPITest, MultipleInputOutput) {
                      {16, 16, 3, 3});
 }
 
+TEST_F(MaceAPITest, RunBatch) {
+  MaceRunBatch<CPU, float>(3,
+                           {2, 16, 16, 16},
+                           {1, 16, 16, 16},
+                           {16, 16, 3, 3});
+  MaceRunBatch<GPU, float>(3,
+                           {2, 16, 16, 16},
+                           {1, 16, 16, 16},
+                           {16, 16, 3, 3});
+}
+
+TEST_F(MaceAPITest, RunAsync) {
+  MaceRunAsync<CPU, float>(3, {1, 16, 16, 16}, {16, 16, 3, 3});
+  MaceRunAsync<GPU, float>(3, {1, 16, 16, 16}, {16, 16, 3, 3});
+  MaceRunAsync<GPU, float>(7, {1, 16, 16, 16}, {16, 16, 3, 3}, 4);
+}
+
+TEST_F(MaceAPITest, ZeroCopy) {
+  MaceRunZeroCopy<CPU, float>({1, 16, 16, 16}, {16, 16, 3, 3});
+}
+
+TEST_F(MaceAPITest, InputPreprocess) {
+  MaceRunInputPreprocess<CPU, float>({1, 16, 16, 3}, {1, 16, 16, 4},
+                                     {3, 3, 3, 3});
+  MaceRunInputPreprocess<CPU, float>({1, 16, 16, 3}, {1, 30, 25, 4},
+                                     {3, 3, 3, 3});
+  MaceRunInputPreprocess<GPU, float>({1, 16, 16, 3}, {1, 30, 25, 4},
+                                     {3, 3, 3, 3});
+}
+
+TEST_F(MaceAPITest, HalfInputOutput) {
+  MaceRunHalfInputOutput<CPU, float>({1, 16, 16, 3}, {3, 3, 3, 3});
+  MaceRunHalfInputOutput<GPU, float>({1, 16, 16, 3}, {3, 3, 3, 3});
+}
+
+TEST_F(MaceAPITest, TiledExecution) {
+  MaceRunTiled<CPU, float>({1, 16, 16, 16}, {1, 40, 36, 16}, {16, 16, 3, 3});
+  MaceRunTiled<GPU, float>({1, 16, 16, 16}, {1, 40, 36, 16}, {16, 16, 3, 3});
+}
+
+TEST_F(MaceAPITest, LineBufferedHead) {
+  MaceRunLineBufferedHead<CPU, float>({1, 256, 128, 16}, {16, 16, 3, 3});
+}
+
+TEST_F(MaceAPITest, WarmUp) {
+  MaceRunWarmUp<CPU, float>({1, 16, 16, 16}, {16, 16, 3, 3}, false);
+  MaceRunWarmUp<CPU, float>({1, 16, 16, 16}, {16, 16, 3, 3}, true);
+  MaceRunWarmUp<GPU, float>({1, 16, 16, 16}, {16, 16, 3, 3}, true);
+}
+
+TEST_F(MaceAPITest, Trim) {
+  MaceRunTrim<CPU, float>({1, 16, 16, 16}, {16, 16, 3, 3}, false);
+  MaceRunTrim<CPU, float>({1, 16, 16, 16}, {16, 16, 3, 3}, true);
+  MaceRunTrim<GPU, float>({1, 16, 16, 16}, {16, 16, 3, 3}, false);
+}
+
+TEST_F(MaceAPITest, IncrementalInputs) {
+  MaceRunIncremental<CPU, float>({1, 16, 16, 16}, {16, 16, 3, 3});
+}
+
+TEST_F(MaceAPITest, ConcurrentRuns) {
+  MaceRunConcurrent<CPU, float>(4, 5, {1, 16, 16, 16}, {16, 16, 3, 3});
+  MaceRunConcurrent<GPU, float>(2, 3, {1, 16, 16, 16}, {16, 16, 3, 3});
+}
+
+TEST_F(MaceAPITest, ShapePlanCache) {
+  MaceRunShapePlans<CPU, float>(
+      {{1, 16, 16, 16}, {1, 8, 24, 16}, {1, 20, 12, 16}}, {16, 16, 3, 3});
+}
+
+TEST_F(MaceAPITest, InterOpParallelism) {
+  MaceRunBranches<CPU, float>(2, {1, 16, 16, 16}, {16, 16, 3, 3});
+  MaceRunBranches<CPU, float>(3, {1, 16, 16, 16}, {16, 16, 3, 3});
+  MaceRunBranches<GPU, float>(2, {1, 16, 16, 16}, {16, 16, 3, 3});
+}
+
+TEST_F(MaceAPITest, Pipeline) {
+  MaceRunPipeline<CPU, float>(5, {1, 16, 16, 16}, {16, 16, 3, 3});
+  MaceRunPipeline<GPU, float>(5, {1, 16, 16, 16}, {16, 16, 3, 3});
+}
+
+TEST_F(MaceAPITest, NextModel) {
+  MaceRunNextModel<CPU, float>({1, 16, 16, 16}, {16, 16, 3, 3});
+  MaceRunNextModel<GPU, float>({1, 16, 16, 16}, {16, 16, 3, 3});
+}
+
+TEST_F(MaceAPITest, Snapshot) {
+  MaceRunSnapshot<CPU, float>({1, 16, 16, 16}, {1, 8, 8, 16}, {16, 16, 3, 3});
+  MaceRunSnapshot<GPU, float>({1, 16, 16, 16}, {1, 8, 8, 16}, {16, 16, 3, 3});
+}
+
+TEST_F(MaceAPITest, GPUKernelReplay) {
+  MaceRunKernelReplay<GPU, float>({1, 16, 16, 16}, {16, 16, 3, 3});
+  MaceRunKernelReplay<GPU, half>({1, 16, 16, 16}, {16, 16, 3, 3});
+}
+
+TEST_F(MaceAPITest, SelectDevice) {
+  std::vector<std::string> input_names = {"input"};
+  std::vector<std::string> output_names = {"output"};
+  const std::vector<int64_t> shape = {1, 16, 16, 16};
+  const std::vector<int64_t> filter_shape = {16, 16, 3, 3};
+  std::shared_ptr<NetDef> net_def(new NetDef());
+  std::vector<float> data;
+  ops::test::GenerateRandomRealTypeData<float>(filter_shape, &data);
+  AddTensor<float>("filter", filter_shape, 0, data.size(), net_def.get());
+  InputInfo *input_info = net_def->add_input_info();
+  input_info->set_name(input_names[0]);
+  for (auto d : shape) {
+    input_info->add_dims(static_cast<int>(d));
+  }
+  net_def->add_output_info()->set_name(output_names[0]);
+  Conv3x3<float>(input_names[0], "filter", output_names[0], shape,
+                 net_def.get());
+
+  const char *storage_path = getenv("MACE_INTERNAL_STORAGE_PATH");
+  for (int i = 0; i < 2; ++i) {
+    DevicePlacement placement;
+    ASSERT_EQ(SelectDevice({CPU, GPU}, net_def.get(), input_names,
+                           output_names,
+                           reinterpret_cast<unsigned char *>(data.data()),
+                           data.size() * sizeof(float),
+                           storage_path == nullptr ? "" : storage_path,
+                           &placement),
+              MaceStatus::MACE_SUCCESS);
+    ASSERT_EQ(2, placement.latencies.size());
+    // the model runs at least on the CPU
+    EXPECT_LE(0, placement.latencies[0].exec_time);
+    EXPECT_EQ(i == 1 && storage_path != nullptr, placement.cached);
+  }
+}
+
+TEST_F(MaceAPITest, Calibrate) {
+  // output = relu(input) * input, of known ranges over the samples
+  std::vector<std::string> input_names = {"input"};
+  std::vector<std::string> output_names = {"output"};
+  const std::vector<int64_t> shape = {1, 4, 4, 2};
+  NetDef net_def;
+  InputInfo *input_info = net_def.add_input_info();
+  input_info->set_name(input_names[0]);
+  for (auto d : shape) {
+    input_info->add_dims(static_cast<int>(d));
+  }
+  net_def.add_output_info()->set_name(output_names[0]);
+  Relu<float>(input_names[0], "relu", CPU, &net_def);
+  ops::test::OpDefBuilder("Eltwise", "EltwiseTest")
+      .Input("relu")
+      .Input(input_names[0])
+      .Output(output_names[0])
+      .AddIntArg("type", static_cast<int>(ops::EltwiseType::PROD))
+      .OutputShape(shape)
+      .Finalize(net_def.add_op());
+  std::string model_graph;
+  ASSERT_TRUE(net_def.SerializeToString(&model_graph));
+
+  MaceEngineConfig config(CPU);
+  MaceEngine engine(config);
+  ASSERT_EQ(engine.Init(&net_def, input_names, output_names, nullptr),
+            MaceStatus::MACE_SUCCESS);
+
+  // the values of the samples are in [-2, 1] and [-1, 3]
+  const float ranges[][2] = {{-2.f, 1.f}, {-1.f, 3.f}};
+  std::vector<std::map<std::string, mace::MaceTensor>> dataset(2);
+  for (int i = 0; i < 2; ++i) {
+    GenerateInputs(input_names, shape, &dataset[i]);
+    float *data = dataset[i][input_names[0]].data().get();
+    const int64_t size = std::accumulate(shape.begin(), shape.end(), 1,
+                                         std::multiplies<int64_t>());
+    for (int64_t j = 0; j < size; ++j) {
+      data[j] = ranges[i][0] + (ranges[i][1] - ranges[i][0]) * j / (size - 1);
+    }
+  }
+
+  const unsigned char *model_graph_proto =
+      reinterpret_cast<const unsigned char *>(model_graph.data());
+  std::vector<unsigned char> calibrated;
+  ASSERT_EQ(engine.Calibrate(dataset, CALIBRATION_MIN_MAX, 0,
+                             model_graph_proto, model_graph.size(),
+                             &calibrated),
+            MaceStatus::MACE_SUCCESS);
+  NetDef calibrated_def;
+  ASSERT_TRUE(calibrated_def.ParseFromArray(
+      calibrated.data(), static_cast<int>(calibrated.size())));
+  ASSERT_EQ(2, calibrated_def.op_size());
+  // the uint8 ranges of [0, 3] and [0, 9], which start at the zero
+  const float max_vals[] = {3.f, 9.f};
+  for (int i = 0; i < 2; ++i) {
+    const OperatorDef &op = calibrated_def.op(i);
+    ASSERT_EQ(1, op.quantize_info_size()) << op.name();
+    const QuantizeActivationInfo &info = op.quantize_info(0);
+    EXPECT_EQ(0, info.zero_point()) << op.name();
+    EXPECT_FLOAT_EQ(max_vals[i] / 255, info.scale()) << op.name();
+    EXPECT_FLOAT_EQ(0.f, info.minval()) << op.name();
+    EXPECT_FLOAT_EQ(max_vals[i], info.maxval()) << op.name();
+  }
+
+  // no samples, nothing is calibrated
+  calibrated.clear();
+  EXPECT_EQ(engine.Calibrate({}, CALIBRATION_MIN_MAX, 0, model_graph_proto,
+                             model_graph.size(), &calibrated),
+            MaceStatus::MACE_INVALID_ARGS);
+  EXPECT_TRUE(calibrated.empty());
+  EXPECT_EQ(engine.Calibrate(dataset, CALIBRATION_PERCENTILE, 50,
+                             model_graph_proto, model_graph.size(),
+                             &calibrated),
+            MaceStatus::MACE_INVALID_ARGS);
+  EXPECT_TRUE(calibrated.empty());
+}
+
+TEST_F(MaceAPITest, AllocationFreeRuns) {
+  MaceRunAllocationFree<CPU, float>({1, 16, 16, 16}, {16, 16, 3, 3});
+  MaceRunAllocationFree<GPU, float>({1, 16, 16, 16}, {16, 16, 3, 3});
+}
+
+#ifdef MACE_ENABLE_OPENCL
+TEST_F(MaceAPITest, OpenCLBuffer) {
+  MaceRunOpenCLBuffer<float>({1, 16, 16, 16}, {16, 16, 3, 3});
+  MaceRunOpenCLBuffer<half>({1, 16, 16, 16}, {16, 16, 3, 3});
+}
+#endif  // MACE_ENABLE_OPENCL
+
 TEST_F(MaceAPITest, VariableInputShape) {
   // TODO(liyin): there is a bug of cpu convolution
 //  MaceRun<CPU, float>(1,
@@ -120,6 +120,62 @@ void AddTensor(const std::string &name,
   tensor_ptr->set_data_type(DataTypeToEnum<T>::value);
 }
 
+// The net of the inputs and outputs, the inputs of shape, with "filter" of
+// filter_shape as its weight, whose data is made random unless given. The
+// ops are left to the caller.
+template <typename T>
+std::shared_ptr<NetDef> BuildNet(const std::vector<std::string> &input_names,
+                                 const std::vector<std::string> &output_names,
+                                 const std::vector<int64_t> &shape,
+                                 const std::vector<int64_t> &filter_shape,
+                                 std::vector<T> *data) {
+  std::shared_ptr<NetDef> net_def(new NetDef());
+  if (data->empty()) {
+    ops::test::GenerateRandomRealTypeData<T>(filter_shape, data);
+  }
+  AddTensor<T>("filter", filter_shape, 0, data->size(), net_def.get());
+  for (auto &input_name : input_names) {
+    InputInfo *input_info = net_def->add_input_info();
+    input_info->set_name(input_name);
+    for (auto d : shape) {
+      input_info->add_dims(static_cast<int>(d));
+    }
+  }
+  for (auto &output_name : output_names) {
+    net_def->add_output_info()->set_name(output_name);
+  }
+  return net_def;
+}
+
+// BuildNet with a 3x3 conv of each input to its output.
+template <typename T>
+std::shared_ptr<NetDef> BuildConvNet(
+    const std::vector<std::string> &input_names,
+    const std::vector<std::string> &output_names,
+    const std::vector<int64_t> &shape,
+    const std::vector<int64_t> &filter_shape,
+    std::vector<T> *data) {
+  std::shared_ptr<NetDef> net_def =
+      BuildNet<T>(input_names, output_names, shape, filter_shape, data);
+  for (size_t i = 0; i < output_names.size(); ++i) {
+    Conv3x3<T>(input_names[i], "filter", output_names[i], shape,
+               net_def.get());
+  }
+  return net_def;
+}
+
+template <typename T>
+MaceStatus CreateEngine(const MaceEngineConfig &config,
+                        const NetDef &net_def,
+                        const std::vector<std::string> &input_names,
+                        const std::vector<std::string> &output_names,
+                        const std::vector<T> &data,
+                        std::unique_ptr<MaceEngine> *engine) {
+  engine->reset(new MaceEngine(config));
+  return (*engine)->Init(&net_def, input_names, output_names,
+                         reinterpret_cast<const unsigned char *>(data.data()));
+}
+
 template <DeviceType D, typename T>
 void CheckOutputs(const NetDef &net_def,
                   const std::map<std::string, mace::MaceTensor> &inputs,
@@ -23,14 +23,37 @@
  *          --output_file=mace.out  \
  *          --model_data_file=model_data.data \
  *          --device=GPU
+ *
+ * With --input_dir, it runs every input file of the directory after the
+ * rounds of --input_file, with --num_engines engines in parallel, and
+ * reports the throughput:
+ * mace_run ... --input_dir=inputs --output_dir=outputs --num_engines=2
  */
+#include <dirent.h>
+#include <fcntl.h>
 #include <malloc.h>
 #include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>  // NOLINT(build/c++11)
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <deque>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>  // NOLINT(build/c++11)
 #include <numeric>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
 
 #include "gflags/gflags.h"
 #include "mace/public/mace.h"
@@ -174,13 +197,23 @@ DEFINE_string(input_file,
 DEFINE_string(output_file,
               "",
               "output file name | output file prefix for multiple outputs");
-// TODO(liyin): support batch validation
 DEFINE_string(input_dir,
               "",
-              "input directory name");
+              "input directory name, whose files named after the first input"
+              " node are run with the files of the same suffix of the other"
+              " input nodes, empty to disable");
 DEFINE_string(output_dir,
               "output",
-              "output directory name");
+              "output directory name of the runs of input_dir, empty to not"
+              " write the outputs");
+DEFINE_int32(num_engines, 1,
+             "engines running the files of input_dir in parallel, each on"
+             " its own thread with omp_num_threads threads");
+DEFINE_int32(batch_files, 1,
+             "files of input_dir stacked on the first dim of each run, the"
+             " input and output shapes are those of the whole batch");
+DEFINE_int32(prefetch_runs, 2,
+             "runs of input files read ahead for each engine");
 DEFINE_string(opencl_binary_file,
               "",
               "compiled opencl binary file path");
@@ -201,7 +234,348 @@ DEFINE_int32(gpu_perf_hint, 3, "0:DEFAULT/1:LOW/2:NORMAL/3:HIGH");
 DEFINE_int32(gpu_priority_hint, 3, "0:DEFAULT/1:LOW/2:NORMAL/3:HIGH");
 DEFINE_int32(omp_num_threads, -1, "num of openmp threads");
 DEFINE_int32(cpu_affinity_policy, 1,
-             "0:AFFINITY_NONE/1:AFFINITY_BIG_ONLY/2:AFFINITY_LITTLE_ONLY");
+             "0:AFFINITY_NONE/1:AFFINITY_BIG_ONLY/2:AFFINITY_LITTLE_ONLY"
+             "/5:AFFINITY_ADAPTIVE");
+DEFINE_string(trace_file, "",
+              "chrome trace file of the engine, empty to disable");
+DEFINE_string(dump_memory_plan_file, "",
+              "write the model graph with the memory plan of the engine to"
+              " the file, which is loaded instead of planning the memory"
+              " again, empty to disable");
+DEFINE_string(snapshot_file, "",
+              "create the engine from the snapshot in the file, if any, and"
+              " write its snapshot after the warm up run, empty to disable");
+
+MaceStatus CreateEngine(const std::string &model_name,
+                        const std::vector<unsigned char> &model_graph_data,
+                        const unsigned char *model_weights_data,
+                        const size_t model_weights_data_size,
+                        const std::vector<std::string> &input_names,
+                        const std::vector<std::string> &output_names,
+                        const MaceEngineConfig &config,
+                        std::shared_ptr<mace::MaceEngine> *engine) {
+#ifdef MODEL_GRAPH_FORMAT_CODE
+  (void)(model_graph_data);
+  return CreateMaceEngineFromCode(model_name,
+                                  model_weights_data,
+                                  model_weights_data_size,
+                                  input_names,
+                                  output_names,
+                                  config,
+                                  engine);
+#else
+  (void)(model_name);
+  return CreateMaceEngineFromProto(model_graph_data.data(),
+                                   model_graph_data.size(),
+                                   model_weights_data,
+                                   model_weights_data_size,
+                                   input_names,
+                                   output_names,
+                                   config,
+                                   engine);
+#endif
+}
+
+// Write the file through a shared mapping of it, without the copies of a
+// stream.
+bool WriteFileMapped(const std::string &file_name,
+                     const void *data,
+                     const size_t size) {
+  int fd = open(file_name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    LOG(ERROR) << "Open output file " << file_name << " failed: "
+               << strerror(errno);
+    return false;
+  }
+  bool ret = true;
+  if (size > 0) {
+    void *mapped = MAP_FAILED;
+    if (ftruncate(fd, size) == 0) {
+      mapped = mmap(nullptr, size, PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (mapped == MAP_FAILED) {
+      LOG(ERROR) << "Map output file " << file_name << " failed: "
+                 << strerror(errno);
+      ret = false;
+    } else {
+      memcpy(mapped, data, size);
+      munmap(mapped, size);
+    }
+  }
+  close(fd);
+  return ret;
+}
+
+// The input files of a run of input_dir, by their suffix.
+struct DirRun {
+  std::vector<std::string> suffixes;
+  std::map<std::string, mace::MaceTensor> inputs;
+};
+
+// Reads the runs of input_dir on its own thread, into a pool of runs which
+// the engines return once they have run them, so that the reading of the
+// next inputs overlaps the runs.
+class InputDirReader {
+ public:
+  InputDirReader(const std::vector<std::string> &suffixes,
+                 const std::vector<std::string> &input_names,
+                 const std::vector<std::vector<int64_t>> &input_shapes,
+                 const size_t pool_size)
+      : suffixes_(suffixes), input_names_(input_names),
+        next_suffix_(0), stopped_(false), done_(false) {
+    for (size_t i = 0; i < pool_size; ++i) {
+      std::unique_ptr<DirRun> run(new DirRun);
+      for (size_t j = 0; j < input_names.size(); ++j) {
+        int64_t input_size =
+            std::accumulate(input_shapes[j].begin(), input_shapes[j].end(),
+                            1, std::multiplies<int64_t>());
+        auto buffer_in = std::shared_ptr<float>(
+            new float[input_size], std::default_delete<float[]>());
+        run->inputs[input_names[j]] =
+            mace::MaceTensor(input_shapes[j], buffer_in);
+      }
+      free_runs_.push_back(std::move(run));
+    }
+    thread_ = std::thread(&InputDirReader::ReadLoop, this);
+  }
+
+  ~InputDirReader() {
+    Stop();
+    thread_.join();
+  }
+
+  // false once all the runs are taken or the reading stopped
+  bool Pop(std::unique_ptr<DirRun> *run) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait(lock, [&] { return !ready_runs_.empty() || done_; });
+    if (ready_runs_.empty()) {
+      return false;
+    }
+    *run = std::move(ready_runs_.front());
+    ready_runs_.pop_front();
+    return true;
+  }
+
+  void Recycle(std::unique_ptr<DirRun> run) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_runs_.push_back(std::move(run));
+    cond_.notify_all();
+  }
+
+  void Stop() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopped_ = true;
+    cond_.notify_all();
+  }
+
+ private:
+  void ReadLoop() {
+    const int batch_files = FLAGS_batch_files;
+    while (true) {
+      std::unique_ptr<DirRun> run;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [&] { return !free_runs_.empty() || stopped_; });
+        if (stopped_ || next_suffix_ == suffixes_.size()) {
+          break;
+        }
+        run = std::move(free_runs_.back());
+        free_runs_.pop_back();
+      }
+      const size_t end =
+          std::min(next_suffix_ + batch_files, suffixes_.size());
+      run->suffixes.assign(suffixes_.begin() + next_suffix_,
+                           suffixes_.begin() + end);
+      next_suffix_ = end;
+      if (!ReadRun(run.get())) {
+        Stop();
+        break;
+      }
+      std::lock_guard<std::mutex> lock(mutex_);
+      ready_runs_.push_back(std::move(run));
+      cond_.notify_all();
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    done_ = true;
+    cond_.notify_all();
+  }
+
+  bool ReadRun(DirRun *run) {
+    for (auto &input_name : input_names_) {
+      mace::MaceTensor &input = run->inputs[input_name];
+      const int64_t input_size =
+          std::accumulate(input.shape().begin(), input.shape().end(), 1,
+                          std::multiplies<int64_t>());
+      const int64_t file_size = input_size / FLAGS_batch_files;
+      float *data = input.data().get();
+      for (size_t i = 0; i < run->suffixes.size(); ++i) {
+        const std::string file_name = FLAGS_input_dir + "/" +
+            FormatName(input_name) + run->suffixes[i];
+        std::ifstream in_file(file_name, std::ios::in | std::ios::binary);
+        if (!in_file.is_open()) {
+          LOG(ERROR) << "Open input file " << file_name << " failed";
+          return false;
+        }
+        in_file.read(reinterpret_cast<char *>(data + i * file_size),
+                     file_size * sizeof(float));
+      }
+      // the files missing from the last batch run on zeros
+      std::fill(data + run->suffixes.size() * file_size,
+                data + input_size, 0.f);
+    }
+    return true;
+  }
+
+  const std::vector<std::string> suffixes_;
+  const std::vector<std::string> input_names_;
+  size_t next_suffix_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::vector<std::unique_ptr<DirRun>> free_runs_;
+  std::deque<std::unique_ptr<DirRun>> ready_runs_;
+  bool stopped_;
+  bool done_;
+  std::thread thread_;
+};
+
+void RunInputDirLoop(mace::MaceEngine *engine,
+                     InputDirReader *reader,
+                     const std::vector<std::string> &output_names,
+                     const std::vector<std::vector<int64_t>> &output_shapes,
+                     std::atomic<int64_t> *files,
+                     std::atomic<bool> *failed) {
+  std::map<std::string, mace::MaceTensor> outputs;
+  for (size_t i = 0; i < output_names.size(); ++i) {
+    int64_t output_size =
+        std::accumulate(output_shapes[i].begin(), output_shapes[i].end(), 1,
+                        std::multiplies<int64_t>());
+    auto buffer_out = std::shared_ptr<float>(new float[output_size],
+                                             std::default_delete<float[]>());
+    outputs[output_names[i]] = mace::MaceTensor(output_shapes[i], buffer_out);
+  }
+  std::unique_ptr<DirRun> run;
+  while (reader->Pop(&run)) {
+    MaceStatus run_status = engine->Run(run->inputs, &outputs);
+    bool ret = run_status == MaceStatus::MACE_SUCCESS;
+    if (!ret) {
+      LOG(ERROR) << "Mace run " << FormatName(output_names[0])
+                 << run->suffixes[0] << " error: "
+                 << run_status.information();
+    }
+    for (size_t i = 0; ret && !FLAGS_output_dir.empty() &&
+        i < output_names.size(); ++i) {
+      const int64_t file_size =
+          std::accumulate(output_shapes[i].begin(), output_shapes[i].end(),
+                          1, std::multiplies<int64_t>()) /
+          FLAGS_batch_files;
+      const float *data = outputs[output_names[i]].data().get();
+      for (size_t j = 0; ret && j < run->suffixes.size(); ++j) {
+        ret = WriteFileMapped(
+            FLAGS_output_dir + "/" + FormatName(output_names[i]) +
+                run->suffixes[j],
+            data + j * file_size, file_size * sizeof(float));
+      }
+    }
+    if (!ret) {
+      failed->store(true);
+      reader->Stop();
+    } else {
+      files->fetch_add(run->suffixes.size());
+    }
+    reader->Recycle(std::move(run));
+  }
+}
+
+// Run all the files of input_dir with num_engines engines, the first of
+// which is engine, and report the files run per second.
+bool RunInputDir(const std::shared_ptr<mace::MaceEngine> &engine,
+                 const std::function<MaceStatus(
+                     std::shared_ptr<mace::MaceEngine> *)> &create_engine,
+                 const std::map<std::string, mace::MaceTensor> &warmup_inputs,
+                 const std::vector<std::string> &input_names,
+                 const std::vector<std::vector<int64_t>> &input_shapes,
+                 const std::vector<std::string> &output_names,
+                 const std::vector<std::vector<int64_t>> &output_shapes) {
+  const int batch_files = FLAGS_batch_files;
+  for (auto &shapes : {input_shapes, output_shapes}) {
+    for (auto &shape : shapes) {
+      if (batch_files < 1 || shape.empty() || shape[0] % batch_files != 0) {
+        LOG(ERROR) << "The first dims of the input and output shapes should"
+                   << " be multiples of batch_files " << batch_files;
+        return false;
+      }
+    }
+  }
+
+  std::vector<std::string> suffixes;
+  DIR *dir = opendir(FLAGS_input_dir.c_str());
+  if (dir == nullptr) {
+    LOG(ERROR) << "Directory " << FLAGS_input_dir << " does not exist.";
+    return false;
+  }
+  const std::string prefix = FormatName(input_names[0]);
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != nullptr) {
+    std::string file_name(entry->d_name);
+    if (file_name.compare(0, prefix.size(), prefix) == 0) {
+      suffixes.push_back(file_name.substr(prefix.size()));
+    }
+  }
+  closedir(dir);
+  std::sort(suffixes.begin(), suffixes.end());
+  if (!FLAGS_output_dir.empty()) {
+    mkdir(FLAGS_output_dir.c_str(), 0755);
+  }
+
+  std::vector<std::shared_ptr<mace::MaceEngine>> engines = {engine};
+  std::map<std::string, mace::MaceTensor> warmup_outputs;
+  for (size_t i = 0; i < output_names.size(); ++i) {
+    int64_t output_size =
+        std::accumulate(output_shapes[i].begin(), output_shapes[i].end(), 1,
+                        std::multiplies<int64_t>());
+    warmup_outputs[output_names[i]] = mace::MaceTensor(
+        output_shapes[i], std::shared_ptr<float>(
+            new float[output_size], std::default_delete<float[]>()));
+  }
+  for (int i = 1; i < FLAGS_num_engines; ++i) {
+    std::shared_ptr<mace::MaceEngine> new_engine;
+    MaceStatus status = create_engine(&new_engine);
+    if (status == MaceStatus::MACE_SUCCESS) {
+      status = new_engine->Run(warmup_inputs, &warmup_outputs);
+    }
+    if (status != MaceStatus::MACE_SUCCESS) {
+      LOG(ERROR) << "Create engine " << i << " failed: "
+                 << status.information();
+      return false;
+    }
+    engines.push_back(new_engine);
+  }
+
+  LOG(INFO) << "Run " << suffixes.size() << " files of " << FLAGS_input_dir
+            << " with " << engines.size() << " engines";
+  const int64_t t0 = NowMicros();
+  std::atomic<int64_t> files(0);
+  std::atomic<bool> failed(false);
+  {
+    InputDirReader reader(suffixes, input_names, input_shapes,
+                          engines.size() * std::max(FLAGS_prefetch_runs, 1));
+    std::vector<std::thread> workers;
+    for (auto &e : engines) {
+      workers.emplace_back(RunInputDirLoop, e.get(), &reader,
+                           std::cref(output_names), std::cref(output_shapes),
+                           &files, &failed);
+    }
+    for (auto &worker : workers) {
+      worker.join();
+    }
+  }
+  const double seconds = (NowMicros() - t0) / 1e6;
+  printf("input_dir: %lld files in %.3f s, %.3f files/s\n",
+         static_cast<long long>(files.load()), seconds,  // NOLINT
+         seconds > 0 ? files.load() / seconds : 0.0);
+  return !failed.load() &&
+      files.load() == static_cast<int64_t>(suffixes.size());
+}
 
 bool RunModel(const std::string &model_name,
               const std::vector<std::string> &input_names,
@@ -221,6 +595,9 @@ bool RunModel(const std::string &model_name,
   if (status != MaceStatus::MACE_SUCCESS) {
     LOG(WARNING) << "Set openmp or cpu affinity failed.";
   }
+  if (!FLAGS_trace_file.empty()) {
+    config.SetTraceFile(FLAGS_trace_file);
+  }
 #ifdef MACE_ENABLE_OPENCL
   std::shared_ptr<GPUContext> gpu_context;
   if (device_type == DeviceType::GPU) {
@@ -259,6 +636,11 @@ bool RunModel(const std::string &model_name,
     MACE_CHECK(model_weights_data != nullptr && model_weights_data_size != 0);
   }
 
+  auto create_engine = [&](std::shared_ptr<mace::MaceEngine> *new_engine) {
+    return CreateEngine(model_name, model_graph_data, model_weights_data,
+                        model_weights_data_size, input_names, output_names,
+                        config, new_engine);
+  };
   std::shared_ptr<mace::MaceEngine> engine;
   MaceStatus create_engine_status;
 
@@ -276,15 +658,29 @@ bool RunModel(const std::string &model_name,
                                    &engine);
 #else
     (void)(model_name);
-    create_engine_status =
-        CreateMaceEngineFromProto(model_graph_data.data(),
-                                  model_graph_data.size(),
-                                  model_weights_data,
-                                  model_weights_data_size,
-                                  input_names,
-                                  output_names,
-                                  config,
-                                  &engine);
+    if (!FLAGS_snapshot_file.empty() &&
+        std::ifstream(FLAGS_snapshot_file).good()) {
+      create_engine_status =
+          CreateMaceEngineFromSnapshot(FLAGS_snapshot_file,
+                                       model_graph_data.data(),
+                                       model_graph_data.size(),
+                                       model_weights_data,
+                                       model_weights_data_size,
+                                       input_names,
+                                       output_names,
+                                       config,
+                                       &engine);
+    } else {
+      create_engine_status =
+          CreateMaceEngineFromProto(model_graph_data.data(),
+                                    model_graph_data.size(),
+                                    model_weights_data,
+                                    model_weights_data_size,
+                                    input_names,
+                                    output_names,
+                                    config,
+                                    &engine);
+    }
 #endif
     int64_t t1 = NowMicros();
 
@@ -302,6 +698,26 @@ bool RunModel(const std::string &model_name,
   double init_millis = (t1 - t0) / 1000.0;
   LOG(INFO) << "Total init latency: " << init_millis << " ms";
 
+  if (!FLAGS_dump_memory_plan_file.empty() && model_graph_data.empty()) {
+    LOG(ERROR) << "The memory plan is only stored in pb model files";
+  } else if (!FLAGS_dump_memory_plan_file.empty()) {
+    std::vector<unsigned char> planned_model_graph_data;
+    status = engine->ExportMemoryPlan(model_graph_data.data(),
+                                      model_graph_data.size(),
+                                      &planned_model_graph_data);
+    if (status != MaceStatus::MACE_SUCCESS) {
+      LOG(ERROR) << "Export memory plan failed: " << status.information();
+    } else {
+      std::ofstream plan_file(FLAGS_dump_memory_plan_file, std::ios::binary);
+      plan_file.write(
+          reinterpret_cast<char *>(planned_model_graph_data.data()),
+          planned_model_graph_data.size());
+      plan_file.close();
+      LOG(INFO) << "Write the model graph with the memory plan to "
+                << FLAGS_dump_memory_plan_file;
+    }
+  }
+
   const size_t input_count = input_names.size();
   const size_t output_count = output_names.size();
 
@@ -346,26 +762,7 @@ bool RunModel(const std::string &model_name,
       LOG(ERROR) << "Warmup runtime error, retry ... errcode: "
                  << warmup_status.information();
       do {
-#ifdef MODEL_GRAPH_FORMAT_CODE
-        create_engine_status =
-          CreateMaceEngineFromCode(model_name,
-                                   model_weights_data,
-                                   model_weights_data_size,
-                                   input_names,
-                                   output_names,
-                                   config,
-                                   &engine);
-#else
-        create_engine_status =
-            CreateMaceEngineFromProto(model_graph_data.data(),
-                                      model_graph_data.size(),
-                                      model_weights_data,
-                                      model_weights_data_size,
-                                      input_names,
-                                      output_names,
-                                      config,
-                                      &engine);
-#endif
+        create_engine_status = create_engine(&engine);
       } while (create_engine_status != MaceStatus::MACE_SUCCESS);
     } else {
       int64_t t4 = NowMicros();
@@ -375,6 +772,18 @@ bool RunModel(const std::string &model_name,
     }
   }
 
+  // after the warm up run, which benchmarks the kernels of the algorithm
+  // cache
+  if (!FLAGS_snapshot_file.empty()) {
+    status = engine->SaveSnapshot(FLAGS_snapshot_file);
+    if (status != MaceStatus::MACE_SUCCESS) {
+      LOG(ERROR) << "Save snapshot failed: " << status.information();
+    } else {
+      LOG(INFO) << "Write the snapshot of the engine to "
+                << FLAGS_snapshot_file;
+    }
+  }
+
   double model_run_millis = -1;
   if (FLAGS_round > 0) {
     LOG(INFO) << "Run model";
@@ -389,26 +798,7 @@ bool RunModel(const std::string &model_name,
           LOG(ERROR) << "Mace run model runtime error, retry ... errcode: "
                      << run_status.information();
           do {
-#ifdef MODEL_GRAPH_FORMAT_CODE
-            create_engine_status =
-              CreateMaceEngineFromCode(model_name,
-                                       model_weights_data,
-                                       model_weights_data_size,
-                                       input_names,
-                                       output_names,
-                                       config,
-                                       &engine);
-#else
-            create_engine_status =
-                CreateMaceEngineFromProto(model_graph_data.data(),
-                                          model_graph_data.size(),
-                                          model_weights_data,
-                                          model_weights_data_size,
-                                          input_names,
-                                          output_names,
-                                          config,
-                                          &engine);
-#endif
+            create_engine_status = create_engine(&engine);
           } while (create_engine_status != MaceStatus::MACE_SUCCESS);
         } else {
           int64_t t1 = NowMicros();
@@ -425,6 +815,12 @@ bool RunModel(const std::string &model_name,
     LOG(INFO) << "Average latency: " << model_run_millis << " ms";
   }
 
+  bool input_dir_ret = true;
+  if (!FLAGS_input_dir.empty()) {
+    input_dir_ret = RunInputDir(engine, create_engine, inputs, input_names,
+                                input_shapes, output_names, output_shapes);
+  }
+
   // Metrics reporting tools depends on the format, keep in consistent
   printf("========================================\n");
   printf("            init      warmup     run_avg\n");
@@ -453,7 +849,7 @@ bool RunModel(const std::string &model_name,
     MemoryUnMap(model_weights_data, model_weights_data_size);
   }
 
-  return true;
+  return input_dir_ret;
 }
 
 int Main(int argc, char **argv) {
@@ -479,6 +875,9 @@ int Main(int argc, char **argv) {
   LOG(INFO) << "gpu_priority_hint: " << FLAGS_gpu_priority_hint;
   LOG(INFO) << "omp_num_threads: " << FLAGS_omp_num_threads;
   LOG(INFO) << "cpu_affinity_policy: " << FLAGS_cpu_affinity_policy;
+  LOG(INFO) << "input_dir: " << FLAGS_input_dir;
+  LOG(INFO) << "num_engines: " << FLAGS_num_engines;
+  LOG(INFO) << "batch_files: " << FLAGS_batch_files;
 
   std::vector<std::string> input_names = str_util::Split(FLAGS_input_node, ',');
   std::vector<std::string> output_names =
@@ -0,0 +1,128 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/utils/latency_histogram.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace mace {
+
+constexpr int LatencyHistogram::kExactBits;
+constexpr int LatencyHistogram::kSubBucketBits;
+constexpr int LatencyHistogram::kMaxBits;
+constexpr int LatencyHistogram::kNumBuckets;
+
+namespace {
+int HighestBit(uint64_t value) {
+  int bit = 0;
+  while (value >>= 1) {
+    ++bit;
+  }
+  return bit;
+}
+
+int64_t ValueAt(std::atomic<int64_t> *value, bool reset, int64_t initial) {
+  return reset ? value->exchange(initial, std::memory_order_relaxed)
+               : value->load(std::memory_order_relaxed);
+}
+}  // namespace
+
+LatencyHistogram::LatencyHistogram()
+    : sum_micros_(0),
+      min_micros_(std::numeric_limits<int64_t>::max()),
+      max_micros_(0) {
+  for (auto &bucket : buckets_) {
+    bucket.store(0, std::memory_order_relaxed);
+  }
+}
+
+int LatencyHistogram::BucketIndex(int64_t micros) {
+  const int64_t max_micros = (static_cast<int64_t>(1) << kMaxBits) - 1;
+  const uint64_t value =
+      static_cast<uint64_t>(std::min(std::max<int64_t>(micros, 0),
+                                     max_micros));
+  if (value < (1u << kExactBits)) {
+    return static_cast<int>(value);
+  }
+  const int bit = HighestBit(value);
+  const int sub_bucket = static_cast<int>(
+      (value >> (bit - kSubBucketBits)) & ((1 << kSubBucketBits) - 1));
+  return (1 << kExactBits) + ((bit - kExactBits) << kSubBucketBits) +
+      sub_bucket;
+}
+
+int64_t LatencyHistogram::BucketMaxMicros(int index) {
+  if (index < (1 << kExactBits)) {
+    return index;
+  }
+  const int offset = index - (1 << kExactBits);
+  const int bit = kExactBits + (offset >> kSubBucketBits);
+  const int64_t sub_bucket =
+      (1 << kSubBucketBits) + (offset & ((1 << kSubBucketBits) - 1));
+  return ((sub_bucket + 1) << (bit - kSubBucketBits)) - 1;
+}
+
+void LatencyHistogram::Record(int64_t micros) {
+  micros = std::max<int64_t>(micros, 0);
+  buckets_[BucketIndex(micros)].fetch_add(1, std::memory_order_relaxed);
+  sum_micros_.fetch_add(micros, std::memory_order_relaxed);
+  int64_t min_micros = min_micros_.load(std::memory_order_relaxed);
+  while (micros < min_micros &&
+         !min_micros_.compare_exchange_weak(min_micros, micros,
+                                            std::memory_order_relaxed)) {
+  }
+  int64_t max_micros = max_micros_.load(std::memory_order_relaxed);
+  while (micros > max_micros &&
+         !max_micros_.compare_exchange_weak(max_micros, micros,
+                                            std::memory_order_relaxed)) {
+  }
+}
+
+void LatencyHistogram::GetStats(LatencyStats *stats, bool reset) {
+  int64_t counts[kNumBuckets];
+  int64_t count = 0;
+  for (int i = 0; i < kNumBuckets; ++i) {
+    counts[i] = ValueAt(&buckets_[i], reset, 0);
+    count += counts[i];
+  }
+  const int64_t sum_micros = ValueAt(&sum_micros_, reset, 0);
+  const int64_t min_micros = ValueAt(
+      &min_micros_, reset, std::numeric_limits<int64_t>::max());
+  const int64_t max_micros = ValueAt(&max_micros_, reset, 0);
+
+  *stats = LatencyStats();
+  stats->count = count;
+  if (count == 0) {
+    return;
+  }
+  stats->min_micros = min_micros;
+  stats->max_micros = max_micros;
+  stats->mean_micros = static_cast<double>(sum_micros) / count;
+  const double percentiles[] = {0.5, 0.9, 0.99};
+  int64_t *results[] = {&stats->p50_micros, &stats->p90_micros,
+                        &stats->p99_micros};
+  int64_t seen = 0;
+  int p = 0;
+  for (int i = 0; i < kNumBuckets && p < 3; ++i) {
+    seen += counts[i];
+    while (p < 3 && seen >= percentiles[p] * count) {
+      // the bucket bound never exceeds the largest latency recorded
+      *results[p] = std::min(BucketMaxMicros(i), max_micros);
+      ++p;
+    }
+  }
+}
+
+}  // namespace mace
@@ -0,0 +1,62 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_UTILS_LATENCY_HISTOGRAM_H_
+#define MACE_UTILS_LATENCY_HISTOGRAM_H_
+
+#include <atomic>  // NOLINT(build/c++11)
+#include <cstdint>
+
+#include "mace/public/mace.h"
+#include "mace/utils/utils.h"
+
+namespace mace {
+
+// Histogram of latencies in microseconds with log-linear buckets, like
+// HdrHistogram with 3 significant bits: values below 16 are exact, each
+// larger power of two is split into 8 buckets, so percentiles are within
+// 12.5%. The buckets are preallocated, Record never locks nor allocates and
+// could be called by several threads while a snapshot is taken.
+class LatencyHistogram {
+ public:
+  LatencyHistogram();
+
+  void Record(int64_t micros);
+
+  // A snapshot of the recorded latencies, reset them if reset is true.
+  void GetStats(LatencyStats *stats, bool reset = false);
+
+  static constexpr int kExactBits = 4;
+  static constexpr int kSubBucketBits = 3;
+  // latencies are clamped to 2^kMaxBits - 1 micros, about 12 days
+  static constexpr int kMaxBits = 40;
+  static constexpr int kNumBuckets =
+      (1 << kExactBits) + ((kMaxBits - kExactBits) << kSubBucketBits);
+
+  static int BucketIndex(int64_t micros);
+  // the largest latency of the bucket
+  static int64_t BucketMaxMicros(int index);
+
+ private:
+  std::atomic<int64_t> buckets_[kNumBuckets];
+  std::atomic<int64_t> sum_micros_;
+  std::atomic<int64_t> min_micros_;
+  std::atomic<int64_t> max_micros_;
+
+  MACE_DISABLE_COPY_AND_ASSIGN(LatencyHistogram);
+};
+
+}  // namespace mace
+
+#endif  // MACE_UTILS_LATENCY_HISTOGRAM_H_
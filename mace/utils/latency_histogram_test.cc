@@ -0,0 +1,90 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "mace/utils/latency_histogram.h"
+
+namespace mace {
+
+TEST(LatencyHistogramTest, Buckets) {
+  for (int64_t micros : {0, 1, 15, 16, 17, 100, 1000, 123456, 9999999}) {
+    const int index = LatencyHistogram::BucketIndex(micros);
+    EXPECT_GE(LatencyHistogram::BucketMaxMicros(index), micros);
+    EXPECT_LE(LatencyHistogram::BucketMaxMicros(index), micros * 1.125 + 1);
+    if (index > 0) {
+      EXPECT_LT(LatencyHistogram::BucketMaxMicros(index - 1), micros);
+    }
+  }
+  EXPECT_EQ(LatencyHistogram::kNumBuckets - 1,
+            LatencyHistogram::BucketIndex(int64_t(1) << 50));
+}
+
+TEST(LatencyHistogramTest, Percentiles) {
+  LatencyHistogram histogram;
+  LatencyStats stats;
+  histogram.GetStats(&stats);
+  EXPECT_EQ(0, stats.count);
+  for (int64_t micros = 1; micros <= 1000; ++micros) {
+    histogram.Record(micros);
+  }
+  histogram.GetStats(&stats);
+  EXPECT_EQ(1000, stats.count);
+  EXPECT_EQ(1, stats.min_micros);
+  EXPECT_EQ(1000, stats.max_micros);
+  EXPECT_DOUBLE_EQ(500.5, stats.mean_micros);
+  EXPECT_NEAR(500, stats.p50_micros, 500 * 0.125);
+  EXPECT_NEAR(900, stats.p90_micros, 900 * 0.125);
+  EXPECT_NEAR(990, stats.p99_micros, 990 * 0.125);
+  EXPECT_LE(stats.p99_micros, stats.max_micros);
+}
+
+TEST(LatencyHistogramTest, Reset) {
+  LatencyHistogram histogram;
+  histogram.Record(10);
+  LatencyStats stats;
+  histogram.GetStats(&stats, true);
+  EXPECT_EQ(1, stats.count);
+  EXPECT_EQ(10, stats.p50_micros);
+  histogram.Record(20);
+  histogram.GetStats(&stats);
+  EXPECT_EQ(1, stats.count);
+  EXPECT_EQ(20, stats.min_micros);
+  EXPECT_EQ(20, stats.max_micros);
+}
+
+TEST(LatencyHistogramTest, Concurrent) {
+  LatencyHistogram histogram;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back([&histogram, i] {
+      for (int j = 0; j < 10000; ++j) {
+        histogram.Record(i * 100 + j % 100);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  LatencyStats stats;
+  histogram.GetStats(&stats);
+  EXPECT_EQ(40000, stats.count);
+  EXPECT_EQ(0, stats.min_micros);
+  EXPECT_EQ(399, stats.max_micros);
+}
+
+}  // namespace mace
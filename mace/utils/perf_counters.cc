@@ -0,0 +1,189 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/utils/perf_counters.h"
+
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+
+#if defined(__linux__) || defined(__ANDROID__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#define MACE_HAS_PERF_EVENT
+#endif
+
+#include <cerrno>
+#include <cstring>
+
+#include "mace/utils/logging.h"
+
+namespace mace {
+namespace utils {
+
+namespace {
+
+#ifdef MACE_HAS_PERF_EVENT
+struct CounterEvent {
+  uint32_t type;
+  uint64_t config;
+};
+
+constexpr uint64_t CacheReadMisses(uint64_t cache) {
+  return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+
+// in the order of the fields of PerfCounterStats
+const CounterEvent kCounterEvents[] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE, CacheReadMisses(PERF_COUNT_HW_CACHE_L1D)},
+    {PERF_TYPE_HW_CACHE, CacheReadMisses(PERF_COUNT_HW_CACHE_LL)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+#if defined(__arm__) || defined(__aarch64__)
+    // the BUS_ACCESS event of the ARM PMU, which the generic bus cycles
+    // are not mapped to on most cores
+    {PERF_TYPE_RAW, 0x19},
+#else
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BUS_CYCLES},
+#endif
+};
+#else
+const int kCounterEvents[6] = {0};
+#endif  // MACE_HAS_PERF_EVENT
+
+constexpr size_t kCounterCount =
+    sizeof(kCounterEvents) / sizeof(kCounterEvents[0]);
+static_assert(kCounterCount == 6, "a counter for each of PerfCounterStats");
+
+#ifdef MACE_HAS_PERF_EVENT
+int OpenCounter(const CounterEvent &event, int thread_id) {
+  perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = event.type;
+  attr.config = event.config;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format =
+      PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return static_cast<int>(
+      syscall(__NR_perf_event_open, &attr, thread_id, -1, -1, 0));
+}
+
+// the count scaled to the time the counter was enabled, -1 if unreadable
+int64_t ReadCounter(int fd) {
+  uint64_t values[3];
+  if (read(fd, values, sizeof(values)) != sizeof(values)) {
+    return -1;
+  }
+  if (values[2] == 0) {
+    return 0;
+  }
+  if (values[2] < values[1]) {
+    return static_cast<int64_t>(
+        static_cast<double>(values[0]) * values[1] / values[2]);
+  }
+  return static_cast<int64_t>(values[0]);
+}
+#endif  // MACE_HAS_PERF_EVENT
+
+}  // namespace
+
+int CurrentThreadId() {
+#if defined(__ANDROID__)
+  return gettid();
+#else
+  return static_cast<int>(syscall(SYS_gettid));
+#endif
+}
+
+PerfCounters::PerfCounters(const std::vector<int> &thread_ids)
+    : fds_(kCounterCount, std::vector<int>(thread_ids.size(), -1)),
+      available_(false) {
+#ifdef MACE_HAS_PERF_EVENT
+  for (size_t c = 0; c < kCounterCount; ++c) {
+    for (size_t t = 0; t < thread_ids.size(); ++t) {
+      fds_[c][t] = OpenCounter(kCounterEvents[c], thread_ids[t]);
+      if (fds_[c][t] >= 0) {
+        available_ = true;
+      } else {
+        VLOG(2) << "Failed to open the perf counter " << c << " of thread "
+                << thread_ids[t] << ": " << strerror(errno);
+      }
+    }
+  }
+#endif  // MACE_HAS_PERF_EVENT
+  if (!available_) {
+    LOG(WARNING) << "No CPU perf counter is available";
+  }
+}
+
+PerfCounters::~PerfCounters() {
+  for (auto &fds : fds_) {
+    for (int fd : fds) {
+      if (fd >= 0) {
+        close(fd);
+      }
+    }
+  }
+}
+
+void PerfCounters::Start() {
+#ifdef MACE_HAS_PERF_EVENT
+  for (auto &fds : fds_) {
+    for (int fd : fds) {
+      if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+      }
+    }
+  }
+#endif  // MACE_HAS_PERF_EVENT
+}
+
+void PerfCounters::Stop(PerfCounterStats *stats) {
+#ifdef MACE_HAS_PERF_EVENT
+  for (auto &fds : fds_) {
+    for (int fd : fds) {
+      if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+      }
+    }
+  }
+#endif  // MACE_HAS_PERF_EVENT
+  int64_t counts[kCounterCount];
+  for (size_t c = 0; c < kCounterCount; ++c) {
+    counts[c] = -1;
+#ifdef MACE_HAS_PERF_EVENT
+    for (int fd : fds_[c]) {
+      const int64_t count = fd >= 0 ? ReadCounter(fd) : -1;
+      if (count >= 0) {
+        counts[c] = (counts[c] < 0 ? 0 : counts[c]) + count;
+      }
+    }
+#endif  // MACE_HAS_PERF_EVENT
+  }
+  stats->cycles = counts[0];
+  stats->instructions = counts[1];
+  stats->l1d_misses = counts[2];
+  stats->llc_misses = counts[3];
+  stats->branch_misses = counts[4];
+  stats->bus_accesses = counts[5];
+}
+
+}  // namespace utils
+}  // namespace mace
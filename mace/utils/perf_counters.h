@@ -0,0 +1,57 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_UTILS_PERF_COUNTERS_H_
+#define MACE_UTILS_PERF_COUNTERS_H_
+
+#include <vector>
+
+#include "mace/public/mace.h"
+
+namespace mace {
+namespace utils {
+
+// the kernel id of the calling thread
+int CurrentThreadId();
+
+// The user-space hardware counters of PerfCounterStats on a set of threads,
+// opened with perf_event_open on Linux and Android. Each counter of each
+// thread is opened on its own, so the counters the PMU cannot hold together
+// are multiplexed and scaled to the time they were enabled.
+class PerfCounters {
+ public:
+  explicit PerfCounters(const std::vector<int> &thread_ids);
+  ~PerfCounters();
+  PerfCounters(const PerfCounters &) = delete;
+  PerfCounters &operator=(const PerfCounters &) = delete;
+
+  // whether any counter could be opened, perf_event_paranoid or a seccomp
+  // filter may forbid them all
+  bool available() const { return available_; }
+
+  // reset and enable the counters of all the threads
+  void Start();
+  // disable the counters and sum them over the threads into stats
+  void Stop(PerfCounterStats *stats);
+
+ private:
+  // the fds of each counter, a thread each, -1 where it failed to open
+  std::vector<std::vector<int>> fds_;
+  bool available_;
+};
+
+}  // namespace utils
+}  // namespace mace
+
+#endif  // MACE_UTILS_PERF_COUNTERS_H_
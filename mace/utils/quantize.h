@@ -18,6 +18,7 @@
 #include <algorithm>
 #include <cmath>
 #include <limits>
+#include <vector>
 
 #include "mace/utils/logging.h"
 
@@ -125,6 +126,23 @@ inline void Quantize(const float *input,
   QuantizeWithScaleAndZeropoint(input, size, *scale, *zero_point, output);
 }
 
+// Quantize to a signed type around a zero point of 0, the largest magnitude
+// of the input mapped to the largest value of T.
+template<typename T>
+inline void QuantizeSymmetric(const float *input,
+                              const index_t size,
+                              T *output,
+                              float *scale) {
+  float in_min_data;
+  float in_max_data;
+  FindMinMax(input, size, &in_min_data, &in_max_data);
+  const float max_abs = std::max(std::fabs(in_min_data),
+                                 std::fabs(in_max_data));
+  *scale = max_abs > 0.f ? max_abs / std::numeric_limits<T>::max() : 1.f;
+
+  QuantizeWithScaleAndZeropoint(input, size, *scale, 0, output);
+}
+
 template<typename T>
 inline void Quantize(const Tensor &input,
                      Tensor *output,
@@ -199,6 +217,53 @@ inline void GetOutputMultiplierAndShift(
   MACE_CHECK(*right_shift >= 0);
 }
 
+// Fixed point multiplication with the multiplier and right shift above, the
+// same rounding as gemmlowp's OutputStageQuantizeDownInt32ToUint8-
+// ScaleByFixedPoint.
+inline int32_t SaturatingRoundingDoublingHighMul(const int32_t a,
+                                                 const int32_t b) {
+  if (a == b && a == std::numeric_limits<int32_t>::min()) {
+    return std::numeric_limits<int32_t>::max();
+  }
+  const int64_t ab = static_cast<int64_t>(a) * static_cast<int64_t>(b);
+  const int64_t nudge = ab >= 0 ? (1ll << 30) : (1 - (1ll << 30));
+  return static_cast<int32_t>((ab + nudge) / (1ll << 31));
+}
+
+inline int32_t RoundingDivideByPOT(const int32_t x, const int exponent) {
+  const int32_t mask = static_cast<int32_t>((1ll << exponent) - 1);
+  const int32_t remainder = x & mask;
+  const int32_t threshold = (mask >> 1) + (x < 0 ? 1 : 0);
+  return (x >> exponent) + (remainder > threshold ? 1 : 0);
+}
+
+inline int32_t MultiplyByQuantizedMultiplier(const int32_t x,
+                                             const int32_t multiplier,
+                                             const int right_shift) {
+  return RoundingDivideByPOT(SaturatingRoundingDoublingHighMul(x, multiplier),
+                             right_shift);
+}
+
+// Multipliers and right shifts of the channels of a per-channel quantized
+// lhs of lhs_scales, or all of lhs_scale if lhs_scales is empty.
+inline void GetOutputMultipliersAndShifts(
+    const float lhs_scale, const std::vector<float> &lhs_scales,
+    const index_t channels, const float rhs_scale, const float output_scale,
+    std::vector<int32_t> *quantized_multipliers,
+    std::vector<int> *right_shifts) {
+  MACE_CHECK(lhs_scales.empty()
+                 || static_cast<index_t>(lhs_scales.size()) == channels,
+             lhs_scales.size(), " scales for ", channels, " channels");
+  quantized_multipliers->resize(channels);
+  right_shifts->resize(channels);
+  for (index_t c = 0; c < channels; ++c) {
+    GetOutputMultiplierAndShift(lhs_scales.empty() ? lhs_scale : lhs_scales[c],
+                                rhs_scale, output_scale,
+                                &(*quantized_multipliers)[c],
+                                &(*right_shifts)[c]);
+  }
+}
+
 }  // namespace mace
 
 #endif  // MACE_UTILS_QUANTIZE_H_
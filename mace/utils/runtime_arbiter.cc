@@ -0,0 +1,203 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/utils/runtime_arbiter.h"
+
+#include <algorithm>
+#include <chrono>  // NOLINT(build/c++11)
+#include <limits>
+#include <thread>  // NOLINT(build/c++11)
+
+#include "mace/utils/logging.h"
+
+namespace mace {
+
+namespace {
+constexpr int64_t kNoDeadline = std::numeric_limits<int64_t>::max();
+
+// monotonic, the deadlines are waited for
+int64_t SteadyMicros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+}  // namespace
+
+RuntimeArbiter::Lease::Lease()
+    : arbiter_(nullptr),
+      device_type_(DeviceType::CPU),
+      units_(0),
+      start_micros_(0) {}
+
+RuntimeArbiter::Lease::~Lease() {
+  if (arbiter_ != nullptr) {
+    arbiter_->Release(this);
+  }
+}
+
+RuntimeArbiter::Device::Device()
+    : in_use(0),
+      admitted_runs(0),
+      rejected_runs(0),
+      expired_runs(0),
+      wait_micros(0),
+      busy_micros(0) {}
+
+RuntimeArbiter::RuntimeArbiter()
+    : cpu_thread_budget_(
+          std::max(1, static_cast<int>(std::thread::hardware_concurrency()))),
+      max_queue_length_(0),
+      arrivals_(0),
+      stats_start_micros_(SteadyMicros()) {}
+
+void RuntimeArbiter::SetCPUThreadBudget(int num_threads) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cpu_thread_budget_ = std::max(num_threads, 1);
+  }
+  // the waiting runs may fit now
+  cond_.notify_all();
+}
+
+void RuntimeArbiter::SetMaxQueueLength(int max_queue_length) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  max_queue_length_ = static_cast<size_t>(std::max(max_queue_length, 0));
+}
+
+int RuntimeArbiter::Capacity(DeviceType device_type) const {
+  return device_type == DeviceType::CPU ? cpu_thread_budget_ : 1;
+}
+
+const RuntimeArbiter::Waiter *RuntimeArbiter::Next(const Device &device) {
+  const Waiter *next = nullptr;
+  for (const Waiter *waiter : device.queue) {
+    if (next == nullptr || waiter->priority > next->priority ||
+        (waiter->priority == next->priority &&
+            (waiter->deadline_micros < next->deadline_micros ||
+                (waiter->deadline_micros == next->deadline_micros &&
+                    waiter->arrival < next->arrival)))) {
+      next = waiter;
+    }
+  }
+  return next;
+}
+
+void RuntimeArbiter::Remove(const Waiter *waiter, Device *device) {
+  device->queue.erase(
+      std::find(device->queue.begin(), device->queue.end(), waiter));
+}
+
+MaceStatus RuntimeArbiter::Acquire(DeviceType device_type,
+                                   int units,
+                                   int priority,
+                                   int64_t deadline_micros,
+                                   Lease *lease) {
+  MACE_CHECK(lease->arbiter_ == nullptr, "the lease holds a run");
+  std::unique_lock<std::mutex> lock(mutex_);
+  Device &device = devices_[device_type];
+  if (max_queue_length_ > 0 && device.queue.size() >= max_queue_length_) {
+    ++device.rejected_runs;
+    return MaceStatus(MaceStatus::MACE_OUT_OF_RESOURCES,
+                      "too many runs wait for the device");
+  }
+  const int64_t call_micros = SteadyMicros();
+  Waiter waiter = {priority,
+                   deadline_micros > 0 ? call_micros + deadline_micros
+                                       : kNoDeadline,
+                   arrivals_++,
+                   std::max(units, 1)};
+  device.queue.push_back(&waiter);
+  // the capacity could change while waiting
+  auto held_units = [this, device_type, &waiter] {
+    return std::min(waiter.units, Capacity(device_type));
+  };
+  while (Next(device) != &waiter ||
+      device.in_use + held_units() > Capacity(device_type)) {
+    if (waiter.deadline_micros == kNoDeadline) {
+      cond_.wait(lock);
+      continue;
+    }
+    const int64_t remaining_micros = waiter.deadline_micros - SteadyMicros();
+    if (remaining_micros <= 0) {
+      Remove(&waiter, &device);
+      ++device.expired_runs;
+      // the runs behind it may be admitted now
+      cond_.notify_all();
+      return MaceStatus(MaceStatus::MACE_OUT_OF_RESOURCES,
+                        "the deadline passed before the run was admitted");
+    }
+    cond_.wait_for(lock, std::chrono::microseconds(remaining_micros));
+  }
+  Remove(&waiter, &device);
+  lease->arbiter_ = this;
+  lease->device_type_ = device_type;
+  lease->units_ = held_units();
+  lease->start_micros_ = SteadyMicros();
+  device.in_use += lease->units_;
+  ++device.admitted_runs;
+  device.wait_micros += lease->start_micros_ - call_micros;
+  // the next run may fit too, e.g. of fewer CPU threads
+  cond_.notify_all();
+  return MaceStatus::MACE_SUCCESS;
+}
+
+void RuntimeArbiter::Release(Lease *lease) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Device &device = devices_[lease->device_type_];
+    device.in_use -= lease->units_;
+    device.busy_micros +=
+        (SteadyMicros() - lease->start_micros_) * lease->units_;
+  }
+  lease->arbiter_ = nullptr;
+  cond_.notify_all();
+}
+
+void RuntimeArbiter::GetStats(std::vector<RuntimeDeviceStats> *stats,
+                              bool reset) {
+  MACE_CHECK_NOTNULL(stats);
+  stats->clear();
+  std::lock_guard<std::mutex> lock(mutex_);
+  const int64_t now_micros = SteadyMicros();
+  const int64_t elapsed_micros =
+      std::max<int64_t>(now_micros - stats_start_micros_, 1);
+  for (auto &item : devices_) {
+    Device &device = item.second;
+    RuntimeDeviceStats device_stats;
+    device_stats.device_type = item.first;
+    device_stats.capacity = Capacity(item.first);
+    device_stats.in_use = device.in_use;
+    device_stats.queued = static_cast<int>(device.queue.size());
+    device_stats.admitted_runs = device.admitted_runs;
+    device_stats.rejected_runs = device.rejected_runs;
+    device_stats.expired_runs = device.expired_runs;
+    device_stats.wait_micros = device.wait_micros;
+    device_stats.busy_micros = device.busy_micros;
+    device_stats.utilization = std::min(
+        1.f, static_cast<float>(device.busy_micros) /
+            (static_cast<float>(elapsed_micros) * device_stats.capacity));
+    stats->push_back(device_stats);
+    if (reset) {
+      device.admitted_runs = 0;
+      device.rejected_runs = 0;
+      device.expired_runs = 0;
+      device.wait_micros = 0;
+      device.busy_micros = 0;
+    }
+  }
+  if (reset) {
+    stats_start_micros_ = now_micros;
+  }
+}
+
+}  // namespace mace
@@ -0,0 +1,114 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_UTILS_RUNTIME_ARBITER_H_
+#define MACE_UTILS_RUNTIME_ARBITER_H_
+
+#include <condition_variable>  // NOLINT(build/c++11)
+#include <cstdint>
+#include <map>
+#include <mutex>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "mace/public/mace.h"
+#include "mace/utils/utils.h"
+
+namespace mace {
+
+// Admission of the runs of several engines onto their devices. A device has
+// a capacity in units, the CPU threads of the process or a single run on the
+// other devices, and a run is admitted when the units it holds fit in it and
+// no waiting run goes before it: one of higher priority, then of an earlier
+// deadline, then of an earlier arrival. An admitted run is not preempted.
+class RuntimeArbiter {
+ public:
+  RuntimeArbiter();
+
+  // A run admitted onto a device, which it holds until the lease is
+  // destroyed.
+  class Lease {
+   public:
+    Lease();
+    ~Lease();
+
+   private:
+    friend class RuntimeArbiter;
+
+    RuntimeArbiter *arbiter_;
+    DeviceType device_type_;
+    int units_;
+    int64_t start_micros_;
+
+    MACE_DISABLE_COPY_AND_ASSIGN(Lease);
+  };
+
+  // the CPU threads at a time, at least 1
+  void SetCPUThreadBudget(int num_threads);
+
+  // the runs waiting for a device, 0 for no limit
+  void SetMaxQueueLength(int max_queue_length);
+
+  // Wait until a run of units of the device is admitted into lease, units
+  // are clamped to the capacity. Fails with MACE_OUT_OF_RESOURCES if the
+  // queue of the device is full or the deadline, in micros from now, 0 for
+  // none, passes first.
+  MaceStatus Acquire(DeviceType device_type,
+                     int units,
+                     int priority,
+                     int64_t deadline_micros,
+                     Lease *lease);
+
+  // The stats of the devices which got runs, reset them if reset is true.
+  void GetStats(std::vector<RuntimeDeviceStats> *stats, bool reset = false);
+
+ private:
+  struct Waiter {
+    int priority;
+    int64_t deadline_micros;
+    uint64_t arrival;
+    int units;
+  };
+
+  struct Device {
+    Device();
+
+    int in_use;
+    std::vector<const Waiter *> queue;
+    int64_t admitted_runs;
+    int64_t rejected_runs;
+    int64_t expired_runs;
+    int64_t wait_micros;
+    int64_t busy_micros;
+  };
+
+  void Release(Lease *lease);
+  int Capacity(DeviceType device_type) const;
+  // the waiting run admitted first
+  static const Waiter *Next(const Device &device);
+  static void Remove(const Waiter *waiter, Device *device);
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::map<DeviceType, Device> devices_;
+  int cpu_thread_budget_;
+  size_t max_queue_length_;
+  uint64_t arrivals_;
+  int64_t stats_start_micros_;
+
+  MACE_DISABLE_COPY_AND_ASSIGN(RuntimeArbiter);
+};
+
+}  // namespace mace
+
+#endif  // MACE_UTILS_RUNTIME_ARBITER_H_
@@ -0,0 +1,140 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <memory>
+#include <mutex>  // NOLINT(build/c++11)
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "mace/utils/runtime_arbiter.h"
+
+namespace mace {
+
+namespace {
+RuntimeDeviceStats DeviceStats(RuntimeArbiter *arbiter,
+                               DeviceType device_type) {
+  std::vector<RuntimeDeviceStats> stats;
+  arbiter->GetStats(&stats);
+  for (auto &device_stats : stats) {
+    if (device_stats.device_type == device_type) {
+      return device_stats;
+    }
+  }
+  return RuntimeDeviceStats();
+}
+
+void WaitQueued(RuntimeArbiter *arbiter, DeviceType device_type, int queued) {
+  while (DeviceStats(arbiter, device_type).queued != queued) {
+    std::this_thread::yield();
+  }
+}
+}  // namespace
+
+TEST(RuntimeArbiterTest, Priority) {
+  RuntimeArbiter arbiter;
+  std::unique_ptr<RuntimeArbiter::Lease> lease(new RuntimeArbiter::Lease);
+  ASSERT_EQ(MaceStatus::MACE_SUCCESS,
+            arbiter.Acquire(DeviceType::GPU, 1, 0, 0, lease.get()).code());
+
+  std::mutex mutex;
+  std::vector<int> order;
+  auto run = [&](int priority, int64_t deadline_micros) {
+    RuntimeArbiter::Lease run_lease;
+    EXPECT_EQ(MaceStatus::MACE_SUCCESS,
+              arbiter.Acquire(DeviceType::GPU, 1, priority, deadline_micros,
+                              &run_lease).code());
+    std::lock_guard<std::mutex> lock(mutex);
+    order.push_back(priority * 10 + (deadline_micros > 0 ? 1 : 0));
+  };
+  std::vector<std::thread> threads;
+  threads.emplace_back(run, 0, 0);
+  WaitQueued(&arbiter, DeviceType::GPU, 1);
+  threads.emplace_back(run, 1, 0);
+  WaitQueued(&arbiter, DeviceType::GPU, 2);
+  threads.emplace_back(run, 0, 10000000);
+  WaitQueued(&arbiter, DeviceType::GPU, 3);
+  EXPECT_EQ(1, DeviceStats(&arbiter, DeviceType::GPU).in_use);
+
+  lease.reset();
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  // the higher priority, then the earlier deadline, then the arrival
+  EXPECT_EQ((std::vector<int>{10, 1, 0}), order);
+  RuntimeDeviceStats stats = DeviceStats(&arbiter, DeviceType::GPU);
+  EXPECT_EQ(1, stats.capacity);
+  EXPECT_EQ(0, stats.in_use);
+  EXPECT_EQ(4, stats.admitted_runs);
+}
+
+TEST(RuntimeArbiterTest, CPUThreadBudget) {
+  RuntimeArbiter arbiter;
+  arbiter.SetCPUThreadBudget(4);
+  std::unique_ptr<RuntimeArbiter::Lease> lease(new RuntimeArbiter::Lease);
+  ASSERT_EQ(MaceStatus::MACE_SUCCESS,
+            arbiter.Acquire(DeviceType::CPU, 3, 0, 0, lease.get()).code());
+  {
+    RuntimeArbiter::Lease fitting_lease;
+    EXPECT_EQ(MaceStatus::MACE_SUCCESS,
+              arbiter.Acquire(DeviceType::CPU, 1, 0, 0, &fitting_lease).code());
+    EXPECT_EQ(4, DeviceStats(&arbiter, DeviceType::CPU).in_use);
+  }
+  RuntimeArbiter::Lease expired_lease;
+  EXPECT_EQ(MaceStatus::MACE_OUT_OF_RESOURCES,
+            arbiter.Acquire(DeviceType::CPU, 2, 0, 1000, &expired_lease).code());
+  EXPECT_EQ(1, DeviceStats(&arbiter, DeviceType::CPU).expired_runs);
+
+  // more threads than the budget hold all of it
+  std::thread thread([&arbiter] {
+    RuntimeArbiter::Lease large_lease;
+    EXPECT_EQ(MaceStatus::MACE_SUCCESS,
+              arbiter.Acquire(DeviceType::CPU, 8, 0, 0, &large_lease).code());
+    EXPECT_EQ(4, DeviceStats(&arbiter, DeviceType::CPU).in_use);
+  });
+  WaitQueued(&arbiter, DeviceType::CPU, 1);
+  lease.reset();
+  thread.join();
+}
+
+TEST(RuntimeArbiterTest, MaxQueueLength) {
+  RuntimeArbiter arbiter;
+  arbiter.SetMaxQueueLength(1);
+  std::unique_ptr<RuntimeArbiter::Lease> lease(new RuntimeArbiter::Lease);
+  ASSERT_EQ(MaceStatus::MACE_SUCCESS,
+            arbiter.Acquire(DeviceType::HEXAGON, 1, 0, 0, lease.get()).code());
+  std::thread thread([&arbiter] {
+    RuntimeArbiter::Lease queued_lease;
+    EXPECT_EQ(MaceStatus::MACE_SUCCESS,
+              arbiter.Acquire(DeviceType::HEXAGON, 1, 0, 0, &queued_lease).code());
+  });
+  WaitQueued(&arbiter, DeviceType::HEXAGON, 1);
+  RuntimeArbiter::Lease rejected_lease;
+  EXPECT_EQ(MaceStatus::MACE_OUT_OF_RESOURCES,
+            arbiter.Acquire(DeviceType::HEXAGON, 1, 0, 0, &rejected_lease).code());
+  lease.reset();
+  thread.join();
+
+  std::vector<RuntimeDeviceStats> stats;
+  arbiter.GetStats(&stats, true);
+  ASSERT_EQ(1u, stats.size());
+  EXPECT_EQ(2, stats[0].admitted_runs);
+  EXPECT_EQ(1, stats[0].rejected_runs);
+  EXPECT_TRUE(stats[0].utilization > 0 && stats[0].utilization <= 1);
+  arbiter.GetStats(&stats);
+  EXPECT_EQ(0, stats[0].admitted_runs);
+}
+
+}  // namespace mace
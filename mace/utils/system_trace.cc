@@ -0,0 +1,152 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/utils/system_trace.h"
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+
+#include "mace/utils/logging.h"
+
+namespace mace {
+namespace utils {
+
+namespace {
+
+typedef bool (*ATraceIsEnabledFunc)();
+typedef void (*ATraceBeginSectionFunc)(const char *);
+typedef void (*ATraceEndSectionFunc)();
+
+// The ATrace of libandroid, from API 23, or the ftrace trace_marker which
+// the sections are written to as systrace does.
+class SystemTracer {
+ public:
+  static SystemTracer *Get() {
+    static SystemTracer tracer;
+    return &tracer;
+  }
+
+  bool enabled() const {
+    if (is_enabled_ != nullptr) {
+      return is_enabled_();
+    }
+    return marker_fd_ >= 0;
+  }
+
+  void Begin(const char *name) {
+    if (begin_section_ != nullptr) {
+      begin_section_(name);
+    } else if (marker_fd_ >= 0) {
+      char buf[1024];
+      const int size = snprintf(buf, sizeof(buf), "B|%d|%s", pid_, name);
+      if (size > 0) {
+        Write(buf, std::min<size_t>(size, sizeof(buf) - 1));
+      }
+    }
+  }
+
+  void End() {
+    if (end_section_ != nullptr) {
+      end_section_();
+    } else if (marker_fd_ >= 0) {
+      char buf[32];
+      const int size = snprintf(buf, sizeof(buf), "E|%d", pid_);
+      if (size > 0) {
+        Write(buf, size);
+      }
+    }
+  }
+
+ private:
+  void Write(const char *buf, size_t size) {
+    if (write(marker_fd_, buf, size) < 0) {
+      VLOG(3) << "Failed to write the trace_marker";
+    }
+  }
+
+  SystemTracer()
+      : is_enabled_(nullptr),
+        begin_section_(nullptr),
+        end_section_(nullptr),
+        marker_fd_(-1),
+        pid_(getpid()) {
+#ifdef __ANDROID__
+    // never closed, the functions are called until the process exits
+    void *handle = dlopen("libandroid.so", RTLD_NOW | RTLD_LOCAL);
+    if (handle != nullptr) {
+      is_enabled_ = reinterpret_cast<ATraceIsEnabledFunc>(
+          dlsym(handle, "ATrace_isEnabled"));
+      begin_section_ = reinterpret_cast<ATraceBeginSectionFunc>(
+          dlsym(handle, "ATrace_beginSection"));
+      end_section_ = reinterpret_cast<ATraceEndSectionFunc>(
+          dlsym(handle, "ATrace_endSection"));
+      if (is_enabled_ == nullptr || begin_section_ == nullptr ||
+          end_section_ == nullptr) {
+        VLOG(2) << "ATrace is not available before Android M";
+        is_enabled_ = nullptr;
+        begin_section_ = nullptr;
+        end_section_ = nullptr;
+        dlclose(handle);
+      }
+    }
+#endif  // __ANDROID__
+    if (is_enabled_ == nullptr && EnvEnabled("MACE_TRACE_MARKER")) {
+      for (const char *path : {"/sys/kernel/tracing/trace_marker",
+                               "/sys/kernel/debug/tracing/trace_marker"}) {
+        marker_fd_ = open(path, O_WRONLY | O_CLOEXEC);
+        if (marker_fd_ >= 0) {
+          break;
+        }
+      }
+      if (marker_fd_ < 0) {
+        LOG(WARNING) << "Failed to open the trace_marker of ftrace";
+      }
+    }
+  }
+
+  ~SystemTracer() {
+    if (marker_fd_ >= 0) {
+      close(marker_fd_);
+    }
+  }
+
+  ATraceIsEnabledFunc is_enabled_;
+  ATraceBeginSectionFunc begin_section_;
+  ATraceEndSectionFunc end_section_;
+  int marker_fd_;
+  const int pid_;
+
+  MACE_DISABLE_COPY_AND_ASSIGN(SystemTracer);
+};
+
+}  // namespace
+
+bool SystemTraceEnabled() {
+  return SystemTracer::Get()->enabled();
+}
+
+void BeginSystemTrace(const char *name) {
+  SystemTracer::Get()->Begin(name);
+}
+
+void EndSystemTrace() {
+  SystemTracer::Get()->End();
+}
+
+}  // namespace utils
+}  // namespace mace
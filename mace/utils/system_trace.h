@@ -0,0 +1,65 @@
+// Copyright 2019 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_UTILS_SYSTEM_TRACE_H_
+#define MACE_UTILS_SYSTEM_TRACE_H_
+
+#include <string>
+
+#include "mace/utils/string_util.h"
+#include "mace/utils/utils.h"
+
+namespace mace {
+namespace utils {
+
+// Whether the sections are captured by a system trace: the ATrace of
+// libandroid on Android, while systrace or perfetto records the app, and
+// the ftrace trace_marker elsewhere with MACE_TRACE_MARKER=1.
+bool SystemTraceEnabled();
+
+// Begin and end a section of the calling thread, nested as the calls.
+void BeginSystemTrace(const char *name);
+void EndSystemTrace();
+
+// A section of the scope, none for an empty name.
+class SystemTraceScope {
+ public:
+  explicit SystemTraceScope(const std::string &name)
+      : started_(!name.empty()) {
+    if (started_) {
+      BeginSystemTrace(name.c_str());
+    }
+  }
+  ~SystemTraceScope() {
+    if (started_) {
+      EndSystemTrace();
+    }
+  }
+
+ private:
+  const bool started_;
+
+  MACE_DISABLE_COPY_AND_ASSIGN(SystemTraceScope);
+};
+
+}  // namespace utils
+}  // namespace mace
+
+// the name is only formatted while the system is traced
+#define MACE_SYSTEM_TRACE(...)                                \
+  mace::utils::SystemTraceScope system_trace_scope(           \
+      mace::utils::SystemTraceEnabled() ?                     \
+      mace::MakeString(__VA_ARGS__) : std::string())
+
+#endif  // MACE_UTILS_SYSTEM_TRACE_H_
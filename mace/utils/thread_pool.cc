@@ -0,0 +1,513 @@
+// Copyright 2018 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mace/utils/thread_pool.h"
+
+#include <sched.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <string>
+
+#include "mace/utils/logging.h"
+
+namespace mace {
+namespace utils {
+
+namespace {
+
+// iterations an idle thread spins before it goes to sleep
+constexpr int kSpinCount = 1 << 16;
+// a real-time worker is alone on its core, spinning costs no one else
+constexpr int kRealTimeSpinCount = 1 << 20;
+
+int SpinCount(CPUSchedulingPolicy sched_policy) {
+  switch (sched_policy) {
+    case CPUSchedulingPolicy::CPU_SCHED_IDLE:
+      return 0;
+    case CPUSchedulingPolicy::CPU_SCHED_FIFO:
+    case CPUSchedulingPolicy::CPU_SCHED_RR:
+      return kRealTimeSpinCount;
+    default:
+      return kSpinCount;
+  }
+}
+
+inline uint64_t PackRange(uint64_t head, uint64_t tail) {
+  return (head << 32) | tail;
+}
+
+inline int64_t RoundUpDiv(int64_t value, int64_t divisor) {
+  return (value + divisor - 1) / divisor;
+}
+
+}  // namespace
+
+MaceStatus SetThreadAffinity(const std::vector<size_t> &cpu_ids) {
+  if (cpu_ids.empty()) {
+    return MaceStatus::MACE_SUCCESS;
+  }
+  cpu_set_t mask;
+  CPU_ZERO(&mask);
+  for (auto cpu_id : cpu_ids) {
+    CPU_SET(cpu_id, &mask);
+  }
+#if defined(__ANDROID__)
+  pid_t pid = gettid();
+#else
+  pid_t pid = syscall(SYS_gettid);
+#endif
+  int err = sched_setaffinity(pid, sizeof(mask), &mask);
+  if (err) {
+    LOG(WARNING) << "set affinity error: " << strerror(errno);
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      "set affinity error: " + std::string(strerror(errno)));
+  } else {
+    return MaceStatus::MACE_SUCCESS;
+  }
+}
+
+MaceStatus SetThreadPriority(int nice) {
+#if defined(__ANDROID__)
+  pid_t pid = gettid();
+#else
+  pid_t pid = syscall(SYS_gettid);
+#endif
+  int err = setpriority(PRIO_PROCESS, pid, nice);
+  if (err) {
+    LOG(WARNING) << "set priority error: " << strerror(errno);
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      "set priority error: " + std::string(strerror(errno)));
+  }
+  return MaceStatus::MACE_SUCCESS;
+}
+
+MaceStatus SetThreadScheduling(CPUSchedulingPolicy policy, int priority) {
+  int sched_policy = SCHED_OTHER;
+  switch (policy) {
+    case CPUSchedulingPolicy::CPU_SCHED_NORMAL:
+      break;
+    case CPUSchedulingPolicy::CPU_SCHED_IDLE:
+#ifdef SCHED_IDLE
+      sched_policy = SCHED_IDLE;
+      break;
+#else
+      return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                        "SCHED_IDLE is not supported");
+#endif
+    case CPUSchedulingPolicy::CPU_SCHED_FIFO:
+      sched_policy = SCHED_FIFO;
+      break;
+    case CPUSchedulingPolicy::CPU_SCHED_RR:
+      sched_policy = SCHED_RR;
+      break;
+    default:
+      return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                        MakeString("unknown scheduling class ",
+                                   static_cast<int>(policy)));
+  }
+#if defined(__ANDROID__)
+  pid_t pid = gettid();
+#else
+  pid_t pid = syscall(SYS_gettid);
+#endif
+  sched_param param;
+  memset(&param, 0, sizeof(param));
+  param.sched_priority = priority;
+  int err = sched_setscheduler(pid, sched_policy, &param);
+  if (err) {
+    LOG(WARNING) << "set scheduler error: " << strerror(errno);
+    return MaceStatus(MaceStatus::MACE_INVALID_ARGS,
+                      "set scheduler error: " + std::string(strerror(errno)));
+  }
+  return MaceStatus::MACE_SUCCESS;
+}
+
+PriorityInheritanceMutex::PriorityInheritanceMutex() {
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+#if defined(_POSIX_THREAD_PRIO_INHERIT) && _POSIX_THREAD_PRIO_INHERIT > 0
+  pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+#endif
+  pthread_mutex_init(&mutex_, &attr);
+  pthread_mutexattr_destroy(&attr);
+}
+
+PriorityInheritanceMutex::~PriorityInheritanceMutex() {
+  pthread_mutex_destroy(&mutex_);
+}
+
+void PriorityInheritanceMutex::lock() {
+  int err = pthread_mutex_lock(&mutex_);
+  MACE_CHECK(err == 0, "lock mutex error: ", strerror(err));
+}
+
+bool PriorityInheritanceMutex::try_lock() {
+  return pthread_mutex_trylock(&mutex_) == 0;
+}
+
+void PriorityInheritanceMutex::unlock() {
+  pthread_mutex_unlock(&mutex_);
+}
+
+ThreadPool::ThreadPool(const int thread_count,
+                       const std::vector<size_t> &cpu_ids,
+                       CPUSchedulingPolicy sched_policy,
+                       int sched_priority,
+                       const std::vector<float> &core_speeds)
+    : thread_count_(std::max(thread_count, 1)),
+      cpu_ids_(cpu_ids),
+      sched_policy_(sched_policy),
+      sched_priority_(sched_priority),
+      spin_count_(SpinCount(sched_policy)),
+      tile_ranges_(new TileRange[thread_count_]),
+      func_(nullptr),
+      task_id_(0),
+      pending_workers_(0),
+      stop_(false) {
+  VLOG(1) << "Create thread pool with " << thread_count_
+          << " threads, CPU core IDs: " << MakeString(cpu_ids_);
+  for (int i = 0; i < thread_count_; ++i) {
+    tile_ranges_[i].range.store(0, std::memory_order_relaxed);
+    tile_ranges_[i].executed = 0;
+  }
+  if (thread_count_ > 1 && !core_speeds.empty() &&
+      core_speeds.size() == cpu_ids_.size()) {
+    // thread i starts at the speed of the core it is bound to, the calling
+    // thread at that of the first one
+    float total_speed = 0;
+    for (int i = 0; i < thread_count_; ++i) {
+      thread_weights_.push_back(core_speeds[i % core_speeds.size()]);
+      total_speed += thread_weights_.back();
+    }
+    for (float &weight : thread_weights_) {
+      weight *= thread_count_ / total_speed;
+    }
+    VLOG(1) << "Split the tiles by the thread speeds "
+            << MakeString(thread_weights_);
+  }
+  for (int i = 1; i < thread_count_; ++i) {
+    workers_.emplace_back(&ThreadPool::WorkerLoop, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<PriorityInheritanceMutex> lock(sleep_mutex_);
+    stop_.store(true, std::memory_order_release);
+  }
+  sleep_cond_.notify_all();
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+}
+
+void ThreadPool::WorkerLoop(size_t thread_idx) {
+  if (thread_weights_.empty()) {
+    SetThreadAffinity(cpu_ids_);
+  } else {
+    // the speed of a thread moving between the cores could not be told
+    SetThreadAffinity({cpu_ids_[thread_idx % cpu_ids_.size()]});
+  }
+  // the workers otherwise inherit the class of the thread creating them
+  if (sched_policy_ != CPUSchedulingPolicy::CPU_SCHED_NORMAL) {
+    SetThreadScheduling(sched_policy_, sched_priority_);
+  }
+  uint64_t last_task_id = 0;
+  while (true) {
+    int spin = 0;
+    while (task_id_.load(std::memory_order_acquire) == last_task_id &&
+        !stop_.load(std::memory_order_acquire)) {
+      if (++spin < spin_count_) {
+        continue;
+      }
+      std::unique_lock<PriorityInheritanceMutex> lock(sleep_mutex_);
+      sleep_cond_.wait(lock, [this, last_task_id] {
+        return task_id_.load(std::memory_order_acquire) != last_task_id ||
+            stop_.load(std::memory_order_acquire);
+      });
+    }
+    if (stop_.load(std::memory_order_acquire)) {
+      return;
+    }
+    last_task_id = task_id_.load(std::memory_order_acquire);
+    RunTiles(thread_idx);
+    pending_workers_.fetch_sub(1, std::memory_order_release);
+  }
+}
+
+bool ThreadPool::PopTile(size_t thread_idx, bool steal, int64_t *tile) {
+  auto &range = tile_ranges_[thread_idx].range;
+  uint64_t value = range.load(std::memory_order_acquire);
+  while (true) {
+    uint64_t head = value >> 32;
+    uint64_t tail = value & 0xffffffff;
+    if (head >= tail) {
+      return false;
+    }
+    // the owner pops from the head, thieves from the tail
+    uint64_t next = steal ? PackRange(head, tail - 1)
+                          : PackRange(head + 1, tail);
+    if (range.compare_exchange_weak(value, next,
+                                    std::memory_order_acq_rel,
+                                    std::memory_order_acquire)) {
+      *tile = static_cast<int64_t>(steal ? tail - 1 : head);
+      return true;
+    }
+  }
+}
+
+void ThreadPool::RunTiles(size_t thread_idx) {
+  const std::function<void(int64_t)> &func = *func_;
+  int64_t tile;
+  int64_t executed = 0;
+  while (PopTile(thread_idx, false, &tile)) {
+    func(tile);
+    ++executed;
+  }
+  for (int i = 1; i < thread_count_; ++i) {
+    size_t victim = (thread_idx + i) % thread_count_;
+    while (PopTile(victim, true, &tile)) {
+      func(tile);
+      ++executed;
+    }
+  }
+  // read by the calling thread once the workers are done
+  tile_ranges_[thread_idx].executed = executed;
+}
+
+void ThreadPool::Run(const std::function<void(int64_t)> &func,
+                     int64_t tile_count) {
+  if (tile_count <= 0) {
+    return;
+  }
+  if (thread_count_ == 1 || tile_count == 1) {
+    for (int64_t tile = 0; tile < tile_count; ++tile) {
+      func(tile);
+    }
+    return;
+  }
+  MACE_CHECK(tile_count <= std::numeric_limits<uint32_t>::max(),
+             "too many tiles: ", tile_count);
+  std::lock_guard<PriorityInheritanceMutex> run_lock(run_mutex_);
+  func_ = &func;
+  if (thread_weights_.empty()) {
+    for (int i = 0; i < thread_count_; ++i) {
+      uint64_t head = static_cast<uint64_t>(tile_count * i / thread_count_);
+      uint64_t tail =
+          static_cast<uint64_t>(tile_count * (i + 1) / thread_count_);
+      tile_ranges_[i].range.store(PackRange(head, tail),
+                                  std::memory_order_relaxed);
+    }
+  } else {
+    // the weights sum up to thread_count_
+    float weight_sum = 0;
+    uint64_t head = 0;
+    for (int i = 0; i < thread_count_; ++i) {
+      weight_sum += thread_weights_[i];
+      uint64_t tail = i + 1 == thread_count_ ?
+          static_cast<uint64_t>(tile_count) :
+          std::min(static_cast<uint64_t>(tile_count),
+                   static_cast<uint64_t>(
+                       tile_count * weight_sum / thread_count_));
+      tail = std::max(head, tail);
+      tile_ranges_[i].range.store(PackRange(head, tail),
+                                  std::memory_order_relaxed);
+      head = tail;
+    }
+  }
+  pending_workers_.store(thread_count_ - 1, std::memory_order_relaxed);
+  {
+    std::lock_guard<PriorityInheritanceMutex> lock(sleep_mutex_);
+    task_id_.fetch_add(1, std::memory_order_release);
+  }
+  sleep_cond_.notify_all();
+  RunTiles(0);
+  int spin = 0;
+  while (pending_workers_.load(std::memory_order_acquire) != 0) {
+    if (++spin >= spin_count_) {
+      std::this_thread::yield();
+    }
+  }
+  func_ = nullptr;
+  if (!thread_weights_.empty()) {
+    Calibrate(tile_count);
+  }
+}
+
+void ThreadPool::Calibrate(int64_t tile_count) {
+  // too few tiles to tell the speeds from the stealing
+  if (tile_count < thread_count_ * 4) {
+    return;
+  }
+  // a weight never drops to 0, so a thread which overslept a run still
+  // gets tiles of the next ones
+  const float kMinWeight = 0.1f;
+  const float kRate = 0.25f;
+  float weight_sum = 0;
+  for (int i = 0; i < thread_count_; ++i) {
+    const float share = static_cast<float>(tile_ranges_[i].executed) *
+        thread_count_ / tile_count;
+    thread_weights_[i] = std::max(
+        kMinWeight, (1 - kRate) * thread_weights_[i] + kRate * share);
+    weight_sum += thread_weights_[i];
+  }
+  for (float &weight : thread_weights_) {
+    weight *= thread_count_ / weight_sum;
+  }
+}
+
+int64_t ThreadPool::DefaultTileSize(int64_t iterations) const {
+  // a few tiles per thread leave room for stealing
+  return std::max<int64_t>(1, iterations / (thread_count_ * 4));
+}
+
+void ThreadPool::Compute1D(const std::function<void(int64_t,
+                                                    int64_t,
+                                                    int64_t)> &func,
+                           int64_t start,
+                           int64_t end,
+                           int64_t step,
+                           int64_t tile_size) {
+  if (start >= end) {
+    return;
+  }
+  if (thread_count_ == 1) {
+    func(start, end, step);
+    return;
+  }
+  const int64_t items = RoundUpDiv(end - start, step);
+  if (tile_size <= 0) {
+    tile_size = DefaultTileSize(items);
+  }
+  const int64_t tile_count = RoundUpDiv(items, tile_size);
+  Run([&](int64_t tile) {
+    int64_t tile_start = start + tile * tile_size * step;
+    int64_t tile_end = std::min(end, tile_start + tile_size * step);
+    func(tile_start, tile_end, step);
+  }, tile_count);
+}
+
+void ThreadPool::Compute2D(const std::function<void(int64_t,
+                                                    int64_t,
+                                                    int64_t,
+                                                    int64_t,
+                                                    int64_t,
+                                                    int64_t)> &func,
+                           int64_t start0,
+                           int64_t end0,
+                           int64_t step0,
+                           int64_t start1,
+                           int64_t end1,
+                           int64_t step1,
+                           int64_t tile_size0,
+                           int64_t tile_size1) {
+  if (start0 >= end0 || start1 >= end1) {
+    return;
+  }
+  if (thread_count_ == 1) {
+    func(start0, end0, step0, start1, end1, step1);
+    return;
+  }
+  const int64_t items0 = RoundUpDiv(end0 - start0, step0);
+  const int64_t items1 = RoundUpDiv(end1 - start1, step1);
+  if (tile_size0 <= 0 || tile_size1 <= 0) {
+    // split the outer dimension first, the inner one if it is too short
+    if (items0 >= thread_count_) {
+      tile_size0 = DefaultTileSize(items0);
+      tile_size1 = items1;
+    } else {
+      tile_size0 = 1;
+      tile_size1 = std::min(items1, DefaultTileSize(items0 * items1));
+    }
+  }
+  const int64_t tile_count0 = RoundUpDiv(items0, tile_size0);
+  const int64_t tile_count1 = RoundUpDiv(items1, tile_size1);
+  Run([&](int64_t tile) {
+    int64_t tile_start0 = start0 + (tile / tile_count1) * tile_size0 * step0;
+    int64_t tile_end0 = std::min(end0, tile_start0 + tile_size0 * step0);
+    int64_t tile_start1 = start1 + (tile % tile_count1) * tile_size1 * step1;
+    int64_t tile_end1 = std::min(end1, tile_start1 + tile_size1 * step1);
+    func(tile_start0, tile_end0, step0, tile_start1, tile_end1, step1);
+  }, tile_count0 * tile_count1);
+}
+
+void ThreadPool::Compute3D(const std::function<void(int64_t,
+                                                    int64_t,
+                                                    int64_t,
+                                                    int64_t,
+                                                    int64_t,
+                                                    int64_t,
+                                                    int64_t,
+                                                    int64_t,
+                                                    int64_t)> &func,
+                           int64_t start0,
+                           int64_t end0,
+                           int64_t step0,
+                           int64_t start1,
+                           int64_t end1,
+                           int64_t step1,
+                           int64_t start2,
+                           int64_t end2,
+                           int64_t step2,
+                           int64_t tile_size0,
+                           int64_t tile_size1,
+                           int64_t tile_size2) {
+  if (start0 >= end0 || start1 >= end1 || start2 >= end2) {
+    return;
+  }
+  if (thread_count_ == 1) {
+    func(start0, end0, step0, start1, end1, step1, start2, end2, step2);
+    return;
+  }
+  const int64_t items0 = RoundUpDiv(end0 - start0, step0);
+  const int64_t items1 = RoundUpDiv(end1 - start1, step1);
+  const int64_t items2 = RoundUpDiv(end2 - start2, step2);
+  if (tile_size0 <= 0 || tile_size1 <= 0 || tile_size2 <= 0) {
+    // keep the innermost dimension whole, split the outer two like 2D
+    tile_size2 = items2;
+    if (items0 >= thread_count_) {
+      tile_size0 = DefaultTileSize(items0);
+      tile_size1 = items1;
+    } else {
+      tile_size0 = 1;
+      tile_size1 = std::min(items1, DefaultTileSize(items0 * items1));
+    }
+  }
+  const int64_t tile_count0 = RoundUpDiv(items0, tile_size0);
+  const int64_t tile_count1 = RoundUpDiv(items1, tile_size1);
+  const int64_t tile_count2 = RoundUpDiv(items2, tile_size2);
+  Run([&](int64_t tile) {
+    int64_t tile1 = tile / tile_count2;
+    int64_t tile_start0 =
+        start0 + (tile1 / tile_count1) * tile_size0 * step0;
+    int64_t tile_end0 = std::min(end0, tile_start0 + tile_size0 * step0);
+    int64_t tile_start1 =
+        start1 + (tile1 % tile_count1) * tile_size1 * step1;
+    int64_t tile_end1 = std::min(end1, tile_start1 + tile_size1 * step1);
+    int64_t tile_start2 = start2 + (tile % tile_count2) * tile_size2 * step2;
+    int64_t tile_end2 = std::min(end2, tile_start2 + tile_size2 * step2);
+    func(tile_start0, tile_end0, step0,
+         tile_start1, tile_end1, step1,
+         tile_start2, tile_end2, step2);
+  }, tile_count0 * tile_count1 * tile_count2);
+}
+
+}  // namespace utils
+}  // namespace mace
@@ -0,0 +1,177 @@
+// Copyright 2018 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MACE_UTILS_THREAD_POOL_H_
+#define MACE_UTILS_THREAD_POOL_H_
+
+#include <pthread.h>
+
+#include <atomic>
+#include <condition_variable>  // NOLINT(build/c++11)
+#include <functional>
+#include <memory>
+#include <mutex>  // NOLINT(build/c++11)
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "mace/public/mace.h"
+
+namespace mace {
+namespace utils {
+
+// Bind the calling thread to the cpu cores, no-op if cpu_ids is empty.
+MaceStatus SetThreadAffinity(const std::vector<size_t> &cpu_ids);
+
+// Set the nice value of the calling thread, lower for a higher priority.
+MaceStatus SetThreadPriority(int nice);
+
+// Set the scheduling class of the calling thread, see CPUSchedulingPolicy.
+MaceStatus SetThreadScheduling(CPUSchedulingPolicy policy, int priority);
+
+// A mutex whose owner runs at the priority of the threads waiting on it,
+// so that a real-time thread is not held up by a lower one holding it,
+// where the system supports it.
+class PriorityInheritanceMutex {
+ public:
+  PriorityInheritanceMutex();
+  ~PriorityInheritanceMutex();
+  PriorityInheritanceMutex(const PriorityInheritanceMutex &) = delete;
+  PriorityInheritanceMutex &operator=(
+      const PriorityInheritanceMutex &) = delete;
+
+  void lock();
+  bool try_lock();
+  void unlock();
+
+ private:
+  pthread_mutex_t mutex_;
+};
+
+// Fork-join pool whose workers are bound to a set of cores. Tiles of a
+// computation are split evenly between the calling thread and the workers,
+// and a thread which runs out of tiles steals from the others. Idle workers
+// spin for a while before sleeping, so back-to-back ops wake them cheaply;
+// longer in the real-time scheduling classes, not at all in SCHED_IDLE.
+//
+// On cores of different speeds, such as the big and the little ones of a
+// big.LITTLE SoC, each worker is bound to a core of its own and the tiles
+// are split in proportion to the speed of the threads, starting from that
+// of their cores and calibrated by the tiles they ran, stolen ones included.
+//
+// Each CPURuntime owns its pool, so engines bound to disjoint cores never
+// share threads. Compute* calls from different threads are serialized.
+class ThreadPool {
+ public:
+  ThreadPool(const int thread_count,
+             const std::vector<size_t> &cpu_ids,
+             CPUSchedulingPolicy sched_policy =
+                 CPUSchedulingPolicy::CPU_SCHED_NORMAL,
+             int sched_priority = 0,
+             const std::vector<float> &core_speeds = std::vector<float>());
+  ~ThreadPool();
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  int thread_count() const { return thread_count_; }
+
+  // func(start, end, step) for tiles of [start, end); tile_size is the
+  // number of iterations of a tile, chosen automatically when it is 0.
+  void Compute1D(const std::function<void(int64_t /* start */,
+                                          int64_t /* end */,
+                                          int64_t /* step */)> &func,
+                 int64_t start,
+                 int64_t end,
+                 int64_t step,
+                 int64_t tile_size = 0);
+
+  void Compute2D(const std::function<void(int64_t /* start0 */,
+                                          int64_t /* end0 */,
+                                          int64_t /* step0 */,
+                                          int64_t /* start1 */,
+                                          int64_t /* end1 */,
+                                          int64_t /* step1 */)> &func,
+                 int64_t start0,
+                 int64_t end0,
+                 int64_t step0,
+                 int64_t start1,
+                 int64_t end1,
+                 int64_t step1,
+                 int64_t tile_size0 = 0,
+                 int64_t tile_size1 = 0);
+
+  void Compute3D(const std::function<void(int64_t /* start0 */,
+                                          int64_t /* end0 */,
+                                          int64_t /* step0 */,
+                                          int64_t /* start1 */,
+                                          int64_t /* end1 */,
+                                          int64_t /* step1 */,
+                                          int64_t /* start2 */,
+                                          int64_t /* end2 */,
+                                          int64_t /* step2 */)> &func,
+                 int64_t start0,
+                 int64_t end0,
+                 int64_t step0,
+                 int64_t start1,
+                 int64_t end1,
+                 int64_t step1,
+                 int64_t start2,
+                 int64_t end2,
+                 int64_t step2,
+                 int64_t tile_size0 = 0,
+                 int64_t tile_size1 = 0,
+                 int64_t tile_size2 = 0);
+
+ private:
+  // Tiles [head, tail) owned by one thread, packed to be updated by CAS,
+  // and the tiles the thread ran in the last run, padded to a cache line
+  // against false sharing.
+  struct TileRange {
+    std::atomic<uint64_t> range;
+    int64_t executed;
+    char padding[64 - sizeof(std::atomic<uint64_t>) - sizeof(int64_t)];
+  };
+
+  // Run func(tile) for every tile in [0, tile_count).
+  void Run(const std::function<void(int64_t)> &func, int64_t tile_count);
+  void RunTiles(size_t thread_idx);
+  bool PopTile(size_t thread_idx, bool steal, int64_t *tile);
+  void WorkerLoop(size_t thread_idx);
+  int64_t DefaultTileSize(int64_t iterations) const;
+  // move the weights of the threads towards the shares of the tiles they ran
+  void Calibrate(int64_t tile_count);
+
+ private:
+  const int thread_count_;
+  const std::vector<size_t> cpu_ids_;
+  const CPUSchedulingPolicy sched_policy_;
+  const int sched_priority_;
+  const int spin_count_;
+  // the relative speeds of the threads, summing up to thread_count_, empty
+  // if the cores are all as fast
+  std::vector<float> thread_weights_;
+  std::unique_ptr<TileRange[]> tile_ranges_;
+  std::vector<std::thread> workers_;
+  const std::function<void(int64_t)> *func_;
+  std::atomic<uint64_t> task_id_;
+  std::atomic<int> pending_workers_;
+  std::atomic<bool> stop_;
+  PriorityInheritanceMutex run_mutex_;
+  PriorityInheritanceMutex sleep_mutex_;
+  std::condition_variable_any sleep_cond_;
+};
+
+}  // namespace utils
+}  // namespace mace
+
+#endif  // MACE_UTILS_THREAD_POOL_H_
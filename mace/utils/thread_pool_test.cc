@@ -0,0 +1,135 @@
+// Copyright 2018 The MACE Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <atomic>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "mace/utils/thread_pool.h"
+
+namespace mace {
+namespace utils {
+
+TEST(ThreadPoolTest, Compute1D) {
+  ThreadPool thread_pool(4, {});
+  std::vector<int> visits(1003, 0);
+  for (int64_t tile_size : {0, 1, 7, 2000}) {
+    std::fill(visits.begin(), visits.end(), 0);
+    thread_pool.Compute1D([&](int64_t start, int64_t end, int64_t step) {
+      for (int64_t i = start; i < end; i += step) {
+        ++visits[i];
+      }
+    }, 1, 1003, 2, tile_size);
+    for (size_t i = 0; i < visits.size(); ++i) {
+      EXPECT_EQ(i % 2 == 1 ? 1 : 0, visits[i]);
+    }
+  }
+}
+
+TEST(ThreadPoolTest, Compute2D) {
+  ThreadPool thread_pool(3, {});
+  for (int64_t rows : {1, 2, 37}) {
+    std::vector<int> visits(rows * 29, 0);
+    thread_pool.Compute2D([&](int64_t start0, int64_t end0, int64_t step0,
+                              int64_t start1, int64_t end1, int64_t step1) {
+      for (int64_t i = start0; i < end0; i += step0) {
+        for (int64_t j = start1; j < end1; j += step1) {
+          ++visits[i * 29 + j];
+        }
+      }
+    }, 0, rows, 1, 0, 29, 1);
+    for (auto visit : visits) {
+      EXPECT_EQ(1, visit);
+    }
+  }
+}
+
+TEST(ThreadPoolTest, Compute3D) {
+  ThreadPool thread_pool(4, {});
+  std::vector<int> visits(3 * 11 * 5, 0);
+  thread_pool.Compute3D([&](int64_t start0, int64_t end0, int64_t step0,
+                            int64_t start1, int64_t end1, int64_t step1,
+                            int64_t start2, int64_t end2, int64_t step2) {
+    for (int64_t i = start0; i < end0; i += step0) {
+      for (int64_t j = start1; j < end1; j += step1) {
+        for (int64_t k = start2; k < end2; k += step2) {
+          ++visits[(i * 11 + j) * 5 + k];
+        }
+      }
+    }
+  }, 0, 3, 1, 0, 11, 1, 0, 5, 1, 1, 2, 3);
+  for (auto visit : visits) {
+    EXPECT_EQ(1, visit);
+  }
+}
+
+TEST(ThreadPoolTest, IndependentPools) {
+  ThreadPool pools[2] = {{2, {}}, {2, {}}};
+  std::atomic<int64_t> sums[2];
+  std::vector<std::thread> threads;
+  for (int p = 0; p < 2; ++p) {
+    sums[p] = 0;
+    threads.emplace_back([&, p] {
+      for (int round = 0; round < 100; ++round) {
+        pools[p].Compute1D([&](int64_t start, int64_t end, int64_t step) {
+          for (int64_t i = start; i < end; i += step) {
+            sums[p] += i;
+          }
+        }, 0, 100, 1);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(100 * 4950, sums[0]);
+  EXPECT_EQ(100 * 4950, sums[1]);
+}
+
+TEST(ThreadPoolTest, IdleScheduling) {
+  // SCHED_IDLE needs no privilege, its workers sleep without spinning
+  ThreadPool thread_pool(3, {}, CPUSchedulingPolicy::CPU_SCHED_IDLE, 0);
+  std::atomic<int64_t> sum(0);
+  for (int round = 0; round < 10; ++round) {
+    thread_pool.Compute1D([&](int64_t start, int64_t end, int64_t step) {
+      for (int64_t i = start; i < end; i += step) {
+        sum += i;
+      }
+    }, 0, 100, 1, 1);
+  }
+  EXPECT_EQ(10 * 4950, sum);
+}
+
+TEST(ThreadPoolTest, CoresOfDifferentSpeeds) {
+  // both bound to the first core, which every machine has
+  ThreadPool thread_pool(2, {0, 0}, CPUSchedulingPolicy::CPU_SCHED_NORMAL, 0,
+                         {1.f, 0.5f});
+  std::vector<int> visits(1000, 0);
+  for (int round = 0; round < 10; ++round) {
+    std::fill(visits.begin(), visits.end(), 0);
+    thread_pool.Compute1D([&](int64_t start, int64_t end, int64_t step) {
+      for (int64_t i = start; i < end; i += step) {
+        ++visits[i];
+      }
+    }, 0, 1000, 1, 10);
+    for (auto visit : visits) {
+      EXPECT_EQ(1, visit);
+    }
+  }
+}
+
+}  // namespace utils
+}  // namespace mace
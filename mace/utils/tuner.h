@@ -20,11 +20,15 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
 #include <cstring>
 #include <fstream>
 #include <functional>
 #include <limits>
 #include <map>
+#include <mutex>  // NOLINT(build/c++11)
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -40,22 +44,43 @@ inline bool IsTuning() {
   return tuning != nullptr && strlen(tuning) == 1 && tuning[0] == '1';
 }
 
+// Online tuning measures a few candidates of the untuned kernels in each run
+// of the deployed model, until every kernel has settled on its fastest one.
+inline bool IsOnlineTuning() {
+  const char *tuning = getenv("MACE_ONLINE_TUNING");
+  return tuning != nullptr && strlen(tuning) == 1 && tuning[0] == '1';
+}
+
 template <typename param_type>
 class Tuner {
  public:
   explicit Tuner(const std::string tuned_param_file_path = "",
       const unsigned char *param_byte_stream = nullptr,
-      const size_t param_byte_stream_size = 0):
-      tuned_param_file_path_(tuned_param_file_path) {
+      const size_t param_byte_stream_size = 0,
+      const std::string online_tuned_param_file_path = ""):
+      tuned_param_file_path_(tuned_param_file_path),
+      online_tuned_param_file_path_(online_tuned_param_file_path),
+      online_tuning_micros_(0),
+      online_params_changed_(false),
+      nearest_param_table_size_(0) {
     path_ = getenv("MACE_RUN_PARAMETER_PATH");
     if (param_byte_stream != nullptr && param_byte_stream_size != 0) {
-      ParseData(param_byte_stream, param_byte_stream_size);
+      ParseData(param_byte_stream, param_byte_stream_size, &param_table_);
     } else {
-      ReadRunParamters();
+      ReadRunParamters(tuned_param_file_path_, &param_table_);
+    }
+    // the parameters tuned offline take precedence
+    ReadRunParamters(online_tuned_param_file_path_, &online_param_table_);
+    for (auto &kp : online_param_table_) {
+      param_table_.emplace(kp.first, kp.second);
     }
   }
 
-  ~Tuner() { WriteRunParameters(); }
+  ~Tuner() {
+    if (path_ != nullptr) {
+      WriteRunParameters(path_, param_table_);
+    }
+  }
 
   Tuner(const Tuner &) = delete;
   Tuner &operator=(const Tuner &) = delete;
@@ -69,7 +94,9 @@ class Tuner {
       const std::function<RetType(const std::vector<param_type> &,
                                   Timer *,
                                   std::vector<param_type> *)> &func,
-      Timer *timer) {
+      Timer *timer,
+      const std::function<bool(std::vector<param_type> *)> &fit_param =
+          nullptr) {
     std::string obfucated_param_key = MACE_OBFUSCATE_SYMBOL(param_key);
     if (IsTuning() && param_generator != nullptr) {
       // tune
@@ -79,6 +106,10 @@ class Tuner {
               << " retult: " << (VLOG_IS_ON(3) ? MakeString(opt_param) : "");
       param_table_[obfucated_param_key] = opt_param;
       return res;
+    } else if (IsOnlineTuning() && param_generator != nullptr &&
+        timer != nullptr) {
+      return OnlineTuneOrRun<RetType>(obfucated_param_key, default_param,
+                                      param_generator, func, timer);
     } else {
       // run
       if (param_table_.find(obfucated_param_key) != param_table_.end()) {
@@ -87,44 +118,226 @@ class Tuner {
                         ? MakeString(param_table_[obfucated_param_key])
                         : "");
         return func(param_table_[obfucated_param_key], nullptr, nullptr);
+      }
+      std::vector<param_type> nearest_param;
+      if (fit_param != nullptr &&
+          NearestParam(obfucated_param_key, fit_param, &nearest_param)) {
+        VLOG(3) << param_key << " (nearest tuned shape): "
+                << (VLOG_IS_ON(3) ? MakeString(nearest_param) : "");
+        return func(nearest_param, nullptr, nullptr);
+      }
+      return func(default_param, nullptr, nullptr);
+    }
+  }
+
+  // Called after each run of a model: renews the online tuning budget and
+  // persists the parameters settled since the last call.
+  void FinishRun() {
+    if (!IsOnlineTuning()) return;
+    std::lock_guard<std::mutex> lock(online_tuning_mutex_);
+    online_tuning_micros_ = 0;
+    if (online_params_changed_ && !online_tuned_param_file_path_.empty()) {
+      // write a temporary file and rename it, so a crash never tears it
+      const std::string tmp_path = online_tuned_param_file_path_ + ".tmp";
+      if (WriteRunParameters(tmp_path.c_str(), online_param_table_) &&
+          rename(tmp_path.c_str(),
+                 online_tuned_param_file_path_.c_str()) == 0) {
+        online_params_changed_ = false;
       } else {
-        return func(default_param, nullptr, nullptr);
+        LOG(WARNING) << "Write online tuned parameters to "
+                     << online_tuned_param_file_path_ << " failed";
       }
     }
   }
 
  private:
-  inline void WriteRunParameters() {
-    if (path_ != nullptr) {
-      VLOG(3) << "Write tuning result to " << path_;
-      std::ofstream ofs(path_, std::ios::binary | std::ios::out);
-      if (ofs.is_open()) {
-        int64_t num_pramas = param_table_.size();
-        ofs.write(reinterpret_cast<char *>(&num_pramas), sizeof(num_pramas));
+  // measured microseconds of candidates allowed in a run of a model
+  static constexpr double kOnlineTuningBudgetMicros = 2000;
+  // times each candidate is measured, the fastest time of them counts
+  static constexpr size_t kOnlineTuningSamples = 3;
+
+  struct OnlineTuningState {
+    std::vector<std::vector<param_type>> candidates;
+    std::vector<double> times;
+    std::vector<std::vector<param_type>> results;
+    size_t next_run = 0;
+  };
+
+  // Splits a key made by Concat(kernel name, dims...) into the name and the
+  // trailing numeric dims, false if it has none.
+  static bool ParseShapeKey(const std::string &param_key,
+                            std::string *name,
+                            std::vector<double> *dims) {
+    const std::string key = MACE_DEOBFUSCATE_SYMBOL(param_key);
+    size_t end = key.size();
+    dims->clear();
+    while (end > 0) {
+      size_t begin = key.rfind('_', end - 1);
+      if (begin == std::string::npos || begin + 1 == end) {
+        break;
+      }
+      const std::string token = key.substr(begin + 1, end - begin - 1);
+      if (token.find_first_not_of("0123456789") != std::string::npos) {
+        break;
+      }
+      dims->push_back(std::stod(token));
+      end = begin;
+    }
+    *name = key.substr(0, end);
+    return !dims->empty() && !name->empty();
+  }
+
+  // The parameters tuned for the nearest shape of the same kernel, fitted by
+  // fit_param to param_key's shape, and cached by param_key. The distance is
+  // the sum of the log ratios of the dims, so a shape twice as large in one
+  // dim is as near as a shape half as large.
+  bool NearestParam(
+      const std::string &param_key,
+      const std::function<bool(std::vector<param_type> *)> &fit_param,
+      std::vector<param_type> *param) {
+    std::lock_guard<std::mutex> lock(nearest_param_mutex_);
+    if (nearest_param_table_size_ != param_table_.size()) {
+      // tuned parameters were added since
+      nearest_param_table_.clear();
+      nearest_param_table_size_ = param_table_.size();
+    }
+    auto iter = nearest_param_table_.find(param_key);
+    if (iter == nearest_param_table_.end()) {
+      std::vector<param_type> nearest;
+      std::string name;
+      std::vector<double> dims;
+      if (ParseShapeKey(param_key, &name, &dims)) {
+        double min_distance = std::numeric_limits<double>::max();
+        std::string nearest_key;
+        std::string tuned_name;
+        std::vector<double> tuned_dims;
         for (auto &kp : param_table_) {
-          int32_t key_size = kp.first.size();
-          ofs.write(reinterpret_cast<char *>(&key_size), sizeof(key_size));
-          ofs.write(kp.first.c_str(), key_size);
-
-          auto &params = kp.second;
-          int32_t params_size = params.size() * sizeof(param_type);
-          ofs.write(reinterpret_cast<char *>(&params_size),
-                    sizeof(params_size));
-
-          VLOG(3) << "Write tuning param: " << kp.first.c_str() << ": "
-                  << (VLOG_IS_ON(3) ? MakeString(params) : "");
-          for (auto &param : params) {
-            ofs.write(reinterpret_cast<char *>(&param), sizeof(params_size));
+          if (!ParseShapeKey(kp.first, &tuned_name, &tuned_dims) ||
+              tuned_name != name || tuned_dims.size() != dims.size()) {
+            continue;
+          }
+          double distance = 0;
+          for (size_t i = 0; i < dims.size(); ++i) {
+            distance += std::fabs(std::log((dims[i] + 1) /
+                                           (tuned_dims[i] + 1)));
+          }
+          // the key breaks ties, the table is unordered
+          if (distance < min_distance ||
+              (distance == min_distance && kp.first < nearest_key)) {
+            min_distance = distance;
+            nearest_key = kp.first;
+            nearest = kp.second;
           }
         }
-        ofs.close();
-      } else {
-        LOG(WARNING) << "Write run parameter file failed.";
+      }
+      if (!nearest.empty() && !fit_param(&nearest)) {
+        nearest.clear();
+      }
+      // an empty entry records that there is none
+      iter = nearest_param_table_.emplace(param_key, nearest).first;
+    }
+    if (iter->second.empty()) {
+      return false;
+    }
+    *param = iter->second;
+    return true;
+  }
+
+  // Run the untuned param_key with the next candidate while the budget of
+  // this run lasts, else with the default parameters.
+  template <typename RetType>
+  RetType OnlineTuneOrRun(
+      const std::string &param_key,
+      const std::vector<param_type> &default_param,
+      const std::function<std::vector<std::vector<param_type>>()>
+          &param_generator,
+      const std::function<RetType(const std::vector<param_type> &,
+                                  Timer *,
+                                  std::vector<param_type> *)> &func,
+      Timer *timer) {
+    std::lock_guard<std::mutex> lock(online_tuning_mutex_);
+    auto param_iter = param_table_.find(param_key);
+    if (param_iter != param_table_.end()) {
+      return func(param_iter->second, nullptr, nullptr);
+    }
+    OnlineTuningState &state = online_tuning_states_[param_key];
+    if (state.candidates.empty()) {
+      state.candidates = param_generator();
+      if (state.candidates.empty()) {
+        state.candidates.push_back(default_param);
+      }
+      state.times.assign(state.candidates.size(),
+                         std::numeric_limits<double>::max());
+      state.results.resize(state.candidates.size());
+    }
+    if (online_tuning_micros_ >= kOnlineTuningBudgetMicros) {
+      return func(default_param, nullptr, nullptr);
+    }
+
+    const size_t idx = state.next_run % state.candidates.size();
+    std::vector<param_type> tuning_result;
+    RetType res = func(state.candidates[idx], timer, &tuning_result);
+    const double time = timer->AccumulatedMicros();
+    online_tuning_micros_ += time;
+    // a candidate failed to run measures no time
+    if (time > 0 && time < state.times[idx]) {
+      state.times[idx] = time;
+      state.results[idx] = tuning_result;
+    }
+    if (++state.next_run == state.candidates.size() * kOnlineTuningSamples) {
+      const size_t opt_idx = std::min_element(state.times.begin(),
+                                              state.times.end())
+          - state.times.begin();
+      const std::vector<param_type> &opt_param =
+          state.times[opt_idx] == std::numeric_limits<double>::max()
+          ? default_param : state.results[opt_idx];
+      VLOG(2) << "Online tuning " << param_key << " result: "
+              << MakeString(opt_param);
+      param_table_[param_key] = opt_param;
+      online_param_table_[param_key] = opt_param;
+      online_params_changed_ = true;
+      online_tuning_states_.erase(param_key);
+    }
+    return res;
+  }
+
+  inline bool WriteRunParameters(
+      const char *path,
+      const std::unordered_map<std::string, std::vector<param_type>>
+          &param_table) {
+    VLOG(3) << "Write tuning result to " << path;
+    std::ofstream ofs(path, std::ios::binary | std::ios::out);
+    if (!ofs.is_open()) {
+      LOG(WARNING) << "Write run parameter file failed.";
+      return false;
+    }
+    int64_t num_pramas = param_table.size();
+    ofs.write(reinterpret_cast<char *>(&num_pramas), sizeof(num_pramas));
+    for (auto &kp : param_table) {
+      int32_t key_size = kp.first.size();
+      ofs.write(reinterpret_cast<char *>(&key_size), sizeof(key_size));
+      ofs.write(kp.first.c_str(), key_size);
+
+      auto &params = kp.second;
+      int32_t params_size = params.size() * sizeof(param_type);
+      ofs.write(reinterpret_cast<char *>(&params_size),
+                sizeof(params_size));
+
+      VLOG(3) << "Write tuning param: " << kp.first.c_str() << ": "
+              << (VLOG_IS_ON(3) ? MakeString(params) : "");
+      for (auto &param : params) {
+        ofs.write(reinterpret_cast<const char *>(&param),
+                  sizeof(params_size));
       }
     }
+    ofs.close();
+    return !ofs.fail();
   }
 
-  inline void ParseData(const unsigned char *data, size_t data_size) {
+  inline void ParseData(
+      const unsigned char *data,
+      size_t data_size,
+      std::unordered_map<std::string, std::vector<param_type>> *param_table) {
     const size_t int_size = sizeof(int32_t);
     const size_t param_type_size = sizeof(param_type);
 
@@ -156,34 +369,36 @@ class Tuner {
       MACE_CHECK(parsed_offset <= data_size,
                  "Parsing tuned data out of range: ",
                  parsed_offset, " > ", data_size);
-      param_table_.emplace(key, params);
+      param_table->emplace(key, params);
     }
   }
 
-  inline void ReadRunParamters() {
-    if (!tuned_param_file_path_.empty()) {
+  inline void ReadRunParamters(
+      const std::string &tuned_param_file_path,
+      std::unordered_map<std::string, std::vector<param_type>> *param_table) {
+    if (!tuned_param_file_path.empty()) {
       struct stat st;
-      if (stat(tuned_param_file_path_.c_str(), &st) == -1) {
+      if (stat(tuned_param_file_path.c_str(), &st) == -1) {
         if (errno == ENOENT) {
-          VLOG(1) << "File " << tuned_param_file_path_
+          VLOG(1) << "File " << tuned_param_file_path
                   << " does not exist";
         } else {
-          LOG(WARNING) << "Stat file " << tuned_param_file_path_
+          LOG(WARNING) << "Stat file " << tuned_param_file_path
                        << " failed, error code: " << strerror(errno);
         }
         return;
       } else if (!S_ISREG(st.st_mode)) {
-        VLOG(1) << "The path " << tuned_param_file_path_
+        VLOG(1) << "The path " << tuned_param_file_path
                 << " is not a file";
         return;
       }
-      int fd = open(tuned_param_file_path_.c_str(), O_RDONLY);
+      int fd = open(tuned_param_file_path.c_str(), O_RDONLY);
       if (fd < 0) {
         if (errno == ENOENT) {
-          LOG(INFO) << "File " << tuned_param_file_path_
+          LOG(INFO) << "File " << tuned_param_file_path
                     << " does not exist";
         } else {
-          LOG(WARNING) << "open file " << tuned_param_file_path_
+          LOG(WARNING) << "open file " << tuned_param_file_path
                        << " failed, error code: " << strerror(errno);
         }
         return;
@@ -194,32 +409,32 @@ class Tuner {
                                             MAP_PRIVATE, fd, 0));
       int res = 0;
       if (file_data == MAP_FAILED) {
-        LOG(WARNING) << "mmap file " << tuned_param_file_path_
+        LOG(WARNING) << "mmap file " << tuned_param_file_path
                      << " failed, error code: " << strerror(errno);
 
         res = close(fd);
         if (res != 0) {
-          LOG(WARNING) << "close file " << tuned_param_file_path_
+          LOG(WARNING) << "close file " << tuned_param_file_path
                        << " failed, error code: " << strerror(errno);
         }
         return;
       }
 
-      ParseData(file_data, file_size);
+      ParseData(file_data, file_size, param_table);
       res = munmap(file_data, file_size);
       if (res != 0) {
-        LOG(WARNING) << "munmap file " << tuned_param_file_path_
+        LOG(WARNING) << "munmap file " << tuned_param_file_path
                      << " failed, error code: " << strerror(errno);
         res = close(fd);
         if (res != 0) {
-          LOG(WARNING) << "close file " << tuned_param_file_path_
+          LOG(WARNING) << "close file " << tuned_param_file_path
                        << " failed, error code: " << strerror(errno);
         }
         return;
       }
       res = close(fd);
       if (res != 0) {
-        LOG(WARNING) << "close file " << tuned_param_file_path_
+        LOG(WARNING) << "close file " << tuned_param_file_path
                      << " failed, error code: " << strerror(errno);
         return;
       }
@@ -290,6 +505,18 @@ class Tuner {
   std::string tuned_param_file_path_;
   const char *path_;
   std::unordered_map<std::string, std::vector<param_type>> param_table_;
+  // the parameters settled by online tuning, persisted on their own
+  std::string online_tuned_param_file_path_;
+  std::unordered_map<std::string, std::vector<param_type>> online_param_table_;
+  std::unordered_map<std::string, OnlineTuningState> online_tuning_states_;
+  double online_tuning_micros_;
+  bool online_params_changed_;
+  std::mutex online_tuning_mutex_;
+  // the fitted parameters of the nearest tuned shapes of untuned keys
+  std::mutex nearest_param_mutex_;
+  std::unordered_map<std::string, std::vector<param_type>>
+      nearest_param_table_;
+  size_t nearest_param_table_size_;
 };
 
 }  // namespace mace
@@ -12,7 +12,11 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <cstring>
+#include <string>
 #include <thread>  // NOLINT(build/c++11)
+#include <utility>
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -101,4 +105,124 @@ TEST_F(TunerTest, SimpleTune) {
   EXPECT_EQ(expect, res);
 }
 
+TEST_F(TunerTest, OnlineTune) {
+  setenv("MACE_TUNING", "0", 1);
+  setenv("MACE_ONLINE_TUNING", "1", 1);
+  const std::string online_param_path = "/data/local/tmp/mace_online.config";
+  remove(online_param_path.c_str());
+  unsigned int expect = 3;
+  int timed_runs = 0;
+  auto TunerFunc = [&](const std::vector<unsigned int> &params, Timer *timer,
+                       std::vector<uint32_t> *tuning_result) -> int {
+    if (timer) {
+      ++timed_runs;
+      timer->ClearTiming();
+      timer->StartTiming();
+    }
+    if (params.front() != expect) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    } else {
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    if (timer) {
+      timer->AccumulateTiming();
+      tuning_result->assign(params.begin(), params.end());
+    }
+    return params.front();
+  };
+  std::vector<unsigned int> default_params(1, 1);
+  auto params_generator = []() -> std::vector<std::vector<unsigned int>> {
+    return {{1}, {2}, {3}, {4}};
+  };
+
+  {
+    Tuner<unsigned int> tuner("", nullptr, 0, online_param_path);
+    WallClockTimer timer;
+    // the slow candidates exhaust the budget, a run times one of them
+    int res = tuner.TuneOrRun<int>(
+        "OnlineTune", default_params, params_generator, TunerFunc, &timer);
+    EXPECT_EQ(1, res);
+    res = tuner.TuneOrRun<int>(
+        "OnlineTune", default_params, params_generator, TunerFunc, &timer);
+    EXPECT_EQ(1, res);
+    EXPECT_EQ(1, timed_runs);
+    for (int i = 0; i < 20; ++i) {
+      tuner.FinishRun();
+      tuner.TuneOrRun<int>(
+          "OnlineTune", default_params, params_generator, TunerFunc, &timer);
+    }
+    EXPECT_EQ(12, timed_runs);
+    res = tuner.TuneOrRun<int>(
+        "OnlineTune", default_params, params_generator, TunerFunc, &timer);
+    EXPECT_EQ(expect, res);
+    tuner.FinishRun();
+  }
+
+  // the settled parameters are loaded by the next tuner
+  Tuner<unsigned int> tuner("", nullptr, 0, online_param_path);
+  WallClockTimer timer;
+  int res = tuner.TuneOrRun<int>(
+      "OnlineTune", default_params, nullptr, TunerFunc, &timer);
+  EXPECT_EQ(expect, res);
+  unsetenv("MACE_ONLINE_TUNING");
+}
+
+TEST_F(TunerTest, NearestShape) {
+  setenv("MACE_TUNING", "0", 1);
+  unsetenv("MACE_RUN_PARAMETER_PATH");
+  // the tuned parameters of two shapes of a kernel
+  const std::vector<std::pair<std::string, unsigned int>> tuned = {
+      {"kernel_1_16_16", 2}, {"kernel_1_64_64", 4}};
+  std::vector<unsigned char> data(sizeof(int64_t));
+  int64_t num_params = tuned.size();
+  memcpy(data.data(), &num_params, sizeof(num_params));
+  for (auto &kp : tuned) {
+    const std::string key = MACE_OBFUSCATE_SYMBOL(kp.first);
+    const int32_t key_size = key.size();
+    const int32_t params_size = sizeof(unsigned int);
+    const size_t offset = data.size();
+    data.resize(offset + 2 * sizeof(int32_t) + key_size + params_size);
+    unsigned char *ptr = data.data() + offset;
+    memcpy(ptr, &key_size, sizeof(key_size));
+    memcpy(ptr + sizeof(key_size), key.data(), key_size);
+    ptr += sizeof(key_size) + key_size;
+    memcpy(ptr, &params_size, sizeof(params_size));
+    memcpy(ptr + sizeof(params_size), &kp.second, params_size);
+  }
+
+  auto TunerFunc = [&](const std::vector<unsigned int> &params, Timer *timer,
+                       std::vector<uint32_t> *tuning_result) -> int {
+    (void)(timer);
+    (void)(tuning_result);
+    return params.front();
+  };
+  int fitted = 0;
+  auto FitParam = [&](std::vector<unsigned int> *params) -> bool {
+    ++fitted;
+    (*params)[0] *= 10;
+    return true;
+  };
+  Tuner<unsigned int> tuner("", data.data(), data.size());
+  WallClockTimer timer;
+  std::vector<unsigned int> default_params(1, 1);
+  // a tuned shape runs its parameters
+  EXPECT_EQ(4, tuner.TuneOrRun<int>("kernel_1_64_64", default_params, nullptr,
+                                    TunerFunc, &timer, FitParam));
+  // untuned shapes run the fitted parameters of the nearest tuned one
+  EXPECT_EQ(20, tuner.TuneOrRun<int>("kernel_1_20_24", default_params,
+                                     nullptr, TunerFunc, &timer, FitParam));
+  EXPECT_EQ(40, tuner.TuneOrRun<int>("kernel_1_48_56", default_params,
+                                     nullptr, TunerFunc, &timer, FitParam));
+  EXPECT_EQ(40, tuner.TuneOrRun<int>("kernel_1_48_56", default_params,
+                                     nullptr, TunerFunc, &timer, FitParam));
+  EXPECT_EQ(2, fitted);
+  // not without a fitting, for another kernel or another rank
+  EXPECT_EQ(1, tuner.TuneOrRun<int>("kernel_1_20_24", default_params,
+                                    nullptr, TunerFunc, &timer));
+  EXPECT_EQ(1, tuner.TuneOrRun<int>("other_1_20_24", default_params,
+                                    nullptr, TunerFunc, &timer, FitParam));
+  EXPECT_EQ(1, tuner.TuneOrRun<int>("kernel_20_24", default_params,
+                                    nullptr, TunerFunc, &timer, FitParam));
+}
+
 }  // namespace mace
@@ -27,24 +27,78 @@
 #include <utility>
 #include <vector>
 
+#if defined(MACE_ENABLE_NEON)
+#include <arm_neon.h>
+#endif
+
 #include "mace/utils/logging.h"
 
 namespace mace {
 
+namespace {
+const char kObfuscateLookupTable[] = "Mobile-AI-Compute-Engine";
+
+void ObfuscateBytes(const char *src,
+                    size_t size,
+                    const std::string &lookup_table,
+                    char *dest) {
+  const size_t table_size = lookup_table.size();
+  if (table_size == 0) {
+    std::copy(src, src + size, dest);
+    return;
+  }
+  size_t i = 0;
+  // the table repeated over whole vectors of 16 bytes, to xor a period of
+  // it at a time instead of a byte and a modulo
+  size_t period = table_size;
+  while (period % 16 != 0) {
+    period += table_size;
+  }
+  if (size >= period) {
+    std::vector<unsigned char> keys(period);
+    for (size_t k = 0; k < period; ++k) {
+      keys[k] = static_cast<unsigned char>(lookup_table[k % table_size]);
+    }
+    const unsigned char *in = reinterpret_cast<const unsigned char *>(src);
+    unsigned char *out = reinterpret_cast<unsigned char *>(dest);
+    for (; i + period <= size; i += period) {
+#if defined(MACE_ENABLE_NEON)
+      for (size_t k = 0; k < period; k += 16) {
+        vst1q_u8(out + i + k,
+                 veorq_u8(vld1q_u8(in + i + k), vld1q_u8(keys.data() + k)));
+      }
+#else
+      for (size_t k = 0; k < period; ++k) {
+        out[i + k] = in[i + k] ^ keys[k];
+      }
+#endif  // MACE_ENABLE_NEON
+    }
+  }
+  for (size_t k = i % table_size; i < size; ++i) {
+    dest[i] = src[i] ^ lookup_table[k];
+    if (++k == table_size) {
+      k = 0;
+    }
+  }
+}
+}  // namespace
+
 std::string ObfuscateString(const std::string &src,
                             const std::string &lookup_table) {
   std::string dest;
   dest.resize(src.size());
-  for (size_t i = 0; i < src.size(); i++) {
-    dest[i] = src[i] ^ lookup_table[i % lookup_table.size()];
-  }
+  ObfuscateBytes(src.data(), src.size(), lookup_table, &dest[0]);
   return dest;
 }
 
 // ObfuscateString(ObfuscateString(str)) ==> str
 std::string ObfuscateString(const std::string &src) {
   // Keep consistent with obfuscation in python tools
-  return ObfuscateString(src, "Mobile-AI-Compute-Engine");
+  return ObfuscateString(src, kObfuscateLookupTable);
+}
+
+void ObfuscateBytes(const char *src, size_t size, char *dest) {
+  ObfuscateBytes(src, size, kObfuscateLookupTable, dest);
 }
 
 // Obfuscate synbol or path string
@@ -77,6 +131,31 @@ std::string ObfuscateSymbol(const std::string &src) {
   return dest;
 }
 
+// The inverse of ObfuscateSymbol for symbols of digits, lower case letters
+// and underscores
+std::string DeobfuscateSymbol(const std::string &src) {
+  std::string dest = src;
+  const std::string encode_dict =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789_";
+  const int dict_size = static_cast<int>(encode_dict.size());
+  for (size_t i = 1; i < src.size(); i++) {
+    size_t pos = encode_dict.find(src[i]);
+    if (pos == std::string::npos) {
+      continue;
+    }
+    int idx = (static_cast<int>(pos) - static_cast<int>(i % dict_size) - 31
+        + 2 * dict_size) % dict_size;
+    if (idx < 10) {
+      dest[i] = static_cast<char>('0' + idx);
+    } else if (idx < 10 + 26) {
+      dest[i] = static_cast<char>('a' + idx - 10);
+    } else {
+      dest[i] = '_';
+    }
+  }
+  return dest;
+}
+
 std::vector<std::string> Split(const std::string &str, char delims) {
   std::vector<std::string> result;
   std::string tmp = str;
@@ -100,14 +100,22 @@ inline T ScalarTanh(T in) {
 
 std::string ObfuscateString(const std::string &src);
 
+// ObfuscateString of the size bytes of src into dest, which may be src
+// itself, without the copies of the strings.
+void ObfuscateBytes(const char *src, size_t size, char *dest);
+
 std::string ObfuscateSymbol(const std::string &src);
 
+std::string DeobfuscateSymbol(const std::string &src);
+
 #ifdef MACE_OBFUSCATE_LITERALS
 #define MACE_OBFUSCATE_STRING(str) ObfuscateString(str)
 #define MACE_OBFUSCATE_SYMBOL(str) ObfuscateSymbol(str)
+#define MACE_DEOBFUSCATE_SYMBOL(str) DeobfuscateSymbol(str)
 #else
 #define MACE_OBFUSCATE_STRING(str) (str)
 #define MACE_OBFUSCATE_SYMBOL(str) (str)
+#define MACE_DEOBFUSCATE_SYMBOL(str) (str)
 #endif
 
 std::vector<std::string> Split(const std::string &str, char delims);
@@ -26,8 +26,11 @@ def _opencl_encrypt_kernel_impl(repository_ctx):
     )
     if ret.return_code == 0:
         unused_var = repository_ctx.path(Label("//:mace/ops/opencl/cl/activation.cl"))
+        unused_var = repository_ctx.path(Label("//:mace/ops/opencl/cl/activation_buffer.cl"))
         unused_var = repository_ctx.path(Label("//:mace/ops/opencl/cl/addn.cl"))
+        unused_var = repository_ctx.path(Label("//:mace/ops/opencl/cl/attention.cl"))
         unused_var = repository_ctx.path(Label("//:mace/ops/opencl/cl/batch_norm.cl"))
+        unused_var = repository_ctx.path(Label("//:mace/ops/opencl/cl/batch_norm_buffer.cl"))
         unused_var = repository_ctx.path(Label("//:mace/ops/opencl/cl/batch_to_space.cl"))
         unused_var = repository_ctx.path(Label("//:mace/ops/opencl/cl/bias_add.cl"))
         unused_var = repository_ctx.path(Label("//:mace/ops/opencl/cl/buffer_to_image.cl"))
@@ -47,7 +50,10 @@ def _opencl_encrypt_kernel_impl(repository_ctx):
         unused_var = repository_ctx.path(Label("//:mace/ops/opencl/cl/depthwise_conv2d.cl"))
         unused_var = repository_ctx.path(Label("//:mace/ops/opencl/cl/depthwise_conv2d_buffer.cl"))
         unused_var = repository_ctx.path(Label("//:mace/ops/opencl/cl/eltwise.cl"))
+        unused_var = repository_ctx.path(Label("//:mace/ops/opencl/cl/eltwise_buffer.cl"))
+        unused_var = repository_ctx.path(Label("//:mace/ops/opencl/cl/fused_elementwise.cl"))
         unused_var = repository_ctx.path(Label("//:mace/ops/opencl/cl/fully_connected.cl"))
+        unused_var = repository_ctx.path(Label("//:mace/ops/opencl/cl/layer_norm.cl"))
         unused_var = repository_ctx.path(Label("//:mace/ops/opencl/cl/lstmcell.cl"))
         unused_var = repository_ctx.path(Label("//:mace/ops/opencl/cl/matmul.cl"))
         unused_var = repository_ctx.path(Label("//:mace/ops/opencl/cl/pad.cl"))
@@ -65,6 +71,15 @@ def _opencl_encrypt_kernel_impl(repository_ctx):
         unused_var = repository_ctx.path(Label("//:mace/ops/opencl/cl/sqrdiff_mean.cl"))
         unused_var = repository_ctx.path(Label("//:mace/ops/opencl/cl/winograd_transform.cl"))
 
+    # written by the converter for selective build
+    cl_kernel_names_file = ""
+    ret = repository_ctx.execute(
+        ["test", "-f", "%s/mace/codegen/ops/opencl_kernels" % mace_root_path],
+    )
+    if ret.return_code == 0:
+        unused_var = repository_ctx.path(Label("//:mace/codegen/ops/opencl_kernels"))
+        cl_kernel_names_file = "%s/mace/codegen/ops/opencl_kernels" % mace_root_path
+
     python_bin_path = repository_ctx.which("python")
 
     repository_ctx.execute([
@@ -72,6 +87,7 @@ def _opencl_encrypt_kernel_impl(repository_ctx):
         "%s/mace/python/tools/encrypt_opencl_codegen.py" % mace_root_path,
         "--cl_kernel_dir=%s/mace/ops/opencl/cl" % mace_root_path,
         "--output_path=%s/encrypt_opencl_kernel" % generated_files_path,
+        "--cl_kernel_names_file=%s" % cl_kernel_names_file,
     ], quiet = False)
 
 encrypt_opencl_kernel_repository = repository_rule(
@@ -365,6 +365,7 @@ class YAMLKeyword(object):
     target_socs = 'target_socs'
     model_graph_format = 'model_graph_format'
     model_data_format = 'model_data_format'
+    selective_build = 'selective_build'
     models = 'models'
     platform = 'platform'
     device_name = 'device_name'
@@ -395,11 +396,18 @@ class YAMLKeyword(object):
     winograd = 'winograd'
     quantize = 'quantize'
     quantize_range_file = 'quantize_range_file'
+    quantize_per_channel = 'quantize_per_channel'
+    quantize_embedding = 'quantize_embedding'
+    palettize_weights = 'palettize_weights'
+    weight_only_quantize = 'weight_only_quantize'
+    quantize_8x16 = 'quantize_8x16'
     change_concat_ranges = 'change_concat_ranges'
     validation_inputs_data = 'validation_inputs_data'
     validation_threshold = 'validation_threshold'
     graph_optimize_options = 'graph_optimize_options'  # internal use for now
     cl_mem_type = 'cl_mem_type'
+    fp32_ops = 'fp32_ops'
+    aot = 'aot'
     backend = 'backend'
     validation_outputs_data = 'validation_outputs_data'
     docker_image_tag = 'docker_image_tag'
@@ -450,6 +458,7 @@ MODEL_CODEGEN_DIR = CODEGEN_BASE_DIR + '/models'
 ENGINE_CODEGEN_DIR = CODEGEN_BASE_DIR + '/engine'
 LIB_CODEGEN_DIR = CODEGEN_BASE_DIR + '/lib'
 OPENCL_CODEGEN_DIR = CODEGEN_BASE_DIR + '/opencl'
+OPS_CODEGEN_DIR = CODEGEN_BASE_DIR + '/ops'
 LIBMACE_SO_TARGET = "//mace/libmace:libmace.so"
 LIBMACE_STATIC_TARGET = "//mace/libmace:libmace_static"
 LIBMACE_STATIC_PATH = "bazel-genfiles/mace/libmace/libmace.a"
@@ -13,6 +13,7 @@
 # limitations under the License.
 
 import argparse
+import copy
 import glob
 import hashlib
 import os
@@ -93,6 +94,9 @@ DSPDataType = Enum('DSPDataType', [(ele, ele) for ele in DSPDataTypeStrs],
 
 WinogradParameters = [0, 2, 4]
 
+PalettizeBits = [0, 2, 4, 6, 8]
+WeightOnlyBits = [0, 4, 8]
+
 DataFormatStrs = [
     "NONE",
     "NHWC",
@@ -194,6 +198,10 @@ def get_quantize_mode(configs):
     return False
 
 
+def get_selective_build_mode(configs):
+    return configs[YAMLKeyword.selective_build] == 1
+
+
 def md5sum(str):
     md5 = hashlib.md5()
     md5.update(str.encode('utf-8'))
@@ -284,6 +292,9 @@ def format_model_config(flags):
                "If model_graph format is 'file',"
                " the model_data_format must be 'file' too")
 
+    configs[YAMLKeyword.selective_build] = \
+        configs.get(YAMLKeyword.selective_build, 0)
+
     model_names = configs.get(YAMLKeyword.models, [])
     mace_check(len(model_names) > 0, ModuleName.YAML_CONFIG,
                "no model found in config file")
@@ -498,17 +509,40 @@ def format_model_config(flags):
                     YAMLKeyword.obfuscate,
                     YAMLKeyword.winograd,
                     YAMLKeyword.quantize,
-                    YAMLKeyword.change_concat_ranges]:
+                    YAMLKeyword.quantize_per_channel,
+                    YAMLKeyword.quantize_embedding,
+                    YAMLKeyword.palettize_weights,
+                    YAMLKeyword.weight_only_quantize,
+                    YAMLKeyword.quantize_8x16,
+                    YAMLKeyword.change_concat_ranges,
+                    YAMLKeyword.aot]:
             value = model_config.get(key, "")
             if value == "":
                 model_config[key] = 0
 
+        mace_check(not model_config[YAMLKeyword.aot] or
+                   model_graph_format == ModelFormat.code,
+                   ModuleName.YAML_CONFIG,
+                   "'aot' needs the 'code' model_graph_format")
+
         mace_check(model_config[YAMLKeyword.winograd] in WinogradParameters,
                    ModuleName.YAML_CONFIG,
                    "'winograd' parameters must be in "
                    + str(WinogradParameters) +
                    ". 0 for disable winograd convolution")
 
+        mace_check(model_config[YAMLKeyword.palettize_weights] in
+                   PalettizeBits,
+                   ModuleName.YAML_CONFIG,
+                   "'palettize_weights' must be in " + str(PalettizeBits) +
+                   ". 0 for disable weight palettization")
+
+        mace_check(model_config[YAMLKeyword.weight_only_quantize] in
+                   WeightOnlyBits,
+                   ModuleName.YAML_CONFIG,
+                   "'weight_only_quantize' must be in " + str(WeightOnlyBits) +
+                   ". 0 for disable weight-only quantization")
+
         weight_file_path = model_config.get(YAMLKeyword.weight_file_path, "")
         model_config[YAMLKeyword.weight_file_path] = weight_file_path
 
@@ -549,6 +583,8 @@ def print_configuration(configs):
                  configs[YAMLKeyword.model_graph_format]])
     data.append([YAMLKeyword.model_data_format,
                  configs[YAMLKeyword.model_data_format]])
+    data.append([YAMLKeyword.selective_build,
+                 configs[YAMLKeyword.selective_build]])
     MaceLogger.summary(StringFormatter.table(header, data, title))
 
 
@@ -704,12 +740,19 @@ def convert_model(configs, cl_mem_type):
             model_config[YAMLKeyword.winograd],
             model_config[YAMLKeyword.quantize],
             quantize_range_file_path,
+            model_config[YAMLKeyword.quantize_per_channel],
+            model_config[YAMLKeyword.quantize_embedding],
+            model_config[YAMLKeyword.palettize_weights],
+            model_config[YAMLKeyword.weight_only_quantize],
+            model_config[YAMLKeyword.quantize_8x16],
             model_config[YAMLKeyword.change_concat_ranges],
             model_config[YAMLKeyword.obfuscate],
             configs[YAMLKeyword.model_graph_format],
             data_type,
             model_config[YAMLKeyword.cl_mem_type],
-            ",".join(model_config.get(YAMLKeyword.graph_optimize_options, [])))
+            ",".join(model_config.get(YAMLKeyword.graph_optimize_options, [])),
+            ",".join(model_config.get(YAMLKeyword.fp32_ops, [])),
+            model_config[YAMLKeyword.aot])
 
         if configs[YAMLKeyword.model_graph_format] == ModelFormat.file:
             sh.mv("-f",
@@ -729,6 +772,12 @@ def convert_model(configs, cl_mem_type):
         MaceLogger.summary(
             StringFormatter.block("Model %s converted" % model_name))
 
+    if os.path.exists(OPS_CODEGEN_DIR):
+        sh.rm("-rf", OPS_CODEGEN_DIR)
+    if get_selective_build_mode(configs):
+        sh_commands.gen_selected_ops_source(
+            glob.glob("%s/*/*.ops" % MODEL_CODEGEN_DIR), OPS_CODEGEN_DIR)
+
 
 def build_model_lib(configs, address_sanitizer):
     MaceLogger.header(StringFormatter.block("Building model library"))
@@ -750,6 +799,7 @@ def build_model_lib(configs, address_sanitizer):
             hexagon_mode=hexagon_mode,
             enable_opencl=get_opencl_mode(configs),
             enable_quantize=get_quantize_mode(configs),
+            selective_build=get_selective_build_mode(configs),
             address_sanitizer=address_sanitizer,
             symbol_hidden=True
         )
@@ -865,6 +915,7 @@ def build_mace_run(configs, target_abi, toolchain, enable_openmp,
         enable_openmp=enable_openmp,
         enable_opencl=get_opencl_mode(configs),
         enable_quantize=get_quantize_mode(configs),
+        selective_build=get_selective_build_mode(configs),
         address_sanitizer=address_sanitizer,
         symbol_hidden=symbol_hidden,
         extra_args=build_arg
@@ -910,6 +961,7 @@ def build_example(configs, target_abi, toolchain,
                             enable_openmp=enable_openmp,
                             enable_opencl=get_opencl_mode(configs),
                             enable_quantize=get_quantize_mode(configs),
+                            selective_build=get_selective_build_mode(configs),
                             hexagon_mode=hexagon_mode,
                             address_sanitizer=flags.address_sanitizer,
                             symbol_hidden=symbol_hidden)
@@ -941,6 +993,7 @@ def build_example(configs, target_abi, toolchain,
                             enable_openmp=enable_openmp,
                             enable_opencl=get_opencl_mode(configs),
                             enable_quantize=get_quantize_mode(configs),
+                            selective_build=get_selective_build_mode(configs),
                             hexagon_mode=hexagon_mode,
                             address_sanitizer=flags.address_sanitizer,
                             extra_args=build_arg)
@@ -966,6 +1019,15 @@ def run_mace(flags):
 
     clear_build_dirs(configs[YAMLKeyword.library_name])
 
+    run_model_on_devices(flags, configs)
+
+    # package the output files
+    package_path = sh_commands.packaging_lib(BUILD_OUTPUT_DIR,
+                                             configs[YAMLKeyword.library_name])
+    print_package_summary(package_path)
+
+
+def run_model_on_devices(flags, configs):
     target_socs = configs[YAMLKeyword.target_socs]
     device_list = DeviceManager.list_devices(flags.device_yml)
     if target_socs and TargetSOCTag.all not in target_socs:
@@ -1006,11 +1068,6 @@ def run_mace(flags):
                            (dev[YAMLKeyword.target_socs], target_abi),
                            file=sys.stderr)
 
-    # package the output files
-    package_path = sh_commands.packaging_lib(BUILD_OUTPUT_DIR,
-                                             configs[YAMLKeyword.library_name])
-    print_package_summary(package_path)
-
 
 ################################
 #  benchmark model
@@ -1044,6 +1101,7 @@ def build_benchmark_model(configs,
                             enable_openmp=enable_openmp,
                             enable_opencl=get_opencl_mode(configs),
                             enable_quantize=get_quantize_mode(configs),
+                            selective_build=get_selective_build_mode(configs),
                             hexagon_mode=hexagon_mode,
                             symbol_hidden=symbol_hidden,
                             extra_args=build_arg)
@@ -1091,6 +1149,150 @@ def benchmark_model(flags):
                            file=sys.stderr)
 
 
+################################
+#  sweep
+################################
+# name: (runtime, data_type, quantize)
+SweepConfigs = {
+    "cpu_fp32": (RuntimeType.cpu, FPDataType.fp32_fp32.value, 0),
+    "gpu_fp16": (RuntimeType.gpu, FPDataType.fp16_fp32.value, 0),
+    "gpu_fp32": (RuntimeType.gpu, FPDataType.fp32_fp32.value, 0),
+    "cpu_int8": (RuntimeType.cpu, FPDataType.fp32_fp32.value, 1),
+    "dsp_uint8": (RuntimeType.dsp, DSPDataType.uint8.value, 1),
+}
+SweepConfigNames = ["cpu_fp32", "gpu_fp16", "gpu_fp32",
+                    "cpu_int8", "dsp_uint8"]
+
+
+def sweep_supported(configs, runtime, quantize):
+    if ABIType.host in configs[YAMLKeyword.target_abis] \
+            and runtime != RuntimeType.cpu:
+        return False
+    if quantize == 1:
+        # the ranges of the activations are needed
+        for model_config in configs[YAMLKeyword.models].values():
+            if not model_config.get(YAMLKeyword.quantize_range_file, "") \
+                    and model_config[YAMLKeyword.quantize] != 1:
+                return False
+    return True
+
+
+def read_csv(path):
+    if not os.path.exists(path):
+        return []
+    with open(path) as f:
+        lines = [line.strip().split(',') for line in f if line.strip()]
+    return [dict(zip(lines[0], line)) for line in lines[1:]]
+
+
+def sweep_results(config_name, runtime, output_dir, num_outputs):
+    """The latency of the whole model and the errors of its layers, per
+    device, from the report and the validation logs of the runs."""
+    results = {}
+    for row in read_csv(output_dir + "/report.csv"):
+        # the whole model is run after its layers
+        results[row["device_name"]] = {
+            "config": config_name,
+            "run_avg(ms)": float(row["run_avg(ms)"]),
+        }
+    for device_name, result in six.iteritems(results):
+        layers = read_csv("%s/%s/%s/log.csv" %
+                          (output_dir, device_name, runtime))
+        similarities = [float(layer["similarity"]) for layer in layers]
+        outputs = layers[-num_outputs:] if layers else []
+        result["similarity"] = min(
+            [float(output["similarity"]) for output in outputs] or [0])
+        result["sqnr"] = min(
+            [float(output["sqnr"]) for output in outputs] or [0])
+        worst = similarities.index(min(similarities)) if layers else -1
+        result["worst_layer"] = \
+            layers[worst]["output_name"] if layers else ""
+        result["worst_similarity"] = similarities[worst] if layers else 0
+    return results
+
+
+def pareto_frontier(results):
+    """The results no other one is both faster and more accurate than."""
+    frontier = []
+    for result in results:
+        dominated = False
+        for other in results:
+            if other["run_avg(ms)"] <= result["run_avg(ms)"] \
+                    and other["similarity"] >= result["similarity"] \
+                    and (other["run_avg(ms)"] < result["run_avg(ms)"]
+                         or other["similarity"] > result["similarity"]):
+                dominated = True
+                break
+        if not dominated:
+            frontier.append(result)
+    return frontier
+
+
+def sweep_model(flags):
+    base_configs = format_model_config(flags)
+    library_name = base_configs[YAMLKeyword.library_name]
+    if base_configs[YAMLKeyword.model_graph_format] != ModelFormat.file:
+        MaceLogger.warning("The layers are validated with model format "
+                           "'file' only, the outputs are validated instead")
+        flags.layers = "-1"
+    sweep_dir = "%s/%s_sweep" % (BUILD_OUTPUT_DIR, library_name)
+    if os.path.exists(sweep_dir):
+        sh.rm("-rf", sweep_dir)
+    os.makedirs(sweep_dir)
+
+    num_outputs = 0
+    for model_config in base_configs[YAMLKeyword.models].values():
+        subgraph = model_config[YAMLKeyword.subgraphs][0]
+        num_outputs = max(num_outputs, len(
+            subgraph[YAMLKeyword.check_tensors] or
+            subgraph[YAMLKeyword.output_tensors]))
+
+    results = {}
+    for config_name in flags.sweep_configs.split(','):
+        mace_check(config_name in SweepConfigs, ModuleName.RUN,
+                   "sweep config must be in " + str(SweepConfigNames))
+        runtime, data_type, quantize = SweepConfigs[config_name]
+        if not sweep_supported(base_configs, runtime, quantize):
+            MaceLogger.warning("Skip unsupported sweep config %s"
+                               % config_name)
+            continue
+        MaceLogger.header(StringFormatter.block("Sweep " + config_name))
+        configs = copy.deepcopy(base_configs)
+        for model_config in configs[YAMLKeyword.models].values():
+            model_config[YAMLKeyword.runtime] = runtime
+            model_config[YAMLKeyword.data_type] = data_type
+            model_config[YAMLKeyword.quantize] = quantize
+        output_dir = "%s/%s" % (sweep_dir, config_name)
+        os.makedirs(output_dir)
+        flags.report_dir = output_dir
+        flags.layers_log_dir = output_dir
+
+        clear_build_dirs(library_name)
+        convert_model(configs, flags.cl_mem_type)
+        if configs[YAMLKeyword.model_graph_format] == ModelFormat.code:
+            build_model_lib(configs, flags.address_sanitizer)
+        run_model_on_devices(flags, configs)
+
+        for device_name, result in six.iteritems(sweep_results(
+                config_name, runtime, output_dir, num_outputs)):
+            results.setdefault(device_name, []).append(result)
+
+    header = ["device", "config", "run_avg(ms)", "similarity", "sqnr",
+              "worst_layer", "worst_similarity", "pareto"]
+    data = []
+    for device_name, device_results in six.iteritems(results):
+        frontier = pareto_frontier(device_results)
+        for result in device_results:
+            data.append([device_name] + [str(result[key])
+                                         for key in header[1:-1]] +
+                        [str(result in frontier)])
+    with open(sweep_dir + "/sweep.csv", 'w') as f:
+        f.write(",".join(header) + "\n")
+        for row in data:
+            f.write(",".join(row) + "\n")
+    MaceLogger.summary(StringFormatter.table(header, data, "Sweep"))
+
+
 ################################
 # parsing arguments
 ################################
@@ -1191,100 +1393,107 @@ def parse_args():
         default='',
         help='embedded linux device config yml file'
     )
-    parser = argparse.ArgumentParser()
-    subparsers = parser.add_subparsers()
-    convert = subparsers.add_parser(
-        'convert',
-        parents=[all_type_parent_parser, convert_run_parent_parser],
-        help='convert to mace model (file or code)')
-    convert.add_argument(
-        "--cl_mem_type",
-        type=str,
-        default=None,
-        help="Which type of OpenCL memory type to use [image | buffer].")
-    convert.set_defaults(func=convert_func)
-    run = subparsers.add_parser(
-        'run',
-        parents=[all_type_parent_parser, run_bm_parent_parser,
-                 convert_run_parent_parser],
-        help='run model in command line')
-    run.set_defaults(func=run_mace)
-    run.add_argument(
+    run_parent_parser = argparse.ArgumentParser(add_help=False)
+    run_parent_parser.add_argument(
         "--disable_tuning",
         action="store_true",
         help="Disable tuning for specific thread.")
-    run.add_argument(
+    run_parent_parser.add_argument(
         "--round",
         type=int,
         default=1,
         help="The model running round.")
-    run.add_argument(
+    run_parent_parser.add_argument(
         "--validate",
         action="store_true",
         help="whether to verify the results are consistent with "
              "the frameworks.")
-    run.add_argument(
+    run_parent_parser.add_argument(
         "--layers",
         type=str,
         default="-1",
         help="'start_layer:end_layer' or 'layer', similar to python slice."
              " Use with --validate flag.")
-    run.add_argument(
+    run_parent_parser.add_argument(
         "--caffe_env",
         type=str_to_caffe_env_type,
         default='docker',
         help="[docker | local] you can specific caffe environment for"
              " validation. local environment or caffe docker image.")
-    run.add_argument(
+    run_parent_parser.add_argument(
         "--vlog_level",
         type=int,
         default=0,
         help="[1~5]. Verbose log level for debug.")
-    run.add_argument(
+    run_parent_parser.add_argument(
         "--gpu_out_of_range_check",
         action="store_true",
         help="Enable out of memory check for gpu.")
-    run.add_argument(
+    run_parent_parser.add_argument(
         "--restart_round",
         type=int,
         default=1,
         help="restart round between run.")
-    run.add_argument(
+    run_parent_parser.add_argument(
         "--report",
         action="store_true",
         help="print run statistics report.")
-    run.add_argument(
+    run_parent_parser.add_argument(
         "--report_dir",
         type=str,
         default="",
         help="print run statistics report.")
-    run.add_argument(
+    run_parent_parser.add_argument(
         "--runtime_failure_ratio",
         type=float,
         default=0.0,
         help="[mock runtime failure ratio].")
-    run.add_argument(
+    run_parent_parser.add_argument(
         "--example",
         action="store_true",
         help="whether to run example.")
-    run.add_argument(
+    run_parent_parser.add_argument(
         "--quantize_stat",
         action="store_true",
         help="whether to stat quantization range.")
-    run.add_argument(
+    run_parent_parser.add_argument(
         "--input_dir",
         type=str,
         default="",
         help="quantize stat input dir.")
-    run.add_argument(
+    run_parent_parser.add_argument(
         "--output_dir",
         type=str,
         default="",
         help="quantize stat output dir.")
-    run.add_argument(
+    run_parent_parser.add_argument(
         "--cl_binary_to_code",
         action="store_true",
         help="convert OpenCL binaries to cpp.")
+    run_parent_parser.add_argument(
+        "--layers_log_dir",
+        type=str,
+        default="",
+        help="dir of the per-layer validation logs, the model dir if empty."
+             " Use with --layers flag.")
+    parser = argparse.ArgumentParser()
+    subparsers = parser.add_subparsers()
+    convert = subparsers.add_parser(
+        'convert',
+        parents=[all_type_parent_parser, convert_run_parent_parser],
+        help='convert to mace model (file or code)')
+    convert.add_argument(
+        "--cl_mem_type",
+        type=str,
+        default=None,
+        help="Which type of OpenCL memory type to use [image | buffer].")
+    convert.set_defaults(func=convert_func)
+    run = subparsers.add_parser(
+        'run',
+        parents=[all_type_parent_parser, run_bm_parent_parser,
+                 convert_run_parent_parser, run_parent_parser],
+        help='run model in command line')
+    run.set_defaults(func=run_mace)
     benchmark = subparsers.add_parser(
         'benchmark',
         parents=[all_type_parent_parser, run_bm_parent_parser],
@@ -1300,6 +1509,24 @@ def parse_args():
         type=float,
         default=10.0,
         help="max number of seconds to run.")
+    sweep = subparsers.add_parser(
+        'sweep',
+        parents=[all_type_parent_parser, run_bm_parent_parser,
+                 convert_run_parent_parser, run_parent_parser],
+        help='validate and run the model of every device and precision')
+    sweep.set_defaults(func=sweep_model, validate=True, report=True,
+                       layers="0:")
+    sweep.add_argument(
+        "--cl_mem_type",
+        type=str,
+        default=None,
+        help="Which type of OpenCL memory type to use [image | buffer].")
+    sweep.add_argument(
+        "--sweep_configs",
+        type=str,
+        default=",".join(SweepConfigNames),
+        help="configs to sweep, comma seperated list of "
+             + str(SweepConfigNames))
     return parser.parse_known_args()
 
 
@@ -565,6 +565,9 @@ class DeviceWrapper:
                                                      model_name,
                                                      flags.layers)
                     log_dir = mace_model_dir + "/" + runtime
+                    if flags.layers_log_dir:
+                        log_dir = "%s/%s/%s" % (flags.layers_log_dir,
+                                                self.device_name, runtime)
                     if os.path.exists(log_dir):
                         sh.rm('-rf', log_dir)
                     os.makedirs(log_dir)
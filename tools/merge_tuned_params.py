@@ -0,0 +1,111 @@
+# Copyright 2019 The MACE Authors. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Merges the OpenCL parameter files tuned by many runs, e.g. of the shapes
+# of a dynamic shape model or on the devices of a GPU family, into one file.
+# A key tuned to different parameters takes the most frequent ones, the
+# ones of the first file listed on a tie.
+#
+# python tools/merge_tuned_params.py \
+#     --input_files=run0/tuned_opencl_parameter,run1/tuned_opencl_parameter \
+#     --output_file=tuned_opencl_parameter
+
+import argparse
+import collections
+import struct
+import sys
+
+import six
+
+
+def read_tuned_params(path):
+    """Returns the list of (key, params) of a tuned parameter file."""
+    with open(path, "rb") as f:
+        data = f.read()
+    idx = 0
+    size, = struct.unpack("q", data[idx:idx + 8])
+    idx += 8
+    entries = []
+    for _ in six.moves.range(size):
+        key_size, = struct.unpack("i", data[idx:idx + 4])
+        idx += 4
+        key = data[idx:idx + key_size]
+        idx += key_size
+        params_size, = struct.unpack("i", data[idx:idx + 4])
+        idx += 4
+        params = struct.unpack(str(params_size // 4) + "I",
+                               data[idx:idx + params_size])
+        idx += params_size
+        entries.append((key, params))
+    return entries
+
+
+def write_tuned_params(entries, path):
+    with open(path, "wb") as f:
+        f.write(struct.pack("q", len(entries)))
+        for key, params in entries:
+            f.write(struct.pack("i", len(key)))
+            f.write(key)
+            f.write(struct.pack("i", len(params) * 4))
+            f.write(struct.pack(str(len(params)) + "I", *params))
+
+
+def merge_tuned_params(input_files):
+    votes = collections.OrderedDict()
+    for path in input_files:
+        for key, params in read_tuned_params(path):
+            votes.setdefault(key, collections.OrderedDict())
+            votes[key][params] = votes[key].get(params, 0) + 1
+    merged = []
+    conflicts = 0
+    for key, counts in six.iteritems(votes):
+        if len(counts) > 1:
+            conflicts += 1
+        # max keeps the first of the most frequent parameters
+        params = max(counts, key=lambda p: counts[p])
+        merged.append((key, params))
+    return merged, conflicts
+
+
+def parse_args():
+    """Parses command line arguments."""
+    parser = argparse.ArgumentParser()
+    parser.add_argument(
+        "--input_files",
+        type=str,
+        default="",
+        help="The tuned parameter files to merge, separated by ','.")
+    parser.add_argument(
+        "--output_file",
+        type=str,
+        default="tuned_opencl_parameter",
+        help="The merged tuned parameter file.")
+    return parser.parse_known_args()
+
+
+def main():
+    input_files = [f for f in FLAGS.input_files.split(",") if f]
+    if not input_files:
+        six.print_("No tuned parameter file to merge", file=sys.stderr)
+        sys.exit(1)
+    merged, conflicts = merge_tuned_params(input_files)
+    write_tuned_params(merged, FLAGS.output_file)
+    six.print_("Merged %d tuned parameters of %d files into %s, "
+               "%d of them tuned differently" %
+               (len(merged), len(input_files), FLAGS.output_file, conflicts))
+
+
+if __name__ == "__main__":
+    FLAGS, unparsed = parse_args()
+    main()
@@ -0,0 +1,161 @@
+# Copyright 2019 The MACE Authors. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Packs the OpenCL binaries and the tuned parameters built on many devices
+# into one package, loaded by GPUContextBuilder::SetOpenCLBinaryPackagePath,
+# of which each device uses the entry of its platform. The i-th parameter
+# file is tuned on the platform of the i-th binary file, an empty name skips
+# it. Binaries of the same platform are merged.
+#
+# python tools/pack_opencl_binaries.py \
+#     --binary_files=sdm845/compiled_opencl_kernel.bin,... \
+#     --parameter_files=sdm845/tuned_opencl_parameter.bin,... \
+#     --output_file=opencl_binary_package.bin
+
+import argparse
+import collections
+import struct
+import sys
+import zlib
+
+import six
+
+PLATFORM_INFO_KEY = b"mace_opencl_precompiled_platform_info_key"
+PACKAGE_MAGIC = b"MACECLPK"
+PACKAGE_VERSION = 1
+# of the versioned program cache written by FileStorage
+OPENCL_STORAGE_MAGIC = 0x0031564B4543414D
+OPENCL_STORAGE_VERSION = 1
+
+
+def parse_programs(data):
+    """Returns the ordered key-value pairs of an OpenCL program file, of
+    either the versioned format of the program cache or the unversioned
+    one of the precompiled binaries."""
+    kvs = collections.OrderedDict()
+    if len(data) >= 8 and \
+            struct.unpack("Q", data[0:8])[0] == OPENCL_STORAGE_MAGIC:
+        version, _, size = struct.unpack("IIQ", data[8:24])
+        if version != OPENCL_STORAGE_VERSION:
+            raise ValueError("Unsupported OpenCL cache version %d" % version)
+        idx = 24
+        for _ in six.moves.range(size):
+            key_size, value_size, _, crc = struct.unpack(
+                "IIII", data[idx:idx + 16])
+            idx += 16
+            key = data[idx:idx + key_size]
+            idx += key_size
+            value = data[idx:idx + value_size]
+            idx += value_size
+            if zlib.crc32(value, zlib.crc32(key)) & 0xffffffff != crc:
+                six.print_("Skip corrupted OpenCL program", key,
+                           file=sys.stderr)
+                continue
+            kvs[key] = value
+        return kvs
+
+    size, = struct.unpack("Q", data[0:8])
+    idx = 8
+    for _ in six.moves.range(size):
+        key_size, = struct.unpack("i", data[idx:idx + 4])
+        idx += 4
+        key = data[idx:idx + key_size]
+        idx += key_size
+        value_size, = struct.unpack("i", data[idx:idx + 4])
+        idx += 4
+        kvs[key] = data[idx:idx + value_size]
+        idx += value_size
+    return kvs
+
+
+def serialize_programs(kvs):
+    """The unversioned format of the precompiled binaries."""
+    data = bytearray(struct.pack("Q", len(kvs)))
+    for key, value in six.iteritems(kvs):
+        data.extend(struct.pack("i", len(key)))
+        data.extend(key)
+        data.extend(struct.pack("i", len(value)))
+        data.extend(value)
+    return bytes(data)
+
+
+def pack_opencl_binaries(binary_files, parameter_files, output_file):
+    programs = collections.OrderedDict()
+    parameters = {}
+    for i, binary_file in enumerate(binary_files):
+        with open(binary_file, "rb") as f:
+            kvs = parse_programs(f.read())
+        if PLATFORM_INFO_KEY not in kvs:
+            six.print_("Skip %s without platform info" % binary_file,
+                       file=sys.stderr)
+            continue
+        platform_info = kvs[PLATFORM_INFO_KEY]
+        programs.setdefault(platform_info, collections.OrderedDict())
+        programs[platform_info].update(kvs)
+        if i < len(parameter_files) and parameter_files[i]:
+            with open(parameter_files[i], "rb") as f:
+                parameters[platform_info] = f.read()
+        six.print_("Pack", binary_file, "of", platform_info.decode())
+
+    entries = [(platform_info, serialize_programs(kvs),
+                parameters.get(platform_info, b""))
+               for platform_info, kvs in six.iteritems(programs)]
+    index_size = len(PACKAGE_MAGIC) + 8
+    for platform_info, _, _ in entries:
+        index_size += 4 + len(platform_info) + 32
+    index = bytearray(PACKAGE_MAGIC)
+    index.extend(struct.pack("II", PACKAGE_VERSION, len(entries)))
+    offset = index_size
+    for platform_info, binary, parameter in entries:
+        index.extend(struct.pack("I", len(platform_info)))
+        index.extend(platform_info)
+        index.extend(struct.pack("QQQQ", offset, len(binary),
+                                 offset + len(binary), len(parameter)))
+        offset += len(binary) + len(parameter)
+    with open(output_file, "wb") as f:
+        f.write(bytes(index))
+        for _, binary, parameter in entries:
+            f.write(binary)
+            f.write(parameter)
+    six.print_("Packed %d platforms into %s" % (len(entries), output_file))
+
+
+def parse_args():
+    """Parses command line arguments."""
+    parser = argparse.ArgumentParser()
+    parser.add_argument(
+        "--binary_files",
+        type=str,
+        default="",
+        help="The OpenCL binary files, separated by ','.")
+    parser.add_argument(
+        "--parameter_files",
+        type=str,
+        default="",
+        help="The tuned OpenCL parameter files of the binary files, "
+             "separated by ','.")
+    parser.add_argument(
+        "--output_file",
+        type=str,
+        default="opencl_binary_package.bin",
+        help="The OpenCL binary package.")
+    return parser.parse_known_args()
+
+
+if __name__ == "__main__":
+    FLAGS, unparsed = parse_args()
+    pack_opencl_binaries(
+        [f for f in FLAGS.binary_files.split(",") if f],
+        FLAGS.parameter_files.split(",") if FLAGS.parameter_files else [],
+        FLAGS.output_file)
@@ -24,6 +24,7 @@ import struct
 import sys
 import time
 import platform
+import zlib
 
 import six
 
@@ -37,6 +38,7 @@ try:
     from generate_data import generate_input_data
     from validate import validate
     from mace_engine_factory_codegen import gen_mace_engine_factory
+    from selected_ops_codegen import gen_selected_ops, read_op_types
 except Exception as e:
     six.print_("Import error:\n%s" % e, file=sys.stderr)
     exit(1)
@@ -268,6 +270,7 @@ def bazel_build(target,
                 enable_neon=True,
                 enable_opencl=True,
                 enable_quantize=True,
+                selective_build=False,
                 address_sanitizer=False,
                 symbol_hidden=True,
                 extra_args=""):
@@ -298,6 +301,8 @@ def bazel_build(target,
             "quantize=%s" % str(enable_quantize).lower(),
             "--define",
             "hexagon=%s" % str(hexagon_mode).lower())
+    if selective_build:
+        bazel_args += ("--define", "selective_build=true")
     if address_sanitizer:
         bazel_args += ("--config", "asan")
     else:
@@ -344,6 +349,13 @@ def gen_encrypted_opencl_source(codegen_path="mace/codegen"):
                            "mace/codegen/opencl/opencl_encrypt_program.cc")
 
 
+def gen_selected_ops_source(ops_files, output_dir):
+    op_types = read_op_types(ops_files)
+    six.print_("* Selective build of ops %s" % ",".join(op_types))
+    gen_selected_ops(op_types, "mace/python/tools",
+                     "mace/ops/ops_registry.cc", output_dir)
+
+
 def gen_mace_engine_factory_source(model_tags,
                                    embed_model_data,
                                    codegen_path="mace/codegen"):
@@ -359,6 +371,52 @@ def gen_mace_engine_factory_source(model_tags,
     six.print_("Generate mace engine creator source done!\n")
 
 
+OPENCL_STORAGE_MAGIC = 0x0031564B4543414D
+OPENCL_STORAGE_VERSION = 1
+
+
+def parse_opencl_compiled_programs(binary_array):
+    """Parse the key-value pairs of the OpenCL program cache, of either the
+    versioned format written by FileStorage, whose entries are checked by
+    crc, or the unversioned format of the precompiled binaries."""
+    kvs = []
+    idx = 0
+    if len(binary_array) >= 8 and struct.unpack(
+            "Q", binary_array[0:8])[0] == OPENCL_STORAGE_MAGIC:
+        version, _, size = struct.unpack("IIQ", binary_array[8:24])
+        common.mace_check(version == OPENCL_STORAGE_VERSION, "",
+                          "Unsupported OpenCL cache version %d" % version)
+        idx = 24
+        for _ in six.moves.range(size):
+            key_size, value_size, _, crc = struct.unpack(
+                "IIII", binary_array[idx:idx + 16])
+            idx += 16
+            key = binary_array[idx:idx + key_size].tobytes()
+            idx += key_size
+            value = binary_array[idx:idx + value_size]
+            idx += value_size
+            if zlib.crc32(value.tobytes(), zlib.crc32(key)) & 0xffffffff \
+                    != crc:
+                six.print_("Skip corrupted OpenCL program", key)
+                continue
+            kvs.append((key, value))
+        return kvs
+
+    size, = struct.unpack("Q", binary_array[idx:idx + 8])
+    idx += 8
+    for _ in six.moves.range(size):
+        key_size, = struct.unpack("i", binary_array[idx:idx + 4])
+        idx += 4
+        key, = struct.unpack(
+            str(key_size) + "s", binary_array[idx:idx + key_size])
+        idx += key_size
+        value_size, = struct.unpack("i", binary_array[idx:idx + 4])
+        idx += 4
+        kvs.append((key, binary_array[idx:idx + value_size]))
+        idx += value_size
+    return kvs
+
+
 def merge_opencl_binaries(binaries_dirs,
                           cl_compiled_program_file_name,
                           output_file_path):
@@ -380,27 +438,15 @@ def merge_opencl_binaries(binaries_dirs,
         with open(binary_path, "rb") as f:
             binary_array = np.fromfile(f, dtype=np.uint8)
 
-        idx = 0
-        size, = struct.unpack("Q", binary_array[idx:idx + 8])
-        idx += 8
-        for _ in six.moves.range(size):
-            key_size, = struct.unpack("i", binary_array[idx:idx + 4])
-            idx += 4
-            key, = struct.unpack(
-                str(key_size) + "s", binary_array[idx:idx + key_size])
-            idx += key_size
-            value_size, = struct.unpack("i", binary_array[idx:idx + 4])
-            idx += 4
+        for key, value in parse_opencl_compiled_programs(binary_array):
             if key == platform_info_key and key in kvs:
                 common.mace_check(
-                    (kvs[key] == binary_array[idx:idx + value_size]).all(),
+                    (kvs[key] == value).all(),
                     "",
                     "There exists more than one OpenCL version for models:"
-                    " %s vs %s " %
-                    (kvs[key], binary_array[idx:idx + value_size]))
+                    " %s vs %s " % (kvs[key], value))
             else:
-                kvs[key] = binary_array[idx:idx + value_size]
-            idx += value_size
+                kvs[key] = value
 
     output_byte_array = bytearray()
     data_size = len(kvs)
@@ -486,12 +532,19 @@ def gen_model_code(model_codegen_dir,
                    winograd,
                    quantize,
                    quantize_range_file,
+                   quantize_per_channel,
+                   quantize_embedding,
+                   palettize_weights,
+                   weight_only_quantize,
+                   quantize_8x16,
                    change_concat_ranges,
                    obfuscate,
                    model_graph_format,
                    data_type,
                    cl_mem_type,
-                   graph_optimize_options):
+                   graph_optimize_options,
+                   fp32_ops,
+                   aot):
     bazel_build_common("//mace/python/tools:converter")
 
     if os.path.exists(model_codegen_dir):
@@ -522,6 +575,11 @@ def gen_model_code(model_codegen_dir,
               "--winograd=%s" % winograd,
               "--quantize=%s" % quantize,
               "--quantize_range_file=%s" % quantize_range_file,
+              "--quantize_per_channel=%s" % quantize_per_channel,
+              "--quantize_embedding=%s" % quantize_embedding,
+              "--palettize_weights=%s" % palettize_weights,
+              "--weight_only_quantize=%s" % weight_only_quantize,
+              "--quantize_8x16=%s" % quantize_8x16,
               "--change_concat_ranges=%s" % change_concat_ranges,
               "--obfuscate=%s" % obfuscate,
               "--output_dir=%s" % model_codegen_dir,
@@ -529,6 +587,8 @@ def gen_model_code(model_codegen_dir,
               "--data_type=%s" % data_type,
               "--graph_optimize_options=%s" % graph_optimize_options,
               "--cl_mem_type=%s" % cl_mem_type,
+              "--fp32_ops=%s" % fp32_ops,
+              "--aot=%s" % aot,
               _fg=True)
 
 